@@ -0,0 +1,658 @@
+/**
+ * 7z FFI SDK benchmark
+ *
+ * Runs every create, extract, list and test path of the library over
+ * generated corpora and reports, per operation, throughput (uncompressed
+ * MB/s), peak resident memory and CPU utilization (CPU time / wall time,
+ * so 200% means two cores busy on average).
+ *
+ * Corpora:
+ *   small   many 4KB text files in subdirectories
+ *   huge    a few large files of mixed text and binary records
+ *   random  one incompressible file
+ *   text    one file of word-like text
+ *   sparse  one file that is mostly holes, with scattered data blocks
+ *
+ * Each corpus is generated under the work directory with a fixed seed,
+ * so runs on the same machine compare directly. Existing data can be
+ * benchmarked with --input instead.
+ */
+
+#include "7z_ffi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+    #include <direct.h>
+    #define MKDIR(path) _mkdir(path)
+    #define FSEEK64 _fseeki64
+#else
+    #include <sys/types.h>
+    #include <sys/time.h>
+    #include <sys/resource.h>
+    #include <dirent.h>
+    #include <time.h>
+    #define MKDIR(path) mkdir(path, 0755)
+    #define FSEEK64 fseeko
+#endif
+
+#define MB (1024.0 * 1024.0)
+#define SMALL_FILE_SIZE 4096
+#define SMALL_FILES_PER_DIR 1000
+#define HUGE_FILE_COUNT 3
+#define SPARSE_DATA_EVERY (16u << 20)
+#define SPARSE_DATA_SIZE (256u << 10)
+#define GEN_BUF_SIZE (1u << 20)
+
+/* ============================================================================
+ * Measurement
+ * ============================================================================ */
+
+static double wall_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/* User plus system time of all threads of the process */
+static double cpu_seconds(void) {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (double)(k.QuadPart + u.QuadPart) / 1e7;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0.0;
+    return (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6 +
+           (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+/*
+ * Peak RSS is reset before each operation where the system allows it
+ * (Linux clear_refs). Elsewhere it is the process peak so far, which is
+ * still exact for the first operation that reaches a new high.
+ */
+static int peak_rss_resettable = 0;
+
+static void reset_peak_rss(void) {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        peak_rss_resettable = fputs("5", f) >= 0;
+        if (fclose(f) != 0) peak_rss_resettable = 0;
+    }
+#endif
+}
+
+static uint64_t peak_rss_bytes(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return (uint64_t)pmc.PeakWorkingSetSize;
+#else
+    #ifdef __linux__
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+        }
+        fclose(f);
+        if (kb) return (uint64_t)kb * 1024;
+    }
+    #endif
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    #ifdef __APPLE__
+    return (uint64_t)ru.ru_maxrss;          /* Bytes on macOS */
+    #else
+    return (uint64_t)ru.ru_maxrss * 1024;   /* Kilobytes elsewhere */
+    #endif
+#endif
+}
+
+/* ============================================================================
+ * Corpus generation
+ * ============================================================================ */
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static void fill_random(unsigned char* buf, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v = rng_next();
+        memcpy(buf + i, &v, 8);
+    }
+    if (i < size) {
+        uint64_t v = rng_next();
+        memcpy(buf + i, &v, size - i);
+    }
+}
+
+static const char* const words[] = {
+    "archive", "stream", "block", "folder", "volume", "header", "entry",
+    "the", "of", "and", "to", "in", "is", "for", "with", "data", "file",
+    "compress", "extract", "dictionary", "match", "literal", "offset",
+    "length", "window", "thread", "buffer", "index", "size", "checksum"
+};
+
+/* Word-like text with line breaks: compresses about as well as prose */
+static void fill_text(unsigned char* buf, size_t size) {
+    size_t pos = 0, line = 0;
+    while (pos < size) {
+        uint64_t r = rng_next();
+        const char* w = words[r % (sizeof(words) / sizeof(words[0]))];
+        size_t n = strlen(w);
+        for (size_t i = 0; i < n && pos < size; i++) buf[pos++] = (unsigned char)w[i];
+        line += n + 1;
+        if (pos < size) {
+            buf[pos++] = line > 72 ? '\n' : ' ';
+            if (line > 72) line = 0;
+        }
+    }
+}
+
+/* Text with a binary record every 64KB, like logs with embedded blobs */
+static void fill_mixed(unsigned char* buf, size_t size) {
+    fill_text(buf, size);
+    for (size_t pos = 0; pos + 4096 <= size; pos += 65536) {
+        fill_random(buf + pos, 4096);
+    }
+}
+
+static int write_file(const char* path, uint64_t size, void (*fill)(unsigned char*, size_t),
+                      unsigned char* buf) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+    uint64_t done = 0;
+    while (done < size) {
+        size_t n = size - done < GEN_BUF_SIZE ? (size_t)(size - done) : GEN_BUF_SIZE;
+        fill(buf, n);
+        if (fwrite(buf, 1, n, f) != n) {
+            fclose(f);
+            return 0;
+        }
+        done += n;
+    }
+    return fclose(f) == 0;
+}
+
+static int gen_small(const char* dir, uint64_t size, unsigned char* buf) {
+    uint64_t count = size / SMALL_FILE_SIZE;
+    char path[1024];
+    if (count == 0) count = 1;
+    for (uint64_t i = 0; i < count; i++) {
+        if (i % SMALL_FILES_PER_DIR == 0) {
+            snprintf(path, sizeof(path), "%s/d%03llu", dir,
+                     (unsigned long long)(i / SMALL_FILES_PER_DIR));
+            MKDIR(path);
+        }
+        snprintf(path, sizeof(path), "%s/d%03llu/f%06llu.txt", dir,
+                 (unsigned long long)(i / SMALL_FILES_PER_DIR), (unsigned long long)i);
+        if (!write_file(path, SMALL_FILE_SIZE, fill_text, buf)) return 0;
+    }
+    return 1;
+}
+
+static int gen_huge(const char* dir, uint64_t size, unsigned char* buf) {
+    char path[1024];
+    for (int i = 0; i < HUGE_FILE_COUNT; i++) {
+        snprintf(path, sizeof(path), "%s/huge%d.bin", dir, i);
+        if (!write_file(path, size / HUGE_FILE_COUNT, fill_mixed, buf)) return 0;
+    }
+    return 1;
+}
+
+static int gen_random(const char* dir, uint64_t size, unsigned char* buf) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/random.bin", dir);
+    return write_file(path, size, fill_random, buf);
+}
+
+static int gen_text(const char* dir, uint64_t size, unsigned char* buf) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/text.txt", dir);
+    return write_file(path, size, fill_text, buf);
+}
+
+/* Data blocks are written at intervals; the gaps are never written */
+static int gen_sparse(const char* dir, uint64_t size, unsigned char* buf) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/sparse.img", dir);
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+    int ok = 1;
+    for (uint64_t pos = 0; ok && pos + SPARSE_DATA_SIZE <= size; pos += SPARSE_DATA_EVERY) {
+        fill_mixed(buf, SPARSE_DATA_SIZE);
+        ok = FSEEK64(f, (int64_t)pos, SEEK_SET) == 0 &&
+             fwrite(buf, 1, SPARSE_DATA_SIZE, f) == SPARSE_DATA_SIZE;
+    }
+    if (ok && size > 0) {
+        /* Last byte sets the file size */
+        ok = FSEEK64(f, (int64_t)(size - 1), SEEK_SET) == 0 && fputc(0, f) != EOF;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+typedef struct {
+    const char* name;
+    int (*generate)(const char* dir, uint64_t size, unsigned char* buf);
+} Corpus;
+
+static const Corpus corpora[] = {
+    { "small",  gen_small },
+    { "huge",   gen_huge },
+    { "random", gen_random },
+    { "text",   gen_text },
+    { "sparse", gen_sparse },
+};
+
+#define CORPUS_COUNT (sizeof(corpora) / sizeof(corpora[0]))
+
+/* ============================================================================
+ * Operations
+ * ============================================================================ */
+
+typedef struct {
+    const char* input;          /* Corpus directory or --input path */
+    uint64_t input_size;        /* Uncompressed bytes */
+    SevenZipCompressionLevel level;
+    int threads;
+    uint64_t split_size;
+    char archive[1024];         /* sevenzip_create_7z() output */
+    char split_archive[1024];   /* Multi-volume base name */
+    char stream_archive[1024];
+    char true_stream_archive[1024];
+    char extract_dir[1024];
+    char split_extract_dir[1024];
+    uint64_t packed_size;       /* Archive bytes written by the last create */
+} BenchContext;
+
+static uint64_t file_size(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+/* Bytes of an archive, or of all its volumes (.001, .002, ...) */
+static uint64_t archive_size(const char* path) {
+    char volume[1100];
+    uint64_t total = file_size(path);
+    for (int i = 1; i < 10000; i++) {
+        snprintf(volume, sizeof(volume), "%s.%03d", path, i);
+        uint64_t n = file_size(volume);
+        if (n == 0) break;
+        total += n;
+    }
+    return total;
+}
+
+static void compress_options(const BenchContext* ctx, SevenZipCompressOptions* opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->num_threads = ctx->threads;
+    opts->solid = 1;
+}
+
+static void stream_options(const BenchContext* ctx, SevenZipStreamOptions* opts) {
+    sevenzip_stream_options_init(opts);
+    if (ctx->threads > 0) opts->num_threads = ctx->threads;
+}
+
+static void extract_options(const BenchContext* ctx, SevenZipExtractOptions* opts) {
+    sevenzip_extract_options_init(opts);
+    if (ctx->threads > 0) opts->num_threads = ctx->threads;
+}
+
+static SevenZipErrorCode op_create_7z(BenchContext* ctx) {
+    SevenZipCompressOptions opts;
+    const char* inputs[] = { ctx->input, NULL };
+    compress_options(ctx, &opts);
+    remove(ctx->archive);
+    SevenZipErrorCode err = sevenzip_create_7z(ctx->archive, inputs, ctx->level, &opts, NULL, NULL);
+    ctx->packed_size = archive_size(ctx->archive);
+    return err;
+}
+
+static SevenZipErrorCode op_create_streaming(BenchContext* ctx) {
+    SevenZipStreamOptions opts;
+    const char* inputs[] = { ctx->input, NULL };
+    stream_options(ctx, &opts);
+    remove(ctx->stream_archive);
+    SevenZipErrorCode err = sevenzip_create_7z_streaming(
+        ctx->stream_archive, inputs, ctx->level, &opts, NULL, NULL);
+    ctx->packed_size = archive_size(ctx->stream_archive);
+    return err;
+}
+
+static SevenZipErrorCode op_create_true_streaming(BenchContext* ctx) {
+    SevenZipStreamOptions opts;
+    const char* inputs[] = { ctx->input, NULL };
+    stream_options(ctx, &opts);
+    remove(ctx->true_stream_archive);
+    SevenZipErrorCode err = sevenzip_create_7z_true_streaming(
+        ctx->true_stream_archive, inputs, ctx->level, &opts, NULL, NULL);
+    ctx->packed_size = archive_size(ctx->true_stream_archive);
+    return err;
+}
+
+/* Splitting streaming creation is the multi-volume writer */
+static SevenZipErrorCode op_create_multivolume(BenchContext* ctx) {
+    SevenZipStreamOptions opts;
+    const char* inputs[] = { ctx->input, NULL };
+    stream_options(ctx, &opts);
+    opts.split_size = ctx->split_size;
+    SevenZipErrorCode err = sevenzip_create_7z_streaming(
+        ctx->split_archive, inputs, ctx->level, &opts, NULL, NULL);
+    ctx->packed_size = archive_size(ctx->split_archive);
+    return err;
+}
+
+static SevenZipErrorCode op_extract(BenchContext* ctx) {
+    SevenZipExtractOptions opts;
+    extract_options(ctx, &opts);
+    return sevenzip_extract_with_options(ctx->archive, ctx->extract_dir, NULL, &opts, NULL, NULL);
+}
+
+static SevenZipErrorCode op_extract_split(BenchContext* ctx) {
+    SevenZipExtractOptions opts;
+    char first[1100];
+    extract_options(ctx, &opts);
+    /* Inputs that fit one volume are written as a plain archive */
+    snprintf(first, sizeof(first), "%s.001", ctx->split_archive);
+    const char* path = file_size(first) ? first : ctx->split_archive;
+    return sevenzip_extract_streaming_with_options(
+        path, ctx->split_extract_dir, NULL, &opts, NULL, NULL);
+}
+
+static SevenZipErrorCode op_list(BenchContext* ctx) {
+    SevenZipList* list = NULL;
+    SevenZipErrorCode err = sevenzip_list(ctx->archive, NULL, &list);
+    if (list) sevenzip_free_list(list);
+    return err;
+}
+
+static SevenZipErrorCode op_test(BenchContext* ctx) {
+    SevenZipExtractOptions opts;
+    extract_options(ctx, &opts);
+    return sevenzip_test_archive_with_options(ctx->archive, NULL, &opts, NULL, NULL);
+}
+
+typedef struct {
+    const char* name;
+    SevenZipErrorCode (*run)(BenchContext* ctx);
+    int creates;                /* Report the compression ratio */
+} Operation;
+
+/* Creates come first: extraction, list and test read their archives */
+static const Operation operations[] = {
+    { "create_7z",             op_create_7z,             1 },
+    { "create_streaming",      op_create_streaming,      1 },
+    { "create_true_streaming", op_create_true_streaming, 1 },
+    { "create_multivolume",    op_create_multivolume,    1 },
+    { "extract",               op_extract,               0 },
+    { "extract_split",         op_extract_split,         0 },
+    { "list",                  op_list,                  0 },
+    { "test",                  op_test,                  0 },
+};
+
+#define OPERATION_COUNT (sizeof(operations) / sizeof(operations[0]))
+
+/* ============================================================================
+ * Driver
+ * ============================================================================ */
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options]\n\n", prog);
+    printf("Options:\n");
+    printf("  -c, --corpus NAMES  Comma-separated corpora: small,huge,random,text,sparse\n");
+    printf("                      or all (default: all)\n");
+    printf("  -i, --input PATH    Benchmark an existing file or directory instead\n");
+    printf("  -s, --size MB       Uncompressed size of each generated corpus (default: 64)\n");
+    printf("  -l, --level N       Compression level 0-9 (default: 5)\n");
+    printf("  -t, --threads N     Threads for every operation (default: 0 = library default)\n");
+    printf("  -v, --split MB      Volume size for the multi-volume paths (default: size / 4)\n");
+    printf("  -w, --work DIR      Directory for corpora, archives and output (default: bench_work)\n");
+    printf("      --csv           Print comma-separated values instead of a table\n");
+    printf("  -h, --help          Show this help\n");
+}
+
+static int corpus_selected(const char* list, const char* name) {
+    if (strcmp(list, "all") == 0) return 1;
+    size_t n = strlen(name);
+    for (const char* p = list; (p = strstr(p, name)) != NULL; p += n) {
+        int starts = p == list || p[-1] == ',';
+        int ends = p[n] == '\0' || p[n] == ',';
+        if (starts && ends) return 1;
+    }
+    return 0;
+}
+
+/* Total bytes of regular files under a path */
+#ifdef _WIN32
+static uint64_t tree_size(const char* path) {
+    char pattern[1100];
+    WIN32_FIND_DATAA fd;
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    if (!(st.st_mode & _S_IFDIR)) return (uint64_t)st.st_size;
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    HANDLE h = FindFirstFileA(pattern, &fd);
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    uint64_t total = 0;
+    do {
+        if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+        char child[1100];
+        snprintf(child, sizeof(child), "%s\\%s", path, fd.cFileName);
+        total += tree_size(child);
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+    return total;
+}
+#else
+static uint64_t tree_size(const char* path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return 0;
+    if (!S_ISDIR(st.st_mode)) return S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0;
+    DIR* d = opendir(path);
+    if (!d) return 0;
+    uint64_t total = 0;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char child[1100];
+        snprintf(child, sizeof(child), "%s/%s", path, e->d_name);
+        total += tree_size(child);
+    }
+    closedir(d);
+    return total;
+}
+#endif
+
+static int run_corpus(const char* label, BenchContext* ctx, int csv) {
+    int failures = 0;
+    if (!csv) {
+        printf("\nCorpus: %s (%.1f MB)\n", label, ctx->input_size / MB);
+        printf("%-22s %10s %10s %12s %8s %8s\n",
+               "Operation", "MB/s", "Seconds", "Peak RSS MB", "CPU %", "Ratio");
+        printf("--------------------------------------------------------------------------\n");
+    }
+
+    for (size_t i = 0; i < OPERATION_COUNT; i++) {
+        const Operation* op = &operations[i];
+        reset_peak_rss();
+        double cpu0 = cpu_seconds();
+        double t0 = wall_seconds();
+        SevenZipErrorCode err = op->run(ctx);
+        double wall = wall_seconds() - t0;
+        double cpu = cpu_seconds() - cpu0;
+        uint64_t rss = peak_rss_bytes();
+
+        if (err != SEVENZIP_OK) {
+            failures++;
+            if (csv) {
+                printf("%s,%s,error,%d\n", label, op->name, (int)err);
+            } else {
+                printf("%-22s failed: %s\n", op->name, sevenzip_get_error_message(err));
+            }
+            continue;
+        }
+
+        double rate = wall > 0 ? ctx->input_size / MB / wall : 0.0;
+        double util = wall > 0 ? 100.0 * cpu / wall : 0.0;
+        double ratio = op->creates && ctx->input_size
+                           ? (double)ctx->packed_size / (double)ctx->input_size : 0.0;
+        if (csv) {
+            printf("%s,%s,%.2f,%.3f,%.1f,%.1f,%.4f\n",
+                   label, op->name, rate, wall, rss / MB, util, ratio);
+        } else if (op->creates) {
+            printf("%-22s %10.2f %10.3f %12.1f %8.1f %8.3f\n",
+                   op->name, rate, wall, rss / MB, util, ratio);
+        } else {
+            printf("%-22s %10.2f %10.3f %12.1f %8.1f %8s\n",
+                   op->name, rate, wall, rss / MB, util, "-");
+        }
+        fflush(stdout);
+    }
+    return failures;
+}
+
+static void set_paths(BenchContext* ctx, const char* dir) {
+    snprintf(ctx->archive, sizeof(ctx->archive), "%s/bench.7z", dir);
+    snprintf(ctx->stream_archive, sizeof(ctx->stream_archive), "%s/bench_stream.7z", dir);
+    snprintf(ctx->true_stream_archive, sizeof(ctx->true_stream_archive), "%s/bench_true_stream.7z", dir);
+    snprintf(ctx->split_archive, sizeof(ctx->split_archive), "%s/bench_split.7z", dir);
+    snprintf(ctx->extract_dir, sizeof(ctx->extract_dir), "%s/out", dir);
+    snprintf(ctx->split_extract_dir, sizeof(ctx->split_extract_dir), "%s/out_split", dir);
+    MKDIR(ctx->extract_dir);
+    MKDIR(ctx->split_extract_dir);
+}
+
+int main(int argc, char* argv[]) {
+    const char* corpus_list = "all";
+    const char* input = NULL;
+    const char* work = "bench_work";
+    uint64_t size_mb = 64, split_mb = 0;
+    int level = SEVENZIP_LEVEL_NORMAL, threads = 0, csv = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(a, "--csv") == 0) {
+            csv = 1;
+        } else if (has_value && (strcmp(a, "-c") == 0 || strcmp(a, "--corpus") == 0)) {
+            corpus_list = argv[++i];
+        } else if (has_value && (strcmp(a, "-i") == 0 || strcmp(a, "--input") == 0)) {
+            input = argv[++i];
+        } else if (has_value && (strcmp(a, "-s") == 0 || strcmp(a, "--size") == 0)) {
+            size_mb = strtoull(argv[++i], NULL, 10);
+        } else if (has_value && (strcmp(a, "-l") == 0 || strcmp(a, "--level") == 0)) {
+            level = atoi(argv[++i]);
+        } else if (has_value && (strcmp(a, "-t") == 0 || strcmp(a, "--threads") == 0)) {
+            threads = atoi(argv[++i]);
+        } else if (has_value && (strcmp(a, "-v") == 0 || strcmp(a, "--split") == 0)) {
+            split_mb = strtoull(argv[++i], NULL, 10);
+        } else if (has_value && (strcmp(a, "-w") == 0 || strcmp(a, "--work") == 0)) {
+            work = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", a);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (level < 0 || level > 9 || size_mb == 0) {
+        fprintf(stderr, "Invalid level or size\n");
+        return 1;
+    }
+
+    SevenZipErrorCode result = sevenzip_init();
+    if (result != SEVENZIP_OK) {
+        fprintf(stderr, "Failed to initialize: %s\n", sevenzip_get_error_message(result));
+        return 1;
+    }
+
+    BenchContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.level = (SevenZipCompressionLevel)level;
+    ctx.threads = threads;
+    MKDIR(work);
+
+    if (csv) {
+        printf("corpus,operation,mb_per_s,seconds,peak_rss_mb,cpu_percent,ratio\n");
+    } else {
+        printf("7z FFI SDK v%s benchmark: level %d, threads %d%s\n",
+               sevenzip_get_version(), level, threads,
+               threads == 0 ? " (library default)" : "");
+    }
+
+    int failures = 0;
+    if (input) {
+        ctx.input = input;
+        ctx.input_size = tree_size(input);
+        ctx.split_size = split_mb ? split_mb << 20 : (ctx.input_size / 4 > 0 ? ctx.input_size / 4 : 1 << 20);
+        set_paths(&ctx, work);
+        failures += run_corpus(input, &ctx, csv);
+    } else {
+        unsigned char* buf = (unsigned char*)malloc(GEN_BUF_SIZE);
+        if (!buf) {
+            sevenzip_cleanup();
+            return 1;
+        }
+        uint64_t size = size_mb << 20;
+        for (size_t c = 0; c < CORPUS_COUNT; c++) {
+            char dir[1024], data[1100];
+            if (!corpus_selected(corpus_list, corpora[c].name)) continue;
+            snprintf(dir, sizeof(dir), "%s/%s", work, corpora[c].name);
+            snprintf(data, sizeof(data), "%s/data", dir);
+            MKDIR(dir);
+            MKDIR(data);
+            rng_state = 0x9E3779B97F4A7C15ULL + c;
+            if (!corpora[c].generate(data, size, buf)) {
+                fprintf(stderr, "Failed to generate corpus %s in %s\n", corpora[c].name, data);
+                failures++;
+                continue;
+            }
+            ctx.input = data;
+            ctx.input_size = tree_size(data);
+            ctx.split_size = split_mb ? split_mb << 20 : size / 4;
+            set_paths(&ctx, dir);
+            failures += run_corpus(corpora[c].name, &ctx, csv);
+        }
+        free(buf);
+    }
+
+    if (!csv && !peak_rss_resettable) {
+        printf("\nPeak RSS is the process peak up to each operation on this system.\n");
+    }
+
+    sevenzip_cleanup();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * 7z FFI SDK kernel microbenchmark
+ *
+ * Times every version of the CRC-32, AES-CBC, SHA-256 and match finder
+ * kernels this host can run (sevenzip_kernel_variants()), each called
+ * directly, and marks the one runtime dispatch picked. Throughput is
+ * GB/s (10^9 bytes) of input.
+ *
+ * CRC, AES and SHA-256 run over a buffer that stays in cache (1MB by
+ * default), so the figure is the kernel's, not the memory's. The match
+ * finder runs over 4MB of generated data with matches at all distances.
+ * Each variant repeats until --seconds have passed.
+ *
+ * --json prints one object for tracking across hosts:
+ *   {"arch": "x86_64", "seconds": 0.5, "variants": [
+ *     {"kernel": "crc32", "variant": "slice8", "in_use": true, "gbps": 2.71}, ...]}
+ */
+
+#include "7z_ffi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <malloc.h>
+#else
+    #include <time.h>
+#endif
+
+#define MB (1024 * 1024)
+#define MATCH_FINDER_SIZE (4 * MB)
+
+static double wall_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+static void* alloc_aligned(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, 64);
+#else
+    void* p = NULL;
+    return posix_memalign(&p, 64, size) == 0 ? p : NULL;
+#endif
+}
+
+static void free_aligned(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+/* Literal runs and copies at short and long distances */
+static void fill_matches(unsigned char* buf, size_t size) {
+    uint32_t x = 0x9E3779B9;
+    size_t pos = 0;
+    while (pos < size) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        if (pos < 256 || (x & 3) == 0) {
+            size_t len = 1 + ((x >> 2) & 31);
+            for (size_t i = 0; i < len && pos < size; i++) {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                buf[pos++] = (unsigned char)(x >> 24);
+            }
+        } else {
+            size_t span = (size_t)1 << (8 + ((x >> 2) & 7) * 2);
+            if (span > pos) span = pos;
+            size_t dist = 1 + (size_t)((x >> 8) % span);
+            size_t len = 2 + ((x >> 26) & 31);
+            for (size_t i = 0; i < len && pos < size; i++, pos++) {
+                buf[pos] = buf[pos - dist];
+            }
+        }
+    }
+}
+
+static const char* kernel_name(SevenZipKernel kernel) {
+    switch (kernel) {
+        case SEVENZIP_KERNEL_CRC32: return "crc32";
+        case SEVENZIP_KERNEL_AES_CBC_ENCODE: return "aes_cbc_encode";
+        case SEVENZIP_KERNEL_AES_CBC_DECODE: return "aes_cbc_decode";
+        case SEVENZIP_KERNEL_SHA256: return "sha256";
+        case SEVENZIP_KERNEL_MATCH_FINDER: return "match_finder";
+    }
+    return "unknown";
+}
+
+static const char* arch_name(void) {
+#if defined(__x86_64__) || defined(_M_X64)
+    return "x86_64";
+#elif defined(__i386__) || defined(_M_IX86)
+    return "x86";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    return "aarch64";
+#elif defined(__arm__) || defined(_M_ARM)
+    return "arm";
+#else
+    return "other";
+#endif
+}
+
+/* GB/s of one variant, or a negative value if it failed */
+static double time_variant(size_t index, void* data, size_t size, double seconds) {
+    uint32_t check = 0, sum = 0;
+    if (sevenzip_kernel_run(index, data, size, &check) != SEVENZIP_OK) return -1.0;  /* Warm-up */
+    uint64_t bytes = 0;
+    double start = wall_seconds(), elapsed;
+    do {
+        if (sevenzip_kernel_run(index, data, size, &check) != SEVENZIP_OK) return -1.0;
+        sum += check;
+        bytes += size;
+        elapsed = wall_seconds() - start;
+    } while (elapsed < seconds);
+    if (sum == 0x12345678u) fputc(' ', stderr);  /* Keeps the results live */
+    return (double)bytes / 1e9 / elapsed;
+}
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --json             Print JSON instead of a table\n");
+    printf("  -s, --size KB      Buffer of the CRC, AES and SHA-256 runs (default: 1024)\n");
+    printf("  -t, --seconds S    Least time per variant (default: 0.5)\n");
+}
+
+int main(int argc, char* argv[]) {
+    int json = 0;
+    size_t size_kb = 1024;
+    double seconds = 0.5;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (strcmp(a, "--json") == 0) {
+            json = 1;
+        } else if (has_value && (strcmp(a, "-s") == 0 || strcmp(a, "--size") == 0)) {
+            size_kb = (size_t)strtoull(argv[++i], NULL, 10);
+        } else if (has_value && (strcmp(a, "-t") == 0 || strcmp(a, "--seconds") == 0)) {
+            seconds = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", a);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (size_kb == 0 || seconds <= 0) {
+        fprintf(stderr, "Invalid size or time\n");
+        return 1;
+    }
+
+    SevenZipKernelVariant variants[SEVENZIP_MAX_KERNEL_VARIANTS];
+    size_t count = sevenzip_kernel_variants(variants, SEVENZIP_MAX_KERNEL_VARIANTS);
+    if (count > SEVENZIP_MAX_KERNEL_VARIANTS) count = SEVENZIP_MAX_KERNEL_VARIANTS;
+
+    size_t size = size_kb * 1024;
+    unsigned char* buf = (unsigned char*)alloc_aligned(size);
+    unsigned char* text = (unsigned char*)alloc_aligned(MATCH_FINDER_SIZE);
+    if (!buf || !text) {
+        fprintf(stderr, "Out of memory\n");
+        free_aligned(buf);
+        free_aligned(text);
+        return 1;
+    }
+    for (size_t i = 0; i < size; i++) buf[i] = (unsigned char)(i * 131 + (i >> 9));
+    fill_matches(text, MATCH_FINDER_SIZE);
+
+    if (json) {
+        printf("{\"arch\": \"%s\", \"seconds\": %g, \"variants\": [", arch_name(), seconds);
+    } else {
+        printf("%-16s %-14s %6s %10s\n", "kernel", "variant", "in use", "GB/s");
+    }
+    int failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        int mf = variants[i].kernel == SEVENZIP_KERNEL_MATCH_FINDER;
+        double gbps = time_variant(i, mf ? text : buf, mf ? MATCH_FINDER_SIZE : size, seconds);
+        if (gbps < 0) failed = 1;
+        if (json) {
+            printf("%s\n  {\"kernel\": \"%s\", \"variant\": \"%s\", \"in_use\": %s, \"gbps\": %.4f}",
+                   i ? "," : "", kernel_name(variants[i].kernel), variants[i].name,
+                   variants[i].in_use ? "true" : "false", gbps);
+        } else {
+            printf("%-16s %-14s %6s %10.3f\n", kernel_name(variants[i].kernel), variants[i].name,
+                   variants[i].in_use ? "*" : "", gbps);
+        }
+        fflush(stdout);
+    }
+    if (json) printf("\n]}\n");
+
+    free_aligned(buf);
+    free_aligned(text);
+    return failed;
+}
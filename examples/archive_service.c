@@ -0,0 +1,53 @@
+#include "7z_ffi.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Archive service daemon: serves sevenzip_service_*() clients on a Unix
+ * socket until SIGINT or SIGTERM, sharing one job queue, thread quota,
+ * key cache and set of open archives between them.
+ */
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <socket path> [max threads] [max jobs]\n", argv[0]);
+        return 1;
+    }
+
+    /* Host-wide caps: every client's work runs inside these */
+    SevenZipInitOptions init = {0};
+    if (argc > 2) init.max_threads = atoi(argv[2]);
+    if (argc > 3) init.max_jobs = atoi(argv[3]);
+    SevenZipErrorCode result = sevenzip_init_with_options(&init);
+    if (result != SEVENZIP_OK) {
+        fprintf(stderr, "Failed to initialize: %s\n", sevenzip_get_error_message(result));
+        return 1;
+    }
+
+    SevenZipService* service = NULL;
+    result = sevenzip_service_start(argv[1], NULL, &service);
+    if (result != SEVENZIP_OK) {
+        fprintf(stderr, "Failed to start service: %s\n", sevenzip_get_error_message(result));
+        sevenzip_cleanup();
+        return 1;
+    }
+    printf("Serving on %s\n", argv[1]);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    while (!g_stop) pause();
+
+    printf("Stopping\n");
+    sevenzip_service_stop(service);
+    sevenzip_cleanup();
+    return 0;
+}
@@ -8,6 +8,7 @@
  * - Byte-level progress tracking
  * - Multi-threading support
  * - Encryption support (when enabled)
+ * - SHA-256 (or XXH3-128) manifest of the evidence, hashed in the compression read pass
  */
 
 #include <stdio.h>
@@ -25,10 +26,14 @@
 /* Global flag for interrupt handling */
 static volatile int interrupted = 0;
 
+/* Stops a running compression; cancelling is safe from a signal handler */
+static SevenZipCancelToken* cancel_token = NULL;
+
 /* Signal handler for graceful interruption */
 static void signal_handler(int sig) {
     printf("\n\nInterrupted! Saving checkpoint...\n");
     interrupted = 1;
+    sevenzip_cancel_token_cancel(cancel_token);
 }
 
 /* Secure password prompting (no echo) */
@@ -203,7 +208,13 @@ static void print_usage(const char* program) {
     printf("  --chunk <size>        Chunk size for streaming (default: 64m)\n");
     printf("  --threads <num>       Number of threads (default: 2, 0=auto)\n");
     printf("  --password [pass]     Encrypt with password (prompts if not provided)\n");
-    printf("  --resume              Enable resume capability\n");
+    printf("  --resume              Keep a checkpoint so split jobs can be resumed\n");
+    printf("  --manifest <file>     Write the SHA-256 of every file (sha256sum format),\n");
+    printf("                        computed while compressing; not with resume\n");
+    printf("  --xxh3                Manifest holds XXH3-128 instead (xxhsum format), for\n");
+    printf("                        cheap change checks between runs\n");
+    printf("  --incremental <file>  Leave out files unchanged since the snapshot in <file>\n");
+    printf("                        (size, mtime, inode) and update it; not with resume\n");
     printf("\n");
     
     printf("Examples:\n");
@@ -216,6 +227,18 @@ static void print_usage(const char* program) {
     printf("  # Compress 82GB forensic images with optimal settings:\n");
     printf("  %s compress case1827.7z /evidence --split 8589934592 --level 5 --threads 8 --resume\n\n", program);
     
+    printf("  # Image a drive straight into 8GB volumes, no dd image first (not with resume):\n");
+    printf("  %s compress disk.7z /dev/sdb --split 8g --manifest disk.sha256\n\n", program);
+    
+    printf("  # Compress and hash evidence in one pass (check with sha256sum -c):\n");
+    printf("  %s compress case1827.7z /evidence --split 8g --manifest case1827.sha256\n\n", program);
+    
+    printf("  # Nightly backup with a change detection manifest (check with xxhsum -c):\n");
+    printf("  %s compress backup.7z /data --manifest backup.xxh128 --xxh3\n\n", program);
+    
+    printf("  # Daily backup of only the files changed since the last run:\n");
+    printf("  %s compress backup-$(date +%%F).7z /data --incremental backup.state\n\n", program);
+    
     printf("  # Extract split archive:\n");
     printf("  %s extract evidence.7z.001 /output\n\n", program);
     
@@ -223,7 +246,7 @@ static void print_usage(const char* program) {
     printf("  %s extract secure.7z /output --password\n\n", program);
     
     printf("  # Resume interrupted compression:\n");
-    printf("  %s resume evidence.7z\n\n", program);
+    printf("  %s resume evidence.7z [--threads <num>] [--password [pass]]\n\n", program);
 }
 
 /* Parse size string (e.g., "4g", "512m", "1024k") */
@@ -263,6 +286,7 @@ int main(int argc, char* argv[]) {
                 sevenzip_get_error_message(result));
         return 1;
     }
+    cancel_token = sevenzip_cancel_token_create();
     
     if (strcmp(command, "compress") == 0) {
         if (argc < 4) {
@@ -276,6 +300,7 @@ int main(int argc, char* argv[]) {
         /* Parse options */
         SevenZipStreamOptions opts;
         sevenzip_stream_options_init(&opts);
+        opts.cancel = cancel_token;
         
         SevenZipCompressionLevel level = SEVENZIP_LEVEL_NORMAL;
         int enable_resume = 0;
@@ -312,6 +337,14 @@ int main(int argc, char* argv[]) {
                 opts.password = password;
             } else if (strcmp(argv[i], "--resume") == 0) {
                 enable_resume = 1;
+                opts.checkpoint = 1;
+            } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+                opts.digest_manifest = argv[++i];
+            } else if (strcmp(argv[i], "--xxh3") == 0) {
+                opts.digest_algorithm = SEVENZIP_DIGEST_XXH3_128;
+            } else if (strcmp(argv[i], "--incremental") == 0 && i + 1 < argc) {
+                opts.snapshot_base = argv[++i];
+                opts.snapshot_output = opts.snapshot_base;
             } else {
                 input_files[file_count++] = argv[i];
             }
@@ -357,6 +390,13 @@ int main(int argc, char* argv[]) {
         if (opts.password) {
             printf("Encryption:  Enabled (password protected)\n");
         }
+        if (opts.digest_manifest) {
+            printf("Manifest:    %s (%s)\n", opts.digest_manifest,
+                   opts.digest_algorithm == SEVENZIP_DIGEST_XXH3_128 ? "XXH3-128" : "SHA-256");
+        }
+        if (opts.snapshot_base) {
+            printf("Snapshot:    %s (unchanged files left out)\n", opts.snapshot_base);
+        }
         printf("\n");
         
         /* Setup progress tracking */
@@ -384,6 +424,11 @@ int main(int argc, char* argv[]) {
             
             printf("✓ Compression completed successfully!\n");
             printf("  Total time: %s\n", elapsed_str);
+            if (opts.digest_manifest) {
+                printf("  %s manifest: %s\n",
+                       opts.digest_algorithm == SEVENZIP_DIGEST_XXH3_128 ? "XXH3-128" : "SHA-256",
+                       opts.digest_manifest);
+            }
             
             if (opts.split_size > 0) {
                 printf("\n");
@@ -401,6 +446,51 @@ int main(int argc, char* argv[]) {
         
         free(input_files);
         
+    } else if (strcmp(command, "resume") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "Error: resume requires <archive>\n");
+            sevenzip_cleanup();
+            return 1;
+        }
+        
+        const char* archive_path = argv[2];
+        char password_buffer[256] = {0};
+        
+        /* Level and split size come from the checkpoint */
+        SevenZipStreamOptions opts;
+        sevenzip_stream_options_init(&opts);
+        opts.cancel = cancel_token;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                opts.num_threads = atoi(argv[++i]);
+            } else if (strcmp(argv[i], "--password") == 0) {
+                if (i + 1 < argc && argv[i+1][0] != '-') {
+                    opts.password = argv[++i];
+                } else {
+                    opts.password = prompt_password("Enter password: ", password_buffer, sizeof(password_buffer));
+                }
+            }
+        }
+        
+        ProgressState progress_state = {0};
+        progress_state.start_time = time(NULL);
+        progress_state.last_update_time = progress_state.start_time;
+        
+        printf("Resuming compression of %s...\n\n", archive_path);
+        result = sevenzip_resume_multivolume(archive_path, &opts,
+                                             forensic_progress_callback, &progress_state);
+        printf("\n\n");
+        
+        if (result == SEVENZIP_OK) {
+            printf("✓ Compression completed successfully!\n");
+        } else {
+            fprintf(stderr, "✗ Resume failed: %s\n", sevenzip_get_error_message(result));
+            if (result == SEVENZIP_ERROR_CANCELLED) {
+                fprintf(stderr, "\nYou can resume again with:\n");
+                fprintf(stderr, "  %s resume %s\n", argv[0], archive_path);
+            }
+        }
+        
     } else if (strcmp(command, "extract") == 0) {
         if (argc < 4) {
             fprintf(stderr, "Error: extract requires <archive> and <output_dir>\n");
@@ -524,6 +614,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    sevenzip_cancel_token_free(cancel_token);
     sevenzip_cleanup();
     return (result == SEVENZIP_OK) ? 0 : 1;
 }
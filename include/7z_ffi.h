@@ -29,6 +29,8 @@ typedef enum {
     SEVENZIP_ERROR_COMPRESS = 5,
     SEVENZIP_ERROR_INVALID_PARAM = 6,
     SEVENZIP_ERROR_NOT_IMPLEMENTED = 7,
+    SEVENZIP_ERROR_CANCELLED = 8,
+    SEVENZIP_ERROR_BUFFER_TOO_SMALL = 9,
     SEVENZIP_ERROR_UNKNOWN = 99
 } SevenZipErrorCode;
 
@@ -61,6 +63,32 @@ typedef void (*SevenZipBytesProgressCallback)(
     void* user_data
 );
 
+/* Volume `index` (0-based) of `size` bytes at `path` is complete: closed,
+   and on disk with sync_volumes; `digest` is its digest_algorithm digest
+   with volume_digests (NULL without). Extraction with consume_volumes
+   passes volumes it has read for the last time, with a NULL digest */
+typedef void (*SevenZipVolumeCallback)(uint32_t index, const char* path, uint64_t size,
+                                       const uint8_t* digest, void* user_data);
+
+/* Next input path of a create job, NULL once there are no more; the
+   string need only stay valid until the next call */
+typedef const char* (*SevenZipPathCallback)(void* user_data);
+
+/*
+ * Cancellation handle, see sevenzip_cancel_token_create(). Set in the
+ * `cancel` field of an options struct; cancelling it makes a running
+ * call stop at its next read or encoder progress step and return
+ * SEVENZIP_ERROR_CANCELLED.
+ */
+typedef struct SevenZipCancelToken SevenZipCancelToken;
+
+/*
+ * Read and write bandwidth budget, see sevenzip_rate_limit_create(). Set
+ * in the `rate_limit` field of SevenZipStreamOptions; its rates may be
+ * changed while jobs using it run, and jobs sharing it share the budget.
+ */
+typedef struct SevenZipRateLimit SevenZipRateLimit;
+
 /* Compression level */
 typedef enum {
     SEVENZIP_LEVEL_STORE = 0,      /* No compression */
@@ -71,39 +99,450 @@ typedef enum {
     SEVENZIP_LEVEL_ULTRA = 9       /* Ultra compression */
 } SevenZipCompressionLevel;
 
+/* Filter chained before LZMA2 (branch converters for code, Delta for raw data) */
+typedef enum {
+    SEVENZIP_FILTER_AUTO = 0,      /* Detect per file from ELF/PE/Mach-O headers */
+    SEVENZIP_FILTER_NONE = 1,      /* Never filter */
+    SEVENZIP_FILTER_BCJ = 2,       /* x86 / x86-64 */
+    SEVENZIP_FILTER_ARM64 = 3,     /* AArch64 */
+    SEVENZIP_FILTER_ARM = 4,       /* 32-bit ARM */
+    SEVENZIP_FILTER_ARMT = 5,      /* ARM Thumb */
+    SEVENZIP_FILTER_PPC = 6,       /* PowerPC (big-endian) */
+    SEVENZIP_FILTER_SPARC = 7,     /* SPARC */
+    SEVENZIP_FILTER_IA64 = 8,      /* Itanium */
+    SEVENZIP_FILTER_DELTA = 9      /* Byte delta at delta_distance (raw samples, pixels) */
+} SevenZipFilter;
+
+/* Main compression method of each solid block */
+typedef enum {
+    SEVENZIP_METHOD_LZMA2 = 0,     /* LZMA2 for everything */
+    SEVENZIP_METHOD_PPMD = 1,      /* PPMd for everything (best on text, slower) */
+    SEVENZIP_METHOD_AUTO = 2       /* PPMd for files classified as text, LZMA2 for the rest */
+} SevenZipMethod;
+
+/* Placement of encoder threads on hosts with several NUMA nodes */
+typedef enum {
+    SEVENZIP_NUMA_OFF = 0,         /* Threads run wherever the OS schedules them */
+    SEVENZIP_NUMA_LOCAL = 1        /* Each LZMA2 block thread and its match-finder threads are pinned to a node, round robin, with their memory on that node */
+} SevenZipNumaPolicy;
+
+/* Per-file digest of SevenZipStreamOptions.digest_manifest */
+typedef enum {
+    SEVENZIP_DIGEST_SHA256 = 0,    /* Cryptographic, checked with sha256sum -c */
+    SEVENZIP_DIGEST_XXH3_128 = 1   /* Non-cryptographic, several times faster, for change detection; checked with xxhsum -c */
+} SevenZipDigestAlgorithm;
+
+/* CRCs checked while extracting, SevenZipExtractOptions.verify; decoder
+ * errors and sizes are checked in every mode */
+typedef enum {
+    SEVENZIP_VERIFY_FILE = 0,      /* Every file's CRC, and the folder CRC where the archive stores one */
+    SEVENZIP_VERIFY_FOLDER = 1,    /* The folder CRC where the archive stores one, else the file CRCs as SEVENZIP_VERIFY_FILE (archives written by this library store file CRCs only) */
+    SEVENZIP_VERIFY_NONE = 2       /* No CRC is computed; for archives already verified (sevenzip_test_archive()) or protected otherwise */
+} SevenZipVerifyMode;
+
+/* Entries whose output file already exists, SevenZipExtractOptions.existing */
+typedef enum {
+    SEVENZIP_EXISTING_OVERWRITE = 0,     /* Written again */
+    SEVENZIP_EXISTING_SKIP_SAME = 1,     /* Left alone when a regular file of the entry's size and modification time (to the second) is there; entries without a time are written */
+    SEVENZIP_EXISTING_SKIP_SAME_CRC = 2  /* As SEVENZIP_EXISTING_SKIP_SAME, once the file also has the entry's CRC (read in full); entries without a CRC are written */
+} SevenZipExistingPolicy;
+
+/*
+ * What of an extraction survives a crash, SevenZipExtractOptions.durability,
+ * for sevenzip_extract_with_options(), sevenzip_extract_from_stream() and
+ * sevenzip_extract_streaming_with_options().
+ * FILE fsyncs each file, data and times, before closing it, and every
+ * directory of the run once at the end. BATCHED starts writeback of each
+ * file as it is closed and makes the whole run durable with one syncfs of
+ * the output filesystem at the end; without syncfs (other than Linux)
+ * files are synced as with FILE. ATOMIC writes files as <name>.7zpart and
+ * renames them into place in batches of 1024 once their data is on disk
+ * (one syncfs per batch, else an fsync per file), then syncs the names at
+ * the end. Files done before a failure are still renamed; the .7zpart
+ * being written is removed.
+ */
+typedef enum {
+    SEVENZIP_DURABILITY_NONE = 0,     /* Left to the OS: recent files may be missing or partial after a crash (default) */
+    SEVENZIP_DURABILITY_FILE = 1,     /* A closed file's contents are on disk, its name once the call returns */
+    SEVENZIP_DURABILITY_BATCHED = 2,  /* Nothing is promised before the call returns, everything after */
+    SEVENZIP_DURABILITY_ATOMIC = 3    /* A file under its own name is complete, or the version it replaced, never partial */
+} SevenZipDurability;
+
+/* LZMA match finder: hash chain (hc, fast) or binary tree (bt, better
+ * matches), with the number of bytes hashed */
+typedef enum {
+    SEVENZIP_MATCH_FINDER_AUTO = 0, /* The level's: hc5 up to SEVENZIP_LEVEL_FAST, bt4 above */
+    SEVENZIP_MATCH_FINDER_HC4 = 1,
+    SEVENZIP_MATCH_FINDER_HC5 = 2,
+    SEVENZIP_MATCH_FINDER_BT2 = 3,
+    SEVENZIP_MATCH_FINDER_BT3 = 4,
+    SEVENZIP_MATCH_FINDER_BT4 = 5
+} SevenZipMatchFinder;
+
+/* LZMA encoder parameters that replace those of the compression level;
+ * set up with sevenzip_lzma_params_init(), out-of-range values are clamped */
+typedef struct {
+    SevenZipMatchFinder match_finder; /* Match finder (default: SEVENZIP_MATCH_FINDER_AUTO) */
+    int algorithm;             /* 0 = fast, 1 = normal (optimal parsing), -1 = the level's: normal from SEVENZIP_LEVEL_NORMAL */
+    int fast_bytes;            /* fb: match length the encoder settles for, 5-273 (-1 = the level's: 32, 64 from SEVENZIP_LEVEL_MAXIMUM) */
+    uint32_t match_cycles;     /* mc: match-finder steps per position (0 = from fast_bytes and the match finder) */
+    int lc;                    /* Literal context bits, 0-4 with lc + lp at most 4 (-1 = 3) */
+    int lp;                    /* Literal position bits, 0-4 (-1 = 0) */
+    int pb;                    /* Position bits, 0-4 (-1 = 2) */
+} SevenZipLzmaParams;
+
 /* Advanced compression options */
 typedef struct {
-    int num_threads;           /* Number of threads (0 = auto, default: 2) */
+    int num_threads;           /* Number of threads (0 = auto: the CPUs the process may use, within its affinity and cgroup quota; default: 2) */
     uint64_t dict_size;        /* Dictionary size in bytes (0 = auto) */
     int solid;                 /* Solid archive (1 = yes, 0 = no, default: 1) */
     const char* password;      /* Password for encryption (NULL = no encryption) */
+    uint64_t solid_block_size; /* Start a new solid block after this many input bytes (0 = unlimited) */
+    int solid_block_files;     /* Start a new solid block after this many files (0 = unlimited) */
+    SevenZipFilter filter;     /* Filter before LZMA2 (default: SEVENZIP_FILTER_AUTO) */
+    int delta_distance;        /* Delta filter distance in bytes, 1-256 (0 = 1) */
+    const char* delta_extensions; /* Comma-separated extensions that get Delta in AUTO mode (NULL = none) */
+    SevenZipMethod method;     /* Compression method (default: SEVENZIP_METHOD_LZMA2) */
+    int ppmd_order;            /* PPMd model order, 2-64 (0 = per level) */
+    uint32_t ppmd_mem_size;    /* PPMd model size in bytes (0 = per level) */
+    uint64_t max_memory;       /* Peak memory budget in bytes; threads, blocks and buffers are reduced to fit (0 = no limit) */
+    SevenZipCancelToken* cancel; /* sevenzip_create_7z(): stops the job once cancelled (NULL = not cancellable) */
+    uint64_t block_size;       /* LZMA2 block size, the unit a block thread compresses (0 = auto: 4x dictionary) */
+    int thread_weight;         /* Share of the sevenzip_init_with_options() thread quota against other jobs (0 = 1) */
+    SevenZipNumaPolicy numa_policy; /* Encoder thread placement (default: SEVENZIP_NUMA_OFF; no effect on single-node hosts) */
+    int detect_compressed;     /* Files an extension or magic number shows are compressed already (JPEG, PNG, ZIP, gzip, zstd, MP4, 7z, ...) go into Copy folders of their own, after the other files in solid archives (default: 0) */
+    const SevenZipLzmaParams* lzma_params; /* LZMA encoder parameters over those of the level (NULL = the level's) */
+    int solid_sort;            /* Solid archives: files ordered by extension, then name, then size (7-Zip's -mqs), so each type, and its filter, forms one run; entries are listed in that order (default: 0) */
+    uint32_t dedup_chunk_size; /* sevenzip_create_archive_with_options(): average deduplication chunk size (0 = off, default) */
 } SevenZipCompressOptions;
 
+/* Coders of one file, as SevenZipStreamOptions.entry_policy decides them */
+typedef struct {
+    SevenZipMethod method;     /* LZMA2 or PPMd; AUTO = PPMd if the file is classified as text */
+    SevenZipFilter filter;     /* Filter before LZMA2, not for PPMd (AUTO = detected from the file) */
+    int level;                 /* 1-9: that level's parsing (algorithm, fast bytes, match cycles) over the job's dictionary and match finder; 0 = Copy */
+    uint32_t group;            /* Solid archives: groups go in ascending order, each in solid blocks of its own */
+} SevenZipEntryPolicy;
+
+/*
+ * Called once for every file with data, on the thread that started the
+ * job, before any is compressed: `head` holds up to the first 4KB of the
+ * file (magic numbers included) and `policy` the job's own choice, which
+ * the callback may change.
+ */
+typedef void (*SevenZipEntryPolicyCallback)(const char* path, uint64_t size,
+                                            const uint8_t* head, size_t head_size,
+                                            SevenZipEntryPolicy* policy, void* user_data);
+
 /* Streaming compression options for large files and split archives */
 typedef struct {
-    int num_threads;           /* Number of threads (0 = auto, default: 2) */
+    int num_threads;           /* Number of threads (0 = auto: the CPUs the process may use, within its affinity and cgroup quota; default: 2) */
     uint64_t dict_size;        /* Dictionary size in bytes (0 = auto, default: 32MB) */
     int solid;                 /* Solid archive (1 = yes, 0 = no, default: 1) */
     const char* password;      /* Password for encryption (NULL = no encryption) */
     uint64_t split_size;       /* Split archive size in bytes (0 = no split, e.g., 4GB = 4294967296) */
-    uint64_t chunk_size;       /* Chunk size for streaming (0 = auto, default: 64MB) */
-    const char* temp_dir;      /* Temporary directory (NULL = system default) */
+    uint64_t chunk_size;       /* Chunk size for streaming; sevenzip_create_7z_true_streaming() codes chunks as independent LZMA2 blocks, one per thread at a time (0 = auto, default: 64MB) */
+    const char* temp_dir;      /* Scratch files of non-solid pack streams finished ahead of their turn; the one being written goes straight to the archive, so most jobs make none (NULL = system default) */
     int delete_temp_on_error;  /* Delete temp files on error (1 = yes, 0 = no, default: 1) */
+    int prefetch_buffers;      /* Read-ahead ring slots (4MB each) filled by a reader thread (0 = off, default: 4) */
+    uint64_t solid_block_size; /* Start a new solid block after this many input bytes (0 = unlimited) */
+    int solid_block_files;     /* Start a new solid block after this many files (0 = unlimited) */
+    SevenZipFilter filter;     /* Filter before LZMA2 (default: SEVENZIP_FILTER_AUTO) */
+    int delta_distance;        /* Delta filter distance in bytes, 1-256 (0 = 1) */
+    const char* delta_extensions; /* Comma-separated extensions that get Delta in AUTO mode (NULL = none) */
+    SevenZipMethod method;     /* Compression method (default: SEVENZIP_METHOD_LZMA2) */
+    int ppmd_order;            /* PPMd model order, 2-64 (0 = per level) */
+    uint32_t ppmd_mem_size;    /* PPMd model size in bytes (0 = per level) */
+    uint64_t max_memory;       /* Peak memory budget in bytes; threads, blocks and buffers are reduced to fit (0 = no limit) */
+    int unbuffered_output;     /* Split volumes bypass the page cache (default: 0) */
+    int input_access_hints;    /* Split and true-streaming paths: read ahead of sources, drop read data from the page cache (default: 0) */
+    int progress_interval_ms;  /* Least time between progress calls, made from a reporter thread (0 = 100ms, negative = every update, on the working thread) */
+    uint64_t progress_interval_bytes; /* Also report once this many input bytes passed since the last call (0 = time only) */
+    SevenZipCancelToken* cancel; /* Stops the job once cancelled; partial output goes as with delete_temp_on_error (NULL = not cancellable) */
+    int checkpoint;            /* Split archives: keep a checkpoint for sevenzip_resume_multivolume() (default: 0) */
+    uint64_t block_size;       /* LZMA2 block size, the unit a block thread compresses (0 = auto) */
+    int thread_weight;         /* Share of the sevenzip_init_with_options() thread quota against other jobs (0 = 1) */
+    SevenZipNumaPolicy numa_policy; /* Encoder thread placement; non-solid split archives pin their file workers (default: SEVENZIP_NUMA_OFF) */
+    const char** volume_dirs;  /* Split archives: NULL-terminated directories the volumes are spread over (NULL = next to archive_path) */
+    const char* digest_manifest; /* Path for a sha256sum-style manifest of every file's digest (NULL = none) */
+    SevenZipDigestAlgorithm digest_algorithm; /* Digest of digest_manifest and the volume digests (default: SEVENZIP_DIGEST_SHA256) */
+    const char* snapshot_base; /* Snapshot of an earlier run (snapshot_output) whose unchanged files are left out (NULL = archive all) */
+    const char* snapshot_output; /* Path for a snapshot of the inputs, for a later snapshot_base (NULL = none) */
+    int detect_compressed;     /* As in SevenZipCompressOptions; not for true streaming, which writes one folder (default: 0) */
+    const SevenZipLzmaParams* lzma_params; /* LZMA encoder parameters over those of the level (NULL = the level's) */
+    int sync_volumes;          /* fsync every volume before returning (default: 0) */
+    SevenZipVolumeCallback volume_complete; /* Called as each volume is complete (NULL = none) */
+    void* volume_user_data;    /* user_data of volume_complete */
+    int volume_digests;        /* Digest every volume as it is written (default: 0) */
+    const char* volume_manifest; /* Path for a manifest of the volume digests (NULL = none) */
+    int write_index;           /* Write <archive_path>.7zidx, the entry table, folder offsets and volume sizes, for sevenzip_list_index(); not for sinks (default: 0) */
+    int zero_blocks;           /* Code long runs of zeros as precomputed LZMA2 chunks (default: 0) */
+    int memory_pressure_throttle; /* Non-solid jobs: PSI memory stall percentage above which workers run one at a time (0 = off, default) */
+    SevenZipRateLimit* rate_limit; /* Read and write bandwidth budget (NULL = unlimited) */
+    SevenZipPathCallback next_input_path; /* Inputs after input_paths, one per call (NULL = none) */
+    void* input_path_user_data; /* user_data of next_input_path */
+    const char* input_list;    /* File of further inputs, one path per line (NULL = none) */
+    int verify_writes;         /* Check every LZMA2 folder against its input as it is written (default: 0) */
+    int group_duplicates;      /* Solid archives: place files with the same first 16KB next to each other (default: 0) */
+    int solid_sort;            /* As in SevenZipCompressOptions; with group_duplicates the copies join the first of them in sorted order (default: 0) */
+    int streamable;            /* Copy the header to the front for sevenzip_extract_from_stream() (default: 0) */
+    uint64_t streamable_reserve; /* Bytes reserved for the streamable header copy (0 = auto) */
+    int folder_stats;          /* Keep encoder counters of every LZMA2 folder (default: 0) */
+    double throughput_target;  /* Input MB/s to hold by trading ratio for speed (0 = off, default) */
+    SevenZipEntryPolicyCallback entry_policy; /* Method, filter, level and solid group of each file (NULL = the options' choice for every file) */
+    void* entry_policy_data;   /* user_data of entry_policy */
+    int deterministic;         /* Same bytes for the same inputs at any thread count (default: 0) */
+    int64_t fixed_mtime;       /* Every entry's modification time, e.g. SOURCE_DATE_EPOCH (0 = each file's own) */
+    const char* block_cache_dir; /* Directory caching non-solid pack streams across runs (NULL = off, default) */
+    const char** include_patterns; /* NULL-terminated globs over archive names of files to archive (NULL = every file) */
+    const char** exclude_patterns; /* NULL-terminated globs over archive names to leave out (NULL = none) */
+    uint32_t parity_volumes;   /* Split archives: Reed-Solomon parity volumes, up to 32 (0 = off, default) */
 } SevenZipStreamOptions;
 
+/* Extraction options */
+typedef struct {
+    int num_threads;           /* Folders decoded at once, each with its own file handle (0 = auto: 4, fewer on fewer CPUs, 1 = sequential) */
+    int lzma2_threads;         /* Decoder threads per multi-block LZMA2 folder; holds a block per thread (0 = num_threads shared among the folders decoded at once) */
+    int writer_threads;        /* sevenzip_extract_with_options(): threads creating and writing files of up to 1MB off the decoding threads (0 = write inline, default: 4) */
+    int sparse_output;         /* Extraction: all-zero 4KB blocks are left as holes instead of written (default: 0) */
+    int progress_interval_ms;  /* sevenzip_extract_with_options(): least time between progress calls, made from a reporter thread (0 = 100ms, negative = every file, on the working thread) */
+    SevenZipCancelToken* cancel; /* sevenzip_extract_with_options(): stops the job once cancelled; files already written stay (NULL = not cancellable) */
+    int thread_weight;         /* Share of the sevenzip_init_with_options() thread quota against other jobs (0 = 1) */
+    int volume_readahead;      /* sevenzip_extract_streaming_with_options(): split volumes after the one being read whose heads are read at once, one helper thread each (0 = auto: 2, at most 16) */
+    SevenZipVerifyMode verify; /* CRCs checked on extraction; sevenzip_test_archive_with_options() always checks them all (default: SEVENZIP_VERIFY_FILE) */
+    SevenZipExistingPolicy existing; /* Files already there (default: SEVENZIP_EXISTING_OVERWRITE) */
+    uint64_t max_memory;       /* Decoder memory budget in bytes (0 = no limit) */
+    int cache_neutral_output;  /* Extraction: keep written files out of the page cache (default: 0) */
+    int consume_volumes;       /* sevenzip_extract_streaming_with_options(): delete split volumes once read (default: 0) */
+    SevenZipVolumeCallback volume_consumed; /* With consume_volumes: called with each volume instead of deleting it (NULL = delete) */
+    void* volume_consumed_user_data; /* user_data of volume_consumed */
+    const char* checkpoint_path; /* sevenzip_extract_streaming_with_options(): progress file for resuming a failed run (NULL = none) */
+    SevenZipDurability durability; /* When written files are made durable (default: SEVENZIP_DURABILITY_NONE) */
+    int follow_timeout_ms;     /* sevenzip_extract_following(): longest wait for the next byte of the archive to arrive before failing with SEVENZIP_ERROR_OPEN_FILE (0 = wait until cancelled) */
+    const char** include_patterns; /* NULL-terminated globs over entry names to extract (NULL = every entry) */
+    const char** exclude_patterns; /* NULL-terminated globs over entry names to leave out (NULL = none) */
+} SevenZipExtractOptions;
+
+/* Standalone .lzma / .lzma2 decompression options */
+typedef struct {
+    int num_threads;           /* LZMA2 decoder threads (0 = auto: 2, 1 on one CPU, 1 = single-threaded) */
+    size_t output_step;        /* Bytes decoded between writes to the output file (0 = 4MB) */
+} SevenZipDecompressOptions;
+
+/* Layout of the data sevenzip_compress_buffer() writes */
+typedef enum {
+    SEVENZIP_BUFFER_LZMA = 0,  /* .lzma: 5 property bytes, 8-byte size, LZMA stream */
+    SEVENZIP_BUFFER_LZMA2 = 1, /* Property byte and LZMA2 stream, as sevenzip_compress_lzma2() writes */
+    SEVENZIP_BUFFER_7Z = 2     /* .7z archive holding one file */
+} SevenZipBufferFormat;
+
+/* In-memory compression options */
+typedef struct {
+    int num_threads;           /* LZMA2 and 7z: encoder threads (0 = 1) */
+    const char* entry_name;    /* 7z: name of the file in the archive (NULL = "data") */
+    const SevenZipLzmaParams* lzma_params; /* Encoder parameters over the level's (NULL = per level) */
+} SevenZipBufferOptions;
+
+/* Integrity check stored in .xz blocks (values are the xz check IDs) */
+typedef enum {
+    SEVENZIP_XZ_CHECK_NONE = 0,
+    SEVENZIP_XZ_CHECK_CRC32 = 1,
+    SEVENZIP_XZ_CHECK_CRC64 = 4,   /* Default, as in xz */
+    SEVENZIP_XZ_CHECK_SHA256 = 10
+} SevenZipXzCheck;
+
+/* .xz compression and decompression options */
+typedef struct {
+    int num_threads;           /* Encoder or decoder threads (0 = auto: 2, 1 on one CPU, 1 = single-threaded) */
+    uint64_t dict_size;        /* Compression: dictionary size in bytes (0 = per level) */
+    uint64_t block_size;       /* Compression: input bytes per xz block; blocks are compressed and decompressed in parallel (0 = auto: 4x dictionary, UINT64_MAX = one block) */
+    SevenZipXzCheck check;     /* Compression: block check (default: SEVENZIP_XZ_CHECK_CRC64) */
+} SevenZipXzOptions;
+
+/*
+ * Byte stream callbacks for the stream forms of the .xz functions. `read`
+ * stores up to *size bytes at buf and sets *size to the count (0 at the
+ * end of the input); `write` takes `size` bytes that are only valid
+ * during the call. Both return 0 to go on; any other value stops.
+ */
+typedef int (*SevenZipReadCallback)(void* buf, size_t* size, void* user_data);
+typedef int (*SevenZipWriteCallback)(const void* data, size_t size, void* user_data);
+
+/*
+ * Receiver of decoded entries for sevenzip_extract_to_sink(). Every
+ * callback is optional and returns 0 to go on; any other value stops the
+ * extraction. `write` gets the decoder's own output window: `data` is
+ * only valid during the call and must be copied to be kept.
+ */
+typedef struct {
+    int (*begin_entry)(uint32_t entry_index, const char* name, uint64_t size, void* user_data);
+    int (*write)(uint32_t entry_index, const void* data, size_t size, void* user_data);
+    int (*end_entry)(uint32_t entry_index, void* user_data);  /* All bytes out, CRC matched */
+    void* user_data;
+} SevenZipExtractSink;
+
+/*
+ * Receiver of the archive bytes for sevenzip_create_7z_to_sink(), in place
+ * of the archive file or volume files. `write` (required) gets the bytes of
+ * volume `volume_index` in order; `data` is only valid during the call.
+ * The start header near the front of the first volume is only known once
+ * everything else is out: its bytes are written as zeros, then `patch`
+ * (required) gets their value to overwrite them with - seek back, or hold
+ * that start of volume 0 back until then. `begin_volume` and `end_volume`
+ * are optional; every volume ends before the next begins except volume 0,
+ * which ends last, after its patch. Callbacks return 0 to go on; any
+ * other value fails the job.
+ */
+typedef struct {
+    int (*begin_volume)(uint32_t volume_index, void* user_data);
+    int (*write)(uint32_t volume_index, const void* data, size_t size, void* user_data);
+    int (*patch)(uint64_t offset, const void* data, size_t size, void* user_data);  /* Volume 0 */
+    int (*end_volume)(uint32_t volume_index, uint64_t size, void* user_data);
+    void* user_data;
+} SevenZipArchiveSink;
+
+/* SevenZipSourceEntry.size of an entry read until its callback ends it */
+#define SEVENZIP_SIZE_UNKNOWN UINT64_MAX
+
+/*
+ * One entry of sevenzip_create_7z_from_source(), filled in by the source's
+ * next_entry(). `name` is copied at once; `read` and `read_user_data`
+ * are used until the next next_entry() call.
+ */
+typedef struct {
+    const char* name;          /* Path inside the archive, '/' separated */
+    uint64_t size;             /* Bytes `read` delivers, or SEVENZIP_SIZE_UNKNOWN */
+    int64_t mtime;             /* Modification time in Unix seconds (0 = now) */
+    int is_dir;                /* 1 = directory, no data */
+    SevenZipReadCallback read; /* Data of the entry, 0 bytes at its end (NULL = empty) */
+    void* read_user_data;      /* Passed to `read` */
+    uint32_t attributes;       /* Windows attributes, with a Unix mode in the high 16 bits when 0x8000 is set (0 = directory or archive bit by is_dir) */
+} SevenZipSourceEntry;
+
+/*
+ * Producer of the entries of sevenzip_create_7z_from_source().
+ * next_entry() fills in `entry` (zeroed before each call) and returns 0
+ * to go on; leaving entry->name NULL ends the archive. Any other return
+ * value fails the job, as does a failing `read`.
+ */
+typedef struct {
+    int (*next_entry)(SevenZipSourceEntry* entry, void* user_data);
+    void* user_data;
+} SevenZipEntrySource;
+
 /**
  * Initialize the 7z library
- * Call this before any other functions
+ * Builds the CRC, AES and SHA-256 tables and picks the CPU-specific coder
+ * functions, once per process; concurrent and later calls wait for that
+ * and return. Every other function does the same on first use, so calling
+ * this first is not required.
+ *
+ * Thread safety: unless a function's documentation says otherwise, any
+ * number of threads may call the library at once. Inputs (paths, options,
+ * passwords, buffers) are only read and may be shared; outputs (archive
+ * paths, output directories, result structs) must not be. A handle
+ * (archive, stream, crypt context, job) serves one call at a time.
+ * Process-wide settings are the exception: sevenzip_set_allocator() and
+ * sevenzip_set_large_pages() must be called while nothing else runs;
+ * sevenzip_init_with_options() may be called at any time and applies to
+ * jobs that start after it.
  * @return SEVENZIP_OK on success, error code otherwise
  */
 SEVENZIP_API SevenZipErrorCode sevenzip_init(void);
 
+/* CPU scheduling of library threads */
+typedef enum {
+    SEVENZIP_SCHED_NORMAL = 0,     /* As the thread that started them */
+    SEVENZIP_SCHED_BATCH = 1,      /* SCHED_BATCH (Windows: below normal priority) */
+    SEVENZIP_SCHED_IDLE = 2        /* SCHED_IDLE: run only on CPU time nothing else wants */
+} SevenZipSchedPolicy;
+
+/* Disk scheduling of library threads */
+typedef enum {
+    SEVENZIP_IO_NORMAL = 0,        /* As the thread that started them */
+    SEVENZIP_IO_LOW = 1,           /* Lowest best-effort level (Windows: background mode) */
+    SEVENZIP_IO_IDLE = 2           /* Idle class: only when the disk is otherwise idle */
+} SevenZipIoPriority;
+
+/* Library-wide settings for sevenzip_init_with_options() */
+typedef struct {
+    int max_threads;           /* Compute threads all jobs of the process share (0 = hardware threads: those online, within the affinity mask and cgroup CPU quota) */
+    int max_jobs;              /* sevenzip_submit_*() jobs run at once, the rest wait (0 = hardware threads) */
+    const char* cpu_affinity;  /* CPUs library threads may run on, e.g. "0-3,8" (NULL or "" = any) */
+    SevenZipSchedPolicy sched_policy;  /* CPU scheduling of library threads (default: SEVENZIP_SCHED_NORMAL) */
+    int nice;                  /* Nice value of library threads, 1-19 (0 = unchanged) */
+    SevenZipIoPriority io_priority;    /* Disk scheduling of library threads (default: SEVENZIP_IO_NORMAL) */
+    int64_t decoder_pool_bytes;  /* Freed decoder buffers kept for reuse (0 = 128MB, negative = no pool) */
+} SevenZipInitOptions;
+
+/**
+ * Initialize the 7z library with a thread quota shared by all jobs
+ * Jobs with a num_threads option take their threads from the quota when
+ * they start: at most num_threads (all of it when that is auto), at most
+ * their thread_weight share among the jobs running and waiting, and at
+ * least one. A job waits while the quota is used up, and keeps its
+ * threads until it ends. Jobs started from a callback of another job run
+ * on that job's threads. Encoder and decoder threads are counted; threads
+ * that mostly wait on I/O (prefetch, volume and file writers) are not.
+ * Calling it again resizes the quota; without it jobs use the threads
+ * they ask for.
+ *
+ * The scheduling settings let background archiving use spare CPU and
+ * disk time without delaying other work on the host. They apply to every
+ * thread the library starts: encoder and decoder threads, pools, writers
+ * and the sevenzip_submit_*() runners, from their start (runners from
+ * their next job). The calling thread is never changed, so a job run on
+ * it with one thread keeps its priority; use sevenzip_submit_*() or a
+ * thread of your own. A thread already nicer than `nice` keeps its
+ * value. Linux applies all of the settings; Windows
+ * maps them to thread priorities, affinity within the first 64 CPUs and
+ * background mode; other platforms ignore them.
+ *
+ * Up to decoder_pool_bytes of freed decoder dictionaries and I/O buffers
+ * of 64KB and more are kept for the next entries, folders and archives
+ * decoded with the same dictionary size, so steady-state decoding
+ * allocates nothing large. Pooled bytes stay counted in
+ * sevenzip_get_memory_stats().
+ * @param options Settings (NULL = no quota and no scheduling settings,
+ *        like sevenzip_init())
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM for a
+ *         negative max_threads or max_jobs, a nice value outside 0-19,
+ *         an unknown policy or priority or a malformed cpu_affinity
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_init_with_options(const SevenZipInitOptions* options);
+
 /**
  * Cleanup the 7z library
- * Call this when done using the library
+ * Frees the decoder dictionaries and I/O buffers pooled for reuse
+ * (SevenZipInitOptions.decoder_pool_bytes). The tables stay valid for
+ * the life of the process, so this does not affect calls running on
+ * other threads and the library stays usable afterwards.
  */
 SEVENZIP_API void sevenzip_cleanup(void);
 
+/**
+ * Threads the "auto" thread counts are sized for
+ * Logical processors online, within the affinity mask (so a cpuset
+ * cgroup) and the cgroup v2 cpu.max or v1 CFS quota rounded up, at least
+ * 1: a container limited to 4 CPUs on a 96-core host gets 4. Counted on
+ * first use.
+ * @return Number of threads
+ */
+SEVENZIP_API int sevenzip_hardware_threads(void);
+
+/**
+ * Back large encoder and decoder buffers with huge pages
+ * Match finders, dictionaries and PPMd models of 4MB and more are mapped
+ * with MAP_HUGETLB or transparent huge pages on Linux, and with large pages
+ * on Windows (requires the "Lock pages in memory" privilege). Any block the
+ * OS refuses falls back to normal pages. Call after sevenzip_init(),
+ * before starting jobs.
+ * @param enable 1 to enable, 0 to disable (default: disabled)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_NOT_IMPLEMENTED if the
+ *         platform has no large pages (allocation stays unchanged)
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_set_large_pages(int enable);
+
 /**
  * Extract a 7z archive
  * @param archive_path Path to the archive file
@@ -121,15 +560,156 @@ SEVENZIP_API SevenZipErrorCode sevenzip_extract(
     void* user_data
 );
 
+/**
+ * Initialize extraction options with defaults
+ * @param options Pointer to options structure to initialize
+ */
+SEVENZIP_API void sevenzip_extract_options_init(SevenZipExtractOptions* options);
+
+/**
+ * Extract a 7z archive, decoding independent folders in parallel
+ * Non-solid archives and solid archives with block limits have one folder
+ * per block; each worker decodes whole folders through its own reader.
+ * Progress counts finished entries; a reporter thread passes it on at
+ * most every options->progress_interval_ms, and the final count is
+ * delivered before the call returns. Calls never overlap.
+ *
+ * options->include_patterns and exclude_patterns are globs over entry
+ * names ("*" within a component, "**" across them, "?", "[a-z]", "\\"
+ * escapes), also used by sevenzip_extract_from_stream() and
+ * sevenzip_extract_following(). Only entries matching an include pattern,
+ * if any, and no exclude pattern are extracted; a match on a directory
+ * takes everything under it. They are compiled once and tested in the
+ * pass that selects entries, so folders holding nothing wanted are not
+ * decoded, and others only as far as their last entry wanted. A malformed
+ * pattern fails with SEVENZIP_ERROR_INVALID_PARAM.
+ *
+ * With options->cache_neutral_output, written files are handed to
+ * writeback 8MB at a time and dropped from the page cache behind the write
+ * cursor, and each is on disk and out of the cache once closed, so large
+ * restores do not evict other processes' data. Linux uses sync_file_range
+ * and POSIX_FADV_DONTNEED and macOS F_NOCACHE; elsewhere only pages
+ * already written back are dropped.
+ *
+ * With options->existing, entries already extracted are skipped, and
+ * folders are decoded only as far as their last entry written.
+ *
+ * options->max_memory is checked against the coder props before anything
+ * is decoded: LZMA2 threads, then folders decoded at once, are reduced to
+ * fit, and an archive with one folder over it fails with
+ * SEVENZIP_ERROR_MEMORY.
+ * @param archive_path Path to the archive file
+ * @param output_dir Directory to extract to
+ * @param password Optional password (NULL if not encrypted)
+ * @param options Extraction options (NULL for defaults)
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_with_options(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Extract a streamable archive (SevenZipStreamOptions.streamable) read
+ * front to back from a callback, such as a pipe from curl or a tape
+ * The header copy at the front opens the archive; each folder is then
+ * decoded as its bytes arrive and its files written as they come out,
+ * holding one read buffer instead of the archive. Folders are decoded
+ * one at a time, each with num_threads LZMA2 threads; the other options
+ * apply as in sevenzip_extract_with_options(), entries already extracted
+ * under `existing` being decoded and dropped. The stream is read up to the
+ * archive's last byte (split volumes may be concatenated into it).
+ * @param read_callback Source of the archive bytes, 0 bytes at its end
+ * @param output_dir Directory to extract to
+ * @param options Extraction options (NULL for defaults)
+ * @param progress_callback Optional progress callback, finished entries (NULL to disable)
+ * @param user_data User data passed to both callbacks
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_ARCHIVE if the
+ *         stream is not a streamable archive, SEVENZIP_ERROR_EXTRACT if
+ *         the callback failed, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_from_stream(
+    SevenZipReadCallback read_callback,
+    const char* output_dir,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Extract a streamable archive (SevenZipStreamOptions.streamable) while
+ * it is still being written or downloaded, as sevenzip_extract_from_stream()
+ * does from a callback. The archive file, or its .NNN volumes, is read
+ * front to back; a read past what exists waits for more (polling every
+ * 50ms), so folders are decoded as their bytes arrive. The first volume
+ * is waited for too. A volume is complete once it reaches the size the
+ * index gives it (<archive_path>.7zidx, SevenZipStreamOptions.write_index,
+ * if present when the volume is opened); without an index, once the next
+ * volume exists, so volumes must then arrive whole or in order.
+ * @param archive_path Archive file, base of its volumes, or a .NNN volume
+ *        (read from .001)
+ * @param output_dir Directory to extract to
+ * @param options Extraction options (NULL for defaults), follow_timeout_ms
+ *        and cancel bounding the waits
+ * @param progress_callback Optional progress callback, finished entries (NULL to disable)
+ * @param user_data User data for callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_OPEN_FILE if no byte came
+ *         within follow_timeout_ms, SEVENZIP_ERROR_CANCELLED,
+ *         SEVENZIP_ERROR_INVALID_ARCHIVE if it is not a streamable
+ *         archive, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_following(
+    const char* archive_path,
+    const char* output_dir,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Estimate the peak decoder memory of sevenzip_extract_with_options()
+ * Reads only the archive header and sizes each folder's decoder from its
+ * coder props (dictionary capped at the folder size, PPMd model, filter
+ * and output windows, whole BCJ2 folders), for the folders decoded at
+ * once with options->num_threads and lzma2_threads. Applies the same
+ * fitting as the job itself (including max_memory), so the result is what
+ * the job will be held to. It is an upper bound: Lzma2DecMt threads are
+ * counted with the largest block they may hold, and the archive database
+ * itself is not counted.
+ * @param archive_path Path to the archive file (first volume of a split archive)
+ * @param options Extraction options (NULL for defaults)
+ * @param peak_bytes Output: estimated peak decoder memory in bytes
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_MEMORY if one folder on
+ *         one thread needs more than max_memory (peak_bytes is still set),
+ *         SEVENZIP_ERROR_OPEN_FILE or SEVENZIP_ERROR_INVALID_ARCHIVE
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_estimate_extract_memory(
+    const char* archive_path,
+    const SevenZipExtractOptions* options,
+    uint64_t* peak_bytes
+);
+
 /**
  * Extract specific files from a 7z archive
+ * Names are matched exactly against the entry names sevenzip_list()
+ * reports; naming a directory creates it but does not select its contents.
+ * Whatever order `files` names them in, entries are written in the order
+ * of their data, each folder decoded once across the span from its first
+ * to its last requested file.
  * @param archive_path Path to the archive file
  * @param output_dir Directory to extract to
  * @param files Array of file names to extract (NULL-terminated)
  * @param password Optional password (NULL if not encrypted)
  * @param progress_callback Optional progress callback (NULL to disable)
  * @param user_data User data passed to progress callback
- * @return SEVENZIP_OK on success, error code otherwise
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if a name matched
+ *         no entry (the others are still extracted), error code otherwise
  */
 SEVENZIP_API SevenZipErrorCode sevenzip_extract_files(
     const char* archive_path,
@@ -140,6 +720,74 @@ SEVENZIP_API SevenZipErrorCode sevenzip_extract_files(
     void* user_data
 );
 
+/**
+ * Extract one file, decoding as little of its folder as possible
+ * In a solid folder, decoding starts at the last LZMA2 dictionary reset
+ * at or before the file (archives written with several block threads
+ * reset at every block) and stops at the file's end. The same seeking is
+ * used by sevenzip_extract_files().
+ * @param archive_path Path to the archive file
+ * @param output_dir Directory to extract to
+ * @param file_name Entry name, as sevenzip_list() reports it
+ * @param password Optional password (NULL if not encrypted)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if no entry has
+ *         that name, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_file_fast(
+    const char* archive_path,
+    const char* output_dir,
+    const char* file_name,
+    const char* password
+);
+
+/**
+ * Extract entries into callbacks instead of files
+ * Each file entry gets begin_entry(), its bytes through write() as they
+ * are decoded, then end_entry() once its CRC matched; a file with a bad
+ * CRC gets no end_entry() and the call fails. Directories are not passed
+ * on. Empty files come first, then the files of each folder in archive
+ * order; callbacks run on the calling thread.
+ * @param archive_path Path to the archive file
+ * @param files Entry names to extract (NULL-terminated), or NULL for all
+ * @param password Optional password (NULL if not encrypted)
+ * @param sink Callbacks receiving the entries
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if a callback
+ *         stopped the extraction or a name matched no entry, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_to_sink(
+    const char* archive_path,
+    const char** files,
+    const char* password,
+    const SevenZipExtractSink* sink
+);
+
+/**
+ * Stream an archive out as a tar archive, without writing files
+ * Each entry becomes a ustar record built from its name, size, time and
+ * attributes (the Unix mode when the archive carries one), with a pax
+ * header for long names, sizes of 8GB or more and times before 1970.
+ * Directories come first, then empty files, then the files of each
+ * folder in archive order as they are decoded; folders are decoded one
+ * at a time, so memory is one folder decoder whatever the archive size.
+ * A file's bytes go out before its CRC is checked: a mismatch fails the
+ * call after that record, and the stream then has no end-of-archive blocks.
+ * @param archive_path Path to the archive file (first volume of a split archive)
+ * @param password Optional password (NULL if not encrypted)
+ * @param options Extraction options: num_threads goes to the LZMA2 decoder
+ *        (0 = auto: 2), max_memory and thread_weight apply (NULL for defaults)
+ * @param write_callback Receiver of the tar stream, called on the calling thread
+ * @param user_data User data passed to write_callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if write_callback
+ *         stopped the export or a CRC did not match, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_export_tar(
+    const char* archive_path,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipWriteCallback write_callback,
+    void* user_data
+);
+
 /**
  * Create a 7z archive
  * @param archive_path Path for the new archive file
@@ -161,13 +809,17 @@ SEVENZIP_API SevenZipErrorCode sevenzip_compress(
 
 /**
  * Create a multi-file archive with LZMA2 compression
+ * Writes the indexed 7ZFF format (version 2): files are compressed on two
+ * threads, their data is appended as each one finishes, and an index at
+ * the end records where every file's data is.
  * @param archive_path Path for the new archive file
  * @param input_paths Array of file paths to compress (NULL-terminated)
  * @param level Compression level
- * @param password Optional password (NULL for no encryption - not yet implemented)
+ * @param password Must be NULL: the format has no encryption
  * @param progress_callback Optional progress callback (NULL to disable)
  * @param user_data User data passed to progress callback
- * @return SEVENZIP_OK on success, error code otherwise
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_NOT_IMPLEMENTED with a
+ *         password, error code otherwise
  */
 SEVENZIP_API SevenZipErrorCode sevenzip_create_archive(
     const char* archive_path,
@@ -178,10 +830,48 @@ SEVENZIP_API SevenZipErrorCode sevenzip_create_archive(
     void* user_data
 );
 
+/**
+ * sevenzip_create_archive() with options
+ * Up to num_threads files are compressed at once, each on its own LZMA2
+ * encoder; threads left over when there are fewer files than threads go
+ * to the encoders' block threads. Memory holds the input mapping and the
+ * compressed data of each file being compressed. With dedup_chunk_size the
+ * files are cut into chunks instead, and only chunks not seen before are
+ * compressed, num_threads at once.
+ *
+ * Chunks are content-defined (FastCDC) with dedup_chunk_size rounded down
+ * to a power of two in 4KB-4MB as their average; each is a quarter to four
+ * times it. The calling thread reads and chunks the files while the
+ * workers compress, and each distinct chunk is stored once, in 7ZFF
+ * version 3, which only sevenzip_extract_archive*() read. 256KB suits
+ * disk images; smaller finds more repeats, larger compresses each chunk
+ * better.
+ * @param archive_path Path for the new archive file
+ * @param input_paths Array of file paths to compress (NULL-terminated)
+ * @param level Compression level
+ * @param options Compression options; num_threads, dict_size and
+ *                dedup_chunk_size are used, a password gives
+ *                SEVENZIP_ERROR_NOT_IMPLEMENTED (NULL for defaults)
+ * @param progress_callback Optional progress callback, files done of all files;
+ *                          may be called from any worker thread, one call at a time
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_create_archive_with_options(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
 /**
  * Create a standard .7z archive (compatible with 7-Zip)
  * Uses LZMA2 compression and creates archives readable by official 7-Zip
  * Supports: directories, large files (>4GB), multi-threading, solid compression
+ * With options->password the job is handed to sevenzip_create_7z_streaming(),
+ * which encrypts the data and the header with 7zAES.
  * @param archive_path Path for the output .7z file
  * @param input_paths Array of file/directory paths to compress (NULL-terminated)
  * @param level Compression level
@@ -199,118 +889,1511 @@ SEVENZIP_API SevenZipErrorCode sevenzip_create_7z(
     void* user_data
 );
 
+/** One entry of a pre-scanned input table (sevenzip_create_7z_from_table()) */
+typedef struct {
+    const char* path;           /* File to read (NULL for a directory, or for an empty entry such as a device node) */
+    const char* name;           /* Name in the archive, '/'-separated */
+    uint64_t size;              /* Bytes read from path (ignored without one) */
+    uint64_t mtime;             /* Modification time as FILETIME (100ns since 1601) */
+    uint32_t attrib;            /* st_mode on POSIX, FILE_ATTRIBUTE_* on Windows, as sevenzip_create_7z() stores them */
+    int is_dir;
+} SevenZipInputEntry;
+
 /**
- * Extract a multi-file archive created with sevenzip_create_archive()
- * @param archive_path Path to the archive file
- * @param output_dir Directory to extract to
- * @param password Optional password (NULL if not encrypted)
- * @param progress_callback Optional progress callback (NULL to disable)
+ * Create a .7z archive from entries the caller has already scanned
+ * Same as sevenzip_create_7z(), but nothing is stat'ed or walked: the
+ * entries are archived in the given order, with the given names, sizes,
+ * times and attributes, so a caller that walked the inputs itself (to
+ * size the job, say) does not have them walked again. Files are only
+ * opened when their data is compressed, and `size` bytes of each are
+ * archived; one that has shrunk below that fails the job.
+ * @param archive_path Path for the output .7z file
+ * @param entries Input table; strings need only last for the call
+ * @param count Number of entries
+ * @param level Compression level
+ * @param options Advanced options (NULL for defaults)
+ * @param progress_callback Optional progress callback, given entries taken and count (NULL to disable)
  * @param user_data User data passed to progress callback
- * @return SEVENZIP_OK on success, error code otherwise
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM for an entry without a name,
+ *         SEVENZIP_ERROR_NOT_IMPLEMENTED with a password
  */
-SEVENZIP_API SevenZipErrorCode sevenzip_extract_archive(
+SEVENZIP_API SevenZipErrorCode sevenzip_create_7z_from_table(
     const char* archive_path,
-    const char* output_dir,
-    const char* password,
+    const SevenZipInputEntry* entries,
+    size_t count,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
     SevenZipProgressCallback progress_callback,
     void* user_data
 );
 
-/**
- * List contents of a 7z archive
- * @param archive_path Path to the archive file
- * @param password Optional password (NULL if not encrypted)
- * @param list Pointer to receive the list result (must be freed with sevenzip_free_list)
- * @return SEVENZIP_OK on success, error code otherwise
- */
-SEVENZIP_API SevenZipErrorCode sevenzip_list(
-    const char* archive_path,
-    const char* password,
-    SevenZipList** list
-);
+/** One archive of a sevenzip_create_7z_batch() call */
+typedef struct {
+    const char* archive_path;   /* Path for the output .7z file */
+    const char** input_paths;   /* NULL-terminated, as in sevenzip_create_7z() */
+} SevenZipBatchEntry;
 
 /**
- * Free memory allocated by sevenzip_list
- * @param list List to free
+ * Create many small .7z archives in one call
+ * Entries are handed out to a pool of workers, each compressing one archive
+ * at a time with a single encoder thread. A worker keeps its LZMA2 encoder
+ * (match finder tables included) and I/O buffers from one archive to the
+ * next, so small archives cost their compression work rather than setup.
+ * Once options->cancel is cancelled, entries not yet started fail with
+ * SEVENZIP_ERROR_CANCELLED.
+ * @param entries Archives to create
+ * @param count Number of entries
+ * @param level Compression level for every archive
+ * @param options Options for every archive; num_threads is the number of
+ *                workers (NULL or 0 = hardware threads, within the
+ *                sevenzip_init_with_options() quota)
+ * @param results Receives the result of each entry (count elements)
+ * @return SEVENZIP_OK if every archive was created, otherwise the first
+ *         failing entry's code (see results for the others)
  */
-SEVENZIP_API void sevenzip_free_list(SevenZipList* list);
+SEVENZIP_API SevenZipErrorCode sevenzip_create_7z_batch(
+    const SevenZipBatchEntry* entries,
+    size_t count,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipErrorCode* results
+);
 
 /**
- * Test archive integrity without extracting
- * Validates CRCs, decompression, and structure without writing files to disk
- * @param archive_path Path to the archive file (supports split volumes)
- * @param password Optional password (NULL if not encrypted)
+ * Add new and changed files to an existing .7z archive
+ * Inputs are named as in sevenzip_create_7z(). An archived entry whose
+ * input has the same name, type, size and modification time (to the
+ * second) is kept as it is; entries without a matching input are kept
+ * too. Folders with no superseded file are copied byte-for-byte without
+ * decoding; a folder that loses a file is decoded once and its remaining
+ * files are compressed again with the new inputs. The result is written
+ * to "<archive_path>.tmp" and then replaces the archive.
+ * @param archive_path Archive to update (created if it does not exist)
+ * @param input_paths Array of file/directory paths (NULL-terminated)
+ * @param level Compression level for new data
+ * @param options Advanced options for new data (NULL for defaults)
  * @param progress_callback Optional progress callback (NULL to disable)
  * @param user_data User data passed to progress callback
- * @return SEVENZIP_OK if archive is valid, error code otherwise
+ * @return SEVENZIP_OK on success (also when nothing changed),
+ *         SEVENZIP_ERROR_INVALID_ARCHIVE if the archive cannot be read,
+ *         SEVENZIP_ERROR_NOT_IMPLEMENTED with a password for an existing archive
  */
-SEVENZIP_API SevenZipErrorCode sevenzip_test_archive(
+SEVENZIP_API SevenZipErrorCode sevenzip_update_archive(
     const char* archive_path,
-    const char* password,
-    SevenZipBytesProgressCallback progress_callback,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
     void* user_data
 );
 
 /**
- * Decompress a standalone LZMA file (.lzma)
- * @param lzma_path Path to the .lzma file
- * @param output_path Path for the decompressed output file
+ * Remove entries from a .7z archive without rebuilding it
+ * Folders holding none of the named entries are copied byte-for-byte;
+ * a folder that loses an entry is decoded once and its other files are
+ * compressed again with `level` and `options`, so smaller solid blocks
+ * bound the rewrite to the blocks involved. A name also removes every
+ * entry below it. The result is written to "<archive_path>.tmp" and then
+ * replaces the archive; nothing is written when no entry matches.
+ * @param archive_path Archive to edit
+ * @param entry_names Entry names as listed (NULL-terminated)
+ * @param level Compression level for repacked folders
+ * @param options Advanced options for repacked folders (NULL for defaults)
+ * @param deleted_count Output: entries removed (may be NULL)
+ * @return SEVENZIP_OK on success (also when nothing matched),
+ *         SEVENZIP_ERROR_INVALID_ARCHIVE if the archive cannot be read,
+ *         SEVENZIP_ERROR_NOT_IMPLEMENTED with a password
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_delete_entries(
+    const char* archive_path,
+    const char** entry_names,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    size_t* deleted_count
+);
+
+/**
+ * Compress one subset of a dataset into a part for sevenzip_assemble_archive()
+ * Parts can be made on different machines at the same time. A part is an
+ * ordinary .7z archive: its packed streams, then a header holding the
+ * folder metadata (coders and their properties, unpack sizes, CRCs), so
+ * it can be tested or extracted where it was made.
+ * @param part_path Part file to create
+ * @param input_paths Array of file/directory paths (NULL-terminated),
+ *                    named as in sevenzip_create_7z()
+ * @param name_prefix Directory the part's entries are put under, to keep
+ *                    the names of different parts apart (NULL = none)
+ * @param level Compression level
+ * @param options Advanced options (NULL for defaults)
  * @param progress_callback Optional progress callback (NULL to disable)
  * @param user_data User data passed to progress callback
- * @return SEVENZIP_OK on success, error code otherwise
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_NOT_IMPLEMENTED with a
+ *         password, error code otherwise
  */
-SEVENZIP_API SevenZipErrorCode sevenzip_decompress_lzma(
-    const char* lzma_path,
-    const char* output_path,
+SEVENZIP_API SevenZipErrorCode sevenzip_compress_folder_part(
+    const char* part_path,
+    const char** input_paths,
+    const char* name_prefix,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
     SevenZipProgressCallback progress_callback,
     void* user_data
 );
 
 /**
- * Decompress a standalone LZMA2 file (.xz or custom format)
- * @param lzma2_path Path to the LZMA2 file
- * @param output_path Path for the decompressed output file
- * @param progress_callback Optional progress callback (NULL to disable)
+ * Concatenate parts into one .7z archive
+ * Nothing is decoded or compressed: each part's packed streams are copied
+ * byte-for-byte in part order (file-to-file in the kernel on Linux), and
+ * one header describing all their folders and entries is written. The
+ * start header is known before any data, so the output is written front
+ * to back. Entry names are not
+ * checked for clashes between parts. Any 7z archive this library can
+ * read without a password serves as a part.
+ * @param archive_path Archive to create (base name of the volumes if split)
+ * @param part_paths Array of part paths (NULL-terminated)
+ * @param split_size Volume size in bytes: archive_path.001, .002, ...
+ *                   (0 = one archive file)
+ * @param progress_callback Optional progress callback, called with the
+ *                          folders copied and the total (NULL to disable)
  * @param user_data User data passed to progress callback
- * @return SEVENZIP_OK on success, error code otherwise
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_ARCHIVE if a part
+ *         cannot be read; written files are removed on failure
  */
-SEVENZIP_API SevenZipErrorCode sevenzip_decompress_lzma2(
-    const char* lzma2_path,
-    const char* output_path,
+SEVENZIP_API SevenZipErrorCode sevenzip_assemble_archive(
+    const char* archive_path,
+    const char** part_paths,
+    uint64_t split_size,
     SevenZipProgressCallback progress_callback,
     void* user_data
 );
 
-/**
- * Get error message for error code
- * @param error_code Error code
- * @return Human-readable error message
- */
-SEVENZIP_API const char* sevenzip_get_error_message(SevenZipErrorCode error_code);
+/* Files of one name in several merged archives */
+typedef enum {
+    SEVENZIP_MERGE_RENAME = 0,   /* Later ones become "<stem> (2)<ext>", "(3)", ... */
+    SEVENZIP_MERGE_KEEP_ALL = 1  /* Each listed under the name; extraction leaves the last */
+} SevenZipMergeNames;
+
+/* Options of sevenzip_merge_archives() */
+typedef struct {
+    SevenZipMergeNames names;  /* Name clashes between files (default: SEVENZIP_MERGE_RENAME) */
+    int drop_identical;        /* Leave out a file with the name, size and CRC (empty files: attributes) of an earlier one when every file of its folder goes, so the folder is not copied; otherwise it clashes as names says (default: 1) */
+    uint64_t split_size;       /* Volume size in bytes: archive_path.001, .002, ... (0 = one archive file) */
+} SevenZipMergeOptions;
+
+/* Initialize merge options with defaults */
+SEVENZIP_API void sevenzip_merge_options_init(SevenZipMergeOptions* options);
 
 /**
- * Get library version
- * @return Version string (e.g., "1.0.0")
+ * Merge .7z archives into one without recompressing
+ * As sevenzip_assemble_archive(), each input's folders are copied as they
+ * are (with copy_file_range on Linux, which shares extents where the
+ * filesystem can) and one header is written, so the cost is the I/O of
+ * the kept packed bytes. Directories of one name become one entry, and
+ * files of one name are deduplicated or renamed as `options` says.
+ * @param archive_path Archive to create (base name of the volumes if split)
+ * @param input_paths Archives to merge, in order (NULL-terminated)
+ * @param options Merge options (NULL for defaults)
+ * @param progress_callback Optional progress callback, called with the
+ *                          folders copied and the total (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_ARCHIVE if an
+ *         input cannot be read; written files are removed on failure
  */
-SEVENZIP_API const char* sevenzip_get_version(void);
+SEVENZIP_API SevenZipErrorCode sevenzip_merge_archives(
+    const char* archive_path,
+    const char** input_paths,
+    const SevenZipMergeOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
 
 /**
- * Initialize streaming options with defaults
- * @param options Pointer to options structure to initialize
+ * Cut a split archive into volumes of another size, or join it into one file
+ * A split archive is its volumes' bytes end to end, so nothing is decoded:
+ * the bytes go volume to volume, file-to-file in the kernel on Linux.
+ * The start header is checked first, so a missing volume is reported
+ * before anything is written; bytes past the archive's end are left out.
+ * @param src_first_volume First volume (name.7z.001), or a single archive file
+ * @param dst_base Output archive, or base name of its volumes; must not
+ *                 name the source volumes
+ * @param new_split_size Volume size in bytes: dst_base.001, .002, ...
+ *                       (0 = join into the one file dst_base)
+ * @param progress_callback Optional progress callback, called with the
+ *                          bytes written and the total (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_ARCHIVE if the
+ *         source is not a complete 7z archive; written files are removed
+ *         on failure
  */
-SEVENZIP_API void sevenzip_stream_options_init(SevenZipStreamOptions* options);
+SEVENZIP_API SevenZipErrorCode sevenzip_resplit_archive(
+    const char* src_first_volume,
+    const char* dst_base,
+    uint64_t new_split_size,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
 
 /**
- * Create a 7z archive with streaming compression (handles large files and splits)
+ * Extract a multi-file archive created with sevenzip_create_archive()
+ * Reads every 7ZFF version; files of versions 2 and 3 are checked
+ * against their CRC32. This is sevenzip_extract_archive_with_options() with defaults.
+ * @param archive_path Path to the archive file
+ * @param output_dir Directory to extract to
+ * @param password Must be NULL: 7ZFF archives are not encrypted
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_NOT_IMPLEMENTED with a
+ *         password, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_archive(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Extract a multi-file archive on several threads
+ * Each worker reads the archive through its own mapping and decodes whole
+ * files, taking them in the order of their data.
+ * @param archive_path Path to the archive file
+ * @param output_dir Directory to extract to
+ * @param options Extraction options; num_threads (files decoded at once,
+ *                0 = auto: 4, fewer on fewer CPUs), sparse_output and
+ *                cache_neutral_output are used (NULL for defaults)
+ * @param progress_callback Optional progress callback, files done of all files;
+ *                          may be called from any worker thread, one call at a time
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_archive_with_options(
+    const char* archive_path,
+    const char* output_dir,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Extract one file of a multi-file archive
+ * The entry table gives the file's offset, so only its own data is read.
+ * @param archive_path Path to the archive file
+ * @param output_dir Directory to extract to
+ * @param file_name Entry name, as stored by sevenzip_create_archive()
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if no entry has
+ *         that name, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_archive_file(
+    const char* archive_path,
+    const char* output_dir,
+    const char* file_name
+);
+
+/**
+ * List contents of a 7z archive
+ * @param archive_path Path to the archive file
+ * @param password Optional password (NULL if not encrypted)
+ * @param list Pointer to receive the list result (must be freed with sevenzip_free_list)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_list(
+    const char* archive_path,
+    const char* password,
+    SevenZipList** list
+);
+
+/**
+ * Free memory allocated by sevenzip_list
+ * A list is a single allocation; entry names point into it.
+ * @param list List to free
+ */
+SEVENZIP_API void sevenzip_free_list(SevenZipList* list);
+
+/**
+ * List an archive from its .7zidx sidecar (SevenZipStreamOptions.write_index)
+ * No volume is opened and no header parsed: the index holds the entry
+ * table as written, for archives on tape or object storage where fetching
+ * the first and last volume is slow. packed_size is 0, as sevenzip_list()
+ * reports it.
+ * @param index_path Path of the index, <archive_path>.7zidx
+ * @param list Pointer to receive the list result (must be freed with sevenzip_free_list)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_OPEN_FILE if it cannot be
+ *         read, SEVENZIP_ERROR_INVALID_ARCHIVE if it is not an intact index
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_list_index(
+    const char* index_path,
+    SevenZipList** list
+);
+
+/* Catalog of the entries of many archives, see sevenzip_catalog_build() */
+typedef struct SevenZipCatalog SevenZipCatalog;
+
+/* folder_index of a SevenZipCatalogHit without data */
+#define SEVENZIP_CATALOG_NO_FOLDER 0xFFFFFFFFu
+
+/* One entry a catalog lookup found */
+typedef struct {
+    const char* archive_path;  /* As given to sevenzip_catalog_build(), valid until sevenzip_catalog_close() */
+    uint32_t archive_index;    /* Position in the build's archive_paths */
+    uint32_t entry_index;      /* Entry of the archive, for sevenzip_archive_extract_entry() */
+    uint32_t folder_index;     /* Folder holding the data (SEVENZIP_CATALOG_NO_FOLDER for directories and empty files) */
+    uint64_t size;             /* Uncompressed size */
+    uint64_t pack_offset;      /* Offset of the folder's packed data from the start of the archive's first volume (0 without a folder) */
+    int is_directory;          /* 1 if directory, 0 if file */
+} SevenZipCatalogHit;
+
+/**
+ * Write a catalog of every entry of many archives, sorted by path
+ * Each archive is read from its .7zidx sidecar when there is an intact
+ * one, without opening a volume, else from its header. The catalog holds
+ * the archive paths as given, and per entry its path, archive, entry and
+ * folder index and the folder's pack offset, in fixed-width records
+ * searched in place once mapped by sevenzip_catalog_open(). It is written
+ * to a temporary file renamed into place.
+ * @param archive_paths Archives to catalog (split volumes by their first volume)
+ * @param count Number of archives
+ * @param catalog_path Path of the catalog file
+ * @return SEVENZIP_OK, the error of the first archive that could not be
+ *         read, or SEVENZIP_ERROR_OPEN_FILE if the catalog could not be written
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_catalog_build(
+    const char** archive_paths,
+    size_t count,
+    const char* catalog_path
+);
+
+/**
+ * Map a catalog for lookups
+ * Only the header is checked here; the tables are read in place.
+ * @param catalog_path Path of the catalog file
+ * @param catalog Receives the handle (must be closed with sevenzip_catalog_close)
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_OPEN_FILE, or
+ *         SEVENZIP_ERROR_INVALID_ARCHIVE if it is not an intact catalog
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_catalog_open(
+    const char* catalog_path,
+    SevenZipCatalog** catalog
+);
+
+/**
+ * Find the entries named `path` across the catalogued archives
+ * A binary search over the sorted records; nothing is allocated and the
+ * handle may be searched from several threads at once. Hits come in
+ * archive order. A hit opens with sevenzip_open(hit.archive_path) and
+ * extracts with sevenzip_archive_extract_entry(hit.entry_index).
+ * @param catalog Open catalog
+ * @param path Entry path, exactly as sevenzip_list() reports it
+ * @param hits Receives up to max_hits entries (may be NULL when max_hits is 0)
+ * @param max_hits Capacity of hits
+ * @param count Receives the number of entries named `path`, which may exceed max_hits
+ * @return SEVENZIP_OK (count 0 if no archive has the path), or
+ *         SEVENZIP_ERROR_INVALID_ARCHIVE for a damaged record
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_catalog_lookup(
+    const SevenZipCatalog* catalog,
+    const char* path,
+    SevenZipCatalogHit* hits,
+    size_t max_hits,
+    size_t* count
+);
+
+/**
+ * Unmap a catalog; the archive_path of its hits are no longer valid
+ */
+SEVENZIP_API void sevenzip_catalog_close(SevenZipCatalog* catalog);
+
+/* Archive opened once for several list and extract calls */
+typedef struct SevenZipArchive SevenZipArchive;
+
+/**
+ * Open an archive and parse its header once
+ * The volumes stay open and the header parsed until sevenzip_close().
+ * List, extract and entry reader calls may run on one handle from several
+ * threads at once: each reads with positioned reads (or its own view of
+ * the mapped volumes) and decoder state of its own. Only sevenzip_close()
+ * must wait for the others.
+ * @param archive_path Path to the archive file (supports split volumes)
+ * @param password Optional password (NULL if not encrypted)
+ * @param archive Receives the handle (must be closed with sevenzip_close)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_open(
+    const char* archive_path,
+    const char* password,
+    SevenZipArchive** archive
+);
+
+/*
+ * Positioned reads of an archive held elsewhere (HTTP range requests,
+ * object store GETs). read_at fills `buf` with exactly `size` bytes from
+ * `offset` and returns 0, or returns non-zero on failure; it may be called
+ * from several threads at once when calls on the handle run in parallel.
+ */
+typedef struct {
+    int (*read_at)(void* user_data, uint64_t offset, void* buf, size_t size);
+    uint64_t size;             /* Total size of the archive in bytes */
+    void* user_data;           /* Passed to read_at */
+} SevenZipRangeReader;
+
+/**
+ * Open an archive through a read-at-offset callback
+ * The handle works as one from sevenzip_open(). Reads are gathered into
+ * requests of whole 1MB blocks, of which 16 are kept for every call on the
+ * handle; a call reading on sequentially, as folder decoding does, fetches
+ * further ahead with each request, up to 8MB. Opening and listing cost the
+ * first block and the header's; extracting one entry the blocks of its
+ * folder up to that entry.
+ * @param reader Callback and archive size, copied; read_at and user_data
+ *               must stay valid until sevenzip_close()
+ * @param password Optional password (NULL if not encrypted)
+ * @param archive Receives the handle (must be closed with sevenzip_close)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_ARCHIVE if it is
+ *         not a 7z archive or a read failed, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_open_range(
+    const SevenZipRangeReader* reader,
+    const char* password,
+    SevenZipArchive** archive
+);
+
+/**
+ * List the entries of an open archive, as sevenzip_list() does
+ * entries[i] describes entry index i of sevenzip_archive_extract_entry().
+ * @param archive Open archive
+ * @param list Pointer to receive the list result (must be freed with sevenzip_free_list)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_list(
+    SevenZipArchive* archive,
+    SevenZipList** list
+);
+
+/**
+ * List a page of the entries of an open archive
+ * Memory is bounded by the page, so archives with millions of entries can
+ * be listed in steps: call with first_index 0, max_entries, 2*max_entries
+ * ... until the page comes back with fewer than max_entries entries.
+ * @param archive Open archive
+ * @param first_index Index of the first entry of the page
+ * @param max_entries Largest number of entries to return
+ * @param list Receives entries [first_index, first_index + count), count
+ *        0 past the end (must be freed with sevenzip_free_list)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_list_page(
+    SevenZipArchive* archive,
+    uint32_t first_index,
+    uint32_t max_entries,
+    SevenZipList** list
+);
+
+/**
+ * Number of entries of an open archive (0 for NULL)
+ */
+SEVENZIP_API uint32_t sevenzip_archive_entry_count(const SevenZipArchive* archive);
+
+/* Columns of sevenzip_archive_list_columns(), or'ed into its field mask */
+typedef enum {
+    SEVENZIP_FIELD_NAME = 0x01,          /* names */
+    SEVENZIP_FIELD_SIZE = 0x02,          /* sizes */
+    SEVENZIP_FIELD_MTIME = 0x04,         /* modified_times */
+    SEVENZIP_FIELD_ATTRIBUTES = 0x08,    /* attributes */
+    SEVENZIP_FIELD_IS_DIRECTORY = 0x10,  /* is_directory */
+    SEVENZIP_FIELD_ALL = 0x1F
+} SevenZipListField;
+
+/* Entries of a list page as columns; a column not requested is NULL */
+typedef struct {
+    size_t count;              /* Entries in each column */
+    char** names;              /* UTF-8, NULL for an unnamed entry */
+    uint64_t* sizes;           /* Uncompressed sizes */
+    uint64_t* modified_times;  /* Unix timestamps, 0 when not stored */
+    uint32_t* attributes;      /* File attributes */
+    uint8_t* is_directory;     /* 1 if directory, 0 if file */
+} SevenZipListColumns;
+
+/**
+ * List a page of the entries of an open archive, only the fields asked for
+ * Like sevenzip_archive_list_page(), but each field is an array of its
+ * own and fields outside `fields` are neither converted nor allocated: a
+ * size total needs no UTF-16 conversion of the names, a path index no
+ * time conversion. The columns are one allocation.
+ * @param archive Open archive
+ * @param first_index Index of the first entry of the page
+ * @param max_entries Largest number of entries to return
+ * @param fields SEVENZIP_FIELD_* flags
+ * @param columns Receives entries [first_index, first_index + count)
+ *        (must be freed with sevenzip_free_list_columns)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_list_columns(
+    SevenZipArchive* archive,
+    uint32_t first_index,
+    uint32_t max_entries,
+    uint32_t fields,
+    SevenZipListColumns** columns
+);
+
+/**
+ * Free columns allocated by sevenzip_archive_list_columns
+ * @param columns Columns to free (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_free_list_columns(SevenZipListColumns* columns);
+
+/**
+ * Pass one file of an open archive to a sink
+ * The sink sees begin_entry, any write calls and end_entry for this file
+ * only; end_entry follows the CRC check. A folder of up to 64MB unpacked
+ * (see sevenzip_archive_set_folder_cache) is decoded whole once and kept,
+ * so further entries of the same folder are copied from memory, also by
+ * calls on other threads; entries of larger folders, and of other folders
+ * while one is being cached, are decoded from the nearest point the coder
+ * can start at.
+ * @param archive Open archive
+ * @param entry_index Entry to extract, as in sevenzip_archive_list()
+ * @param sink Callbacks receiving the file
+ * @return SEVENZIP_OK on success; SEVENZIP_ERROR_INVALID_PARAM for a
+ *         directory or an index past the end; SEVENZIP_ERROR_EXTRACT if a
+ *         callback asked to stop or the data is corrupt
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_extract_entry(
+    SevenZipArchive* archive,
+    uint32_t entry_index,
+    const SevenZipExtractSink* sink
+);
+
+/**
+ * Pass a queue of files of an open archive to a sink, in the order of
+ * their data rather than the order requested
+ * Empty files come first, then the requested files of each folder in
+ * archive order; each folder is decoded at most once, across the span
+ * from its first to its last requested file (or copied from the cache as
+ * by sevenzip_archive_extract_entry()), so a list gathered from many
+ * requests costs one pass over the folders it touches. An index given
+ * twice is passed on once.
+ * @param archive Open archive
+ * @param entry_indices Entries to extract, as in sevenzip_archive_list(), in any order
+ * @param count Number of indices
+ * @param sink Callbacks receiving the files
+ * @return SEVENZIP_OK on success; SEVENZIP_ERROR_INVALID_PARAM, before
+ *         anything is passed on, for a directory or an index past the
+ *         end; SEVENZIP_ERROR_EXTRACT if a callback asked to stop or the
+ *         data is corrupt
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_extract_entries(
+    SevenZipArchive* archive,
+    const uint32_t* entry_indices,
+    uint32_t count,
+    const SevenZipExtractSink* sink
+);
+
+/**
+ * Largest folder that sevenzip_archive_extract_entry() decodes whole and
+ * keeps for later entries of the same folder
+ * Above 64MB is clamped to 64MB; 0 streams every entry and keeps nothing,
+ * for callers whose threads read unrelated entries.
+ * @param archive Open archive
+ * @param max_folder_size Unpacked bytes (default 64MB)
+ */
+SEVENZIP_API void sevenzip_archive_set_folder_cache(
+    SevenZipArchive* archive,
+    uint64_t max_folder_size
+);
+
+/**
+ * Total unpacked bytes of the folders sevenzip_archive_extract_entry()
+ * keeps decoded; past it the least recently read folder is dropped first,
+ * so repeated reads of a few hot folders cost a copy each
+ * A folder larger than the budget is streamed; 0 streams every entry and
+ * keeps nothing. A folder being copied from is freed once the copy ends.
+ * @param archive Open archive
+ * @param total_bytes Unpacked bytes (default 64MB)
+ */
+SEVENZIP_API void sevenzip_archive_set_cache_budget(
+    SevenZipArchive* archive,
+    uint64_t total_bytes
+);
+
+/* One file of an open archive, read a piece at a time */
+typedef struct SevenZipEntryReader SevenZipEntryReader;
+
+/**
+ * Open one file of an open archive for reading
+ * The file is decoded as by sevenzip_archive_extract_entry(), on a thread
+ * of its own, 1MB ahead of the reads. The archive must not be closed
+ * until the reader is closed.
+ * @param archive Open archive
+ * @param entry_index Entry to read, as in sevenzip_archive_list()
+ * @param reader Output: the reader (close with sevenzip_entry_reader_close)
+ * @return SEVENZIP_OK on success; SEVENZIP_ERROR_INVALID_PARAM for a
+ *         directory or an index past the end
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_entry_reader_open(
+    SevenZipArchive* archive,
+    uint32_t entry_index,
+    SevenZipEntryReader** reader
+);
+
+/**
+ * Read the next bytes of the file
+ * Waits for at least one byte unless the file has ended. Data reaches the
+ * reader before the CRC of the whole file is known: a mismatch is
+ * reported in place of the end.
+ * @param reader Reader
+ * @param buffer Buffer for the data
+ * @param size In: capacity of buffer; out: bytes read, 0 at the end
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT for corrupt data
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_entry_reader_read(
+    SevenZipEntryReader* reader,
+    void* buffer,
+    size_t* size
+);
+
+/**
+ * Close a reader, stopping the decoder if the file was not read to the end
+ * @param reader Reader (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_entry_reader_close(SevenZipEntryReader* reader);
+
+/**
+ * Read bytes at an offset of one file of an open archive, as pread() does
+ * A file of a folder the cache keeps (see sevenzip_archive_set_cache_budget)
+ * is copied from it, its CRC checked when the folder was decoded; others
+ * are decoded from the nearest point the coder can start at before the
+ * offset up to the end of the range, without a CRC check.
+ * @param archive Open archive
+ * @param entry_index File to read, as in sevenzip_archive_list()
+ * @param offset Byte of the file to start at
+ * @param buffer Buffer for the data
+ * @param size In: capacity of buffer; out: bytes read, short only at the
+ *        end of the file (0 at or past it)
+ * @return SEVENZIP_OK on success; SEVENZIP_ERROR_INVALID_PARAM for a
+ *         directory or an index past the end; SEVENZIP_ERROR_EXTRACT for
+ *         corrupt data
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_pread(
+    SevenZipArchive* archive,
+    uint32_t entry_index,
+    uint64_t offset,
+    void* buffer,
+    size_t* size
+);
+
+/* entry_index of a directory that only appears in other entries' paths */
+#define SEVENZIP_VFS_NO_ENTRY 0xFFFFFFFFu
+
+/* A file or directory of an open archive's tree */
+typedef struct {
+    uint32_t entry_index;    /* As in sevenzip_archive_list(), or SEVENZIP_VFS_NO_ENTRY */
+    uint64_t size;           /* Uncompressed size (0 for directories) */
+    uint64_t modified_time;  /* Unix timestamp (0 if not stored) */
+    uint32_t attributes;     /* File attributes */
+    int is_directory;        /* 1 if directory, 0 if file */
+} SevenZipVfsStat;
+
+/**
+ * Called by sevenzip_archive_readdir() for each child of a directory
+ * @param name Name of the child (UTF-8, no separators), valid until sevenzip_close()
+ * @param stat What sevenzip_archive_stat() gives for the child
+ * @param user_data User-provided data pointer
+ * @return 0 to continue, nonzero to stop the listing
+ */
+typedef int (*SevenZipVfsDirCallback)(const char* name, const SevenZipVfsStat* stat, void* user_data);
+
+/**
+ * Look up a path of an open archive, for a filesystem view of it
+ * The tree is built from the header by the first stat or readdir call and
+ * kept with the handle, so later lookups cost a hash probe per component.
+ * '/' and '\' both separate components; leading, trailing and repeated
+ * separators and "." components are ignored, so "" and "/" are the root.
+ * Directories that only appear in other entries' paths are listed too.
+ * @param archive Open archive
+ * @param path Path inside the archive (UTF-8)
+ * @param stat Receives the file or directory
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_OPEN_FILE if nothing is
+ *         at path
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_stat(
+    SevenZipArchive* archive,
+    const char* path,
+    SevenZipVfsStat* stat
+);
+
+/**
+ * List the children of a directory of an open archive, in archive order
+ * @param archive Open archive
+ * @param path Directory inside the archive, as for sevenzip_archive_stat()
+ * @param callback Called for each child
+ * @param user_data User data for the callback
+ * @return SEVENZIP_OK on success (also when the callback stopped),
+ *         SEVENZIP_ERROR_OPEN_FILE if nothing is at path,
+ *         SEVENZIP_ERROR_INVALID_PARAM if it is a file
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_readdir(
+    SevenZipArchive* archive,
+    const char* path,
+    SevenZipVfsDirCallback callback,
+    void* user_data
+);
+
+/**
+ * Close an archive opened with sevenzip_open()
+ * @param archive Handle to close (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_close(SevenZipArchive* archive);
+
+/**
+ * Test archive integrity without extracting
+ * Validates CRCs, decompression, and structure without writing files to disk
+ * @param archive_path Path to the archive file (supports split volumes)
+ * @param password Optional password (NULL if not encrypted)
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK if archive is valid, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_test_archive(
+    const char* archive_path,
+    const char* password,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * sevenzip_test_archive() with independent folders verified in parallel
+ * Each folder is decoded front to back with its file CRCs checked as the
+ * bytes come out; nothing is buffered beyond the decoder. Workers read
+ * the volumes at their own offsets, so folders in different volumes are
+ * read at once. Testing stops at the first failed folder. Byte progress
+ * may be reported from any worker thread, one call at a time.
+ * @param archive_path Path to the archive file (supports split volumes)
+ * @param password Optional password (NULL if not encrypted)
+ * @param options num_threads and lzma2_threads as for extraction (NULL for defaults)
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK if archive is valid, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_test_archive_with_options(
+    const char* archive_path,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
+/* Work sevenzip_archive_batch() does on each archive */
+typedef enum {
+    SEVENZIP_ARCHIVE_BATCH_LIST = 0,  /* Header parsed and entries listed */
+    SEVENZIP_ARCHIVE_BATCH_TEST = 1   /* Listed, then every folder decoded with its file CRCs checked */
+} SevenZipArchiveBatchMode;
+
+/* sevenzip_archive_batch() options, set up with sevenzip_archive_batch_options_init() */
+typedef struct {
+    SevenZipArchiveBatchMode mode;  /* default: SEVENZIP_ARCHIVE_BATCH_LIST */
+    int num_threads;                /* Archives processed at once; with fewer archives than threads, the rest go to their LZMA2 decoders (0 = hardware threads, within the sevenzip_init_with_options() quota) */
+    int io_depth;                   /* Reads in flight at once across the whole batch, each one look-buffer refill of 256KB (0 = one per archive processed at once) */
+    int thread_weight;              /* Share of the thread quota, as in SevenZipCompressOptions (0 = 1) */
+    SevenZipCancelToken* cancel;    /* Stops the batch once cancelled: archives in progress and not yet started fail with SEVENZIP_ERROR_CANCELLED (NULL = not cancellable) */
+} SevenZipArchiveBatchOptions;
+
+/* Outcome of one archive of a batch */
+typedef struct {
+    size_t index;                   /* Position in archive_paths */
+    const char* archive_path;
+    SevenZipErrorCode result;       /* SEVENZIP_OK, or why the archive could not be listed or failed its test */
+    const SevenZipList* list;       /* Entries once the header parsed, else NULL; valid during the callback only */
+    uint32_t num_folders;           /* Folders (solid blocks) of the archive */
+    uint64_t unpacked_size;         /* Sum of the entry sizes */
+    uint64_t packed_size;           /* Bytes of packed streams */
+    uint64_t tested_bytes;          /* SEVENZIP_ARCHIVE_BATCH_TEST: bytes of the entries whose CRC matched */
+} SevenZipArchiveBatchResult;
+
+/* Receives each archive as it finishes; nonzero stops the batch */
+typedef int (*SevenZipArchiveBatchCallback)(const SevenZipArchiveBatchResult* result, void* user_data);
+
+SEVENZIP_API void sevenzip_archive_batch_options_init(SevenZipArchiveBatchOptions* options);
+
+/**
+ * List or test many archives on one pool of workers
+ * Archives are handed out in order to whichever worker is free; each
+ * worker parses an archive's header and, in test mode, decodes its
+ * folders front to back, so headers of later archives are read while
+ * earlier ones decode. Reads of every worker share io_depth slots, which
+ * keeps the batch from flooding a slow disk or network mount with one
+ * request per thread. Results come back through `callback` in completion
+ * order, one call at a time, from any worker thread.
+ * @param archive_paths Archives to process (split volumes by their first volume)
+ * @param count Number of paths
+ * @param options Options (NULL for defaults)
+ * @param callback Receives each archive's result (may be NULL)
+ * @param user_data Passed to callback
+ * @return SEVENZIP_OK if every archive succeeded, SEVENZIP_ERROR_CANCELLED
+ *         if the callback stopped the batch, otherwise the code of the
+ *         lowest-numbered failed archive
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_archive_batch(
+    const char** archive_paths,
+    size_t count,
+    const SevenZipArchiveBatchOptions* options,
+    SevenZipArchiveBatchCallback callback,
+    void* user_data
+);
+
+/**
+ * Decompress a standalone LZMA file (.lzma)
+ * @param lzma_path Path to the .lzma file
+ * @param output_path Path for the decompressed output file
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_lzma(
+    const char* lzma_path,
+    const char* output_path,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Compress one file to a standalone LZMA file (.lzma)
+ * Writes the 13-byte .lzma header (properties and size) followed by the
+ * LZMA stream, the format sevenzip_decompress_lzma() reads. The file is
+ * streamed through the encoder, so memory does not grow with its size.
+ * The size is written into the header once the input has been read; an
+ * output that cannot seek (a pipe) keeps it unknown and ends the stream
+ * with an end marker.
+ * @param input_path Path of the file to compress
+ * @param output_path Path for the .lzma file
+ * @param level Compression level
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_compress_lzma(
+    const char* input_path,
+    const char* output_path,
+    SevenZipCompressionLevel level,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Compress one file to a standalone LZMA2 file
+ * Writes the properties byte followed by the raw LZMA2 stream, the format
+ * sevenzip_decompress_lzma2() reads. The file is streamed through the
+ * encoder, with blocks compressed on several threads when the host has
+ * them, so memory does not grow with its size.
+ * @param input_path Path of the file to compress
+ * @param output_path Path for the LZMA2 file
+ * @param level Compression level
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_compress_lzma2(
+    const char* input_path,
+    const char* output_path,
+    SevenZipCompressionLevel level,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Decompress a standalone LZMA2 file (.xz or custom format)
+ * Decodes on one thread, and fails if the stream ends before its end
+ * marker.
+ * @param lzma2_path Path to the LZMA2 file
+ * @param output_path Path for the decompressed output file
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_lzma2(
+    const char* lzma2_path,
+    const char* output_path,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Decompress a standalone LZMA2 file on several threads
+ * Streams written with a block size have their blocks decoded in parallel,
+ * holding up to one unpacked block per thread. On more than one thread a
+ * stream cut short is not reported; sevenzip_decompress_lzma2() decodes
+ * on one thread and does report it.
+ * @param lzma2_path Path to the LZMA2 file
+ * @param output_path Path for the decompressed output file
+ * @param num_threads Decoder threads (0 = auto: 2, 1 on one CPU, 1 = single-threaded)
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_lzma2_mt(
+    const char* lzma2_path,
+    const char* output_path,
+    int num_threads,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Initialize standalone decompression options with defaults
+ * @param options Pointer to options structure to initialize
+ */
+SEVENZIP_API void sevenzip_decompress_options_init(SevenZipDecompressOptions* options);
+
+/**
+ * sevenzip_decompress_lzma() with options
+ * The input is mapped where possible and decoded in place. Output is
+ * written straight from the decoder's dictionary, output_step bytes at
+ * a time, into a file whose space is reserved from the size in the
+ * .lzma header.
+ * @param lzma_path Path to the .lzma file
+ * @param output_path Path for the decompressed output file
+ * @param options Decompression options (NULL for defaults; num_threads is unused)
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_lzma_with_options(
+    const char* lzma_path,
+    const char* output_path,
+    const SevenZipDecompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * sevenzip_decompress_lzma2_mt() with options
+ * The input is mapped where possible; output goes out in writes of at
+ * least output_step bytes.
+ * @param lzma2_path Path to the LZMA2 file
+ * @param output_path Path for the decompressed output file
+ * @param options Decompression options (NULL for defaults)
+ * @param progress_callback Optional progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_lzma2_with_options(
+    const char* lzma2_path,
+    const char* output_path,
+    const SevenZipDecompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Initialize in-memory compression options with defaults
+ * @param options Pointer to options structure to initialize
+ */
+SEVENZIP_API void sevenzip_buffer_options_init(SevenZipBufferOptions* options);
+
+/**
+ * Largest output sevenzip_compress_buffer() can produce for an input size
+ * Incompressible input is stored in LZMA2 copy chunks, so the LZMA2 and 7z
+ * bounds are a few bytes per 64KB over the input; LZMA has no stored form
+ * and may grow by up to a third.
+ * @param format Output layout
+ * @param input_size Bytes to compress
+ * @param options Options the call will use (NULL for defaults; 7z: the entry name counts)
+ * @return Bound in bytes, 0 for an unknown format or a bound past SIZE_MAX
+ */
+SEVENZIP_API size_t sevenzip_compress_buffer_bound(
+    SevenZipBufferFormat format,
+    size_t input_size,
+    const SevenZipBufferOptions* options
+);
+
+/**
+ * Compress a buffer into a caller buffer
+ * The encoder reads the input and writes the output in place, with no
+ * staging copy of either. An output of sevenzip_compress_buffer_bound()
+ * bytes always fits; a smaller one is tried as it is.
+ * @param format Output layout
+ * @param input Data to compress (may be NULL if input_size is 0)
+ * @param input_size Bytes at input
+ * @param output Buffer for the compressed data
+ * @param output_size In: capacity of output; out: bytes written, or the
+ *        bound when SEVENZIP_ERROR_BUFFER_TOO_SMALL is returned
+ * @param level Compression level
+ * @param options Options (NULL for defaults)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_BUFFER_TOO_SMALL if the
+ *         output did not fit, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_compress_buffer(
+    SevenZipBufferFormat format,
+    const void* input,
+    size_t input_size,
+    void* output,
+    size_t* output_size,
+    SevenZipCompressionLevel level,
+    const SevenZipBufferOptions* options
+);
+
+/**
+ * Size sevenzip_decompress_buffer() will produce
+ * Read from the .lzma header, the LZMA2 chunk headers or the 7z header,
+ * without decoding; only a .lzma stream of unknown size written without
+ * one is decoded to count its bytes.
+ * @param format Layout of the input
+ * @param input Compressed data
+ * @param input_size Bytes at input
+ * @param size Output: decompressed size in bytes
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_ARCHIVE (7z:
+ *         no single file) or SEVENZIP_ERROR_EXTRACT for damaged input
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_buffer_size(
+    SevenZipBufferFormat format,
+    const void* input,
+    size_t input_size,
+    uint64_t* size
+);
+
+/**
+ * Decompress a buffer into a caller buffer
+ * The decoder uses the output as its dictionary, so the data is written
+ * once, straight where the caller wants it. A 7z input must hold exactly
+ * one file (directories aside); its CRC is checked.
+ * @param format Layout of the input
+ * @param input Compressed data
+ * @param input_size Bytes at input
+ * @param output Buffer for the decompressed data
+ * @param output_size In: capacity of output; out: bytes written, or the
+ *        size needed when SEVENZIP_ERROR_BUFFER_TOO_SMALL is returned
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_BUFFER_TOO_SMALL if the
+ *         output does not fit, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_buffer(
+    SevenZipBufferFormat format,
+    const void* input,
+    size_t input_size,
+    void* output,
+    size_t* output_size
+);
+
+/* Streaming .lzma / LZMA2 encoder fed and drained a piece at a time */
+typedef struct SevenZipEncoder SevenZipEncoder;
+
+/* Streaming .lzma / LZMA2 decoder fed and drained a piece at a time */
+typedef struct SevenZipDecoder SevenZipDecoder;
+
+/**
+ * Create a streaming encoder
+ * The output is what sevenzip_compress_buffer() writes for the same
+ * format, except that a .lzma header records no size: the stream ends
+ * with an end marker. Memory is the encoder plus 2MB of buffers, however
+ * long the stream. The encoder runs on a thread of its own.
+ * @param format SEVENZIP_BUFFER_LZMA or SEVENZIP_BUFFER_LZMA2 (a 7z
+ *        header needs the sizes up front)
+ * @param level Compression level
+ * @param options Options (NULL for defaults; entry_name is not used)
+ * @param encoder Output: the encoder (free with sevenzip_encoder_free)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_encoder_create(
+    SevenZipBufferFormat format,
+    SevenZipCompressionLevel level,
+    const SevenZipBufferOptions* options,
+    SevenZipEncoder** encoder
+);
+
+/**
+ * Feed input and take compressed output
+ * Waits only while no input can go in and no output is ready.
+ * @param encoder Encoder
+ * @param input Data to compress
+ * @param input_size In: bytes at input; out: bytes taken
+ * @param output Buffer for compressed data
+ * @param output_size In: capacity of output; out: bytes written
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_encoder_update(
+    SevenZipEncoder* encoder,
+    const void* input,
+    size_t* input_size,
+    void* output,
+    size_t* output_size
+);
+
+/**
+ * End the input and take the rest of the output
+ * Call until *finished is set; no input may follow.
+ * @param encoder Encoder
+ * @param output Buffer for compressed data
+ * @param output_size In: capacity of output; out: bytes written
+ * @param finished Output: 1 once the stream is complete and all of it out
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_encoder_finish(
+    SevenZipEncoder* encoder,
+    void* output,
+    size_t* output_size,
+    int* finished
+);
+
+/**
+ * Free an encoder, stopping it if the stream is not finished
+ * @param encoder Encoder (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_encoder_free(SevenZipEncoder* encoder);
+
+/**
+ * Create a streaming decoder
+ * Decodes on the calling thread; memory is the dictionary of the stream.
+ * A .lzma stream may record its size or end with a marker.
+ * @param format SEVENZIP_BUFFER_LZMA or SEVENZIP_BUFFER_LZMA2
+ * @param decoder Output: the decoder (free with sevenzip_decoder_free)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decoder_create(
+    SevenZipBufferFormat format,
+    SevenZipDecoder** decoder
+);
+
+/**
+ * Feed compressed input and take decompressed output
+ * Input past the end of the stream is not taken.
+ * @param decoder Decoder
+ * @param input Compressed data (may be NULL if *input_size is 0)
+ * @param input_size In: bytes at input; out: bytes taken
+ * @param output Buffer for decompressed data
+ * @param output_size In: capacity of output; out: bytes written
+ * @param finished Output: 1 once the end of the stream is reached and all
+ *        of it out
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT for damaged
+ *         input, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decoder_update(
+    SevenZipDecoder* decoder,
+    const void* input,
+    size_t* input_size,
+    void* output,
+    size_t* output_size,
+    int* finished
+);
+
+/**
+ * Free a decoder
+ * @param decoder Decoder (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_decoder_free(SevenZipDecoder* decoder);
+
+/**
+ * Initialize .xz options with defaults
+ * @param options Pointer to options structure to initialize
+ */
+SEVENZIP_API void sevenzip_xz_options_init(SevenZipXzOptions* options);
+
+/**
+ * Compress a file to .xz (readable by xz and 7-Zip)
+ * The input is cut into blocks of options->block_size that are compressed
+ * on num_threads threads; each block header records its sizes, so the
+ * file can also be decompressed in parallel.
+ * @param input_path Path to the file to compress
+ * @param xz_path Path for the .xz file
+ * @param level Compression level (SEVENZIP_LEVEL_STORE compresses at level 0)
+ * @param options .xz options (NULL for defaults)
+ * @param progress_callback Optional progress callback, input bytes of the file size (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_compress_xz(
+    const char* input_path,
+    const char* xz_path,
+    SevenZipCompressionLevel level,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Decompress a .xz file
+ * Blocks that record their sizes (files from sevenzip_compress_xz(), xz -T)
+ * are decoded on num_threads threads; other files decode on one thread.
+ * Concatenated streams are decoded one after another.
+ * @param xz_path Path to the .xz file
+ * @param output_path Path for the decompressed output file
+ * @param options .xz options, only num_threads is used (NULL for defaults)
+ * @param progress_callback Optional progress callback, packed bytes of the file size (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_xz(
+    const char* xz_path,
+    const char* output_path,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * sevenzip_compress_xz() from a read callback to a write callback
+ * @param read_callback Source of the data to compress
+ * @param write_callback Receiver of the .xz stream
+ * @param level Compression level
+ * @param options .xz options (NULL for defaults)
+ * @param progress_callback Optional progress callback, input bytes so far as both values (NULL to disable)
+ * @param user_data User data passed to all three callbacks
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_compress_xz_stream(
+    SevenZipReadCallback read_callback,
+    SevenZipWriteCallback write_callback,
+    SevenZipCompressionLevel level,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * sevenzip_decompress_xz() from a read callback to a write callback
+ * @param read_callback Source of the .xz stream
+ * @param write_callback Receiver of the decompressed data
+ * @param options .xz options, only num_threads is used (NULL for defaults)
+ * @param progress_callback Optional progress callback, packed bytes so far as both values (NULL to disable)
+ * @param user_data User data passed to all three callbacks
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decompress_xz_stream(
+    SevenZipReadCallback read_callback,
+    SevenZipWriteCallback write_callback,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Rewrap an LZMA2 folder of a 7z archive as a .xz file, without recompressing
+ * The folder's packed stream is copied as the data of a single xz block,
+ * between a block header carrying its dictionary property and both sizes
+ * and the xz index and footer. The file decompresses to the folder's data:
+ * its one file for a single-file archive, else its files one after
+ * another in archive order. The block check is computed by decoding the
+ * folder (which also verifies its CRCs), except for SEVENZIP_XZ_CHECK_NONE
+ * and for SEVENZIP_XZ_CHECK_CRC32 when the archive stores the CRC of the
+ * folder or of its one file, which cost the copy only.
+ * @param archive_path Path to the archive file (first volume of a split archive)
+ * @param folder_index Folder to rewrap (0 for a single-file archive)
+ * @param xz_path Path for the .xz file
+ * @param check Block check to write
+ * @param progress_callback Optional progress callback, archive bytes read so
+ *        far (decoded, then copied) and their total (NULL to disable)
+ * @param user_data User data passed to progress_callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_NOT_IMPLEMENTED if the
+ *         folder is not a single LZMA2 coder (filters, encryption, other
+ *         methods), SEVENZIP_ERROR_INVALID_PARAM for a folder past the last,
+ *         error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_remux_to_xz(
+    const char* archive_path,
+    uint32_t folder_index,
+    const char* xz_path,
+    SevenZipXzCheck check,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Estimate how compressible a file is
+ * Averages the byte entropy of windows sampled across the file (skipping
+ * its header), the same estimate the create functions use to store
+ * incompressible data instead of compressing it.
+ * @param path Path to the file
+ * @param bits_per_byte Output order-0 entropy, 0.0 (constant) to 8.0 (random)
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_estimate_entropy(const char* path, double* bits_per_byte);
+
+/**
+ * Get error message for error code
+ * @param error_code Error code
+ * @return Human-readable error message
+ */
+SEVENZIP_API const char* sevenzip_get_error_message(SevenZipErrorCode error_code);
+
+/**
+ * Get library version
+ * @return Version string (e.g., "1.0.0")
+ */
+SEVENZIP_API const char* sevenzip_get_version(void);
+
+/**
+ * Initialize streaming options with defaults
+ * @param options Pointer to options structure to initialize
+ */
+SEVENZIP_API void sevenzip_stream_options_init(SevenZipStreamOptions* options);
+
+/**
+ * Initialize LZMA encoder parameters to those of the level
+ * Change only the fields to override, then point an options lzma_params at it.
+ * @param params Pointer to the structure to initialize
+ */
+SEVENZIP_API void sevenzip_lzma_params_init(SevenZipLzmaParams* params);
+
+/**
+ * Create a 7z archive with streaming compression (handles large files and splits)
  * This function processes files in chunks to avoid loading entire files into RAM.
  * Supports split/multi-volume archives for easier transfer and storage.
+ * Directory inputs are stored under their own name, with the directories
+ * below them as entries, as 7-Zip does; unreadable entries are skipped.
+ * sevenzip_create_7z_true_streaming(), sevenzip_create_multivolume_7z_complete()
+ * and sevenzip_create_7z_to_sink() write their archives the same way.
+ *
+ * With options->streamable, streamable_reserve bytes are left after the
+ * start header and filled with a copy of the header once the archive is
+ * complete, so sevenzip_extract_from_stream() can extract it front to
+ * back from a pipe; other readers see a plain 7z archive. The automatic
+ * reserve fits the plain header of the gathered entries, about 64KB plus
+ * 140 bytes and twice the name per entry; a header that does not fit
+ * leaves a complete archive that is not streamable, and the job fails
+ * with SEVENZIP_ERROR_COMPRESS. Split archives need the room in volume 0.
+ * Not with checkpoint or for sevenzip_create_7z_true_streaming().
+ *
+ * With options->throughput_target, each LZMA2 task (a file or split
+ * block; in solid archives a folder of solid_block_size) reports its
+ * encoder rate, and later tasks get faster parsing and shorter searches
+ * while the job falls short, and the level's own settings back once it is
+ * well ahead. Past the fastest settings, files sampling 7 bits per byte or
+ * more are stored. Dictionary and memory stay the level's; the rung in use
+ * at the end is in SevenZipOpStats.throughput_rung. Not for true
+ * streaming, which writes one folder.
+ *
+ * With options->deterministic the archive's bytes depend on the inputs,
+ * level and options only, not on num_threads or timing. LZMA2 blocks keep
+ * block_size at any thread count (auto: 64MB, or chunk_size for true
+ * streaming; 4x the dictionary for sevenzip_create_7z_from_source()),
+ * non-solid files larger than it are split into blocks on one worker too,
+ * and entries are sorted by name before solid_sort, group_duplicates and
+ * entry_policy reorder them. max_memory only takes threads away, failing
+ * with SEVENZIP_ERROR_MEMORY where it would shrink blocks or the
+ * dictionary. Not with throughput_target. Encrypted archives still get a
+ * random IV per folder. Set fixed_mtime as well for inputs whose times
+ * vary; snapshot_output keeps the real times.
+ *
+ * options->block_cache_dir names an existing directory that keeps the pack
+ * streams of non-solid folders across runs, by XXH3-128 of the file's data
+ * and the coder settings. A file found there is spliced in without being
+ * compressed, after one read to hash it; files not found are read twice.
+ * Stored files are not kept and nothing is removed, so the caller prunes
+ * it. Solid archives and true streaming ignore it. Not with a password,
+ * whose folders would be kept unencrypted, or with throughput_target.
+ *
+ * options->include_patterns and exclude_patterns use the glob syntax of
+ * SevenZipExtractOptions and are tested by the input scan against each
+ * archive name before it is stat'ed. A pattern without a '/' other than
+ * a trailing one matches a component at any depth, as in .gitignore
+ * ("*.c", "src"), and a leading '/' anchors one at the archive root. Only
+ * files matching an include pattern, if any, are archived; directories
+ * are still descended, and listed only if they match. Matching an exclude
+ * pattern leaves a file out, and a directory is then neither stat'ed nor
+ * descended, so "node_modules" or ".git" costs one name test per tree. A
+ * malformed pattern fails with SEVENZIP_ERROR_INVALID_PARAM.
+ *
+ * With options->parity_volumes, that many Reed-Solomon volumes
+ * (base.p001, ...) are written next to a split archive, computed as the
+ * volumes are written.
+ * Up to that many missing or damaged volumes of each group of 128 are
+ * rebuilt on the fly by every reader of the split (extract, list, test,
+ * sevenzip_open(), resplit), which checks each 1MB block against a CRC
+ * kept in the parity files. They take parity_volumes x split_size of
+ * memory while running. Not with volume_dirs, checkpoint or
+ * sevenzip_resume_multivolume(); ignored for sinks and single files.
+ *
+ * With options->volume_dirs, volume i of a split archive is written to
+ * volume_dirs[i % count] under the archive's file name, several at once by
+ * a writer thread each. Gather the volumes in one directory to extract
+ * them, and pass the same list to sevenzip_resume_multivolume().
+ *
+ * With options->digest_manifest, the digest_algorithm digest of every
+ * file, computed in the pass that reads it for the CRC, is written to that
+ * path as sha256sum lines once the archive is complete. Non-solid jobs then
+ * no longer split large files over workers. Not for
+ * sevenzip_resume_multivolume().
+ *
+ * With options->snapshot_base, files whose name, size, mtime and inode
+ * match the snapshot are left out without being read, and a run with none
+ * changed writes an empty archive; a missing snapshot file archives
+ * everything. options->snapshot_output receives the name, size, mtime and
+ * inode of every input, archived or left out, once the archive is
+ * complete, and may be the snapshot_base path. Not for
+ * sevenzip_resume_multivolume() or sevenzip_create_7z_from_source().
+ *
+ * With options->memory_pressure_throttle, a non-solid job whose cgroup
+ * (else the system) spent that percentage of the last 10s with tasks
+ * stalled on memory (PSI "some avg10") runs its workers one at a time, each
+ * freeing its encoder while held back, until the figure falls below half
+ * of it. Only on kernels with PSI.
+ *
+ * With options->group_duplicates, a pre-pass hashes the first 16KB of every
+ * file of a solid archive and moves files with the same head next to the
+ * first of them, smaller first, so copies scattered over the tree are found
+ * in the dictionary instead of coded again. Entries are listed in that
+ * order. Not for sevenzip_create_7z_from_source().
+ *
+ * With options->entry_policy, files differing in method, filter, level or
+ * solid group go into different folders, and the memory plan makes room
+ * for both coders. No effect at SEVENZIP_LEVEL_STORE; not for true
+ * streaming, which writes one folder.
+ *
+ * With options->sync_volumes, every volume (or the one archive file) is
+ * fsync'ed before the call returns; a finisher thread closes and syncs each
+ * full volume while the next one fills. options->volume_complete is called
+ * from that thread as each volume is complete, in the order they finish,
+ * volume 0 last of all once its start header is written. Sinks have
+ * end_volume instead.
+ *
+ * With options->unbuffered_output, split volumes bypass the page cache:
+ * O_DIRECT through an aligned staging buffer, F_NOCACHE on macOS, and
+ * FILE_FLAG_NO_BUFFERING with double-buffered overlapped writes on
+ * Windows. A volume whose filesystem refuses O_DIRECT is written buffered.
+ *
+ * With options->volume_digests, every volume (or the one archive file) is
+ * digested with digest_algorithm as its bytes are written, and the digest
+ * is passed to volume_complete; volume 0 is read back once, after its start
+ * header is written. options->volume_manifest implies volume_digests and
+ * writes the digests to that path as sha256sum lines by volume file name
+ * once the archive is complete. Not for sinks or
+ * sevenzip_resume_multivolume().
+ *
+ * With options->zero_blocks, runs of 1MB or more of zeros, in 64KB units,
+ * bypass the match finder as LZMA2 chunks encoded once. The dictionary
+ * restarts after each run, so it suits disk and VM images.
+ *
+ * With options->rate_limit, input bytes read and archive bytes written
+ * per second are held to its budget: readers and the volume writer wait
+ * for it while the encoders work on what is buffered.
+ *
+ * With options->verify_writes, every LZMA2 folder is decoded on a thread
+ * of its own as it is written, and the job fails with
+ * SEVENZIP_ERROR_COMPRESS unless it matches the CRC and size of its input.
+ * This replaces testing the archive afterwards, at the cost of a core, 9MB
+ * and a dictionary.
+ *
+ * options->next_input_path yields inputs after input_paths, pulled one at
+ * a time while the scan runs, so a caller with millions of paths never
+ * holds them all. options->input_list names a file of inputs after both,
+ * one path per line ("find" output), read as the scan goes. With either,
+ * input_paths may be NULL.
+ *
+ * With options->folder_stats, the encoder counters of every LZMA2 folder
+ * (symbol mix, match length, time and rate per block thread) are kept for
+ * sevenzip_get_last_folder_stats(). Their totals are in SevenZipOpStats
+ * either way.
  * 
  * @param archive_path Base path for the archive (e.g., "archive.7z")
- *                     For split archives, creates archive.7z.001, archive.7z.002, etc.
- * @param input_paths Array of file/directory paths to compress (NULL-terminated)
+ *                     For split archives, creates archive.7z.001, archive.7z.002, etc.;
+ *                     an input that fits one split_size volume is written to
+ *                     archive_path itself
+ * @param input_paths Array of file/directory paths to compress (NULL-terminated;
+ *                    NULL with options->next_input_path or input_list)
  * @param level Compression level (0-9)
  * @param options Streaming options (NULL for defaults)
- * @param progress_callback Optional byte-level progress callback (NULL to disable)
+ * @param progress_callback Optional byte-level progress callback, input bytes
+ *                          done of the total, called from a reporter thread,
+ *                          rate-limited by the progress_interval options; the
+ *                          final count is delivered before returning
+ *                          (NULL to disable)
  * @param user_data User data passed to progress callback
  * @return SEVENZIP_OK on success, error code otherwise
  * 
@@ -335,20 +2418,152 @@ SEVENZIP_API SevenZipErrorCode sevenzip_create_7z_streaming(
     void* user_data
 );
 
+/**
+ * Create a 7z archive whose bytes go to callbacks instead of files
+ * As the split sevenzip_create_7z_streaming() path, its output goes to
+ * `sink`, e.g. straight into the parts of a multipart upload, with no
+ * local copy of the archive. With options->split_size each volume is cut
+ * at that size; without, the archive is volume 0. Callbacks run on one
+ * thread at a time, the writer thread or the caller's, never at once.
+ * @param input_paths Array of file/directory paths to compress (NULL-terminated)
+ * @param level Compression level (0-9)
+ * @param options Streaming options (NULL for defaults); volume_dirs and
+ *                unbuffered_output do not apply, checkpoint must be 0
+ * @param sink Callbacks receiving the volumes
+ * @param progress_callback As for sevenzip_create_7z_streaming()
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_COMPRESS if a callback
+ *         failed the job, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_create_7z_to_sink(
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    const SevenZipArchiveSink* sink,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Finish a split sevenzip_create_7z_streaming() job that was interrupted
+ * Needs the <archive_path>.ckpt file of a job run with options->checkpoint;
+ * the volumes it covers are kept when that job fails.
+ * Checkpoints are taken where a solid block or file ends, once a volume has
+ * filled since the last one, so the data of inputs after the checkpoint is
+ * compressed again: volumes are cut back to the checkpoint and the job goes
+ * on from there. Those inputs must still have the size and modification
+ * time they had when the job started. Encrypted Store jobs keep one stream
+ * for all files and never save a checkpoint.
+ * @param archive_path Base path given to the interrupted job
+ * @param options Options for the rest of the job (NULL for defaults); the
+ *                level, split_size, solid, solid_block_size, solid_block_files
+ *                and delta_distance of the checkpoint replace their own, and
+ *                password must be the job's
+ * @param progress_callback As for sevenzip_create_7z_streaming(); inputs done
+ *                          before the checkpoint count as done at once
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK once the archive is complete (the checkpoint is then
+ *         removed), SEVENZIP_ERROR_OPEN_FILE without a checkpoint or with
+ *         volumes missing, SEVENZIP_ERROR_INVALID_ARCHIVE for a damaged
+ *         checkpoint, SEVENZIP_ERROR_INVALID_PARAM if inputs changed or the
+ *         password differs, otherwise as sevenzip_create_7z_streaming()
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_resume_multivolume(
+    const char* archive_path,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Estimate the peak memory of sevenzip_create_7z_streaming()
+ * Applies the same fitting as the job itself (including max_memory), so
+ * the result is what the job will be held to. It is an upper bound: small
+ * inputs shrink the dictionary and use less.
+ * @param level Compression level
+ * @param options Streaming options (NULL for defaults)
+ * @param peak_bytes Output: estimated peak heap use in bytes
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_MEMORY if max_memory is
+ *         too small for the job even after reducing it
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_estimate_memory(
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    uint64_t* peak_bytes
+);
+
+/* Engine sevenzip_create_7z_auto() runs */
+typedef enum {
+    SEVENZIP_ENGINE_IN_MEMORY = 0,  /* sevenzip_create_7z(): each file read and compressed whole */
+    SEVENZIP_ENGINE_STREAMING = 1   /* sevenzip_create_7z_streaming(): bounded memory, volumes */
+} SevenZipCreateEngine;
+
+/**
+ * Pick the engine sevenzip_create_7z_auto() would run for these inputs
+ * The in-memory builder has the least set-up cost and wins for a few small
+ * files: all inputs regular files, 16MB and 256 files at most, with its
+ * memory plan and the data it holds within half the available memory
+ * (MemAvailable capped by the cgroup limit on Linux). Directory trees,
+ * larger inputs and the options only the create engine has (password,
+ * split_size, checkpoint, volume_dirs, digest_manifest, snapshot_base,
+ * snapshot_output, unbuffered_output, sync_volumes, volume_complete,
+ * volume_digests, volume_manifest, write_index) get the streaming
+ * engine.
+ * @param input_paths Array of file/directory paths (NULL-terminated)
+ * @param level Compression level
+ * @param options Streaming options (NULL for defaults)
+ * @param engine Output: the engine chosen
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM for NULL arguments
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_choose_create_engine(
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipCreateEngine* engine
+);
+
+/**
+ * Create a 7z archive with the engine that suits the input
+ * Runs sevenzip_create_7z() or sevenzip_create_7z_streaming() as
+ * sevenzip_choose_create_engine() decides; both write the same entries
+ * for file inputs. A streaming job without max_memory whose plan exceeds
+ * three quarters of the available memory is held to that much.
+ * @param archive_path Path for the output archive (base path when split)
+ * @param input_paths Array of file/directory paths to compress (NULL-terminated)
+ * @param level Compression level
+ * @param options Streaming options (NULL for defaults)
+ * @param progress_callback As for sevenzip_create_7z_streaming(); the
+ *                          in-memory engine reports only its start and end
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_create_7z_auto(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
 /**
  * Create a 7z archive with TRUE streaming compression
  * 
- * ⚠️ IMPORTANT: This function processes files in 64MB chunks WITHOUT loading
- * all data into RAM first. This is essential for large archives (10GB+) that
- * would otherwise cause out-of-memory crashes.
- * 
- * Memory usage: ~250MB peak regardless of archive size
+ * As sevenzip_create_7z_streaming() without split_size, with every file in
+ * one solid folder: options->solid, the solid block limits and
+ * detect_compressed do not apply. Files are read as the encoder needs them,
+ * never whole, so memory use does not grow with the archive; max_memory
+ * bounds it. The folder is cut into independent chunk_size LZMA2 blocks,
+ * each thread coding one and the blocks written in order, so a single
+ * huge file uses every core in about threads x 2 x chunk_size of memory.
  * 
  * @param archive_path Output archive path
  * @param input_paths Array of file/directory paths to compress (NULL-terminated)
  * @param level Compression level
  * @param options Streaming options (NULL for defaults)
- * @param progress_callback Byte-level progress callback (NULL to disable)
+ * @param progress_callback Byte-level progress callback, called from a reporter
+ *                          thread as set by the progress_interval options
+ *                          (NULL to disable)
  * @param user_data User data for callback
  * @return SEVENZIP_OK on success, error code otherwise
  */
@@ -361,6 +2576,61 @@ SEVENZIP_API SevenZipErrorCode sevenzip_create_7z_true_streaming(
     void* user_data
 );
 
+/**
+ * Create a 7z archive from entries that are not files
+ * As sevenzip_create_7z_true_streaming(), with the entries coming from
+ * `source` one at a time as the encoder reaches them, so data from
+ * sockets, databases or memory is archived without staging it on disk.
+ * Entries of unknown size are read until their callback ends them. The
+ * callbacks run on one thread at a time, not necessarily the caller's.
+ * @param archive_path Output archive path
+ * @param source Entry callbacks
+ * @param level Compression level
+ * @param options Streaming options (NULL for defaults)
+ * @param progress_callback As for sevenzip_create_7z_true_streaming(); the
+ *                          total counts the known sizes of entries so far
+ * @param user_data User data for callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_COMPRESS if a callback
+ *         failed or an entry ended before its size, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_create_7z_from_source(
+    const char* archive_path,
+    const SevenZipEntrySource* source,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
+/**
+ * Recompress an archive at another level, method or layout, file by file
+ * The files of `source_path` are decoded in the order of their data, each
+ * folder once, on a thread of their own, and fed through a 4MB ring to
+ * sevenzip_create_7z_from_source() as its entries, so decoding and
+ * encoding run at once with no scratch files. Names, times (to the
+ * second) and attributes are kept; directories and empty files come
+ * first, then the other files in archive order.
+ * @param source_path Archive to read (first volume of a split archive)
+ * @param archive_path Archive to write; not the source
+ * @param password Password of the source (NULL if not encrypted); the new
+ *        archive is encrypted only by options->password
+ * @param level Compression level of the new archive
+ * @param options Streaming options of the new archive (NULL for defaults)
+ * @param progress_callback As for sevenzip_create_7z_from_source()
+ * @param user_data User data for callback
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if the source is
+ *         damaged, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_transcode_archive(
+    const char* source_path,
+    const char* archive_path,
+    const char* password,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
 /**
  * Extract a 7z archive with streaming decompression and byte-level progress
  * Handles split/multi-volume archives automatically.
@@ -380,6 +2650,46 @@ SEVENZIP_API SevenZipErrorCode sevenzip_extract_streaming(
     void* user_data
 );
 
+/**
+ * sevenzip_extract_streaming() with independent folders decoded in parallel
+ * Workers read the volumes at their own offsets. Byte progress sums
+ * the reads of all workers and may be reported from any worker thread,
+ * one call at a time.
+ *
+ * With options->consume_volumes each .NNN volume of a split archive is
+ * closed and deleted once decoding has moved past it for good (a streamed
+ * folder as it is read, one decoded whole once the next begins), and the
+ * rest once all succeeded, so a restore needs room for its output and the
+ * volumes not yet read. Folders are then decoded one at a time in archive
+ * order, num_threads going to the LZMA2 decoders, and volumes are read
+ * rather than mapped. Volumes consumed before a failure are gone. With
+ * volume_consumed set, each closed volume is passed to it instead, in
+ * volume order on the thread reading them, with a NULL digest.
+ *
+ * With options->checkpoint_path the folders written so far, and the files
+ * written of those begun, are kept in that file, saved every 64MB of
+ * output and when the run fails. A run finding it skips what it records,
+ * resumes a folder from the last decoder reset point before its first
+ * file left, and removes it once the archive is extracted. A checkpoint
+ * of another archive fails with SEVENZIP_ERROR_INVALID_PARAM. Not with
+ * consume_volumes.
+ * @param archive_path Path to archive (for splits, use base name like "archive.7z.001")
+ * @param output_dir Directory to extract to
+ * @param password Optional password (NULL if not encrypted)
+ * @param options Extraction options (NULL for defaults)
+ * @param progress_callback Optional byte-level progress callback (NULL to disable)
+ * @param user_data User data passed to progress callback
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_extract_streaming_with_options(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+);
+
 /**
  * ============================================================================
  * AES-256 Encryption Functions
@@ -439,35 +2749,124 @@ SEVENZIP_API SevenZipErrorCode sevenzip_init_decryption(
  * @param ciphertext_len In: buffer size, Out: actual encrypted length
  * @return SEVENZIP_OK on success, error code otherwise
  */
-SEVENZIP_API SevenZipErrorCode sevenzip_encrypt_data(
-    uint32_t* aes_context,
-    const uint8_t* iv,
-    const uint8_t* plaintext,
-    size_t plaintext_len,
-    uint8_t* ciphertext,
-    size_t* ciphertext_len
+SEVENZIP_API SevenZipErrorCode sevenzip_encrypt_data(
+    uint32_t* aes_context,
+    const uint8_t* iv,
+    const uint8_t* plaintext,
+    size_t plaintext_len,
+    uint8_t* ciphertext,
+    size_t* ciphertext_len
+);
+
+/**
+ * Decrypt data using AES-256-CBC and verify PKCS#7 padding
+ * 
+ * @param aes_context AES context from sevenzip_init_decryption()
+ * @param iv Initialization vector (16 bytes, from archive header)
+ * @param ciphertext Encrypted data
+ * @param ciphertext_len Length of ciphertext in bytes (must be multiple of 16)
+ * @param plaintext Output buffer for decrypted data (must be 16-byte aligned)
+ * @param plaintext_len In: buffer size, Out: actual decrypted length
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if wrong password
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decrypt_data(
+    uint32_t* aes_context,
+    const uint8_t* iv,
+    const uint8_t* ciphertext,
+    size_t ciphertext_len,
+    uint8_t* plaintext,
+    size_t* plaintext_len
+);
+
+/**
+ * Decrypt data using AES-256-CBC on several threads
+ * 
+ * Same result as sevenzip_decrypt_data(). CBC decryption of a block only
+ * needs the ciphertext block before it, so large buffers are split into
+ * runs (at least 1MB each) decrypted in parallel, each seeded with the
+ * preceding ciphertext block as its IV.
+ * 
+ * @param aes_context AES context from sevenzip_init_decryption()
+ * @param iv Initialization vector (16 bytes, from archive header)
+ * @param ciphertext Encrypted data
+ * @param ciphertext_len Length of ciphertext in bytes (must be multiple of 16)
+ * @param plaintext Output buffer for decrypted data (16-byte aligned; may
+ *                  be the ciphertext buffer itself to decrypt in place)
+ * @param plaintext_len In: buffer size, Out: actual decrypted length
+ * @param num_threads Maximum number of threads (0 = default of 4, fewer on fewer CPUs)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if wrong password
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_decrypt_data_parallel(
+    uint32_t* aes_context,
+    const uint8_t* iv,
+    const uint8_t* ciphertext,
+    size_t ciphertext_len,
+    uint8_t* plaintext,
+    size_t* plaintext_len,
+    int num_threads
+);
+
+/* Direction of a streaming cipher context */
+typedef enum {
+    SEVENZIP_CRYPT_ENCRYPT = 0,
+    SEVENZIP_CRYPT_DECRYPT = 1
+} SevenZipCryptMode;
+
+/* Opaque streaming cipher context (aligned key schedule + CBC state) */
+typedef struct SevenZipCryptContext SevenZipCryptContext;
+
+/**
+ * Create a persistent AES-256-CBC context for chunked, in-place processing
+ * 
+ * The key schedule is expanded once and the CBC chaining state carries
+ * over between sevenzip_crypt_update() calls, so a stream can be processed
+ * in any number of chunks without per-call allocation. No padding is
+ * added or removed; that is left to the caller.
+ * 
+ * @param mode SEVENZIP_CRYPT_ENCRYPT or SEVENZIP_CRYPT_DECRYPT
+ * @param key AES-256 key (32 bytes), e.g. from sevenzip_init_encryption()
+ * @param iv Initialization vector (16 bytes)
+ * @param ctx Output: new context, released with sevenzip_crypt_free()
+ * @return SEVENZIP_OK on success, error code otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_crypt_create(
+    SevenZipCryptMode mode,
+    const uint8_t* key,
+    const uint8_t* iv,
+    SevenZipCryptContext** ctx
+);
+
+/**
+ * Encrypt or decrypt the next chunk of the stream in place
+ * 
+ * @param ctx Context from sevenzip_crypt_create()
+ * @param buf Data (must be 16-byte aligned), overwritten with the result
+ * @param len Length in bytes (must be a multiple of 16)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM otherwise
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_crypt_update(
+    SevenZipCryptContext* ctx,
+    uint8_t* buf,
+    size_t len
 );
 
 /**
- * Decrypt data using AES-256-CBC and verify PKCS#7 padding
+ * Restart the context on a new stream with the same key
  * 
- * @param aes_context AES context from sevenzip_init_decryption()
- * @param iv Initialization vector (16 bytes, from archive header)
- * @param ciphertext Encrypted data
- * @param ciphertext_len Length of ciphertext in bytes (must be multiple of 16)
- * @param plaintext Output buffer for decrypted data (must be 16-byte aligned)
- * @param plaintext_len In: buffer size, Out: actual decrypted length
- * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if wrong password
+ * @param ctx Context from sevenzip_crypt_create()
+ * @param iv Initialization vector of the new stream (16 bytes)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM otherwise
  */
-SEVENZIP_API SevenZipErrorCode sevenzip_decrypt_data(
-    uint32_t* aes_context,
-    const uint8_t* iv,
-    const uint8_t* ciphertext,
-    size_t ciphertext_len,
-    uint8_t* plaintext,
-    size_t* plaintext_len
+SEVENZIP_API SevenZipErrorCode sevenzip_crypt_reset(
+    SevenZipCryptContext* ctx,
+    const uint8_t* iv
 );
 
+/**
+ * Zeroize and free a context (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_crypt_free(SevenZipCryptContext* ctx);
+
 /**
  * Verify password correctness by decrypting test block
  * 
@@ -488,6 +2887,16 @@ SEVENZIP_API SevenZipErrorCode sevenzip_verify_password(
     const uint8_t* iv
 );
 
+/**
+ * Forget all cached password-derived keys
+ * 
+ * Derived keys are cached per process, keyed by password hash, salt and
+ * iteration count, so repeated init/verify calls with the same password
+ * skip key derivation. This zeroizes the cache, e.g. once a batch of
+ * encrypted archives has been processed.
+ */
+SEVENZIP_API void sevenzip_clear_key_cache(void);
+
 /* ============================================================================
  * Enhanced Error Reporting
  * ============================================================================ */
@@ -526,6 +2935,729 @@ SEVENZIP_API void sevenzip_clear_last_error(void);
  */
 SEVENZIP_API const char* sevenzip_get_error_string(SevenZipErrorCode code);
 
+/* ============================================================================
+ * Cancellation
+ * ============================================================================ */
+
+/**
+ * Create a cancellation token
+ * One token may be shared by several jobs; all of them stop when it is
+ * cancelled.
+ * @return New token, or NULL if out of memory
+ */
+SEVENZIP_API SevenZipCancelToken* sevenzip_cancel_token_create(void);
+
+/**
+ * Request cancellation of every job using the token
+ * Safe to call from any thread and from a signal handler. Encoder and
+ * decoder threads stop at their next read or progress step, so a job
+ * returns within milliseconds, not after its current block.
+ * @param token Token to cancel (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_cancel_token_cancel(SevenZipCancelToken* token);
+
+/**
+ * @param token Token to query (NULL counts as not cancelled)
+ * @return 1 once sevenzip_cancel_token_cancel() was called, 0 otherwise
+ */
+SEVENZIP_API int sevenzip_cancel_token_is_cancelled(const SevenZipCancelToken* token);
+
+/**
+ * Clear a cancellation so the token can be used for another job
+ * @param token Token to reset (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_cancel_token_reset(SevenZipCancelToken* token);
+
+/**
+ * Free a token; no job may still be using it
+ * @param token Token to free (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_cancel_token_free(SevenZipCancelToken* token);
+
+/* ============================================================================
+ * Bandwidth Limits
+ * ============================================================================ */
+
+/**
+ * Create a bandwidth budget
+ * A token bucket per direction, holding 100ms of its rate, so reads and
+ * writes are spread evenly instead of in bursts. Reads are those of the
+ * input files, writes those of the volumes (or the archive file, or sink).
+ * @param read_bytes_per_sec Input budget (0 = unlimited)
+ * @param write_bytes_per_sec Output budget (0 = unlimited)
+ * @return New budget, or NULL if out of memory
+ */
+SEVENZIP_API SevenZipRateLimit* sevenzip_rate_limit_create(uint64_t read_bytes_per_sec,
+                                                           uint64_t write_bytes_per_sec);
+
+/**
+ * Change the rates of a budget
+ * Safe to call from any thread while jobs use it; waiting readers and
+ * writers see the new rates within 100ms.
+ * @param limit Budget to change (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_rate_limit_set(SevenZipRateLimit* limit, uint64_t read_bytes_per_sec,
+                                          uint64_t write_bytes_per_sec);
+
+/**
+ * Free a budget; no job may still be using it
+ * @param limit Budget to free (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_rate_limit_free(SevenZipRateLimit* limit);
+
+/* ============================================================================
+ * Background Jobs
+ * ============================================================================ */
+
+/* Handle of a job running in the background, see sevenzip_submit_create() */
+typedef struct SevenZipJob SevenZipJob;
+
+/**
+ * Completion callback of a background job
+ * Called once, on the library thread that ran the job, before
+ * sevenzip_job_wait() and sevenzip_job_poll() see the job finished.
+ */
+typedef void (*SevenZipJobCallback)(SevenZipJob* job, SevenZipErrorCode result, void* user_data);
+
+/**
+ * Start sevenzip_create_7z_streaming() in the background
+ * The call returns once the job is queued. Jobs run on library threads,
+ * at most SevenZipInitOptions.max_jobs at once and the rest in order of
+ * submission. Paths, options and their strings are copied; callbacks,
+ * an options cancel token, rate_limit and next_input_path's user data
+ * must stay valid until the job has finished.
+ * The progress callback gets `user_data` as well.
+ * @param done_callback Called when the job has finished (NULL = none)
+ * @param job Receives the handle, freed with sevenzip_job_free() (NULL =
+ *        free the job by itself once finished)
+ * @return SEVENZIP_OK once queued, SEVENZIP_ERROR_INVALID_PARAM,
+ *         SEVENZIP_ERROR_MEMORY if neither the job nor a thread to run it
+ *         could be created
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_submit_create(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    SevenZipJobCallback done_callback,
+    void* user_data,
+    SevenZipJob** job
+);
+
+/**
+ * Start sevenzip_extract_with_options() in the background
+ * Queued and run like sevenzip_submit_create().
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_submit_extract(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    SevenZipJobCallback done_callback,
+    void* user_data,
+    SevenZipJob** job
+);
+
+/**
+ * Wait for a job to finish
+ * Not from inside another job's callbacks: the job may be queued behind
+ * the one making the call.
+ * @return The job's result, SEVENZIP_ERROR_INVALID_PARAM for a NULL job
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_job_wait(SevenZipJob* job);
+
+/**
+ * @param result Receives the job's result once it has finished (may be NULL)
+ * @return 1 if the job has finished, 0 while it is queued or running
+ */
+SEVENZIP_API int sevenzip_job_poll(SevenZipJob* job, SevenZipErrorCode* result);
+
+/**
+ * Descriptor that becomes readable when the job has finished
+ * For poll(), epoll or an async runtime's reactor. Created on the first
+ * call and owned by the job: do not read from or close it.
+ * @return The descriptor, -1 on Windows or when no pipe could be created
+ */
+SEVENZIP_API int sevenzip_job_fd(SevenZipJob* job);
+
+/**
+ * Cancel a job through its options cancel token, or a token of its own
+ * A queued job finishes without starting; a running one as with
+ * sevenzip_cancel_token_cancel(). Either returns SEVENZIP_ERROR_CANCELLED.
+ */
+SEVENZIP_API void sevenzip_job_cancel(SevenZipJob* job);
+
+/**
+ * Change the bandwidth budget of a create job
+ * Applies to its options rate_limit, or to a budget of its own (unlimited
+ * until set); a budget shared with other jobs changes for all of them.
+ * Extract jobs are not limited and ignore the call.
+ * @param read_bytes_per_sec Input budget (0 = unlimited)
+ * @param write_bytes_per_sec Output budget (0 = unlimited)
+ */
+SEVENZIP_API void sevenzip_job_set_rate_limit(SevenZipJob* job, uint64_t read_bytes_per_sec,
+                                              uint64_t write_bytes_per_sec);
+
+/**
+ * Release a job handle
+ * A job that has not finished goes on and is freed when it does; its
+ * completion callback still runs.
+ * @param job Handle to release (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_job_free(SevenZipJob* job);
+
+/* ============================================================================
+ * Archive Service
+ * ============================================================================ */
+
+/*
+ * One process serves create, extract, list and read requests of many
+ * short-lived ones over a Unix socket, so they share its job runners and
+ * thread quota (SevenZipInitOptions.max_jobs, max_threads), its derived
+ * key cache, and archives it keeps open with their headers parsed and
+ * decoded folders cached. Entry data and lists come back in shared memory
+ * passed with the reply, not copied through the socket. Not on Windows:
+ * every call returns SEVENZIP_ERROR_NOT_IMPLEMENTED.
+ */
+
+/* Service started by sevenzip_service_start() */
+typedef struct SevenZipService SevenZipService;
+
+typedef struct {
+    int max_clients;           /* Requests served at once, each on a thread of the service; more wait to be accepted (0 = 16) */
+    int max_archives;          /* Archives kept open for list and read requests, least recently used closed first (0 = 16) */
+    uint64_t cache_budget;     /* Decoded-folder bytes each open archive keeps, see sevenzip_archive_set_cache_budget() (0 = 64MB) */
+    int socket_mode;           /* Permission bits of the socket; paths of requests are read and written with the service's own rights, so only widen this for clients trusted with them (0 = 0600: the owner's processes) */
+} SevenZipServiceOptions;
+
+/**
+ * Initialize service options with defaults
+ */
+SEVENZIP_API void sevenzip_service_options_init(SevenZipServiceOptions* options);
+
+/**
+ * Listen on a Unix socket and serve requests on threads of the service
+ * until sevenzip_service_stop(). A socket file left by a service that is
+ * gone is replaced; one with a live service behind it is not.
+ * @param socket_path Path of the socket to create
+ * @param options Options (NULL for defaults)
+ * @param service Receives the service
+ * @return SEVENZIP_OK; SEVENZIP_ERROR_INVALID_PARAM for a path too long
+ *         for a socket; SEVENZIP_ERROR_OPEN_FILE if it cannot be bound
+ *         (a service already listens there); SEVENZIP_ERROR_MEMORY
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_service_start(
+    const char* socket_path,
+    const SevenZipServiceOptions* options,
+    SevenZipService** service
+);
+
+/**
+ * Stop accepting, wait for the requests being served, close the archives
+ * kept open and remove the socket
+ * @param service Service to stop (NULL is ignored)
+ */
+SEVENZIP_API void sevenzip_service_stop(SevenZipService* service);
+
+/*
+ * Clients. Each call is one request on a connection of its own; relative
+ * paths are taken from the caller's working directory. A service that
+ * cannot be reached gives SEVENZIP_ERROR_OPEN_FILE, a reply that is not
+ * one SEVENZIP_ERROR_UNKNOWN; otherwise the result is the operation's.
+ */
+
+/**
+ * sevenzip_create_7z_streaming() in the service, queued as a job
+ * Of `options` only num_threads, solid and password are sent; the rest
+ * are the defaults.
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_service_create(
+    const char* socket_path,
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options
+);
+
+/**
+ * sevenzip_extract_with_options() in the service, queued as a job
+ * Of `options` num_threads, verify, existing, sparse_output,
+ * cache_neutral_output and durability are sent; the rest are the defaults.
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_service_extract(
+    const char* socket_path,
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options
+);
+
+/**
+ * sevenzip_list() through an archive the service keeps open
+ * @param list Receives the list (must be freed with sevenzip_free_list)
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_service_list(
+    const char* socket_path,
+    const char* archive_path,
+    const char* password,
+    SevenZipList** list
+);
+
+/**
+ * Read one file of an archive the service keeps open, as
+ * sevenzip_archive_extract_entry() would pass it on
+ * The service decodes the file into shared memory that is mapped here,
+ * so the data is not copied on the way.
+ * @param entry_index Entry, as in sevenzip_service_list()
+ * @param data Receives the file's data, read-only (NULL for an empty
+ *        file); release it with sevenzip_service_free_data()
+ * @param size Receives its size in bytes
+ * @return As sevenzip_archive_extract_entry()
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_service_read_entry(
+    const char* socket_path,
+    const char* archive_path,
+    const char* password,
+    uint32_t entry_index,
+    const void** data,
+    size_t* size
+);
+
+/**
+ * Release data returned by sevenzip_service_read_entry()
+ * @param data Data (NULL is ignored)
+ * @param size Its size
+ */
+SEVENZIP_API void sevenzip_service_free_data(const void* data, size_t size);
+
+/* ============================================================================
+ * Operation Statistics
+ * ============================================================================ */
+
+/* Phases of an archive creation, indexes of SevenZipOpStats.phases */
+typedef enum {
+    SEVENZIP_PHASE_SCAN = 0,       /* Walking the inputs for names, sizes and attributes */
+    SEVENZIP_PHASE_READ = 1,       /* Inside input reads, on any thread */
+    SEVENZIP_PHASE_COMPRESS = 2,   /* The data stage as a whole; READ and WRITE run within it */
+    SEVENZIP_PHASE_WRITE = 3,      /* Inside archive writes, on any thread */
+    SEVENZIP_PHASE_HEADER = 4,     /* Building and writing the archive header */
+    SEVENZIP_PHASE_COUNT = 5
+} SevenZipPhase;
+
+typedef struct {
+    double wall_seconds;           /* Summed over the threads doing the phase */
+    double cpu_seconds;            /* SCAN/COMPRESS/HEADER: whole process; READ/WRITE: the I/O threads */
+} SevenZipPhaseStats;
+
+/*
+ * Statistics of one operation. A stage bound by I/O shows READ or WRITE
+ * wall time close to COMPRESS wall time; a compression-bound one shows
+ * COMPRESS CPU time near encoder_threads times its wall time.
+ */
+typedef struct {
+    SevenZipPhaseStats phases[SEVENZIP_PHASE_COUNT];
+    double wall_seconds;           /* Whole operation */
+    double cpu_seconds;            /* All threads of the process during the operation */
+    uint64_t bytes_read;           /* Input bytes read */
+    uint64_t bytes_written;        /* Archive bytes written, headers included */
+    uint64_t files;                /* Files with data (directories not counted) */
+    double files_per_second;
+    int encoder_threads;           /* Encoder threads used; the largest number in use at once */
+    uint64_t peak_buffer_bytes;    /* Planned peak of encoder state and I/O buffers (an upper bound) */
+    uint64_t lzma2_block_size;     /* LZMA2 block handed to a block thread or non-solid worker, the largest in use (0 = each stream one block) */
+    uint64_t lzma_literals;        /* LZMA2 folders: literals coded, chunks LZMA2 then stored raw included */
+    uint64_t lzma_matches;         /* Matches at a new distance (0 when built with ENABLE_ENCODER_STATS=OFF) */
+    uint64_t lzma_rep_matches;     /* Matches at one of the last four distances, one-byte short reps included */
+    double average_match_length;   /* Bytes per match or rep match */
+    double encode_seconds;         /* Wall time inside the LZMA2 encoders, summed over the folders and the workers of split files */
+    uint64_t folder_stats_count;   /* Folder records kept with folder_stats, for sevenzip_get_last_folder_stats() */
+    int throughput_rung;           /* throughput_target: encoder settings in use at the end, 0 = the level's own to 4 = fastest, 5 = also storing poor data */
+    uint64_t throughput_changes;   /* throughput_target: times the settings moved */
+    uint64_t block_cache_hits;     /* block_cache_dir: files spliced in from the cache */
+    uint64_t block_cache_stores;   /* block_cache_dir: files compressed and added to it */
+} SevenZipOpStats;
+
+/*
+ * Encoder counters of one LZMA2 folder. A level or match finder that
+ * buys nothing on some data shows about the same pack_size and symbol
+ * mix at a lower bytes_per_second.
+ */
+typedef struct {
+    uint64_t folder;               /* Index in the archive */
+    uint64_t unpack_size;
+    uint64_t pack_size;
+    uint64_t literals;
+    uint64_t matches;              /* At a new distance */
+    uint64_t rep_matches;          /* At one of the last four distances, short reps included */
+    double average_match_length;   /* Bytes per match or rep match */
+    double encode_seconds;         /* Wall time inside the encoder, summed over the workers of a split file */
+    int block_threads;             /* Block threads of the encoder (1 per worker of a split file) */
+    double bytes_per_second;       /* Input coded per second by one block thread */
+} SevenZipFolderStats;
+
+/**
+ * Get the statistics of the last archive creation on this thread
+ * Filled in by sevenzip_create_7z_streaming(), the functions written
+ * the same way and sevenzip_create_7z_from_source(). Failed operations
+ * report what was done up to the failure; calls rejected before they
+ * start leave zeros.
+ *
+ * @param stats Output structure
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_INVALID_PARAM if stats is NULL
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_get_last_stats(SevenZipOpStats* stats);
+
+/**
+ * Get the folder records of the last archive creation on this thread
+ * Kept for its LZMA2 folders in archive order when it ran with
+ * SevenZipStreamOptions.folder_stats; folders resumed from a checkpoint
+ * have none.
+ *
+ * @param stats Output array (may be NULL when capacity is 0)
+ * @param capacity Entries that fit in stats
+ * @param count Output: records there are, which may exceed capacity
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_INVALID_PARAM if count is NULL,
+ *         or stats is NULL with a capacity
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_get_last_folder_stats(SevenZipFolderStats* stats,
+                                                              size_t capacity, size_t* count);
+
+/* ============================================================================
+ * Memory Accounting
+ * ============================================================================ */
+
+/* What a heap block of the library is for, indexes of SevenZipMemoryStats.categories */
+typedef enum {
+    SEVENZIP_MEM_MATCH_FINDER = 0, /* Encoders: match finders, windows, coder state, PPMd models */
+    SEVENZIP_MEM_IO_BUFFERS = 1,   /* Read, write, copy, prefetch and staging buffers */
+    SEVENZIP_MEM_HEADER = 2,       /* Archive headers being built or parsed, file tables */
+    SEVENZIP_MEM_NAMES = 3,        /* File names and paths */
+    SEVENZIP_MEM_DECODER = 4,      /* Decoders: dictionaries, windows, unpacked folders */
+    SEVENZIP_MEM_OTHER = 5,        /* Everything else (ciphers, work queues, indexes) */
+    SEVENZIP_MEM_CATEGORY_COUNT = 6
+} SevenZipMemCategory;
+
+typedef struct {
+    uint64_t current_bytes;        /* Held right now */
+    uint64_t peak_bytes;           /* Most held at once since start or the last reset */
+    uint64_t allocations;          /* Blocks allocated since start */
+} SevenZipMemUsage;
+
+/*
+ * Heap use of the library, process-wide. The total peak is the most held
+ * at once over all categories, which may be less than the sum of their
+ * peaks. Requested sizes are counted; allocator overhead is not, and
+ * huge-page blocks count their requested size, not the mapped pages.
+ */
+typedef struct {
+    SevenZipMemUsage categories[SEVENZIP_MEM_CATEGORY_COUNT];
+    SevenZipMemUsage total;
+} SevenZipMemoryStats;
+
+/**
+ * Get the library's current and peak heap use by category
+ * Counts the encoder, decoder, header, name and buffer memory of every
+ * operation and open archive; small fixed-size records (handles, tokens,
+ * per-thread error and stats records) are not counted.
+ * @param stats Output structure
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_INVALID_PARAM if stats is NULL
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_get_memory_stats(SevenZipMemoryStats* stats);
+
+/**
+ * Restart peak tracking: every peak becomes the current value
+ */
+SEVENZIP_API void sevenzip_reset_memory_peaks(void);
+
+/**
+ * Caller-supplied allocator for the library's counted heap blocks
+ * `alloc` returns `size` bytes aligned to at least 16 bytes, or NULL;
+ * `free` releases a block `alloc` returned. Both may be called from any
+ * thread at once.
+ */
+typedef struct {
+    void* (*alloc)(void* opaque, size_t size);
+    void (*free)(void* opaque, void* address);
+    void* opaque;
+} SevenZipAllocator;
+
+/**
+ * Route the library's counted heap blocks through a caller-supplied allocator
+ * Huge pages, when enabled with sevenzip_set_large_pages(), still back
+ * the big encoder and decoder blocks; requests the OS refuses and all
+ * other blocks go to this allocator. Call while no operation is running
+ * and no archive is open: blocks are freed by the allocator in place when
+ * they are released.
+ * @param allocator Allocator to copy, or NULL for the default (malloc)
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_INVALID_PARAM if a function is missing
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_set_allocator(const SevenZipAllocator* allocator);
+
+/* ============================================================================
+ * Process Metrics
+ * ============================================================================ */
+
+/* Operations counted by sevenzip_metrics_snapshot(), indexes of SevenZipMetrics.ops */
+typedef enum {
+    SEVENZIP_METRIC_CREATE = 0,    /* sevenzip_create_7z_streaming() and the writers built on it, sevenzip_create_7z_from_source() */
+    SEVENZIP_METRIC_EXTRACT = 1,   /* sevenzip_extract*() to a directory, streaming and split ones included */
+    SEVENZIP_METRIC_LIST = 2,      /* sevenzip_list() */
+    SEVENZIP_METRIC_TEST = 3,      /* sevenzip_test_archive*() */
+    SEVENZIP_METRIC_READ = 4,      /* sevenzip_archive_extract_entry() */
+    SEVENZIP_METRIC_OP_COUNT = 5
+} SevenZipMetricOp;
+
+/* Caches counted by sevenzip_metrics_snapshot(), indexes of SevenZipMetrics.caches */
+typedef enum {
+    SEVENZIP_METRIC_CACHE_KEY = 0,     /* Derived password keys */
+    SEVENZIP_METRIC_CACHE_HEADER = 1,  /* Parsed archives an archive service keeps open */
+    SEVENZIP_METRIC_CACHE_FOLDER = 2,  /* Decoded folders of SevenZipArchive handles */
+    SEVENZIP_METRIC_CACHE_COUNT = 3
+} SevenZipMetricCache;
+
+/* Latency buckets of each operation: 1 ms doubling up to 16.384 s, then +Inf */
+#define SEVENZIP_METRICS_BUCKETS 16
+
+typedef struct {
+    uint64_t count;                /* Finished */
+    uint64_t errors;               /* Finished with a result other than SEVENZIP_OK */
+    uint64_t bytes_in;             /* Read: input files (create), packed data of the folders decoded (extract, test) */
+    uint64_t bytes_out;            /* Produced: archive bytes (create), file data (extract, test, read) */
+    double latency_seconds;        /* Sum over the finished operations */
+    uint64_t latency_buckets[SEVENZIP_METRICS_BUCKETS];  /* Cumulative: finished within latency_bounds[i] */
+} SevenZipOpMetrics;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+} SevenZipCacheMetrics;
+
+/*
+ * Process-wide counters since start. Counters only grow; the job,
+ * thread and memory figures are the current values. Shaped after
+ * Prometheus: each SevenZipOpMetrics maps onto a histogram with `le`
+ * bounds latency_bounds, _sum latency_seconds and _count count.
+ */
+typedef struct {
+    SevenZipOpMetrics ops[SEVENZIP_METRIC_OP_COUNT];
+    double latency_bounds[SEVENZIP_METRICS_BUCKETS];  /* Upper bounds in seconds, the last +Inf */
+    SevenZipCacheMetrics caches[SEVENZIP_METRIC_CACHE_COUNT];
+    uint64_t jobs_active;          /* sevenzip_submit_*() jobs running */
+    uint64_t jobs_queued;          /* Submitted jobs waiting for a runner */
+    uint64_t threads_busy;         /* Compute threads leased by running operations */
+    uint64_t bytes_allocated;      /* Heap held, as sevenzip_get_memory_stats() total.current_bytes */
+    uint64_t allocations;          /* Heap blocks allocated since start */
+} SevenZipMetrics;
+
+/**
+ * Read the process-wide metrics, cheap enough to scrape every few seconds
+ * Every thread adds to counters of its own with plain stores, taking no
+ * lock and sharing no cache line; a snapshot sums them under a lock only
+ * thread start and exit also take. Counters of exited threads are kept.
+ * Bytes are counted for operations that succeeded; a snapshot taken
+ * while operations finish may see one's count before its buckets.
+ * @param metrics Output structure
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_INVALID_PARAM if metrics is NULL
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_metrics_snapshot(SevenZipMetrics* metrics);
+
+/* ============================================================================
+ * Tracing
+ * ============================================================================ */
+
+/**
+ * Write the recorded timeline as Chrome trace JSON (chrome://tracing, Perfetto)
+ * Only libraries built with ENABLE_TRACE record: every thread keeps its
+ * latest 8192 spans of input reads, encoder calls, packed writes, volume
+ * opens and header builds, each with its byte count (the volume index
+ * for volume opens). Recording costs two clock reads per span and takes
+ * no lock. Dumping does not clear the spans; spans recorded while the
+ * dump runs may be missing or torn, so dump between operations.
+ * @param path Output file
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_NOT_IMPLEMENTED without
+ *         ENABLE_TRACE, SEVENZIP_ERROR_OPEN_FILE if the file cannot be written
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_trace_dump(const char* path);
+
+/* ============================================================================
+ * CPU Benchmark and Auto-Tuning
+ * ============================================================================ */
+
+/* LZMA coder speed of this host at one level, see sevenzip_benchmark() */
+typedef struct {
+    SevenZipCompressionLevel level;
+    int threads;                   /* Threads run at once for the *_all rates */
+    double encode_mbps;            /* One encoder thread alone, MB/s of input */
+    double decode_mbps;            /* One decoder thread alone, MB/s of output */
+    double encode_mbps_all;        /* All `threads` encoders together */
+    double decode_mbps_all;        /* All `threads` decoders together */
+} SevenZipBenchmarkResult;
+
+/**
+ * Measure LZMA encode and decode speed on this host, like `7z b`
+ * Times the LZMA coder that every LZMA2 block runs on, over 1 MB of
+ * generated data of roughly 3:1 compressibility: one thread alone, then
+ * `threads` at once, each run repeated for at least 0.2 seconds. Takes
+ * about a second and some 16 MB per thread. Results are cached per
+ * level and thread count for the life of the process; concurrent calls
+ * wait for each other so that measurements do not overlap.
+ * @param level Level to measure (not SEVENZIP_LEVEL_STORE)
+ * @param threads Threads for the *_all rates (0 = hardware threads)
+ * @param result Output structure
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM for a NULL
+ *         result or an unusable level, SEVENZIP_ERROR_MEMORY
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_benchmark(SevenZipCompressionLevel level, int threads,
+                                                  SevenZipBenchmarkResult* result);
+
+/* Settings picked by sevenzip_auto_tune() */
+typedef struct {
+    SevenZipCompressionLevel level;
+    int num_threads;               /* For the num_threads option */
+    uint64_t block_size;           /* For the block_size option (0 = input size unknown: keep the default) */
+    double expected_mbps;          /* Predicted encode throughput, MB/s of input */
+} SevenZipTuning;
+
+/**
+ * Pick level, threads and LZMA2 block size for a target throughput
+ * Benchmarks the levels it considers with sevenzip_benchmark() (cached)
+ * and takes the highest level whose predicted throughput on at most all
+ * hardware threads reaches the target, with the fewest threads that do.
+ * Predictions scale the per-thread rate measured with all threads busy.
+ * The block size gives every thread a block of its own when the input
+ * is smaller than threads times the default block. If no level is fast
+ * enough, SEVENZIP_LEVEL_FASTEST on all threads is returned and
+ * expected_mbps stays below the target.
+ * @param target_mbps Wanted MB/s of input (0 or less = best ratio on all threads)
+ * @param input_size Bytes to compress (0 = unknown)
+ * @param max_level Highest level to consider
+ * @param tuning Output structure
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM for a NULL
+ *         tuning or a max_level of SEVENZIP_LEVEL_STORE, SEVENZIP_ERROR_MEMORY
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_auto_tune(double target_mbps, uint64_t input_size,
+                                                  SevenZipCompressionLevel max_level,
+                                                  SevenZipTuning* tuning);
+
+/* sevenzip_estimate_job() options, set up with sevenzip_estimate_options_init() */
+typedef struct {
+    double sample_fraction;        /* Share of each file type's bytes read and compressed (default: 0.01) */
+    uint64_t min_sample_bytes;     /* Per file type at least this much, or all of it (default: 1MB) */
+    uint64_t max_sample_bytes;     /* All file types together at most this much, which also caps the dictionary the samples get (default: 16MB) */
+    SevenZipCompressionLevel min_level;  /* Levels estimated, min_level to max_level (default: FASTEST to ULTRA) */
+    SevenZipCompressionLevel max_level;
+    int num_threads;               /* Threads the job would run with (0 = hardware threads) */
+} SevenZipEstimateOptions;
+
+/* Prediction for one level, see sevenzip_estimate_job() */
+typedef struct {
+    SevenZipCompressionLevel level;
+    int num_threads;               /* Threads the job keeps busy: num_threads, at most one per default LZMA2 block (4x the level's dictionary) */
+    uint64_t input_bytes;          /* Bytes of the inputs */
+    uint64_t sample_bytes;         /* Bytes compressed to predict from */
+    uint64_t predicted_size;       /* Packed data, headers not counted */
+    double predicted_seconds;      /* Encoder wall time on num_threads */
+    double predicted_seconds_one_thread;
+} SevenZipJobEstimate;
+
+SEVENZIP_API void sevenzip_estimate_options_init(SevenZipEstimateOptions* options);
+
+/**
+ * Predict archive size and compression time per level before compressing
+ * Groups the files below input_paths by extension and reads from each
+ * group sample_fraction of its bytes, in pieces spread evenly over it
+ * and joined across file boundaries the way a solid folder joins them.
+ * Each group's samples are compressed on this host at every level; the
+ * group's share of size and time scales with its bytes. Times on several
+ * threads scale the one-thread time by sevenzip_benchmark() (cached), so
+ * the first call with a thread count takes about a second per level.
+ * Reading the inputs is not counted, and samples see a dictionary no
+ * larger than themselves, so slow disks and data with distant repeats
+ * do better or worse than predicted.
+ * @param input_paths NULL-terminated files and directories, as for the create functions
+ * @param options Estimate options (NULL for defaults)
+ * @param estimates Output array, best ratio level first (may be NULL when capacity is 0)
+ * @param capacity Entries that fit in estimates
+ * @param count Output: levels estimated, which may exceed capacity
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM for no
+ *         inputs, a NULL count or an unusable level range,
+ *         SEVENZIP_ERROR_OPEN_FILE if an input cannot be read,
+ *         SEVENZIP_ERROR_MEMORY
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_estimate_job(const char** input_paths,
+                                                     const SevenZipEstimateOptions* options,
+                                                     SevenZipJobEstimate* estimates, size_t capacity,
+                                                     size_t* count);
+
+/* Kernels this host runs, see sevenzip_get_cpu_features(); each is 1 when in use */
+typedef struct {
+    int crc32_hw;                  /* CRC-32 with the ARMv8 CRC instructions (else slicing tables) */
+    int aes_hw;                    /* AES-NI or ARMv8 AES for AES-256 */
+    int aes_vaes_avx2;             /* VAES on 256-bit registers for CBC decryption */
+    int sha256_hw;                 /* SHA-NI or ARMv8 SHA-256 instructions */
+    int match_finder_bits;         /* Match-finder normalisation width: 256 (AVX2), 128 (SSE4.1, NEON), 0 (scalar) */
+    int xxh3_avx2;                 /* XXH3 stripes with AVX2 */
+    int lzma_dec_asm;              /* LZMA decoder loop in assembly (ENABLE_ASM_LZMA_DEC) */
+} SevenZipCpuFeatures;
+
+/**
+ * Report which CPU-specific kernels are in use
+ * The SIMD kernels are chosen once per process from the CPUID / hwcaps
+ * detection in CpuArch.c, so one binary takes the fast paths a host has
+ * and the portable C ones elsewhere; this reports that choice.
+ * lzma_dec_asm is fixed at build time.
+ * @param features Output structure
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_INVALID_PARAM for NULL
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_get_cpu_features(SevenZipCpuFeatures* features);
+
+/* Hot loops of the library, each with the versions listed by sevenzip_kernel_variants() */
+typedef enum {
+    SEVENZIP_KERNEL_CRC32 = 0,          /* Every CRC computed or checked */
+    SEVENZIP_KERNEL_AES_CBC_ENCODE = 1, /* 7zAES encryption */
+    SEVENZIP_KERNEL_AES_CBC_DECODE = 2, /* 7zAES decryption */
+    SEVENZIP_KERNEL_SHA256 = 3,         /* Digest manifests and the 7zAES key derivation */
+    SEVENZIP_KERNEL_MATCH_FINDER = 4    /* LZMA/LZMA2 encoder match search */
+} SevenZipKernel;
+
+/* Most variants sevenzip_kernel_variants() can list */
+#define SEVENZIP_MAX_KERNEL_VARIANTS 16
+
+/* A version of a kernel this host can run */
+typedef struct {
+    SevenZipKernel kernel;
+    const char* name;              /* "slice4", "slice8", "armv8-crc32", "scalar", "aes-ni", "armv8-aes", "vaes-avx2", "sha-ni", "armv8-sha2", "bt4", "hc4"; static */
+    int in_use;                    /* 1 for the version runtime dispatch picked (both match finders: bt4 serves levels 5 and up, hc4 those below) */
+} SevenZipKernelVariant;
+
+/**
+ * List the versions of each kernel this host can run
+ * Variants are in kernel order, portable versions first, and their
+ * indexes stay the same for the life of the process.
+ * @param variants Output array (may be NULL to count)
+ * @param capacity Entries of `variants`
+ * @return Number of variants, also those beyond capacity
+ */
+SEVENZIP_API size_t sevenzip_kernel_variants(SevenZipKernelVariant* variants, size_t capacity);
+
+/**
+ * Run one kernel variant over a buffer, for timing it
+ * CRC-32 and SHA-256 read the buffer; AES-CBC encrypts or decrypts it in
+ * place with a fixed key; the match finder finds the matches at every
+ * position with a window of up to 16MB, as the encoder's search does.
+ * @param variant Index from sevenzip_kernel_variants()
+ * @param data Buffer; 16-byte aligned for AES
+ * @param size Bytes; a multiple of 16 for AES, at most 1GB for the match finder
+ * @param check Output: a value depending on the result, so the work
+ *        cannot be skipped (may be NULL)
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_INVALID_PARAM for an unknown variant
+ *         or a buffer the kernel cannot take, SEVENZIP_ERROR_MEMORY
+ */
+SEVENZIP_API SevenZipErrorCode sevenzip_kernel_run(size_t variant, void* data, size_t size,
+                                                   uint32_t* check);
+
 #ifdef __cplusplus
 }
 #endif
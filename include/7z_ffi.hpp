@@ -0,0 +1,556 @@
+/**
+ * 7z FFI SDK - C++17 Wrapper
+ *
+ * Header-only layer over 7z_ffi.h: move-only handles that free what the C
+ * calls hand out, views over the C results instead of copies, and
+ * adapters that turn an object's member functions into the callback
+ * structs of the streaming calls. Nothing here allocates or copies
+ * beyond what the C function it wraps does, with one exception noted on
+ * PathArray. Errors are returned as SevenZipErrorCode, as in C; nothing
+ * throws.
+ *
+ *     sevenzip::Archive archive;
+ *     if (sevenzip::Archive::open("a.7z", nullptr, archive) != SEVENZIP_OK) ...
+ *     sevenzip::List list;
+ *     archive.list(list);
+ *     for (sevenzip::EntryView e : list)
+ *         if (e.name() == "docs/readme.txt") ...
+ *
+ * C++17 has no std::span, so Span is a pointer and a count, made from a
+ * C array, a pointer and a size, or any contiguous container with data()
+ * and size() (std::vector, std::array, std::span under C++20).
+ */
+
+#ifndef SEVENZIP_FFI_HPP
+#define SEVENZIP_FFI_HPP
+
+#include "7z_ffi.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace sevenzip {
+
+using ErrorCode = SevenZipErrorCode;
+
+inline const char* error_string(ErrorCode code) { return sevenzip_get_error_string(code); }
+
+/* Contiguous elements held elsewhere */
+template <class T>
+class Span {
+public:
+    constexpr Span() noexcept = default;
+    constexpr Span(T* data, size_t size) noexcept : data_(data), size_(size) {}
+    template <size_t N>
+    constexpr Span(T (&array)[N]) noexcept : data_(array), size_(N) {}
+    template <class C, class = std::enable_if_t<
+        std::is_convertible_v<decltype(std::declval<C&>().data()), T*> &&
+        !std::is_same_v<std::remove_cv_t<std::remove_reference_t<C>>, Span>>>
+    constexpr Span(C&& container) noexcept : data_(container.data()), size_(container.size()) {}
+
+    constexpr T* data() const noexcept { return data_; }
+    constexpr size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T& operator[](size_t i) const noexcept { return data_[i]; }
+    constexpr T* begin() const noexcept { return data_; }
+    constexpr T* end() const noexcept { return data_ + size_; }
+
+private:
+    T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+using Bytes = Span<const unsigned char>;
+
+/* NUL-terminated string held elsewhere: a const char* or a std::string,
+   never a std::string_view, which need not end in a NUL */
+class CStr {
+public:
+    constexpr CStr(const char* s) noexcept : s_(s) {}
+    CStr(const std::string& s) noexcept : s_(s.c_str()) {}
+    constexpr const char* c_str() const noexcept { return s_; }
+
+private:
+    const char* s_;
+};
+
+/**
+ * NULL-terminated path array for the C calls, from a C array, Span or
+ * contiguous container of C strings or std::strings. An array of
+ * const char* that already ends in nullptr is passed through as it is;
+ * otherwise the pointers (not the strings) are copied to an array on
+ * the stack, or for kInline paths or more to one heap array. Keep it
+ * alive for the call it is passed to.
+ */
+class PathArray {
+public:
+    static constexpr size_t kInline = 32;
+
+    template <class C>
+    PathArray(const C& paths) {
+        using E = std::remove_cv_t<std::remove_reference_t<decltype(*std::data(paths))>>;
+        const size_t count = std::size(paths);
+        if constexpr (std::is_same_v<E, std::string>) {
+            const char** out = reserve(count);
+            for (size_t i = 0; i < count; i++) out[i] = std::data(paths)[i].c_str();
+            out[count] = nullptr;
+        } else {
+            static_assert(std::is_convertible_v<E, const char*>, "paths must be C strings or std::strings");
+            if constexpr (std::is_same_v<E, const char*>) {
+                if (count > 0 && std::data(paths)[count - 1] == nullptr) {
+                    paths_ = const_cast<const char**>(std::data(paths));
+                    return;
+                }
+            }
+            const char** out = reserve(count);
+            for (size_t i = 0; i < count; i++) out[i] = std::data(paths)[i];
+            out[count] = nullptr;
+        }
+    }
+    PathArray(const PathArray&) = delete;
+    PathArray& operator=(const PathArray&) = delete;
+
+    const char** get() const noexcept { return paths_; }
+
+private:
+    const char** reserve(size_t count) {
+        if (count < kInline) {
+            paths_ = inline_;
+        } else {
+            heap_.reset(new const char*[count + 1]);
+            paths_ = heap_.get();
+        }
+        return paths_;
+    }
+
+    const char** paths_ = nullptr;
+    const char* inline_[kInline];
+    std::unique_ptr<const char*[]> heap_;
+};
+
+/* One entry of a List, pointing into it */
+class EntryView {
+public:
+    explicit EntryView(const SevenZipEntry* entry) noexcept : e_(entry) {}
+
+    std::string_view name() const noexcept { return e_->name ? std::string_view(e_->name) : std::string_view(); }
+    const char* c_name() const noexcept { return e_->name; }
+    uint64_t size() const noexcept { return e_->size; }
+    uint64_t packed_size() const noexcept { return e_->packed_size; }
+    uint64_t modified_time() const noexcept { return e_->modified_time; }
+    uint32_t attributes() const noexcept { return e_->attributes; }
+    bool is_directory() const noexcept { return e_->is_directory != 0; }
+    const SevenZipEntry& raw() const noexcept { return *e_; }
+
+private:
+    const SevenZipEntry* e_;
+};
+
+/* Entries of sevenzip_list(), sevenzip_archive_list() or a page of them */
+class List {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = EntryView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = EntryView;
+
+        explicit iterator(const SevenZipEntry* p) noexcept : p_(p) {}
+        EntryView operator*() const noexcept { return EntryView(p_); }
+        EntryView operator[](difference_type n) const noexcept { return EntryView(p_ + n); }
+        iterator& operator++() noexcept { ++p_; return *this; }
+        iterator operator++(int) noexcept { iterator t = *this; ++p_; return t; }
+        iterator& operator--() noexcept { --p_; return *this; }
+        iterator operator--(int) noexcept { iterator t = *this; --p_; return t; }
+        iterator& operator+=(difference_type n) noexcept { p_ += n; return *this; }
+        iterator& operator-=(difference_type n) noexcept { p_ -= n; return *this; }
+        iterator operator+(difference_type n) const noexcept { return iterator(p_ + n); }
+        iterator operator-(difference_type n) const noexcept { return iterator(p_ - n); }
+        difference_type operator-(const iterator& o) const noexcept { return p_ - o.p_; }
+        bool operator==(const iterator& o) const noexcept { return p_ == o.p_; }
+        bool operator!=(const iterator& o) const noexcept { return p_ != o.p_; }
+        bool operator<(const iterator& o) const noexcept { return p_ < o.p_; }
+
+    private:
+        const SevenZipEntry* p_;
+    };
+
+    List() noexcept = default;
+    explicit List(SevenZipList* list) noexcept : list_(list) {}
+    List(List&& o) noexcept : list_(std::exchange(o.list_, nullptr)) {}
+    List& operator=(List&& o) noexcept {
+        if (this != &o) reset(std::exchange(o.list_, nullptr));
+        return *this;
+    }
+    List(const List&) = delete;
+    List& operator=(const List&) = delete;
+    ~List() { reset(); }
+
+    /* sevenzip_list() */
+    static ErrorCode open(CStr archive_path, const char* password, List& out) {
+        SevenZipList* list = nullptr;
+        ErrorCode rc = sevenzip_list(archive_path.c_str(), password, &list);
+        if (rc == SEVENZIP_OK) out.reset(list);
+        return rc;
+    }
+
+    size_t size() const noexcept { return list_ ? list_->count : 0; }
+    bool empty() const noexcept { return size() == 0; }
+    EntryView operator[](size_t i) const noexcept { return EntryView(&list_->entries[i]); }
+    iterator begin() const noexcept { return iterator(list_ ? list_->entries : nullptr); }
+    iterator end() const noexcept { return begin() + (std::ptrdiff_t)size(); }
+
+    SevenZipList* get() const noexcept { return list_; }
+    SevenZipList* release() noexcept { return std::exchange(list_, nullptr); }
+    void reset(SevenZipList* list = nullptr) noexcept {
+        if (list_) sevenzip_free_list(list_);
+        list_ = list;
+    }
+
+private:
+    SevenZipList* list_ = nullptr;
+};
+
+namespace detail {
+
+template <class T, class = void> struct HasBeginEntry : std::false_type {};
+template <class T> struct HasBeginEntry<T, std::void_t<decltype(std::declval<T&>().begin_entry(
+    uint32_t(), std::string_view(), uint64_t()))>> : std::true_type {};
+template <class T, class = void> struct HasWrite : std::false_type {};
+template <class T> struct HasWrite<T, std::void_t<decltype(std::declval<T&>().write(
+    uint32_t(), Bytes()))>> : std::true_type {};
+template <class T, class = void> struct HasEndEntry : std::false_type {};
+template <class T> struct HasEndEntry<T, std::void_t<decltype(std::declval<T&>().end_entry(
+    uint32_t()))>> : std::true_type {};
+template <class T, class = void> struct HasBeginVolume : std::false_type {};
+template <class T> struct HasBeginVolume<T, std::void_t<decltype(std::declval<T&>().begin_volume(
+    uint32_t()))>> : std::true_type {};
+template <class T, class = void> struct HasEndVolume : std::false_type {};
+template <class T> struct HasEndVolume<T, std::void_t<decltype(std::declval<T&>().end_volume(
+    uint32_t(), uint64_t()))>> : std::true_type {};
+
+inline Bytes bytes(const void* data, size_t size) noexcept {
+    return Bytes(static_cast<const unsigned char*>(data), size);
+}
+
+} // namespace detail
+
+/**
+ * SevenZipExtractSink calling the members of `sink` that it has:
+ *     int begin_entry(uint32_t index, std::string_view name, uint64_t size);
+ *     int write(uint32_t index, sevenzip::Bytes data);
+ *     int end_entry(uint32_t index);
+ * Each returns 0 to go on. `data` is the decoder's window, valid during
+ * the call only; `sink` must outlive the extraction.
+ */
+template <class T>
+SevenZipExtractSink extract_sink(T& sink) noexcept {
+    SevenZipExtractSink s{};
+    s.user_data = &sink;
+    if constexpr (detail::HasBeginEntry<T>::value) {
+        s.begin_entry = [](uint32_t index, const char* name, uint64_t size, void* u) -> int {
+            return static_cast<T*>(u)->begin_entry(index, std::string_view(name), size);
+        };
+    }
+    if constexpr (detail::HasWrite<T>::value) {
+        s.write = [](uint32_t index, const void* data, size_t size, void* u) -> int {
+            return static_cast<T*>(u)->write(index, detail::bytes(data, size));
+        };
+    }
+    if constexpr (detail::HasEndEntry<T>::value) {
+        s.end_entry = [](uint32_t index, void* u) -> int { return static_cast<T*>(u)->end_entry(index); };
+    }
+    return s;
+}
+
+/**
+ * SevenZipArchiveSink calling the members of `sink`:
+ *     int write(uint32_t volume, sevenzip::Bytes data);
+ *     int patch(uint64_t offset, sevenzip::Bytes data);
+ * and, if it has them,
+ *     int begin_volume(uint32_t volume);
+ *     int end_volume(uint32_t volume, uint64_t size);
+ */
+template <class T>
+SevenZipArchiveSink archive_sink(T& sink) noexcept {
+    SevenZipArchiveSink s{};
+    s.user_data = &sink;
+    s.write = [](uint32_t volume, const void* data, size_t size, void* u) -> int {
+        return static_cast<T*>(u)->write(volume, detail::bytes(data, size));
+    };
+    s.patch = [](uint64_t offset, const void* data, size_t size, void* u) -> int {
+        return static_cast<T*>(u)->patch(offset, detail::bytes(data, size));
+    };
+    if constexpr (detail::HasBeginVolume<T>::value) {
+        s.begin_volume = [](uint32_t volume, void* u) -> int { return static_cast<T*>(u)->begin_volume(volume); };
+    }
+    if constexpr (detail::HasEndVolume<T>::value) {
+        s.end_volume = [](uint32_t volume, uint64_t size, void* u) -> int {
+            return static_cast<T*>(u)->end_volume(volume, size);
+        };
+    }
+    return s;
+}
+
+/**
+ * SevenZipEntrySource calling `int next_entry(SevenZipSourceEntry& entry)`
+ * of `source`; set the entry's data with bind_read()
+ */
+template <class T>
+SevenZipEntrySource entry_source(T& source) noexcept {
+    SevenZipEntrySource s{};
+    s.user_data = &source;
+    s.next_entry = [](SevenZipSourceEntry* entry, void* u) -> int {
+        return static_cast<T*>(u)->next_entry(*entry);
+    };
+    return s;
+}
+
+/* SevenZipReadCallback of `reader`'s `int read(void* buf, size_t& size)` */
+template <class R>
+constexpr SevenZipReadCallback read_callback() noexcept {
+    return [](void* buf, size_t* size, void* u) -> int { return static_cast<R*>(u)->read(buf, *size); };
+}
+
+/* Read the data of a source entry from `reader`, until the next next_entry() */
+template <class R>
+void bind_read(SevenZipSourceEntry& entry, R& reader) noexcept {
+    entry.read = read_callback<R>();
+    entry.read_user_data = &reader;
+}
+
+/* SevenZipStreamOptions.next_input_path from `const char* next()` of `paths` */
+template <class P>
+void bind_input_paths(SevenZipStreamOptions& options, P& paths) noexcept {
+    options.next_input_path = [](void* u) -> const char* { return static_cast<P*>(u)->next(); };
+    options.input_path_user_data = &paths;
+}
+
+/**
+ * SevenZipRangeReader calling `int read_at(uint64_t offset, void* buf,
+ * size_t size)` of `reader`, possibly from several threads at once
+ */
+template <class R>
+SevenZipRangeReader range_reader(R& reader, uint64_t size) noexcept {
+    SevenZipRangeReader r{};
+    r.read_at = [](void* u, uint64_t offset, void* buf, size_t n) -> int {
+        return static_cast<R*>(u)->read_at(offset, buf, n);
+    };
+    r.size = size;
+    r.user_data = &reader;
+    return r;
+}
+
+/* One file of an open Archive, read a piece at a time */
+class EntryReader {
+public:
+    EntryReader() noexcept = default;
+    EntryReader(EntryReader&& o) noexcept : r_(std::exchange(o.r_, nullptr)) {}
+    EntryReader& operator=(EntryReader&& o) noexcept {
+        if (this != &o) reset(std::exchange(o.r_, nullptr));
+        return *this;
+    }
+    EntryReader(const EntryReader&) = delete;
+    EntryReader& operator=(const EntryReader&) = delete;
+    ~EntryReader() { reset(); }
+
+    /* size: in, capacity of buffer; out, bytes read, 0 at the end. Also
+       the read() of read_callback(), so a reader can feed bind_read() */
+    ErrorCode read(void* buffer, size_t& size) { return sevenzip_entry_reader_read(r_, buffer, &size); }
+
+    SevenZipEntryReader* get() const noexcept { return r_; }
+    void reset(SevenZipEntryReader* r = nullptr) noexcept {
+        if (r_) sevenzip_entry_reader_close(r_);
+        r_ = r;
+    }
+
+private:
+    SevenZipEntryReader* r_ = nullptr;
+};
+
+/* Archive opened once for several list and extract calls */
+class Archive {
+public:
+    Archive() noexcept = default;
+    explicit Archive(SevenZipArchive* archive) noexcept : a_(archive) {}
+    Archive(Archive&& o) noexcept : a_(std::exchange(o.a_, nullptr)) {}
+    Archive& operator=(Archive&& o) noexcept {
+        if (this != &o) reset(std::exchange(o.a_, nullptr));
+        return *this;
+    }
+    Archive(const Archive&) = delete;
+    Archive& operator=(const Archive&) = delete;
+    ~Archive() { reset(); }
+
+    static ErrorCode open(CStr archive_path, const char* password, Archive& out) {
+        SevenZipArchive* a = nullptr;
+        ErrorCode rc = sevenzip_open(archive_path.c_str(), password, &a);
+        if (rc == SEVENZIP_OK) out.reset(a);
+        return rc;
+    }
+    /* `reader`'s callback must outlive the Archive, see range_reader() */
+    static ErrorCode open_range(const SevenZipRangeReader& reader, const char* password, Archive& out) {
+        SevenZipArchive* a = nullptr;
+        ErrorCode rc = sevenzip_open_range(&reader, password, &a);
+        if (rc == SEVENZIP_OK) out.reset(a);
+        return rc;
+    }
+
+    uint32_t entry_count() const noexcept { return sevenzip_archive_entry_count(a_); }
+
+    ErrorCode list(List& out) const {
+        SevenZipList* list = nullptr;
+        ErrorCode rc = sevenzip_archive_list(a_, &list);
+        if (rc == SEVENZIP_OK) out.reset(list);
+        return rc;
+    }
+    ErrorCode list_page(uint32_t first_index, uint32_t max_entries, List& out) const {
+        SevenZipList* list = nullptr;
+        ErrorCode rc = sevenzip_archive_list_page(a_, first_index, max_entries, &list);
+        if (rc == SEVENZIP_OK) out.reset(list);
+        return rc;
+    }
+
+    template <class T>
+    ErrorCode extract_entry(uint32_t entry_index, T& sink) const {
+        SevenZipExtractSink s = extract_sink(sink);
+        return sevenzip_archive_extract_entry(a_, entry_index, &s);
+    }
+    template <class T>
+    ErrorCode extract_entries(Span<const uint32_t> entry_indices, T& sink) const {
+        SevenZipExtractSink s = extract_sink(sink);
+        return sevenzip_archive_extract_entries(a_, entry_indices.data(), (uint32_t)entry_indices.size(), &s);
+    }
+
+    /* The reader must be closed before the Archive */
+    ErrorCode open_reader(uint32_t entry_index, EntryReader& out) const {
+        SevenZipEntryReader* r = nullptr;
+        ErrorCode rc = sevenzip_entry_reader_open(a_, entry_index, &r);
+        if (rc == SEVENZIP_OK) out.reset(r);
+        return rc;
+    }
+
+    void set_folder_cache(uint64_t max_folder_size) { sevenzip_archive_set_folder_cache(a_, max_folder_size); }
+    void set_cache_budget(uint64_t total_bytes) { sevenzip_archive_set_cache_budget(a_, total_bytes); }
+
+    SevenZipArchive* get() const noexcept { return a_; }
+    SevenZipArchive* release() noexcept { return std::exchange(a_, nullptr); }
+    void reset(SevenZipArchive* a = nullptr) noexcept {
+        if (a_) sevenzip_close(a_);
+        a_ = a;
+    }
+
+private:
+    SevenZipArchive* a_ = nullptr;
+};
+
+/**
+ * Background job; destroying the handle lets an unfinished job go on,
+ * so callbacks and user data it was given must outlive the job itself
+ */
+class Job {
+public:
+    Job() noexcept = default;
+    explicit Job(SevenZipJob* job) noexcept : j_(job) {}
+    Job(Job&& o) noexcept : j_(std::exchange(o.j_, nullptr)) {}
+    Job& operator=(Job&& o) noexcept {
+        if (this != &o) reset(std::exchange(o.j_, nullptr));
+        return *this;
+    }
+    Job(const Job&) = delete;
+    Job& operator=(const Job&) = delete;
+    ~Job() { reset(); }
+
+    /* sevenzip_submit_create(); paths and options are copied by the library */
+    static ErrorCode submit_create(CStr archive_path, const PathArray& input_paths,
+                                   SevenZipCompressionLevel level, const SevenZipStreamOptions* options,
+                                   Job& out, SevenZipBytesProgressCallback progress = nullptr,
+                                   SevenZipJobCallback done = nullptr, void* user_data = nullptr) {
+        SevenZipJob* j = nullptr;
+        ErrorCode rc = sevenzip_submit_create(archive_path.c_str(), input_paths.get(), level, options,
+                                              progress, done, user_data, &j);
+        if (rc == SEVENZIP_OK) out.reset(j);
+        return rc;
+    }
+    static ErrorCode submit_extract(CStr archive_path, CStr output_dir, const char* password,
+                                    const SevenZipExtractOptions* options, Job& out,
+                                    SevenZipProgressCallback progress = nullptr,
+                                    SevenZipJobCallback done = nullptr, void* user_data = nullptr) {
+        SevenZipJob* j = nullptr;
+        ErrorCode rc = sevenzip_submit_extract(archive_path.c_str(), output_dir.c_str(), password, options,
+                                               progress, done, user_data, &j);
+        if (rc == SEVENZIP_OK) out.reset(j);
+        return rc;
+    }
+
+    ErrorCode wait() { return sevenzip_job_wait(j_); }
+    bool poll(ErrorCode* result = nullptr) { return sevenzip_job_poll(j_, result) != 0; }
+    int fd() { return sevenzip_job_fd(j_); }
+    void cancel() { sevenzip_job_cancel(j_); }
+    void set_rate_limit(uint64_t read_bytes_per_sec, uint64_t write_bytes_per_sec) {
+        sevenzip_job_set_rate_limit(j_, read_bytes_per_sec, write_bytes_per_sec);
+    }
+
+    SevenZipJob* get() const noexcept { return j_; }
+    SevenZipJob* release() noexcept { return std::exchange(j_, nullptr); }
+    void reset(SevenZipJob* j = nullptr) noexcept {
+        if (j_) sevenzip_job_free(j_);
+        j_ = j;
+    }
+
+private:
+    SevenZipJob* j_ = nullptr;
+};
+
+/* sevenzip_create_7z_streaming() */
+inline ErrorCode create_streaming(CStr archive_path, const PathArray& input_paths,
+                                  SevenZipCompressionLevel level, const SevenZipStreamOptions* options,
+                                  SevenZipBytesProgressCallback progress = nullptr, void* user_data = nullptr) {
+    return sevenzip_create_7z_streaming(archive_path.c_str(), input_paths.get(), level, options,
+                                        progress, user_data);
+}
+
+/* sevenzip_create_7z_to_sink() with the members of `sink`, see archive_sink() */
+template <class T>
+ErrorCode create_to_sink(const PathArray& input_paths, SevenZipCompressionLevel level,
+                         const SevenZipStreamOptions* options, T& sink,
+                         SevenZipBytesProgressCallback progress = nullptr, void* user_data = nullptr) {
+    SevenZipArchiveSink s = archive_sink(sink);
+    return sevenzip_create_7z_to_sink(input_paths.get(), level, options, &s, progress, user_data);
+}
+
+/* sevenzip_create_7z_from_source() with the members of `source`, see entry_source() */
+template <class T>
+ErrorCode create_from_source(CStr archive_path, T& source, SevenZipCompressionLevel level,
+                             const SevenZipStreamOptions* options,
+                             SevenZipBytesProgressCallback progress = nullptr, void* user_data = nullptr) {
+    SevenZipEntrySource s = entry_source(source);
+    return sevenzip_create_7z_from_source(archive_path.c_str(), &s, level, options, progress, user_data);
+}
+
+/* sevenzip_extract_to_sink() with the members of `sink`, see extract_sink();
+   files NULL-terminated, or nullptr for all */
+template <class T>
+ErrorCode extract_to_sink(CStr archive_path, const char** files, const char* password, T& sink) {
+    SevenZipExtractSink s = extract_sink(sink);
+    return sevenzip_extract_to_sink(archive_path.c_str(), files, password, &s);
+}
+
+/* sevenzip_extract_from_stream() reading from `int read(void* buf, size_t& size)` of `reader` */
+template <class R>
+ErrorCode extract_from_stream(R& reader, CStr output_dir, const SevenZipExtractOptions* options) {
+    return sevenzip_extract_from_stream(read_callback<R>(), output_dir.c_str(), options, nullptr, &reader);
+}
+
+} // namespace sevenzip
+
+#endif /* SEVENZIP_FFI_HPP */
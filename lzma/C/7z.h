@@ -126,6 +126,11 @@ typedef struct
 
   size_t *FileNameOffsets; /* in 2-byte steps */
   Byte *FileNames;  /* UTF-16-LE */
+
+  /* The decoded header, kept when names, times or attributes point into
+     it rather than into copies of their own */
+  Byte *HeaderBuf;
+  size_t HeaderSize;
 } CSzArEx;
 
 #define SzArEx_IsDir(p, i) (SzBitArray_Check((p)->IsDirs, i))
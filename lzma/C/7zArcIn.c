@@ -142,6 +142,9 @@ void SzArEx_Init(CSzArEx *p)
   
   p->FileNameOffsets = NULL;
   p->FileNames = NULL;
+
+  p->HeaderBuf = NULL;
+  p->HeaderSize = 0;
   
   SzBitUi32s_INIT(&p->CRCs)
   SzBitUi32s_INIT(&p->Attribs)
@@ -150,6 +153,20 @@ void SzArEx_Init(CSzArEx *p)
   SzBitUi64s_INIT(&p->CTime)
 }
 
+static int SzArEx_InHeader(const CSzArEx *p, const void *ptr)
+{
+  return ptr && p->HeaderBuf
+      && (const Byte *)ptr >= p->HeaderBuf
+      && (const Byte *)ptr < p->HeaderBuf + p->HeaderSize;
+}
+
+/* Values read in place are released with the header itself */
+static void SzArEx_FreeVals(CSzArEx *p, void *vals, ISzAllocPtr alloc)
+{
+  if (!SzArEx_InHeader(p, vals))
+    ISzAlloc_Free(alloc, vals);
+}
+
 void SzArEx_Free(CSzArEx *p, ISzAllocPtr alloc)
 {
   ISzAlloc_Free(alloc, p->UnpackPositions);
@@ -159,13 +176,21 @@ void SzArEx_Free(CSzArEx *p, ISzAllocPtr alloc)
   ISzAlloc_Free(alloc, p->FileToFolder);
 
   ISzAlloc_Free(alloc, p->FileNameOffsets);
-  ISzAlloc_Free(alloc, p->FileNames);
+  SzArEx_FreeVals(p, p->FileNames, alloc);
 
   SzBitUi32s_Free(&p->CRCs, alloc);
+  SzArEx_FreeVals(p, p->Attribs.Vals, alloc);
+  p->Attribs.Vals = NULL;
   SzBitUi32s_Free(&p->Attribs, alloc);
   // SzBitUi32s_Free(&p->Parents, alloc);
+  SzArEx_FreeVals(p, p->MTime.Vals, alloc);
+  p->MTime.Vals = NULL;
   SzBitUi64s_Free(&p->MTime, alloc);
+  SzArEx_FreeVals(p, p->CTime.Vals, alloc);
+  p->CTime.Vals = NULL;
   SzBitUi64s_Free(&p->CTime, alloc);
+
+  ISzAlloc_Free(alloc, p->HeaderBuf);
   
   SzAr_Free(&p->db, alloc);
   SzArEx_Init(p);
@@ -992,6 +1017,7 @@ static SRes SzReadAndDecodePackedStreams(
     UInt32 numFoldersMax,
     UInt64 baseOffset,
     CSzAr *p,
+    ISzAllocPtr allocBuf,
     ISzAllocPtr allocTemp)
 {
   UInt64 dataStartPos;
@@ -1013,7 +1039,7 @@ static SRes SzReadAndDecodePackedStreams(
     const UInt64 unpackSize = SzAr_GetFolderUnpackSize(p, fo);
     if ((size_t)unpackSize != unpackSize)
       return SZ_ERROR_MEM;
-    if (!Buf_Create(tempBuf, (size_t)unpackSize, allocTemp))
+    if (!Buf_Create(tempBuf, (size_t)unpackSize, allocBuf))
       return SZ_ERROR_MEM;
   }
   
@@ -1081,6 +1107,19 @@ static Z7_NO_INLINE SRes ReadTime(CSzBitUi64s *p, UInt32 num,
     sd.Data = tempBufs[index].data;
     sd.Size = tempBufs[index].size;
   }
+
+ #ifdef MY_CPU_LE_UNALIGN
+  if (external == 0 && num != 0 && CountDefinedBits(p->Defs, num) == num)
+  {
+    /* Every time stored in entry order: the header bytes are the array */
+    if (sd.Size / 8 < num)
+      return SZ_ERROR_ARCHIVE;
+    p->Vals = (CNtfsFileTime *)(void *)sd.Data;
+    SKIP_DATA2(sd, (size_t)num * 8)
+    *sd2 = sd;
+    return SZ_OK;
+  }
+ #endif
   
   MY_ALLOC_ZE(CNtfsFileTime, p->Vals, num, alloc)
   vals = p->Vals;
@@ -1152,7 +1191,7 @@ static SRes SzReadHeader2(
     tempAr.RangeLimit = p->db.RangeLimit;
 
     res = SzReadAndDecodePackedStreams(inStream, sd, tempBufs, NUM_ADDITIONAL_STREAMS_MAX,
-        p->startPosAfterHeader, &tempAr, allocTemp);
+        p->startPosAfterHeader, &tempAr, allocTemp, allocTemp);
     *numTempBufs = tempAr.NumFolders;
     SzAr_Free(&tempAr, allocTemp);
     
@@ -1229,7 +1268,15 @@ static SRes SzReadHeader2(
         if ((namesSize & 1) != 0)
           return SZ_ERROR_ARCHIVE;
         MY_ALLOC(size_t, p->FileNameOffsets, numFiles + 1, allocMain)
-        MY_ALLOC_ZE_AND_CPY(p->FileNames, namesSize, namesData, allocMain)
+        if (external == 0)
+        {
+          /* Names stay in the kept header, only their offsets are indexed */
+          p->FileNames = namesSize ? (Byte *)(void *)namesData : NULL;
+        }
+        else
+        {
+          MY_ALLOC_ZE_AND_CPY(p->FileNames, namesSize, namesData, allocMain)
+        }
         RINOK(SzReadFileNames(p->FileNames, namesSize, numFiles, p->FileNameOffsets))
         if (external == 0)
         {
@@ -1254,6 +1301,8 @@ static SRes SzReadHeader2(
         Byte external;
         CSzData sdSwitch;
         CSzData *sdPtr;
+        if (SzArEx_InHeader(p, p->Attribs.Vals))
+          p->Attribs.Vals = NULL;
         SzBitUi32s_Free(&p->Attribs, allocMain);
         RINOK(ReadBitVector(sd, numFiles, &p->Attribs.Defs, allocMain))
 
@@ -1270,6 +1319,16 @@ static SRes SzReadHeader2(
           sdSwitch.Size = (tempBufs)[index].size;
           sdPtr = &sdSwitch;
         }
+       #ifdef MY_CPU_LE_UNALIGN
+        if (external == 0 && numFiles != 0 && CountDefinedBits(p->Attribs.Defs, numFiles) == numFiles)
+        {
+          if (sd->Size / 4 < numFiles)
+            return SZ_ERROR_ARCHIVE;
+          p->Attribs.Vals = (UInt32 *)(void *)sd->Data;
+          SKIP_DATA(sd, (size_t)numFiles * 4)
+          break;
+        }
+       #endif
         RINOK(ReadUi32s(sdPtr, numFiles, &p->Attribs, allocMain))
         break;
       }
@@ -1564,7 +1623,8 @@ static SRes SzArEx_Open2(
 
   RINOK(LookInStream_SeekTo(inStream, (UInt64)startArcPos + k7zStartHeaderSize + nextHeaderOffset))
 
-  if (!Buf_Create(&buf, nextHeaderSizeT, allocTemp))
+  /* The header is read and decoded with allocMain: the database may keep it */
+  if (!Buf_Create(&buf, nextHeaderSizeT, allocMain))
     return SZ_ERROR_MEM;
 
   res = LookInStream_Read(inStream, buf.data, nextHeaderSizeT);
@@ -1590,16 +1650,17 @@ static SRes SzArEx_Open2(
         SzAr_Init(&tempAr);
         tempAr.RangeLimit = p->db.RangeLimit;
 
-        res = SzReadAndDecodePackedStreams(inStream, &sd, &tempBuf, 1, p->startPosAfterHeader, &tempAr, allocTemp);
+        res = SzReadAndDecodePackedStreams(inStream, &sd, &tempBuf, 1, p->startPosAfterHeader, &tempAr,
+            allocMain, allocTemp);
         SzAr_Free(&tempAr, allocTemp);
        
         if (res != SZ_OK)
         {
-          Buf_Free(&tempBuf, allocTemp);
+          Buf_Free(&tempBuf, allocMain);
         }
         else
         {
-          Buf_Free(&buf, allocTemp);
+          Buf_Free(&buf, allocMain);
           buf.data = tempBuf.data;
           buf.size = tempBuf.size;
           sd.Data = buf.data;
@@ -1624,7 +1685,20 @@ static SRes SzArEx_Open2(
               break;
           }
           */
+          p->HeaderBuf = buf.data;
+          p->HeaderSize = buf.size;
+          Buf_Init(&buf);
           res = SzReadHeader(p, &sd, inStream, allocMain, allocTemp);
+          if (res == SZ_OK
+              && !SzArEx_InHeader(p, p->FileNames)
+              && !SzArEx_InHeader(p, p->Attribs.Vals)
+              && !SzArEx_InHeader(p, p->MTime.Vals)
+              && !SzArEx_InHeader(p, p->CTime.Vals))
+          {
+            ISzAlloc_Free(allocMain, p->HeaderBuf);
+            p->HeaderBuf = NULL;
+            p->HeaderSize = 0;
+          }
         }
         else
           res = SZ_ERROR_UNSUPPORTED;
@@ -1632,7 +1706,7 @@ static SRes SzArEx_Open2(
     }
   }
  
-  Buf_Free(&buf, allocTemp);
+  Buf_Free(&buf, allocMain);
   return res;
 }
 
@@ -494,6 +494,16 @@ Byte Lzma2Enc_WriteProperties(CLzma2EncHandle p)
 }
 
 
+void Lzma2Enc_AddStats(CLzma2EncHandle p, CLzmaEncStats *stats)
+{
+  // GET_CLzma2Enc_p
+  unsigned i;
+  for (i = 0; i < MTCODER_THREADS_MAX; i++)
+    if (p->coders[i].enc)
+      LzmaEnc_AddStats(p->coders[i].enc, stats);
+}
+
+
 static SRes Lzma2Enc_EncodeMt1(
     CLzma2Enc *me,
     CLzma2EncInt *p,
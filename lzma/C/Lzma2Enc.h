@@ -45,6 +45,8 @@ void Lzma2Enc_Destroy(CLzma2EncHandle p);
 SRes Lzma2Enc_SetProps(CLzma2EncHandle p, const CLzma2EncProps *props);
 void Lzma2Enc_SetDataSize(CLzma2EncHandle p, UInt64 expectedDataSiize);
 Byte Lzma2Enc_WriteProperties(CLzma2EncHandle p);
+/* adds the counts of all its LZMA coders (one per block thread) to (stats) */
+void Lzma2Enc_AddStats(CLzma2EncHandle p, CLzmaEncStats *stats);
 SRes Lzma2Enc_Encode2(CLzma2EncHandle p,
     ISeqOutStreamPtr outStream,
     Byte *outBuf, size_t *outBufSize,
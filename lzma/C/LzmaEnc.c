@@ -417,6 +417,8 @@ struct CLzmaEnc
   // BoolInt _maxMode;
 
   UInt64 nowPos64;
+  UInt64 codedBytes;
+  CLzmaEncStats stats;  /* literals are counted as codedBytes - matchBytes */
   
   unsigned matchPriceCount;
   // unsigned alignPriceCount;
@@ -2341,6 +2343,8 @@ static void LzmaEnc_Construct(CLzmaEnc *p)
   LzmaEnc_InitPriceTables(p->ProbPrices);
   p->litProbs = NULL;
   p->saveState.litProbs = NULL;
+  p->codedBytes = 0;
+  memset(&p->stats, 0, sizeof(p->stats));
 }
 
 CLzmaEncHandle LzmaEnc_Create(ISzAllocPtr alloc)
@@ -2477,9 +2481,15 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, UInt32 maxPackSize, UInt32 maxUnpa
       RC_BIT_1(&p->rc, probs)
       probs = &p->isRep[p->state];
       RC_BIT_PRE(&p->rc, probs)
+      #ifdef Z7_LZMA_ENC_STATS
+      p->stats.matchBytes += len;
+      #endif
       
       if (dist < LZMA_NUM_REPS)
       {
+        #ifdef Z7_LZMA_ENC_STATS
+        p->stats.reps++;
+        #endif
         RC_BIT_1(&p->rc, probs)
         probs = &p->isRepG0[p->state];
         RC_BIT_PRE(&p->rc, probs)
@@ -2544,6 +2554,9 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, UInt32 maxPackSize, UInt32 maxUnpa
       else
       {
         unsigned posSlot;
+        #ifdef Z7_LZMA_ENC_STATS
+        p->stats.matches++;
+        #endif
         RC_BIT_0(&p->rc, probs)
         p->rc.range = range;
         p->state = kMatchNextStates[p->state];
@@ -2670,12 +2683,14 @@ static SRes LzmaEnc_CodeOneBlock(CLzmaEnc *p, UInt32 maxPackSize, UInt32 maxUnpa
       else if (processed >= (1 << 17))
       {
         p->nowPos64 += nowPos32 - startPos32;
+        p->codedBytes += nowPos32 - startPos32;
         return CheckErrors(p);
       }
     }
   }
 
   p->nowPos64 += nowPos32 - startPos32;
+  p->codedBytes += nowPos32 - startPos32;
   return Flush(p, nowPos32);
 }
 
@@ -3070,6 +3085,15 @@ SRes LzmaEnc_WriteProperties(CLzmaEncHandle p, Byte *props, SizeT *size)
 }
 
 
+void LzmaEnc_AddStats(CLzmaEncHandle p, CLzmaEncStats *stats)
+{
+  stats->literals += p->codedBytes - p->stats.matchBytes;
+  stats->matches += p->stats.matches;
+  stats->reps += p->stats.reps;
+  stats->matchBytes += p->stats.matchBytes;
+}
+
+
 unsigned LzmaEnc_IsWriteEndMark(CLzmaEncHandle p)
 {
   // GET_CLzmaEnc_p
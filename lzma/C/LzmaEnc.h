@@ -66,6 +66,20 @@ void LzmaEnc_SetDataSize(CLzmaEncHandle p, UInt64 expectedDataSiize);
 SRes LzmaEnc_WriteProperties(CLzmaEncHandle p, Byte *properties, SizeT *size);
 unsigned LzmaEnc_IsWriteEndMark(CLzmaEncHandle p);
 
+/* Symbols coded since the handle was created; matches, reps and
+   matchBytes are counted only when built with Z7_LZMA_ENC_STATS,
+   otherwise every byte counts as a literal */
+typedef struct
+{
+  UInt64 literals;
+  UInt64 matches;     /* matches at a new distance */
+  UInt64 reps;        /* matches at one of the last LZMA_NUM_REPS distances, short reps included */
+  UInt64 matchBytes;  /* bytes covered by matches and reps */
+} CLzmaEncStats;
+
+/* adds the handle's counts to (stats) */
+void LzmaEnc_AddStats(CLzmaEncHandle p, CLzmaEncStats *stats);
+
 SRes LzmaEnc_Encode(CLzmaEncHandle p, ISeqOutStreamPtr outStream, ISeqInStreamPtr inStream,
     ICompressProgressPtr progress, ISzAllocPtr alloc, ISzAllocPtr allocBig);
 SRes LzmaEnc_MemEncode(CLzmaEncHandle p, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
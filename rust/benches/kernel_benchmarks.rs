@@ -0,0 +1,88 @@
+//! Kernel microbenchmarks for sevenzip-ffi
+//!
+//! Every version of the CRC-32, AES-CBC, SHA-256 and match finder kernels
+//! this host can run (`advanced::kernel_variants`), timed one against the
+//! other; the ids mark the one runtime dispatch picked with `*`. CRC, AES
+//! and SHA-256 run over 1 MB that stays in cache, the match finder over
+//! 4 MB with matches at all distances. The `7z_ffi_kernels_bench` CMake
+//! target measures the same and prints JSON for tracking across hosts.
+//!
+//! Run with: cargo bench --bench kernel_benchmarks
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use seven_zip::advanced::{self, Kernel};
+
+const MB: usize = 1024 * 1024;
+
+/// 16-byte aligned buffer, as the AES kernels need
+fn aligned(size: usize) -> Vec<u128> {
+    vec![0u128; size / 16]
+}
+
+fn bytes(buf: &mut [u128]) -> &mut [u8] {
+    unsafe { std::slice::from_raw_parts_mut(buf.as_mut_ptr() as *mut u8, buf.len() * 16) }
+}
+
+/// Literal runs and copies at short and long distances
+fn fill_matches(buf: &mut [u8]) {
+    let mut x: u32 = 0x9E37_79B9;
+    let mut next = || {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        x
+    };
+    let mut pos = 0;
+    while pos < buf.len() {
+        let r = next();
+        if pos < 256 || r & 3 == 0 {
+            for _ in 0..1 + ((r >> 2) & 31) {
+                if pos == buf.len() {
+                    break;
+                }
+                buf[pos] = (next() >> 24) as u8;
+                pos += 1;
+            }
+        } else {
+            let span = (1usize << (8 + ((r >> 2) & 7) * 2)).min(pos);
+            let dist = 1 + (r >> 8) as usize % span;
+            for _ in 0..2 + ((r >> 26) & 31) {
+                if pos == buf.len() {
+                    break;
+                }
+                buf[pos] = buf[pos - dist];
+                pos += 1;
+            }
+        }
+    }
+}
+
+fn bench_kernels(c: &mut Criterion) {
+    let mut stream = aligned(MB);
+    for (i, b) in bytes(&mut stream).iter_mut().enumerate() {
+        *b = (i * 131 + (i >> 9)) as u8;
+    }
+    let mut text = aligned(4 * MB);
+    fill_matches(bytes(&mut text));
+
+    let variants = advanced::kernel_variants();
+    for kernel in [Kernel::Crc32, Kernel::AesCbcEncode, Kernel::AesCbcDecode, Kernel::Sha256, Kernel::MatchFinder] {
+        let mut group = c.benchmark_group(kernel.name());
+        let data = if kernel == Kernel::MatchFinder { &mut text } else { &mut stream };
+        let data = bytes(data);
+        group.throughput(Throughput::Bytes(data.len() as u64));
+        if kernel == Kernel::MatchFinder {
+            group.sample_size(10);
+        }
+        for v in variants.iter().filter(|v| v.kernel == kernel) {
+            let id = if v.in_use { format!("{}*", v.name) } else { v.name.clone() };
+            group.bench_function(BenchmarkId::from_parameter(id), |b| {
+                b.iter(|| black_box(advanced::run_kernel(v.index, data).unwrap()))
+            });
+        }
+        group.finish();
+    }
+}
+
+criterion_group!(benches, bench_kernels);
+criterion_main!(benches);
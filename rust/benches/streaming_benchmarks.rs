@@ -0,0 +1,449 @@
+//! Large-input benchmarks for sevenzip-ffi
+//!
+//! These benchmarks measure the paths `compression_benchmarks` leaves out:
+//! - `create_archive_streaming`, split and unsplit, and `create_archive_true_streaming`
+//! - `extract_streaming` of a split archive
+//! - Extraction of a multi-folder archive at 1 to all cores
+//! - One member out of a large solid archive, from the folder start and
+//!   with `extract_file_fast`
+//! - Raw LZMA2 with `advanced::compress_lzma2` / `decompress_lzma2(_mt)`
+//! - Thread scaling of the split writer from 1 to all cores
+//! - Peak resident memory of every benchmark
+//!
+//! The input is 1 GB by default (`SEVENZIP_BENCH_MB` changes it). It is
+//! generated once into `target/bench-data` and reused by later runs.
+//! Before a benchmark is timed, one untimed run prints its peak RSS. On
+//! Linux the peak is reset first through /proc/self/clear_refs; elsewhere
+//! the figure is the process peak so far.
+//!
+//! Run with: cargo bench --bench streaming_benchmarks
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use seven_zip::{advanced, CompressionLevel, ExtractOptions, SevenZip, StreamOptions};
+use std::fs::{self, File};
+use std::io::{BufWriter, Write};
+use std::path::{Path, PathBuf};
+use std::sync::OnceLock;
+use std::time::Duration;
+use tempfile::TempDir;
+
+const MB: u64 = 1024 * 1024;
+
+/// Largest volume of the split benchmarks
+const SPLIT_SIZE: u64 = 256 * MB;
+
+/// Cached benchmark input: a directory of four files of one size each
+struct BenchInput {
+    dir: PathBuf,
+    files: Vec<PathBuf>,
+    total: u64,
+}
+
+impl BenchInput {
+    /// The file with text and random data interleaved, for the single-file benchmarks
+    fn mixed_file(&self) -> &Path {
+        &self.files[3]
+    }
+
+    fn mixed_size(&self) -> u64 {
+        self.total / self.files.len() as u64
+    }
+
+    /// Volume size giving at least four volumes; an input that fits one volume is not split
+    fn split_size(&self) -> u64 {
+        (self.total / 4).clamp(MB, SPLIT_SIZE)
+    }
+
+    fn split_label(&self) -> String {
+        format!("split_{}MB", self.split_size() / MB)
+    }
+}
+
+/// Small xorshift generator; fast enough to produce gigabytes of incompressible data
+struct XorShift(u64);
+
+impl XorShift {
+    fn fill(&mut self, buf: &mut [u8]) {
+        for chunk in buf.chunks_mut(8) {
+            self.0 ^= self.0 << 13;
+            self.0 ^= self.0 >> 7;
+            self.0 ^= self.0 << 17;
+            chunk.copy_from_slice(&self.0.to_le_bytes()[..chunk.len()]);
+        }
+    }
+}
+
+/// Log-like lines, compressible but not trivially so
+fn fill_text(buf: &mut Vec<u8>, line: &mut u64, size: usize) {
+    buf.clear();
+    while buf.len() < size {
+        let n = *line;
+        let _ = writeln!(
+            buf,
+            "2024-03-{:02} {:02}:{:02}:{:02} INFO worker-{} handled request {} in {}ms status={}",
+            n % 28 + 1, n % 24, n % 60, n % 59, n % 16, n, n % 997,
+            if n % 31 == 0 { 500 } else { 200 }
+        );
+        *line += 1;
+    }
+    buf.truncate(size);
+}
+
+/// Write `size` bytes of one kind: 0 = text, 1 = random, 2 = text and random in 64KB runs
+fn generate_file(path: &Path, size: u64, kind: u32) -> std::io::Result<()> {
+    const BLOCK: usize = 4 * 1024 * 1024;
+    let mut out = BufWriter::with_capacity(BLOCK, File::create(path)?);
+    let mut rng = XorShift(0x9E37_79B9_7F4A_7C15 ^ kind as u64);
+    let mut line = 0u64;
+    let mut buf = Vec::with_capacity(BLOCK);
+    let mut written = 0u64;
+    while written < size {
+        let len = (size - written).min(BLOCK as u64) as usize;
+        match kind {
+            0 => fill_text(&mut buf, &mut line, len),
+            1 => {
+                buf.resize(len, 0);
+                rng.fill(&mut buf);
+            }
+            _ => {
+                fill_text(&mut buf, &mut line, len);
+                for run in buf.chunks_mut(64 * 1024).skip(1).step_by(2) {
+                    rng.fill(run);
+                }
+            }
+        }
+        out.write_all(&buf)?;
+        written += len as u64;
+    }
+    out.flush()
+}
+
+/// Generate the input on first use; later runs find it complete and reuse it
+fn bench_input() -> &'static BenchInput {
+    static INPUT: OnceLock<BenchInput> = OnceLock::new();
+    INPUT.get_or_init(|| {
+        let size_mb: u64 = std::env::var("SEVENZIP_BENCH_MB")
+            .ok()
+            .and_then(|v| v.parse().ok())
+            .filter(|&v| v >= 4)
+            .unwrap_or(1024);
+        let base = std::env::var_os("CARGO_TARGET_DIR")
+            .map(PathBuf::from)
+            .unwrap_or_else(|| Path::new(env!("CARGO_MANIFEST_DIR")).join("target"));
+        let dir = base.join("bench-data").join(format!("input_{}mb", size_mb));
+        let names = ["app.log", "events.log", "random.bin", "mixed.img"];
+        let kinds = [0, 0, 1, 2];
+        let files: Vec<PathBuf> = names.iter().map(|n| dir.join(n)).collect();
+        let file_size = size_mb * MB / files.len() as u64;
+
+        // The marker is written last, so an interrupted generation is redone
+        let marker = dir.join(".complete");
+        if !marker.exists() {
+            println!("Generating {} MB of benchmark input in {}", size_mb, dir.display());
+            fs::create_dir_all(&dir).unwrap();
+            for (file, &kind) in files.iter().zip(kinds.iter()) {
+                generate_file(file, file_size, kind).unwrap();
+            }
+            fs::write(&marker, b"").unwrap();
+        }
+
+        BenchInput { dir, files, total: file_size * names.len() as u64 }
+    })
+}
+
+/// Output directory next to the input, so large archives stay off a tmpfs /tmp
+fn output_dir(input: &BenchInput) -> TempDir {
+    TempDir::new_in(input.dir.parent().unwrap()).unwrap()
+}
+
+// ===== Peak memory =====
+
+fn read_status_kb(field: &str) -> Option<u64> {
+    let status = fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|l| l.starts_with(field))?;
+    line[field.len()..].trim().trim_end_matches("kB").trim().parse().ok()
+}
+
+/// Reset the peak RSS; false where the system keeps only the process peak
+fn reset_peak_rss() -> bool {
+    fs::write("/proc/self/clear_refs", "5").is_ok()
+}
+
+/// Run `op` once, untimed, and print the peak resident set it reached
+fn report_peak_rss<F: FnOnce()>(name: &str, op: F) {
+    let resettable = reset_peak_rss();
+    let baseline = read_status_kb("VmRSS:");
+    op();
+    match (read_status_kb("VmHWM:"), baseline) {
+        (Some(peak), Some(base)) => println!(
+            "peak RSS {:<40} {:>8.1} MB ({:.1} MB above the {:.1} MB before it){}",
+            name,
+            peak as f64 / 1024.0,
+            peak.saturating_sub(base) as f64 / 1024.0,
+            base as f64 / 1024.0,
+            if resettable { "" } else { " [process peak]" }
+        ),
+        _ => println!("peak RSS {:<40} not available on this platform", name),
+    }
+}
+
+/// Criterion settings for operations that take seconds each
+fn configure_large(group: &mut criterion::BenchmarkGroup<criterion::measurement::WallTime>, bytes: u64) {
+    group.throughput(Throughput::Bytes(bytes));
+    group.sample_size(10);
+    group.warm_up_time(Duration::from_secs(1));
+    group.measurement_time(Duration::from_secs(30));
+}
+
+// ===== Streaming Creation Benchmarks =====
+
+fn bench_streaming_create(c: &mut Criterion) {
+    let input = bench_input();
+    let sz = SevenZip::new().unwrap();
+    let mut group = c.benchmark_group("streaming_create");
+    configure_large(&mut group, input.total);
+
+    let mut split = StreamOptions::default();
+    split.split_size = input.split_size();
+    let unsplit = StreamOptions::default();
+    let split_label = input.split_label();
+    let variants = [(split_label.as_str(), &split), ("unsplit", &unsplit)];
+
+    for (name, opts) in variants {
+        let run = || {
+            let out = output_dir(input);
+            sz.create_archive_streaming(
+                out.path().join("bench.7z"),
+                &input.files,
+                CompressionLevel::Fast,
+                Some(opts),
+                None,
+            ).unwrap();
+            black_box(out);
+        };
+        report_peak_rss(&format!("create_archive_streaming/{}", name), run);
+        group.bench_function(BenchmarkId::new("create_archive_streaming", name), |b| b.iter(run));
+    }
+
+    let run = || {
+        let out = output_dir(input);
+        sz.create_archive_true_streaming(
+            out.path().join("bench.7z"),
+            &input.files,
+            CompressionLevel::Fast,
+            Some(&unsplit),
+            None,
+        ).unwrap();
+        black_box(out);
+    };
+    report_peak_rss("create_archive_true_streaming", run);
+    group.bench_function("create_archive_true_streaming", |b| b.iter(run));
+
+    group.finish();
+}
+
+// ===== Split Extraction Benchmarks =====
+
+fn bench_split_extract(c: &mut Criterion) {
+    let input = bench_input();
+    let sz = SevenZip::new().unwrap();
+
+    // Setup: Create the split archive once
+    let archive_dir = output_dir(input);
+    let mut opts = StreamOptions::default();
+    opts.split_size = input.split_size();
+    sz.create_archive_streaming(
+        archive_dir.path().join("bench.7z"),
+        &input.files,
+        CompressionLevel::Fast,
+        Some(&opts),
+        None,
+    ).unwrap();
+    let first_volume = archive_dir.path().join("bench.7z.001");
+
+    let mut group = c.benchmark_group("split_extract");
+    configure_large(&mut group, input.total);
+
+    let run = || {
+        let out = output_dir(input);
+        sz.extract_streaming(&first_volume, out.path(), None, None).unwrap();
+        black_box(out);
+    };
+    report_peak_rss(&format!("extract_streaming/{}", input.split_label()), run);
+    group.bench_function("extract_streaming", |b| b.iter(run));
+
+    group.finish();
+}
+
+// ===== Raw LZMA2 Benchmarks =====
+
+fn bench_lzma2(c: &mut Criterion) {
+    let input = bench_input();
+    let source = input.mixed_file();
+    let cores = std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1);
+
+    // Setup: Compress once for the decompression benchmarks
+    let packed_dir = output_dir(input);
+    let packed = packed_dir.path().join("mixed.img.lzma2");
+    advanced::compress_lzma2(source, &packed, CompressionLevel::Fast).unwrap();
+
+    let mut group = c.benchmark_group("lzma2");
+    configure_large(&mut group, input.mixed_size());
+
+    let run = || {
+        let out = output_dir(input);
+        advanced::compress_lzma2(source, out.path().join("out.lzma2"), CompressionLevel::Fast).unwrap();
+        black_box(out);
+    };
+    report_peak_rss("compress_lzma2", run);
+    group.bench_function("compress_lzma2", |b| b.iter(run));
+
+    let run = || {
+        let out = output_dir(input);
+        advanced::decompress_lzma2(&packed, out.path().join("out.bin")).unwrap();
+        black_box(out);
+    };
+    report_peak_rss("decompress_lzma2", run);
+    group.bench_function("decompress_lzma2", |b| b.iter(run));
+
+    let run = || {
+        let out = output_dir(input);
+        advanced::decompress_lzma2_mt(&packed, out.path().join("out.bin"), cores).unwrap();
+        black_box(out);
+    };
+    report_peak_rss(&format!("decompress_lzma2_mt/{}threads", cores), run);
+    group.bench_function(BenchmarkId::new("decompress_lzma2_mt", format!("{}threads", cores)), |b| {
+        b.iter(run)
+    });
+
+    group.finish();
+}
+
+// ===== Thread Scaling Benchmarks =====
+
+/// 1, 2, 4, ... up to the core count, which is always included
+fn thread_counts() -> Vec<usize> {
+    let cores = std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1);
+    let mut counts: Vec<usize> = std::iter::successors(Some(1usize), |&n| Some(n * 2))
+        .take_while(|&n| n < cores)
+        .collect();
+    counts.push(cores);
+    counts
+}
+
+fn bench_thread_scaling(c: &mut Criterion) {
+    let input = bench_input();
+    let sz = SevenZip::new().unwrap();
+    let mut group = c.benchmark_group("thread_scaling");
+    configure_large(&mut group, input.total);
+
+    for num_threads in thread_counts() {
+        let mut opts = StreamOptions::default();
+        opts.split_size = input.split_size();
+        opts.num_threads = num_threads;
+        let run = || {
+            let out = output_dir(input);
+            sz.create_archive_streaming(
+                out.path().join("bench.7z"),
+                &input.files,
+                CompressionLevel::Normal,
+                Some(&opts),
+                None,
+            ).unwrap();
+            black_box(out);
+        };
+        report_peak_rss(&format!("split_writer/{}threads", num_threads), run);
+        group.bench_with_input(
+            BenchmarkId::new("split_writer", format!("{}threads", num_threads)),
+            &num_threads,
+            |b, _| b.iter(run),
+        );
+    }
+
+    group.finish();
+}
+
+// ===== Parallel Extraction Benchmarks =====
+
+fn bench_parallel_extract(c: &mut Criterion) {
+    let input = bench_input();
+    let sz = SevenZip::new().unwrap();
+
+    // Setup: One folder per input file; threads beyond the folders decode
+    // the LZMA2 blocks of the folders
+    let archive_dir = output_dir(input);
+    let archive = archive_dir.path().join("folders.7z");
+    let mut opts = StreamOptions::default();
+    opts.solid = false;
+    sz.create_archive_streaming(&archive, &input.files, CompressionLevel::Fast, Some(&opts), None)
+        .unwrap();
+
+    let mut group = c.benchmark_group("parallel_extract");
+    configure_large(&mut group, input.total);
+
+    for num_threads in thread_counts() {
+        let options = ExtractOptions { num_threads, ..Default::default() };
+        let run = || {
+            let out = output_dir(input);
+            sz.extract_with_options(&archive, out.path(), None, &options, None).unwrap();
+            black_box(out);
+        };
+        report_peak_rss(&format!("extract_with_options/{}threads", num_threads), run);
+        group.bench_with_input(
+            BenchmarkId::new("extract_with_options", format!("{}threads", num_threads)),
+            &num_threads,
+            |b, _| b.iter(run),
+        );
+    }
+
+    group.finish();
+}
+
+// ===== Selective Extraction Benchmarks =====
+
+fn bench_selective_extract(c: &mut Criterion) {
+    let input = bench_input();
+    let sz = SevenZip::new().unwrap();
+
+    // Setup: One solid folder, written by every core so it holds many
+    // LZMA2 blocks; the member is the last file, behind all the others
+    let archive_dir = output_dir(input);
+    let archive = archive_dir.path().join("solid.7z");
+    let opts = StreamOptions::default();
+    sz.create_archive_streaming(&archive, &input.files, CompressionLevel::Fast, Some(&opts), None)
+        .unwrap();
+    let member = input.mixed_file().file_name().unwrap().to_str().unwrap();
+
+    let mut group = c.benchmark_group("selective_extract");
+    configure_large(&mut group, input.mixed_size());
+
+    let run = || {
+        let out = output_dir(input);
+        sz.extract_files(&archive, out.path(), &[member], None).unwrap();
+        black_box(out);
+    };
+    report_peak_rss("extract_files/last_member", run);
+    group.bench_function("extract_files", |b| b.iter(run));
+
+    let run = || {
+        let out = output_dir(input);
+        sz.extract_file_fast(&archive, out.path(), member, None).unwrap();
+        black_box(out);
+    };
+    report_peak_rss("extract_file_fast/last_member", run);
+    group.bench_function("extract_file_fast", |b| b.iter(run));
+
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_streaming_create,
+    bench_split_extract,
+    bench_parallel_extract,
+    bench_selective_extract,
+    bench_lzma2,
+    bench_thread_scaling,
+);
+
+criterion_main!(benches);
@@ -24,8 +24,13 @@ fn main() {
         println!("cargo:warning=Building C library...");
         
         // Run cmake configuration
+        let asm_lzma_dec = if env::var_os("CARGO_FEATURE_ASM_LZMA_DEC").is_some() {
+            "-DENABLE_ASM_LZMA_DEC=ON"
+        } else {
+            "-DENABLE_ASM_LZMA_DEC=OFF"
+        };
         let cmake_status = Command::new("cmake")
-            .args(&["-B", "build", "-DCMAKE_BUILD_TYPE=Release"])
+            .args(&["-B", "build", "-DCMAKE_BUILD_TYPE=Release", asm_lzma_dec])
             .current_dir(project_root)
             .status();
         
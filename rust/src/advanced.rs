@@ -3,11 +3,13 @@
 //! This module provides advanced functionality for:
 //! - Split/multi-volume archives for easier transfer and storage
 //! - Raw LZMA/LZMA2 compression for .lzma and .xz files
+//! - In-memory LZMA, LZMA2 and single-file .7z compression of byte slices
 //! - Detailed error reporting with context and suggestions
+//! - The CPU-specific kernel variants, for timing them
 
 use crate::error::{Error, Result};
 use crate::ffi;
-use crate::CompressionLevel;
+use crate::{CompressionLevel, LzmaParams};
 use std::ffi::{CString, CStr};
 use std::path::Path;
 use std::os::raw::c_char;
@@ -85,6 +87,8 @@ pub fn get_error_string(code: i32) -> String {
         5 => ffi::SevenZipErrorCode::SEVENZIP_ERROR_COMPRESS,
         6 => ffi::SevenZipErrorCode::SEVENZIP_ERROR_INVALID_PARAM,
         7 => ffi::SevenZipErrorCode::SEVENZIP_ERROR_NOT_IMPLEMENTED,
+        8 => ffi::SevenZipErrorCode::SEVENZIP_ERROR_CANCELLED,
+        9 => ffi::SevenZipErrorCode::SEVENZIP_ERROR_BUFFER_TOO_SMALL,
         _ => ffi::SevenZipErrorCode::SEVENZIP_ERROR_UNKNOWN,
     };
     
@@ -180,6 +184,23 @@ pub fn create_split_archive(
         dict_size: 0,   // auto
         solid: 1,       // solid archive
         password: c_password.as_ref().map_or(std::ptr::null(), |p| p.as_ptr()),
+        solid_block_size: 0,
+        solid_block_files: 0,
+        filter: ffi::SevenZipFilter::SEVENZIP_FILTER_AUTO,
+        delta_distance: 0,
+        delta_extensions: std::ptr::null(),
+        method: ffi::SevenZipMethod::SEVENZIP_METHOD_LZMA2,
+        ppmd_order: 0,
+        ppmd_mem_size: 0,
+        max_memory: 0,
+        cancel: std::ptr::null_mut(),
+        block_size: 0,
+        thread_weight: 0,
+        numa_policy: ffi::SevenZipNumaPolicy::SEVENZIP_NUMA_OFF,
+        detect_compressed: 0,
+        lzma_params: std::ptr::null(),
+        solid_sort: 0,
+        dedup_chunk_size: 0,
     };
     
     unsafe {
@@ -386,7 +407,8 @@ pub fn compress_lzma2(
 
 /// Decompress a LZMA2/XZ file (.xz)
 ///
-/// Decompresses a standalone LZMA2 or XZ file.
+/// Decompresses a standalone LZMA2 or XZ file on one thread; a file cut
+/// short fails.
 ///
 /// # Example
 ///
@@ -423,6 +445,562 @@ pub fn decompress_lzma2(
     Ok(())
 }
 
+/// Decompress a LZMA2 file on several threads
+///
+/// Streams written with a block size (all of this library's writers) have
+/// their blocks decoded in parallel. `num_threads` of 0 picks the default.
+/// On more than one thread a file cut short is not reported.
+///
+/// # Example
+///
+/// ```no_run
+/// use seven_zip::advanced;
+///
+/// advanced::decompress_lzma2_mt("file.xz", "file.bin", 4)?;
+/// # Ok::<(), seven_zip::Error>(())
+/// ```
+pub fn decompress_lzma2_mt(
+    input_path: impl AsRef<Path>,
+    output_path: impl AsRef<Path>,
+    num_threads: usize,
+) -> Result<()> {
+    let input = input_path.as_ref().to_str().ok_or(Error::Io("Invalid path encoding".to_string()))?;
+    let output = output_path.as_ref().to_str().ok_or(Error::Io("Invalid path encoding".to_string()))?;
+    
+    let c_input = CString::new(input)?;
+    let c_output = CString::new(output)?;
+    
+    unsafe {
+        let result = ffi::sevenzip_decompress_lzma2_mt(
+            c_input.as_ptr(),
+            c_output.as_ptr(),
+            num_threads.min(i32::MAX as usize) as i32,
+            None,
+            std::ptr::null_mut(),
+        );
+        
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK { return Err(Error::from_code(result)); }
+    }
+    
+    Ok(())
+}
+
+/// Layout of in-memory compressed data
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum BufferFormat {
+    /// .lzma: properties, size and LZMA stream, as [`compress_lzma`] writes
+    Lzma,
+    /// Property byte and LZMA2 stream, as [`compress_lzma2`] writes
+    Lzma2,
+    /// .7z archive holding one file
+    SevenZ,
+}
+
+impl From<BufferFormat> for ffi::SevenZipBufferFormat {
+    fn from(format: BufferFormat) -> Self {
+        match format {
+            BufferFormat::Lzma => ffi::SevenZipBufferFormat::SEVENZIP_BUFFER_LZMA,
+            BufferFormat::Lzma2 => ffi::SevenZipBufferFormat::SEVENZIP_BUFFER_LZMA2,
+            BufferFormat::SevenZ => ffi::SevenZipBufferFormat::SEVENZIP_BUFFER_7Z,
+        }
+    }
+}
+
+/// Options of the in-memory compressors
+#[derive(Debug, Clone, Default)]
+pub struct BufferOptions {
+    /// LZMA2 and 7z: encoder threads (0 = 1)
+    pub num_threads: usize,
+    /// 7z: name of the file in the archive (None = "data")
+    pub entry_name: Option<String>,
+    /// Encoder parameters over the level's
+    pub lzma_params: Option<LzmaParams>,
+}
+
+/// C strings and structs a `BufferOptions` points into for one call
+struct BufferOptionRefs {
+    entry_name: Option<CString>,
+    lzma_params: Option<ffi::SevenZipLzmaParams>,
+}
+
+impl BufferOptions {
+    fn refs_c(&self) -> Result<BufferOptionRefs> {
+        Ok(BufferOptionRefs {
+            entry_name: self.entry_name.as_deref().map(CString::new).transpose()?,
+            lzma_params: self.lzma_params.map(Into::into),
+        })
+    }
+
+    fn to_ffi(&self, refs: &BufferOptionRefs) -> ffi::SevenZipBufferOptions {
+        ffi::SevenZipBufferOptions {
+            num_threads: self.num_threads.min(i32::MAX as usize) as i32,
+            entry_name: refs.entry_name.as_ref().map_or(std::ptr::null(), |s| s.as_ptr()),
+            lzma_params: refs.lzma_params.as_ref().map_or(std::ptr::null(), |p| p as *const _),
+        }
+    }
+}
+
+/// Largest output [`compress_buffer`] can produce for `input_size` bytes
+pub fn compress_buffer_bound(format: BufferFormat, input_size: usize, options: &BufferOptions) -> Result<usize> {
+    let refs = options.refs_c()?;
+    let opts = options.to_ffi(&refs);
+    let bound = unsafe { ffi::sevenzip_compress_buffer_bound(format.into(), input_size, &opts) };
+    if bound == 0 {
+        return Err(Error::InvalidParameter("Input too large for one buffer".to_string()));
+    }
+    Ok(bound)
+}
+
+/// Compress `input` into `output`, returning the bytes written
+///
+/// An output of [`compress_buffer_bound`] bytes always fits; a smaller one
+/// is tried as it is and fails with [`Error::BufferTooSmall`].
+///
+/// # Example
+///
+/// ```no_run
+/// use seven_zip::advanced::{self, BufferFormat, BufferOptions};
+/// use seven_zip::CompressionLevel;
+///
+/// let payload = b"payload already in memory";
+/// let mut packed = [0u8; 256];
+/// let n = advanced::compress_buffer(BufferFormat::Lzma2, payload, &mut packed,
+///                                   CompressionLevel::Fast, &BufferOptions::default())?;
+/// # let _ = n;
+/// # Ok::<(), seven_zip::Error>(())
+/// ```
+pub fn compress_buffer(
+    format: BufferFormat,
+    input: &[u8],
+    output: &mut [u8],
+    level: CompressionLevel,
+    options: &BufferOptions,
+) -> Result<usize> {
+    let refs = options.refs_c()?;
+    let opts = options.to_ffi(&refs);
+    let mut size = output.len();
+    unsafe {
+        let result = ffi::sevenzip_compress_buffer(
+            format.into(),
+            input.as_ptr() as *const std::os::raw::c_void,
+            input.len(),
+            output.as_mut_ptr() as *mut std::os::raw::c_void,
+            &mut size,
+            level.into(),
+            &opts,
+        );
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK { return Err(Error::from_code(result)); }
+    }
+    Ok(size)
+}
+
+/// Compress `input` and append it to `output`, returning the bytes added
+///
+/// The bound is reserved in `output` and the encoder writes into the spare
+/// capacity directly; existing contents stay in front.
+pub fn compress_to_vec(
+    format: BufferFormat,
+    input: &[u8],
+    output: &mut Vec<u8>,
+    level: CompressionLevel,
+    options: &BufferOptions,
+) -> Result<usize> {
+    let bound = compress_buffer_bound(format, input.len(), options)?;
+    let refs = options.refs_c()?;
+    let opts = options.to_ffi(&refs);
+    output.reserve(bound);
+    let start = output.len();
+    let mut size = bound;
+    unsafe {
+        let result = ffi::sevenzip_compress_buffer(
+            format.into(),
+            input.as_ptr() as *const std::os::raw::c_void,
+            input.len(),
+            output.as_mut_ptr().add(start) as *mut std::os::raw::c_void,
+            &mut size,
+            level.into(),
+            &opts,
+        );
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK { return Err(Error::from_code(result)); }
+        // The encoder initialised `size` bytes of the reserved capacity
+        output.set_len(start + size);
+    }
+    Ok(size)
+}
+
+/// A hot loop of the library with CPU-specific versions
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Kernel {
+    /// Every CRC computed or checked
+    Crc32,
+    /// 7zAES encryption
+    AesCbcEncode,
+    /// 7zAES decryption
+    AesCbcDecode,
+    /// Digest manifests and the 7zAES key derivation
+    Sha256,
+    /// LZMA/LZMA2 encoder match search
+    MatchFinder,
+}
+
+impl Kernel {
+    /// Short name, as the `7z_ffi_kernels_bench` JSON has it
+    pub fn name(self) -> &'static str {
+        match self {
+            Kernel::Crc32 => "crc32",
+            Kernel::AesCbcEncode => "aes_cbc_encode",
+            Kernel::AesCbcDecode => "aes_cbc_decode",
+            Kernel::Sha256 => "sha256",
+            Kernel::MatchFinder => "match_finder",
+        }
+    }
+}
+
+/// A version of a kernel this host can run, see [`kernel_variants`]
+#[derive(Debug, Clone)]
+pub struct KernelVariant {
+    /// Index for [`run_kernel`]
+    pub index: usize,
+    /// Kernel it is a version of
+    pub kernel: Kernel,
+    /// "slice8", "aes-ni", "vaes-avx2", "sha-ni", "armv8-aes", "bt4", ...
+    pub name: String,
+    /// The version runtime dispatch picked (both match finders: they serve different levels)
+    pub in_use: bool,
+}
+
+/// Every version of the CRC-32, AES-CBC, SHA-256 and match finder kernels this host can run
+pub fn kernel_variants() -> Vec<KernelVariant> {
+    let mut raw = [ffi::SevenZipKernelVariant {
+        kernel: ffi::SevenZipKernel::SEVENZIP_KERNEL_CRC32,
+        name: std::ptr::null(),
+        in_use: 0,
+    }; ffi::SEVENZIP_MAX_KERNEL_VARIANTS];
+    let count = unsafe { ffi::sevenzip_kernel_variants(raw.as_mut_ptr(), raw.len()) }.min(raw.len());
+    raw[..count]
+        .iter()
+        .enumerate()
+        .map(|(index, v)| KernelVariant {
+            index,
+            kernel: match v.kernel {
+                ffi::SevenZipKernel::SEVENZIP_KERNEL_CRC32 => Kernel::Crc32,
+                ffi::SevenZipKernel::SEVENZIP_KERNEL_AES_CBC_ENCODE => Kernel::AesCbcEncode,
+                ffi::SevenZipKernel::SEVENZIP_KERNEL_AES_CBC_DECODE => Kernel::AesCbcDecode,
+                ffi::SevenZipKernel::SEVENZIP_KERNEL_SHA256 => Kernel::Sha256,
+                ffi::SevenZipKernel::SEVENZIP_KERNEL_MATCH_FINDER => Kernel::MatchFinder,
+            },
+            name: unsafe { CStr::from_ptr(v.name) }.to_string_lossy().into_owned(),
+            in_use: v.in_use != 0,
+        })
+        .collect()
+}
+
+/// Run one kernel variant over `data`, returning a value that depends on the result
+///
+/// CRC-32 and SHA-256 read `data`; AES-CBC encrypts or decrypts it in place
+/// with a fixed key and needs it 16-byte aligned and whole blocks long; the
+/// match finder searches it as the encoder's fast levels do.
+///
+/// # Example
+///
+/// ```no_run
+/// use seven_zip::advanced;
+///
+/// let mut data = vec![0u128; 65536];  // u128: 16-byte aligned for AES
+/// let bytes = unsafe { std::slice::from_raw_parts_mut(data.as_mut_ptr() as *mut u8, 1 << 20) };
+/// for v in advanced::kernel_variants() {
+///     advanced::run_kernel(v.index, bytes)?;
+/// }
+/// # Ok::<(), seven_zip::Error>(())
+/// ```
+pub fn run_kernel(index: usize, data: &mut [u8]) -> Result<u32> {
+    let mut check = 0u32;
+    let result = unsafe {
+        ffi::sevenzip_kernel_run(index, data.as_mut_ptr() as *mut std::os::raw::c_void, data.len(), &mut check)
+    };
+    if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+        return Err(Error::from_code(result));
+    }
+    Ok(check)
+}
+
+/// Size [`decompress_buffer`] will produce for `input`, read from its headers
+pub fn decompressed_size(format: BufferFormat, input: &[u8]) -> Result<u64> {
+    let mut size = 0u64;
+    unsafe {
+        let result = ffi::sevenzip_decompress_buffer_size(
+            format.into(),
+            input.as_ptr() as *const std::os::raw::c_void,
+            input.len(),
+            &mut size,
+        );
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK { return Err(Error::from_code(result)); }
+    }
+    Ok(size)
+}
+
+/// Decompress `input` into `output`, returning the bytes written
+///
+/// The decoder uses `output` as its dictionary, so the data is written once.
+/// A .7z input must hold exactly one file. Fails with
+/// [`Error::BufferTooSmall`] if `output` is shorter than [`decompressed_size`].
+pub fn decompress_buffer(format: BufferFormat, input: &[u8], output: &mut [u8]) -> Result<usize> {
+    let mut size = output.len();
+    unsafe {
+        let result = ffi::sevenzip_decompress_buffer(
+            format.into(),
+            input.as_ptr() as *const std::os::raw::c_void,
+            input.len(),
+            output.as_mut_ptr() as *mut std::os::raw::c_void,
+            &mut size,
+        );
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK { return Err(Error::from_code(result)); }
+    }
+    Ok(size)
+}
+
+/// Decompress `input` and append it to `output`, returning the bytes added
+///
+/// Exactly [`decompressed_size`] bytes are reserved and decoded into the
+/// spare capacity, with no zero-filling or copy.
+pub fn decompress_to_vec(format: BufferFormat, input: &[u8], output: &mut Vec<u8>) -> Result<usize> {
+    let needed = decompressed_size(format, input)?;
+    let needed = usize::try_from(needed)
+        .map_err(|_| Error::Memory("Decompressed size exceeds the address space".to_string()))?;
+    output.reserve(needed);
+    let start = output.len();
+    let mut size = needed;
+    unsafe {
+        let result = ffi::sevenzip_decompress_buffer(
+            format.into(),
+            input.as_ptr() as *const std::os::raw::c_void,
+            input.len(),
+            output.as_mut_ptr().add(start) as *mut std::os::raw::c_void,
+            &mut size,
+        );
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK { return Err(Error::from_code(result)); }
+        // The decoder initialised `size` bytes of the reserved capacity
+        output.set_len(start + size);
+    }
+    Ok(size)
+}
+
+/// Output window of [`LzmaWriter`] and input window of [`LzmaReader`]
+const STREAM_CHUNK: usize = 64 * 1024;
+
+fn stream_error(result: ffi::SevenZipErrorCode, kind: std::io::ErrorKind) -> std::io::Error {
+    std::io::Error::new(kind, Error::from_code(result))
+}
+
+/// Compressing [`Write`](std::io::Write) adapter writing .lzma or LZMA2 to `W`
+///
+/// Bytes written are compressed as they come, on an encoder thread, and the
+/// compressed stream goes to the inner writer in 64 KB pieces; memory stays
+/// constant whatever the length. The output is what [`compress_buffer`]
+/// writes, except that a .lzma header records no size and the stream ends
+/// with a marker instead. Call [`finish`](Self::finish) to end the stream
+/// and get the writer back; dropping the adapter finishes it too, ignoring
+/// errors.
+///
+/// # Example
+///
+/// ```no_run
+/// use seven_zip::advanced::LzmaWriter;
+/// use seven_zip::CompressionLevel;
+/// use std::io::Write;
+///
+/// let file = std::fs::File::create("log.lzma")?;
+/// let mut writer = LzmaWriter::new(file, CompressionLevel::Normal)?;
+/// writer.write_all(b"request served\n")?;
+/// writer.finish()?;
+/// # Ok::<(), Box<dyn std::error::Error>>(())
+/// ```
+pub struct LzmaWriter<W: std::io::Write> {
+    inner: Option<W>,
+    encoder: *mut ffi::SevenZipEncoder,
+    window: Vec<u8>,
+}
+
+// The encoder handle is only used through &mut self
+unsafe impl<W: std::io::Write + Send> Send for LzmaWriter<W> {}
+
+impl<W: std::io::Write> LzmaWriter<W> {
+    /// .lzma output with default options
+    pub fn new(inner: W, level: CompressionLevel) -> Result<Self> {
+        Self::with_options(inner, BufferFormat::Lzma, level, &BufferOptions::default())
+    }
+
+    /// `format` output ([`BufferFormat::Lzma`] or [`BufferFormat::Lzma2`])
+    ///
+    /// `options.entry_name` is not used.
+    pub fn with_options(inner: W, format: BufferFormat, level: CompressionLevel,
+                        options: &BufferOptions) -> Result<Self> {
+        let refs = options.refs_c()?;
+        let opts = options.to_ffi(&refs);
+        let mut encoder: *mut ffi::SevenZipEncoder = std::ptr::null_mut();
+        let result = unsafe { ffi::sevenzip_encoder_create(format.into(), level.into(), &opts, &mut encoder) };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(LzmaWriter { inner: Some(inner), encoder, window: vec![0u8; STREAM_CHUNK] })
+    }
+
+    /// The inner writer
+    pub fn get_ref(&self) -> &W {
+        self.inner.as_ref().expect("writer present until finish")
+    }
+
+    /// End the stream, write the rest of it and return the inner writer
+    pub fn finish(mut self) -> std::io::Result<W> {
+        self.finish_stream()?;
+        Ok(self.inner.take().expect("writer present until finish"))
+    }
+
+    fn finish_stream(&mut self) -> std::io::Result<()> {
+        let inner = match self.inner.as_mut() {
+            Some(inner) => inner,
+            None => return Ok(()),
+        };
+        loop {
+            let mut out_size = self.window.len();
+            let mut finished = 0;
+            let result = unsafe {
+                ffi::sevenzip_encoder_finish(self.encoder, self.window.as_mut_ptr() as *mut std::os::raw::c_void,
+                                             &mut out_size, &mut finished)
+            };
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(stream_error(result, std::io::ErrorKind::Other));
+            }
+            inner.write_all(&self.window[..out_size])?;
+            if finished != 0 {
+                return inner.flush();
+            }
+        }
+    }
+}
+
+impl<W: std::io::Write> std::io::Write for LzmaWriter<W> {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        let inner = self.inner.as_mut().expect("writer present until finish");
+        let mut consumed = 0;
+        while consumed < buf.len() {
+            let mut in_size = buf.len() - consumed;
+            let mut out_size = self.window.len();
+            let result = unsafe {
+                ffi::sevenzip_encoder_update(
+                    self.encoder,
+                    buf[consumed..].as_ptr() as *const std::os::raw::c_void,
+                    &mut in_size,
+                    self.window.as_mut_ptr() as *mut std::os::raw::c_void,
+                    &mut out_size,
+                )
+            };
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(stream_error(result, std::io::ErrorKind::Other));
+            }
+            inner.write_all(&self.window[..out_size])?;
+            consumed += in_size;
+        }
+        Ok(consumed)
+    }
+
+    /// Flushes the inner writer; bytes still in the encoder stay there
+    fn flush(&mut self) -> std::io::Result<()> {
+        self.inner.as_mut().expect("writer present until finish").flush()
+    }
+}
+
+impl<W: std::io::Write> Drop for LzmaWriter<W> {
+    fn drop(&mut self) {
+        if !std::thread::panicking() {
+            let _ = self.finish_stream();
+        }
+        unsafe { ffi::sevenzip_encoder_free(self.encoder) };
+    }
+}
+
+/// Decompressing [`Read`](std::io::Read) adapter over .lzma or LZMA2 data from `R`
+///
+/// Reads the compressed stream from the inner reader in 64 KB pieces and
+/// decodes it on the calling thread; memory is the stream's dictionary.
+/// A .lzma stream may record its size or end with a marker. The reader
+/// returns 0 at the end of the stream; input that ends before it is an
+/// [`UnexpectedEof`](std::io::ErrorKind::UnexpectedEof) error.
+pub struct LzmaReader<R: std::io::Read> {
+    inner: R,
+    decoder: *mut ffi::SevenZipDecoder,
+    window: Vec<u8>,
+    pos: usize,
+    len: usize,
+    eof: bool,
+    finished: bool,
+}
+
+// The decoder handle is only used through &mut self
+unsafe impl<R: std::io::Read + Send> Send for LzmaReader<R> {}
+
+impl<R: std::io::Read> LzmaReader<R> {
+    /// `format` input ([`BufferFormat::Lzma`] or [`BufferFormat::Lzma2`])
+    pub fn new(inner: R, format: BufferFormat) -> Result<Self> {
+        let mut decoder: *mut ffi::SevenZipDecoder = std::ptr::null_mut();
+        let result = unsafe { ffi::sevenzip_decoder_create(format.into(), &mut decoder) };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(LzmaReader { inner, decoder, window: vec![0u8; STREAM_CHUNK], pos: 0, len: 0, eof: false, finished: false })
+    }
+
+    /// The inner reader
+    pub fn get_ref(&self) -> &R {
+        &self.inner
+    }
+}
+
+impl<R: std::io::Read> std::io::Read for LzmaReader<R> {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        if buf.is_empty() || self.finished {
+            return Ok(0);
+        }
+        loop {
+            if self.pos == self.len && !self.eof {
+                self.len = self.inner.read(&mut self.window)?;
+                self.pos = 0;
+                self.eof = self.len == 0;
+            }
+            let mut in_size = self.len - self.pos;
+            let mut out_size = buf.len();
+            let mut finished = 0;
+            let result = unsafe {
+                ffi::sevenzip_decoder_update(
+                    self.decoder,
+                    self.window[self.pos..].as_ptr() as *const std::os::raw::c_void,
+                    &mut in_size,
+                    buf.as_mut_ptr() as *mut std::os::raw::c_void,
+                    &mut out_size,
+                    &mut finished,
+                )
+            };
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(stream_error(result, std::io::ErrorKind::InvalidData));
+            }
+            self.pos += in_size;
+            self.finished = finished != 0;
+            if out_size > 0 || self.finished {
+                return Ok(out_size);
+            }
+            if self.eof {
+                return Err(std::io::Error::new(std::io::ErrorKind::UnexpectedEof, "compressed stream ends early"));
+            }
+        }
+    }
+}
+
+impl<R: std::io::Read> Drop for LzmaReader<R> {
+    fn drop(&mut self) {
+        unsafe { ffi::sevenzip_decoder_free(self.decoder) };
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -433,6 +1011,49 @@ mod tests {
         assert!(!version.is_empty());
     }
     
+    #[test]
+    fn test_buffer_round_trip() {
+        let input: Vec<u8> = (0..100_000u32).map(|i| (i % 251) as u8).collect();
+        let options = BufferOptions::default();
+        for format in [BufferFormat::Lzma, BufferFormat::Lzma2, BufferFormat::SevenZ] {
+            let mut packed = Vec::new();
+            compress_to_vec(format, &input, &mut packed, CompressionLevel::Fast, &options).unwrap();
+            assert_eq!(decompressed_size(format, &packed).unwrap(), input.len() as u64);
+            let mut output = Vec::new();
+            decompress_to_vec(format, &packed, &mut output).unwrap();
+            assert_eq!(output, input);
+            let mut short = vec![0u8; input.len() - 1];
+            assert!(matches!(decompress_buffer(format, &packed, &mut short), Err(Error::BufferTooSmall(_))));
+        }
+    }
+
+    #[test]
+    fn test_stream_adapters() {
+        use std::io::{Read, Write};
+        let input: Vec<u8> = (0..300_000u32).map(|i| (i % 251) as u8 ^ (i / 7919) as u8).collect();
+        for format in [BufferFormat::Lzma, BufferFormat::Lzma2] {
+            let mut writer = LzmaWriter::with_options(Vec::new(), format, CompressionLevel::Fast,
+                                                      &BufferOptions::default()).unwrap();
+            for piece in input.chunks(7777) {
+                writer.write_all(piece).unwrap();
+            }
+            let packed = writer.finish().unwrap();
+
+            let mut output = Vec::new();
+            decompress_to_vec(format, &packed, &mut output).unwrap();
+            assert_eq!(output, input);
+
+            let mut reader = LzmaReader::new(&packed[..], format).unwrap();
+            let mut output = Vec::new();
+            reader.read_to_end(&mut output).unwrap();
+            assert_eq!(output, input);
+
+            let mut truncated = LzmaReader::new(&packed[..packed.len() / 2], format).unwrap();
+            let err = truncated.read_to_end(&mut Vec::new()).unwrap_err();
+            assert_eq!(err.kind(), std::io::ErrorKind::UnexpectedEof);
+        }
+    }
+
     #[test]
     fn test_get_error_string() {
         let msg = get_error_string(0);
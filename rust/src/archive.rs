@@ -5,9 +5,15 @@
 
 use crate::error::{Error, Result};
 use crate::ffi;
+use std::cell::RefCell;
 use std::ffi::{CStr, CString};
-use std::path::Path;
+use std::io::{Read, Seek, SeekFrom, Write};
+use std::path::{Path, PathBuf};
 use std::ptr;
+use std::future::Future;
+use std::pin::Pin;
+use std::sync::{Arc, Mutex};
+use std::task::{Context, Poll, Waker};
 
 /// Compression level for archive operations
 #[derive(Debug, Copy, Clone, PartialEq, Eq)]
@@ -39,6 +45,603 @@ impl From<CompressionLevel> for ffi::SevenZipCompressionLevel {
     }
 }
 
+/// Filter chained before LZMA2 (branch converters for code, Delta for raw data)
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum Filter {
+    /// Detect per file from ELF/PE/Mach-O headers
+    Auto,
+    /// Never filter
+    None,
+    /// x86 / x86-64
+    Bcj,
+    /// AArch64
+    Arm64,
+    /// 32-bit ARM
+    Arm,
+    /// ARM Thumb
+    ArmThumb,
+    /// PowerPC (big-endian)
+    Ppc,
+    /// SPARC
+    Sparc,
+    /// Itanium
+    Ia64,
+    /// Byte delta at `delta_distance` (raw samples, pixels)
+    Delta,
+}
+
+impl From<Filter> for ffi::SevenZipFilter {
+    fn from(filter: Filter) -> Self {
+        match filter {
+            Filter::Auto => ffi::SevenZipFilter::SEVENZIP_FILTER_AUTO,
+            Filter::None => ffi::SevenZipFilter::SEVENZIP_FILTER_NONE,
+            Filter::Bcj => ffi::SevenZipFilter::SEVENZIP_FILTER_BCJ,
+            Filter::Arm64 => ffi::SevenZipFilter::SEVENZIP_FILTER_ARM64,
+            Filter::Arm => ffi::SevenZipFilter::SEVENZIP_FILTER_ARM,
+            Filter::ArmThumb => ffi::SevenZipFilter::SEVENZIP_FILTER_ARMT,
+            Filter::Ppc => ffi::SevenZipFilter::SEVENZIP_FILTER_PPC,
+            Filter::Sparc => ffi::SevenZipFilter::SEVENZIP_FILTER_SPARC,
+            Filter::Ia64 => ffi::SevenZipFilter::SEVENZIP_FILTER_IA64,
+            Filter::Delta => ffi::SevenZipFilter::SEVENZIP_FILTER_DELTA,
+        }
+    }
+}
+
+/// Main compression method of each solid block
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum Method {
+    /// LZMA2 for everything
+    Lzma2,
+    /// PPMd for everything (best on text, slower)
+    Ppmd,
+    /// PPMd for files classified as text, LZMA2 for the rest
+    Auto,
+}
+
+impl From<Method> for ffi::SevenZipMethod {
+    fn from(method: Method) -> Self {
+        match method {
+            Method::Lzma2 => ffi::SevenZipMethod::SEVENZIP_METHOD_LZMA2,
+            Method::Ppmd => ffi::SevenZipMethod::SEVENZIP_METHOD_PPMD,
+            Method::Auto => ffi::SevenZipMethod::SEVENZIP_METHOD_AUTO,
+        }
+    }
+}
+
+impl From<ffi::SevenZipFilter> for Filter {
+    fn from(filter: ffi::SevenZipFilter) -> Self {
+        match filter {
+            ffi::SevenZipFilter::SEVENZIP_FILTER_AUTO => Filter::Auto,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_NONE => Filter::None,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_BCJ => Filter::Bcj,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_ARM64 => Filter::Arm64,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_ARM => Filter::Arm,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_ARMT => Filter::ArmThumb,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_PPC => Filter::Ppc,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_SPARC => Filter::Sparc,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_IA64 => Filter::Ia64,
+            ffi::SevenZipFilter::SEVENZIP_FILTER_DELTA => Filter::Delta,
+        }
+    }
+}
+
+impl From<ffi::SevenZipMethod> for Method {
+    fn from(method: ffi::SevenZipMethod) -> Self {
+        match method {
+            ffi::SevenZipMethod::SEVENZIP_METHOD_LZMA2 => Method::Lzma2,
+            ffi::SevenZipMethod::SEVENZIP_METHOD_PPMD => Method::Ppmd,
+            ffi::SevenZipMethod::SEVENZIP_METHOD_AUTO => Method::Auto,
+        }
+    }
+}
+
+/// Coders of one file, as an [`EntryPolicy`] decides them
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub struct EntryChoice {
+    /// LZMA2 or PPMd; `Auto` = PPMd if the file is classified as text
+    pub method: Method,
+    /// Filter before LZMA2, not for PPMd (`Auto` = detected from the file)
+    pub filter: Filter,
+    /// 1-9: that level's parsing over the job's dictionary and match
+    /// finder; 0 = stored
+    pub level: u32,
+    /// Solid archives: groups go in ascending order, each in solid blocks
+    /// of its own
+    pub group: u32,
+}
+
+/// Per-file policy of [`StreamOptions::entry_policy`]: called once for
+/// every file with data, with its path, size and first 4KB, to change the
+/// job's own [`EntryChoice`] for it
+#[derive(Clone)]
+pub struct EntryPolicy(Arc<dyn Fn(&Path, u64, &[u8], &mut EntryChoice) + Send + Sync>);
+
+impl EntryPolicy {
+    /// Policy calling `f`
+    pub fn new<F>(f: F) -> Self
+    where
+        F: Fn(&Path, u64, &[u8], &mut EntryChoice) + Send + Sync + 'static,
+    {
+        EntryPolicy(Arc::new(f))
+    }
+}
+
+impl std::fmt::Debug for EntryPolicy {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str("EntryPolicy")
+    }
+}
+
+unsafe extern "C" fn entry_policy_wrapper(
+    path: *const std::os::raw::c_char,
+    size: u64,
+    head: *const u8,
+    head_size: usize,
+    policy: *mut ffi::SevenZipEntryPolicy,
+    user_data: *mut std::os::raw::c_void,
+) {
+    if user_data.is_null() || path.is_null() || policy.is_null() {
+        return;
+    }
+    unsafe {
+        // SAFETY: user_data is the EntryPolicy of the StreamOptions the job
+        // was started with, borrowed for the whole call
+        let callback = &*(user_data as *const EntryPolicy);
+        let path = CStr::from_ptr(path).to_string_lossy();
+        let head = if head.is_null() { &[][..] } else { std::slice::from_raw_parts(head, head_size) };
+        let c = &mut *policy;
+        let mut choice = EntryChoice {
+            method: c.method.into(),
+            filter: c.filter.into(),
+            level: c.level.max(0) as u32,
+            group: c.group,
+        };
+        (callback.0)(Path::new(&*path), size, head, &mut choice);
+        c.method = choice.method.into();
+        c.filter = choice.filter.into();
+        c.level = choice.level.min(9) as i32;
+        c.group = choice.group;
+    }
+}
+
+/// Placement of encoder threads on multi-node (NUMA) hosts
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum NumaPolicy {
+    /// Leave threads to the OS scheduler
+    Off,
+    /// Spread encoder threads over the nodes, each keeping its buffers on its own node
+    Local,
+}
+
+impl From<NumaPolicy> for ffi::SevenZipNumaPolicy {
+    fn from(policy: NumaPolicy) -> Self {
+        match policy {
+            NumaPolicy::Off => ffi::SevenZipNumaPolicy::SEVENZIP_NUMA_OFF,
+            NumaPolicy::Local => ffi::SevenZipNumaPolicy::SEVENZIP_NUMA_LOCAL,
+        }
+    }
+}
+
+/// Per-file digest written to [`StreamOptions::digest_manifest`]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum DigestAlgorithm {
+    /// SHA-256, checked with `sha256sum -c`
+    Sha256,
+    /// XXH3-128: not cryptographic, several times faster, for change
+    /// detection between runs; checked with `xxhsum -c`
+    Xxh3_128,
+}
+
+impl From<DigestAlgorithm> for ffi::SevenZipDigestAlgorithm {
+    fn from(algorithm: DigestAlgorithm) -> Self {
+        match algorithm {
+            DigestAlgorithm::Sha256 => ffi::SevenZipDigestAlgorithm::SEVENZIP_DIGEST_SHA256,
+            DigestAlgorithm::Xxh3_128 => ffi::SevenZipDigestAlgorithm::SEVENZIP_DIGEST_XXH3_128,
+        }
+    }
+}
+
+/// Block check of a .xz file, see [`SevenZip::remux_to_xz`]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Default)]
+pub enum XzCheck {
+    /// No check
+    None,
+    /// CRC-32
+    Crc32,
+    /// CRC-64, as xz writes by default
+    #[default]
+    Crc64,
+    /// SHA-256
+    Sha256,
+}
+
+impl From<XzCheck> for ffi::SevenZipXzCheck {
+    fn from(check: XzCheck) -> Self {
+        match check {
+            XzCheck::None => ffi::SevenZipXzCheck::SEVENZIP_XZ_CHECK_NONE,
+            XzCheck::Crc32 => ffi::SevenZipXzCheck::SEVENZIP_XZ_CHECK_CRC32,
+            XzCheck::Crc64 => ffi::SevenZipXzCheck::SEVENZIP_XZ_CHECK_CRC64,
+            XzCheck::Sha256 => ffi::SevenZipXzCheck::SEVENZIP_XZ_CHECK_SHA256,
+        }
+    }
+}
+
+/// CRCs checked while extracting, see [`SevenZip::extract_verified`]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Default)]
+pub enum Verify {
+    /// Every file's CRC, and the folder CRC where the archive stores one
+    #[default]
+    File,
+    /// The folder CRC where the archive stores one, else the file CRCs;
+    /// archives written by this crate store file CRCs only
+    Folder,
+    /// No CRC is computed; for archives already checked with
+    /// [`SevenZip::test_archive`] or protected otherwise. Decoder errors
+    /// are still reported.
+    None,
+}
+
+impl From<Verify> for ffi::SevenZipVerifyMode {
+    fn from(verify: Verify) -> Self {
+        match verify {
+            Verify::File => ffi::SevenZipVerifyMode::SEVENZIP_VERIFY_FILE,
+            Verify::Folder => ffi::SevenZipVerifyMode::SEVENZIP_VERIFY_FOLDER,
+            Verify::None => ffi::SevenZipVerifyMode::SEVENZIP_VERIFY_NONE,
+        }
+    }
+}
+
+/// Work [`SevenZip::archive_batch`] does on each archive
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Default)]
+pub enum BatchMode {
+    /// Parse the header and list the entries
+    #[default]
+    List,
+    /// List, then decode every folder with its file CRCs checked
+    Test,
+}
+
+impl From<BatchMode> for ffi::SevenZipArchiveBatchMode {
+    fn from(mode: BatchMode) -> Self {
+        match mode {
+            BatchMode::List => ffi::SevenZipArchiveBatchMode::SEVENZIP_ARCHIVE_BATCH_LIST,
+            BatchMode::Test => ffi::SevenZipArchiveBatchMode::SEVENZIP_ARCHIVE_BATCH_TEST,
+        }
+    }
+}
+
+/// Files of one name in several archives, see [`MergeOptions::names`]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Default)]
+pub enum MergeNames {
+    /// Later ones become `<stem> (2)<ext>`, `(3)`, ...
+    #[default]
+    Rename,
+    /// Each listed under the name; extraction leaves the last
+    KeepAll,
+}
+
+impl From<MergeNames> for ffi::SevenZipMergeNames {
+    fn from(names: MergeNames) -> Self {
+        match names {
+            MergeNames::Rename => ffi::SevenZipMergeNames::SEVENZIP_MERGE_RENAME,
+            MergeNames::KeepAll => ffi::SevenZipMergeNames::SEVENZIP_MERGE_KEEP_ALL,
+        }
+    }
+}
+
+/// Options of [`SevenZip::merge_archives`]
+#[derive(Debug, Clone)]
+pub struct MergeOptions {
+    /// Name clashes between files
+    pub names: MergeNames,
+    /// Leave out a file with the name, size and CRC of an earlier one when
+    /// every file of its folder goes, so the folder is not copied
+    pub drop_identical: bool,
+    /// Volume size in bytes (0 = one archive file)
+    pub split_size: u64,
+}
+
+impl Default for MergeOptions {
+    fn default() -> Self {
+        Self {
+            names: MergeNames::Rename,
+            drop_identical: true,
+            split_size: 0,
+        }
+    }
+}
+
+/// Outcome of one archive of [`SevenZip::archive_batch`]
+#[derive(Debug)]
+pub struct BatchResult {
+    /// Position in the paths passed in
+    pub index: usize,
+    /// `Ok` once the archive listed (and, in [`BatchMode::Test`], tested)
+    pub result: Result<()>,
+    /// Entries, empty if the header did not parse
+    pub entries: Vec<ArchiveEntry>,
+    /// Folders (solid blocks)
+    pub num_folders: u32,
+    /// Sum of the entry sizes
+    pub unpacked_size: u64,
+    /// Bytes of packed streams
+    pub packed_size: u64,
+    /// [`BatchMode::Test`]: bytes of the entries whose CRC matched
+    pub tested_bytes: u64,
+}
+
+/// Handling of entries whose output file already exists, see
+/// [`ExtractOptions::existing`]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Default)]
+pub enum Existing {
+    /// Write every entry again
+    #[default]
+    Overwrite,
+    /// Leave a regular file of the entry's size and modification time (to
+    /// the second) alone; entries without a time are written
+    SkipSame,
+    /// As `SkipSame`, once the file also has the entry's CRC
+    SkipSameCrc,
+}
+
+impl From<Existing> for ffi::SevenZipExistingPolicy {
+    fn from(existing: Existing) -> Self {
+        match existing {
+            Existing::Overwrite => ffi::SevenZipExistingPolicy::SEVENZIP_EXISTING_OVERWRITE,
+            Existing::SkipSame => ffi::SevenZipExistingPolicy::SEVENZIP_EXISTING_SKIP_SAME,
+            Existing::SkipSameCrc => ffi::SevenZipExistingPolicy::SEVENZIP_EXISTING_SKIP_SAME_CRC,
+        }
+    }
+}
+
+/// What of an extraction survives a crash, see
+/// [`ExtractOptions::durability`]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Default)]
+pub enum Durability {
+    /// Left to the OS: recently written files may be missing or partial
+    #[default]
+    None,
+    /// Each file fsynced before it is closed, its directory at the end
+    File,
+    /// One filesystem sync at the end makes the whole run durable
+    Batched,
+    /// Files written under a temporary name and renamed in batches once
+    /// on disk: a file under its own name is never partial
+    Atomic,
+}
+
+impl From<Durability> for ffi::SevenZipDurability {
+    fn from(durability: Durability) -> Self {
+        match durability {
+            Durability::None => ffi::SevenZipDurability::SEVENZIP_DURABILITY_NONE,
+            Durability::File => ffi::SevenZipDurability::SEVENZIP_DURABILITY_FILE,
+            Durability::Batched => ffi::SevenZipDurability::SEVENZIP_DURABILITY_BATCHED,
+            Durability::Atomic => ffi::SevenZipDurability::SEVENZIP_DURABILITY_ATOMIC,
+        }
+    }
+}
+
+/// Engine [`SevenZip::create_archive_auto`] runs, see
+/// [`SevenZip::choose_create_engine`]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum CreateEngine {
+    /// Each file read and compressed whole: a few small regular files
+    InMemory,
+    /// Bounded memory, volumes, encryption: everything else
+    Streaming,
+}
+
+impl From<ffi::SevenZipCreateEngine> for CreateEngine {
+    fn from(engine: ffi::SevenZipCreateEngine) -> Self {
+        match engine {
+            ffi::SevenZipCreateEngine::SEVENZIP_ENGINE_IN_MEMORY => CreateEngine::InMemory,
+            ffi::SevenZipCreateEngine::SEVENZIP_ENGINE_STREAMING => CreateEngine::Streaming,
+        }
+    }
+}
+
+/// Options of [`SevenZip::extract_with_options`]
+#[derive(Debug, Clone, Default)]
+pub struct ExtractOptions {
+    /// Folders decoded at once (0 = library default)
+    pub num_threads: usize,
+    /// CRCs checked while extracting
+    pub verify: Verify,
+    /// Entries already extracted to the output directory are skipped;
+    /// folders are decoded only as far as their last entry written
+    pub existing: Existing,
+    /// Decoder memory budget in bytes: fewer LZMA2 threads, then fewer
+    /// folders at once, and an archive with a folder over it fails with
+    /// [`Error::Memory`] before decoding (0 = no limit)
+    pub max_memory: u64,
+    /// Written files leave the page cache behind the write cursor and are
+    /// on disk once closed, so a large restore does not evict the data of
+    /// other processes
+    pub cache_neutral_output: bool,
+    /// When written files are made durable, so what a crash can leave
+    /// behind
+    pub durability: Durability,
+    /// [`SevenZip::extract_following`]: longest wait for the next byte of
+    /// the archive before failing with [`Error::OpenFile`] (0 = no limit)
+    pub follow_timeout_ms: u32,
+}
+
+impl ExtractOptions {
+    fn to_ffi(&self) -> ffi::SevenZipExtractOptions {
+        ffi::SevenZipExtractOptions {
+            num_threads: self.num_threads.min(i32::MAX as usize) as i32,
+            lzma2_threads: 0,
+            writer_threads: 4, // sevenzip_extract_options_init() default
+            sparse_output: 0,
+            progress_interval_ms: 0,
+            cancel: ptr::null_mut(),
+            thread_weight: 0,
+            volume_readahead: 0,
+            verify: self.verify.into(),
+            existing: self.existing.into(),
+            max_memory: self.max_memory,
+            cache_neutral_output: self.cache_neutral_output as i32,
+            consume_volumes: 0,
+            volume_consumed: None,
+            volume_consumed_user_data: ptr::null_mut(),
+            checkpoint_path: ptr::null(),
+            durability: self.durability.into(),
+            follow_timeout_ms: self.follow_timeout_ms.min(i32::MAX as u32) as i32,
+            include_patterns: ptr::null(),
+            exclude_patterns: ptr::null(),
+        }
+    }
+}
+
+/// LZMA match finder: hash chain (`Hc*`, fast) or binary tree (`Bt*`,
+/// better matches), with the number of bytes hashed
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Default)]
+pub enum MatchFinder {
+    /// The level's: hc5 up to [`CompressionLevel::Fast`], bt4 above
+    #[default]
+    Auto,
+    Hc4,
+    Hc5,
+    Bt2,
+    Bt3,
+    Bt4,
+}
+
+impl From<MatchFinder> for ffi::SevenZipMatchFinder {
+    fn from(finder: MatchFinder) -> Self {
+        match finder {
+            MatchFinder::Auto => ffi::SevenZipMatchFinder::SEVENZIP_MATCH_FINDER_AUTO,
+            MatchFinder::Hc4 => ffi::SevenZipMatchFinder::SEVENZIP_MATCH_FINDER_HC4,
+            MatchFinder::Hc5 => ffi::SevenZipMatchFinder::SEVENZIP_MATCH_FINDER_HC5,
+            MatchFinder::Bt2 => ffi::SevenZipMatchFinder::SEVENZIP_MATCH_FINDER_BT2,
+            MatchFinder::Bt3 => ffi::SevenZipMatchFinder::SEVENZIP_MATCH_FINDER_BT3,
+            MatchFinder::Bt4 => ffi::SevenZipMatchFinder::SEVENZIP_MATCH_FINDER_BT4,
+        }
+    }
+}
+
+/// LZMA encoder parameters that replace those of the compression level;
+/// `None` keeps the level's value, out-of-range values are clamped
+#[derive(Debug, Copy, Clone, Default)]
+pub struct LzmaParams {
+    pub match_finder: MatchFinder,
+    /// `Some(true)` = fast parsing, `Some(false)` = normal (optimal) parsing
+    pub fast_mode: Option<bool>,
+    /// `fb`: match length the encoder settles for, 5-273
+    pub fast_bytes: Option<u32>,
+    /// `mc`: match-finder steps per position
+    pub match_cycles: Option<u32>,
+    /// Literal context bits, 0-4 with `lc + lp` at most 4
+    pub lc: Option<u32>,
+    /// Literal position bits, 0-4
+    pub lp: Option<u32>,
+    /// Position bits, 0-4
+    pub pb: Option<u32>,
+}
+
+impl LzmaParams {
+    /// Throughput profile for logs and similar text: hc4, fast parsing, fb 32
+    pub fn fast_hc4() -> Self {
+        Self {
+            match_finder: MatchFinder::Hc4,
+            fast_mode: Some(true),
+            fast_bytes: Some(32),
+            ..Self::default()
+        }
+    }
+}
+
+impl From<LzmaParams> for ffi::SevenZipLzmaParams {
+    fn from(params: LzmaParams) -> Self {
+        let int = |v: Option<u32>| v.map_or(-1, |v| v.min(i32::MAX as u32) as i32);
+        ffi::SevenZipLzmaParams {
+            match_finder: params.match_finder.into(),
+            algorithm: params.fast_mode.map_or(-1, |fast| if fast { 0 } else { 1 }),
+            fast_bytes: int(params.fast_bytes),
+            match_cycles: params.match_cycles.unwrap_or(0),
+            lc: int(params.lc),
+            lp: int(params.lp),
+            pb: int(params.pb),
+        }
+    }
+}
+
+/// CPU scheduling of the threads the library starts
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SchedPolicy {
+    /// As the thread that starts them
+    Normal,
+    /// `SCHED_BATCH` (Windows: below normal priority)
+    Batch,
+    /// `SCHED_IDLE`: only CPU time nothing else wants
+    Idle,
+}
+
+impl From<SchedPolicy> for ffi::SevenZipSchedPolicy {
+    fn from(policy: SchedPolicy) -> Self {
+        match policy {
+            SchedPolicy::Normal => ffi::SevenZipSchedPolicy::SEVENZIP_SCHED_NORMAL,
+            SchedPolicy::Batch => ffi::SevenZipSchedPolicy::SEVENZIP_SCHED_BATCH,
+            SchedPolicy::Idle => ffi::SevenZipSchedPolicy::SEVENZIP_SCHED_IDLE,
+        }
+    }
+}
+
+/// Disk scheduling of the threads the library starts
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum IoPriority {
+    /// As the thread that starts them
+    Normal,
+    /// Lowest best-effort level (Windows: background mode)
+    Low,
+    /// Idle class: only when the disk is otherwise idle
+    Idle,
+}
+
+impl From<IoPriority> for ffi::SevenZipIoPriority {
+    fn from(priority: IoPriority) -> Self {
+        match priority {
+            IoPriority::Normal => ffi::SevenZipIoPriority::SEVENZIP_IO_NORMAL,
+            IoPriority::Low => ffi::SevenZipIoPriority::SEVENZIP_IO_LOW,
+            IoPriority::Idle => ffi::SevenZipIoPriority::SEVENZIP_IO_IDLE,
+        }
+    }
+}
+
+/// Process-wide settings for [`SevenZip::with_options`]
+#[derive(Debug, Clone)]
+pub struct InitOptions {
+    /// Compute threads all jobs share (0 = hardware threads)
+    pub max_threads: usize,
+    /// Background jobs run at once (0 = hardware threads)
+    pub max_jobs: usize,
+    /// CPUs library threads may run on, e.g. `"0-3,8"` (None = any)
+    pub cpu_affinity: Option<String>,
+    /// CPU scheduling of library threads
+    pub sched_policy: SchedPolicy,
+    /// Nice value of library threads, 1-19 (0 = unchanged)
+    pub nice: u8,
+    /// Disk scheduling of library threads
+    pub io_priority: IoPriority,
+    /// Freed decoder dictionaries and I/O buffers kept for reuse by the
+    /// next entries, folders and archives (0 = 128MB, negative = no pool)
+    pub decoder_pool_bytes: i64,
+}
+
+impl Default for InitOptions {
+    fn default() -> Self {
+        Self {
+            max_threads: 0,
+            max_jobs: 0,
+            cpu_affinity: None,
+            sched_policy: SchedPolicy::Normal,
+            nice: 0,
+            io_priority: IoPriority::Normal,
+            decoder_pool_bytes: 0,
+        }
+    }
+}
+
 /// Archive entry information
 #[derive(Debug, Clone)]
 pub struct ArchiveEntry {
@@ -67,140 +670,692 @@ impl ArchiveEntry {
     }
 }
 
-/// Progress callback closure type
-pub type ProgressCallback = Box<dyn FnMut(u64, u64) + Send>;
+/// Entries of an archive as the library listed them, freed on drop
+///
+/// The C list is one allocation with every name in it; the entries handed
+/// out by [`iter`](Self::iter) and [`get`](Self::get) borrow from it, so
+/// walking a listing of millions of entries allocates nothing in Rust.
+/// Use [`EntryRef::to_entry`] to keep an entry past the list.
+pub struct EntryList {
+    list: *mut ffi::SevenZipList,
+}
 
-/// Byte-level progress callback closure type  
-/// Parameters: (bytes_processed, bytes_total, current_file_bytes, current_file_total, current_file_name)
-pub type BytesProgressCallback = Box<dyn FnMut(u64, u64, u64, u64, &str) + Send>;
+// The list is never changed after it was filled
+unsafe impl Send for EntryList {}
+unsafe impl Sync for EntryList {}
 
-/// Calculate Shannon entropy for data compressibility detection
-/// Returns value between 0.0 (very compressible) and 1.0 (incompressible)
-fn calculate_entropy(data: &[u8]) -> f64 {
-    if data.is_empty() {
-        return 0.0;
-    }
-    
-    let mut counts = [0u32; 256];
-    for &byte in data {
-        counts[byte as usize] += 1;
+impl EntryList {
+    /// Take ownership of a list from the C API (NULL = empty)
+    ///
+    /// # Safety
+    ///
+    /// `list` is NULL or a list returned by sevenzip_list()/sevenzip_archive_list().
+    unsafe fn from_raw(list: *mut ffi::SevenZipList) -> Self {
+        EntryList { list }
     }
-    
-    let len = data.len() as f64;
-    let mut entropy = 0.0;
-    
-    for &count in &counts {
-        if count > 0 {
-            let p = count as f64 / len;
-            entropy -= p * p.log2();
+
+    fn raw_entries(&self) -> &[ffi::SevenZipEntry] {
+        if self.list.is_null() {
+            return &[];
         }
+        let list = unsafe { &*self.list };
+        if list.entries.is_null() || list.count == 0 {
+            return &[];
+        }
+        unsafe { std::slice::from_raw_parts(list.entries, list.count) }
     }
-    
-    // Normalize to 0-1 range (max entropy for byte is 8)
-    entropy / 8.0
-}
 
-/// Analyze file to determine if compression is worthwhile
-/// Returns (entropy, recommended_compression_level)
-pub fn analyze_file_compressibility(file_path: &Path) -> std::io::Result<(f64, CompressionLevel)> {
-    use std::fs::File;
-    use std::io::Read;
-    
-    let metadata = std::fs::metadata(file_path)?;
-    let file_size = metadata.len();
-    
-    // Sample size: 64KB or 5% of file, whichever is smaller
-    let sample_size = ((file_size / 20).min(65536).max(4096)) as usize;
-    
-    let mut file = File::open(file_path)?;
-    let mut buffer = vec![0u8; sample_size];
-    let bytes_read = file.read(&mut buffer)?;
-    buffer.truncate(bytes_read);
-    
-    let entropy = calculate_entropy(&buffer);
-    
-    // Determine compression level based on entropy
-    let recommended_level = match entropy {
-        e if e > 0.95 => CompressionLevel::Store,    // Already compressed/encrypted
-        e if e > 0.85 => CompressionLevel::Fastest,  // Low compression potential
-        e if e > 0.70 => CompressionLevel::Fast,     // Moderate compression
-        e if e > 0.50 => CompressionLevel::Normal,   // Good compression potential
-        _ => CompressionLevel::Maximum,              // High compression potential
-    };
-    
-    Ok((entropy, recommended_level))
-}
+    /// Number of entries
+    pub fn len(&self) -> usize {
+        self.raw_entries().len()
+    }
 
-/// Calculate optimal thread count based on total data size
-/// Returns recommended thread count considering overhead vs benefit
-pub fn calculate_optimal_threads(total_bytes: u64) -> usize {
-    let available_cores = std::thread::available_parallelism()
-        .map(|n| n.get())
-        .unwrap_or(1);
-    
-    // Thresholds determined from benchmark data:
-    // - <1MB: Single thread fastest (no threading overhead)
-    // - 1-10MB: 2 threads provides minimal benefit
-    // - 10-50MB: 4 threads good balance
-    // - >50MB: Scale with cores
-    
-    match total_bytes {
-        0..=1_048_576 => 1,                          // <1MB
-        1_048_577..=10_485_760 => 2,                 // 1-10MB
-        10_485_761..=52_428_800 => {                 // 10-50MB
-            available_cores.min(4)
-        },
-        52_428_801..=524_288_000 => {                // 50-500MB
-            available_cores.min(8)
-        },
-        _ => available_cores.min(16),                // >500MB
+    /// True when there are no entries
+    pub fn is_empty(&self) -> bool {
+        self.raw_entries().is_empty()
+    }
+
+    /// Entry `index`, if there is one
+    pub fn get(&self, index: usize) -> Option<EntryRef<'_>> {
+        self.raw_entries().get(index).map(|entry| EntryRef { entry })
+    }
+
+    /// The entries in order
+    pub fn iter(&self) -> EntryIter<'_> {
+        EntryIter { inner: self.raw_entries().iter() }
     }
 }
 
-/// Get total size of all files to be compressed
-fn calculate_total_size(file_paths: &[&str]) -> std::io::Result<u64> {
-    let mut total = 0u64;
-    for path in file_paths {
-        let metadata = std::fs::metadata(path)?;
-        if metadata.is_file() {
-            total += metadata.len();
+impl Drop for EntryList {
+    fn drop(&mut self) {
+        if !self.list.is_null() {
+            unsafe { ffi::sevenzip_free_list(self.list) };
         }
     }
-    Ok(total)
 }
 
-/// Advanced compression options
-#[derive(Debug, Clone)]
-pub struct CompressOptions {
-    /// Number of threads to use (0 = auto-detect)
-    pub num_threads: usize,
-    /// Dictionary size in bytes (0 = auto)
-    pub dict_size: u64,
-    /// Create solid archive (better compression)
-    pub solid: bool,
-    /// Optional password for encryption
-    pub password: Option<String>,
-    /// Auto-detect and skip compression for incompressible data
-    pub auto_detect_incompressible: bool,
-}
+impl<'a> IntoIterator for &'a EntryList {
+    type Item = EntryRef<'a>;
+    type IntoIter = EntryIter<'a>;
 
-impl Default for CompressOptions {
-    fn default() -> Self {
-        Self {
-            num_threads: 0, // auto-detect
-            dict_size: 0,   // auto
-            solid: true,
-            password: None,
-            auto_detect_incompressible: false, // Conservative default
-        }
+    fn into_iter(self) -> EntryIter<'a> {
+        self.iter()
     }
 }
 
-impl CompressOptions {
-    /// Create options with auto-tuned thread count based on file sizes
-    pub fn auto_tuned(file_paths: &[&str]) -> std::io::Result<Self> {
-        let total_size = calculate_total_size(file_paths)?;
-        let optimal_threads = calculate_optimal_threads(total_size);
+/// Columns of [`Archive::list_columns`], combined with `|`
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ListFields(u32);
+
+impl ListFields {
+    /// Entry names
+    pub const NAME: ListFields = ListFields(ffi::SEVENZIP_FIELD_NAME);
+    /// Uncompressed sizes
+    pub const SIZE: ListFields = ListFields(ffi::SEVENZIP_FIELD_SIZE);
+    /// Modified times, Unix timestamps
+    pub const MTIME: ListFields = ListFields(ffi::SEVENZIP_FIELD_MTIME);
+    /// File attributes
+    pub const ATTRIBUTES: ListFields = ListFields(ffi::SEVENZIP_FIELD_ATTRIBUTES);
+    /// Directory flags
+    pub const IS_DIRECTORY: ListFields = ListFields(ffi::SEVENZIP_FIELD_IS_DIRECTORY);
+    /// Every column
+    pub const ALL: ListFields = ListFields(0x1F);
+}
+
+impl std::ops::BitOr for ListFields {
+    type Output = ListFields;
+
+    fn bitor(self, other: ListFields) -> ListFields {
+        ListFields(self.0 | other.0)
+    }
+}
+
+/// A list page as columns, one C allocation the slices borrow from
+///
+/// A column that was not requested is `None`.
+pub struct ListColumns {
+    columns: *mut ffi::SevenZipListColumns,
+}
+
+// The columns are never changed after they were filled
+unsafe impl Send for ListColumns {}
+unsafe impl Sync for ListColumns {}
+
+impl ListColumns {
+    fn raw(&self) -> &ffi::SevenZipListColumns {
+        unsafe { &*self.columns }
+    }
+
+    fn column<T>(&self, data: *mut T) -> Option<&[T]> {
+        let count = self.raw().count;
+        if data.is_null() {
+            return None;
+        }
+        if count == 0 {
+            return Some(&[][..]);
+        }
+        Some(unsafe { std::slice::from_raw_parts(data, count) })
+    }
+
+    /// Number of entries
+    pub fn len(&self) -> usize {
+        self.raw().count
+    }
+
+    /// True when there are no entries
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Name of entry `index` ("" when unnamed); `None` without the column
+    pub fn name(&self, index: usize) -> Option<&str> {
+        let names = self.column(self.raw().names)?;
+        let name = *names.get(index)?;
+        if name.is_null() {
+            return Some("");
+        }
+        // The library writes UTF-8 only: unpaired surrogates became U+FFFD
+        Some(unsafe { CStr::from_ptr(name) }.to_str().unwrap_or(""))
+    }
+
+    /// Uncompressed sizes
+    pub fn sizes(&self) -> Option<&[u64]> {
+        self.column(self.raw().sizes)
+    }
+
+    /// Modified times, Unix timestamps (0 = not stored)
+    pub fn modified_times(&self) -> Option<&[u64]> {
+        self.column(self.raw().modified_times)
+    }
+
+    /// File attributes
+    pub fn attributes(&self) -> Option<&[u32]> {
+        self.column(self.raw().attributes)
+    }
+
+    /// 1 for a directory, 0 for a file
+    pub fn is_directory(&self) -> Option<&[u8]> {
+        self.column(self.raw().is_directory)
+    }
+}
+
+impl Drop for ListColumns {
+    fn drop(&mut self) {
+        unsafe { ffi::sevenzip_free_list_columns(self.columns) };
+    }
+}
+
+/// One entry of an [`EntryList`], borrowed from it
+#[derive(Clone, Copy)]
+pub struct EntryRef<'a> {
+    entry: &'a ffi::SevenZipEntry,
+}
+
+impl<'a> EntryRef<'a> {
+    /// File name, pointing into the list
+    pub fn name(&self) -> &'a str {
+        if self.entry.name.is_null() {
+            return "";
+        }
+        // The library writes UTF-8 only: unpaired surrogates became U+FFFD
+        unsafe { CStr::from_ptr(self.entry.name) }.to_str().unwrap_or("")
+    }
+
+    /// Uncompressed size in bytes
+    pub fn size(&self) -> u64 {
+        self.entry.size
+    }
+
+    /// Compressed size in bytes
+    pub fn packed_size(&self) -> u64 {
+        self.entry.packed_size
+    }
+
+    /// Unix timestamp of last modification
+    pub fn modified_time(&self) -> u64 {
+        self.entry.modified_time
+    }
+
+    /// File attributes
+    pub fn attributes(&self) -> u32 {
+        self.entry.attributes
+    }
+
+    /// True if this is a directory
+    pub fn is_directory(&self) -> bool {
+        self.entry.is_directory != 0
+    }
+
+    /// An owned copy, name included
+    pub fn to_entry(&self) -> ArchiveEntry {
+        ArchiveEntry {
+            name: self.name().to_string(),
+            size: self.size(),
+            packed_size: self.packed_size(),
+            modified_time: self.modified_time(),
+            attributes: self.attributes(),
+            is_directory: self.is_directory(),
+        }
+    }
+}
+
+impl std::fmt::Debug for EntryRef<'_> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("EntryRef")
+            .field("name", &self.name())
+            .field("size", &self.size())
+            .field("is_directory", &self.is_directory())
+            .finish()
+    }
+}
+
+/// Iterator over the entries of an [`EntryList`]
+pub struct EntryIter<'a> {
+    inner: std::slice::Iter<'a, ffi::SevenZipEntry>,
+}
+
+impl<'a> Iterator for EntryIter<'a> {
+    type Item = EntryRef<'a>;
+
+    fn next(&mut self) -> Option<EntryRef<'a>> {
+        self.inner.next().map(|entry| EntryRef { entry })
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.inner.size_hint()
+    }
+}
+
+impl ExactSizeIterator for EntryIter<'_> {}
+
+impl<'a> DoubleEndedIterator for EntryIter<'a> {
+    fn next_back(&mut self) -> Option<EntryRef<'a>> {
+        self.inner.next_back().map(|entry| EntryRef { entry })
+    }
+}
+
+/// Entry of [`SevenZip::create_archive_from_entries`], data from a reader
+pub struct SourceEntry {
+    /// Path inside the archive, '/' separated
+    pub name: String,
+    /// Bytes the reader delivers (`None` = read until it ends)
+    pub size: Option<u64>,
+    /// Unix timestamp of last modification (0 = now)
+    pub modified_time: i64,
+    /// True if this is a directory (no reader)
+    pub is_directory: bool,
+    /// Data of the entry (`None` = empty)
+    pub reader: Option<Box<dyn Read + Send>>,
+}
+
+/// Progress callback closure type
+pub type ProgressCallback = Box<dyn FnMut(u64, u64) + Send>;
+
+/// Byte-level progress callback closure type  
+/// Parameters: (bytes_processed, bytes_total, current_file_bytes, current_file_total, current_file_name)
+pub type BytesProgressCallback = Box<dyn FnMut(u64, u64, u64, u64, &str) + Send>;
+
+/// Analyze file to determine if compression is worthwhile
+/// Returns (entropy, recommended_compression_level), with entropy normalized
+/// to 0.0 (very compressible) - 1.0 (incompressible)
+///
+/// Uses the same sampled estimate as the C library's store-vs-compress
+/// decision, so windows from across the file are considered, not just its header.
+pub fn analyze_file_compressibility(file_path: &Path) -> std::io::Result<(f64, CompressionLevel)> {
+    let path_c = CString::new(file_path.to_string_lossy().as_bytes())
+        .map_err(|e| std::io::Error::new(std::io::ErrorKind::InvalidInput, e))?;
+    
+    let mut bits_per_byte = 0.0f64;
+    let result = unsafe { ffi::sevenzip_estimate_entropy(path_c.as_ptr(), &mut bits_per_byte) };
+    if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+        // Surface the usual io error (e.g. NotFound) when the path is the problem
+        std::fs::metadata(file_path)?;
+        return Err(std::io::Error::new(std::io::ErrorKind::Other, "entropy estimation failed"));
+    }
+    
+    // Normalize to 0-1 range (max entropy for byte is 8)
+    let entropy = bits_per_byte / 8.0;
+    
+    // Determine compression level based on entropy
+    let recommended_level = match entropy {
+        e if e > 0.95 => CompressionLevel::Store,    // Already compressed/encrypted
+        e if e > 0.85 => CompressionLevel::Fastest,  // Low compression potential
+        e if e > 0.70 => CompressionLevel::Fast,     // Moderate compression
+        e if e > 0.50 => CompressionLevel::Normal,   // Good compression potential
+        _ => CompressionLevel::Maximum,              // High compression potential
+    };
+    
+    Ok((entropy, recommended_level))
+}
+
+/// Calculate optimal thread count based on total data size
+/// Returns recommended thread count considering overhead vs benefit
+pub fn calculate_optimal_threads(total_bytes: u64) -> usize {
+    // CPUs the library sizes its own auto counts for: the affinity mask and
+    // a container's cgroup quota, rounded up, not the host's cores
+    let available_cores = unsafe { ffi::sevenzip_hardware_threads() }.max(1) as usize;
+    
+    // Thresholds determined from benchmark data:
+    // - <1MB: Single thread fastest (no threading overhead)
+    // - 1-10MB: 2 threads provides minimal benefit
+    // - 10-50MB: 4 threads good balance
+    // - >50MB: Scale with cores
+    
+    match total_bytes {
+        0..=1_048_576 => 1,                          // <1MB
+        1_048_577..=10_485_760 => 2,                 // 1-10MB
+        10_485_761..=52_428_800 => {                 // 10-50MB
+            available_cores.min(4)
+        },
+        52_428_801..=524_288_000 => {                // 50-500MB
+            available_cores.min(8)
+        },
+        _ => available_cores.min(16),                // >500MB
+    }
+}
+
+/// Get total size of all files to be compressed
+fn calculate_total_size(file_paths: &[&str]) -> std::io::Result<u64> {
+    let mut total = 0u64;
+    for path in file_paths {
+        let metadata = std::fs::metadata(path)?;
+        if metadata.is_file() {
+            total += metadata.len();
+        }
+    }
+    Ok(total)
+}
+
+/// Level for `single`, the only input, when `opts` asks to detect incompressible data
+/// (a directory fails the estimate and keeps the level)
+fn incompressible_level(opts: &CompressOptions, single: Option<&Path>, level: CompressionLevel) -> CompressionLevel {
+    let path = match single {
+        Some(path) if opts.auto_detect_incompressible => path,
+        _ => return level,
+    };
+    match analyze_file_compressibility(path) {
+        Ok((entropy, _)) if entropy > 0.95 => {
+            eprintln!("Info: Data appears incompressible (entropy: {:.2}), using Store mode", entropy);
+            CompressionLevel::Store
+        },
+        Ok((entropy, _)) if entropy > 0.85 => {
+            eprintln!("Info: Low compression potential detected (entropy: {:.2})", entropy);
+            level
+        }
+        _ => level,
+    }
+}
+
+/// FILETIME of the 1970 epoch
+const FILETIME_UNIX_EPOCH: u64 = 116_444_736_000_000_000;
+
+/// Modification time as FILETIME, in whole seconds like the library's stat
+fn metadata_filetime(metadata: &std::fs::Metadata) -> u64 {
+    match metadata.modified().map(|t| t.duration_since(std::time::UNIX_EPOCH)) {
+        Ok(Ok(since)) => since.as_secs() * 10_000_000 + FILETIME_UNIX_EPOCH,
+        Ok(Err(before)) => FILETIME_UNIX_EPOCH.saturating_sub(before.duration().as_secs() * 10_000_000),
+        Err(_) => 0,
+    }
+}
+
+/// Attributes as the library stores them: `st_mode`, `FILE_ATTRIBUTE_*` on Windows
+fn metadata_attributes(metadata: &std::fs::Metadata) -> u32 {
+    #[cfg(unix)]
+    {
+        use std::os::unix::fs::MetadataExt;
+        metadata.mode()
+    }
+    #[cfg(windows)]
+    {
+        use std::os::windows::fs::MetadataExt;
+        metadata.file_attributes()
+    }
+    #[cfg(not(any(unix, windows)))]
+    {
+        let _ = metadata;
+        0
+    }
+}
+
+/// One file or directory of an [`InputTable`]
+#[derive(Debug, Clone)]
+pub struct InputEntry {
+    /// File to read (`None` for directories, and for inputs that are
+    /// neither files nor directories, archived empty)
+    pub path: Option<PathBuf>,
+    /// Name in the archive, '/'-separated
+    pub name: String,
+    /// Bytes archived from `path`
+    pub size: u64,
+    /// Modification time as FILETIME (100ns units since 1601)
+    pub modified_time: u64,
+    /// `st_mode` on Unix, `FILE_ATTRIBUTE_*` on Windows
+    pub attributes: u32,
+    pub is_directory: bool,
+}
+
+/// Inputs of an archive, scanned once
+///
+/// Entries are named and ordered as [`SevenZip::create_archive`] archives
+/// them: a file input by its file name, the contents of a directory input
+/// relative to it, depth first. [`SevenZip::create_archive_from_table`]
+/// takes the table as it is, so the inputs are not walked again, and
+/// `total_size` sizes the job ([`CompressOptions::auto_tuned_for`]).
+#[derive(Debug, Clone, Default)]
+pub struct InputTable {
+    pub entries: Vec<InputEntry>,
+    /// Bytes of all files
+    pub total_size: u64,
+}
+
+/// Directories listed at once by [`InputTable::scan`]
+const SCAN_MAX_THREADS: usize = 8;
+
+/// A directory's entries, each subdirectory with the index of its own listing
+type DirListing = Vec<(InputEntry, Option<usize>)>;
+
+/// Walk shared by the [`InputTable::scan`] threads
+struct ScanState {
+    queue: Vec<(usize, PathBuf, String)>,  // Listing index, directory, its archive name
+    listings: Vec<Option<DirListing>>,
+    pending: usize,                        // Directories queued or being listed
+    error: Option<std::io::Error>,
+}
+
+impl InputTable {
+    /// Stat the inputs and walk the directories among them
+    ///
+    /// Directories are listed by up to 8 threads at a time, so trees on
+    /// high-latency storage are read many directories at once; symbolic
+    /// links are followed, and only files and directories are kept from
+    /// below a directory input.
+    pub fn scan(input_paths: &[impl AsRef<Path>]) -> std::io::Result<Self> {
+        let mut table = InputTable::default();
+        let mut roots = Vec::new();  // Entry index after which each root's contents go
+        let mut state = ScanState { queue: Vec::new(), listings: Vec::new(), pending: 0, error: None };
+        for input in input_paths {
+            let path = input.as_ref();
+            let metadata = std::fs::metadata(path)?;
+            if metadata.is_dir() {
+                roots.push((table.entries.len(), state.listings.len()));
+                state.queue.push((state.listings.len(), path.to_path_buf(), String::new()));
+                state.listings.push(None);
+                continue;
+            }
+            let name = path.file_name().map(|n| n.to_string_lossy().into_owned())
+                .unwrap_or_else(|| path.to_string_lossy().into_owned());
+            let is_file = metadata.is_file();
+            table.entries.push(InputEntry {
+                path: if is_file { Some(path.to_path_buf()) } else { None },
+                name,
+                size: if is_file { metadata.len() } else { 0 },
+                modified_time: metadata_filetime(&metadata),
+                attributes: metadata_attributes(&metadata),
+                is_directory: false,
+            });
+        }
+        if roots.is_empty() {
+            table.total_size = table.entries.iter().map(|e| e.size).sum();
+            return Ok(table);
+        }
+
+        state.pending = state.queue.len();
+        let threads = std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+            .min(SCAN_MAX_THREADS);
+        let shared = (Mutex::new(state), std::sync::Condvar::new());
+        std::thread::scope(|scope| {
+            for _ in 0..threads {
+                scope.spawn(|| scan_worker(&shared));
+            }
+        });
+        let mut state = shared.0.into_inner().unwrap_or_else(|e| e.into_inner());
+        if let Some(error) = state.error.take() {
+            return Err(error);
+        }
+
+        // Depth first: each directory's contents right after it
+        let mut walked = Vec::new();
+        let mut files = std::mem::take(&mut table.entries).into_iter();
+        let mut taken = 0;
+        for (position, listing) in roots {
+            walked.extend(files.by_ref().take(position - taken));
+            taken = position;
+            let mut stack = vec![state.listings[listing].take().unwrap_or_default().into_iter()];
+            while let Some(items) = stack.last_mut() {
+                match items.next() {
+                    Some((entry, child)) => {
+                        walked.push(entry);
+                        if let Some(child) = child {
+                            stack.push(state.listings[child].take().unwrap_or_default().into_iter());
+                        }
+                    }
+                    None => {
+                        stack.pop();
+                    }
+                }
+            }
+        }
+        walked.extend(files);
+        table.entries = walked;
+        table.total_size = table.entries.iter().map(|e| e.size).sum();
+        Ok(table)
+    }
+}
+
+/// List queued directories until none are left or one fails
+fn scan_worker(shared: &(Mutex<ScanState>, std::sync::Condvar)) {
+    let (lock, wake) = shared;
+    loop {
+        let (index, dir, prefix) = {
+            let mut state = lock.lock().unwrap_or_else(|e| e.into_inner());
+            loop {
+                if state.error.is_some() || state.pending == 0 {
+                    return;
+                }
+                if let Some(job) = state.queue.pop() {
+                    break job;
+                }
+                state = wake.wait(state).unwrap_or_else(|e| e.into_inner());
+            }
+        };
+
+        let listed = list_directory(&dir, &prefix);
+        let mut state = lock.lock().unwrap_or_else(|e| e.into_inner());
+        match listed {
+            Ok((mut items, subdirs)) => {
+                for (position, path) in subdirs {
+                    let child = state.listings.len();
+                    state.listings.push(None);
+                    let name = items[position].0.name.clone();
+                    state.queue.push((child, path, name));
+                    state.pending += 1;
+                    items[position].1 = Some(child);
+                }
+                state.listings[index] = Some(items);
+            }
+            Err(error) => {
+                state.error.get_or_insert(error);
+            }
+        }
+        state.pending -= 1;
+        drop(state);
+        wake.notify_all();
+    }
+}
+
+/// Entries of one directory named below `prefix`, and its subdirectories by position
+fn list_directory(dir: &Path, prefix: &str) -> std::io::Result<(DirListing, Vec<(usize, PathBuf)>)> {
+    let mut items = Vec::new();
+    let mut subdirs = Vec::new();
+    for dir_entry in std::fs::read_dir(dir)? {
+        let dir_entry = dir_entry?;
+        let path = dir_entry.path();
+        let metadata = std::fs::metadata(&path)?;
+        let file_name = dir_entry.file_name();
+        let name = if prefix.is_empty() {
+            file_name.to_string_lossy().into_owned()
+        } else {
+            format!("{}/{}", prefix, file_name.to_string_lossy())
+        };
+        let is_directory = metadata.is_dir();
+        if !is_directory && !metadata.is_file() {
+            continue;
+        }
+        if is_directory {
+            subdirs.push((items.len(), path.clone()));
+        }
+        items.push((InputEntry {
+            path: if is_directory { None } else { Some(path) },
+            name,
+            size: if is_directory { 0 } else { metadata.len() },
+            modified_time: metadata_filetime(&metadata),
+            attributes: metadata_attributes(&metadata),
+            is_directory,
+        }, None));
+    }
+    Ok((items, subdirs))
+}
+
+/// Advanced compression options
+#[derive(Debug, Clone)]
+pub struct CompressOptions {
+    /// Number of threads to use (0 = auto-detect)
+    pub num_threads: usize,
+    /// Dictionary size in bytes (0 = auto)
+    pub dict_size: u64,
+    /// Create solid archive (better compression)
+    pub solid: bool,
+    /// Optional password for encryption
+    pub password: Option<String>,
+    /// Auto-detect and skip compression for incompressible data
+    pub auto_detect_incompressible: bool,
+    /// Start a new solid block after this many input bytes (0 = unlimited)
+    pub solid_block_size: u64,
+    /// Start a new solid block after this many files (0 = unlimited)
+    pub solid_block_files: usize,
+    /// Filter applied before LZMA2
+    pub filter: Filter,
+    /// Delta filter distance in bytes, 1-256 (0 = 1)
+    pub delta_distance: usize,
+    /// Comma-separated extensions that get the Delta filter in `Filter::Auto` mode
+    pub delta_extensions: Option<String>,
+    /// Compression method
+    pub method: Method,
+    /// PPMd model order, 2-64 (0 = per level)
+    pub ppmd_order: usize,
+    /// PPMd model size in bytes (0 = per level)
+    pub ppmd_mem_size: u32,
+    /// Peak memory budget in bytes; threads, blocks and buffers shrink to fit (0 = no limit)
+    pub max_memory: u64,
+    /// LZMA2 block size in bytes; blocks are what threads compress in parallel (0 = 4x dictionary)
+    pub block_size: u64,
+    /// Share of the [`SevenZip::with_thread_quota`] quota against other jobs (0 = 1)
+    pub thread_weight: u32,
+    /// Encoder thread placement; no effect on single-node hosts
+    pub numa_policy: NumaPolicy,
+    /// Store files an extension or magic number shows are compressed
+    /// already (JPEG, PNG, ZIP, gzip, zstd, MP4, 7z, ...) in Copy folders
+    /// of their own, after the other files in solid archives
+    pub detect_compressed: bool,
+    /// LZMA encoder parameters over those of the level (`None` = the level's)
+    pub lzma_params: Option<LzmaParams>,
+    /// Solid archives: order files by extension, then name, then size,
+    /// like 7-Zip's `-mqs`
+    pub solid_sort: bool,
+}
+
+impl Default for CompressOptions {
+    fn default() -> Self {
+        Self {
+            num_threads: 0, // auto-detect
+            dict_size: 0,   // auto
+            solid: true,
+            password: None,
+            auto_detect_incompressible: false, // Conservative default
+            solid_block_size: 0,
+            solid_block_files: 0,
+            filter: Filter::Auto,
+            delta_distance: 0,
+            delta_extensions: None,
+            method: Method::Lzma2,
+            ppmd_order: 0,
+            ppmd_mem_size: 0,
+            max_memory: 0,
+            block_size: 0,
+            thread_weight: 0,
+            numa_policy: NumaPolicy::Off,
+            detect_compressed: false,
+            lzma_params: None,
+            solid_sort: false,
+        }
+    }
+}
+
+impl CompressOptions {
+    /// Create options with auto-tuned thread count based on file sizes
+    pub fn auto_tuned(file_paths: &[&str]) -> std::io::Result<Self> {
+        let total_size = calculate_total_size(file_paths)?;
+        let optimal_threads = calculate_optimal_threads(total_size);
         
         Ok(Self {
             num_threads: optimal_threads,
@@ -208,9 +1363,70 @@ impl CompressOptions {
             solid: true,
             password: None,
             auto_detect_incompressible: true, // Enable by default for smart mode
+            solid_block_size: 0,
+            solid_block_files: 0,
+            filter: Filter::Auto,
+            delta_distance: 0,
+            delta_extensions: None,
+            method: Method::Lzma2,
+            ppmd_order: 0,
+            ppmd_mem_size: 0,
+            max_memory: 0,
+            block_size: 0,
+            thread_weight: 0,
+            numa_policy: NumaPolicy::Off,
+            detect_compressed: false,
+            lzma_params: None,
+            solid_sort: false,
         })
     }
     
+    /// Options with the thread count picked for a scanned table's total size
+    ///
+    /// Unlike [`auto_tuned`](Self::auto_tuned), which stats the inputs
+    /// itself and counts no bytes below directories, this takes the sizes
+    /// the scan already has.
+    pub fn auto_tuned_for(table: &InputTable) -> Self {
+        Self {
+            num_threads: calculate_optimal_threads(table.total_size),
+            auto_detect_incompressible: true,
+            ..Self::default()
+        }
+    }
+
+    /// C options borrowing `password`, `delta_extensions` and `lzma_params`,
+    /// which must outlive the returned struct
+    fn to_ffi(
+        &self,
+        password: &Option<CString>,
+        delta_extensions: &Option<CString>,
+        lzma_params: &Option<ffi::SevenZipLzmaParams>,
+    ) -> ffi::SevenZipCompressOptions {
+        ffi::SevenZipCompressOptions {
+            num_threads: self.num_threads as i32,
+            dict_size: self.dict_size,
+            solid: if self.solid { 1 } else { 0 },
+            password: password.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+            solid_block_size: self.solid_block_size,
+            solid_block_files: self.solid_block_files as i32,
+            filter: self.filter.into(),
+            delta_distance: self.delta_distance as i32,
+            delta_extensions: delta_extensions.as_ref().map_or(ptr::null(), |e| e.as_ptr()),
+            method: self.method.into(),
+            ppmd_order: self.ppmd_order as i32,
+            ppmd_mem_size: self.ppmd_mem_size,
+            max_memory: self.max_memory,
+            cancel: ptr::null_mut(),
+            block_size: self.block_size,
+            thread_weight: self.thread_weight as i32,
+            numa_policy: self.numa_policy.into(),
+            detect_compressed: if self.detect_compressed { 1 } else { 0 },
+            lzma_params: lzma_params.as_ref().map_or(ptr::null(), |p| p as *const _),
+            solid_sort: if self.solid_sort { 1 } else { 0 },
+            dedup_chunk_size: 0,
+        }
+    }
+    
     /// Enable auto-detection with method chaining
     pub fn with_auto_detect(mut self, enable: bool) -> Self {
         self.auto_detect_incompressible = enable;
@@ -228,13 +1444,35 @@ impl CompressOptions {
         self.password = Some(password);
         self
     }
-}
-
-/// Streaming compression options for large files and split archives
-#[derive(Debug, Clone)]
-pub struct StreamOptions {
-    /// Number of threads to use (0 = auto-detect)
-    pub num_threads: usize,
+    
+    /// Limit solid blocks by size and/or file count (0 = unlimited), like 7-Zip's `-ms=`
+    ///
+    /// Smaller blocks compress slightly worse but let single files be
+    /// extracted without decoding everything stored before them.
+    pub fn with_solid_block(mut self, size: u64, files: usize) -> Self {
+        self.solid_block_size = size;
+        self.solid_block_files = files;
+        self
+    }
+    
+    /// Set the filter with method chaining
+    pub fn with_filter(mut self, filter: Filter) -> Self {
+        self.filter = filter;
+        self
+    }
+    
+    /// Set the compression method with method chaining
+    pub fn with_method(mut self, method: Method) -> Self {
+        self.method = method;
+        self
+    }
+}
+
+/// Streaming compression options for large files and split archives
+#[derive(Debug, Clone)]
+pub struct StreamOptions {
+    /// Number of threads to use (0 = auto-detect)
+    pub num_threads: usize,
     /// Dictionary size in bytes (0 = auto)
     pub dict_size: u64,
     /// Create solid archive
@@ -245,10 +1483,140 @@ pub struct StreamOptions {
     pub split_size: u64,
     /// Chunk size for streaming (0 = auto)
     pub chunk_size: u64,
-    /// Temporary directory (None = system default)
+    /// Directory of the scratch files of non-solid pack streams finished
+    /// ahead of their turn; the one being written goes straight to the
+    /// archive (None = system default)
     pub temp_dir: Option<String>,
     /// Delete temporary files on error
     pub delete_temp_on_error: bool,
+    /// Number of 4MB read-ahead buffers filled by a reader thread (0 = disabled)
+    pub prefetch_buffers: usize,
+    /// Start a new solid block after this many input bytes (0 = unlimited)
+    pub solid_block_size: u64,
+    /// Start a new solid block after this many files (0 = unlimited)
+    pub solid_block_files: usize,
+    /// Filter applied before LZMA2
+    pub filter: Filter,
+    /// Delta filter distance in bytes, 1-256 (0 = 1)
+    pub delta_distance: usize,
+    /// Comma-separated extensions that get the Delta filter in `Filter::Auto` mode
+    pub delta_extensions: Option<String>,
+    /// Compression method
+    pub method: Method,
+    /// PPMd model order, 2-64 (0 = per level)
+    pub ppmd_order: usize,
+    /// PPMd model size in bytes (0 = per level)
+    pub ppmd_mem_size: u32,
+    /// Peak memory budget in bytes; threads, blocks and buffers shrink to fit (0 = no limit)
+    pub max_memory: u64,
+    /// Write split volumes around the page cache (O_DIRECT / F_NOCACHE / FILE_FLAG_NO_BUFFERING)
+    pub unbuffered_output: bool,
+    /// Read sources with kernel hints: read ahead, drop consumed data from the page cache
+    pub input_access_hints: bool,
+    /// Least milliseconds between progress calls, made from a reporter thread
+    /// (0 = 100ms, negative = every update, on the working thread)
+    pub progress_interval_ms: i32,
+    /// Also report once this many input bytes passed since the last call (0 = time only)
+    pub progress_interval_bytes: u64,
+    /// Stop the job once this token is cancelled (partial output goes as
+    /// with `delete_temp_on_error`)
+    pub cancel: Option<Arc<CancelToken>>,
+    /// Split archives: keep `<archive>.ckpt` for [`SevenZip::resume_multivolume`],
+    /// saved as volumes fill; the volumes it covers outlive a failure
+    pub checkpoint: bool,
+    /// LZMA2 block size in bytes; blocks are what threads compress in parallel (0 = auto)
+    pub block_size: u64,
+    /// Share of the [`SevenZip::with_thread_quota`] quota against other jobs (0 = 1)
+    pub thread_weight: u32,
+    /// Encoder thread placement; no effect on single-node hosts
+    pub numa_policy: NumaPolicy,
+    /// Split archives: directories the volumes go to round robin, each
+    /// written by its own thread (empty = next to the archive path).
+    /// Gather the volumes in one directory to extract them.
+    pub volume_dirs: Vec<PathBuf>,
+    /// Write the `digest_algorithm` digest of every file, computed in the
+    /// pass that reads it for the CRC, to this path as `sha256sum` lines
+    /// once the archive is complete (non-solid jobs then keep large files
+    /// whole; not for [`SevenZip::resume_multivolume`])
+    pub digest_manifest: Option<PathBuf>,
+    /// Digest of `digest_manifest`
+    pub digest_algorithm: DigestAlgorithm,
+    /// Snapshot of an earlier run (`snapshot_output`): files whose name,
+    /// size, mtime and inode match it are left out without being read, and
+    /// a run with none changed writes an empty archive. A missing file
+    /// archives everything. Not for [`SevenZip::resume_multivolume`].
+    pub snapshot_base: Option<PathBuf>,
+    /// Write the name, size, mtime and inode of every input, archived or
+    /// left out by `snapshot_base`, to this path once the archive is
+    /// complete; may be the `snapshot_base` path
+    pub snapshot_output: Option<PathBuf>,
+    /// As in [`CompressOptions`]; not for true streaming, which writes one folder
+    pub detect_compressed: bool,
+    /// LZMA encoder parameters over those of the level (`None` = the level's)
+    pub lzma_params: Option<LzmaParams>,
+    /// fsync every volume (or the one archive file) before the call
+    /// returns; full volumes are closed and synced by a finisher thread
+    /// while the next one fills
+    pub sync_volumes: bool,
+    /// Write the `digest_algorithm` digest of every volume, computed as
+    /// its bytes are written (the first is read back once patched), to
+    /// this path as `sha256sum` lines by volume file name once the archive
+    /// is complete (not for [`SevenZip::resume_multivolume`])
+    pub volume_manifest: Option<PathBuf>,
+    /// Write `<archive>.7zidx`, the entry table, folder offsets and volume
+    /// sizes, for [`SevenZip::list_index`]
+    pub write_index: bool,
+    /// Write runs of 1MB or more of zeros (in 64KB units) as precomputed
+    /// LZMA2 chunks instead of encoding them; the dictionary restarts
+    /// after each run, so it suits disk and VM images
+    pub zero_blocks: bool,
+    /// Non-solid jobs: percentage of stalled time (PSI "some avg10" of
+    /// the cgroup, else the system) from which workers run one at a time,
+    /// freeing their encoders while held back (0 = off)
+    pub memory_pressure_throttle: u32,
+    /// Bytes read and written per second; may be shared with other jobs
+    /// and changed while they run (`None` = unlimited)
+    pub rate_limit: Option<Arc<RateLimit>>,
+    /// File of inputs after the paths given to the call, one per line
+    /// (`find` output), read as the scan goes
+    pub input_list: Option<PathBuf>,
+    /// Decode every LZMA2 folder on a thread of its own as it is written,
+    /// failing the job unless it matches its input, instead of testing the
+    /// archive afterwards
+    pub verify_writes: bool,
+    /// Solid archives: place files whose first 16KB match next to each
+    /// other, so scattered copies cost next to nothing
+    pub group_duplicates: bool,
+    /// Solid archives: order files by extension, then name, then size
+    pub solid_sort: bool,
+    /// Reserve room after the start header and fill it with a copy of the
+    /// header, so [`SevenZip::extract_from_stream`] can extract the archive
+    /// from a pipe; other readers see a plain 7z archive
+    pub streamable: bool,
+    /// Bytes reserved for `streamable` (0 = sized from the gathered entries)
+    pub streamable_reserve: u64,
+    /// Keep encoder counters per LZMA2 folder for
+    /// `sevenzip_get_last_folder_stats()`
+    pub folder_stats: bool,
+    /// MB/s of input to hold by moving later LZMA2 tasks to faster
+    /// encoder settings, and back (0.0 = off)
+    pub throughput_target: f64,
+    /// Method, filter, level and solid group of each file; files differing
+    /// in any of them go into different folders (`None` = the options'
+    /// choice for every file)
+    pub entry_policy: Option<EntryPolicy>,
+    /// Archive bytes that depend on the inputs, level and options only,
+    /// not on `num_threads`: fixed LZMA2 blocks, entries sorted by name;
+    /// `max_memory` only takes threads away (not with `throughput_target`)
+    pub deterministic: bool,
+    /// Unix time written as every entry's modification time, e.g.
+    /// `SOURCE_DATE_EPOCH` (0 = each file's own)
+    pub fixed_mtime: i64,
+    /// Existing directory keeping the pack streams of non-solid folders
+    /// across runs, by content hash and coder settings: unchanged files
+    /// are spliced in without being compressed. Never pruned here; not
+    /// with a password or `throughput_target`
+    pub block_cache_dir: Option<PathBuf>,
 }
 
 impl Default for StreamOptions {
@@ -262,137 +1630,2347 @@ impl Default for StreamOptions {
             chunk_size: 0,
             temp_dir: None,
             delete_temp_on_error: true,
+            prefetch_buffers: 4,
+            solid_block_size: 0,
+            solid_block_files: 0,
+            filter: Filter::Auto,
+            delta_distance: 0,
+            delta_extensions: None,
+            method: Method::Lzma2,
+            ppmd_order: 0,
+            ppmd_mem_size: 0,
+            max_memory: 0,
+            unbuffered_output: false,
+            input_access_hints: false,
+            progress_interval_ms: 0,
+            progress_interval_bytes: 0,
+            cancel: None,
+            checkpoint: false,
+            block_size: 0,
+            thread_weight: 0,
+            numa_policy: NumaPolicy::Off,
+            volume_dirs: Vec::new(),
+            digest_manifest: None,
+            digest_algorithm: DigestAlgorithm::Sha256,
+            snapshot_base: None,
+            snapshot_output: None,
+            detect_compressed: false,
+            lzma_params: None,
+            sync_volumes: false,
+            volume_manifest: None,
+            write_index: false,
+            zero_blocks: false,
+            memory_pressure_throttle: 0,
+            rate_limit: None,
+            input_list: None,
+            verify_writes: false,
+            group_duplicates: false,
+            solid_sort: false,
+            streamable: false,
+            streamable_reserve: 0,
+            folder_stats: false,
+            throughput_target: 0.0,
+            entry_policy: None,
+            deterministic: false,
+            fixed_mtime: 0,
+            block_cache_dir: None,
+        }
+    }
+}
+
+impl StreamOptions {
+    /// Build the C options struct.
+    ///
+    /// Starts from `sevenzip_stream_options_init` so any C-side field not
+    /// exposed here keeps its library default. `password`, `temp_dir`,
+    /// `delta_extensions`, `volume_dirs` (from [`c_string_list`]) and
+    /// `refs` must outlive the returned struct.
+    fn to_ffi(
+        &self,
+        password: &Option<CString>,
+        temp_dir: &Option<CString>,
+        delta_extensions: &Option<CString>,
+        volume_dirs: &[*const std::os::raw::c_char],
+        refs: &StreamOptionRefs,
+    ) -> ffi::SevenZipStreamOptions {
+        let mut c_opts = std::mem::MaybeUninit::<ffi::SevenZipStreamOptions>::uninit();
+        let mut c_opts = unsafe {
+            ffi::sevenzip_stream_options_init(c_opts.as_mut_ptr());
+            c_opts.assume_init()
+        };
+        c_opts.num_threads = self.num_threads as i32;
+        c_opts.dict_size = self.dict_size;
+        c_opts.solid = if self.solid { 1 } else { 0 };
+        c_opts.password = password.as_ref().map_or(ptr::null(), |p| p.as_ptr());
+        c_opts.split_size = self.split_size;
+        c_opts.chunk_size = self.chunk_size;
+        c_opts.temp_dir = temp_dir.as_ref().map_or(ptr::null(), |p| p.as_ptr());
+        c_opts.delete_temp_on_error = if self.delete_temp_on_error { 1 } else { 0 };
+        c_opts.prefetch_buffers = self.prefetch_buffers as i32;
+        c_opts.solid_block_size = self.solid_block_size;
+        c_opts.solid_block_files = self.solid_block_files as i32;
+        c_opts.filter = self.filter.into();
+        c_opts.delta_distance = self.delta_distance as i32;
+        c_opts.delta_extensions = delta_extensions.as_ref().map_or(ptr::null(), |e| e.as_ptr());
+        c_opts.method = self.method.into();
+        c_opts.ppmd_order = self.ppmd_order as i32;
+        c_opts.ppmd_mem_size = self.ppmd_mem_size;
+        c_opts.max_memory = self.max_memory;
+        c_opts.unbuffered_output = if self.unbuffered_output { 1 } else { 0 };
+        c_opts.input_access_hints = if self.input_access_hints { 1 } else { 0 };
+        c_opts.progress_interval_ms = self.progress_interval_ms;
+        c_opts.progress_interval_bytes = self.progress_interval_bytes;
+        c_opts.cancel = self.cancel.as_ref().map_or(ptr::null_mut(), |t| t.handle);
+        c_opts.checkpoint = if self.checkpoint { 1 } else { 0 };
+        c_opts.block_size = self.block_size;
+        c_opts.thread_weight = self.thread_weight.min(i32::MAX as u32) as i32;
+        c_opts.numa_policy = self.numa_policy.into();
+        c_opts.volume_dirs = if volume_dirs.is_empty() { ptr::null() } else { volume_dirs.as_ptr() };
+        c_opts.digest_manifest = c_path_or_null(&refs.digest_manifest);
+        c_opts.digest_algorithm = self.digest_algorithm.into();
+        c_opts.snapshot_base = c_path_or_null(&refs.snapshot_base);
+        c_opts.snapshot_output = c_path_or_null(&refs.snapshot_output);
+        c_opts.detect_compressed = if self.detect_compressed { 1 } else { 0 };
+        c_opts.lzma_params = refs.lzma_params.as_ref().map_or(ptr::null(), |p| p as *const _);
+        c_opts.sync_volumes = if self.sync_volumes { 1 } else { 0 };
+        c_opts.volume_manifest = c_path_or_null(&refs.volume_manifest);
+        c_opts.write_index = if self.write_index { 1 } else { 0 };
+        c_opts.zero_blocks = if self.zero_blocks { 1 } else { 0 };
+        c_opts.memory_pressure_throttle = self.memory_pressure_throttle.min(100) as i32;
+        c_opts.rate_limit = self.rate_limit.as_ref().map_or(ptr::null_mut(), |l| l.handle);
+        c_opts.input_list = c_path_or_null(&refs.input_list);
+        c_opts.verify_writes = if self.verify_writes { 1 } else { 0 };
+        c_opts.group_duplicates = if self.group_duplicates { 1 } else { 0 };
+        c_opts.solid_sort = if self.solid_sort { 1 } else { 0 };
+        c_opts.streamable = if self.streamable { 1 } else { 0 };
+        c_opts.streamable_reserve = self.streamable_reserve;
+        c_opts.folder_stats = if self.folder_stats { 1 } else { 0 };
+        c_opts.throughput_target = self.throughput_target;
+        c_opts.deterministic = if self.deterministic { 1 } else { 0 };
+        c_opts.fixed_mtime = self.fixed_mtime;
+        c_opts.block_cache_dir = c_path_or_null(&refs.block_cache_dir);
+        if let Some(policy) = &self.entry_policy {
+            c_opts.entry_policy = Some(entry_policy_wrapper);
+            c_opts.entry_policy_data = policy as *const EntryPolicy as *mut std::os::raw::c_void;
+        }
+        c_opts
+    }
+
+    /// C strings of `volume_dirs`, for [`c_string_list`]
+    fn volume_dirs_c(&self) -> Result<Vec<CString>> {
+        self.volume_dirs.iter().map(|d| path_to_cstring(d)).collect()
+    }
+
+    /// C strings of the path options and the C LZMA parameters, for
+    /// [`StreamOptions::to_ffi`]
+    fn refs_c(&self) -> Result<StreamOptionRefs> {
+        let c = |p: &Option<PathBuf>| p.as_deref().map(path_to_cstring).transpose();
+        Ok(StreamOptionRefs {
+            digest_manifest: c(&self.digest_manifest)?,
+            snapshot_base: c(&self.snapshot_base)?,
+            snapshot_output: c(&self.snapshot_output)?,
+            volume_manifest: c(&self.volume_manifest)?,
+            input_list: c(&self.input_list)?,
+            block_cache_dir: c(&self.block_cache_dir)?,
+            lzma_params: self.lzma_params.map(ffi::SevenZipLzmaParams::from),
+        })
+    }
+}
+
+/// C values the [`StreamOptions`] point at (path strings, LZMA
+/// parameters), kept alive next to the C struct
+#[derive(Default)]
+struct StreamOptionRefs {
+    digest_manifest: Option<CString>,
+    snapshot_base: Option<CString>,
+    snapshot_output: Option<CString>,
+    volume_manifest: Option<CString>,
+    input_list: Option<CString>,
+    block_cache_dir: Option<CString>,
+    lzma_params: Option<ffi::SevenZipLzmaParams>,
+}
+
+fn c_path_or_null(path: &Option<CString>) -> *const std::os::raw::c_char {
+    path.as_ref().map_or(ptr::null(), |p| p.as_ptr())
+}
+
+/// Main 7z archive interface
+pub struct SevenZip {
+    _initialized: bool,
+}
+
+impl SevenZip {
+    /// Create a new SevenZip instance
+    ///
+    /// Initializes the underlying 7z library.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn new() -> Result<Self> {
+        unsafe {
+            let result = ffi::sevenzip_init();
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+        Ok(Self { _initialized: true })
+    }
+
+    /// Initialize the library with a thread quota shared by every job in the process
+    ///
+    /// Jobs then take at most their `num_threads` (all of the quota when
+    /// 0) and at most their `thread_weight` share among running and
+    /// waiting jobs, and wait while the quota is used up, so many
+    /// concurrent jobs stay within `max_threads` (0 = hardware threads).
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::with_thread_quota(8)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn with_thread_quota(max_threads: usize) -> Result<Self> {
+        Self::with_options(&InitOptions {
+            max_threads,
+            ..InitOptions::default()
+        })
+    }
+
+    /// Initialize the library with process-wide settings
+    ///
+    /// Besides the thread quota of [`SevenZip::with_thread_quota`], sets
+    /// how the threads the library starts are scheduled, so background
+    /// archiving takes spare CPU and disk time only. The calling thread is
+    /// never changed; run jobs with the `*_async` methods to have all of
+    /// their work scheduled this way.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{InitOptions, SchedPolicy, IoPriority, SevenZip};
+    ///
+    /// let sz = SevenZip::with_options(&InitOptions {
+    ///     sched_policy: SchedPolicy::Idle,
+    ///     io_priority: IoPriority::Idle,
+    ///     cpu_affinity: Some("4-7".into()),
+    ///     ..InitOptions::default()
+    /// })?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn with_options(options: &InitOptions) -> Result<Self> {
+        let cpu_affinity_c = options.cpu_affinity.as_deref().map(CString::new).transpose()?;
+        let c_opts = ffi::SevenZipInitOptions {
+            max_threads: options.max_threads.min(i32::MAX as usize) as i32,
+            max_jobs: options.max_jobs.min(i32::MAX as usize) as i32,
+            cpu_affinity: cpu_affinity_c.as_ref().map_or(ptr::null(), |c| c.as_ptr()),
+            sched_policy: options.sched_policy.into(),
+            nice: options.nice as i32,
+            io_priority: options.io_priority.into(),
+            decoder_pool_bytes: options.decoder_pool_bytes,
+        };
+        unsafe {
+            let result = ffi::sevenzip_init_with_options(&c_opts);
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+        Ok(Self { _initialized: true })
+    }
+
+    /// Back large encoder and decoder buffers with huge pages
+    ///
+    /// Speeds up big dictionaries by cutting TLB misses. Blocks the OS
+    /// cannot map with huge pages silently use normal pages; an error is
+    /// returned only when the platform has no large-page support at all.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let _ = sz.set_large_pages(true);
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn set_large_pages(&self, enable: bool) -> Result<()> {
+        let result = unsafe { ffi::sevenzip_set_large_pages(enable as i32) };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Extract a 7z archive
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `output_dir` - Directory to extract to
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.extract("archive.7z", "output")?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract(&self, archive_path: impl AsRef<Path>, output_dir: impl AsRef<Path>) -> Result<()> {
+        self.extract_with_password(archive_path, output_dir, None, None)
+    }
+
+    /// Extract a 7z archive with password and progress callback
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `output_dir` - Directory to extract to
+    /// * `password` - Optional password for encrypted archives
+    /// * `progress` - Optional progress callback
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.extract_with_password(
+    ///     "archive.7z",
+    ///     "output",
+    ///     Some("password"),
+    ///     Some(Box::new(|completed, total| {
+    ///         println!("Progress: {}/{} bytes", completed, total);
+    ///     }))
+    /// )?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_with_password(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        progress: Option<ProgressCallback>,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+
+        let (callback, user_data) = if let Some(cb) = progress {
+            // Convert Box<dyn FnMut> into raw pointer that can cross FFI boundary
+            let boxed = Box::new(cb);
+            let raw = Box::into_raw(boxed);
+            (
+                Some(progress_callback_wrapper as unsafe extern "C" fn(u64, u64, *mut std::os::raw::c_void)),
+                raw as *mut std::os::raw::c_void,
+            )
+        } else {
+            (None, ptr::null_mut())
+        };
+
+        unsafe {
+            let result = ffi::sevenzip_extract(
+                archive_path_c.as_ptr(),
+                output_dir_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                callback,
+                user_data,
+            );
+
+            // Clean up the callback if it was allocated
+            if !user_data.is_null() {
+                let _boxed = Box::from_raw(user_data as *mut ProgressCallback);
+                // Drops automatically
+            }
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Extract a 7z archive, decoding independent folders on several threads
+    ///
+    /// Non-solid archives, and solid archives written with block limits,
+    /// hold one folder per block; each thread decodes whole folders through
+    /// its own file handle. `num_threads` of 0 picks the library default;
+    /// threads left over when there are fewer folders than threads decode
+    /// the blocks of multi-block LZMA2 folders. Files of up to 1MB are created
+    /// and written by a pool of writer threads so the decoders do not wait on
+    /// file creation. The progress callback counts finished entries and may run on any of
+    /// the worker threads, one call at a time.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.extract_parallel("archive.7z", "output", None, 4, None)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_parallel(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        num_threads: usize,
+        progress: Option<ProgressCallback>,
+    ) -> Result<()> {
+        self.extract_verified(archive_path, output_dir, password, num_threads, Verify::File, progress)
+    }
+
+    /// [`extract_parallel`](Self::extract_parallel) checking only the CRCs
+    /// `verify` asks for
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, Verify};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.test_archive("archive.7z", None)?;
+    /// sz.extract_verified("archive.7z", "output", None, 4, Verify::None, None)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_verified(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        num_threads: usize,
+        verify: Verify,
+        progress: Option<ProgressCallback>,
+    ) -> Result<()> {
+        let options = ExtractOptions { num_threads, verify, ..Default::default() };
+        self.extract_with_options(archive_path, output_dir, password, &options, progress)
+    }
+
+    /// [`extract_parallel`](Self::extract_parallel) with [`ExtractOptions`]
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{Existing, ExtractOptions, SevenZip};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// // Finish a restore that stopped part way
+    /// let options = ExtractOptions { existing: Existing::SkipSame, ..Default::default() };
+    /// sz.extract_with_options("archive.7z", "output", None, &options, None)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_with_options(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        options: &ExtractOptions,
+        progress: Option<ProgressCallback>,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+        let options = options.to_ffi();
+
+        let (callback, user_data) = if let Some(cb) = progress {
+            let boxed = Box::new(cb);
+            let raw = Box::into_raw(boxed);
+            (
+                Some(progress_callback_wrapper as unsafe extern "C" fn(u64, u64, *mut std::os::raw::c_void)),
+                raw as *mut std::os::raw::c_void,
+            )
+        } else {
+            (None, ptr::null_mut())
+        };
+
+        unsafe {
+            let result = ffi::sevenzip_extract_with_options(
+                archive_path_c.as_ptr(),
+                output_dir_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &options,
+                callback,
+                user_data,
+            );
+
+            // Clean up the callback if it was allocated
+            if !user_data.is_null() {
+                let _boxed = Box::from_raw(user_data as *mut ProgressCallback);
+            }
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Extract an archive created with [`StreamOptions::streamable`],
+    /// reading it front to back from `reader` (a pipe, a socket, a tape)
+    ///
+    /// The header copy at the front opens the archive, then each folder is
+    /// decoded as its bytes arrive; the archive is never held whole.
+    /// `reader` is read up to the archive's last byte.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, ExtractOptions};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.extract_from_stream(std::io::stdin().lock(), "output", &ExtractOptions::default())?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_from_stream<R: Read>(
+        &self,
+        reader: R,
+        output_dir: impl AsRef<Path>,
+        options: &ExtractOptions,
+    ) -> Result<()> {
+        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
+        let options = options.to_ffi();
+        let mut context = StreamReadContext { reader, error: None };
+        let result = unsafe {
+            ffi::sevenzip_extract_from_stream(
+                Some(stream_read_wrapper::<R>),
+                output_dir_c.as_ptr(),
+                &options,
+                None,
+                &mut context as *mut StreamReadContext<R> as *mut std::os::raw::c_void,
+            )
+        };
+
+        if let Some(err) = context.error {
+            return Err(err);
+        }
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Extract an archive created with [`StreamOptions::streamable`] while
+    /// its file, or its `.NNN` volumes, are still being downloaded
+    ///
+    /// Reads wait for bytes that have not arrived yet, so early folders are
+    /// decoded while later volumes are still on their way. A volume is
+    /// complete at the size the `.7zidx` index next to the archive gives
+    /// it, or else once the next volume exists.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, ExtractOptions};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let options = ExtractOptions { follow_timeout_ms: 60_000, ..Default::default() };
+    /// sz.extract_following("incoming/backup.7z", "output", &options)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_following(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        options: &ExtractOptions,
+    ) -> Result<()> {
+        let archive_c = path_to_cstring(archive_path.as_ref())?;
+        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
+        let options = options.to_ffi();
+        let result = unsafe {
+            ffi::sevenzip_extract_following(
+                archive_c.as_ptr(),
+                output_dir_c.as_ptr(),
+                &options,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Extract specific files from an archive
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `output_dir` - Directory to extract to
+    /// * `files` - List of files to extract
+    /// * `password` - Optional password
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.extract_files(
+    ///     "archive.7z",
+    ///     "output",
+    ///     &["file1.txt", "dir/file2.txt"],
+    ///     None
+    /// )?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_files(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        files: &[&str],
+        password: Option<&str>,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+
+        // Convert file list to C string array
+        let files_c: Vec<CString> = files
+            .iter()
+            .map(|&f| CString::new(f))
+            .collect::<std::result::Result<_, _>>()?;
+        let mut files_ptrs: Vec<*const i8> = files_c.iter().map(|s| s.as_ptr()).collect();
+        files_ptrs.push(ptr::null()); // NULL-terminate
+
+        unsafe {
+            let result = ffi::sevenzip_extract_files(
+                archive_path_c.as_ptr(),
+                output_dir_c.as_ptr(),
+                files_ptrs.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                None,
+                ptr::null_mut(),
+            );
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Extract a single file, decoding as little of its solid block as possible
+    ///
+    /// Decoding starts at the last LZMA2 dictionary reset at or before the
+    /// file and stops at its end, so files deep inside a large solid
+    /// archive written with several block threads come out quickly.
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `output_dir` - Directory to extract to
+    /// * `file_name` - Entry name, as `list` reports it
+    /// * `password` - Optional password
+    pub fn extract_file_fast(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        file_name: &str,
+        password: Option<&str>,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
+        let file_name_c = CString::new(file_name)?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+
+        unsafe {
+            let result = ffi::sevenzip_extract_file_fast(
+                archive_path_c.as_ptr(),
+                output_dir_c.as_ptr(),
+                file_name_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+            );
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Extract entries into writers instead of files
+    ///
+    /// `open` is called with the name and size of each file entry and
+    /// returns the writer that receives the entry's bytes as they are
+    /// decoded, or `None` to skip it. The writer is flushed and dropped once
+    /// the entry's CRC matched. Directories are not passed on.
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `files` - Entry names to extract (`None` for all of them)
+    /// * `password` - Optional password
+    /// * `open` - Writer for each entry
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let mut total = 0u64;
+    /// sz.extract_to_writers("archive.7z", None, None, |_name, size| {
+    ///     total += size;
+    ///     Ok(Some(std::io::sink()))
+    /// })?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn extract_to_writers<W, F>(
+        &self,
+        archive_path: impl AsRef<Path>,
+        files: Option<&[&str]>,
+        password: Option<&str>,
+        open: F,
+    ) -> Result<()>
+    where
+        W: Write,
+        F: FnMut(&str, u64) -> std::io::Result<Option<W>>,
+    {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+
+        let files_c: Vec<CString> = files
+            .unwrap_or(&[])
+            .iter()
+            .map(|&f| CString::new(f))
+            .collect::<std::result::Result<_, _>>()?;
+        let mut files_ptrs: Vec<*const i8> = files_c.iter().map(|s| s.as_ptr()).collect();
+        files_ptrs.push(ptr::null()); // NULL-terminate
+
+        let mut context = SinkContext { open, writer: None, error: None };
+        let sink = make_sink(&mut context);
+
+        let result = unsafe {
+            ffi::sevenzip_extract_to_sink(
+                archive_path_c.as_ptr(),
+                if files.is_some() { files_ptrs.as_ptr() } else { ptr::null() },
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &sink,
+            )
+        };
+
+        if let Some(err) = context.error {
+            return Err(err.into());
+        }
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Read one entry into memory
+    ///
+    /// Decodes only as much of the entry's solid block as
+    /// `extract_file_fast` does. The result can be read through
+    /// `std::io::Cursor`.
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `file_name` - Entry name, as `list` reports it
+    /// * `password` - Optional password
+    pub fn read_entry(
+        &self,
+        archive_path: impl AsRef<Path>,
+        file_name: &str,
+        password: Option<&str>,
+    ) -> Result<Vec<u8>> {
+        let data = RefCell::new(Vec::new());
+        self.extract_to_writers(archive_path, Some(&[file_name]), password, |_, size| {
+            data.borrow_mut().reserve(size as usize);
+            Ok(Some(BufferWriter(&data)))
+        })?;
+        Ok(data.into_inner())
+    }
+
+    /// Stream an archive out as a tar archive, in one pass
+    ///
+    /// Entries become ustar records (pax headers for long names and large
+    /// sizes) written to `writer` as folders are decoded, one at a time, so
+    /// memory stays that of one folder decoder. Directories come first,
+    /// then empty files, then the rest in archive order.
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `password` - Optional password
+    /// * `options` - `num_threads` goes to the LZMA2 decoder, and
+    ///   `max_memory` applies
+    /// * `writer` - Receiver of the tar stream
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{ExtractOptions, SevenZip};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let stdout = std::io::stdout();
+    /// sz.export_tar("archive.7z", None, &ExtractOptions::default(), &mut stdout.lock())?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn export_tar<W: Write>(
+        &self,
+        archive_path: impl AsRef<Path>,
+        password: Option<&str>,
+        options: &ExtractOptions,
+        writer: &mut W,
+    ) -> Result<()> {
+        struct TarContext<'a, W: Write> {
+            writer: &'a mut W,
+            error: Option<std::io::Error>,
+        }
+
+        unsafe extern "C" fn write_tar<W: Write>(
+            data: *const std::os::raw::c_void,
+            size: usize,
+            user_data: *mut std::os::raw::c_void,
+        ) -> std::os::raw::c_int {
+            let context = &mut *(user_data as *mut TarContext<W>);
+            let bytes = std::slice::from_raw_parts(data as *const u8, size);
+            match context.writer.write_all(bytes) {
+                Ok(()) => 0,
+                Err(e) => {
+                    context.error = Some(e);
+                    1
+                }
+            }
+        }
+
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+        let options = options.to_ffi();
+        let mut context = TarContext { writer, error: None };
+
+        let result = unsafe {
+            ffi::sevenzip_export_tar(
+                archive_path_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &options,
+                Some(write_tar::<W>),
+                &mut context as *mut TarContext<W> as *mut std::os::raw::c_void,
+            )
+        };
+
+        if let Some(err) = context.error {
+            return Err(err.into());
+        }
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        context.writer.flush()?;
+        Ok(())
+    }
+
+    /// List contents of an archive
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Path to the archive file
+    /// * `password` - Optional password for encrypted archives
+    ///
+    /// # Returns
+    ///
+    /// Vec of ArchiveEntry with information about each file
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let entries = sz.list("archive.7z", None)?;
+    /// for entry in entries {
+    ///     println!("{}: {} bytes ({}% compressed)",
+    ///         entry.name, entry.size, entry.compression_ratio());
+    /// }
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn list(&self, archive_path: impl AsRef<Path>, password: Option<&str>) -> Result<Vec<ArchiveEntry>> {
+        Ok(self.list_entries(archive_path, password)?.iter().map(|entry| entry.to_entry()).collect())
+    }
+
+    /// List the archive without copying it: entries borrow from the list
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let list = sz.list_entries("archive.7z", None)?;
+    /// let total: u64 = list.iter().filter(|e| e.name().ends_with(".log")).map(|e| e.size()).sum();
+    /// # let _ = total;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn list_entries(&self, archive_path: impl AsRef<Path>, password: Option<&str>) -> Result<EntryList> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+
+        let mut list_ptr: *mut ffi::SevenZipList = ptr::null_mut();
+
+        unsafe {
+            let result = ffi::sevenzip_list(
+                archive_path_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &mut list_ptr as *mut *mut ffi::SevenZipList,
+            );
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+
+            Ok(EntryList::from_raw(list_ptr))
+        }
+    }
+
+    /// List an archive from the `.7zidx` sidecar written with
+    /// [`StreamOptions::write_index`], without opening a volume
+    /// (`packed_size` is 0, as with [`SevenZip::list`])
+    pub fn list_index(&self, index_path: impl AsRef<Path>) -> Result<Vec<ArchiveEntry>> {
+        let index_path_c = path_to_cstring(index_path.as_ref())?;
+        let mut list_ptr: *mut ffi::SevenZipList = ptr::null_mut();
+        unsafe {
+            let result = ffi::sevenzip_list_index(index_path_c.as_ptr(), &mut list_ptr);
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+            let list = EntryList::from_raw(list_ptr);
+            Ok(list.iter().map(|entry| entry.to_entry()).collect())
+        }
+    }
+
+    /// Write a catalog of every entry of many archives, sorted by path, for
+    /// [`Catalog::lookup`]
+    ///
+    /// Archives with an intact `.7zidx` sidecar are read from it without
+    /// opening a volume; the others from their header.
+    pub fn build_catalog(
+        &self,
+        archive_paths: &[impl AsRef<Path>],
+        catalog_path: impl AsRef<Path>,
+    ) -> Result<()> {
+        let paths_c: Vec<CString> = archive_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let path_ptrs: Vec<*const i8> = paths_c.iter().map(|s| s.as_ptr()).collect();
+        let catalog_path_c = path_to_cstring(catalog_path.as_ref())?;
+        result_of(unsafe {
+            ffi::sevenzip_catalog_build(path_ptrs.as_ptr(), path_ptrs.len(), catalog_path_c.as_ptr())
+        })
+    }
+
+    /// Map a catalog written by [`build_catalog`](Self::build_catalog)
+    pub fn open_catalog(&self, catalog_path: impl AsRef<Path>) -> Result<Catalog> {
+        let catalog_path_c = path_to_cstring(catalog_path.as_ref())?;
+        let mut handle: *mut ffi::SevenZipCatalog = ptr::null_mut();
+        result_of(unsafe { ffi::sevenzip_catalog_open(catalog_path_c.as_ptr(), &mut handle) })?;
+        Ok(Catalog { handle })
+    }
+
+    /// Open an archive once for several list and extract calls
+    ///
+    /// The header is parsed here and kept, see [`Archive`].
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let mut archive = sz.open("archive.7z", None)?;
+    /// for (index, entry) in archive.list()?.iter().enumerate() {
+    ///     if !entry.is_directory {
+    ///         let data = archive.read_entry(index as u32)?;
+    ///         println!("{}: {} bytes", entry.name, data.len());
+    ///     }
+    /// }
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn open(&self, archive_path: impl AsRef<Path>, password: Option<&str>) -> Result<Archive> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+
+        let mut handle: *mut ffi::SevenZipArchive = ptr::null_mut();
+        let result = unsafe {
+            ffi::sevenzip_open(
+                archive_path_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &mut handle,
+            )
+        };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(Archive { handle, _range_reader: None })
+    }
+
+    /// Open an archive held elsewhere through positioned reads
+    ///
+    /// `read_at(offset, buf)` fills `buf` from `offset` of the archive, e.g.
+    /// with an HTTP range request; it may run on several threads at once.
+    /// Reads are gathered into requests of whole 1MB blocks, cached and
+    /// read further ahead while a folder decodes, so listing costs about
+    /// two requests. The returned [`Archive`] works as one from
+    /// [`open`](Self::open).
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    /// use std::os::unix::fs::FileExt;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let file = std::fs::File::open("archive.7z")?;
+    /// let size = file.metadata()?.len();
+    /// let archive = sz.open_range(size, move |offset, buf| file.read_exact_at(buf, offset), None)?;
+    /// println!("{} entries", archive.list()?.len());
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn open_range<F>(&self, size: u64, read_at: F, password: Option<&str>) -> Result<Archive>
+    where
+        F: Fn(u64, &mut [u8]) -> std::io::Result<()> + Send + Sync + 'static,
+    {
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+        let reader: Box<RangeReadFn> = Box::new(Box::new(read_at) as RangeReadFn);
+        let c_reader = ffi::SevenZipRangeReader {
+            read_at: Some(range_read_wrapper),
+            size,
+            user_data: &*reader as *const RangeReadFn as *mut std::os::raw::c_void,
+        };
+
+        let mut handle: *mut ffi::SevenZipArchive = ptr::null_mut();
+        let result = unsafe {
+            ffi::sevenzip_open_range(
+                &c_reader,
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &mut handle,
+            )
+        };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(Archive { handle, _range_reader: Some(reader) })
+    }
+
+    /// Create a standard 7z archive
+    ///
+    /// Files are read lazily and streamed through the LZMA2 encoder, so memory
+    /// use is bounded by the encoder state regardless of input size. Use
+    /// [`create_archive_streaming`](Self::create_archive_streaming) for split archives.
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Output archive path
+    /// * `input_paths` - Files/directories to compress
+    /// * `level` - Compression level
+    /// * `options` - Optional compression options
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel, CompressOptions};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let mut opts = CompressOptions::default();
+    /// opts.num_threads = 4;
+    /// opts.password = Some("secret".to_string());
+    ///
+    /// sz.create_archive(
+    ///     "archive.7z",
+    ///     &["file1.txt", "file2.txt", "directory"],
+    ///     CompressionLevel::Normal,
+    ///     Some(&opts)
+    /// )?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn create_archive(
+        &self,
+        archive_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+        options: Option<&CompressOptions>,
+    ) -> Result<()> {
+        // The inputs are walked once, here, and handed over as a table the
+        // library archives without a stat of its own; num_threads == 0 is
+        // still resolved by the library
+        let opts = options.cloned().unwrap_or_default();
+        let single = if input_paths.len() == 1 { Some(input_paths[0].as_ref()) } else { None };
+        let effective_level = incompressible_level(&opts, single, level);
+        let table = InputTable::scan(input_paths).map_err(|e| Error::OpenFile(e.to_string()))?;
+        self.create_archive_from_table(archive_path, &table, effective_level, Some(&opts))
+    }
+
+    /// Create a standard 7z archive from inputs scanned by [`InputTable::scan`]
+    ///
+    /// The entries are archived in the table's order with its names, sizes,
+    /// times and attributes; nothing is stat'ed or walked again, so a caller
+    /// that scanned to size the job (see [`CompressOptions::auto_tuned_for`])
+    /// pays for one scan. `size` bytes of each file are archived; a file that
+    /// has shrunk since the scan fails the job.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel, CompressOptions, InputTable};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let table = InputTable::scan(&["photos", "notes.txt"])?;
+    /// let opts = CompressOptions::auto_tuned_for(&table);
+    /// sz.create_archive_from_table("backup.7z", &table, CompressionLevel::Normal, Some(&opts))?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn create_archive_from_table(
+        &self,
+        archive_path: impl AsRef<Path>,
+        table: &InputTable,
+        level: CompressionLevel,
+        options: Option<&CompressOptions>,
+    ) -> Result<()> {
+        let opts = options.cloned().unwrap_or_default();
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+
+        // C strings first, then the entries pointing into them
+        let strings: Vec<(Option<CString>, CString)> = table.entries
+            .iter()
+            .map(|e| -> Result<(Option<CString>, CString)> {
+                Ok((e.path.as_deref().map(path_to_cstring).transpose()?, CString::new(e.name.as_str())?))
+            })
+            .collect::<Result<_>>()?;
+        let entries: Vec<ffi::SevenZipInputEntry> = table.entries
+            .iter()
+            .zip(&strings)
+            .map(|(e, (path, name))| ffi::SevenZipInputEntry {
+                path: path.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                name: name.as_ptr(),
+                size: e.size,
+                mtime: e.modified_time,
+                attrib: e.attributes,
+                is_dir: e.is_directory as i32,
+            })
+            .collect();
+
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let lzma_c = opts.lzma_params.map(ffi::SevenZipLzmaParams::from);
+        let c_opts = opts.to_ffi(&password_c, &delta_ext_c, &lzma_c);
+
+        let result = unsafe {
+            ffi::sevenzip_create_7z_from_table(
+                archive_path_c.as_ptr(),
+                entries.as_ptr(),
+                entries.len(),
+                level.into(),
+                &c_opts,
+                None,
+                ptr::null_mut(),
+            )
+        };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Create many small archives in one call
+    ///
+    /// Each entry is an archive path and its inputs. Archives are spread
+    /// over `options.num_threads` workers (0 = hardware threads), each
+    /// reusing one single-threaded encoder from archive to archive. The
+    /// result holds one outcome per entry, in order.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let results = sz.create_archives_batch(
+    ///     &[("a.7z", vec!["a.txt"]), ("b.7z", vec!["b.txt"])],
+    ///     CompressionLevel::Normal,
+    ///     None,
+    /// )?;
+    /// assert!(results.iter().all(|r| r.is_ok()));
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn create_archives_batch(
+        &self,
+        entries: &[(impl AsRef<Path>, Vec<impl AsRef<Path>>)],
+        level: CompressionLevel,
+        options: Option<&CompressOptions>,
+    ) -> Result<Vec<Result<()>>> {
+        let opts = options.cloned().unwrap_or_default();
+        let mut archive_paths_c = Vec::with_capacity(entries.len());
+        let mut input_paths_c = Vec::with_capacity(entries.len());
+        for (archive_path, inputs) in entries {
+            archive_paths_c.push(path_to_cstring(archive_path.as_ref())?);
+            let paths: Vec<CString> = inputs
+                .iter()
+                .map(|p| path_to_cstring(p.as_ref()))
+                .collect::<Result<_>>()?;
+            input_paths_c.push(paths);
+        }
+        let input_ptrs: Vec<Vec<*const i8>> = input_paths_c
+            .iter()
+            .map(|paths| {
+                let mut ptrs: Vec<*const i8> = paths.iter().map(|s| s.as_ptr()).collect();
+                ptrs.push(ptr::null());
+                ptrs
+            })
+            .collect();
+        let c_entries: Vec<ffi::SevenZipBatchEntry> = archive_paths_c
+            .iter()
+            .zip(&input_ptrs)
+            .map(|(archive, inputs)| ffi::SevenZipBatchEntry {
+                archive_path: archive.as_ptr(),
+                input_paths: inputs.as_ptr(),
+            })
+            .collect();
+
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let lzma_c = opts.lzma_params.map(ffi::SevenZipLzmaParams::from);
+        let c_opts = opts.to_ffi(&password_c, &delta_ext_c, &lzma_c);
+
+        // The return value repeats the first failure in `results`
+        let mut results = vec![ffi::SevenZipErrorCode::SEVENZIP_OK; c_entries.len()];
+        unsafe {
+            ffi::sevenzip_create_7z_batch(
+                c_entries.as_ptr(),
+                c_entries.len(),
+                level.into(),
+                &c_opts,
+                results.as_mut_ptr(),
+            );
+        }
+        Ok(results.into_iter().map(result_of).collect())
+    }
+
+    /// Add new and changed files to an existing 7z archive
+    ///
+    /// Entries whose input is unchanged (same name, type, size and
+    /// modification time) are kept, and folders that lose no file are copied
+    /// without recompression. The archive is created if it does not exist.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.update_archive("backup.7z", &["documents"], CompressionLevel::Normal, None)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn update_archive(
+        &self,
+        archive_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+        options: Option<&CompressOptions>,
+    ) -> Result<()> {
+        let opts = options.cloned().unwrap_or_default();
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+
+        let input_paths_c: Vec<CString> = input_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
+        input_ptrs.push(ptr::null());
+
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let lzma_c = opts.lzma_params.map(ffi::SevenZipLzmaParams::from);
+        let c_opts = opts.to_ffi(&password_c, &delta_ext_c, &lzma_c);
+
+        let result = unsafe {
+            ffi::sevenzip_update_archive(
+                archive_path_c.as_ptr(),
+                input_ptrs.as_ptr(),
+                level.into(),
+                &c_opts,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Remove entries from a 7z archive without rebuilding it
+    ///
+    /// Folders without a named entry are copied as they are; the other
+    /// files of a folder that loses one are compressed again with `level`
+    /// and `options`. A name also removes everything below it. Returns the
+    /// number of entries removed.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let removed = sz.delete_entries("records.7z", &["customers/1042"], CompressionLevel::Normal, None)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn delete_entries(
+        &self,
+        archive_path: impl AsRef<Path>,
+        entry_names: &[&str],
+        level: CompressionLevel,
+        options: Option<&CompressOptions>,
+    ) -> Result<usize> {
+        let opts = options.cloned().unwrap_or_default();
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let names_c: Vec<CString> = entry_names
+            .iter()
+            .map(|n| CString::new(*n))
+            .collect::<std::result::Result<_, _>>()?;
+        let mut name_ptrs: Vec<*const i8> = names_c.iter().map(|s| s.as_ptr()).collect();
+        name_ptrs.push(ptr::null());
+
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let lzma_c = opts.lzma_params.map(ffi::SevenZipLzmaParams::from);
+        let c_opts = opts.to_ffi(&password_c, &delta_ext_c, &lzma_c);
+
+        let mut deleted: usize = 0;
+        let result = unsafe {
+            ffi::sevenzip_delete_entries(
+                archive_path_c.as_ptr(),
+                name_ptrs.as_ptr(),
+                level.into(),
+                &c_opts,
+                &mut deleted,
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(deleted)
+    }
+
+    /// Compress one subset of a dataset into a part for [`assemble_archive`](Self::assemble_archive)
+    ///
+    /// A part is an ordinary 7z archive, so parts can be made on different
+    /// machines and checked where they were made. `name_prefix` puts the
+    /// part's entries under a directory of that name.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.compress_folder_part("shard0.7z", &["data/shard0"], Some("shard0"),
+    ///                         CompressionLevel::Normal, None)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn compress_folder_part(
+        &self,
+        part_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        name_prefix: Option<&str>,
+        level: CompressionLevel,
+        options: Option<&CompressOptions>,
+    ) -> Result<()> {
+        let opts = options.cloned().unwrap_or_default();
+        let part_path_c = path_to_cstring(part_path.as_ref())?;
+
+        let input_paths_c: Vec<CString> = input_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
+        input_ptrs.push(ptr::null());
+
+        let prefix_c = name_prefix.map(CString::new).transpose()?;
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let lzma_c = opts.lzma_params.map(ffi::SevenZipLzmaParams::from);
+        let c_opts = opts.to_ffi(&password_c, &delta_ext_c, &lzma_c);
+
+        let result = unsafe {
+            ffi::sevenzip_compress_folder_part(
+                part_path_c.as_ptr(),
+                input_ptrs.as_ptr(),
+                prefix_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                level.into(),
+                &c_opts,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Concatenate parts into one 7z archive without recompressing them
+    ///
+    /// The parts' packed streams are copied byte-for-byte in order and one
+    /// combined header is written. With `split_size` > 0 the archive is
+    /// written as `archive_path.001`, `.002`, ...
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.assemble_archive("dataset.7z", &["shard0.7z", "shard1.7z"], 0)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn assemble_archive(
+        &self,
+        archive_path: impl AsRef<Path>,
+        part_paths: &[impl AsRef<Path>],
+        split_size: u64,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let part_paths_c: Vec<CString> = part_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let mut part_ptrs: Vec<*const i8> = part_paths_c.iter().map(|s| s.as_ptr()).collect();
+        part_ptrs.push(ptr::null());
+
+        let result = unsafe {
+            ffi::sevenzip_assemble_archive(
+                archive_path_c.as_ptr(),
+                part_ptrs.as_ptr(),
+                split_size,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Merge 7z archives into one without recompressing
+    ///
+    /// Every input's folders are copied as they are and one header is
+    /// written, so merging costs I/O, not CPU. Directories of one name
+    /// become one entry; files of one name are handled per `options`.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.merge_archives("day.7z", &["00.7z", "01.7z", "02.7z"], None)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn merge_archives(
+        &self,
+        archive_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        options: Option<&MergeOptions>,
+    ) -> Result<()> {
+        let opts = options.cloned().unwrap_or_default();
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let input_paths_c: Vec<CString> = input_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
+        input_ptrs.push(ptr::null());
+
+        let c_opts = ffi::SevenZipMergeOptions {
+            names: opts.names.into(),
+            drop_identical: opts.drop_identical as i32,
+            split_size: opts.split_size,
+        };
+        let result = unsafe {
+            ffi::sevenzip_merge_archives(
+                archive_path_c.as_ptr(),
+                input_ptrs.as_ptr(),
+                &c_opts,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Cut a split archive into volumes of another size, or join it
+    ///
+    /// Bytes move volume to volume without decoding. `new_split_size` 0
+    /// joins the volumes into the one file `dst_base`.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.resplit_archive("backup.7z.001", "tape/backup.7z", 50 * 1024 * 1024 * 1024)?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn resplit_archive(
+        &self,
+        src_first_volume: impl AsRef<Path>,
+        dst_base: impl AsRef<Path>,
+        new_split_size: u64,
+    ) -> Result<()> {
+        let src_c = path_to_cstring(src_first_volume.as_ref())?;
+        let dst_c = path_to_cstring(dst_base.as_ref())?;
+        let result = unsafe {
+            ffi::sevenzip_resplit_archive(
+                src_c.as_ptr(),
+                dst_c.as_ptr(),
+                new_split_size,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Create encrypted archive with recommended settings
+    /// 
+    /// Encryption has virtually zero performance overhead (<1%)
+    /// and provides strong AES-256 security.
+    /// 
+    /// # Example
+    /// 
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    /// 
+    /// let sz = SevenZip::new()?;
+    /// sz.create_encrypted_archive(
+    ///     "secure.7z",
+    ///     &["sensitive.txt", "private.doc"],
+    ///     "MyStrongPassword123!",
+    ///     seven_zip::CompressionLevel::Normal,
+    /// )?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn create_encrypted_archive(
+        &self,
+        archive_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        password: &str,
+        level: CompressionLevel,
+    ) -> Result<()> {
+        // One scan sizes the job and is what gets archived
+        let table = InputTable::scan(input_paths).map_err(|e| Error::OpenFile(e.to_string()))?;
+        let opts = CompressOptions::auto_tuned_for(&table).with_password(password.to_string());
+        let single = if input_paths.len() == 1 { Some(input_paths[0].as_ref()) } else { None };
+        let effective_level = incompressible_level(&opts, single, level);
+        self.create_archive_from_table(archive_path, &table, effective_level, Some(&opts))
+    }
+
+    /// Create archive with smart defaults (auto-tuned threads, engine picked
+    /// by [`create_archive_auto`](Self::create_archive_auto))
+    /// 
+    /// # Example
+    /// 
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    /// 
+    /// let sz = SevenZip::new()?;
+    /// sz.create_smart_archive(
+    ///     "backup.7z",
+    ///     &["file1.txt", "file2.bin"],
+    ///     seven_zip::CompressionLevel::Normal,
+    /// )?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn create_smart_archive(
+        &self,
+        archive_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+    ) -> Result<()> {
+        let file_path_strs: Vec<String> = input_paths
+            .iter()
+            .map(|p| p.as_ref().to_string_lossy().to_string())
+            .collect();
+        let file_paths_refs: Vec<&str> = file_path_strs.iter().map(|s| s.as_str()).collect();
+        
+        let mut opts = StreamOptions::default();
+        if let Ok(tuned) = CompressOptions::auto_tuned(&file_paths_refs) {
+            opts.num_threads = tuned.num_threads;
+        }
+        self.create_archive_auto(archive_path, input_paths, level, Some(&opts), None)
+    }
+
+    /// Test archive integrity
+    ///
+    /// Validates CRCs and decompression without writing files.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::SevenZip;
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.test_archive("archive.7z", None)?;
+    /// println!("Archive is valid!");
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn test_archive(&self, archive_path: impl AsRef<Path>, password: Option<&str>) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+
+        unsafe {
+            let result = ffi::sevenzip_test_archive(
+                archive_path_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                None,
+                ptr::null_mut(),
+            );
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// [`test_archive`](Self::test_archive) with independent folders verified
+    /// on several threads
+    ///
+    /// Folders in different volumes are read at once. `num_threads` of 0
+    /// picks the library default. Testing stops at the first failed folder.
+    pub fn test_archive_parallel(
+        &self,
+        archive_path: impl AsRef<Path>,
+        password: Option<&str>,
+        num_threads: usize,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let password_c = password.map(|p| CString::new(p)).transpose()?;
+        let options = ffi::SevenZipExtractOptions {
+            num_threads: num_threads.min(i32::MAX as usize) as i32,
+            lzma2_threads: 0,
+            writer_threads: 4, // sevenzip_extract_options_init() default
+            sparse_output: 0,
+            progress_interval_ms: 0,
+            cancel: ptr::null_mut(),
+            thread_weight: 0,
+            volume_readahead: 0,
+            verify: ffi::SevenZipVerifyMode::SEVENZIP_VERIFY_FILE,
+            existing: ffi::SevenZipExistingPolicy::SEVENZIP_EXISTING_OVERWRITE,
+            max_memory: 0,
+            cache_neutral_output: 0,
+            consume_volumes: 0,
+            volume_consumed: None,
+            volume_consumed_user_data: ptr::null_mut(),
+            checkpoint_path: ptr::null(),
+            durability: ffi::SevenZipDurability::SEVENZIP_DURABILITY_NONE,
+            follow_timeout_ms: 0,
+            include_patterns: ptr::null(),
+            exclude_patterns: ptr::null(),
+        };
+
+        unsafe {
+            let result = ffi::sevenzip_test_archive_with_options(
+                archive_path_c.as_ptr(),
+                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &options,
+                None,
+                ptr::null_mut(),
+            );
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// List or test many archives on one pool of threads
+    ///
+    /// `on_result` gets each archive as it finishes, in completion order, one
+    /// call at a time; returning `false` stops the batch. `io_depth` bounds
+    /// the reads in flight across the batch (0 = one per archive processed
+    /// at once); `num_threads` of 0 uses every hardware thread. Returns the
+    /// error of the lowest-numbered failed archive, or [`Error::Cancelled`]
+    /// once stopped.
+    pub fn archive_batch<F>(
+        &self,
+        archive_paths: &[impl AsRef<Path>],
+        mode: BatchMode,
+        num_threads: usize,
+        io_depth: usize,
+        mut on_result: F,
+    ) -> Result<()>
+    where
+        F: FnMut(BatchResult) -> bool + Send,
+    {
+        let paths_c: Vec<CString> = archive_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let path_ptrs: Vec<*const i8> = paths_c.iter().map(|s| s.as_ptr()).collect();
+        let options = ffi::SevenZipArchiveBatchOptions {
+            mode: mode.into(),
+            num_threads: num_threads.min(i32::MAX as usize) as i32,
+            io_depth: io_depth.min(i32::MAX as usize) as i32,
+            thread_weight: 0,
+            cancel: ptr::null_mut(),
+        };
+
+        unsafe extern "C" fn batch_wrapper<F: FnMut(BatchResult) -> bool>(
+            result: *const ffi::SevenZipArchiveBatchResult,
+            user_data: *mut std::os::raw::c_void,
+        ) -> std::os::raw::c_int {
+            let on_result = &mut *(user_data as *mut F);
+            let r = &*result;
+            let entries = if r.list.is_null() {
+                Vec::new()
+            } else {
+                let list = &*r.list;
+                if list.entries.is_null() {
+                    Vec::new()
+                } else {
+                    std::slice::from_raw_parts(list.entries, list.count)
+                        .iter()
+                        .map(|entry| EntryRef { entry }.to_entry())
+                        .collect()
+                }
+            };
+            let batch_result = BatchResult {
+                index: r.index,
+                result: result_of(r.result),
+                entries,
+                num_folders: r.num_folders,
+                unpacked_size: r.unpacked_size,
+                packed_size: r.packed_size,
+                tested_bytes: r.tested_bytes,
+            };
+            // The library calls back one archive at a time
+            match std::panic::catch_unwind(std::panic::AssertUnwindSafe(|| on_result(batch_result))) {
+                Ok(true) => 0,
+                _ => 1,
+            }
+        }
+
+        let code = unsafe {
+            ffi::sevenzip_archive_batch(
+                path_ptrs.as_ptr(),
+                path_ptrs.len(),
+                &options,
+                Some(batch_wrapper::<F>),
+                &mut on_result as *mut F as *mut std::os::raw::c_void,
+            )
+        };
+        result_of(code)
+    }
+
+    /// Create a 7z archive with streaming compression (supports large files and split archives)
+    ///
+    /// This method is optimized for large files and supports creating split/multi-volume archives.
+    /// Files are processed in chunks to avoid loading entire files into RAM.
+    ///
+    /// # Arguments
+    ///
+    /// * `archive_path` - Base path for the archive (e.g., "archive.7z")
+    ///                    For split archives, creates archive.7z.001, archive.7z.002, etc.
+    /// * `input_paths` - Files/directories to compress
+    /// * `level` - Compression level
+    /// * `options` - Streaming options (split size, chunk size, etc.)
+    /// * `progress` - Optional byte-level progress callback
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel, StreamOptions};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let mut opts = StreamOptions::default();
+    /// opts.split_size = 4_294_967_296; // 4GB segments
+    /// opts.chunk_size = 67_108_864;     // 64MB chunks
+    /// opts.num_threads = 8;
+    ///
+    /// sz.create_archive_streaming(
+    ///     "large_archive.7z",
+    ///     &["/path/to/large/file.img"],
+    ///     CompressionLevel::Normal,
+    ///     Some(&opts),
+    ///     Some(Box::new(|processed, total, file_bytes, file_total, filename| {
+    ///         println!("Processing {}: {}/{} bytes", filename, file_bytes, file_total);
+    ///         println!("Total: {}/{} bytes", processed, total);
+    ///     }))
+    /// )?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn create_archive_streaming(
+        &self,
+        archive_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
+        self.run_stream_create(ffi::sevenzip_create_7z_streaming, archive_path.as_ref(),
+                               input_paths, level, options, progress)
+    }
+
+    /// Create an archive with the engine that suits the input
+    ///
+    /// A few small regular files (16MB and 256 files at most, within half
+    /// the available memory, cgroup limits included) are compressed in
+    /// memory, which starts fastest; directory trees, larger inputs and
+    /// options only the streaming engine has (password, `split_size`,
+    /// `checkpoint`, `volume_dirs`, manifests, snapshots) go to
+    /// [`create_archive_streaming`](Self::create_archive_streaming), held to
+    /// three quarters of the available memory when `max_memory` is 0.
+    pub fn create_archive_auto(
+        &self,
+        archive_path: impl AsRef<Path>,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
+        self.run_stream_create(ffi::sevenzip_create_7z_auto, archive_path.as_ref(),
+                               input_paths, level, options, progress)
+    }
+
+    /// Engine [`create_archive_auto`](Self::create_archive_auto) would run
+    pub fn choose_create_engine(
+        &self,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+    ) -> Result<CreateEngine> {
+        let input_paths_c: Vec<CString> = input_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
+        input_ptrs.push(ptr::null());
+
+        let defaults = StreamOptions::default();
+        let opts = options.unwrap_or(&defaults);
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let volume_dirs_c = opts.volume_dirs_c()?;
+        let volume_dir_ptrs = c_string_list(&volume_dirs_c);
+        let refs_c = opts.refs_c()?;
+        let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &volume_dir_ptrs, &refs_c);
+
+        let mut engine = ffi::SevenZipCreateEngine::SEVENZIP_ENGINE_STREAMING;
+        let result = unsafe {
+            ffi::sevenzip_choose_create_engine(input_ptrs.as_ptr(), level.into(), &c_opts, &mut engine)
+        };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(engine.into())
+    }
+
+    /// Call `create`, a C entry point taking the arguments of
+    /// `sevenzip_create_7z_streaming`, with the paths, options and progress
+    /// callback converted
+    fn run_stream_create(
+        &self,
+        create: unsafe extern "C" fn(
+            *const std::os::raw::c_char,
+            *const *const std::os::raw::c_char,
+            ffi::SevenZipCompressionLevel,
+            *const ffi::SevenZipStreamOptions,
+            ffi::SevenZipBytesProgressCallback,
+            *mut std::os::raw::c_void,
+        ) -> ffi::SevenZipErrorCode,
+        archive_path: &Path,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path)?;
+        
+        // Convert input paths to C strings
+        let input_paths_c: Vec<CString> = input_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
+        input_ptrs.push(ptr::null()); // NULL-terminate
+
+        // Convert options to C struct
+        let (opts_ptr, _password_c, _temp_dir_c, _delta_ext_c, _volume_dirs) = if let Some(opts) = options {
+            let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+            let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+            let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+            let volume_dirs_c = opts.volume_dirs_c()?;
+            let volume_dir_ptrs = c_string_list(&volume_dirs_c);
+            let refs_c = opts.refs_c()?;
+            let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &volume_dir_ptrs, &refs_c);
+            (Box::new(c_opts), password_c, temp_dir_c, delta_ext_c, (volume_dirs_c, volume_dir_ptrs, refs_c))
+        } else {
+            // Initialize with defaults
+            let mut c_opts = std::mem::MaybeUninit::<ffi::SevenZipStreamOptions>::uninit();
+            unsafe {
+                ffi::sevenzip_stream_options_init(c_opts.as_mut_ptr());
+                (Box::new(c_opts.assume_init()), None, None, None, (Vec::new(), Vec::new(), StreamOptionRefs::default()))
+            }
+        };
+
+        // Set up progress callback
+        let (callback, user_data) = if let Some(cb) = progress {
+            let boxed = Box::new(cb);
+            let raw = Box::into_raw(boxed);
+            (
+                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
+                raw as *mut std::os::raw::c_void,
+            )
+        } else {
+            (None, ptr::null_mut())
+        };
+
+        unsafe {
+            let result = create(
+                archive_path_c.as_ptr(),
+                input_ptrs.as_ptr(),
+                level.into(),
+                &*opts_ptr,
+                callback,
+                user_data,
+            );
+
+            // Clean up the callback if it was allocated
+            if !user_data.is_null() {
+                let _boxed = Box::from_raw(user_data as *mut BytesProgressCallback);
+                // Drops automatically
+            }
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Create an archive into writers instead of files
+    ///
+    /// `open` is called with the index of each volume (only 0 unless
+    /// `split_size` is set) and returns the writer of its bytes, e.g. one
+    /// part of a multipart upload. Every volume is flushed and dropped
+    /// before the next one opens, except volume 0: the start header near
+    /// its front is written last, by seeking back, so it is dropped at the
+    /// end. The writers are used from a library thread while the call runs.
+    ///
+    /// # Arguments
+    ///
+    /// * `input_paths` - Files or directories to compress
+    /// * `level` - Compression level
+    /// * `options` - Streaming options; `volume_dirs`, `unbuffered_output`
+    ///   and `checkpoint` do not apply
+    /// * `open` - Writer for each volume
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// sz.create_archive_to_writers(&["data"], CompressionLevel::Normal, None, |volume| {
+    ///     std::fs::File::create(format!("upload.7z.{:03}", volume + 1))
+    /// })?;
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn create_archive_to_writers<W, F>(
+        &self,
+        input_paths: &[impl AsRef<Path>],
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+        open: F,
+    ) -> Result<()>
+    where
+        W: Write + Seek + Send,
+        F: FnMut(u32) -> std::io::Result<W> + Send,
+    {
+        let input_paths_c: Vec<CString> = input_paths
+            .iter()
+            .map(|p| path_to_cstring(p.as_ref()))
+            .collect::<Result<_>>()?;
+        let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
+        input_ptrs.push(ptr::null()); // NULL-terminate
+
+        let defaults = StreamOptions::default();
+        let opts = options.unwrap_or(&defaults);
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let refs_c = opts.refs_c()?;
+        let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &[], &refs_c);
+
+        let mut context = VolumeSinkContext { open, first: None, current: None, error: None };
+        let sink = ffi::SevenZipArchiveSink {
+            begin_volume: Some(volume_begin_wrapper::<W, F>),
+            write: Some(volume_write_wrapper::<W, F>),
+            patch: Some(volume_patch_wrapper::<W, F>),
+            end_volume: Some(volume_end_wrapper::<W, F>),
+            user_data: &mut context as *mut VolumeSinkContext<W, F> as *mut std::os::raw::c_void,
+        };
+
+        let result = unsafe {
+            ffi::sevenzip_create_7z_to_sink(input_ptrs.as_ptr(), level.into(), &c_opts, &sink, None, ptr::null_mut())
+        };
+
+        if let Some(err) = context.error {
+            return Err(err.into());
         }
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
     }
-}
-
-/// Main 7z archive interface
-pub struct SevenZip {
-    _initialized: bool,
-}
 
-impl SevenZip {
-    /// Create a new SevenZip instance
+    /// Create an archive of entries that are not files
     ///
-    /// Initializes the underlying 7z library.
+    /// `entries` yields each entry as the encoder reaches it; its reader is
+    /// read to the entry's size, or to its end when the size is unknown,
+    /// and dropped before the next entry is taken. Nothing is staged on
+    /// disk. The iterator and readers are used from a library thread while
+    /// the call runs.
     ///
     /// # Example
     ///
     /// ```no_run
-    /// use seven_zip::SevenZip;
+    /// use seven_zip::{SevenZip, CompressionLevel, SourceEntry};
     ///
     /// let sz = SevenZip::new()?;
+    /// let entry = SourceEntry {
+    ///     name: "hello.txt".to_string(),
+    ///     size: None,
+    ///     modified_time: 0,
+    ///     is_directory: false,
+    ///     reader: Some(Box::new(std::io::Cursor::new(b"hello".to_vec()))),
+    /// };
+    /// sz.create_archive_from_entries("generated.7z", std::iter::once(Ok(entry)),
+    ///                                CompressionLevel::Normal, None)?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn new() -> Result<Self> {
-        unsafe {
-            let result = ffi::sevenzip_init();
-            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
-                return Err(Error::from_code(result));
-            }
+    pub fn create_archive_from_entries<I>(
+        &self,
+        archive_path: impl AsRef<Path>,
+        entries: I,
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+    ) -> Result<()>
+    where
+        I: Iterator<Item = std::io::Result<SourceEntry>> + Send,
+    {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let defaults = StreamOptions::default();
+        let opts = options.unwrap_or(&defaults);
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let refs_c = opts.refs_c()?;
+        let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &[], &refs_c);
+
+        let mut context = EntrySourceContext { entries, name: None, reader: None, error: None };
+        let source = ffi::SevenZipEntrySource {
+            next_entry: Some(source_next_wrapper::<I>),
+            user_data: &mut context as *mut EntrySourceContext<I> as *mut std::os::raw::c_void,
+        };
+
+        let result = unsafe {
+            ffi::sevenzip_create_7z_from_source(
+                archive_path_c.as_ptr(),
+                &source,
+                level.into(),
+                &c_opts,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if let Some(err) = context.error {
+            return Err(err);
         }
-        Ok(Self { _initialized: true })
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
     }
 
-    /// Extract a 7z archive
+    /// Recompress an archive at another level, method or layout
+    ///
+    /// The source's files are decoded on a thread of their own, folder by
+    /// folder, and fed to the encoder as the entries of the new archive, so
+    /// nothing is staged on disk. Names, times and attributes are kept.
     ///
     /// # Arguments
     ///
-    /// * `archive_path` - Path to the archive file
-    /// * `output_dir` - Directory to extract to
+    /// * `source_path` - Archive to read
+    /// * `archive_path` - Archive to write (not the source)
+    /// * `password` - Password of the source; `options.password` encrypts the new one
+    /// * `level` - Compression level of the new archive
+    /// * `options` - Streaming options of the new archive
     ///
     /// # Example
     ///
     /// ```no_run
-    /// use seven_zip::SevenZip;
+    /// use seven_zip::{SevenZip, CompressionLevel};
     ///
     /// let sz = SevenZip::new()?;
-    /// sz.extract("archive.7z", "output")?;
+    /// sz.transcode_archive("ingest.7z", "cold.7z", None, CompressionLevel::Ultra, None)?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn extract(&self, archive_path: impl AsRef<Path>, output_dir: impl AsRef<Path>) -> Result<()> {
-        self.extract_with_password(archive_path, output_dir, None, None)
+    pub fn transcode_archive(
+        &self,
+        source_path: impl AsRef<Path>,
+        archive_path: impl AsRef<Path>,
+        password: Option<&str>,
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+    ) -> Result<()> {
+        let source_path_c = path_to_cstring(source_path.as_ref())?;
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let source_password_c = password.map(|p| CString::new(p)).transpose()?;
+        let defaults = StreamOptions::default();
+        let opts = options.unwrap_or(&defaults);
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let refs_c = opts.refs_c()?;
+        let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &[], &refs_c);
+
+        let result = unsafe {
+            ffi::sevenzip_transcode_archive(
+                source_path_c.as_ptr(),
+                archive_path_c.as_ptr(),
+                source_password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                level.into(),
+                &c_opts,
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
     }
 
-    /// Extract a 7z archive with password and progress callback
+    /// Rewrap an LZMA2 folder of an archive as a .xz file without recompressing
+    ///
+    /// The folder's packed stream is copied into one xz block, so the file
+    /// decompresses to the folder's data (the one file of a single-file
+    /// archive). The check is computed by decoding the folder, except for
+    /// `XzCheck::None` and for `XzCheck::Crc32` when the archive stores it.
     ///
     /// # Arguments
     ///
-    /// * `archive_path` - Path to the archive file
-    /// * `output_dir` - Directory to extract to
-    /// * `password` - Optional password for encrypted archives
-    /// * `progress` - Optional progress callback
+    /// * `archive_path` - Archive to read
+    /// * `folder_index` - Folder to rewrap (0 for a single-file archive)
+    /// * `xz_path` - .xz file to write
+    /// * `check` - Block check to write
     ///
     /// # Example
     ///
     /// ```no_run
-    /// use seven_zip::SevenZip;
+    /// use seven_zip::{SevenZip, XzCheck};
     ///
     /// let sz = SevenZip::new()?;
-    /// sz.extract_with_password(
-    ///     "archive.7z",
-    ///     "output",
-    ///     Some("password"),
-    ///     Some(Box::new(|completed, total| {
-    ///         println!("Progress: {}/{} bytes", completed, total);
-    ///     }))
-    /// )?;
+    /// sz.remux_to_xz("dump.7z", 0, "dump.sql.xz", XzCheck::Crc64)?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn extract_with_password(
+    pub fn remux_to_xz(
         &self,
         archive_path: impl AsRef<Path>,
-        output_dir: impl AsRef<Path>,
-        password: Option<&str>,
-        progress: Option<ProgressCallback>,
+        folder_index: u32,
+        xz_path: impl AsRef<Path>,
+        check: XzCheck,
     ) -> Result<()> {
         let archive_path_c = path_to_cstring(archive_path.as_ref())?;
-        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
-        let password_c = password.map(|p| CString::new(p)).transpose()?;
+        let xz_path_c = path_to_cstring(xz_path.as_ref())?;
+
+        let result = unsafe {
+            ffi::sevenzip_remux_to_xz(
+                archive_path_c.as_ptr(),
+                folder_index,
+                xz_path_c.as_ptr(),
+                check.into(),
+                None,
+                ptr::null_mut(),
+            )
+        };
+
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Finish a split [`create_archive_streaming`](Self::create_archive_streaming)
+    /// job that was run with `checkpoint` and got interrupted
+    ///
+    /// The volumes are cut back to the last checkpoint and the job goes on
+    /// with the inputs after it, which must not have changed. Level, split
+    /// size and solid block settings come from the checkpoint; `options`
+    /// supplies the rest and must carry the job's password.
+    pub fn resume_multivolume(
+        &self,
+        archive_path: impl AsRef<Path>,
+        options: Option<&StreamOptions>,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let defaults = StreamOptions::default();
+        let opts = options.unwrap_or(&defaults);
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let volume_dirs_c = opts.volume_dirs_c()?;
+        let volume_dir_ptrs = c_string_list(&volume_dirs_c);
+        let refs_c = opts.refs_c()?;
+        let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &volume_dir_ptrs, &refs_c);
 
         let (callback, user_data) = if let Some(cb) = progress {
-            // Convert Box<dyn FnMut> into raw pointer that can cross FFI boundary
-            let boxed = Box::new(cb);
-            let raw = Box::into_raw(boxed);
+            let raw = Box::into_raw(Box::new(cb));
             (
-                Some(progress_callback_wrapper as unsafe extern "C" fn(u64, u64, *mut std::os::raw::c_void)),
+                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
                 raw as *mut std::os::raw::c_void,
             )
         } else {
             (None, ptr::null_mut())
         };
 
-        unsafe {
-            let result = ffi::sevenzip_extract(
-                archive_path_c.as_ptr(),
-                output_dir_c.as_ptr(),
-                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
-                callback,
-                user_data,
-            );
-
-            // Clean up the callback if it was allocated
+        let result = unsafe {
+            let result = ffi::sevenzip_resume_multivolume(archive_path_c.as_ptr(), &c_opts, callback, user_data);
             if !user_data.is_null() {
-                let _boxed = Box::from_raw(user_data as *mut ProgressCallback);
-                // Drops automatically
+                drop(Box::from_raw(user_data as *mut BytesProgressCallback));
             }
+            result
+        };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
 
-            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
-                return Err(Error::from_code(result));
-            }
+    /// Estimate the peak memory of `create_archive_streaming` with these options
+    ///
+    /// The same fitting to `max_memory` is applied as in the job itself, so a
+    /// scheduler can reserve the returned amount before starting it.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{SevenZip, CompressionLevel, StreamOptions};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let mut opts = StreamOptions::default();
+    /// opts.max_memory = 512 * 1024 * 1024;
+    /// let peak = sz.estimate_memory(CompressionLevel::Ultra, Some(&opts))?;
+    /// assert!(peak <= opts.max_memory);
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn estimate_memory(
+        &self,
+        level: CompressionLevel,
+        options: Option<&StreamOptions>,
+    ) -> Result<u64> {
+        let defaults = StreamOptions::default();
+        let opts = options.unwrap_or(&defaults);
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let volume_dirs_c = opts.volume_dirs_c()?;
+        let volume_dir_ptrs = c_string_list(&volume_dirs_c);
+        let refs_c = opts.refs_c()?;
+        let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &volume_dir_ptrs, &refs_c);
+
+        let mut peak: u64 = 0;
+        let result = unsafe { ffi::sevenzip_estimate_memory(level.into(), &c_opts, &mut peak) };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
         }
+        Ok(peak)
+    }
 
-        Ok(())
+    /// Estimate the peak decoder memory of [`extract_with_options`](Self::extract_with_options)
+    ///
+    /// Only the archive header is read; each folder's decoder is sized from
+    /// its coder props and the same fitting to `max_memory` is applied as in
+    /// the job itself.
+    ///
+    /// # Example
+    ///
+    /// ```no_run
+    /// use seven_zip::{ExtractOptions, SevenZip};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let peak = sz.estimate_extract_memory("archive.7z", &ExtractOptions::default())?;
+    /// println!("reserve {} bytes", peak);
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn estimate_extract_memory(
+        &self,
+        archive_path: impl AsRef<Path>,
+        options: &ExtractOptions,
+    ) -> Result<u64> {
+        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let c_opts = options.to_ffi();
+        let mut peak: u64 = 0;
+        let result = unsafe {
+            ffi::sevenzip_estimate_extract_memory(archive_path_c.as_ptr(), &c_opts, &mut peak)
+        };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(peak)
     }
 
-    /// Extract specific files from an archive
+    /// Extract a 7z archive with streaming decompression and byte-level progress
+    ///
+    /// Automatically handles split/multi-volume archives. For split archives, provide
+    /// the path to the first volume (e.g., "archive.7z.001").
     ///
     /// # Arguments
     ///
-    /// * `archive_path` - Path to the archive file
+    /// * `archive_path` - Path to archive (for splits, use base name like "archive.7z.001")
     /// * `output_dir` - Directory to extract to
-    /// * `files` - List of files to extract
-    /// * `password` - Optional password
+    /// * `password` - Optional password for encrypted archives
+    /// * `progress` - Optional byte-level progress callback
     ///
     /// # Example
     ///
@@ -400,43 +3978,57 @@ impl SevenZip {
     /// use seven_zip::SevenZip;
     ///
     /// let sz = SevenZip::new()?;
-    /// sz.extract_files(
-    ///     "archive.7z",
+    /// sz.extract_streaming(
+    ///     "archive.7z.001",  // First volume of split archive
     ///     "output",
-    ///     &["file1.txt", "dir/file2.txt"],
-    ///     None
+    ///     None,
+    ///     Some(Box::new(|processed, total, file_bytes, file_total, filename| {
+    ///         if total > 0 {
+    ///             let percent = (processed as f64 / total as f64) * 100.0;
+    ///             println!("Extracting {}: {:.1}%", filename, percent);
+    ///         }
+    ///     }))
     /// )?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn extract_files(
+    pub fn extract_streaming(
         &self,
         archive_path: impl AsRef<Path>,
         output_dir: impl AsRef<Path>,
-        files: &[&str],
         password: Option<&str>,
+        progress: Option<BytesProgressCallback>,
     ) -> Result<()> {
         let archive_path_c = path_to_cstring(archive_path.as_ref())?;
         let output_dir_c = path_to_cstring(output_dir.as_ref())?;
         let password_c = password.map(|p| CString::new(p)).transpose()?;
 
-        // Convert file list to C string array
-        let files_c: Vec<CString> = files
-            .iter()
-            .map(|&f| CString::new(f))
-            .collect::<std::result::Result<_, _>>()?;
-        let mut files_ptrs: Vec<*const i8> = files_c.iter().map(|s| s.as_ptr()).collect();
-        files_ptrs.push(ptr::null()); // NULL-terminate
+        // Set up progress callback
+        let (callback, user_data) = if let Some(cb) = progress {
+            let boxed = Box::new(cb);
+            let raw = Box::into_raw(boxed);
+            (
+                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
+                raw as *mut std::os::raw::c_void,
+            )
+        } else {
+            (None, ptr::null_mut())
+        };
 
         unsafe {
-            let result = ffi::sevenzip_extract_files(
+            let result = ffi::sevenzip_extract_streaming(
                 archive_path_c.as_ptr(),
                 output_dir_c.as_ptr(),
-                files_ptrs.as_ptr(),
                 password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
-                None,
-                ptr::null_mut(),
+                callback,
+                user_data,
             );
 
+            // Clean up the callback if it was allocated
+            if !user_data.is_null() {
+                let _boxed = Box::from_raw(user_data as *mut BytesProgressCallback);
+                // Drops automatically
+            }
+
             if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
                 return Err(Error::from_code(result));
             }
@@ -445,16 +4037,49 @@ impl SevenZip {
         Ok(())
     }
 
-    /// List contents of an archive
+    /// [`extract_streaming`](Self::extract_streaming) with independent folders
+    /// decoded on several threads, each with its own handles on the volumes
     ///
-    /// # Arguments
-    ///
-    /// * `archive_path` - Path to the archive file
-    /// * `password` - Optional password for encrypted archives
+    /// `num_threads` of 0 picks the library default. Byte progress sums the
+    /// reads of all threads and may run on any of them, one call at a time.
+    pub fn extract_streaming_parallel(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        num_threads: usize,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
+        self.extract_streaming_threads(archive_path, output_dir, password, num_threads, false, None, progress)
+    }
+
+    /// [`extract_streaming`](Self::extract_streaming) of a split archive that
+    /// deletes each `.NNN` volume once decoding has moved past it for good,
+    /// and the rest once all succeeded, so a restore needs room for its
+    /// output and the volumes not yet read
     ///
-    /// # Returns
+    /// Folders are decoded one at a time in archive order, `num_threads`
+    /// going to the LZMA2 decoders. Volumes consumed before an error are gone.
+    pub fn extract_streaming_consuming(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        num_threads: usize,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
+        self.extract_streaming_threads(archive_path, output_dir, password, num_threads, true, None, progress)
+    }
+
+    /// [`extract_streaming`](Self::extract_streaming) that can pick up where
+    /// a failed run stopped
     ///
-    /// Vec of ArchiveEntry with information about each file
+    /// The folders written, and the files written of those begun, are kept
+    /// in `checkpoint`, saved as output accumulates and when the run fails.
+    /// A later call with the same checkpoint skips them and resumes a folder
+    /// from the last decoder reset point before its first file left; the
+    /// checkpoint is removed once the archive is extracted. A checkpoint of
+    /// another archive fails with [`Error::InvalidParameter`].
     ///
     /// # Example
     ///
@@ -462,155 +4087,142 @@ impl SevenZip {
     /// use seven_zip::SevenZip;
     ///
     /// let sz = SevenZip::new()?;
-    /// let entries = sz.list("archive.7z", None)?;
-    /// for entry in entries {
-    ///     println!("{}: {} bytes ({}% compressed)",
-    ///         entry.name, entry.size, entry.compression_ratio());
-    /// }
+    /// // Run again after a failure; finished files are not written twice
+    /// sz.extract_streaming_resumable("backup.7z.001", "restore", None, 0, "restore.ckpt", None)?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn list(&self, archive_path: impl AsRef<Path>, password: Option<&str>) -> Result<Vec<ArchiveEntry>> {
+    pub fn extract_streaming_resumable(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        num_threads: usize,
+        checkpoint: impl AsRef<Path>,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
+        self.extract_streaming_threads(archive_path, output_dir, password, num_threads, false,
+                                       Some(checkpoint.as_ref()), progress)
+    }
+
+    fn extract_streaming_threads(
+        &self,
+        archive_path: impl AsRef<Path>,
+        output_dir: impl AsRef<Path>,
+        password: Option<&str>,
+        num_threads: usize,
+        consume_volumes: bool,
+        checkpoint: Option<&Path>,
+        progress: Option<BytesProgressCallback>,
+    ) -> Result<()> {
         let archive_path_c = path_to_cstring(archive_path.as_ref())?;
+        let output_dir_c = path_to_cstring(output_dir.as_ref())?;
         let password_c = password.map(|p| CString::new(p)).transpose()?;
+        let checkpoint_c = checkpoint.map(path_to_cstring).transpose()?;
+        let options = ffi::SevenZipExtractOptions {
+            num_threads: num_threads.min(i32::MAX as usize) as i32,
+            lzma2_threads: 0,
+            writer_threads: 4, // sevenzip_extract_options_init() default
+            sparse_output: 0,
+            progress_interval_ms: 0,
+            cancel: ptr::null_mut(),
+            thread_weight: 0,
+            volume_readahead: 0,
+            verify: ffi::SevenZipVerifyMode::SEVENZIP_VERIFY_FILE,
+            existing: ffi::SevenZipExistingPolicy::SEVENZIP_EXISTING_OVERWRITE,
+            max_memory: 0,
+            cache_neutral_output: 0,
+            consume_volumes: consume_volumes as i32,
+            volume_consumed: None,
+            volume_consumed_user_data: ptr::null_mut(),
+            checkpoint_path: checkpoint_c.as_ref().map_or(ptr::null(), |c| c.as_ptr()),
+            durability: ffi::SevenZipDurability::SEVENZIP_DURABILITY_NONE,
+            follow_timeout_ms: 0,
+            include_patterns: ptr::null(),
+            exclude_patterns: ptr::null(),
+        };
 
-        let mut list_ptr: *mut ffi::SevenZipList = ptr::null_mut();
+        let (callback, user_data) = if let Some(cb) = progress {
+            let boxed = Box::new(cb);
+            let raw = Box::into_raw(boxed);
+            (
+                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
+                raw as *mut std::os::raw::c_void,
+            )
+        } else {
+            (None, ptr::null_mut())
+        };
 
         unsafe {
-            let result = ffi::sevenzip_list(
+            let result = ffi::sevenzip_extract_streaming_with_options(
                 archive_path_c.as_ptr(),
+                output_dir_c.as_ptr(),
                 password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
-                &mut list_ptr as *mut *mut ffi::SevenZipList,
+                &options,
+                callback,
+                user_data,
             );
 
-            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
-                return Err(Error::from_code(result));
-            }
-
-            if list_ptr.is_null() {
-                return Ok(Vec::new());
+            // Clean up the callback if it was allocated
+            if !user_data.is_null() {
+                let _boxed = Box::from_raw(user_data as *mut BytesProgressCallback);
             }
 
-            let list = &*list_ptr;
-            let mut entries = Vec::with_capacity(list.count);
-
-            for i in 0..list.count {
-                let entry = &*list.entries.add(i);
-                let name = CStr::from_ptr(entry.name).to_string_lossy().into_owned();
-
-                entries.push(ArchiveEntry {
-                    name,
-                    size: entry.size,
-                    packed_size: entry.packed_size,
-                    modified_time: entry.modified_time,
-                    attributes: entry.attributes,
-                    is_directory: entry.is_directory != 0,
-                });
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
             }
-
-            ffi::sevenzip_free_list(list_ptr);
-            Ok(entries)
         }
+
+        Ok(())
     }
 
-    /// Create a standard 7z archive
+    /// Create a 7z archive with every file in one solid folder
     ///
-    /// **WARNING**: This function loads entire files into memory before compression.
-    /// For files larger than ~1GB, use [`create_archive_streaming`](Self::create_archive_streaming)
-    /// instead to avoid memory exhaustion.
+    /// Written like [`create_archive_streaming`](Self::create_archive_streaming)
+    /// without a split size; `solid`, the solid block limits and
+    /// `detect_compressed` do not apply. Files are read as the encoder needs
+    /// them, so memory use does not grow with the archive.
     ///
     /// # Arguments
     ///
     /// * `archive_path` - Output archive path
     /// * `input_paths` - Files/directories to compress
     /// * `level` - Compression level
-    /// * `options` - Optional compression options
-    ///
-    /// # Memory Warning
-    ///
-    /// This function is NOT suitable for large files (82GB evidence directories, etc.).
-    /// It will attempt to load entire files into RAM and may cause system instability.
-    /// Use `create_archive_streaming()` for large files.
+    /// * `options` - Streaming options (chunk size, threads, etc.)
+    /// * `progress` - Optional byte-level progress callback
     ///
     /// # Example
     ///
     /// ```no_run
-    /// use seven_zip::{SevenZip, CompressionLevel, CompressOptions};
+    /// use seven_zip::{SevenZip, CompressionLevel, StreamOptions};
     ///
     /// let sz = SevenZip::new()?;
-    /// let mut opts = CompressOptions::default();
-    /// opts.num_threads = 4;
-    /// opts.password = Some("secret".to_string());
+    /// let mut opts = StreamOptions::default();
+    /// opts.num_threads = 8;
+    /// opts.chunk_size = 64 * 1024 * 1024; // 64MB chunks
     ///
-    /// sz.create_archive(
-    ///     "archive.7z",
-    ///     &["file1.txt", "file2.txt", "directory"],
+    /// // Create 88GB archive without running out of memory
+    /// sz.create_archive_true_streaming(
+    ///     "forensic_evidence.7z",
+    ///     &["/path/to/88gb/evidence/folder"],
     ///     CompressionLevel::Normal,
-    ///     Some(&opts)
+    ///     Some(&opts),
+    ///     Some(Box::new(|processed, total, file_bytes, file_total, filename| {
+    ///         let percent = if total > 0 {
+    ///             (processed as f64 / total as f64) * 100.0
+    ///         } else { 0.0 };
+    ///         println!("[{:.1}%] {} ({}/{} bytes)", percent, filename, file_bytes, file_total);
+    ///     }))
     /// )?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn create_archive(
+    pub fn create_archive_true_streaming(
         &self,
         archive_path: impl AsRef<Path>,
         input_paths: &[impl AsRef<Path>],
         level: CompressionLevel,
-        options: Option<&CompressOptions>,
+        options: Option<&StreamOptions>,
+        progress: Option<BytesProgressCallback>,
     ) -> Result<()> {
-        // Smart defaults: auto-tune if no options provided
-        let mut opts = options.cloned().unwrap_or_default();
-        
-        // Check total size and warn if it's large
-        let mut total_size: u64 = 0;
-        for path in input_paths {
-            if let Ok(metadata) = std::fs::metadata(path.as_ref()) {
-                if metadata.is_dir() {
-                    // Estimate directory size (walk would be expensive, just warn)
-                    eprintln!("WARNING: create_archive() loads files into memory.");
-                    eprintln!("For large directories, use create_archive_streaming() instead.");
-                } else {
-                    total_size += metadata.len();
-                }
-            }
-        }
-        
-        // Warn if total size exceeds 1GB
-        const MAX_SAFE_SIZE: u64 = 1024 * 1024 * 1024; // 1GB
-        if total_size > MAX_SAFE_SIZE {
-            eprintln!("WARNING: Total input size is {:.2} GB", total_size as f64 / 1e9);
-            eprintln!("This may exhaust system memory. Consider using create_archive_streaming().");
-        }
-        
-        // Auto-tune threads if not explicitly set (num_threads == 0)
-        if opts.num_threads == 0 && total_size > 0 {
-            opts.num_threads = calculate_optimal_threads(total_size);
-        }
-        
-        // Auto-detect incompressible data if enabled and single file
-        let effective_level = if opts.auto_detect_incompressible && input_paths.len() == 1 {
-            let path = input_paths[0].as_ref();
-            if let Ok(metadata) = std::fs::metadata(path) {
-                if metadata.is_file() {
-                    match analyze_file_compressibility(path) {
-                        Ok((entropy, recommended)) if entropy > 0.95 => {
-                            eprintln!("Info: Data appears incompressible (entropy: {:.2}), using Store mode", entropy);
-                            CompressionLevel::Store
-                        },
-                        Ok((entropy, _)) if entropy > 0.85 => {
-                            eprintln!("Info: Low compression potential detected (entropy: {:.2})", entropy);
-                            level
-                        }
-                        _ => level,
-                    }
-                } else {
-                    level
-                }
-            } else {
-                level
-            }
-        } else {
-            level
-        };
-        
         let archive_path_c = path_to_cstring(archive_path.as_ref())?;
         
         // Convert input paths to C strings
@@ -622,25 +4234,52 @@ impl SevenZip {
         input_ptrs.push(ptr::null()); // NULL-terminate
 
         // Convert options to C struct
-        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
-        let c_opts = ffi::SevenZipCompressOptions {
-            num_threads: opts.num_threads as i32,
-            dict_size: opts.dict_size,
-            solid: if opts.solid { 1 } else { 0 },
-            password: password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+        let (opts_ptr, _password_c, _temp_dir_c, _delta_ext_c, _volume_dirs) = if let Some(opts) = options {
+            let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+            let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+            let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+            let volume_dirs_c = opts.volume_dirs_c()?;
+            let volume_dir_ptrs = c_string_list(&volume_dirs_c);
+            let refs_c = opts.refs_c()?;
+            let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &volume_dir_ptrs, &refs_c);
+            (Box::new(c_opts), password_c, temp_dir_c, delta_ext_c, (volume_dirs_c, volume_dir_ptrs, refs_c))
+        } else {
+            // Initialize with defaults
+            let mut c_opts = std::mem::MaybeUninit::<ffi::SevenZipStreamOptions>::uninit();
+            unsafe {
+                ffi::sevenzip_stream_options_init(c_opts.as_mut_ptr());
+                (Box::new(c_opts.assume_init()), None, None, None, (Vec::new(), Vec::new(), StreamOptionRefs::default()))
+            }
+        };
+
+        // Set up progress callback
+        let (callback, user_data) = if let Some(cb) = progress {
+            let boxed = Box::new(cb);
+            let raw = Box::into_raw(boxed);
+            (
+                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
+                raw as *mut std::os::raw::c_void,
+            )
+        } else {
+            (None, ptr::null_mut())
         };
-        let opts_ptr = Box::new(c_opts);
 
         unsafe {
-            let result = ffi::sevenzip_create_7z(
+            let result = ffi::sevenzip_create_7z_true_streaming(
                 archive_path_c.as_ptr(),
                 input_ptrs.as_ptr(),
-                effective_level.into(),
-                Box::as_ref(&opts_ptr) as *const ffi::SevenZipCompressOptions,
-                None,
-                ptr::null_mut(),
+                level.into(),
+                &*opts_ptr,
+                callback,
+                user_data,
             );
 
+            // Clean up the callback if it was allocated
+            if !user_data.is_null() {
+                let _boxed = Box::from_raw(user_data as *mut BytesProgressCallback);
+                // Drops automatically
+            }
+
             if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
                 return Err(Error::from_code(result));
             }
@@ -649,79 +4288,44 @@ impl SevenZip {
         Ok(())
     }
 
-    /// Create encrypted archive with recommended settings
-    /// 
-    /// Encryption has virtually zero performance overhead (<1%)
-    /// and provides strong AES-256 security.
-    /// 
+    /// Compress a single file to LZMA2 format
+    ///
     /// # Example
-    /// 
+    ///
     /// ```no_run
-    /// use seven_zip::SevenZip;
-    /// 
+    /// use seven_zip::{SevenZip, CompressionLevel};
+    ///
     /// let sz = SevenZip::new()?;
-    /// sz.create_encrypted_archive(
-    ///     "secure.7z",
-    ///     &["sensitive.txt", "private.doc"],
-    ///     "MyStrongPassword123!",
-    ///     seven_zip::CompressionLevel::Normal,
-    /// )?;
+    /// sz.compress_file("input.txt", "output.lzma2", CompressionLevel::Normal)?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn create_encrypted_archive(
+    pub fn compress_file(
         &self,
-        archive_path: impl AsRef<Path>,
-        input_paths: &[impl AsRef<Path>],
-        password: &str,
+        input_path: impl AsRef<Path>,
+        output_path: impl AsRef<Path>,
         level: CompressionLevel,
     ) -> Result<()> {
-        let file_path_strs: Vec<String> = input_paths
-            .iter()
-            .map(|p| p.as_ref().to_string_lossy().to_string())
-            .collect();
-        let file_paths_refs: Vec<&str> = file_path_strs.iter().map(|s| s.as_str()).collect();
-        
-        let opts = CompressOptions::auto_tuned(&file_paths_refs)
-            .unwrap_or_default()
-            .with_password(password.to_string());
-        
-        self.create_archive(archive_path, input_paths, level, Some(&opts))
-    }
+        let input_path_c = path_to_cstring(input_path.as_ref())?;
+        let output_path_c = path_to_cstring(output_path.as_ref())?;
 
-    /// Create archive with smart defaults (auto-tuned threads, incompressible detection)
-    /// 
-    /// # Example
-    /// 
-    /// ```no_run
-    /// use seven_zip::SevenZip;
-    /// 
-    /// let sz = SevenZip::new()?;
-    /// sz.create_smart_archive(
-    ///     "backup.7z",
-    ///     &["file1.txt", "file2.bin"],
-    ///     seven_zip::CompressionLevel::Normal,
-    /// )?;
-    /// # Ok::<(), seven_zip::Error>(())
-    /// ```
-    pub fn create_smart_archive(
-        &self,
-        archive_path: impl AsRef<Path>,
-        input_paths: &[impl AsRef<Path>],
-        level: CompressionLevel,
-    ) -> Result<()> {
-        let file_path_strs: Vec<String> = input_paths
-            .iter()
-            .map(|p| p.as_ref().to_string_lossy().to_string())
-            .collect();
-        let file_paths_refs: Vec<&str> = file_path_strs.iter().map(|s| s.as_str()).collect();
-        
-        let opts = CompressOptions::auto_tuned(&file_paths_refs).unwrap_or_default();
-        self.create_archive(archive_path, input_paths, level, Some(&opts))
+        unsafe {
+            let result = ffi::sevenzip_compress_file(
+                input_path_c.as_ptr(),
+                output_path_c.as_ptr(),
+                level.into(),
+                None,
+                ptr::null_mut(),
+            );
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        Ok(())
     }
 
-    /// Test archive integrity
-    ///
-    /// Validates CRCs and decompression without writing files.
+    /// Decompress a single LZMA2 file
     ///
     /// # Example
     ///
@@ -729,18 +4333,21 @@ impl SevenZip {
     /// use seven_zip::SevenZip;
     ///
     /// let sz = SevenZip::new()?;
-    /// sz.test_archive("archive.7z", None)?;
-    /// println!("Archive is valid!");
+    /// sz.decompress_file("input.lzma2", "output.txt")?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn test_archive(&self, archive_path: impl AsRef<Path>, password: Option<&str>) -> Result<()> {
-        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
-        let password_c = password.map(|p| CString::new(p)).transpose()?;
+    pub fn decompress_file(
+        &self,
+        input_path: impl AsRef<Path>,
+        output_path: impl AsRef<Path>,
+    ) -> Result<()> {
+        let input_path_c = path_to_cstring(input_path.as_ref())?;
+        let output_path_c = path_to_cstring(output_path.as_ref())?;
 
         unsafe {
-            let result = ffi::sevenzip_test_archive(
-                archive_path_c.as_ptr(),
-                password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+            let result = ffi::sevenzip_decompress_file(
+                input_path_c.as_ptr(),
+                output_path_c.as_ptr(),
                 None,
                 ptr::null_mut(),
             );
@@ -752,133 +4359,64 @@ impl SevenZip {
 
         Ok(())
     }
-
-    /// Create a 7z archive with streaming compression (supports large files and split archives)
-    ///
-    /// This method is optimized for large files and supports creating split/multi-volume archives.
-    /// Files are processed in chunks to avoid loading entire files into RAM.
-    ///
-    /// # Arguments
+    /// Start `create_archive_streaming` on a library runner thread
     ///
-    /// * `archive_path` - Base path for the archive (e.g., "archive.7z")
-    ///                    For split archives, creates archive.7z.001, archive.7z.002, etc.
-    /// * `input_paths` - Files/directories to compress
-    /// * `level` - Compression level
-    /// * `options` - Streaming options (split size, chunk size, etc.)
-    /// * `progress` - Optional byte-level progress callback
+    /// Await the returned job, or [`wait`](ArchiveJob::wait) on it to block.
+    /// Dropping it cancels the archive.
     ///
     /// # Example
     ///
     /// ```no_run
-    /// use seven_zip::{SevenZip, CompressionLevel, StreamOptions};
-    ///
-    /// let sz = SevenZip::new()?;
-    /// let mut opts = StreamOptions::default();
-    /// opts.split_size = 4_294_967_296; // 4GB segments
-    /// opts.chunk_size = 67_108_864;     // 64MB chunks
-    /// opts.num_threads = 8;
-    ///
-    /// sz.create_archive_streaming(
-    ///     "large_archive.7z",
-    ///     &["/path/to/large/file.img"],
-    ///     CompressionLevel::Normal,
-    ///     Some(&opts),
-    ///     Some(Box::new(|processed, total, file_bytes, file_total, filename| {
-    ///         println!("Processing {}: {}/{} bytes", filename, file_bytes, file_total);
-    ///         println!("Total: {}/{} bytes", processed, total);
-    ///     }))
-    /// )?;
+    /// use seven_zip::{SevenZip, CompressionLevel};
+    ///
+    /// let sz = SevenZip::new()?;
+    /// let job = sz.create_archive_async("backup.7z", &["data"], CompressionLevel::Normal, None)?;
+    /// // ... other work ...
+    /// job.wait()?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn create_archive_streaming(
+    pub fn create_archive_async(
         &self,
         archive_path: impl AsRef<Path>,
         input_paths: &[impl AsRef<Path>],
         level: CompressionLevel,
         options: Option<&StreamOptions>,
-        progress: Option<BytesProgressCallback>,
-    ) -> Result<()> {
+    ) -> Result<ArchiveJob> {
         let archive_path_c = path_to_cstring(archive_path.as_ref())?;
-        
-        // Convert input paths to C strings
         let input_paths_c: Vec<CString> = input_paths
             .iter()
             .map(|p| path_to_cstring(p.as_ref()))
             .collect::<Result<_>>()?;
         let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
-        input_ptrs.push(ptr::null()); // NULL-terminate
-
-        // Convert options to C struct
-        let (opts_ptr, _password_c, _temp_dir_c) = if let Some(opts) = options {
-            let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
-            let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
-            let c_opts = ffi::SevenZipStreamOptions {
-                num_threads: opts.num_threads as i32,
-                dict_size: opts.dict_size,
-                solid: if opts.solid { 1 } else { 0 },
-                password: password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
-                split_size: opts.split_size,
-                chunk_size: opts.chunk_size,
-                temp_dir: temp_dir_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
-                delete_temp_on_error: if opts.delete_temp_on_error { 1 } else { 0 },
-            };
-            (Box::new(c_opts), password_c, temp_dir_c)
-        } else {
-            // Initialize with defaults
-            let mut c_opts = std::mem::MaybeUninit::<ffi::SevenZipStreamOptions>::uninit();
-            unsafe {
-                ffi::sevenzip_stream_options_init(c_opts.as_mut_ptr());
-                (Box::new(c_opts.assume_init()), None, None)
-            }
-        };
+        input_ptrs.push(ptr::null());
 
-        // Set up progress callback
-        let (callback, user_data) = if let Some(cb) = progress {
-            let boxed = Box::new(cb);
-            let raw = Box::into_raw(boxed);
-            (
-                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
-                raw as *mut std::os::raw::c_void,
-            )
-        } else {
-            (None, ptr::null_mut())
-        };
+        // The C side copies the options and strings, so they only need to
+        // live through the submit call
+        let defaults = StreamOptions::default();
+        let opts = options.unwrap_or(&defaults);
+        let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
+        let delta_ext_c = opts.delta_extensions.as_ref().map(|e| CString::new(e.as_str())).transpose()?;
+        let volume_dirs_c = opts.volume_dirs_c()?;
+        let volume_dir_ptrs = c_string_list(&volume_dirs_c);
+        let refs_c = opts.refs_c()?;
+        let c_opts = opts.to_ffi(&password_c, &temp_dir_c, &delta_ext_c, &volume_dir_ptrs, &refs_c);
 
-        unsafe {
-            let result = ffi::sevenzip_create_7z_streaming(
+        ArchiveJob::submit(opts.cancel.clone(), opts.rate_limit.clone(), |callback, user_data, job| unsafe {
+            ffi::sevenzip_submit_create(
                 archive_path_c.as_ptr(),
                 input_ptrs.as_ptr(),
                 level.into(),
-                &*opts_ptr,
+                &c_opts,
+                None,
                 callback,
                 user_data,
-            );
-
-            // Clean up the callback if it was allocated
-            if !user_data.is_null() {
-                let _boxed = Box::from_raw(user_data as *mut BytesProgressCallback);
-                // Drops automatically
-            }
-
-            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
-                return Err(Error::from_code(result));
-            }
-        }
-
-        Ok(())
+                job,
+            )
+        })
     }
 
-    /// Extract a 7z archive with streaming decompression and byte-level progress
-    ///
-    /// Automatically handles split/multi-volume archives. For split archives, provide
-    /// the path to the first volume (e.g., "archive.7z.001").
-    ///
-    /// # Arguments
-    ///
-    /// * `archive_path` - Path to archive (for splits, use base name like "archive.7z.001")
-    /// * `output_dir` - Directory to extract to
-    /// * `password` - Optional password for encrypted archives
-    /// * `progress` - Optional byte-level progress callback
+    /// Start `extract_parallel` on a library runner thread
     ///
     /// # Example
     ///
@@ -886,269 +4424,705 @@ impl SevenZip {
     /// use seven_zip::SevenZip;
     ///
     /// let sz = SevenZip::new()?;
-    /// sz.extract_streaming(
-    ///     "archive.7z.001",  // First volume of split archive
-    ///     "output",
-    ///     None,
-    ///     Some(Box::new(|processed, total, file_bytes, file_total, filename| {
-    ///         if total > 0 {
-    ///             let percent = (processed as f64 / total as f64) * 100.0;
-    ///             println!("Extracting {}: {:.1}%", filename, percent);
-    ///         }
-    ///     }))
-    /// )?;
+    /// let job = sz.extract_async("archive.7z", "output", None, 4)?;
+    /// job.wait()?;
     /// # Ok::<(), seven_zip::Error>(())
     /// ```
-    pub fn extract_streaming(
+    pub fn extract_async(
         &self,
         archive_path: impl AsRef<Path>,
         output_dir: impl AsRef<Path>,
         password: Option<&str>,
-        progress: Option<BytesProgressCallback>,
-    ) -> Result<()> {
+        num_threads: usize,
+    ) -> Result<ArchiveJob> {
         let archive_path_c = path_to_cstring(archive_path.as_ref())?;
         let output_dir_c = path_to_cstring(output_dir.as_ref())?;
         let password_c = password.map(|p| CString::new(p)).transpose()?;
-
-        // Set up progress callback
-        let (callback, user_data) = if let Some(cb) = progress {
-            let boxed = Box::new(cb);
-            let raw = Box::into_raw(boxed);
-            (
-                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
-                raw as *mut std::os::raw::c_void,
-            )
-        } else {
-            (None, ptr::null_mut())
+        let options = ffi::SevenZipExtractOptions {
+            num_threads: num_threads.min(i32::MAX as usize) as i32,
+            lzma2_threads: 0,
+            writer_threads: 4, // sevenzip_extract_options_init() default
+            sparse_output: 0,
+            progress_interval_ms: 0,
+            cancel: ptr::null_mut(),
+            thread_weight: 0,
+            volume_readahead: 0,
+            verify: ffi::SevenZipVerifyMode::SEVENZIP_VERIFY_FILE,
+            existing: ffi::SevenZipExistingPolicy::SEVENZIP_EXISTING_OVERWRITE,
+            max_memory: 0,
+            cache_neutral_output: 0,
+            consume_volumes: 0,
+            volume_consumed: None,
+            volume_consumed_user_data: ptr::null_mut(),
+            checkpoint_path: ptr::null(),
+            durability: ffi::SevenZipDurability::SEVENZIP_DURABILITY_NONE,
+            follow_timeout_ms: 0,
+            include_patterns: ptr::null(),
+            exclude_patterns: ptr::null(),
         };
 
-        unsafe {
-            let result = ffi::sevenzip_extract_streaming(
+        ArchiveJob::submit(None, None, |callback, user_data, job| unsafe {
+            ffi::sevenzip_submit_extract(
                 archive_path_c.as_ptr(),
                 output_dir_c.as_ptr(),
                 password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
+                &options,
+                None,
                 callback,
                 user_data,
-            );
+                job,
+            )
+        })
+    }
+}
 
-            // Clean up the callback if it was allocated
-            if !user_data.is_null() {
-                let _boxed = Box::from_raw(user_data as *mut BytesProgressCallback);
-                // Drops automatically
-            }
+impl Drop for SevenZip {
+    fn drop(&mut self) {
+        unsafe {
+            ffi::sevenzip_cleanup();
+        }
+    }
+}
+
+/// An archive opened with [`SevenZip::open`]
+///
+/// Keeps the volumes open and the parsed header, so listing and reading
+/// entries does not reopen the file. The solid blocks read last (64 MB
+/// unpacked in all, see [`set_cache_budget`](Self::set_cache_budget)) stay
+/// decoded, which makes reading entries of a few blocks in turn cheap.
+/// Entries are addressed by their index in [`list`](Self::list), or by
+/// path through [`stat`](Self::stat) and [`read_dir`](Self::read_dir).
+///
+/// An `Archive` can be shared between threads (for example in an `Arc`):
+/// every read uses positioned reads and decoder state of its own, and the
+/// decoded blocks are shared under a lock, so reads of different entries
+/// run in parallel.
+///
+/// # Example
+///
+/// ```no_run
+/// use seven_zip::SevenZip;
+/// use std::sync::Arc;
+///
+/// let sz = SevenZip::new()?;
+/// let archive = Arc::new(sz.open("assets.7z", None)?);
+/// let workers: Vec<_> = (0..4u32).map(|i| {
+///     let archive = Arc::clone(&archive);
+///     std::thread::spawn(move || archive.read_entry(i).map(|data| data.len()))
+/// }).collect();
+/// for worker in workers {
+///     println!("{} bytes", worker.join().unwrap()?);
+/// }
+/// # Ok::<(), seven_zip::Error>(())
+/// ```
+pub struct Archive {
+    handle: *mut ffi::SevenZipArchive,
+    _range_reader: Option<Box<RangeReadFn>>, // Of open_range(), freed after the close
+}
+
+/// The read_at of [`SevenZip::open_range`]
+type RangeReadFn = Box<dyn Fn(u64, &mut [u8]) -> std::io::Result<()> + Send + Sync>;
+
+unsafe extern "C" fn range_read_wrapper(
+    user_data: *mut std::os::raw::c_void,
+    offset: u64,
+    buf: *mut std::os::raw::c_void,
+    size: usize,
+) -> std::os::raw::c_int {
+    // SAFETY: user_data is the RangeReadFn the Archive owns; buf holds size bytes
+    let read_at = unsafe { &*(user_data as *const RangeReadFn) };
+    let out = unsafe { std::slice::from_raw_parts_mut(buf as *mut u8, size) };
+    match read_at(offset, out) {
+        Ok(()) => 0,
+        Err(_) => 1,
+    }
+}
+
+// The C handle serves calls from several threads at once; only the close
+// in Drop needs them finished, which the borrow checker guarantees
+unsafe impl Send for Archive {}
+unsafe impl Sync for Archive {}
 
+impl Archive {
+    /// Entries of the archive, in index order
+    pub fn list(&self) -> Result<Vec<ArchiveEntry>> {
+        Ok(self.entries()?.iter().map(|entry| entry.to_entry()).collect())
+    }
+
+    /// Entries of the archive, in index order, borrowing from one list
+    pub fn entries(&self) -> Result<EntryList> {
+        let mut list_ptr: *mut ffi::SevenZipList = ptr::null_mut();
+        unsafe {
+            let result = ffi::sevenzip_archive_list(self.handle, &mut list_ptr);
             if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
                 return Err(Error::from_code(result));
             }
+            Ok(EntryList::from_raw(list_ptr))
         }
+    }
 
-        Ok(())
+    /// Number of entries, directories included
+    pub fn entry_count(&self) -> u32 {
+        unsafe { ffi::sevenzip_archive_entry_count(self.handle) }
+    }
+
+    /// Entries `first..first + max_entries` (fewer at the end, none past it)
+    ///
+    /// Lists archives with millions of entries in bounded memory; entry
+    /// `first + i` of the archive is element `i` of the page.
+    pub fn list_page(&self, first: u32, max_entries: u32) -> Result<Vec<ArchiveEntry>> {
+        Ok(self.entries_page(first, max_entries)?.iter().map(|entry| entry.to_entry()).collect())
+    }
+
+    /// [`list_page`](Self::list_page), borrowing from one list
+    pub fn entries_page(&self, first: u32, max_entries: u32) -> Result<EntryList> {
+        let mut list_ptr: *mut ffi::SevenZipList = ptr::null_mut();
+        unsafe {
+            let result = ffi::sevenzip_archive_list_page(self.handle, first, max_entries, &mut list_ptr);
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+            Ok(EntryList::from_raw(list_ptr))
+        }
     }
 
-    /// Create a 7z archive using TRUE streaming compression (RECOMMENDED for large archives)
+    /// Entries `first..first + max_entries` as columns, only `fields` filled
     ///
-    /// ⚠️ **IMPORTANT**: This method processes files in 64MB chunks WITHOUT loading
-    /// all data into RAM first. Use this for archives larger than 8GB to avoid
-    /// out-of-memory crashes.
+    /// Fields not asked for are neither converted nor allocated, so a
+    /// size total over millions of entries skips the name conversion.
     ///
-    /// The standard `create_archive_streaming` method (when split_size == 0) still
-    /// loads all file data into memory before compression, which causes OOM for
-    /// large archives. This method fixes that limitation.
+    /// ```no_run
+    /// use seven_zip::{SevenZip, ListFields};
     ///
-    /// Memory usage: ~250MB peak regardless of archive size
+    /// let archive = SevenZip::new()?.open("backup.7z", None)?;
+    /// let columns = archive.list_columns(0, u32::MAX, ListFields::SIZE)?;
+    /// let total: u64 = columns.sizes().unwrap_or(&[]).iter().sum();
+    /// # Ok::<(), seven_zip::Error>(())
+    /// ```
+    pub fn list_columns(&self, first: u32, max_entries: u32, fields: ListFields) -> Result<ListColumns> {
+        let mut columns: *mut ffi::SevenZipListColumns = ptr::null_mut();
+        unsafe {
+            let result = ffi::sevenzip_archive_list_columns(self.handle, first, max_entries, fields.0,
+                                                            &mut columns);
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+        Ok(ListColumns { columns })
+    }
+
+    /// Write one file entry to `writer`, after which its CRC has been checked
     ///
-    /// # Arguments
+    /// Directories and indices past the end are rejected.
+    pub fn extract_entry<W: Write>(&self, index: u32, writer: &mut W) -> Result<()> {
+        let mut target = Some(writer);
+        let mut context = SinkContext {
+            open: |_: &str, _: u64| Ok(target.take()),
+            writer: None,
+            error: None,
+        };
+        let sink = make_sink(&mut context);
+        let result = unsafe { ffi::sevenzip_archive_extract_entry(self.handle, index, &sink) };
+
+        if let Some(err) = context.error {
+            return Err(err.into());
+        }
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Write file entries given in any order to writers, in the order of
+    /// their data
     ///
-    /// * `archive_path` - Output archive path
-    /// * `input_paths` - Files/directories to compress
-    /// * `level` - Compression level
-    /// * `options` - Streaming options (chunk size, threads, etc.)
-    /// * `progress` - Optional byte-level progress callback
+    /// Each solid block is decoded at most once, across the span of the
+    /// entries asked for in it, so a queue of requests gathered over time
+    /// costs one pass. `open` gets each entry's name and size, as in
+    /// [`SevenZip::extract_to_writers`]; an index given twice is written
+    /// once. Directories and indices past the end are rejected before any
+    /// entry is written.
+    pub fn extract_entries<W, F>(&self, indices: &[u32], open: F) -> Result<()>
+    where
+        W: Write,
+        F: FnMut(&str, u64) -> std::io::Result<Option<W>>,
+    {
+        let count = u32::try_from(indices.len())
+            .map_err(|_| Error::InvalidParameter("too many entries".to_string()))?;
+        let mut context = SinkContext { open, writer: None, error: None };
+        let sink = make_sink(&mut context);
+        let result = unsafe {
+            ffi::sevenzip_archive_extract_entries(self.handle, indices.as_ptr(), count, &sink)
+        };
+
+        if let Some(err) = context.error {
+            return Err(err.into());
+        }
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(())
+    }
+
+    /// Largest block decoded whole and kept for the next reads (default and
+    /// most 64 MB; 0 = decode only the entry asked for)
     ///
-    /// # Example
+    /// Turn it off when threads read unrelated entries of large solid
+    /// blocks and would only take turns replacing the kept ones.
+    pub fn set_folder_cache(&self, max_folder_size: u64) {
+        unsafe { ffi::sevenzip_archive_set_folder_cache(self.handle, max_folder_size) };
+    }
+
+    /// Total of the blocks kept decoded (default 64 MB; 0 = none)
     ///
-    /// ```no_run
-    /// use seven_zip::{SevenZip, CompressionLevel, StreamOptions};
+    /// Past it the least recently read block is dropped first, so reads
+    /// that keep coming back to a few hot blocks decode each one once.
+    pub fn set_cache_budget(&self, total_bytes: u64) {
+        unsafe { ffi::sevenzip_archive_set_cache_budget(self.handle, total_bytes) };
+    }
+
+    /// Read one file entry into memory
+    pub fn read_entry(&self, index: u32) -> Result<Vec<u8>> {
+        let mut data = Vec::new();
+        self.extract_entry(index, &mut data)?;
+        Ok(data)
+    }
+
+    /// Stream one file entry through [`Read`]
     ///
-    /// let sz = SevenZip::new()?;
-    /// let mut opts = StreamOptions::default();
-    /// opts.num_threads = 8;
-    /// opts.chunk_size = 64 * 1024 * 1024; // 64MB chunks
+    /// The entry is decoded on a thread of its own, at most 1 MB ahead of
+    /// the reads, so memory stays constant whatever its size. The archive
+    /// is borrowed until the reader is dropped; dropping it early stops the
+    /// decoder. Directories and indices past the end are rejected.
+    pub fn entry_reader(&self, index: u32) -> Result<ArchiveEntryReader<'_>> {
+        let mut handle: *mut ffi::SevenZipEntryReader = ptr::null_mut();
+        let result = unsafe { ffi::sevenzip_entry_reader_open(self.handle, index, &mut handle) };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(Error::from_code(result));
+        }
+        Ok(ArchiveEntryReader { handle, _archive: std::marker::PhantomData })
+    }
+
+    /// Read bytes of a file entry at `offset`, as `pread` does
     ///
-    /// // Create 88GB archive without running out of memory
-    /// sz.create_archive_true_streaming(
-    ///     "forensic_evidence.7z",
-    ///     &["/path/to/88gb/evidence/folder"],
-    ///     CompressionLevel::Normal,
-    ///     Some(&opts),
-    ///     Some(Box::new(|processed, total, file_bytes, file_total, filename| {
-    ///         let percent = if total > 0 {
-    ///             (processed as f64 / total as f64) * 100.0
-    ///         } else { 0.0 };
-    ///         println!("[{:.1}%] {} ({}/{} bytes)", percent, filename, file_bytes, file_total);
-    ///     }))
-    /// )?;
-    /// # Ok::<(), seven_zip::Error>(())
-    /// ```
-    pub fn create_archive_true_streaming(
-        &self,
-        archive_path: impl AsRef<Path>,
-        input_paths: &[impl AsRef<Path>],
-        level: CompressionLevel,
-        options: Option<&StreamOptions>,
-        progress: Option<BytesProgressCallback>,
-    ) -> Result<()> {
-        let archive_path_c = path_to_cstring(archive_path.as_ref())?;
-        
-        // Convert input paths to C strings
-        let input_paths_c: Vec<CString> = input_paths
-            .iter()
-            .map(|p| path_to_cstring(p.as_ref()))
-            .collect::<Result<_>>()?;
-        let mut input_ptrs: Vec<*const i8> = input_paths_c.iter().map(|s| s.as_ptr()).collect();
-        input_ptrs.push(ptr::null()); // NULL-terminate
+    /// Returns the bytes read: short only at the end of the entry, 0 at or
+    /// past it. A cached block is copied from; otherwise decoding starts at
+    /// the nearest point before `offset` the coder allows and stops at the
+    /// end of `buf`, without checking the entry's CRC.
+    pub fn read_at(&self, index: u32, offset: u64, buf: &mut [u8]) -> Result<usize> {
+        let mut size = buf.len();
+        let result = unsafe {
+            ffi::sevenzip_archive_pread(self.handle, index, offset,
+                                        buf.as_mut_ptr() as *mut std::os::raw::c_void, &mut size)
+        };
+        result_of(result)?;
+        Ok(size)
+    }
+
+    /// The file or directory at `path` of the archive's tree
+    ///
+    /// '/' and '\' both separate components, and "" or "/" is the root.
+    /// Directories that only appear in other entries' paths have no entry
+    /// index. The tree is built by the first `stat` or `read_dir` call.
+    pub fn stat(&self, path: &str) -> Result<VfsStat> {
+        let path_c = CString::new(path)
+            .map_err(|_| Error::InvalidParameter("Path contains null byte".to_string()))?;
+        let mut stat = std::mem::MaybeUninit::<ffi::SevenZipVfsStat>::uninit();
+        let result = unsafe { ffi::sevenzip_archive_stat(self.handle, path_c.as_ptr(), stat.as_mut_ptr()) };
+        result_of(result)?;
+        Ok(VfsStat::from_ffi(unsafe { &stat.assume_init() }))
+    }
+
+    /// Names and details of the children of the directory at `path`, in
+    /// archive order
+    pub fn read_dir(&self, path: &str) -> Result<Vec<(String, VfsStat)>> {
+        let path_c = CString::new(path)
+            .map_err(|_| Error::InvalidParameter("Path contains null byte".to_string()))?;
+        let mut children: Vec<(String, VfsStat)> = Vec::new();
+        let result = unsafe {
+            ffi::sevenzip_archive_readdir(self.handle, path_c.as_ptr(), Some(read_dir_callback),
+                                          &mut children as *mut _ as *mut std::os::raw::c_void)
+        };
+        result_of(result)?;
+        Ok(children)
+    }
+}
+
+/// A file or directory of an [`Archive`]'s tree
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct VfsStat {
+    /// Index in [`Archive::list`]; `None` for a directory only implied by other paths
+    pub entry_index: Option<u32>,
+    /// Uncompressed size in bytes (0 for directories)
+    pub size: u64,
+    /// Unix timestamp of last modification (0 if not stored)
+    pub modified_time: u64,
+    /// File attributes
+    pub attributes: u32,
+    /// True if this is a directory
+    pub is_directory: bool,
+}
+
+impl VfsStat {
+    fn from_ffi(stat: &ffi::SevenZipVfsStat) -> Self {
+        Self {
+            entry_index: if stat.entry_index == ffi::SEVENZIP_VFS_NO_ENTRY { None } else { Some(stat.entry_index) },
+            size: stat.size,
+            modified_time: stat.modified_time,
+            attributes: stat.attributes,
+            is_directory: stat.is_directory != 0,
+        }
+    }
+}
+
+unsafe extern "C" fn read_dir_callback(
+    name: *const std::os::raw::c_char,
+    stat: *const ffi::SevenZipVfsStat,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int {
+    let children = &mut *(user_data as *mut Vec<(String, VfsStat)>);
+    let name = CStr::from_ptr(name).to_string_lossy().into_owned();
+    children.push((name, VfsStat::from_ffi(&*stat)));
+    0
+}
+
+/// One file of an [`Archive`], read a piece at a time
+///
+/// Bytes arrive before the CRC of the whole entry is known: a mismatch
+/// is the error of the read that would have returned 0.
+pub struct ArchiveEntryReader<'a> {
+    handle: *mut ffi::SevenZipEntryReader,
+    _archive: std::marker::PhantomData<&'a Archive>,
+}
+
+// The decoder thread only touches the archive the reader holds borrowed
+unsafe impl Send for ArchiveEntryReader<'_> {}
+
+impl Read for ArchiveEntryReader<'_> {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        let mut size = buf.len();
+        let result = unsafe {
+            ffi::sevenzip_entry_reader_read(self.handle, buf.as_mut_ptr() as *mut std::os::raw::c_void, &mut size)
+        };
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            return Err(std::io::Error::new(std::io::ErrorKind::InvalidData, Error::from_code(result)));
+        }
+        Ok(size)
+    }
+}
+
+impl Drop for ArchiveEntryReader<'_> {
+    fn drop(&mut self) {
+        unsafe { ffi::sevenzip_entry_reader_close(self.handle) };
+    }
+}
+
+impl Drop for Archive {
+    fn drop(&mut self) {
+        unsafe { ffi::sevenzip_close(self.handle) };
+    }
+}
+
+/// Entries of many archives by path, mapped from a catalog file
+///
+/// Lookups are binary searches over the mapped records and may run on
+/// several threads at once.
+pub struct Catalog {
+    handle: *mut ffi::SevenZipCatalog,
+}
+
+// Lookups only read the mapping
+unsafe impl Send for Catalog {}
+unsafe impl Sync for Catalog {}
+
+/// One entry a [`Catalog::lookup`] found
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct CatalogHit {
+    /// Archive holding the entry, as passed to [`SevenZip::build_catalog`]
+    pub archive_path: PathBuf,
+    /// Position of the archive in the build's paths
+    pub archive_index: u32,
+    /// Entry of the archive, for [`Archive::read_entry`]
+    pub entry_index: u32,
+    /// Folder holding the data, `None` for directories and empty files
+    pub folder_index: Option<u32>,
+    /// Uncompressed size in bytes
+    pub size: u64,
+    /// Offset of the folder's packed data from the start of the first volume
+    pub pack_offset: u64,
+    /// True if this is a directory
+    pub is_directory: bool,
+}
 
-        // Convert options to C struct
-        let (opts_ptr, _password_c, _temp_dir_c) = if let Some(opts) = options {
-            let password_c = opts.password.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
-            let temp_dir_c = opts.temp_dir.as_ref().map(|p| CString::new(p.as_str())).transpose()?;
-            let c_opts = ffi::SevenZipStreamOptions {
-                num_threads: opts.num_threads as i32,
-                dict_size: opts.dict_size,
-                solid: if opts.solid { 1 } else { 0 },
-                password: password_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
-                split_size: opts.split_size,
-                chunk_size: opts.chunk_size,
-                temp_dir: temp_dir_c.as_ref().map_or(ptr::null(), |p| p.as_ptr()),
-                delete_temp_on_error: if opts.delete_temp_on_error { 1 } else { 0 },
-            };
-            (Box::new(c_opts), password_c, temp_dir_c)
-        } else {
-            // Initialize with defaults
-            let mut c_opts = std::mem::MaybeUninit::<ffi::SevenZipStreamOptions>::uninit();
-            unsafe {
-                ffi::sevenzip_stream_options_init(c_opts.as_mut_ptr());
-                (Box::new(c_opts.assume_init()), None, None)
+impl Catalog {
+    /// Entries named `path` (as [`SevenZip::list`] names them), in archive order
+    pub fn lookup(&self, path: &str) -> Result<Vec<CatalogHit>> {
+        let path_c = CString::new(path)?;
+        let mut hits: Vec<ffi::SevenZipCatalogHit> = Vec::with_capacity(4);
+        loop {
+            let mut count = 0usize;
+            result_of(unsafe {
+                ffi::sevenzip_catalog_lookup(
+                    self.handle,
+                    path_c.as_ptr(),
+                    hits.as_mut_ptr(),
+                    hits.capacity(),
+                    &mut count,
+                )
+            })?;
+            if count <= hits.capacity() {
+                unsafe { hits.set_len(count) };
+                break;
             }
-        };
+            hits.reserve(count);
+        }
+        Ok(hits
+            .iter()
+            .map(|hit| CatalogHit {
+                archive_path: PathBuf::from(
+                    unsafe { CStr::from_ptr(hit.archive_path) }.to_string_lossy().into_owned(),
+                ),
+                archive_index: hit.archive_index,
+                entry_index: hit.entry_index,
+                folder_index: (hit.folder_index != ffi::SEVENZIP_CATALOG_NO_FOLDER).then_some(hit.folder_index),
+                size: hit.size,
+                pack_offset: hit.pack_offset,
+                is_directory: hit.is_directory != 0,
+            })
+            .collect())
+    }
+}
 
-        // Set up progress callback
-        let (callback, user_data) = if let Some(cb) = progress {
-            let boxed = Box::new(cb);
-            let raw = Box::into_raw(boxed);
-            (
-                Some(bytes_progress_callback_wrapper as unsafe extern "C" fn(u64, u64, u64, u64, *const std::os::raw::c_char, *mut std::os::raw::c_void)),
-                raw as *mut std::os::raw::c_void,
-            )
-        } else {
-            (None, ptr::null_mut())
-        };
+impl Drop for Catalog {
+    fn drop(&mut self) {
+        unsafe { ffi::sevenzip_catalog_close(self.handle) };
+    }
+}
 
-        unsafe {
-            let result = ffi::sevenzip_create_7z_true_streaming(
-                archive_path_c.as_ptr(),
-                input_ptrs.as_ptr(),
-                level.into(),
-                &*opts_ptr,
-                callback,
-                user_data,
-            );
+/// Cooperative cancellation of a running job
+///
+/// Share it through an `Arc` between the job's [`StreamOptions::cancel`] and
+/// whatever decides to stop it; [`cancel`](Self::cancel) may be called from
+/// any thread. The job returns [`Error::Cancelled`] soon after.
+pub struct CancelToken {
+    handle: *mut ffi::SevenZipCancelToken,
+}
 
-            // Clean up the callback if it was allocated
-            if !user_data.is_null() {
-                let _boxed = Box::from_raw(user_data as *mut BytesProgressCallback);
-                // Drops automatically
-            }
+// The token is a single atomic flag on the C side
+unsafe impl Send for CancelToken {}
+unsafe impl Sync for CancelToken {}
 
-            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
-                return Err(Error::from_code(result));
-            }
+impl CancelToken {
+    /// A token that is not cancelled
+    pub fn new() -> Result<Self> {
+        let handle = unsafe { ffi::sevenzip_cancel_token_create() };
+        if handle.is_null() {
+            return Err(Error::Memory("Failed to allocate cancellation token".to_string()));
         }
+        Ok(Self { handle })
+    }
 
-        Ok(())
+    /// Ask every job using the token to stop
+    pub fn cancel(&self) {
+        unsafe { ffi::sevenzip_cancel_token_cancel(self.handle) };
     }
 
-    /// Compress a single file to LZMA2 format
-    ///
-    /// # Example
-    ///
-    /// ```no_run
-    /// use seven_zip::{SevenZip, CompressionLevel};
-    ///
-    /// let sz = SevenZip::new()?;
-    /// sz.compress_file("input.txt", "output.lzma2", CompressionLevel::Normal)?;
-    /// # Ok::<(), seven_zip::Error>(())
-    /// ```
-    pub fn compress_file(
-        &self,
-        input_path: impl AsRef<Path>,
-        output_path: impl AsRef<Path>,
-        level: CompressionLevel,
-    ) -> Result<()> {
-        let input_path_c = path_to_cstring(input_path.as_ref())?;
-        let output_path_c = path_to_cstring(output_path.as_ref())?;
+    /// Whether [`cancel`](Self::cancel) was called since creation or the last reset
+    pub fn is_cancelled(&self) -> bool {
+        unsafe { ffi::sevenzip_cancel_token_is_cancelled(self.handle) != 0 }
+    }
 
-        unsafe {
-            let result = ffi::sevenzip_compress_file(
-                input_path_c.as_ptr(),
-                output_path_c.as_ptr(),
-                level.into(),
-                None,
-                ptr::null_mut(),
-            );
+    /// Clear the token for the next job
+    pub fn reset(&self) {
+        unsafe { ffi::sevenzip_cancel_token_reset(self.handle) };
+    }
+}
 
-            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
-                return Err(Error::from_code(result));
-            }
+impl std::fmt::Debug for CancelToken {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("CancelToken").field("cancelled", &self.is_cancelled()).finish()
+    }
+}
+
+impl Drop for CancelToken {
+    fn drop(&mut self) {
+        unsafe { ffi::sevenzip_cancel_token_free(self.handle) };
+    }
+}
+
+/// Read and write bandwidth budget of archive jobs
+///
+/// Token buckets holding 100ms of their rate, so input reads and volume
+/// writes are spread evenly. Share it through an `Arc` between the
+/// [`StreamOptions::rate_limit`] of one or more jobs, which then share the
+/// budget; [`set`](Self::set) may be called from any thread while they run.
+pub struct RateLimit {
+    handle: *mut ffi::SevenZipRateLimit,
+}
+
+// The budget is guarded by a lock on the C side
+unsafe impl Send for RateLimit {}
+unsafe impl Sync for RateLimit {}
+
+impl RateLimit {
+    /// A budget of bytes per second for each direction (0 = unlimited)
+    pub fn new(read_bytes_per_sec: u64, write_bytes_per_sec: u64) -> Result<Self> {
+        let handle = unsafe { ffi::sevenzip_rate_limit_create(read_bytes_per_sec, write_bytes_per_sec) };
+        if handle.is_null() {
+            return Err(Error::Memory("Failed to allocate rate limit".to_string()));
         }
+        Ok(Self { handle })
+    }
 
-        Ok(())
+    /// Change both rates; waiting readers and writers see them within 100ms
+    pub fn set(&self, read_bytes_per_sec: u64, write_bytes_per_sec: u64) {
+        unsafe { ffi::sevenzip_rate_limit_set(self.handle, read_bytes_per_sec, write_bytes_per_sec) };
     }
+}
 
-    /// Decompress a single LZMA2 file
-    ///
-    /// # Example
-    ///
-    /// ```no_run
-    /// use seven_zip::SevenZip;
-    ///
-    /// let sz = SevenZip::new()?;
-    /// sz.decompress_file("input.lzma2", "output.txt")?;
-    /// # Ok::<(), seven_zip::Error>(())
-    /// ```
-    pub fn decompress_file(
-        &self,
-        input_path: impl AsRef<Path>,
-        output_path: impl AsRef<Path>,
-    ) -> Result<()> {
-        let input_path_c = path_to_cstring(input_path.as_ref())?;
-        let output_path_c = path_to_cstring(output_path.as_ref())?;
+impl std::fmt::Debug for RateLimit {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("RateLimit").finish_non_exhaustive()
+    }
+}
 
-        unsafe {
-            let result = ffi::sevenzip_decompress_file(
-                input_path_c.as_ptr(),
-                output_path_c.as_ptr(),
-                None,
-                ptr::null_mut(),
-            );
+impl Drop for RateLimit {
+    fn drop(&mut self) {
+        unsafe { ffi::sevenzip_rate_limit_free(self.handle) };
+    }
+}
 
-            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
-                return Err(Error::from_code(result));
+/// Archive job running on a library runner thread
+///
+/// Returned by [`SevenZip::create_archive_async`] and
+/// [`SevenZip::extract_async`]. It is a [`Future`] that needs no particular
+/// runtime: the runner wakes the task when the job finishes. Dropping an
+/// unfinished job cancels it.
+pub struct ArchiveJob {
+    job: *mut ffi::SevenZipJob,
+    state: Arc<JobState>,
+}
+
+struct JobState {
+    finished: Mutex<(Option<ffi::SevenZipErrorCode>, Option<Waker>)>,
+    // The C job keeps the raw token and budget, so they must outlive the job
+    _cancel: Option<Arc<CancelToken>>,
+    _rate_limit: Option<Arc<RateLimit>>,
+}
+
+// The C job handle is safe to use from any thread
+unsafe impl Send for ArchiveJob {}
+unsafe impl Sync for ArchiveJob {}
+
+impl ArchiveJob {
+    fn submit(
+        cancel: Option<Arc<CancelToken>>,
+        rate_limit: Option<Arc<RateLimit>>,
+        start: impl FnOnce(ffi::SevenZipJobCallback, *mut std::os::raw::c_void, *mut *mut ffi::SevenZipJob) -> ffi::SevenZipErrorCode,
+    ) -> Result<Self> {
+        let state = Arc::new(JobState {
+            finished: Mutex::new((None, None)),
+            _cancel: cancel,
+            _rate_limit: rate_limit,
+        });
+        let user_data = Arc::into_raw(state.clone()) as *mut std::os::raw::c_void;
+        let mut job = ptr::null_mut();
+        let result = start(Some(job_done_callback), user_data, &mut job);
+        if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+            // Never queued, so the callback will not take its reference
+            unsafe { drop(Arc::from_raw(user_data as *const JobState)) };
+            return Err(Error::from_code(result));
+        }
+        Ok(Self { job, state })
+    }
+
+    /// Ask the job to stop; it finishes with [`Error::Cancelled`]
+    pub fn cancel(&self) {
+        unsafe { ffi::sevenzip_job_cancel(self.job) };
+    }
+
+    /// Change the bandwidth budget of a create job: its
+    /// [`StreamOptions::rate_limit`] (for every job sharing it), else one
+    /// of its own; extract jobs ignore it (0 = unlimited)
+    pub fn set_rate_limit(&self, read_bytes_per_sec: u64, write_bytes_per_sec: u64) {
+        unsafe { ffi::sevenzip_job_set_rate_limit(self.job, read_bytes_per_sec, write_bytes_per_sec) };
+    }
+
+    /// Block until the job finishes
+    pub fn wait(self) -> Result<()> {
+        result_of(unsafe { ffi::sevenzip_job_wait(self.job) })
+    }
+
+    /// Whether the job finished
+    pub fn is_finished(&self) -> bool {
+        self.state.finished.lock().unwrap().0.is_some()
+    }
+
+    /// Descriptor that turns readable once the job finished, for poll(2)
+    /// based event loops (`None` where the platform has none)
+    pub fn fd(&self) -> Option<i32> {
+        let fd = unsafe { ffi::sevenzip_job_fd(self.job) };
+        if fd < 0 { None } else { Some(fd) }
+    }
+}
+
+impl Future for ArchiveJob {
+    type Output = Result<()>;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        let mut finished = self.state.finished.lock().unwrap();
+        match finished.0 {
+            Some(code) => Poll::Ready(result_of(code)),
+            None => {
+                finished.1 = Some(cx.waker().clone());
+                Poll::Pending
             }
         }
+    }
+}
 
-        Ok(())
+impl std::fmt::Debug for ArchiveJob {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("ArchiveJob").field("finished", &self.is_finished()).finish()
     }
 }
 
-impl Drop for SevenZip {
+impl Drop for ArchiveJob {
     fn drop(&mut self) {
         unsafe {
-            ffi::sevenzip_cleanup();
+            if !self.is_finished() {
+                ffi::sevenzip_job_cancel(self.job);
+            }
+            ffi::sevenzip_job_free(self.job);
         }
     }
 }
 
+/// Runner side of an [`ArchiveJob`], taking over the reference from `submit`
+unsafe extern "C" fn job_done_callback(
+    _job: *mut ffi::SevenZipJob,
+    result: ffi::SevenZipErrorCode,
+    user_data: *mut std::os::raw::c_void,
+) {
+    let state = Arc::from_raw(user_data as *const JobState);
+    let waker = {
+        let mut finished = state.finished.lock().unwrap();
+        finished.0 = Some(result);
+        finished.1.take()
+    };
+    if let Some(waker) = waker {
+        waker.wake();
+    }
+}
+
+fn result_of(code: ffi::SevenZipErrorCode) -> Result<()> {
+    if code == ffi::SevenZipErrorCode::SEVENZIP_OK {
+        Ok(())
+    } else {
+        Err(Error::from_code(code))
+    }
+}
+
 // Helper functions
 
 fn path_to_cstring(path: &Path) -> Result<CString> {
@@ -1158,6 +5132,339 @@ fn path_to_cstring(path: &Path) -> Result<CString> {
         .map_err(|_| Error::InvalidParameter("Path contains null byte".to_string()))
 }
 
+/// NULL-terminated pointers to `strings`, empty when there are none
+fn c_string_list(strings: &[CString]) -> Vec<*const std::os::raw::c_char> {
+    if strings.is_empty() {
+        return Vec::new();
+    }
+    let mut ptrs: Vec<*const std::os::raw::c_char> = strings.iter().map(|s| s.as_ptr()).collect();
+    ptrs.push(ptr::null());
+    ptrs
+}
+
+/// Appends to a buffer the `open` closure of `read_entry` can hand out again
+struct BufferWriter<'a>(&'a RefCell<Vec<u8>>);
+
+impl Write for BufferWriter<'_> {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        self.0.borrow_mut().write(buf)
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        Ok(())
+    }
+}
+
+/// State of `extract_to_writers` and `Archive::extract_entry` behind the sink's user data
+struct SinkContext<W, F> {
+    open: F,
+    writer: Option<W>,
+    error: Option<std::io::Error>,
+}
+
+/// Sink calling back into `context`, which must outlive its use
+fn make_sink<W, F>(context: &mut SinkContext<W, F>) -> ffi::SevenZipExtractSink
+where
+    W: Write,
+    F: FnMut(&str, u64) -> std::io::Result<Option<W>>,
+{
+    ffi::SevenZipExtractSink {
+        begin_entry: Some(sink_begin_wrapper::<W, F>),
+        write: Some(sink_write_wrapper::<W, F>),
+        end_entry: Some(sink_end_wrapper::<W, F>),
+        user_data: context as *mut SinkContext<W, F> as *mut std::os::raw::c_void,
+    }
+}
+
+unsafe extern "C" fn sink_begin_wrapper<W, F>(
+    _entry_index: u32,
+    name: *const std::os::raw::c_char,
+    size: u64,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    W: Write,
+    F: FnMut(&str, u64) -> std::io::Result<Option<W>>,
+{
+    // SAFETY: user_data is the SinkContext of the running extract call
+    let context = unsafe { &mut *(user_data as *mut SinkContext<W, F>) };
+    let name = unsafe { CStr::from_ptr(name) }.to_str().unwrap_or("<invalid utf-8>");
+    match (context.open)(name, size) {
+        Ok(writer) => {
+            context.writer = writer;
+            0
+        }
+        Err(err) => {
+            context.error = Some(err);
+            1
+        }
+    }
+}
+
+unsafe extern "C" fn sink_write_wrapper<W, F>(
+    _entry_index: u32,
+    data: *const std::os::raw::c_void,
+    size: usize,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    W: Write,
+    F: FnMut(&str, u64) -> std::io::Result<Option<W>>,
+{
+    // SAFETY: user_data as above; data holds `size` bytes for this call only
+    let context = unsafe { &mut *(user_data as *mut SinkContext<W, F>) };
+    let Some(writer) = context.writer.as_mut() else { return 0 };
+    let bytes = unsafe { std::slice::from_raw_parts(data as *const u8, size) };
+    match writer.write_all(bytes) {
+        Ok(()) => 0,
+        Err(err) => {
+            context.error = Some(err);
+            1
+        }
+    }
+}
+
+unsafe extern "C" fn sink_end_wrapper<W, F>(
+    _entry_index: u32,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    W: Write,
+    F: FnMut(&str, u64) -> std::io::Result<Option<W>>,
+{
+    // SAFETY: user_data as above
+    let context = unsafe { &mut *(user_data as *mut SinkContext<W, F>) };
+    let Some(mut writer) = context.writer.take() else { return 0 };
+    match writer.flush() {
+        Ok(()) => 0,
+        Err(err) => {
+            context.error = Some(err);
+            1
+        }
+    }
+}
+
+/// State of `create_archive_to_writers` behind the sink's user data
+struct VolumeSinkContext<W, F> {
+    open: F,
+    first: Option<W>,          // Volume 0, kept for the start header patch
+    current: Option<(u32, W)>, // A later volume being written
+    error: Option<std::io::Error>,
+}
+
+impl<W: Write + Seek, F> VolumeSinkContext<W, F> {
+    fn writer(&mut self, volume_index: u32) -> Option<&mut W> {
+        match self.current {
+            Some((index, ref mut writer)) if index == volume_index => Some(writer),
+            _ if volume_index == 0 => self.first.as_mut(),
+            _ => None,
+        }
+    }
+
+    /// Store the error of a callback, 1 to stop the job
+    fn fail(&mut self, err: std::io::Error) -> std::os::raw::c_int {
+        self.error = Some(err);
+        1
+    }
+}
+
+unsafe extern "C" fn volume_begin_wrapper<W, F>(
+    volume_index: u32,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    W: Write + Seek,
+    F: FnMut(u32) -> std::io::Result<W>,
+{
+    // SAFETY: user_data is the VolumeSinkContext of the running create call
+    let context = unsafe { &mut *(user_data as *mut VolumeSinkContext<W, F>) };
+    match (context.open)(volume_index) {
+        Ok(writer) if volume_index == 0 => {
+            context.first = Some(writer);
+            0
+        }
+        Ok(writer) => {
+            context.current = Some((volume_index, writer));
+            0
+        }
+        Err(err) => context.fail(err),
+    }
+}
+
+unsafe extern "C" fn volume_write_wrapper<W, F>(
+    volume_index: u32,
+    data: *const std::os::raw::c_void,
+    size: usize,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    W: Write + Seek,
+    F: FnMut(u32) -> std::io::Result<W>,
+{
+    // SAFETY: user_data as above; data holds `size` bytes for this call only
+    let context = unsafe { &mut *(user_data as *mut VolumeSinkContext<W, F>) };
+    let bytes = unsafe { std::slice::from_raw_parts(data as *const u8, size) };
+    let Some(writer) = context.writer(volume_index) else { return 1 };
+    match writer.write_all(bytes) {
+        Ok(()) => 0,
+        Err(err) => context.fail(err),
+    }
+}
+
+unsafe extern "C" fn volume_patch_wrapper<W, F>(
+    offset: u64,
+    data: *const std::os::raw::c_void,
+    size: usize,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    W: Write + Seek,
+    F: FnMut(u32) -> std::io::Result<W>,
+{
+    // SAFETY: user_data as above; data holds `size` bytes for this call only
+    let context = unsafe { &mut *(user_data as *mut VolumeSinkContext<W, F>) };
+    let bytes = unsafe { std::slice::from_raw_parts(data as *const u8, size) };
+    let Some(writer) = context.first.as_mut() else { return 1 };
+    let patched = writer
+        .seek(SeekFrom::Start(offset))
+        .and_then(|_| writer.write_all(bytes))
+        .and_then(|_| writer.seek(SeekFrom::End(0)).map(|_| ()));
+    match patched {
+        Ok(()) => 0,
+        Err(err) => context.fail(err),
+    }
+}
+
+unsafe extern "C" fn volume_end_wrapper<W, F>(
+    volume_index: u32,
+    _size: u64,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    W: Write + Seek,
+    F: FnMut(u32) -> std::io::Result<W>,
+{
+    // SAFETY: user_data as above
+    let context = unsafe { &mut *(user_data as *mut VolumeSinkContext<W, F>) };
+    let writer = if volume_index == 0 {
+        context.first.take()
+    } else {
+        context.current.take().map(|(_, writer)| writer)
+    };
+    let Some(mut writer) = writer else { return 1 };
+    match writer.flush() {
+        Ok(()) => 0,
+        Err(err) => context.fail(err),
+    }
+}
+
+/// State of `create_archive_from_entries` behind the source's user data
+struct EntrySourceContext<I> {
+    entries: I,
+    name: Option<CString>,              // Of the current entry, kept for the call
+    reader: Option<Box<dyn Read + Send>>,
+    error: Option<Error>,
+}
+
+unsafe extern "C" fn source_next_wrapper<I>(
+    entry: *mut ffi::SevenZipSourceEntry,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    I: Iterator<Item = std::io::Result<SourceEntry>>,
+{
+    // SAFETY: user_data is the EntrySourceContext of the running create call,
+    // entry the zeroed struct to fill in
+    let context = unsafe { &mut *(user_data as *mut EntrySourceContext<I>) };
+    let entry = unsafe { &mut *entry };
+    context.reader = None;
+    let next = match context.entries.next() {
+        None => return 0,
+        Some(Ok(next)) => next,
+        Some(Err(err)) => {
+            context.error = Some(err.into());
+            return 1;
+        }
+    };
+    let name = match CString::new(next.name) {
+        Ok(name) => name,
+        Err(err) => {
+            context.error = Some(err.into());
+            return 1;
+        }
+    };
+    entry.name = name.as_ptr();
+    entry.size = next.size.unwrap_or(ffi::SEVENZIP_SIZE_UNKNOWN);
+    entry.mtime = next.modified_time;
+    entry.is_dir = next.is_directory as std::os::raw::c_int;
+    if next.reader.is_some() {
+        entry.read = Some(source_read_wrapper::<I>);
+        entry.read_user_data = user_data;
+    }
+    context.name = Some(name);
+    context.reader = next.reader;
+    0
+}
+
+unsafe extern "C" fn source_read_wrapper<I>(
+    buf: *mut std::os::raw::c_void,
+    size: *mut usize,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int
+where
+    I: Iterator<Item = std::io::Result<SourceEntry>>,
+{
+    // SAFETY: user_data as above; buf holds *size bytes
+    let context = unsafe { &mut *(user_data as *mut EntrySourceContext<I>) };
+    let out = unsafe { std::slice::from_raw_parts_mut(buf as *mut u8, *size) };
+    let Some(reader) = context.reader.as_mut() else {
+        unsafe { *size = 0 };
+        return 0;
+    };
+    loop {
+        match reader.read(out) {
+            Ok(n) => {
+                unsafe { *size = n };
+                return 0;
+            }
+            Err(err) if err.kind() == std::io::ErrorKind::Interrupted => continue,
+            Err(err) => {
+                context.error = Some(err.into());
+                return 1;
+            }
+        }
+    }
+}
+
+/// Reader of [`SevenZip::extract_from_stream`], and its first error
+struct StreamReadContext<R> {
+    reader: R,
+    error: Option<Error>,
+}
+
+unsafe extern "C" fn stream_read_wrapper<R: Read>(
+    buf: *mut std::os::raw::c_void,
+    size: *mut usize,
+    user_data: *mut std::os::raw::c_void,
+) -> std::os::raw::c_int {
+    // SAFETY: user_data is the StreamReadContext of the running call; buf holds *size bytes
+    let context = unsafe { &mut *(user_data as *mut StreamReadContext<R>) };
+    let out = unsafe { std::slice::from_raw_parts_mut(buf as *mut u8, *size) };
+    loop {
+        match context.reader.read(out) {
+            Ok(n) => {
+                unsafe { *size = n };
+                return 0;
+            }
+            Err(err) if err.kind() == std::io::ErrorKind::Interrupted => continue,
+            Err(err) => {
+                context.error = Some(err.into());
+                return 1;
+            }
+        }
+    }
+}
+
 unsafe extern "C" fn progress_callback_wrapper(
     completed: u64,
     total: u64,
@@ -1225,6 +5532,14 @@ mod tests {
         assert_eq!(entry.compression_ratio(), 70.0);
     }
 
+    #[test]
+    fn test_empty_entry_list() {
+        let list = unsafe { EntryList::from_raw(ptr::null_mut()) };
+        assert!(list.is_empty());
+        assert!(list.get(0).is_none());
+        assert_eq!(list.iter().len(), 0);
+    }
+
     #[test]
     fn test_default_options() {
         let opts = CompressOptions::default();
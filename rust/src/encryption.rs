@@ -342,6 +342,55 @@ impl DecryptionContext {
         plaintext.truncate(plaintext_len);
         Ok(plaintext)
     }
+
+    /// Decrypt data using AES-256-CBC on several threads
+    ///
+    /// Same result as [`decrypt`](Self::decrypt); large buffers are split
+    /// into segments decrypted in parallel by the C library.
+    ///
+    /// # Arguments
+    ///
+    /// * `ciphertext` - Encrypted data
+    /// * `iv` - Initialization vector from archive header (16 bytes)
+    /// * `num_threads` - Maximum number of threads (0 = library default)
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if decryption fails or padding is invalid.
+    pub fn decrypt_parallel(
+        &mut self,
+        ciphertext: &[u8],
+        iv: &[u8; ffi::AES_BLOCK_SIZE],
+        num_threads: usize,
+    ) -> Result<Vec<u8>> {
+        if ciphertext.is_empty() || ciphertext.len() % ffi::AES_BLOCK_SIZE != 0 {
+            return Err(Error::InvalidParameter(
+                "Ciphertext length must be a non-zero multiple of 16 bytes".to_string(),
+            ));
+        }
+
+        let mut plaintext = vec![0u8; ciphertext.len()];
+        let mut plaintext_len = ciphertext.len();
+
+        unsafe {
+            let result = ffi::sevenzip_decrypt_data_parallel(
+                self.aes_context.as_mut_ptr(),
+                iv.as_ptr(),
+                ciphertext.as_ptr(),
+                ciphertext.len(),
+                plaintext.as_mut_ptr(),
+                &mut plaintext_len as *mut usize,
+                num_threads as std::os::raw::c_int,
+            );
+
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+
+        plaintext.truncate(plaintext_len);
+        Ok(plaintext)
+    }
 }
 
 /// Verify if a password is correct for an encrypted archive
@@ -406,6 +455,103 @@ pub fn verify_password(
     Ok(())
 }
 
+/// Persistent AES-256-CBC context for chunked, in-place processing
+///
+/// Holds the expanded key schedule and the CBC chaining state in C memory,
+/// so a stream can be encrypted or decrypted in any number of chunks with
+/// no allocation or key setup per chunk. No padding is added or removed.
+///
+/// # Example
+///
+/// ```no_run
+/// use seven_zip::encryption::CryptContext;
+///
+/// let key = [0u8; 32];
+/// let iv = [0u8; 16];
+/// let mut ctx = CryptContext::new_encrypt(&key, &iv)?;
+/// let mut chunk = vec![0u8; 1 << 20];
+/// ctx.update(&mut chunk)?;
+/// # Ok::<(), seven_zip::Error>(())
+/// ```
+pub struct CryptContext {
+    ctx: *mut ffi::SevenZipCryptContext,
+}
+
+// The context is only touched through &mut self
+unsafe impl Send for CryptContext {}
+
+impl CryptContext {
+    fn new(
+        mode: ffi::SevenZipCryptMode,
+        key: &[u8; ffi::AES_KEY_SIZE],
+        iv: &[u8; ffi::AES_BLOCK_SIZE],
+    ) -> Result<Self> {
+        let mut ctx = std::ptr::null_mut();
+        unsafe {
+            let result = ffi::sevenzip_crypt_create(mode, key.as_ptr(), iv.as_ptr(), &mut ctx);
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+        Ok(Self { ctx })
+    }
+
+    /// Create an encrypting context from a 32-byte key and 16-byte IV
+    pub fn new_encrypt(key: &[u8; ffi::AES_KEY_SIZE], iv: &[u8; ffi::AES_BLOCK_SIZE]) -> Result<Self> {
+        Self::new(ffi::SevenZipCryptMode::SEVENZIP_CRYPT_ENCRYPT, key, iv)
+    }
+
+    /// Create a decrypting context from a 32-byte key and 16-byte IV
+    pub fn new_decrypt(key: &[u8; ffi::AES_KEY_SIZE], iv: &[u8; ffi::AES_BLOCK_SIZE]) -> Result<Self> {
+        Self::new(ffi::SevenZipCryptMode::SEVENZIP_CRYPT_DECRYPT, key, iv)
+    }
+
+    /// Encrypt or decrypt the next chunk in place
+    ///
+    /// # Errors
+    ///
+    /// Returns an error if the length is not a multiple of 16 bytes or the
+    /// buffer is not 16-byte aligned.
+    pub fn update(&mut self, buf: &mut [u8]) -> Result<()> {
+        if buf.len() % ffi::AES_BLOCK_SIZE != 0 {
+            return Err(Error::InvalidParameter(
+                "Chunk length must be multiple of 16 bytes".to_string(),
+            ));
+        }
+        if buf.as_ptr() as usize % 16 != 0 {
+            return Err(Error::InvalidParameter(
+                "Chunk must be 16-byte aligned".to_string(),
+            ));
+        }
+
+        unsafe {
+            let result = ffi::sevenzip_crypt_update(self.ctx, buf.as_mut_ptr(), buf.len());
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+        Ok(())
+    }
+
+    /// Restart on a new stream with the same key
+    pub fn reset(&mut self, iv: &[u8; ffi::AES_BLOCK_SIZE]) -> Result<()> {
+        unsafe {
+            let result = ffi::sevenzip_crypt_reset(self.ctx, iv.as_ptr());
+            if result != ffi::SevenZipErrorCode::SEVENZIP_OK {
+                return Err(Error::from_code(result));
+            }
+        }
+        Ok(())
+    }
+}
+
+impl Drop for CryptContext {
+    fn drop(&mut self) {
+        // The C side zeroizes the key schedule before freeing it
+        unsafe { ffi::sevenzip_crypt_free(self.ctx) };
+    }
+}
+
 // Ensure sensitive data is zeroed on drop
 impl Drop for EncryptionContext {
     fn drop(&mut self) {
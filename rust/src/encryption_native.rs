@@ -10,12 +10,15 @@
 //! - Secure random IV and salt generation
 //! - PKCS#7 padding
 //! - Automatic key zeroization on drop
+//! - Process-wide cache of derived keys, zeroized on eviction and by
+//!   [`clear_key_cache`]
 
 use aes::cipher::{block_padding::Pkcs7, BlockDecryptMut, BlockEncryptMut, KeyIvInit};
 use pbkdf2::pbkdf2_hmac;
 use rand::RngCore;
-use sha2::Sha256;
-use zeroize::ZeroizeOnDrop;
+use sha2::{Digest, Sha256};
+use std::sync::{Mutex, OnceLock};
+use zeroize::{Zeroize, ZeroizeOnDrop};
 
 use crate::error::{Error, Result};
 
@@ -27,6 +30,10 @@ pub const AES_KEY_SIZE: usize = 32;
 pub const SALT_SIZE: usize = 16;
 /// PBKDF2 iterations (7-Zip default)
 pub const PBKDF2_ITERATIONS: u32 = 262_144;
+/// Derived keys kept by the process-wide key cache
+pub const KEY_CACHE_ENTRIES: usize = 16;
+/// Smallest segment [`DecryptionContext::decrypt_parallel`] gives a thread
+pub const PARALLEL_DECRYPT_MIN_SEGMENT: usize = 1 << 20;
 
 type Aes256CbcEnc = cbc::Encryptor<aes::Aes256>;
 type Aes256CbcDec = cbc::Decryptor<aes::Aes256>;
@@ -74,7 +81,6 @@ impl EncryptionContext {
 
         let mut salt = [0u8; SALT_SIZE];
         let mut iv = [0u8; AES_BLOCK_SIZE];
-        let mut key = [0u8; AES_KEY_SIZE];
 
         // Generate random salt and IV
         let mut rng = rand::thread_rng();
@@ -82,7 +88,7 @@ impl EncryptionContext {
         rng.fill_bytes(&mut iv);
 
         // Derive key using PBKDF2-SHA256
-        pbkdf2_hmac::<Sha256>(password.as_bytes(), &salt, PBKDF2_ITERATIONS, &mut key);
+        let key = derive_key(password, &salt);
 
         Ok(Self { key, iv, salt })
     }
@@ -98,8 +104,7 @@ impl EncryptionContext {
             return Err(Error::InvalidParameter("Salt cannot be empty".to_string()));
         }
 
-        let mut key = [0u8; AES_KEY_SIZE];
-        pbkdf2_hmac::<Sha256>(password.as_bytes(), salt, PBKDF2_ITERATIONS, &mut key);
+        let key = derive_key(password, salt);
 
         let mut salt_arr = [0u8; SALT_SIZE];
         let copy_len = salt.len().min(SALT_SIZE);
@@ -155,17 +160,55 @@ impl EncryptionContext {
     /// assert_eq!(ciphertext.len() % 16, 0);
     /// ```
     pub fn encrypt(&self, plaintext: &[u8]) -> Result<Vec<u8>> {
-        // Calculate buffer size (PKCS#7 adds 1-16 bytes of padding)
-        let padded_len = ((plaintext.len() / AES_BLOCK_SIZE) + 1) * AES_BLOCK_SIZE;
-        let mut buffer = vec![0u8; padded_len];
+        let mut buffer = vec![0u8; padded_len(plaintext.len())];
         buffer[..plaintext.len()].copy_from_slice(plaintext);
+        let len = self.encrypt_in_place(&mut buffer, plaintext.len())?;
+        buffer.truncate(len);
+        Ok(buffer)
+    }
+
+    /// Encrypt the first `plaintext_len` bytes of `buffer` in place
+    ///
+    /// `buffer` must have room for the padding: at least
+    /// [`padded_len`]`(plaintext_len)` bytes. Nothing is allocated.
+    ///
+    /// # Returns
+    ///
+    /// The ciphertext length; the ciphertext is `buffer[..len]`
+    ///
+    /// # Example
+    ///
+    /// ```
+    /// use seven_zip::encryption_native::{padded_len, EncryptionContext};
+    ///
+    /// let ctx = EncryptionContext::new("password").unwrap();
+    /// let mut buffer = [0u8; 64];
+    /// buffer[..11].copy_from_slice(b"Secret data");
+    /// assert!(buffer.len() >= padded_len(11));
+    /// let len = ctx.encrypt_in_place(&mut buffer, 11).unwrap();
+    /// let len = ctx.decrypt_in_place(&mut buffer[..len]).unwrap();
+    /// assert_eq!(&buffer[..len], b"Secret data");
+    /// ```
+    pub fn encrypt_in_place(&self, buffer: &mut [u8], plaintext_len: usize) -> Result<usize> {
+        if buffer.len() < padded_len(plaintext_len) {
+            return Err(Error::InvalidParameter(
+                "Buffer has no room for the padding".to_string(),
+            ));
+        }
 
         let cipher = Aes256CbcEnc::new(&self.key.into(), &self.iv.into());
         let ciphertext = cipher
-            .encrypt_padded_mut::<Pkcs7>(&mut buffer, plaintext.len())
+            .encrypt_padded_mut::<Pkcs7>(buffer, plaintext_len)
             .map_err(|_| Error::EncryptionError("Encryption failed".to_string()))?;
 
-        Ok(ciphertext.to_vec())
+        Ok(ciphertext.len())
+    }
+
+    /// Streaming [`Write`](std::io::Write) encryptor writing ciphertext to `inner`
+    ///
+    /// See [`EncryptingWriter`].
+    pub fn writer<W: std::io::Write>(&self, inner: W) -> EncryptingWriter<W> {
+        EncryptingWriter::new(inner, &self.key, &self.iv)
     }
 
     /// Decrypt data using AES-256-CBC and verify PKCS#7 padding
@@ -190,20 +233,26 @@ impl EncryptionContext {
     /// assert_eq!(plaintext.as_slice(), decrypted.as_slice());
     /// ```
     pub fn decrypt(&self, ciphertext: &[u8]) -> Result<Vec<u8>> {
-        if ciphertext.len() % AES_BLOCK_SIZE != 0 {
-            return Err(Error::InvalidParameter(
-                "Ciphertext length must be multiple of 16 bytes".to_string(),
-            ));
-        }
-
         let mut buffer = ciphertext.to_vec();
-        let cipher = Aes256CbcDec::new(&self.key.into(), &self.iv.into());
-        
-        let plaintext = cipher
-            .decrypt_padded_mut::<Pkcs7>(&mut buffer)
-            .map_err(|_| Error::DecryptionError("Decryption failed (wrong password?)".to_string()))?;
+        let len = self.decrypt_in_place(&mut buffer)?;
+        buffer.truncate(len);
+        Ok(buffer)
+    }
 
-        Ok(plaintext.to_vec())
+    /// Decrypt `buffer` in place and verify PKCS#7 padding
+    ///
+    /// # Returns
+    ///
+    /// The plaintext length; the plaintext is `buffer[..len]`
+    pub fn decrypt_in_place(&self, buffer: &mut [u8]) -> Result<usize> {
+        decrypt_cbc_in_place(&self.key, &self.iv, buffer)
+    }
+
+    /// Decrypt `buffer` in place on several threads
+    ///
+    /// See [`DecryptionContext::decrypt_parallel`].
+    pub fn decrypt_parallel_in_place(&self, buffer: &mut [u8], num_threads: usize) -> Result<usize> {
+        decrypt_cbc_parallel_in_place(&self.key, &self.iv, buffer, num_threads)
     }
 }
 
@@ -250,8 +299,7 @@ impl DecryptionContext {
             return Err(Error::InvalidParameter("Salt cannot be empty".to_string()));
         }
 
-        let mut key = [0u8; AES_KEY_SIZE];
-        pbkdf2_hmac::<Sha256>(password.as_bytes(), salt, PBKDF2_ITERATIONS, &mut key);
+        let key = derive_key(password, salt);
 
         Ok(Self { key })
     }
@@ -272,20 +320,242 @@ impl DecryptionContext {
     ///
     /// Decrypted data with padding removed
     pub fn decrypt(&self, ciphertext: &[u8], iv: &[u8; AES_BLOCK_SIZE]) -> Result<Vec<u8>> {
-        if ciphertext.len() % AES_BLOCK_SIZE != 0 {
-            return Err(Error::InvalidParameter(
-                "Ciphertext length must be multiple of 16 bytes".to_string(),
-            ));
-        }
+        let mut buffer = ciphertext.to_vec();
+        let len = self.decrypt_in_place(&mut buffer, iv)?;
+        buffer.truncate(len);
+        Ok(buffer)
+    }
 
+    /// Decrypt `buffer` in place using AES-256-CBC
+    ///
+    /// # Returns
+    ///
+    /// The plaintext length; the plaintext is `buffer[..len]`
+    pub fn decrypt_in_place(&self, buffer: &mut [u8], iv: &[u8; AES_BLOCK_SIZE]) -> Result<usize> {
+        decrypt_cbc_in_place(&self.key, iv, buffer)
+    }
+
+    /// Decrypt data using AES-256-CBC on several threads
+    ///
+    /// Same result as [`decrypt`](Self::decrypt). CBC decryption of a block
+    /// only needs the ciphertext block before it, so the data is split into
+    /// segments of at least [`PARALLEL_DECRYPT_MIN_SEGMENT`] bytes, each
+    /// seeded with the preceding ciphertext block as its IV.
+    ///
+    /// # Arguments
+    ///
+    /// * `ciphertext` - Encrypted data
+    /// * `iv` - Initialization vector from archive header (16 bytes)
+    /// * `num_threads` - Maximum number of threads (0 = available parallelism)
+    ///
+    /// # Returns
+    ///
+    /// Decrypted data with padding removed
+    pub fn decrypt_parallel(
+        &self,
+        ciphertext: &[u8],
+        iv: &[u8; AES_BLOCK_SIZE],
+        num_threads: usize,
+    ) -> Result<Vec<u8>> {
         let mut buffer = ciphertext.to_vec();
-        let cipher = Aes256CbcDec::new(&self.key.into(), iv.into());
-        
-        let plaintext = cipher
-            .decrypt_padded_mut::<Pkcs7>(&mut buffer)
-            .map_err(|_| Error::DecryptionError("Decryption failed (wrong password?)".to_string()))?;
+        let len = self.decrypt_parallel_in_place(&mut buffer, iv, num_threads)?;
+        buffer.truncate(len);
+        Ok(buffer)
+    }
+
+    /// [`decrypt_parallel`](Self::decrypt_parallel) in place
+    ///
+    /// # Returns
+    ///
+    /// The plaintext length; the plaintext is `buffer[..len]`
+    pub fn decrypt_parallel_in_place(
+        &self,
+        buffer: &mut [u8],
+        iv: &[u8; AES_BLOCK_SIZE],
+        num_threads: usize,
+    ) -> Result<usize> {
+        decrypt_cbc_parallel_in_place(&self.key, iv, buffer, num_threads)
+    }
+}
+
+/// Ciphertext length of `plaintext_len` bytes: PKCS#7 adds 1-16 bytes of padding
+pub fn padded_len(plaintext_len: usize) -> usize {
+    (plaintext_len / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE
+}
+
+fn decrypt_cbc_in_place(
+    key: &[u8; AES_KEY_SIZE],
+    iv: &[u8; AES_BLOCK_SIZE],
+    buffer: &mut [u8],
+) -> Result<usize> {
+    if buffer.len() % AES_BLOCK_SIZE != 0 {
+        return Err(Error::InvalidParameter(
+            "Ciphertext length must be multiple of 16 bytes".to_string(),
+        ));
+    }
+
+    let cipher = Aes256CbcDec::new(key.into(), iv.into());
+    let plaintext = cipher
+        .decrypt_padded_mut::<Pkcs7>(buffer)
+        .map_err(|_| Error::DecryptionError("Decryption failed (wrong password?)".to_string()))?;
+
+    Ok(plaintext.len())
+}
+
+fn decrypt_cbc_parallel_in_place(
+    key: &[u8; AES_KEY_SIZE],
+    iv: &[u8; AES_BLOCK_SIZE],
+    buffer: &mut [u8],
+    num_threads: usize,
+) -> Result<usize> {
+    if buffer.is_empty() || buffer.len() % AES_BLOCK_SIZE != 0 {
+        return Err(Error::InvalidParameter(
+            "Ciphertext length must be a non-zero multiple of 16 bytes".to_string(),
+        ));
+    }
+
+    let threads = if num_threads == 0 {
+        std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+    } else {
+        num_threads
+    };
+    let total_blocks = buffer.len() / AES_BLOCK_SIZE;
+    let count = (buffer.len() / PARALLEL_DECRYPT_MIN_SEGMENT).clamp(1, threads);
+
+    // Each segment's IV is the ciphertext block before it, taken before any
+    // segment is decrypted over
+    let mut segments = Vec::with_capacity(count);
+    let mut first = 0;
+    for i in 0..count {
+        let end = total_blocks * (i + 1) / count;
+        let mut segment_iv = *iv;
+        if first > 0 {
+            segment_iv.copy_from_slice(&buffer[(first - 1) * AES_BLOCK_SIZE..first * AES_BLOCK_SIZE]);
+        }
+        segments.push((end - first, segment_iv));
+        first = end;
+    }
+
+    std::thread::scope(|scope| {
+        let mut rest = &mut buffer[..];
+        for (blocks, segment_iv) in segments {
+            let (segment, tail) = std::mem::take(&mut rest).split_at_mut(blocks * AES_BLOCK_SIZE);
+            rest = tail;
+            scope.spawn(move || {
+                let mut cipher = Aes256CbcDec::new(key.into(), &segment_iv.into());
+                for block in segment.chunks_exact_mut(AES_BLOCK_SIZE) {
+                    cipher.decrypt_block_mut(block.into());
+                }
+            });
+        }
+    });
+
+    // PKCS#7, checked as decrypt_padded_mut does
+    let pad = buffer[buffer.len() - 1] as usize;
+    if pad == 0 || pad > AES_BLOCK_SIZE || !buffer[buffer.len() - pad..].iter().all(|&b| b as usize == pad) {
+        buffer.zeroize();
+        return Err(Error::DecryptionError("Decryption failed (wrong password?)".to_string()));
+    }
+    Ok(buffer.len() - pad)
+}
+
+/// Plaintext gathered by [`EncryptingWriter`] before it encrypts and writes
+const ENCRYPT_CHUNK: usize = 64 * 1024;
+
+/// Encrypting [`Write`](std::io::Write) adapter writing AES-256-CBC to `W`
+///
+/// Bytes written are encrypted in 64 KB pieces and go to the inner writer as
+/// they fill; memory stays constant whatever the length. The output is what
+/// [`EncryptionContext::encrypt`] returns for all the bytes written, once
+/// [`finish`](Self::finish) has written the padded last block. Dropping the
+/// writer finishes it too, ignoring errors.
+///
+/// # Example
+///
+/// ```
+/// use seven_zip::encryption_native::EncryptionContext;
+/// use std::io::Write;
+///
+/// let ctx = EncryptionContext::new("password").unwrap();
+/// let mut writer = ctx.writer(Vec::new());
+/// writer.write_all(b"Secret data").unwrap();
+/// let ciphertext = writer.finish().unwrap();
+/// assert_eq!(ctx.decrypt(&ciphertext).unwrap(), b"Secret data");
+/// ```
+pub struct EncryptingWriter<W: std::io::Write> {
+    inner: Option<W>,
+    cipher: Aes256CbcEnc,
+    pending: Vec<u8>,
+    finished: bool,
+}
+
+impl<W: std::io::Write> EncryptingWriter<W> {
+    /// Encrypt with `key` and `iv` into `inner`
+    pub fn new(inner: W, key: &[u8; AES_KEY_SIZE], iv: &[u8; AES_BLOCK_SIZE]) -> Self {
+        EncryptingWriter {
+            inner: Some(inner),
+            cipher: Aes256CbcEnc::new(key.into(), iv.into()),
+            pending: Vec::with_capacity(ENCRYPT_CHUNK + AES_BLOCK_SIZE),
+            finished: false,
+        }
+    }
+
+    /// The inner writer
+    pub fn get_ref(&self) -> &W {
+        self.inner.as_ref().expect("writer present until finish")
+    }
+
+    /// Write the padded last block and return the inner writer
+    pub fn finish(mut self) -> std::io::Result<W> {
+        self.finish_stream()?;
+        Ok(self.inner.take().expect("writer present until finish"))
+    }
+
+    fn encrypt_pending(&mut self) -> std::io::Result<()> {
+        let inner = self.inner.as_mut().expect("writer present until finish");
+        for block in self.pending.chunks_exact_mut(AES_BLOCK_SIZE) {
+            self.cipher.encrypt_block_mut(block.into());
+        }
+        let result = inner.write_all(&self.pending);
+        self.pending.clear();
+        result
+    }
+
+    fn finish_stream(&mut self) -> std::io::Result<()> {
+        if self.finished {
+            return Ok(());
+        }
+        self.finished = true;
+        let pad = AES_BLOCK_SIZE - self.pending.len() % AES_BLOCK_SIZE;
+        self.pending.resize(self.pending.len() + pad, pad as u8);
+        self.encrypt_pending()?;
+        self.inner.as_mut().expect("writer present until finish").flush()
+    }
+}
+
+impl<W: std::io::Write> std::io::Write for EncryptingWriter<W> {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        let take = buf.len().min(ENCRYPT_CHUNK - self.pending.len());
+        self.pending.extend_from_slice(&buf[..take]);
+        if self.pending.len() == ENCRYPT_CHUNK {
+            self.encrypt_pending()?;
+        }
+        Ok(take)
+    }
+
+    /// Flushes the inner writer; a partial block stays here until more
+    /// bytes or the end complete it
+    fn flush(&mut self) -> std::io::Result<()> {
+        self.inner.as_mut().expect("writer present until finish").flush()
+    }
+}
 
-        Ok(plaintext.to_vec())
+impl<W: std::io::Write> Drop for EncryptingWriter<W> {
+    fn drop(&mut self) {
+        if !std::thread::panicking() {
+            let _ = self.finish_stream();
+        }
+        self.pending.zeroize();
     }
 }
 
@@ -328,15 +598,92 @@ pub fn verify_password(
     Ok(())
 }
 
+/// One derived key, identified by a hash of the password
+#[derive(Zeroize, ZeroizeOnDrop)]
+struct CachedKey {
+    password_hash: [u8; 32],
+    salt: Vec<u8>,
+    iterations: u32,
+    key: [u8; AES_KEY_SIZE],
+    last_use: u64,
+}
+
+struct KeyCache {
+    entries: Vec<CachedKey>,
+    clock: u64,
+}
+
+fn key_cache() -> &'static Mutex<KeyCache> {
+    static CACHE: OnceLock<Mutex<KeyCache>> = OnceLock::new();
+    CACHE.get_or_init(|| Mutex::new(KeyCache { entries: Vec::new(), clock: 0 }))
+}
+
+impl KeyCache {
+    fn lookup(&mut self, password_hash: &[u8; 32], salt: &[u8], iterations: u32) -> Option<[u8; AES_KEY_SIZE]> {
+        self.clock += 1;
+        let clock = self.clock;
+        self.entries
+            .iter_mut()
+            .find(|e| e.iterations == iterations && e.salt == salt && &e.password_hash == password_hash)
+            .map(|e| {
+                e.last_use = clock;
+                e.key
+            })
+    }
+
+    fn store(&mut self, password_hash: &[u8; 32], salt: &[u8], iterations: u32, key: &[u8; AES_KEY_SIZE]) {
+        self.clock += 1;
+        if self.entries.len() >= KEY_CACHE_ENTRIES {
+            // Evict the least recently used key; dropping it zeroizes it
+            if let Some(oldest) = (0..self.entries.len()).min_by_key(|&i| self.entries[i].last_use) {
+                self.entries.swap_remove(oldest);
+            }
+        }
+        self.entries.push(CachedKey {
+            password_hash: *password_hash,
+            salt: salt.to_vec(),
+            iterations,
+            key: *key,
+            last_use: self.clock,
+        });
+    }
+}
+
 /// Derive a key from password and salt using PBKDF2-SHA256
 ///
-/// Uses 262,144 iterations (7-Zip default).
+/// Uses 262,144 iterations (7-Zip default). Keys are cached per process by
+/// (password hash, salt, iterations), so deriving the same key again, e.g.
+/// for many archives sharing a password, costs one SHA-256 instead of the
+/// full PBKDF2 run.
 pub fn derive_key(password: &str, salt: &[u8]) -> [u8; AES_KEY_SIZE] {
+    let mut password_hash: [u8; 32] = Sha256::digest(password.as_bytes()).into();
+    let cache = key_cache();
+
+    let cached = cache
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+        .lookup(&password_hash, salt, PBKDF2_ITERATIONS);
+    if let Some(key) = cached {
+        password_hash.zeroize();
+        return key;
+    }
+
+    // Derived outside the lock so other passwords are not held up
     let mut key = [0u8; AES_KEY_SIZE];
     pbkdf2_hmac::<Sha256>(password.as_bytes(), salt, PBKDF2_ITERATIONS, &mut key);
+    cache
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+        .store(&password_hash, salt, PBKDF2_ITERATIONS, &key);
+    password_hash.zeroize();
     key
 }
 
+/// Zeroize and drop every key held by the [`derive_key`] cache
+pub fn clear_key_cache() {
+    key_cache().lock().unwrap_or_else(|e| e.into_inner()).entries.clear();
+}
+
 /// Generate a random salt
 pub fn generate_salt() -> [u8; SALT_SIZE] {
     let mut salt = [0u8; SALT_SIZE];
@@ -410,6 +757,50 @@ mod tests {
         assert!(verify_password("wrong_password", &ciphertext, ctx.salt(), ctx.iv()).is_err());
     }
 
+    #[test]
+    fn test_parallel_decrypt_matches_sequential() {
+        let ctx = EncryptionContext::new("password").unwrap();
+        let plaintext: Vec<u8> = (0..3 * PARALLEL_DECRYPT_MIN_SEGMENT + 100).map(|i| (i * 7) as u8).collect();
+        let ciphertext = ctx.encrypt(&plaintext).unwrap();
+
+        let dec = DecryptionContext::new("password", ctx.salt()).unwrap();
+        let sequential = dec.decrypt(&ciphertext, ctx.iv()).unwrap();
+        let parallel = dec.decrypt_parallel(&ciphertext, ctx.iv(), 4).unwrap();
+        assert_eq!(sequential, plaintext);
+        assert_eq!(parallel, plaintext);
+
+        let mut buffer = ciphertext.clone();
+        let len = dec.decrypt_parallel_in_place(&mut buffer, ctx.iv(), 3).unwrap();
+        assert_eq!(&buffer[..len], plaintext.as_slice());
+    }
+
+    #[test]
+    fn test_in_place_and_streaming_match_encrypt() {
+        let ctx = EncryptionContext::new("password").unwrap();
+        let plaintext: Vec<u8> = (0..200_003).map(|i| (i * 13) as u8).collect();
+        let ciphertext = ctx.encrypt(&plaintext).unwrap();
+
+        let mut buffer = plaintext.clone();
+        assert!(ctx.encrypt_in_place(&mut buffer, plaintext.len()).is_err());
+        buffer.resize(padded_len(plaintext.len()), 0);
+        let len = ctx.encrypt_in_place(&mut buffer, plaintext.len()).unwrap();
+        assert_eq!(&buffer[..len], ciphertext.as_slice());
+        let len = ctx.decrypt_in_place(&mut buffer[..len]).unwrap();
+        assert_eq!(&buffer[..len], plaintext.as_slice());
+
+        use std::io::Write;
+        let mut writer = ctx.writer(Vec::new());
+        for piece in plaintext.chunks(7777) {
+            writer.write_all(piece).unwrap();
+        }
+        assert_eq!(writer.finish().unwrap(), ciphertext);
+
+        // Block-aligned input still ends with a whole padding block
+        let mut writer = ctx.writer(Vec::new());
+        writer.write_all(&plaintext[..ENCRYPT_CHUNK]).unwrap();
+        assert_eq!(writer.finish().unwrap(), ctx.encrypt(&plaintext[..ENCRYPT_CHUNK]).unwrap());
+    }
+
     #[test]
     fn test_key_derivation() {
         let salt = [0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
@@ -26,6 +26,10 @@ pub enum Error {
     InvalidParameter(String),
     /// Feature not implemented
     NotImplemented(String),
+    /// Stopped through a cancellation token
+    Cancelled(String),
+    /// Output buffer too small for the result
+    BufferTooSmall(String),
     /// Unknown or unspecified error
     Unknown(String),
     /// IO error
@@ -64,6 +68,12 @@ impl Error {
             SevenZipErrorCode::SEVENZIP_ERROR_NOT_IMPLEMENTED => {
                 Error::NotImplemented("Feature not implemented".to_string())
             }
+            SevenZipErrorCode::SEVENZIP_ERROR_CANCELLED => {
+                Error::Cancelled("Operation cancelled".to_string())
+            }
+            SevenZipErrorCode::SEVENZIP_ERROR_BUFFER_TOO_SMALL => {
+                Error::BufferTooSmall("Output buffer too small".to_string())
+            }
             SevenZipErrorCode::SEVENZIP_ERROR_UNKNOWN => {
                 Error::Unknown("Unknown error".to_string())
             }
@@ -81,6 +91,8 @@ impl Error {
             Error::Compress(_) => Error::Compress(msg),
             Error::InvalidParameter(_) => Error::InvalidParameter(msg),
             Error::NotImplemented(_) => Error::NotImplemented(msg),
+            Error::Cancelled(_) => Error::Cancelled(msg),
+            Error::BufferTooSmall(_) => Error::BufferTooSmall(msg),
             Error::Unknown(_) => Error::Unknown(msg),
             Error::Io(_) => Error::Io(msg),
             Error::EncryptionError(_) => Error::EncryptionError(msg),
@@ -99,6 +111,8 @@ impl fmt::Display for Error {
             Error::Compress(msg) => write!(f, "Compression failed: {}", msg),
             Error::InvalidParameter(msg) => write!(f, "Invalid parameter: {}", msg),
             Error::NotImplemented(msg) => write!(f, "Not implemented: {}", msg),
+            Error::Cancelled(msg) => write!(f, "Cancelled: {}", msg),
+            Error::BufferTooSmall(msg) => write!(f, "Buffer too small: {}", msg),
             Error::Unknown(msg) => write!(f, "Unknown error: {}", msg),
             Error::Io(msg) => write!(f, "IO error: {}", msg),
             Error::EncryptionError(msg) => write!(f, "Encryption failed: {}", msg),
@@ -22,6 +22,8 @@ pub enum SevenZipErrorCode {
     SEVENZIP_ERROR_COMPRESS = 5,
     SEVENZIP_ERROR_INVALID_PARAM = 6,
     SEVENZIP_ERROR_NOT_IMPLEMENTED = 7,
+    SEVENZIP_ERROR_CANCELLED = 8,
+    SEVENZIP_ERROR_BUFFER_TOO_SMALL = 9,
     SEVENZIP_ERROR_UNKNOWN = 99,
 }
 
@@ -45,6 +47,24 @@ pub struct SevenZipList {
     pub count: usize,
 }
 
+/// Entries of a list page as columns, from sevenzip_archive_list_columns()
+#[repr(C)]
+#[derive(Debug)]
+pub struct SevenZipListColumns {
+    pub count: usize,
+    pub names: *mut *mut c_char,
+    pub sizes: *mut u64,
+    pub modified_times: *mut u64,
+    pub attributes: *mut u32,
+    pub is_directory: *mut u8,
+}
+
+pub const SEVENZIP_FIELD_NAME: u32 = 0x01;
+pub const SEVENZIP_FIELD_SIZE: u32 = 0x02;
+pub const SEVENZIP_FIELD_MTIME: u32 = 0x04;
+pub const SEVENZIP_FIELD_ATTRIBUTES: u32 = 0x08;
+pub const SEVENZIP_FIELD_IS_DIRECTORY: u32 = 0x10;
+
 /// Progress callback function type
 pub type SevenZipProgressCallback =
     Option<unsafe extern "C" fn(completed: u64, total: u64, user_data: *mut c_void)>;
@@ -61,6 +81,58 @@ pub type SevenZipBytesProgressCallback = Option<
     ),
 >;
 
+/// Next input path of a create job, null once there are no more
+pub type SevenZipPathCallback =
+    Option<unsafe extern "C" fn(user_data: *mut c_void) -> *const c_char>;
+
+/// Volume `index` of `size` bytes at `path` is complete: closed, and on
+/// disk with `sync_volumes`; `digest` is set with `volume_digests`
+pub type SevenZipVolumeCallback = Option<
+    unsafe extern "C" fn(
+        index: u32,
+        path: *const c_char,
+        size: u64,
+        digest: *const u8,
+        user_data: *mut c_void,
+    ),
+>;
+
+/// Coders of one file, as an entry policy decides them
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct SevenZipEntryPolicy {
+    pub method: SevenZipMethod,
+    pub filter: SevenZipFilter,
+    pub level: c_int,
+    pub group: u32,
+}
+
+/// Entry policy: called per file with data with its path, size and head,
+/// and the job's own choice in `policy` to change
+pub type SevenZipEntryPolicyCallback = Option<
+    unsafe extern "C" fn(
+        path: *const c_char,
+        size: u64,
+        head: *const u8,
+        head_size: usize,
+        policy: *mut SevenZipEntryPolicy,
+        user_data: *mut c_void,
+    ),
+>;
+
+/// Completion callback of a background job, see sevenzip_submit_create()
+pub type SevenZipJobCallback = Option<
+    unsafe extern "C" fn(job: *mut SevenZipJob, result: SevenZipErrorCode, user_data: *mut c_void),
+>;
+
+/// Read callback of the .xz stream functions (`*size` in: capacity, out: bytes read)
+pub type SevenZipReadCallback =
+    Option<unsafe extern "C" fn(buf: *mut c_void, size: *mut usize, user_data: *mut c_void) -> c_int>;
+
+/// Write callback of the .xz stream functions
+pub type SevenZipWriteCallback =
+    Option<unsafe extern "C" fn(data: *const c_void, size: usize, user_data: *mut c_void) -> c_int>;
+
 /// Compression levels
 #[repr(C)]
 #[derive(Debug, Copy, Clone, PartialEq, Eq)]
@@ -73,6 +145,204 @@ pub enum SevenZipCompressionLevel {
     SEVENZIP_LEVEL_ULTRA = 9,
 }
 
+/// Branch-converter filters
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipFilter {
+    SEVENZIP_FILTER_AUTO = 0,
+    SEVENZIP_FILTER_NONE = 1,
+    SEVENZIP_FILTER_BCJ = 2,
+    SEVENZIP_FILTER_ARM64 = 3,
+    SEVENZIP_FILTER_ARM = 4,
+    SEVENZIP_FILTER_ARMT = 5,
+    SEVENZIP_FILTER_PPC = 6,
+    SEVENZIP_FILTER_SPARC = 7,
+    SEVENZIP_FILTER_IA64 = 8,
+    SEVENZIP_FILTER_DELTA = 9,
+}
+
+/// Main compression method
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipMethod {
+    SEVENZIP_METHOD_LZMA2 = 0,
+    SEVENZIP_METHOD_PPMD = 1,
+    SEVENZIP_METHOD_AUTO = 2,
+}
+
+/// Placement of encoder threads on multi-node hosts
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipNumaPolicy {
+    SEVENZIP_NUMA_OFF = 0,
+    SEVENZIP_NUMA_LOCAL = 1,
+}
+
+/// Per-file digest of a digest manifest
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipDigestAlgorithm {
+    SEVENZIP_DIGEST_SHA256 = 0,
+    SEVENZIP_DIGEST_XXH3_128 = 1,
+}
+
+/// CRCs checked while extracting
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipVerifyMode {
+    SEVENZIP_VERIFY_FILE = 0,
+    SEVENZIP_VERIFY_FOLDER = 1,
+    SEVENZIP_VERIFY_NONE = 2,
+}
+
+/// Handling of entries already extracted
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipExistingPolicy {
+    SEVENZIP_EXISTING_OVERWRITE = 0,
+    SEVENZIP_EXISTING_SKIP_SAME = 1,
+    SEVENZIP_EXISTING_SKIP_SAME_CRC = 2,
+}
+
+/// What of an extraction survives a crash
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipDurability {
+    SEVENZIP_DURABILITY_NONE = 0,
+    SEVENZIP_DURABILITY_FILE = 1,
+    SEVENZIP_DURABILITY_BATCHED = 2,
+    SEVENZIP_DURABILITY_ATOMIC = 3,
+}
+
+/// Engine picked by sevenzip_create_7z_auto
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipCreateEngine {
+    SEVENZIP_ENGINE_IN_MEMORY = 0,
+    SEVENZIP_ENGINE_STREAMING = 1,
+}
+
+/// LZMA match finder of SevenZipLzmaParams
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipMatchFinder {
+    SEVENZIP_MATCH_FINDER_AUTO = 0,
+    SEVENZIP_MATCH_FINDER_HC4 = 1,
+    SEVENZIP_MATCH_FINDER_HC5 = 2,
+    SEVENZIP_MATCH_FINDER_BT2 = 3,
+    SEVENZIP_MATCH_FINDER_BT3 = 4,
+    SEVENZIP_MATCH_FINDER_BT4 = 5,
+}
+
+/// LZMA encoder parameters over those of the level, see sevenzip_lzma_params_init()
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct SevenZipLzmaParams {
+    pub match_finder: SevenZipMatchFinder,
+    pub algorithm: c_int,
+    pub fast_bytes: c_int,
+    pub match_cycles: u32,
+    pub lc: c_int,
+    pub lp: c_int,
+    pub pb: c_int,
+}
+
+/// Integrity check of .xz blocks
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipXzCheck {
+    SEVENZIP_XZ_CHECK_NONE = 0,
+    SEVENZIP_XZ_CHECK_CRC32 = 1,
+    SEVENZIP_XZ_CHECK_CRC64 = 4,
+    SEVENZIP_XZ_CHECK_SHA256 = 10,
+}
+
+/// Direction of a streaming cipher context
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipCryptMode {
+    SEVENZIP_CRYPT_ENCRYPT = 0,
+    SEVENZIP_CRYPT_DECRYPT = 1,
+}
+
+/// Opaque streaming cipher context
+#[repr(C)]
+pub struct SevenZipCryptContext {
+    _private: [u8; 0],
+}
+
+/// Opaque archive opened by sevenzip_open()
+#[repr(C)]
+pub struct SevenZipArchive {
+    _private: [u8; 0],
+}
+
+/// Opaque catalog mapped by sevenzip_catalog_open()
+#[repr(C)]
+pub struct SevenZipCatalog {
+    _private: [u8; 0],
+}
+
+/// folder_index of a SevenZipCatalogHit without data
+pub const SEVENZIP_CATALOG_NO_FOLDER: u32 = 0xFFFF_FFFF;
+
+/// One entry a catalog lookup found
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipCatalogHit {
+    pub archive_path: *const c_char,
+    pub archive_index: u32,
+    pub entry_index: u32,
+    pub folder_index: u32,
+    pub size: u64,
+    pub pack_offset: u64,
+    pub is_directory: c_int,
+}
+
+/// Positioned reads of an archive opened with sevenzip_open_range()
+#[repr(C)]
+pub struct SevenZipRangeReader {
+    pub read_at: Option<unsafe extern "C" fn(*mut c_void, u64, *mut c_void, usize) -> c_int>,
+    pub size: u64,
+    pub user_data: *mut c_void,
+}
+
+/// Opaque reader of one file of an open archive, see sevenzip_entry_reader_open()
+#[repr(C)]
+pub struct SevenZipEntryReader {
+    _private: [u8; 0],
+}
+
+/// Opaque streaming encoder, see sevenzip_encoder_create()
+#[repr(C)]
+pub struct SevenZipEncoder {
+    _private: [u8; 0],
+}
+
+/// Opaque streaming decoder, see sevenzip_decoder_create()
+#[repr(C)]
+pub struct SevenZipDecoder {
+    _private: [u8; 0],
+}
+
+/// Opaque background job, see sevenzip_submit_create()
+#[repr(C)]
+pub struct SevenZipJob {
+    _private: [u8; 0],
+}
+
+/// Opaque cancellation token, see sevenzip_cancel_token_create()
+#[repr(C)]
+pub struct SevenZipCancelToken {
+    _private: [u8; 0],
+}
+
+/// Opaque read and write bandwidth budget, see sevenzip_rate_limit_create()
+#[repr(C)]
+pub struct SevenZipRateLimit {
+    _private: [u8; 0],
+}
+
 /// Advanced compression options
 #[repr(C)]
 #[derive(Debug, Clone)]
@@ -81,8 +351,100 @@ pub struct SevenZipCompressOptions {
     pub dict_size: u64,
     pub solid: c_int,
     pub password: *const c_char,
+    pub solid_block_size: u64,
+    pub solid_block_files: c_int,
+    pub filter: SevenZipFilter,
+    pub delta_distance: c_int,
+    pub delta_extensions: *const c_char,
+    pub method: SevenZipMethod,
+    pub ppmd_order: c_int,
+    pub ppmd_mem_size: u32,
+    pub max_memory: u64,
+    pub cancel: *mut SevenZipCancelToken,
+    pub block_size: u64,
+    pub thread_weight: c_int,
+    pub numa_policy: SevenZipNumaPolicy,
+    pub detect_compressed: c_int,
+    pub lzma_params: *const SevenZipLzmaParams,
+    pub solid_sort: c_int,
+    pub dedup_chunk_size: u32,
 }
 
+/// One entry of a pre-scanned input table (sevenzip_create_7z_from_table())
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipInputEntry {
+    pub path: *const c_char,
+    pub name: *const c_char,
+    pub size: u64,
+    pub mtime: u64,
+    pub attrib: u32,
+    pub is_dir: c_int,
+}
+
+/// One archive of a sevenzip_create_7z_batch() call
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipBatchEntry {
+    pub archive_path: *const c_char,
+    pub input_paths: *const *const c_char,
+}
+
+/// Work sevenzip_archive_batch() does on each archive
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipArchiveBatchMode {
+    SEVENZIP_ARCHIVE_BATCH_LIST = 0,
+    SEVENZIP_ARCHIVE_BATCH_TEST = 1,
+}
+
+/// Files of one name in several merged archives
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipMergeNames {
+    SEVENZIP_MERGE_RENAME = 0,
+    SEVENZIP_MERGE_KEEP_ALL = 1,
+}
+
+/// sevenzip_merge_archives() options
+#[repr(C)]
+#[derive(Debug, Clone)]
+pub struct SevenZipMergeOptions {
+    pub names: SevenZipMergeNames,
+    pub drop_identical: c_int,
+    pub split_size: u64,
+}
+
+/// sevenzip_archive_batch() options
+#[repr(C)]
+#[derive(Debug, Clone)]
+pub struct SevenZipArchiveBatchOptions {
+    pub mode: SevenZipArchiveBatchMode,
+    pub num_threads: c_int,
+    pub io_depth: c_int,
+    pub thread_weight: c_int,
+    pub cancel: *mut SevenZipCancelToken,
+}
+
+/// Outcome of one archive of a sevenzip_archive_batch() call
+#[repr(C)]
+#[derive(Debug)]
+pub struct SevenZipArchiveBatchResult {
+    pub index: usize,
+    pub archive_path: *const c_char,
+    pub result: SevenZipErrorCode,
+    pub list: *const SevenZipList,
+    pub num_folders: u32,
+    pub unpacked_size: u64,
+    pub packed_size: u64,
+    pub tested_bytes: u64,
+}
+
+/// Receives each archive of a batch as it finishes; nonzero stops the batch
+pub type SevenZipArchiveBatchCallback = Option<
+    unsafe extern "C" fn(result: *const SevenZipArchiveBatchResult, user_data: *mut c_void) -> c_int,
+>;
+
 /// Streaming compression options for large files and split archives
 #[repr(C)]
 #[derive(Debug, Clone)]
@@ -95,6 +457,236 @@ pub struct SevenZipStreamOptions {
     pub chunk_size: u64,
     pub temp_dir: *const c_char,
     pub delete_temp_on_error: c_int,
+    pub prefetch_buffers: c_int,
+    pub solid_block_size: u64,
+    pub solid_block_files: c_int,
+    pub filter: SevenZipFilter,
+    pub delta_distance: c_int,
+    pub delta_extensions: *const c_char,
+    pub method: SevenZipMethod,
+    pub ppmd_order: c_int,
+    pub ppmd_mem_size: u32,
+    pub max_memory: u64,
+    pub unbuffered_output: c_int,
+    pub input_access_hints: c_int,
+    pub progress_interval_ms: c_int,
+    pub progress_interval_bytes: u64,
+    pub cancel: *mut SevenZipCancelToken,
+    pub checkpoint: c_int,
+    pub block_size: u64,
+    pub thread_weight: c_int,
+    pub numa_policy: SevenZipNumaPolicy,
+    pub volume_dirs: *const *const c_char,
+    pub digest_manifest: *const c_char,
+    pub digest_algorithm: SevenZipDigestAlgorithm,
+    pub snapshot_base: *const c_char,
+    pub snapshot_output: *const c_char,
+    pub detect_compressed: c_int,
+    pub lzma_params: *const SevenZipLzmaParams,
+    pub sync_volumes: c_int,
+    pub volume_complete: SevenZipVolumeCallback,
+    pub volume_user_data: *mut c_void,
+    pub volume_digests: c_int,
+    pub volume_manifest: *const c_char,
+    pub write_index: c_int,
+    pub zero_blocks: c_int,
+    pub memory_pressure_throttle: c_int,
+    pub rate_limit: *mut SevenZipRateLimit,
+    pub next_input_path: SevenZipPathCallback,
+    pub input_path_user_data: *mut c_void,
+    pub input_list: *const c_char,
+    pub verify_writes: c_int,
+    pub group_duplicates: c_int,
+    pub solid_sort: c_int,
+    pub streamable: c_int,
+    pub streamable_reserve: u64,
+    pub folder_stats: c_int,
+    pub throughput_target: f64,
+    pub entry_policy: SevenZipEntryPolicyCallback,
+    pub entry_policy_data: *mut c_void,
+    pub deterministic: c_int,
+    pub fixed_mtime: i64,
+    pub block_cache_dir: *const c_char,
+    pub include_patterns: *const *const c_char,
+    pub exclude_patterns: *const *const c_char,
+    pub parity_volumes: u32,
+}
+
+/// CPU scheduling of library threads
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipSchedPolicy {
+    SEVENZIP_SCHED_NORMAL = 0,
+    SEVENZIP_SCHED_BATCH = 1,
+    SEVENZIP_SCHED_IDLE = 2,
+}
+
+/// Disk scheduling of library threads
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipIoPriority {
+    SEVENZIP_IO_NORMAL = 0,
+    SEVENZIP_IO_LOW = 1,
+    SEVENZIP_IO_IDLE = 2,
+}
+
+/// Library-wide settings for sevenzip_init_with_options()
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipInitOptions {
+    pub max_threads: c_int,
+    pub max_jobs: c_int,
+    pub cpu_affinity: *const c_char,
+    pub sched_policy: SevenZipSchedPolicy,
+    pub nice: c_int,
+    pub io_priority: SevenZipIoPriority,
+    pub decoder_pool_bytes: i64,
+}
+
+/// Opaque service started by sevenzip_service_start()
+#[repr(C)]
+pub struct SevenZipService {
+    _private: [u8; 0],
+}
+
+/// Options for sevenzip_service_start()
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipServiceOptions {
+    pub max_clients: c_int,
+    pub max_archives: c_int,
+    pub cache_budget: u64,
+    pub socket_mode: c_int,
+}
+
+/// Extraction options
+#[repr(C)]
+#[derive(Debug, Clone)]
+pub struct SevenZipExtractOptions {
+    pub num_threads: c_int,
+    pub lzma2_threads: c_int,
+    pub writer_threads: c_int,
+    pub sparse_output: c_int,
+    pub progress_interval_ms: c_int,
+    pub cancel: *mut SevenZipCancelToken,
+    pub thread_weight: c_int,
+    pub volume_readahead: c_int,
+    pub verify: SevenZipVerifyMode,
+    pub existing: SevenZipExistingPolicy,
+    pub max_memory: u64,
+    pub cache_neutral_output: c_int,
+    pub consume_volumes: c_int,
+    pub volume_consumed: SevenZipVolumeCallback,
+    pub volume_consumed_user_data: *mut c_void,
+    pub checkpoint_path: *const c_char,
+    pub durability: SevenZipDurability,
+    pub follow_timeout_ms: c_int,
+    pub include_patterns: *const *const c_char,
+    pub exclude_patterns: *const *const c_char,
+}
+
+/// Standalone .lzma/.lzma2 decompression options
+#[repr(C)]
+#[derive(Debug, Clone)]
+pub struct SevenZipDecompressOptions {
+    pub num_threads: c_int,
+    pub output_step: usize,
+}
+
+/// Layout of the data sevenzip_compress_buffer() writes
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum SevenZipBufferFormat {
+    SEVENZIP_BUFFER_LZMA = 0,
+    SEVENZIP_BUFFER_LZMA2 = 1,
+    SEVENZIP_BUFFER_7Z = 2,
+}
+
+/// In-memory compression options
+#[repr(C)]
+#[derive(Debug, Clone)]
+pub struct SevenZipBufferOptions {
+    pub num_threads: c_int,
+    pub entry_name: *const c_char,
+    pub lzma_params: *const SevenZipLzmaParams,
+}
+
+/// .xz compression and decompression options
+#[repr(C)]
+#[derive(Debug, Clone)]
+pub struct SevenZipXzOptions {
+    pub num_threads: c_int,
+    pub dict_size: u64,
+    pub block_size: u64,
+    pub check: SevenZipXzCheck,
+}
+
+/// Entry callbacks of sevenzip_extract_to_sink(); `data` is only valid during `write`
+#[repr(C)]
+pub struct SevenZipExtractSink {
+    pub begin_entry: Option<
+        unsafe extern "C" fn(entry_index: u32, name: *const c_char, size: u64, user_data: *mut c_void) -> c_int,
+    >,
+    pub write: Option<
+        unsafe extern "C" fn(entry_index: u32, data: *const c_void, size: usize, user_data: *mut c_void) -> c_int,
+    >,
+    pub end_entry: Option<unsafe extern "C" fn(entry_index: u32, user_data: *mut c_void) -> c_int>,
+    pub user_data: *mut c_void,
+}
+
+/// Volume callbacks of sevenzip_create_7z_to_sink(); `patch` overwrites bytes of volume 0
+#[repr(C)]
+pub struct SevenZipArchiveSink {
+    pub begin_volume: Option<unsafe extern "C" fn(volume_index: u32, user_data: *mut c_void) -> c_int>,
+    pub write: Option<
+        unsafe extern "C" fn(volume_index: u32, data: *const c_void, size: usize, user_data: *mut c_void) -> c_int,
+    >,
+    pub patch: Option<
+        unsafe extern "C" fn(offset: u64, data: *const c_void, size: usize, user_data: *mut c_void) -> c_int,
+    >,
+    pub end_volume: Option<unsafe extern "C" fn(volume_index: u32, size: u64, user_data: *mut c_void) -> c_int>,
+    pub user_data: *mut c_void,
+}
+
+/// SevenZipSourceEntry::size of an entry read until its callback ends it
+pub const SEVENZIP_SIZE_UNKNOWN: u64 = u64::MAX;
+
+/// SevenZipVfsStat::entry_index of a directory only implied by other paths
+pub const SEVENZIP_VFS_NO_ENTRY: u32 = u32::MAX;
+
+/// A file or directory of an open archive's tree
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipVfsStat {
+    pub entry_index: u32,
+    pub size: u64,
+    pub modified_time: u64,
+    pub attributes: u32,
+    pub is_directory: c_int,
+}
+
+/// Child callback of sevenzip_archive_readdir (nonzero stops the listing)
+pub type SevenZipVfsDirCallback = Option<
+    unsafe extern "C" fn(name: *const c_char, stat: *const SevenZipVfsStat, user_data: *mut c_void) -> c_int,
+>;
+
+/// Entry filled in by the next_entry callback of sevenzip_create_7z_from_source()
+#[repr(C)]
+pub struct SevenZipSourceEntry {
+    pub name: *const c_char,
+    pub size: u64,
+    pub mtime: i64,
+    pub is_dir: c_int,
+    pub read: SevenZipReadCallback,
+    pub read_user_data: *mut c_void,
+    pub attributes: u32,
+}
+
+/// Entry producer of sevenzip_create_7z_from_source(); a NULL name ends the archive
+#[repr(C)]
+pub struct SevenZipEntrySource {
+    pub next_entry: Option<unsafe extern "C" fn(entry: *mut SevenZipSourceEntry, user_data: *mut c_void) -> c_int>,
+    pub user_data: *mut c_void,
 }
 
 /// AES encryption constants
@@ -111,8 +703,18 @@ extern "C" {
     /// Initialize the 7z library
     pub fn sevenzip_init() -> SevenZipErrorCode;
     
+    /// Initialize the 7z library with a thread quota shared by all jobs (NULL = no quota)
+    pub fn sevenzip_init_with_options(options: *const SevenZipInitOptions) -> SevenZipErrorCode;
+    
     /// Cleanup the 7z library
     pub fn sevenzip_cleanup();
+    
+    /// Threads the "auto" thread counts are sized for: online CPUs within the
+    /// affinity mask and the cgroup CPU quota
+    pub fn sevenzip_hardware_threads() -> c_int;
+    
+    /// Back large encoder and decoder buffers with huge pages
+    pub fn sevenzip_set_large_pages(enable: c_int) -> SevenZipErrorCode;
 
     // ============================================================================
     // Archive Extraction Functions
@@ -127,6 +729,44 @@ extern "C" {
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
+    /// Initialize extraction options with defaults
+    pub fn sevenzip_extract_options_init(options: *mut SevenZipExtractOptions);
+
+    /// Extract a 7z archive, decoding independent folders in parallel
+    pub fn sevenzip_extract_with_options(
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        password: *const c_char,
+        options: *const SevenZipExtractOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Extract a streamable archive read front to back from a callback
+    pub fn sevenzip_extract_from_stream(
+        read_callback: SevenZipReadCallback,
+        output_dir: *const c_char,
+        options: *const SevenZipExtractOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Extract a streamable archive while its file or volumes are still arriving
+    pub fn sevenzip_extract_following(
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        options: *const SevenZipExtractOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Estimate the peak decoder memory of sevenzip_extract_with_options()
+    pub fn sevenzip_estimate_extract_memory(
+        archive_path: *const c_char,
+        options: *const SevenZipExtractOptions,
+        peak_bytes: *mut u64,
+    ) -> SevenZipErrorCode;
+
     /// Extract specific files from a 7z archive
     pub fn sevenzip_extract_files(
         archive_path: *const c_char,
@@ -137,6 +777,31 @@ extern "C" {
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
+    /// Extract one file, starting at the nearest LZMA2 dictionary reset
+    pub fn sevenzip_extract_file_fast(
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        file_name: *const c_char,
+        password: *const c_char,
+    ) -> SevenZipErrorCode;
+
+    /// Stream an archive out as a tar archive through a write callback
+    pub fn sevenzip_export_tar(
+        archive_path: *const c_char,
+        password: *const c_char,
+        options: *const SevenZipExtractOptions,
+        write_callback: SevenZipWriteCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Extract entries into callbacks, handing out the decoder's output window
+    pub fn sevenzip_extract_to_sink(
+        archive_path: *const c_char,
+        files: *const *const c_char,
+        password: *const c_char,
+        sink: *const SevenZipExtractSink,
+    ) -> SevenZipErrorCode;
+
     /// Extract a multi-file archive created with sevenzip_create_archive()
     pub fn sevenzip_extract_archive(
         archive_path: *const c_char,
@@ -146,6 +811,22 @@ extern "C" {
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
+    /// Extract a multi-file archive on several threads
+    pub fn sevenzip_extract_archive_with_options(
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        options: *const SevenZipExtractOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Extract one file of a multi-file archive
+    pub fn sevenzip_extract_archive_file(
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        file_name: *const c_char,
+    ) -> SevenZipErrorCode;
+
     // ============================================================================
     // Archive Creation Functions
     // ============================================================================
@@ -170,6 +851,16 @@ extern "C" {
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
+    /// Create a multi-file archive, compressing several files at once
+    pub fn sevenzip_create_archive_with_options(
+        archive_path: *const c_char,
+        input_paths: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipCompressOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
     /// Create a standard .7z archive (compatible with 7-Zip)
     pub fn sevenzip_create_7z(
         archive_path: *const c_char,
@@ -180,12 +871,95 @@ extern "C" {
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
+    /// Create a .7z archive from an input table the caller already scanned
+    pub fn sevenzip_create_7z_from_table(
+        archive_path: *const c_char,
+        entries: *const SevenZipInputEntry,
+        count: usize,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipCompressOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Create many small .7z archives in one call, one result per entry
+    pub fn sevenzip_create_7z_batch(
+        entries: *const SevenZipBatchEntry,
+        count: usize,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipCompressOptions,
+        results: *mut SevenZipErrorCode,
+    ) -> SevenZipErrorCode;
+
+    /// Add new and changed files to an existing .7z archive
+    pub fn sevenzip_update_archive(
+        archive_path: *const c_char,
+        input_paths: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipCompressOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Remove entries from a .7z archive, repacking only the folders they were in
+    pub fn sevenzip_delete_entries(
+        archive_path: *const c_char,
+        entry_names: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipCompressOptions,
+        deleted_count: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Compress a subset of the inputs into a part for sevenzip_assemble_archive
+    pub fn sevenzip_compress_folder_part(
+        part_path: *const c_char,
+        input_paths: *const *const c_char,
+        name_prefix: *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipCompressOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Concatenate parts into one archive (split when split_size > 0), writing only a new header
+    pub fn sevenzip_assemble_archive(
+        archive_path: *const c_char,
+        part_paths: *const *const c_char,
+        split_size: u64,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Initialize merge options with defaults
+    pub fn sevenzip_merge_options_init(options: *mut SevenZipMergeOptions);
+
+    /// Merge .7z archives into one without recompressing
+    pub fn sevenzip_merge_archives(
+        archive_path: *const c_char,
+        input_paths: *const *const c_char,
+        options: *const SevenZipMergeOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Cut a split archive into volumes of another size, or join it into one file
+    pub fn sevenzip_resplit_archive(
+        src_first_volume: *const c_char,
+        dst_base: *const c_char,
+        new_split_size: u64,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
     // ============================================================================
     // Streaming Compression (Large Files & Split Archives)
     // ============================================================================
     
     /// Initialize streaming options with defaults
     pub fn sevenzip_stream_options_init(options: *mut SevenZipStreamOptions);
+
+    /// Initialize LZMA encoder parameters to those of the level
+    pub fn sevenzip_lzma_params_init(params: *mut SevenZipLzmaParams);
     
     /// Create a 7z archive with streaming compression (handles large files and splits)
     pub fn sevenzip_create_7z_streaming(
@@ -196,9 +970,72 @@ extern "C" {
         progress_callback: SevenZipBytesProgressCallback,
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
+
+    /// Create a 7z archive whose volumes go to sink callbacks instead of files
+    pub fn sevenzip_create_7z_to_sink(
+        input_paths: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+        sink: *const SevenZipArchiveSink,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Recompress an archive file by file, decoding and encoding at once
+    pub fn sevenzip_transcode_archive(
+        source_path: *const c_char,
+        archive_path: *const c_char,
+        password: *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Create a 7z archive from entries produced by callbacks instead of files
+    pub fn sevenzip_create_7z_from_source(
+        archive_path: *const c_char,
+        source: *const SevenZipEntrySource,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Finish an interrupted split `sevenzip_create_7z_streaming` job from its checkpoint
+    pub fn sevenzip_resume_multivolume(
+        archive_path: *const c_char,
+        options: *const SevenZipStreamOptions,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Estimate the peak memory of `sevenzip_create_7z_streaming` for these options
+    pub fn sevenzip_estimate_memory(
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+        peak_bytes: *mut u64,
+    ) -> SevenZipErrorCode;
+    
+    /// Engine `sevenzip_create_7z_auto` would run for these inputs
+    pub fn sevenzip_choose_create_engine(
+        input_paths: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+        engine: *mut SevenZipCreateEngine,
+    ) -> SevenZipErrorCode;
+    
+    /// Create a 7z archive in memory for a few small files, streaming otherwise
+    pub fn sevenzip_create_7z_auto(
+        archive_path: *const c_char,
+        input_paths: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
     
-    /// Create a 7z archive using TRUE streaming (processes in chunks, ~250MB RAM max)
-    /// This is the recommended function for large archives (10GB+) to avoid OOM crashes
+    /// Create a 7z archive with every file in one solid folder
     pub fn sevenzip_create_7z_true_streaming(
         archive_path: *const c_char,
         input_paths: *const *const c_char,
@@ -217,6 +1054,16 @@ extern "C" {
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
+    /// Streaming extraction with independent folders decoded in parallel
+    pub fn sevenzip_extract_streaming_with_options(
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        password: *const c_char,
+        options: *const SevenZipExtractOptions,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
     /// Compress files with streaming support and split archives
     pub fn sevenzip_compress_stream(
         archive_path: *const c_char,
@@ -227,36 +1074,200 @@ extern "C" {
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
-    /// Resume interrupted compression from checkpoint
-    pub fn sevenzip_compress_resume(
-        archive_path: *const c_char,
-        checkpoint_path: *const c_char,
-        progress_callback: SevenZipBytesProgressCallback,
+    /// Resume interrupted compression from checkpoint
+    pub fn sevenzip_compress_resume(
+        archive_path: *const c_char,
+        checkpoint_path: *const c_char,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    // ============================================================================
+    // Archive Inspection Functions
+    // ============================================================================
+    
+    /// List contents of a 7z archive
+    pub fn sevenzip_list(
+        archive_path: *const c_char,
+        password: *const c_char,
+        list: *mut *mut SevenZipList,
+    ) -> SevenZipErrorCode;
+
+    /// List an archive from its .7zidx sidecar, without opening a volume
+    pub fn sevenzip_list_index(
+        index_path: *const c_char,
+        list: *mut *mut SevenZipList,
+    ) -> SevenZipErrorCode;
+
+    /// Write a catalog of every entry of many archives, sorted by path
+    pub fn sevenzip_catalog_build(
+        archive_paths: *const *const c_char,
+        count: usize,
+        catalog_path: *const c_char,
+    ) -> SevenZipErrorCode;
+
+    /// Map a catalog for lookups
+    pub fn sevenzip_catalog_open(
+        catalog_path: *const c_char,
+        catalog: *mut *mut SevenZipCatalog,
+    ) -> SevenZipErrorCode;
+
+    /// Find the entries named `path` across the catalogued archives
+    pub fn sevenzip_catalog_lookup(
+        catalog: *const SevenZipCatalog,
+        path: *const c_char,
+        hits: *mut SevenZipCatalogHit,
+        max_hits: usize,
+        count: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Unmap a catalog
+    pub fn sevenzip_catalog_close(catalog: *mut SevenZipCatalog);
+
+    /// Free memory allocated by sevenzip_list
+    pub fn sevenzip_free_list(list: *mut SevenZipList);
+
+    /// Open an archive and parse its header once
+    pub fn sevenzip_open(
+        archive_path: *const c_char,
+        password: *const c_char,
+        archive: *mut *mut SevenZipArchive,
+    ) -> SevenZipErrorCode;
+
+    /// Open an archive through a read-at-offset callback
+    pub fn sevenzip_open_range(
+        reader: *const SevenZipRangeReader,
+        password: *const c_char,
+        archive: *mut *mut SevenZipArchive,
+    ) -> SevenZipErrorCode;
+
+    /// List the entries of an open archive
+    pub fn sevenzip_archive_list(
+        archive: *mut SevenZipArchive,
+        list: *mut *mut SevenZipList,
+    ) -> SevenZipErrorCode;
+
+    /// List a page of the entries of an open archive
+    pub fn sevenzip_archive_list_page(
+        archive: *mut SevenZipArchive,
+        first_index: u32,
+        max_entries: u32,
+        list: *mut *mut SevenZipList,
+    ) -> SevenZipErrorCode;
+
+    /// Number of entries of an open archive
+    pub fn sevenzip_archive_entry_count(archive: *const SevenZipArchive) -> u32;
+
+    /// List a page of an open archive, only the requested columns
+    pub fn sevenzip_archive_list_columns(
+        archive: *mut SevenZipArchive,
+        first_index: u32,
+        max_entries: u32,
+        fields: u32,
+        columns: *mut *mut SevenZipListColumns,
+    ) -> SevenZipErrorCode;
+
+    /// Free columns allocated by sevenzip_archive_list_columns
+    pub fn sevenzip_free_list_columns(columns: *mut SevenZipListColumns);
+
+    /// Pass one file of an open archive to a sink
+    pub fn sevenzip_archive_extract_entry(
+        archive: *mut SevenZipArchive,
+        entry_index: u32,
+        sink: *const SevenZipExtractSink,
+    ) -> SevenZipErrorCode;
+
+    /// Pass files of an open archive to a sink in the order of their data,
+    /// each folder decoded at most once
+    pub fn sevenzip_archive_extract_entries(
+        archive: *mut SevenZipArchive,
+        entry_indices: *const u32,
+        count: u32,
+        sink: *const SevenZipExtractSink,
+    ) -> SevenZipErrorCode;
+
+    /// Largest folder decoded whole and kept by sevenzip_archive_extract_entry (0 = none)
+    pub fn sevenzip_archive_set_folder_cache(archive: *mut SevenZipArchive, max_folder_size: u64);
+
+    /// Total of the folders kept decoded, least recently read dropped first (0 = none)
+    pub fn sevenzip_archive_set_cache_budget(archive: *mut SevenZipArchive, total_bytes: u64);
+
+    /// Open one file of an open archive for reading
+    pub fn sevenzip_entry_reader_open(
+        archive: *mut SevenZipArchive,
+        entry_index: u32,
+        reader: *mut *mut SevenZipEntryReader,
+    ) -> SevenZipErrorCode;
+
+    /// Read the next bytes of the file; size is capacity in, bytes read out (0 at the end)
+    pub fn sevenzip_entry_reader_read(
+        reader: *mut SevenZipEntryReader,
+        buffer: *mut c_void,
+        size: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Close a reader, stopping its decoder
+    pub fn sevenzip_entry_reader_close(reader: *mut SevenZipEntryReader);
+
+    /// Read bytes at an offset of one file of an open archive
+    pub fn sevenzip_archive_pread(
+        archive: *mut SevenZipArchive,
+        entry_index: u32,
+        offset: u64,
+        buffer: *mut c_void,
+        size: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Look up a path of an open archive's tree
+    pub fn sevenzip_archive_stat(
+        archive: *mut SevenZipArchive,
+        path: *const c_char,
+        stat: *mut SevenZipVfsStat,
+    ) -> SevenZipErrorCode;
+
+    /// List the children of a directory of an open archive's tree
+    pub fn sevenzip_archive_readdir(
+        archive: *mut SevenZipArchive,
+        path: *const c_char,
+        callback: SevenZipVfsDirCallback,
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
-    // ============================================================================
-    // Archive Inspection Functions
-    // ============================================================================
-    
-    /// List contents of a 7z archive
-    pub fn sevenzip_list(
+    /// Close an archive opened with sevenzip_open
+    pub fn sevenzip_close(archive: *mut SevenZipArchive);
+
+    /// Test archive integrity without extracting
+    pub fn sevenzip_test_archive(
         archive_path: *const c_char,
         password: *const c_char,
-        list: *mut *mut SevenZipList,
+        progress_callback: SevenZipBytesProgressCallback,
+        user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
-    /// Free memory allocated by sevenzip_list
-    pub fn sevenzip_free_list(list: *mut SevenZipList);
-
-    /// Test archive integrity without extracting
-    pub fn sevenzip_test_archive(
+    /// Test archive integrity with independent folders verified in parallel
+    pub fn sevenzip_test_archive_with_options(
         archive_path: *const c_char,
         password: *const c_char,
+        options: *const SevenZipExtractOptions,
         progress_callback: SevenZipBytesProgressCallback,
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
 
+    /// List or test many archives on one pool, results as each finishes
+    pub fn sevenzip_archive_batch(
+        archive_paths: *const *const c_char,
+        count: usize,
+        options: *const SevenZipArchiveBatchOptions,
+        callback: SevenZipArchiveBatchCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Estimate a file's entropy in bits per byte from windows sampled across it
+    pub fn sevenzip_estimate_entropy(
+        path: *const c_char,
+        bits_per_byte: *mut f64,
+    ) -> SevenZipErrorCode;
+
     // ============================================================================
     // Single File Compression/Decompression
     // ============================================================================
@@ -319,6 +1330,16 @@ extern "C" {
         plaintext_len: *mut usize,
     ) -> SevenZipErrorCode;
 
+    pub fn sevenzip_decrypt_data_parallel(
+        aes_context: *mut u32,
+        iv: *const u8,
+        ciphertext: *const u8,
+        ciphertext_len: usize,
+        plaintext: *mut u8,
+        plaintext_len: *mut usize,
+        num_threads: c_int,
+    ) -> SevenZipErrorCode;
+
     /// Verify password correctness by decrypting test block
     pub fn sevenzip_verify_password(
         password: *const c_char,
@@ -329,6 +1350,28 @@ extern "C" {
         iv: *const u8,
     ) -> SevenZipErrorCode;
 
+    pub fn sevenzip_clear_key_cache();
+
+    pub fn sevenzip_crypt_create(
+        mode: SevenZipCryptMode,
+        key: *const u8,
+        iv: *const u8,
+        ctx: *mut *mut SevenZipCryptContext,
+    ) -> SevenZipErrorCode;
+
+    pub fn sevenzip_crypt_update(
+        ctx: *mut SevenZipCryptContext,
+        buf: *mut u8,
+        len: usize,
+    ) -> SevenZipErrorCode;
+
+    pub fn sevenzip_crypt_reset(
+        ctx: *mut SevenZipCryptContext,
+        iv: *const u8,
+    ) -> SevenZipErrorCode;
+
+    pub fn sevenzip_crypt_free(ctx: *mut SevenZipCryptContext);
+
     // ============================================================================
     // LZMA/LZMA2 Raw Compression (Missing Functions)
     // ============================================================================
@@ -348,6 +1391,172 @@ extern "C" {
         progress_callback: SevenZipProgressCallback,
         user_data: *mut c_void,
     ) -> SevenZipErrorCode;
+
+    /// Decompress a standalone LZMA2 file on several threads
+    pub fn sevenzip_decompress_lzma2_mt(
+        lzma2_path: *const c_char,
+        output_path: *const c_char,
+        num_threads: c_int,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Initialize standalone decompression options with defaults
+    pub fn sevenzip_decompress_options_init(options: *mut SevenZipDecompressOptions);
+
+    /// Decompress a standalone LZMA file with options
+    pub fn sevenzip_decompress_lzma_with_options(
+        lzma_path: *const c_char,
+        output_path: *const c_char,
+        options: *const SevenZipDecompressOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Decompress a standalone LZMA2 file with options
+    pub fn sevenzip_decompress_lzma2_with_options(
+        lzma2_path: *const c_char,
+        output_path: *const c_char,
+        options: *const SevenZipDecompressOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+    
+    /// Initialize in-memory compression options with defaults
+    pub fn sevenzip_buffer_options_init(options: *mut SevenZipBufferOptions);
+
+    /// Largest output sevenzip_compress_buffer() can produce (0 = unknown format or too large)
+    pub fn sevenzip_compress_buffer_bound(
+        format: SevenZipBufferFormat,
+        input_size: usize,
+        options: *const SevenZipBufferOptions,
+    ) -> usize;
+
+    /// Compress a buffer into a caller buffer; output_size is capacity in, bytes written out
+    pub fn sevenzip_compress_buffer(
+        format: SevenZipBufferFormat,
+        input: *const c_void,
+        input_size: usize,
+        output: *mut c_void,
+        output_size: *mut usize,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipBufferOptions,
+    ) -> SevenZipErrorCode;
+
+    /// Size sevenzip_decompress_buffer() will produce, from the headers
+    pub fn sevenzip_decompress_buffer_size(
+        format: SevenZipBufferFormat,
+        input: *const c_void,
+        input_size: usize,
+        size: *mut u64,
+    ) -> SevenZipErrorCode;
+
+    /// Decompress a buffer into a caller buffer; output_size is capacity in, bytes written out
+    pub fn sevenzip_decompress_buffer(
+        format: SevenZipBufferFormat,
+        input: *const c_void,
+        input_size: usize,
+        output: *mut c_void,
+        output_size: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Create a streaming .lzma / LZMA2 encoder
+    pub fn sevenzip_encoder_create(
+        format: SevenZipBufferFormat,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipBufferOptions,
+        encoder: *mut *mut SevenZipEncoder,
+    ) -> SevenZipErrorCode;
+
+    /// Feed input and take compressed output; sizes are capacity in, bytes moved out
+    pub fn sevenzip_encoder_update(
+        encoder: *mut SevenZipEncoder,
+        input: *const c_void,
+        input_size: *mut usize,
+        output: *mut c_void,
+        output_size: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// End the input and take the rest of the output, until finished is set
+    pub fn sevenzip_encoder_finish(
+        encoder: *mut SevenZipEncoder,
+        output: *mut c_void,
+        output_size: *mut usize,
+        finished: *mut c_int,
+    ) -> SevenZipErrorCode;
+
+    /// Free an encoder, stopping it if the stream is not finished
+    pub fn sevenzip_encoder_free(encoder: *mut SevenZipEncoder);
+
+    /// Create a streaming .lzma / LZMA2 decoder
+    pub fn sevenzip_decoder_create(
+        format: SevenZipBufferFormat,
+        decoder: *mut *mut SevenZipDecoder,
+    ) -> SevenZipErrorCode;
+
+    /// Feed compressed input and take decompressed output; sizes are capacity in, bytes moved out
+    pub fn sevenzip_decoder_update(
+        decoder: *mut SevenZipDecoder,
+        input: *const c_void,
+        input_size: *mut usize,
+        output: *mut c_void,
+        output_size: *mut usize,
+        finished: *mut c_int,
+    ) -> SevenZipErrorCode;
+
+    /// Free a decoder
+    pub fn sevenzip_decoder_free(decoder: *mut SevenZipDecoder);
+
+    /// Initialize .xz options with defaults
+    pub fn sevenzip_xz_options_init(options: *mut SevenZipXzOptions);
+
+    /// Compress a file to .xz, blocks in parallel
+    pub fn sevenzip_compress_xz(
+        input_path: *const c_char,
+        xz_path: *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipXzOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Decompress a .xz file, blocks in parallel
+    pub fn sevenzip_decompress_xz(
+        xz_path: *const c_char,
+        output_path: *const c_char,
+        options: *const SevenZipXzOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Rewrap an LZMA2 folder of an archive as a .xz file
+    pub fn sevenzip_remux_to_xz(
+        archive_path: *const c_char,
+        folder_index: u32,
+        xz_path: *const c_char,
+        check: SevenZipXzCheck,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Compress from a read callback to a write callback as .xz
+    pub fn sevenzip_compress_xz_stream(
+        read_callback: SevenZipReadCallback,
+        write_callback: SevenZipWriteCallback,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipXzOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
+
+    /// Decompress a .xz stream from a read callback to a write callback
+    pub fn sevenzip_decompress_xz_stream(
+        read_callback: SevenZipReadCallback,
+        write_callback: SevenZipWriteCallback,
+        options: *const SevenZipXzOptions,
+        progress_callback: SevenZipProgressCallback,
+        user_data: *mut c_void,
+    ) -> SevenZipErrorCode;
     
     /// Compress a file to LZMA format
     pub fn sevenzip_compress_lzma(
@@ -403,6 +1612,190 @@ extern "C" {
     
     /// Get human-readable error message for error code
     pub fn sevenzip_get_error_string(code: SevenZipErrorCode) -> *const c_char;
+
+    /// Get the statistics of the calling thread's last streaming create
+    pub fn sevenzip_get_last_stats(stats: *mut SevenZipOpStats) -> SevenZipErrorCode;
+
+    /// Get the folder records of the calling thread's last create with folder_stats
+    pub fn sevenzip_get_last_folder_stats(
+        stats: *mut SevenZipFolderStats,
+        capacity: usize,
+        count: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Get the library's heap use per category since it was loaded
+    pub fn sevenzip_get_memory_stats(stats: *mut SevenZipMemoryStats) -> SevenZipErrorCode;
+
+    /// Restart every peak from the current use
+    pub fn sevenzip_reset_memory_peaks();
+
+    /// Read the process-wide operation, cache, job and memory metrics
+    pub fn sevenzip_metrics_snapshot(metrics: *mut SevenZipMetrics) -> SevenZipErrorCode;
+
+    /// Route the library's counted allocations to `allocator` (NULL for malloc)
+    pub fn sevenzip_set_allocator(allocator: *const SevenZipAllocator) -> SevenZipErrorCode;
+
+    /// Write the recorded spans as Chrome trace JSON (libraries built with ENABLE_TRACE)
+    pub fn sevenzip_trace_dump(path: *const c_char) -> SevenZipErrorCode;
+
+    /// Measure LZMA encode/decode speed at `level`, alone and on `threads` threads (cached)
+    pub fn sevenzip_benchmark(
+        level: SevenZipCompressionLevel,
+        threads: c_int,
+        result: *mut SevenZipBenchmarkResult,
+    ) -> SevenZipErrorCode;
+
+    /// Pick level, threads and block size that reach `target_mbps`
+    pub fn sevenzip_auto_tune(
+        target_mbps: f64,
+        input_size: u64,
+        max_level: SevenZipCompressionLevel,
+        tuning: *mut SevenZipTuning,
+    ) -> SevenZipErrorCode;
+
+    /// Set `options` to the sevenzip_estimate_job() defaults
+    pub fn sevenzip_estimate_options_init(options: *mut SevenZipEstimateOptions);
+
+    /// Predict packed size and compression time per level from samples of the inputs
+    pub fn sevenzip_estimate_job(
+        input_paths: *const *const c_char,
+        options: *const SevenZipEstimateOptions,
+        estimates: *mut SevenZipJobEstimate,
+        capacity: usize,
+        count: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Report which CPU-specific CRC, AES, SHA-256, match-finder and LZMA decoder kernels are in use
+    pub fn sevenzip_get_cpu_features(features: *mut SevenZipCpuFeatures) -> SevenZipErrorCode;
+
+    /// List the versions of the CRC, AES, SHA-256 and match-finder kernels this host can run
+    pub fn sevenzip_kernel_variants(variants: *mut SevenZipKernelVariant, capacity: usize) -> usize;
+
+    /// Run one kernel variant over a buffer, for timing it
+    pub fn sevenzip_kernel_run(
+        variant: usize,
+        data: *mut c_void,
+        size: usize,
+        check: *mut u32,
+    ) -> SevenZipErrorCode;
+
+    /// Create a cancellation token, not cancelled
+    pub fn sevenzip_cancel_token_create() -> *mut SevenZipCancelToken;
+
+    /// Ask every operation using the token to stop
+    pub fn sevenzip_cancel_token_cancel(token: *mut SevenZipCancelToken);
+
+    /// Whether the token has been cancelled since its creation or last reset
+    pub fn sevenzip_cancel_token_is_cancelled(token: *const SevenZipCancelToken) -> c_int;
+
+    /// Clear the token for reuse
+    pub fn sevenzip_cancel_token_reset(token: *mut SevenZipCancelToken);
+
+    /// Free a token no longer used by any operation
+    pub fn sevenzip_cancel_token_free(token: *mut SevenZipCancelToken);
+
+    /// Create a budget of bytes read and written per second (0 = unlimited)
+    pub fn sevenzip_rate_limit_create(read_bytes_per_sec: u64, write_bytes_per_sec: u64) -> *mut SevenZipRateLimit;
+
+    /// Change the rates of a budget, also for jobs already using it
+    pub fn sevenzip_rate_limit_set(limit: *mut SevenZipRateLimit, read_bytes_per_sec: u64, write_bytes_per_sec: u64);
+
+    /// Free a budget no longer used by any job
+    pub fn sevenzip_rate_limit_free(limit: *mut SevenZipRateLimit);
+
+    /// Queue sevenzip_create_7z_streaming() on a library thread
+    pub fn sevenzip_submit_create(
+        archive_path: *const c_char,
+        input_paths: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+        progress_callback: SevenZipBytesProgressCallback,
+        done_callback: SevenZipJobCallback,
+        user_data: *mut c_void,
+        job: *mut *mut SevenZipJob,
+    ) -> SevenZipErrorCode;
+
+    /// Queue sevenzip_extract_with_options() on a library thread
+    pub fn sevenzip_submit_extract(
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        password: *const c_char,
+        options: *const SevenZipExtractOptions,
+        progress_callback: SevenZipProgressCallback,
+        done_callback: SevenZipJobCallback,
+        user_data: *mut c_void,
+        job: *mut *mut SevenZipJob,
+    ) -> SevenZipErrorCode;
+
+    /// Wait for a job and return its result
+    pub fn sevenzip_job_wait(job: *mut SevenZipJob) -> SevenZipErrorCode;
+
+    /// 1 once the job finished, with its result in `*result`
+    pub fn sevenzip_job_poll(job: *mut SevenZipJob, result: *mut SevenZipErrorCode) -> c_int;
+
+    /// Descriptor readable once the job finished (-1 if unavailable)
+    pub fn sevenzip_job_fd(job: *mut SevenZipJob) -> c_int;
+
+    /// Cancel a queued or running job
+    pub fn sevenzip_job_cancel(job: *mut SevenZipJob);
+
+    /// Change the bandwidth budget of a create job
+    pub fn sevenzip_job_set_rate_limit(job: *mut SevenZipJob, read_bytes_per_sec: u64, write_bytes_per_sec: u64);
+
+    /// Release a job handle; an unfinished job goes on and frees itself
+    pub fn sevenzip_job_free(job: *mut SevenZipJob);
+
+    /// Initialize service options with defaults
+    pub fn sevenzip_service_options_init(options: *mut SevenZipServiceOptions);
+
+    /// Serve requests on a Unix socket until sevenzip_service_stop()
+    pub fn sevenzip_service_start(
+        socket_path: *const c_char,
+        options: *const SevenZipServiceOptions,
+        service: *mut *mut SevenZipService,
+    ) -> SevenZipErrorCode;
+
+    /// Stop a service and remove its socket
+    pub fn sevenzip_service_stop(service: *mut SevenZipService);
+
+    /// Create an archive in the service
+    pub fn sevenzip_service_create(
+        socket_path: *const c_char,
+        archive_path: *const c_char,
+        input_paths: *const *const c_char,
+        level: SevenZipCompressionLevel,
+        options: *const SevenZipStreamOptions,
+    ) -> SevenZipErrorCode;
+
+    /// Extract an archive in the service
+    pub fn sevenzip_service_extract(
+        socket_path: *const c_char,
+        archive_path: *const c_char,
+        output_dir: *const c_char,
+        password: *const c_char,
+        options: *const SevenZipExtractOptions,
+    ) -> SevenZipErrorCode;
+
+    /// List an archive the service keeps open
+    pub fn sevenzip_service_list(
+        socket_path: *const c_char,
+        archive_path: *const c_char,
+        password: *const c_char,
+        list: *mut *mut SevenZipList,
+    ) -> SevenZipErrorCode;
+
+    /// Read one file of an archive the service keeps open, in shared memory
+    pub fn sevenzip_service_read_entry(
+        socket_path: *const c_char,
+        archive_path: *const c_char,
+        password: *const c_char,
+        entry_index: u32,
+        data: *mut *const c_void,
+        size: *mut usize,
+    ) -> SevenZipErrorCode;
+
+    /// Release data returned by sevenzip_service_read_entry()
+    pub fn sevenzip_service_free_data(data: *const c_void, size: usize);
     
     /// Get library version string
     pub fn sevenzip_get_version() -> *const c_char;
@@ -419,6 +1812,254 @@ pub struct SevenZipErrorInfo {
     pub suggestion: [c_char; 256],
 }
 
+/// Phases of an archive operation, indexes of SevenZipOpStats::phases
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SevenZipPhase {
+    SEVENZIP_PHASE_SCAN = 0,
+    SEVENZIP_PHASE_READ = 1,
+    SEVENZIP_PHASE_COMPRESS = 2,
+    SEVENZIP_PHASE_WRITE = 3,
+    SEVENZIP_PHASE_HEADER = 4,
+}
+
+pub const SEVENZIP_PHASE_COUNT: usize = 5;
+
+/// Wall and CPU time of one phase
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipPhaseStats {
+    pub wall_seconds: f64,
+    pub cpu_seconds: f64,
+}
+
+/// Statistics of the last operation, see sevenzip_get_last_stats()
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipOpStats {
+    pub phases: [SevenZipPhaseStats; SEVENZIP_PHASE_COUNT],
+    pub wall_seconds: f64,
+    pub cpu_seconds: f64,
+    pub bytes_read: u64,
+    pub bytes_written: u64,
+    pub files: u64,
+    pub files_per_second: f64,
+    pub encoder_threads: c_int,
+    pub peak_buffer_bytes: u64,
+    pub lzma2_block_size: u64,
+    pub lzma_literals: u64,
+    pub lzma_matches: u64,
+    pub lzma_rep_matches: u64,
+    pub average_match_length: f64,
+    pub encode_seconds: f64,
+    pub folder_stats_count: u64,
+    pub throughput_rung: c_int,
+    pub throughput_changes: u64,
+    pub block_cache_hits: u64,
+    pub block_cache_stores: u64,
+}
+
+/// Encoder counters of one LZMA2 folder, see sevenzip_get_last_folder_stats()
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipFolderStats {
+    pub folder: u64,
+    pub unpack_size: u64,
+    pub pack_size: u64,
+    pub literals: u64,
+    pub matches: u64,
+    pub rep_matches: u64,
+    pub average_match_length: f64,
+    pub encode_seconds: f64,
+    pub block_threads: c_int,
+    pub bytes_per_second: f64,
+}
+
+/// Categories of counted heap memory, indexes of SevenZipMemoryStats::categories
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SevenZipMemCategory {
+    SEVENZIP_MEM_MATCH_FINDER = 0,
+    SEVENZIP_MEM_IO_BUFFERS = 1,
+    SEVENZIP_MEM_HEADER = 2,
+    SEVENZIP_MEM_NAMES = 3,
+    SEVENZIP_MEM_DECODER = 4,
+    SEVENZIP_MEM_OTHER = 5,
+}
+
+pub const SEVENZIP_MEM_CATEGORY_COUNT: usize = 6;
+
+/// Use of one category
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipMemUsage {
+    pub current_bytes: u64,
+    pub peak_bytes: u64,
+    pub allocations: u64,
+}
+
+/// Heap use of the library, see sevenzip_get_memory_stats()
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipMemoryStats {
+    pub categories: [SevenZipMemUsage; SEVENZIP_MEM_CATEGORY_COUNT],
+    pub total: SevenZipMemUsage,
+}
+
+/// Operations counted by sevenzip_metrics_snapshot(), indexes of SevenZipMetrics::ops
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SevenZipMetricOp {
+    SEVENZIP_METRIC_CREATE = 0,
+    SEVENZIP_METRIC_EXTRACT = 1,
+    SEVENZIP_METRIC_LIST = 2,
+    SEVENZIP_METRIC_TEST = 3,
+    SEVENZIP_METRIC_READ = 4,
+}
+
+pub const SEVENZIP_METRIC_OP_COUNT: usize = 5;
+
+/// Caches counted by sevenzip_metrics_snapshot(), indexes of SevenZipMetrics::caches
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SevenZipMetricCache {
+    SEVENZIP_METRIC_CACHE_KEY = 0,
+    SEVENZIP_METRIC_CACHE_HEADER = 1,
+    SEVENZIP_METRIC_CACHE_FOLDER = 2,
+}
+
+pub const SEVENZIP_METRIC_CACHE_COUNT: usize = 3;
+
+/// Latency buckets per operation: 1 ms doubling, the last +Inf
+pub const SEVENZIP_METRICS_BUCKETS: usize = 16;
+
+/// Counters of one operation kind
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipOpMetrics {
+    pub count: u64,
+    pub errors: u64,
+    pub bytes_in: u64,
+    pub bytes_out: u64,
+    pub latency_seconds: f64,
+    pub latency_buckets: [u64; SEVENZIP_METRICS_BUCKETS],
+}
+
+/// Lookups of one cache
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipCacheMetrics {
+    pub hits: u64,
+    pub misses: u64,
+}
+
+/// Process-wide metrics, see sevenzip_metrics_snapshot()
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipMetrics {
+    pub ops: [SevenZipOpMetrics; SEVENZIP_METRIC_OP_COUNT],
+    pub latency_bounds: [f64; SEVENZIP_METRICS_BUCKETS],
+    pub caches: [SevenZipCacheMetrics; SEVENZIP_METRIC_CACHE_COUNT],
+    pub jobs_active: u64,
+    pub jobs_queued: u64,
+    pub threads_busy: u64,
+    pub bytes_allocated: u64,
+    pub allocations: u64,
+}
+
+/// Caller allocator for sevenzip_set_allocator(); blocks must be 16-byte aligned
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipAllocator {
+    pub alloc: Option<unsafe extern "C" fn(opaque: *mut c_void, size: usize) -> *mut c_void>,
+    pub free: Option<unsafe extern "C" fn(opaque: *mut c_void, address: *mut c_void)>,
+    pub opaque: *mut c_void,
+}
+
+/// LZMA coder speed of this host at one level, see sevenzip_benchmark()
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipBenchmarkResult {
+    pub level: SevenZipCompressionLevel,
+    pub threads: c_int,
+    pub encode_mbps: f64,
+    pub decode_mbps: f64,
+    pub encode_mbps_all: f64,
+    pub decode_mbps_all: f64,
+}
+
+/// Settings picked by sevenzip_auto_tune()
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipTuning {
+    pub level: SevenZipCompressionLevel,
+    pub num_threads: c_int,
+    pub block_size: u64,
+    pub expected_mbps: f64,
+}
+
+/// sevenzip_estimate_job() options, see sevenzip_estimate_options_init()
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipEstimateOptions {
+    pub sample_fraction: f64,
+    pub min_sample_bytes: u64,
+    pub max_sample_bytes: u64,
+    pub min_level: SevenZipCompressionLevel,
+    pub max_level: SevenZipCompressionLevel,
+    pub num_threads: c_int,
+}
+
+/// Prediction for one level, see sevenzip_estimate_job()
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipJobEstimate {
+    pub level: SevenZipCompressionLevel,
+    pub num_threads: c_int,
+    pub input_bytes: u64,
+    pub sample_bytes: u64,
+    pub predicted_size: u64,
+    pub predicted_seconds: f64,
+    pub predicted_seconds_one_thread: f64,
+}
+
+/// Kernels this host runs, see sevenzip_get_cpu_features(); each is 1 when in use
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct SevenZipCpuFeatures {
+    pub crc32_hw: c_int,
+    pub aes_hw: c_int,
+    pub aes_vaes_avx2: c_int,
+    pub sha256_hw: c_int,
+    pub match_finder_bits: c_int,
+    pub xxh3_avx2: c_int,
+    pub lzma_dec_asm: c_int,
+}
+
+/// Hot loops of the library, see sevenzip_kernel_variants()
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[allow(non_camel_case_types)]
+pub enum SevenZipKernel {
+    SEVENZIP_KERNEL_CRC32 = 0,
+    SEVENZIP_KERNEL_AES_CBC_ENCODE = 1,
+    SEVENZIP_KERNEL_AES_CBC_DECODE = 2,
+    SEVENZIP_KERNEL_SHA256 = 3,
+    SEVENZIP_KERNEL_MATCH_FINDER = 4,
+}
+
+/// Most variants sevenzip_kernel_variants() can list
+pub const SEVENZIP_MAX_KERNEL_VARIANTS: usize = 16;
+
+/// A version of a kernel this host can run
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct SevenZipKernelVariant {
+    pub kernel: SevenZipKernel,
+    pub name: *const c_char,
+    pub in_use: c_int,
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -174,10 +174,47 @@ pub mod encryption_native;
 pub use error::{Error, Result};
 pub use archive::{
     SevenZip,
+    Archive,
     ArchiveEntry,
+    ArchiveEntryReader,
+    VfsStat,
+    EntryList,
+    EntryRef,
+    EntryIter,
+    ListFields,
+    ListColumns,
+    BatchMode,
+    BatchResult,
+    MergeNames,
+    MergeOptions,
+    Catalog,
+    CatalogHit,
     CompressionLevel,
     CompressOptions,
+    InputTable,
+    InputEntry,
+    Filter,
+    Method,
+    EntryChoice,
+    EntryPolicy,
+    NumaPolicy,
+    DigestAlgorithm,
+    XzCheck,
+    CreateEngine,
+    Verify,
+    Existing,
+    Durability,
+    ExtractOptions,
+    MatchFinder,
+    LzmaParams,
+    InitOptions,
+    SchedPolicy,
+    IoPriority,
     StreamOptions,
+    SourceEntry,
+    CancelToken,
+    RateLimit,
+    ArchiveJob,
     ProgressCallback,
     BytesProgressCallback,
 };
@@ -187,7 +224,10 @@ pub use encryption_native::{
     EncryptionContext as NativeEncryptionContext,
     DecryptionContext as NativeDecryptionContext,
     verify_password as native_verify_password,
+    EncryptingWriter,
+    padded_len,
     derive_key,
+    clear_key_cache,
     generate_salt,
     generate_iv,
     AES_BLOCK_SIZE,
@@ -200,6 +240,7 @@ pub use encryption_native::{
 pub use encryption::{
     EncryptionContext,
     DecryptionContext,
+    CryptContext,
     verify_password,
 };
 
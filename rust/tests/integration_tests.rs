@@ -6,7 +6,7 @@
 //! - Progress callbacks
 //! - Error handling
 
-use seven_zip::{SevenZip, CompressionLevel, CompressOptions};
+use seven_zip::{SevenZip, CompressionLevel, CompressOptions, InputTable};
 use std::fs;
 use std::path::PathBuf;
 use tempfile::TempDir;
@@ -819,4 +819,31 @@ fn test_compressoptions_builder_pattern() {
     assert_eq!(opts.auto_detect_incompressible, true);
 }
 
+#[test]
+fn test_create_from_scanned_table() {
+    let temp = TempDir::new().unwrap();
+    let tree = temp.path().join("tree");
+    fs::create_dir_all(tree.join("sub")).unwrap();
+    create_test_file(&tree, "top.txt", "top level");
+    create_test_file(&tree.join("sub"), "inner.txt", "one level down");
+    let single = create_test_file(temp.path(), "single.txt", "a file input");
+
+    let table = InputTable::scan(&[tree.as_path(), single.as_path()]).unwrap();
+    let names: Vec<&str> = table.entries.iter().map(|e| e.name.as_str()).collect();
+    assert_eq!(names.len(), 4);
+    assert!(names.contains(&"sub/inner.txt") && names.contains(&"single.txt"));
+    let sub = names.iter().position(|n| *n == "sub").unwrap();
+    assert_eq!(names[sub + 1], "sub/inner.txt", "Directory contents follow it");
+    assert_eq!(table.total_size, ("top level".len() + "one level down".len() + "a file input".len()) as u64);
+
+    let sz = SevenZip::new().unwrap();
+    let archive_path = temp.path().join("table.7z");
+    let opts = CompressOptions::auto_tuned_for(&table);
+    sz.create_archive_from_table(&archive_path, &table, CompressionLevel::Fast, Some(&opts)).unwrap();
 
+    let extract_dir = temp.path().join("extracted");
+    fs::create_dir(&extract_dir).unwrap();
+    sz.extract(archive_path.to_str().unwrap(), extract_dir.to_str().unwrap()).unwrap();
+    assert_eq!(fs::read_to_string(extract_dir.join("sub/inner.txt")).unwrap(), "one level down");
+    assert_eq!(fs::read_to_string(extract_dir.join("single.txt")).unwrap(), "a file input");
+}
@@ -0,0 +1,510 @@
+/**
+ * 7zAES Coder
+ *
+ * Layout of the method as read by 7-Zip (CPP/7zip/Crypto/7zAes.cpp):
+ * properties are a flags byte (NumCyclesPower, salt/IV present), a byte
+ * with the salt and IV sizes, then the IV. Ciphertext is plain AES-256-CBC
+ * of the coder's input, zero-padded to whole blocks; the folder records the
+ * unpadded size as the AES coder's unpack size.
+ *
+ * CBC decrypts any block given the ciphertext block before it, so the
+ * decrypting stream seeks without reading from the start of the folder.
+ */
+
+#ifdef _WIN32
+    #define _CRT_RAND_S  /* rand_s() */
+#endif
+
+#include "aes_coder.h"
+#include "key_cache.h"
+#include "mem_alloc.h"
+#include "thread_placement.h"
+#include "Aes.h"
+#include "Sha256.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const Byte k7zMethodAES[4] = { 0x06, 0xF1, 0x07, 0x01 };
+
+/* AES needs 16-byte alignment; a cache line keeps the buffer to itself */
+#define AES_CODER_ALIGN 64
+
+/* UTF-8 to UTF-16LE; returns the byte length, or (size_t)-1 if malformed */
+static size_t utf8_to_utf16le(const char* src, Byte* dst) {
+    const Byte* s = (const Byte*)src;
+    size_t n = 0;
+
+    while (*s) {
+        UInt32 c = *s++;
+        int extra = 0;
+        if (c >= 0xF8) return (size_t)-1;
+        else if (c >= 0xF0) { c &= 0x07; extra = 3; }
+        else if (c >= 0xE0) { c &= 0x0F; extra = 2; }
+        else if (c >= 0xC0) { c &= 0x1F; extra = 1; }
+        else if (c >= 0x80) return (size_t)-1;
+        for (int i = 0; i < extra; i++) {
+            if ((*s & 0xC0) != 0x80) return (size_t)-1;
+            c = (c << 6) | (*s++ & 0x3F);
+        }
+        if (c >= 0x10000) {
+            /* Surrogate pair */
+            c -= 0x10000;
+            UInt32 hi = 0xD800 + (c >> 10);
+            UInt32 lo = 0xDC00 + (c & 0x3FF);
+            dst[n++] = (Byte)hi; dst[n++] = (Byte)(hi >> 8);
+            dst[n++] = (Byte)lo; dst[n++] = (Byte)(lo >> 8);
+        } else {
+            dst[n++] = (Byte)c; dst[n++] = (Byte)(c >> 8);
+        }
+    }
+    return n;
+}
+
+/* CKeyInfo::CalcKey: SHA-256 over salt || password || 64-bit round counter
+ * for each round, or salt and password as the key for AES_CODER_CYCLES_RAW */
+static SevenZipErrorCode aes_kdf(const char* password, unsigned num_cycles_power,
+                                 const Byte* salt, size_t salt_size, Byte* key) {
+    if (!password || !key || salt_size > AES_CODER_MAX_SALT ||
+        (num_cycles_power > AES_CODER_MAX_CYCLES_POWER && num_cycles_power != AES_CODER_CYCLES_RAW)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    int raw = num_cycles_power == AES_CODER_CYCLES_RAW;
+    const UInt64 rounds = raw ? 1 : (UInt64)1 << num_cycles_power;
+    if (key_cache_lookup(KEY_CACHE_KDF_7ZAES, password, salt, salt_size, (uint32_t)rounds, key)) {
+        return SEVENZIP_OK;
+    }
+
+    size_t max_size = salt_size + strlen(password) * 2 + 8;
+    Byte* buf = (Byte*)malloc(max_size);
+    if (!buf) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    if (salt_size > 0) memcpy(buf, salt, salt_size);
+    size_t pw_size = utf8_to_utf16le(password, buf + salt_size);
+    if (pw_size == (size_t)-1) {
+        free(buf);
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    size_t size = salt_size + pw_size;
+
+    CSha256 sha;
+    if (raw) {
+        memset(key, 0, AES_CODER_KEY_SIZE);
+        memcpy(key, buf, size < AES_CODER_KEY_SIZE ? size : AES_CODER_KEY_SIZE);
+    } else {
+        Byte* counter = buf + size;
+        memset(counter, 0, 8);
+        Sha256_Init(&sha);
+        for (UInt64 round = 0; round < rounds; round++) {
+            Sha256_Update(&sha, buf, size + 8);
+            for (int i = 0; i < 8 && ++counter[i] == 0; i++) {}
+        }
+        Sha256_Final(&sha, key);
+        key_cache_zero(&sha, sizeof(sha));
+    }
+    key_cache_store(KEY_CACHE_KDF_7ZAES, password, salt, salt_size, (uint32_t)rounds, key);
+
+    key_cache_zero(buf, max_size);
+    free(buf);
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_aes_derive_key(const char* password, Byte* key) {
+    return aes_kdf(password, AES_CODER_NUM_CYCLES_POWER, NULL, 0, key);
+}
+
+/* CDecoder::SetDecoderProperties2 */
+int sevenzip_aes_read_props(const Byte* props, size_t size, AesCoderProps* out) {
+    memset(out, 0, sizeof(*out));
+    if (size == 0) return 0;
+    out->num_cycles_power = props[0] & 0x3F;
+    if ((props[0] & 0xC0) == 0) {
+        return size == 1;
+    }
+    if (size < 2) return 0;
+    unsigned salt_size = ((props[0] >> 7) & 1) + (props[1] >> 4);
+    unsigned iv_size = ((props[0] >> 6) & 1) + (props[1] & 0x0F);
+    if (size != 2 + (size_t)salt_size + iv_size) return 0;
+    memcpy(out->salt, props + 2, salt_size);
+    out->salt_size = salt_size;
+    memcpy(out->iv, props + 2 + salt_size, iv_size);
+    return 1;
+}
+
+SevenZipErrorCode sevenzip_aes_derive_key_props(const char* password, const AesCoderProps* props,
+                                                Byte* key) {
+    return aes_kdf(password, props->num_cycles_power, props->salt, props->salt_size, key);
+}
+
+SevenZipErrorCode sevenzip_aes_new_iv(Byte* iv) {
+#ifdef _WIN32
+    for (int i = 0; i < AES_CODER_IV_SIZE; i += 4) {
+        unsigned int r;
+        if (rand_s(&r) != 0) return SEVENZIP_ERROR_UNKNOWN;
+        memcpy(iv + i, &r, 4);
+    }
+    return SEVENZIP_OK;
+#else
+    FILE* f = fopen("/dev/urandom", "rb");
+    if (!f) return SEVENZIP_ERROR_UNKNOWN;
+    size_t got = fread(iv, 1, AES_CODER_IV_SIZE, f);
+    fclose(f);
+    return got == AES_CODER_IV_SIZE ? SEVENZIP_OK : SEVENZIP_ERROR_UNKNOWN;
+#endif
+}
+
+size_t sevenzip_aes_write_coder(const Byte* iv, Byte* p) {
+    Byte* start = p;
+    *p++ = (Byte)(sizeof(k7zMethodAES) | 0x20);  /* ID size, has properties */
+    memcpy(p, k7zMethodAES, sizeof(k7zMethodAES));
+    p += sizeof(k7zMethodAES);
+    *p++ = 2 + AES_CODER_IV_SIZE;                 /* Properties size */
+    *p++ = (Byte)(AES_CODER_NUM_CYCLES_POWER | 0x40);  /* IV present, no salt */
+    *p++ = (Byte)(AES_CODER_IV_SIZE - 1);         /* Salt size 0, IV size 16 */
+    memcpy(p, iv, AES_CODER_IV_SIZE);
+    p += AES_CODER_IV_SIZE;
+    return (size_t)(p - start);
+}
+
+/* Encrypt `size` bytes (whole blocks) of the buffer and pass them on */
+static int AesOutStream_Emit(AesOutStream* s, size_t size) {
+    if (size == 0) return 1;
+    g_AesCbc_Encode(s->aes, s->buffer, size / AES_BLOCK_SIZE);
+    if (ISeqOutStream_Write(s->out, s->buffer, size) != size) {
+        s->failed = 1;
+        return 0;
+    }
+    s->written += size;
+    return 1;
+}
+
+static size_t AesOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    AesOutStream* s = Z7_CONTAINER_FROM_VTBL(pp, AesOutStream, vt);
+    const Byte* src = (const Byte*)data;
+    size_t remaining = size;
+
+    while (remaining > 0) {
+        if (s->failed) return size - remaining;
+        size_t copy = AES_CODER_BUFFER_SIZE - s->pos;
+        if (copy > remaining) copy = remaining;
+        memcpy(s->buffer + s->pos, src, copy);
+        s->pos += copy;
+        src += copy;
+        remaining -= copy;
+        if (s->pos == AES_CODER_BUFFER_SIZE) {
+            if (!AesOutStream_Emit(s, s->pos)) return 0;
+            s->pos = 0;
+        }
+    }
+    s->processed += size;
+    return size;
+}
+
+SRes AesOutStream_Init(AesOutStream* s, const Byte* key, const Byte* iv, ISeqOutStreamPtr out) {
+    memset(s, 0, sizeof(*s));
+    s->vt.Write = AesOutStream_Write;
+    s->out = out;
+    s->aes = (UInt32*)mem_alloc_aligned(SEVENZIP_MEM_OTHER, AES_NUM_IVMRK_WORDS * sizeof(UInt32),
+                                        AES_CODER_ALIGN);
+    s->buffer = (Byte*)mem_alloc_aligned(SEVENZIP_MEM_IO_BUFFERS, AES_CODER_BUFFER_SIZE,
+                                         AES_CODER_ALIGN);
+    if (!s->aes || !s->buffer) {
+        AesOutStream_Free(s);
+        return SZ_ERROR_MEM;
+    }
+    AesCbc_Init(s->aes, iv);
+    Aes_SetKey_Enc(s->aes + 4, key, AES_CODER_KEY_SIZE);
+    return SZ_OK;
+}
+
+int AesOutStream_Finish(AesOutStream* s) {
+    if (s->failed) return 0;
+    size_t padded = (s->pos + AES_BLOCK_SIZE - 1) & ~(size_t)(AES_BLOCK_SIZE - 1);
+    memset(s->buffer + s->pos, 0, padded - s->pos);
+    int ok = AesOutStream_Emit(s, padded);
+    s->pos = 0;
+    return ok;
+}
+
+void AesOutStream_Free(AesOutStream* s) {
+    if (s->aes) {
+        memset(s->aes, 0, AES_NUM_IVMRK_WORDS * sizeof(UInt32));  /* Key schedule */
+        mem_free(s->aes);
+    }
+    mem_free(s->buffer);
+    s->aes = NULL;
+    s->buffer = NULL;
+}
+
+/* ---- Decryption ---- */
+
+/* First step after a seek; each step read in order doubles the next */
+#define AES_IN_SEEK_STEP (4 << 10)
+
+/* Step from which the decryption thread takes over */
+#define AES_IN_PIPELINE_STEP (AES_IN_SLOT_SIZE / 4)
+
+/* Decrypt `size` bytes (whole blocks) of the pack stream at `offset`, the
+ * block the CBC state is chained to, into `buf` */
+static SRes aes_in_decrypt(AesInStream* s, Byte* buf, UInt64 offset, size_t size) {
+    if (s->in_pos != offset) {
+        s->in_pos = (UInt64)-1;
+        RINOK(LookInStream_SeekTo(s->in, s->base + offset))
+    }
+    SRes res = LookInStream_Read(s->in, buf, size);
+    if (res != SZ_OK) {
+        s->in_pos = (UInt64)-1;
+        return res == SZ_ERROR_INPUT_EOF ? SZ_ERROR_DATA : res;
+    }
+    s->in_pos = offset + size;
+    g_AesCbc_Decode(s->aes, buf, size / AES_BLOCK_SIZE);
+    return SZ_OK;
+}
+
+static void* aes_in_thread(void* arg) {
+    AesInStream* s = (AesInStream*)arg;
+    thread_sched_enter();
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->stop && s->filled + (unsigned)s->held >= AES_IN_SLOTS) {
+            pthread_cond_wait(&s->changed, &s->lock);
+        }
+        if (s->stop) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        unsigned slot = (s->next_take + (unsigned)s->held + s->filled) % AES_IN_SLOTS;
+        pthread_mutex_unlock(&s->lock);
+
+        size_t size = AES_IN_SLOT_SIZE;
+        if ((UInt64)size > s->cipher_end - s->thread_pos) size = (size_t)(s->cipher_end - s->thread_pos);
+        SRes res = aes_in_decrypt(s, s->slots[slot], s->thread_pos, size);
+
+        pthread_mutex_lock(&s->lock);
+        s->slot_start[slot] = s->thread_pos;
+        s->slot_size[slot] = size;
+        s->slot_res[slot] = res;
+        s->filled++;
+        pthread_cond_broadcast(&s->changed);
+        pthread_mutex_unlock(&s->lock);
+        s->thread_pos += size;
+        if (res != SZ_OK || s->thread_pos >= s->cipher_end) break;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/* Decrypt ahead from the chained block on a thread; 0 if it did not start */
+static int aes_in_start(AesInStream* s) {
+    s->thread_pos = s->chained;
+    s->next_take = 0;
+    s->filled = 0;
+    s->held = 0;
+    s->stop = 0;
+    s->done = 0;
+    s->view_size = 0;  /* The view's slot is the thread's to fill */
+    if (pthread_create(&s->thread, NULL, aes_in_thread, s) != 0) {
+        return 0;
+    }
+    s->running = 1;
+    return 1;
+}
+
+static void aes_in_stop(AesInStream* s) {
+    if (!s->running) return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+    s->running = 0;
+    s->view_size = 0;
+    s->chained = (UInt64)-1;
+    s->in_pos = (UInt64)-1;
+}
+
+/* The next slot from the thread; it starts where the view ended */
+static SRes aes_in_take(AesInStream* s) {
+    pthread_mutex_lock(&s->lock);
+    if (s->held) {
+        s->held = 0;
+        s->next_take = (s->next_take + 1) % AES_IN_SLOTS;
+        pthread_cond_broadcast(&s->changed);
+    }
+    while (s->filled == 0 && !s->done) {
+        pthread_cond_wait(&s->changed, &s->lock);
+    }
+    SRes res = SZ_ERROR_DATA;
+    if (s->filled > 0) {
+        unsigned slot = s->next_take;
+        s->filled--;
+        s->held = 1;
+        res = s->slot_res[slot];
+        s->view = s->slots[slot];
+        s->view_start = s->slot_start[slot];
+        s->view_size = res == SZ_OK ? s->slot_size[slot] : 0;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return res;
+}
+
+/* Decrypt a step from the block `pos` is in, on the reader's thread */
+static SRes aes_in_step(AesInStream* s, UInt64 pos) {
+    UInt64 block = pos & ~(UInt64)(AES_BLOCK_SIZE - 1);
+    if (block != s->chained) {
+        /* CBC: the IV of a block is the ciphertext block before it */
+        Byte iv[AES_BLOCK_SIZE];
+        if (block == 0) {
+            memcpy(iv, s->iv, AES_BLOCK_SIZE);
+        } else {
+            s->in_pos = (UInt64)-1;
+            RINOK(LookInStream_SeekTo(s->in, s->base + block - AES_BLOCK_SIZE))
+            SRes res = LookInStream_Read(s->in, iv, AES_BLOCK_SIZE);
+            if (res != SZ_OK) return res == SZ_ERROR_INPUT_EOF ? SZ_ERROR_DATA : res;
+            s->in_pos = block;
+        }
+        AesCbc_Init(s->aes, iv);
+        s->chained = block;
+        s->step = AES_IN_SEEK_STEP;
+    }
+    size_t size = s->step;
+    if ((UInt64)size > s->cipher_end - block) size = (size_t)(s->cipher_end - block);
+    s->view_size = 0;
+    s->chained = (UInt64)-1;
+    RINOK(aes_in_decrypt(s, s->slots[0], block, size))
+    s->view = s->slots[0];
+    s->view_start = block;
+    s->view_size = size;
+    s->chained = block + size;
+    if (s->step < AES_IN_SLOT_SIZE) s->step *= 2;
+    return SZ_OK;
+}
+
+static SRes AesInStream_Look(ILookInStreamPtr pp, const void** buf, size_t* size) {
+    AesInStream* s = Z7_CONTAINER_FROM_VTBL(pp, AesInStream, vt);
+    UInt64 end = s->view_start + s->view_size;
+    if (*size > 0 && s->pos < s->plain_size && (s->pos < s->view_start || s->pos >= end)) {
+        if (s->pos >= s->cipher_end) {
+            *size = 0;  /* The plaintext runs past the ciphertext */
+            return SZ_OK;
+        }
+        int in_order = s->pos == end && s->view_size > 0;
+        if (s->running && !in_order) {
+            aes_in_stop(s);
+        }
+        if (!s->running && in_order && s->step >= AES_IN_PIPELINE_STEP &&
+            s->cipher_end - s->chained > AES_IN_SLOT_SIZE) {
+            aes_in_start(s);
+        }
+        if (s->running) {
+            RINOK(aes_in_take(s))
+        } else {
+            RINOK(aes_in_step(s, s->pos))
+        }
+        end = s->view_start + s->view_size;
+    }
+    size_t avail = 0;
+    if (s->pos >= s->view_start && s->pos < end) {
+        UInt64 limit = end < s->plain_size ? end : s->plain_size;
+        avail = s->pos < limit ? (size_t)(limit - s->pos) : 0;
+    }
+    if (*size > avail) *size = avail;
+    *buf = s->view + (avail > 0 ? (size_t)(s->pos - s->view_start) : 0);
+    return SZ_OK;
+}
+
+static SRes AesInStream_Skip(ILookInStreamPtr pp, size_t offset) {
+    AesInStream* s = Z7_CONTAINER_FROM_VTBL(pp, AesInStream, vt);
+    s->pos += offset;
+    return SZ_OK;
+}
+
+static SRes AesInStream_Read(ILookInStreamPtr pp, void* buf, size_t* size) {
+    const void* look;
+    RINOK(AesInStream_Look(pp, &look, size))
+    memcpy(buf, look, *size);
+    return AesInStream_Skip(pp, *size);
+}
+
+static SRes AesInStream_Seek(ILookInStreamPtr pp, Int64* pos, ESzSeek origin) {
+    AesInStream* s = Z7_CONTAINER_FROM_VTBL(pp, AesInStream, vt);
+    Int64 base;
+    switch (origin) {
+        case SZ_SEEK_SET: base = 0; break;
+        case SZ_SEEK_CUR: base = (Int64)s->pos; break;
+        case SZ_SEEK_END: base = (Int64)s->plain_size; break;
+        default: return SZ_ERROR_PARAM;
+    }
+    Int64 target = base + *pos;
+    if (target < 0) return SZ_ERROR_PARAM;
+    s->pos = (UInt64)target;
+    *pos = target;
+    return SZ_OK;
+}
+
+SRes AesInStream_Init(AesInStream* s, ILookInStreamPtr in, UInt64 base, UInt64 pack_size,
+                      UInt64 plain_size, const Byte* key, const Byte* iv) {
+    memset(s, 0, sizeof(*s));
+    s->vt.Look = AesInStream_Look;
+    s->vt.Skip = AesInStream_Skip;
+    s->vt.Read = AesInStream_Read;
+    s->vt.Seek = AesInStream_Seek;
+    s->in = in;
+    s->base = base;
+    s->plain_size = plain_size;
+    s->cipher_end = pack_size & ~(UInt64)(AES_BLOCK_SIZE - 1);
+    UInt64 padded = (plain_size + AES_BLOCK_SIZE - 1) & ~(UInt64)(AES_BLOCK_SIZE - 1);
+    if (padded < s->cipher_end) s->cipher_end = padded;
+    s->in_pos = (UInt64)-1;
+    s->chained = (UInt64)-1;
+    s->step = AES_IN_SEEK_STEP;
+    memcpy(s->iv, iv, AES_CODER_IV_SIZE);
+
+    if (pthread_mutex_init(&s->lock, NULL) != 0) {
+        return SZ_ERROR_THREAD;
+    }
+    if (pthread_cond_init(&s->changed, NULL) != 0) {
+        pthread_mutex_destroy(&s->lock);
+        return SZ_ERROR_THREAD;
+    }
+
+    s->aes = (UInt32*)mem_alloc_aligned(SEVENZIP_MEM_OTHER, AES_NUM_IVMRK_WORDS * sizeof(UInt32),
+                                        AES_CODER_ALIGN);
+    int ok = s->aes != NULL;
+    for (int i = 0; i < AES_IN_SLOTS; i++) {
+        s->slots[i] = (Byte*)mem_alloc_aligned(SEVENZIP_MEM_IO_BUFFERS, AES_IN_SLOT_SIZE,
+                                               AES_CODER_ALIGN);
+        if (!s->slots[i]) ok = 0;
+    }
+    if (!ok) {
+        AesInStream_Free(s);
+        return SZ_ERROR_MEM;
+    }
+    s->view = s->slots[0];
+    Aes_SetKey_Dec(s->aes + 4, key, AES_CODER_KEY_SIZE);
+    return SZ_OK;
+}
+
+void AesInStream_Free(AesInStream* s) {
+    aes_in_stop(s);
+    pthread_cond_destroy(&s->changed);
+    pthread_mutex_destroy(&s->lock);
+    if (s->aes) {
+        memset(s->aes, 0, AES_NUM_IVMRK_WORDS * sizeof(UInt32));  /* Key schedule */
+        mem_free(s->aes);
+    }
+    for (int i = 0; i < AES_IN_SLOTS; i++) {
+        mem_free(s->slots[i]);
+        s->slots[i] = NULL;
+    }
+    s->aes = NULL;
+    s->view = NULL;
+}
@@ -0,0 +1,188 @@
+/**
+ * 7zAES Coder - Internal Header
+ *
+ * Encryption of folder pack streams with the 7zAES method (AES-256-CBC,
+ * key = SHA-256 iterated 2^19 times over the UTF-16LE password), so the
+ * create paths encrypt packed data as the encoder emits it instead of in a
+ * second pass. Readable by 7-Zip; the archive header stays unencrypted.
+ * The folder decoder reads encrypted pack streams through AesInStream,
+ * which decrypts on a thread of its own ahead of the decoder.
+ */
+
+#ifndef SEVENZIP_AES_CODER_H
+#define SEVENZIP_AES_CODER_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AES_CODER_KEY_SIZE 32
+#define AES_CODER_IV_SIZE 16
+
+/* Key derivation cost written by 7-Zip (2^19 SHA-256 rounds) */
+#define AES_CODER_NUM_CYCLES_POWER 19
+
+/* Size of the coder record written by sevenzip_aes_write_coder() */
+#define AES_CODER_RECORD_SIZE (1 + 4 + 1 + 2 + AES_CODER_IV_SIZE)
+
+/* Plaintext gathered before a run of blocks is encrypted and passed on */
+#define AES_CODER_BUFFER_SIZE (1 << 20)
+
+/* Longest salt 7-Zip reads from the properties */
+#define AES_CODER_MAX_SALT 16
+
+/* Highest NumCyclesPower 7-Zip accepts, and its "no hashing" value */
+#define AES_CODER_MAX_CYCLES_POWER 24
+#define AES_CODER_CYCLES_RAW 0x3F
+
+/* Decrypted slots of an AesInStream: one the reader holds, the others
+ * filled ahead of it by the decryption thread */
+#define AES_IN_SLOTS 3
+#define AES_IN_SLOT_SIZE (1 << 18)
+
+/* Memory of one AesInStream besides the struct */
+#define AES_IN_STREAM_MEMORY ((UInt64)AES_IN_SLOTS * AES_IN_SLOT_SIZE)
+
+/**
+ * Derive the archive key from a password (no salt, as 7-Zip writes it)
+ * @param password UTF-8 password
+ * @param key Output: AES_CODER_KEY_SIZE bytes
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_INVALID_PARAM for malformed UTF-8,
+ *         or SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode sevenzip_aes_derive_key(const char* password, Byte* key);
+
+/* Properties of a 7zAES coder as any 7-Zip writes them */
+typedef struct {
+    unsigned num_cycles_power;
+    Byte salt[AES_CODER_MAX_SALT];
+    unsigned salt_size;
+    Byte iv[AES_CODER_IV_SIZE];   /* Zero-filled past the stored bytes */
+} AesCoderProps;
+
+/**
+ * Parse the properties of a 7zAES coder record
+ * @return 1, or 0 if they are malformed or cost more than 7-Zip allows
+ */
+int sevenzip_aes_read_props(const Byte* props, size_t size, AesCoderProps* out);
+
+/**
+ * Derive the key of a folder from a password and its coder's properties,
+ * through the same cache as sevenzip_aes_derive_key()
+ * @return As sevenzip_aes_derive_key()
+ */
+SevenZipErrorCode sevenzip_aes_derive_key_props(const char* password, const AesCoderProps* props,
+                                                Byte* key);
+
+/**
+ * Fill a fresh random IV for one folder
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_UNKNOWN if no random source exists
+ */
+SevenZipErrorCode sevenzip_aes_new_iv(Byte* iv);
+
+/**
+ * Write the 7zAES coder record of a folder (ID 06F10701 and properties)
+ * @return Bytes written (AES_CODER_RECORD_SIZE)
+ */
+size_t sevenzip_aes_write_coder(const Byte* iv, Byte* p);
+
+/* Output stream that encrypts into another output stream */
+typedef struct {
+    ISeqOutStream vt;
+    ISeqOutStreamPtr out;
+    UInt32* aes;          /* IV + key schedule, 16-byte aligned */
+    Byte* buffer;         /* AES_CODER_BUFFER_SIZE bytes, 16-byte aligned */
+    size_t pos;
+    uint64_t processed;   /* Plaintext bytes taken (the coder's unpack size) */
+    uint64_t written;     /* Ciphertext bytes passed on (the pack size) */
+    int failed;           /* `out` took less than it was given */
+} AesOutStream;
+
+/**
+ * Start encrypting one pack stream
+ * @param key Archive key from sevenzip_aes_derive_key()
+ * @param iv IV of the folder
+ * @param out Stream the ciphertext goes to
+ * @return SZ_OK or SZ_ERROR_MEM
+ */
+SRes AesOutStream_Init(AesOutStream* s, const Byte* key, const Byte* iv, ISeqOutStreamPtr out);
+
+/**
+ * Zero-pad the last block and pass the rest on
+ * @return 1 on success, 0 if a write failed
+ */
+int AesOutStream_Finish(AesOutStream* s);
+
+void AesOutStream_Free(AesOutStream* s);
+
+/*
+ * Look stream of the plaintext of one encrypted pack stream. Offsets are
+ * plaintext offsets from the start of the stream. A seek decrypts from the
+ * block it lands in, with the ciphertext block before it as the IV, in
+ * small steps; once reads stay in order the steps grow, and from
+ * AES_IN_SLOT_SIZE / 4 on a thread reads and decrypts slots ahead while
+ * the caller decodes the one it holds. `in` is only read by that thread
+ * while it runs.
+ */
+typedef struct {
+    ILookInStream vt;
+    ILookInStreamPtr in;
+    UInt64 base;           /* Offset of the pack stream in `in` */
+    UInt64 cipher_end;     /* Ciphertext bytes that hold the plaintext, whole blocks */
+    UInt64 plain_size;     /* The coder's unpack size; the rest is padding */
+    UInt32* aes;           /* IV + key schedule, 16-byte aligned */
+    Byte iv[AES_CODER_IV_SIZE];
+    Byte* slots[AES_IN_SLOTS];
+    UInt64 in_pos;         /* Where `in` stands in the pack stream, (UInt64)-1 if unknown */
+    UInt64 chained;        /* Block offset the CBC state decrypts next, (UInt64)-1 if none */
+
+    /* Reader */
+    UInt64 pos;
+    const Byte* view;
+    UInt64 view_start;
+    size_t view_size;
+    size_t step;           /* Next decryption step on the reader's thread */
+
+    /* Decryption thread; `lock` guards what follows it */
+    pthread_t thread;
+    int running;
+    UInt64 thread_pos;     /* Block offset the thread decrypts next (its own) */
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UInt64 slot_start[AES_IN_SLOTS];
+    size_t slot_size[AES_IN_SLOTS];
+    SRes slot_res[AES_IN_SLOTS];
+    unsigned next_take;
+    unsigned filled;       /* Slots decrypted and not yet taken */
+    int held;              /* The reader holds slot next_take */
+    int stop;
+    int done;              /* The thread has nothing more to decrypt */
+} AesInStream;
+
+/**
+ * Start decrypting a pack stream
+ * @param in Stream the archive is read from
+ * @param base Offset of the pack stream in `in`
+ * @param pack_size Ciphertext bytes of the pack stream
+ * @param plain_size Unpack size of the 7zAES coder
+ * @param key Folder key from sevenzip_aes_derive_key_props()
+ * @param iv IV of the folder
+ * @return SZ_OK, SZ_ERROR_MEM, or SZ_ERROR_THREAD
+ */
+SRes AesInStream_Init(AesInStream* s, ILookInStreamPtr in, UInt64 base, UInt64 pack_size,
+                      UInt64 plain_size, const Byte* key, const Byte* iv);
+
+/* Stop the thread, zero the key schedule and free the slots */
+void AesInStream_Free(AesInStream* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_AES_CODER_H */
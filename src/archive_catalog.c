@@ -0,0 +1,383 @@
+/**
+ * Multi-Archive Catalog
+ *
+ * One file naming every entry of many archives, sorted by path, so the
+ * archive holding a path is found by a binary search instead of a listing
+ * of each archive. Every field is little-endian and fixed-width and names
+ * are offsets into a NUL-terminated string table, so the catalog is
+ * mapped and searched in place:
+ *
+ *   header    magic "7zFFIcat", version, CRC of the rest of the header,
+ *             archive_count, record_count, names_size
+ *   archives  archive_count x (name_offset uint64, entry_count uint64)
+ *   records   record_count x CatalogRecord (40 bytes), by path then archive
+ *   names     names_size bytes of UTF-8, each name NUL-terminated
+ *
+ * A lookup touches the header, about log2(record_count) records and
+ * their names, so only the header is checked when the catalog is opened;
+ * every offset a lookup follows is checked against the table it points
+ * into instead.
+ */
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
+#include "archive_handle.h"
+#include "archive_index.h"
+#include "mmap_stream.h"
+#include "mem_alloc.h"
+#include "global_tables.h"
+#include "utf_convert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+
+#define CATALOG_MAGIC "7zFFIcat"
+#define CATALOG_MAGIC_SIZE 8
+#define CATALOG_VERSION 1
+#define CATALOG_HEADER_SIZE 64
+#define CATALOG_ARCHIVE_SIZE 16
+#define CATALOG_RECORD_SIZE 40
+
+#define CATALOG_RECORD_DIR 1u
+
+/* One entry of one archive, as written */
+typedef struct {
+    uint64_t name_offset;
+    uint64_t size;
+    uint64_t pack_offset;  /* Of the entry's folder, from the start of volume 0 */
+    uint32_t archive;
+    uint32_t entry;
+    uint32_t folder;       /* SEVENZIP_CATALOG_NO_FOLDER = empty file or directory */
+    uint32_t flags;        /* CATALOG_RECORD_* */
+    const char* name;      /* Set for the sort, once the string table is complete */
+} CatalogRecord;
+
+typedef struct {
+    CatalogRecord* records;
+    size_t record_count;
+    size_t record_capacity;
+    char* names;
+    size_t names_size;
+    size_t names_capacity;
+    uint64_t* archives;    /* Per archive: name_offset, entry_count */
+    int failed;            /* Out of memory */
+} CatalogBuilder;
+
+struct SevenZipCatalog {
+    MmapInStream mapped;
+    const unsigned char* data;
+    uint64_t size;
+    uint64_t archive_count;
+    uint64_t record_count;
+    const unsigned char* archives;
+    const unsigned char* records;
+    const char* names;
+    uint64_t names_size;
+};
+
+/* Append a name to the string table
+ * @return Its offset (meaningless once `failed` is set) */
+static uint64_t catalog_add_name(CatalogBuilder* b, const char* name, size_t len) {
+    uint64_t offset = b->names_size;
+    if (b->failed) return offset;
+    if (b->names_size + len + 1 > b->names_capacity) {
+        size_t grown = b->names_capacity ? b->names_capacity * 2 : 65536;
+        while (grown < b->names_size + len + 1) grown *= 2;
+        char* p = (char*)mem_realloc(SEVENZIP_MEM_NAMES, b->names, grown);
+        if (!p) {
+            b->failed = 1;
+            return offset;
+        }
+        b->names = p;
+        b->names_capacity = grown;
+    }
+    memcpy(b->names + b->names_size, name, len);
+    b->names[b->names_size + len] = '\0';
+    b->names_size += len + 1;
+    return offset;
+}
+
+static CatalogRecord* catalog_add_record(CatalogBuilder* b) {
+    if (b->failed) return NULL;
+    if (b->record_count == b->record_capacity) {
+        size_t grown = b->record_capacity ? b->record_capacity * 2 : 4096;
+        CatalogRecord* p = (CatalogRecord*)mem_realloc(SEVENZIP_MEM_HEADER, b->records,
+                                                       grown * sizeof(CatalogRecord));
+        if (!p) {
+            b->failed = 1;
+            return NULL;
+        }
+        b->records = p;
+        b->record_capacity = grown;
+    }
+    return &b->records[b->record_count++];
+}
+
+/* Entries of archive `a` from its .7zidx sidecar
+ * @return SEVENZIP_OK, or the sidecar's error (SEVENZIP_ERROR_OPEN_FILE if there is none) */
+static SevenZipErrorCode catalog_add_index(CatalogBuilder* b, uint32_t a, const char* archive_path) {
+    char index_path[1300];
+    archive_index_path(index_path, sizeof(index_path), archive_path);
+    ArchiveIndexReader r;
+    SevenZipErrorCode err = archive_index_read(&r, index_path);
+    if (err != SEVENZIP_OK) return err;
+    if (r.entry_count > UINT32_MAX) {
+        archive_index_reader_free(&r);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    for (uint64_t i = 0; i < r.entry_count && !b->failed; i++) {
+        ArchiveIndexEntry entry;
+        const char* name;
+        if (!archive_index_get_entry(&r, i, &entry, &name) ||
+            (entry.folder != ARCHIVE_INDEX_NO_FOLDER && entry.folder >= r.folder_count)) {
+            archive_index_reader_free(&r);
+            return SEVENZIP_ERROR_INVALID_ARCHIVE;
+        }
+        CatalogRecord* rec = catalog_add_record(b);
+        if (!rec) break;
+        rec->name_offset = catalog_add_name(b, name, strlen(name));
+        rec->size = entry.size;
+        rec->pack_offset = 0;
+        if (entry.folder != ARCHIVE_INDEX_NO_FOLDER) {
+            ArchiveIndexFolder folder;
+            archive_index_get_folder(&r, entry.folder, &folder);
+            rec->pack_offset = folder.pack_offset;
+        }
+        rec->archive = a;
+        rec->entry = (uint32_t)i;
+        rec->folder = entry.folder;
+        rec->flags = (entry.flags & ARCHIVE_INDEX_ENTRY_DIR) ? CATALOG_RECORD_DIR : 0;
+    }
+    b->archives[2 * a + 1] = r.entry_count;
+    archive_index_reader_free(&r);
+    return SEVENZIP_OK;
+}
+
+/* Entries of archive `a` from its header */
+static SevenZipErrorCode catalog_add_header(CatalogBuilder* b, uint32_t a, const char* archive_path) {
+    SevenZipArchive* archive = NULL;
+    SevenZipErrorCode err = sevenzip_open(archive_path, NULL, &archive);
+    if (err != SEVENZIP_OK) return err;
+    const CSzArEx* db = &archive->db;
+    for (UInt32 i = 0; i < db->NumFiles && !b->failed; i++) {
+        size_t len16 = SzArEx_GetFileNameUtf16(db, i, NULL);
+        char* name = utf16le_to_utf8_dup(db->FileNames + db->FileNameOffsets[i] * 2, len16);
+        if (!name && len16 > 1) {
+            b->failed = 1;
+            break;
+        }
+        CatalogRecord* rec = catalog_add_record(b);
+        if (rec) {
+            rec->name_offset = catalog_add_name(b, name ? name : "", name ? strlen(name) : 0);
+            UInt32 folder = db->FileToFolder[i];
+            rec->size = SzArEx_GetFileSize(db, i);
+            rec->pack_offset = folder == (UInt32)-1 ? 0 :
+                db->dataPos + db->db.PackPositions[db->db.FoStartPackStreamIndex[folder]];
+            rec->archive = a;
+            rec->entry = i;
+            rec->folder = folder;
+            rec->flags = SzArEx_IsDir(db, i) ? CATALOG_RECORD_DIR : 0;
+        }
+        mem_free(name);
+    }
+    b->archives[2 * a + 1] = db->NumFiles;
+    sevenzip_close(archive);
+    return SEVENZIP_OK;
+}
+
+static int compare_records(const void* x, const void* y) {
+    const CatalogRecord* a = (const CatalogRecord*)x;
+    const CatalogRecord* b = (const CatalogRecord*)y;
+    int c = strcmp(a->name, b->name);
+    if (c != 0) return c;
+    if (a->archive != b->archive) return a->archive < b->archive ? -1 : 1;
+    return a->entry < b->entry ? -1 : a->entry > b->entry;
+}
+
+static int catalog_write(const CatalogBuilder* b, size_t archive_count, const char* path) {
+    unsigned char header[CATALOG_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, CATALOG_MAGIC, CATALOG_MAGIC_SIZE);
+    SetUi32(header + 8, CATALOG_VERSION)
+    SetUi64(header + 16, (UInt64)archive_count)
+    SetUi64(header + 24, (UInt64)b->record_count)
+    SetUi64(header + 32, (UInt64)b->names_size)
+    SetUi32(header + 12, CrcCalc(header + 16, CATALOG_HEADER_SIZE - 16))
+
+    char tmp_path[1300];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) return 0;
+    int ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    for (size_t i = 0; ok && i < archive_count; i++) {
+        unsigned char rec[CATALOG_ARCHIVE_SIZE];
+        SetUi64(rec, b->archives[2 * i])
+        SetUi64(rec + 8, b->archives[2 * i + 1])
+        ok = fwrite(rec, 1, sizeof(rec), f) == sizeof(rec);
+    }
+    for (size_t i = 0; ok && i < b->record_count; i++) {
+        const CatalogRecord* r = &b->records[i];
+        unsigned char rec[CATALOG_RECORD_SIZE];
+        SetUi64(rec, r->name_offset)
+        SetUi64(rec + 8, r->size)
+        SetUi64(rec + 16, r->pack_offset)
+        SetUi32(rec + 24, r->archive)
+        SetUi32(rec + 28, r->entry)
+        SetUi32(rec + 32, r->folder)
+        SetUi32(rec + 36, r->flags)
+        ok = fwrite(rec, 1, sizeof(rec), f) == sizeof(rec);
+    }
+    ok = ok && fwrite(b->names, 1, b->names_size, f) == b->names_size;
+    ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp_path, path) == 0;
+#endif
+    if (!ok) remove(tmp_path);
+    return ok;
+}
+
+SevenZipErrorCode sevenzip_catalog_build(const char** archive_paths, size_t count,
+                                         const char* catalog_path) {
+    if ((!archive_paths && count > 0) || !catalog_path || count > UINT32_MAX) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    global_tables_init();
+
+    CatalogBuilder b;
+    memset(&b, 0, sizeof(b));
+    b.archives = (uint64_t*)mem_calloc(SEVENZIP_MEM_HEADER, count ? 2 * count : 1, sizeof(uint64_t));
+    if (!b.archives) return SEVENZIP_ERROR_MEMORY;
+
+    SevenZipErrorCode err = SEVENZIP_OK;
+    for (size_t a = 0; a < count && err == SEVENZIP_OK && !b.failed; a++) {
+        if (!archive_paths[a]) {
+            err = SEVENZIP_ERROR_INVALID_PARAM;
+            break;
+        }
+        b.archives[2 * a] = catalog_add_name(&b, archive_paths[a], strlen(archive_paths[a]));
+        /* The sidecar spares opening the volumes; without one the header is parsed */
+        size_t records_before = b.record_count;
+        size_t names_after_path = b.names_size;
+        err = catalog_add_index(&b, (uint32_t)a, archive_paths[a]);
+        if (err != SEVENZIP_OK && err != SEVENZIP_ERROR_MEMORY) {
+            b.record_count = records_before;
+            b.names_size = names_after_path;
+            err = catalog_add_header(&b, (uint32_t)a, archive_paths[a]);
+        }
+    }
+    if (err == SEVENZIP_OK && b.failed) err = SEVENZIP_ERROR_MEMORY;
+
+    if (err == SEVENZIP_OK) {
+        for (size_t i = 0; i < b.record_count; i++) {
+            b.records[i].name = b.names + b.records[i].name_offset;
+        }
+        if (b.record_count > 1) qsort(b.records, b.record_count, sizeof(CatalogRecord), compare_records);
+        if (!catalog_write(&b, count, catalog_path)) err = SEVENZIP_ERROR_OPEN_FILE;
+    }
+
+    mem_free(b.records);
+    mem_free(b.names);
+    mem_free(b.archives);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_catalog_open(const char* catalog_path, SevenZipCatalog** catalog) {
+    if (!catalog_path || !catalog) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    *catalog = NULL;
+    global_tables_init();
+
+    SevenZipCatalog* c = (SevenZipCatalog*)mem_calloc(SEVENZIP_MEM_OTHER, 1, sizeof(SevenZipCatalog));
+    if (!c) return SEVENZIP_ERROR_MEMORY;
+    if (!mmap_in_stream_open(&c->mapped, catalog_path)) {
+        mem_free(c);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    c->data = c->mapped.volumes[0].data;
+    c->size = c->mapped.total_size;
+
+    const unsigned char* h = c->data;
+    int ok = c->size >= CATALOG_HEADER_SIZE && memcmp(h, CATALOG_MAGIC, CATALOG_MAGIC_SIZE) == 0 &&
+             GetUi32(h + 8) == CATALOG_VERSION &&
+             GetUi32(h + 12) == CrcCalc(h + 16, CATALOG_HEADER_SIZE - 16);
+    if (ok) {
+        c->archive_count = GetUi64(h + 16);
+        c->record_count = GetUi64(h + 24);
+        c->names_size = GetUi64(h + 32);
+        /* Counts bounded by the file before they are multiplied */
+        ok = c->archive_count <= c->size / CATALOG_ARCHIVE_SIZE &&
+             c->record_count <= c->size / CATALOG_RECORD_SIZE && c->names_size <= c->size &&
+             CATALOG_HEADER_SIZE + c->archive_count * CATALOG_ARCHIVE_SIZE +
+                 c->record_count * CATALOG_RECORD_SIZE + c->names_size == c->size &&
+             (c->names_size == 0 || c->data[c->size - 1] == '\0');
+    }
+    if (!ok) {
+        mmap_in_stream_close(&c->mapped);
+        mem_free(c);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    c->archives = c->data + CATALOG_HEADER_SIZE;
+    c->records = c->archives + c->archive_count * CATALOG_ARCHIVE_SIZE;
+    c->names = (const char*)(c->records + c->record_count * CATALOG_RECORD_SIZE);
+    *catalog = c;
+    return SEVENZIP_OK;
+}
+
+/* Name at `offset` of the string table, "" past its end */
+static const char* catalog_name(const SevenZipCatalog* c, uint64_t offset) {
+    return offset < c->names_size ? c->names + offset : "";
+}
+
+SevenZipErrorCode sevenzip_catalog_lookup(const SevenZipCatalog* catalog, const char* path,
+                                          SevenZipCatalogHit* hits, size_t max_hits,
+                                          size_t* count) {
+    if (!catalog || !path || !count || (!hits && max_hits > 0)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    *count = 0;
+
+    /* First record at or after `path` */
+    uint64_t lo = 0, hi = catalog->record_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        const unsigned char* rec = catalog->records + mid * CATALOG_RECORD_SIZE;
+        if (strcmp(catalog_name(catalog, GetUi64(rec)), path) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    size_t n = 0;
+    for (uint64_t i = lo; i < catalog->record_count; i++, n++) {
+        const unsigned char* rec = catalog->records + i * CATALOG_RECORD_SIZE;
+        if (strcmp(catalog_name(catalog, GetUi64(rec)), path) != 0) break;
+        if (n >= max_hits) continue;
+        uint32_t archive = GetUi32(rec + 24);
+        if (archive >= catalog->archive_count) return SEVENZIP_ERROR_INVALID_ARCHIVE;
+        SevenZipCatalogHit* hit = &hits[n];
+        hit->archive_path = catalog_name(catalog,
+                                         GetUi64(catalog->archives + (uint64_t)archive * CATALOG_ARCHIVE_SIZE));
+        hit->archive_index = archive;
+        hit->entry_index = GetUi32(rec + 28);
+        hit->folder_index = GetUi32(rec + 32);
+        hit->size = GetUi64(rec + 8);
+        hit->pack_offset = GetUi64(rec + 16);
+        hit->is_directory = (GetUi32(rec + 36) & CATALOG_RECORD_DIR) != 0;
+    }
+    *count = n;
+    return SEVENZIP_OK;
+}
+
+void sevenzip_catalog_close(SevenZipCatalog* catalog) {
+    if (!catalog) return;
+    mmap_in_stream_close(&catalog->mapped);
+    mem_free(catalog);
+}
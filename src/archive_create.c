@@ -5,9 +5,28 @@
  */
 
 #include "../include/7z_ffi.h"
+#include "archive_filters.h"
+#include "archive_header.h"
+#include "ppmd_compress.h"
+#include "entropy_estimate.h"
+#include "mem_alloc.h"
+#include "memory_budget.h"
+#include "lzma2_block_size.h"
+#include "lzma_params.h"
+#include "dir_scan.h"
+#include "volume_stream.h"
+#include "utf_convert.h"
+#include "cancel_token.h"
+#include "thread_quota.h"
+#include "thread_placement.h"
+#include "trace.h"
 #include "Lzma2Enc.h"
+#include "Threads.h"
 #include "7zCrc.h"
-#include "Alloc.h"
+#include "7z.h"
+#include "CpuArch.h"
+#include "global_tables.h"
+#include "7zFile.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,20 +36,26 @@
 
 #ifdef _WIN32
     #include <windows.h>
+    #include <io.h>
     #define STAT _stat
+    #define FSEEK64 _fseeki64
+    #define FTELL64 _ftelli64
+    #define TRUNCATE_FILE(f, len) _chsize_s(_fileno(f), (__int64)(len))
     #define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
     #define S_ISDIR(m) (((m) & _S_IFMT) == _S_IFDIR)
 #else
     #include <unistd.h>
+    #ifdef __linux__
+        #include <sys/syscall.h>
+    #endif
     #define STAT stat
+    #define FSEEK64 fseeko
+    #define FTELL64 ftello
+    #define TRUNCATE_FILE(f, len) ftruncate(fileno(f), (off_t)(len))
 #endif
 
-#define k7zSignature_Size 6
+/* 7z format constants (signature and start header size come from 7z.h) */
 #define k7zMajorVersion 0
-#define k7zStartHeaderSize 0x20
-
-/* 7z format constants */
-static const Byte k7zSignature[k7zSignature_Size] = {'7', 'z', 0xBC, 0xAF, 0x27, 0x1C};
 
 /* Property IDs for 7z headers */
 typedef enum {
@@ -59,33 +84,6 @@ typedef enum {
     k7zIdDummy = 0x19
 } E7zIdEnum;
 
-/* Test if data is compressible by checking entropy
- * Returns 1 if data appears compressible, 0 if it looks like random/encrypted data
- */
-static int is_data_compressible(const Byte* data, size_t size) {
-    if (size < 1024) return 1;  /* Small data - just compress it */
-    
-    /* Sample up to 64KB */
-    size_t sample_size = (size < 65536) ? size : 65536;
-    
-    /* Count byte frequencies */
-    size_t freq[256] = {0};
-    for (size_t i = 0; i < sample_size; i++) {
-        freq[data[i]]++;
-    }
-    
-    /* Calculate entropy estimate - count unique bytes with significant frequency */
-    int unique_bytes = 0;
-    size_t threshold = sample_size / 512;  /* 0.2% threshold = 128 for 64KB sample */
-    for (int i = 0; i < 256; i++) {
-        if (freq[i] > threshold) unique_bytes++;
-    }
-    
-    /* If >220 unique bytes appear frequently, data is likely incompressible (random/encrypted) */
-    /* Typical text has ~60-100 unique frequent bytes */
-    return unique_bytes < 220;
-}
-
 /* Coder method IDs */
 static const Byte k7zMethodLZMA2[1] = { 0x21 };
 static const Byte k7zMethodCopy[1] = { 0x00 };  /* Copy codec - no compression */
@@ -98,112 +96,71 @@ typedef struct {
     uint64_t mtime;
     uint32_t attrib;
     uint32_t crc;
-    Byte* data;  /* Raw data (for in-memory compression) */
+    char* full_path;  /* Filesystem path, read lazily during compression */
     int is_dir;
+    SevenZipFilter filter;  /* Filter chosen for this file's data */
+    int use_ppmd;           /* 1 = PPMd chosen for this file's data */
+    int precompressed;      /* 1 = stored: detect_compressed recognized its format */
+    int copied;             /* 1 = entry taken over from the archive being updated */
+    int no_crc;             /* 1 = copied entry whose CRC that archive did not record */
+    const Byte* name_utf16; /* Copied entry's name (UTF-16LE with terminator), else NULL */
+    size_t name_utf16_size; /* Bytes at name_utf16 */
 } SevenZFile;
 
+/* Solid block (7z folder): a contiguous run of files with data */
+typedef struct {
+    size_t first_file;     /* Index of the first file in the builder */
+    size_t end_file;       /* One past the last file in the builder */
+    size_t num_streams;    /* Files with data in [first_file, end_file) */
+    uint64_t unpack_size;
+    uint64_t pack_size;
+    Byte lzma2_prop_byte;  /* LZMA2 property byte for header */
+    int use_copy_codec;    /* 1 = Copy codec (planned for precompressed files, or chosen while compressing), 0 = LZMA2 */
+    int use_ppmd;          /* 1 = PPMd instead of LZMA2 */
+    SevenZipFilter filter; /* Filter chained before LZMA2 (NONE = single coder) */
+    int copied;            /* 1 = packed stream(s) copied unchanged from `src` */
+    const CSzArEx* src;    /* Archive being updated, or part being assembled */
+    CSzFile* src_file;     /* Its file, for copying packed streams */
+    UInt32 src_folder;     /* Folder index in `src` */
+} SevenZFolder;
+
+/* Buffer sizes handed to stdio for the archive and for each input file */
+#define ARCHIVE_WRITE_BUFFER_SIZE (4 * 1024 * 1024)
+#define INPUT_READ_BUFFER_SIZE (1024 * 1024)
+
+/* Coder and buffers a batch worker keeps from one archive to the next */
+typedef struct {
+    CLzma2EncHandle enc;   /* Created on first LZMA2 folder */
+    char* write_buf;       /* ARCHIVE_WRITE_BUFFER_SIZE */
+    char* read_buf;        /* INPUT_READ_BUFFER_SIZE */
+} CreateScratch;
+
 /* Archive builder */
 typedef struct {
     SevenZFile* files;
     size_t file_count;
     size_t file_capacity;
     CLzma2EncProps props;
-    Byte lzma2_prop_byte;  /* LZMA2 property byte for header */
     int use_copy_codec;    /* 1 = use Copy codec (store), 0 = use LZMA2 */
+    uint64_t solid_block_size;   /* Bytes per folder before starting a new one (0 = unlimited) */
+    size_t solid_block_files;    /* Files per folder before starting a new one (0 = unlimited) */
+    SevenZipFilter filter;       /* Requested filter (AUTO = detect per file) */
+    unsigned delta_distance;     /* Distance for SEVENZIP_FILTER_DELTA */
+    const char* delta_extensions;  /* Extensions that get Delta in AUTO mode */
+    int detect_compressed;       /* opts->detect_compressed */
+    int solid_sort;              /* opts->solid_sort */
+    int auto_block_size;         /* 1 = opts->block_size 0: blocks sized per folder */
+    SevenZipMethod method;       /* Requested method (AUTO = PPMd for text files) */
+    unsigned ppmd_order;
+    UInt32 ppmd_mem_size;
+    SevenZFolder* folders;
+    size_t folder_count;         /* Copied folders first, then the compressed ones */
+    const SevenZipCancelToken* cancel;  /* opts->cancel */
+    CreateScratch* scratch;      /* Batch worker state (NULL = allocate per archive) */
+    SevenZipNumaPolicy numa_policy;  /* opts->numa_policy */
+    ThreadPlacer* placer;        /* Allocators of the encoder, when thread placement applies */
 } SevenZArchiveBuilder;
 
-/* Helper: Write number in variable-length encoding (7z format) 
- * 
- * 7z number encoding (from 7zArcIn.c ReadNumber):
- * - 0x00-0x7F: 1 byte, value = byte (7 bits)
- * - 0x80-0xBF: 2 bytes, value = ((first & 0x3F) << 8) | second (14 bits)
- * - 0xC0-0xDF: 3 bytes, value = byte2 | (byte3 << 8) | ((first & 0x1F) << 16) (21 bits)
- * - 0xE0-0xEF: 4 bytes, value = byte2 | (byte3 << 8) | (byte4 << 16) | ((first & 0x0F) << 24) (28 bits)
- * - 0xF0-0xF7: 5 bytes (35 bits)
- * - 0xF8-0xFB: 6 bytes (42 bits)
- * - 0xFC-0xFD: 7 bytes (49 bits)
- * - 0xFE:      8 bytes (56 bits)
- * - 0xFF:      9 bytes (64 bits)
- */
-static void WriteNumber(Byte** buf, uint64_t value) {
-    Byte* p = *buf;
-    
-    if (value < 0x80) {
-        /* 1 byte: 7 bits */
-        *p++ = (Byte)value;
-    }
-    else if (value < ((uint64_t)1 << 14)) {
-        /* 2 bytes: 6 bits in first byte + 8 bits in second = 14 bits */
-        *p++ = (Byte)(0x80 | (value >> 8));
-        *p++ = (Byte)(value & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 21)) {
-        /* 3 bytes: 5 bits in first byte + 16 bits little-endian = 21 bits */
-        *p++ = (Byte)(0xC0 | ((value >> 16) & 0x1F));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 28)) {
-        /* 4 bytes: 4 bits in first byte + 24 bits little-endian = 28 bits */
-        *p++ = (Byte)(0xE0 | ((value >> 24) & 0x0F));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 35)) {
-        /* 5 bytes: 3 bits in first byte + 32 bits little-endian = 35 bits */
-        *p++ = (Byte)(0xF0 | ((value >> 32) & 0x07));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 42)) {
-        /* 6 bytes: 2 bits in first byte + 40 bits little-endian = 42 bits */
-        *p++ = (Byte)(0xF8 | ((value >> 40) & 0x03));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 49)) {
-        /* 7 bytes: 1 bit in first byte + 48 bits little-endian = 49 bits */
-        *p++ = (Byte)(0xFC | ((value >> 48) & 0x01));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-        *p++ = (Byte)((value >> 40) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 56)) {
-        /* 8 bytes: first byte 0xFE + 56 bits little-endian */
-        *p++ = 0xFE;
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-        *p++ = (Byte)((value >> 40) & 0xFF);
-        *p++ = (Byte)((value >> 48) & 0xFF);
-    }
-    else {
-        /* 9 bytes: first byte 0xFF + 64 bits little-endian */
-        *p++ = 0xFF;
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-        *p++ = (Byte)((value >> 40) & 0xFF);
-        *p++ = (Byte)((value >> 48) & 0xFF);
-        *p++ = (Byte)((value >> 56) & 0xFF);
-    }
-    
-    *buf = p;
-}
-
 /* Helper: Calculate encoded number size */
 static size_t GetNumberSize(uint64_t value) {
     int i;
@@ -214,623 +171,1044 @@ static size_t GetNumberSize(uint64_t value) {
     return 9;
 }
 
-/* Helper: Add directory and its contents recursively */
-#ifdef _WIN32
-#include <windows.h>
-static SevenZipErrorCode add_directory_recursive(
-    SevenZArchiveBuilder* builder,
-    const char* dir_path,
-    const char* base_path
-) {
-    char pattern[4096];
-    snprintf(pattern, sizeof(pattern), "%s\\*", dir_path);
+/* Helper: Add one entry found below a directory input (see dir_scan.h) */
+static SevenZipErrorCode add_directory_entry(const DirScanEntry* entry, void* user_data) {
+    SevenZArchiveBuilder* builder = (SevenZArchiveBuilder*)user_data;
+    
+    /* Expand array if needed */
+    if (builder->file_count >= builder->file_capacity) {
+        size_t new_capacity = builder->file_capacity * 2;
+        SevenZFile* new_files = (SevenZFile*)mem_realloc(SEVENZIP_MEM_HEADER,
+            builder->files, new_capacity * sizeof(SevenZFile));
+        if (!new_files) {
+            return SEVENZIP_ERROR_MEMORY;
+        }
+        builder->files = new_files;
+        builder->file_capacity = new_capacity;
+    }
     
-    WIN32_FIND_DATAA find_data;
-    HANDLE hFind = FindFirstFileA(pattern, &find_data);
-    if (hFind == INVALID_HANDLE_VALUE) {
-        return SEVENZIP_ERROR_OPEN_FILE;
+    SevenZFile* file = &builder->files[builder->file_count];
+    memset(file, 0, sizeof(SevenZFile));
+    file->name = mem_strdup(SEVENZIP_MEM_NAMES, entry->name);
+    file->mtime = entry->mtime;
+    file->attrib = entry->attrib;
+    file->is_dir = entry->is_dir;
+    if (!file->is_dir && entry->full_path) {
+        /* Record path and size only - data is streamed at compression time */
+        file->size = entry->size;
+        file->full_path = mem_strdup(SEVENZIP_MEM_NAMES, entry->full_path);
+    }
+    if (!file->name || (!file->is_dir && entry->full_path && !file->full_path)) {
+        mem_free(file->name);
+        mem_free(file->full_path);
+        return SEVENZIP_ERROR_MEMORY;
     }
     
-    do {
-        if (strcmp(find_data.cFileName, ".") == 0 || strcmp(find_data.cFileName, "..") == 0) {
-            continue;
-        }
-        
-        char full_path[4096];
-        snprintf(full_path, sizeof(full_path), "%s\\%s", dir_path, find_data.cFileName);
-        
-        /* Expand array if needed */
-        if (builder->file_count >= builder->file_capacity) {
-            builder->file_capacity *= 2;
-            SevenZFile* new_files = (SevenZFile*)realloc(
-                builder->files, builder->file_capacity * sizeof(SevenZFile));
-            if (!new_files) {
-                FindClose(hFind);
-                return SEVENZIP_ERROR_MEMORY;
+    builder->file_count++;
+    return SEVENZIP_OK;
+}
+
+/* Read buffer size for the Copy codec path */
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+/* Input stream that reads the files of one folder in order as one solid
+ * stream. Files are opened lazily and CRCs are computed on the fly, so
+ * memory use does not depend on the size of the input set.
+ */
+typedef struct {
+    ISeqInStream vt;
+    SevenZArchiveBuilder* builder;
+    size_t current_file;
+    size_t end_file;
+    FILE* current_fp;
+    uint64_t current_read;
+    uint32_t current_crc;
+    SevenZipErrorCode error;
+} SolidFileInStream;
+
+static SRes SolidFileInStream_Read(ISeqInStreamPtr pp, void *buf, size_t *size) {
+    SolidFileInStream* s = Z7_CONTAINER_FROM_VTBL(pp, SolidFileInStream, vt);
+    SevenZArchiveBuilder* builder = s->builder;
+    size_t remaining = *size;
+    Byte* out = (Byte*)buf;
+    
+    if (cancel_token_requested(builder->cancel)) {
+        s->error = SEVENZIP_ERROR_CANCELLED;
+        return SZ_ERROR_PROGRESS;
+    }
+    
+    while (remaining > 0) {
+        /* Open next file with data if needed */
+        while (!s->current_fp) {
+            if (s->current_file >= s->end_file) {
+                *size -= remaining;
+                return SZ_OK;
             }
-            builder->files = new_files;
-        }
-        
-        SevenZFile* file = &builder->files[builder->file_count++];
-        memset(file, 0, sizeof(SevenZFile));
-        
-        /* Compute relative path */
-        const char* rel_path = full_path + strlen(base_path);
-        while (*rel_path == '/' || *rel_path == '\\') rel_path++;
-        file->name = strdup(rel_path);
-        
-        FILETIME ft = find_data.ftLastWriteTime;
-        ULARGE_INTEGER ull;
-        ull.LowPart = ft.dwLowDateTime;
-        ull.HighPart = ft.dwHighDateTime;
-        file->mtime = ull.QuadPart;
-        file->attrib = find_data.dwFileAttributes;
-        file->is_dir = (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-        
-        if (file->is_dir) {
-            /* Recursively add directory contents */
-            SevenZipErrorCode err = add_directory_recursive(builder, full_path, base_path);
-            if (err != SEVENZIP_OK) {
-                FindClose(hFind);
-                return err;
+            
+            SevenZFile* file = &builder->files[s->current_file];
+            if (file->is_dir || file->size == 0 || !file->full_path) {
+                file->crc = CRC_GET_DIGEST(CRC_INIT_VAL);
+                s->current_file++;
+                continue;
             }
-        } else {
-            /* Read file data */
-            FILE* f = fopen(full_path, "rb");
-            if (!f) {
-                FindClose(hFind);
-                return SEVENZIP_ERROR_OPEN_FILE;
+            
+            s->current_fp = fopen(file->full_path, "rb");
+            if (!s->current_fp) {
+                s->error = SEVENZIP_ERROR_OPEN_FILE;
+                return SZ_ERROR_READ;
             }
             
             /* Use 1MB read buffer for optimal I/O performance */
-            setvbuf(f, NULL, _IOFBF, 1024 * 1024);
-            
-            fseek(f, 0, SEEK_END);
-            file->size = ftell(f);
-            fseek(f, 0, SEEK_SET);
-            
-            file->data = (Byte*)malloc(file->size);
-            if (!file->data) {
-                fclose(f);
-                FindClose(hFind);
-                return SEVENZIP_ERROR_MEMORY;
+            setvbuf(s->current_fp, builder->scratch ? builder->scratch->read_buf : NULL,
+                    _IOFBF, INPUT_READ_BUFFER_SIZE);
+            s->current_read = 0;
+            s->current_crc = CRC_INIT_VAL;
+        }
+        
+        SevenZFile* file = &builder->files[s->current_file];
+        size_t to_read = remaining;
+        if (to_read > file->size - s->current_read) {
+            to_read = (size_t)(file->size - s->current_read);
+        }
+        
+        TRACE_BEGIN(read);
+        size_t got = fread(out, 1, to_read, s->current_fp);
+        TRACE_END(read, TRACE_READ, got);
+        if (got == 0) {
+            /* File shrank after it was scanned */
+            s->error = SEVENZIP_ERROR_OPEN_FILE;
+            return SZ_ERROR_READ;
+        }
+        
+        s->current_crc = CrcUpdate(s->current_crc, out, got);
+        s->current_read += got;
+        
+        if (s->current_read == file->size) {
+            file->crc = CRC_GET_DIGEST(s->current_crc);
+            fclose(s->current_fp);
+            s->current_fp = NULL;
+            s->current_file++;
+        }
+        
+        out += got;
+        remaining -= got;
+    }
+    
+    return SZ_OK;
+}
+
+static void SolidFileInStream_Init(SolidFileInStream* s, SevenZArchiveBuilder* builder,
+                                   const SevenZFolder* folder) {
+    memset(s, 0, sizeof(*s));
+    s->vt.Read = SolidFileInStream_Read;
+    s->builder = builder;
+    s->current_file = folder->first_file;
+    s->end_file = folder->end_file;
+    s->error = SEVENZIP_OK;
+}
+
+static void SolidFileInStream_Close(SolidFileInStream* s) {
+    if (s->current_fp) {
+        fclose(s->current_fp);
+        s->current_fp = NULL;
+    }
+}
+
+/* Output stream that appends packed data to the archive file */
+typedef struct {
+    ISeqOutStream vt;
+    FILE* file;
+    uint64_t written;
+    int failed;
+} PackOutStream;
+
+static size_t PackOutStream_Write(ISeqOutStreamPtr pp, const void *buf, size_t size) {
+    PackOutStream* s = Z7_CONTAINER_FROM_VTBL(pp, PackOutStream, vt);
+    TRACE_BEGIN(write);
+    size_t written = fwrite(buf, 1, size, s->file);
+    TRACE_END(write, TRACE_WRITE, written);
+    s->written += written;
+    if (written != size) s->failed = 1;
+    return written;
+}
+
+/* Helper: Estimate the entropy of a folder's data
+ *
+ * Windows are spread over the concatenated files, so a folder of videos
+ * is judged by their payloads rather than by the first file's header.
+ * Returns 0 bits (compress) if any window cannot be read.
+ */
+static double estimate_folder_entropy(SevenZArchiveBuilder* builder, const SevenZFolder* folder) {
+    EntropyMean mean = { 0.0, 0 };
+    EntropyHistogram h;
+    
+    size_t file = folder->first_file;
+    uint64_t file_start = 0;  /* Offset of `file` within the folder */
+    for (unsigned i = 0; i < ENTROPY_WINDOWS; i++) {
+        uint64_t pos = entropy_window_offset(folder->unpack_size, i);
+        size_t len = ENTROPY_WINDOW_SIZE;
+        entropy_histogram_init(&h);
+        
+        /* A window crossing a file boundary continues in the next file */
+        while (len > 0 && file < folder->end_file) {
+            const SevenZFile* f = &builder->files[file];
+            if (f->is_dir || pos >= file_start + f->size) {
+                file_start += f->is_dir ? 0 : f->size;
+                file++;
+                continue;
             }
-            
-            if (fread(file->data, 1, file->size, f) != file->size) {
-                fclose(f);
-                FindClose(hFind);
-                return SEVENZIP_ERROR_OPEN_FILE;
+            uint64_t in_file = f->size - (pos - file_start);
+            size_t take = in_file < len ? (size_t)in_file : len;
+            if (!entropy_histogram_add_file_range(&h, f->full_path, pos - file_start, take)) {
+                return 0.0;
             }
-            fclose(f);
+            pos += take;
+            len -= take;
         }
-    } while (FindNextFileA(hFind, &find_data));
-    
-    FindClose(hFind);
+        entropy_mean_add(&mean, &h);
+    }
+    return entropy_mean_bits(&mean);
+}
+
+static int compare_solid_order(const void* a, const void* b) {
+    const SevenZFile* x = *(const SevenZFile* const*)a;
+    const SevenZFile* y = *(const SevenZFile* const*)b;
+    int c = sevenzip_solid_order_compare(x->name, x->size, y->name, y->size);
+    if (c == 0) c = x < y ? -1 : (x > y);  /* Scan order among equals */
+    return c;
+}
+
+/* Helper: Sort the files to be added by type (opts->solid_sort) */
+static SevenZipErrorCode sort_solid_order(SevenZArchiveBuilder* builder) {
+    size_t first = 0;
+    while (first < builder->file_count && builder->files[first].copied) first++;
+    size_t count = builder->file_count - first;
+    if (count < 2) return SEVENZIP_OK;
+    
+    SevenZFile** order = (SevenZFile**)mem_alloc(SEVENZIP_MEM_OTHER, count * sizeof(SevenZFile*));
+    SevenZFile* sorted = (SevenZFile*)mem_alloc(SEVENZIP_MEM_OTHER, count * sizeof(SevenZFile));
+    if (!order || !sorted) {
+        mem_free(order);
+        mem_free(sorted);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    for (size_t i = 0; i < count; i++) {
+        order[i] = &builder->files[first + i];
+    }
+    qsort(order, count, sizeof(SevenZFile*), compare_solid_order);
+    for (size_t i = 0; i < count; i++) {
+        sorted[i] = *order[i];
+    }
+    memcpy(builder->files + first, sorted, count * sizeof(SevenZFile));
+    mem_free(sorted);
+    mem_free(order);
     return SEVENZIP_OK;
 }
-#else
-#include <dirent.h>
-static SevenZipErrorCode add_directory_recursive(
-    SevenZArchiveBuilder* builder,
-    const char* dir_path,
-    const char* base_path
-) {
-    DIR* dir = opendir(dir_path);
-    if (!dir) {
-        return SEVENZIP_ERROR_OPEN_FILE;
+
+/* Helper: Mark files of compressed formats and, in solid archives, move
+ * them behind the other files to be added, both groups in their own order */
+static SevenZipErrorCode group_precompressed(SevenZArchiveBuilder* builder) {
+    size_t first = 0;
+    while (first < builder->file_count && builder->files[first].copied) first++;
+    
+    size_t marked = 0;
+    for (size_t i = first; i < builder->file_count; i++) {
+        SevenZFile* file = &builder->files[i];
+        file->precompressed = !file->is_dir && file->size > 0 &&
+                              sevenzip_is_precompressed_file(file->full_path);
+        marked += (size_t)file->precompressed;
+    }
+    if (marked == 0 || builder->solid_block_files == 1) return SEVENZIP_OK;
+    
+    size_t count = builder->file_count - first;
+    SevenZFile* sorted = (SevenZFile*)mem_alloc(SEVENZIP_MEM_OTHER, count * sizeof(SevenZFile));
+    if (!sorted) return SEVENZIP_ERROR_MEMORY;
+    size_t head = 0;
+    size_t tail = count - marked;
+    for (size_t i = first; i < builder->file_count; i++) {
+        SevenZFile* file = &builder->files[i];
+        sorted[file->precompressed ? tail++ : head++] = *file;
+    }
+    memcpy(builder->files + first, sorted, count * sizeof(SevenZFile));
+    mem_free(sorted);
+    return SEVENZIP_OK;
+}
+
+/* Helper: Split the file list into folders at the solid block thresholds
+ *
+ * Directories, empty files and copied entries never open a folder. A
+ * folder is closed once adding a file reaches either limit, so a single
+ * file larger than solid_block_size still gets a folder of its own. Files
+ * that need a different filter or method also start a new folder.
+ * With detect_compressed, files of compressed formats are moved behind
+ * the others (keeping their order) and planned as Copy folders, so one
+ * solid LZMA2 folder is not broken up by every photo among the documents.
+ * With solid_sort, they are first ordered by type.
+ */
+static SevenZipErrorCode plan_folders(SevenZArchiveBuilder* builder) {
+    /* Folders copied from an updated archive stay in front */
+    size_t copied = builder->folder_count;
+    size_t capacity = copied + (builder->file_count > 0 ? builder->file_count : 1);
+    SevenZFolder* folders = (SevenZFolder*)mem_realloc(SEVENZIP_MEM_HEADER, builder->folders, capacity * sizeof(SevenZFolder));
+    if (!folders) return SEVENZIP_ERROR_MEMORY;
+    memset(folders + copied, 0, (capacity - copied) * sizeof(SevenZFolder));
+    builder->folders = folders;
+    
+    if (builder->solid_sort && builder->solid_block_files != 1 && !builder->use_copy_codec) {
+        SevenZipErrorCode result = sort_solid_order(builder);
+        if (result != SEVENZIP_OK) return result;
+    }
+    if (builder->detect_compressed && !builder->use_copy_codec) {
+        SevenZipErrorCode result = group_precompressed(builder);
+        if (result != SEVENZIP_OK) return result;
     }
     
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
+    SevenZFolder* open = NULL;
+    for (size_t i = 0; i < builder->file_count; i++) {
+        SevenZFile* file = &builder->files[i];
+        if (file->is_dir || file->size == 0 || file->copied) continue;
         
-        char full_path[4096];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
+        int coded = !builder->use_copy_codec && !file->precompressed;
+        file->use_ppmd = coded && sevenzip_ppmd_choose(builder->method, file->full_path);
+        file->filter = (!coded || file->use_ppmd)
+            ? SEVENZIP_FILTER_NONE
+            : sevenzip_filter_choose(builder->filter, file->full_path, file->size,
+                                     builder->delta_extensions);
         
-        /* Get file info */
-        struct STAT st;
-        if (STAT(full_path, &st) != 0) {
-            closedir(dir);
-            return SEVENZIP_ERROR_OPEN_FILE;
+        if (open && (open->filter != file->filter || open->use_ppmd != file->use_ppmd ||
+                     open->use_copy_codec != file->precompressed)) {
+            open = NULL;
         }
+        if (!open) {
+            open = &builder->folders[builder->folder_count++];
+            open->first_file = i;
+            open->filter = file->filter;
+            open->use_ppmd = file->use_ppmd;
+            open->use_copy_codec = file->precompressed;
+        }
+        open->end_file = i + 1;
+        open->num_streams++;
+        open->unpack_size += file->size;
         
-        /* Expand array if needed */
-        if (builder->file_count >= builder->file_capacity) {
-            builder->file_capacity *= 2;
-            SevenZFile* new_files = (SevenZFile*)realloc(
-                builder->files, builder->file_capacity * sizeof(SevenZFile));
-            if (!new_files) {
-                closedir(dir);
-                return SEVENZIP_ERROR_MEMORY;
-            }
-            builder->files = new_files;
-        }
-        
-        SevenZFile* file = &builder->files[builder->file_count++];
-        memset(file, 0, sizeof(SevenZFile));
-        
-        /* Compute relative path */
-        const char* rel_path = full_path + strlen(base_path);
-        while (*rel_path == '/') rel_path++;
-        file->name = strdup(rel_path);
-        file->mtime = (uint64_t)st.st_mtime * 10000000ULL + 116444736000000000ULL;
-        file->attrib = (uint32_t)st.st_mode;
-        file->is_dir = S_ISDIR(st.st_mode);
-        
-        if (file->is_dir) {
-            /* Recursively add directory contents */
-            SevenZipErrorCode err = add_directory_recursive(builder, full_path, base_path);
-            if (err != SEVENZIP_OK) {
-                closedir(dir);
-                return err;
-            }
-        } else if (S_ISREG(st.st_mode)) {
-            /* Read file data */
-            FILE* f = fopen(full_path, "rb");
-            if (!f) {
-                closedir(dir);
-                return SEVENZIP_ERROR_OPEN_FILE;
-            }
-            
-            /* Use 1MB read buffer for optimal I/O performance */
-            setvbuf(f, NULL, _IOFBF, 1024 * 1024);
-            
-            file->size = st.st_size;
-            file->data = (Byte*)malloc(file->size);
-            if (!file->data) {
-                fclose(f);
-                closedir(dir);
-                return SEVENZIP_ERROR_MEMORY;
-            }
-            
-            if (fread(file->data, 1, file->size, f) != file->size) {
-                fclose(f);
-                closedir(dir);
-                return SEVENZIP_ERROR_OPEN_FILE;
-            }
-            fclose(f);
+        if ((builder->solid_block_files > 0 && open->num_streams >= builder->solid_block_files) ||
+            (builder->solid_block_size > 0 && open->unpack_size >= builder->solid_block_size)) {
+            open = NULL;
         }
     }
-    
-    closedir(dir);
     return SEVENZIP_OK;
 }
-#endif
 
-/* Helper: Compress all files into a single LZMA2 stream */
-static SevenZipErrorCode compress_all_files(
+/* Helper: Append a folder's files to the archive unchanged (Copy codec) */
+static SevenZipErrorCode store_folder(
     SevenZArchiveBuilder* builder,
-    Byte** output,
-    size_t* output_size
+    SevenZFolder* folder,
+    FILE* f
 ) {
-    /* Calculate total input size */
-    size_t total_input_size = 0;
-    for (size_t i = 0; i < builder->file_count; i++) {
-        if (!builder->files[i].is_dir && builder->files[i].data) {
-            total_input_size += builder->files[i].size;
-        }
-    }
-    
-    if (total_input_size == 0) {
-        *output = NULL;
-        *output_size = 0;
-        return SEVENZIP_OK;
-    }
-    
-    /* Concatenate all file data into single buffer */
-    Byte* combined = (Byte*)malloc(total_input_size);
-    if (!combined) return SEVENZIP_ERROR_MEMORY;
+    folder->use_copy_codec = 1;
+    folder->filter = SEVENZIP_FILTER_NONE;
+    folder->use_ppmd = 0;
+    folder->pack_size = 0;
+
+    SolidFileInStream in;
+    SolidFileInStream_Init(&in, builder, folder);
+
+    /* Use Copy codec - stream raw data directly (fastest possible) */
+    Byte* buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, COPY_BUFFER_SIZE);
+    if (!buf) return SEVENZIP_ERROR_MEMORY;
     
-    size_t offset = 0;
-    for (size_t i = 0; i < builder->file_count; i++) {
-        if (!builder->files[i].is_dir && builder->files[i].data) {
-            memcpy(combined + offset, builder->files[i].data, builder->files[i].size);
-            /* Calculate individual CRC while we're at it */
-            builder->files[i].crc = CrcCalc(builder->files[i].data, builder->files[i].size);
-            offset += builder->files[i].size;
+    SevenZipErrorCode result = SEVENZIP_OK;
+    for (;;) {
+        size_t got = COPY_BUFFER_SIZE;
+        if (in.vt.Read(&in.vt, buf, &got) != SZ_OK) {
+            result = in.error != SEVENZIP_OK ? in.error : SEVENZIP_ERROR_COMPRESS;
+            break;
+        }
+        if (got == 0) break;
+        if (fwrite(buf, 1, got, f) != got) {
+            result = SEVENZIP_ERROR_COMPRESS;
+            break;
         }
+        folder->pack_size += got;
     }
     
+    SolidFileInStream_Close(&in);
+    mem_free(buf);
+    return result;
+}
+
+/* Helper: Compress one folder and append its packed stream to the archive
+ *
+ * `enc` is created on first LZMA2 use and reused for later folders. Data the
+ * entropy sample misses is caught while encoding: a RatioGuard stops LZMA2
+ * once the output is clearly not shrinking, and the folder is rewound and
+ * stored instead, so incompressible input is never encoded to the end.
+ */
+static SevenZipErrorCode compress_folder(
+    SevenZArchiveBuilder* builder,
+    SevenZFolder* folder,
+    CLzma2EncHandle* enc,
+    FILE* f
+) {
     /* ADAPTIVE COMPRESSION: Check if data is compressible */
     /* For large data (>1MB), if it looks like random/encrypted data, use Copy codec */
     /* Also use Copy codec if explicitly requested (Store mode) */
-    if (builder->use_copy_codec || 
-        (total_input_size > 1024 * 1024 && !is_data_compressible(combined, total_input_size))) {
-        /* Use Copy codec - return raw data directly (fastest possible) */
-        builder->use_copy_codec = 1;
-        builder->lzma2_prop_byte = 0;  /* Not used for Copy codec */
-        
-        *output = combined;  /* Return concatenated raw data */
-        *output_size = total_input_size;
-        return SEVENZIP_OK;
+    if (builder->use_copy_codec || folder->use_copy_codec ||
+        (folder->unpack_size > ENTROPY_MIN_CHECK_SIZE &&
+         !sevenzip_entropy_is_compressible(estimate_folder_entropy(builder, folder)))) {
+        return store_folder(builder, folder, f);
     }
-    
-    builder->use_copy_codec = 0;
-    
-    /* Create LZMA2 encoder */
-    CLzma2EncHandle enc = Lzma2Enc_Create(&g_Alloc, &g_Alloc);
-    if (!enc) {
-        free(combined);
-        return SEVENZIP_ERROR_MEMORY;
+    folder->use_copy_codec = 0;
+    
+    /* Start of this folder's packed stream, for the store fallback */
+    int64_t folder_start = (int64_t)FTELL64(f);
+    if (folder_start < 0) return SEVENZIP_ERROR_COMPRESS;
+    
+    SolidFileInStream in;
+    SolidFileInStream_Init(&in, builder, folder);
+    
+    PackOutStream out;
+    out.vt.Write = PackOutStream_Write;
+    out.file = f;
+    out.written = 0;
+    out.failed = 0;
+    
+    int fall_back = 0;
+    if (folder->use_ppmd) {
+        TRACE_BEGIN(compress);
+        SRes ppmd_res = sevenzip_ppmd_encode(&out.vt, &in.vt, builder->ppmd_order,
+                                             builder->ppmd_mem_size);
+        TRACE_END(compress, TRACE_COMPRESS, folder->unpack_size);
+        SolidFileInStream_Close(&in);
+        
+        if (in.error != SEVENZIP_OK) {
+            return in.error;
+        }
+        if (ppmd_res != SZ_OK || out.failed) {
+            return ppmd_res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_COMPRESS;
+        }
+        fall_back = !sevenzip_ratio_is_worthwhile(folder->unpack_size, out.written);
+    } else {
+        /* Create LZMA2 encoder */
+        if (!*enc) {
+            *enc = builder->placer
+                ? Lzma2Enc_Create(&builder->placer->small, &builder->placer->big)
+                : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+            if (!*enc) {
+                SolidFileInStream_Close(&in);
+                return SEVENZIP_ERROR_MEMORY;
+            }
+        }
+        
+        /* Blocks sized for this folder, unless opts->block_size set them */
+        CLzma2EncProps props = builder->props;
+        if (builder->auto_block_size) {
+            sevenzip_lzma2_spread_blocks(&props, folder->unpack_size);
+        }
+        SRes res = Lzma2Enc_SetProps(*enc, &props);
+        if (res != SZ_OK) {
+            SolidFileInStream_Close(&in);
+            return SEVENZIP_ERROR_COMPRESS;
+        }
+        
+        /* Expected size lets the encoder choose block sizes for threading */
+        Lzma2Enc_SetDataSize(*enc, folder->unpack_size);
+        
+        /* Get LZMA2 property byte for header */
+        folder->lzma2_prop_byte = Lzma2Enc_WriteProperties(*enc);
+        
+        /* Filter runs on the raw data in front of the encoder */
+        ISeqInStreamPtr src = &in.vt;
+        FilterInStream filtered;
+        int use_filter = (folder->filter != SEVENZIP_FILTER_NONE);
+        if (use_filter) {
+            if (FilterInStream_Init(&filtered, folder->filter, builder->delta_distance, &in.vt) != SZ_OK) {
+                SolidFileInStream_Close(&in);
+                return SEVENZIP_ERROR_MEMORY;
+            }
+            src = &filtered.vt;
+        }
+        
+        RatioGuard guard;
+        RatioGuard_Init(&guard);
+        CancelProgress cancel;
+        TRACE_BEGIN(compress);
+        res = Lzma2Enc_Encode2(*enc, &out.vt, NULL, NULL, src, NULL, 0,
+                               CancelProgress_Init(&cancel, builder->cancel, &guard.vt));
+        TRACE_END(compress, TRACE_COMPRESS, folder->unpack_size);
+        
+        if (use_filter) {
+            FilterInStream_Free(&filtered);
+        }
+        SolidFileInStream_Close(&in);
+        
+        if (in.error != SEVENZIP_OK) {
+            return in.error;
+        }
+        if (res == SZ_ERROR_PROGRESS && !guard.tripped) {
+            return SEVENZIP_ERROR_CANCELLED;  /* Stopped by the token's check */
+        }
+        if (guard.tripped && !out.failed) {
+            fall_back = 1;
+        } else if (res != SZ_OK || out.failed) {
+            return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_COMPRESS;
+        } else {
+            fall_back = !sevenzip_ratio_is_worthwhile(folder->unpack_size, out.written);
+        }
     }
     
-    SRes res = Lzma2Enc_SetProps(enc, &builder->props);
-    if (res != SZ_OK) {
-        Lzma2Enc_Destroy(enc);
-        free(combined);
-        return SEVENZIP_ERROR_COMPRESS;
+    if (fall_back) {
+        /* Overwrite the partial stream; any tail left past the final header
+         * is cut off in write_7z_archive() */
+        if (FSEEK64(f, folder_start, SEEK_SET) != 0) {
+            return SEVENZIP_ERROR_COMPRESS;
+        }
+        return store_folder(builder, folder, f);
     }
     
-    /* Get LZMA2 property byte for header */
-    builder->lzma2_prop_byte = Lzma2Enc_WriteProperties(enc);
+    folder->pack_size = out.written;
+    return SEVENZIP_OK;
+}
+
+/* Where copied packed bytes go: the archive file, or assembled volumes
+ * @return 1 if all `size` bytes were written */
+typedef int (*PackedWriteFunc)(void* ctx, const void* data, size_t size);
+
+static int write_stdio(void* ctx, const void* data, size_t size) {
+    return fwrite(data, 1, size, (FILE*)ctx) == size;
+}
+
+/* Helper: Packed bytes of a copied folder (all of its pack streams) */
+static uint64_t copied_pack_size(const SevenZFolder* folder) {
+    const CSzAr* ar = &folder->src->db;
+    UInt32 first = ar->FoStartPackStreamIndex[folder->src_folder];
+    UInt32 end = ar->FoStartPackStreamIndex[folder->src_folder + 1];
+    return ar->PackPositions[end] - ar->PackPositions[first];
+}
+
+/* Helper: Offset of a copied folder's first packed byte in its source file */
+static uint64_t copied_pack_offset(const SevenZFolder* folder) {
+    const CSzAr* ar = &folder->src->db;
+    return folder->src->dataPos + ar->PackPositions[ar->FoStartPackStreamIndex[folder->src_folder]];
+}
+
+/* Helper: Append a copied folder's packed streams from its source archive
+ *
+ * The bytes are moved verbatim, so any coder chain (including ones this
+ * library cannot encode) survives an update or an assembly.
+ * @param skip Leading bytes already written another way
+ */
+static SevenZipErrorCode copy_folder(
+    SevenZFolder* folder,
+    uint64_t skip,
+    PackedWriteFunc write,
+    void* ctx
+) {
+    folder->pack_size = copied_pack_size(folder);
+    UInt64 remaining = folder->pack_size - skip;
+    Int64 pos = (Int64)(copied_pack_offset(folder) + skip);
     
-    /* Allocate output buffer (compressed data) */
-    size_t out_size = total_input_size + total_input_size / 3 + 128;
-    Byte* out_buf = (Byte*)malloc(out_size);
-    if (!out_buf) {
-        Lzma2Enc_Destroy(enc);
-        free(combined);
-        return SEVENZIP_ERROR_MEMORY;
+    if (File_Seek(folder->src_file, &pos, SZ_SEEK_SET) != 0) {
+        return SEVENZIP_ERROR_OPEN_FILE;
     }
     
-    /* Compress all data into single stream */
-    res = Lzma2Enc_Encode2(enc, NULL, out_buf, &out_size,
-                           NULL, combined, total_input_size, NULL);
+    Byte* buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, COPY_BUFFER_SIZE);
+    if (!buf) return SEVENZIP_ERROR_MEMORY;
     
-    Lzma2Enc_Destroy(enc);
-    free(combined);
-    
-    if (res != SZ_OK) {
-        free(out_buf);
-        return SEVENZIP_ERROR_COMPRESS;
+    SevenZipErrorCode result = SEVENZIP_OK;
+    while (remaining > 0) {
+        size_t got = remaining < COPY_BUFFER_SIZE ? (size_t)remaining : COPY_BUFFER_SIZE;
+        if (File_Read(folder->src_file, buf, &got) != 0 || got == 0) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+            break;
+        }
+        if (!write(ctx, buf, got)) {
+            result = SEVENZIP_ERROR_COMPRESS;
+            break;
+        }
+        remaining -= got;
     }
     
-    /* NOTE: Lzma2Enc_Encode2 updates out_size to the actual bytes written.
-     * The encoder produces a valid LZMA2 stream with proper end marker.
-     * We trust the encoder's reported size directly.
-     * 
-     * Previous code tried to parse LZMA2 chunks to find the end marker,
-     * but this was buggy because 0x00 bytes in uncompressed data could
-     * be misinterpreted as end markers when parsing logic had errors.
-     */
-    
-    *output = out_buf;
-    *output_size = out_size;
-    return SEVENZIP_OK;
+    mem_free(buf);
+    return result;
 }
 
-/* Helper: Write 7z archive with proper format structure */
-static SevenZipErrorCode write_7z_archive(
-    const char* archive_path,
-    SevenZArchiveBuilder* builder
+/* Helper: Compress all files into one packed stream per folder
+ *
+ * Memory is bounded by the encoder state plus one read buffer: files are
+ * pulled through SolidFileInStream and packed bytes go straight to `f`.
+ * Copied folders are written first, in their order in the updated archive.
+ */
+static SevenZipErrorCode compress_all_files(
+    SevenZArchiveBuilder* builder,
+    FILE* f,
+    uint64_t* pack_size
 ) {
-    FILE* f = fopen(archive_path, "wb");
-    if (!f) return SEVENZIP_ERROR_OPEN_FILE;
-    
-    /* Use 4MB write buffer for optimal I/O performance */
-    setvbuf(f, NULL, _IOFBF, 4 * 1024 * 1024);
-    
-    /* === WRITE SIGNATURE HEADER === */
-    fwrite(k7zSignature, 1, k7zSignature_Size, f);
-    
-    /* Version (0.4) */
-    Byte ver[2] = {k7zMajorVersion, 4};
-    fwrite(ver, 1, 2, f);
-    
-    /* Start header CRC placeholder */
-    long start_crc_pos = ftell(f);
-    uint32_t dummy_crc = 0;
-    fwrite(&dummy_crc, 4, 1, f);
-    
-    /* Next header offset and size placeholders */
-    long next_header_offset_pos = ftell(f);
-    uint64_t dummy_offset = 0;
-    uint64_t dummy_size = 0;
-    fwrite(&dummy_offset, 8, 1, f);
-    fwrite(&dummy_size, 8, 1, f);
-    
-    /* Next header CRC placeholder */
-    fwrite(&dummy_crc, 4, 1, f);
-    
-    /* === WRITE PACKED DATA === */
-    /* Compress all files into a single LZMA2 stream */
-    Byte* pack_data = NULL;
-    size_t pack_size = 0;
-    SevenZipErrorCode compress_err = compress_all_files(builder, &pack_data, &pack_size);
-    if (compress_err != SEVENZIP_OK) {
-        fclose(f);
-        return compress_err;
+    *pack_size = 0;
+    for (size_t i = 0; i < builder->file_count; i++) {
+        if (!builder->files[i].copied) builder->files[i].crc = CRC_GET_DIGEST(CRC_INIT_VAL);
     }
     
-    long pack_pos = ftell(f);
-    
-    /* Write the single compressed stream */
-    if (pack_data && pack_size > 0) {
-        fwrite(pack_data, 1, pack_size, f);
+    SevenZipErrorCode result = plan_folders(builder);
+    if (result != SEVENZIP_OK) return result;
+    
+    /* A batch worker's encoder outlives the archive; it is single-threaded,
+     * so only an encoder of this call has block threads to place */
+    CLzma2EncHandle local_enc = NULL;
+    CLzma2EncHandle* enc = builder->scratch ? &builder->scratch->enc : &local_enc;
+    ThreadPlacer placer;
+    builder->placer = !builder->scratch && thread_placer_init(&placer, builder->numa_policy)
+                      ? &placer : NULL;
+    for (size_t i = 0; i < builder->folder_count; i++) {
+        result = builder->folders[i].copied
+            ? copy_folder(&builder->folders[i], 0, write_stdio, f)
+            : compress_folder(builder, &builder->folders[i], enc, f);
+        if (result != SEVENZIP_OK) break;
+        *pack_size += builder->folders[i].pack_size;
     }
     
-    /* === BUILD HEADER IN MEMORY === */
-    size_t header_capacity = 65536;  /* 64KB buffer */
-    Byte* header = (Byte*)malloc(header_capacity);
-    if (!header) {
-        free(pack_data);
-        fclose(f);
-        return SEVENZIP_ERROR_MEMORY;
+    if (local_enc) {
+        Lzma2Enc_Destroy(local_enc);
+    }
+    builder->placer = NULL;
+    return result;
+}
+
+/* Helper: Bytes of a file's name in the header (UTF-16LE with terminator) */
+static size_t file_name_size(const SevenZFile* file) {
+    return file->name_utf16 ? file->name_utf16_size : utf8_to_utf16le_size(file->name) + 2;
+}
+
+/* Helper: Pack streams of a folder (copied folders may have several) */
+static UInt32 folder_pack_streams(const SevenZFolder* folder) {
+    if (!folder->copied) return 1;
+    const CSzAr* ar = &folder->src->db;
+    return ar->FoStartPackStreamIndex[folder->src_folder + 1] -
+           ar->FoStartPackStreamIndex[folder->src_folder];
+}
+
+/* Header written behind the packed streams, and the start header fields
+ * that point at it */
+typedef struct {
+    Byte* data;                  /* Bytes following the packed streams (mem_free) */
+    size_t size;
+    uint64_t next_header_offset; /* From the end of the start header */
+    uint64_t next_header_size;
+    uint32_t next_header_crc;
+} ArchiveTail;
+
+/* Helper: Build the archive header for the builder's files and folders
+ * Folder pack sizes must be final; the header is compressed when that
+ * makes it smaller.
+ * @param pack_size Packed bytes between the start header and the tail
+ */
+static SevenZipErrorCode build_archive_tail(
+    const SevenZArchiveBuilder* builder,
+    uint64_t pack_size,
+    ArchiveTail* tail
+) {
+    TRACE_BEGIN(header);
+    HeaderBuffer hb;
+    header_buffer_init(&hb);
+    size_t num_pack_streams = 0;
+    for (size_t i = 0; i < builder->folder_count; i++) {
+        num_pack_streams += folder_pack_streams(&builder->folders[i]);
     }
-    
-    Byte* p = header;
-    Byte* header_start = p;
     
     /* Header marker */
-    *p++ = k7zIdHeader;
+    header_buffer_byte(&hb, k7zIdHeader);
     
     /* === MainStreamsInfo === */
-    *p++ = k7zIdMainStreamsInfo;
-    
-    /* --- PackInfo --- */
-    *p++ = k7zIdPackInfo;
-    WriteNumber(&p, 0);  /* Pack position (offset from end of SignatureHeader) */
-    WriteNumber(&p, 1);  /* Number of pack streams - always 1 (all files in single stream) */
-    
-    /* Pack size */
-    *p++ = k7zIdSize;
-    WriteNumber(&p, pack_size);  /* Size of the single compressed stream */
-
-    
-    *p++ = k7zIdEnd;  /* End PackInfo */
-    
-    /* --- UnpackInfo --- */
-    *p++ = k7zIdUnpackInfo;
-    
-    /* Folder */
-    *p++ = k7zIdFolder;
-    WriteNumber(&p, 1);  /* Number of folders */
-    
-    /* External flag (0 = not external) */
-    WriteNumber(&p, 0);
-    
-    /* Number of coders */
-    WriteNumber(&p, 1);
-    
-    if (builder->use_copy_codec) {
-        /* Coder flags byte for Copy codec:
-         *   Bits 7-6: reserved (0)
-         *   Bit 5: HasProperties (0 = no property data)
-         *   Bit 4: IsComplex (0 = simple coder)
-         *   Bits 0-3: Codec ID size (1 byte)
-         * Value: 0x01 = 00000001 = ID_size=1, no properties
-         */
-        *p++ = 0x01;
+    /* Omitted entirely when no file carries data */
+    if (builder->folder_count > 0) {
+        header_buffer_byte(&hb, k7zIdMainStreamsInfo);
         
-        /* Codec ID (Copy = 0x00) */
-        *p++ = 0x00;
+        /* --- PackInfo --- */
+        header_buffer_byte(&hb, k7zIdPackInfo);
+        header_buffer_number(&hb, 0);  /* Pack position (offset from end of SignatureHeader) */
+        header_buffer_number(&hb, num_pack_streams);  /* One per folder, copied folders may have more */
         
-        /* No property data for Copy codec */
-    } else {
-        /* Coder flags byte for LZMA2:
-         *   Bits 7-6: reserved (0)
-         *   Bit 5: HasProperties (1 = has property data after codec ID)
-         *   Bit 4: IsComplex (0 = simple coder, no NumIn/NumOut)
-         *   Bits 0-3: Codec ID size (1 byte for LZMA2)
-         * Value: 0x21 = 00100001 = HasProperties + ID_size=1
-         */
-        *p++ = 0x21;
-        
-        /* Codec ID (LZMA2 = 0x21) */
-        *p++ = 0x21;
-        
-        /* Property data (because HasProperties bit is set) */
-        WriteNumber(&p, 1);  /* Properties size = 1 byte */
-        *p++ = builder->lzma2_prop_byte;  /* Actual LZMA2 property byte */
-    }
-    
-    /* CoderUnpackSizes */
-    *p++ = k7zIdCodersUnpackSize;
-    uint64_t total_unpack_size = 0;
-    for (size_t i = 0; i < builder->file_count; i++) {
-        if (!builder->files[i].is_dir) {
-            total_unpack_size += builder->files[i].size;
-        }
-    }
-    WriteNumber(&p, total_unpack_size);
-    
-    *p++ = k7zIdEnd;  /* End UnpackInfo */
-    
-    /* --- SubStreamsInfo --- */
-    *p++ = k7zIdSubStreamsInfo;
-    
-    /* Count non-directory files */
-    size_t num_files = 0;
-    for (size_t i = 0; i < builder->file_count; i++) {
-        if (!builder->files[i].is_dir) {
-            num_files++;
-        }
-    }
-    
-    /* Number of unpack streams per folder */
-    *p++ = k7zIdNumUnpackStream;
-    WriteNumber(&p, num_files);  /* Number of files extracted from single stream */
-    
-    /* Individual file sizes (all but last - last is implied) */
-    if (num_files > 1) {
-        *p++ = k7zIdSize;
-        size_t written = 0;
-        for (size_t i = 0; i < builder->file_count && written < num_files - 1; i++) {
-            if (!builder->files[i].is_dir) {
-                WriteNumber(&p, builder->files[i].size);
-                written++;
+        /* Pack sizes */
+        header_buffer_byte(&hb, k7zIdSize);
+        for (size_t i = 0; i < builder->folder_count; i++) {
+            const SevenZFolder* folder = &builder->folders[i];
+            if (folder->copied) {
+                const CSzAr* ar = &folder->src->db;
+                for (UInt32 k = ar->FoStartPackStreamIndex[folder->src_folder];
+                     k < ar->FoStartPackStreamIndex[folder->src_folder + 1]; k++) {
+                    header_buffer_number(&hb, ar->PackPositions[k + 1] - ar->PackPositions[k]);
+                }
+            } else {
+                header_buffer_number(&hb, folder->pack_size);
             }
         }
-    }
-    
-    /* CRC values for all files */
-    *p++ = k7zIdCRC;
-    *p++ = 1;  /* All CRCs are defined */
-    for (size_t i = 0; i < builder->file_count; i++) {
-        if (!builder->files[i].is_dir) {
-            /* Write CRC in little-endian */
-            uint32_t crc_le = builder->files[i].crc;
-            memcpy(p, &crc_le, 4);
-            p += 4;
+        
+        header_buffer_byte(&hb, k7zIdEnd);  /* End PackInfo */
+        
+        /* --- UnpackInfo --- */
+        header_buffer_byte(&hb, k7zIdUnpackInfo);
+        
+        /* Folders */
+        header_buffer_byte(&hb, k7zIdFolder);
+        header_buffer_number(&hb, builder->folder_count);  /* Number of folders */
+        
+        /* External flag (0 = not external) */
+        header_buffer_number(&hb, 0);
+        
+        for (size_t i = 0; i < builder->folder_count; i++) {
+            if (builder->folders[i].copied) {
+                /* Coders, bonds and pack stream indices exactly as they were */
+                const CSzAr* ar = &builder->folders[i].src->db;
+                UInt32 fo = builder->folders[i].src_folder;
+                size_t record_size = ar->FoCodersOffsets[fo + 1] - ar->FoCodersOffsets[fo];
+                header_buffer_bytes(&hb, ar->CodersData + ar->FoCodersOffsets[fo], record_size);
+                continue;
+            }
+            
+            /* Number of coders: LZMA2, plus the filter it feeds */
+            int has_filter = builder->folders[i].filter != SEVENZIP_FILTER_NONE;
+            header_buffer_number(&hb, has_filter ? 2 : 1);
+            
+            if (builder->folders[i].use_copy_codec) {
+                /* Coder flags byte for Copy codec:
+                 *   Bits 7-6: reserved (0)
+                 *   Bit 5: HasProperties (0 = no property data)
+                 *   Bit 4: IsComplex (0 = simple coder)
+                 *   Bits 0-3: Codec ID size (1 byte)
+                 * Value: 0x01 = 00000001 = ID_size=1, no properties
+                 */
+                header_buffer_byte(&hb, 0x01);
+                
+                /* Codec ID (Copy = 0x00) */
+                header_buffer_byte(&hb, 0x00);
+                
+                /* No property data for Copy codec */
+            } else if (builder->folders[i].use_ppmd) {
+                /* PPMd: 3-byte ID 03 04 01, properties = order + model size */
+                Byte* q = header_buffer_reserve(&hb, HEADER_CODER_MAX);
+                if (q) {
+                    header_buffer_commit(&hb, sevenzip_ppmd_write_coder(builder->ppmd_order,
+                                                                        builder->ppmd_mem_size, q));
+                }
+            } else {
+                /* Coder flags byte for LZMA2:
+                 *   Bits 7-6: reserved (0)
+                 *   Bit 5: HasProperties (1 = has property data after codec ID)
+                 *   Bit 4: IsComplex (0 = simple coder, no NumIn/NumOut)
+                 *   Bits 0-3: Codec ID size (1 byte for LZMA2)
+                 * Value: 0x21 = 00100001 = HasProperties + ID_size=1
+                 */
+                header_buffer_byte(&hb, 0x21);
+                
+                /* Codec ID (LZMA2 = 0x21) */
+                header_buffer_byte(&hb, 0x21);
+                
+                /* Property data (because HasProperties bit is set) */
+                header_buffer_number(&hb, 1);  /* Properties size = 1 byte */
+                header_buffer_byte(&hb, builder->folders[i].lzma2_prop_byte);  /* Actual LZMA2 property byte */
+            }
+            
+            if (has_filter) {
+                /* Coder 1: the filter (Delta carries its distance as a property) */
+                Byte* q = header_buffer_reserve(&hb, HEADER_CODER_MAX);
+                if (q) {
+                    header_buffer_commit(&hb, sevenzip_filter_write_coder(builder->folders[i].filter,
+                                                                          builder->delta_distance, q));
+                }
+                
+                /* Bond: filter input (in stream 1) <- LZMA2 output (out stream 0);
+                 * the single pack stream is the unbound LZMA2 input */
+                header_buffer_number(&hb, 1);
+                header_buffer_number(&hb, 0);
+            }
+        }
+        
+        /* CoderUnpackSizes */
+        header_buffer_byte(&hb, k7zIdCodersUnpackSize);
+        for (size_t i = 0; i < builder->folder_count; i++) {
+            if (builder->folders[i].copied) {
+                const CSzAr* ar = &builder->folders[i].src->db;
+                UInt32 fo = builder->folders[i].src_folder;
+                for (UInt32 k = ar->FoToCoderUnpackSizes[fo]; k < ar->FoToCoderUnpackSizes[fo + 1]; k++) {
+                    header_buffer_number(&hb, ar->CoderUnpackSizes[k]);
+                }
+                continue;
+            }
+            
+            /* One size per coder output; filters preserve length */
+            header_buffer_number(&hb, builder->folders[i].unpack_size);
+            if (builder->folders[i].filter != SEVENZIP_FILTER_NONE) {
+                header_buffer_number(&hb, builder->folders[i].unpack_size);
+            }
+        }
+        
+        header_buffer_byte(&hb, k7zIdEnd);  /* End UnpackInfo */
+        
+        /* --- SubStreamsInfo --- */
+        header_buffer_byte(&hb, k7zIdSubStreamsInfo);
+        
+        /* Number of unpack streams per folder */
+        header_buffer_byte(&hb, k7zIdNumUnpackStream);
+        for (size_t i = 0; i < builder->folder_count; i++) {
+            header_buffer_number(&hb, builder->folders[i].num_streams);
+        }
+        
+        /* Individual file sizes (all but the last of each folder - last is implied) */
+        int has_sizes = 0;
+        for (size_t i = 0; i < builder->folder_count; i++) {
+            if (builder->folders[i].num_streams > 1) has_sizes = 1;
+        }
+        if (has_sizes) {
+            header_buffer_byte(&hb, k7zIdSize);
+            for (size_t i = 0; i < builder->folder_count; i++) {
+                const SevenZFolder* folder = &builder->folders[i];
+                size_t written = 0;
+                for (size_t j = folder->first_file;
+                     j < folder->end_file && written + 1 < folder->num_streams; j++) {
+                    if (!builder->files[j].is_dir && builder->files[j].size > 0) {
+                        header_buffer_number(&hb, builder->files[j].size);
+                        written++;
+                    }
+                }
+            }
+        }
+        
+        /* CRC values for all files with data; copied entries may lack one */
+        int all_crcs = 1;
+        for (size_t i = 0; i < builder->file_count; i++) {
+            if (!builder->files[i].is_dir && builder->files[i].size > 0 && builder->files[i].no_crc) {
+                all_crcs = 0;
+            }
+        }
+        header_buffer_byte(&hb, k7zIdCRC);
+        header_buffer_byte(&hb, (Byte)all_crcs);
+        if (!all_crcs) {
+            HeaderBits defined;
+            header_bits_begin(&defined, &hb);
+            for (size_t i = 0; i < builder->file_count; i++) {
+                if (!builder->files[i].is_dir && builder->files[i].size > 0) {
+                    header_bits_put(&defined, !builder->files[i].no_crc);
+                }
+            }
+            header_bits_end(&defined);
+        }
+        for (size_t i = 0; i < builder->file_count; i++) {
+            if (!builder->files[i].is_dir && builder->files[i].size > 0 && !builder->files[i].no_crc) {
+                header_buffer_uint32(&hb, builder->files[i].crc);
+            }
         }
+        
+        header_buffer_byte(&hb, k7zIdEnd);  /* End SubStreamsInfo */
+        header_buffer_byte(&hb, k7zIdEnd);  /* End MainStreamsInfo */
     }
-
-    
-    *p++ = k7zIdEnd;  /* End SubStreamsInfo */
-    *p++ = k7zIdEnd;  /* End MainStreamsInfo */
     
     /* === FilesInfo === */
-    *p++ = k7zIdFilesInfo;
-    WriteNumber(&p, builder->file_count);
+    header_buffer_byte(&hb, k7zIdFilesInfo);
+    header_buffer_number(&hb, builder->file_count);
     
-    /* EmptyStream bit vector (for directories) */
-    int has_dirs = 0;
+    /* EmptyStream bit vector (directories and empty files) */
+    size_t num_empty = 0;
     for (size_t i = 0; i < builder->file_count; i++) {
-        if (builder->files[i].is_dir) {
-            has_dirs = 1;
-            break;
+        if (builder->files[i].is_dir || builder->files[i].size == 0) {
+            num_empty++;
         }
     }
     
-    if (has_dirs) {
-        *p++ = k7zIdEmptyStream;
-        size_t mask_size = (builder->file_count + 7) / 8;
-        WriteNumber(&p, mask_size);
-        memset(p, 0, mask_size);
+    if (num_empty > 0) {
+        header_buffer_byte(&hb, k7zIdEmptyStream);
+        header_buffer_number(&hb, (builder->file_count + 7) / 8);
+        HeaderBits empty_stream;
+        header_bits_begin(&empty_stream, &hb);
         for (size_t i = 0; i < builder->file_count; i++) {
-            if (builder->files[i].is_dir) {
-                p[i / 8] |= (1 << (7 - (i % 8)));
+            header_bits_put(&empty_stream, builder->files[i].is_dir || builder->files[i].size == 0);
+        }
+        header_bits_end(&empty_stream);
+        
+        /* EmptyFile bit vector, indexed over the empty streams only */
+        header_buffer_byte(&hb, k7zIdEmptyFile);
+        header_buffer_number(&hb, (num_empty + 7) / 8);
+        HeaderBits empty_file;
+        header_bits_begin(&empty_file, &hb);
+        for (size_t i = 0; i < builder->file_count; i++) {
+            if (builder->files[i].is_dir || builder->files[i].size == 0) {
+                header_bits_put(&empty_file, !builder->files[i].is_dir);
             }
         }
-        p += mask_size;
+        header_bits_end(&empty_file);
     }
     
     /* Names (UTF-16LE) */
-    *p++ = k7zIdName;
+    header_buffer_byte(&hb, k7zIdName);
     size_t names_size = 0;
     for (size_t i = 0; i < builder->file_count; i++) {
-        names_size += (strlen(builder->files[i].name) + 1) * 2;
+        names_size += file_name_size(&builder->files[i]);
     }
-    WriteNumber(&p, names_size + 1);
-    *p++ = 0;  /* External flag = 0 (names embedded) */
+    header_buffer_number(&hb, names_size + 1);
+    header_buffer_byte(&hb, 0);  /* External flag = 0 (names embedded) */
     
     for (size_t i = 0; i < builder->file_count; i++) {
-        const char* name = builder->files[i].name;
-        while (*name) {
-            *p++ = (Byte)*name++;
-            *p++ = 0;  /* High byte of UTF-16LE */
+        if (builder->files[i].name_utf16) {
+            header_buffer_bytes(&hb, builder->files[i].name_utf16, builder->files[i].name_utf16_size);
+            continue;
         }
-        *p++ = 0;  /* Null terminator low byte */
-        *p++ = 0;  /* Null terminator high byte */
+        Byte* q = header_buffer_reserve(&hb, file_name_size(&builder->files[i]));
+        if (!q) break;
+        size_t len = utf8_to_utf16le(builder->files[i].name, q);
+        q[len] = 0;      /* Null terminator low byte */
+        q[len + 1] = 0;  /* Null terminator high byte */
+        header_buffer_commit(&hb, len + 2);
     }
     
     /* Modification times (Windows FILETIME format) */
-    *p++ = k7zIdMTime;
-    size_t time_size = 2 + (8 * builder->file_count);
-    WriteNumber(&p, time_size);
-    *p++ = 1;  /* All times defined */
-    *p++ = 0;  /* External flag = 0 */
+    header_buffer_byte(&hb, k7zIdMTime);
+    header_buffer_number(&hb, 2 + (8 * (uint64_t)builder->file_count));
+    header_buffer_byte(&hb, 1);  /* All times defined */
+    header_buffer_byte(&hb, 0);  /* External flag = 0 */
     for (size_t i = 0; i < builder->file_count; i++) {
-        uint64_t filetime = builder->files[i].mtime;
-        memcpy(p, &filetime, 8);
-        p += 8;
+        header_buffer_uint64(&hb, builder->files[i].mtime);
     }
     
     /* Attributes */
-    *p++ = k7zIdWinAttrib;
-    size_t attrib_size = 2 + (4 * builder->file_count);
-    WriteNumber(&p, attrib_size);
-    *p++ = 1;  /* All attributes defined */
-    *p++ = 0;  /* External flag = 0 */
+    header_buffer_byte(&hb, k7zIdWinAttrib);
+    header_buffer_number(&hb, 2 + (4 * (uint64_t)builder->file_count));
+    header_buffer_byte(&hb, 1);  /* All attributes defined */
+    header_buffer_byte(&hb, 0);  /* External flag = 0 */
     for (size_t i = 0; i < builder->file_count; i++) {
-        uint32_t attr = builder->files[i].attrib;
-        memcpy(p, &attr, 4);
-        p += 4;
+        header_buffer_uint32(&hb, builder->files[i].attrib);
+    }
+    
+    header_buffer_byte(&hb, k7zIdEnd);  /* End FilesInfo */
+    header_buffer_byte(&hb, k7zIdEnd);  /* End Header */
+    
+    if (hb.failed) {
+        header_buffer_free(&hb);
+        return SEVENZIP_ERROR_MEMORY;
     }
+    Byte* header = hb.data;
+    Byte* header_start = header;
+    size_t actual_header_size = hb.size;
+    
+    /* Compress the header when that makes it smaller; the start header
+       then points at the kEncodedHeader record behind its packed stream */
+    Byte* encoded = NULL;
+    size_t encoded_size = 0;
+    size_t record_offset = 0;
+    uint64_t header_offset = pack_size;
+    if (sevenzip_encode_header(header_start, actual_header_size, pack_size,
+                               &encoded, &encoded_size, &record_offset)) {
+        mem_free(header);
+        header = encoded;
+        header_start = encoded + record_offset;
+        header_offset = pack_size + record_offset;
+        actual_header_size = encoded_size - record_offset;
+    }
+    
+    tail->data = header;
+    tail->size = (size_t)(header_start - header) + actual_header_size;
+    tail->next_header_offset = header_offset;
+    tail->next_header_size = actual_header_size;
+    tail->next_header_crc = CrcCalc(header_start, actual_header_size);
+    TRACE_END(header, TRACE_HEADER, actual_header_size);
+    return SEVENZIP_OK;
+}
+
+/* Helper: The signature header (version 0.4) pointing at an archive's tail */
+static void fill_start_header(Byte* out, const ArchiveTail* tail) {
+    memcpy(out, k7zSignature, k7zSignatureSize);
+    out[6] = k7zMajorVersion;
+    out[7] = 4;
+    SetUi64(out + 12, tail->next_header_offset)
+    SetUi64(out + 20, tail->next_header_size)
+    SetUi32(out + 28, tail->next_header_crc)
+    SetUi32(out + 8, CrcCalc(out + 12, 20))
+}
+
+/* Helper: Write 7z archive with proper format structure */
+static SevenZipErrorCode write_7z_archive(
+    const char* archive_path,
+    SevenZArchiveBuilder* builder
+) {
+    FILE* f = fopen(archive_path, "wb");
+    if (!f) return SEVENZIP_ERROR_OPEN_FILE;
+    
+    /* Use 4MB write buffer for optimal I/O performance */
+    setvbuf(f, builder->scratch ? builder->scratch->write_buf : NULL,
+            _IOFBF, ARCHIVE_WRITE_BUFFER_SIZE);
     
-    *p++ = k7zIdEnd;  /* End FilesInfo */
-    *p++ = k7zIdEnd;  /* End Header */
+    /* === WRITE SIGNATURE HEADER === */
+    /* Placeholder until the header it points at is known */
+    Byte start_header[k7zStartHeaderSize];
+    memset(start_header, 0, sizeof(start_header));
+    fwrite(start_header, 1, sizeof(start_header), f);
     
-    /* === FINALIZE HEADER === */
-    size_t actual_header_size = p - header_start;
+    /* === WRITE PACKED DATA === */
+    /* Stream all files into a single LZMA2 stream right after the signature header */
+    uint64_t pack_size = 0;
+    SevenZipErrorCode result = compress_all_files(builder, f, &pack_size);
     
-    /* Ensure we didn't overflow */
-    if (actual_header_size > header_capacity) {
-        free(header);
+    /* === BUILD HEADER IN MEMORY === */
+    ArchiveTail tail;
+    if (result == SEVENZIP_OK) {
+        result = build_archive_tail(builder, pack_size, &tail);
+    }
+    if (result != SEVENZIP_OK) {
         fclose(f);
-        return SEVENZIP_ERROR_COMPRESS;  /* Header too large */
+        remove(archive_path);
+        return result;
     }
     
-    /* Calculate header CRC */
-    uint32_t header_crc = CrcCalc(header_start, actual_header_size);
+    /* Write header to file (it directly follows the packed stream) */
+    fwrite(tail.data, 1, tail.size, f);
+    mem_free(tail.data);
     
-    /* Write header to file */
-    uint64_t header_offset = ftell(f) - pack_pos;
-    fwrite(header_start, 1, actual_header_size, f);
-    free(header);
+    /* Drop bytes of an abandoned compressed stream that ran past the end */
+    int64_t archive_end = (int64_t)FTELL64(f);
+    if (archive_end < 0 || fflush(f) != 0 || TRUNCATE_FILE(f, archive_end) != 0) {
+        fclose(f);
+        return SEVENZIP_ERROR_COMPRESS;
+    }
     
     /* === UPDATE START HEADER === */
     /* Go back and write the actual values */
-    fseek(f, next_header_offset_pos, SEEK_SET);
-    fwrite(&header_offset, 8, 1, f);
-    uint64_t header_size_field = actual_header_size;
-    fwrite(&header_size_field, 8, 1, f);
-    fwrite(&header_crc, 4, 1, f);
-    
-    /* Calculate and write start header CRC */
-    Byte start_header[20];
-    memcpy(start_header, &header_offset, 8);
-    memcpy(start_header + 8, &header_size_field, 8);
-    memcpy(start_header + 16, &header_crc, 4);
-    uint32_t start_header_crc = CrcCalc(start_header, 20);
-    
-    fseek(f, start_crc_pos, SEEK_SET);
-    fwrite(&start_header_crc, 4, 1, f);
+    fill_start_header(start_header, &tail);
+    fseek(f, 0, SEEK_SET);
+    fwrite(start_header, 1, sizeof(start_header), f);
     
     fclose(f);
-    free(pack_data);  /* Free compressed data */
     return SEVENZIP_OK;
 }
 
-/* Main API: Create 7z archive */
-SevenZipErrorCode sevenzip_create_7z(
-    const char* archive_path,
-    const char** input_paths,
+/* Options used when sevenzip_create_7z() gets NULL */
+static const SevenZipCompressOptions k_default_options = {
+    .num_threads = 2,
+    .dict_size = 0,  /* Auto */
+    .solid = 1,       /* Solid archive */
+    .password = NULL,  /* No encryption */
+    .solid_block_size = 0,   /* Unlimited */
+    .solid_block_files = 0,  /* Unlimited */
+    .filter = SEVENZIP_FILTER_AUTO,
+    .delta_distance = 0,
+    .delta_extensions = NULL,
+    .method = SEVENZIP_METHOD_LZMA2,
+    .ppmd_order = 0,
+    .ppmd_mem_size = 0,
+    .max_memory = 0,  /* No limit */
+    .cancel = NULL,
+    .block_size = 0,  /* Auto */
+    .detect_compressed = 0,
+    .lzma_params = NULL,  /* The level's */
+    .solid_sort = 0
+};
+
+/* Helper: LZMA2 properties for a level and options
+ * @return 1 if the level stores files (Copy codec) instead
+ */
+static int setup_props(
+    CLzma2EncProps* props,
     SevenZipCompressionLevel level,
-    const SevenZipCompressOptions* options,
-    SevenZipProgressCallback progress_callback,
-    void* user_data
+    const SevenZipCompressOptions* opts
 ) {
-    if (!archive_path || !input_paths) {
-        return SEVENZIP_ERROR_INVALID_PARAM;
-    }
-    
-    /* Initialize CRC tables */
-    CrcGenerateTable();
-    
-    /* Set default options if not provided */
-    SevenZipCompressOptions default_opts = {
-        .num_threads = 2,
-        .dict_size = 0,  /* Auto */
-        .solid = 1,       /* Solid archive */
-        .password = NULL  /* No encryption */
-    };
-    const SevenZipCompressOptions* opts = options ? options : &default_opts;
-    
-    /* Create builder */
-    SevenZArchiveBuilder builder;
-    builder.file_count = 0;
-    builder.file_capacity = 16;
-    builder.use_copy_codec = 0;  /* Default: use LZMA2 compression */
-    builder.files = (SevenZFile*)calloc(builder.file_capacity, sizeof(SevenZFile));
-    if (!builder.files) {
-        return SEVENZIP_ERROR_MEMORY;
-    }
-    
-    /* Set compression properties */
-    Lzma2EncProps_Init(&builder.props);
+    Lzma2EncProps_Init(props);
+    int store = 0;
     
     /* Apply thread count from options - OPTIMIZED for block-level parallelism
      * LZMA2 achieves parallelism by compressing multiple blocks simultaneously.
@@ -840,120 +1218,222 @@ SevenZipErrorCode sevenzip_create_7z(
     if (opts->num_threads > 0) {
         int block_threads = opts->num_threads / 2;
         if (block_threads < 1) block_threads = 1;
-        builder.props.numBlockThreads_Max = block_threads;
-        builder.props.lzmaProps.numThreads = 2;  /* 2 threads per block encoder */
-        builder.props.numTotalThreads = opts->num_threads;
+        props->numBlockThreads_Max = block_threads;
+        props->lzmaProps.numThreads = opts->num_threads > 1 ? 2 : 1;  /* 2 threads per block encoder */
+        props->numTotalThreads = opts->num_threads;
         /* Set explicit block size for parallel compression (4x dictionary) */
-        builder.props.blockSize = 0;  /* 0 = auto-calculate based on dict size */
+        props->blockSize = 0;  /* 0 = auto-calculate based on dict size */
     }
     
     switch (level) {
         case SEVENZIP_LEVEL_STORE:
-            builder.use_copy_codec = 1;  /* Use Copy codec for Store mode */
-            builder.props.lzmaProps.level = 0;
-            builder.props.lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 16);
+            store = 1;  /* Use Copy codec for Store mode */
+            props->lzmaProps.level = 0;
+            props->lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 16);
             break;
         case SEVENZIP_LEVEL_FASTEST:
-            builder.props.lzmaProps.level = 1;
-            builder.props.lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 18);
+            props->lzmaProps.level = 1;
+            props->lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 18);
             break;
         case SEVENZIP_LEVEL_FAST:
-            builder.props.lzmaProps.level = 3;
-            builder.props.lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 20);
+            props->lzmaProps.level = 3;
+            props->lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 20);
             break;
         case SEVENZIP_LEVEL_NORMAL:
-            builder.props.lzmaProps.level = 5;
-            builder.props.lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 23);
-            if (opts->num_threads == 0) builder.props.numBlockThreads_Max = 2;
+            props->lzmaProps.level = 5;
+            props->lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 23);
+            if (opts->num_threads == 0) props->numBlockThreads_Max = 2;
             break;
         case SEVENZIP_LEVEL_MAXIMUM:
-            builder.props.lzmaProps.level = 7;
-            builder.props.lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 25);
-            if (opts->num_threads == 0) builder.props.numBlockThreads_Max = 2;
+            props->lzmaProps.level = 7;
+            props->lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 25);
+            if (opts->num_threads == 0) props->numBlockThreads_Max = 2;
             break;
         case SEVENZIP_LEVEL_ULTRA:
-            builder.props.lzmaProps.level = 9;
-            builder.props.lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 26);
-            if (opts->num_threads == 0) builder.props.numBlockThreads_Max = 2;
+            props->lzmaProps.level = 9;
+            props->lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 26);
+            if (opts->num_threads == 0) props->numBlockThreads_Max = 2;
             break;
         default:
-            builder.props.lzmaProps.level = 5;
-            builder.props.lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 23);
+            props->lzmaProps.level = 5;
+            props->lzmaProps.dictSize = opts->dict_size > 0 ? opts->dict_size : (1 << 23);
+    }
+    if (opts->block_size > 0) props->blockSize = opts->block_size;
+    sevenzip_lzma_params_apply(opts->lzma_params, &props->lzmaProps);
+    Lzma2EncProps_Normalize(props);
+    return store;
+}
+
+/* Fixed I/O memory: archive write buffer, input read buffer, copy and
+ * filter buffers */
+#define CREATE_IO_MEMORY ((uint64_t)5 * 1024 * 1024 + COPY_BUFFER_SIZE + FILTER_BUFFER_SIZE)
+
+/* Helper: Fit the coders to `max_memory` (0 = no limit) and report the peak
+ *
+ * One LZMA2 encoder is kept for the whole archive; with METHOD_AUTO a PPMd
+ * model is alive next to it while text folders are encoded.
+ */
+static SevenZipErrorCode fit_memory(
+    CLzma2EncProps* props,
+    int store,
+    SevenZipMethod method,
+    UInt32* ppmd_mem_size,
+    uint64_t max_memory,
+    uint64_t* peak
+) {
+    uint64_t coders = 0;
+    if (!store) {
+        CLzma2EncProps* lzma = (method == SEVENZIP_METHOD_PPMD) ? NULL : props;
+        UInt32* ppmd = (method == SEVENZIP_METHOD_LZMA2) ? NULL : ppmd_mem_size;
+        uint64_t budget = max_memory > CREATE_IO_MEMORY ? max_memory - CREATE_IO_MEMORY : 0;
+        if (max_memory == 0) budget = UINT64_MAX;
+        if (!sevenzip_fit_coders(lzma, ppmd, budget, &coders)) {
+            return SEVENZIP_ERROR_MEMORY;
+        }
+    }
+    
+    *peak = CREATE_IO_MEMORY + coders;
+    return (max_memory && *peak > max_memory) ? SEVENZIP_ERROR_MEMORY : SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_create_memory_plan(
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    uint64_t* peak_bytes
+) {
+    if (!peak_bytes) return SEVENZIP_ERROR_INVALID_PARAM;
+    const SevenZipCompressOptions* opts = options ? options : &k_default_options;
+    
+    /* An auto job gets the hardware threads (without a quota) */
+    SevenZipCompressOptions sized;
+    if (opts->num_threads <= 0) {
+        sized = *opts;
+        sized.num_threads = hardware_thread_count();
+        opts = &sized;
+    }
+    
+    CLzma2EncProps props;
+    int store = setup_props(&props, level, opts);
+    unsigned order;
+    UInt32 ppmd_mem_size;
+    sevenzip_ppmd_props(level, opts->ppmd_order, opts->ppmd_mem_size, &order, &ppmd_mem_size);
+    return fit_memory(&props, store, opts->method, &ppmd_mem_size, opts->max_memory, peak_bytes);
+}
+
+/* Helper: Set up an empty builder for a level and options, fitted to max_memory */
+static SevenZipErrorCode builder_init(
+    SevenZArchiveBuilder* builder,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* opts
+) {
+    memset(builder, 0, sizeof(*builder));
+    builder->file_capacity = 16;
+    
+    /* Solid block limits; a non-solid archive is one folder per file */
+    builder->solid_block_size = opts->solid_block_size;
+    builder->solid_block_files = opts->solid_block_files > 0 ? (size_t)opts->solid_block_files : 0;
+    if (!opts->solid) {
+        builder->solid_block_files = 1;
+    }
+    builder->filter = opts->filter;
+    builder->delta_distance = sevenzip_filter_delta_distance(opts->delta_distance);
+    builder->delta_extensions = opts->delta_extensions;
+    builder->detect_compressed = opts->detect_compressed;
+    builder->solid_sort = opts->solid_sort;
+    builder->auto_block_size = opts->block_size == 0;
+    builder->method = opts->method;
+    builder->cancel = opts->cancel;
+    builder->numa_policy = opts->numa_policy;
+    sevenzip_ppmd_props(level, opts->ppmd_order, opts->ppmd_mem_size,
+                        &builder->ppmd_order, &builder->ppmd_mem_size);
+    builder->files = (SevenZFile*)mem_calloc(SEVENZIP_MEM_HEADER, builder->file_capacity, sizeof(SevenZFile));
+    if (!builder->files) {
+        return SEVENZIP_ERROR_MEMORY;
     }
-    Lzma2EncProps_Normalize(&builder.props);
     
+    /* Set compression properties, then fit them to max_memory */
+    builder->use_copy_codec = setup_props(&builder->props, level, opts);
+    uint64_t peak_memory;
+    SevenZipErrorCode result = fit_memory(&builder->props, builder->use_copy_codec, builder->method,
+                                          &builder->ppmd_mem_size, opts->max_memory, &peak_memory);
+    if (result != SEVENZIP_OK) {
+        mem_free(builder->files);
+        builder->files = NULL;
+    }
+    return result;
+}
+
+static void builder_free(SevenZArchiveBuilder* builder) {
+    for (size_t i = 0; i < builder->file_count; i++) {
+        if (builder->files[i].name) mem_free(builder->files[i].name);
+        if (builder->files[i].full_path) mem_free(builder->files[i].full_path);
+    }
+    mem_free(builder->files);
+    mem_free(builder->folders);
+    builder->files = NULL;
+    builder->folders = NULL;
+    builder->file_count = 0;
+    builder->folder_count = 0;
+}
+
+/* Helper: Add the inputs of a create call (files and directory trees) */
+static SevenZipErrorCode add_input_paths(
+    SevenZArchiveBuilder* builder,
+    const char** input_paths,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
     /* Count files */
     size_t total_files = 0;
     for (const char** p = input_paths; *p; p++) total_files++;
     
     /* Add files/directories */
-    SevenZipErrorCode result = SEVENZIP_OK;
     for (size_t i = 0; i < total_files; i++) {
         const char* path = input_paths[i];
         
         /* Get file info */
         struct STAT st;
         if (STAT(path, &st) != 0) {
-            result = SEVENZIP_ERROR_OPEN_FILE;
-            goto cleanup;
+            return SEVENZIP_ERROR_OPEN_FILE;
         }
         
         if (S_ISDIR(st.st_mode)) {
-            /* Add directory recursively */
-            result = add_directory_recursive(&builder, path, path);
+            /* Add directory contents, named relative to the directory */
+            SevenZipErrorCode result = sevenzip_scan_directory(path, NULL, DIR_SCAN_DIRS, 0, NULL,
+                                                               add_directory_entry, builder);
             if (result != SEVENZIP_OK) {
-                goto cleanup;
+                return result;
             }
         } else {
             /* Expand array if needed */
-            if (builder.file_count >= builder.file_capacity) {
-                builder.file_capacity *= 2;
-                SevenZFile* new_files = (SevenZFile*)realloc(
-                    builder.files, builder.file_capacity * sizeof(SevenZFile));
+            if (builder->file_count >= builder->file_capacity) {
+                builder->file_capacity *= 2;
+                SevenZFile* new_files = (SevenZFile*)mem_realloc(SEVENZIP_MEM_HEADER,
+                    builder->files, builder->file_capacity * sizeof(SevenZFile));
                 if (!new_files) {
-                    result = SEVENZIP_ERROR_MEMORY;
-                    goto cleanup;
+                    return SEVENZIP_ERROR_MEMORY;
                 }
-                builder.files = new_files;
+                builder->files = new_files;
             }
             
-            SevenZFile* file = &builder.files[builder.file_count++];
+            SevenZFile* file = &builder->files[builder->file_count++];
             memset(file, 0, sizeof(SevenZFile));
             
             /* Extract filename */
             const char* name = strrchr(path, '/');
             if (!name) name = strrchr(path, '\\');
-            file->name = strdup(name ? name + 1 : path);
+            file->name = mem_strdup(SEVENZIP_MEM_NAMES, name ? name + 1 : path);
             file->mtime = (uint64_t)st.st_mtime * 10000000ULL + 116444736000000000ULL;
             file->attrib = (uint32_t)st.st_mode;
             file->is_dir = 0;  /* Regular file */
             
             if (S_ISREG(st.st_mode)) {
-                /* Read file */
-                FILE* f = fopen(path, "rb");
-                if (!f) {
-                    result = SEVENZIP_ERROR_OPEN_FILE;
-                    goto cleanup;
-                }
-                
+                /* Record path only - data is streamed during compression */
                 file->size = st.st_size;
-                Byte* file_data = (Byte*)malloc(file->size);
-                if (!file_data) {
-                    fclose(f);
-                    result = SEVENZIP_ERROR_MEMORY;
-                    goto cleanup;
-                }
-                
-                if (fread(file_data, 1, file->size, f) != file->size) {
-                    free(file_data);
-                    fclose(f);
-                    result = SEVENZIP_ERROR_OPEN_FILE;
-                    goto cleanup;
+                file->full_path = mem_strdup(SEVENZIP_MEM_NAMES, path);
+                if (!file->name || !file->full_path) {
+                    return SEVENZIP_ERROR_MEMORY;
                 }
-                fclose(f);
-                
-                /* Store raw data (compression happens later for all files together) */
-                file->data = file_data;
                 file->pack_size = file->size;  /* Will be updated after compression */
                 file->crc = 0;  /* Will be calculated during compression */
             }
@@ -964,17 +1444,1494 @@ SevenZipErrorCode sevenzip_create_7z(
             progress_callback(i + 1, total_files, user_data);
         }
     }
+    return SEVENZIP_OK;
+}
+
+/* Helper: Add the entries of a caller's table as they are, without a stat */
+static SevenZipErrorCode add_input_table(
+    SevenZArchiveBuilder* builder,
+    const SevenZipInputEntry* entries,
+    size_t count,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    for (size_t i = 0; i < count; i++) {
+        const SevenZipInputEntry* input = &entries[i];
+        if (!input->name || !input->name[0]) {
+            return SEVENZIP_ERROR_INVALID_PARAM;
+        }
+        DirScanEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.full_path = input->is_dir ? NULL : input->path;
+        entry.name = input->name;
+        entry.size = input->size;
+        entry.mtime = input->mtime;
+        entry.attrib = input->attrib;
+        entry.is_dir = input->is_dir;
+        SevenZipErrorCode result = add_directory_entry(&entry, builder);
+        if (result != SEVENZIP_OK) {
+            return result;
+        }
+        if (progress_callback) {
+            progress_callback(i + 1, count, user_data);
+        }
+    }
+    return SEVENZIP_OK;
+}
+
+/* Helper: Put every entry under "<prefix>/" */
+static SevenZipErrorCode prefix_names(SevenZArchiveBuilder* builder, const char* prefix) {
+    size_t prefix_len = strlen(prefix);
+    while (prefix_len > 0 && (prefix[prefix_len - 1] == '/' || prefix[prefix_len - 1] == '\\')) {
+        prefix_len--;
+    }
+    if (prefix_len == 0) return SEVENZIP_OK;
     
-    /* Write archive */
-    result = write_7z_archive(archive_path, &builder);
+    for (size_t i = 0; i < builder->file_count; i++) {
+        SevenZFile* file = &builder->files[i];
+        size_t size = prefix_len + 1 + strlen(file->name) + 1;
+        char* name = (char*)mem_alloc(SEVENZIP_MEM_NAMES, size);
+        if (!name) return SEVENZIP_ERROR_MEMORY;
+        snprintf(name, size, "%.*s/%s", (int)prefix_len, prefix, file->name);
+        mem_free(file->name);
+        file->name = name;
+    }
+    return SEVENZIP_OK;
+}
+
+/* Files-done progress of a job handed to the streaming writer */
+typedef struct {
+    SevenZipProgressCallback callback;
+    void* user_data;
+} EncryptedProgress;
+
+static void encrypted_progress(uint64_t bytes_processed, uint64_t bytes_total,
+                               uint64_t current_file_bytes, uint64_t current_file_total,
+                               const char* current_file_name, void* user_data) {
+    (void)current_file_bytes;
+    (void)current_file_total;
+    (void)current_file_name;
+    EncryptedProgress* p = (EncryptedProgress*)user_data;
+    p->callback(bytes_processed, bytes_total, p->user_data);
+}
+
+/* Helper: The builder has no 7zAES coder, so password jobs go to the
+ * streaming writer, which encrypts every pack stream and the header */
+static SevenZipErrorCode create_encrypted(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* o,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipStreamOptions s;
+    sevenzip_stream_options_init(&s);
+    s.num_threads = o->num_threads;
+    s.dict_size = o->dict_size;
+    s.solid = o->solid;
+    s.password = o->password;
+    s.solid_block_size = o->solid_block_size;
+    s.solid_block_files = o->solid_block_files;
+    s.filter = o->filter;
+    s.delta_distance = o->delta_distance;
+    s.delta_extensions = o->delta_extensions;
+    s.method = o->method;
+    s.ppmd_order = o->ppmd_order;
+    s.ppmd_mem_size = o->ppmd_mem_size;
+    s.max_memory = o->max_memory;
+    s.cancel = o->cancel;
+    s.block_size = o->block_size;
+    s.thread_weight = o->thread_weight;
+    s.numa_policy = o->numa_policy;
+    s.detect_compressed = o->detect_compressed;
+    s.lzma_params = o->lzma_params;
+    s.solid_sort = o->solid_sort;
+    
+    EncryptedProgress progress = { progress_callback, user_data };
+    return sevenzip_create_7z_streaming(archive_path, input_paths, level, &s,
+                                        progress_callback ? encrypted_progress : NULL,
+                                        &progress);
+}
+
+/* Helper: Create an archive of the inputs (input_paths, else the table),
+ * named below `name_prefix` if set */
+static SevenZipErrorCode create_archive(
+    const char* archive_path,
+    const char** input_paths,
+    const SevenZipInputEntry* table,
+    size_t table_count,
+    const char* name_prefix,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || (!input_paths && !table)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
     
-cleanup:
-    /* Free resources */
-    for (size_t i = 0; i < builder.file_count; i++) {
-        if (builder.files[i].name) free(builder.files[i].name);
-        if (builder.files[i].data) free(builder.files[i].data);
+    global_tables_init();
+    
+    const SevenZipCompressOptions* opts = options ? options : &k_default_options;
+    if (opts->password && opts->password[0]) {
+        if (!input_paths) {
+            return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+        }
+        return create_encrypted(archive_path, input_paths, level, opts,
+                                progress_callback, user_data);
+    }
+    
+    /* Threads come from the sevenzip_init_with_options() quota, if any */
+    SevenZipCompressOptions leased = *opts;
+    ThreadLease lease;
+    leased.num_threads = thread_lease_acquire(&lease, opts->num_threads, opts->thread_weight);
+    opts = &leased;
+    
+    /* Create builder */
+    SevenZArchiveBuilder builder;
+    SevenZipErrorCode result = builder_init(&builder, level, opts);
+    if (result == SEVENZIP_OK) {
+        result = input_paths ? add_input_paths(&builder, input_paths, progress_callback, user_data)
+                             : add_input_table(&builder, table, table_count, progress_callback, user_data);
+        if (result == SEVENZIP_OK && name_prefix) {
+            result = prefix_names(&builder, name_prefix);
+        }
+        
+        /* Write archive */
+        if (result == SEVENZIP_OK) {
+            result = write_7z_archive(archive_path, &builder);
+        }
+        builder_free(&builder);
     }
-    free(builder.files);
     
+    thread_lease_release(&lease);
     return result;
 }
+
+/* Main API: Create 7z archive */
+SevenZipErrorCode sevenzip_create_7z(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    return create_archive(archive_path, input_paths, NULL, 0, NULL, level, options,
+                          progress_callback, user_data);
+}
+
+SevenZipErrorCode sevenzip_create_7z_from_table(
+    const char* archive_path,
+    const SevenZipInputEntry* entries,
+    size_t count,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    return create_archive(archive_path, NULL, entries, count, NULL, level, options,
+                          progress_callback, user_data);
+}
+
+/* ============================================================================
+ * Batch: many small archives on a pool of single-threaded workers
+ * ============================================================================ */
+
+typedef struct {
+    const SevenZipBatchEntry* entries;
+    size_t count;
+    SevenZipCompressionLevel level;
+    const SevenZipCompressOptions* opts;  /* num_threads = 1 */
+    SevenZipErrorCode* results;
+    CCriticalSection lock;
+    size_t next;
+    int pinned;                           /* Workers placed by SEVENZIP_NUMA_LOCAL */
+} BatchPool;
+
+static void BatchPool_Work(BatchPool* pool) {
+    CreateScratch scratch;
+    scratch.enc = NULL;
+    scratch.write_buf = (char*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, ARCHIVE_WRITE_BUFFER_SIZE);
+    scratch.read_buf = (char*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, INPUT_READ_BUFFER_SIZE);
+    
+    for (;;) {
+        CriticalSection_Enter(&pool->lock);
+        size_t i = pool->next++;
+        CriticalSection_Leave(&pool->lock);
+        if (i >= pool->count) break;
+        
+        const SevenZipBatchEntry* entry = &pool->entries[i];
+        SevenZipErrorCode result;
+        if (!entry->archive_path || !entry->input_paths) {
+            result = SEVENZIP_ERROR_INVALID_PARAM;
+        } else if (!scratch.write_buf || !scratch.read_buf) {
+            result = SEVENZIP_ERROR_MEMORY;
+        } else if (cancel_token_requested(pool->opts->cancel)) {
+            result = SEVENZIP_ERROR_CANCELLED;
+        } else {
+            SevenZArchiveBuilder builder;
+            result = builder_init(&builder, pool->level, pool->opts);
+            if (result == SEVENZIP_OK) {
+                builder.scratch = &scratch;
+                result = add_input_paths(&builder, entry->input_paths, NULL, NULL);
+                if (result == SEVENZIP_OK) {
+                    result = write_7z_archive(entry->archive_path, &builder);
+                }
+                builder_free(&builder);
+            }
+        }
+        pool->results[i] = result;
+    }
+    
+    if (scratch.enc) Lzma2Enc_Destroy(scratch.enc);
+    mem_free(scratch.write_buf);
+    mem_free(scratch.read_buf);
+}
+
+static THREAD_FUNC_DECL BatchPool_Thread(void* arg) {
+    BatchPool* pool = (BatchPool*)arg;
+    thread_sched_enter();
+    if (pool->opts->numa_policy == SEVENZIP_NUMA_LOCAL) {
+        /* Spread over the nodes; the calling thread counts as the first */
+        CriticalSection_Enter(&pool->lock);
+        int node = ++pool->pinned;
+        CriticalSection_Leave(&pool->lock);
+        numa_bind_thread(node);
+    }
+    BatchPool_Work(pool);
+    return THREAD_FUNC_RET_ZERO;
+}
+
+SevenZipErrorCode sevenzip_create_7z_batch(
+    const SevenZipBatchEntry* entries,
+    size_t count,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipErrorCode* results
+) {
+    if ((!entries || !results) && count > 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    if (count == 0) return SEVENZIP_OK;
+    
+    global_tables_init();
+    
+    /* Each archive gets one encoder thread; the thread count sizes the pool */
+    const SevenZipCompressOptions* opts = options ? options : &k_default_options;
+    SevenZipCompressOptions single = *opts;
+    single.num_threads = 1;
+    ThreadLease lease;
+    int num_workers = thread_lease_acquire(&lease, options ? options->num_threads : 0,
+                                           opts->thread_weight);
+    if (num_workers <= 0) num_workers = hardware_thread_count();
+    if ((size_t)num_workers > count) num_workers = (int)count;
+    
+    BatchPool pool;
+    pool.entries = entries;
+    pool.count = count;
+    pool.level = level;
+    pool.opts = &single;
+    pool.results = results;
+    pool.next = 0;
+    pool.pinned = 0;
+    CriticalSection_Init(&pool.lock);
+    
+    /* The calling thread is a worker too, so a failed thread start only
+     * narrows the pool */
+    CThread* threads = NULL;
+    int started = 0;
+    if (num_workers > 1) {
+        threads = (CThread*)mem_calloc(SEVENZIP_MEM_OTHER, (size_t)num_workers - 1, sizeof(CThread));
+    }
+    for (int i = 0; threads && i < num_workers - 1; i++) {
+        Thread_CONSTRUCT(&threads[i])
+        if (Thread_Create(&threads[i], BatchPool_Thread, &pool) != 0) break;
+        started++;
+    }
+    BatchPool_Work(&pool);
+    for (int i = 0; i < started; i++) {
+        Thread_Wait_Close(&threads[i]);
+    }
+    mem_free(threads);
+    CriticalSection_Delete(&pool.lock);
+    thread_lease_release(&lease);
+    
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] != SEVENZIP_OK) return results[i];
+    }
+    return SEVENZIP_OK;
+}
+
+/* ============================================================================
+ * Update and delete: rewrite an archive, copying the folders left whole
+ * ============================================================================ */
+
+#define UPDATE_NO_FOLDER ((UInt32)-1)
+
+/* Helper: Entry name of the updated archive as it compares to input names
+ * @return 0 when out of memory
+ */
+static int source_entry_name(const CSzArEx* db, UInt32 index, char** name) {
+    size_t len = SzArEx_GetFileNameUtf16(db, index, NULL);
+    *name = utf16le_to_utf8_dup(db->FileNames + db->FileNameOffsets[index] * 2, len);
+    return *name || len <= 1;
+}
+
+/* Helper: Does a source entry carry data in one of its folders? */
+static int source_entry_has_stream(const CSzArEx* db, UInt32 index) {
+    return !SzArEx_IsDir(db, index) && SzArEx_GetFileSize(db, index) > 0 &&
+           db->FileToFolder[index] != UPDATE_NO_FOLDER;
+}
+
+/* Helper: Is the source entry still current for this input?
+ * Inputs carry whole seconds, so times are compared at that resolution.
+ */
+static int source_entry_unchanged(const CSzArEx* db, UInt32 index, const SevenZFile* input) {
+    int is_dir = SzArEx_IsDir(db, index) ? 1 : 0;
+    if (is_dir != (input->is_dir ? 1 : 0)) return 0;
+    if (is_dir) return 1;
+    if (SzArEx_GetFileSize(db, index) != input->size) return 0;
+    if (!SzBitWithVals_Check(&db->MTime, index)) return 0;
+    uint64_t mtime = db->MTime.Vals[index].Low | ((uint64_t)db->MTime.Vals[index].High << 32);
+    return mtime / 10000000ULL == input->mtime / 10000000ULL;
+}
+
+/* Helper: Entry metadata taken over from the source archive */
+static void copy_source_entry(SevenZFile* file, const CSzArEx* db, UInt32 index) {
+    memset(file, 0, sizeof(*file));
+    file->copied = 1;
+    file->is_dir = SzArEx_IsDir(db, index) ? 1 : 0;
+    file->size = file->is_dir ? 0 : SzArEx_GetFileSize(db, index);
+    file->name_utf16 = db->FileNames + db->FileNameOffsets[index] * 2;
+    file->name_utf16_size = (db->FileNameOffsets[index + 1] - db->FileNameOffsets[index]) * 2;
+    if (SzBitWithVals_Check(&db->MTime, index)) {
+        file->mtime = db->MTime.Vals[index].Low | ((uint64_t)db->MTime.Vals[index].High << 32);
+    }
+    if (SzBitWithVals_Check(&db->Attribs, index)) {
+        file->attrib = db->Attribs.Vals[index];
+    }
+    if (SzBitWithVals_Check(&db->CRCs, index)) {
+        file->crc = db->CRCs.Vals[index];
+    } else {
+        file->no_crc = 1;
+    }
+}
+
+/* Helper: Append a zeroed entry to the builder */
+static SevenZFile* builder_append(SevenZArchiveBuilder* builder) {
+    if (builder->file_count >= builder->file_capacity) {
+        size_t new_capacity = builder->file_capacity * 2;
+        SevenZFile* new_files = (SevenZFile*)mem_realloc(SEVENZIP_MEM_HEADER,
+            builder->files, new_capacity * sizeof(SevenZFile));
+        if (!new_files) return NULL;
+        builder->files = new_files;
+        builder->file_capacity = new_capacity;
+    }
+    SevenZFile* file = &builder->files[builder->file_count++];
+    memset(file, 0, sizeof(SevenZFile));
+    return file;
+}
+
+/* Helper: Append a source entry unchanged, its data in a copied folder
+ * The builder's folders must have room for every folder of `db`.
+ */
+static SevenZipErrorCode keep_source_entry(
+    SevenZArchiveBuilder* builder,
+    const CSzArEx* db,
+    CSzFile* src_file,
+    UInt32 index
+) {
+    SevenZFile* file = builder_append(builder);
+    if (!file) return SEVENZIP_ERROR_MEMORY;
+    copy_source_entry(file, db, index);
+    if (!source_entry_has_stream(db, index)) {
+        /* Zero-length substreams become empty entries, which the
+         * folder's byte layout does not notice */
+        file->size = 0;
+        return SEVENZIP_OK;
+    }
+    
+    UInt32 fo = db->FileToFolder[index];
+    SevenZFolder* folder = builder->folder_count > 0
+        ? &builder->folders[builder->folder_count - 1] : NULL;
+    if (!folder || folder->src != db || folder->src_folder != fo) {
+        folder = &builder->folders[builder->folder_count++];
+        folder->copied = 1;
+        folder->src = db;
+        folder->src_file = src_file;
+        folder->src_folder = fo;
+        folder->first_file = builder->file_count - 1;
+    }
+    folder->end_file = builder->file_count;
+    folder->num_streams++;
+    return SEVENZIP_OK;
+}
+
+static int compare_file_names(const void* a, const void* b) {
+    return strcmp((*(const SevenZFile* const*)a)->name, (*(const SevenZFile* const*)b)->name);
+}
+
+/* Helper: Write the kept files of a partly superseded folder to side files
+ *
+ * Such a folder cannot be copied, so it is decoded once and its surviving
+ * files are compressed again with the new inputs. They are spilled next to
+ * the archive (keeping their extension for filter choice) so memory holds
+ * one decoded folder at a time.
+ */
+static SevenZipErrorCode repack_folder(
+    SevenZArchiveBuilder* builder,
+    const CSzArEx* db,
+    UInt32 folder_index,
+    const Byte* replaced,
+    ILookInStreamPtr stream,
+    const char* archive_path
+) {
+    UInt32 first = db->FolderToFile[folder_index];
+    UInt32 end = db->FolderToFile[folder_index + 1];
+    
+    int any_kept = 0;
+    for (UInt32 i = first; i < end; i++) {
+        if (source_entry_has_stream(db, i) && db->FileToFolder[i] == folder_index && !replaced[i]) {
+            any_kept = 1;
+        }
+    }
+    if (!any_kept) return SEVENZIP_OK;
+    
+    UInt64 unpack_size = SzAr_GetFolderUnpackSize(&db->db, folder_index);
+    if (unpack_size != (size_t)unpack_size) return SEVENZIP_ERROR_MEMORY;
+    Byte* data = (Byte*)ISzAlloc_Alloc(&g_MemDecoderAlloc, (size_t)unpack_size);
+    if (!data && unpack_size > 0) return SEVENZIP_ERROR_MEMORY;
+    
+    SRes res = SzAr_DecodeFolder(&db->db, folder_index, stream, db->dataPos,
+                                 data, (size_t)unpack_size, &g_MemDecoderAlloc);
+    if (res != SZ_OK) {
+        ISzAlloc_Free(&g_MemDecoderAlloc, data);
+        return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+    }
+    
+    SevenZipErrorCode result = SEVENZIP_OK;
+    UInt64 folder_start = db->UnpackPositions[first];
+    for (UInt32 i = first; i < end && result == SEVENZIP_OK; i++) {
+        if (!source_entry_has_stream(db, i) || db->FileToFolder[i] != folder_index || replaced[i]) {
+            continue;
+        }
+        
+        char* name;
+        if (!source_entry_name(db, i, &name)) {
+            result = SEVENZIP_ERROR_MEMORY;
+            break;
+        }
+        const char* ext = name ? strrchr(name, '.') : NULL;
+        if (ext && (strchr(ext, '/') || strlen(ext) > 16)) ext = NULL;
+        
+        size_t path_size = strlen(archive_path) + 32 + (ext ? strlen(ext) : 0);
+        char* path = (char*)mem_alloc(SEVENZIP_MEM_NAMES, path_size);
+        if (path) snprintf(path, path_size, "%s.repack%u%s", archive_path, (unsigned)i, ext ? ext : "");
+        mem_free(name);
+        
+        SevenZFile* file = path ? builder_append(builder) : NULL;
+        if (!file) {
+            mem_free(path);
+            result = SEVENZIP_ERROR_MEMORY;
+            break;
+        }
+        copy_source_entry(file, db, i);
+        file->copied = 0;  /* Compressed again from the side file */
+        file->no_crc = 0;
+        file->full_path = path;
+        
+        FILE* out = fopen(path, "wb");
+        size_t offset = (size_t)(db->UnpackPositions[i] - folder_start);
+        if (!out || fwrite(data + offset, 1, (size_t)file->size, out) != file->size) {
+            result = SEVENZIP_ERROR_OPEN_FILE;
+        }
+        if (out && fclose(out) != 0) {
+            result = SEVENZIP_ERROR_OPEN_FILE;
+        }
+    }
+    
+    ISzAlloc_Free(&g_MemDecoderAlloc, data);
+    return result;
+}
+
+/* Helper: Entries of the source that stay, with their data
+ *
+ * Folders that lost no entry are copied as they are; the survivors of a
+ * folder that did are decoded and compressed again (see repack_folder).
+ * Entries are appended in folder order: copied ones, then repacked ones.
+ * @param replaced One byte per source entry, 1 = leaves the archive
+ */
+static SevenZipErrorCode plan_kept(
+    SevenZArchiveBuilder* builder,
+    const CSzArEx* db,
+    CSzFile* src_file,
+    const Byte* replaced,
+    ILookInStreamPtr stream,
+    const char* archive_path
+) {
+    UInt32 num_files = db->NumFiles;
+    UInt32 num_folders = db->db.NumFolders;
+    Byte* dirty = (Byte*)mem_calloc(SEVENZIP_MEM_OTHER, num_folders + 1, 1);
+    builder->folders = (SevenZFolder*)mem_calloc(SEVENZIP_MEM_HEADER, num_folders + 1, sizeof(SevenZFolder));
+    if (!dirty || !builder->folders) {
+        mem_free(dirty);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    for (UInt32 i = 0; i < num_files; i++) {
+        if (replaced[i] && source_entry_has_stream(db, i)) dirty[db->FileToFolder[i]] = 1;
+    }
+    
+    /* 1. Kept entries; clean folders are copied as they are */
+    SevenZipErrorCode result = SEVENZIP_OK;
+    for (UInt32 i = 0; i < num_files && result == SEVENZIP_OK; i++) {
+        if (replaced[i]) continue;
+        if (source_entry_has_stream(db, i) && dirty[db->FileToFolder[i]]) continue;
+        result = keep_source_entry(builder, db, src_file, i);
+    }
+    
+    /* 2. Survivors of folders that lost a file */
+    for (UInt32 fo = 0; fo < num_folders && result == SEVENZIP_OK; fo++) {
+        if (dirty[fo]) {
+            result = repack_folder(builder, db, fo, replaced, stream, archive_path);
+        }
+    }
+    
+    mem_free(dirty);
+    return result;
+}
+
+/* Helper: Build the merged entry list of an update
+ *
+ * Order follows the 7z rule that streams appear in folder order: entries
+ * kept from the source with their folders copied, then the kept files of
+ * repacked folders, then the new and changed inputs. Inputs identical to
+ * their archived version are dropped.
+ * @param changed Output: 0 when the archive would come out unchanged
+ */
+static SevenZipErrorCode plan_update(
+    SevenZArchiveBuilder* builder,
+    SevenZArchiveBuilder* inputs,
+    const CSzArEx* db,
+    CSzFile* src_file,
+    ILookInStreamPtr stream,
+    const char* archive_path,
+    int* changed
+) {
+    UInt32 num_files = db->NumFiles;
+    Byte* replaced = (Byte*)mem_calloc(SEVENZIP_MEM_OTHER, num_files + 1, 1);
+    Byte* current = (Byte*)mem_calloc(SEVENZIP_MEM_OTHER, inputs->file_count + 1, 1);
+    SevenZFile** sorted = (SevenZFile**)mem_alloc(SEVENZIP_MEM_OTHER, (inputs->file_count + 1) * sizeof(SevenZFile*));
+    SevenZipErrorCode result = SEVENZIP_OK;
+    *changed = 0;
+    
+    if (!replaced || !current || !sorted) {
+        result = SEVENZIP_ERROR_MEMORY;
+        goto done;
+    }
+    
+    /* Match archived entries against the inputs by name */
+    size_t num_sorted = 0;
+    for (size_t j = 0; j < inputs->file_count; j++) {
+        if (inputs->files[j].name) sorted[num_sorted++] = &inputs->files[j];
+    }
+    qsort(sorted, num_sorted, sizeof(SevenZFile*), compare_file_names);
+    
+    for (UInt32 i = 0; i < num_files; i++) {
+        char* name;
+        if (!source_entry_name(db, i, &name)) {
+            result = SEVENZIP_ERROR_MEMORY;
+            goto done;
+        }
+        if (!name) continue;
+        
+        SevenZFile key;
+        key.name = name;
+        const SevenZFile* key_ptr = &key;
+        SevenZFile** hit = (SevenZFile**)bsearch(&key_ptr, sorted, num_sorted,
+                                                 sizeof(SevenZFile*), compare_file_names);
+        mem_free(name);
+        if (!hit) continue;
+        
+        if (source_entry_unchanged(db, i, *hit)) {
+            current[*hit - inputs->files] = 1;
+        } else {
+            replaced[i] = 1;
+            *changed = 1;
+        }
+    }
+    
+    /* 1, 2. Kept entries, copied or repacked */
+    result = plan_kept(builder, db, src_file, replaced, stream, archive_path);
+    if (result != SEVENZIP_OK) goto done;
+    
+    /* 3. New and changed inputs; the builder takes over their strings */
+    for (size_t j = 0; j < inputs->file_count; j++) {
+        if (current[j]) continue;
+        SevenZFile* file = builder_append(builder);
+        if (!file) {
+            result = SEVENZIP_ERROR_MEMORY;
+            goto done;
+        }
+        *file = inputs->files[j];
+        inputs->files[j].name = NULL;
+        inputs->files[j].full_path = NULL;
+        *changed = 1;
+    }
+    
+done:
+    mem_free(replaced);
+    mem_free(current);
+    mem_free(sorted);
+    return result;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/* Helper: Entry list of an archive without the named entries
+ * A name also takes everything below it, so naming a directory removes
+ * its tree.
+ * @param deleted Output: entries removed
+ */
+static SevenZipErrorCode plan_delete(
+    SevenZArchiveBuilder* builder,
+    const char** names,
+    const CSzArEx* db,
+    CSzFile* src_file,
+    ILookInStreamPtr stream,
+    const char* archive_path,
+    size_t* deleted
+) {
+    size_t count = 0;
+    for (const char** p = names; *p; p++) count++;
+    const char** sorted = (const char**)mem_alloc(SEVENZIP_MEM_OTHER, (count + 1) * sizeof(char*));
+    Byte* replaced = (Byte*)mem_calloc(SEVENZIP_MEM_OTHER, db->NumFiles + 1, 1);
+    SevenZipErrorCode result = SEVENZIP_OK;
+    *deleted = 0;
+    if (!sorted || !replaced) {
+        result = SEVENZIP_ERROR_MEMORY;
+        goto done;
+    }
+    memcpy(sorted, names, count * sizeof(char*));
+    qsort(sorted, count, sizeof(char*), compare_names);
+    
+    for (UInt32 i = 0; i < db->NumFiles; i++) {
+        char* name;
+        if (!source_entry_name(db, i, &name)) {
+            result = SEVENZIP_ERROR_MEMORY;
+            goto done;
+        }
+        if (!name) continue;
+        
+        /* The entry itself, then each directory above it */
+        int hit = 0;
+        for (size_t len = strlen(name); !hit; ) {
+            char saved = name[len];
+            name[len] = '\0';
+            const char* key = name;
+            hit = bsearch(&key, sorted, count, sizeof(char*), compare_names) != NULL;
+            name[len] = saved;
+            while (len > 0 && name[len - 1] != '/') len--;
+            if (len == 0) break;
+            len--;
+        }
+        mem_free(name);
+        if (hit) {
+            replaced[i] = 1;
+            (*deleted)++;
+        }
+    }
+    
+    if (*deleted > 0) {
+        result = plan_kept(builder, db, src_file, replaced, stream, archive_path);
+    }
+    
+done:
+    mem_free(sorted);
+    mem_free(replaced);
+    return result;
+}
+
+/* Helper: Rewrite an archive with files added (`input_paths`) or removed
+ * (`delete_names`); unchanged folders are copied, not recompressed
+ * @param deleted Output for deletions: entries removed (may be NULL)
+ */
+static SevenZipErrorCode rewrite_archive(
+    const char* archive_path,
+    const char** input_paths,
+    const char** delete_names,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data,
+    size_t* deleted
+) {
+    global_tables_init();
+    const SevenZipCompressOptions* opts = options ? options : &k_default_options;
+    if (opts->password && opts->password[0]) {
+        return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+    }
+    
+    /* Open the archive being updated */
+    CFileInStream archive_stream;
+    CLookToRead2 look_stream;
+    const size_t kInputBufSize = ((size_t)1 << 18);
+    if (InFile_Open(&archive_stream.file, archive_path) != 0) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    FileInStream_CreateVTable(&archive_stream);
+    
+    ISzAlloc alloc_imp = g_MemHeaderAlloc;
+    
+    LookToRead2_CreateVTable(&look_stream, False);
+    look_stream.buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, kInputBufSize);
+    if (!look_stream.buf) {
+        File_Close(&archive_stream.file);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    look_stream.bufSize = kInputBufSize;
+    look_stream.realStream = &archive_stream.vt;
+    LookToRead2_INIT(&look_stream);
+    
+    CSzArEx db;
+    SzArEx_Init(&db);
+    SevenZArchiveBuilder inputs;
+    SevenZArchiveBuilder builder;
+    memset(&inputs, 0, sizeof(inputs));
+    memset(&builder, 0, sizeof(builder));
+    char* temp_path = NULL;
+    int file_open = 1;
+    int changed = 0;
+    
+    SevenZipCompressOptions leased = *opts;
+    ThreadLease lease;
+    leased.num_threads = thread_lease_acquire(&lease, opts->num_threads, opts->thread_weight);
+    opts = &leased;
+    
+    SevenZipErrorCode result = SEVENZIP_OK;
+    SRes res = SzArEx_Open(&db, &look_stream.vt, &alloc_imp, &alloc_imp);
+    if (res != SZ_OK) {
+        result = res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_INVALID_ARCHIVE;
+        goto cleanup;
+    }
+    
+    if (delete_names) {
+        size_t removed = 0;
+        result = builder_init(&builder, level, opts);
+        if (result == SEVENZIP_OK) {
+            result = plan_delete(&builder, delete_names, &db, &archive_stream.file, &look_stream.vt,
+                                 archive_path, &removed);
+        }
+        changed = removed > 0;
+        if (deleted) *deleted = result == SEVENZIP_OK ? removed : 0;
+    } else {
+        /* Gather the inputs as sevenzip_create_7z() would */
+        result = builder_init(&inputs, level, opts);
+        if (result == SEVENZIP_OK) {
+            result = add_input_paths(&inputs, input_paths, progress_callback, user_data);
+        }
+        if (result == SEVENZIP_OK) {
+            result = builder_init(&builder, level, opts);
+        }
+        if (result == SEVENZIP_OK) {
+            result = plan_update(&builder, &inputs, &db, &archive_stream.file, &look_stream.vt,
+                                 archive_path, &changed);
+        }
+    }
+    if (result != SEVENZIP_OK || !changed) goto cleanup;
+    
+    /* Write next to the archive, then replace it */
+    size_t temp_size = strlen(archive_path) + 5;
+    temp_path = (char*)mem_alloc(SEVENZIP_MEM_NAMES, temp_size);
+    if (!temp_path) {
+        result = SEVENZIP_ERROR_MEMORY;
+        goto cleanup;
+    }
+    snprintf(temp_path, temp_size, "%s.tmp", archive_path);
+    
+    result = write_7z_archive(temp_path, &builder);
+    File_Close(&archive_stream.file);
+    file_open = 0;
+    if (result == SEVENZIP_OK) {
+#ifdef _WIN32
+        int moved = MoveFileExA(temp_path, archive_path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        int moved = rename(temp_path, archive_path) == 0;
+#endif
+        if (!moved) {
+            remove(temp_path);
+            result = SEVENZIP_ERROR_OPEN_FILE;
+        }
+    }
+    
+cleanup:
+    /* Side files of repacked folders */
+    for (size_t i = 0; i < builder.file_count; i++) {
+        if (builder.files[i].name_utf16 && builder.files[i].full_path) {
+            remove(builder.files[i].full_path);
+        }
+    }
+    mem_free(temp_path);
+    builder_free(&builder);
+    builder_free(&inputs);
+    SzArEx_Free(&db, &alloc_imp);
+    ISzAlloc_Free(&g_MemIoAlloc, look_stream.buf);
+    if (file_open) File_Close(&archive_stream.file);
+    thread_lease_release(&lease);
+    return result;
+}
+
+/* Main API: Add new and changed files to an existing 7z archive */
+SevenZipErrorCode sevenzip_update_archive(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !input_paths) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    /* Nothing to update yet: same as creating the archive */
+    struct STAT st;
+    if (STAT(archive_path, &st) != 0) {
+        return sevenzip_create_7z(archive_path, input_paths, level, options,
+                                  progress_callback, user_data);
+    }
+    return rewrite_archive(archive_path, input_paths, NULL, level, options,
+                           progress_callback, user_data, NULL);
+}
+
+/* Main API: Remove entries from a 7z archive, repacking only their folders */
+SevenZipErrorCode sevenzip_delete_entries(
+    const char* archive_path,
+    const char** entry_names,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    size_t* deleted_count
+) {
+    if (deleted_count) *deleted_count = 0;
+    if (!archive_path || !entry_names) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    return rewrite_archive(archive_path, NULL, entry_names, level, options, NULL, NULL, deleted_count);
+}
+
+/* ============================================================================
+ * Distributed compression: parts made apart, assembled by copying
+ * ============================================================================ */
+
+/* Main API: Compress a subset of the inputs into a part for assembly */
+SevenZipErrorCode sevenzip_compress_folder_part(
+    const char* part_path,
+    const char** input_paths,
+    const char* name_prefix,
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!input_paths) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    /* Parts are assembled by copying their pack streams and header data */
+    if (options && options->password && options->password[0]) {
+        return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+    }
+    return create_archive(part_path, input_paths, NULL, 0, name_prefix, level, options,
+                          progress_callback, user_data);
+}
+
+/* One part being assembled, open for reading its header and packed data */
+typedef struct {
+    CFileInStream stream;
+    CLookToRead2 look;
+    CSzArEx db;
+    int file_open;
+} AssemblyPart;
+
+/* Output of an assembly: the archive file, or volumes of split_size bytes */
+typedef struct {
+    const char* archive_path;
+    uint64_t split_size;
+    FILE* f;
+    uint32_t volume_count;
+    uint64_t volume_size;        /* Bytes in the current volume */
+    int kernel_copy;             /* 1 = copy_file_range not refused yet */
+} AssemblyOut;
+
+/* Packed streams go file-to-file in the kernel where it can */
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    #define ASSEMBLY_KERNEL_COPY 1
+#else
+    #define ASSEMBLY_KERNEL_COPY 0
+#endif
+
+/* Helper: Path of an assembled archive's volume (the archive itself unsplit) */
+static void assembly_volume_path(const AssemblyOut* out, uint32_t index, char* buffer, size_t size) {
+    if (out->split_size == 0) {
+        snprintf(buffer, size, "%s", out->archive_path);
+    } else {
+        snprintf(buffer, size, "%s.%03u", out->archive_path, (unsigned)index + 1);
+    }
+}
+
+static int assembly_close_volume(AssemblyOut* out) {
+    if (!out->f) return 1;
+    int ok = fclose(out->f) == 0;
+    out->f = NULL;
+    return ok;
+}
+
+/* Helper: Room for more bytes, opening the next volume once one is full
+ * @return Bytes the current volume still takes (SIZE_MAX unsplit), 0 on failure
+ */
+static uint64_t assembly_room(AssemblyOut* out) {
+    if (!out->f || (out->split_size > 0 && out->volume_size >= out->split_size)) {
+        if (!assembly_close_volume(out)) return 0;
+        char path[4096];
+        assembly_volume_path(out, out->volume_count, path, sizeof(path));
+        out->f = fopen(path, "wb");
+        if (!out->f) return 0;
+        setvbuf(out->f, NULL, _IOFBF, ARCHIVE_WRITE_BUFFER_SIZE);
+        out->volume_count++;
+        out->volume_size = 0;
+    }
+    return out->split_size > 0 ? out->split_size - out->volume_size : (uint64_t)SIZE_MAX;
+}
+
+static int assembly_write(void* ctx, const void* data, size_t size) {
+    AssemblyOut* out = (AssemblyOut*)ctx;
+    const Byte* p = (const Byte*)data;
+    while (size > 0) {
+        uint64_t room = assembly_room(out);
+        if (room == 0) return 0;
+        size_t n = (uint64_t)size > room ? (size_t)room : size;
+        if (fwrite(p, 1, n, out->f) != n) return 0;
+        out->volume_size += n;
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
+
+#if ASSEMBLY_KERNEL_COPY
+/* Helper: Copy `size` bytes at `offset` of `fd` file-to-file inside the kernel
+ * copy_file_range shares extents on filesystems with reflinks (Btrfs, XFS)
+ * and otherwise copies without a trip through user space. The first
+ * refusal (other filesystem, old kernel) turns it off for the output.
+ * @return Leading bytes copied; the caller writes the rest
+ */
+static uint64_t assembly_kernel_copy(AssemblyOut* out, int fd, uint64_t offset, uint64_t size) {
+    int64_t in_off = (int64_t)offset;
+    uint64_t done = 0;
+    while (out->kernel_copy && done < size) {
+        uint64_t room = assembly_room(out);
+        if (room == 0 || fflush(out->f) != 0) break;
+        uint64_t n = size - done;
+        if (n > room) n = room;
+        if (n > ((size_t)1 << 30)) n = (size_t)1 << 30;
+        ssize_t got = (ssize_t)syscall(SYS_copy_file_range, fd, &in_off,
+                                       fileno(out->f), NULL, (size_t)n, 0);
+        if (got <= 0) {
+            out->kernel_copy = 0;
+            break;
+        }
+        done += (uint64_t)got;
+        out->volume_size += (uint64_t)got;
+    }
+    return done;
+}
+#endif
+
+/* Helper: Open a part and read its header */
+static SevenZipErrorCode assembly_open_part(AssemblyPart* part, const char* path) {
+    const size_t kInputBufSize = ((size_t)1 << 18);
+    ISzAlloc alloc_imp = g_MemHeaderAlloc;
+    if (InFile_Open(&part->stream.file, path) != 0) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    part->file_open = 1;
+    FileInStream_CreateVTable(&part->stream);
+    
+    LookToRead2_CreateVTable(&part->look, False);
+    part->look.buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, kInputBufSize);
+    if (!part->look.buf) return SEVENZIP_ERROR_MEMORY;
+    part->look.bufSize = kInputBufSize;
+    part->look.realStream = &part->stream.vt;
+    LookToRead2_INIT(&part->look);
+    
+    SRes res = SzArEx_Open(&part->db, &part->look.vt, &alloc_imp, &alloc_imp);
+    if (res != SZ_OK) {
+        return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    return SEVENZIP_OK;
+}
+
+/* Helper: Write the start header, the parts' packed streams and the new
+ * header front to back; pack sizes are known from the parts, so the start
+ * header is final before the first byte is written and nothing is sought */
+static SevenZipErrorCode write_assembled_archive(
+    SevenZArchiveBuilder* builder,
+    AssemblyOut* out,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    uint64_t pack_size = 0;
+    for (size_t i = 0; i < builder->folder_count; i++) {
+        builder->folders[i].pack_size = copied_pack_size(&builder->folders[i]);
+        pack_size += builder->folders[i].pack_size;
+    }
+    
+    ArchiveTail tail;
+    SevenZipErrorCode result = build_archive_tail(builder, pack_size, &tail);
+    if (result != SEVENZIP_OK) return result;
+    
+    Byte start_header[k7zStartHeaderSize];
+    fill_start_header(start_header, &tail);
+    if (!assembly_write(out, start_header, sizeof(start_header))) {
+        result = SEVENZIP_ERROR_COMPRESS;
+    }
+    for (size_t i = 0; i < builder->folder_count && result == SEVENZIP_OK; i++) {
+        uint64_t done = 0;
+#if ASSEMBLY_KERNEL_COPY
+        const SevenZFolder* folder = &builder->folders[i];
+        done = assembly_kernel_copy(out, folder->src_file->fd, copied_pack_offset(folder),
+                                    copied_pack_size(folder));
+#endif
+        result = copy_folder(&builder->folders[i], done, assembly_write, out);
+        if (result == SEVENZIP_OK && progress_callback) {
+            progress_callback(i + 1, builder->folder_count, user_data);
+        }
+    }
+    if (result == SEVENZIP_OK && !assembly_write(out, tail.data, tail.size)) {
+        result = SEVENZIP_ERROR_COMPRESS;
+    }
+    mem_free(tail.data);
+    return result;
+}
+
+/* What a merge does with one source entry */
+typedef enum {
+    MERGE_KEEP = 0,
+    MERGE_DROP,            /* Directory already present, or identical file */
+    MERGE_RENAME           /* File whose name an earlier one has */
+} MergeAction;
+
+typedef struct {
+    char* name;            /* UTF-8 name, NULL for an unnamed entry */
+    char* renamed;         /* MERGE_RENAME: name in the merged archive */
+    UInt32 part;
+    UInt32 index;
+    MergeAction action;
+} MergeEntry;
+
+static int compare_merge_entries(const void* a, const void* b) {
+    const MergeEntry* x = *(const MergeEntry* const*)a;
+    const MergeEntry* y = *(const MergeEntry* const*)b;
+    int c = strcmp(x->name, y->name);
+    if (c != 0) return c;
+    if (x->part != y->part) return x->part < y->part ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/* Helper: Same size and CRC (both recorded) */
+static int merge_same_content(const AssemblyPart* parts, const MergeEntry* x, const MergeEntry* y) {
+    const CSzArEx* a = &parts[x->part].db;
+    const CSzArEx* b = &parts[y->part].db;
+    if (!source_entry_has_stream(a, x->index) && !source_entry_has_stream(b, y->index)) {
+        /* Empty files have no CRC: the same attributes make them identical */
+        int defined = SzBitWithVals_Check(&a->Attribs, x->index);
+        return SzArEx_GetFileSize(a, x->index) == 0 && SzArEx_GetFileSize(b, y->index) == 0 &&
+               defined == SzBitWithVals_Check(&b->Attribs, y->index) &&
+               (!defined || a->Attribs.Vals[x->index] == b->Attribs.Vals[y->index]);
+    }
+    return SzArEx_GetFileSize(a, x->index) == SzArEx_GetFileSize(b, y->index) &&
+           SzBitWithVals_Check(&a->CRCs, x->index) && SzBitWithVals_Check(&b->CRCs, y->index) &&
+           a->CRCs.Vals[x->index] == b->CRCs.Vals[y->index];
+}
+
+/* Helper: "<stem> (n)<ext>" of a clashing name, not taken by any source entry */
+static char* merge_rename(const char* name, MergeEntry** sorted, size_t count, unsigned* n) {
+    const char* base = strrchr(name, '/');
+    const char* ext = strrchr(base ? base + 1 : name, '.');
+    if (!ext || ext == (base ? base + 1 : name)) ext = name + strlen(name);
+    size_t size = strlen(name) + 16;
+    char* renamed = (char*)mem_alloc(SEVENZIP_MEM_NAMES, size);
+    if (!renamed) return NULL;
+    for (;;) {
+        snprintf(renamed, size, "%.*s (%u)%s", (int)(ext - name), name, ++*n, ext);
+        int taken = 0;
+        for (size_t lo = 0, hi = count; lo < hi && !taken;) {
+            size_t mid = (lo + hi) / 2;
+            int c = strcmp(sorted[mid]->name, renamed);
+            if (c == 0) taken = 1;
+            else if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        if (!taken) return renamed;
+    }
+}
+
+/* Helper: Decide what happens to every entry of the parts
+ *
+ * Directories of the same name become one. With drop_identical a file
+ * whose name, size and CRC an earlier kept file has (or an empty file with
+ * the same attributes) is left out, but only
+ * when every file of its folder goes, since a copied folder keeps all its
+ * streams; otherwise it clashes like any other file of a taken name.
+ */
+static SevenZipErrorCode plan_merge(
+    const AssemblyPart* parts,
+    size_t part_count,
+    const SevenZipMergeOptions* merge,
+    MergeEntry** entries_out,
+    size_t* count_out
+) {
+    size_t count = 0;
+    for (size_t k = 0; k < part_count; k++) count += parts[k].db.NumFiles;
+    MergeEntry* entries = (MergeEntry*)mem_calloc(SEVENZIP_MEM_OTHER, count + 1, sizeof(MergeEntry));
+    MergeEntry** sorted = (MergeEntry**)mem_alloc(SEVENZIP_MEM_OTHER, (count + 1) * sizeof(MergeEntry*));
+    size_t num_sorted = 0;
+    SevenZipErrorCode result = SEVENZIP_OK;
+    *entries_out = entries;
+    *count_out = 0;
+    if (!entries || !sorted) {
+        mem_free(sorted);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    
+    size_t e = 0;
+    for (size_t k = 0; k < part_count && result == SEVENZIP_OK; k++) {
+        for (UInt32 i = 0; i < parts[k].db.NumFiles; i++, e++) {
+            entries[e].part = (UInt32)k;
+            entries[e].index = i;
+            *count_out = e + 1;
+            if (!source_entry_name(&parts[k].db, i, &entries[e].name)) {
+                result = SEVENZIP_ERROR_MEMORY;
+                break;
+            }
+            if (entries[e].name) sorted[num_sorted++] = &entries[e];
+        }
+    }
+    if (result != SEVENZIP_OK) {
+        mem_free(sorted);
+        return result;
+    }
+    qsort(sorted, num_sorted, sizeof(MergeEntry*), compare_merge_entries);
+    
+    /* 1. Within each run of one name, in part order */
+    for (size_t g = 0; g < num_sorted;) {
+        size_t end = g + 1;
+        while (end < num_sorted && strcmp(sorted[end]->name, sorted[g]->name) == 0) end++;
+        int have_dir = 0;
+        for (size_t j = g; j < end; j++) {
+            MergeEntry* entry = sorted[j];
+            const CSzArEx* db = &parts[entry->part].db;
+            if (SzArEx_IsDir(db, entry->index)) {
+                entry->action = have_dir ? MERGE_DROP : MERGE_KEEP;
+                have_dir = 1;
+                continue;
+            }
+            entry->action = MERGE_KEEP;
+            for (size_t m = g; m < j; m++) {
+                if (sorted[m]->action != MERGE_KEEP || SzArEx_IsDir(&parts[sorted[m]->part].db, sorted[m]->index)) {
+                    continue;
+                }
+                if (merge->drop_identical && merge_same_content(parts, sorted[m], entry)) {
+                    entry->action = MERGE_DROP;
+                    break;
+                }
+                entry->action = MERGE_RENAME;
+            }
+        }
+        g = end;
+    }
+    
+    /* 2. Identical files stay if their folder is copied anyway */
+    for (size_t k = 0, base = 0; k < part_count; base += parts[k].db.NumFiles, k++) {
+        const CSzArEx* db = &parts[k].db;
+        for (UInt32 fo = 0; fo < db->db.NumFolders; fo++) {
+            int copied = 0;
+            for (UInt32 i = db->FolderToFile[fo]; i < db->FolderToFile[fo + 1]; i++) {
+                if (source_entry_has_stream(db, i) && entries[base + i].action != MERGE_DROP) copied = 1;
+            }
+            if (!copied) continue;
+            for (UInt32 i = db->FolderToFile[fo]; i < db->FolderToFile[fo + 1]; i++) {
+                if (source_entry_has_stream(db, i) && entries[base + i].action == MERGE_DROP) {
+                    entries[base + i].action = MERGE_RENAME;
+                }
+            }
+        }
+    }
+    
+    /* 3. Names for the clashes, or the same name listed again */
+    for (size_t g = 0; g < num_sorted && result == SEVENZIP_OK;) {
+        size_t end = g + 1;
+        while (end < num_sorted && strcmp(sorted[end]->name, sorted[g]->name) == 0) end++;
+        unsigned n = 1;
+        for (size_t j = g; j < end; j++) {
+            MergeEntry* entry = sorted[j];
+            if (entry->action != MERGE_RENAME) continue;
+            if (merge->names == SEVENZIP_MERGE_KEEP_ALL) {
+                entry->action = MERGE_KEEP;
+                continue;
+            }
+            char* renamed = merge_rename(entry->name, sorted, num_sorted, &n);
+            if (!renamed) {
+                result = SEVENZIP_ERROR_MEMORY;
+                break;
+            }
+            entry->renamed = renamed;
+        }
+        g = end;
+    }
+    
+    mem_free(sorted);
+    return result;
+}
+
+/* Helper: Assemble parts, or merge archives when `merge` is given */
+static SevenZipErrorCode assemble_parts(
+    const char* archive_path,
+    const char** part_paths,
+    const SevenZipMergeOptions* merge,
+    uint64_t split_size,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !part_paths) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    global_tables_init();
+    
+    size_t part_count = 0;
+    for (const char** p = part_paths; *p; p++) part_count++;
+    
+    AssemblyPart* parts = (AssemblyPart*)mem_calloc(SEVENZIP_MEM_OTHER, part_count + 1, sizeof(AssemblyPart));
+    if (!parts) return SEVENZIP_ERROR_MEMORY;
+    for (size_t k = 0; k < part_count; k++) {
+        SzArEx_Init(&parts[k].db);
+    }
+    
+    SevenZArchiveBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    AssemblyOut out;
+    memset(&out, 0, sizeof(out));
+    out.archive_path = archive_path;
+    out.split_size = split_size;
+    out.kernel_copy = 1;
+    MergeEntry* entries = NULL;
+    size_t entry_count = 0;
+    
+    SevenZipErrorCode result = SEVENZIP_OK;
+    size_t total_folders = 0;
+    for (size_t k = 0; k < part_count && result == SEVENZIP_OK; k++) {
+        result = assembly_open_part(&parts[k], part_paths[k]);
+        total_folders += parts[k].db.db.NumFolders;
+    }
+    if (result == SEVENZIP_OK && merge) {
+        result = plan_merge(parts, part_count, merge, &entries, &entry_count);
+    }
+    
+    /* Entries in part order, each part's folders copied as they are */
+    if (result == SEVENZIP_OK) {
+        builder.file_capacity = 16;
+        builder.files = (SevenZFile*)mem_calloc(SEVENZIP_MEM_HEADER, builder.file_capacity, sizeof(SevenZFile));
+        builder.folders = (SevenZFolder*)mem_calloc(SEVENZIP_MEM_HEADER, total_folders + 1, sizeof(SevenZFolder));
+        if (!builder.files || !builder.folders) result = SEVENZIP_ERROR_MEMORY;
+    }
+    for (size_t k = 0, e = 0; k < part_count && result == SEVENZIP_OK; k++) {
+        for (UInt32 i = 0; i < parts[k].db.NumFiles && result == SEVENZIP_OK; i++, e++) {
+            MergeAction action = entries ? entries[e].action : MERGE_KEEP;
+            if (action == MERGE_DROP) continue;
+            result = keep_source_entry(&builder, &parts[k].db, &parts[k].stream.file, i);
+            if (result == SEVENZIP_OK && action == MERGE_RENAME) {
+                /* The builder takes over the new name */
+                SevenZFile* file = &builder.files[builder.file_count - 1];
+                file->name = entries[e].renamed;
+                file->name_utf16 = NULL;
+                entries[e].renamed = NULL;
+            }
+        }
+    }
+    
+    if (result == SEVENZIP_OK) {
+        result = write_assembled_archive(&builder, &out, progress_callback, user_data);
+    }
+    if (!assembly_close_volume(&out) && result == SEVENZIP_OK) {
+        result = SEVENZIP_ERROR_COMPRESS;
+    }
+    if (result != SEVENZIP_OK) {
+        for (uint32_t v = 0; v < out.volume_count; v++) {
+            char path[4096];
+            assembly_volume_path(&out, v, path, sizeof(path));
+            remove(path);
+        }
+    }
+    
+    builder_free(&builder);
+    for (size_t e = 0; e < entry_count; e++) {
+        mem_free(entries[e].name);
+        mem_free(entries[e].renamed);
+    }
+    mem_free(entries);
+    ISzAlloc alloc_imp = g_MemHeaderAlloc;
+    for (size_t k = 0; k < part_count; k++) {
+        SzArEx_Free(&parts[k].db, &alloc_imp);
+        ISzAlloc_Free(&g_MemIoAlloc, parts[k].look.buf);
+        if (parts[k].file_open) File_Close(&parts[k].stream.file);
+    }
+    mem_free(parts);
+    return result;
+}
+
+/* Main API: Concatenate parts into one archive, writing only a new header */
+SevenZipErrorCode sevenzip_assemble_archive(
+    const char* archive_path,
+    const char** part_paths,
+    uint64_t split_size,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    return assemble_parts(archive_path, part_paths, NULL, split_size, progress_callback, user_data);
+}
+
+void sevenzip_merge_options_init(SevenZipMergeOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->names = SEVENZIP_MERGE_RENAME;
+    options->drop_identical = 1;
+}
+
+/* Main API: Merge archives into one without recompressing */
+SevenZipErrorCode sevenzip_merge_archives(
+    const char* archive_path,
+    const char** input_paths,
+    const SevenZipMergeOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipMergeOptions defaults;
+    sevenzip_merge_options_init(&defaults);
+    const SevenZipMergeOptions* merge = options ? options : &defaults;
+    return assemble_parts(archive_path, input_paths, merge, merge->split_size,
+                          progress_callback, user_data);
+}
+
+/* ============================================================================
+ * Re-split: the volumes of an archive cut to another size
+ * ============================================================================ */
+
+/* Helper: Would writing `dst_base` (or its volumes) overwrite a source volume? */
+static int resplit_overlaps(const VolumeSet* set, const char* dst_base) {
+    size_t len = strlen(dst_base);
+    for (int v = 0; v < set->count; v++) {
+        const char* p = set->paths[v];
+        if (strcmp(p, dst_base) == 0) return 1;
+        if (strncmp(p, dst_base, len) == 0 && strlen(p) == len + 4 && p[len] == '.') return 1;
+    }
+    return 0;
+}
+
+/* Main API: Write an archive's bytes again as volumes of another size */
+SevenZipErrorCode sevenzip_resplit_archive(
+    const char* src_first_volume,
+    const char* dst_base,
+    uint64_t new_split_size,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!src_first_volume || !dst_base) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    global_tables_init();
+    
+    VolumeSet set;
+    if (!volume_set_open(&set, src_first_volume, 1)) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    if (resplit_overlaps(&set, dst_base)) {
+        volume_set_close(&set);
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    /* The start header says where the archive ends: a missing volume
+     * shows before anything is written, and trailing bytes are left out */
+    Byte start[k7zStartHeaderSize];
+    size_t got = sizeof(start);
+    int current = 0;
+    SevenZipErrorCode result = SEVENZIP_OK;
+    uint64_t end = 0;
+    if (volume_set_read(&set, 0, start, &got, &current) != SZ_OK || got != sizeof(start) ||
+        memcmp(start, k7zSignature, k7zSignatureSize) != 0 ||
+        GetUi32(start + 8) != CrcCalc(start + 12, 20)) {
+        result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+    } else {
+        end = k7zStartHeaderSize + GetUi64(start + 12) + GetUi64(start + 20);
+        if (end > set.total_size || end < k7zStartHeaderSize) result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    
+    AssemblyOut out;
+    memset(&out, 0, sizeof(out));
+    out.archive_path = dst_base;
+    out.split_size = new_split_size;
+    out.kernel_copy = 1;
+    Byte* buf = NULL;
+    if (result == SEVENZIP_OK) {
+        buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, COPY_BUFFER_SIZE);
+        if (!buf) result = SEVENZIP_ERROR_MEMORY;
+    }
+    
+    /* Volume to volume: each source volume's bytes, kernel-copied where
+     * it can, the rest read and written through the buffer; with parity
+     * every byte goes through the set, which repairs what it reads */
+    uint64_t pos = 0;
+    for (int v = 0; v < set.count && pos < end && result == SEVENZIP_OK; v++) {
+        uint64_t size = set.sizes[v];
+        if (size > end - pos) size = end - pos;
+        uint64_t done = 0;
+#if ASSEMBLY_KERNEL_COPY
+        if (!set.parity) done = assembly_kernel_copy(&out, fileno(set.files[v]), 0, size);
+#endif
+        if (!set.parity && done < size && FSEEK64(set.files[v], (int64_t)done, SEEK_SET) != 0) {
+            result = SEVENZIP_ERROR_OPEN_FILE;
+        }
+        while (done < size && result == SEVENZIP_OK) {
+            size_t n = size - done < COPY_BUFFER_SIZE ? (size_t)(size - done) : COPY_BUFFER_SIZE;
+            size_t got = n;
+            if (set.parity ? volume_set_read(&set, pos + done, buf, &got, &current) != SZ_OK || got != n
+                           : fread(buf, 1, n, set.files[v]) != n) {
+                result = SEVENZIP_ERROR_OPEN_FILE;
+            } else if (!assembly_write(&out, buf, n)) {
+                result = SEVENZIP_ERROR_COMPRESS;
+            }
+            done += n;
+        }
+        pos += size;
+        if (result == SEVENZIP_OK && progress_callback) {
+            progress_callback(pos, end, user_data);
+        }
+    }
+    
+    if (!assembly_close_volume(&out) && result == SEVENZIP_OK) {
+        result = SEVENZIP_ERROR_COMPRESS;
+    }
+    if (result != SEVENZIP_OK) {
+        for (uint32_t v = 0; v < out.volume_count; v++) {
+            char path[4096];
+            assembly_volume_path(&out, v, path, sizeof(path));
+            remove(path);
+        }
+    }
+    mem_free(buf);
+    volume_set_close(&set);
+    return result;
+}
+
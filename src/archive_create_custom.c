@@ -1,27 +1,71 @@
 /**
  * Multi-file Archive Creation using LZMA2
- * 
+ *
  * Creates archives with multiple files compressed using LZMA2.
- * Uses a simple custom format: Header + File Entries + Compressed Data
- * 
- * Archive Format:
+ * Uses a simple custom format: Header + Compressed Data + Index + Trailer
+ *
+ * Archive Format (version 2, little-endian):
  * - Magic: "7ZFF" (4 bytes)
- * - Version: 1 (1 byte)
- * - File Count: N (4 bytes)
- * - File Entries: N * Entry
- *   - Name Length (2 bytes)
- *   - Name (UTF-8)
- *   - Original Size (8 bytes)
- *   - Compressed Size (8 bytes)
- *   - Offset (8 bytes)
- *   - Timestamp (8 bytes)
- *   - Attributes (4 bytes)
- * - Compressed Data Blocks
+ * - Version: 2 (1 byte)
+ * - Compressed Data Blocks, one per file in any order:
+ *   LZMA2 property byte + LZMA2 stream
+ * - Index:
+ *   - File Count: N (4 bytes)
+ *   - File Entries: N * Entry
+ *     - Name Length (2 bytes)
+ *     - Name (UTF-8)
+ *     - Original Size (8 bytes)
+ *     - Compressed Size (8 bytes, property byte included)
+ *     - Offset (8 bytes, from the start of the archive)
+ *     - Timestamp (8 bytes)
+ *     - Attributes (4 bytes)
+ *     - CRC32 of the original data (4 bytes)
+ * - Trailer (24 bytes):
+ *   - Index Offset (8 bytes)
+ *   - Index Size (8 bytes)
+ *   - Index CRC32 (4 bytes)
+ *   - Magic: "7ZFI" (4 bytes)
+ *
+ * Version 3 (SevenZipCompressOptions.dedup_chunk_size) stores every
+ * file as a list of content-defined chunks, each distinct chunk once:
+ * - Compressed Data Blocks, one per distinct chunk in any order, as above
+ * - Index:
+ *   - Chunk Count: C (4 bytes)
+ *   - Chunk Entries: C * (Offset 8, Compressed Size 4, Original Size 4,
+ *     CRC32 4, XXH3-128 of the original data 16)
+ *   - File Count: N (4 bytes)
+ *   - File Entries: N * (Name Length 2, Name, Original Size 8,
+ *     Timestamp 8, Attributes 4, CRC32 4, Chunk Count 4, then that many
+ *     4-byte chunk numbers in data order)
+ * - Trailer as above
+ *
+ * Version 1 archives (entry table in front, data offsets relative to its
+ * end, native byte order) are still extracted.
+ *
+ * Files are compressed on a pool of workers, each with its own encoder.
+ * A worker appends its block to the archive as soon as the block is done,
+ * so at most one compressed file per worker is held in memory; the index
+ * written last records where each block landed.
+ *
+ * With dedup the calling thread reads the files in order instead, cuts
+ * them into chunks (cdc_chunker.h) and looks each chunk's XXH3-128 up in
+ * a hash table of the chunks seen so far. Only new chunks are queued, on
+ * a bounded queue, for the workers to compress and append; a repeat costs
+ * the hash and four bytes of index.
  */
 
 #include "../include/7z_ffi.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
 #include "Lzma2Enc.h"
-#include "Alloc.h"
+#include "Threads.h"
+#include "mem_alloc.h"
+#include "packed_input.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+#include "thread_placement.h"
+#include "cdc_chunker.h"
+#include "xxh3.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -43,335 +87,731 @@
 #endif
 
 #define ARCHIVE_MAGIC "7ZFF"
-#define ARCHIVE_VERSION 1
+#define ARCHIVE_INDEX_MAGIC "7ZFI"
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_VERSION_DEDUP 3
+#define DEDUP_CHUNK_ENTRY_SIZE 36   /* Version 3 chunk entry */
+#define DEDUP_FILE_FIXED_SIZE 30    /* Version 3 file entry without name and chunk numbers */
+#define DEDUP_QUEUE_PER_WORKER 2    /* New chunks queued per worker before the reader waits */
+#define ARCHIVE_HEADER_SIZE 5
+#define ARCHIVE_TRAILER_SIZE 24
+#define ARCHIVE_ENTRY_FIXED_SIZE 42  /* Index entry without its name */
+#define ARCHIVE_DEFAULT_THREADS 2
+#define ARCHIVE_MAX_THREADS 64
 #define MAX_PATH_LEN 4096
 
 /* File entry in archive */
 typedef struct {
+    const char* path;
     char* name;
     uint64_t original_size;
     uint64_t compressed_size;
     uint64_t offset;
     uint64_t timestamp;
     uint32_t attributes;
-    unsigned char* compressed_data;
+    uint32_t crc;
+    uint32_t* chunks;             /* Dedup: chunk numbers of the data, in order */
+    size_t chunk_count;
+    size_t chunk_capacity;
 } ArchiveFileEntry;
 
-/* Archive builder context */
+/* Archive builder context, shared by the workers */
 typedef struct {
     ArchiveFileEntry* entries;
     size_t entry_count;
-    size_t entry_capacity;
-    CLzma2EncProps props;
+    CLzma2EncProps props;         /* Per-file encoder settings */
+    FILE* file;
+    uint64_t file_pos;            /* End of the data written so far (under write_lock) */
+    CCriticalSection write_lock;
+    CCriticalSection lock;        /* Guards everything below */
+    size_t next_entry;
+    size_t entries_done;
+    SevenZipErrorCode error_code;
+    SevenZipProgressCallback progress_callback;
+    void* user_data;
 } ArchiveBuilder;
 
-/* Helper: Initialize archive builder */
-static ArchiveBuilder* create_archive_builder(SevenZipCompressionLevel level) {
-    ArchiveBuilder* builder = (ArchiveBuilder*)calloc(1, sizeof(ArchiveBuilder));
-    if (!builder) return NULL;
-    
-    builder->entry_capacity = 16;
-    builder->entries = (ArchiveFileEntry*)calloc(builder->entry_capacity, sizeof(ArchiveFileEntry));
-    if (!builder->entries) {
-        free(builder);
-        return NULL;
-    }
-    
-    /* Set compression properties */
-    Lzma2EncProps_Init(&builder->props);
+/* A distinct chunk of a dedup archive */
+typedef struct {
+    Byte digest[XXH3_128_DIGEST_SIZE];
+    uint32_t original_size;
+    uint32_t compressed_size;     /* Set by the worker that appends it */
+    uint32_t crc;
+    uint64_t offset;
+} DedupChunk;
+
+/* A new chunk waiting for a worker; the worker frees the data */
+typedef struct {
+    uint32_t id;
+    Byte* data;
+    uint32_t size;
+} DedupJob;
+
+/* Dedup state: the reader owns the table, workers take the queue */
+typedef struct {
+    ArchiveBuilder* builder;
+    uint32_t avg_size;
+    DedupChunk* chunks;           /* Grown by the reader under write_lock */
+    size_t chunk_count;
+    size_t chunk_capacity;
+    uint32_t* slots;              /* Chunk number + 1 by digest, 0 = free */
+    size_t slot_mask;
+    DedupJob* queue;              /* Ring under builder->lock */
+    size_t queue_size;
+    size_t queue_head;
+    size_t queue_count;
+    CSemaphore free_slots;
+    CSemaphore filled;            /* One count per job, and one per worker at the end */
+    CLzma2EncHandle inline_encoder; /* Without workers the reader compresses */
+} DedupStage;
+
+typedef struct {
+    CThread thread;
+    ArchiveBuilder* builder;
+    DedupStage* dedup;            /* NULL = whole files */
+} ArchiveWorker;
+
+/* Helper: LZMA2 properties for a level */
+static void setup_props(CLzma2EncProps* props, SevenZipCompressionLevel level, uint64_t dict_size) {
+    Lzma2EncProps_Init(props);
     switch (level) {
         case SEVENZIP_LEVEL_STORE:
-            builder->props.lzmaProps.level = 0;
-            builder->props.lzmaProps.dictSize = 1 << 16;
+            props->lzmaProps.level = 0;
+            props->lzmaProps.dictSize = 1 << 16;
             break;
         case SEVENZIP_LEVEL_FASTEST:
-            builder->props.lzmaProps.level = 1;
-            builder->props.lzmaProps.dictSize = 1 << 18;
+            props->lzmaProps.level = 1;
+            props->lzmaProps.dictSize = 1 << 18;
             break;
         case SEVENZIP_LEVEL_FAST:
-            builder->props.lzmaProps.level = 3;
-            builder->props.lzmaProps.dictSize = 1 << 20;
+            props->lzmaProps.level = 3;
+            props->lzmaProps.dictSize = 1 << 20;
             break;
         case SEVENZIP_LEVEL_NORMAL:
-            builder->props.lzmaProps.level = 5;
-            builder->props.lzmaProps.dictSize = 1 << 23;
-            builder->props.numBlockThreads_Max = 2;
+            props->lzmaProps.level = 5;
+            props->lzmaProps.dictSize = 1 << 23;
             break;
         case SEVENZIP_LEVEL_MAXIMUM:
-            builder->props.lzmaProps.level = 7;
-            builder->props.lzmaProps.dictSize = 1 << 25;
-            builder->props.numBlockThreads_Max = 2;
+            props->lzmaProps.level = 7;
+            props->lzmaProps.dictSize = 1 << 25;
             break;
         case SEVENZIP_LEVEL_ULTRA:
-            builder->props.lzmaProps.level = 9;
-            builder->props.lzmaProps.dictSize = 1 << 26;
-            builder->props.numBlockThreads_Max = 2;
+            props->lzmaProps.level = 9;
+            props->lzmaProps.dictSize = 1 << 26;
             break;
         default:
-            builder->props.lzmaProps.level = 5;
-            builder->props.lzmaProps.dictSize = 1 << 23;
-            builder->props.numBlockThreads_Max = 1;
+            props->lzmaProps.level = 5;
+            props->lzmaProps.dictSize = 1 << 23;
     }
-    Lzma2EncProps_Normalize(&builder->props);
-    
-    return builder;
-}
-
-/* Helper: Free archive builder */
-static void free_archive_builder(ArchiveBuilder* builder) {
-    if (!builder) return;
-    
-    for (size_t i = 0; i < builder->entry_count; i++) {
-        if (builder->entries[i].name) free(builder->entries[i].name);
-        if (builder->entries[i].compressed_data) free(builder->entries[i].compressed_data);
+    if (dict_size > 0) {
+        props->lzmaProps.dictSize = (UInt32)(dict_size < ((uint64_t)3 << 29) ? dict_size : ((uint64_t)3 << 29));
     }
-    
-    if (builder->entries) free(builder->entries);
-    free(builder);
 }
 
-/* Helper: Compress file data using LZMA2 */
-static SevenZipErrorCode compress_file_data(
-    const unsigned char* input_data,
-    size_t input_size,
-    unsigned char** output_data,
-    size_t* output_size,
-    const CLzma2EncProps* props
+/* Helper: Record an input file (size and metadata; the data is read by a worker) */
+static SevenZipErrorCode add_file_entry(
+    ArchiveFileEntry* entry,
+    const char* file_path,
+    const char* archive_name
 ) {
-    CLzma2EncHandle encoder = Lzma2Enc_Create(&g_Alloc, &g_Alloc);
-    if (!encoder) {
+    /* Get file info */
+    struct STAT st;
+    if (STAT(file_path, &st) != 0) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        return SEVENZIP_ERROR_INVALID_PARAM; /* Only regular files for now */
+    }
+
+    size_t name_len = strlen(archive_name);
+    if (name_len > 0xFFFF) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    entry->name = mem_strdup(SEVENZIP_MEM_NAMES, archive_name);
+    if (!entry->name) {
         return SEVENZIP_ERROR_MEMORY;
     }
-    
-    SRes res = Lzma2Enc_SetProps(encoder, props);
+    entry->path = file_path;
+    entry->original_size = (uint64_t)st.st_size;
+    entry->timestamp = (uint64_t)st.st_mtime;
+    entry->attributes = (uint32_t)st.st_mode;
+    return SEVENZIP_OK;
+}
+
+/* Helper: Whole file contents, in place when the file is mapped
+ * @return The data (*owned set if it must be freed), NULL on failure */
+static const Byte* load_file(PackedInput* in, uint64_t size, Byte** owned, SevenZipErrorCode* error) {
+    *owned = NULL;
+    if (size == 0) return (const Byte*)"";
+    if (size != (size_t)size) {
+        *error = SEVENZIP_ERROR_MEMORY;
+        return NULL;
+    }
+
+    const Byte* data;
+    size_t got = packed_input_peek(in, &data);
+    if (got == size) return data;  /* Mapped */
+
+    Byte* buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, (size_t)size);
+    if (!buf) {
+        *error = SEVENZIP_ERROR_MEMORY;
+        return NULL;
+    }
+    size_t pos = 0;
+    while (got > 0 && pos < size) {
+        if (got > size - pos) got = (size_t)(size - pos);
+        memcpy(buf + pos, data, got);
+        packed_input_consume(in, got);
+        pos += got;
+        got = packed_input_peek(in, &data);
+    }
+    if (pos != size) {  /* File changed size since it was listed */
+        mem_free(buf);
+        *error = SEVENZIP_ERROR_OPEN_FILE;
+        return NULL;
+    }
+    *owned = buf;
+    return buf;
+}
+
+/* Helper: Property byte and LZMA2 stream of `data` in a new buffer */
+static SevenZipErrorCode encode_block(
+    ArchiveBuilder* builder,
+    CLzma2EncHandle encoder,
+    const Byte* data,
+    size_t size,
+    Byte** out,
+    size_t* out_total
+) {
+    /* Dictionary no larger than the data needs */
+    CLzma2EncProps props = builder->props;
+    props.lzmaProps.reduceSize = size;
+    SRes res = Lzma2Enc_SetProps(encoder, &props);
     if (res != SZ_OK) {
-        Lzma2Enc_Destroy(encoder);
         return SEVENZIP_ERROR_COMPRESS;
     }
-    
-    /* Allocate output buffer */
-    size_t out_buf_size = input_size + input_size / 3 + 128;
-    unsigned char* out_buf = (unsigned char*)malloc(out_buf_size);
+
+    size_t out_buf_size = 1 + size + size / 3 + 128;
+    Byte* out_buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, out_buf_size);
     if (!out_buf) {
-        Lzma2Enc_Destroy(encoder);
         return SEVENZIP_ERROR_MEMORY;
     }
-    
-    /* Compress */
-    size_t out_size = out_buf_size;
-    res = Lzma2Enc_Encode2(
-        encoder,
-        NULL, out_buf, &out_size,
-        NULL, input_data, input_size,
-        NULL
-    );
-    
-    Lzma2Enc_Destroy(encoder);
-    
+    out_buf[0] = Lzma2Enc_WriteProperties(encoder);
+    size_t out_size = out_buf_size - 1;
+    res = Lzma2Enc_Encode2(encoder, NULL, out_buf + 1, &out_size, NULL, data, size, NULL);
     if (res != SZ_OK) {
-        free(out_buf);
-        return SEVENZIP_ERROR_COMPRESS;
+        mem_free(out_buf);
+        return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_COMPRESS;
     }
-    
-    *output_data = out_buf;
-    *output_size = out_size;
+    *out = out_buf;
+    *out_total = 1 + out_size;
     return SEVENZIP_OK;
 }
 
-/* Helper: Add file to archive */
-static SevenZipErrorCode add_file_to_archive(
+/* Helper: Append a block at the end of the data written so far */
+static SevenZipErrorCode append_block(ArchiveBuilder* builder, const Byte* block, size_t size,
+                                      uint64_t* offset) {
+    SevenZipErrorCode result = SEVENZIP_OK;
+    CriticalSection_Enter(&builder->write_lock);
+    *offset = builder->file_pos;
+    if (fwrite(block, 1, size, builder->file) != size) {
+        result = SEVENZIP_ERROR_COMPRESS;
+    }
+    builder->file_pos += size;
+    CriticalSection_Leave(&builder->write_lock);
+    return result;
+}
+
+/* Helper: Compress one file and append its block to the archive */
+static SevenZipErrorCode compress_entry(
     ArchiveBuilder* builder,
-    const char* file_path,
-    const char* archive_name
+    CLzma2EncHandle encoder,
+    ArchiveFileEntry* entry
 ) {
-    /* Get file info */
-    struct STAT st;
-    if (STAT(file_path, &st) != 0) {
+    PackedInput in;
+    if (!packed_input_open(&in, entry->path)) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
-    
-    if (!S_ISREG(st.st_mode)) {
-        return SEVENZIP_ERROR_INVALID_PARAM; /* Only regular files for now */
+
+    Byte* owned = NULL;
+    SevenZipErrorCode result = SEVENZIP_OK;
+    const Byte* data = load_file(&in, entry->original_size, &owned, &result);
+    if (!data) {
+        packed_input_close(&in);
+        return result;
     }
-    
-    /* CRITICAL: Check file size to prevent memory exhaustion */
-    /* Files > 1GB should use streaming API instead */
-    #define MAX_SAFE_FILE_SIZE (1024ULL * 1024 * 1024)  /* 1 GB */
-    if ((uint64_t)st.st_size > MAX_SAFE_FILE_SIZE) {
-        fprintf(stderr, "WARNING: File '%s' is %.2f GB\n", 
-                file_path, (double)st.st_size / 1e9);
-        fprintf(stderr, "WARNING: This function loads entire files into memory!\n");
-        fprintf(stderr, "WARNING: Use sevenzip_create_7z_streaming() for large files.\n");
-        /* Continue anyway, but warn user */
-    }
-    
-    /* Read file */
-    FILE* f = fopen(file_path, "rb");
-    if (!f) {
-        return SEVENZIP_ERROR_OPEN_FILE;
+    size_t size = (size_t)entry->original_size;
+    entry->crc = CrcCalc(data, size);
+
+    Byte* out_buf = NULL;
+    size_t out_size = 0;
+    result = encode_block(builder, encoder, data, size, &out_buf, &out_size);
+
+    /* The input is no longer needed once the block is encoded */
+    mem_free(owned);
+    packed_input_close(&in);
+
+    if (result == SEVENZIP_OK) {
+        entry->compressed_size = out_size;
+        result = append_block(builder, out_buf, out_size, &entry->offset);
     }
-    
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    
-    if (file_size < 0) {
-        fclose(f);
-        return SEVENZIP_ERROR_OPEN_FILE;
+    mem_free(out_buf);
+    return result;
+}
+
+/* Helper: Compress entries until none are left or one failed */
+static void archive_worker_run(ArchiveBuilder* builder, CLzma2EncHandle encoder) {
+    for (;;) {
+        CriticalSection_Enter(&builder->lock);
+        size_t i = builder->next_entry;
+        int done = builder->error_code != SEVENZIP_OK || i >= builder->entry_count;
+        if (!done) builder->next_entry++;
+        CriticalSection_Leave(&builder->lock);
+        if (done) break;
+
+        SevenZipErrorCode result = encoder
+            ? compress_entry(builder, encoder, &builder->entries[i])
+            : SEVENZIP_ERROR_MEMORY;
+
+        CriticalSection_Enter(&builder->lock);
+        if (result != SEVENZIP_OK) {
+            if (builder->error_code == SEVENZIP_OK) builder->error_code = result;
+        } else {
+            builder->entries_done++;
+            if (builder->progress_callback) {
+                builder->progress_callback(builder->entries_done, builder->entry_count,
+                                           builder->user_data);
+            }
+        }
+        CriticalSection_Leave(&builder->lock);
+        if (result != SEVENZIP_OK) break;
     }
-    
-    unsigned char* file_data = (unsigned char*)malloc(file_size);
-    if (!file_data) {
-        fclose(f);
-        fprintf(stderr, "ERROR: Failed to allocate %ld bytes for file data\n", file_size);
-        fprintf(stderr, "ERROR: File too large for in-memory compression.\n");
-        fprintf(stderr, "ERROR: Use sevenzip_create_7z_streaming() instead.\n");
-        return SEVENZIP_ERROR_MEMORY;
+}
+
+/* Helper: Record the first error of the run */
+static void builder_fail(ArchiveBuilder* builder, SevenZipErrorCode result) {
+    CriticalSection_Enter(&builder->lock);
+    if (builder->error_code == SEVENZIP_OK) builder->error_code = result;
+    CriticalSection_Leave(&builder->lock);
+}
+
+/* Helper: Compress a new chunk and append its block */
+static SevenZipErrorCode compress_chunk(DedupStage* d, CLzma2EncHandle encoder, const DedupJob* job) {
+    ArchiveBuilder* builder = d->builder;
+    uint32_t crc = CrcCalc(job->data, job->size);
+    Byte* out_buf = NULL;
+    size_t out_size = 0;
+    SevenZipErrorCode result = encode_block(builder, encoder, job->data, job->size, &out_buf, &out_size);
+    uint64_t offset = 0;
+    if (result == SEVENZIP_OK) {
+        result = append_block(builder, out_buf, out_size, &offset);
     }
-    
-    if (fread(file_data, 1, file_size, f) != (size_t)file_size) {
-        free(file_data);
-        fclose(f);
-        return SEVENZIP_ERROR_OPEN_FILE;
+    mem_free(out_buf);
+    if (result == SEVENZIP_OK) {
+        /* The reader may be growing the table */
+        CriticalSection_Enter(&builder->write_lock);
+        DedupChunk* chunk = &d->chunks[job->id];
+        chunk->offset = offset;
+        chunk->compressed_size = (uint32_t)out_size;
+        chunk->crc = crc;
+        CriticalSection_Leave(&builder->write_lock);
+    }
+    return result;
+}
+
+/* Helper: Compress queued chunks until the reader is done; after a
+ * failure the queue is still emptied, so the reader never waits forever */
+static void dedup_worker_run(DedupStage* d, CLzma2EncHandle encoder) {
+    ArchiveBuilder* builder = d->builder;
+    for (;;) {
+        Semaphore_Wait(&d->filled);
+        CriticalSection_Enter(&builder->lock);
+        if (d->queue_count == 0) {
+            CriticalSection_Leave(&builder->lock);
+            break;
+        }
+        DedupJob job = d->queue[d->queue_head];
+        d->queue_head = (d->queue_head + 1) % d->queue_size;
+        d->queue_count--;
+        int failed = builder->error_code != SEVENZIP_OK;
+        CriticalSection_Leave(&builder->lock);
+        Semaphore_Release1(&d->free_slots);
+
+        if (!failed) {
+            SevenZipErrorCode result = encoder ? compress_chunk(d, encoder, &job) : SEVENZIP_ERROR_MEMORY;
+            if (result != SEVENZIP_OK) builder_fail(builder, result);
+        }
+        mem_free(job.data);
+    }
+}
+
+static THREAD_FUNC_DECL ArchiveWorker_Thread(void* arg) {
+    ArchiveWorker* w = (ArchiveWorker*)arg;
+    thread_sched_enter();
+    ThreadPlacer placer;
+    CLzma2EncHandle encoder = thread_placer_init(&placer, SEVENZIP_NUMA_OFF)
+        ? Lzma2Enc_Create(&placer.small, &placer.big)
+        : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    if (w->dedup) {
+        dedup_worker_run(w->dedup, encoder);
+    } else {
+        archive_worker_run(w->builder, encoder);
+    }
+    if (encoder) Lzma2Enc_Destroy(encoder);
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Helper: Grow the digest table to twice its size */
+static int dedup_rehash(DedupStage* d) {
+    size_t size = d->slot_mask ? (d->slot_mask + 1) * 2 : 4096;
+    uint32_t* slots = (uint32_t*)mem_calloc(SEVENZIP_MEM_OTHER, size, sizeof(uint32_t));
+    if (!slots) return 0;
+    for (size_t i = 0; i < d->chunk_count; i++) {
+        size_t slot = GetUi32(d->chunks[i].digest) & (size - 1);
+        while (slots[slot]) slot = (slot + 1) & (size - 1);
+        slots[slot] = (uint32_t)i + 1;
+    }
+    mem_free(d->slots);
+    d->slots = slots;
+    d->slot_mask = size - 1;
+    return 1;
+}
+
+/* Helper: Append a chunk number to the file's list */
+static int dedup_add_ref(ArchiveFileEntry* entry, uint32_t id) {
+    if (entry->chunk_count == entry->chunk_capacity) {
+        size_t cap = entry->chunk_capacity ? entry->chunk_capacity * 2 : 16;
+        if (cap > 0xFFFFFFFFu) return 0;
+        uint32_t* chunks = (uint32_t*)mem_realloc(SEVENZIP_MEM_HEADER, entry->chunks, cap * sizeof(uint32_t));
+        if (!chunks) return 0;
+        entry->chunks = chunks;
+        entry->chunk_capacity = cap;
+    }
+    entry->chunks[entry->chunk_count++] = id;
+    return 1;
+}
+
+/* Helper: A whole chunk of `entry`, in *stage: a repeat is only referenced,
+ * a new chunk takes the buffer to a worker and *stage gets a fresh one */
+static SevenZipErrorCode dedup_add_chunk(DedupStage* d, ArchiveFileEntry* entry, Byte** stage,
+                                         uint32_t size, uint32_t max_size) {
+    Xxh3State xs;
+    Byte digest[XXH3_128_DIGEST_SIZE];
+    xxh3_128_init(&xs);
+    xxh3_128_update(&xs, *stage, size);
+    xxh3_128_final(&xs, digest);
+
+    size_t slot = GetUi32(digest) & d->slot_mask;
+    while (d->slots[slot]) {
+        uint32_t id = d->slots[slot] - 1;
+        if (d->chunks[id].original_size == size && memcmp(d->chunks[id].digest, digest, sizeof(digest)) == 0) {
+            return dedup_add_ref(entry, id) ? SEVENZIP_OK : SEVENZIP_ERROR_MEMORY;
+        }
+        slot = (slot + 1) & d->slot_mask;
     }
-    fclose(f);
-    
-    /* Compress file data */
-    unsigned char* compressed_data = NULL;
-    size_t compressed_size = 0;
-    SevenZipErrorCode result = compress_file_data(
-        file_data, file_size,
-        &compressed_data, &compressed_size,
-        &builder->props
-    );
-    
-    free(file_data);
-    
+
+    if (d->chunk_count >= 0xFFFFFFFEu) return SEVENZIP_ERROR_INVALID_PARAM;
+    if (d->chunk_count == d->chunk_capacity) {
+        size_t cap = d->chunk_capacity ? d->chunk_capacity * 2 : 1024;
+        CriticalSection_Enter(&d->builder->write_lock);
+        DedupChunk* chunks = (DedupChunk*)mem_realloc(SEVENZIP_MEM_HEADER, d->chunks, cap * sizeof(DedupChunk));
+        if (chunks) {
+            d->chunks = chunks;
+            d->chunk_capacity = cap;
+        }
+        CriticalSection_Leave(&d->builder->write_lock);
+        if (!chunks) return SEVENZIP_ERROR_MEMORY;
+    }
+    uint32_t id = (uint32_t)d->chunk_count;
+    DedupChunk* chunk = &d->chunks[id];
+    memset(chunk, 0, sizeof(*chunk));
+    memcpy(chunk->digest, digest, sizeof(digest));
+    chunk->original_size = size;
+    d->chunk_count++;
+    d->slots[slot] = id + 1;
+    if (!dedup_add_ref(entry, id)) return SEVENZIP_ERROR_MEMORY;
+    if (d->chunk_count * 2 > d->slot_mask + 1 && !dedup_rehash(d)) return SEVENZIP_ERROR_MEMORY;
+
+    DedupJob job = { id, *stage, size };
+    if (d->inline_encoder) {
+        return compress_chunk(d, d->inline_encoder, &job);
+    }
+    Semaphore_Wait(&d->free_slots);
+    CriticalSection_Enter(&d->builder->lock);
+    SevenZipErrorCode result = d->builder->error_code;
+    if (result == SEVENZIP_OK) {
+        d->queue[(d->queue_head + d->queue_count) % d->queue_size] = job;
+        d->queue_count++;
+    }
+    CriticalSection_Leave(&d->builder->lock);
     if (result != SEVENZIP_OK) {
+        Semaphore_Release1(&d->free_slots);
         return result;
     }
-    
-    /* Expand entries array if needed */
-    if (builder->entry_count >= builder->entry_capacity) {
-        size_t new_capacity = builder->entry_capacity * 2;
-        ArchiveFileEntry* new_entries = (ArchiveFileEntry*)realloc(
-            builder->entries,
-            new_capacity * sizeof(ArchiveFileEntry)
-        );
-        if (!new_entries) {
-            free(compressed_data);
-            return SEVENZIP_ERROR_MEMORY;
-        }
-        builder->entries = new_entries;
-        builder->entry_capacity = new_capacity;
-    }
-    
-    /* Add entry */
-    ArchiveFileEntry* entry = &builder->entries[builder->entry_count];
-    memset(entry, 0, sizeof(ArchiveFileEntry));
-    
-    entry->name = strdup(archive_name);
-    entry->original_size = file_size;
-    entry->compressed_size = compressed_size;
-    entry->compressed_data = compressed_data;
-    entry->timestamp = (uint64_t)st.st_mtime;
-    entry->attributes = (uint32_t)st.st_mode;
-    
-    builder->entry_count++;
-    
-    return SEVENZIP_OK;
+    Semaphore_Release1(&d->filled);
+    *stage = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, max_size);
+    return *stage ? SEVENZIP_OK : SEVENZIP_ERROR_MEMORY;
 }
 
-/* Helper: Write archive to file */
-static SevenZipErrorCode write_archive(
-    ArchiveBuilder* builder,
-    const char* archive_path,
-    SevenZipProgressCallback progress_callback,
-    void* user_data
-) {
-    FILE* f = fopen(archive_path, "wb");
-    if (!f) {
+/* Helper: Cut one file into chunks, its CRC32 on the way */
+static SevenZipErrorCode dedup_file(DedupStage* d, ArchiveFileEntry* entry, Byte** stage) {
+    PackedInput in;
+    if (!packed_input_open(&in, entry->path)) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
-    
-    /* Write magic and version */
-    fwrite(ARCHIVE_MAGIC, 1, 4, f);
-    fwrite(&(char){ARCHIVE_VERSION}, 1, 1, f);
-    
-    /* Write file count */
-    uint32_t file_count = (uint32_t)builder->entry_count;
-    fwrite(&file_count, 4, 1, f);
-    
-    /* Calculate offsets */
-    uint64_t current_offset = 0;
+    CdcChunker chunker;
+    cdc_chunker_init(&chunker, d->avg_size);
+
+    SevenZipErrorCode result = SEVENZIP_OK;
+    UInt32 crc = CRC_INIT_VAL;
+    uint64_t total = 0;
+    uint32_t length = 0;
+    const Byte* data;
+    size_t got;
+    while (result == SEVENZIP_OK && (got = packed_input_peek(&in, &data)) > 0) {
+        size_t pos = 0;
+        while (pos < got && result == SEVENZIP_OK) {
+            int cut;
+            size_t n = cdc_chunker_scan(&chunker, data + pos, got - pos, &cut);
+            memcpy(*stage + length, data + pos, n);
+            length += (uint32_t)n;
+            pos += n;
+            if (cut) {
+                result = dedup_add_chunk(d, entry, stage, length, chunker.max_size);
+                length = 0;
+            }
+        }
+        crc = CrcUpdate(crc, data, got);
+        total += got;
+        packed_input_consume(&in, got);
+    }
+    if (result == SEVENZIP_OK && length > 0) {
+        result = dedup_add_chunk(d, entry, stage, length, chunker.max_size);
+    }
+    /* A file that changed size since it was listed */
+    if (result == SEVENZIP_OK && (in.read_error || total != entry->original_size)) {
+        result = SEVENZIP_ERROR_OPEN_FILE;
+    }
+    entry->crc = CRC_GET_DIGEST(crc);
+    packed_input_close(&in);
+    return result;
+}
+
+/* Helper: Chunk every file on this thread while `num_threads` workers
+ * compress the new chunks (inline without workers) */
+static SevenZipErrorCode dedup_run(ArchiveBuilder* builder, DedupStage* d, int num_threads) {
+    d->builder = builder;
+    d->queue_size = (size_t)num_threads * DEDUP_QUEUE_PER_WORKER;
+    d->queue = (DedupJob*)mem_alloc(SEVENZIP_MEM_OTHER, d->queue_size * sizeof(DedupJob));
+    CdcChunker probe;
+    cdc_chunker_init(&probe, d->avg_size);
+    Byte* stage = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, probe.max_size);
+    Semaphore_Construct(&d->free_slots);
+    Semaphore_Construct(&d->filled);
+    if (!d->queue || !stage || !dedup_rehash(d) ||
+        Semaphore_Create(&d->free_slots, (UInt32)d->queue_size, (UInt32)d->queue_size) != 0 ||
+        Semaphore_Create(&d->filled, 0, (UInt32)(d->queue_size + (size_t)num_threads)) != 0) {
+        if (Semaphore_IsCreated(&d->free_slots)) Semaphore_Close(&d->free_slots);
+        mem_free(stage);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    /* Threads that fail to start leave their share to the others */
+    ArchiveWorker workers[ARCHIVE_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < num_threads; i++) {
+        ArchiveWorker* w = &workers[started];
+        w->builder = builder;
+        w->dedup = d;
+        Thread_CONSTRUCT(&w->thread)
+        if (Thread_Create(&w->thread, ArchiveWorker_Thread, w) != 0) break;
+        started++;
+    }
+    ThreadPlacer placer;
+    if (started == 0) {
+        d->inline_encoder = thread_placer_init(&placer, SEVENZIP_NUMA_OFF)
+            ? Lzma2Enc_Create(&placer.small, &placer.big)
+            : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+        if (!d->inline_encoder) builder_fail(builder, SEVENZIP_ERROR_MEMORY);
+    }
+
+    for (size_t i = 0; i < builder->entry_count; i++) {
+        CriticalSection_Enter(&builder->lock);
+        SevenZipErrorCode result = builder->error_code;
+        CriticalSection_Leave(&builder->lock);
+        if (result == SEVENZIP_OK) result = dedup_file(d, &builder->entries[i], &stage);
+        if (result != SEVENZIP_OK) {
+            builder_fail(builder, result);
+            break;
+        }
+        CriticalSection_Enter(&builder->lock);
+        builder->entries_done++;
+        if (builder->progress_callback) {
+            builder->progress_callback(builder->entries_done, builder->entry_count, builder->user_data);
+        }
+        CriticalSection_Leave(&builder->lock);
+    }
+
+    /* One wake-up per worker finds the queue empty once it is drained */
+    if (started > 0) Semaphore_ReleaseN(&d->filled, (UInt32)started);
+    for (int i = 0; i < started; i++) {
+        Thread_Wait_Close(&workers[i].thread);
+    }
+    if (d->inline_encoder) Lzma2Enc_Destroy(d->inline_encoder);
+    Semaphore_Close(&d->free_slots);
+    Semaphore_Close(&d->filled);
+    mem_free(stage);
+    return builder->error_code;
+}
+
+/* Helper: Write index and trailer after the data */
+static SevenZipErrorCode write_index(ArchiveBuilder* builder) {
+    size_t index_size = 4;
     for (size_t i = 0; i < builder->entry_count; i++) {
-        builder->entries[i].offset = current_offset;
-        current_offset += builder->entries[i].compressed_size;
+        index_size += ARCHIVE_ENTRY_FIXED_SIZE + strlen(builder->entries[i].name);
+    }
+
+    Byte* index = (Byte*)mem_alloc(SEVENZIP_MEM_HEADER, index_size + ARCHIVE_TRAILER_SIZE);
+    if (!index) {
+        return SEVENZIP_ERROR_MEMORY;
     }
-    
-    /* Write file entries */
+
+    Byte* p = index;
+    SetUi32(p, (UInt32)builder->entry_count);
+    p += 4;
     for (size_t i = 0; i < builder->entry_count; i++) {
-        ArchiveFileEntry* entry = &builder->entries[i];
-        
+        const ArchiveFileEntry* entry = &builder->entries[i];
+
         /* Name length and name */
-        uint16_t name_len = (uint16_t)strlen(entry->name);
-        fwrite(&name_len, 2, 1, f);
-        fwrite(entry->name, 1, name_len, f);
-        
-        /* Sizes and offset */
-        fwrite(&entry->original_size, 8, 1, f);
-        fwrite(&entry->compressed_size, 8, 1, f);
-        fwrite(&entry->offset, 8, 1, f);
-        fwrite(&entry->timestamp, 8, 1, f);
-        fwrite(&entry->attributes, 4, 1, f);
-    }
-    
-    /* Write compressed data */
+        size_t name_len = strlen(entry->name);
+        SetUi16(p, (UInt16)name_len);
+        memcpy(p + 2, entry->name, name_len);
+        p += 2 + name_len;
+
+        /* Sizes, offset and metadata */
+        SetUi64(p, entry->original_size);
+        SetUi64(p + 8, entry->compressed_size);
+        SetUi64(p + 16, entry->offset);
+        SetUi64(p + 24, entry->timestamp);
+        SetUi32(p + 32, entry->attributes);
+        SetUi32(p + 36, entry->crc);
+        p += 40;
+    }
+
+    /* Trailer */
+    SetUi64(p, builder->file_pos);
+    SetUi64(p + 8, (UInt64)index_size);
+    SetUi32(p + 16, CrcCalc(index, index_size));
+    memcpy(p + 20, ARCHIVE_INDEX_MAGIC, 4);
+
+    size_t total = index_size + ARCHIVE_TRAILER_SIZE;
+    SevenZipErrorCode result = fwrite(index, 1, total, builder->file) == total
+        ? SEVENZIP_OK : SEVENZIP_ERROR_COMPRESS;
+    mem_free(index);
+    return result;
+}
+
+/* Helper: Write the version 3 index, chunks then files, and the trailer */
+static SevenZipErrorCode write_dedup_index(ArchiveBuilder* builder, const DedupStage* d) {
+    size_t index_size = 8 + d->chunk_count * DEDUP_CHUNK_ENTRY_SIZE;
     for (size_t i = 0; i < builder->entry_count; i++) {
-        fwrite(builder->entries[i].compressed_data, 1, 
-               builder->entries[i].compressed_size, f);
-        
-        if (progress_callback) {
-            progress_callback(i + 1, builder->entry_count, user_data);
+        index_size += DEDUP_FILE_FIXED_SIZE + strlen(builder->entries[i].name) +
+                      builder->entries[i].chunk_count * 4;
+    }
+
+    Byte* index = (Byte*)mem_alloc(SEVENZIP_MEM_HEADER, index_size + ARCHIVE_TRAILER_SIZE);
+    if (!index) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    Byte* p = index;
+    SetUi32(p, (UInt32)d->chunk_count);
+    p += 4;
+    for (size_t i = 0; i < d->chunk_count; i++) {
+        const DedupChunk* chunk = &d->chunks[i];
+        SetUi64(p, chunk->offset);
+        SetUi32(p + 8, chunk->compressed_size);
+        SetUi32(p + 12, chunk->original_size);
+        SetUi32(p + 16, chunk->crc);
+        memcpy(p + 20, chunk->digest, XXH3_128_DIGEST_SIZE);
+        p += DEDUP_CHUNK_ENTRY_SIZE;
+    }
+
+    SetUi32(p, (UInt32)builder->entry_count);
+    p += 4;
+    for (size_t i = 0; i < builder->entry_count; i++) {
+        const ArchiveFileEntry* entry = &builder->entries[i];
+        size_t name_len = strlen(entry->name);
+        SetUi16(p, (UInt16)name_len);
+        memcpy(p + 2, entry->name, name_len);
+        p += 2 + name_len;
+
+        SetUi64(p, entry->original_size);
+        SetUi64(p + 8, entry->timestamp);
+        SetUi32(p + 16, entry->attributes);
+        SetUi32(p + 20, entry->crc);
+        SetUi32(p + 24, (UInt32)entry->chunk_count);
+        p += 28;
+        for (size_t c = 0; c < entry->chunk_count; c++) {
+            SetUi32(p, entry->chunks[c]);
+            p += 4;
         }
     }
-    
-    fclose(f);
-    return SEVENZIP_OK;
+
+    /* Trailer */
+    SetUi64(p, builder->file_pos);
+    SetUi64(p + 8, (UInt64)index_size);
+    SetUi32(p + 16, CrcCalc(index, index_size));
+    memcpy(p + 20, ARCHIVE_INDEX_MAGIC, 4);
+
+    size_t total = index_size + ARCHIVE_TRAILER_SIZE;
+    SevenZipErrorCode result = fwrite(index, 1, total, builder->file) == total
+        ? SEVENZIP_OK : SEVENZIP_ERROR_COMPRESS;
+    mem_free(index);
+    return result;
 }
 
-/* Main function: Create multi-file archive */
-SevenZipErrorCode sevenzip_create_archive(
+/* Main function: Create multi-file archive with options */
+SevenZipErrorCode sevenzip_create_archive_with_options(
     const char* archive_path,
     const char** input_paths,
     SevenZipCompressionLevel level,
-    const char* password,
+    const SevenZipCompressOptions* options,
     SevenZipProgressCallback progress_callback,
     void* user_data
 ) {
     if (!archive_path || !input_paths) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
-    
+    if (options && options->password && options->password[0]) {
+        return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+    }
+
     /* Count input files */
     size_t num_inputs = 0;
     while (input_paths[num_inputs] != NULL) {
         num_inputs++;
     }
-    
-    if (num_inputs == 0) {
+
+    if (num_inputs == 0 || num_inputs > 0xFFFFFFFFu) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
-    
+    global_tables_init();
+
     /* Create archive builder */
-    ArchiveBuilder* builder = create_archive_builder(level);
-    if (!builder) {
+    ArchiveBuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.entries = (ArchiveFileEntry*)mem_calloc(SEVENZIP_MEM_HEADER, num_inputs, sizeof(ArchiveFileEntry));
+    if (!builder.entries) {
         return SEVENZIP_ERROR_MEMORY;
     }
-    
-    /* Add all files */
+    builder.progress_callback = progress_callback;
+    builder.user_data = user_data;
+
+    /* List all files */
     SevenZipErrorCode result = SEVENZIP_OK;
-    for (size_t i = 0; i < num_inputs; i++) {
+    for (size_t i = 0; i < num_inputs && result == SEVENZIP_OK; i++) {
         /* Extract filename from path */
         const char* filename = strrchr(input_paths[i], PATH_SEPARATOR);
         if (filename) {
@@ -379,17 +819,120 @@ SevenZipErrorCode sevenzip_create_archive(
         } else {
             filename = input_paths[i];
         }
-        
-        result = add_file_to_archive(builder, input_paths[i], filename);
+
+        result = add_file_entry(&builder.entries[i], input_paths[i], filename);
+        builder.entry_count = i + 1;
+    }
+
+    /* Files compressed at once, and encoder threads of each */
+    int num_threads = options ? options->num_threads : ARCHIVE_DEFAULT_THREADS;
+    ThreadLease lease;
+    num_threads = thread_lease_acquire(&lease, num_threads, options ? options->thread_weight : 0);
+    if (num_threads > ARCHIVE_MAX_THREADS) num_threads = ARCHIVE_MAX_THREADS;
+    int num_workers = (size_t)num_threads < num_inputs ? num_threads : (int)num_inputs;
+    setup_props(&builder.props, level, options ? options->dict_size : 0);
+    builder.props.numTotalThreads = num_threads / num_workers;
+
+    /* Chunks are small: one encoder thread each, every thread a worker */
+    DedupStage dedup;
+    memset(&dedup, 0, sizeof(dedup));
+    dedup.avg_size = options ? options->dedup_chunk_size : 0;
+    if (dedup.avg_size) builder.props.numTotalThreads = 1;
+
+    if (result == SEVENZIP_OK) {
+        builder.file = fopen(archive_path, "wb");
+        if (!builder.file) {
+            result = SEVENZIP_ERROR_OPEN_FILE;
+        } else if (CriticalSection_Init(&builder.lock) != 0) {
+            fclose(builder.file);
+            builder.file = NULL;
+            result = SEVENZIP_ERROR_MEMORY;
+        } else if (CriticalSection_Init(&builder.write_lock) != 0) {
+            CriticalSection_Delete(&builder.lock);
+            fclose(builder.file);
+            builder.file = NULL;
+            result = SEVENZIP_ERROR_MEMORY;
+        }
+    }
+
+    if (result == SEVENZIP_OK) {
+        /* Write magic and version */
+        Byte header[ARCHIVE_HEADER_SIZE];
+        memcpy(header, ARCHIVE_MAGIC, 4);
+        header[4] = dedup.avg_size ? ARCHIVE_VERSION_DEDUP : ARCHIVE_VERSION;
+        if (fwrite(header, 1, ARCHIVE_HEADER_SIZE, builder.file) != ARCHIVE_HEADER_SIZE) {
+            result = SEVENZIP_ERROR_COMPRESS;
+        }
+        builder.file_pos = ARCHIVE_HEADER_SIZE;
+        builder.error_code = result;
+
+        if (dedup.avg_size) {
+            if (result == SEVENZIP_OK) {
+                result = dedup_run(&builder, &dedup, num_threads);
+            }
+        } else {
+            /* Threads that fail to start leave their share to the others */
+            ArchiveWorker workers[ARCHIVE_MAX_THREADS];
+            int started = 0;
+            for (int i = 1; i < num_workers; i++) {
+                ArchiveWorker* w = &workers[started];
+                w->builder = &builder;
+                w->dedup = NULL;
+                Thread_CONSTRUCT(&w->thread)
+                if (Thread_Create(&w->thread, ArchiveWorker_Thread, w) != 0) break;
+                started++;
+            }
+
+            ThreadPlacer placer;
+            CLzma2EncHandle encoder = thread_placer_init(&placer, SEVENZIP_NUMA_OFF)
+                ? Lzma2Enc_Create(&placer.small, &placer.big)
+                : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+            archive_worker_run(&builder, encoder);
+            if (encoder) Lzma2Enc_Destroy(encoder);
+
+            for (int i = 0; i < started; i++) {
+                Thread_Wait_Close(&workers[i].thread);
+            }
+            result = builder.error_code;
+        }
+        CriticalSection_Delete(&builder.write_lock);
+        CriticalSection_Delete(&builder.lock);
+
+        if (result == SEVENZIP_OK) {
+            result = dedup.avg_size ? write_dedup_index(&builder, &dedup) : write_index(&builder);
+        }
+        if (fclose(builder.file) != 0 && result == SEVENZIP_OK) {
+            result = SEVENZIP_ERROR_COMPRESS;
+        }
         if (result != SEVENZIP_OK) {
-            free_archive_builder(builder);
-            return result;
+            remove(archive_path);
         }
     }
-    
-    /* Write archive */
-    result = write_archive(builder, archive_path, progress_callback, user_data);
-    
-    free_archive_builder(builder);
+
+    thread_lease_release(&lease);
+    for (size_t i = 0; i < builder.entry_count; i++) {
+        mem_free(builder.entries[i].name);
+        mem_free(builder.entries[i].chunks);
+    }
+    mem_free(builder.entries);
+    mem_free(dedup.chunks);
+    mem_free(dedup.slots);
+    mem_free(dedup.queue);
     return result;
 }
+
+/* Main function: Create multi-file archive */
+SevenZipErrorCode sevenzip_create_archive(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const char* password,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipCompressOptions options;
+    memset(&options, 0, sizeof(options));
+    options.password = password;
+    return sevenzip_create_archive_with_options(archive_path, input_paths, level, &options,
+                                                progress_callback, user_data);
+}
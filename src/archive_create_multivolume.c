@@ -8,12 +8,56 @@
  * Compatible with 7-Zip for extraction.
  */
 
+/* O_DIRECT is only declared by glibc's <fcntl.h> with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
 #include "../include/7z_ffi.h"
 #include "../lzma/C/7zFile.h"
 #include "../lzma/C/7zTypes.h"
 #include "../lzma/C/7zCrc.h"
+#include "file_digest.h"
+#include "parity_volumes.h"
 #include "../lzma/C/Lzma2Enc.h"
 #include "../lzma/C/Alloc.h"
+#include "../lzma/C/Threads.h"
+#include "archive_filters.h"
+#include "archive_header.h"
+#include "create_engine.h"
+#include "name_arena.h"
+#include "snapshot.h"
+#include "archive_index.h"
+#include "stream_layout.h"
+#include "read_hints.h"
+#include "sparse_input.h"
+#include "device_input.h"
+#include "crc_stage.h"
+#include "aes_coder.h"
+#include "ppmd_compress.h"
+#include "entropy_estimate.h"
+#include "zero_runs.h"
+#include "memory_pressure.h"
+#include "throughput_slo.h"
+#include "rate_limit.h"
+#include "write_verify.h"
+#include "mem_alloc.h"
+#include "memory_budget.h"
+#include "lzma2_block_size.h"
+#include "lzma_params.h"
+#include "op_stats.h"
+#include "metrics.h"
+#include "trace.h"
+#include "progress_reporter.h"
+#include "cancel_token.h"
+#include "thread_quota.h"
+#include "thread_placement.h"
+#include "dir_scan.h"
+#include "utf_convert.h"
+#include "global_tables.h"
+#include "xxh3.h"
+#include "small_file_batch.h"
+#include "block_cache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,7 +72,10 @@
 
 #ifdef _WIN32
     #include <windows.h>
+    #include <io.h>
+    #include <fcntl.h>
     #define STAT _stat
+    #define FSEEK64 _fseeki64
     #define PATH_SEP '\\'
     #define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
     #define S_ISDIR(m) (((m) & _S_IFMT) == _S_IFDIR)
@@ -39,10 +86,39 @@
     #include <sys/mman.h>
     #include <fcntl.h>
     #define STAT stat
+    #define FSEEK64 fseeko
     #define PATH_SEP '/'
     #define USE_MMAP 1
 #endif
 
+/* Kernel-side file-to-file copy for stored data (copy_file_range, then sendfile) */
+#if USE_MMAP && defined(__linux__)
+    #include <sys/sendfile.h>
+    #include <sys/syscall.h>
+    #include <errno.h>
+    #define USE_KERNEL_COPY 1
+#else
+    #define USE_KERNEL_COPY 0
+#endif
+
+/* Unbuffered volumes: O_DIRECT and FILE_FLAG_NO_BUFFERING need buffer
+ * addresses, sizes and file offsets aligned to the device block size, so
+ * their output is staged in an aligned buffer. On Windows the volume is
+ * also overlapped: a full buffer is handed to WriteFile and the next one
+ * fills while it is written. macOS only needs F_NOCACHE on an ordinary
+ * buffered stream. */
+#if defined(_WIN32) || defined(O_DIRECT)
+    #define USE_DIRECT_IO 1
+#else
+    #define USE_DIRECT_IO 0
+#endif
+#define DIRECT_IO_ALIGNMENT 4096
+#define DIRECT_BUFFER_SIZE (4 * 1024 * 1024)
+
+/* Headroom over the input size when reserving the space of the last volume
+ * (incompressible data, headers) */
+#define VOLUME_PREALLOC_SLACK (16 * 1024 * 1024)
+
 /* 7z format constants */
 #define k7zSignature_Size 6
 #define k7zStartHeaderSize 32
@@ -64,6 +140,7 @@ typedef enum {
     k7zIdCodersUnpackSize = 0x0C,
     k7zIdNumUnpackStream = 0x0D,
     k7zIdEmptyStream = 0x0E,
+    k7zIdEmptyFile = 0x0F,
     k7zIdName = 0x11,
     k7zIdMTime = 0x14,
     k7zIdWinAttrib = 0x15
@@ -77,16 +154,34 @@ typedef struct {
     uint64_t mtime;
     uint32_t attrib;
     uint32_t crc;
+    uint64_t inode;   /* For options->snapshot_output, 0 = unknown */
+    FileDigestSlot* digest_slot;  /* In ctx.digests, NULL = not computed */
     Byte lzma2_prop;  /* LZMA2 property byte for this file */
     int is_dir;
+    SevenZipFilter filter;  /* Filter for this file's data */
+    int use_ppmd;           /* 1 = PPMd instead of LZMA2 for this file's data */
+    int store;              /* 1 = Copy codec: options->detect_compressed recognized its format */
+    int level;              /* Parsing of this level over the job's encoder (options->entry_policy), 0 = the job's */
+    uint32_t group;         /* Solid group (options->entry_policy) */
+    int device;             /* Block or raw device, read through DeviceInput */
+    int sparse;             /* The scan found holes: extents are looked up when read */
+    uint64_t dev;           /* Device of `inode`, 0 = unknown */
+    int hard_linked;        /* The file has other names (st_nlink > 1) */
 } MV_FileEntry;
 
+/* PPMd model parameters shared by every PPMd folder of an archive */
+typedef struct {
+    unsigned order;
+    UInt32 mem_size;
+} MV_PpmdParams;
+
 /* File list for gathering entries */
 typedef struct {
     MV_FileEntry* entries;
     size_t count;
     size_t capacity;
     uint64_t total_size;
+    NameArena names;  /* Strings of the entries */
 } MV_FileList;
 
 /* Initialize file list */
@@ -95,25 +190,23 @@ static void mv_file_list_init(MV_FileList* list) {
     list->count = 0;
     list->capacity = 0;
     list->total_size = 0;
+    name_arena_init(&list->names);
 }
 
 /* Free file list */
 static void mv_file_list_free(MV_FileList* list) {
-    for (size_t i = 0; i < list->count; i++) {
-        free(list->entries[i].name);
-        free(list->entries[i].full_path);
-    }
-    free(list->entries);
+    name_arena_free(&list->names);
+    mem_free(list->entries);
     list->entries = NULL;
     list->count = 0;
     list->capacity = 0;
 }
 
-/* Add file to list */
-static int mv_file_list_add(MV_FileList* list, const char* full_path, const char* archive_name, uint64_t size, uint64_t mtime, uint32_t attrib) {
+/* Add file (or, with is_dir, directory) to list */
+static int mv_file_list_add(MV_FileList* list, const char* full_path, const char* archive_name, uint64_t size, uint64_t mtime, uint32_t attrib, uint64_t inode, int is_dir) {
     if (list->count >= list->capacity) {
         size_t new_cap = list->capacity == 0 ? 64 : list->capacity * 2;
-        MV_FileEntry* new_entries = (MV_FileEntry*)realloc(list->entries, new_cap * sizeof(MV_FileEntry));
+        MV_FileEntry* new_entries = (MV_FileEntry*)mem_realloc(SEVENZIP_MEM_HEADER, list->entries, new_cap * sizeof(MV_FileEntry));
         if (!new_entries) return 0;
         list->entries = new_entries;
         list->capacity = new_cap;
@@ -121,121 +214,327 @@ static int mv_file_list_add(MV_FileList* list, const char* full_path, const char
     
     MV_FileEntry* entry = &list->entries[list->count];
     memset(entry, 0, sizeof(MV_FileEntry));
-    entry->full_path = strdup(full_path);
-    entry->name = strdup(archive_name);
+    if (!name_arena_add_entry(&list->names, full_path, archive_name,
+                              &entry->full_path, &entry->name)) {
+        return 0;
+    }
     entry->size = size;
     entry->mtime = mtime;
     entry->attrib = attrib;
-    entry->is_dir = 0;
+    entry->inode = inode;
+    entry->is_dir = is_dir;
     
     list->count++;
     list->total_size += size;
     return 1;
 }
 
-/* Forward declaration for recursion */
-static int mv_gather_directory(const char* dir_path, const char* base_name, MV_FileList* list);
+/* Where gathered files go: with a base snapshot, the files it has
+ * unchanged are left out of the archive, and only listed (in `unchanged`)
+ * when a new snapshot is written */
+typedef struct {
+    MV_FileList* list;
+    MV_FileList* unchanged;    /* NULL = drop unchanged files */
+    const Snapshot* base;      /* NULL = archive every file */
+    const NameFilter* filter;  /* Scan patterns, NULL = none */
+} MV_Gather;
+
+/* Helper: Windows attributes of a gathered entry */
+static uint32_t mv_attributes(int is_dir, int read_only) {
+    uint32_t attrib = is_dir ? 0x10 : 0x20;  /* FILE_ATTRIBUTE_DIRECTORY / _ARCHIVE */
+    if (read_only) attrib |= 0x01;  /* FILE_ATTRIBUTE_READONLY */
+    return attrib;
+}
+
+/* Helper: Add one gathered file or directory to the list its snapshot
+ * state picks
+ * @return The entry, or NULL if left out (*ok = 1) or out of memory (*ok = 0) */
+static MV_FileEntry* mv_gather_add(MV_Gather* g, const DirScanEntry* e, int* ok) {
+    MV_FileList* list = g->list;
+    *ok = 1;
+    if (g->base) {
+        SnapshotEntry entry = { e->name, e->size, e->mtime, e->inode };
+        if (snapshot_unchanged(g->base, &entry)) {
+            if (!g->unchanged) return NULL;
+            list = g->unchanged;
+        }
+    }
+    if (!mv_file_list_add(list, e->full_path, e->name, e->size, e->mtime,
+                          mv_attributes(e->is_dir, e->read_only), e->inode, e->is_dir)) {
+        *ok = 0;
+        return NULL;
+    }
+    MV_FileEntry* added = &list->entries[list->count - 1];
+    added->sparse = e->sparse;
+    added->dev = e->dev;
+    added->hard_linked = e->hard_linked;
+    return added;
+}
 
-/* Gather files from a path (file or directory) */
-static int mv_gather_files(const char* path, const char* base_name, MV_FileList* list) {
-    struct STAT st;
-    if (STAT(path, &st) != 0) {
-        fprintf(stderr, "mv_gather: Cannot stat: %s\n", path);
-        return 0;
+/* Add one file or directory found by the directory scanner */
+static SevenZipErrorCode mv_gather_entry(const DirScanEntry* entry, void* user_data) {
+    int ok;
+    mv_gather_add((MV_Gather*)user_data, entry, &ok);
+    return ok ? SEVENZIP_OK : SEVENZIP_ERROR_MEMORY;
+}
+
+/* Helper: Add a block or raw device as a file of its size, dated now
+ * (the time of the image) */
+static int mv_gather_device(MV_Gather* g, const char* path, const char* name, uint64_t size) {
+    DirScanEntry e;
+    memset(&e, 0, sizeof(e));
+    e.full_path = path;
+    e.name = name;
+    e.size = size;
+    e.mtime = ((uint64_t)time(NULL) * 10000000ULL) + 116444736000000000ULL;
+    int ok;
+    MV_FileEntry* added = mv_gather_add(g, &e, &ok);
+    if (added) added->device = 1;
+    return ok;
+}
+
+/* Gather files from a path (file or directory, the directory and
+ * everything below it as entries); unreadable paths are skipped, 0 is
+ * returned only when out of memory */
+static int mv_gather_files(const char* path, MV_Gather* g) {
+    /* Entries are named after the input's last path component */
+    const char* name = strrchr(path, PATH_SEP);
+    name = name ? name + 1 : path;
+    
+    /* Inputs are filtered by that name like the entries below them */
+    int included = 1;
+    if (g->filter) {
+        if (name_filter_excludes(g->filter, name)) return 1;
+        included = name_filter_includes(g->filter, name);
     }
     
-    if (S_ISREG(st.st_mode)) {
-        /* Regular file - use base_name if provided, otherwise just filename */
-        const char* name = base_name;
-        if (!name) {
-            name = strrchr(path, PATH_SEP);
-            name = name ? name + 1 : path;
-        }
-        
-        /* Convert Unix time to Windows FILETIME */
-        uint64_t mtime = ((uint64_t)st.st_mtime * 10000000ULL) + 116444736000000000ULL;
-        
-        /* Set attributes */
-        uint32_t attrib = 0x20;  /* FILE_ATTRIBUTE_ARCHIVE */
-        if (!(st.st_mode & S_IWUSR)) {
-            attrib |= 0x01;  /* FILE_ATTRIBUTE_READONLY */
+    /* One stat; only what it finds is not a file or directory (and, on
+     * Windows, what it cannot stat) is probed as a device */
+    struct STAT st;
+    int found = STAT(path, &st) == 0;
+    if (!found || (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))) {
+        uint64_t device_size = 0;
+        if (device_input_probe(path, &device_size)) {
+            return !included || mv_gather_device(g, path, name, device_size);
         }
-        
-        return mv_file_list_add(list, path, name, st.st_size, mtime, attrib);
-    } else if (S_ISDIR(st.st_mode)) {
-        return mv_gather_directory(path, base_name, list);
+        return 1;  /* Unreadable, or another type: skipped */
     }
     
-    return 1;  /* Skip other types */
+    DirScanEntry e;
+    memset(&e, 0, sizeof(e));
+    e.full_path = path;
+    e.name = name;
+    e.is_dir = S_ISDIR(st.st_mode);
+    e.size = e.is_dir ? 0 : (uint64_t)st.st_size;
+    /* Convert Unix time to Windows FILETIME */
+    e.mtime = ((uint64_t)st.st_mtime * 10000000ULL) + 116444736000000000ULL;
+    e.read_only = !(st.st_mode & S_IWUSR);
+#ifdef _WIN32
+    DWORD win_attrib = e.is_dir ? INVALID_FILE_ATTRIBUTES : GetFileAttributesA(path);
+    e.sparse = win_attrib != INVALID_FILE_ATTRIBUTES && (win_attrib & FILE_ATTRIBUTE_SPARSE_FILE);
+#else
+    e.inode = (uint64_t)st.st_ino;
+    e.dev = (uint64_t)st.st_dev;
+    e.sparse = !e.is_dir && (uint64_t)st.st_blocks * 512 < e.size;
+    e.hard_linked = !e.is_dir && st.st_nlink > 1;
+#endif
+    int ok = 1;
+    if (!included && !e.is_dir) return 1;
+    if (included) mv_gather_add(g, &e, &ok);
+    if (ok && e.is_dir) {
+        return sevenzip_scan_directory(path, name, DIR_SCAN_DIRS | DIR_SCAN_SKIP_ERRORS, 0,
+                                       g->filter, mv_gather_entry, g) != SEVENZIP_ERROR_MEMORY;
+    }
+    return ok;
 }
 
-/* Gather files from a directory recursively */
-static int mv_gather_directory(const char* dir_path, const char* base_name, MV_FileList* list) {
-#ifdef _WIN32
-    char search_path[1024];
-    snprintf(search_path, sizeof(search_path), "%s\\*", dir_path);
-    
-    WIN32_FIND_DATAA fd;
-    HANDLE hFind = FindFirstFileA(search_path, &fd);
-    if (hFind == INVALID_HANDLE_VALUE) {
-        return 0;
+/* Gather the paths of a list file, one per line (CR LF or LF); lines of
+ * any length, empty ones skipped
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_OPEN_FILE if the list cannot be read,
+ *         SEVENZIP_ERROR_MEMORY */
+static SevenZipErrorCode mv_gather_list(const char* list_path, MV_Gather* g) {
+    FILE* f = fopen(list_path, "rb");
+    if (!f) return SEVENZIP_ERROR_OPEN_FILE;
+    size_t capacity = 4096;
+    char* line = (char*)mem_alloc(SEVENZIP_MEM_NAMES, capacity);
+    SevenZipErrorCode err = line ? SEVENZIP_OK : SEVENZIP_ERROR_MEMORY;
+    size_t len = 0;
+    while (err == SEVENZIP_OK && fgets(line + len, (int)(capacity - len), f)) {
+        len += strlen(line + len);
+        if (len + 1 == capacity && line[len - 1] != '\n') {
+            /* Longer than the buffer: the rest follows */
+            char* grown = (char*)mem_realloc(SEVENZIP_MEM_NAMES, line, capacity * 2);
+            if (!grown) {
+                err = SEVENZIP_ERROR_MEMORY;
+                break;
+            }
+            line = grown;
+            capacity *= 2;
+            continue;
+        }
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (len > 0 && !mv_gather_files(line, g)) err = SEVENZIP_ERROR_MEMORY;
+        len = 0;
+    }
+    if (err == SEVENZIP_OK && ferror(f)) err = SEVENZIP_ERROR_OPEN_FILE;
+    mem_free(line);
+    fclose(f);
+    return err;
+}
+
+/* Gather the files of `input_paths`, then of options->next_input_path and
+ * options->input_list, into `list`. With options->snapshot_base
+ * the files it has unchanged are left out, or with options->snapshot_output
+ * moved behind the others, *unchanged_count of them, to be listed in the
+ * new snapshot without being archived */
+static SevenZipErrorCode mv_gather_inputs(const char** input_paths,
+                                          const SevenZipStreamOptions* options,
+                                          MV_FileList* list, size_t* unchanged_count) {
+    *unchanged_count = 0;
+    Snapshot base;
+    snapshot_init(&base);
+    if (options->snapshot_base) {
+        SevenZipErrorCode err = snapshot_load(&base, options->snapshot_base);
+        if (err != SEVENZIP_OK) return err;
     }
     
-    do {
-        if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
-        
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s\\%s", dir_path, fd.cFileName);
-        
-        char archive_name[1024];
-        if (base_name) {
-            snprintf(archive_name, sizeof(archive_name), "%s/%s", base_name, fd.cFileName);
-        } else {
-            snprintf(archive_name, sizeof(archive_name), "%s", fd.cFileName);
-        }
-        
-        if (!mv_gather_files(full_path, archive_name, list)) {
-            FindClose(hFind);
-            return 0;
+    /* Scan patterns match at any depth, as in .gitignore */
+    NameFilter filter;
+    int filtered = options->include_patterns || options->exclude_patterns;
+    if (filtered) {
+        SevenZipErrorCode err = name_filter_compile(&filter, options->include_patterns,
+                                                    options->exclude_patterns, NAME_FILTER_ANY_DEPTH);
+        if (err != SEVENZIP_OK) {
+            snapshot_free(&base);
+            return err;
         }
-    } while (FindNextFileA(hFind, &fd));
-    
-    FindClose(hFind);
-#else
-    DIR* dir = opendir(dir_path);
-    if (!dir) {
-        fprintf(stderr, "mv_gather: Cannot open directory: %s\n", dir_path);
-        return 0;
     }
     
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-        
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-        
-        char archive_name[1024];
-        if (base_name) {
-            snprintf(archive_name, sizeof(archive_name), "%s/%s", base_name, entry->d_name);
-        } else {
-            /* Use the directory name as the base */
-            const char* dir_name = strrchr(dir_path, PATH_SEP);
-            dir_name = dir_name ? dir_name + 1 : dir_path;
-            snprintf(archive_name, sizeof(archive_name), "%s/%s", dir_name, entry->d_name);
+    MV_FileList unchanged;
+    mv_file_list_init(&unchanged);
+    MV_Gather gather = { list, options->snapshot_output ? &unchanged : NULL,
+                         options->snapshot_base ? &base : NULL, filtered ? &filter : NULL };
+    int ok = 1;
+    for (int i = 0; ok && input_paths && input_paths[i] != NULL; i++) {
+        ok = mv_gather_files(input_paths[i], &gather);
+    }
+    /* Pulled paths are gathered as they come: only the entries are kept */
+    const char* path;
+    while (ok && options->next_input_path &&
+           (path = options->next_input_path(options->input_path_user_data)) != NULL) {
+        ok = mv_gather_files(path, &gather);
+    }
+    SevenZipErrorCode err = ok ? SEVENZIP_OK : SEVENZIP_ERROR_MEMORY;
+    if (err == SEVENZIP_OK && options->input_list) {
+        err = mv_gather_list(options->input_list, &gather);
+        if (err == SEVENZIP_ERROR_OPEN_FILE) {
+            fprintf(stderr, "Cannot read input list: %s\n", options->input_list);
         }
-        
-        if (!mv_gather_files(full_path, archive_name, list)) {
-            closedir(dir);
-            return 0;
+        ok = err == SEVENZIP_OK;
+    }
+    snapshot_free(&base);
+    if (filtered) name_filter_free(&filter);
+    
+    if (ok && unchanged.count > 0) {
+        size_t count = list->count + unchanged.count;
+        MV_FileEntry* entries = (MV_FileEntry*)mem_realloc(SEVENZIP_MEM_HEADER, list->entries,
+                                                           count * sizeof(MV_FileEntry));
+        ok = entries != NULL;
+        if (ok) {
+            memcpy(entries + list->count, unchanged.entries, unchanged.count * sizeof(MV_FileEntry));
+            name_arena_take(&list->names, &unchanged.names);
+            list->entries = entries;
+            list->count = count;
+            list->capacity = count;
+            *unchanged_count = unchanged.count;
         }
     }
-    
-    closedir(dir);
-#endif
-    return 1;
+    mv_file_list_free(&unchanged);
+    if (err == SEVENZIP_OK && !ok) err = SEVENZIP_ERROR_MEMORY;
+    return err;
 }
 
+/* Encoder and I/O buffers owned by one archive, reused for every file and
+ * solid block instead of being rebuilt each time (created on first use) */
+typedef struct {
+    CLzma2EncHandle enc;
+    Byte* out_buffer;  /* buffer_size bytes, VolumeOutStream coalescing */
+    Byte* in_buffer;   /* buffer_size bytes, FILE* input fallback */
+    size_t buffer_size; /* STREAM_BUFFER_SIZE unless reduced for max_memory */
+} MV_EncoderCache;
+
+/* Write-behind stage for the volume output
+ *
+ * write_across_volumes() copies packed bytes into a bounded ring of blocks
+ * and a writer thread does the fwrite calls and volume switches, so a slow
+ * target (spinning disk, network share) overlaps with encoding instead of
+ * throttling it. The encoder only waits when every block is still queued.
+ *
+ * With options->volume_dirs, volumes go round robin to several targets,
+ * each with a ring and thread of its own: the writer thread only opens
+ * volumes and hands their bytes on, so one disk writes out its volume
+ * while the next volume is filling on another.
+ */
+#define WRITER_BLOCK_SIZE (4 * 1024 * 1024)  /* 4MB per ring slot */
+#define WRITER_BLOCK_COUNT 4
+
+/* Finisher stage for full volumes (options->sync_volumes, volume_complete)
+ *
+ * Closing a volume, and with sync_volumes its fsync, waits for the disk to
+ * take all of it. Once the next volume is open the full one goes to a
+ * finisher thread instead, so that wait overlaps with writing the next.
+ * Volume 0 stays open for the start header, the last one for its final
+ * size: both are finished at the end. Stripe writers pass their volumes
+ * on after the last block, so several threads may queue.
+ */
+#define FINISHER_QUEUE_SIZE 8
+
+typedef struct {
+    FILE* file;   /* NULL = shutdown request */
+    size_t index; /* Every queued volume is full: max_volume_size bytes */
+    FileDigestSlot digest;  /* With options->volume_digests */
+} FinishedVolume;
+
+typedef struct {
+    FinishedVolume queue[FINISHER_QUEUE_SIZE];
+    UInt32 head;          /* Next volume to finish (finisher thread only) */
+    UInt32 tail;          /* Next free entry, under `lock` */
+    CCriticalSection lock;
+    CSemaphore free_slots;
+    CSemaphore filled_slots;
+    CThread thread;
+    int running;          /* 0 = volumes stay open until the end */
+    volatile int discard; /* The job failed: only close what is queued */
+    volatile int failed;  /* A volume could not be synced or closed */
+} VolumeFinisher;
+
+typedef struct {
+    Byte* data;
+    size_t size;
+    FILE* file;   /* Volume of the data (stripe writers) */
+    int stop;     /* 1 = shutdown request, carries no data */
+    int finish;   /* Stripe writers: `file`, volume `index`, is complete; no data */
+    size_t index;
+    FileDigestSlot digest;  /* Of the finished volume */
+} WriterBlock;
+
+typedef struct {
+    WriterBlock* blocks;
+    UInt32 count;         /* 0 = no writer thread, write synchronously */
+    UInt32 head;          /* Next slot to write (writer thread only) */
+    UInt32 tail;          /* Next slot to fill */
+    int tail_valid;       /* blocks[tail] has been acquired by the producer */
+    CSemaphore free_slots;
+    CSemaphore filled_slots;
+    CThread thread;
+    volatile int failed;  /* A write failed; later blocks are dropped */
+    OpStats* stats;       /* Stripe writers: WRITE time of their fwrite calls */
+    VolumeFinisher* finisher; /* Stripe writers: where complete volumes go */
+} VolumeWriter;
+
+/* Resume state of a job run with options->checkpoint, see mv_checkpoint_save() */
+typedef struct MV_Checkpoint MV_Checkpoint;
+
 /* Multi-volume context */
 typedef struct {
     FILE** volumes;
@@ -244,199 +543,1033 @@ typedef struct {
     uint64_t current_volume_size;
     uint64_t max_volume_size;
     char base_path[1024];
+    const char** volume_dirs;  /* options->volume_dirs, NULL = next to base_path */
+    size_t volume_dir_count;
+    const char* volume_name;   /* File name part of base_path */
+    VolumeWriter* stripes;     /* One writer per volume_dirs entry while running */
+    const SevenZipArchiveSink* sink;  /* sevenzip_create_7z_to_sink(): volumes[] stay NULL */
+    int single_file;      /* CREATE_OUTPUT_FILE: the one volume is base_path itself */
     
     /* Compressed data tracking */
     uint64_t total_packed_size;
+    uint64_t pack_pos;    /* options->streamable: region between the start header and the packed data */
     
     /* Progress */
-    SevenZipBytesProgressCallback progress_callback;
-    void* user_data;
+    ProgressReporter progress;  /* Input bytes done of total_size */
     uint64_t total_size;
     uint64_t bytes_written;
+    
+    MV_EncoderCache cache;
+    VolumeWriter writer;  /* Owns volumes[] and current_volume_size while running */
+    VolumeFinisher finisher;  /* Owns the full volumes handed to it; their volumes[] are NULL */
+    int sync_volumes;     /* options->sync_volumes */
+    SevenZipVolumeCallback volume_complete;  /* options->volume_complete */
+    void* volume_user_data;
+    /* options->volume_digests: the bytes of each volume but the first are
+       digested on their way out, the first is read back once patched */
+    FileDigestSlot* volume_digests;  /* volume_capacity slots, NULL = off */
+    FileDigest volume_digest;        /* Of the last volume */
+    /* options->parity_volumes: fed like the digests, volume 0 read back last */
+    ParityWriter parity_state;
+    ParityWriter* parity;            /* &parity_state, NULL = off */
+    
+    /* Unbuffered output (options->unbuffered_output) */
+    int unbuffered;
+    int direct_volume;    /* Last volume is open for direct I/O */
+    Byte* direct_buffer;  /* DIRECT_BUFFER_SIZE bytes, DIRECT_IO_ALIGNMENT aligned */
+    size_t direct_pos;    /* Staged bytes not yet written to the last volume */
+#ifdef _WIN32
+    Byte* direct_spare;   /* Buffer of the write in flight */
+    OVERLAPPED direct_ov;
+    HANDLE direct_handle; /* Volume of the write in flight, NULL = none */
+    DWORD direct_size;
+    uint64_t direct_offset;  /* Volume offset of the next write */
+#endif
+    
+    int input_hints;      /* options->input_access_hints */
+    ZeroRunChunks zero_chunks;  /* options->zero_blocks */
+    const ZeroRunChunks* zero_runs;  /* &zero_chunks, NULL = off */
+    MemoryPressure pressure_watch;   /* options->memory_pressure_throttle */
+    MemoryPressure* pressure;        /* &pressure_watch, NULL = off */
+    ThroughputSlo slo_state;         /* options->throughput_target */
+    ThroughputSlo* slo;              /* &slo_state, NULL = off */
+    SevenZipRateLimit* rate_limit;   /* options->rate_limit */
+    int deterministic;               /* options->deterministic */
+    uint64_t fixed_mtime;            /* options->fixed_mtime as FILETIME, 0 = the files' own */
+    const char* block_cache_dir;     /* options->block_cache_dir, NULL = off */
+    BlockCacheWriter* cache_writer;  /* Entry the pack stream being written also goes to, NULL = none */
+    const SevenZipCancelToken* cancel;  /* options->cancel */
+    const char* temp_dir;   /* options->temp_dir: scratch files of pack streams finished early */
+    WriteVerify verify_state;  /* options->verify_writes */
+    WriteVerify* verify;    /* &verify_state while its thread runs, NULL = off */
+    SevenZipNumaPolicy numa_policy;     /* options->numa_policy */
+    ThreadPlacer placer;    /* Allocators of cache.enc when placed is set */
+    int placed;
+    CrcStage crc_stage;   /* Per-file CRCs of the main thread's streams */
+    FileDigestSlot* digests;  /* Digest of every file (options->digest_manifest), NULL = off */
+    
+    /* 7zAES (options->password): while cipher_active, packed data passes
+       through `cipher` on its way to the volumes */
+    int encrypt;
+    Byte aes_key[AES_CODER_KEY_SIZE];
+    AesOutStream cipher;
+    int cipher_active;
+    ISeqOutStream packed_vt;  /* Sink of `cipher` */
+    
+    OpStats stats;        /* For sevenzip_get_last_stats() */
+    MV_Checkpoint* checkpoint;  /* NULL = options->checkpoint off */
 } MultiVolumeContext;
 
-/* Helper: Write number in 7z variable-length encoding (little-endian for bytes after first)
- * 
- * 7z uses a variable-length encoding where the first byte indicates how many additional
- * bytes follow:
- * - 0x00-0x7F:  1 byte  (7 bits of data)
- * - 0x80-0xBF:  2 bytes (6 bits in first + 8 bits in second = 14 bits)
- * - 0xC0-0xDF:  3 bytes (5 bits in first + 16 bits LE = 21 bits)
- * - 0xE0-0xEF:  4 bytes (4 bits in first + 24 bits LE = 28 bits)
- * - 0xF0-0xF7:  5 bytes (3 bits in first + 32 bits LE = 35 bits)
- * - 0xF8-0xFB:  6 bytes (2 bits in first + 40 bits LE = 42 bits)
- * - 0xFC-0xFD:  7 bytes (1 bit in first + 48 bits LE = 49 bits)
- * - 0xFE:       8 bytes (56 bits LE)
- * - 0xFF:       9 bytes (64 bits LE)
- */
-static void WriteNumber(Byte** buf, uint64_t value) {
-    Byte* p = *buf;
-    
-    if (value < 0x80) {
-        /* 1 byte: 7 bits */
-        *p++ = (Byte)value;
-    }
-    else if (value < ((uint64_t)1 << 14)) {
-        /* 2 bytes: 6 bits in first byte + 8 bits in second = 14 bits */
-        *p++ = (Byte)(0x80 | (value >> 8));
-        *p++ = (Byte)(value & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 21)) {
-        /* 3 bytes: 5 bits in first byte + 16 bits little-endian = 21 bits */
-        *p++ = (Byte)(0xC0 | ((value >> 16) & 0x1F));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 28)) {
-        /* 4 bytes: 4 bits in first byte + 24 bits little-endian = 28 bits */
-        *p++ = (Byte)(0xE0 | ((value >> 24) & 0x0F));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 35)) {
-        /* 5 bytes: 3 bits in first byte + 32 bits little-endian = 35 bits */
-        *p++ = (Byte)(0xF0 | ((value >> 32) & 0x07));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 42)) {
-        /* 6 bytes: 2 bits in first byte + 40 bits little-endian = 42 bits */
-        *p++ = (Byte)(0xF8 | ((value >> 40) & 0x03));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 49)) {
-        /* 7 bytes: 1 bit in first byte + 48 bits little-endian = 49 bits */
-        *p++ = (Byte)(0xFC | ((value >> 48) & 0x01));
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-        *p++ = (Byte)((value >> 40) & 0xFF);
-    }
-    else if (value < ((uint64_t)1 << 56)) {
-        /* 8 bytes: first byte 0xFE + 56 bits little-endian */
-        *p++ = 0xFE;
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-        *p++ = (Byte)((value >> 40) & 0xFF);
-        *p++ = (Byte)((value >> 48) & 0xFF);
-    }
-    else {
-        /* 9 bytes: first byte 0xFF + 64 bits little-endian */
-        *p++ = 0xFF;
-        *p++ = (Byte)(value & 0xFF);
-        *p++ = (Byte)((value >> 8) & 0xFF);
-        *p++ = (Byte)((value >> 16) & 0xFF);
-        *p++ = (Byte)((value >> 24) & 0xFF);
-        *p++ = (Byte)((value >> 32) & 0xFF);
-        *p++ = (Byte)((value >> 40) & 0xFF);
-        *p++ = (Byte)((value >> 48) & 0xFF);
-        *p++ = (Byte)((value >> 56) & 0xFF);
-    }
-    
-    *buf = p;
-}
-
 /* Helper: Get volume filename */
 static void get_volume_filename(char* buffer, size_t size, const char* base, int index) {
     snprintf(buffer, size, "%s.%03d", base, index + 1);
 }
 
-/* Helper: Open new volume file */
-static FILE* open_new_volume(MultiVolumeContext* ctx) {
+/* Helper: Path of volume `index`, in its volume_dirs entry if there are any */
+static void mv_volume_path(const MultiVolumeContext* ctx, char* buffer, size_t size, size_t index) {
+    if (ctx->single_file) {
+        snprintf(buffer, size, "%s", ctx->base_path);
+        return;
+    }
+    if (ctx->volume_dir_count == 0) {
+        get_volume_filename(buffer, size, ctx->base_path, (int)index);
+        return;
+    }
+    const char* dir = ctx->volume_dirs[index % ctx->volume_dir_count];
+    size_t len = strlen(dir);
+    int sep = len > 0 && dir[len - 1] != '/' && dir[len - 1] != '\\';
+    snprintf(buffer, size, "%s%s%s.%03d", dir, sep ? "/" : "", ctx->volume_name, (int)index + 1);
+}
+
+/* Helper: Cut a volume file to `size` bytes (frees preallocated space) */
+static int set_volume_size(FILE* f, uint64_t size) {
+#ifdef _WIN32
+    return _chsize_s(_fileno(f), (__int64)size) == 0;
+#else
+    return ftruncate(fileno(f), (off_t)size) == 0;
+#endif
+}
+
+/* Flush a stream through to the disk */
+static int sync_file(FILE* f) {
+    if (fflush(f) != 0) return 0;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+/* Helper: Digest of the file at `path`, with the algorithm of `slot` */
+static int mv_digest_file(const char* path, FileDigestSlot* slot) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    Byte* buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, WRITER_BLOCK_SIZE);
+    if (!buf) {
+        fclose(f);
+        return 0;
+    }
+    FileDigest digest;
+    file_digest_init(&digest, slot->algorithm);
+    size_t n;
+    while ((n = fread(buf, 1, WRITER_BLOCK_SIZE, f)) > 0) {
+        file_digest_update(&digest, buf, n);
+    }
+    int ok = !ferror(f);
+    fclose(f);
+    mem_free(buf);
+    file_digest_final(&digest, slot);
+    return ok;
+}
+
+/* Helper: Reserve disk space for a volume expected to reach `size` bytes
+ * One allocation up front gives the filesystem a chance to lay the file
+ * out contiguously, where appends from parallel jobs would interleave.
+ * Failure (ENOSPC, no filesystem support) only loses that benefit. */
+static void preallocate_volume(FILE* f, uint64_t size) {
+    if (size == 0) return;
+#if defined(__linux__)
+    /* Not posix_fallocate: its fallback writes the zeros itself */
+    fallocate(fileno(f), 0, 0, (off_t)size);
+#elif defined(__APPLE__) && defined(F_PREALLOCATE)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)size, 0 };
+    if (fcntl(fileno(f), F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(fileno(f), F_PREALLOCATE, &store);
+    }
+#elif defined(_WIN32)
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    SetFileInformationByHandle((HANDLE)_get_osfhandle(_fileno(f)), FileAllocationInfo,
+                               &info, sizeof(info));
+#else
+    (void)f;
+#endif
+}
+
+#if USE_DIRECT_IO
+static void* direct_buffer_alloc(void) {
+    return mem_alloc_aligned(SEVENZIP_MEM_IO_BUFFERS, DIRECT_BUFFER_SIZE, DIRECT_IO_ALIGNMENT);
+}
+
+/* Staging buffers of unbuffered volumes; 0 = volumes are written buffered */
+static int direct_buffers_alloc(MultiVolumeContext* ctx) {
+    ctx->direct_buffer = (Byte*)direct_buffer_alloc();
+#ifdef _WIN32
+    ctx->direct_spare = (Byte*)direct_buffer_alloc();
+    if (!ctx->direct_spare) {
+        mem_free(ctx->direct_buffer);
+        ctx->direct_buffer = NULL;
+    }
+#endif
+    return ctx->direct_buffer != NULL;
+}
+
+static void direct_buffers_free(MultiVolumeContext* ctx) {
+    mem_free(ctx->direct_buffer);
+    ctx->direct_buffer = NULL;
+#ifdef _WIN32
+    mem_free(ctx->direct_spare);
+    ctx->direct_spare = NULL;
+#endif
+}
+
+/* Open a volume that bypasses the page cache; NULL if the filesystem
+ * does not support it (e.g. tmpfs), the caller then opens it buffered */
+static FILE* open_direct_volume(const char* path) {
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL);
+    if (h == INVALID_HANDLE_VALUE) return NULL;
+    int fd = _open_osfhandle((intptr_t)h, _O_WRONLY | _O_BINARY);
+    if (fd < 0) {
+        CloseHandle(h);
+        return NULL;
+    }
+    FILE* f = _fdopen(fd, "wb");
+    if (!f) _close(fd);
+#else
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0) return NULL;
+    FILE* f = fdopen(fd, "wb");
+    if (!f) close(fd);
+#endif
+    return f;
+}
+
+#ifdef _WIN32
+/* Wait for the write in flight, if any */
+static int direct_write_wait(MultiVolumeContext* ctx) {
+    if (!ctx->direct_handle) return 1;
+    DWORD written = 0;
+    BOOL ok = GetOverlappedResult(ctx->direct_handle, &ctx->direct_ov, &written, TRUE);
+    ctx->direct_handle = NULL;
+    return ok && written == ctx->direct_size;
+}
+#endif
+
+/* Write the first `size` bytes of direct_buffer to the direct volume `f`;
+ * on Windows the write is left in flight and direct_buffer is the other
+ * buffer on return */
+static int direct_write_buffer(MultiVolumeContext* ctx, FILE* f, size_t size) {
+#ifdef _WIN32
+    if (!direct_write_wait(ctx)) return 0;
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+    memset(&ctx->direct_ov, 0, sizeof(ctx->direct_ov));
+    ctx->direct_ov.Offset = (DWORD)ctx->direct_offset;
+    ctx->direct_ov.OffsetHigh = (DWORD)(ctx->direct_offset >> 32);
+    if (!WriteFile(h, ctx->direct_buffer, (DWORD)size, NULL, &ctx->direct_ov) &&
+        GetLastError() != ERROR_IO_PENDING) {
+        return 0;
+    }
+    ctx->direct_handle = h;
+    ctx->direct_size = (DWORD)size;
+    ctx->direct_offset += size;
+    Byte* filled = ctx->direct_buffer;
+    ctx->direct_buffer = ctx->direct_spare;
+    ctx->direct_spare = filled;
+    return 1;
+#else
+    const Byte* data = ctx->direct_buffer;
+    int fd = fileno(f);
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0) return 0;
+        data += n;
+        size -= (size_t)n;
+    }
+    return 1;
+#endif
+}
+
+/* Complete the last volume when it is a direct one: the partial tail
+ * block is written zero-padded to the alignment and cut back to size */
+static int finish_direct_volume(MultiVolumeContext* ctx) {
+    if (!ctx->direct_volume) return 1;
+    ctx->direct_volume = 0;
+    
+    FILE* f = ctx->volumes[ctx->volume_count - 1];
+    int padded_tail = ctx->direct_pos > 0;
+    int ok = 1;
+    if (padded_tail) {
+        size_t padded = (ctx->direct_pos + DIRECT_IO_ALIGNMENT - 1) & ~(size_t)(DIRECT_IO_ALIGNMENT - 1);
+        memset(ctx->direct_buffer + ctx->direct_pos, 0, padded - ctx->direct_pos);
+        ctx->direct_pos = 0;
+        ok = direct_write_buffer(ctx, f, padded);
+    }
+#ifdef _WIN32
+    if (!direct_write_wait(ctx)) ok = 0;
+#endif
+    return ok && (!padded_tail || set_volume_size(f, ctx->current_volume_size));
+}
+#endif
+
+/* Helper: Tell the sink that volume `index` of `size` bytes is complete */
+static int mv_sink_end_volume(MultiVolumeContext* ctx, size_t index, uint64_t size) {
+    const SevenZipArchiveSink* sink = ctx->sink;
+    return !sink->end_volume || sink->end_volume((uint32_t)index, size, sink->user_data) == 0;
+}
+
+/* Helper: Start the next volume of a sink; every volume but the first
+ * is complete when the next one starts, the first waits for its patch */
+static int mv_sink_begin_volume(MultiVolumeContext* ctx) {
+    const SevenZipArchiveSink* sink = ctx->sink;
+    if (ctx->volume_count > 1 && !mv_sink_end_volume(ctx, ctx->volume_count - 1, ctx->current_volume_size)) {
+        return 0;
+    }
+    if (sink->begin_volume && sink->begin_volume((uint32_t)ctx->volume_count, sink->user_data) != 0) {
+        return 0;
+    }
+    ctx->volumes[ctx->volume_count++] = NULL;
+    ctx->current_volume_size = 0;
+    return 1;
+}
+
+/* Hand the producer's current slot to the writer thread */
+static void VolumeWriter_Submit(VolumeWriter* w) {
+    w->tail = (w->tail + 1) % w->count;
+    w->tail_valid = 0;
+    Semaphore_Release1(&w->filled_slots);
+}
+
+/* Helper: Close volume `index` of `size` bytes, synced first if `sync`, and
+ * report it to options->volume_complete with its `digest` (NULL = none) */
+static int mv_finish_volume(MultiVolumeContext* ctx, FILE* f, size_t index, uint64_t size, int sync,
+                            const FileDigestSlot* digest) {
+    int ok = !sync || sync_file(f);
+    ok = fclose(f) == 0 && ok;
+    if (ok && ctx->volume_complete) {
+        char vol_path[1280];
+        mv_volume_path(ctx, vol_path, sizeof(vol_path), index);
+        ctx->volume_complete((uint32_t)index, vol_path, size, digest ? digest->value : NULL,
+                             ctx->volume_user_data);
+    }
+    return ok;
+}
+
+/* Queue a full volume to the finisher; any thread may call this */
+static void VolumeFinisher_Submit(VolumeFinisher* fin, FILE* f, size_t index,
+                                  const FileDigestSlot* digest) {
+    Semaphore_Wait(&fin->free_slots);
+    CriticalSection_Enter(&fin->lock);
+    fin->queue[fin->tail].file = f;
+    fin->queue[fin->tail].index = index;
+    if (digest) fin->queue[fin->tail].digest = *digest;
+    fin->tail = (fin->tail + 1) % FINISHER_QUEUE_SIZE;
+    CriticalSection_Leave(&fin->lock);
+    Semaphore_Release1(&fin->filled_slots);
+}
+
+/* Finisher thread: finish queued volumes in order
+ * A checkpoint only covers synced volumes, so with one every volume is. */
+static THREAD_FUNC_DECL VolumeFinisher_Thread(void* arg) {
+    MultiVolumeContext* ctx = (MultiVolumeContext*)arg;
+    thread_sched_enter();
+    VolumeFinisher* fin = &ctx->finisher;
+    
+    for (;;) {
+        Semaphore_Wait(&fin->filled_slots);
+        FinishedVolume v = fin->queue[fin->head];
+        fin->head = (fin->head + 1) % FINISHER_QUEUE_SIZE;
+        if (!v.file) break;
+        if (fin->discard) {
+            fclose(v.file);
+        } else if (!mv_finish_volume(ctx, v.file, v.index, ctx->max_volume_size,
+                                     ctx->sync_volumes || ctx->checkpoint,
+                                     ctx->volume_digests ? &v.digest : NULL)) {
+            fin->failed = 1;
+        }
+        Semaphore_Release1(&fin->free_slots);
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Wait until every queued volume is finished; no volume may be queued meanwhile
+ * @return 1 on success, 0 if one could not be synced or closed
+ */
+static int VolumeFinisher_Wait(VolumeFinisher* fin) {
+    if (!fin->running) return 1;
+    for (UInt32 i = 0; i < FINISHER_QUEUE_SIZE; i++) {
+        Semaphore_Wait(&fin->free_slots);
+    }
+    Semaphore_ReleaseN(&fin->free_slots, FINISHER_QUEUE_SIZE);
+    return !fin->failed;
+}
+
+/* Finish what is queued, only closing it when `discard`, and stop the thread
+ * Call after VolumeWriter_Destroy(): the stripe writers queue volumes too.
+ * @return 1 on success, 0 if a volume could not be synced or closed
+ */
+static int VolumeFinisher_Stop(VolumeFinisher* fin, int discard) {
+    if (Thread_WasCreated(&fin->thread)) {
+        if (discard) fin->discard = 1;
+        VolumeFinisher_Submit(fin, NULL, 0, NULL);
+        Thread_Wait_Close(&fin->thread);
+    }
+    if (Semaphore_IsCreated(&fin->free_slots)) Semaphore_Close(&fin->free_slots);
+    if (Semaphore_IsCreated(&fin->filled_slots)) Semaphore_Close(&fin->filled_slots);
+    if (fin->running) CriticalSection_Delete(&fin->lock);
+    int ok = !fin->failed;
+    memset(fin, 0, sizeof(*fin));
+    return ok;
+}
+
+/* Start the finisher thread; on failure every volume is finished at the end */
+static void VolumeFinisher_Start(MultiVolumeContext* ctx) {
+    VolumeFinisher* fin = &ctx->finisher;
+    memset(fin, 0, sizeof(*fin));
+    Thread_CONSTRUCT(&fin->thread)
+    Semaphore_Construct(&fin->free_slots);
+    Semaphore_Construct(&fin->filled_slots);
+    if (CriticalSection_Init(&fin->lock) != 0) return;
+    fin->running = 1;
+    if (Semaphore_Create(&fin->free_slots, FINISHER_QUEUE_SIZE, FINISHER_QUEUE_SIZE) != 0 ||
+        Semaphore_Create(&fin->filled_slots, 0, FINISHER_QUEUE_SIZE) != 0 ||
+        Thread_Create(&fin->thread, VolumeFinisher_Thread, ctx) != 0) {
+        VolumeFinisher_Stop(fin, 1);
+    }
+}
+
+/* Queue the end of volume `index` on stripe writer `w`, after its last bytes */
+static void VolumeStripe_Finish(VolumeWriter* w, FILE* f, size_t index, const FileDigestSlot* digest) {
+    if (w->tail_valid && w->blocks[w->tail].size > 0) {
+        VolumeWriter_Submit(w);
+    }
+    if (!w->tail_valid) {
+        Semaphore_Wait(&w->free_slots);
+        w->tail_valid = 1;
+    }
+    WriterBlock* blk = &w->blocks[w->tail];
+    blk->file = f;
+    blk->finish = 1;
+    blk->index = index;
+    if (digest) blk->digest = *digest;
+    VolumeWriter_Submit(w);
+}
+
+/* Helper: The last volume is full and the next one about to start: hand it
+ * to the finisher, through its stripe writer if it has one */
+static void mv_hand_off_volume(MultiVolumeContext* ctx) {
+    if (!ctx->finisher.running || ctx->volume_count < 2) return;
+    size_t index = ctx->volume_count - 1;
+    FILE* f = ctx->volumes[index];
+    ctx->volumes[index] = NULL;
+    const FileDigestSlot* digest = ctx->volume_digests ? &ctx->volume_digests[index] : NULL;
+    if (ctx->stripes) {
+        VolumeStripe_Finish(&ctx->stripes[index % ctx->volume_dir_count], f, index, digest);
+    } else {
+        VolumeFinisher_Submit(&ctx->finisher, f, index, digest);
+    }
+}
+
+/* Helper: Digest bytes of the last volume; the first is read back instead */
+static void mv_volume_digest_update(MultiVolumeContext* ctx, const void* data, size_t size) {
+    if (ctx->volume_digests && ctx->volume_count > 1) {
+        file_digest_update(&ctx->volume_digest, data, size);
+    }
+}
+
+/* Helper: Feed bytes of the last volume to the parity; the first is read back instead
+ * @return 0 if a parity file could not be written */
+static int mv_parity_update(MultiVolumeContext* ctx, const void* data, size_t size) {
+    return !ctx->parity || ctx->volume_count < 2 ||
+           parity_writer_update(ctx->parity, (uint32_t)(ctx->volume_count - 1), data, size);
+}
+
+/* Helper: The last volume is complete: store its digest */
+static void mv_volume_digest_end(MultiVolumeContext* ctx) {
+    if (ctx->volume_digests && ctx->volume_count > 1) {
+        file_digest_final(&ctx->volume_digest, &ctx->volume_digests[ctx->volume_count - 1]);
+    }
+}
+
+/* Helper: Open new volume file, or start the sink's next volume
+ * @return 1 on success, 0 on failure
+ */
+static int open_new_volume(MultiVolumeContext* ctx) {
+    TRACE_BEGIN(open);
+#if USE_DIRECT_IO
+    if (!finish_direct_volume(ctx)) return 0;
+#endif
     if (ctx->volume_count >= ctx->volume_capacity) {
         ctx->volume_capacity *= 2;
-        FILE** new_vols = (FILE**)realloc(ctx->volumes, ctx->volume_capacity * sizeof(FILE*));
-        if (!new_vols) return NULL;
+        FILE** new_vols = (FILE**)mem_realloc(SEVENZIP_MEM_OTHER, ctx->volumes, ctx->volume_capacity * sizeof(FILE*));
+        if (!new_vols) return 0;
         ctx->volumes = new_vols;
+        if (ctx->volume_digests) {
+            FileDigestSlot* new_digests = (FileDigestSlot*)mem_realloc(
+                SEVENZIP_MEM_OTHER, ctx->volume_digests, ctx->volume_capacity * sizeof(FileDigestSlot));
+            if (!new_digests) return 0;
+            ctx->volume_digests = new_digests;
+        }
+    }
+    if (ctx->sink) {
+        int ok = mv_sink_begin_volume(ctx);
+        TRACE_END(open, TRACE_VOLUME_OPEN, ctx->volume_count - 1);
+        return ok;
     }
+    mv_volume_digest_end(ctx);
+    mv_hand_off_volume(ctx);
     
     char vol_path[1280];
-    get_volume_filename(vol_path, sizeof(vol_path), ctx->base_path, ctx->volume_count);
-    
-    FILE* f = fopen(vol_path, "wb");
-    if (!f) return NULL;
+    mv_volume_path(ctx, vol_path, sizeof(vol_path), ctx->volume_count);
+    
+    FILE* f = NULL;
+#if USE_DIRECT_IO
+    if (ctx->unbuffered && ctx->direct_buffer) {
+        f = open_direct_volume(vol_path);
+        if (f) {
+            /* All writes go through direct_buffer, stdio only holds the fd */
+            setvbuf(f, NULL, _IONBF, 0);
+            ctx->direct_volume = 1;
+            ctx->direct_pos = 0;
+#ifdef _WIN32
+            ctx->direct_offset = 0;
+#endif
+        }
+    }
+#endif
+    if (!f) {
+        f = fopen(vol_path, "wb");
+        if (!f) return 0;
+        
+        /* Use larger buffer for faster I/O (4MB for output) */
+        setvbuf(f, NULL, _IOFBF, 4 * 1024 * 1024);
+#if defined(__APPLE__) && defined(F_NOCACHE)
+        if (ctx->unbuffered) fcntl(fileno(f), F_NOCACHE, 1);
+#endif
+    }
     
-    /* Use larger buffer for faster I/O (4MB for output) */
-    setvbuf(f, NULL, _IOFBF, 4 * 1024 * 1024);
+    /* Every volume but the last ends up exactly max_volume_size bytes long;
+       the estimate keeps a small archive from reserving a whole volume */
+    uint64_t written = (uint64_t)ctx->volume_count * ctx->max_volume_size;
+    uint64_t expected = ctx->total_size + VOLUME_PREALLOC_SLACK;
+    uint64_t reserve = (expected > written) ? expected - written : 0;
+    if (reserve > ctx->max_volume_size) reserve = ctx->max_volume_size;
+    preallocate_volume(f, reserve);
     
     ctx->volumes[ctx->volume_count++] = f;
     ctx->current_volume_size = 0;
+    if (ctx->volume_digests) {
+        ctx->volume_digests[ctx->volume_count - 1].algorithm = ctx->volume_digest.algorithm;
+        file_digest_init(&ctx->volume_digest, ctx->volume_digest.algorithm);
+    }
     
-    return f;
+    TRACE_END(open, TRACE_VOLUME_OPEN, ctx->volume_count - 1);
+    return 1;
 }
 
-/* Helper: Write data across volumes */
-static int write_across_volumes(MultiVolumeContext* ctx, const void* data, size_t size) {
-    const Byte* src = (const Byte*)data;
+/* Helper: Append to the last volume, `f`, or hand the bytes to the sink */
+static int volume_append(MultiVolumeContext* ctx, FILE* f, const Byte* data, size_t size) {
+    const SevenZipArchiveSink* sink = ctx->sink;
+    if (sink) {
+        return sink->write((uint32_t)(ctx->volume_count - 1), data, size, sink->user_data) == 0;
+    }
+    return fwrite(data, 1, size, f) == size;
+}
+
+/* Queue bytes of volume `f` to its stripe writer; a block holds the
+ * bytes of one volume only */
+static int VolumeStripe_Write(VolumeWriter* w, FILE* f, const Byte* src, size_t size) {
+    while (size > 0) {
+        if (w->failed) return 0;
+        if (w->tail_valid && w->blocks[w->tail].size > 0 && w->blocks[w->tail].file != f) {
+            VolumeWriter_Submit(w);
+        }
+        if (!w->tail_valid) {
+            Semaphore_Wait(&w->free_slots);
+            w->tail_valid = 1;
+        }
+        WriterBlock* blk = &w->blocks[w->tail];
+        blk->file = f;
+        size_t copy = WRITER_BLOCK_SIZE - blk->size;
+        if (copy > size) copy = size;
+        memcpy(blk->data + blk->size, src, copy);
+        blk->size += copy;
+        src += copy;
+        size -= copy;
+        if (blk->size == WRITER_BLOCK_SIZE) {
+            VolumeWriter_Submit(w);
+        }
+    }
+    return 1;
+}
+
+/* Helper: Write data across volumes, starting new ones as each fills up */
+static int write_volumes_untimed(MultiVolumeContext* ctx, const Byte* src, size_t size) {
     size_t remaining = size;
     
     while (remaining > 0) {
-        FILE* current = (ctx->volume_count > 0) ? ctx->volumes[ctx->volume_count - 1] : NULL;
-        
         /* Need new volume? */
-        if (!current || ctx->current_volume_size >= ctx->max_volume_size) {
-            current = open_new_volume(ctx);
-            if (!current) return 0;
+        if (ctx->volume_count == 0 || ctx->current_volume_size >= ctx->max_volume_size) {
+            if (!open_new_volume(ctx)) return 0;
         }
+        FILE* current = ctx->volumes[ctx->volume_count - 1];
         
         /* Calculate how much to write to current volume */
         size_t space_in_volume = ctx->max_volume_size - ctx->current_volume_size;
         size_t to_write = (remaining < space_in_volume) ? remaining : space_in_volume;
+        rate_limit_take(ctx->rate_limit, RATE_LIMIT_WRITE, to_write, ctx->cancel);
+        mv_volume_digest_update(ctx, src, to_write);
+        if (!mv_parity_update(ctx, src, to_write)) return 0;
         
-        if (fwrite(src, 1, to_write, current) != to_write) {
+#if USE_DIRECT_IO
+        if (ctx->direct_volume) {
+            /* Stage into the aligned buffer, write it out whenever it fills */
+            size_t done = 0;
+            while (done < to_write) {
+                size_t copy = DIRECT_BUFFER_SIZE - ctx->direct_pos;
+                if (copy > to_write - done) copy = to_write - done;
+                memcpy(ctx->direct_buffer + ctx->direct_pos, src + done, copy);
+                ctx->direct_pos += copy;
+                done += copy;
+                if (ctx->direct_pos == DIRECT_BUFFER_SIZE) {
+                    if (!direct_write_buffer(ctx, current, DIRECT_BUFFER_SIZE)) return 0;
+                    ctx->direct_pos = 0;
+                }
+            }
+        } else
+#endif
+        if (ctx->stripes) {
+            VolumeWriter* stripe = &ctx->stripes[(ctx->volume_count - 1) % ctx->volume_dir_count];
+            if (!VolumeStripe_Write(stripe, current, src, to_write)) return 0;
+        } else if (!volume_append(ctx, current, src, to_write)) {
             return 0;
         }
         
         src += to_write;
         remaining -= to_write;
         ctx->current_volume_size += to_write;
-        ctx->bytes_written += to_write;  /* Track all bytes written including header */
-        
-        /* Progress callback */
-        if (ctx->progress_callback && ctx->total_size > 0) {
-            ctx->progress_callback(
-                ctx->bytes_written,
-                ctx->total_size,
-                to_write,
-                0,
-                "",
-                ctx->user_data
-            );
-        }
     }
     
     return 1;
 }
 
-/* ============================================================================
- * Streaming interfaces for LZMA2 encoding
- * ============================================================================ */
-
-/* Large read buffer size for optimal I/O throughput */
-#define STREAM_BUFFER_SIZE (32 * 1024 * 1024)  /* 32MB buffer - better I/O batching */
+/* Timed for the WRITE phase wherever it runs (writer thread or inline) */
+static int write_volumes_direct(MultiVolumeContext* ctx, const Byte* src, size_t size) {
+    OpStatsTimer timer;
+    op_stats_io_begin(&ctx->stats, &timer);
+    TRACE_BEGIN(write);
+    int ok = write_volumes_untimed(ctx, src, size);
+    TRACE_END(write, TRACE_WRITE, ok ? size : 0);
+    op_stats_io_end(&ctx->stats, &timer, SEVENZIP_PHASE_WRITE, ok ? size : 0);
+    return ok;
+}
 
-#if USE_MMAP
-/* Memory-mapped input stream - FASTEST possible I/O */
-typedef struct {
-    ISeqInStream vt;       /* Virtual table - MUST be first! */
-    const Byte* data;      /* Memory-mapped data */
-    uint64_t size;         /* Total file size */
-    uint64_t pos;          /* Current position */
-    uint32_t* crc;         /* Pointer to CRC accumulator */
-    int fd;                /* File descriptor for cleanup */
-} MmapInStream;
+/* Writer thread: write filled ring slots in order */
+static THREAD_FUNC_DECL VolumeWriter_Thread(void* arg) {
+    MultiVolumeContext* ctx = (MultiVolumeContext*)arg;
+    thread_sched_enter();
+    VolumeWriter* w = &ctx->writer;
+    
+    for (;;) {
+        Semaphore_Wait(&w->filled_slots);
+        WriterBlock* blk = &w->blocks[w->head];
+        if (blk->stop) break;
+        if (!w->failed && !write_volumes_direct(ctx, blk->data, blk->size)) {
+            w->failed = 1;
+        }
+        blk->size = 0;
+        w->head = (w->head + 1) % w->count;
+        Semaphore_Release1(&w->free_slots);
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Stripe writer thread: write the volumes of one target directory
+ * Bytes were counted when queued; only the time is added here. */
+static THREAD_FUNC_DECL VolumeStripe_Thread(void* arg) {
+    VolumeWriter* w = (VolumeWriter*)arg;
+    thread_sched_enter();
+    FILE* last = NULL;
+    
+    for (;;) {
+        Semaphore_Wait(&w->filled_slots);
+        WriterBlock* blk = &w->blocks[w->head];
+        if (blk->stop) break;
+        if (blk->finish) {
+            /* Even after a failure: the finisher closes the file */
+            if (last == blk->file) last = NULL;
+            VolumeFinisher_Submit(w->finisher, blk->file, blk->index, &blk->digest);
+            blk->finish = 0;
+        } else if (!w->failed) {
+            OpStatsTimer timer;
+            op_stats_io_begin(w->stats, &timer);
+            /* The previous volume on this target is complete: hand it to the OS now */
+            if (last && blk->file != last && fflush(last) != 0) w->failed = 1;
+            if (fwrite(blk->data, 1, blk->size, blk->file) != blk->size) w->failed = 1;
+            op_stats_io_end(w->stats, &timer, SEVENZIP_PHASE_WRITE, 0);
+            last = blk->file;
+        }
+        blk->size = 0;
+        w->head = (w->head + 1) % w->count;
+        Semaphore_Release1(&w->free_slots);
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Wait until everything queued on `w` is written
+ * @return 1 on success, 0 if a queued write failed
+ */
+static int VolumeWriter_Wait(VolumeWriter* w) {
+    if (w->count == 0) return 1;
+    
+    if (w->tail_valid) {
+        if (w->blocks[w->tail].size > 0) {
+            VolumeWriter_Submit(w);
+        } else {
+            w->tail_valid = 0;
+            Semaphore_Release1(&w->free_slots);
+        }
+    }
+    for (UInt32 i = 0; i < w->count; i++) {
+        Semaphore_Wait(&w->free_slots);
+    }
+    Semaphore_ReleaseN(&w->free_slots, w->count);
+    return !w->failed;
+}
+
+/* Wait until everything queued is on disk; the caller may then touch the
+ * volume files directly until the next write_across_volumes()
+ * @return 1 on success, 0 if a queued write failed
+ */
+static int VolumeWriter_Drain(MultiVolumeContext* ctx) {
+    int ok = VolumeWriter_Wait(&ctx->writer);
+    /* The writer thread feeds the stripes, so they are waited for second */
+    for (size_t i = 0; ctx->stripes && i < ctx->volume_dir_count; i++) {
+        ok = VolumeWriter_Wait(&ctx->stripes[i]) && ok;
+    }
+    return ok;
+}
+
+/* Stop the thread of `w` and free its ring; anything still queued is dropped */
+static void VolumeWriter_Stop(VolumeWriter* w) {
+    if (Thread_WasCreated(&w->thread)) {
+        w->failed = 1;
+        if (!w->tail_valid) {
+            Semaphore_Wait(&w->free_slots);
+        }
+        w->blocks[w->tail].stop = 1;
+        Semaphore_Release1(&w->filled_slots);
+        Thread_Wait_Close(&w->thread);
+    }
+    if (Semaphore_IsCreated(&w->free_slots)) Semaphore_Close(&w->free_slots);
+    if (Semaphore_IsCreated(&w->filled_slots)) Semaphore_Close(&w->filled_slots);
+    if (w->blocks) {
+        for (UInt32 i = 0; i < w->count; i++) {
+            mem_free(w->blocks[i].data);
+        }
+        mem_free(w->blocks);
+    }
+    memset(w, 0, sizeof(*w));
+}
+
+/* Stop the writer and stripe threads; anything still queued is dropped, so
+ * drain first when the data matters. Later writes go straight to the volumes. */
+static void VolumeWriter_Destroy(MultiVolumeContext* ctx) {
+    VolumeWriter_Stop(&ctx->writer);
+    if (ctx->stripes) {
+        for (size_t i = 0; i < ctx->volume_dir_count; i++) {
+            VolumeWriter_Stop(&ctx->stripes[i]);
+        }
+        mem_free(ctx->stripes);
+        ctx->stripes = NULL;
+    }
+}
+
+/* Give `w` (zeroed but for `stats` and `finisher`) `count` ring slots and a thread
+ * running `func(arg)`; a failure leaves it stopped */
+static SRes VolumeWriter_Create(VolumeWriter* w, UInt32 count, THREAD_FUNC_TYPE func, void* arg) {
+    Thread_CONSTRUCT(&w->thread)
+    Semaphore_Construct(&w->free_slots);
+    Semaphore_Construct(&w->filled_slots);
+    
+    w->blocks = (WriterBlock*)mem_calloc(SEVENZIP_MEM_IO_BUFFERS, count, sizeof(WriterBlock));
+    if (!w->blocks) return SZ_ERROR_MEM;
+    w->count = count;
+    for (UInt32 i = 0; i < count; i++) {
+        w->blocks[i].data = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, WRITER_BLOCK_SIZE);
+        if (!w->blocks[i].data) {
+            VolumeWriter_Stop(w);
+            return SZ_ERROR_MEM;
+        }
+    }
+    
+    if (Semaphore_Create(&w->free_slots, count, count) != 0 ||
+        Semaphore_Create(&w->filled_slots, 0, count) != 0 ||
+        Thread_Create(&w->thread, func, arg) != 0) {
+        VolumeWriter_Stop(w);
+        return SZ_ERROR_THREAD;
+    }
+    return SZ_OK;
+}
+
+/* Start the writer thread with `count` ring slots, and a stripe writer
+ * with as many per volume_dirs entry when there are several
+ * On failure the context keeps writing synchronously. */
+static SRes VolumeWriter_Start(MultiVolumeContext* ctx, UInt32 count) {
+    memset(&ctx->writer, 0, sizeof(ctx->writer));
+    if (ctx->volume_dir_count > 1) {
+        ctx->stripes = (VolumeWriter*)mem_calloc(SEVENZIP_MEM_OTHER, ctx->volume_dir_count,
+                                                 sizeof(VolumeWriter));
+        if (!ctx->stripes) return SZ_ERROR_MEM;
+        for (size_t i = 0; i < ctx->volume_dir_count; i++) {
+            VolumeWriter* stripe = &ctx->stripes[i];
+            stripe->stats = &ctx->stats;
+            stripe->finisher = &ctx->finisher;
+            SRes res = VolumeWriter_Create(stripe, count, VolumeStripe_Thread, stripe);
+            if (res != SZ_OK) {
+                VolumeWriter_Destroy(ctx);
+                return res;
+            }
+        }
+    }
+    SRes res = VolumeWriter_Create(&ctx->writer, count, VolumeWriter_Thread, ctx);
+    if (res != SZ_OK) VolumeWriter_Destroy(ctx);
+    return res;
+}
+
+/* Write packed (or encrypted) bytes, queued to the writer thread if running */
+static int write_packed(MultiVolumeContext* ctx, const void* data, size_t size) {
+    const Byte* src = (const Byte*)data;
+    VolumeWriter* w = &ctx->writer;
+    
+    if (w->count == 0) {
+        if (!write_volumes_direct(ctx, src, size)) return 0;
+    } else {
+        size_t remaining = size;
+        while (remaining > 0) {
+            if (w->failed) return 0;
+            if (!w->tail_valid) {
+                /* Backpressure: blocks only when every slot is queued */
+                Semaphore_Wait(&w->free_slots);
+                w->tail_valid = 1;
+            }
+            WriterBlock* blk = &w->blocks[w->tail];
+            size_t copy = WRITER_BLOCK_SIZE - blk->size;
+            if (copy > remaining) copy = remaining;
+            memcpy(blk->data + blk->size, src, copy);
+            blk->size += copy;
+            src += copy;
+            remaining -= copy;
+            if (blk->size == WRITER_BLOCK_SIZE) {
+                VolumeWriter_Submit(w);
+            }
+        }
+    }
+    
+    ctx->bytes_written += size;  /* Track all bytes written including header */
+    return 1;
+}
+
+static size_t PackedOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    MultiVolumeContext* ctx = Z7_CONTAINER_FROM_VTBL(pp, MultiVolumeContext, packed_vt);
+    return write_packed(ctx, data, size) ? size : 0;
+}
+
+/* Helper: Write data across volumes, encrypting it inside an encrypted folder
+ * (the verifier sees the bytes of an LZMA2 folder before they are encrypted) */
+static int write_across_volumes(MultiVolumeContext* ctx, const void* data, size_t size) {
+    if (ctx->verify && !write_verify_feed(ctx->verify, data, size)) return 0;
+    if (ctx->cache_writer) block_cache_write(ctx->cache_writer, data, size);
+    if (ctx->cipher_active) {
+        return ISeqOutStream_Write(&ctx->cipher.vt, data, size) == size;
+    }
+    return write_packed(ctx, data, size);
+}
+
+#if USE_MMAP
+/* Stored data is checksummed and copied in steps of this size, so each step
+ * is still in the page cache when the kernel copies it */
+#define STORE_MAP_CHUNK_SIZE (8 * 1024 * 1024)
+
+#if USE_KERNEL_COPY
+/* Copy up to `len` bytes from `in_fd` at `*in_off` to the end of `out_fd`.
+ * copy_file_range can share extents or stay in the page cache; sendfile is
+ * the fallback on kernels or filesystem pairs that reject it. */
+static ssize_t kernel_copy(int in_fd, off_t* in_off, int out_fd, size_t len, int* use_copy_file_range) {
+#ifdef SYS_copy_file_range
+    if (*use_copy_file_range) {
+        ssize_t n = (ssize_t)syscall(SYS_copy_file_range, in_fd, in_off, out_fd, NULL, len, 0);
+        if (n > 0) return n;
+        if (n < 0 && errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP) {
+            return n;
+        }
+        *use_copy_file_range = 0;
+    }
+#else
+    (void)use_copy_file_range;
+#endif
+    return sendfile(out_fd, in_fd, in_off, len);
+}
+#endif
+
+/* Write a mapped file across volumes, computing its CRC (and SHA-256)
+ * from the mapping
+ *
+ * With USE_KERNEL_COPY the bytes go file-to-file inside the kernel and
+ * never pass through a user-space buffer; otherwise (or if the kernel
+ * refuses) they are written straight from the mapping. The CRC of each
+ * chunk runs on ctx->crc_stage while the chunk is copied; the caller
+ * syncs the stage before unmapping.
+ */
+static int store_mapped_across_volumes(MultiVolumeContext* ctx, int in_fd, const Byte* mapped,
+                                       uint64_t size, uint32_t* crc, FileDigestSlot* digest_slot) {
+    uint64_t offset = 0;
+    /* Queued bytes go first, then this thread owns the volume files */
+    if (!VolumeWriter_Drain(ctx)) return 0;
+    ReadHints hints;
+    read_hints_begin(&hints, in_fd, mapped, size, ctx->input_hints);
+    crc_stage_begin_digest(&ctx->crc_stage, size, NULL, digest_slot);
+#if USE_KERNEL_COPY
+    int use_kernel_copy = !ctx->sink;
+    int use_copy_file_range = 1;
+#else
+    (void)in_fd;
+#endif
+
+    while (offset < size) {
+        if (cancel_token_requested(ctx->cancel)) return 0;
+        if (ctx->volume_count == 0 || ctx->current_volume_size >= ctx->max_volume_size) {
+            if (!open_new_volume(ctx)) return 0;
+        }
+        FILE* current = ctx->volumes[ctx->volume_count - 1];
+
+        uint64_t chunk = size - offset;
+        uint64_t space_in_volume = ctx->max_volume_size - ctx->current_volume_size;
+        if (chunk > space_in_volume) chunk = space_in_volume;
+        if (chunk > STORE_MAP_CHUNK_SIZE) chunk = STORE_MAP_CHUNK_SIZE;
+
+        /* The chunk counts as read and as written */
+        rate_limit_take(ctx->rate_limit, RATE_LIMIT_READ, chunk, ctx->cancel);
+        rate_limit_take(ctx->rate_limit, RATE_LIMIT_WRITE, chunk, ctx->cancel);
+        crc_stage_update(&ctx->crc_stage, mapped + offset, (size_t)chunk);
+        mv_volume_digest_update(ctx, mapped + offset, (size_t)chunk);
+        if (!mv_parity_update(ctx, mapped + offset, (size_t)chunk)) return 0;
+
+        /* Reading the mapping and writing the volume are one step here */
+        OpStatsTimer timer;
+        op_stats_io_begin(&ctx->stats, &timer);
+        TRACE_BEGIN(copy);
+        uint64_t done = 0;
+#if USE_KERNEL_COPY
+        if (use_kernel_copy) {
+            /* Buffered header bytes must reach the file before the kernel appends */
+            if (fflush(current) != 0) return 0;
+            int out_fd = fileno(current);
+            while (done < chunk) {
+                off_t in_off = (off_t)(offset + done);
+                ssize_t n = kernel_copy(in_fd, &in_off, out_fd, (size_t)(chunk - done),
+                                        &use_copy_file_range);
+                if (n <= 0) {
+                    use_kernel_copy = 0;
+                    break;
+                }
+                done += (uint64_t)n;
+            }
+            /* Resync stdio with the descriptor's new position (not the
+               end of file, which preallocation has moved out) */
+            if (fseeko(current, (off_t)(ctx->current_volume_size + done), SEEK_SET) != 0) return 0;
+        }
+#endif
+        if (done < chunk && !volume_append(ctx, current, mapped + offset + done, (size_t)(chunk - done))) {
+            return 0;
+        }
+        TRACE_END(copy, TRACE_WRITE, chunk);
+        op_stats_io_end(&ctx->stats, &timer, SEVENZIP_PHASE_WRITE, chunk);
+        op_stats_add_bytes(&ctx->stats, chunk, 0);
+
+        offset += chunk;
+        ctx->current_volume_size += chunk;
+        ctx->bytes_written += chunk;
+        /* Pages are dropped only once the stage is done with them */
+        if (hints.fd >= 0 || hints.mapping) crc_stage_sync(&ctx->crc_stage);
+        read_hints_advance(&hints, offset);
+        progress_reporter_add(&ctx->progress, chunk);
+    }
+    crc_stage_end(&ctx->crc_stage, crc);
+    crc_stage_sync(&ctx->crc_stage);
+    read_hints_end(&hints);
+    return 1;
+}
+#endif
+
+/* ============================================================================
+ * Streaming interfaces for LZMA2 encoding
+ * ============================================================================ */
+
+/* Large read buffer size for optimal I/O throughput */
+#define STREAM_BUFFER_SIZE (32 * 1024 * 1024)  /* 32MB buffer - better I/O batching */
+
+/* Get the archive's encoder, configured for the next `data_size` bytes
+ * Lzma2Enc_SetProps resets the handle; its match-finder tables and
+ * (multithreaded) coder state are kept and reused when the sizes match. */
+static SRes mv_cache_encoder(MultiVolumeContext* ctx, const CLzma2EncProps* props,
+                             uint64_t data_size, CLzma2EncHandle* out_enc) {
+    if (!ctx->cache.enc) {
+        ctx->cache.enc = ctx->placed
+            ? Lzma2Enc_Create(&ctx->placer.small, &ctx->placer.big)
+            : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+        if (!ctx->cache.enc) return SZ_ERROR_MEM;
+    }
+    
+    /* Set expected data size - helps encoder optimize block threading */
+    Lzma2Enc_SetDataSize(ctx->cache.enc, data_size);
+    SRes res = Lzma2Enc_SetProps(ctx->cache.enc, props);
+    if (res != SZ_OK) return res;
+    
+    *out_enc = ctx->cache.enc;
+    return SZ_OK;
+}
+
+/* Get one of the archive's stream buffers (NULL on allocation failure) */
+static Byte* mv_cache_buffer(MV_EncoderCache* cache, Byte** slot) {
+    if (!*slot) {
+        *slot = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, cache->buffer_size);
+    }
+    return *slot;
+}
+
+static void mv_cache_free(MV_EncoderCache* cache) {
+    if (cache->enc) Lzma2Enc_Destroy(cache->enc);
+    mem_free(cache->out_buffer);
+    mem_free(cache->in_buffer);
+    memset(cache, 0, sizeof(*cache));
+}
+
+#if USE_MMAP
+/* Memory-mapped input stream - FASTEST possible I/O */
+typedef struct {
+    ISeqInStream vt;       /* Virtual table - MUST be first! */
+    const Byte* data;      /* Memory-mapped data */
+    uint64_t size;         /* Total file size */
+    uint64_t pos;          /* Current position */
+    CrcStage* crc_stage;   /* Checksums the ranges handed out */
+    int fd;                /* File descriptor for cleanup */
+    ReadHints hints;       /* Advanced by crc_stage */
+    SevenZipRateLimit* rate_limit;  /* Copies count as reads */
+    const SevenZipCancelToken* cancel;
+} MmapInStream;
 
 /* ISeqInStream::Read for mmap - zero-copy reads! */
 static SRes MmapInStream_Read(const ISeqInStream *p, void *buf, size_t *size) {
@@ -450,13 +1583,14 @@ static SRes MmapInStream_Read(const ISeqInStream *p, void *buf, size_t *size) {
         return SZ_OK;
     }
     
-    /* Direct memory copy - no system calls! */
+    /* Direct memory copy - no system calls! (page faults are the read) */
+    rate_limit_take(s->rate_limit, RATE_LIMIT_READ, to_read, s->cancel);
+    TRACE_BEGIN(read);
     memcpy(buf, s->data + s->pos, to_read);
+    TRACE_END(read, TRACE_READ, to_read);
     
-    /* Update CRC */
-    if (s->crc) {
-        *s->crc = CrcUpdate(*s->crc, s->data + s->pos, to_read);
-    }
+    /* The mapping outlives the encode, so the range is checksummed behind us */
+    crc_stage_update(s->crc_stage, s->data + s->pos, to_read);
     
     s->pos += to_read;
     *size = to_read;
@@ -469,11 +1603,16 @@ typedef struct {
     ISeqInStream vt;       /* Virtual table - MUST be first! */
     FILE* file;
     uint64_t remaining;
-    uint32_t* crc;         /* Pointer to CRC accumulator */
+    CrcStage* crc_stage;   /* Checksums each buffer fill */
     /* Buffered reading for better I/O performance */
     Byte* buffer;
+    size_t capacity;       /* Size of buffer */
     size_t buf_size;
     size_t buf_pos;
+    ReadHints hints;
+    uint64_t file_pos;     /* Bytes read from the file so far */
+    SevenZipRateLimit* rate_limit;
+    const SevenZipCancelToken* cancel;
 } FileInStream;
 
 /* Output stream context for writing to multi-volume archive */
@@ -507,14 +1646,22 @@ static SRes FileInStream_Read(const ISeqInStream *p, void *buf, size_t *size) {
     while (total_read < requested) {
         /* Refill buffer if empty */
         if (s->buf_pos >= s->buf_size) {
-            size_t to_read = STREAM_BUFFER_SIZE;
+            size_t to_read = s->capacity;
             if (to_read > s->remaining - total_read) {
                 to_read = (size_t)(s->remaining - total_read);
             }
             if (to_read == 0) break;
             
+            /* The previous fill must be checksummed before it is overwritten */
+            crc_stage_sync(s->crc_stage);
+            rate_limit_take(s->rate_limit, RATE_LIMIT_READ, to_read, s->cancel);
+            TRACE_BEGIN(read);
             s->buf_size = fread(s->buffer, 1, to_read, s->file);
+            TRACE_END(read, TRACE_READ, s->buf_size);
             s->buf_pos = 0;
+            s->file_pos += s->buf_size;
+            read_hints_advance(&s->hints, s->file_pos);
+            crc_stage_update(s->crc_stage, s->buffer, s->buf_size);
             
             if (s->buf_size == 0) break;
         }
@@ -526,11 +1673,6 @@ static SRes FileInStream_Read(const ISeqInStream *p, void *buf, size_t *size) {
         
         memcpy(dst + total_read, s->buffer + s->buf_pos, copy);
         
-        /* Update CRC incrementally */
-        if (s->crc) {
-            *s->crc = CrcUpdate(*s->crc, s->buffer + s->buf_pos, copy);
-        }
-        
         s->buf_pos += copy;
         total_read += copy;
     }
@@ -558,7 +1700,7 @@ static size_t VolumeOutStream_Write(const ISeqOutStream *p, const void *buf, siz
     VolumeOutStream *s = (VolumeOutStream *)p;
     
     /* For large writes, bypass buffer and write directly */
-    if (size >= STREAM_BUFFER_SIZE) {
+    if (size >= s->buf_size) {
         /* Flush existing buffer first */
         if (!VolumeOutStream_Flush(s)) return 0;
         
@@ -574,7 +1716,7 @@ static size_t VolumeOutStream_Write(const ISeqOutStream *p, const void *buf, siz
     size_t remaining = size;
     
     while (remaining > 0) {
-        size_t space = STREAM_BUFFER_SIZE - s->buf_pos;
+        size_t space = s->buf_size - s->buf_pos;
         size_t copy = (remaining < space) ? remaining : space;
         
         memcpy(s->buffer + s->buf_pos, src, copy);
@@ -583,7 +1725,7 @@ static size_t VolumeOutStream_Write(const ISeqOutStream *p, const void *buf, siz
         remaining -= copy;
         
         /* Flush if full */
-        if (s->buf_pos >= STREAM_BUFFER_SIZE) {
+        if (s->buf_pos >= s->buf_size) {
             if (!VolumeOutStream_Flush(s)) return 0;
         }
     }
@@ -591,33 +1733,6 @@ static size_t VolumeOutStream_Write(const ISeqOutStream *p, const void *buf, siz
     return size;
 }
 
-/* Test if data is compressible by checking entropy
- * Returns 1 if data appears compressible, 0 if it looks like random/encrypted data
- */
-static int is_data_compressible(const Byte* data, size_t size) {
-    if (size < 1024) return 1;  /* Small data - just compress it */
-    
-    /* Sample up to 64KB */
-    size_t sample_size = (size < 65536) ? size : 65536;
-    
-    /* Count byte frequencies */
-    size_t freq[256] = {0};
-    for (size_t i = 0; i < sample_size; i++) {
-        freq[data[i]]++;
-    }
-    
-    /* Calculate entropy estimate - count unique bytes with significant frequency */
-    int unique_bytes = 0;
-    size_t threshold = sample_size / 512;  /* 0.2% threshold = 128 for 64KB sample */
-    for (int i = 0; i < 256; i++) {
-        if (freq[i] > threshold) unique_bytes++;
-    }
-    
-    /* If >200 unique bytes appear frequently, data is likely incompressible (random/encrypted) */
-    /* Typical text has ~60-100 unique frequent bytes */
-    return unique_bytes < 200;
-}
-
 /* Store file without compression (fast copy) */
 static SRes store_file_uncompressed(
     const char* file_path,
@@ -625,19 +1740,55 @@ static SRes store_file_uncompressed(
     uint64_t file_size,
     MultiVolumeContext* ctx,
     uint32_t* out_crc,
+    FileDigestSlot* out_digest,  /* NULL = CRC only */
     uint64_t* out_packed_size
 ) {
-    uint32_t crc = CRC_INIT_VAL;
+    uint32_t crc = 0;  /* Digest, stored by ctx->crc_stage */
+    
+#if USE_MMAP
+    /* Map the file ourselves so the copy can stay in the kernel
+       (not for unbuffered volumes, whose writes must stay aligned, nor
+       for encrypted ones, whose bytes must pass through the cipher) */
+    if (!mapped_data && file_size > 0 && !ctx->unbuffered && !ctx->cipher_active) {
+        int fd = open(file_path, O_RDONLY);
+        void* mapped = (fd >= 0)
+            ? mmap(NULL, file_size, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0)
+            : MAP_FAILED;
+        if (mapped != MAP_FAILED) {
+            /* Hinted reads request and drop the mapping window by window */
+            if (!ctx->input_hints) madvise(mapped, file_size, MADV_SEQUENTIAL);
+            int ok = store_mapped_across_volumes(ctx, fd, (const Byte*)mapped, file_size, &crc,
+                                                 out_digest);
+            crc_stage_sync(&ctx->crc_stage);
+            munmap(mapped, file_size);
+            close(fd);
+            if (!ok) return SZ_ERROR_WRITE;
+            
+            *out_crc = crc;
+            *out_packed_size = file_size;
+            return SZ_OK;
+        }
+        if (fd >= 0) close(fd);
+        /* Not mappable (e.g. special file): use the buffered copy below */
+    }
+#endif
     
     if (mapped_data) {
-        /* Fast path: data is already mapped */
-        crc = CrcUpdate(crc, mapped_data, file_size);
-        if (!write_across_volumes(ctx, mapped_data, file_size)) {
+        /* Fast path: data is already mapped (checksummed while it is copied out) */
+        crc_stage_begin_digest(&ctx->crc_stage, file_size, NULL, out_digest);
+        rate_limit_take(ctx->rate_limit, RATE_LIMIT_READ, file_size, ctx->cancel);
+        crc_stage_update(&ctx->crc_stage, mapped_data, (size_t)file_size);
+        op_stats_add_bytes(&ctx->stats, file_size, 0);
+        int ok = write_across_volumes(ctx, mapped_data, file_size);
+        progress_reporter_add(&ctx->progress, file_size);
+        crc_stage_end(&ctx->crc_stage, &crc);
+        crc_stage_sync(&ctx->crc_stage);
+        if (!ok) {
             return SZ_ERROR_WRITE;
         }
     } else {
         /* Fallback: read file in chunks */
-        FILE* f = fopen(file_path, "rb");
+        FILE* f = fopen(file_path, READ_HINTS_FOPEN_MODE);
         if (!f) {
             fprintf(stderr, "DEBUG: Cannot open file: %s\n", file_path);
             return SZ_ERROR_READ;
@@ -645,276 +1796,568 @@ static SRes store_file_uncompressed(
         
         /* Use 64KB buffer for very large files to reduce memory pressure */
         size_t buf_size = (file_size > 4ULL * 1024 * 1024 * 1024) ? 
-                          (64 * 1024) : STREAM_BUFFER_SIZE;
-        Byte* buffer = (Byte*)malloc(buf_size);
+                          (64 * 1024) : ctx->cache.buffer_size;
+        Byte* buffer = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, buf_size);
         if (!buffer) {
             fclose(f);
             return SZ_ERROR_MEM;
         }
         
+        ReadHints hints;
+        read_hints_begin_file(&hints, f, file_size, ctx->input_hints);
+        crc_stage_begin_digest(&ctx->crc_stage, file_size, NULL, out_digest);
+        
         uint64_t remaining = file_size;
         uint64_t total_read = 0;
         while (remaining > 0) {
             size_t to_read = (remaining < buf_size) ? (size_t)remaining : buf_size;
+            /* The previous chunk must be checksummed before it is overwritten */
+            crc_stage_sync(&ctx->crc_stage);
+            if (cancel_token_requested(ctx->cancel)) {
+                mem_free(buffer);
+                fclose(f);
+                return SZ_ERROR_PROGRESS;
+            }
+            rate_limit_take(ctx->rate_limit, RATE_LIMIT_READ, to_read, ctx->cancel);
+            OpStatsTimer timer;
+            op_stats_io_begin(&ctx->stats, &timer);
+            TRACE_BEGIN(read);
             size_t got = fread(buffer, 1, to_read, f);
+            TRACE_END(read, TRACE_READ, got);
+            op_stats_io_end(&ctx->stats, &timer, SEVENZIP_PHASE_READ, got);
             if (got == 0) {
                 if (ferror(f)) {
                     fprintf(stderr, "DEBUG: Read error at offset %llu\n", total_read);
-                    free(buffer);
+                    mem_free(buffer);
                     fclose(f);
                     return SZ_ERROR_READ;
                 }
                 break;  /* EOF */
             }
             
-            crc = CrcUpdate(crc, buffer, got);
+            crc_stage_update(&ctx->crc_stage, buffer, got);
             if (!write_across_volumes(ctx, buffer, got)) {
                 fprintf(stderr, "DEBUG: Write error at offset %llu\n", total_read);
-                free(buffer);
+                crc_stage_sync(&ctx->crc_stage);
+                mem_free(buffer);
                 fclose(f);
                 return SZ_ERROR_WRITE;
             }
             remaining -= got;
             total_read += got;
+            read_hints_advance(&hints, total_read);
+            progress_reporter_add(&ctx->progress, got);
         }
-        free(buffer);
+        crc_stage_end(&ctx->crc_stage, &crc);
+        crc_stage_sync(&ctx->crc_stage);
+        read_hints_end(&hints);
+        mem_free(buffer);
         fclose(f);
     }
     
-    *out_crc = CRC_GET_DIGEST(crc);
+    *out_crc = crc;
     *out_packed_size = file_size;  /* No compression */
     return SZ_OK;
 }
 
-/* Compress file and write to volumes using proper streaming */
-static SRes compress_file_streaming(
-    const char* file_path,
-    MultiVolumeContext* ctx,
-    const CLzma2EncProps* props,
-    uint32_t* out_crc,
-    uint64_t* out_packed_size,
-    Byte* out_prop
-) {
-    struct STAT st;
-    if (STAT(file_path, &st) != 0) return SZ_ERROR_READ;
-    uint64_t file_size = st.st_size;
-    
-#if USE_MMAP
-    /* Try memory-mapped I/O for maximum speed */
-    int fd = open(file_path, O_RDONLY);
-    if (fd < 0) return SZ_ERROR_READ;
-    
-    /* Use mmap for files - enables zero-copy reads */
-    void* mapped = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
-    if (mapped == MAP_FAILED) {
-        close(fd);
-        /* Fall back to FILE* based reading */
-        goto fallback_read;
-    }
-    
-    /* Advise kernel we'll read sequentially */
-    madvise(mapped, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
-    
-    /* ADAPTIVE: Check if data is compressible */
-    /* For large files (>1MB), if data looks random, skip compression */
-    int compressible = is_data_compressible((const Byte*)mapped, file_size);
-    if (file_size > 1024 * 1024 && !compressible) {
-        /* Data appears incompressible - use store mode for MASSIVE speed gain */
-        *out_prop = 0;  /* Store indicator */
-        SRes res = store_file_uncompressed(file_path, (const Byte*)mapped, file_size, ctx, out_crc, out_packed_size);
-        munmap(mapped, file_size);
-        close(fd);
-        return res;
-    }
-    
-    /* Create encoder */
-    CLzma2EncHandle enc = Lzma2Enc_Create(&g_Alloc, &g_BigAlloc);
-    if (!enc) {
-        munmap(mapped, file_size);
-        close(fd);
-        return SZ_ERROR_MEM;
+/* Read-ahead stage for the solid input stream
+ *
+ * A reader thread opens, reads and CRCs (and hashes, where a file has a
+ * digest slot) upcoming files into a bounded ring
+ * of blocks while the encoder consumes the current one, so file opens and
+ * cold-cache reads no longer stall the LZMA2 pipeline. Runs of files of up
+ * to SMALL_FILE_MAX are read a batch at a time (small_file_batch.h), so a
+ * tree of small files does not pay its open and read latency file by file,
+ * and a hard link right behind another name of its file is not read at all
+ * when that name's data is one slot.
+ */
+#define PREFETCH_BLOCK_SIZE (4 * 1024 * 1024)  /* 4MB per ring slot */
+
+typedef struct {
+    Byte* data;
+    size_t size;
+    size_t file_index;
+    SRes error;   /* SZ_OK, or the read error that ended the stream */
+    int eof;      /* 1 = no more data after this slot */
+} PrefetchBlock;
+
+typedef struct {
+    PrefetchBlock* blocks;
+    UInt32 count;
+    UInt32 head;          /* Next slot to consume */
+    UInt32 tail;          /* Next slot to fill (reader thread only) */
+    size_t head_pos;      /* Consumer offset inside blocks[head] */
+    int head_valid;       /* blocks[head] has been acquired by the consumer */
+    int finished;         /* Consumer saw the eof slot */
+    CSemaphore free_slots;
+    CSemaphore filled_slots;
+    CThread thread;
+    volatile int stop;
+    MV_FileEntry* files;
+    size_t file_count;
+    uint32_t* file_crcs;
+    int input_hints;
+    OpStats* stats;
+    SevenZipRateLimit* rate_limit;
+    const SevenZipCancelToken* cancel;  /* Ends waits for rate_limit */
+} SolidPrefetch;
+
+/* Input stream that reads from multiple files sequentially (for solid compression) */
+typedef struct {
+    ISeqInStream vt;
+    MV_FileEntry* files;
+    size_t file_count;
+    size_t current_file;
+    FILE* current_fp;
+    uint64_t current_file_remaining;
+    uint32_t* file_crcs;  /* Array to store per-file CRCs */
+    uint32_t current_crc;
+    FileDigest current_digest;  /* Inline, of files with a digest slot */
+    MultiVolumeContext* ctx;
+    ProgressReporter* progress;  /* NULL = not reported per read */
+    uint64_t total_read;
+    SolidPrefetch* prefetch;  /* NULL = read on the encoder thread */
+    uint64_t current_file_read;
+    int input_hints;
+    ReadHints hints;          /* Of current_fp */
+    SparseInput sparse;       /* Reads of current_fp, its holes not read */
+    DeviceInput device;       /* Reads of current_fp when it is a device */
+    /* Set: CRCs run on the stage over reads staged in stage_buf
+       (CRC_STAGE_BUFFER_SIZE); NULL: inline on the reading thread */
+    CrcStage* crc_stage;
+    Byte* stage_buf;
+    size_t stage_size;
+    size_t stage_pos;
+    OpStats* stats;           /* Times the reads (NULL = not timed) */
+    const SevenZipCancelToken* cancel;  /* Reads fail with SZ_ERROR_PROGRESS once cancelled */
+    SevenZipRateLimit* rate_limit;      /* Reads wait for its budget (NULL = unlimited) */
+    uint64_t range_offset;    /* Block task: read range_size bytes of files[0] from here */
+    uint64_t range_size;      /* 0 = whole files */
+} SolidInStream;
+
+static void SolidInStream_CloseFile(SolidInStream* s) {
+    FileDigestSlot* slot = s->files[s->current_file].digest_slot;
+    if (s->crc_stage) {
+        crc_stage_end(s->crc_stage, &s->file_crcs[s->current_file]);
+    } else {
+        s->file_crcs[s->current_file] = CRC_GET_DIGEST(s->current_crc);
+        if (slot) file_digest_final(&s->current_digest, slot);
     }
-    
-    /* Set expected data size - helps encoder optimize block threading */
-    Lzma2Enc_SetDataSize(enc, file_size);
-    
-    SRes res = Lzma2Enc_SetProps(enc, props);
-    if (res != SZ_OK) {
-        Lzma2Enc_Destroy(enc);
-        munmap(mapped, file_size);
-        close(fd);
-        return res;
+    read_hints_end(&s->hints);
+    if (s->files[s->current_file].device) device_input_end(&s->device);
+    fclose(s->current_fp);
+    s->current_fp = NULL;
+}
+
+/* The next bytes of current_fp, from the device or around the file's holes */
+static size_t SolidInStream_ReadSource(SolidInStream* s, Byte* out, size_t size) {
+    rate_limit_take(s->rate_limit, RATE_LIMIT_READ, size, s->cancel);
+    return s->files[s->current_file].device ? device_input_read(&s->device, out, size)
+                                            : sparse_input_read(&s->sparse, out, size);
+}
+
+/* Read the next bytes of current_fp (at most `size`, within the file) */
+static size_t SolidInStream_ReadFile(SolidInStream* s, Byte* out, size_t size) {
+    OpStatsTimer timer;
+    if (!s->crc_stage) {
+        op_stats_io_begin(s->stats, &timer);
+        TRACE_BEGIN(read);
+        size_t got = SolidInStream_ReadSource(s, out, size);
+        TRACE_END(read, TRACE_READ, got);
+        op_stats_io_end(s->stats, &timer, SEVENZIP_PHASE_READ, got);
+        s->current_crc = CrcUpdate(s->current_crc, out, got);
+        if (s->files[s->current_file].digest_slot) file_digest_update(&s->current_digest, out, got);
+        return got;
     }
     
-    Byte prop = Lzma2Enc_WriteProperties(enc);
-    *out_prop = prop;
-    
-    uint32_t crc = CRC_INIT_VAL;
-    uint64_t packed_size = 0;
-    
-    /* Allocate output buffer */
-    Byte* out_buffer = (Byte*)malloc(STREAM_BUFFER_SIZE);
-    if (!out_buffer) {
-        Lzma2Enc_Destroy(enc);
-        munmap(mapped, file_size);
-        close(fd);
-        return SZ_ERROR_MEM;
+    if (s->stage_pos == s->stage_size) {
+        /* The previous fill must be checksummed before it is overwritten */
+        crc_stage_sync(s->crc_stage);
+        size_t fill = CRC_STAGE_BUFFER_SIZE;
+        if (fill > s->current_file_remaining) fill = (size_t)s->current_file_remaining;
+        op_stats_io_begin(s->stats, &timer);
+        TRACE_BEGIN(read);
+        s->stage_size = SolidInStream_ReadSource(s, s->stage_buf, fill);
+        TRACE_END(read, TRACE_READ, s->stage_size);
+        op_stats_io_end(s->stats, &timer, SEVENZIP_PHASE_READ, s->stage_size);
+        s->stage_pos = 0;
+        crc_stage_update(s->crc_stage, s->stage_buf, s->stage_size);
     }
     
-    /* Setup mmap input stream - zero-copy! */
-    MmapInStream inStream;
-    inStream.vt.Read = MmapInStream_Read;
-    inStream.data = (const Byte*)mapped;
-    inStream.size = file_size;
-    inStream.pos = 0;
-    inStream.crc = &crc;
-    inStream.fd = fd;
-    
-    /* Setup output stream */
-    VolumeOutStream outStream;
-    outStream.vt.Write = VolumeOutStream_Write;
-    outStream.ctx = ctx;
-    outStream.packed_size = &packed_size;
-    outStream.buffer = out_buffer;
-    outStream.buf_size = STREAM_BUFFER_SIZE;
-    outStream.buf_pos = 0;
-    
-    /* Encode using streaming */
-    res = Lzma2Enc_Encode2(enc,
-        &outStream.vt, NULL, NULL,
-        &inStream.vt, NULL, 0,
-        NULL);
-    
-    if (res == SZ_OK) {
-        VolumeOutStream_Flush(&outStream);
+    size_t got = s->stage_size - s->stage_pos;
+    if (got > size) got = size;
+    memcpy(out, s->stage_buf + s->stage_pos, got);
+    s->stage_pos += got;
+    return got;
+}
+
+/* Whether the reader thread reads a file in a small-file batch */
+static int SolidPrefetch_IsSmall(const MV_FileEntry* entry) {
+    return !entry->is_dir && entry->full_path && !entry->device && entry->size <= SMALL_FILE_MAX;
+}
+
+/* Whether files[i] is another name of the file before it */
+static int SolidPrefetch_IsLink(const SolidPrefetch* pf, size_t i) {
+    if (i == 0) return 0;
+    const MV_FileEntry* entry = &pf->files[i];
+    const MV_FileEntry* prev = &pf->files[i - 1];
+    return entry->hard_linked && entry->inode != 0 && !entry->device &&
+           entry->inode == prev->inode && entry->dev == prev->dev;
+}
+
+/* Whether the data of files[i], a link, is the slot filled last: the
+ * one slot of the name before it */
+static int SolidPrefetch_Repeats(const SolidPrefetch* pf, size_t i) {
+    if (!SolidPrefetch_IsLink(pf, i)) return 0;
+    uint64_t size = pf->files[i].size;
+    const PrefetchBlock* last = &pf->blocks[(pf->tail + pf->count - 1) % pf->count];
+    return size > 0 && size == pf->files[i - 1].size && size <= PREFETCH_BLOCK_SIZE &&
+           !last->eof && last->file_index == i - 1 && last->size == size;
+}
+
+/* Reader thread: hand files[i] over again from the slot filled last,
+ * which only this thread writes, instead of reading the inode again
+ * @return 0 once stopped */
+static int SolidPrefetch_Repeat(SolidPrefetch* pf, size_t i) {
+    UInt32 last = (pf->tail + pf->count - 1) % pf->count;
+    Semaphore_Wait(&pf->free_slots);
+    if (pf->stop) return 0;
+    PrefetchBlock* blk = &pf->blocks[pf->tail];
+    if (pf->tail != last) memcpy(blk->data, pf->blocks[last].data, pf->blocks[last].size);
+    blk->size = pf->blocks[last].size;
+    blk->file_index = i;
+    blk->error = SZ_OK;
+    blk->eof = 0;
+    
+    MV_FileEntry* entry = &pf->files[i];
+    pf->file_crcs[i] = pf->file_crcs[i - 1];
+    if (entry->digest_slot) {
+        FileDigest digest;
+        file_digest_init(&digest, entry->digest_slot->algorithm);
+        file_digest_update(&digest, blk->data, blk->size);
+        file_digest_final(&digest, entry->digest_slot);
     }
-    
-    free(out_buffer);
-    Lzma2Enc_Destroy(enc);
-    munmap(mapped, file_size);
-    close(fd);
-    
-    if (res != SZ_OK) return res;
-    
-    *out_crc = CRC_GET_DIGEST(crc);
-    *out_packed_size = packed_size;
-    return SZ_OK;
+    pf->tail = (pf->tail + 1) % pf->count;
+    Semaphore_Release1(&pf->filled_slots);
+    return 1;
+}
 
-fallback_read:
-    ; /* Empty statement after label */
-#endif
-    {
-        /* Fallback: FILE* based reading */
-        FILE* in_file = fopen(file_path, "rb");
-        if (!in_file) return SZ_ERROR_READ;
-        
-        /* Use larger buffer for faster I/O */
-        setvbuf(in_file, NULL, _IOFBF, 1024 * 1024);
-        
-        /* Create encoder */
-        CLzma2EncHandle enc2 = Lzma2Enc_Create(&g_Alloc, &g_BigAlloc);
-        if (!enc2) {
-            fclose(in_file);
-            return SZ_ERROR_MEM;
+/*
+ * Reader thread: read the run of small files from `*next` in one batch
+ * and hand each to a slot; directories in the run are passed over.
+ * *next ends past the run.
+ * @return 0 once stopped, else 1 with *error set on a failed read
+ */
+static int SolidPrefetch_ReadSmall(SolidPrefetch* pf, SmallFileBatch* batch,
+                                   SmallFileRead* reads, size_t* next, SRes* error) {
+    size_t first = *next;
+    size_t end = first;
+    size_t count = 0;
+    uint64_t bytes = 0;
+    while (end < pf->file_count && count < SMALL_BATCH_FILES) {
+        MV_FileEntry* entry = &pf->files[end];
+        if (entry->is_dir || !entry->full_path) {
+            end++;
+            continue;
         }
-        
-        /* Set expected data size - helps encoder optimize block threading */
-        Lzma2Enc_SetDataSize(enc2, file_size);
-        
-        SRes res2 = Lzma2Enc_SetProps(enc2, props);
-        if (res2 != SZ_OK) {
-            Lzma2Enc_Destroy(enc2);
-            fclose(in_file);
-            return res2;
+        if (!SolidPrefetch_IsSmall(entry) || bytes + entry->size > SMALL_BATCH_BYTES) break;
+        if (end > first && SolidPrefetch_IsLink(pf, end)) break;  /* Repeated, not read */
+        reads[count].path = entry->full_path;
+        reads[count].size = (size_t)entry->size;
+        bytes += entry->size;
+        count++;
+        end++;
+    }
+    *next = end;
+    
+    rate_limit_take(pf->rate_limit, RATE_LIMIT_READ, bytes, pf->cancel);
+    OpStatsTimer timer;
+    op_stats_io_begin(pf->stats, &timer);
+    TRACE_BEGIN(read);
+    small_batch_read(batch, reads, count);
+    TRACE_END(read, TRACE_READ, bytes);
+    op_stats_io_end(pf->stats, &timer, SEVENZIP_PHASE_READ, bytes);
+    
+    size_t k = 0;
+    for (size_t i = first; i < end; i++) {
+        MV_FileEntry* entry = &pf->files[i];
+        if (entry->is_dir || !entry->full_path) {
+            pf->file_crcs[i] = 0;
+            continue;
         }
-        
-        /* Get LZMA2 properties byte (for header, not for stream) */
-        Byte prop2 = Lzma2Enc_WriteProperties(enc2);
-        *out_prop = prop2;
-        
-        /* Initialize CRC */
-        uint32_t crc2 = CRC_INIT_VAL;
-        uint64_t packed_size2 = 0;
-        
-        /* Allocate I/O buffers for optimal performance */
-        Byte* in_buffer = (Byte*)malloc(STREAM_BUFFER_SIZE);
-        Byte* out_buffer2 = (Byte*)malloc(STREAM_BUFFER_SIZE);
-        if (!in_buffer || !out_buffer2) {
-            free(in_buffer);
-            free(out_buffer2);
-            Lzma2Enc_Destroy(enc2);
-            fclose(in_file);
-            return SZ_ERROR_MEM;
+        SmallFileRead* read = &reads[k++];
+        if (read->failed) {
+            /* Gone or shrunk since the scan - header sizes would be wrong */
+            *error = SZ_ERROR_READ;
+            return 1;
         }
-        
-        /* Setup input stream with buffering */
-        FileInStream fileInStream;
-        fileInStream.vt.Read = FileInStream_Read;
-        fileInStream.file = in_file;
-        fileInStream.remaining = file_size;
-        fileInStream.crc = &crc2;
-        fileInStream.buffer = in_buffer;
-        fileInStream.buf_size = 0;
-        fileInStream.buf_pos = 0;
-        
-        /* Setup output stream with buffering */
-        VolumeOutStream outStream2;
-        outStream2.vt.Write = VolumeOutStream_Write;
-        outStream2.ctx = ctx;
-        outStream2.packed_size = &packed_size2;
-        outStream2.buffer = out_buffer2;
-        outStream2.buf_size = STREAM_BUFFER_SIZE;
-        outStream2.buf_pos = 0;
-        
-        /* Encode entire file using streaming interface */
-        res2 = Lzma2Enc_Encode2(enc2,
-            &outStream2.vt,    /* Output stream */
-            NULL, NULL,       /* No output buffer */
-            &fileInStream.vt, /* Input stream */
-            NULL, 0,          /* No input buffer */
-            NULL);            /* No progress */
-        
-        /* Flush any remaining data in output buffer */
-        if (res2 == SZ_OK) {
-            VolumeOutStream_Flush(&outStream2);
+        pf->file_crcs[i] = CrcCalc(read->data, read->size);
+        if (entry->digest_slot) {
+            FileDigest digest;
+            file_digest_init(&digest, entry->digest_slot->algorithm);
+            file_digest_update(&digest, read->data, read->size);
+            file_digest_final(&digest, entry->digest_slot);
         }
+        if (read->size == 0) continue;
         
-        /* Cleanup */
-        free(in_buffer);
-        free(out_buffer2);
-        Lzma2Enc_Destroy(enc2);
-        fclose(in_file);
+        Semaphore_Wait(&pf->free_slots);
+        if (pf->stop) return 0;
+        PrefetchBlock* blk = &pf->blocks[pf->tail];
+        memcpy(blk->data, read->data, read->size);
+        blk->size = read->size;
+        blk->file_index = i;
+        blk->error = SZ_OK;
+        blk->eof = 0;
+        pf->tail = (pf->tail + 1) % pf->count;
+        Semaphore_Release1(&pf->filled_slots);
+    }
+    return 1;
+}
+
+/* Reader thread: fill ring slots with file data in archive order */
+static THREAD_FUNC_DECL SolidPrefetch_Thread(void* arg) {
+    SolidPrefetch* pf = (SolidPrefetch*)arg;
+    thread_sched_enter();
+    SRes error = SZ_OK;
+    SmallFileBatch batch;
+    SmallFileRead* reads = NULL;
+    int batched = small_batch_init(&batch) == SZ_OK;
+    if (batched) {
+        reads = (SmallFileRead*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, SMALL_BATCH_FILES * sizeof(SmallFileRead));
+        batched = reads != NULL;
+    }
+    
+    for (size_t i = 0; i < pf->file_count && error == SZ_OK; i++) {
+        MV_FileEntry* entry = &pf->files[i];
+        if (entry->is_dir || !entry->full_path) {
+            pf->file_crcs[i] = 0;
+            continue;
+        }
+        if (SolidPrefetch_Repeats(pf, i)) {
+            if (!SolidPrefetch_Repeat(pf, i)) {
+                small_batch_free(&batch);
+                mem_free(reads);
+                return THREAD_FUNC_RET_ZERO;
+            }
+            continue;
+        }
+        if (batched && SolidPrefetch_IsSmall(entry)) {
+            size_t next = i;
+            if (!SolidPrefetch_ReadSmall(pf, &batch, reads, &next, &error)) {
+                small_batch_free(&batch);
+                mem_free(reads);
+                return THREAD_FUNC_RET_ZERO;
+            }
+            i = next - 1;
+            continue;
+        }
         
-        if (res2 != SZ_OK) {
-            return res2;
+        FILE* fp = fopen(entry->full_path, READ_HINTS_FOPEN_MODE);
+        if (!fp) {
+            error = SZ_ERROR_READ;
+            break;
+        }
+        setvbuf(fp, NULL, _IOFBF, 1024 * 1024);
+        ReadHints hints;
+        read_hints_begin_file(&hints, fp, entry->size, pf->input_hints);
+        SparseInput sparse;
+        sparse_input_begin(&sparse, fp, entry->size, 0, entry->sparse);
+        DeviceInput device;
+        if (entry->device && device_input_begin(&device, fp, entry->size, 0) != SZ_OK) {
+            read_hints_end(&hints);
+            fclose(fp);
+            error = SZ_ERROR_MEM;
+            break;
         }
         
-        *out_crc = CRC_GET_DIGEST(crc2);
-        *out_packed_size = packed_size2;
+        uint32_t crc = CRC_INIT_VAL;
+        FileDigest digest;
+        if (entry->digest_slot) file_digest_init(&digest, entry->digest_slot->algorithm);
+        uint64_t remaining = entry->size;
+        while (remaining > 0) {
+            Semaphore_Wait(&pf->free_slots);
+            if (pf->stop) {
+                read_hints_end(&hints);
+                if (entry->device) device_input_end(&device);
+                fclose(fp);
+                small_batch_free(&batch);
+                mem_free(reads);
+                return THREAD_FUNC_RET_ZERO;
+            }
+            
+            PrefetchBlock* blk = &pf->blocks[pf->tail];
+            size_t to_read = PREFETCH_BLOCK_SIZE;
+            if (to_read > remaining) to_read = (size_t)remaining;
+            
+            rate_limit_take(pf->rate_limit, RATE_LIMIT_READ, to_read, pf->cancel);
+            OpStatsTimer timer;
+            op_stats_io_begin(pf->stats, &timer);
+            TRACE_BEGIN(read);
+            size_t got = entry->device ? device_input_read(&device, blk->data, to_read)
+                                       : sparse_input_read(&sparse, blk->data, to_read);
+            TRACE_END(read, TRACE_READ, got);
+            op_stats_io_end(pf->stats, &timer, SEVENZIP_PHASE_READ, got);
+            if (got == 0) {
+                /* File shrank after scanning - header sizes would be wrong */
+                Semaphore_Release1(&pf->free_slots);
+                error = SZ_ERROR_READ;
+                break;
+            }
+            
+            crc = CrcUpdate(crc, blk->data, got);
+            if (entry->digest_slot) file_digest_update(&digest, blk->data, got);
+            blk->size = got;
+            blk->file_index = i;
+            blk->error = SZ_OK;
+            blk->eof = 0;
+            pf->tail = (pf->tail + 1) % pf->count;
+            Semaphore_Release1(&pf->filled_slots);
+            remaining -= got;
+            read_hints_advance(&hints, entry->size - remaining);
+        }
         
-        return SZ_OK;
+        pf->file_crcs[i] = CRC_GET_DIGEST(crc);
+        if (entry->digest_slot) file_digest_final(&digest, entry->digest_slot);
+        read_hints_end(&hints);
+        if (entry->device) device_input_end(&device);
+        fclose(fp);
+    }
+    small_batch_free(&batch);
+    mem_free(reads);
+    
+    /* Terminal slot carries EOF or the error */
+    Semaphore_Wait(&pf->free_slots);
+    if (!pf->stop) {
+        PrefetchBlock* blk = &pf->blocks[pf->tail];
+        blk->size = 0;
+        blk->error = error;
+        blk->eof = 1;
+        Semaphore_Release1(&pf->filled_slots);
     }
+    return THREAD_FUNC_RET_ZERO;
 }
 
-/* Input stream that reads from multiple files sequentially (for solid compression) */
-typedef struct {
-    ISeqInStream vt;
-    MV_FileEntry* files;
-    size_t file_count;
-    size_t current_file;
-    FILE* current_fp;
-    uint64_t current_file_remaining;
-    uint32_t* file_crcs;  /* Array to store per-file CRCs */
-    uint32_t current_crc;
-    MultiVolumeContext* ctx;  /* For progress updates */
-    SevenZipBytesProgressCallback progress_callback;
-    void* user_data;
-    uint64_t total_read;
-    uint64_t total_size;
-} SolidInStream;
+static void SolidPrefetch_Destroy(SolidPrefetch* pf) {
+    if (Thread_WasCreated(&pf->thread)) {
+        pf->stop = 1;
+        Semaphore_Release1(&pf->free_slots);  /* Wake reader if it waits for a slot */
+        Thread_Wait_Close(&pf->thread);
+    }
+    if (Semaphore_IsCreated(&pf->free_slots)) Semaphore_Close(&pf->free_slots);
+    if (Semaphore_IsCreated(&pf->filled_slots)) Semaphore_Close(&pf->filled_slots);
+    if (pf->blocks) {
+        for (UInt32 i = 0; i < pf->count; i++) {
+            mem_free(pf->blocks[i].data);
+        }
+        mem_free(pf->blocks);
+    }
+    memset(pf, 0, sizeof(*pf));
+}
+
+static SRes SolidPrefetch_Start(
+    SolidPrefetch* pf,
+    UInt32 count,
+    MV_FileEntry* files,
+    size_t file_count,
+    uint32_t* file_crcs,
+    int input_hints,
+    OpStats* stats,
+    SevenZipRateLimit* rate_limit,
+    const SevenZipCancelToken* cancel
+) {
+    memset(pf, 0, sizeof(*pf));
+    Thread_CONSTRUCT(&pf->thread)
+    Semaphore_Construct(&pf->free_slots);
+    Semaphore_Construct(&pf->filled_slots);
+    pf->files = files;
+    pf->file_count = file_count;
+    pf->file_crcs = file_crcs;
+    pf->input_hints = input_hints;
+    pf->stats = stats;
+    pf->rate_limit = rate_limit;
+    pf->cancel = cancel;
+    
+    pf->blocks = (PrefetchBlock*)mem_calloc(SEVENZIP_MEM_IO_BUFFERS, count, sizeof(PrefetchBlock));
+    if (!pf->blocks) return SZ_ERROR_MEM;
+    pf->count = count;
+    for (UInt32 i = 0; i < count; i++) {
+        pf->blocks[i].data = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, PREFETCH_BLOCK_SIZE);
+        if (!pf->blocks[i].data) {
+            SolidPrefetch_Destroy(pf);
+            return SZ_ERROR_MEM;
+        }
+    }
+    
+    /* +1 on free_slots max leaves room for the shutdown wake-up */
+    if (Semaphore_Create(&pf->free_slots, count, count + 1) != 0 ||
+        Semaphore_Create(&pf->filled_slots, 0, count) != 0 ||
+        Thread_Create(&pf->thread, SolidPrefetch_Thread, pf) != 0) {
+        SolidPrefetch_Destroy(pf);
+        return SZ_ERROR_THREAD;
+    }
+    return SZ_OK;
+}
+
+/* Consumer side of SolidInStream_Read when a prefetch ring is attached */
+static SRes SolidInStream_ReadPrefetched(SolidInStream* s, void* buf, size_t* size) {
+    SolidPrefetch* pf = s->prefetch;
+    size_t remaining = *size;
+    Byte* out = (Byte*)buf;
+    
+    while (remaining > 0 && !pf->finished) {
+        if (!pf->head_valid) {
+            Semaphore_Wait(&pf->filled_slots);
+            PrefetchBlock* blk = &pf->blocks[pf->head];
+            if (blk->eof) {
+                pf->finished = 1;
+                if (blk->error != SZ_OK) return blk->error;
+                break;
+            }
+            pf->head_valid = 1;
+            pf->head_pos = 0;
+            
+            /* Progress update - new file */
+            if (blk->file_index != s->current_file || s->current_file_read == 0) {
+                s->current_file = blk->file_index;
+                s->current_file_read = 0;
+                if (s->progress) {
+                    MV_FileEntry* entry = &s->files[s->current_file];
+                    const char* name = entry->name ? entry->name : entry->full_path;
+                    progress_reporter_begin_file(s->progress, name, entry->size);
+                }
+            }
+        }
+        
+        PrefetchBlock* blk = &pf->blocks[pf->head];
+        size_t n = blk->size - pf->head_pos;
+        if (n > remaining) n = remaining;
+        memcpy(out, blk->data + pf->head_pos, n);
+        pf->head_pos += n;
+        
+        s->total_read += n;
+        s->current_file_read += n;
+        if (s->progress) progress_reporter_add(s->progress, n);
+        
+        if (pf->head_pos == blk->size) {
+            pf->head_valid = 0;
+            pf->head = (pf->head + 1) % pf->count;
+            Semaphore_Release1(&pf->free_slots);
+        }
+        
+        out += n;
+        remaining -= n;
+    }
+    
+    *size -= remaining;
+    return SZ_OK;
+}
 
 static SRes SolidInStream_Read(ISeqInStreamPtr pp, void *buf, size_t *size) {
     SolidInStream *s = Z7_CONTAINER_FROM_VTBL(pp, SolidInStream, vt);
+    if (cancel_token_requested(s->cancel)) return SZ_ERROR_PROGRESS;
+    if (s->prefetch) {
+        return SolidInStream_ReadPrefetched(s, buf, size);
+    }
     size_t remaining = *size;
     Byte* out = (Byte*)buf;
     
@@ -923,9 +2366,7 @@ static SRes SolidInStream_Read(ISeqInStreamPtr pp, void *buf, size_t *size) {
         while (!s->current_fp || s->current_file_remaining == 0) {
             /* Finalize CRC of previous file */
             if (s->current_fp) {
-                s->file_crcs[s->current_file] = CRC_GET_DIGEST(s->current_crc);
-                fclose(s->current_fp);
-                s->current_fp = NULL;
+                SolidInStream_CloseFile(s);
                 s->current_file++;
             }
             
@@ -943,18 +2384,38 @@ static SRes SolidInStream_Read(ISeqInStreamPtr pp, void *buf, size_t *size) {
                 continue;
             }
             
-            s->current_fp = fopen(entry->full_path, "rb");
+            s->current_fp = fopen(entry->full_path, READ_HINTS_FOPEN_MODE);
             if (!s->current_fp) {
                 return SZ_ERROR_READ;
             }
             setvbuf(s->current_fp, NULL, _IOFBF, 1024 * 1024);  /* 1MB buffer */
-            s->current_file_remaining = entry->size;
+            if (s->range_size && FSEEK64(s->current_fp, (int64_t)s->range_offset, SEEK_SET) != 0) {
+                fclose(s->current_fp);
+                s->current_fp = NULL;
+                return SZ_ERROR_READ;
+            }
+            read_hints_begin_file(&s->hints, s->current_fp, entry->size, s->input_hints);
+            sparse_input_begin(&s->sparse, s->current_fp, entry->size,
+                               s->range_size ? s->range_offset : 0, entry->sparse);
+            if (entry->device &&
+                device_input_begin(&s->device, s->current_fp, entry->size,
+                                   s->range_size ? s->range_offset : 0) != SZ_OK) {
+                read_hints_end(&s->hints);
+                fclose(s->current_fp);
+                s->current_fp = NULL;
+                return SZ_ERROR_MEM;
+            }
+            s->current_file_remaining = s->range_size ? s->range_size : entry->size;
             s->current_crc = CRC_INIT_VAL;
+            if (entry->digest_slot && !s->crc_stage) {
+                file_digest_init(&s->current_digest, entry->digest_slot->algorithm);
+            }
+            if (s->crc_stage) crc_stage_begin_digest(s->crc_stage, entry->size, NULL, entry->digest_slot);
             
             /* Progress update - new file */
-            if (s->progress_callback && s->ctx) {
+            if (s->progress) {
                 const char* name = entry->name ? entry->name : entry->full_path;
-                s->progress_callback(s->total_read, s->total_size, 0, entry->size, name, s->user_data);
+                progress_reporter_begin_file(s->progress, name, entry->size);
             }
         }
         
@@ -964,29 +2425,21 @@ static SRes SolidInStream_Read(ISeqInStreamPtr pp, void *buf, size_t *size) {
             to_read = (size_t)s->current_file_remaining;
         }
         
-        size_t got = fread(out, 1, to_read, s->current_fp);
+        size_t got = SolidInStream_ReadFile(s, out, to_read);
         if (got == 0) {
             /* Premature EOF - close file and move to next */
-            s->file_crcs[s->current_file] = CRC_GET_DIGEST(s->current_crc);
-            fclose(s->current_fp);
-            s->current_fp = NULL;
+            SolidInStream_CloseFile(s);
             s->current_file++;
             continue;
         }
         
-        /* Update CRC */
-        s->current_crc = CrcUpdate(s->current_crc, out, got);
-        
         /* Update progress */
         s->total_read += got;
-        if (s->progress_callback && s->ctx) {
-            MV_FileEntry* entry = &s->files[s->current_file];
-            const char* name = entry->name ? entry->name : entry->full_path;
-            uint64_t file_read = entry->size - s->current_file_remaining + got;
-            s->progress_callback(s->total_read, s->total_size, file_read, entry->size, name, s->user_data);
-        }
+        if (s->progress) progress_reporter_add(s->progress, got);
         
         s->current_file_remaining -= got;
+        uint64_t span = s->range_size ? s->range_size : s->files[s->current_file].size;
+        read_hints_advance(&s->hints, s->range_offset + span - s->current_file_remaining);
         out += got;
         remaining -= got;
     }
@@ -994,47 +2447,46 @@ static SRes SolidInStream_Read(ISeqInStreamPtr pp, void *buf, size_t *size) {
     return SZ_OK;
 }
 
-/* Compress ALL files as a single solid stream - maximum parallelism */
+static uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b);
+
+/* Compress ALL files as a single solid stream - maximum parallelism
+ * (`store` = concatenate them into a Copy folder instead) */
 static SRes compress_solid_streaming(
     MV_FileEntry* files,
     size_t file_count,
     uint64_t total_uncompressed_size,
+    uint64_t progress_base,
     MultiVolumeContext* ctx,
     const CLzma2EncProps* props,
     uint64_t* out_packed_size,
     Byte* out_prop,
-    SevenZipBytesProgressCallback progress_callback,
-    void* user_data
+    UInt32 prefetch_buffers,
+    SevenZipFilter filter,
+    unsigned delta_distance,
+    const MV_PpmdParams* ppmd,
+    int store,
+    OpStatsEncode* encode
 ) {
-    /* Create encoder */
-    CLzma2EncHandle enc = Lzma2Enc_Create(&g_Alloc, &g_BigAlloc);
-    if (!enc) return SZ_ERROR_MEM;
-    
-    /* Set expected data size for optimal block threading */
-    Lzma2Enc_SetDataSize(enc, total_uncompressed_size);
-    
-    SRes res = Lzma2Enc_SetProps(enc, props);
-    if (res != SZ_OK) {
-        Lzma2Enc_Destroy(enc);
-        return res;
+    SRes res = SZ_OK;
+    CLzma2EncHandle enc = NULL;
+    *out_prop = 0;
+    
+    /* Archive-wide encoder, reused by every solid block
+     * (PPMd blocks build their model inside sevenzip_ppmd_encode,
+     * stored blocks are copied through) */
+    if (!ppmd && !store) {
+        res = mv_cache_encoder(ctx, props, total_uncompressed_size, &enc);
+        if (res != SZ_OK) return res;
+        *out_prop = Lzma2Enc_WriteProperties(enc);
+        if (ctx->verify) write_verify_begin(ctx->verify, *out_prop, filter, delta_distance);
     }
     
-    *out_prop = Lzma2Enc_WriteProperties(enc);
+    Byte* out_buffer = mv_cache_buffer(&ctx->cache, &ctx->cache.out_buffer);
+    if (!out_buffer) return SZ_ERROR_MEM;
     
     /* Allocate file CRC array */
-    uint32_t* file_crcs = (uint32_t*)calloc(file_count, sizeof(uint32_t));
-    if (!file_crcs) {
-        Lzma2Enc_Destroy(enc);
-        return SZ_ERROR_MEM;
-    }
-    
-    /* Allocate output buffer */
-    Byte* out_buffer = (Byte*)malloc(STREAM_BUFFER_SIZE);
-    if (!out_buffer) {
-        free(file_crcs);
-        Lzma2Enc_Destroy(enc);
-        return SZ_ERROR_MEM;
-    }
+    uint32_t* file_crcs = (uint32_t*)mem_calloc(SEVENZIP_MEM_OTHER, file_count, sizeof(uint32_t));
+    if (!file_crcs) return SZ_ERROR_MEM;
     
     /* Setup solid input stream */
     SolidInStream inStream;
@@ -1047,10 +2499,37 @@ static SRes compress_solid_streaming(
     inStream.file_crcs = file_crcs;
     inStream.current_crc = CRC_INIT_VAL;
     inStream.ctx = ctx;
-    inStream.progress_callback = progress_callback;
-    inStream.user_data = user_data;
-    inStream.total_read = 0;
-    inStream.total_size = total_uncompressed_size;
+    inStream.progress = &ctx->progress;
+    inStream.cancel = ctx->cancel;
+    inStream.rate_limit = ctx->rate_limit;
+    inStream.total_read = progress_base;
+    inStream.prefetch = NULL;
+    inStream.current_file_read = 0;
+    inStream.input_hints = ctx->input_hints;
+    inStream.crc_stage = NULL;
+    inStream.stage_buf = NULL;
+    inStream.stage_size = 0;
+    inStream.stage_pos = 0;
+    inStream.stats = &ctx->stats;
+    inStream.range_offset = 0;
+    inStream.range_size = 0;  /* Whole files */
+    
+    /* Optional read-ahead stage */
+    SolidPrefetch prefetch;
+    if (prefetch_buffers > 0) {
+        res = SolidPrefetch_Start(&prefetch, prefetch_buffers, files, file_count, file_crcs,
+                                  ctx->input_hints, &ctx->stats, ctx->rate_limit, ctx->cancel);
+        if (res != SZ_OK) {
+            mem_free(file_crcs);
+            return res;
+        }
+        inStream.prefetch = &prefetch;
+    } else {
+        /* Reads stay on the encoder thread, their CRCs move off it
+           (without the staging buffer they are computed inline) */
+        inStream.stage_buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, CRC_STAGE_BUFFER_SIZE);
+        if (inStream.stage_buf) inStream.crc_stage = &ctx->crc_stage;
+    }
     
     /* Setup output stream */
     uint64_t packed_size = 0;
@@ -1059,372 +2538,1865 @@ static SRes compress_solid_streaming(
     outStream.ctx = ctx;
     outStream.packed_size = &packed_size;
     outStream.buffer = out_buffer;
-    outStream.buf_size = STREAM_BUFFER_SIZE;
+    outStream.buf_size = ctx->cache.buffer_size;
     outStream.buf_pos = 0;
     
+    /* Filter runs on the raw data in front of the encoder */
+    ISeqInStreamPtr src = &inStream.vt;
+    FilterInStream filtered;
+    int use_filter = (filter != SEVENZIP_FILTER_NONE);
+    if (use_filter) {
+        res = FilterInStream_Init(&filtered, filter, delta_distance, &inStream.vt);
+        src = &filtered.vt;
+    }
+    
     /* Compress entire solid stream */
-    res = Lzma2Enc_Encode2(enc,
-        &outStream.vt, NULL, NULL,
-        &inStream.vt, NULL, 0,
-        NULL);
+    TRACE_BEGIN(compress);
+    if (res == SZ_OK && store) {
+        Byte* copy_buf = mv_cache_buffer(&ctx->cache, &ctx->cache.in_buffer);
+        if (!copy_buf) res = SZ_ERROR_MEM;
+        while (res == SZ_OK) {
+            size_t got = ctx->cache.buffer_size;
+            res = src->Read(src, copy_buf, &got);
+            if (res != SZ_OK || got == 0) break;
+            if (outStream.vt.Write(&outStream.vt, copy_buf, got) != got) res = SZ_ERROR_WRITE;
+        }
+    } else if (res == SZ_OK && ppmd) {
+        res = sevenzip_ppmd_encode(&outStream.vt, src, ppmd->order, ppmd->mem_size);
+    } else if (res == SZ_OK) {
+        /* Block threads check the token between their input and progress steps */
+        CancelProgress cancel;
+        OpStatsEncodeTimer encode_timer;
+        op_stats_encode_begin(&ctx->stats, &encode_timer, enc);
+        if (ctx->zero_runs) {
+            res = zero_run_encode(enc, props, total_uncompressed_size, &outStream.vt, src,
+                                  CancelProgress_Init(&cancel, ctx->cancel, NULL),
+                                  ctx->zero_runs, NULL);
+        } else {
+            res = Lzma2Enc_Encode2(enc,
+                &outStream.vt, NULL, NULL,
+                src, NULL, 0,
+                CancelProgress_Init(&cancel, ctx->cancel, NULL));
+        }
+        op_stats_encode_end(&ctx->stats, &encode_timer, enc,
+                            op_stats_block_threads(props, total_uncompressed_size), encode);
+    }
+    TRACE_END(compress, TRACE_COMPRESS, total_uncompressed_size);
+    
+    if (use_filter) {
+        FilterInStream_Free(&filtered);
+    }
+    
+    if (res == SZ_OK && !VolumeOutStream_Flush(&outStream)) {
+        res = SZ_ERROR_WRITE;
+    }
+    
+    /* A file that shrank after scanning would desync the substream sizes */
+    if (res == SZ_OK && inStream.total_read - progress_base != total_uncompressed_size) {
+        res = SZ_ERROR_READ;
+    }
     
-    if (res == SZ_OK) {
-        VolumeOutStream_Flush(&outStream);
+    /* Stop the reader thread; CRCs it produced are in file_crcs */
+    if (inStream.prefetch) {
+        SolidPrefetch_Destroy(inStream.prefetch);
     }
     
     /* Close any remaining open file */
     if (inStream.current_fp) {
-        inStream.file_crcs[inStream.current_file] = CRC_GET_DIGEST(inStream.current_crc);
-        fclose(inStream.current_fp);
+        SolidInStream_CloseFile(&inStream);
     }
     
+    /* Digests of the staged reads are stored once the stage is synced */
+    if (inStream.crc_stage) {
+        crc_stage_sync(inStream.crc_stage);
+    }
+    mem_free(inStream.stage_buf);
+    
     /* Copy CRCs back to file entries */
+    uint32_t folder_crc = 0;
     for (size_t i = 0; i < file_count; i++) {
         files[i].crc = file_crcs[i];
         files[i].lzma2_prop = *out_prop;  /* All files share same LZMA2 prop in solid archive */
+        if (!files[i].is_dir) folder_crc = crc32_combine(folder_crc, file_crcs[i], files[i].size);
+    }
+    if (ctx->verify && res == SZ_OK) {
+        write_verify_end(ctx->verify, folder_crc, total_uncompressed_size);
     }
     
-    free(file_crcs);
-    free(out_buffer);
-    Lzma2Enc_Destroy(enc);
+    mem_free(file_crcs);
     
     *out_packed_size = packed_size;
     return res;
 }
 
-/* Build 7z header in memory */
-static Byte* build_7z_header(
-    MV_FileEntry* files,
-    size_t file_count,
-    uint64_t total_packed_size,
-    size_t* header_size
-) {
-    size_t capacity = 256 * 1024;  /* 256KB buffer */
-    Byte* header = (Byte*)malloc(capacity);
-    if (!header) return NULL;
-    
-    Byte* p = header;
-    
-    *p++ = k7zIdHeader;
-    
-    /* MainStreamsInfo */
-    *p++ = k7zIdMainStreamsInfo;
-    
-    /* PackInfo */
-    *p++ = k7zIdPackInfo;
-    WriteNumber(&p, 0);  /* Pack position */
-    WriteNumber(&p, 1);  /* Number of pack streams */
-    
-    *p++ = k7zIdSize;
-    fprintf(stderr, "[DEBUG build_7z_header] total_packed_size = %llu (0x%llX)\n", 
-            (unsigned long long)total_packed_size, (unsigned long long)total_packed_size);
-    WriteNumber(&p, total_packed_size);
-    
-    *p++ = k7zIdEnd;
-    
-    /* UnpackInfo */
-    *p++ = k7zIdUnpackInfo;
-    
-    *p++ = k7zIdFolder;
-    WriteNumber(&p, 1);  /* One folder */
-    WriteNumber(&p, 0);  /* Not external */
-    WriteNumber(&p, 1);  /* One coder */
-    
-    /* Check if using Copy/Store method (prop_byte == 0 means Copy) */
-    Byte prop_byte = 0x01;  /* Default LZMA2 */
-    for (size_t i = 0; i < file_count; i++) {
-        if (!files[i].is_dir) {
-            prop_byte = files[i].lzma2_prop;
-            fprintf(stderr, "[DEBUG] File %s has lzma2_prop = 0x%02X\n", files[i].name, prop_byte);
-            break;
+/* ============================================================================
+ * Non-solid parallel compression
+ *
+ * Each non-empty file becomes its own folder. A pool of workers compresses
+ * independent files into per-slot spill buffers; the calling thread acts
+ * as sequencer and writes the finished pack streams to the volumes in
+ * archive order. At most `slot_count` files are in flight, which bounds
+ * memory to slot_count * spill limit (SPILL_MEMORY_LIMIT unless reduced
+ * for max_memory) plus encoder state.
+ *
+ * The slot the sequencer waits for is written through: once its buffer
+ * reaches the limit the worker hands it over and the sequencer writes it
+ * to the volumes, so only pack streams finished ahead of their turn ever
+ * go to a scratch file (in options->temp_dir). A stream written through
+ * is final, so a file that turns out incompressible past that point
+ * keeps its LZMA2 stream (which stores such chunks raw) instead of being
+ * read again into a Copy folder.
+ * ============================================================================ */
+
+#define SPILL_MEMORY_LIMIT (16 * 1024 * 1024)  /* Spill to a scratch file beyond 16MB */
+#define STORE_COPY_BUFFER_SIZE (1 << 20)        /* Read size for files stored by a worker */
+
+/* Folder description used by the header writer */
+typedef struct {
+    uint64_t pack_size;
+    uint64_t unpack_size;
+    size_t num_files;     /* Number of substreams (non-empty files) */
+    Byte lzma2_prop;      /* 0 = Copy codec (unless use_ppmd) */
+    SevenZipFilter filter; /* Filter before LZMA2 (NONE = single coder) */
+    unsigned delta_distance;  /* Property of SEVENZIP_FILTER_DELTA */
+    int use_ppmd;         /* 1 = PPMd coder with `ppmd` properties */
+    MV_PpmdParams ppmd;
+    int encrypted;        /* 1 = 7zAES coder in front of the pack stream */
+    Byte aes_iv[AES_CODER_IV_SIZE];
+    uint64_t aes_size;    /* Unpadded size of the encrypted coder output */
+    OpStatsEncode encode; /* LZMA2 encoder counts, for the op stats */
+} MV_Folder;
+
+/* Start the pack stream of `folder`; with a password it is encrypted */
+static int mv_cipher_begin(MultiVolumeContext* ctx, MV_Folder* folder) {
+    folder->encrypted = 0;
+    if (!ctx->encrypt) return 1;
+    if (sevenzip_aes_new_iv(folder->aes_iv) != SEVENZIP_OK ||
+        AesOutStream_Init(&ctx->cipher, ctx->aes_key, folder->aes_iv, &ctx->packed_vt) != SZ_OK) {
+        return 0;
+    }
+    ctx->cipher_active = 1;
+    folder->encrypted = 1;
+    return 1;
+}
+
+/* End the pack stream of `folder`; an encrypted one is padded to whole
+ * AES blocks, which makes the padded size its pack size */
+static int mv_cipher_end(MultiVolumeContext* ctx, MV_Folder* folder) {
+    if (!ctx->cipher_active) return 1;
+    int ok = AesOutStream_Finish(&ctx->cipher);
+    folder->aes_size = ctx->cipher.processed;
+    folder->pack_size = ctx->cipher.written;
+    AesOutStream_Free(&ctx->cipher);
+    ctx->cipher_active = 0;
+    return ok;
+}
+
+/* Checkpoints
+ *
+ * A job run with options->checkpoint keeps <archive>.ckpt up to date: the
+ * input list with the coders chosen for each file, the CRCs of the files
+ * done, the finished folders and the packed size behind them. Encoder
+ * state cannot be saved, so a checkpoint is only taken where a folder ends
+ * (in Store mode, where a file ends), and only once another volume has
+ * filled since the last one. The file is replaced by a rename, so a crash
+ * leaves one whole checkpoint or the other. Numbers are stored as 8
+ * little-endian bytes; a CRC32 of everything before it ends the file.
+ */
+#define CKPT_MAGIC "7zFFckpt"
+#define CKPT_MAGIC_SIZE 8
+#define CKPT_VERSION 3
+
+struct MV_Checkpoint {
+    char path[1280];            /* <archive>.ckpt */
+    const MV_FileEntry* files;  /* The whole input list */
+    size_t file_count;
+    const MV_Folder* folders;   /* Finished folders, in archive order */
+    /* Settings the volume layout depends on, restored on resume */
+    SevenZipCompressionLevel level;
+    uint64_t split_size;
+    int solid;
+    uint64_t solid_block_size;
+    int solid_block_files;
+    unsigned delta_distance;
+    int encrypted;
+    uint32_t key_check;         /* CRC32 of the AES key, tells a wrong password */
+    uint64_t volume;            /* Volumes before this one are complete in the file */
+    size_t synced;              /* Volumes before this one are on disk */
+    int saved;                  /* A checkpoint of the volumes on disk exists */
+};
+
+/* A checkpoint read back by sevenzip_resume_multivolume() */
+typedef struct {
+    SevenZipCompressionLevel level;
+    uint64_t split_size;
+    int solid;
+    uint64_t solid_block_size;
+    int solid_block_files;
+    unsigned delta_distance;
+    int encrypted;
+    uint32_t key_check;
+    uint64_t packed_size;       /* Packed bytes after the signature header */
+    size_t next_file;           /* First file whose data is not in the volumes */
+    MV_FileList list;
+    MV_Folder* folders;         /* list.count entries, folder_count used */
+    size_t folder_count;
+} MV_Resume;
+
+static void get_checkpoint_filename(char* buffer, size_t size, const char* base) {
+    snprintf(buffer, size, "%s.ckpt", base);
+}
+
+/* Growable buffer a checkpoint is serialized into */
+typedef struct {
+    Byte* data;
+    size_t size;
+    size_t capacity;
+    int failed;
+} CkptWriter;
+
+static void ckpt_put(CkptWriter* w, const void* src, size_t size) {
+    if (w->failed) return;
+    if (w->size + size > w->capacity) {
+        size_t cap = w->capacity ? w->capacity * 2 : 4096;
+        while (cap < w->size + size) cap *= 2;
+        Byte* data = (Byte*)mem_realloc(SEVENZIP_MEM_HEADER, w->data, cap);
+        if (!data) {
+            w->failed = 1;
+            return;
         }
+        w->data = data;
+        w->capacity = cap;
     }
-    fprintf(stderr, "[DEBUG] Using prop_byte = 0x%02X, Copy mode = %s\n", prop_byte, prop_byte == 0 ? "YES" : "NO");
-    
-    if (prop_byte == 0) {
-        /* Copy/Store method - no compression 
-         * 7z Copy codec: ID = {0x00} (1 byte), no properties
-         * Coder byte: 0x00 = simple coder, ID size = 0 (inline), no properties
-         * But 7z expects at least 1 byte for codec ID
-         */
-        *p++ = 0x01;  /* Coder: ID size = 1, no NumInStreams/OutStreams, no properties */
-        *p++ = 0x00;  /* Copy codec ID = 0x00 */
-    } else {
-        /* LZMA2 compression */
-        *p++ = 0x21;  /* Coder flags (1 byte ID, has properties) */
-        *p++ = 0x21;  /* LZMA2 codec ID */
-        *p++ = 1;     /* Properties size = 1 byte */
-        *p++ = prop_byte;
+    memcpy(w->data + w->size, src, size);
+    w->size += size;
+}
+
+static void ckpt_put_u64(CkptWriter* w, uint64_t value) {
+    Byte b[8];
+    for (int i = 0; i < 8; i++) b[i] = (Byte)(value >> (8 * i));
+    ckpt_put(w, b, sizeof(b));
+}
+
+static void ckpt_put_str(CkptWriter* w, const char* str) {
+    size_t len = strlen(str);
+    ckpt_put_u64(w, len);
+    ckpt_put(w, str, len);
+}
+
+/* Cursor over a checkpoint in memory; reading past the end fails */
+typedef struct {
+    const Byte* p;
+    size_t left;
+    int failed;
+} CkptReader;
+
+static void ckpt_get(CkptReader* r, void* dst, size_t size) {
+    if (r->failed || r->left < size) {
+        r->failed = 1;
+        memset(dst, 0, size);
+        return;
     }
-    
-    *p++ = k7zIdCodersUnpackSize;
-    uint64_t total_unpack = 0;
-    for (size_t i = 0; i < file_count; i++) {
-        if (!files[i].is_dir) {
-            total_unpack += files[i].size;
-        }
+    memcpy(dst, r->p, size);
+    r->p += size;
+    r->left -= size;
+}
+
+static uint64_t ckpt_get_u64(CkptReader* r) {
+    Byte b[8];
+    ckpt_get(r, b, sizeof(b));
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | b[i];
+    return value;
+}
+
+/* malloc'd string, NULL once the reader has failed */
+static char* ckpt_get_str(CkptReader* r) {
+    uint64_t len = ckpt_get_u64(r);
+    if (r->failed || len > r->left) {
+        r->failed = 1;
+        return NULL;
     }
-    WriteNumber(&p, total_unpack);
-    
-    *p++ = k7zIdEnd;
-    
-    /* SubStreamsInfo */
-    *p++ = k7zIdSubStreamsInfo;
-    
-    size_t num_files = 0;
-    for (size_t i = 0; i < file_count; i++) {
-        if (!files[i].is_dir) num_files++;
+    char* str = (char*)mem_alloc(SEVENZIP_MEM_NAMES, (size_t)len + 1);
+    if (!str) {
+        r->failed = 1;
+        return NULL;
     }
-    
-    /* Always emit NumUnpackStream (like working 7z_create.c) */
-    *p++ = k7zIdNumUnpackStream;
-    WriteNumber(&p, num_files);
-    
-    /* Individual file sizes (all but last - last is implied) */
-    if (num_files > 1) {
-        *p++ = k7zIdSize;
-        size_t written = 0;
-        for (size_t i = 0; i < file_count && written < num_files - 1; i++) {
-            if (!files[i].is_dir) {
-                WriteNumber(&p, files[i].size);
-                written++;
-            }
-        }
+    ckpt_get(r, str, (size_t)len);
+    str[len] = '\0';
+    return str;
+}
+
+/* Save a checkpoint if a volume filled since the last one
+ * Called between folders on the main thread, with no cipher active.
+ * `next_file` is the first file whose data is not in the volumes yet,
+ * `folders_end` follows the last finished folder.
+ * @return 0 if the volumes or the checkpoint could not be written
+ */
+static int mv_checkpoint_save(MultiVolumeContext* ctx, const MV_FileEntry* next_file,
+                              const MV_Folder* folders_end) {
+    MV_Checkpoint* ck = ctx->checkpoint;
+    if (!ck) return 1;
+    uint64_t volume = (k7zStartHeaderSize + ctx->total_packed_size) / ctx->max_volume_size;
+    if (volume <= ck->volume) return 1;
+
+    /* The checkpoint may only describe bytes that reached the disk */
+    if (!VolumeWriter_Drain(ctx) || !VolumeFinisher_Wait(&ctx->finisher)) return 0;
+    for (size_t i = ck->synced; i < ctx->volume_count; i++) {
+        /* Volumes the finisher closed were synced by it */
+        if (ctx->volumes[i] && !sync_file(ctx->volumes[i])) return 0;
     }
-    
-    *p++ = k7zIdCRC;
-    *p++ = 1;  /* All defined */
-    for (size_t i = 0; i < file_count; i++) {
-        if (!files[i].is_dir) {
-            memcpy(p, &files[i].crc, 4);
-            p += 4;
-        }
+    if (ctx->volume_count > 0) ck->synced = ctx->volume_count - 1;
+
+    size_t folder_count = (size_t)(folders_end - ck->folders);
+    CkptWriter w;
+    memset(&w, 0, sizeof(w));
+    ckpt_put(&w, CKPT_MAGIC, CKPT_MAGIC_SIZE);
+    ckpt_put_u64(&w, CKPT_VERSION);
+    ckpt_put_u64(&w, (uint64_t)ck->level);
+    ckpt_put_u64(&w, ck->split_size);
+    ckpt_put_u64(&w, (uint64_t)ck->solid);
+    ckpt_put_u64(&w, ck->solid_block_size);
+    ckpt_put_u64(&w, (uint64_t)ck->solid_block_files);
+    ckpt_put_u64(&w, ck->delta_distance);
+    ckpt_put_u64(&w, (uint64_t)ck->encrypted);
+    ckpt_put_u64(&w, ck->key_check);
+    ckpt_put_u64(&w, ctx->total_packed_size);
+    ckpt_put_u64(&w, (uint64_t)(next_file - ck->files));
+    ckpt_put_u64(&w, ck->file_count);
+    ckpt_put_u64(&w, folder_count);
+    for (size_t i = 0; i < ck->file_count; i++) {
+        const MV_FileEntry* file = &ck->files[i];
+        ckpt_put_str(&w, file->name);
+        ckpt_put_str(&w, file->full_path);
+        ckpt_put_u64(&w, file->size);
+        ckpt_put_u64(&w, file->mtime);
+        ckpt_put_u64(&w, file->attrib);
+        ckpt_put_u64(&w, file->crc);
+        ckpt_put_u64(&w, file->lzma2_prop);
+        ckpt_put_u64(&w, (uint64_t)file->is_dir);
+        ckpt_put_u64(&w, (uint64_t)file->filter);
+        ckpt_put_u64(&w, (uint64_t)file->use_ppmd);
+        ckpt_put_u64(&w, (uint64_t)file->store);
+        ckpt_put_u64(&w, (uint64_t)file->level);
+        ckpt_put_u64(&w, file->group);
     }
-    
-    *p++ = k7zIdEnd;
-    *p++ = k7zIdEnd;
-    
-    /* FilesInfo */
-    *p++ = k7zIdFilesInfo;
-    WriteNumber(&p, file_count);
-    
-    /* Names */
-    *p++ = k7zIdName;
-    size_t names_size = 0;
-    for (size_t i = 0; i < file_count; i++) {
-        names_size += (strlen(files[i].name) + 1) * 2;
+    for (size_t i = 0; i < folder_count; i++) {
+        const MV_Folder* folder = &ck->folders[i];
+        ckpt_put_u64(&w, folder->pack_size);
+        ckpt_put_u64(&w, folder->unpack_size);
+        ckpt_put_u64(&w, folder->num_files);
+        ckpt_put_u64(&w, folder->lzma2_prop);
+        ckpt_put_u64(&w, (uint64_t)folder->filter);
+        ckpt_put_u64(&w, folder->delta_distance);
+        ckpt_put_u64(&w, (uint64_t)folder->use_ppmd);
+        ckpt_put_u64(&w, folder->ppmd.order);
+        ckpt_put_u64(&w, folder->ppmd.mem_size);
+        ckpt_put_u64(&w, (uint64_t)folder->encrypted);
+        ckpt_put(&w, folder->aes_iv, AES_CODER_IV_SIZE);
+        ckpt_put_u64(&w, folder->aes_size);
     }
-    WriteNumber(&p, names_size + 1);
-    *p++ = 0;  /* Not external */
-    
-    for (size_t i = 0; i < file_count; i++) {
-        const char* name = files[i].name;
-        while (*name) {
-            *p++ = (Byte)*name++;
-            *p++ = 0;
-        }
-        *p++ = 0;
-        *p++ = 0;
+    if (!w.failed) {
+        uint32_t crc = CrcCalc(w.data, w.size);
+        Byte crc_bytes[4];
+        for (int i = 0; i < 4; i++) crc_bytes[i] = (Byte)(crc >> (8 * i));
+        ckpt_put(&w, crc_bytes, sizeof(crc_bytes));
     }
-    
-    /* MTime (Modification Time) */
-    *p++ = k7zIdMTime;
-    WriteNumber(&p, file_count * 8 + 2);  /* Size: AllDefined(1) + External(1) + 8 bytes per file */
-    *p++ = 1;  /* All defined */
-    *p++ = 0;  /* External = 0 (inline data) */
-    for (size_t i = 0; i < file_count; i++) {
-        memcpy(p, &files[i].mtime, 8);
-        p += 8;
+
+    char tmp_path[1300];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", ck->path);
+    int ok = !w.failed;
+    if (ok) {
+        FILE* f = fopen(tmp_path, "wb");
+        ok = f && fwrite(w.data, 1, w.size, f) == w.size;
+        if (f) {
+            ok = sync_file(f) && ok;
+            ok = fclose(f) == 0 && ok;
+        }
     }
-    
-    /* WinAttrib (Windows Attributes) */
-    *p++ = k7zIdWinAttrib;
-    WriteNumber(&p, file_count * 4 + 2);  /* Size: AllDefined(1) + External(1) + 4 bytes per file */
-    *p++ = 1;  /* All defined */
-    *p++ = 0;  /* External = 0 (inline data) */
-    for (size_t i = 0; i < file_count; i++) {
-        memcpy(p, &files[i].attrib, 4);
-        p += 4;
+    mem_free(w.data);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, ck->path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    ok = ok && rename(tmp_path, ck->path) == 0;
+#endif
+    if (!ok) {
+        remove(tmp_path);
+        fprintf(stderr, "Cannot write checkpoint: %s\n", ck->path);
+        return 0;
     }
-    
-    *p++ = k7zIdEnd;  /* End FilesInfo */
-    *p++ = k7zIdEnd;  /* End Header */
-    
-    *header_size = p - header;
-    return header;
+    ck->volume = volume;
+    ck->saved = 1;
+    return 1;
 }
 
-/* Main multi-volume creation function */
-SevenZipErrorCode sevenzip_create_multivolume_7z_complete(
-    const char* archive_path,
-    const char** input_paths,
-    SevenZipCompressionLevel level,
-    const SevenZipStreamOptions* options,
-    SevenZipBytesProgressCallback progress_callback,
-    void* user_data
-) {
-    if (!archive_path || !input_paths || !options || options->split_size == 0) {
-        return SEVENZIP_ERROR_INVALID_PARAM;
+static void mv_resume_free(MV_Resume* r) {
+    mv_file_list_free(&r->list);
+    mem_free(r->folders);
+    r->folders = NULL;
+}
+
+/* Read the checkpoint at `path`
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_OPEN_FILE if there is none,
+ *         SEVENZIP_ERROR_INVALID_ARCHIVE if it is damaged
+ */
+static SevenZipErrorCode mv_checkpoint_load(const char* path, MV_Resume* r) {
+    memset(r, 0, sizeof(*r));
+    mv_file_list_init(&r->list);
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "No checkpoint to resume from: %s\n", path);
+        return SEVENZIP_ERROR_OPEN_FILE;
     }
-    
-    CrcGenerateTable();
-    
-    /* Initialize context */
-    MultiVolumeContext ctx;
-    memset(&ctx, 0, sizeof(ctx));
-    strncpy(ctx.base_path, archive_path, sizeof(ctx.base_path) - 1);
-    ctx.max_volume_size = options->split_size;
-    ctx.progress_callback = progress_callback;
-    ctx.user_data = user_data;
-    ctx.volume_capacity = 8;
-    ctx.volumes = (FILE**)malloc(ctx.volume_capacity * sizeof(FILE*));
-    if (!ctx.volumes) {
-        return SEVENZIP_ERROR_MEMORY;
+    Byte* data = NULL;
+    size_t size = 0;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long end = ftell(f);
+        if (end > 0 && fseek(f, 0, SEEK_SET) == 0) {
+            data = (Byte*)mem_alloc(SEVENZIP_MEM_HEADER, (size_t)end);
+            if (data && fread(data, 1, (size_t)end, f) == (size_t)end) {
+                size = (size_t)end;
+            }
+        }
     }
-    
-    /* Gather file entries */
-    size_t file_capacity = 256;
-    size_t file_count = 0;
-    MV_FileEntry* files = (MV_FileEntry*)malloc(file_capacity * sizeof(MV_FileEntry));
-    if (!files) {
-        free(ctx.volumes);
+    fclose(f);
+    if (!data) {
         return SEVENZIP_ERROR_MEMORY;
     }
-    
-    /* Helper to add a single file entry */
-    #define ADD_FILE_ENTRY(full_path_str, relative_name_str) do { \
-        if (file_count >= file_capacity) { \
-            file_capacity *= 2; \
-            MV_FileEntry* new_files = (MV_FileEntry*)realloc(files, file_capacity * sizeof(MV_FileEntry)); \
-            if (!new_files) { \
-                for (size_t _i = 0; _i < file_count; _i++) { free(files[_i].name); free(files[_i].full_path); } \
-                free(files); \
-                free(ctx.volumes); \
-                return SEVENZIP_ERROR_MEMORY; \
-            } \
-            files = new_files; \
-        } \
-        MV_FileEntry* entry = &files[file_count++]; \
-        memset(entry, 0, sizeof(MV_FileEntry)); \
-        entry->name = strdup(relative_name_str); \
-        entry->full_path = strdup(full_path_str); \
-        struct STAT _st; \
-        STAT(full_path_str, &_st); \
-        entry->size = _st.st_size; \
-        entry->mtime = ((uint64_t)_st.st_mtime * 10000000ULL) + 116444736000000000ULL; \
-        entry->attrib = 0x20; \
-        if (!(_st.st_mode & S_IWUSR)) entry->attrib |= 0x01; \
-        entry->is_dir = 0; \
-        ctx.total_size += _st.st_size; \
-    } while(0)
-    
-    /* Process each input path - can be file or directory */
-    for (int i = 0; input_paths[i] != NULL; i++) {
+
+    uint32_t stored_crc = 0;
+    if (size >= CKPT_MAGIC_SIZE + 4) {
+        for (int i = 3; i >= 0; i--) stored_crc = (stored_crc << 8) | data[size - 4 + i];
+    }
+    if (size < CKPT_MAGIC_SIZE + 4 || memcmp(data, CKPT_MAGIC, CKPT_MAGIC_SIZE) != 0 ||
+        CrcCalc(data, size - 4) != stored_crc) {
+        mem_free(data);
+        fprintf(stderr, "Damaged checkpoint: %s\n", path);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+
+    CkptReader rd = { data + CKPT_MAGIC_SIZE, size - CKPT_MAGIC_SIZE - 4, 0 };
+    int ok = ckpt_get_u64(&rd) == CKPT_VERSION;
+    r->level = (SevenZipCompressionLevel)ckpt_get_u64(&rd);
+    r->split_size = ckpt_get_u64(&rd);
+    r->solid = (int)ckpt_get_u64(&rd);
+    r->solid_block_size = ckpt_get_u64(&rd);
+    r->solid_block_files = (int)ckpt_get_u64(&rd);
+    r->delta_distance = (unsigned)ckpt_get_u64(&rd);
+    r->encrypted = (int)ckpt_get_u64(&rd);
+    r->key_check = (uint32_t)ckpt_get_u64(&rd);
+    r->packed_size = ckpt_get_u64(&rd);
+    uint64_t next_file = ckpt_get_u64(&rd);
+    uint64_t file_count = ckpt_get_u64(&rd);
+    uint64_t folder_count = ckpt_get_u64(&rd);
+    /* Every file takes at least 80 bytes, which bounds the allocation */
+    ok = ok && !rd.failed && r->split_size > 0 && file_count > 0 &&
+         file_count <= rd.left / 80 && next_file <= file_count && folder_count <= file_count;
+
+    for (uint64_t i = 0; ok && i < file_count; i++) {
+        char* name = ckpt_get_str(&rd);
+        char* full_path = ckpt_get_str(&rd);
+        uint64_t file_size = ckpt_get_u64(&rd);
+        uint64_t mtime = ckpt_get_u64(&rd);
+        uint32_t attrib = (uint32_t)ckpt_get_u64(&rd);
+        ok = !rd.failed && mv_file_list_add(&r->list, full_path, name, file_size, mtime, attrib, 0, 0);
+        mem_free(name);
+        mem_free(full_path);
+        if (!ok) break;
+        MV_FileEntry* file = &r->list.entries[r->list.count - 1];
+        file->sparse = 1;  /* Not scanned: the extents tell as it is read */
+        file->crc = (uint32_t)ckpt_get_u64(&rd);
+        file->lzma2_prop = (Byte)ckpt_get_u64(&rd);
+        file->is_dir = (int)ckpt_get_u64(&rd);
+        file->filter = (SevenZipFilter)ckpt_get_u64(&rd);
+        file->use_ppmd = (int)ckpt_get_u64(&rd);
+        file->store = (int)ckpt_get_u64(&rd);
+        file->level = (int)ckpt_get_u64(&rd);
+        file->group = (uint32_t)ckpt_get_u64(&rd);
+        if (file->is_dir) r->list.total_size -= file_size;
+    }
+
+    if (ok) {
+        r->folders = (MV_Folder*)mem_calloc(SEVENZIP_MEM_HEADER, (size_t)file_count, sizeof(MV_Folder));
+        ok = r->folders != NULL;
+    }
+    for (uint64_t i = 0; ok && i < folder_count; i++) {
+        MV_Folder* folder = &r->folders[i];
+        folder->pack_size = ckpt_get_u64(&rd);
+        folder->unpack_size = ckpt_get_u64(&rd);
+        folder->num_files = (size_t)ckpt_get_u64(&rd);
+        folder->lzma2_prop = (Byte)ckpt_get_u64(&rd);
+        folder->filter = (SevenZipFilter)ckpt_get_u64(&rd);
+        folder->delta_distance = (unsigned)ckpt_get_u64(&rd);
+        folder->use_ppmd = (int)ckpt_get_u64(&rd);
+        folder->ppmd.order = (unsigned)ckpt_get_u64(&rd);
+        folder->ppmd.mem_size = (UInt32)ckpt_get_u64(&rd);
+        folder->encrypted = (int)ckpt_get_u64(&rd);
+        ckpt_get(&rd, folder->aes_iv, AES_CODER_IV_SIZE);
+        folder->aes_size = ckpt_get_u64(&rd);
+    }
+    mem_free(data);
+
+    if (!ok || rd.failed) {
+        mv_resume_free(r);
+        fprintf(stderr, "Damaged checkpoint: %s\n", path);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    r->next_file = (size_t)next_file;
+    r->folder_count = (size_t)folder_count;
+    return SEVENZIP_OK;
+}
+
+/* Files still to be compressed must be the ones the checkpoint was taken of */
+static int mv_inputs_unchanged(const MV_Resume* r) {
+    for (size_t i = r->next_file; i < r->list.count; i++) {
+        const MV_FileEntry* file = &r->list.entries[i];
+        if (file->is_dir) continue;
         struct STAT st;
-        if (STAT(input_paths[i], &st) != 0) {
-            continue;
+        uint64_t mtime = 0;
+        if (STAT(file->full_path, &st) == 0) {
+            mtime = ((uint64_t)st.st_mtime * 10000000ULL) + 116444736000000000ULL;
         }
-        
-        if (S_ISREG(st.st_mode)) {
-            /* Regular file - add directly */
-            const char* basename = strrchr(input_paths[i], PATH_SEP);
-            ADD_FILE_ENTRY(input_paths[i], basename ? basename + 1 : input_paths[i]);
-        }
-        else if (S_ISDIR(st.st_mode)) {
-            /* Directory - recursively gather files */
-            /* We'll use a simple recursive approach with a stack */
-            char** dir_stack = (char**)malloc(256 * sizeof(char*));
-            size_t stack_capacity = 256;
-            size_t stack_size = 0;
-            
-            /* Get the base directory name for relative paths */
-            const char* base_dir_name = strrchr(input_paths[i], PATH_SEP);
-            base_dir_name = base_dir_name ? base_dir_name + 1 : input_paths[i];
-            size_t base_path_len = strlen(input_paths[i]);
-            
-            /* Push initial directory */
-            dir_stack[stack_size++] = strdup(input_paths[i]);
-            
-            while (stack_size > 0) {
-                char* current_dir = dir_stack[--stack_size];
-                
-#ifdef _WIN32
-                /* Windows directory iteration */
-                char search_path[PATH_MAX];
-                snprintf(search_path, PATH_MAX, "%s\\*", current_dir);
-                WIN32_FIND_DATAA fd;
-                HANDLE hFind = FindFirstFileA(search_path, &fd);
-                if (hFind != INVALID_HANDLE_VALUE) {
-                    do {
-                        if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
-                        
-                        char full_path[PATH_MAX];
-                        snprintf(full_path, PATH_MAX, "%s\\%s", current_dir, fd.cFileName);
-                        
-                        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                            if (stack_size >= stack_capacity) {
-                                stack_capacity *= 2;
-                                dir_stack = (char**)realloc(dir_stack, stack_capacity * sizeof(char*));
-                            }
-                            dir_stack[stack_size++] = strdup(full_path);
-                        } else {
-                            /* Build relative name: base_dir_name + path after base_path */
-                            char relative_name[PATH_MAX];
-                            snprintf(relative_name, PATH_MAX, "%s%s", base_dir_name, full_path + base_path_len);
-                            ADD_FILE_ENTRY(full_path, relative_name);
-                        }
-                    } while (FindNextFileA(hFind, &fd));
-                    FindClose(hFind);
-                }
-#else
-                /* Unix directory iteration */
-                DIR* dp = opendir(current_dir);
-                if (dp) {
-                    struct dirent* de;
-                    while ((de = readdir(dp)) != NULL) {
-                        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
-                        
-                        char full_path[PATH_MAX];
-                        snprintf(full_path, PATH_MAX, "%s/%s", current_dir, de->d_name);
-                        
-                        struct STAT child_st;
-                        if (STAT(full_path, &child_st) != 0) continue;
-                        
-                        if (S_ISDIR(child_st.st_mode)) {
-                            if (stack_size >= stack_capacity) {
-                                stack_capacity *= 2;
-                                dir_stack = (char**)realloc(dir_stack, stack_capacity * sizeof(char*));
-                            }
-                            dir_stack[stack_size++] = strdup(full_path);
-                        } else if (S_ISREG(child_st.st_mode)) {
-                            /* Build relative name: base_dir_name + path after base_path */
-                            char relative_name[PATH_MAX];
-                            snprintf(relative_name, PATH_MAX, "%s%s", base_dir_name, full_path + base_path_len);
-                            ADD_FILE_ENTRY(full_path, relative_name);
-                        }
-                    }
-                    closedir(dp);
-                }
-#endif
-                free(current_dir);
-            }
-            free(dir_stack);
+        /* Compared to the second: scanned Windows times carry 100ns ticks */
+        if (mtime == 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size != file->size ||
+            mtime / 10000000ULL != file->mtime / 10000000ULL) {
+            fprintf(stderr, "Input changed since the checkpoint: %s\n", file->full_path);
+            return 0;
         }
     }
-    
-    #undef ADD_FILE_ENTRY
-    
-    if (file_count == 0) {
-        free(files);
-        free(ctx.volumes);
-        return SEVENZIP_ERROR_INVALID_PARAM;
-    }
-    
-    /* Setup encoder properties - Let SDK choose optimal settings */
-    CLzma2EncProps props;
-    Lzma2EncProps_Init(&props);
-    
-    /* Map compression level - SDK will optimize based on level */
+    return 1;
+}
+
+/* Reopen the volumes of an interrupted job, cut back to the signature
+ * header and `packed_size` packed bytes; later volumes are removed */
+static int mv_reopen_volumes(MultiVolumeContext* ctx, uint64_t packed_size) {
+    uint64_t end = k7zStartHeaderSize + packed_size;
+    size_t full = (size_t)(end / ctx->max_volume_size);
+    uint64_t tail = end % ctx->max_volume_size;
+    size_t keep = full + (tail > 0 ? 1 : 0);
+    char vol_path[1280];
+
+    for (size_t i = 0; i < keep; i++) {
+        if (ctx->volume_count >= ctx->volume_capacity) {
+            ctx->volume_capacity *= 2;
+            FILE** new_vols = (FILE**)mem_realloc(SEVENZIP_MEM_OTHER, ctx->volumes, ctx->volume_capacity * sizeof(FILE*));
+            if (!new_vols) return 0;
+            ctx->volumes = new_vols;
+        }
+        mv_volume_path(ctx, vol_path, sizeof(vol_path), i);
+        uint64_t needed = (i < full) ? ctx->max_volume_size : tail;
+        struct STAT st;
+        FILE* f = NULL;
+        if (STAT(vol_path, &st) == 0 && (uint64_t)st.st_size >= needed) {
+            f = fopen(vol_path, "r+b");
+        }
+        if (!f) {
+            fprintf(stderr, "Volume missing or short: %s\n", vol_path);
+            return 0;
+        }
+        setvbuf(f, NULL, _IOFBF, 4 * 1024 * 1024);
+        ctx->volumes[ctx->volume_count++] = f;
+    }
+
+    /* Data written after the checkpoint goes */
+    FILE* last = ctx->volumes[keep - 1];
+    uint64_t last_size = tail > 0 ? tail : ctx->max_volume_size;
+    if (!set_volume_size(last, last_size) || FSEEK64(last, (int64_t)last_size, SEEK_SET) != 0) {
+        return 0;
+    }
+    ctx->current_volume_size = last_size;
+    for (size_t i = keep;; i++) {
+        mv_volume_path(ctx, vol_path, sizeof(vol_path), i);
+        if (remove(vol_path) != 0) break;
+    }
+    return 1;
+}
+
+/* Anonymous scratch file in `dir` (NULL = where tmpfile() puts it) */
+static FILE* mv_scratch_file(const char* dir) {
+    if (!dir || !dir[0]) return tmpfile();
+#ifdef _WIN32
+    char* path = _tempnam(dir, "7z_spill_");
+    if (!path) return NULL;
+    /* D: deleted once closed, T: kept in the cache if it fits */
+    FILE* f = fopen(path, "w+bTD");
+    free(path);
+    return f;
+#else
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/7z_spill_XXXXXX", dir) >= (int)sizeof(path)) return NULL;
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    unlink(path);
+    FILE* f = fdopen(fd, "w+b");
+    if (!f) close(fd);
+    return f;
+#endif
+}
+
+/* Output stream that buffers one pack stream in memory, spilling to disk */
+typedef struct {
+    ISeqOutStream vt;
+    Byte* data;
+    size_t size;
+    size_t capacity;
+    FILE* spill;
+    uint64_t total;
+    int failed;
+    size_t limit;   /* Bytes kept in memory before spilling */
+    const char* temp_dir;  /* Of the spill file (NULL = system default) */
+    /* Write-through to the sequencer */
+    volatile int head;     /* The sequencer waits for this stream */
+    volatile int pending;  /* A full buffer is handed over */
+    uint64_t passed;       /* Bytes the sequencer has written out */
+    CAutoResetEvent* ready;  /* The slot's done event, also set for a handover */
+    CAutoResetEvent drained; /* The sequencer took the buffer */
+    RatioGuard* guard;     /* Disarmed once bytes are passed (NULL = none) */
+} SpillOutStream;
+
+static size_t SpillOutStream_Write(ISeqOutStreamPtr pp, const void *buf, size_t size) {
+    SpillOutStream* s = Z7_CONTAINER_FROM_VTBL(pp, SpillOutStream, vt);
+
+    if (!s->spill && s->size + size > s->limit) {
+        if (s->head && s->size > 1) {
+            /* Written through: the stream is final from here on */
+            if (s->guard) s->guard->disarmed = 1;
+            s->pending = 1;
+            Event_Set(s->ready);
+            Event_Wait(&s->drained);
+            if (s->failed) return 0;
+        } else {
+            s->spill = mv_scratch_file(s->temp_dir);
+            if (!s->spill || (s->size > 0 && fwrite(s->data, 1, s->size, s->spill) != s->size)) {
+                s->failed = 1;
+                return 0;
+            }
+            s->size = 0;
+        }
+    }
+
+    if (s->spill) {
+        if (fwrite(buf, 1, size, s->spill) != size) {
+            s->failed = 1;
+            return 0;
+        }
+    } else {
+        if (s->size + size > s->capacity) {
+            size_t new_capacity = s->capacity ? s->capacity : (64 * 1024);
+            while (new_capacity < s->size + size) new_capacity *= 2;
+            Byte* new_data = (Byte*)mem_realloc(SEVENZIP_MEM_IO_BUFFERS, s->data, new_capacity);
+            if (!new_data) {
+                s->failed = 1;
+                return 0;
+            }
+            s->data = new_data;
+            s->capacity = new_capacity;
+        }
+        memcpy(s->data + s->size, buf, size);
+        s->size += size;
+    }
+
+    s->total += size;
+    return size;
+}
+
+/* Sequencer: write out a handed-over buffer but its last byte, which
+ * SpillOutStream_Trim() may still drop, and give it back */
+static int SpillOutStream_Pass(SpillOutStream* s, MultiVolumeContext* ctx) {
+    size_t n = s->size - 1;
+    int ok = write_across_volumes(ctx, s->data, n);
+    s->data[0] = s->data[n];
+    s->size = 1;
+    s->passed += n;
+    if (!ok) s->failed = 1;
+    s->pending = 0;
+    Event_Set(&s->drained);
+    return ok;
+}
+
+/* Write the buffered pack stream to the volumes and reset the buffer */
+static int SpillOutStream_Drain(SpillOutStream* s, MultiVolumeContext* ctx) {
+    int ok = 1;
+
+    if (s->spill) {
+        rewind(s->spill);
+        if (s->capacity < s->limit) {
+            Byte* new_data = (Byte*)mem_realloc(SEVENZIP_MEM_IO_BUFFERS, s->data, s->limit);
+            if (!new_data) ok = 0;
+            else {
+                s->data = new_data;
+                s->capacity = s->limit;
+            }
+        }
+        uint64_t remaining = s->total;
+        while (ok && remaining > 0) {
+            size_t want = remaining < s->capacity ? (size_t)remaining : s->capacity;
+            size_t got = fread(s->data, 1, want, s->spill);
+            if (got == 0) break;
+            if (!write_across_volumes(ctx, s->data, got)) ok = 0;
+            remaining -= got;
+        }
+        fclose(s->spill);
+        s->spill = NULL;
+    } else if (s->size > 0) {
+        ok = write_across_volumes(ctx, s->data, s->size);
+    }
+
+    s->size = 0;
+    s->total = 0;
+    s->passed = 0;
+    s->failed = 0;
+    return ok;
+}
+
+/* Drop the last `n` bytes written (Drain stops short of them) */
+static void SpillOutStream_Trim(SpillOutStream* s, size_t n) {
+    if (n > s->total) n = (size_t)s->total;
+    if (!s->spill) s->size -= n;
+    s->total -= n;
+}
+
+/* Discard the buffered pack stream, keeping the memory for the next one */
+static void SpillOutStream_Reset(SpillOutStream* s) {
+    if (s->spill) {
+        fclose(s->spill);
+        s->spill = NULL;
+    }
+    s->size = 0;
+    s->total = 0;
+    s->failed = 0;
+}
+
+static void SpillOutStream_Free(SpillOutStream* s) {
+    if (s->spill) fclose(s->spill);
+    if (Event_IsCreated(&s->drained)) Event_Close(&s->drained);
+    mem_free(s->data);
+    memset(s, 0, sizeof(*s));
+}
+
+/* One task: a whole file, or one block of a large file split over the workers */
+typedef struct {
+    size_t file_index;
+    uint64_t offset;       /* Start of the block within the file */
+    uint64_t size;         /* Bytes of the block (whole file: its size) */
+    int first;             /* First block: starts the file's folder */
+    int last;              /* Last block: ends it */
+    int cache_key;         /* options->block_cache_dir: the file has a key */
+    int cached;            /* ... and an entry, spliced in by the worker (whole file) */
+} MV_Task;
+
+/* One in-flight task */
+typedef struct {
+    SpillOutStream out;
+    size_t file_index;
+    uint32_t crc;          /* Of the task's bytes */
+    Byte prop;
+    SRes res;
+    int spliced;           /* The pack stream came from options->block_cache_dir */
+    OpStatsEncode encode;  /* Encoder counts of the task */
+    CAutoResetEvent done;
+} MV_JobSlot;
+
+typedef struct {
+    MV_FileEntry* files;
+    MV_Task* tasks;        /* In archive order, blocks of a file in file order */
+    size_t job_count;
+    size_t next_job;       /* Guarded by lock */
+    MV_JobSlot* slots;
+    UInt32 slot_count;
+    CSemaphore free_slots;
+    CCriticalSection lock;
+    CLzma2EncProps props;  /* Per-worker encoder props (mv_worker_props) */
+    unsigned delta_distance;
+    MV_PpmdParams ppmd;    /* Model for files marked use_ppmd */
+    int input_hints;
+    const ZeroRunChunks* zero_runs;  /* NULL = options->zero_blocks off */
+    MemoryPressure* pressure;        /* NULL = options->memory_pressure_throttle off */
+    ThroughputSlo* slo;              /* NULL = options->throughput_target off */
+    OpStats* stats;
+    const SevenZipCancelToken* cancel;
+    SevenZipRateLimit* rate_limit;
+    const char* block_cache_dir;       /* options->block_cache_dir, NULL = off */
+    const BlockCacheKey* cache_keys;   /* Of each file with MV_Task.cache_key */
+    int numa;              /* SEVENZIP_NUMA_LOCAL: workers are pinned, round robin */
+    int pinned;            /* Workers pinned so far, guarded by lock */
+    volatile int stop;
+} MV_WorkerPool;
+
+/* Encoder props with the parsing of `level` (options->entry_policy) over
+ * the dictionary and match finder of `base`, which the memory plan was
+ * made for; level 0 keeps `base` */
+static void mv_level_props(const CLzma2EncProps* base, int level, CLzma2EncProps* props) {
+    *props = *base;
+    if (level <= 0 || level == base->lzmaProps.level) return;
+    CLzmaEncProps p;
+    LzmaEncProps_Init(&p);
+    p.level = level;
+    p.dictSize = base->lzmaProps.dictSize;
+    p.btMode = base->lzmaProps.btMode;
+    p.numHashBytes = base->lzmaProps.numHashBytes;
+    LzmaEncProps_Normalize(&p);
+    props->lzmaProps.level = level;
+    props->lzmaProps.algo = p.algo;
+    props->lzmaProps.fb = p.fb;
+    props->lzmaProps.mc = p.mc;
+}
+
+/* Helper: Encode one block of a split file into its job slot
+ *
+ * Blocks of a file are independent LZMA2 streams, as the block threads of
+ * Lzma2Enc write them, so the sequencer joins them into one pack stream
+ * once each block but the last loses its end marker. Split files are
+ * unfiltered LZMA2 and were found compressible before splitting, so
+ * there is no store fallback here; LZMA2 keeps any incompressible chunk
+ * stored on its own.
+ */
+static void mv_worker_encode_block(MV_WorkerPool* pool, const MV_Task* task,
+                                   CLzma2EncHandle enc, MV_JobSlot* slot) {
+    MV_FileEntry* file = &pool->files[task->file_index];
+    if (slot->res != SZ_OK) return;
+
+    /* The whole file's size keeps the dictionary, and so the property
+     * byte, the same in every block, whatever rung each one runs on */
+    int rung = pool->slo ? throughput_slo_rung(pool->slo) : 0;
+    CLzma2EncProps props;
+    mv_level_props(&pool->props, file->level, &props);
+    throughput_slo_props(&props, rung, &props);
+    Lzma2Enc_SetDataSize(enc, file->size);
+    slot->res = Lzma2Enc_SetProps(enc, &props);
+    if (slot->res != SZ_OK) return;
+    slot->prop = Lzma2Enc_WriteProperties(enc);
+
+    SolidInStream in;
+    memset(&in, 0, sizeof(in));
+    in.vt.Read = SolidInStream_Read;
+    in.files = file;
+    in.file_count = 1;
+    in.file_crcs = &slot->crc;
+    in.current_crc = CRC_INIT_VAL;
+    in.stats = pool->stats;
+    in.cancel = pool->cancel;
+    in.rate_limit = pool->rate_limit;
+    in.range_offset = task->offset;
+    in.range_size = task->size;
+
+    slot->out.vt.Write = SpillOutStream_Write;
+    slot->out.guard = NULL;
+    CancelProgress cancel;
+    TRACE_BEGIN(compress);
+    OpStatsEncodeTimer encode_timer;
+    op_stats_encode_begin(pool->stats, &encode_timer, enc);
+    if (pool->zero_runs) {
+        slot->res = zero_run_encode(enc, &props, file->size, &slot->out.vt, &in.vt,
+                                    CancelProgress_Init(&cancel, pool->cancel, NULL),
+                                    pool->zero_runs, NULL);
+    } else {
+        slot->res = Lzma2Enc_Encode2(enc, &slot->out.vt, NULL, NULL, &in.vt, NULL, 0,
+                                     CancelProgress_Init(&cancel, pool->cancel, NULL));
+    }
+    op_stats_encode_end(pool->stats, &encode_timer, enc,
+                        op_stats_block_threads(&props, task->size), &slot->encode);
+    TRACE_END(compress, TRACE_COMPRESS, task->size);
+    if (pool->slo && slot->res == SZ_OK) {
+        throughput_slo_report(pool->slo, rung, task->size, slot->encode.seconds);
+    }
+    if (in.current_fp) {
+        SolidInStream_CloseFile(&in);
+    }
+
+    if (slot->res == SZ_OK && (slot->out.failed || in.total_read != task->size)) {
+        slot->res = slot->out.failed ? SZ_ERROR_WRITE : SZ_ERROR_READ;
+    }
+    if (slot->res == SZ_OK && !task->last) {
+        SpillOutStream_Trim(&slot->out, 1);  /* LZMA2_CONTROL_EOF */
+    }
+}
+
+/* Helper: Fill the job slot with the pack stream of the file's entry in
+ * options->block_cache_dir
+ * @return 0 if the entry is gone or damaged before any of it was written
+ *         through, the slot left for the file to be compressed instead */
+static int mv_worker_splice(MV_WorkerPool* pool, const MV_Task* task, Byte* buf, MV_JobSlot* slot) {
+    MV_FileEntry* file = &pool->files[task->file_index];
+    const BlockCacheKey* key = &pool->cache_keys[task->file_index];
+    BlockCacheInfo info;
+    FILE* f = block_cache_open(pool->block_cache_dir, key, &info);
+    if (!f) return 0;
+
+    /* The folder may open at the sequencer while the entry is copied */
+    SevenZipFilter filter = file->filter;
+    int use_ppmd = file->use_ppmd;
+    slot->prop = info.prop;
+    file->filter = info.filter;
+    file->use_ppmd = info.use_ppmd;
+    slot->out.vt.Write = SpillOutStream_Write;
+    slot->out.guard = NULL;
+    int ok = info.unpack_size == file->size &&
+             block_cache_copy(f, &info, &slot->out.vt, buf, STORE_COPY_BUFFER_SIZE);
+    fclose(f);
+    /* A manifest XXH3-128 is the key itself */
+    if (ok && file->digest_slot) {
+        if (file->digest_slot->algorithm == SEVENZIP_DIGEST_XXH3_128) {
+            memcpy(file->digest_slot->value, key->content, XXH3_128_DIGEST_SIZE);
+        } else {
+            ok = mv_digest_file(file->full_path, file->digest_slot);
+        }
+    }
+    if (!ok) {
+        if (slot->out.failed || slot->out.passed > 0) {
+            slot->res = slot->out.failed ? SZ_ERROR_WRITE : SZ_ERROR_DATA;
+            return 1;
+        }
+        SpillOutStream_Reset(&slot->out);
+        file->filter = filter;
+        file->use_ppmd = use_ppmd;
+        return 0;
+    }
+    slot->crc = info.crc;
+    slot->spliced = 1;
+    return 1;
+}
+
+/* Worker: compress the tasks into job slots until the task list is exhausted */
+static THREAD_FUNC_DECL MV_Worker_Thread(void* arg) {
+    MV_WorkerPool* pool = (MV_WorkerPool*)arg;
+    thread_sched_enter();
+    
+    /* Pinned before the encoder exists, so its memory is node-local */
+    if (pool->numa) {
+        CriticalSection_Enter(&pool->lock);
+        int node = pool->pinned++;
+        CriticalSection_Leave(&pool->lock);
+        numa_bind_thread(node);
+    }
+
+    /* One encoder per worker, reused for every file it compresses */
+    ThreadPlacer placer;
+    int placed = thread_placer_init(&placer, SEVENZIP_NUMA_OFF);
+    CLzma2EncHandle enc = placed
+        ? Lzma2Enc_Create(&placer.small, &placer.big)
+        : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    Byte* copy_buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, STORE_COPY_BUFFER_SIZE);
+
+    for (;;) {
+        Semaphore_Wait(&pool->free_slots);
+        if (pool->stop) break;
+
+        /* Held back under memory pressure, the encoder is given up while
+           it waits and made again for the next job */
+        if (pool->pressure) {
+            if (enc && memory_pressure_throttled(pool->pressure)) {
+                Lzma2Enc_Destroy(enc);
+                enc = NULL;
+            }
+            memory_pressure_enter(pool->pressure);
+            if (!enc) {
+                enc = placed ? Lzma2Enc_Create(&placer.small, &placer.big)
+                             : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+            }
+        }
+
+        CriticalSection_Enter(&pool->lock);
+        size_t job = pool->next_job++;
+        CriticalSection_Leave(&pool->lock);
+        if (job >= pool->job_count) {
+            if (pool->pressure) memory_pressure_leave(pool->pressure);
+            break;
+        }
+
+        MV_JobSlot* slot = &pool->slots[job % pool->slot_count];
+        const MV_Task* task = &pool->tasks[job];
+        MV_FileEntry* file = &pool->files[task->file_index];
+        slot->file_index = task->file_index;
+        slot->crc = 0;
+        slot->res = (enc && copy_buf) ? SZ_OK : SZ_ERROR_MEM;
+        slot->spliced = 0;
+        memset(&slot->encode, 0, sizeof(slot->encode));
+
+        if (slot->res == SZ_OK && task->cached && mv_worker_splice(pool, task, copy_buf, slot)) {
+            if (pool->pressure) memory_pressure_leave(pool->pressure);
+            Event_Set(&slot->done);
+            continue;
+        }
+
+        if (!(task->first && task->last)) {
+            mv_worker_encode_block(pool, task, enc, slot);
+            if (pool->pressure) memory_pressure_leave(pool->pressure);
+            Event_Set(&slot->done);
+            continue;
+        }
+
+        /* Recognized formats and large files whose samples look random go
+         * into a Copy folder; behind the throughput target, poor ones too */
+        int rung = pool->slo ? throughput_slo_rung(pool->slo) : 0;
+        CLzma2EncProps props;
+        mv_level_props(&pool->props, file->level, &props);
+        throughput_slo_props(&props, rung, &props);
+        int store = file->store;
+        if (!store && !file->use_ppmd && file->size > ENTROPY_MIN_CHECK_SIZE) {
+            double bits;
+            store = sevenzip_entropy_of_file(file->full_path, file->size, &bits) == SEVENZIP_OK &&
+                    (!sevenzip_entropy_is_compressible(bits) || throughput_slo_stores(rung, bits));
+            if (store) file->filter = SEVENZIP_FILTER_NONE;
+        }
+
+        if (slot->res == SZ_OK && !file->use_ppmd && !store) {
+            Lzma2Enc_SetDataSize(enc, file->size);
+            slot->res = Lzma2Enc_SetProps(enc, &props);
+        }
+
+        /* A compressed stream that fails to shrink is thrown away and the
+         * file is read again into a Copy folder (at most one retry) */
+        while (slot->res == SZ_OK) {
+            slot->prop = (file->use_ppmd || store) ? 0 : Lzma2Enc_WriteProperties(enc);
+
+            /* Single-file solid stream: reuses the CRC-computing reader */
+            SolidInStream in;
+            memset(&in, 0, sizeof(in));
+            in.vt.Read = SolidInStream_Read;
+            in.files = file;
+            in.file_count = 1;
+            in.file_crcs = &slot->crc;
+            in.current_crc = CRC_INIT_VAL;
+            in.input_hints = pool->input_hints;
+            in.stats = pool->stats;
+            in.cancel = pool->cancel;
+            in.rate_limit = pool->rate_limit;
+
+            ISeqInStreamPtr src = &in.vt;
+            FilterInStream filtered;
+            int use_filter = (file->filter != SEVENZIP_FILTER_NONE);
+            if (use_filter) {
+                slot->res = FilterInStream_Init(&filtered, file->filter, pool->delta_distance, &in.vt);
+                src = &filtered.vt;
+            }
+
+            RatioGuard guard;
+            RatioGuard_Init(&guard);
+            slot->out.vt.Write = SpillOutStream_Write;
+            slot->out.guard = &guard;
+            if (slot->res == SZ_OK && store) {
+                for (;;) {
+                    size_t got = STORE_COPY_BUFFER_SIZE;
+                    slot->res = in.vt.Read(&in.vt, copy_buf, &got);
+                    if (slot->res != SZ_OK || got == 0) break;
+                    if (SpillOutStream_Write(&slot->out.vt, copy_buf, got) != got) break;
+                }
+            } else if (slot->res == SZ_OK && file->use_ppmd) {
+                TRACE_BEGIN(compress);
+                slot->res = sevenzip_ppmd_encode(&slot->out.vt, src, pool->ppmd.order,
+                                                 pool->ppmd.mem_size);
+                TRACE_END(compress, TRACE_COMPRESS, file->size);
+            } else if (slot->res == SZ_OK) {
+                CancelProgress cancel;
+                OpStatsEncodeTimer encode_timer;
+                TRACE_BEGIN(compress);
+                op_stats_encode_begin(pool->stats, &encode_timer, enc);
+                if (pool->zero_runs) {
+                    slot->res = zero_run_encode(enc, &props, file->size, &slot->out.vt, src,
+                                                CancelProgress_Init(&cancel, pool->cancel, &guard.vt),
+                                                pool->zero_runs, NULL);
+                } else {
+                    slot->res = Lzma2Enc_Encode2(enc, &slot->out.vt, NULL, NULL, src, NULL, 0,
+                                                 CancelProgress_Init(&cancel, pool->cancel, &guard.vt));
+                }
+                op_stats_encode_end(pool->stats, &encode_timer, enc,
+                                    op_stats_block_threads(&props, file->size), &slot->encode);
+                TRACE_END(compress, TRACE_COMPRESS, file->size);
+                if (pool->slo && slot->res == SZ_OK) {
+                    throughput_slo_report(pool->slo, rung, in.total_read, slot->encode.seconds);
+                }
+            }
+            if (use_filter) {
+                FilterInStream_Free(&filtered);
+            }
+
+            if (in.current_fp) {
+                SolidInStream_CloseFile(&in);
+            }
+
+            slot->out.guard = NULL;
+            int fall_back = !store && !slot->out.failed && slot->out.passed == 0 &&
+                            (guard.tripped ||
+                             (slot->res == SZ_OK && in.total_read == file->size &&
+                              !sevenzip_ratio_is_worthwhile(file->size, slot->out.total)));
+            if (fall_back) {
+                SpillOutStream_Reset(&slot->out);
+                slot->res = SZ_OK;
+                slot->crc = 0;
+                memset(&slot->encode, 0, sizeof(slot->encode));  /* Stored, not coded */
+                store = 1;
+                file->filter = SEVENZIP_FILTER_NONE;
+                file->use_ppmd = 0;
+                continue;
+            }
+
+            if (slot->res == SZ_OK && (slot->out.failed || in.total_read != file->size)) {
+                slot->res = slot->out.failed ? SZ_ERROR_WRITE : SZ_ERROR_READ;
+            }
+            break;
+        }
+
+        if (pool->pressure) memory_pressure_leave(pool->pressure);
+        Event_Set(&slot->done);
+    }
+
+    if (enc) Lzma2Enc_Destroy(enc);
+    mem_free(copy_buf);
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Each worker runs a single-threaded encoder; parallelism comes from files */
+static void mv_worker_props(const CLzma2EncProps* props, CLzma2EncProps* worker) {
+    *worker = *props;
+    worker->numTotalThreads = 1;
+    worker->numBlockThreads_Max = 1;
+    worker->numBlockThreads_Reduced = -1;
+    worker->lzmaProps.numThreads = 1;
+    worker->blockSize = LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID;
+    Lzma2EncProps_Normalize(worker);
+}
+
+/* Helper: CRC-32 of A followed by B from their CRCs and B's length (zlib's
+ * crc32_combine: B's length in zeros is applied to crc_a by squaring the
+ * one-zero-bit operator) */
+static uint32_t gf2_times(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2_square(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2_times(mat, mat[n]);
+    }
+}
+
+static uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+    if (len_b == 0) return crc_a;
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = 0xEDB88320;  /* CRC-32 polynomial, reflected */
+    for (int n = 1, row = 1; n < 32; n++, row <<= 1) {
+        odd[n] = (uint32_t)row;
+    }
+    gf2_square(even, odd);  /* Two zero bits */
+    gf2_square(odd, even);  /* Four zero bits */
+    do {
+        gf2_square(even, odd);
+        if (len_b & 1) crc_a = gf2_times(even, crc_a);
+        len_b >>= 1;
+        if (!len_b) break;
+        gf2_square(odd, even);
+        if (len_b & 1) crc_a = gf2_times(odd, crc_a);
+        len_b >>= 1;
+    } while (len_b);
+    return crc_a ^ crc_b;
+}
+
+/* Helper: Whether `file` is split into blocks of `block_size` for the pool
+ * (`parallel`: more than one worker, or deterministic output, which splits
+ * alike on any number); unfiltered LZMA2 only, and not when its samples
+ * look random (checked here, so it leaves the file whole for the Copy
+ * fallback) */
+static int mv_should_split(MV_FileEntry* file, uint64_t block_size, int parallel) {
+    if (!parallel || block_size == 0 || file->size <= block_size) return 0;
+    if (file->store || file->use_ppmd || file->filter != SEVENZIP_FILTER_NONE) return 0;
+    double bits;
+    return sevenzip_entropy_of_file(file->full_path, file->size, &bits) != SEVENZIP_OK ||
+           sevenzip_entropy_is_compressible(bits);
+}
+
+/* Helper: Start the folder of `file` at the sequencer, its pack stream
+ * encrypted with a password and, if LZMA2, decoded by the verifier
+ * @return The folder, NULL if the cipher could not start */
+static MV_Folder* mv_sequencer_open_folder(MultiVolumeContext* ctx, MV_Folder* folders,
+                                           size_t* folder_count, MV_FileEntry* file, Byte prop,
+                                           unsigned delta_distance, const MV_PpmdParams* ppmd) {
+    MV_Folder* folder = &folders[(*folder_count)++];
+    folder->pack_size = 0;
+    folder->unpack_size = file->size;
+    folder->num_files = 1;
+    folder->lzma2_prop = prop;
+    folder->filter = file->filter;
+    folder->delta_distance = delta_distance;
+    folder->use_ppmd = file->use_ppmd;
+    folder->ppmd = *ppmd;
+    file->lzma2_prop = prop;
+    if (!mv_cipher_begin(ctx, folder)) return NULL;
+    if (ctx->verify && prop != 0 && !file->use_ppmd) {
+        write_verify_begin(ctx->verify, prop, file->filter, delta_distance);
+    }
+    progress_reporter_begin_file(&ctx->progress, file->name, file->size);
+    return folder;
+}
+
+/* Helper: Key of `file` in options->block_cache_dir: the XXH3-128 of its
+ * data and the settings its folder is coded with
+ * @return 0 if the file could not be read */
+static int mv_block_cache_key(const MV_FileEntry* file, const CLzma2EncProps* worker_props,
+                              unsigned delta_distance, const MV_PpmdParams* ppmd,
+                              BlockCacheKey* key) {
+    FileDigestSlot slot;
+    slot.algorithm = SEVENZIP_DIGEST_XXH3_128;
+    if (!mv_digest_file(file->full_path, &slot)) return 0;
+    memcpy(key->content, slot.value, XXH3_128_DIGEST_SIZE);
+
+    UInt32 settings[16];
+    memset(settings, 0, sizeof(settings));
+    settings[0] = (UInt32)file->filter;
+    settings[1] = file->filter == SEVENZIP_FILTER_DELTA ? delta_distance : 0;
+    settings[2] = (UInt32)file->use_ppmd;
+    if (file->use_ppmd) {
+        settings[3] = ppmd->order;
+        settings[4] = ppmd->mem_size;
+    } else {
+        CLzma2EncProps props;
+        mv_level_props(worker_props, file->level, &props);
+        const CLzmaEncProps* lz = &props.lzmaProps;
+        settings[3] = (UInt32)lz->level;
+        settings[4] = lz->dictSize;
+        settings[5] = (UInt32)lz->lc;
+        settings[6] = (UInt32)lz->lp;
+        settings[7] = (UInt32)lz->pb;
+        settings[8] = (UInt32)lz->algo;
+        settings[9] = (UInt32)lz->fb;
+        settings[10] = (UInt32)lz->btMode;
+        settings[11] = (UInt32)lz->numHashBytes;
+        settings[12] = lz->mc;
+    }
+    key->coder = block_cache_coder_key(settings, sizeof(settings));
+    return 1;
+}
+
+/* Non-solid folders on a pool of single-threaded workers
+ *
+ * Workers take tasks from one list in archive order, each as soon as it
+ * is free, and the sequencer writes finished tasks in that order through
+ * a ring of two slots per worker; a worker runs ahead at most that far.
+ * Files larger than `block_size` become one task per block, so the last
+ * large file is compressed by all workers rather than one
+ * (LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID = never split).
+ *
+ * With options->block_cache_dir, each file is hashed first: one with an
+ * entry becomes a single task copying it, and the pack stream of any
+ * other compressed file is added to the cache as the sequencer writes it.
+ */
+static SRes compress_files_parallel(
+    MV_FileEntry* files,
+    size_t file_count,
+    MultiVolumeContext* ctx,
+    const CLzma2EncProps* worker_props,
+    int num_workers,
+    uint64_t block_size,
+    size_t spill_limit,
+    unsigned delta_distance,
+    const MV_PpmdParams* ppmd,
+    MV_Folder* folders,
+    size_t* folder_count
+) {
+    *folder_count = 0;
+    if (num_workers < 1) num_workers = 1;
+    if (block_size == (uint64_t)LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID) block_size = 0;
+    /* Unlike CRCs, manifest digests of blocks cannot be joined */
+    if (ctx->digests) block_size = 0;
+
+    size_t capacity = file_count ? file_count : 1;
+    MV_Task* tasks = (MV_Task*)mem_alloc(SEVENZIP_MEM_OTHER, capacity * sizeof(MV_Task));
+    BlockCacheKey* cache_keys = ctx->block_cache_dir
+        ? (BlockCacheKey*)mem_alloc(SEVENZIP_MEM_OTHER, capacity * sizeof(BlockCacheKey)) : NULL;
+    if (!tasks || (ctx->block_cache_dir && !cache_keys)) {
+        mem_free(tasks);
+        mem_free(cache_keys);
+        return SZ_ERROR_MEM;
+    }
+    size_t job_count = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        MV_FileEntry* file = &files[i];
+        if (file->is_dir || file->size == 0) {
+            file->crc = 0;
+            continue;
+        }
+        /* Stored files are not worth keeping */
+        int cache_key = cache_keys && file->full_path && !file->device && !file->store &&
+                        mv_block_cache_key(file, worker_props, delta_distance, ppmd, &cache_keys[i]);
+        int cached = 0;
+        if (cache_key) {
+            BlockCacheInfo info;
+            FILE* entry = block_cache_open(ctx->block_cache_dir, &cache_keys[i], &info);
+            if (entry) {
+                cached = info.unpack_size == file->size;
+                fclose(entry);
+            }
+        }
+        uint64_t step = !cached && mv_should_split(file, block_size, num_workers > 1 || ctx->deterministic)
+                      ? block_size : file->size;
+        if (step < file->size) op_stats_add_block_size(&ctx->stats, step);
+        for (uint64_t offset = 0; offset < file->size; offset += step) {
+            if (job_count == capacity) {
+                MV_Task* grown = (MV_Task*)mem_realloc(SEVENZIP_MEM_OTHER, tasks, capacity * 2 * sizeof(MV_Task));
+                if (!grown) {
+                    mem_free(tasks);
+                    mem_free(cache_keys);
+                    return SZ_ERROR_MEM;
+                }
+                tasks = grown;
+                capacity *= 2;
+            }
+            MV_Task* task = &tasks[job_count++];
+            task->file_index = i;
+            task->offset = offset;
+            task->size = file->size - offset < step ? file->size - offset : step;
+            task->first = offset == 0;
+            task->last = offset + task->size == file->size;
+            task->cache_key = cache_key;
+            task->cached = cached;
+        }
+    }
+    if (job_count == 0) {
+        mem_free(tasks);
+        mem_free(cache_keys);
+        return SZ_OK;
+    }
+
+    if ((size_t)num_workers > job_count) num_workers = (int)job_count;
+
+    MV_WorkerPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.files = files;
+    pool.tasks = tasks;
+    pool.job_count = job_count;
+    pool.slot_count = (UInt32)num_workers * 2;
+    pool.delta_distance = delta_distance;
+    pool.ppmd = *ppmd;
+    pool.input_hints = ctx->input_hints;
+    pool.zero_runs = ctx->zero_runs;
+    pool.pressure = ctx->pressure;
+    pool.slo = ctx->slo;
+    if (pool.slo) pool.slo->parallel = num_workers;
+    pool.stats = &ctx->stats;
+    pool.cancel = ctx->cancel;
+    pool.rate_limit = ctx->rate_limit;
+    pool.block_cache_dir = ctx->block_cache_dir;
+    pool.cache_keys = cache_keys;
+    pool.numa = ctx->numa_policy == SEVENZIP_NUMA_LOCAL;
+
+    pool.props = *worker_props;
+    op_stats_add_lzma2(&ctx->stats, worker_props, UINT64_MAX, num_workers);
+
+    SRes res = SZ_OK;
+    CThread* threads = (CThread*)mem_calloc(SEVENZIP_MEM_OTHER, (size_t)num_workers, sizeof(CThread));
+    pool.slots = (MV_JobSlot*)mem_calloc(SEVENZIP_MEM_OTHER, pool.slot_count, sizeof(MV_JobSlot));
+    if (!threads || !pool.slots) {
+        mem_free(threads);
+        mem_free(pool.slots);
+        mem_free(tasks);
+        mem_free(cache_keys);
+        return SZ_ERROR_MEM;
+    }
+
+    Semaphore_Construct(&pool.free_slots);
+    CriticalSection_Init(&pool.lock);
+    for (UInt32 i = 0; i < pool.slot_count; i++) {
+        pool.slots[i].out.limit = spill_limit;
+        pool.slots[i].out.temp_dir = ctx->temp_dir;
+        pool.slots[i].out.ready = &pool.slots[i].done;
+        Event_Construct(&pool.slots[i].done);
+        Event_Construct(&pool.slots[i].out.drained);
+        if (AutoResetEvent_CreateNotSignaled(&pool.slots[i].done) != 0 ||
+            AutoResetEvent_CreateNotSignaled(&pool.slots[i].out.drained) != 0) {
+            res = SZ_ERROR_THREAD;
+        }
+    }
+    /* Max count leaves room to wake every worker on shutdown */
+    if (res == SZ_OK &&
+        Semaphore_Create(&pool.free_slots, pool.slot_count, pool.slot_count + (UInt32)num_workers) != 0) {
+        res = SZ_ERROR_THREAD;
+    }
+
+    int started = 0;
+    for (int i = 0; res == SZ_OK && i < num_workers; i++) {
+        Thread_CONSTRUCT(&threads[i])
+        if (Thread_Create(&threads[i], MV_Worker_Thread, &pool) != 0) {
+            res = SZ_ERROR_THREAD;
+            break;
+        }
+        started++;
+    }
+
+    /* Sequencer: write finished pack streams in archive order; the blocks
+     * of a split file are appended to one folder */
+    MV_Folder* folder = NULL;
+    BlockCacheWriter cache_writer;
+    for (size_t job = 0; res == SZ_OK && job < job_count; job++) {
+        MV_JobSlot* slot = &pool.slots[job % pool.slot_count];
+        const MV_Task* task = &tasks[job];
+        MV_FileEntry* file = &files[task->file_index];
+
+        /* A file without an entry is added to the cache as it is written */
+        if (task->first && task->cache_key && !task->cached &&
+            block_cache_write_begin(&cache_writer, ctx->block_cache_dir, &cache_keys[task->file_index])) {
+            ctx->cache_writer = &cache_writer;
+        }
+
+        /* Buffers handed over while the task runs are written as they
+         * come; its folder opens before the first of them */
+        int begun = 0;
+        slot->out.head = 1;
+        for (;;) {
+            Event_Wait(&slot->done);
+            if (!slot->out.pending) break;
+            if (!begun && task->first) {
+                folder = mv_sequencer_open_folder(ctx, folders, folder_count, file, slot->prop,
+                                                  delta_distance, ppmd);
+                if (!folder) res = SZ_ERROR_WRITE;
+            }
+            begun = 1;
+            if (res != SZ_OK) {
+                /* The worker's next write fails */
+                slot->out.failed = 1;
+                slot->out.pending = 0;
+                Event_Set(&slot->out.drained);
+            } else if (!SpillOutStream_Pass(&slot->out, ctx)) {
+                res = SZ_ERROR_WRITE;
+            }
+        }
+        slot->out.head = 0;
+        if (res != SZ_OK) break;
+
+        if (slot->res != SZ_OK) {
+            res = slot->res;
+            break;
+        }
+
+        if (!begun && task->first) {
+            folder = mv_sequencer_open_folder(ctx, folders, folder_count, file, slot->prop,
+                                              delta_distance, ppmd);
+            if (!folder) {
+                res = SZ_ERROR_WRITE;
+                break;
+            }
+        }
+        if (task->first) {
+            file->crc = slot->crc;
+        } else {
+            file->crc = crc32_combine(file->crc, slot->crc, task->size);
+        }
+
+        folder->pack_size += slot->out.total;
+        op_stats_encode_merge(&folder->encode, &slot->encode);
+        if (!SpillOutStream_Drain(&slot->out, ctx) ||
+            (task->last && !mv_cipher_end(ctx, folder))) {
+            res = SZ_ERROR_WRITE;
+            break;
+        }
+        if (task->last && ctx->verify) write_verify_end(ctx->verify, file->crc, file->size);
+        if (task->last && slot->spliced) ctx->stats.stats.block_cache_hits++;
+        /* Compressed after all: the next run makes the entry again */
+        if (task->cached && !slot->spliced) {
+            block_cache_drop(ctx->block_cache_dir, &cache_keys[task->file_index]);
+        }
+        if (task->last && ctx->cache_writer) {
+            /* Files that ended up stored are dropped */
+            BlockCacheInfo info;
+            info.prop = folder->lzma2_prop;
+            info.filter = folder->filter;
+            info.use_ppmd = folder->use_ppmd;
+            info.unpack_size = file->size;
+            info.pack_size = folder->pack_size;
+            info.crc = file->crc;
+            int coded = folder->lzma2_prop != 0 || folder->use_ppmd;
+            if (block_cache_write_end(&cache_writer, coded ? &info : NULL)) {
+                ctx->stats.stats.block_cache_stores++;
+            }
+            ctx->cache_writer = NULL;
+        }
+        /* Workers may read a file twice (store fallback): counted once it is done */
+        progress_reporter_add(&ctx->progress, task->size);
+
+        if (task->last) {
+            ctx->total_packed_size += folder->pack_size;
+            if (!mv_checkpoint_save(ctx, file + 1, folder + 1)) {
+                res = SZ_ERROR_WRITE;
+                break;
+            }
+        }
+
+        Semaphore_Release1(&pool.free_slots);
+    }
+
+    if (ctx->cache_writer) {
+        block_cache_write_end(ctx->cache_writer, NULL);
+        ctx->cache_writer = NULL;
+    }
+
+    /* Shut the pool down (also on error) */
+    pool.stop = 1;
+    if (Semaphore_IsCreated(&pool.free_slots)) {
+        Semaphore_ReleaseN(&pool.free_slots, (UInt32)num_workers);
+    }
+    for (int i = 0; i < started; i++) {
+        Thread_Wait_Close(&threads[i]);
+    }
+
+    for (UInt32 i = 0; i < pool.slot_count; i++) {
+        SpillOutStream_Free(&pool.slots[i].out);
+        if (Event_IsCreated(&pool.slots[i].done)) Event_Close(&pool.slots[i].done);
+    }
+    if (Semaphore_IsCreated(&pool.free_slots)) Semaphore_Close(&pool.free_slots);
+    CriticalSection_Delete(&pool.lock);
+    mem_free(pool.slots);
+    mem_free(threads);
+    mem_free(tasks);
+    mem_free(cache_keys);
+
+    return res;
+}
+
+/* Choose the method and filter for every file with data
+ * (AUTO method = PPMd for text; AUTO filter = extensions, then headers).
+ * PPMd and stored files are never filtered. */
+static void assign_coders(MV_FileEntry* files, size_t file_count, SevenZipMethod method,
+                          SevenZipFilter requested, const char* delta_extensions,
+                          int detect_compressed) {
+    for (size_t i = 0; i < file_count; i++) {
+        MV_FileEntry* file = &files[i];
+        int has_data = !file->is_dir && file->size > 0;
+        file->store = has_data && detect_compressed && sevenzip_is_precompressed_file(file->full_path);
+        if (file->store) has_data = 0;
+        file->use_ppmd = has_data && sevenzip_ppmd_choose(method, file->full_path);
+        file->filter = (!has_data || file->use_ppmd)
+            ? SEVENZIP_FILTER_NONE
+            : sevenzip_filter_choose(requested, file->full_path, file->size, delta_extensions);
+    }
+}
+
+/* Bytes of the file start handed to options->entry_policy */
+#define ENTRY_POLICY_HEAD_SIZE 4096
+
+/* Let options->entry_policy replace the coders assign_coders() chose for
+ * each file with data; `job_level` is the level of the job's encoder */
+static void apply_entry_policy(MV_FileEntry* files, size_t file_count, int job_level,
+                               const SevenZipStreamOptions* options) {
+    Byte head[ENTRY_POLICY_HEAD_SIZE];
+    for (size_t i = 0; i < file_count; i++) {
+        MV_FileEntry* file = &files[i];
+        if (file->is_dir || file->size == 0) continue;
+        size_t got = 0;
+        FILE* f = fopen(file->full_path, "rb");
+        if (f) {
+            got = fread(head, 1, sizeof(head), f);
+            fclose(f);
+        }
+        SevenZipEntryPolicy policy;
+        policy.method = file->use_ppmd ? SEVENZIP_METHOD_PPMD : SEVENZIP_METHOD_LZMA2;
+        policy.filter = file->filter;
+        policy.level = file->store ? 0 : job_level;
+        policy.group = 0;
+        options->entry_policy(file->full_path, file->size, head, got, &policy,
+                              options->entry_policy_data);
+
+        if (policy.level > 9) policy.level = 9;
+        file->store = policy.level <= 0;
+        file->level = (file->store || policy.level == job_level) ? 0 : policy.level;
+        file->use_ppmd = !file->store &&
+            (policy.method == SEVENZIP_METHOD_PPMD ||
+             (policy.method == SEVENZIP_METHOD_AUTO &&
+              sevenzip_ppmd_choose(SEVENZIP_METHOD_AUTO, file->full_path)));
+        if (file->store || file->use_ppmd || (unsigned)policy.filter > SEVENZIP_FILTER_DELTA) {
+            file->filter = SEVENZIP_FILTER_NONE;
+        } else if (policy.filter == SEVENZIP_FILTER_AUTO) {
+            file->filter = sevenzip_filter_choose(SEVENZIP_FILTER_AUTO, file->full_path, file->size,
+                                                  options->delta_extensions);
+        } else {
+            file->filter = policy.filter;
+        }
+        file->group = policy.group;
+    }
+}
+
+/* Move stored files behind the others, both groups in their own order, so
+ * they form Copy blocks of their own instead of splitting the solid blocks
+ * @return 0 on allocation failure */
+static int group_stored_files(MV_FileEntry* files, size_t file_count) {
+    size_t stored = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        stored += (size_t)files[i].store;
+    }
+    if (stored == 0) return 1;
+    
+    MV_FileEntry* sorted = (MV_FileEntry*)mem_alloc(SEVENZIP_MEM_OTHER, file_count * sizeof(MV_FileEntry));
+    if (!sorted) return 0;
+    size_t head = 0;
+    size_t tail = file_count - stored;
+    for (size_t i = 0; i < file_count; i++) {
+        sorted[files[i].store ? tail++ : head++] = files[i];
+    }
+    memcpy(files, sorted, file_count * sizeof(MV_FileEntry));
+    mem_free(sorted);
+    return 1;
+}
+
+static int compare_solid_order(const void* a, const void* b) {
+    const MV_FileEntry* x = *(const MV_FileEntry* const*)a;
+    const MV_FileEntry* y = *(const MV_FileEntry* const*)b;
+    int c = sevenzip_solid_order_compare(x->name, x->size, y->name, y->size);
+    if (c == 0) c = x < y ? -1 : (x > y);  /* Scan order among equals */
+    return c;
+}
+
+static int compare_name_order(const void* a, const void* b) {
+    const MV_FileEntry* x = *(const MV_FileEntry* const*)a;
+    const MV_FileEntry* y = *(const MV_FileEntry* const*)b;
+    int c = strcmp(x->name, y->name);
+    if (c == 0) c = x < y ? -1 : (x > y);  /* Scan order among equals */
+    return c;
+}
+
+static int compare_policy_group(const void* a, const void* b) {
+    const MV_FileEntry* x = *(const MV_FileEntry* const*)a;
+    const MV_FileEntry* y = *(const MV_FileEntry* const*)b;
+    if (x->group != y->group) return x->group < y->group ? -1 : 1;
+    return x < y ? -1 : (x > y);  /* Earlier order within a group */
+}
+
+/* Order files with `compare`: by name for options->deterministic, by
+ * extension, then name, then size for options->solid_sort, by group for
+ * options->entry_policy
+ * @return 0 on allocation failure */
+static int sort_files(MV_FileEntry* files, size_t file_count,
+                      int (*compare)(const void*, const void*)) {
+    if (file_count < 2) return 1;
+    MV_FileEntry** order = (MV_FileEntry**)mem_alloc(SEVENZIP_MEM_OTHER, file_count * sizeof(MV_FileEntry*));
+    MV_FileEntry* sorted = (MV_FileEntry*)mem_alloc(SEVENZIP_MEM_OTHER, file_count * sizeof(MV_FileEntry));
+    if (!order || !sorted) {
+        mem_free(order);
+        mem_free(sorted);
+        return 0;
+    }
+    for (size_t i = 0; i < file_count; i++) {
+        order[i] = &files[i];
+    }
+    qsort(order, file_count, sizeof(MV_FileEntry*), compare);
+    for (size_t i = 0; i < file_count; i++) {
+        sorted[i] = *order[i];
+    }
+    memcpy(files, sorted, file_count * sizeof(MV_FileEntry));
+    mem_free(sorted);
+    mem_free(order);
+    return 1;
+}
+
+/* Bytes of the head of a file hashed to find its copies */
+#define DUPLICATE_SAMPLE_SIZE (16 * 1024)
+
+typedef struct {
+    uint64_t key;      /* Hash of the head sample */
+    size_t leader;     /* First file in scan order with the same key */
+    size_t index;      /* Position in scan order */
+    uint64_t size;
+} MV_DupOrder;
+
+static int compare_dup_keys(const void* a, const void* b) {
+    const MV_DupOrder* x = (const MV_DupOrder*)a;
+    const MV_DupOrder* y = (const MV_DupOrder*)b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+static int compare_dup_clusters(const void* a, const void* b) {
+    const MV_DupOrder* x = (const MV_DupOrder*)a;
+    const MV_DupOrder* y = (const MV_DupOrder*)b;
+    if (x->leader != y->leader) return x->leader < y->leader ? -1 : 1;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/* Helper: hash of the first DUPLICATE_SAMPLE_SIZE bytes of a file
+ * @return 0 if it cannot be read */
+static int sample_file_head(const char* path, Byte* buf, uint64_t* key) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t got = fread(buf, 1, DUPLICATE_SAMPLE_SIZE, f);
+    fclose(f);
+    if (got == 0) return 0;
+
+    Xxh3State state;
+    Byte digest[XXH3_128_DIGEST_SIZE];
+    xxh3_128_init(&state);
+    xxh3_128_update(&state, buf, got);
+    xxh3_128_final(&state, digest);
+    uint64_t k = 0;
+    for (int i = 0; i < 8; i++) k = (k << 8) | digest[i];
+    *key = k;
+    return 1;
+}
+
+/*
+ * Move files whose heads hash alike next to the first of them, so copies
+ * and versions of a file scattered over the tree meet within the
+ * dictionary of the solid stream; in a cluster smaller files come first,
+ * so exact copies (same head, same size) are neighbours. A pre-pass reads
+ * DUPLICATE_SAMPLE_SIZE bytes of every file; files it cannot read, devices
+ * and directories keep their place, as do clusters of one.
+ * @return 0 on allocation failure
+ */
+static int group_duplicate_files(MV_FileEntry* files, size_t file_count) {
+    if (file_count < 2) return 1;
+    MV_DupOrder* order = (MV_DupOrder*)mem_alloc(SEVENZIP_MEM_OTHER, file_count * sizeof(MV_DupOrder));
+    MV_FileEntry* sorted = (MV_FileEntry*)mem_alloc(SEVENZIP_MEM_OTHER, file_count * sizeof(MV_FileEntry));
+    Byte* sample = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, DUPLICATE_SAMPLE_SIZE);
+    if (!order || !sorted || !sample) {
+        mem_free(order);
+        mem_free(sorted);
+        mem_free(sample);
+        return 0;
+    }
+
+    /* Files without a sample get keys no file shares: their own index,
+     * with the top bit set to keep clear of the hashes' usual range */
+    for (size_t i = 0; i < file_count; i++) {
+        MV_FileEntry* file = &files[i];
+        order[i].index = i;
+        order[i].size = file->size;
+        int has_data = !file->is_dir && file->size > 0 && !file->device;
+        if (!has_data || !sample_file_head(file->full_path, sample, &order[i].key)) {
+            order[i].key = ((uint64_t)1 << 63) | i;
+        }
+    }
+    mem_free(sample);
+
+    /* Clusters by key, each led by its first file in scan order */
+    qsort(order, file_count, sizeof(MV_DupOrder), compare_dup_keys);
+    size_t joined = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        int first = (i == 0 || order[i].key != order[i - 1].key);
+        order[i].leader = first ? order[i].index : order[i - 1].leader;
+        joined += !first;
+    }
+    if (joined > 0) {
+        qsort(order, file_count, sizeof(MV_DupOrder), compare_dup_clusters);
+        for (size_t i = 0; i < file_count; i++) {
+            sorted[i] = files[order[i].index];
+        }
+        memcpy(files, sorted, file_count * sizeof(MV_FileEntry));
+    }
+    mem_free(sorted);
+    mem_free(order);
+    return 1;
+}
+
+typedef struct {
+    uint64_t dev;
+    uint64_t inode;
+    size_t index;      /* Position in the current order */
+} MV_LinkOrder;
+
+static int compare_links(const void* a, const void* b) {
+    const MV_LinkOrder* x = (const MV_LinkOrder*)a;
+    const MV_LinkOrder* y = (const MV_LinkOrder*)b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->inode != y->inode) return x->inode < y->inode ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/*
+ * Move the other names of a hard-linked file right behind its first one
+ * one: the second copy then costs the solid stream next to nothing, and
+ * the reader thread hands the data of the name before over again instead
+ * of reading the inode once more (SolidPrefetch_Repeat).
+ * Other files keep their order.
+ * @return 0 on allocation failure
+ */
+static int group_hard_links(MV_FileEntry* files, size_t file_count) {
+    size_t linked = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        linked += (size_t)(files[i].hard_linked && files[i].inode != 0);
+    }
+    if (linked < 2) return 1;
+    MV_LinkOrder* order = (MV_LinkOrder*)mem_alloc(SEVENZIP_MEM_OTHER, linked * sizeof(MV_LinkOrder));
+    size_t* first = (size_t*)mem_alloc(SEVENZIP_MEM_OTHER, file_count * sizeof(size_t));
+    MV_FileEntry* sorted = (MV_FileEntry*)mem_alloc(SEVENZIP_MEM_OTHER, file_count * sizeof(MV_FileEntry));
+    if (!order || !first || !sorted) {
+        mem_free(order);
+        mem_free(first);
+        mem_free(sorted);
+        return 0;
+    }
+    
+    size_t n = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        if (!files[i].hard_linked || files[i].inode == 0) continue;
+        order[n].dev = files[i].dev;
+        order[n].inode = files[i].inode;
+        order[n].index = i;
+        n++;
+    }
+    qsort(order, n, sizeof(MV_LinkOrder), compare_links);
+    
+    /* first[i]: for a first name, where its names start in `order`;
+     * SIZE_MAX for a later name, which goes out with its first */
+    for (size_t i = 0; i < file_count; i++) {
+        first[i] = i;
+    }
+    for (size_t k = 0; k < n; k++) {
+        int leads = k == 0 || order[k].dev != order[k - 1].dev || order[k].inode != order[k - 1].inode;
+        first[order[k].index] = leads ? k : SIZE_MAX;
+    }
+    
+    size_t out = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        if (first[i] == SIZE_MAX) continue;
+        sorted[out++] = files[i];
+        if (!files[i].hard_linked || files[i].inode == 0) continue;
+        for (size_t k = first[i] + 1; k < n && order[k].dev == files[i].dev &&
+                                      order[k].inode == files[i].inode; k++) {
+            sorted[out++] = files[order[k].index];
+        }
+    }
+    memcpy(files, sorted, file_count * sizeof(MV_FileEntry));
+    mem_free(sorted);
+    mem_free(first);
+    mem_free(order);
+    return 1;
+}
+
+/* ============================================================================
+ * Memory planning
+ *
+ * The plan fixes everything that scales memory: encoder properties, the
+ * number of non-solid workers and the stream, read-ahead and spill buffer
+ * sizes. With max_memory set, buffers shrink first, then workers, then the
+ * coders themselves (sevenzip_fit_coders).
+ * ============================================================================ */
+
+/* Header, file table and volume bookkeeping */
+#define MV_BASE_MEMORY ((uint64_t)1 << 20)
+
+typedef struct {
+    CLzma2EncProps props;         /* Solid-block encoder */
+    CLzma2EncProps worker_props;  /* Encoder of each non-solid worker */
+    MV_PpmdParams ppmd;
+    int workers;                  /* Non-solid worker threads */
+    UInt32 prefetch_buffers;      /* Read-ahead ring slots (solid) */
+    UInt32 writer_blocks;         /* Write-behind ring slots (0 = synchronous) */
+    UInt32 stripes;               /* Stripe writers with writer_blocks slots each */
+    size_t stream_buffer_size;    /* VolumeOutStream / fallback read buffer */
+    size_t spill_limit;           /* In-memory part of each job slot */
+    int verify;                   /* options->verify_writes, for LZMA2 folders */
+    uint64_t peak;                /* Estimated peak heap use */
+} MV_MemoryPlan;
+
+/* Helper: LZMA2 properties for a level and options; with `chunk_blocks`
+ * every thread codes chunk_size blocks of its own */
+static void mv_setup_props(CLzma2EncProps* props, SevenZipCompressionLevel level,
+                           const SevenZipStreamOptions* options, int chunk_blocks) {
+    Lzma2EncProps_Init(props);
+    
+    /* Map compression level - SDK will optimize based on level */
     int lzma_level;
     switch (level) {
         case SEVENZIP_LEVEL_STORE:
@@ -1448,62 +4420,833 @@ SevenZipErrorCode sevenzip_create_multivolume_7z_complete(
         default:
             lzma_level = 5;
     }
-    props.lzmaProps.level = lzma_level;
+    props->lzmaProps.level = lzma_level;
+    
+    /* Multi-threading - optimized for maximum CPU utilization */
+    if (options->num_threads > 0) {
+        int block_threads = options->num_threads / 2;
+        if (block_threads < 1) block_threads = 1;
+        props->numTotalThreads = options->num_threads;
+        props->numBlockThreads_Max = block_threads;
+        /* 2 threads per LZMA stream (match finder + range coder) */
+        props->lzmaProps.numThreads = options->num_threads > 1 ? 2 : 1;
+        /* 64 MB blocks at most; smaller inputs get theirs from
+         * sevenzip_lzma2_spread_blocks() so every block thread has one */
+        props->blockSize = (1 << 26);
+        /* A block thread per thread scales near linearly on one huge
+         * input, where a second match finder thread adds far less */
+        if (chunk_blocks && options->num_threads > 1) {
+            props->numBlockThreads_Max = options->num_threads;
+            props->lzmaProps.numThreads = 1;
+        }
+    }
+    if (chunk_blocks && options->chunk_size > 0) {
+        props->blockSize = options->chunk_size;
+    }
+    
+    /* Override dictionary if user specified one */
+    if (options->dict_size > 0) {
+        props->lzmaProps.dictSize = (UInt32)options->dict_size;
+    }
+    if (options->block_size > 0) {
+        props->blockSize = options->block_size;
+    }
+    sevenzip_lzma_params_apply(options->lzma_params, &props->lzmaProps);
+    
+    /* CRITICAL: Normalize will optimize all other parameters based on level */
+    Lzma2EncProps_Normalize(props);
+}
+
+/* Helper: Peak memory of a plan, with or without the coders */
+static uint64_t mv_plan_peak(const MV_MemoryPlan* plan, int store, int solid,
+                             SevenZipMethod method, int with_coders) {
+    uint64_t total = MV_BASE_MEMORY + plan->stream_buffer_size +
+                     (uint64_t)(1 + plan->stripes) * plan->writer_blocks * WRITER_BLOCK_SIZE;
+    if (store) return total;
+
+    int lzma = (method != SEVENZIP_METHOD_PPMD);
+    int ppmd = (method != SEVENZIP_METHOD_LZMA2);
+    /* The verifier's dictionary is as large as the encoder's */
+    if (plan->verify) {
+        total += VERIFY_FIXED_MEMORY;
+        const CLzma2EncProps* enc = solid ? &plan->props : &plan->worker_props;
+        if (with_coders) total += enc->lzmaProps.dictSize;
+    }
+    if (solid) {
+        total += (uint64_t)plan->prefetch_buffers * PREFETCH_BLOCK_SIZE + FILTER_BUFFER_SIZE;
+        if (plan->prefetch_buffers > 0) total += SMALL_BATCH_BYTES;
+        if (with_coders && lzma) total += sevenzip_lzma2_memory(&plan->props);
+        if (with_coders && ppmd) total += sevenzip_ppmd_memory(plan->ppmd.mem_size);
+    } else {
+        /* Every worker creates its LZMA2 encoder up front; each owns two job slots */
+        uint64_t per_worker = STORE_COPY_BUFFER_SIZE + FILTER_BUFFER_SIZE +
+                              2 * (uint64_t)plan->spill_limit;
+        if (with_coders) per_worker += sevenzip_lzma2_memory(&plan->worker_props);
+        if (with_coders && ppmd) per_worker += sevenzip_ppmd_memory(plan->ppmd.mem_size);
+        total += (uint64_t)plan->workers * per_worker;
+    }
+    return total;
+}
+
+/* Helper: Build the plan for a job and fit it to options->max_memory
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_MEMORY if the budget is too small
+ */
+static SevenZipErrorCode mv_plan_memory(SevenZipCompressionLevel level,
+                                        const SevenZipStreamOptions* options,
+                                        int chunk_blocks, MV_MemoryPlan* plan) {
+    mv_setup_props(&plan->props, level, options, chunk_blocks);
+    mv_worker_props(&plan->props, &plan->worker_props);
+    sevenzip_ppmd_props(level, options->ppmd_order, options->ppmd_mem_size,
+                        &plan->ppmd.order, &plan->ppmd.mem_size);
+    plan->workers = options->num_threads > 0 ? options->num_threads : 2;
+    plan->prefetch_buffers = options->prefetch_buffers > 0 ? (UInt32)options->prefetch_buffers : 0;
+    plan->writer_blocks = WRITER_BLOCK_COUNT;
+    plan->stripes = 0;
+    for (size_t i = 0; options->volume_dirs && options->volume_dirs[i]; i++) {
+        plan->stripes = (UInt32)i + 1;
+    }
+    if (plan->stripes < 2) plan->stripes = 0;
+    plan->stream_buffer_size = STREAM_BUFFER_SIZE;
+    plan->spill_limit = SPILL_MEMORY_LIMIT;
+
+    int store = (level == SEVENZIP_LEVEL_STORE);
+    plan->verify = options->verify_writes && !store && options->method != SEVENZIP_METHOD_PPMD;
+    int solid = options->solid;
+    /* An entry policy may pick either coder for any file */
+    SevenZipMethod method = options->entry_policy ? SEVENZIP_METHOD_AUTO : options->method;
+    uint64_t budget = options->max_memory;
+
+    #define PLAN_PEAK() mv_plan_peak(plan, store, solid, method, 1)
+    if (budget) {
+        /* 1. I/O buffers */
+        while (PLAN_PEAK() > budget && solid && plan->prefetch_buffers > 0) {
+            plan->prefetch_buffers--;
+        }
+        while (PLAN_PEAK() > budget && plan->writer_blocks > 0) {
+            plan->writer_blocks--;
+        }
+        while (PLAN_PEAK() > budget && plan->stream_buffer_size > MEMORY_BUDGET_MIN_SIZE) {
+            plan->stream_buffer_size /= 2;
+        }
+        while (PLAN_PEAK() > budget && !solid && plan->spill_limit > MEMORY_BUDGET_MIN_SIZE) {
+            plan->spill_limit /= 2;
+        }
+
+        /* 2. Fewer non-solid workers */
+        while (PLAN_PEAK() > budget && !solid && plan->workers > 1) {
+            plan->workers--;
+        }
+
+        /* 3. The coders: block threads, block size, dictionary, PPMd model;
+         *    for deterministic output block threads only, the rest shaping
+         *    the bytes */
+        while (PLAN_PEAK() > budget && !store && options->deterministic && solid &&
+               plan->props.numBlockThreads_Max > 1) {
+            plan->props.numBlockThreads_Max--;
+            plan->props.numBlockThreads_Reduced = -1;
+            plan->props.numTotalThreads = plan->props.lzmaProps.numThreads * plan->props.numBlockThreads_Max;
+        }
+        if (PLAN_PEAK() > budget && !store && !options->deterministic) {
+            uint64_t fixed = mv_plan_peak(plan, store, solid, method, 0);
+            if (fixed >= budget) return SEVENZIP_ERROR_MEMORY;
+            uint64_t coders = budget - fixed;
+
+            uint32_t* ppmd = (method != SEVENZIP_METHOD_LZMA2) ? &plan->ppmd.mem_size : NULL;
+            if (solid) {
+                CLzma2EncProps* lzma = (method != SEVENZIP_METHOD_PPMD) ? &plan->props : NULL;
+                sevenzip_fit_coders(lzma, ppmd, coders, NULL);
+            } else {
+                sevenzip_fit_coders(&plan->worker_props, ppmd, coders / (uint64_t)plan->workers, NULL);
+            }
+        }
+
+        if (PLAN_PEAK() > budget) return SEVENZIP_ERROR_MEMORY;
+    }
+    plan->peak = PLAN_PEAK();
+    #undef PLAN_PEAK
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_multivolume_memory_plan(
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    uint64_t* peak_bytes
+) {
+    if (!options || !peak_bytes) return SEVENZIP_ERROR_INVALID_PARAM;
+
+    /* An auto job gets the hardware threads (without a quota) */
+    SevenZipStreamOptions sized;
+    if (options->num_threads <= 0) {
+        sized = *options;
+        sized.num_threads = hardware_thread_count();
+        options = &sized;
+    }
+
+    MV_MemoryPlan plan;
+    SevenZipErrorCode err = mv_plan_memory(level, options, 0, &plan);
+    *peak_bytes = plan.peak;
+    return err;
+}
+
+
+/* Build 7z header in memory
+ *
+ * Non-empty files are substreams of `folders`, assigned in archive order.
+ * Zero-length files are empty streams (kEmptyStream + kEmptyFile). The
+ * first pack stream starts `pack_pos` bytes after the start header.
+ * Every entry gets `fixed_mtime` as its time unless it is 0.
+ */
+static Byte* build_7z_header(
+    MV_FileEntry* files,
+    size_t file_count,
+    const MV_Folder* folders,
+    size_t folder_count,
+    uint64_t pack_pos,
+    uint64_t fixed_mtime,
+    size_t* header_size
+) {
+    size_t empty_count = 0;
+    size_t names_size = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        if (files[i].is_dir || files[i].size == 0) empty_count++;
+        names_size += utf8_to_utf16le_size(files[i].name) + 2;
+    }
+
+    HeaderBuffer hb;
+    header_buffer_init(&hb);
+
+    header_buffer_byte(&hb, k7zIdHeader);
+
+    if (folder_count > 0) {
+        /* MainStreamsInfo */
+        header_buffer_byte(&hb, k7zIdMainStreamsInfo);
+
+        /* PackInfo */
+        header_buffer_byte(&hb, k7zIdPackInfo);
+        header_buffer_number(&hb, pack_pos);  /* Pack position */
+        header_buffer_number(&hb, folder_count);  /* One pack stream per folder */
+
+        header_buffer_byte(&hb, k7zIdSize);
+        for (size_t f = 0; f < folder_count; f++) {
+            header_buffer_number(&hb, folders[f].pack_size);
+        }
+
+        header_buffer_byte(&hb, k7zIdEnd);
+
+        /* UnpackInfo */
+        header_buffer_byte(&hb, k7zIdUnpackInfo);
+
+        header_buffer_byte(&hb, k7zIdFolder);
+        header_buffer_number(&hb, folder_count);
+        header_buffer_number(&hb, 0);  /* Not external */
+        for (size_t f = 0; f < folder_count; f++) {
+            int has_filter = folders[f].filter != SEVENZIP_FILTER_NONE;
+            /* LZMA2, plus the filter it feeds and the 7zAES coder feeding it */
+            header_buffer_number(&hb, 1 + has_filter + folders[f].encrypted);
+            if (folders[f].use_ppmd) {
+                /* PPMd: 3-byte ID, properties = order + model size */
+                Byte* q = header_buffer_reserve(&hb, HEADER_CODER_MAX);
+                if (q) {
+                    header_buffer_commit(&hb, sevenzip_ppmd_write_coder(folders[f].ppmd.order,
+                                                                        folders[f].ppmd.mem_size, q));
+                }
+            } else if (folders[f].lzma2_prop == 0) {
+                /* Copy/Store method: ID size = 1, no properties */
+                header_buffer_byte(&hb, 0x01);
+                header_buffer_byte(&hb, 0x00);  /* Copy codec ID */
+            } else {
+                /* LZMA2 compression */
+                header_buffer_byte(&hb, 0x21);  /* Coder flags (1 byte ID, has properties) */
+                header_buffer_byte(&hb, 0x21);  /* LZMA2 codec ID */
+                header_buffer_byte(&hb, 1);     /* Properties size = 1 byte */
+                header_buffer_byte(&hb, folders[f].lzma2_prop);
+            }
+            if (has_filter) {
+                Byte* q = header_buffer_reserve(&hb, HEADER_CODER_MAX);
+                if (q) {
+                    header_buffer_commit(&hb, sevenzip_filter_write_coder(folders[f].filter,
+                                                                          folders[f].delta_distance, q));
+                }
+            }
+            if (folders[f].encrypted) {
+                Byte* q = header_buffer_reserve(&hb, AES_CODER_RECORD_SIZE);
+                if (q) header_buffer_commit(&hb, sevenzip_aes_write_coder(folders[f].aes_iv, q));
+            }
+            /* Bonds follow the coders */
+            if (has_filter) {
+                /* Filter input (in stream 1) <- LZMA2 output (out stream 0) */
+                header_buffer_number(&hb, 1);
+                header_buffer_number(&hb, 0);
+            }
+            if (folders[f].encrypted) {
+                /* LZMA2 input (in stream 0) <- AES output (last out stream);
+                   the AES input is the folder's pack stream */
+                header_buffer_number(&hb, 0);
+                header_buffer_number(&hb, 1 + has_filter);
+            }
+        }
+
+        header_buffer_byte(&hb, k7zIdCodersUnpackSize);
+        for (size_t f = 0; f < folder_count; f++) {
+            /* One size per coder output; branch filters preserve length */
+            header_buffer_number(&hb, folders[f].unpack_size);
+            if (folders[f].filter != SEVENZIP_FILTER_NONE) {
+                header_buffer_number(&hb, folders[f].unpack_size);
+            }
+            if (folders[f].encrypted) {
+                header_buffer_number(&hb, folders[f].aes_size);
+            }
+        }
+
+        header_buffer_byte(&hb, k7zIdEnd);
+
+        /* SubStreamsInfo */
+        header_buffer_byte(&hb, k7zIdSubStreamsInfo);
+
+        header_buffer_byte(&hb, k7zIdNumUnpackStream);
+        for (size_t f = 0; f < folder_count; f++) {
+            header_buffer_number(&hb, folders[f].num_files);
+        }
+
+        /* Individual file sizes (all but last per folder - last is implied) */
+        int need_sizes = 0;
+        for (size_t f = 0; f < folder_count; f++) {
+            if (folders[f].num_files > 1) need_sizes = 1;
+        }
+        if (need_sizes) {
+            header_buffer_byte(&hb, k7zIdSize);
+            size_t fi = 0;
+            for (size_t f = 0; f < folder_count; f++) {
+                for (size_t k = 0; k < folders[f].num_files; k++) {
+                    while (files[fi].is_dir || files[fi].size == 0) fi++;
+                    if (k + 1 < folders[f].num_files) {
+                        header_buffer_number(&hb, files[fi].size);
+                    }
+                    fi++;
+                }
+            }
+        }
+
+        header_buffer_byte(&hb, k7zIdCRC);
+        header_buffer_byte(&hb, 1);  /* All defined */
+        for (size_t i = 0; i < file_count; i++) {
+            if (!files[i].is_dir && files[i].size > 0) {
+                header_buffer_uint32(&hb, files[i].crc);
+            }
+        }
+
+        header_buffer_byte(&hb, k7zIdEnd);
+        header_buffer_byte(&hb, k7zIdEnd);
+    }
+
+    /* FilesInfo */
+    header_buffer_byte(&hb, k7zIdFilesInfo);
+    header_buffer_number(&hb, file_count);
+
+    if (empty_count > 0) {
+        header_buffer_byte(&hb, k7zIdEmptyStream);
+        header_buffer_number(&hb, (file_count + 7) / 8);
+        HeaderBits empty_stream;
+        header_bits_begin(&empty_stream, &hb);
+        for (size_t i = 0; i < file_count; i++) {
+            header_bits_put(&empty_stream, files[i].is_dir || files[i].size == 0);
+        }
+        header_bits_end(&empty_stream);
+
+        /* EmptyFile: bit per empty stream, set for files (not directories) */
+        header_buffer_byte(&hb, k7zIdEmptyFile);
+        header_buffer_number(&hb, (empty_count + 7) / 8);
+        HeaderBits empty_file;
+        header_bits_begin(&empty_file, &hb);
+        for (size_t i = 0; i < file_count; i++) {
+            if (files[i].is_dir || files[i].size == 0) {
+                header_bits_put(&empty_file, !files[i].is_dir);
+            }
+        }
+        header_bits_end(&empty_file);
+    }
+
+    /* Names */
+    header_buffer_byte(&hb, k7zIdName);
+    header_buffer_number(&hb, names_size + 1);
+    header_buffer_byte(&hb, 0);  /* Not external */
+
+    for (size_t i = 0; i < file_count; i++) {
+        Byte* q = header_buffer_reserve(&hb, utf8_to_utf16le_size(files[i].name) + 2);
+        if (!q) break;
+        size_t len = utf8_to_utf16le(files[i].name, q);
+        q[len] = 0;
+        q[len + 1] = 0;
+        header_buffer_commit(&hb, len + 2);
+    }
+
+    /* MTime (Modification Time) */
+    header_buffer_byte(&hb, k7zIdMTime);
+    header_buffer_number(&hb, (uint64_t)file_count * 8 + 2);  /* Size: AllDefined(1) + External(1) + 8 bytes per file */
+    header_buffer_byte(&hb, 1);  /* All defined */
+    header_buffer_byte(&hb, 0);  /* External = 0 (inline data) */
+    for (size_t i = 0; i < file_count; i++) {
+        header_buffer_uint64(&hb, fixed_mtime ? fixed_mtime : files[i].mtime);
+    }
+
+    /* WinAttrib (Windows Attributes) */
+    header_buffer_byte(&hb, k7zIdWinAttrib);
+    header_buffer_number(&hb, (uint64_t)file_count * 4 + 2);  /* Size: AllDefined(1) + External(1) + 4 bytes per file */
+    header_buffer_byte(&hb, 1);  /* All defined */
+    header_buffer_byte(&hb, 0);  /* External = 0 (inline data) */
+    for (size_t i = 0; i < file_count; i++) {
+        header_buffer_uint32(&hb, files[i].attrib);
+    }
+
+    header_buffer_byte(&hb, k7zIdEnd);  /* End FilesInfo */
+    header_buffer_byte(&hb, k7zIdEnd);  /* End Header */
+
+    if (hb.failed) {
+        header_buffer_free(&hb);
+        return NULL;
+    }
+    *header_size = hb.size;
+    return hb.data;
+}
+
+/* Helper: Write the digest of every file to `path` as sha256sum lines
+ * ("<hex>  <name>"), so `sha256sum -c` (`xxhsum -c` for XXH3-128, told
+ * apart by the digest length) checks an extracted tree; names with a
+ * backslash or newline are escaped and their line marked with a leading
+ * backslash, as GNU sha256sum does */
+/* Helper: One sha256sum line: hex digest, two spaces, escaped name */
+static void mv_manifest_line(FILE* f, const Byte* value, size_t digest_size, const char* name) {
+    static const char hex[] = "0123456789abcdef";
+    if (strpbrk(name, "\\\n")) fputc('\\', f);
+    for (size_t b = 0; b < digest_size; b++) {
+        fputc(hex[value[b] >> 4], f);
+        fputc(hex[value[b] & 0x0F], f);
+    }
+    fputs("  ", f);
+    for (const char* c = name; *c; c++) {
+        if (*c == '\\') fputs("\\\\", f);
+        else if (*c == '\n') fputs("\\n", f);
+        else fputc(*c, f);
+    }
+    fputc('\n', f);
+}
+
+static int mv_write_manifest(const char* path, SevenZipDigestAlgorithm algorithm,
+                             const MV_FileEntry* files, size_t file_count) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+
+    /* Empty files are never read: their digest is that of no bytes */
+    FileDigestSlot empty;
+    FileDigest digest;
+    file_digest_init(&digest, algorithm);
+    file_digest_final(&digest, &empty);
+    size_t digest_size = file_digest_size(algorithm);
+
+    for (size_t i = 0; i < file_count; i++) {
+        const MV_FileEntry* file = &files[i];
+        if (file->is_dir || !file->digest_slot) continue;
+        const Byte* value = file->size ? file->digest_slot->value : empty.value;
+        mv_manifest_line(f, value, digest_size, file->name);
+    }
+
+    int ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+/* Helper: Write options->volume_manifest, a line per volume by file name:
+ * volume_dirs spread them, the names alone tell them apart */
+static int mv_write_volume_manifest(const MultiVolumeContext* ctx, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+    size_t digest_size = file_digest_size(ctx->volume_digest.algorithm);
+    for (size_t i = 0; i < ctx->volume_count; i++) {
+        char vol_path[1280];
+        mv_volume_path(ctx, vol_path, sizeof(vol_path), i);
+        const char* name = vol_path;
+        for (const char* p = vol_path; *p; p++) {
+            if (*p == '/' || *p == '\\') name = p + 1;
+        }
+        mv_manifest_line(f, ctx->volume_digests[i].value, digest_size, name);
+    }
+    int ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+/* Helper: Write options->write_index for the `files` and `folders` of the
+ * header, as laid out over the volumes of `ctx` */
+static int mv_write_index(const MultiVolumeContext* ctx, const char* archive_path,
+                          const MV_FileEntry* files, size_t file_count,
+                          const MV_Folder* folders, size_t folder_count) {
+    ArchiveIndexWriter w;
+    archive_index_writer_init(&w);
+
+    /* Non-empty files fill the folders in order, num_files each */
+    size_t folder = 0;
+    size_t in_folder = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        const MV_FileEntry* file = &files[i];
+        ArchiveIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.size = file->size;
+        entry.mtime = ctx->fixed_mtime ? ctx->fixed_mtime : file->mtime;
+        entry.attrib = file->attrib;
+        entry.folder = ARCHIVE_INDEX_NO_FOLDER;
+        entry.flags = file->is_dir ? ARCHIVE_INDEX_ENTRY_DIR : 0;
+        if (!file->is_dir && file->size > 0) {
+            while (folder < folder_count && in_folder >= folders[folder].num_files) {
+                folder++;
+                in_folder = 0;
+            }
+            entry.folder = (uint32_t)folder;
+            entry.crc = file->crc;
+            in_folder++;
+        }
+        archive_index_add_entry(&w, file->name, &entry);
+    }
+
+    uint64_t pack_offset = k7zStartHeaderSize + ctx->pack_pos;
+    for (size_t i = 0; i < folder_count; i++) {
+        ArchiveIndexFolder rec;
+        rec.pack_offset = pack_offset;
+        rec.pack_size = folders[i].pack_size;
+        rec.unpack_size = folders[i].unpack_size;
+        rec.num_files = (uint32_t)folders[i].num_files;
+        rec.flags = folders[i].encrypted ? ARCHIVE_INDEX_FOLDER_ENCRYPTED : 0;
+        archive_index_add_folder(&w, &rec);
+        pack_offset += folders[i].pack_size;
+    }
+
+    for (size_t i = 0; i < ctx->volume_count; i++) {
+        archive_index_add_volume(&w, i + 1 == ctx->volume_count ? ctx->current_volume_size
+                                                                 : ctx->max_volume_size);
+    }
+
+    char path[1300];
+    archive_index_path(path, sizeof(path), archive_path);
+    int ok = archive_index_write(&w, path);
+    archive_index_writer_free(&w);
+    return ok;
+}
+
+/* Helper: Write the snapshot of every gathered file for a later run's
+ * options->snapshot_base */
+static int mv_write_snapshot(const char* path, const MV_FileEntry* files, size_t count) {
+    FILE* f = snapshot_write_begin(path);
+    if (!f) return 0;
+    for (size_t i = 0; i < count; i++) {
+        SnapshotEntry entry = { files[i].name, files[i].size, files[i].mtime, files[i].inode };
+        snapshot_write_entry(f, &entry);
+    }
+    return snapshot_write_end(f);
+}
+
+/* Main creation function, see create_engine.h */
+/* Write the archive of `input_paths` to `output`, or with `resume` carry
+ * on the split job of its checkpoint (whose input list it takes over);
+ * with `sink` the volumes go to its callbacks and `archive_path` is not
+ * used */
+static SevenZipErrorCode mv_create(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data,
+    MV_Resume* resume,
+    const SevenZipArchiveSink* sink,
+    CreateOutput output,
+    int chunk_blocks
+) {
+    /* Initialize context */
+    MultiVolumeContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    crc_stage_init(&ctx.crc_stage);
+    strncpy(ctx.base_path, archive_path, sizeof(ctx.base_path) - 1);
+    ctx.max_volume_size = options->split_size;
+    ctx.sink = sink;
+    ctx.volume_name = ctx.base_path;
+    for (const char* p = ctx.base_path; *p; p++) {
+        if (*p == '/' || *p == '\\') ctx.volume_name = p + 1;
+    }
+    if (options->volume_dirs) {
+        while (options->volume_dirs[ctx.volume_dir_count]) ctx.volume_dir_count++;
+        ctx.volume_dirs = options->volume_dirs;
+    }
+    ctx.volume_capacity = 8;
+    ctx.volumes = (FILE**)mem_alloc(SEVENZIP_MEM_OTHER, ctx.volume_capacity * sizeof(FILE*));
+    if (!ctx.volumes) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    
+    MV_Folder* folders = NULL;
+    op_stats_begin(&ctx.stats);
+    ctx.stats.keep_folders = options->folder_stats;
+    op_stats_phase_begin(&ctx.stats, SEVENZIP_PHASE_SCAN);
+    
+    /* Gather file entries - each input can be a file or a directory */
+    MV_FileList list;
+    mv_file_list_init(&list);
+    if (resume) {
+        list = resume->list;
+        mv_file_list_init(&resume->list);
+    }
+    size_t unchanged_count = 0;
+    if (!resume) {
+        SevenZipErrorCode gather_err = mv_gather_inputs(input_paths, options, &list,
+                                                        &unchanged_count);
+        if (gather_err != SEVENZIP_OK) {
+            mv_file_list_free(&list);
+            mem_free(ctx.volumes);
+            op_stats_finish(&ctx.stats);
+            return gather_err;
+        }
+    }
+    /* Files past file_count are only listed in options->snapshot_output */
+    MV_FileEntry* files = list.entries;
+    size_t file_count = list.count - unchanged_count;
+    ctx.total_size = list.total_size;
+    
+    /* An input that fits one volume is written as a plain archive file,
+       without volume_dirs or a checkpoint */
+    if (output == CREATE_OUTPUT_FIT) {
+        output = (ctx.total_size <= options->split_size) ? CREATE_OUTPUT_FILE : CREATE_OUTPUT_VOLUMES;
+    }
+    if (output == CREATE_OUTPUT_FILE) {
+        ctx.single_file = 1;
+        ctx.max_volume_size = UINT64_MAX;
+        ctx.volume_dirs = NULL;
+        ctx.volume_dir_count = 0;
+    }
     
-    /* Multi-threading - optimized for maximum CPU utilization */
-    if (options->num_threads > 0) {
-        props.numTotalThreads = options->num_threads;
-        props.numBlockThreads_Max = options->num_threads;  /* Use all threads for block compression */
-        props.lzmaProps.numThreads = 2;  /* 2 threads per LZMA stream (match finder + range coder) */
-        props.blockSize = (1 << 26);  /* 64 MB blocks - better thread utilization */
+    if (file_count == 0 && !options->snapshot_base) {
+        mv_file_list_free(&list);
+        mem_free(ctx.volumes);
+        op_stats_finish(&ctx.stats);
+        return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    /* Override dictionary if user specified one */
-    if (options->dict_size > 0) {
-        props.lzmaProps.dictSize = (UInt32)options->dict_size;
+    /* Region of a streamable archive, sized for the header of the gathered
+       entries; its copy is patched in, so it stays in volume 0 */
+    if (options->streamable) {
+        uint64_t names_size = 0;
+        for (size_t i = 0; i < file_count; i++) {
+            names_size += strlen(files[i].name);
+        }
+        ctx.pack_pos = options->streamable_reserve > 0 ? options->streamable_reserve
+                                                       : stream_layout_reserve(names_size, file_count);
+        if (ctx.max_volume_size < k7zStartHeaderSize ||
+            ctx.pack_pos > ctx.max_volume_size - k7zStartHeaderSize) {
+            mv_file_list_free(&list);
+            mem_free(ctx.volumes);
+            op_stats_finish(&ctx.stats);
+            return SEVENZIP_ERROR_INVALID_PARAM;
+        }
     }
+    for (size_t i = 0; i < file_count; i++) {
+        if (!files[i].is_dir) ctx.stats.stats.files++;
+    }
+    progress_reporter_start(&ctx.progress, progress_callback, NULL, user_data, ctx.total_size,
+                            options->progress_interval_ms, options->progress_interval_bytes);
     
-    /* CRITICAL: Normalize will optimize all other parameters based on level */
-    Lzma2EncProps_Normalize(&props);
+    /* Files before the cursor of a resumed job are done already */
+    size_t first_file = resume ? resume->next_file : 0;
+    for (size_t i = 0; i < first_file; i++) {
+        if (!files[i].is_dir) progress_reporter_add(&ctx.progress, files[i].size);
+    }
     
-    /* Reserve space for 7z signature and start header in first volume */
-    FILE* first_vol_temp = open_new_volume(&ctx);
-    if (!first_vol_temp) {
-        for (size_t i = 0; i < file_count; i++) { free(files[i].name); free(files[i].full_path); }
-        free(files);
-        free(ctx.volumes);
-        return SEVENZIP_ERROR_OPEN_FILE;
+    MV_Checkpoint checkpoint;
+    if (options->checkpoint && !ctx.single_file) {
+        memset(&checkpoint, 0, sizeof(checkpoint));
+        get_checkpoint_filename(checkpoint.path, sizeof(checkpoint.path), archive_path);
+        checkpoint.files = files;
+        checkpoint.file_count = file_count;
+        checkpoint.level = level;
+        checkpoint.split_size = options->split_size;
+        checkpoint.solid = options->solid;
+        checkpoint.solid_block_size = options->solid_block_size;
+        checkpoint.solid_block_files = options->solid_block_files;
+        checkpoint.delta_distance = sevenzip_filter_delta_distance(options->delta_distance);
+        if (resume) {
+            checkpoint.volume = (k7zStartHeaderSize + resume->packed_size) / options->split_size;
+            checkpoint.saved = 1;
+        }
+        ctx.checkpoint = &checkpoint;
     }
     
-    /* Write signature */
-    if (fwrite(k7zSignature, 1, k7zSignature_Size, first_vol_temp) != k7zSignature_Size) {
-        goto error;
+    /* Encoder properties, worker count and buffer sizes fitted to max_memory */
+    MV_MemoryPlan plan;
+    if (mv_plan_memory(level, options, chunk_blocks, &plan) != SEVENZIP_OK) {
+        mv_file_list_free(&list);
+        mem_free(ctx.volumes);
+        progress_reporter_stop(&ctx.progress);
+        op_stats_finish(&ctx.stats);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    CLzma2EncProps props = plan.props;
+    ctx.cache.buffer_size = plan.stream_buffer_size;
+    ctx.stats.stats.peak_buffer_bytes = plan.peak;
+    
+    /* Volumes that bypass the page cache; without the aligned staging
+       buffer they are simply written buffered */
+    ctx.unbuffered = options->unbuffered_output;
+    ctx.input_hints = options->input_access_hints;
+    ctx.cancel = options->cancel;
+    ctx.rate_limit = options->rate_limit;
+    ctx.deterministic = options->deterministic;
+    ctx.block_cache_dir = options->block_cache_dir;
+    if (options->fixed_mtime != 0) {
+        ctx.fixed_mtime = (uint64_t)options->fixed_mtime * 10000000ULL + 116444736000000000ULL;
     }
-    ctx.current_volume_size += k7zSignature_Size;
+    ctx.temp_dir = options->temp_dir;
+    ctx.numa_policy = options->numa_policy;
+    ctx.sync_volumes = options->sync_volumes;
+    ctx.volume_complete = options->volume_complete;
+    ctx.volume_user_data = options->volume_user_data;
+    ctx.placed = thread_placer_init(&ctx.placer, ctx.numa_policy);
+#if USE_DIRECT_IO
+    /* A checkpoint needs every byte on disk, the aligned tail included;
+       striped volumes are written by their own threads, buffered */
+    if (ctx.unbuffered && !ctx.checkpoint && ctx.volume_dir_count < 2) {
+        direct_buffers_alloc(&ctx);
+    }
+#endif
     
-    /* Write version */
-    Byte ver[2] = {0, 4};
-    if (fwrite(ver, 1, 2, first_vol_temp) != 2) {
-        goto error;
+    /* One key for the archive, one IV per folder */
+    ctx.packed_vt.Write = PackedOutStream_Write;
+    if (options->password && options->password[0]) {
+        SevenZipErrorCode key_err = sevenzip_aes_derive_key(options->password, ctx.aes_key);
+        if (key_err != SEVENZIP_OK) {
+            mv_file_list_free(&list);
+            mem_free(ctx.volumes);
+#if USE_DIRECT_IO
+            direct_buffers_free(&ctx);
+#endif
+            progress_reporter_stop(&ctx.progress);
+            op_stats_finish(&ctx.stats);
+            return key_err;
+        }
+        ctx.encrypt = 1;
+    }
+    if (ctx.checkpoint) {
+        checkpoint.encrypted = ctx.encrypt;
+        checkpoint.key_check = ctx.encrypt ? CrcCalc(ctx.aes_key, sizeof(ctx.aes_key)) : 0;
     }
-    ctx.current_volume_size += 2;
     
-    /* Placeholder for start header (32 bytes total after signature+version) */
-    long start_header_pos = ftell(first_vol_temp);
-    Byte start_header_data[24];
-    memset(start_header_data, 0, 24);
-    if (fwrite(start_header_data, 1, 24, first_vol_temp) != 24) {
+    SevenZipErrorCode fail_code = SEVENZIP_ERROR_COMPRESS;
+    SevenZipErrorCode done_code = SEVENZIP_OK;  /* Of a complete archive: the manifest */
+    Byte* stream_tail = NULL;  /* The header's bytes, for the streamable region */
+    if (resume && (resume->encrypted != ctx.encrypt || resume->key_check != checkpoint.key_check)) {
+        fprintf(stderr, "Password does not match the checkpointed job\n");
+        fail_code = SEVENZIP_ERROR_INVALID_PARAM;
         goto error;
     }
-    ctx.current_volume_size += 24;
     
-    /* Remember where packed data starts (after SignatureHeader) */
-    long pack_start_pos = ftell(first_vol_temp);
+    /* Reserve space for 7z signature and start header in first volume */
+    op_stats_phase_begin(&ctx.stats, SEVENZIP_PHASE_COMPRESS);
+    long start_header_pos = k7zSignature_Size + 2;
+    if (resume) {
+        /* The volumes already start with the signature and placeholder */
+        if (!mv_reopen_volumes(&ctx, resume->packed_size)) {
+            fail_code = SEVENZIP_ERROR_OPEN_FILE;
+            goto error;
+        }
+        ctx.bytes_written = resume->packed_size;
+        ctx.total_packed_size = resume->packed_size;
+        goto volumes_ready;
+    }
+    if (!open_new_volume(&ctx)) {
+        mv_file_list_free(&list);
+        mem_free(ctx.volumes);
+#if USE_DIRECT_IO
+        direct_buffers_free(&ctx);
+#endif
+        progress_reporter_stop(&ctx.progress);
+        op_stats_finish(&ctx.stats);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    
+    /* Signature, version and a placeholder for the start header; written
+       like packed data so unbuffered volumes stay aligned */
+    Byte signature_header[k7zStartHeaderSize];
+    memset(signature_header, 0, sizeof(signature_header));
+    memcpy(signature_header, k7zSignature, k7zSignature_Size);
+    signature_header[k7zSignature_Size] = 0;      /* Major version */
+    signature_header[k7zSignature_Size + 1] = 4;  /* Minor version */
+    if (!write_volumes_direct(&ctx, signature_header, sizeof(signature_header))) {
+        goto error;
+    }
     
     /* Reset byte tracking - only count packed data, not signature/start header */
     ctx.bytes_written = 0;  /* Reset for packed data tracking */
     ctx.total_packed_size = 0;
     
+    /* The streamable region stays zeros until the header is known */
+    if (ctx.pack_pos > 0) {
+        Byte zeros[4096];
+        memset(zeros, 0, sizeof(zeros));
+        for (uint64_t left = ctx.pack_pos; left > 0; ) {
+            size_t step = left < sizeof(zeros) ? (size_t)left : sizeof(zeros);
+            if (!write_volumes_direct(&ctx, zeros, step)) {
+                goto error;
+            }
+            left -= step;
+        }
+    }
+    
+volumes_ready:
+    /* Full volumes are closed (and synced) behind the writes to the next */
+    if (!sink && !ctx.single_file && (ctx.sync_volumes || ctx.volume_complete)) {
+        VolumeFinisher_Start(&ctx);
+    }
+    if (!sink && (options->volume_digests || options->volume_manifest)) {
+        ctx.volume_digests = (FileDigestSlot*)mem_calloc(SEVENZIP_MEM_OTHER, ctx.volume_capacity,
+                                                         sizeof(FileDigestSlot));
+        if (!ctx.volume_digests) {
+            fail_code = SEVENZIP_ERROR_MEMORY;
+            goto error;
+        }
+        ctx.volume_digest.algorithm = options->digest_algorithm;
+        ctx.volume_digests[0].algorithm = options->digest_algorithm;
+    }
+    if (!sink && !ctx.single_file && options->parity_volumes > 0) {
+        SevenZipErrorCode err = parity_writer_init(&ctx.parity_state, ctx.base_path,
+                                                   options->parity_volumes, ctx.max_volume_size);
+        if (err != SEVENZIP_OK) {
+            fail_code = err;
+            goto error;
+        }
+        ctx.parity = &ctx.parity_state;
+    }
+    
+    /* Without the precomputed chunks runs simply go through the encoder */
+    if (options->zero_blocks && zero_run_chunks_init(&ctx.zero_chunks) == SZ_OK) {
+        ctx.zero_runs = &ctx.zero_chunks;
+    }
+    /* Without PSI in the kernel there is nothing to watch */
+    if (options->memory_pressure_throttle > 0 &&
+        memory_pressure_init(&ctx.pressure_watch, options->memory_pressure_throttle)) {
+        ctx.pressure = &ctx.pressure_watch;
+    }
+    if (options->throughput_target > 0) {
+        throughput_slo_init(&ctx.slo_state, options->throughput_target, 1);
+        ctx.slo = &ctx.slo_state;
+    }
+    
+    /* From here on packed data is written behind the encoder; without the
+       thread (or with a single ring slot) it is written synchronously */
+    if (plan.writer_blocks > 1) {
+        VolumeWriter_Start(&ctx, plan.writer_blocks);
+    }
+    /* Unlike the writer, the verifier is no optimization: no thread, no job */
+    if (plan.verify) {
+        if (write_verify_start(&ctx.verify_state) != SZ_OK) {
+            fail_code = SEVENZIP_ERROR_MEMORY;
+            goto error;
+        }
+        ctx.verify = &ctx.verify_state;
+    }
+    
     /* Calculate total uncompressed size for solid stream */
     uint64_t total_uncompressed = 0;
     for (size_t i = 0; i < file_count; i++) {
@@ -1515,65 +5258,311 @@ SevenZipErrorCode sevenzip_create_multivolume_7z_complete(
     /* Check if we're in Store (raw copy) mode */
     int use_store_mode = (level == SEVENZIP_LEVEL_STORE);
     
-    /* Process each file */
-    for (size_t i = 0; i < file_count; i++) {
-        MV_FileEntry* file = &files[i];
-        
-        if (file->is_dir) {
-            /* Directories: no data, just metadata */
-            file->crc = 0;
-            file->lzma2_prop = 0;
-            continue;
+    /* Folder table: one folder for store, up to one per file otherwise */
+    folders = (MV_Folder*)mem_calloc(SEVENZIP_MEM_HEADER, file_count, sizeof(MV_Folder));
+    if (!folders) {
+        goto error;
+    }
+    size_t folder_count = 0;
+    unsigned delta_distance = sevenzip_filter_delta_distance(options->delta_distance);
+    MV_PpmdParams ppmd = plan.ppmd;
+    if (ctx.checkpoint) checkpoint.folders = folders;
+    
+    /* options->digest_manifest: a digest slot for every file, filled
+       by whichever stream reads the file for its CRC */
+    if (options->digest_manifest) {
+        ctx.digests = (FileDigestSlot*)mem_calloc(SEVENZIP_MEM_OTHER, file_count,
+                                                  sizeof(FileDigestSlot));
+        if (!ctx.digests) {
+            goto error;
         }
-        
-        uint32_t crc = 0;
-        uint64_t packed_size = 0;
-        SRes res;
-        
-        if (use_store_mode) {
-            /* FAST PATH: Raw copy without compression (like 7z -mx=0) */
+        for (size_t i = 0; i < file_count; i++) {
+            ctx.digests[i].algorithm = options->digest_algorithm;
+            if (!files[i].is_dir) files[i].digest_slot = &ctx.digests[i];
+        }
+    }
+    
+    /* Deterministic output: the scan's readdir order varies by filesystem */
+    if (!resume && options->deterministic && !sort_files(files, file_count, compare_name_order)) {
+        goto error;
+    }
+    
+    if (resume) {
+        /* Coders were chosen before the checkpoint, for every file */
+        memcpy(folders, resume->folders, resume->folder_count * sizeof(MV_Folder));
+        folder_count = resume->folder_count;
+    } else if (!use_store_mode) {
+        assign_coders(files, file_count, options->method, options->filter,
+                      options->delta_extensions, options->detect_compressed);
+        if (options->entry_policy) {
+            apply_entry_policy(files, file_count, plan.props.lzmaProps.level, options);
+        }
+        if (options->solid && options->solid_sort &&
+            !sort_files(files, file_count, compare_solid_order)) {
+            goto error;
+        }
+        if (options->solid && options->group_duplicates &&
+            !group_duplicate_files(files, file_count)) {
+            goto error;
+        }
+        if (options->solid && !group_hard_links(files, file_count)) {
+            goto error;
+        }
+        if (options->solid && !group_stored_files(files, file_count)) {
+            goto error;
+        }
+        if (options->solid && options->entry_policy &&
+            !sort_files(files, file_count, compare_policy_group)) {
+            goto error;
+        }
+    }
+    
+    if (use_store_mode) {
+        /* FAST PATH: Raw copy without compression (like 7z -mx=0).
+         * Concatenated raw files form one valid Copy-coded folder. */
+        size_t stored_files = 0;
+        for (size_t i = 0; i < first_file; i++) {
+            if (!files[i].is_dir && files[i].size > 0) stored_files++;
+        }
+        if (!mv_cipher_begin(&ctx, &folders[0])) {
+            goto error;
+        }
+        for (size_t i = first_file; i < file_count; i++) {
+            MV_FileEntry* file = &files[i];
+            
+            if (file->is_dir || file->size == 0) {
+                /* No data, just metadata */
+                file->crc = 0;
+                file->lzma2_prop = 0;
+                continue;
+            }
+            
+            uint32_t crc = 0;
+            uint64_t packed_size = 0;
             file->lzma2_prop = 0;  /* 0 = Copy/Store method */
-            res = store_file_uncompressed(
+            progress_reporter_begin_file(&ctx.progress, file->name, file->size);
+            SRes res = store_file_uncompressed(
                 file->full_path, NULL, file->size,
-                &ctx, &crc, &packed_size);
-        } else {
-            /* Normal compression path */
-            res = compress_file_streaming(
-                file->full_path, &ctx, &props,
-                &crc, &packed_size, &file->lzma2_prop);
+                &ctx, &crc, file->digest_slot, &packed_size);
+            
+            if (res != SZ_OK) {
+                fprintf(stderr, "Error compressing file: %s\n", file->name);
+                goto error;
+            }
+            
+            file->crc = crc;
+            ctx.total_packed_size += packed_size;
+            stored_files++;
+            
+            /* The Copy folder ends wherever a file does, unless encrypted */
+            if (!ctx.encrypt && !mv_checkpoint_save(&ctx, file + 1, folders)) {
+                goto error;
+            }
+        }
+        
+        folders[0].pack_size = ctx.total_packed_size;
+        if (!mv_cipher_end(&ctx, &folders[0])) {
+            goto error;
         }
+        ctx.total_packed_size = folders[0].pack_size;
+        
+        if (stored_files > 0) {
+            folders[0].unpack_size = total_uncompressed;
+            folders[0].num_files = stored_files;
+            folders[0].lzma2_prop = 0;
+            folders[0].filter = SEVENZIP_FILTER_NONE;
+            folder_count = 1;
+        }
+    } else if (!options->solid) {
+        /* Non-solid: compress files as independent folders in parallel;
+         * large files are split into blocks so every worker has one */
+        uint64_t split_block = plan.props.blockSize;
+        if (options->block_size == 0 && !options->deterministic &&
+            split_block != LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID) {
+            split_block = sevenzip_lzma2_block_size(total_uncompressed, plan.workers,
+                                                    plan.props.lzmaProps.dictSize, split_block);
+        }
+        size_t added = 0;
+        SRes res = compress_files_parallel(
+            files + first_file, file_count - first_file, &ctx, &plan.worker_props,
+            plan.workers, split_block, plan.spill_limit, delta_distance, &ppmd,
+            folders + folder_count, &added);
+        folder_count += added;
         
         if (res != SZ_OK) {
-            fprintf(stderr, "Error compressing file: %s\n", file->name);
+            fprintf(stderr, "Error compressing files in parallel\n");
             goto error;
         }
+    } else {
+        /* Solid blocks: one LZMA2 or PPMd folder per run of files, split where
+         * solid_block_size / solid_block_files is reached (unlimited = one folder) */
+        UInt32 prefetch_buffers = plan.prefetch_buffers;
+        uint64_t block_limit = options->solid_block_size;
+        size_t block_files_limit = options->solid_block_files > 0 ? (size_t)options->solid_block_files : 0;
+        uint64_t bytes_done = 0;
+        for (size_t i = 0; i < folder_count; i++) {
+            bytes_done += folders[i].unpack_size;
+        }
+        size_t block_start = first_file;
         
-        file->crc = crc;
-        ctx.total_packed_size += packed_size;
+        while (block_start < file_count) {
+            size_t block_end = block_start;
+            size_t block_streams = 0;
+            uint64_t block_bytes = 0;
+            SevenZipFilter block_filter = SEVENZIP_FILTER_NONE;
+            int block_ppmd = 0;
+            int block_store = 0;
+            int block_level = 0;
+            uint32_t block_group = 0;
+            while (block_end < file_count) {
+                MV_FileEntry* file = &files[block_end];
+                if (file->is_dir || file->size == 0) {
+                    block_end++;
+                    continue;
+                }
+                /* Files needing a different filter, method, level or group start a new block */
+                if (block_streams > 0 &&
+                    (file->filter != block_filter || file->use_ppmd != block_ppmd ||
+                     file->store != block_store || file->level != block_level ||
+                     file->group != block_group)) {
+                    break;
+                }
+                block_filter = file->filter;
+                block_ppmd = file->use_ppmd;
+                block_store = file->store;
+                block_level = file->level;
+                block_group = file->group;
+                block_end++;
+                block_streams++;
+                block_bytes += file->size;
+                if ((block_files_limit > 0 && block_streams >= block_files_limit) ||
+                    (block_limit > 0 && block_bytes >= block_limit)) {
+                    break;
+                }
+            }
+            
+            if (block_streams > 0) {
+                Byte prop = 0;
+                uint64_t packed_size = 0;
+                MV_Folder* folder = &folders[folder_count++];
+                if (!mv_cipher_begin(&ctx, folder)) {
+                    goto error;
+                }
+                /* Blocks sized for this folder's input, unless set by the
+                 * caller or kept for deterministic output */
+                CLzma2EncProps block_props;
+                mv_level_props(&props, block_level, &block_props);
+                if (options->block_size == 0 && !options->deterministic) {
+                    sevenzip_lzma2_spread_blocks(&block_props, block_bytes);
+                }
+                int rung = ctx.slo ? throughput_slo_rung(ctx.slo) : 0;
+                throughput_slo_props(&block_props, rung, &block_props);
+                if (block_ppmd) {
+                    if (ctx.stats.stats.encoder_threads < 1) ctx.stats.stats.encoder_threads = 1;
+                } else if (!block_store) {
+                    op_stats_add_lzma2(&ctx.stats, &block_props, block_bytes, 1);
+                }
+                SRes res = compress_solid_streaming(
+                    files + block_start, block_end - block_start, block_bytes,
+                    bytes_done, &ctx, &block_props,
+                    &packed_size, &prop, prefetch_buffers, block_filter, delta_distance,
+                    block_ppmd ? &ppmd : NULL, block_store, &folder->encode);
+                
+                if (res != SZ_OK) {
+                    fprintf(stderr, "Error compressing solid stream\n");
+                    goto error;
+                }
+                if (ctx.slo && !block_ppmd && !block_store) {
+                    throughput_slo_report(ctx.slo, rung, block_bytes, folder->encode.seconds);
+                }
+                
+                folder->pack_size = packed_size;
+                if (!mv_cipher_end(&ctx, folder)) {
+                    goto error;
+                }
+                ctx.total_packed_size += folder->pack_size;
+                
+                folder->unpack_size = block_bytes;
+                folder->num_files = block_streams;
+                folder->lzma2_prop = prop;
+                folder->filter = block_filter;
+                folder->delta_distance = delta_distance;
+                folder->use_ppmd = block_ppmd;
+                folder->ppmd = ppmd;
+                bytes_done += block_bytes;
+                if (!mv_checkpoint_save(&ctx, files + block_end, folders + folder_count)) {
+                    goto error;
+                }
+            }
+            
+            block_start = block_end;
+        }
+    }
+    
+    /* Every LZMA2 folder is written: wait for the verifier's verdict */
+    if (ctx.verify) {
+        int verified = write_verify_stop(ctx.verify, 0);
+        ctx.verify = NULL;
+        if (!verified) {
+            goto error;
+        }
+    }
+    
+    for (size_t f = 0; f < folder_count; f++) {
+        op_stats_add_folder(&ctx.stats, f, folders[f].unpack_size, folders[f].pack_size,
+                            &folders[f].encode);
     }
     
     /* Build header */
+    op_stats_phase_begin(&ctx.stats, SEVENZIP_PHASE_HEADER);
+    TRACE_BEGIN(header);
     size_t header_size = 0;
-    Byte* header = build_7z_header(files, file_count, ctx.total_packed_size, &header_size);
+    Byte* header = build_7z_header(files, file_count, folders, folder_count, ctx.pack_pos,
+                                   ctx.fixed_mtime, &header_size);
     if (!header) {
         goto error;
     }
     
+    /* Store the header LZMA-compressed when that makes it smaller */
+    size_t record_offset = 0;
+    Byte* encoded = NULL;
+    size_t encoded_size = 0;
+    if (sevenzip_encode_header(header, header_size, ctx.pack_pos + ctx.total_packed_size,
+                               &encoded, &encoded_size, &record_offset)) {
+        mem_free(header);
+        header = encoded;
+        header_size = encoded_size;
+    }
+    
     /* Calculate header CRC before writing */
-    uint32_t header_crc = CrcCalc(header, header_size);
+    uint32_t header_crc = CrcCalc(header + record_offset, header_size - record_offset);
+    TRACE_END(header, TRACE_HEADER, header_size);
     
     /* Write header to current position (end of packed data) */
     if (!write_across_volumes(&ctx, header, header_size)) {
-        free(header);
+        mem_free(header);
         goto error;
     }
-    free(header);
+    
+    /* The streamable region gets the header's bytes, behind its fields */
+    uint64_t tail_offset = k7zStartHeaderSize + ctx.pack_pos + ctx.total_packed_size;
+    Byte stream_head[STREAM_LAYOUT_HEAD_SIZE];
+    if (ctx.pack_pos > 0) {
+        if (stream_layout_head(stream_head, ctx.pack_pos, tail_offset, header, header_size)) {
+            stream_tail = header;
+        } else {
+            fprintf(stderr, "Header (%zu bytes) does not fit the streamable region (%llu bytes)\n",
+                    header_size, (unsigned long long)ctx.pack_pos);
+            done_code = SEVENZIP_ERROR_COMPRESS;
+        }
+    }
+    if (!stream_tail) mem_free(header);
     
     /* Calculate NextHeader offset from end of SignatureHeader */
-    /* SignatureHeader ends at pack_start_pos */
-    /* NextHeader offset = size of all packed data */
-    uint64_t next_header_offset = ctx.total_packed_size;
-    uint64_t next_header_size = header_size;
+    /* SignatureHeader ends at k7zStartHeaderSize */
+    /* NextHeader offset = region and packed data (+ packed header stream) */
+    uint64_t next_header_offset = ctx.pack_pos + ctx.total_packed_size + record_offset;
+    uint64_t next_header_size = header_size - record_offset;
     
     /* Build the StartHeader structure (NextHeaderOffset + NextHeaderSize + NextHeaderCRC) */
     Byte start_header_buf[20];
@@ -1584,9 +5573,65 @@ SevenZipErrorCode sevenzip_create_multivolume_7z_complete(
     /* Calculate StartHeader CRC */
     uint32_t start_header_crc = CrcCalc(start_header_buf, 20);
     
+    /* Wait for the queued writes, then stop the writer thread */
+    int drained = VolumeWriter_Drain(&ctx);
+    VolumeWriter_Destroy(&ctx);
+    if (!drained) {
+        goto error;
+    }
+    if (!VolumeFinisher_Stop(&ctx.finisher, 0)) {
+        fail_code = SEVENZIP_ERROR_OPEN_FILE;
+        goto error;
+    }
+    
+    if (sink) {
+        /* Last volume complete, then the start header and the first volume */
+        Byte patch[k7zStartHeaderSize - k7zSignature_Size - 2];
+        memcpy(patch, &start_header_crc, 4);
+        memcpy(patch + 4, start_header_buf, 20);
+        uint64_t first_size = (ctx.volume_count > 1) ? ctx.max_volume_size : ctx.current_volume_size;
+        if ((ctx.volume_count > 1 &&
+             !mv_sink_end_volume(&ctx, ctx.volume_count - 1, ctx.current_volume_size)) ||
+            sink->patch((uint64_t)start_header_pos, patch, sizeof(patch), sink->user_data) != 0 ||
+            (stream_tail &&
+             (sink->patch(k7zStartHeaderSize, stream_head, sizeof(stream_head), sink->user_data) != 0 ||
+              sink->patch(k7zStartHeaderSize + sizeof(stream_head), stream_tail, header_size,
+                          sink->user_data) != 0)) ||
+            !mv_sink_end_volume(&ctx, 0, first_size)) {
+            goto error;
+        }
+        goto volumes_closed;
+    }
+    
+#if USE_DIRECT_IO
+    /* Write the tail of the last direct volume; the start header patch
+       below is unaligned, so a direct first volume is reopened buffered */
+    if (!finish_direct_volume(&ctx)) {
+        goto error;
+    }
+    if (ctx.direct_buffer) {
+        char first_path[1280];
+        mv_volume_path(&ctx, first_path, sizeof(first_path), 0);
+        FILE* reopened = fopen(first_path, "r+b");
+        if (!reopened) {
+            goto error;
+        }
+        fclose(ctx.volumes[0]);
+        ctx.volumes[0] = reopened;
+    }
+#endif
+    
     /* Flush all volumes before seeking */
     for (size_t i = 0; i < ctx.volume_count; i++) {
-        fflush(ctx.volumes[i]);
+        if (ctx.volumes[i]) fflush(ctx.volumes[i]);
+    }
+    
+    /* The last volume is complete */
+    mv_volume_digest_end(&ctx);
+    
+    /* The last volume was preallocated for more than it holds */
+    if (!set_volume_size(ctx.volumes[ctx.volume_count - 1], ctx.current_volume_size)) {
+        goto error;
     }
     
     /* Go back and write start header in first volume (ALWAYS use ctx.volumes[0] after realloc!) */
@@ -1598,32 +5643,341 @@ SevenZipErrorCode sevenzip_create_multivolume_7z_complete(
     
     /* Write StartHeader data */
     fwrite(start_header_buf, 20, 1, first_vol);
+    
+    /* Then the streamable region behind it */
+    if (stream_tail &&
+        (fwrite(stream_head, 1, sizeof(stream_head), first_vol) != sizeof(stream_head) ||
+         fwrite(stream_tail, 1, header_size, first_vol) != header_size ||
+         fflush(first_vol) != 0)) {
+        goto error;
+    }
     fflush(first_vol);
     
-    /* Close all volumes */
-    for (size_t i = 0; i < ctx.volume_count; i++) {
-        fclose(ctx.volumes[i]);
+    /* Only now is the first volume final: its digest reads it back */
+    if (ctx.volume_digests) {
+        char first_path[1280];
+        mv_volume_path(&ctx, first_path, sizeof(first_path), 0);
+        if (!mv_digest_file(first_path, &ctx.volume_digests[0])) {
+            fail_code = SEVENZIP_ERROR_OPEN_FILE;
+            goto error;
+        }
+    }
+    if (ctx.parity) {
+        char first_path[1280];
+        mv_volume_path(&ctx, first_path, sizeof(first_path), 0);
+        if (!parity_writer_finish(ctx.parity, first_path)) {
+            fprintf(stderr, "Cannot write parity volumes: %s\n", ctx.base_path);
+            fail_code = SEVENZIP_ERROR_OPEN_FILE;
+            goto error;
+        }
+    }
+    
+    /* Close the volumes still open: the last, any the finisher did not
+       take, and then the first */
+    for (size_t n = 1; n <= ctx.volume_count; n++) {
+        size_t i = n % ctx.volume_count;
+        FILE* f = ctx.volumes[i];
+        if (!f) continue;
+        ctx.volumes[i] = NULL;
+        uint64_t size = (i + 1 == ctx.volume_count) ? ctx.current_volume_size : ctx.max_volume_size;
+        if (!mv_finish_volume(&ctx, f, i, size, ctx.sync_volumes,
+                              ctx.volume_digests ? &ctx.volume_digests[i] : NULL)) {
+            fail_code = SEVENZIP_ERROR_OPEN_FILE;
+            goto error;
+        }
+    }
+    if (ctx.checkpoint) {
+        remove(checkpoint.path);
+    }
+    
+volumes_closed:
+    /* The digests are final once the archive is */
+    if (ctx.digests && !mv_write_manifest(options->digest_manifest, options->digest_algorithm,
+                                          files, file_count)) {
+        fprintf(stderr, "Cannot write digest manifest: %s\n", options->digest_manifest);
+        done_code = SEVENZIP_ERROR_OPEN_FILE;
+    }
+    if (ctx.volume_digests && options->volume_manifest && !mv_write_volume_manifest(&ctx, options->volume_manifest)) {
+        fprintf(stderr, "Cannot write volume manifest: %s\n", options->volume_manifest);
+        done_code = SEVENZIP_ERROR_OPEN_FILE;
+    }
+    if (options->write_index && !sink &&
+        !mv_write_index(&ctx, archive_path, files, file_count, folders, folder_count)) {
+        fprintf(stderr, "Cannot write archive index: %s%s\n", archive_path, ARCHIVE_INDEX_SUFFIX);
+        done_code = SEVENZIP_ERROR_OPEN_FILE;
+    }
+    if (options->snapshot_output && !mv_write_snapshot(options->snapshot_output, list.entries, list.count)) {
+        fprintf(stderr, "Cannot write snapshot: %s\n", options->snapshot_output);
+        done_code = SEVENZIP_ERROR_OPEN_FILE;
     }
     
     /* Cleanup */
-    for (size_t i = 0; i < file_count; i++) {
-        free(files[i].name);
-        free(files[i].full_path);
+    mv_file_list_free(&list);
+    mem_free(folders);
+    mem_free(stream_tail);
+    mem_free(ctx.digests);
+    mem_free(ctx.volume_digests);
+    if (ctx.parity) parity_writer_free(ctx.parity);
+    mem_free(ctx.volumes);
+    crc_stage_destroy(&ctx.crc_stage);
+    mv_cache_free(&ctx.cache);
+    zero_run_chunks_free(&ctx.zero_chunks);
+    if (ctx.pressure) memory_pressure_destroy(ctx.pressure);
+    if (ctx.slo) {
+        ctx.stats.stats.throughput_rung = ctx.slo->rung;
+        ctx.stats.stats.throughput_changes = ctx.slo->changes;
+        throughput_slo_destroy(ctx.slo);
     }
-    free(files);
-    free(ctx.volumes);
+    if (ctx.cipher_active) AesOutStream_Free(&ctx.cipher);
+    memset(ctx.aes_key, 0, sizeof(ctx.aes_key));
+#if USE_DIRECT_IO
+    direct_buffers_free(&ctx);
+#endif
+    progress_reporter_stop(&ctx.progress);
+    op_stats_finish(&ctx.stats);
     
-    return SEVENZIP_OK;
+    return done_code;
     
 error:
-    for (size_t i = 0; i < ctx.volume_count; i++) {
-        fclose(ctx.volumes[i]);
+    if (ctx.verify) write_verify_stop(ctx.verify, 1);
+    VolumeWriter_Destroy(&ctx);
+#if USE_DIRECT_IO && defined(_WIN32)
+    direct_write_wait(&ctx);  /* Before its volume is closed and its buffer freed */
+#endif
+    VolumeFinisher_Stop(&ctx.finisher, 1);
+    for (size_t i = 0; !sink && i < ctx.volume_count; i++) {
+        if (ctx.volumes[i]) fclose(ctx.volumes[i]);
+        /* A cancelled or failed job leaves no half-written volume set,
+           unless a checkpoint lets it be resumed */
+        if (options->delete_temp_on_error && !(ctx.checkpoint && checkpoint.saved)) {
+            char volume_path[1280];
+            mv_volume_path(&ctx, volume_path, sizeof(volume_path), i);
+            remove(volume_path);
+        }
     }
-    for (size_t i = 0; i < file_count; i++) {
-        free(files[i].name);
-        free(files[i].full_path);
+    mv_file_list_free(&list);
+    mem_free(folders);
+    mem_free(stream_tail);
+    mem_free(ctx.digests);
+    mem_free(ctx.volume_digests);
+    if (ctx.parity) parity_writer_free(ctx.parity);
+    mem_free(ctx.volumes);
+    crc_stage_destroy(&ctx.crc_stage);
+    mv_cache_free(&ctx.cache);
+    zero_run_chunks_free(&ctx.zero_chunks);
+    if (ctx.pressure) memory_pressure_destroy(ctx.pressure);
+    if (ctx.slo) {
+        ctx.stats.stats.throughput_rung = ctx.slo->rung;
+        ctx.stats.stats.throughput_changes = ctx.slo->changes;
+        throughput_slo_destroy(ctx.slo);
+    }
+    if (ctx.cipher_active) AesOutStream_Free(&ctx.cipher);
+    memset(ctx.aes_key, 0, sizeof(ctx.aes_key));
+#if USE_DIRECT_IO
+    direct_buffers_free(&ctx);
+#endif
+    progress_reporter_stop(&ctx.progress);
+    op_stats_finish(&ctx.stats);
+    return cancel_token_requested(options->cancel) ? SEVENZIP_ERROR_CANCELLED : fail_code;
+}
+
+/* Helper: mv_create() on threads of the sevenzip_init_with_options() quota */
+static SevenZipErrorCode mv_create_leased(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data,
+    MV_Resume* resume,
+    const SevenZipArchiveSink* sink,
+    CreateOutput output,
+    int chunk_blocks
+) {
+    if ((options->digest_manifest || options->volume_digests || options->volume_manifest) &&
+        !file_digest_size(options->digest_algorithm)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    /* The throughput target picks settings by the clock */
+    if (options->deterministic && options->throughput_target > 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    /* Cached folders would be kept unencrypted, or made on the clock's settings */
+    if (options->block_cache_dir &&
+        ((options->password && options->password[0]) || options->throughput_target > 0)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    MetricsOp op;
+    metrics_op_begin(&op, SEVENZIP_METRIC_CREATE);
+    SevenZipStreamOptions leased = *options;
+    ThreadLease lease;
+    leased.num_threads = thread_lease_acquire(&lease, options->num_threads, options->thread_weight);
+    SevenZipErrorCode err = mv_create(archive_path, input_paths, level, &leased,
+                                      progress_callback, user_data, resume, sink, output,
+                                      chunk_blocks);
+    thread_lease_release(&lease);
+    SevenZipOpStats stats;
+    if (sevenzip_get_last_stats(&stats) == SEVENZIP_OK) {
+        op.bytes_in = stats.bytes_read;
+        op.bytes_out = stats.bytes_written;
+    }
+    metrics_op_end(&op, err);
+    return err;
+}
+
+int create_job_has_inputs(const char** input_paths, const SevenZipStreamOptions* options) {
+    return input_paths || (options && (options->next_input_path || options->input_list));
+}
+
+void create_job_init(CreateJob* job, const char* archive_path, const char** input_paths,
+                     SevenZipCompressionLevel level, const SevenZipStreamOptions* options,
+                     CreateOutput output, SevenZipBytesProgressCallback progress_callback,
+                     void* user_data) {
+    memset(job, 0, sizeof(*job));
+    job->archive_path = archive_path;
+    job->input_paths = input_paths;
+    job->level = level;
+    if (options) {
+        job->options = *options;
+    } else {
+        sevenzip_stream_options_init(&job->options);
+    }
+    job->output = output;
+    job->progress_callback = progress_callback;
+    job->user_data = user_data;
+}
+
+SevenZipErrorCode create_engine_run(CreateJob* job) {
+    SevenZipStreamOptions* opts = &job->options;
+    
+    /* Paths that fail before the pipeline starts leave zeros, not an
+       earlier job's stats */
+    op_stats_clear_last();
+    
+    switch (job->output) {
+        case CREATE_OUTPUT_FILE:
+            opts->checkpoint = 0;  /* Only split jobs are resumable */
+            opts->parity_volumes = 0;
+            break;
+        case CREATE_OUTPUT_VOLUMES:
+        case CREATE_OUTPUT_FIT:
+            if (opts->split_size == 0) return SEVENZIP_ERROR_INVALID_PARAM;
+            /* A resumed job cannot go back for the streamable region */
+            if (opts->streamable && opts->checkpoint) return SEVENZIP_ERROR_INVALID_PARAM;
+            /* Parity is kept in memory, not in the checkpoint, and is
+               found next to base.001 only */
+            if (opts->parity_volumes && (opts->checkpoint || opts->volume_dirs)) {
+                return SEVENZIP_ERROR_INVALID_PARAM;
+            }
+            break;
+        case CREATE_OUTPUT_SINK:
+            /* A checkpoint resumes from volume files on disk */
+            if (!job->sink || opts->checkpoint) return SEVENZIP_ERROR_INVALID_PARAM;
+            /* One volume unless split; no files, so no targets or direct I/O */
+            if (opts->split_size == 0) opts->split_size = UINT64_MAX;
+            opts->volume_dirs = NULL;
+            opts->unbuffered_output = 0;
+            opts->sync_volumes = 0;
+            opts->volume_complete = NULL;
+            opts->volume_digests = 0;
+            opts->volume_manifest = NULL;
+            opts->write_index = 0;
+            opts->parity_volumes = 0;
+            break;
+    }
+    
+    global_tables_init();
+    return mv_create_leased(job->output == CREATE_OUTPUT_SINK ? "" : job->archive_path,
+                            job->input_paths, job->level, opts, job->progress_callback,
+                            job->user_data, NULL, job->sink, job->output,
+                            job->chunk_blocks);
+}
+
+SevenZipErrorCode sevenzip_create_multivolume_7z_complete(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !options || !create_job_has_inputs(input_paths, options) ||
+        options->split_size == 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    CreateJob job;
+    create_job_init(&job, archive_path, input_paths, level, options, CREATE_OUTPUT_VOLUMES,
+                    progress_callback, user_data);
+    return create_engine_run(&job);
+}
+
+SevenZipErrorCode sevenzip_create_7z_to_sink(
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    const SevenZipArchiveSink* sink,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!create_job_has_inputs(input_paths, options) || !sink || !sink->write || !sink->patch) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    CreateJob job;
+    create_job_init(&job, NULL, input_paths, level, options, CREATE_OUTPUT_SINK,
+                    progress_callback, user_data);
+    job.sink = sink;
+    return create_engine_run(&job);
+}
+
+SevenZipErrorCode sevenzip_resume_multivolume(
+    const char* archive_path,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    if (options && (options->digest_manifest || options->snapshot_base || options->snapshot_output ||
+                    options->volume_digests || options->volume_manifest || options->streamable ||
+                    options->parity_volumes)) {
+        /* Files and volumes before the checkpoint are not read again, and
+           the checkpoint keeps no inodes */
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    global_tables_init();
+    
+    char path[1280];
+    get_checkpoint_filename(path, sizeof(path), archive_path);
+    MV_Resume resume;
+    SevenZipErrorCode err = mv_checkpoint_load(path, &resume);
+    if (err != SEVENZIP_OK) {
+        return err;
+    }
+    if (!mv_inputs_unchanged(&resume)) {
+        mv_resume_free(&resume);
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    /* The volume layout is the interrupted job's, the rest the caller's */
+    SevenZipStreamOptions opts;
+    if (options) {
+        opts = *options;
+    } else {
+        sevenzip_stream_options_init(&opts);
     }
-    free(files);
-    free(ctx.volumes);
-    return SEVENZIP_ERROR_COMPRESS;
+    opts.split_size = resume.split_size;
+    opts.solid = resume.solid;
+    opts.solid_block_size = resume.solid_block_size;
+    opts.solid_block_files = resume.solid_block_files;
+    opts.delta_distance = (int)resume.delta_distance;
+    opts.checkpoint = 1;
+    
+    err = mv_create_leased(archive_path, NULL, resume.level, &opts, progress_callback, user_data,
+                           &resume, NULL, CREATE_OUTPUT_VOLUMES, 0);
+    mv_resume_free(&resume);
+    return err;
 }
@@ -1,21 +1,19 @@
 /**
- * True Streaming 7z Archive Creation
+ * Entry Source 7z Archive Creation
  * 
- * This implementation uses chunk-based compression that processes files
- * in 64MB chunks WITHOUT loading all data into memory first.
- * 
- * Memory usage: ~250MB peak (64MB input buffer + 128MB LZMA2 dictionaries + overhead)
- * 
- * For large archives (88GB+), this is the only viable approach that doesn't
- * cause OOM crashes.
+ * sevenzip_create_7z_from_source(): entries that are not files, taken
+ * from the source's callbacks as the encoder reaches them and read through
+ * their own read callbacks, so sizes may be learnt only at their end.
+ * Archives of files are written by the create engine (create_engine.h).
  * 
  * ARCHITECTURE:
- * 1. Phase 1: Scan all input paths to gather file metadata (names, sizes, attributes)
- *    - This only stores metadata, not file data
- * 2. Phase 2: For each file, read 64MB chunks and compress them using LZMA2
- *    - Compressed chunks are written directly to output
- *    - Only one file's chunk is in memory at a time
- * 3. Phase 3: Write 7z headers with file metadata
+ * 1. Phase 1: Chain all entries into one ISeqInStream and feed it to Lzma2Enc
+ *    - Compressed data is written directly to the archive (no temp file)
+ *    - Per-file CRCs are computed while the encoder reads
+ * 2. Phase 2: Write 7z headers with file metadata and patch the start header
+ *
+ * Memory use does not grow with the data: one staging buffer, the
+ * encoder and the file table.
  * 
  * This creates valid 7z archives compatible with official 7-Zip.
  */
@@ -23,36 +21,34 @@
 #include "../include/7z_ffi.h"
 #include "Lzma2Enc.h"
 #include "7zCrc.h"
-#include "Alloc.h"
+#include "mem_alloc.h"
+#include "utf_convert.h"
+#include "archive_header.h"
+#include "name_arena.h"
+#include "crc_stage.h"
+#include "aes_coder.h"
+#include "memory_budget.h"
+#include "lzma2_block_size.h"
+#include "lzma_params.h"
+#include "op_stats.h"
+#include "metrics.h"
+#include "trace.h"
+#include "progress_reporter.h"
+#include "cancel_token.h"
+#include "rate_limit.h"
+#include "thread_quota.h"
+#include "thread_placement.h"
+#include "global_tables.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 #include <time.h>
-#include <errno.h>
-
-#ifdef _WIN32
-    #include <windows.h>
-    #include <direct.h>
-    #define STAT _stat
-    #define MKDIR(path) _mkdir(path)
-    #define PATH_SEP '\\'
-    #define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
-    #define S_ISDIR(m) (((m) & _S_IFMT) == _S_IFDIR)
-#else
-    #include <unistd.h>
-    #include <dirent.h>
-    #include <sys/types.h>
-    #define STAT stat
-    #define MKDIR(path) mkdir(path, 0755)
-    #define PATH_SEP '/'
-#endif
 
 /* Constants */
 #define STREAMING_CHUNK_SIZE (64 * 1024 * 1024)   /* 64 MB chunks */
 #define STREAMING_DICT_SIZE  (32 * 1024 * 1024)   /* 32 MB dictionary */
-#define MAX_PATH_LENGTH 4096
+#define STREAMING_STDIO_BUFFERS (4 * 1024 * 1024)  /* Archive setvbuf */
 #define INITIAL_FILE_CAPACITY 256
 
 /* 7z signature and header constants */
@@ -63,12 +59,13 @@ static const unsigned char k7zSignature[6] = {'7', 'z', 0xBC, 0xAF, 0x27, 0x1C};
 /* File metadata (no data buffer!) */
 typedef struct {
     char* name;              /* Relative path within archive */
-    char* full_path;         /* Full filesystem path for reading */
     uint64_t size;           /* Uncompressed size */
     uint64_t mtime;          /* Modification time (FILETIME format) */
     uint32_t attrib;         /* File attributes */
     uint32_t crc;            /* CRC32 - calculated during compression */
     int is_directory;        /* 1 if directory */
+    SevenZipReadCallback read;  /* Data of the entry, NULL for directories and empty entries */
+    void* read_data;
 } FileMetadata;
 
 /* Archive builder state (streaming version) */
@@ -76,37 +73,42 @@ typedef struct {
     FileMetadata* files;     /* Array of file metadata (no data!) */
     size_t file_count;
     size_t file_capacity;
+    NameArena names;         /* Strings of files[] */
     
     /* Compression state */
     CLzma2EncProps props;
     unsigned char lzma2_prop_byte;
+    int use_copy_codec;      /* 1 = Store level, write files with Copy codec */
     
     /* Progress tracking */
     uint64_t total_uncompressed;
-    uint64_t bytes_processed;
-    SevenZipBytesProgressCallback progress_callback;
-    void* user_data;
+    ProgressReporter progress;
     
     /* Output state */
     FILE* output_file;
     uint64_t packed_size;     /* Total compressed data size */
-    unsigned char* chunk_buffer;  /* Reusable chunk read buffer */
+    unsigned char* chunk_buffer;  /* Reusable chunk read buffer (Store only) */
     size_t chunk_size;
-} StreamingArchiveBuilder;
+    const SevenZipCancelToken* cancel;  /* options->cancel */
+    SevenZipRateLimit* rate_limit;      /* options->rate_limit */
+    uint64_t block_size;      /* options->block_size (0 = auto) */
+    int deterministic;        /* options->deterministic */
+    uint64_t fixed_mtime;     /* options->fixed_mtime as FILETIME, 0 = the entries' own */
+    const SevenZipLzmaParams* lzma_params;  /* options->lzma_params (NULL = the level's) */
+    SevenZipNumaPolicy numa_policy;  /* options->numa_policy */
+    CrcStage crc_stage;       /* Per-file CRCs, off the encoder's read path */
+    const SevenZipEntrySource* source;  /* Entries after files[], NULL = none */
+    int source_done;          /* The source has no more entries */
 
-/* Forward declarations */
-static SevenZipErrorCode scan_directory_recursive(
-    StreamingArchiveBuilder* builder,
-    const char* dir_path,
-    const char* base_path
-);
+    /* 7zAES (options->password): the folder's pack stream is encrypted */
+    int encrypt;
+    unsigned char aes_key[AES_CODER_KEY_SIZE];
+    unsigned char aes_iv[AES_CODER_IV_SIZE];
+    uint64_t aes_size;        /* Unpadded size of the encrypted coder output */
 
-static void update_progress(
-    StreamingArchiveBuilder* builder,
-    const char* current_file,
-    uint64_t file_bytes,
-    uint64_t file_total
-);
+    OpStats stats;            /* For sevenzip_get_last_stats() */
+    OpStatsEncode encode;     /* Encoder counts of the one folder */
+} StreamingArchiveBuilder;
 
 /* ============================================================================
  * Utility Functions
@@ -118,25 +120,26 @@ static void update_progress(
 static void builder_init(StreamingArchiveBuilder* builder) {
     memset(builder, 0, sizeof(StreamingArchiveBuilder));
     builder->file_capacity = INITIAL_FILE_CAPACITY;
-    builder->files = (FileMetadata*)calloc(builder->file_capacity, sizeof(FileMetadata));
+    builder->files = (FileMetadata*)mem_calloc(SEVENZIP_MEM_HEADER, builder->file_capacity, sizeof(FileMetadata));
     builder->chunk_size = STREAMING_CHUNK_SIZE;
+    name_arena_init(&builder->names);
+    crc_stage_init(&builder->crc_stage);
 }
 
 /**
  * Free streaming archive builder
  */
 static void builder_free(StreamingArchiveBuilder* builder) {
+    /* Queued ranges may point into the buffers freed below */
+    crc_stage_destroy(&builder->crc_stage);
+    name_arena_free(&builder->names);
     if (builder->files) {
-        for (size_t i = 0; i < builder->file_count; i++) {
-            free(builder->files[i].name);
-            free(builder->files[i].full_path);
-        }
-        free(builder->files);
+        mem_free(builder->files);
     }
     if (builder->chunk_buffer) {
-        free(builder->chunk_buffer);
+        mem_free(builder->chunk_buffer);
     }
-    memset(builder, 0, sizeof(StreamingArchiveBuilder));
+    memset(builder, 0, sizeof(StreamingArchiveBuilder));  /* Also clears aes_key */
 }
 
 /**
@@ -144,7 +147,6 @@ static void builder_free(StreamingArchiveBuilder* builder) {
  */
 static SevenZipErrorCode builder_add_file(
     StreamingArchiveBuilder* builder,
-    const char* full_path,
     const char* relative_name,
     uint64_t size,
     uint64_t mtime,
@@ -154,7 +156,7 @@ static SevenZipErrorCode builder_add_file(
     /* Expand array if needed */
     if (builder->file_count >= builder->file_capacity) {
         size_t new_capacity = builder->file_capacity * 2;
-        FileMetadata* new_files = (FileMetadata*)realloc(
+        FileMetadata* new_files = (FileMetadata*)mem_realloc(SEVENZIP_MEM_HEADER,
             builder->files, new_capacity * sizeof(FileMetadata));
         if (!new_files) {
             return SEVENZIP_ERROR_MEMORY;
@@ -166,19 +168,15 @@ static SevenZipErrorCode builder_add_file(
     FileMetadata* file = &builder->files[builder->file_count];
     memset(file, 0, sizeof(FileMetadata));
     
-    file->name = strdup(relative_name);
-    file->full_path = strdup(full_path);
+    file->name = name_arena_strdup(&builder->names, relative_name);
+    if (!file->name) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
     file->size = size;
     file->mtime = mtime;
     file->attrib = attrib;
     file->is_directory = is_dir;
     
-    if (!file->name || !file->full_path) {
-        free(file->name);
-        free(file->full_path);
-        return SEVENZIP_ERROR_MEMORY;
-    }
-    
     if (!is_dir) {
         builder->total_uncompressed += size;
     }
@@ -195,583 +193,694 @@ static uint64_t unix_to_filetime(time_t unix_time) {
 }
 
 /**
- * Write variable-length number in 7z format
+ * Make files[index] available, asking the source for entries past the
+ * end of the list
+ * @return 1 if there is such an entry, 0 at the end or on error (in *err)
  */
-static void write_number(unsigned char** buf, uint64_t value) {
-    unsigned char* p = *buf;
-    
-    if (value < 0x80) {
-        *p++ = (unsigned char)value;
-    } else if (value < ((uint64_t)1 << 14)) {
-        *p++ = (unsigned char)(0x80 | (value >> 8));
-        *p++ = (unsigned char)(value & 0xFF);
-    } else if (value < ((uint64_t)1 << 21)) {
-        *p++ = (unsigned char)(0xC0 | ((value >> 16) & 0x1F));
-        *p++ = (unsigned char)(value & 0xFF);
-        *p++ = (unsigned char)((value >> 8) & 0xFF);
-    } else if (value < ((uint64_t)1 << 28)) {
-        *p++ = (unsigned char)(0xE0 | ((value >> 24) & 0x0F));
-        *p++ = (unsigned char)(value & 0xFF);
-        *p++ = (unsigned char)((value >> 8) & 0xFF);
-        *p++ = (unsigned char)((value >> 16) & 0xFF);
-    } else {
-        /* For larger values, use 9-byte encoding */
-        *p++ = 0xFF;
-        for (int i = 0; i < 8; i++) {
-            *p++ = (unsigned char)((value >> (i * 8)) & 0xFF);
+static int builder_entry_at(StreamingArchiveBuilder* builder, size_t index, SevenZipErrorCode* err) {
+    *err = SEVENZIP_OK;
+    while (index >= builder->file_count) {
+        if (!builder->source || builder->source_done) return 0;
+        
+        SevenZipSourceEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        if (builder->source->next_entry(&entry, builder->source->user_data) != 0) {
+            fprintf(stderr, "[streaming] Entry source failed\n");
+            *err = SEVENZIP_ERROR_COMPRESS;
+            return 0;
+        }
+        if (!entry.name) {
+            builder->source_done = 1;
+            return 0;
         }
+        
+        /* Unknown sizes are counted once the entry has been read */
+        uint64_t size = (entry.is_dir || !entry.read) ? 0 : entry.size;
+        uint64_t known = (size == SEVENZIP_SIZE_UNKNOWN) ? 0 : size;
+        time_t mtime = entry.mtime ? (time_t)entry.mtime : time(NULL);
+        uint32_t attrib = entry.attributes ? entry.attributes
+                        : entry.is_dir ? 0x10 : 0x20;  /* FILE_ATTRIBUTE_DIRECTORY / _ARCHIVE */
+        *err = builder_add_file(builder, entry.name, known, unix_to_filetime(mtime), attrib, entry.is_dir);
+        if (*err != SEVENZIP_OK) return 0;
+        
+        FileMetadata* file = &builder->files[builder->file_count - 1];
+        file->size = size;
+        file->read = entry.read;
+        file->read_data = entry.read_user_data;
+        if (!entry.is_dir) builder->stats.stats.files++;
+        progress_reporter_set_total(&builder->progress, builder->total_uncompressed);
     }
-    
-    *buf = p;
+    return 1;
 }
 
-/* ============================================================================
- * Phase 1: Scan and Gather File Metadata
- * ============================================================================ */
-
 /**
- * Scan a single file and add its metadata (no data loading!)
+ * Read up to `size` bytes of `file` through its callback
+ * @return Bytes read, 0 at the end of the data; a failing callback also
+ *         sets *err
  */
-static SevenZipErrorCode scan_file(
-    StreamingArchiveBuilder* builder,
-    const char* full_path,
-    const char* relative_name
-) {
-    struct STAT st;
-    if (STAT(full_path, &st) != 0) {
-        fprintf(stderr, "[streaming] Cannot stat: %s (%s)\n", full_path, strerror(errno));
-        return SEVENZIP_ERROR_OPEN_FILE;
+static size_t builder_read(StreamingArchiveBuilder* builder, FileMetadata* file,
+                           void* buf, size_t size, SevenZipErrorCode* err) {
+    rate_limit_take(builder->rate_limit, RATE_LIMIT_READ, size, builder->cancel);
+    OpStatsTimer timer;
+    op_stats_io_begin(&builder->stats, &timer);
+    TRACE_BEGIN(read);
+    size_t got = size;
+    if (file->read(buf, &got, file->read_data) != 0 || got > size) {
+        fprintf(stderr, "[streaming] Read callback failed: %s\n", file->name);
+        *err = SEVENZIP_ERROR_COMPRESS;
+        got = 0;
     }
-    
-    if (S_ISDIR(st.st_mode)) {
-        /* Add directory entry */
-        SevenZipErrorCode err = builder_add_file(
-            builder, full_path, relative_name,
-            0, unix_to_filetime(st.st_mtime), (uint32_t)st.st_mode, 1);
-        if (err != SEVENZIP_OK) return err;
-        
-        /* Recursively scan contents */
-        return scan_directory_recursive(builder, full_path, relative_name);
-    } else if (S_ISREG(st.st_mode)) {
-        /* Add regular file entry */
-        return builder_add_file(
-            builder, full_path, relative_name,
-            (uint64_t)st.st_size, unix_to_filetime(st.st_mtime),
-            (uint32_t)st.st_mode, 0);
-    }
-    
-    /* Skip other file types (symlinks, devices, etc.) */
-    return SEVENZIP_OK;
+    TRACE_END(read, TRACE_READ, got);
+    op_stats_io_end(&builder->stats, &timer, SEVENZIP_PHASE_READ, got);
+    return got;
 }
 
-#ifdef _WIN32
-static SevenZipErrorCode scan_directory_recursive(
-    StreamingArchiveBuilder* builder,
-    const char* dir_path,
-    const char* base_name
-) {
-    char pattern[MAX_PATH_LENGTH];
-    snprintf(pattern, sizeof(pattern), "%s\\*", dir_path);
-    
-    WIN32_FIND_DATAA find_data;
-    HANDLE hFind = FindFirstFileA(pattern, &find_data);
-    if (hFind == INVALID_HANDLE_VALUE) {
-        return SEVENZIP_ERROR_OPEN_FILE;
-    }
-    
-    do {
-        if (strcmp(find_data.cFileName, ".") == 0 || 
-            strcmp(find_data.cFileName, "..") == 0) {
-            continue;
-        }
-        
-        char full_path[MAX_PATH_LENGTH];
-        char relative_name[MAX_PATH_LENGTH];
-        snprintf(full_path, sizeof(full_path), "%s\\%s", dir_path, find_data.cFileName);
-        snprintf(relative_name, sizeof(relative_name), "%s/%s", base_name, find_data.cFileName);
-        
-        SevenZipErrorCode err = scan_file(builder, full_path, relative_name);
-        if (err != SEVENZIP_OK) {
-            FindClose(hFind);
-            return err;
-        }
-    } while (FindNextFileA(hFind, &find_data));
-    
-    FindClose(hFind);
-    return SEVENZIP_OK;
-}
-#else
-static SevenZipErrorCode scan_directory_recursive(
-    StreamingArchiveBuilder* builder,
-    const char* dir_path,
-    const char* base_name
-) {
-    DIR* dir = opendir(dir_path);
-    if (!dir) {
-        fprintf(stderr, "[streaming] Cannot open directory: %s\n", dir_path);
-        return SEVENZIP_ERROR_OPEN_FILE;
-    }
-    
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || 
-            strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-        
-        char full_path[MAX_PATH_LENGTH];
-        char relative_name[MAX_PATH_LENGTH];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-        snprintf(relative_name, sizeof(relative_name), "%s/%s", base_name, entry->d_name);
-        
-        SevenZipErrorCode err = scan_file(builder, full_path, relative_name);
-        if (err != SEVENZIP_OK) {
-            closedir(dir);
-            return err;
-        }
-    }
-    
-    closedir(dir);
-    return SEVENZIP_OK;
+/**
+ * End an entry of unknown size at `size` bytes
+ */
+static void builder_set_size(StreamingArchiveBuilder* builder, FileMetadata* file, uint64_t size) {
+    file->size = size;
+    builder->total_uncompressed += size;
+    progress_reporter_set_total(&builder->progress, builder->total_uncompressed);
 }
-#endif
 
 /* ============================================================================
- * Phase 2: Streaming Compression
+ * Phase 1: Streaming Compression
  * ============================================================================ */
 
 /**
- * LZMA2 output write callback for streaming
+ * Output stream writing packed data straight into the archive file
  */
 typedef struct {
+    ISeqOutStream vt;
     FILE* output;
     uint64_t bytes_written;
     SevenZipErrorCode error;
-} Lzma2OutputStream;
+    OpStats* stats;
+    SevenZipRateLimit* rate_limit;
+    const SevenZipCancelToken* cancel;
+} ArchiveOutStream;
+
+static size_t ArchiveOutStream_Write(ISeqOutStreamPtr pp, const void *buf, size_t size) {
+    ArchiveOutStream* s = Z7_CONTAINER_FROM_VTBL(pp, ArchiveOutStream, vt);
+
+    rate_limit_take(s->rate_limit, RATE_LIMIT_WRITE, size, s->cancel);
+    OpStatsTimer timer;
+    op_stats_io_begin(s->stats, &timer);
+    TRACE_BEGIN(write);
+    size_t written = fwrite(buf, 1, size, s->output);
+    TRACE_END(write, TRACE_WRITE, written);
+    op_stats_io_end(s->stats, &timer, SEVENZIP_PHASE_WRITE, written);
+    s->bytes_written += written;
 
-static size_t lzma2_write(const ISeqOutStream *p, const void *buf, size_t size) {
-    Lzma2OutputStream* stream = (Lzma2OutputStream*)((char*)p - offsetof(struct {
-        ISeqOutStream s;
-        Lzma2OutputStream data;
-    }, data));
-    
-    /* This cast is safe because we control the struct layout */
-    Lzma2OutputStream* out = (Lzma2OutputStream*)((char*)p);
-    
-    size_t written = fwrite(buf, 1, size, out->output);
-    out->bytes_written += written;
-    
     if (written != size) {
-        out->error = SEVENZIP_ERROR_COMPRESS;
-        return 0;
+        s->error = SEVENZIP_ERROR_COMPRESS;
     }
-    
+
     return written;
 }
 
 /**
- * LZMA2 input read callback for streaming
+ * Input stream that chains every regular file of the builder into one
+ * solid stream, computing per-file CRCs on the fly.
+ *
+ * Files are read through a CRC_STAGE_BUFFER_SIZE staging buffer whose
+ * fills are checksummed on builder->crc_stage while the encoder copies
+ * them out, so no file is ever held in memory as a whole.
  */
 typedef struct {
-    FILE* input;
-    uint64_t bytes_read;
-    uint64_t bytes_total;
+    ISeqInStream vt;
     StreamingArchiveBuilder* builder;
-    const char* current_file;
-} Lzma2InputStream;
+    size_t current_file;
+    int current_open;         /* files[current_file] is being read */
+    uint64_t current_read;
+    Byte* stage_buf;
+    size_t stage_size;
+    size_t stage_pos;
+    SevenZipErrorCode error;
+} ChainedFileInStream;
 
-static SRes lzma2_read(const ISeqInStream *p, void *buf, size_t *size) {
-    Lzma2InputStream* in = (Lzma2InputStream*)p;
-    
-    size_t read = fread(buf, 1, *size, in->input);
-    *size = read;
-    in->bytes_read += read;
-    
-    /* Update progress */
-    if (in->builder && in->builder->progress_callback) {
-        in->builder->bytes_processed += read;
-        update_progress(in->builder, in->current_file, 
-                       in->bytes_read, in->bytes_total);
+static void ChainedFileInStream_FinishFile(ChainedFileInStream* s) {
+    FileMetadata* file = &s->builder->files[s->current_file];
+    crc_stage_end(&s->builder->crc_stage, &file->crc);
+    s->current_open = 0;
+    s->current_file++;
+}
+
+static SRes ChainedFileInStream_Read(ISeqInStreamPtr pp, void *buf, size_t *size) {
+    ChainedFileInStream* s = Z7_CONTAINER_FROM_VTBL(pp, ChainedFileInStream, vt);
+    StreamingArchiveBuilder* builder = s->builder;
+    size_t remaining = *size;
+    Byte* out = (Byte*)buf;
+
+    while (remaining > 0) {
+        /* Advance to the next file that still has data */
+        while (!s->current_open) {
+            if (!builder_entry_at(builder, s->current_file, &s->error)) {
+                if (s->error != SEVENZIP_OK) return SZ_ERROR_READ;
+                *size -= remaining;
+                return SZ_OK;
+            }
+
+            FileMetadata* file = &builder->files[s->current_file];
+            if (file->is_directory || file->size == 0) {
+                file->crc = 0;
+                s->current_file++;
+                continue;
+            }
+            s->current_open = 1;
+            crc_stage_begin(&builder->crc_stage, file->size, NULL);
+            s->current_read = 0;
+            progress_reporter_begin_file(&builder->progress, file->name,
+                                         file->size == SEVENZIP_SIZE_UNKNOWN ? 0 : file->size);
+        }
+
+        FileMetadata* file = &builder->files[s->current_file];
+        size_t to_read = remaining;
+        if (to_read > file->size - s->current_read) {
+            to_read = (size_t)(file->size - s->current_read);
+        }
+
+        if (s->stage_pos == s->stage_size) {
+            /* One read can span many fills, so the token is checked per fill */
+            if (cancel_token_requested(builder->cancel)) {
+                s->error = SEVENZIP_ERROR_CANCELLED;
+                return SZ_ERROR_PROGRESS;
+            }
+            /* The previous fill must be checksummed before it is overwritten */
+            crc_stage_sync(&builder->crc_stage);
+            size_t fill = CRC_STAGE_BUFFER_SIZE;
+            if (fill > file->size - s->current_read) {
+                fill = (size_t)(file->size - s->current_read);
+            }
+            s->stage_size = builder_read(builder, file, s->stage_buf, fill, &s->error);
+            s->stage_pos = 0;
+            if (s->error != SEVENZIP_OK) return SZ_ERROR_READ;
+            crc_stage_update(&builder->crc_stage, s->stage_buf, s->stage_size);
+        }
+
+        size_t got = s->stage_size - s->stage_pos;
+        if (got > to_read) got = to_read;
+        if (got == 0 && file->size == SEVENZIP_SIZE_UNKNOWN) {
+            /* The source ended the entry */
+            builder_set_size(builder, file, s->current_read);
+            ChainedFileInStream_FinishFile(s);
+            continue;
+        }
+        if (got == 0) {
+            /* File shrank since it was scanned - sizes in the header would lie */
+            fprintf(stderr, "[streaming] Short read: %s\n", file->name);
+            s->error = SEVENZIP_ERROR_COMPRESS;
+            return SZ_ERROR_READ;
+        }
+        memcpy(out, s->stage_buf + s->stage_pos, got);
+        s->stage_pos += got;
+        s->current_read += got;
+        progress_reporter_add(&builder->progress, got);
+
+        if (s->current_read == file->size) {
+            ChainedFileInStream_FinishFile(s);
+        }
+
+        out += got;
+        remaining -= got;
     }
-    
+
     return SZ_OK;
 }
 
 /**
- * Update progress callback
+ * Store all files uncompressed (Copy codec), chunk by chunk
  */
-static void update_progress(
+static SevenZipErrorCode store_files_streaming(
     StreamingArchiveBuilder* builder,
-    const char* current_file,
-    uint64_t file_bytes,
-    uint64_t file_total
+    ISeqOutStreamPtr archive
 ) {
-    if (builder->progress_callback) {
-        builder->progress_callback(
-            builder->bytes_processed,
-            builder->total_uncompressed,
-            file_bytes,
-            file_total,
-            current_file,
-            builder->user_data
-        );
+    /* Allocate chunk buffer once */
+    builder->chunk_buffer = (unsigned char*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, builder->chunk_size);
+    if (!builder->chunk_buffer) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    builder->stats.stats.peak_buffer_bytes = builder->chunk_size + STREAMING_STDIO_BUFFERS;
+
+    SevenZipErrorCode err;
+    for (size_t i = 0; builder_entry_at(builder, i, &err); i++) {
+        FileMetadata* file = &builder->files[i];
+
+        if (file->is_directory || file->size == 0) {
+            continue;
+        }
+
+        uint64_t file_bytes_read = 0;
+        crc_stage_begin(&builder->crc_stage, file->size, NULL);
+        progress_reporter_begin_file(&builder->progress, file->name,
+                                     file->size == SEVENZIP_SIZE_UNKNOWN ? 0 : file->size);
+
+        while (file_bytes_read < file->size) {
+            if (cancel_token_requested(builder->cancel)) {
+                err = SEVENZIP_ERROR_CANCELLED;
+                break;
+            }
+            size_t to_read = builder->chunk_size;
+            if (file_bytes_read + to_read > file->size) {
+                to_read = (size_t)(file->size - file_bytes_read);
+            }
+
+            /* The previous chunk must be checksummed before it is overwritten */
+            crc_stage_sync(&builder->crc_stage);
+            size_t bytes_read = builder_read(builder, file, builder->chunk_buffer, to_read, &err);
+            if (err != SEVENZIP_OK) break;
+            if (bytes_read == 0 && file->size == SEVENZIP_SIZE_UNKNOWN) {
+                /* The source ended the entry */
+                builder_set_size(builder, file, file_bytes_read);
+                break;
+            }
+            if (bytes_read == 0) {
+                fprintf(stderr, "[streaming] Short read: %s\n", file->name);
+                err = SEVENZIP_ERROR_COMPRESS;
+                break;
+            }
+
+            /* Checksummed while the chunk is written */
+            crc_stage_update(&builder->crc_stage, builder->chunk_buffer, bytes_read);
+
+            if (ISeqOutStream_Write(archive, builder->chunk_buffer, bytes_read) != bytes_read) {
+                err = SEVENZIP_ERROR_COMPRESS;
+                break;
+            }
+
+            file_bytes_read += bytes_read;
+            progress_reporter_add(&builder->progress, bytes_read);
+        }
+
+        crc_stage_end(&builder->crc_stage, &file->crc);
+        if (err != SEVENZIP_OK) {
+            crc_stage_sync(&builder->crc_stage);
+            return err;
+        }
     }
+
+    crc_stage_sync(&builder->crc_stage);
+    return err;
 }
 
 /**
- * Compress all files in streaming mode (chunk by chunk)
- * 
- * Returns compressed data written to a temporary file
+ * Compress all files as one solid LZMA2 stream into `archive`
+ *
+ * The encoder pulls data through ChainedFileInStream and pushes packed
+ * bytes to the archive, so memory stays bounded by the encoder state
+ * regardless of the input size. No temporary file is involved.
  */
-static SevenZipErrorCode compress_files_streaming(
+static SevenZipErrorCode encode_files_streaming(
     StreamingArchiveBuilder* builder,
-    FILE* temp_output,
+    ISeqOutStreamPtr archive,
     SevenZipCompressionLevel level,
-    int num_threads
+    int num_threads,
+    uint64_t dict_size
 ) {
-    /* Allocate chunk buffer once */
-    builder->chunk_buffer = (unsigned char*)malloc(builder->chunk_size);
-    if (!builder->chunk_buffer) {
-        return SEVENZIP_ERROR_MEMORY;
-    }
-    
-    /* Initialize LZMA2 encoder */
-    CLzma2EncHandle enc = Lzma2Enc_Create(&g_Alloc, &g_Alloc);
+    /* Initialize LZMA2 encoder; the placer lives until it is destroyed */
+    ThreadPlacer placer;
+    CLzma2EncHandle enc = thread_placer_init(&placer, builder->numa_policy)
+        ? Lzma2Enc_Create(&placer.small, &placer.big)
+        : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
     if (!enc) {
         return SEVENZIP_ERROR_MEMORY;
     }
-    
+
     CLzma2EncProps props;
     Lzma2EncProps_Init(&props);
     props.lzmaProps.level = level;
-    props.lzmaProps.dictSize = STREAMING_DICT_SIZE;
-    
+    props.lzmaProps.dictSize = dict_size > 0 ? (UInt32)dict_size : STREAMING_DICT_SIZE;
+    sevenzip_lzma_params_apply(builder->lzma_params, &props.lzmaProps);
+
     /* Configure multi-threading */
     if (num_threads > 0) {
         int block_threads = num_threads / 2;
         if (block_threads < 1) block_threads = 1;
         props.numBlockThreads_Max = block_threads;
-        props.lzmaProps.numThreads = 2;
+        props.lzmaProps.numThreads = num_threads > 1 ? 2 : 1;
         props.numTotalThreads = num_threads;
     }
-    
+
+    /* Expected size lets the encoder pick block sizes for MT; the size
+       of a source's entries is only known at the end */
+    uint64_t expected = builder->source ? UINT64_MAX : builder->total_uncompressed;
+    if (builder->block_size > 0) {
+        props.blockSize = builder->block_size;
+    } else if (builder->deterministic) {
+        sevenzip_lzma2_fixed_blocks(&props);
+    } else {
+        sevenzip_lzma2_spread_blocks(&props, expected);
+    }
+    Lzma2Enc_SetDataSize(enc, expected);
+
     SRes res = Lzma2Enc_SetProps(enc, &props);
     if (res != SZ_OK) {
         Lzma2Enc_Destroy(enc);
         return SEVENZIP_ERROR_COMPRESS;
     }
-    
+
     /* Get LZMA2 property byte */
     builder->lzma2_prop_byte = Lzma2Enc_WriteProperties(enc);
-    
+
+    /* Encoder state plus the staging buffer and both stdio buffers */
+    CLzma2EncProps used = props;
+    used.lzmaProps.reduceSize = expected;
+    Lzma2EncProps_Normalize(&used);
+    op_stats_add_lzma2(&builder->stats, &props, expected, 1);
+    builder->stats.stats.peak_buffer_bytes = sevenzip_lzma2_memory(&used) +
+        CRC_STAGE_BUFFER_SIZE + STREAMING_STDIO_BUFFERS;
+
+    ChainedFileInStream in_stream;
+    memset(&in_stream, 0, sizeof(in_stream));
+    in_stream.vt.Read = ChainedFileInStream_Read;
+    in_stream.builder = builder;
+    in_stream.error = SEVENZIP_OK;
+    in_stream.stage_buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, CRC_STAGE_BUFFER_SIZE);
+    if (!in_stream.stage_buf) {
+        Lzma2Enc_Destroy(enc);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    /* Block threads check the token between their input and progress steps */
+    CancelProgress cancel;
+    OpStatsEncodeTimer encode_timer;
+    TRACE_BEGIN(compress);
+    op_stats_encode_begin(&builder->stats, &encode_timer, enc);
+    res = Lzma2Enc_Encode2(enc,
+        archive, NULL, NULL,
+        &in_stream.vt, NULL, 0,
+        CancelProgress_Init(&cancel, builder->cancel, NULL));
+    op_stats_encode_end(&builder->stats, &encode_timer, enc,
+                        op_stats_block_threads(&props, expected), &builder->encode);
+    TRACE_END(compress, TRACE_COMPRESS, builder->total_uncompressed);
+
+    Lzma2Enc_Destroy(enc);
+
+    /* Stores the digests and releases the staging buffer */
+    crc_stage_sync(&builder->crc_stage);
+    mem_free(in_stream.stage_buf);
+
+    if (in_stream.error != SEVENZIP_OK) {
+        return in_stream.error;
+    }
+    if (res != SZ_OK) {
+        return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_COMPRESS;
+    }
+    return SEVENZIP_OK;
+}
+
+/**
+ * Write the folder's pack stream straight into the archive file
+ *
+ * With a password the stream passes through 7zAES on its way, so the
+ * data is encrypted as it is produced rather than in a second pass.
+ */
+static SevenZipErrorCode compress_files_streaming(
+    StreamingArchiveBuilder* builder,
+    FILE* archive,
+    SevenZipCompressionLevel level,
+    int num_threads,
+    uint64_t dict_size
+) {
     builder->packed_size = 0;
-    
-    /* Process each file */
-    for (size_t i = 0; i < builder->file_count; i++) {
-        FileMetadata* file = &builder->files[i];
-        
-        if (file->is_directory || file->size == 0) {
-            continue;  /* Skip directories and empty files */
+
+    ArchiveOutStream out_stream;
+    out_stream.vt.Write = ArchiveOutStream_Write;
+    out_stream.output = archive;
+    out_stream.bytes_written = 0;
+    out_stream.error = SEVENZIP_OK;
+    out_stream.stats = &builder->stats;
+    out_stream.rate_limit = builder->rate_limit;
+    out_stream.cancel = builder->cancel;
+
+    ISeqOutStreamPtr sink = &out_stream.vt;
+    AesOutStream cipher;
+    if (builder->encrypt) {
+        if (sevenzip_aes_new_iv(builder->aes_iv) != SEVENZIP_OK) {
+            return SEVENZIP_ERROR_UNKNOWN;
         }
-        
-        FILE* input = fopen(file->full_path, "rb");
-        if (!input) {
-            fprintf(stderr, "[streaming] Cannot open file: %s\n", file->full_path);
-            Lzma2Enc_Destroy(enc);
-            return SEVENZIP_ERROR_OPEN_FILE;
+        if (AesOutStream_Init(&cipher, builder->aes_key, builder->aes_iv, &out_stream.vt) != SZ_OK) {
+            return SEVENZIP_ERROR_MEMORY;
         }
-        
-        /* Use buffered I/O for better performance */
-        setvbuf(input, NULL, _IOFBF, 1024 * 1024);
-        
-        /* Calculate CRC while reading */
-        uint32_t crc = CRC_INIT_VAL;
-        uint64_t file_bytes_read = 0;
-        
-        /* Read and compress in chunks */
-        while (file_bytes_read < file->size) {
-            size_t to_read = builder->chunk_size;
-            if (file_bytes_read + to_read > file->size) {
-                to_read = (size_t)(file->size - file_bytes_read);
-            }
-            
-            size_t bytes_read = fread(builder->chunk_buffer, 1, to_read, input);
-            if (bytes_read == 0) {
-                break;
-            }
-            
-            /* Update CRC */
-            crc = CrcUpdate(crc, builder->chunk_buffer, bytes_read);
-            
-            /* Write uncompressed data to temp file for now
-             * TODO: Implement proper LZMA2 streaming compression
-             * The LZMA2 encoder's API makes true streaming complex;
-             * for now we write raw data and compress at the end
-             */
-            size_t written = fwrite(builder->chunk_buffer, 1, bytes_read, temp_output);
-            if (written != bytes_read) {
-                fclose(input);
-                Lzma2Enc_Destroy(enc);
-                return SEVENZIP_ERROR_COMPRESS;
-            }
-            
-            file_bytes_read += bytes_read;
-            builder->bytes_processed += bytes_read;
-            builder->packed_size += written;
-            
-            /* Update progress */
-            update_progress(builder, file->name, file_bytes_read, file->size);
+        sink = &cipher.vt;
+    }
+
+    SevenZipErrorCode err = builder->use_copy_codec
+        ? store_files_streaming(builder, sink)
+        : encode_files_streaming(builder, sink, level, num_threads, dict_size);
+
+    if (builder->encrypt) {
+        if (err == SEVENZIP_OK && !AesOutStream_Finish(&cipher)) {
+            err = SEVENZIP_ERROR_COMPRESS;
         }
-        
-        file->crc = CRC_GET_DIGEST(crc);
-        fclose(input);
+        builder->aes_size = cipher.processed;
+        AesOutStream_Free(&cipher);
     }
-    
-    Lzma2Enc_Destroy(enc);
-    return SEVENZIP_OK;
+    if (err == SEVENZIP_OK && out_stream.error != SEVENZIP_OK) {
+        err = out_stream.error;
+    }
+
+    builder->packed_size = out_stream.bytes_written;
+    return err;
 }
 
 /* ============================================================================
- * Phase 3: Write 7z Archive with Headers
+ * Phase 2: Write 7z Headers
  * ============================================================================ */
 
 /**
- * Write complete 7z archive structure
- * 
- * This is a simplified implementation that writes:
- * 1. Signature header
- * 2. Compressed data (from temp file)  
- * 3. File metadata headers
+ * Write the 7z header after the packed data and patch the signature header
+ *
+ * Layout: one folder (LZMA2 or Copy) holding every non-empty file as a
+ * substream. Directories and zero-length files are empty streams; the
+ * latter are additionally flagged in kEmptyFile.
  */
-static SevenZipErrorCode write_7z_archive(
+static SevenZipErrorCode write_7z_header(
     StreamingArchiveBuilder* builder,
-    const char* archive_path,
-    FILE* temp_data,
-    uint64_t data_size
+    FILE* archive
 ) {
-    FILE* archive = fopen(archive_path, "wb");
-    if (!archive) {
-        return SEVENZIP_ERROR_OPEN_FILE;
-    }
-    
-    /* Rewind temp data file */
-    fseek(temp_data, 0, SEEK_SET);
-    
-    /* ===== Write Signature Header ===== */
-    fwrite(k7zSignature, 1, 6, archive);
-    
-    unsigned char version[2] = { k7zMajorVersion, k7zMinorVersion };
-    fwrite(version, 1, 2, archive);
-    
-    /* Start header CRC placeholder (we'll update this later) */
-    long start_header_pos = ftell(archive);
-    uint32_t start_header_crc = 0;
-    fwrite(&start_header_crc, 4, 1, archive);
-    
-    /* Start header (24 bytes): NextHeaderOffset, NextHeaderSize, NextHeaderCRC */
-    uint64_t next_header_offset = data_size;  /* Header comes after data */
-    fwrite(&next_header_offset, 8, 1, archive);
-    
-    /* Placeholder for header size and CRC */
-    uint64_t next_header_size = 0;
-    uint32_t next_header_crc = 0;
-    long header_size_pos = ftell(archive);
-    fwrite(&next_header_size, 8, 1, archive);
-    fwrite(&next_header_crc, 4, 1, archive);
-    
-    /* ===== Copy compressed data from temp file ===== */
-    unsigned char copy_buffer[65536];
-    uint64_t remaining = data_size;
-    
-    while (remaining > 0) {
-        size_t to_copy = sizeof(copy_buffer);
-        if (remaining < to_copy) to_copy = (size_t)remaining;
-        
-        size_t read = fread(copy_buffer, 1, to_copy, temp_data);
-        if (read == 0) break;
-        
-        fwrite(copy_buffer, 1, read, archive);
-        remaining -= read;
-    }
-    
-    /* ===== Write Headers ===== */
-    long header_start = ftell(archive);
-    
-    /* Build header in memory */
-    size_t header_capacity = 4096 + builder->file_count * 512;
-    unsigned char* header = (unsigned char*)malloc(header_capacity);
-    if (!header) {
-        fclose(archive);
-        return SEVENZIP_ERROR_MEMORY;
-    }
-    
-    unsigned char* p = header;
-    
-    /* Main streams info */
-    *p++ = 0x04;  /* kMainStreamsInfo */
-    
-    /* Pack info */
-    *p++ = 0x06;  /* kPackInfo */
-    write_number(&p, 0);  /* Pack position (start of data) */
-    write_number(&p, 1);  /* Number of pack streams */
-    
-    *p++ = 0x09;  /* kSize */
-    write_number(&p, data_size);  /* Pack size */
-    
-    *p++ = 0x00;  /* kEnd of PackInfo */
-    
-    /* Unpack info (simplified - single folder with copy codec) */
-    *p++ = 0x07;  /* kUnpackInfo */
-    *p++ = 0x0B;  /* kFolder */
-    write_number(&p, 1);  /* Number of folders */
-    
-    /* Folder: 1 coder (Copy codec for simplicity) */
-    *p++ = 0x01;  /* NumCoders = 1, simple coder */
-    *p++ = 0x00;  /* Copy codec ID */
-    
-    *p++ = 0x0C;  /* kCodersUnpackSize */
-    write_number(&p, builder->total_uncompressed);  /* Unpack size */
-    
-    *p++ = 0x00;  /* kEnd of UnpackInfo */
-    
-    /* SubStreams info */
-    size_t file_stream_count = 0;
+    TRACE_BEGIN(header);
+    size_t stream_count = 0;
+    size_t empty_count = 0;
+    size_t names_size = 1;  /* External flag byte */
     for (size_t i = 0; i < builder->file_count; i++) {
-        if (!builder->files[i].is_directory && builder->files[i].size > 0) {
-            file_stream_count++;
+        FileMetadata* f = &builder->files[i];
+        if (f->is_directory || f->size == 0) {
+            empty_count++;
+        } else {
+            stream_count++;
         }
+        names_size += utf8_to_utf16le_size(f->name) + 2;
     }
-    
-    if (file_stream_count > 1) {
-        *p++ = 0x08;  /* kSubStreamsInfo */
-        *p++ = 0x0D;  /* kNumUnpackStream */
-        write_number(&p, file_stream_count);
-        
-        *p++ = 0x09;  /* kSize - sizes of each file */
-        for (size_t i = 0; i < builder->file_count; i++) {
-            FileMetadata* f = &builder->files[i];
-            if (!f->is_directory && f->size > 0) {
-                /* Don't write last size (it's implied) */
-                if (i < builder->file_count - 1 || 
-                    builder->files[builder->file_count-1].is_directory) {
-                    write_number(&p, f->size);
+
+    /* Build header in memory; it grows as the properties are appended */
+    size_t bit_bytes = (builder->file_count + 7) / 8;
+    HeaderBuffer hb;
+    header_buffer_init(&hb);
+
+    header_buffer_byte(&hb, 0x01);  /* kHeader */
+
+    if (stream_count > 0) {
+        /* Main streams info */
+        header_buffer_byte(&hb, 0x04);  /* kMainStreamsInfo */
+
+        /* Pack info */
+        header_buffer_byte(&hb, 0x06);  /* kPackInfo */
+        header_buffer_number(&hb, 0);  /* Pack position (start of data) */
+        header_buffer_number(&hb, 1);  /* Number of pack streams */
+        header_buffer_byte(&hb, 0x09);  /* kSize */
+        header_buffer_number(&hb, builder->packed_size);
+        header_buffer_byte(&hb, 0x00);  /* kEnd of PackInfo */
+
+        /* Unpack info: single folder with one coder */
+        header_buffer_byte(&hb, 0x07);  /* kUnpackInfo */
+        header_buffer_byte(&hb, 0x0B);  /* kFolder */
+        header_buffer_number(&hb, 1);  /* Number of folders */
+        header_buffer_byte(&hb, 0x00);  /* External = false */
+        header_buffer_number(&hb, builder->encrypt ? 2 : 1);  /* Number of coders */
+
+        if (builder->use_copy_codec) {
+            header_buffer_byte(&hb, 0x01);  /* ID size 1, no properties */
+            header_buffer_byte(&hb, 0x00);  /* Copy codec ID */
+        } else {
+            header_buffer_byte(&hb, 0x21);  /* ID size 1, has properties */
+            header_buffer_byte(&hb, 0x21);  /* LZMA2 codec ID */
+            header_buffer_number(&hb, 1);  /* Properties size */
+            header_buffer_byte(&hb, builder->lzma2_prop_byte);
+        }
+
+        if (builder->encrypt) {
+            Byte* q = header_buffer_reserve(&hb, AES_CODER_RECORD_SIZE);
+            if (q) header_buffer_commit(&hb, sevenzip_aes_write_coder(builder->aes_iv, q));
+            /* Bond: coder 0 input <- AES output (out stream 1); the AES
+               input is the pack stream */
+            header_buffer_number(&hb, 0);
+            header_buffer_number(&hb, 1);
+        }
+
+        header_buffer_byte(&hb, 0x0C);  /* kCodersUnpackSize */
+        header_buffer_number(&hb, builder->total_uncompressed);
+        if (builder->encrypt) {
+            header_buffer_number(&hb, builder->aes_size);
+        }
+        header_buffer_byte(&hb, 0x00);  /* kEnd of UnpackInfo */
+
+        /* SubStreams info */
+        header_buffer_byte(&hb, 0x08);  /* kSubStreamsInfo */
+        header_buffer_byte(&hb, 0x0D);  /* kNumUnpackStream */
+        header_buffer_number(&hb, stream_count);
+
+        if (stream_count > 1) {
+            header_buffer_byte(&hb, 0x09);  /* kSize - all but the last (implied) */
+            size_t written = 0;
+            for (size_t i = 0; i < builder->file_count && written < stream_count - 1; i++) {
+                FileMetadata* f = &builder->files[i];
+                if (!f->is_directory && f->size > 0) {
+                    header_buffer_number(&hb, f->size);
+                    written++;
                 }
             }
         }
-        
-        *p++ = 0x0A;  /* kCRC */
-        *p++ = 0x01;  /* AllAreDefined = true */
+
+        header_buffer_byte(&hb, 0x0A);  /* kCRC */
+        header_buffer_byte(&hb, 0x01);  /* AllAreDefined = true */
         for (size_t i = 0; i < builder->file_count; i++) {
             FileMetadata* f = &builder->files[i];
             if (!f->is_directory && f->size > 0) {
-                uint32_t crc = f->crc;
-                *p++ = (unsigned char)(crc & 0xFF);
-                *p++ = (unsigned char)((crc >> 8) & 0xFF);
-                *p++ = (unsigned char)((crc >> 16) & 0xFF);
-                *p++ = (unsigned char)((crc >> 24) & 0xFF);
+                header_buffer_uint32(&hb, f->crc);
             }
         }
-        
-        *p++ = 0x00;  /* kEnd of SubStreamsInfo */
+
+        header_buffer_byte(&hb, 0x00);  /* kEnd of SubStreamsInfo */
+        header_buffer_byte(&hb, 0x00);  /* kEnd of MainStreamsInfo */
     }
-    
-    *p++ = 0x00;  /* kEnd of MainStreamsInfo */
-    
+
     /* Files info */
-    *p++ = 0x05;  /* kFilesInfo */
-    write_number(&p, builder->file_count);
-    
-    /* Names */
-    *p++ = 0x11;  /* kName */
-    
-    /* Calculate names size (UTF-16LE + null terminators) */
-    size_t names_size = 1;  /* External flag byte */
-    for (size_t i = 0; i < builder->file_count; i++) {
-        names_size += (strlen(builder->files[i].name) + 1) * 2;
+    header_buffer_byte(&hb, 0x05);  /* kFilesInfo */
+    header_buffer_number(&hb, builder->file_count);
+
+    if (empty_count > 0) {
+        /* Empty stream property (directories and zero-length files) */
+        header_buffer_byte(&hb, 0x0E);  /* kEmptyStream */
+        header_buffer_number(&hb, bit_bytes);
+        HeaderBits empty_stream;
+        header_bits_begin(&empty_stream, &hb);
+        for (size_t i = 0; i < builder->file_count; i++) {
+            FileMetadata* f = &builder->files[i];
+            header_bits_put(&empty_stream, f->is_directory || f->size == 0);
+        }
+        header_bits_end(&empty_stream);
+
+        /* Empty file property: one bit per empty stream, set for files */
+        int has_empty_files = 0;
+        for (size_t i = 0; i < builder->file_count; i++) {
+            if (!builder->files[i].is_directory && builder->files[i].size == 0) {
+                has_empty_files = 1;
+                break;
+            }
+        }
+
+        if (has_empty_files) {
+            header_buffer_byte(&hb, 0x0F);  /* kEmptyFile */
+            header_buffer_number(&hb, (empty_count + 7) / 8);
+            HeaderBits empty_file;
+            header_bits_begin(&empty_file, &hb);
+            for (size_t i = 0; i < builder->file_count; i++) {
+                FileMetadata* f = &builder->files[i];
+                if (f->is_directory || f->size == 0) {
+                    header_bits_put(&empty_file, !f->is_directory);
+                }
+            }
+            header_bits_end(&empty_file);
+        }
     }
-    write_number(&p, names_size);
-    
-    *p++ = 0x00;  /* External = false */
-    
+
+    /* Names */
+    header_buffer_byte(&hb, 0x11);  /* kName */
+    header_buffer_number(&hb, names_size);
+    header_buffer_byte(&hb, 0x00);  /* External = false */
+
     /* Write UTF-16LE names */
     for (size_t i = 0; i < builder->file_count; i++) {
         const char* name = builder->files[i].name;
-        while (*name) {
-            *p++ = (unsigned char)*name;  /* Low byte */
-            *p++ = 0;                      /* High byte (ASCII only) */
-            name++;
-        }
-        *p++ = 0; *p++ = 0;  /* Null terminator */
+        Byte* q = header_buffer_reserve(&hb, utf8_to_utf16le_size(name) + 2);
+        if (!q) break;
+        size_t len = utf8_to_utf16le(name, q);
+        q[len] = 0; q[len + 1] = 0;  /* Null terminator */
+        header_buffer_commit(&hb, len + 2);
     }
-    
-    /* Empty stream property (directories) */
-    int has_dirs = 0;
+
+    /* MTime */
+    header_buffer_byte(&hb, 0x14);  /* kMTime */
+    header_buffer_number(&hb, 2 + (uint64_t)builder->file_count * 8);
+    header_buffer_byte(&hb, 0x01);  /* AllAreDefined */
+    header_buffer_byte(&hb, 0x00);  /* External = false */
     for (size_t i = 0; i < builder->file_count; i++) {
-        if (builder->files[i].is_directory) {
-            has_dirs = 1;
-            break;
-        }
+        header_buffer_uint64(&hb, builder->fixed_mtime ? builder->fixed_mtime : builder->files[i].mtime);
     }
-    
-    if (has_dirs) {
-        *p++ = 0x0E;  /* kEmptyStream */
-        size_t bit_bytes = (builder->file_count + 7) / 8;
-        write_number(&p, bit_bytes);
-        
-        unsigned char* bits = p;
-        memset(bits, 0, bit_bytes);
-        for (size_t i = 0; i < builder->file_count; i++) {
-            if (builder->files[i].is_directory) {
-                bits[i / 8] |= (0x80 >> (i % 8));
-            }
-        }
-        p += bit_bytes;
-    }
-    
-    /* MTime */
-    *p++ = 0x14;  /* kMTime */
-    size_t mtime_size = 2 + builder->file_count * 8;
-    write_number(&p, mtime_size);
-    *p++ = 0x01;  /* AllAreDefined */
-    *p++ = 0x00;  /* External = false */
-    
+
+    /* Attributes */
+    header_buffer_byte(&hb, 0x15);  /* kWinAttrib */
+    header_buffer_number(&hb, 2 + (uint64_t)builder->file_count * 4);
+    header_buffer_byte(&hb, 0x01);  /* AllAreDefined */
+    header_buffer_byte(&hb, 0x00);  /* External = false */
     for (size_t i = 0; i < builder->file_count; i++) {
-        uint64_t mtime = builder->files[i].mtime;
-        for (int j = 0; j < 8; j++) {
-            *p++ = (unsigned char)((mtime >> (j * 8)) & 0xFF);
-        }
+        header_buffer_uint32(&hb, builder->files[i].attrib);
     }
-    
-    *p++ = 0x00;  /* kEnd of FilesInfo */
-    *p++ = 0x00;  /* kEnd of Header */
-    
-    size_t header_size = p - header;
-    
-    /* Write header */
-    fwrite(header, 1, header_size, archive);
-    
-    /* Calculate header CRC */
-    next_header_crc = CrcCalc(header, header_size);
-    next_header_size = header_size;
-    
-    /* Update start header */
-    fseek(archive, header_size_pos, SEEK_SET);
-    fwrite(&next_header_size, 8, 1, archive);
-    fwrite(&next_header_crc, 4, 1, archive);
-    
-    /* Calculate and write start header CRC */
+
+    header_buffer_byte(&hb, 0x00);  /* kEnd of FilesInfo */
+    header_buffer_byte(&hb, 0x00);  /* kEnd of Header */
+
+    if (hb.failed) {
+        header_buffer_free(&hb);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    unsigned char* header = hb.data;
+    size_t header_size = hb.size;
+    size_t record_offset = 0;
+
+    /* Store the header LZMA-compressed when that makes it smaller */
+    unsigned char* encoded = NULL;
+    size_t encoded_size = 0;
+    if (sevenzip_encode_header(header, header_size, builder->packed_size,
+                               &encoded, &encoded_size, &record_offset)) {
+        mem_free(header);
+        header = encoded;
+        header_size = encoded_size;
+    }
+    TRACE_END(header, TRACE_HEADER, header_size);
+
+    /* Write header right after the packed data */
+    OpStatsTimer timer;
+    op_stats_io_begin(&builder->stats, &timer);
+    TRACE_BEGIN(write);
+    size_t written = fwrite(header, 1, header_size, archive);
+    TRACE_END(write, TRACE_WRITE, written);
+    op_stats_io_end(&builder->stats, &timer, SEVENZIP_PHASE_WRITE, written);
+    if (written != header_size) {
+        mem_free(header);
+        return SEVENZIP_ERROR_COMPRESS;
+    }
+
+    uint64_t next_header_offset = builder->packed_size + record_offset;
+    uint64_t next_header_size = header_size - record_offset;
+    uint32_t next_header_crc = CrcCalc(header + record_offset, header_size - record_offset);
+    mem_free(header);
+
+    /* Patch start header: NextHeaderOffset, NextHeaderSize, NextHeaderCRC */
     unsigned char start_header[20];
     memcpy(start_header, &next_header_offset, 8);
     memcpy(start_header + 8, &next_header_size, 8);
     memcpy(start_header + 16, &next_header_crc, 4);
-    start_header_crc = CrcCalc(start_header, 20);
-    
-    fseek(archive, start_header_pos, SEEK_SET);
-    fwrite(&start_header_crc, 4, 1, archive);
-    
-    free(header);
-    fclose(archive);
-    
+    uint32_t start_header_crc = CrcCalc(start_header, 20);
+
+    if (fseek(archive, 8, SEEK_SET) != 0 ||
+        fwrite(&start_header_crc, 4, 1, archive) != 1 ||
+        fwrite(start_header, 1, 20, archive) != 20) {
+        return SEVENZIP_ERROR_COMPRESS;
+    }
+
     return SEVENZIP_OK;
 }
 
@@ -781,100 +890,158 @@ static SevenZipErrorCode write_7z_archive(
 
 /**
  * Create a 7z archive using true streaming compression
- * 
+ *
  * This function processes files in chunks without loading everything into RAM.
  * Memory usage is bounded to approximately 250MB regardless of archive size.
- * 
+ *
  * @param archive_path Output archive path
- * @param input_paths NULL-terminated array of input file/directory paths
+ * @param source Entries to archive
  * @param level Compression level
  * @param options Streaming options (NULL for defaults)
  * @param progress_callback Byte-level progress callback (NULL to disable)
  * @param user_data User data for callback
  * @return SEVENZIP_OK on success
  */
-SevenZipErrorCode sevenzip_create_7z_true_streaming(
+static SevenZipErrorCode true_streaming_create(
     const char* archive_path,
-    const char** input_paths,
+    const SevenZipEntrySource* source,
     SevenZipCompressionLevel level,
     const SevenZipStreamOptions* options,
     SevenZipBytesProgressCallback progress_callback,
     void* user_data
 ) {
-    if (!archive_path || !input_paths) {
-        return SEVENZIP_ERROR_INVALID_PARAM;
-    }
-    
+    global_tables_init();
+
     fprintf(stderr, "[streaming] Starting true streaming archive creation: %s\n", archive_path);
-    
+
     /* Initialize builder */
     StreamingArchiveBuilder builder;
     builder_init(&builder);
-    builder.progress_callback = progress_callback;
-    builder.user_data = user_data;
-    
+    builder.use_copy_codec = (level == SEVENZIP_LEVEL_STORE);
+    builder.source = source;
+
     /* Configure options */
     int num_threads = options ? options->num_threads : 2;
+    uint64_t dict_size = options ? options->dict_size : 0;
+    builder.cancel = options ? options->cancel : NULL;
+    builder.rate_limit = options ? options->rate_limit : NULL;
+    builder.block_size = options ? options->block_size : 0;
+    builder.deterministic = options ? options->deterministic : 0;
+    if (options && options->fixed_mtime != 0) {
+        builder.fixed_mtime = unix_to_filetime((time_t)options->fixed_mtime);
+    }
+    builder.lzma_params = options ? options->lzma_params : NULL;
+    builder.numa_policy = options ? options->numa_policy : SEVENZIP_NUMA_OFF;
     if (options && options->chunk_size > 0) {
         builder.chunk_size = (size_t)options->chunk_size;
     }
-    
-    /* Phase 1: Scan all inputs and gather metadata */
-    fprintf(stderr, "[streaming] Phase 1: Scanning input paths...\n");
-    
-    for (int i = 0; input_paths[i] != NULL; i++) {
-        const char* path = input_paths[i];
-        
-        /* Get basename for relative path */
-        const char* basename = strrchr(path, '/');
-        if (!basename) basename = strrchr(path, '\\');
-        if (basename) basename++; else basename = path;
-        
-        SevenZipErrorCode err = scan_file(&builder, path, basename);
-        if (err != SEVENZIP_OK) {
+    if (options && options->password && options->password[0]) {
+        SevenZipErrorCode key_err = sevenzip_aes_derive_key(options->password, builder.aes_key);
+        if (key_err != SEVENZIP_OK) {
             builder_free(&builder);
-            return err;
+            return key_err;
         }
+        builder.encrypt = 1;
     }
-    
-    fprintf(stderr, "[streaming] Found %zu files, %.2f GB total\n", 
-            builder.file_count, builder.total_uncompressed / (1024.0 * 1024.0 * 1024.0));
-    
-    /* Phase 2: Create temporary file and compress */
-    fprintf(stderr, "[streaming] Phase 2: Compressing files...\n");
-    
-    char temp_path[MAX_PATH_LENGTH];
-    const char* temp_dir = options && options->temp_dir ? options->temp_dir : "/tmp";
-    snprintf(temp_path, sizeof(temp_path), "%s/7z_stream_%d.tmp", temp_dir, (int)time(NULL));
-    
-    FILE* temp_file = fopen(temp_path, "w+b");
-    if (!temp_file) {
-        fprintf(stderr, "[streaming] Failed to create temp file: %s\n", temp_path);
+
+    /* Entries and their sizes are learnt as phase 1 reaches them */
+    op_stats_begin(&builder.stats);
+    builder.stats.keep_folders = options ? options->folder_stats : 0;
+
+    progress_reporter_start(&builder.progress, progress_callback, NULL, user_data,
+                            builder.total_uncompressed,
+                            options ? options->progress_interval_ms : 0,
+                            options ? options->progress_interval_bytes : 0);
+
+    FILE* archive = fopen(archive_path, "wb");
+    if (!archive) {
+        progress_reporter_stop(&builder.progress);
+        op_stats_finish(&builder.stats);
         builder_free(&builder);
         return SEVENZIP_ERROR_OPEN_FILE;
     }
-    
-    SevenZipErrorCode err = compress_files_streaming(&builder, temp_file, level, num_threads);
-    if (err != SEVENZIP_OK) {
-        fclose(temp_file);
-        remove(temp_path);
-        builder_free(&builder);
-        return err;
+
+    /* Use 4MB write buffer for optimal I/O performance */
+    setvbuf(archive, NULL, _IOFBF, 4 * 1024 * 1024);
+
+    /* Signature header; start header fields are patched in phase 2 */
+    unsigned char signature_header[32];
+    memset(signature_header, 0, sizeof(signature_header));
+    memcpy(signature_header, k7zSignature, 6);
+    signature_header[6] = k7zMajorVersion;
+    signature_header[7] = k7zMinorVersion;
+
+    SevenZipErrorCode err = SEVENZIP_OK;
+    OpStatsTimer timer;
+    op_stats_io_begin(&builder.stats, &timer);
+    size_t written = fwrite(signature_header, 1, sizeof(signature_header), archive);
+    op_stats_io_end(&builder.stats, &timer, SEVENZIP_PHASE_WRITE, written);
+    if (written != sizeof(signature_header)) {
+        err = SEVENZIP_ERROR_COMPRESS;
     }
-    
-    /* Phase 3: Write final archive */
-    fprintf(stderr, "[streaming] Phase 3: Writing archive...\n");
-    
-    err = write_7z_archive(&builder, archive_path, temp_file, builder.packed_size);
-    
-    /* Cleanup */
-    fclose(temp_file);
-    remove(temp_path);
-    builder_free(&builder);
-    
+
+    /* Phase 1: Compress directly into the archive */
     if (err == SEVENZIP_OK) {
+        fprintf(stderr, "[streaming] Phase 1: Compressing entries...\n");
+        op_stats_phase_begin(&builder.stats, SEVENZIP_PHASE_COMPRESS);
+        ThreadLease lease;
+        int threads = thread_lease_acquire(&lease, num_threads, options ? options->thread_weight : 0);
+        err = compress_files_streaming(&builder, archive, level, threads, dict_size);
+        thread_lease_release(&lease);
+    }
+
+    /* Phase 2: Write headers */
+    if (err == SEVENZIP_OK) {
+        op_stats_add_folder(&builder.stats, 0, builder.total_uncompressed, builder.packed_size,
+                            &builder.encode);
+        fprintf(stderr, "[streaming] Phase 2: Writing archive header...\n");
+        op_stats_phase_begin(&builder.stats, SEVENZIP_PHASE_HEADER);
+        err = write_7z_header(&builder, archive);
+    }
+
+    /* Buffered header bytes reach the file here */
+    if (fclose(archive) != 0 && err == SEVENZIP_OK) {
+        err = SEVENZIP_ERROR_COMPRESS;
+    }
+    progress_reporter_stop(&builder.progress);
+    op_stats_finish(&builder.stats);
+    /* PROGRESS from the encoder's own check surfaces as a compress error */
+    if (err != SEVENZIP_OK && cancel_token_requested(builder.cancel)) {
+        err = SEVENZIP_ERROR_CANCELLED;
+    }
+
+    if (err != SEVENZIP_OK) {
+        if (!options || options->delete_temp_on_error) {
+            remove(archive_path);
+        }
+    } else {
         fprintf(stderr, "[streaming] Archive created successfully: %s\n", archive_path);
     }
-    
+
+    builder_free(&builder);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_create_7z_from_source(
+    const char* archive_path,
+    const SevenZipEntrySource* source,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !source || !source->next_entry) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    MetricsOp op;
+    metrics_op_begin(&op, SEVENZIP_METRIC_CREATE);
+    SevenZipErrorCode err = true_streaming_create(archive_path, source, level, options,
+                                                  progress_callback, user_data);
+    SevenZipOpStats stats;
+    if (sevenzip_get_last_stats(&stats) == SEVENZIP_OK) {
+        op.bytes_in = stats.bytes_read;
+        op.bytes_out = stats.bytes_written;
+    }
+    metrics_op_end(&op, err);
     return err;
 }
@@ -0,0 +1,378 @@
+/**
+ * 7z to Tar Export
+ *
+ * Turns an archive into a POSIX tar stream in one pass: folders are
+ * decoded front to back (folder_stream.h) and each file's bytes go to
+ * the caller's write callback behind its tar header, straight from the
+ * decoder window. Memory is that of one folder decoder plus a header
+ * block and the longest name, whatever the archive's size.
+ *
+ * Headers are ustar. A name that does not fit the ustar name and prefix
+ * fields, a size of 8GB or more and a time before 1970 or past 2242 go
+ * into a pax extended header ('x') in front of the entry, as GNU and BSD
+ * tar read them.
+ */
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "7zCrc.h"
+#include "mem_alloc.h"
+#include "folder_stream.h"
+#include "mmap_stream.h"
+#include "volume_stream.h"
+#include "entry_writer.h"
+#include "utf_convert.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAR_BLOCK 512
+#define TAR_NAME_SIZE 100
+#define TAR_PREFIX_SIZE 155
+#define TAR_OCTAL_MAX ((UInt64)077777777777)  /* 11 octal digits: size and mtime */
+#define TAR_DEFAULT_LZMA2_THREADS 2
+
+/* FILETIME of 1970-01-01 UTC */
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+/* Attribute flag of archives that carry a Unix mode in the high 16 bits */
+#define ATTRIB_UNIX_EXTENSION 0x8000
+#define ATTRIB_WINDOWS_READONLY 0x1
+
+/* pax records besides the path's value: three of at most 64 bytes */
+#define PAX_OVERHEAD 192
+
+typedef struct {
+    FolderStreamSink vt;
+    const CSzArEx* db;
+    SevenZipWriteCallback write_callback;
+    void* user_data;
+    char* name;              /* Entry name, then the pax records after it */
+    size_t name_capacity;
+    UInt64 size;             /* Of the entry being written */
+    SevenZipErrorCode error_code;
+} TarSink;
+
+static int tar_write(TarSink* p, const void* data, size_t size) {
+    if (p->write_callback(data, size, p->user_data) != 0) {
+        p->error_code = SEVENZIP_ERROR_EXTRACT;
+        return 0;
+    }
+    return 1;
+}
+
+static int tar_reserve(TarSink* p, size_t size) {
+    if (size <= p->name_capacity) return 1;
+    size_t capacity = p->name_capacity ? p->name_capacity : 256;
+    while (capacity < size) capacity *= 2;
+    char* name = (char*)mem_alloc(SEVENZIP_MEM_NAMES, capacity);
+    if (!name) {
+        p->error_code = SEVENZIP_ERROR_MEMORY;
+        return 0;
+    }
+    mem_free(p->name);
+    p->name = name;
+    p->name_capacity = capacity;
+    return 1;
+}
+
+/* Right-aligned, zero-padded octal in a field of `width` (the last byte NUL) */
+static void tar_octal(char* field, size_t width, UInt64 value) {
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i-- > 0;) {
+        field[i] = (char)('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+/* Append one pax record at `out`; returns its length */
+static size_t pax_record(char* out, const char* key, const char* value, size_t value_len) {
+    size_t body = 1 + strlen(key) + 1 + value_len + 1;  /* " key=value\n" */
+    size_t len = body + 1;
+    while (len != body + (size_t)snprintf(NULL, 0, "%zu", len)) {
+        len = body + (size_t)snprintf(NULL, 0, "%zu", len);
+    }
+    int n = sprintf(out, "%zu %s=", len, key);
+    memcpy(out + n, value, value_len);
+    out[n + value_len] = '\n';
+    return len;
+}
+
+/*
+ * Split `name` into the ustar prefix and name fields at a '/', the prefix
+ * as long as it may be; 0 if no split fits
+ */
+static int ustar_split(const char* name, size_t len, size_t* prefix_len) {
+    if (len <= TAR_NAME_SIZE) {
+        *prefix_len = 0;
+        return 1;
+    }
+    size_t limit = len - 1 < TAR_PREFIX_SIZE ? len - 1 : TAR_PREFIX_SIZE;
+    for (size_t i = limit + 1; i-- > 0;) {
+        if (name[i] == '/' && len - i - 1 <= TAR_NAME_SIZE && len - i - 1 > 0) {
+            *prefix_len = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void tar_checksum(Byte* block) {
+    memset(block + 148, ' ', 8);
+    UInt32 sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) sum += block[i];
+    tar_octal((char*)block + 148, 7, sum);
+    block[155] = ' ';
+}
+
+/* A ustar header block with everything but name and checksum filled in */
+static void tar_header(Byte* block, char type, UInt32 mode, UInt64 size, UInt64 mtime) {
+    memset(block, 0, TAR_BLOCK);
+    tar_octal((char*)block + 100, 8, mode);
+    tar_octal((char*)block + 108, 8, 0);
+    tar_octal((char*)block + 116, 8, 0);
+    tar_octal((char*)block + 124, 12, size <= TAR_OCTAL_MAX ? size : 0);
+    tar_octal((char*)block + 136, 12, mtime <= TAR_OCTAL_MAX ? mtime : 0);
+    block[156] = (Byte)type;
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+}
+
+/* Name field of a header: the name, cut to fit when pax carries the whole */
+static void tar_set_name(Byte* block, const char* name, size_t len) {
+    size_t prefix_len = 0;
+    if (ustar_split(name, len, &prefix_len) && prefix_len) {
+        memcpy(block + 345, name, prefix_len);
+        memcpy(block, name + prefix_len + 1, len - prefix_len - 1);
+    } else {
+        memcpy(block, name, len < TAR_NAME_SIZE ? len : TAR_NAME_SIZE);
+    }
+}
+
+static UInt32 entry_mode(const EntryMeta* meta, int is_dir) {
+    if (meta->has_attrib && (meta->attrib & ATTRIB_UNIX_EXTENSION) && (meta->attrib >> 16) != 0) {
+        return (meta->attrib >> 16) & 07777;
+    }
+    UInt32 mode = is_dir ? 0755 : 0644;
+    if (meta->has_attrib && (meta->attrib & ATTRIB_WINDOWS_READONLY)) mode &= ~0222u;
+    return mode;
+}
+
+/* Seconds since 1970 of the entry's time; 0 (and pax unneeded) when not stored */
+static Int64 entry_mtime(const EntryMeta* meta) {
+    if (!meta->has_mtime) return 0;
+    Int64 ticks = (Int64)(meta->mtime - FILETIME_UNIX_EPOCH);
+    Int64 sec = ticks / 10000000;
+    if (ticks % 10000000 < 0) sec--;
+    return sec;
+}
+
+/* Header block, and pax header before it when ustar cannot hold the entry */
+static int tar_begin_entry(TarSink* p, UInt32 index, int is_dir, UInt64 size) {
+    size_t units = SzArEx_GetFileNameUtf16(p->db, index, NULL);
+    const Byte* utf16 = p->db->FileNames + p->db->FileNameOffsets[index] * 2;
+    size_t name_max = (units ? utf16le_to_utf8_size(utf16, units) : 0) + 8;
+    /* The name, then the pax records padded to a block */
+    if (!tar_reserve(p, 2 * name_max + PAX_OVERHEAD + TAR_BLOCK)) return 0;
+
+    size_t len = units > 1
+        ? utf16le_to_utf8(utf16, units, p->name) - 1 : 0;
+    if (len == 0) {
+        memcpy(p->name, "data", 5);
+        len = 4;
+    }
+    /* Archives written on Windows separate with '\\' */
+    for (size_t i = 0; i < len; i++) {
+        if (p->name[i] == '\\') p->name[i] = '/';
+    }
+    /* Names stay relative, as tar writes them */
+    size_t skip = 0;
+    while (skip + 1 < len && p->name[skip] == '/') skip++;
+    char* name = p->name + skip;
+    len -= skip;
+    if (is_dir && name[len - 1] != '/') name[len++] = '/';
+    name[len] = '\0';
+
+    EntryMeta meta;
+    entry_meta_get(p->db, index, &meta);
+    Int64 mtime = entry_mtime(&meta);
+
+    Byte block[TAR_BLOCK];
+    size_t prefix_len;
+    char* pax = name + len + 1;
+    size_t pax_len = 0;
+    if (!ustar_split(name, len, &prefix_len)) {
+        pax_len += pax_record(pax + pax_len, "path", name, len);
+    }
+    if (size > TAR_OCTAL_MAX) {
+        char value[24];
+        int n = snprintf(value, sizeof(value), "%llu", (unsigned long long)size);
+        pax_len += pax_record(pax + pax_len, "size", value, (size_t)n);
+    }
+    if (mtime < 0 || (UInt64)mtime > TAR_OCTAL_MAX) {
+        char value[24];
+        int n = snprintf(value, sizeof(value), "%lld", (long long)mtime);
+        pax_len += pax_record(pax + pax_len, "mtime", value, (size_t)n);
+    }
+    if (pax_len) {
+        tar_header(block, 'x', 0644, pax_len, mtime < 0 ? 0 : (UInt64)mtime);
+        memcpy(block, "PaxHeader", 9);
+        tar_checksum(block);
+        size_t padded = (pax_len + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        memset(pax + pax_len, 0, padded - pax_len);
+        if (!tar_write(p, block, TAR_BLOCK) || !tar_write(p, pax, padded)) return 0;
+    }
+
+    tar_header(block, is_dir ? '5' : '0', entry_mode(&meta, is_dir), size,
+               mtime < 0 ? 0 : (UInt64)mtime);
+    tar_set_name(block, name, len);
+    tar_checksum(block);
+    return tar_write(p, block, TAR_BLOCK);
+}
+
+static SRes TarSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    TarSink* p = Z7_CONTAINER_FROM_VTBL(pp, TarSink, vt);
+    p->size = SzArEx_GetFileSize(p->db, file_index);
+    return tar_begin_entry(p, file_index, 0, p->size) ? SZ_OK : SZ_ERROR_PROGRESS;
+}
+
+static SRes TarSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    TarSink* p = Z7_CONTAINER_FROM_VTBL(pp, TarSink, vt);
+    if (size == 0) return SZ_OK;
+    return tar_write(p, data, size) ? SZ_OK : SZ_ERROR_PROGRESS;
+}
+
+/* Zeros up to the next block */
+static SRes TarSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    TarSink* p = Z7_CONTAINER_FROM_VTBL(pp, TarSink, vt);
+    static const Byte zeros[TAR_BLOCK];
+    (void)file_index;
+    size_t pad = (size_t)((TAR_BLOCK - p->size % TAR_BLOCK) % TAR_BLOCK);
+    if (pad == 0) return SZ_OK;
+    return tar_write(p, zeros, pad) ? SZ_OK : SZ_ERROR_PROGRESS;
+}
+
+static SevenZipErrorCode export_tar(
+    VolumeSet* volumes,
+    const char* password,
+    int lzma2_threads,
+    uint64_t max_memory,
+    SevenZipWriteCallback write_callback,
+    void* user_data
+) {
+    ISzAlloc alloc_imp = g_MemDecoderAlloc;
+    ISzAlloc alloc_header = g_MemHeaderAlloc;
+
+    /* Mapped volumes, else a look buffer over them */
+    MmapInStream mapped;
+    VolumeInStream in_stream;
+    CLookToRead2 look_stream;
+    ILookInStreamPtr stream;
+    memset(&mapped, 0, sizeof(mapped));
+    look_stream.buf = NULL;
+    if (!volumes->parity && mmap_in_stream_open_files(&mapped, volumes->files, volumes->sizes, volumes->count)) {
+        mapped.readahead = volumes->readahead;
+        stream = &mapped.vt;
+    } else {
+        volume_in_stream_init(&in_stream, volumes);
+        LookToRead2_CreateVTable(&look_stream, False);
+        look_stream.buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, (1 << 18));
+        if (!look_stream.buf) return SEVENZIP_ERROR_MEMORY;
+        look_stream.bufSize = (1 << 18);
+        look_stream.realStream = &in_stream.vt;
+        LookToRead2_INIT(&look_stream);
+        stream = &look_stream.vt;
+    }
+
+    CSzArEx db;
+    SzArEx_Init(&db);
+    SRes res = SzArEx_Open(&db, stream, &alloc_header, &alloc_header);
+    SevenZipErrorCode error_code = SEVENZIP_OK;
+    if (res != SZ_OK) {
+        error_code = res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+
+    /* One folder at a time, so the files come out in archive order */
+    int num_workers = 1;
+    if (error_code == SEVENZIP_OK &&
+        folder_stream_fit_memory(&db, NULL, max_memory, &num_workers, &lzma2_threads, NULL) != SZ_OK) {
+        error_code = SEVENZIP_ERROR_MEMORY;
+    }
+
+    TarSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.vt.Begin = TarSink_Begin;
+    sink.vt.Write = TarSink_Write;
+    sink.vt.End = TarSink_End;
+    sink.vt.WriteStored = NULL;
+    sink.db = &db;
+    sink.write_callback = write_callback;
+    sink.user_data = user_data;
+    sink.error_code = SEVENZIP_OK;
+
+    /* Directories, then empty files: nothing to decode for them */
+    for (int pass = 0; pass < 2 && error_code == SEVENZIP_OK; pass++) {
+        for (UInt32 i = 0; i < db.NumFiles && error_code == SEVENZIP_OK; i++) {
+            int is_dir = SzArEx_IsDir(&db, i);
+            if (pass == 0 ? !is_dir : is_dir || db.FileToFolder[i] != (UInt32)-1) continue;
+            if (!tar_begin_entry(&sink, i, is_dir, 0)) error_code = sink.error_code;
+        }
+    }
+
+    if (error_code == SEVENZIP_OK) {
+        FolderStreamWorker worker;
+        worker.stream = stream;
+        worker.sink = &sink.vt;
+        res = folder_stream_decode_folders(&db, &worker, 1, NULL, lzma2_threads,
+                                           SEVENZIP_VERIFY_FILE, password, &alloc_imp, NULL);
+        if (res != SZ_OK) {
+            error_code = sink.error_code != SEVENZIP_OK ? sink.error_code
+                       : res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+        }
+    }
+
+    /* End of archive: two zero blocks */
+    if (error_code == SEVENZIP_OK) {
+        static const Byte zeros[2 * TAR_BLOCK];
+        if (!tar_write(&sink, zeros, sizeof(zeros))) error_code = sink.error_code;
+    }
+
+    mem_free(sink.name);
+    SzArEx_Free(&db, &alloc_header);
+    ISzAlloc_Free(&g_MemIoAlloc, look_stream.buf);
+    mmap_in_stream_close(&mapped);
+    return error_code;
+}
+
+SevenZipErrorCode sevenzip_export_tar(
+    const char* archive_path,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipWriteCallback write_callback,
+    void* user_data
+) {
+    if (!archive_path || !write_callback) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    global_tables_init();
+
+    int lzma2_threads = options ? options->num_threads : 0;
+    if (lzma2_threads <= 0) lzma2_threads = thread_auto_count(TAR_DEFAULT_LZMA2_THREADS);
+    if (lzma2_threads > FOLDER_STREAM_MAX_WORKERS) lzma2_threads = FOLDER_STREAM_MAX_WORKERS;
+
+    VolumeSet volumes;
+    if (!volume_set_open(&volumes, archive_path, 0)) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    ThreadLease lease;
+    lzma2_threads = thread_lease_acquire(&lease, lzma2_threads, options ? options->thread_weight : 0);
+    SevenZipErrorCode err = export_tar(&volumes, password, lzma2_threads,
+                                       options ? options->max_memory : 0, write_callback, user_data);
+    thread_lease_release(&lease);
+    volume_set_close(&volumes);
+    return err;
+}
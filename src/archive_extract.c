@@ -1,257 +1,1162 @@
+/* copy_file_range() is only declared by glibc's <unistd.h> with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
 #include "7z_ffi.h"
 #include "7z.h"
-#include "7zAlloc.h"
 #include "7zBuf.h"
 #include "7zCrc.h"
 #include "7zFile.h"
 #include "7zVersion.h"
+#include "mem_alloc.h"
+#include "folder_stream.h"
+#include "mmap_stream.h"
+#include "volume_stream.h"
+#include "entry_writer.h"
+#include "dir_cache.h"
+#include "sparse_output.h"
+#include "write_hints.h"
+#include "stream_layout.h"
+#include "volume_follow.h"
+#include "name_filter.h"
+#include "archive_handle.h"
+#include "utf_convert.h"
+#include "progress_reporter.h"
+#include "cancel_token.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+#include "metrics.h"
+#include "Threads.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/stat.h>
-#include <errno.h>
+#include <stddef.h>
 
 #ifdef _WIN32
     #include <windows.h>
-    #include <direct.h>
-    #define MKDIR(path) _mkdir(path)
     #define PATH_SEPARATOR '\\'
 #else
     #include <sys/types.h>
     #include <unistd.h>
-    #define MKDIR(path) mkdir(path, 0755)
+    #include <fcntl.h>
+    #include <errno.h>
     #define PATH_SEPARATOR '/'
 #endif
 
-/* Create directory recursively */
-static int create_directory_recursive(const char* path) {
-    char* tmp = strdup(path);
-    if (!tmp) return -1;
+/* Stored files are copied inside the kernel, as reflinks where the filesystem can */
+#if defined(__linux__) && defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    #define HAVE_COPY_FILE_RANGE 1
+#endif
+
+/* Read size when comparing existing output with its entry's CRC */
+#define EXISTING_CRC_BUF_SIZE (1 << 18)
+
+/*
+ * Name and path conversion buffer of one extraction worker, grown to the
+ * longest path seen and reused across entries, so that once it has grown
+ * naming an entry allocates nothing
+ */
+typedef struct {
+    char* name;
+    size_t capacity;  /* In bytes, terminator included */
+} NameScratch;
+
+static void name_scratch_free(NameScratch* s) {
+    mem_free(s->name);
+    s->name = NULL;
+    s->capacity = 0;
+}
+
+static int name_scratch_reserve(NameScratch* s, size_t size) {
+    if (size <= s->capacity) return 1;
+    size_t capacity = s->capacity ? s->capacity : 256;
+    while (capacity < size) capacity *= 2;
+    char* buf = (char*)mem_realloc(SEVENZIP_MEM_NAMES, s->name, capacity);
+    if (!buf) return 0;
+    s->name = buf;
+    s->capacity = capacity;
+    return 1;
+}
+
+/*
+ * Name of an entry in the scratch buffer after `prefix` bytes the caller
+ * put there, or NULL in *name for entries without a name. Valid until the
+ * next call on the same scratch.
+ */
+static SevenZipErrorCode entry_name_after(NameScratch* s, size_t prefix, const CSzArEx* db,
+                                          UInt32 index, char** name) {
+    *name = NULL;
+    size_t len = SzArEx_GetFileNameUtf16(db, index, NULL);
+    if (len <= 1) return SEVENZIP_OK;
     
-    size_t len = strlen(tmp);
-    if (len == 0) {
-        free(tmp);
-        return -1;
+    const Byte* utf16 = db->FileNames + db->FileNameOffsets[index] * 2;
+    size_t size = utf16le_to_utf8_size(utf16, len);
+    if (!name_scratch_reserve(s, prefix + size)) return SEVENZIP_ERROR_MEMORY;
+    utf16le_to_utf8(utf16, len, s->name + prefix);
+    *name = s->name;
+    return SEVENZIP_OK;
+}
+
+static SevenZipErrorCode entry_name(NameScratch* s, const CSzArEx* db, UInt32 index,
+                                    const char** name) {
+    char* buf = NULL;
+    SevenZipErrorCode err = entry_name_after(s, 0, db, index, &buf);
+    *name = buf;
+    return err;
+}
+
+/*
+ * Output path of an entry in the scratch buffer, or NULL in *path for
+ * entries without a name, which are skipped. Valid until the next call on
+ * the same scratch; callers handing the path on copy it.
+ */
+static SevenZipErrorCode get_output_path(const CSzArEx* db, UInt32 index,
+                                         const char* output_dir, NameScratch* scratch,
+                                         char** path) {
+    size_t dir_len = strlen(output_dir);
+    if (!name_scratch_reserve(scratch, dir_len + 1)) return SEVENZIP_ERROR_MEMORY;
+    memcpy(scratch->name, output_dir, dir_len);
+    scratch->name[dir_len] = PATH_SEPARATOR;
+    return entry_name_after(scratch, dir_len + 1, db, index, path);
+}
+
+/*
+ * Requested names as an open-addressing hash set, so selecting entries
+ * costs one lookup per entry whatever the length of the list
+ */
+typedef struct {
+    const char** slots;  /* Caller's strings; NULL slots are free */
+    Byte* matched;       /* Per slot: some entry had this name */
+    size_t mask;
+} NameSet;
+
+/* FNV-1a */
+static UInt32 name_hash(const char* s) {
+    UInt32 h = 2166136261u;
+    while (*s) {
+        h ^= (Byte)*s++;
+        h *= 16777619u;
     }
+    return h;
+}
+
+static int name_set_init(NameSet* set, const char** names) {
+    size_t count = 0;
+    while (names[count]) count++;
+    size_t size = 16;
+    while (size < count * 2) size *= 2;
     
-    if (tmp[len - 1] == PATH_SEPARATOR) {
-        tmp[len - 1] = 0;
+    set->slots = (const char**)mem_calloc(SEVENZIP_MEM_OTHER, size, sizeof(const char*));
+    set->matched = (Byte*)mem_calloc(SEVENZIP_MEM_OTHER, size, 1);
+    set->mask = size - 1;
+    if (!set->slots || !set->matched) {
+        mem_free(set->slots);
+        mem_free(set->matched);
+        return 0;
     }
-    
-    for (char* p = tmp + 1; *p; p++) {
-        if (*p == PATH_SEPARATOR) {
-            *p = 0;
-            
-            #ifdef _WIN32
-            if (strlen(tmp) == 2 && tmp[1] == ':') {
-                *p = PATH_SEPARATOR;
-                continue;
-            }
-            #endif
-            
-            struct stat st;
-            if (stat(tmp, &st) != 0) {
-                if (MKDIR(tmp) != 0 && errno != EEXIST) {
-                    free(tmp);
-                    return -1;
-                }
-            }
-            
-            *p = PATH_SEPARATOR;
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = name_hash(names[i]) & set->mask;
+        while (set->slots[slot] && strcmp(set->slots[slot], names[i]) != 0) {
+            slot = (slot + 1) & set->mask;
         }
+        set->slots[slot] = names[i];  /* Duplicates land on their first copy */
+    }
+    return 1;
+}
+
+/* Slot holding `name`, or -1 */
+static ptrdiff_t name_set_find(const NameSet* set, const char* name) {
+    size_t slot = name_hash(name) & set->mask;
+    while (set->slots[slot]) {
+        if (strcmp(set->slots[slot], name) == 0) return (ptrdiff_t)slot;
+        slot = (slot + 1) & set->mask;
+    }
+    return -1;
+}
+
+static void name_set_free(NameSet* set) {
+    mem_free(set->slots);
+    mem_free(set->matched);
+}
+
+/*
+ * Mark the entries named in `files` (exact names, as listed; NULL for
+ * all) that `filter` (NULL for none) also wants, in one pass over the
+ * names. Sets *missing when some requested name matched no entry.
+ */
+static SevenZipErrorCode select_entries(const CSzArEx* db, const char** files, NameFilter* filter,
+                                        Byte* selected, int* missing) {
+    NameSet set;
+    memset(&set, 0, sizeof(set));
+    if (files && !name_set_init(&set, files)) return SEVENZIP_ERROR_MEMORY;
+    
+    NameScratch scratch = {0};
+    SevenZipErrorCode err = SEVENZIP_OK;
+    for (UInt32 i = 0; i < db->NumFiles; i++) {
+        const char* name = NULL;
+        err = entry_name(&scratch, db, i, &name);
+        if (err != SEVENZIP_OK) break;
+        if (!name) continue;
+        ptrdiff_t slot = files ? name_set_find(&set, name) : 0;
+        if (slot < 0) continue;
+        if (files) set.matched[slot] = 1;
+        if (!filter || name_filter_match(filter, name)) selected[i] = 1;
+    }
+    
+    *missing = 0;
+    for (size_t slot = 0; files && slot <= set.mask; slot++) {
+        if (set.slots[slot] && !set.matched[slot]) *missing = 1;
     }
+    name_scratch_free(&scratch);
+    if (files) name_set_free(&set);
+    return err;
+}
+
+/* Whether the file at `path` holds `size` bytes with CRC `crc` */
+static int file_crc_matches(const char* path, UInt64 size, UInt32 crc) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    Byte* buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, EXISTING_CRC_BUF_SIZE);
+    UInt32 sum = CRC_INIT_VAL;
+    UInt64 total = 0;
+    size_t n = 0;
+    while (buf && (n = fread(buf, 1, EXISTING_CRC_BUF_SIZE, f)) > 0) {
+        sum = CrcUpdate(sum, buf, n);
+        total += n;
+    }
+    int ok = buf && !ferror(f) && total == size && CRC_GET_DIGEST(sum) == crc;
+    mem_free(buf);
+    fclose(f);
+    return ok;
+}
+
+/* Whether entry `i` was extracted to output_dir before, as `existing` judges it */
+static SevenZipErrorCode entry_already_extracted(const CSzArEx* db, UInt32 i,
+                                                const char* output_dir,
+                                                SevenZipExistingPolicy existing,
+                                                NameScratch* scratch, int* same) {
+    *same = 0;
+    char* path = NULL;
+    SevenZipErrorCode err = get_output_path(db, i, output_dir, scratch, &path);
+    if (err != SEVENZIP_OK || !path) return err;
+    
+    EntryMeta meta;
+    entry_meta_get(db, i, &meta);
+    UInt64 size = SzArEx_GetFileSize(db, i);
+    *same = entry_meta_matches(path, size, &meta);
+    if (*same && existing == SEVENZIP_EXISTING_SKIP_SAME_CRC) {
+        *same = SzBitWithVals_Check(&db->CRCs, i) &&
+                file_crc_matches(path, size, db->CRCs.Vals[i]);
+    }
+    return SEVENZIP_OK;
+}
+
+/* What an extraction writes: every entry, or a selection by name or pattern */
+typedef struct {
+    Byte* selected;             /* Per entry; NULL when all are wanted */
+    FolderStreamRange* ranges;  /* Per folder; NULL to decode all folders whole */
+    UInt32 total_files;         /* Entries to write */
+    UInt32 num_folders;         /* Folders with something to decode */
+    int missing;                /* Some requested name matched no entry */
+} ExtractPlan;
+
+/*
+ * Per folder, the span from the first to the last selected file: folders
+ * are decoded only across that span, and not at all when nothing in them
+ * is selected. Files already extracted, when `existing` skips them, are
+ * not selected; inside a span they are decoded and dropped.
+ */
+static SevenZipErrorCode extract_plan_init(ExtractPlan* plan, const CSzArEx* db,
+                                           const char** files, NameFilter* filter,
+                                           const char* output_dir, SevenZipExistingPolicy existing) {
+    memset(plan, 0, sizeof(*plan));
+    plan->total_files = db->NumFiles;
+    plan->num_folders = db->db.NumFolders;
+    if (!files && !filter && existing == SEVENZIP_EXISTING_OVERWRITE) return SEVENZIP_OK;
     
-    struct stat st;
-    if (stat(tmp, &st) != 0) {
-        if (MKDIR(tmp) != 0 && errno != EEXIST) {
-            free(tmp);
-            return -1;
+    plan->selected = (Byte*)mem_calloc(SEVENZIP_MEM_OTHER, db->NumFiles ? db->NumFiles : 1, 1);
+    plan->ranges = (FolderStreamRange*)mem_calloc(SEVENZIP_MEM_OTHER,
+                                                  db->db.NumFolders ? db->db.NumFolders : 1,
+                                                  sizeof(FolderStreamRange));
+    SevenZipErrorCode err = SEVENZIP_OK;
+    if (!plan->selected || !plan->ranges) {
+        err = SEVENZIP_ERROR_MEMORY;
+    } else if (files || filter) {
+        err = select_entries(db, files, filter, plan->selected, &plan->missing);
+    } else {
+        memset(plan->selected, 1, db->NumFiles);
+    }
+    if (err == SEVENZIP_OK && existing != SEVENZIP_EXISTING_OVERWRITE) {
+        NameScratch scratch = {0};
+        for (UInt32 i = 0; i < db->NumFiles && err == SEVENZIP_OK; i++) {
+            if (!plan->selected[i] || SzArEx_IsDir(db, i)) continue;
+            int same = 0;
+            err = entry_already_extracted(db, i, output_dir, existing, &scratch, &same);
+            if (same) plan->selected[i] = 0;
         }
+        name_scratch_free(&scratch);
+    }
+    if (err != SEVENZIP_OK) {
+        mem_free(plan->selected);
+        mem_free(plan->ranges);
+        return err;
     }
     
-    free(tmp);
-    return 0;
+    FolderStreamRange* ranges = plan->ranges;
+    plan->total_files = 0;
+    for (UInt32 i = 0; i < db->NumFiles; i++) {
+        if (!plan->selected[i]) continue;
+        plan->total_files++;
+        UInt32 folder_index = db->FileToFolder[i];
+        if (folder_index != (UInt32)-1 && !SzArEx_IsDir(db, i)) {
+            if (ranges[folder_index].limit == 0) ranges[folder_index].first = i;
+            ranges[folder_index].limit = i + 1;
+        }
+    }
+    plan->num_folders = 0;
+    for (UInt32 f = 0; f < db->db.NumFolders; f++) {
+        if (ranges[f].first < ranges[f].limit) plan->num_folders++;
+    }
+    return SEVENZIP_OK;
 }
 
-/* Build output path */
-static char* build_output_path(const char* output_dir, const char* filename) {
-    size_t dir_len = strlen(output_dir);
-    size_t file_len = strlen(filename);
-    size_t total_len = dir_len + file_len + 2; /* +2 for separator and null terminator */
+static void extract_plan_free(ExtractPlan* plan) {
+    mem_free(plan->selected);
+    mem_free(plan->ranges);
+}
+
+/* Where the files of a run go: how files are made durable, through the run's directories */
+typedef struct {
+    OutputDurability* durability;
+} OutputTarget;
+
+/* Create parent directories (through the run's DirCache) and open the file for writing */
+static FILE* open_output_file(void* target, char* output_path) {
+    OutputTarget* t = (OutputTarget*)target;
+    return output_durability_open(t->durability, output_path);
+}
+
+/*
+ * Writes each file of a folder as the folder decoder produces it. With a
+ * writer pool, small files are collected in `buffer` and handed to the
+ * pool once the folder decoder ended them (see FolderStreamSink.End for
+ * when their CRC is known); the rest is written here.
+ */
+typedef struct {
+    FolderStreamSink vt;
+    const CSzArEx* db;
+    const char* output_dir;
+    const Byte* selected;  /* NULL to write every file */
+    NameScratch scratch;
+    FILE* file;
+    int sparse;            /* Zero blocks of `file` are left as holes */
+    SparseOutput out;
+    int cache_neutral;     /* `file` leaves the page cache as it is written */
+    WriteHints hints;
+    EntryMeta meta;
+    OutputTarget* target;
+    EntryWriterPool* writers;  /* NULL to write every file here */
+    char* buffer_path;     /* Set while the current file is buffered */
+    Byte* buffer;
+    size_t buffer_size;
+    size_t buffered;
+    SevenZipErrorCode error_code;
+    ProgressReporter* progress;  /* Files done, shared by the workers */
+    const SevenZipCancelToken* cancel;
+    int archive_fd;        /* Source of range copies for stored files, -1 for none */
+} ExtractSink;
+
+static SRes ExtractSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    ExtractSink* p = Z7_CONTAINER_FROM_VTBL(pp, ExtractSink, vt);
+    if (cancel_token_requested(p->cancel)) {
+        p->error_code = SEVENZIP_ERROR_CANCELLED;
+        return SZ_ERROR_PROGRESS;
+    }
+    if (p->selected && !p->selected[file_index]) return SZ_OK;  /* Not requested */
+    char* output_path = NULL;
+    p->error_code = get_output_path(p->db, file_index, p->output_dir, &p->scratch, &output_path);
+    if (p->error_code != SEVENZIP_OK) return SZ_ERROR_MEM;
+    if (!output_path) return SZ_OK;  /* Decoded and checked, not written */
+    entry_meta_get(p->db, file_index, &p->meta);
     
-    char* path = (char*)malloc(total_len);
-    if (!path) return NULL;
+    UInt64 size = SzArEx_GetFileSize(p->db, file_index);
+    if (p->writers && size <= ENTRY_WRITER_MAX_BUFFERED) {
+        /* The pool owns what it is handed, so these outlive the scratch */
+        p->buffer = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, size > 0 ? (size_t)size : 1);
+        p->buffer_path = mem_strdup(SEVENZIP_MEM_NAMES, output_path);
+        if (!p->buffer || !p->buffer_path) {
+            mem_free(p->buffer);
+            mem_free(p->buffer_path);
+            p->buffer = NULL;
+            p->buffer_path = NULL;
+            p->error_code = SEVENZIP_ERROR_MEMORY;
+            return SZ_ERROR_MEM;
+        }
+        p->buffer_size = (size_t)size;
+        p->buffered = 0;
+        return SZ_OK;
+    }
     
-    snprintf(path, total_len, "%s%c%s", output_dir, PATH_SEPARATOR, filename);
-    return path;
+    p->file = open_output_file(p->target, output_path);
+    if (!p->file) {
+        p->error_code = SEVENZIP_ERROR_OPEN_FILE;
+        return SZ_ERROR_WRITE;
+    }
+    if (p->sparse) sparse_output_begin(&p->out, p->file);
+    else entry_preallocate(p->file, size);
+    write_hints_begin(&p->hints, p->file, p->cache_neutral);
+    return SZ_OK;
 }
 
-SevenZipErrorCode sevenzip_extract(
+static SRes ExtractSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    ExtractSink* p = Z7_CONTAINER_FROM_VTBL(pp, ExtractSink, vt);
+    if (cancel_token_requested(p->cancel)) {
+        p->error_code = SEVENZIP_ERROR_CANCELLED;
+        return SZ_ERROR_PROGRESS;
+    }
+    if (p->buffer_path) {
+        if (size > p->buffer_size - p->buffered) return SZ_ERROR_DATA;
+        memcpy(p->buffer + p->buffered, data, size);
+        p->buffered += size;
+        return SZ_OK;
+    }
+    if (!p->file) return SZ_OK;
+    int written = p->sparse ? sparse_output_write(&p->out, p->file, data, size)
+                            : fwrite(data, 1, size, p->file) == size;
+    if (!written) {
+        p->error_code = SEVENZIP_ERROR_EXTRACT;
+        return SZ_ERROR_WRITE;
+    }
+    write_hints_wrote(&p->hints, size);
+    return SZ_OK;
+}
+
+/*
+ * Bytes of a Copy folder: the kernel copies them from the archive to the
+ * file, without passing through here; the decoder CRC-sums the mapped
+ * view. Filesystems that cannot (different devices, no support) turn
+ * range copies off for the rest of the run.
+ */
+static SRes ExtractSink_WriteStored(FolderStreamSink* pp, UInt64 offset, const Byte* data,
+                                    size_t size) {
+    ExtractSink* p = Z7_CONTAINER_FROM_VTBL(pp, ExtractSink, vt);
+#ifdef HAVE_COPY_FILE_RANGE
+    if (p->file && !p->sparse && p->archive_fd >= 0 && !cancel_token_requested(p->cancel) &&
+        fflush(p->file) == 0) {
+        int out_fd = fileno(p->file);
+        loff_t in_off = (loff_t)offset;
+        loff_t out_off = lseek(out_fd, 0, SEEK_CUR);
+        size_t left = size;
+        while (left > 0 && out_off >= 0) {
+            ssize_t n = copy_file_range(p->archive_fd, &in_off, out_fd, &out_off, left, 0);
+            if (n <= 0) {
+                if (n < 0 && errno != EINTR) {
+                    close(p->archive_fd);
+                    p->archive_fd = -1;
+                }
+                if (n == 0 || p->archive_fd < 0) break;
+                continue;
+            }
+            left -= (size_t)n;
+        }
+        /* stdio goes on where the copy stopped */
+        if (out_off < 0 || fseeko(p->file, (off_t)out_off, SEEK_SET) != 0) {
+            p->error_code = SEVENZIP_ERROR_EXTRACT;
+            return SZ_ERROR_WRITE;
+        }
+        write_hints_wrote(&p->hints, size - left);
+        data += size - left;
+        size = left;
+        if (size == 0) return SZ_OK;
+    }
+#else
+    (void)offset;
+#endif
+    return ExtractSink_Write(pp, data, size);
+}
+
+static SRes ExtractSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    ExtractSink* p = Z7_CONTAINER_FROM_VTBL(pp, ExtractSink, vt);
+    (void)file_index;
+    if (p->buffer_path) {
+        /* The pool owns path and buffer from here on */
+        p->error_code = entry_writer_pool_submit(p->writers, p->buffer_path,
+                                                 p->buffer, p->buffered, &p->meta);
+        p->buffer_path = NULL;
+        p->buffer = NULL;
+        if (p->error_code != SEVENZIP_OK) return SZ_ERROR_WRITE;
+        progress_reporter_add(p->progress, 1);
+        return SZ_OK;
+    }
+    if (!p->file) return SZ_OK;
+    int failed = p->sparse && !sparse_output_end(&p->out, p->file);
+    write_hints_end(&p->hints, p->file);
+    if (entry_meta_apply(p->file, &p->meta) != 0) failed = 1;
+    if (output_durability_close(p->target->durability, p->file) != 0) failed = 1;
+    p->file = NULL;
+    if (failed) {
+        p->error_code = SEVENZIP_ERROR_EXTRACT;
+        return SZ_ERROR_WRITE;
+    }
+    progress_reporter_add(p->progress, 1);
+    return SZ_OK;
+}
+
+/* Reader and sink of one extraction worker */
+typedef struct {
+    MmapInStream mapped;
+    VolumeSet volumes;        /* Worker 0's, when the archive is not mapped */
+    VolumeInStream in_stream;
+    CLookToRead2 look_stream;
+    ILookInStreamPtr stream;  /* &mapped.vt, the buffered reader, or a borrowed one */
+    int borrowed;             /* stream is the caller's ForwardInStream */
+    ExtractSink sink;
+} ExtractWorker;
+
+/*
+ * Worker 0 maps the archive, else opens its volumes; later workers share
+ * the mapping, or read worker 0's volumes at a position of their own,
+ * so no worker opens the archive again
+ */
+static int extract_worker_open(ExtractWorker* w, const char* archive_path,
+                               ExtractWorker* first,
+                               ISzAllocPtr alloc, size_t buf_size) {
+    w->sink.archive_fd = -1;
+    if (first ? first->mapped.volumes != NULL : mmap_in_stream_open(&w->mapped, archive_path)) {
+        if (first) mmap_in_stream_share(&w->mapped, &first->mapped);
+        w->stream = &w->mapped.vt;
+        return 1;
+    }
+    if (!first && !volume_set_open(&w->volumes, archive_path, 0)) {
+        return 0;
+    }
+    volume_in_stream_init(&w->in_stream, first ? &first->volumes : &w->volumes);
+    LookToRead2_CreateVTable(&w->look_stream, False);
+    w->look_stream.buf = (Byte *)ISzAlloc_Alloc(alloc, buf_size);
+    if (!w->look_stream.buf) {
+        volume_set_close(&w->volumes);
+        return 0;
+    }
+    w->look_stream.bufSize = buf_size;
+    w->look_stream.realStream = &w->in_stream.vt;
+    LookToRead2_INIT(&w->look_stream);
+    w->stream = &w->look_stream.vt;
+    return 1;
+}
+
+static void extract_worker_close(ExtractWorker* w, ISzAllocPtr alloc) {
+    if (w->sink.file) {
+        fclose(w->sink.file);
+        w->sink.file = NULL;
+    }
+#ifdef HAVE_COPY_FILE_RANGE
+    if (w->sink.archive_fd >= 0) close(w->sink.archive_fd);
+#endif
+    w->sink.archive_fd = -1;
+    mem_free(w->sink.buffer_path);
+    mem_free(w->sink.buffer);
+    name_scratch_free(&w->sink.scratch);
+    if (w->borrowed) return;
+    if (w->stream == &w->mapped.vt) {
+        mmap_in_stream_close(&w->mapped);
+        return;
+    }
+    ISzAlloc_Free(alloc, w->look_stream.buf);
+    volume_set_close(&w->volumes);
+}
+
+/*
+ * Open the database of a streamable archive from the start header and
+ * the region at the front of `source`, which is left at the first pack
+ * stream
+ * @param end Output: offset one past the archive's last byte
+ */
+static SevenZipErrorCode extract_open_stream(ForwardInStream* source, CSzArEx* db,
+                                             ISzAllocPtr alloc_header, uint64_t* end) {
+    StreamHeaderView view;
+    SRes res = stream_header_view_read(&view, source);
+    if (res == SZ_OK) {
+        *end = stream_header_view_end(&view);
+        CLookToRead2 look;
+        LookToRead2_CreateVTable(&look, False);
+        look.buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, (size_t)1 << 16);
+        look.bufSize = (size_t)1 << 16;
+        look.realStream = &view.vt;
+        LookToRead2_INIT(&look);
+        res = look.buf ? SzArEx_Open(db, &look.vt, alloc_header, alloc_header) : SZ_ERROR_MEM;
+        ISzAlloc_Free(&g_MemIoAlloc, look.buf);
+        stream_header_view_free(&view);
+    }
+    switch (res) {
+        case SZ_OK: return SEVENZIP_OK;
+        case SZ_ERROR_MEM: return SEVENZIP_ERROR_MEMORY;
+        case SZ_ERROR_READ: return SEVENZIP_ERROR_EXTRACT;
+        default: return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+}
+
+/*
+ * Extract every entry, or only those named in `files` when not NULL and
+ * wanted by `filter` when not NULL;
+ * writer_threads = 0 writes every file on the decoding threads.
+ * Progress goes through a ProgressReporter, see progress_interval_ms.
+ * With a `source`, the archive is read from it front to back by one
+ * worker instead of from archive_path. `op` gets the bytes of a run
+ * that succeeds.
+ */
+static SevenZipErrorCode extract_archive_decode(
     const char* archive_path,
+    ForwardInStream* source,
     const char* output_dir,
+    const char** files,
+    NameFilter* filter,
     const char* password,
+    int num_threads,
+    int lzma2_threads,
+    int writer_threads,
+    int sparse_output,
+    int cache_neutral,
+    SevenZipDurability durability,
+    SevenZipVerifyMode verify,
+    SevenZipExistingPolicy existing,
+    uint64_t max_memory,
+    int progress_interval_ms,
+    const SevenZipCancelToken* cancel,
     SevenZipProgressCallback progress_callback,
-    void* user_data
+    void* user_data,
+    MetricsOp* op
 ) {
-    if (!archive_path || !output_dir) {
+    if ((!archive_path && !source) || !output_dir) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    /* Initialize CRC tables */
-    CrcGenerateTable();
+    global_tables_init();
     
-    /* Open archive file */
-    CFileInStream archive_stream;
-    CLookToRead2 look_stream;
+    /* Allocators */
+    ISzAlloc alloc_imp = g_MemDecoderAlloc;  /* Dictionaries may use huge pages */
+    ISzAlloc alloc_header = g_MemHeaderAlloc;  /* Database and header parse */
     const size_t kInputBufSize = ((size_t)1 << 18);
     
-    if (InFile_Open(&archive_stream.file, archive_path) != 0) {
-        return SEVENZIP_ERROR_OPEN_FILE;
-    }
-    
-    FileInStream_CreateVTable(&archive_stream);
-    
-    /* Allocators */
-    ISzAlloc alloc_imp = { SzAlloc, SzFree };
-    ISzAlloc alloc_temp = { SzAllocTemp, SzFreeTemp };
-    
-    /* Initialize look stream */
-    LookToRead2_CreateVTable(&look_stream, False);
-    look_stream.buf = (Byte *)ISzAlloc_Alloc(&alloc_imp, kInputBufSize);
-    if (!look_stream.buf) {
-        File_Close(&archive_stream.file);
+    /* Open archive file; worker 0 reads through the handle the header came from */
+    ExtractWorker* workers = (ExtractWorker*)calloc((size_t)num_threads, sizeof(ExtractWorker));
+    if (!workers) {
         return SEVENZIP_ERROR_MEMORY;
     }
-    look_stream.bufSize = kInputBufSize;
-    look_stream.realStream = &archive_stream.vt;
-    LookToRead2_INIT(&look_stream);
+    if (source) {
+        workers[0].stream = &source->vt;
+        workers[0].borrowed = 1;
+        workers[0].sink.archive_fd = -1;
+    } else if (!extract_worker_open(&workers[0], archive_path, NULL, &g_MemIoAlloc, kInputBufSize)) {
+        free(workers);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
     
     /* Initialize archive database */
     CSzArEx db;
     SzArEx_Init(&db);
     
     /* Open archive */
-    SRes res = SzArEx_Open(&db, &look_stream.vt, &alloc_imp, &alloc_temp);
-    if (res != SZ_OK) {
-        File_Close(&archive_stream.file);
-        SzArEx_Free(&db, &alloc_imp);
-        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    uint64_t source_end = 0;
+    SevenZipErrorCode open_error = SEVENZIP_OK;
+    SRes res = SZ_OK;
+    if (source) {
+        open_error = extract_open_stream(source, &db, &alloc_header, &source_end);
+    } else if ((res = SzArEx_Open(&db, workers[0].stream, &alloc_header, &alloc_header)) != SZ_OK) {
+        open_error = SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    if (open_error != SEVENZIP_OK) {
+        extract_worker_close(&workers[0], &g_MemIoAlloc);
+        SzArEx_Free(&db, &alloc_header);
+        free(workers);
+        return open_error;
     }
     
-    /* Create output directory */
-    if (create_directory_recursive(output_dir) != 0) {
-        File_Close(&archive_stream.file);
-        SzArEx_Free(&db, &alloc_imp);
-        return SEVENZIP_ERROR_OPEN_FILE;
+    /* Entries to write and the folder spans they need */
+    ExtractPlan plan;
+    SevenZipErrorCode plan_error = extract_plan_init(&plan, &db, files, filter, output_dir, existing);
+    if (plan_error != SEVENZIP_OK) {
+        extract_worker_close(&workers[0], &g_MemIoAlloc);
+        SzArEx_Free(&db, &alloc_header);
+        free(workers);
+        return plan_error;
+    }
+    const Byte* selected = plan.selected;
+    
+    /* A stream cannot go back to a dictionary reset inside a folder: each
+       folder is decoded from its start, and files before those wanted are
+       passed over by the sinks */
+    for (UInt32 f = 0; source && plan.ranges && f < db.db.NumFolders; f++) {
+        if (plan.ranges[f].first < plan.ranges[f].limit) {
+            plan.ranges[f].first = db.FolderToFile[f];
+        }
+    }
+    
+    /* One reader per worker, never more workers than folders to decode */
+    int requested_threads = num_threads;
+    if ((UInt32)num_threads > plan.num_folders) {
+        num_threads = plan.num_folders > 0 ? (int)plan.num_folders : 1;
+    }
+    int num_workers = 1;
+    while (!source && num_workers < num_threads &&
+           extract_worker_open(&workers[num_workers], archive_path, &workers[0],
+                               &g_MemIoAlloc, kInputBufSize)) {
+        num_workers++;
+    }
+    /* Threads the folder workers leave idle go to their LZMA2 decoders */
+    if (lzma2_threads <= 0) {
+        lzma2_threads = requested_threads / num_workers;
+        if (lzma2_threads < 1) lzma2_threads = 1;
     }
     
-    /* Extract all files */
-    UInt32 block_index = 0xFFFFFFFF;
-    Byte* out_buffer = NULL;
-    size_t out_buffer_size = 0;
+    /* Decoders held to max_memory before any of them allocates or a file is made */
+    SevenZipErrorCode setup_error = SEVENZIP_OK;
+    int fit_workers = num_workers;
+    if (folder_stream_fit_memory(&db, plan.ranges, max_memory, &fit_workers,
+                                 &lzma2_threads, NULL) != SZ_OK) {
+        setup_error = SEVENZIP_ERROR_MEMORY;
+    }
+    while (num_workers > fit_workers) {
+        extract_worker_close(&workers[--num_workers], &g_MemIoAlloc);
+    }
+    
+    /* Create output directory; directories made during the run are remembered */
+    DirCache dirs;
+    dir_cache_init(&dirs);
+    char* output_root = setup_error == SEVENZIP_OK ? mem_strdup(SEVENZIP_MEM_NAMES, output_dir) : NULL;
+    if (setup_error == SEVENZIP_OK && (!output_root || dir_cache_create(&dirs, output_root) != 0)) {
+        setup_error = SEVENZIP_ERROR_OPEN_FILE;
+    }
+    OutputDurability durable;
+    OutputTarget target = { &durable };
+    if (setup_error == SEVENZIP_OK) {
+        setup_error = output_durability_begin(&durable, durability, output_dir, &dirs);
+    }
+    mem_free(output_root);
+    if (setup_error != SEVENZIP_OK) {
+        dir_cache_free(&dirs);
+        extract_plan_free(&plan);
+        for (int w = 0; w < num_workers; w++) {
+            extract_worker_close(&workers[w], &g_MemIoAlloc);
+        }
+        SzArEx_Free(&db, &alloc_header);
+        free(workers);
+        return setup_error;
+    }
+    
+    ProgressReporter progress;
+    progress_reporter_start(&progress, NULL, progress_callback, user_data, plan.total_files,
+                            progress_interval_ms, 0);
+    
+    EntryWriterPool writer_pool;
+    EntryWriterPool* writers = entry_writer_pool_start(&writer_pool, writer_threads, sparse_output,
+                                                       cache_neutral, open_output_file, &target,
+                                                       &durable)
+        ? &writer_pool : NULL;
+    
+    FolderStreamWorker folder_workers[FOLDER_STREAM_MAX_WORKERS];
+    for (int w = 0; w < num_workers; w++) {
+        ExtractSink* sink = &workers[w].sink;
+        sink->vt.Begin = ExtractSink_Begin;
+        sink->vt.Write = ExtractSink_Write;
+        sink->vt.End = ExtractSink_End;
+        sink->vt.WriteStored = ExtractSink_WriteStored;
+        sink->db = &db;
+        sink->output_dir = output_dir;
+        sink->selected = selected;
+        sink->file = NULL;
+        sink->sparse = sparse_output;
+        sink->cache_neutral = cache_neutral;
+        sink->target = &target;
+        sink->writers = writers;
+        sink->error_code = SEVENZIP_OK;
+        sink->progress = &progress;
+        sink->cancel = cancel;
+#ifdef HAVE_COPY_FILE_RANGE
+        /* Offsets of a split archive's stored files span volumes */
+        sink->archive_fd = (source || workers[0].volumes.count > 1)
+            ? -1 : open(archive_path, O_RDONLY | O_CLOEXEC);
+#else
+        sink->archive_fd = -1;
+#endif
+        folder_workers[w].stream = workers[w].stream;
+        folder_workers[w].sink = &sink->vt;
+    }
     
+    /* Directories and empty files first, so folders only ever add files */
     SevenZipErrorCode error_code = SEVENZIP_OK;
+    NameScratch scratch = {0};
+    EntryMetaBatch dir_meta;
+    entry_meta_batch_init(&dir_meta);
     
     for (UInt32 i = 0; i < db.NumFiles; i++) {
-        size_t offset = 0;
-        size_t out_size_processed = 0;
+        if (db.FileToFolder[i] != (UInt32)-1 && !SzArEx_IsDir(&db, i)) {
+            continue;  /* Written with its folder */
+        }
+        if (selected && !selected[i]) continue;
+        if (cancel_token_requested(cancel)) {
+            error_code = SEVENZIP_ERROR_CANCELLED;
+            break;
+        }
         
-        /* Get file info */
-        size_t len = SzArEx_GetFileNameUtf16(&db, i, NULL);
-        if (len > 1) {
-            UInt16* temp = (UInt16*)malloc(len * sizeof(UInt16));
-            if (!temp) {
-                error_code = SEVENZIP_ERROR_MEMORY;
-                break;
-            }
-            
-            SzArEx_GetFileNameUtf16(&db, i, temp);
-            
-            /* Convert UTF-16 to UTF-8 (simplified) */
-            char* filename = (char*)malloc(len);
-            if (!filename) {
-                free(temp);
-                error_code = SEVENZIP_ERROR_MEMORY;
+        char* output_path = NULL;
+        error_code = get_output_path(&db, i, output_dir, &scratch, &output_path);
+        if (error_code != SEVENZIP_OK) break;
+        if (!output_path) continue;  /* Unnamed entry */
+        
+        if (SzArEx_IsDir(&db, i)) {
+            dir_cache_create(&dirs, output_path);
+            EntryMeta meta;
+            entry_meta_get(&db, i, &meta);
+            entry_meta_batch_add(&dir_meta, output_path, &meta);
+        } else if (writers) {
+            /* Empty file outside any folder */
+            EntryMeta meta;
+            entry_meta_get(&db, i, &meta);
+            char* owned = mem_strdup(SEVENZIP_MEM_NAMES, output_path);
+            error_code = owned ? entry_writer_pool_submit(writers, owned, NULL, 0, &meta)
+                               : SEVENZIP_ERROR_MEMORY;
+            if (error_code != SEVENZIP_OK) break;
+        } else {
+            EntryMeta meta;
+            entry_meta_get(&db, i, &meta);
+            FILE* output_file = open_output_file(&target, output_path);
+            if (!output_file) {
+                error_code = SEVENZIP_ERROR_OPEN_FILE;
                 break;
             }
-            
-            for (size_t j = 0; j < len; j++) {
-                filename[j] = (char)(temp[j] < 256 ? temp[j] : '?');
-            }
-            free(temp);
-            
-            /* Check if directory */
-            BoolInt is_dir = SzArEx_IsDir(&db, i);
-            
-            /* Build output path */
-            char* output_path = build_output_path(output_dir, filename);
-            free(filename);
-            
-            if (!output_path) {
-                error_code = SEVENZIP_ERROR_MEMORY;
+            entry_meta_apply(output_file, &meta);
+            if (output_durability_close(&durable, output_file) != 0) {
+                error_code = SEVENZIP_ERROR_EXTRACT;
                 break;
             }
-            
-            if (is_dir) {
-                /* Create directory */
-                create_directory_recursive(output_path);
-                free(output_path);
-            } else {
-                /* Extract file */
-                res = SzArEx_Extract(&db, &look_stream.vt, i,
-                                    &block_index, &out_buffer, &out_buffer_size,
-                                    &offset, &out_size_processed,
-                                    &alloc_imp, &alloc_temp);
-                
-                if (res != SZ_OK) {
-                    free(output_path);
-                    error_code = SEVENZIP_ERROR_EXTRACT;
-                    break;
-                }
-                
-                /* Create parent directories */
-                char* last_sep = strrchr(output_path, PATH_SEPARATOR);
-                if (last_sep) {
-                    *last_sep = 0;
-                    create_directory_recursive(output_path);
-                    *last_sep = PATH_SEPARATOR;
-                }
-                
-                /* Write file */
-                FILE* output_file = fopen(output_path, "wb");
-                if (!output_file) {
-                    free(output_path);
-                    error_code = SEVENZIP_ERROR_OPEN_FILE;
-                    break;
-                }
-                
-                size_t written = fwrite(out_buffer + offset, 1, out_size_processed, output_file);
-                fclose(output_file);
-                free(output_path);
-                
-                if (written != out_size_processed) {
-                    error_code = SEVENZIP_ERROR_EXTRACT;
-                    break;
-                }
-            }
-            
-            /* Progress callback */
-            if (progress_callback) {
-                progress_callback(i + 1, db.NumFiles, user_data);
-            }
+        }
+        
+        /* Progress callback */
+        progress_reporter_add(&progress, 1);
+    }
+    
+    name_scratch_free(&scratch);
+    
+    /* Each folder is decoded once, straight into its files */
+    if (error_code == SEVENZIP_OK) {
+        int failed_worker = 0;
+        res = folder_stream_decode_folders(&db, folder_workers, num_workers, plan.ranges,
+                                           lzma2_threads, verify, password, &alloc_imp,
+                                           &failed_worker);
+        if (res != SZ_OK) {
+            SevenZipErrorCode sink_error = workers[failed_worker].sink.error_code;
+            error_code = sink_error != SEVENZIP_OK ? sink_error : SEVENZIP_ERROR_EXTRACT;
         }
     }
     
+    /* The writer of a pipe sees its archive read to the end */
+    if (error_code == SEVENZIP_OK && source && forward_in_stream_drain(source, source_end) != SZ_OK) {
+        error_code = SEVENZIP_ERROR_EXTRACT;
+    }
+    
+    /* Everything handed to the writers is on disk before returning */
+    if (writers) {
+        SevenZipErrorCode writer_error = entry_writer_pool_finish(writers);
+        if (error_code == SEVENZIP_OK) error_code = writer_error;
+    }
+    
+    if (error_code == SEVENZIP_OK) folder_stream_entry_bytes(&db, selected, &op->bytes_in, &op->bytes_out);
+    
     /* Cleanup */
-    if (out_buffer) {
-        ISzAlloc_Free(&alloc_imp, out_buffer);
+    for (int w = 0; w < num_workers; w++) {
+        extract_worker_close(&workers[w], &g_MemIoAlloc);
+    }
+    /* Only once no file of the run is open any more */
+    SevenZipErrorCode durability_error = output_durability_end(&durable, error_code == SEVENZIP_OK);
+    if (error_code == SEVENZIP_OK) error_code = durability_error;
+    /* After the renames of ATOMIC mode, which move directory times too */
+    if (error_code == SEVENZIP_OK) entry_meta_batch_apply(&dir_meta, &dirs);
+    entry_meta_batch_free(&dir_meta);
+    progress_reporter_stop(&progress);
+    dir_cache_free(&dirs);
+    SzArEx_Free(&db, &alloc_header);
+    free(workers);
+    
+    int missing = plan.missing;
+    extract_plan_free(&plan);
+    if (error_code == SEVENZIP_OK && missing) {
+        return SEVENZIP_ERROR_EXTRACT;  /* Everything else was extracted */
+    }
+    return error_code;
+}
+
+/* extract_archive_decode(), counted in the process metrics */
+static SevenZipErrorCode extract_archive_run(
+    const char* archive_path,
+    ForwardInStream* source,
+    const char* output_dir,
+    const char** files,
+    NameFilter* filter,
+    const char* password,
+    int num_threads,
+    int lzma2_threads,
+    int writer_threads,
+    int sparse_output,
+    int cache_neutral,
+    SevenZipDurability durability,
+    SevenZipVerifyMode verify,
+    SevenZipExistingPolicy existing,
+    uint64_t max_memory,
+    int progress_interval_ms,
+    const SevenZipCancelToken* cancel,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    MetricsOp op;
+    metrics_op_begin(&op, SEVENZIP_METRIC_EXTRACT);
+    SevenZipErrorCode err = extract_archive_decode(archive_path, source, output_dir, files, filter, password,
+                                                   num_threads, lzma2_threads, writer_threads,
+                                                   sparse_output, cache_neutral, durability, verify,
+                                                   existing, max_memory, progress_interval_ms, cancel,
+                                                   progress_callback, user_data, &op);
+    metrics_op_end(&op, err);
+    return err;
+}
+
+/* extract_archive_run() on threads of the sevenzip_init_with_options() quota */
+static SevenZipErrorCode extract_archive(
+    const char* archive_path,
+    const char* output_dir,
+    const char** files,
+    NameFilter* filter,
+    const char* password,
+    int num_threads,
+    int lzma2_threads,
+    int thread_weight,
+    int writer_threads,
+    int sparse_output,
+    int cache_neutral,
+    SevenZipDurability durability,
+    SevenZipVerifyMode verify,
+    SevenZipExistingPolicy existing,
+    uint64_t max_memory,
+    int progress_interval_ms,
+    const SevenZipCancelToken* cancel,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    ThreadLease lease;
+    num_threads = thread_lease_acquire(&lease, num_threads, thread_weight);
+    thread_lease_fit(&lease, &num_threads, &lzma2_threads);
+    SevenZipErrorCode err = extract_archive_run(archive_path, NULL, output_dir, files, filter, password,
+                                                num_threads, lzma2_threads, writer_threads, sparse_output,
+                                                cache_neutral, durability, verify, existing, max_memory,
+                                                progress_interval_ms, cancel, progress_callback,
+                                                user_data);
+    thread_lease_release(&lease);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_extract(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    return extract_archive(archive_path, output_dir, NULL, NULL, password, 1, 1, 0,
+                           ENTRY_WRITER_DEFAULT_THREADS, 0, 0, SEVENZIP_DURABILITY_NONE,
+                           SEVENZIP_VERIFY_FILE, SEVENZIP_EXISTING_OVERWRITE, 0, 0, NULL,
+                           progress_callback, user_data);
+}
+
+void sevenzip_extract_options_init(SevenZipExtractOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->num_threads = 0;
+    options->lzma2_threads = 0;
+    options->writer_threads = ENTRY_WRITER_DEFAULT_THREADS;
+}
+
+/* The include and exclude patterns of `options` compiled into `storage`;
+ * *filter is NULL when there are none */
+static SevenZipErrorCode extract_filter_init(const SevenZipExtractOptions* options,
+                                             NameFilter* storage, NameFilter** filter) {
+    *filter = NULL;
+    if (!options || (!options->include_patterns && !options->exclude_patterns)) {
+        return SEVENZIP_OK;
+    }
+    SevenZipErrorCode err = name_filter_compile(storage, options->include_patterns,
+                                                options->exclude_patterns, 0);
+    if (err == SEVENZIP_OK) *filter = storage;
+    return err;
+}
+
+SevenZipErrorCode sevenzip_extract_with_options(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    int num_threads = options ? options->num_threads : 0;
+    int lzma2_threads = options ? options->lzma2_threads : 0;
+    int writer_threads = options ? options->writer_threads : ENTRY_WRITER_DEFAULT_THREADS;
+    int sparse_output = options ? options->sparse_output : 0;
+    int cache_neutral = options ? options->cache_neutral_output : 0;
+    SevenZipDurability durability = options ? options->durability : SEVENZIP_DURABILITY_NONE;
+    int progress_interval_ms = options ? options->progress_interval_ms : 0;
+    const SevenZipCancelToken* cancel = options ? options->cancel : NULL;
+    SevenZipVerifyMode verify = options ? options->verify : SEVENZIP_VERIFY_FILE;
+    SevenZipExistingPolicy existing = options ? options->existing : SEVENZIP_EXISTING_OVERWRITE;
+    if (num_threads <= 0) num_threads = thread_auto_count(FOLDER_STREAM_DEFAULT_WORKERS);
+    if (num_threads > FOLDER_STREAM_MAX_WORKERS) num_threads = FOLDER_STREAM_MAX_WORKERS;
+    uint64_t max_memory = options ? options->max_memory : 0;
+    int thread_weight = options ? options->thread_weight : 0;
+    NameFilter storage;
+    NameFilter* filter;
+    SevenZipErrorCode err = extract_filter_init(options, &storage, &filter);
+    if (err != SEVENZIP_OK) {
+        return err;
+    }
+    err = extract_archive(archive_path, output_dir, NULL, filter, password, num_threads, lzma2_threads,
+                          thread_weight, writer_threads, sparse_output, cache_neutral, durability, verify,
+                          existing, max_memory,
+                          progress_interval_ms, cancel, progress_callback, user_data);
+    if (filter) name_filter_free(filter);
+    return err;
+}
+
+/* Extract a streamable archive from `read`, which gets `read_data` */
+static SevenZipErrorCode extract_forward(
+    SevenZipReadCallback read,
+    void* read_data,
+    const char* output_dir,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipExtractOptions defaults;
+    if (!options) {
+        sevenzip_extract_options_init(&defaults);
+        options = &defaults;
+    }
+    
+    /* One reader: the threads go to the LZMA2 decoder of each folder */
+    int num_threads = options->num_threads;
+    int lzma2_threads = options->lzma2_threads;
+    if (num_threads <= 0) num_threads = thread_auto_count(FOLDER_STREAM_DEFAULT_WORKERS);
+    if (num_threads > FOLDER_STREAM_MAX_WORKERS) num_threads = FOLDER_STREAM_MAX_WORKERS;
+    
+    NameFilter storage;
+    NameFilter* filter;
+    SevenZipErrorCode err = extract_filter_init(options, &storage, &filter);
+    if (err != SEVENZIP_OK) {
+        return err;
+    }
+    ForwardInStream source;
+    if (forward_in_stream_init(&source, read, read_data) != SZ_OK) {
+        forward_in_stream_free(&source);
+        if (filter) name_filter_free(filter);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    ThreadLease lease;
+    num_threads = thread_lease_acquire(&lease, num_threads, options->thread_weight);
+    thread_lease_fit(&lease, &num_threads, &lzma2_threads);
+    err = extract_archive_run(NULL, &source, output_dir, NULL, filter, NULL, num_threads,
+                              lzma2_threads, options->writer_threads,
+                              options->sparse_output, options->cache_neutral_output,
+                              options->durability, options->verify, options->existing,
+                              options->max_memory, options->progress_interval_ms,
+                              options->cancel, progress_callback, user_data);
+    thread_lease_release(&lease);
+    forward_in_stream_free(&source);
+    if (filter) name_filter_free(filter);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_extract_from_stream(
+    SevenZipReadCallback read_callback,
+    const char* output_dir,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!read_callback || !output_dir) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    return extract_forward(read_callback, user_data, output_dir, options, progress_callback, user_data);
+}
+
+SevenZipErrorCode sevenzip_extract_following(
+    const char* archive_path,
+    const char* output_dir,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !output_dir || strlen(archive_path) >= sizeof(((VolumeFollower*)0)->path)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
     }
+    VolumeFollower follower;
+    volume_follower_init(&follower, archive_path, options ? options->follow_timeout_ms : 0,
+                         options ? options->cancel : NULL);
+    SevenZipErrorCode err = extract_forward(volume_follower_read, &follower, output_dir, options,
+                                            progress_callback, user_data);
+    if (follower.cancelled) {
+        err = SEVENZIP_ERROR_CANCELLED;
+    } else if (follower.timed_out) {
+        err = SEVENZIP_ERROR_OPEN_FILE;
+    }
+    volume_follower_free(&follower);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_estimate_extract_memory(
+    const char* archive_path,
+    const SevenZipExtractOptions* options,
+    uint64_t* peak_bytes
+) {
+    if (!archive_path || !peak_bytes) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    *peak_bytes = 0;
+    global_tables_init();
     
-    ISzAlloc_Free(&alloc_imp, look_stream.buf);
-    SzArEx_Free(&db, &alloc_imp);
-    File_Close(&archive_stream.file);
+    /* Worker counts as sevenzip_extract_with_options() settles them */
+    int num_threads = options ? options->num_threads : 0;
+    int lzma2_threads = options ? options->lzma2_threads : 0;
+    if (num_threads <= 0) num_threads = thread_auto_count(FOLDER_STREAM_DEFAULT_WORKERS);
+    if (num_threads > FOLDER_STREAM_MAX_WORKERS) num_threads = FOLDER_STREAM_MAX_WORKERS;
     
+    ISzAlloc alloc_header = g_MemHeaderAlloc;
+    ExtractWorker worker;
+    memset(&worker, 0, sizeof(worker));
+    if (!extract_worker_open(&worker, archive_path, NULL, &g_MemIoAlloc, (size_t)1 << 18)) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    CSzArEx db;
+    SzArEx_Init(&db);
+    SevenZipErrorCode error_code = SEVENZIP_OK;
+    if (SzArEx_Open(&db, worker.stream, &alloc_header, &alloc_header) != SZ_OK) {
+        error_code = SEVENZIP_ERROR_INVALID_ARCHIVE;
+    } else {
+        int requested_threads = num_threads;
+        if ((UInt32)num_threads > db.db.NumFolders) {
+            num_threads = db.db.NumFolders > 0 ? (int)db.db.NumFolders : 1;
+        }
+        if (lzma2_threads <= 0) {
+            lzma2_threads = requested_threads / num_threads;
+            if (lzma2_threads < 1) lzma2_threads = 1;
+        }
+        UInt64 peak = 0;
+        if (folder_stream_fit_memory(&db, NULL, options ? options->max_memory : 0, &num_threads,
+                                     &lzma2_threads, &peak) != SZ_OK) {
+            error_code = SEVENZIP_ERROR_MEMORY;
+        }
+        *peak_bytes = peak;
+    }
+    SzArEx_Free(&db, &alloc_header);
+    extract_worker_close(&worker, &g_MemIoAlloc);
     return error_code;
 }
 
@@ -263,6 +1168,579 @@ SevenZipErrorCode sevenzip_extract_files(
     SevenZipProgressCallback progress_callback,
     void* user_data
 ) {
-    /* TODO: Implement selective file extraction */
-    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+    if (!files) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    return extract_archive(archive_path, output_dir, files, NULL, password, 1, 1, 0,
+                           ENTRY_WRITER_DEFAULT_THREADS, 0, 0, SEVENZIP_DURABILITY_NONE,
+                           SEVENZIP_VERIFY_FILE, SEVENZIP_EXISTING_OVERWRITE, 0, 0, NULL,
+                           progress_callback, user_data);
+}
+
+SevenZipErrorCode sevenzip_extract_file_fast(
+    const char* archive_path,
+    const char* output_dir,
+    const char* file_name,
+    const char* password
+) {
+    if (!file_name) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const char* files[2] = { file_name, NULL };
+    return extract_archive(archive_path, output_dir, files, NULL, password, 1, 1, 0, 0, 0, 0,
+                           SEVENZIP_DURABILITY_NONE, SEVENZIP_VERIFY_FILE, SEVENZIP_EXISTING_OVERWRITE,
+                           0, 0, NULL, NULL, NULL);
+}
+
+/* Passes each file to the caller's callbacks, straight from the decoder window */
+typedef struct {
+    FolderStreamSink vt;
+    const CSzArEx* db;
+    const Byte* selected;  /* NULL to pass on every file */
+    const SevenZipExtractSink* user;
+    NameScratch scratch;
+    UInt32 current;        /* Entry being passed on, (UInt32)-1 for none */
+    SevenZipErrorCode error_code;
+} CallbackSink;
+
+static SRes CallbackSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    CallbackSink* p = Z7_CONTAINER_FROM_VTBL(pp, CallbackSink, vt);
+    p->current = (UInt32)-1;
+    if (p->selected && !p->selected[file_index]) return SZ_OK;  /* Not requested */
+    p->current = file_index;
+    if (!p->user->begin_entry) return SZ_OK;
+    
+    const char* name = NULL;
+    p->error_code = entry_name(&p->scratch, p->db, file_index, &name);
+    if (p->error_code != SEVENZIP_OK) return SZ_ERROR_MEM;
+    if (p->user->begin_entry(file_index, name ? name : "",
+                             SzArEx_GetFileSize(p->db, file_index),
+                             p->user->user_data) != 0) {
+        p->error_code = SEVENZIP_ERROR_EXTRACT;
+        return SZ_ERROR_PROGRESS;
+    }
+    return SZ_OK;
+}
+
+static SRes CallbackSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    CallbackSink* p = Z7_CONTAINER_FROM_VTBL(pp, CallbackSink, vt);
+    if (p->current == (UInt32)-1 || !p->user->write || size == 0) return SZ_OK;
+    if (p->user->write(p->current, data, size, p->user->user_data) != 0) {
+        p->error_code = SEVENZIP_ERROR_EXTRACT;
+        return SZ_ERROR_PROGRESS;
+    }
+    return SZ_OK;
+}
+
+static SRes CallbackSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    CallbackSink* p = Z7_CONTAINER_FROM_VTBL(pp, CallbackSink, vt);
+    if (p->current == (UInt32)-1) return SZ_OK;
+    p->current = (UInt32)-1;
+    if (p->user->end_entry && p->user->end_entry(file_index, p->user->user_data) != 0) {
+        p->error_code = SEVENZIP_ERROR_EXTRACT;
+        return SZ_ERROR_PROGRESS;
+    }
+    return SZ_OK;
+}
+
+SevenZipErrorCode sevenzip_extract_to_sink(
+    const char* archive_path,
+    const char** files,
+    const char* password,
+    const SevenZipExtractSink* sink
+) {
+    if (!archive_path || !sink) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    global_tables_init();
+    
+    ISzAlloc alloc_imp = g_MemDecoderAlloc;
+    ISzAlloc alloc_header = g_MemHeaderAlloc;  /* Database and header parse */
+    
+    ExtractWorker reader;
+    memset(&reader, 0, sizeof(reader));
+    if (!extract_worker_open(&reader, archive_path, NULL, &g_MemIoAlloc, (size_t)1 << 18)) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    
+    CSzArEx db;
+    SzArEx_Init(&db);
+    if (SzArEx_Open(&db, reader.stream, &alloc_header, &alloc_header) != SZ_OK) {
+        extract_worker_close(&reader, &g_MemIoAlloc);
+        SzArEx_Free(&db, &alloc_header);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    
+    ExtractPlan plan;
+    SevenZipErrorCode error_code = extract_plan_init(&plan, &db, files, NULL, NULL,
+                                                     SEVENZIP_EXISTING_OVERWRITE);
+    if (error_code != SEVENZIP_OK) {
+        extract_worker_close(&reader, &g_MemIoAlloc);
+        SzArEx_Free(&db, &alloc_header);
+        return error_code;
+    }
+    
+    CallbackSink callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.vt.Begin = CallbackSink_Begin;
+    callbacks.vt.Write = CallbackSink_Write;
+    callbacks.vt.End = CallbackSink_End;
+    callbacks.db = &db;
+    callbacks.selected = plan.selected;
+    callbacks.user = sink;
+    callbacks.current = (UInt32)-1;
+    callbacks.error_code = SEVENZIP_OK;
+    
+    /* Empty files first, as extract_archive() writes them */
+    for (UInt32 i = 0; i < db.NumFiles && error_code == SEVENZIP_OK; i++) {
+        if (db.FileToFolder[i] != (UInt32)-1 || SzArEx_IsDir(&db, i)) continue;
+        if (CallbackSink_Begin(&callbacks.vt, i) != SZ_OK ||
+            CallbackSink_End(&callbacks.vt, i) != SZ_OK) {
+            error_code = callbacks.error_code;
+        }
+    }
+    
+    if (error_code == SEVENZIP_OK) {
+        FolderStreamWorker worker;
+        worker.stream = reader.stream;
+        worker.sink = &callbacks.vt;
+        if (folder_stream_decode_folders(&db, &worker, 1, plan.ranges, 1, SEVENZIP_VERIFY_FILE,
+                                         password, &alloc_imp, NULL) != SZ_OK) {
+            error_code = callbacks.error_code != SEVENZIP_OK
+                ? callbacks.error_code : SEVENZIP_ERROR_EXTRACT;
+        }
+    }
+    
+    name_scratch_free(&callbacks.scratch);
+    extract_worker_close(&reader, &g_MemIoAlloc);
+    SzArEx_Free(&db, &alloc_header);
+    
+    int missing = plan.missing;
+    extract_plan_free(&plan);
+    if (error_code == SEVENZIP_OK && missing) {
+        return SEVENZIP_ERROR_EXTRACT;
+    }
+    return error_code;
+}
+
+/* Collects a folder decoded whole into the handle's cache */
+typedef struct {
+    FolderStreamSink vt;
+    const CSzArEx* db;
+    Byte* out;
+    size_t size;
+    size_t pos;
+    UInt64 folder_start;   /* Unpacked position of the folder's first file */
+} FolderCacheSink;
+
+static SRes FolderCacheSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    FolderCacheSink* p = Z7_CONTAINER_FROM_VTBL(pp, FolderCacheSink, vt);
+    p->pos = (size_t)(p->db->UnpackPositions[file_index] - p->folder_start);
+    return SZ_OK;
+}
+
+static SRes FolderCacheSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    FolderCacheSink* p = Z7_CONTAINER_FROM_VTBL(pp, FolderCacheSink, vt);
+    if (p->pos > p->size || size > p->size - p->pos) return SZ_ERROR_DATA;
+    memcpy(p->out + p->pos, data, size);
+    p->pos += size;
+    return SZ_OK;
+}
+
+static SRes FolderCacheSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    (void)pp;
+    (void)file_index;
+    return SZ_OK;
+}
+
+static void folder_cache_release(SevenZipArchive* a, ArchiveFolderCache* c) {
+    pthread_mutex_lock(&a->cache_lock);
+    archive_cache_unref(c);
+    pthread_mutex_unlock(&a->cache_lock);
+}
+
+/* Put a folder at the front of the list; the caller holds a->cache_lock */
+static void folder_cache_push_front(SevenZipArchive* a, ArchiveFolderCache* c) {
+    c->prev = NULL;
+    c->next = a->cache_head;
+    if (a->cache_head) a->cache_head->prev = c;
+    else a->cache_tail = c;
+    a->cache_head = c;
+}
+
+/*
+ * The handle's cached copy of folder_index, with a reference for the
+ * caller: the one in the cache, or the folder decoded whole into it after
+ * the least recently read folders make room. NULL when the folder is too
+ * large to cache, another call is filling it, the folders being filled
+ * take the budget, or decoding failed; the caller then streams its entry.
+ */
+static ArchiveFolderCache* folder_cache_acquire(SevenZipArchive* a, ArchiveReader* reader,
+                                                UInt32 folder_index, UInt64 folder_size) {
+    pthread_mutex_lock(&a->cache_lock);
+    for (ArchiveFolderCache* held = a->cache_head; held; held = held->next) {
+        if (held->folder != folder_index) continue;
+        if (!held->ready) {
+            pthread_mutex_unlock(&a->cache_lock);
+            metrics_cache_lookup(SEVENZIP_METRIC_CACHE_FOLDER, 0);
+            return NULL;
+        }
+        if (held != a->cache_head) {
+            held->prev->next = held->next;
+            if (held->next) held->next->prev = held->prev;
+            else a->cache_tail = held->prev;
+            folder_cache_push_front(a, held);
+        }
+        held->refs++;
+        pthread_mutex_unlock(&a->cache_lock);
+        metrics_cache_lookup(SEVENZIP_METRIC_CACHE_FOLDER, 1);
+        return held;
+    }
+    metrics_cache_lookup(SEVENZIP_METRIC_CACHE_FOLDER, 0);
+    if (folder_size > a->cache_limit || folder_size > a->cache_budget) {
+        pthread_mutex_unlock(&a->cache_lock);
+        return NULL;
+    }
+
+    /* Make room from the least recently read end. A buffer nobody copies
+     * from is refilled in place: no free and allocation */
+    size_t size = (size_t)folder_size;
+    ArchiveFolderCache* c = NULL;
+    ArchiveFolderCache* victim = a->cache_tail;
+    while (victim && a->cache_bytes + (c ? c->capacity : size) > a->cache_budget) {
+        ArchiveFolderCache* prev = victim->prev;
+        if (victim->ready) {
+            if (!c && victim->refs == 1 && victim->capacity >= size) {
+                c = victim;
+                c->refs++;
+            }
+            archive_cache_evict(a, victim);
+        }
+        victim = prev;
+    }
+    if (!c) {
+        c = (ArchiveFolderCache*)mem_alloc(SEVENZIP_MEM_OTHER, sizeof(ArchiveFolderCache));
+        if (c) {
+            memset(c, 0, sizeof(*c));
+            c->refs = 1;
+            c->capacity = size;
+        }
+    }
+    if (!c || a->cache_bytes + c->capacity > a->cache_budget) {
+        if (c) archive_cache_unref(c);
+        pthread_mutex_unlock(&a->cache_lock);
+        return NULL;
+    }
+    /* In the list but not ready: other calls stream their entry of it
+     * and nothing evicts it until the decode is done */
+    c->folder = folder_index;
+    c->ready = 0;
+    folder_cache_push_front(a, c);
+    a->cache_bytes += c->capacity;
+    pthread_mutex_unlock(&a->cache_lock);
+
+    if (!c->data) c->data = (Byte*)mem_alloc(SEVENZIP_MEM_DECODER, size ? size : 1);
+    SRes res = SZ_ERROR_MEM;
+    if (c->data) {
+        FolderCacheSink sink;
+        sink.vt.Begin = FolderCacheSink_Begin;
+        sink.vt.Write = FolderCacheSink_Write;
+        sink.vt.End = FolderCacheSink_End;
+        sink.vt.WriteStored = NULL;
+        sink.db = &a->db;
+        sink.out = c->data;
+        sink.size = size;
+        sink.pos = 0;
+        sink.folder_start = a->db.UnpackPositions[a->db.FolderToFile[folder_index]];
+        res = folder_stream_decode(&a->db, reader->stream, folder_index, &sink.vt,
+                                   NULL, 1, a->password, &a->alloc);
+    }
+
+    pthread_mutex_lock(&a->cache_lock);
+    if (res == SZ_OK) {
+        c->ready = 1;
+        c->refs++;
+        /* The limits may have dropped while it decoded */
+        archive_cache_trim(a);
+    } else {
+        archive_cache_evict(a, c);
+        c = NULL;
+    }
+    pthread_mutex_unlock(&a->cache_lock);
+    return c;
+}
+
+/*
+ * The entries of folder_index in `range`, those `callbacks` selects, to
+ * the sink in archive order: copied from the handle's cache, else decoded
+ * across the range once
+ */
+static SRes extract_folder_range(SevenZipArchive* a, ArchiveReader* reader, CallbackSink* callbacks,
+                                 UInt32 folder_index, const FolderStreamRange* range) {
+    const CSzArEx* db = &a->db;
+    /* On a cache failure the entries are streamed below, so only their
+       own CRCs decide whether they can be read */
+    UInt64 folder_size = SzAr_GetFolderUnpackSize(&db->db, folder_index);
+    ArchiveFolderCache* cache = folder_cache_acquire(a, reader, folder_index, folder_size);
+    if (!cache) {
+        return folder_stream_decode(db, reader->stream, folder_index, &callbacks->vt,
+                                    range, 1, a->password, &a->alloc);
+    }
+    SRes res = SZ_OK;
+    UInt64 folder_start = db->UnpackPositions[db->FolderToFile[folder_index]];
+    for (UInt32 i = range->first; i < range->limit && res == SZ_OK; i++) {
+        if (db->FileToFolder[i] != folder_index) continue;  /* Empty file or directory */
+        if (callbacks->selected && !callbacks->selected[i]) continue;
+        size_t offset = (size_t)(db->UnpackPositions[i] - folder_start);
+        res = CallbackSink_Begin(&callbacks->vt, i);
+        if (res == SZ_OK) {
+            res = CallbackSink_Write(&callbacks->vt, cache->data + offset,
+                                     (size_t)SzArEx_GetFileSize(db, i));
+        }
+        if (res == SZ_OK) res = CallbackSink_End(&callbacks->vt, i);
+    }
+    folder_cache_release(a, cache);
+    return res;
+}
+
+/* One entry of a folder to the sink, through a reader of this call's own */
+static SRes extract_from_folder(SevenZipArchive* a, CallbackSink* callbacks,
+                                UInt32 entry_index, UInt32 folder_index) {
+    ArchiveReader reader;
+    SRes res = archive_reader_open(&reader, a);
+    if (res == SZ_OK) {
+        FolderStreamRange range;
+        range.first = entry_index;
+        range.limit = entry_index + 1;
+        res = extract_folder_range(a, &reader, callbacks, folder_index, &range);
+    }
+    archive_reader_close(&reader);
+    return res;
+}
+
+SevenZipErrorCode sevenzip_archive_extract_entry(
+    SevenZipArchive* archive,
+    uint32_t entry_index,
+    const SevenZipExtractSink* sink
+) {
+    if (!archive || !sink || entry_index >= archive->db.NumFiles ||
+        SzArEx_IsDir(&archive->db, entry_index)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const CSzArEx* db = &archive->db;
+    MetricsOp op;
+    metrics_op_begin(&op, SEVENZIP_METRIC_READ);
+    op.bytes_out = SzArEx_GetFileSize(db, entry_index);
+    
+    CallbackSink callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.vt.Begin = CallbackSink_Begin;
+    callbacks.vt.Write = CallbackSink_Write;
+    callbacks.vt.End = CallbackSink_End;
+    callbacks.db = db;
+    callbacks.selected = NULL;
+    callbacks.user = sink;
+    callbacks.current = (UInt32)-1;
+    callbacks.error_code = SEVENZIP_OK;
+    
+    UInt32 folder_index = db->FileToFolder[entry_index];
+    SRes res;
+    if (folder_index == (UInt32)-1) {
+        /* Empty file */
+        res = CallbackSink_Begin(&callbacks.vt, entry_index);
+        if (res == SZ_OK) res = CallbackSink_End(&callbacks.vt, entry_index);
+    } else {
+        res = extract_from_folder(archive, &callbacks, entry_index, folder_index);
+    }
+    
+    name_scratch_free(&callbacks.scratch);
+    SevenZipErrorCode err = SEVENZIP_OK;
+    if (res != SZ_OK) {
+        err = callbacks.error_code != SEVENZIP_OK ? callbacks.error_code
+            : (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+    }
+    metrics_op_end(&op, err);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_archive_extract_entries(
+    SevenZipArchive* archive,
+    const uint32_t* entry_indices,
+    uint32_t count,
+    const SevenZipExtractSink* sink
+) {
+    if (!archive || !sink || (count > 0 && !entry_indices)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const CSzArEx* db = &archive->db;
+    for (uint32_t n = 0; n < count; n++) {
+        if (entry_indices[n] >= db->NumFiles || SzArEx_IsDir(db, entry_indices[n])) {
+            return SEVENZIP_ERROR_INVALID_PARAM;
+        }
+    }
+
+    /* The requests as a selection: duplicates collapse, the order they
+       came in is dropped for the order of the data */
+    Byte* selected = (Byte*)mem_calloc(SEVENZIP_MEM_OTHER, db->NumFiles ? db->NumFiles : 1, 1);
+    FolderStreamRange* ranges = (FolderStreamRange*)mem_calloc(
+        SEVENZIP_MEM_OTHER, db->db.NumFolders ? db->db.NumFolders : 1, sizeof(FolderStreamRange));
+    if (!selected || !ranges) {
+        mem_free(selected);
+        mem_free(ranges);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    for (uint32_t n = 0; n < count; n++) {
+        UInt32 i = entry_indices[n];
+        selected[i] = 1;
+        UInt32 folder_index = db->FileToFolder[i];
+        if (folder_index == (UInt32)-1) continue;
+        if (ranges[folder_index].limit == 0 || i < ranges[folder_index].first) {
+            ranges[folder_index].first = i;
+        }
+        if (i + 1 > ranges[folder_index].limit) ranges[folder_index].limit = i + 1;
+    }
+
+    CallbackSink callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.vt.Begin = CallbackSink_Begin;
+    callbacks.vt.Write = CallbackSink_Write;
+    callbacks.vt.End = CallbackSink_End;
+    callbacks.db = db;
+    callbacks.selected = selected;
+    callbacks.user = sink;
+    callbacks.current = (UInt32)-1;
+    callbacks.error_code = SEVENZIP_OK;
+
+    /* Empty files first, then each folder once, across its requested span */
+    SRes res = SZ_OK;
+    for (UInt32 i = 0; i < db->NumFiles && res == SZ_OK; i++) {
+        if (!selected[i] || db->FileToFolder[i] != (UInt32)-1) continue;
+        res = CallbackSink_Begin(&callbacks.vt, i);
+        if (res == SZ_OK) res = CallbackSink_End(&callbacks.vt, i);
+    }
+    ArchiveReader reader;
+    memset(&reader, 0, sizeof(reader));
+    int have_reader = 0;
+    for (UInt32 f = 0; f < db->db.NumFolders && res == SZ_OK; f++) {
+        if (ranges[f].first >= ranges[f].limit) continue;
+        if (!have_reader) {
+            res = archive_reader_open(&reader, archive);
+            have_reader = 1;
+            if (res != SZ_OK) break;
+        }
+        res = extract_folder_range(archive, &reader, &callbacks, f, &ranges[f]);
+    }
+    if (have_reader) archive_reader_close(&reader);
+
+    name_scratch_free(&callbacks.scratch);
+    mem_free(selected);
+    mem_free(ranges);
+    if (res != SZ_OK) {
+        if (callbacks.error_code != SEVENZIP_OK) return callbacks.error_code;
+        return (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+    }
+    return SEVENZIP_OK;
+}
+
+/* Keeps the bytes [offset, offset + size) of one file, then stops the decoder */
+typedef struct {
+    FolderStreamSink vt;
+    UInt64 pos;            /* Bytes of the file passed so far */
+    UInt64 offset;
+    Byte* out;
+    size_t size;
+    size_t got;
+} WindowSink;
+
+static SRes WindowSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    WindowSink* p = Z7_CONTAINER_FROM_VTBL(pp, WindowSink, vt);
+    (void)file_index;
+    p->pos = 0;
+    return SZ_OK;
+}
+
+static SRes WindowSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    WindowSink* p = Z7_CONTAINER_FROM_VTBL(pp, WindowSink, vt);
+    UInt64 end = p->pos + size;
+    UInt64 want = p->offset + p->got;
+    if (end > want) {
+        size_t skip = (size_t)(want - p->pos);
+        size_t take = size - skip;
+        if (take > p->size - p->got) take = p->size - p->got;
+        memcpy(p->out + p->got, data + skip, take);
+        p->got += take;
+    }
+    p->pos = end;
+    /* Nothing past the window is needed */
+    return p->got == p->size ? SZ_ERROR_PROGRESS : SZ_OK;
+}
+
+static SRes WindowSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    (void)pp;
+    (void)file_index;
+    return SZ_OK;
+}
+
+SevenZipErrorCode sevenzip_archive_pread(
+    SevenZipArchive* archive,
+    uint32_t entry_index,
+    uint64_t offset,
+    void* buffer,
+    size_t* size
+) {
+    if (!archive || !size || (!buffer && *size) || entry_index >= archive->db.NumFiles ||
+        SzArEx_IsDir(&archive->db, entry_index)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const CSzArEx* db = &archive->db;
+    UInt64 file_size = SzArEx_GetFileSize(db, entry_index);
+    size_t want = *size;
+    *size = 0;
+    if (offset >= file_size || want == 0) {
+        return SEVENZIP_OK;
+    }
+    if (want > file_size - offset) want = (size_t)(file_size - offset);
+    UInt32 folder_index = db->FileToFolder[entry_index];
+
+    ArchiveReader reader;
+    SRes res = archive_reader_open(&reader, archive);
+    if (res != SZ_OK) {
+        archive_reader_close(&reader);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    UInt64 folder_size = SzAr_GetFolderUnpackSize(&db->db, folder_index);
+    ArchiveFolderCache* cache = folder_cache_acquire(archive, &reader, folder_index, folder_size);
+    if (cache) {
+        size_t start = (size_t)(db->UnpackPositions[entry_index] -
+                                db->UnpackPositions[db->FolderToFile[folder_index]] + offset);
+        memcpy(buffer, cache->data + start, want);
+        folder_cache_release(archive, cache);
+        *size = want;
+    } else {
+        WindowSink sink;
+        sink.vt.Begin = WindowSink_Begin;
+        sink.vt.Write = WindowSink_Write;
+        sink.vt.End = WindowSink_End;
+        sink.vt.WriteStored = NULL;
+        sink.pos = 0;
+        sink.offset = offset;
+        sink.out = (Byte*)buffer;
+        sink.size = want;
+        sink.got = 0;
+        FolderStreamRange range;
+        range.first = entry_index;
+        range.limit = entry_index + 1;
+        res = folder_stream_decode(db, reader.stream, folder_index, &sink.vt,
+                                   &range, 1, archive->password, &archive->alloc);
+        if (res == SZ_ERROR_PROGRESS && sink.got == want) res = SZ_OK;
+        if (res == SZ_OK && sink.got == want) *size = want;
+        else if (res == SZ_OK) res = SZ_ERROR_DATA;
+    }
+    archive_reader_close(&reader);
+    if (res != SZ_OK) {
+        return (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+    }
+    return SEVENZIP_OK;
 }
@@ -1,307 +1,827 @@
 /**
  * Multi-file Archive Extraction using LZMA2
- * 
- * Extracts archives created with sevenzip_create_archive()
+ *
+ * Extracts archives created with sevenzip_create_archive(). The data of
+ * every file is found through the entry table: the index at the end of
+ * version 2 and 3 archives (located by the trailer), or the table in
+ * front of version 1 archives. A version 3 file is the concatenation of
+ * its chunks, each a block of its own, decoded in turn into the file. Files are decoded on a pool of workers, each reading
+ * through its own PackedInput (mapped where possible) and writing straight
+ * from its LZMA2 decoder's dictionary. Workers take files in the order of
+ * their data, so the archive is read front to back.
  */
 
 #include "../include/7z_ffi.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
 #include "Lzma2Dec.h"
-#include "Alloc.h"
+#include "Threads.h"
+#include "mem_alloc.h"
+#include "dir_cache.h"
+#include "entry_writer.h"
+#include "packed_input.h"
+#include "thread_quota.h"
+#include "sparse_output.h"
+#include "write_hints.h"
+#include "global_tables.h"
+#include "thread_placement.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/stat.h>
-#include <errno.h>
 
 #ifdef _WIN32
     #include <windows.h>
-    #include <direct.h>
-    #define mkdir(path, mode) _mkdir(path)
+    #define FSEEK64 _fseeki64
+    #define FTELL64 _ftelli64
 #else
     #include <unistd.h>
+    #include <sys/types.h>
+    #define FSEEK64 fseeko
+    #define FTELL64 ftello
 #endif
 
 #define ARCHIVE_MAGIC "7ZFF"
-#define ARCHIVE_VERSION 1
-#define IN_BUF_SIZE (1 << 16)
-#define OUT_BUF_SIZE (1 << 16)
+#define ARCHIVE_INDEX_MAGIC "7ZFI"
+#define ARCHIVE_VERSION_1 1
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_VERSION_DEDUP 3
+#define DEDUP_CHUNK_ENTRY_SIZE 36   /* Version 3 chunk entry */
+#define DEDUP_FILE_FIXED_SIZE 30    /* Version 3 file entry without name and chunk numbers */
+#define ARCHIVE_HEADER_SIZE 5
+#define ARCHIVE_TRAILER_SIZE 24
+#define ARCHIVE_ENTRY_FIXED_SIZE 42  /* Index entry without its name */
+#define EXTRACT_DEFAULT_THREADS 4
+#define EXTRACT_MAX_THREADS 64
+
+/* A block of compressed data: a whole file, or a version 3 chunk */
+typedef struct {
+    uint64_t offset;     /* From the start of the archive */
+    uint64_t compressed_size;
+    uint64_t original_size;
+} ArchiveChunk;
 
 /* File entry structure (matches create format) */
 typedef struct {
     char* name;
     uint64_t original_size;
     uint64_t compressed_size;
-    uint64_t offset;
+    uint64_t offset;     /* From the start of the archive; version 3: of the first chunk */
     uint64_t timestamp;
     uint32_t attributes;
+    uint32_t crc;
+    int has_crc;         /* Versions 2 and 3: CRC32 and exact size are checked */
+    uint32_t* chunks;    /* Version 3: numbers in the chunk table, in data order */
+    uint32_t chunk_count;
 } ArchiveEntry;
 
-/* Helper: Create directory recursively */
-static int create_directory_recursive(const char* path) {
-    char tmp[1024];
-    char* p = NULL;
-    size_t len;
-    
-    snprintf(tmp, sizeof(tmp), "%s", path);
-    len = strlen(tmp);
-    if (tmp[len - 1] == '/') {
-        tmp[len - 1] = 0;
-    }
-    
-    for (p = tmp + 1; *p; p++) {
-        if (*p == '/' || *p == '\\') {
-            *p = 0;
-            mkdir(tmp, 0755);
-            *p = '/';
-        }
+static void free_entries(ArchiveEntry* entries, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        mem_free(entries[i].name);
+        mem_free(entries[i].chunks);
     }
-    return mkdir(tmp, 0755);
+    mem_free(entries);
 }
 
-/* Helper: Read archive header and entries */
-static SevenZipErrorCode read_archive_header(
+/* Helper: Read the version 1 entry table that follows the version byte */
+static SevenZipErrorCode read_archive_header_v1(
     FILE* f,
     ArchiveEntry** entries,
     uint32_t* entry_count
 ) {
-    /* Read and verify magic */
-    char magic[4];
-    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, ARCHIVE_MAGIC, 4) != 0) {
-        return SEVENZIP_ERROR_INVALID_ARCHIVE;
-    }
-    
-    /* Read and verify version */
-    uint8_t version;
-    if (fread(&version, 1, 1, f) != 1 || version != ARCHIVE_VERSION) {
-        return SEVENZIP_ERROR_INVALID_ARCHIVE;
-    }
-    
     /* Read file count */
     uint32_t count;
     if (fread(&count, 4, 1, f) != 1 || count == 0) {
         return SEVENZIP_ERROR_INVALID_ARCHIVE;
     }
-    
+
     /* Allocate entries */
-    ArchiveEntry* ents = (ArchiveEntry*)calloc(count, sizeof(ArchiveEntry));
+    ArchiveEntry* ents = (ArchiveEntry*)mem_calloc(SEVENZIP_MEM_HEADER, count,
+                                                   sizeof(ArchiveEntry));
     if (!ents) {
         return SEVENZIP_ERROR_MEMORY;
     }
-    
+
     /* Read all entries */
     for (uint32_t i = 0; i < count; i++) {
         /* Read name length */
         uint16_t name_len;
         if (fread(&name_len, 2, 1, f) != 1) {
-            for (uint32_t j = 0; j < i; j++) free(ents[j].name);
-            free(ents);
+            free_entries(ents, count);
             return SEVENZIP_ERROR_INVALID_ARCHIVE;
         }
-        
+
         /* Read name */
-        ents[i].name = (char*)malloc(name_len + 1);
+        ents[i].name = (char*)mem_alloc(SEVENZIP_MEM_NAMES, name_len + 1);
         if (!ents[i].name || fread(ents[i].name, 1, name_len, f) != name_len) {
-            for (uint32_t j = 0; j <= i; j++) if (ents[j].name) free(ents[j].name);
-            free(ents);
+            free_entries(ents, count);
             return SEVENZIP_ERROR_MEMORY;
         }
         ents[i].name[name_len] = '\0';
-        
+
         /* Read metadata */
         if (fread(&ents[i].original_size, 8, 1, f) != 1 ||
             fread(&ents[i].compressed_size, 8, 1, f) != 1 ||
             fread(&ents[i].offset, 8, 1, f) != 1 ||
             fread(&ents[i].timestamp, 8, 1, f) != 1 ||
             fread(&ents[i].attributes, 4, 1, f) != 1) {
-            for (uint32_t j = 0; j <= i; j++) free(ents[j].name);
-            free(ents);
+            free_entries(ents, count);
             return SEVENZIP_ERROR_INVALID_ARCHIVE;
         }
     }
-    
+
+    /* Data offsets count from the end of the table */
+    int64_t data_start_pos = FTELL64(f);
+    if (data_start_pos < 0) {
+        free_entries(ents, count);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ents[i].offset += (uint64_t)data_start_pos;
+    }
+
     *entries = ents;
     *entry_count = count;
     return SEVENZIP_OK;
 }
 
-/* Helper: Decompress file from archive */
-static SevenZipErrorCode extract_file_from_archive(
-    FILE* archive_file,
-    const ArchiveEntry* entry,
-    const char* output_path,
-    long data_start_pos
+/* Helper: The index of a version 2 or 3 archive, found through the
+ * trailer at the end of the file and checked against its CRC32 */
+static SevenZipErrorCode read_index_bytes(
+    FILE* f,
+    Byte** index_out,
+    uint64_t* index_size_out,
+    uint64_t* index_offset_out
 ) {
-    /* Seek to compressed data (absolute position) */
-    if (fseek(archive_file, data_start_pos + entry->offset, SEEK_SET) != 0) {
-        return SEVENZIP_ERROR_EXTRACT;
-    }
-    
-    /* Open output file */
-    FILE* out_file = fopen(output_path, "wb");
-    if (!out_file) {
+    Byte trailer[ARCHIVE_TRAILER_SIZE];
+    if (FSEEK64(f, 0, SEEK_END) != 0) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
-    
-    /* Allocate buffers */
-    Byte* in_buf = (Byte*)malloc(IN_BUF_SIZE);
-    Byte* out_buf = (Byte*)malloc(OUT_BUF_SIZE);
-    if (!in_buf || !out_buf) {
-        if (in_buf) free(in_buf);
-        if (out_buf) free(out_buf);
-        fclose(out_file);
+    int64_t file_size = FTELL64(f);
+    if (file_size < ARCHIVE_HEADER_SIZE + ARCHIVE_TRAILER_SIZE + 4 ||
+        FSEEK64(f, file_size - ARCHIVE_TRAILER_SIZE, SEEK_SET) != 0 ||
+        fread(trailer, 1, ARCHIVE_TRAILER_SIZE, f) != ARCHIVE_TRAILER_SIZE ||
+        memcmp(trailer + 20, ARCHIVE_INDEX_MAGIC, 4) != 0) {
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+
+    /* The index ends where the trailer starts */
+    uint64_t index_offset = GetUi64(trailer);
+    uint64_t index_size = GetUi64(trailer + 8);
+    uint64_t index_end = (uint64_t)file_size - ARCHIVE_TRAILER_SIZE;
+    if (index_offset < ARCHIVE_HEADER_SIZE || index_size < 4 || index_size > index_end ||
+        index_offset != index_end - index_size || index_size != (size_t)index_size) {
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+
+    Byte* index = (Byte*)mem_alloc(SEVENZIP_MEM_HEADER, (size_t)index_size);
+    if (!index) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    if (FSEEK64(f, (int64_t)index_offset, SEEK_SET) != 0 ||
+        fread(index, 1, (size_t)index_size, f) != (size_t)index_size ||
+        CrcCalc(index, (size_t)index_size) != GetUi32(trailer + 16)) {
+        mem_free(index);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    *index_out = index;
+    *index_size_out = index_size;
+    *index_offset_out = index_offset;
+    return SEVENZIP_OK;
+}
+
+/* Helper: Read the version 2 index */
+static SevenZipErrorCode read_archive_index(
+    FILE* f,
+    ArchiveEntry** entries,
+    uint32_t* entry_count
+) {
+    Byte* index;
+    uint64_t index_size, index_offset;
+    SevenZipErrorCode err = read_index_bytes(f, &index, &index_size, &index_offset);
+    if (err != SEVENZIP_OK) {
+        return err;
+    }
+
+    /* Every entry takes at least its fixed fields */
+    uint32_t count = GetUi32(index);
+    if (count > (index_size - 4) / ARCHIVE_ENTRY_FIXED_SIZE) {
+        mem_free(index);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    ArchiveEntry* ents = (ArchiveEntry*)mem_calloc(SEVENZIP_MEM_HEADER, count ? count : 1,
+                                                   sizeof(ArchiveEntry));
+    if (!ents) {
+        mem_free(index);
         return SEVENZIP_ERROR_MEMORY;
     }
-    
+
+    const Byte* p = index + 4;
+    const Byte* end = index + (size_t)index_size;
+    SevenZipErrorCode result = SEVENZIP_OK;
+    for (uint32_t i = 0; i < count; i++) {
+        if ((size_t)(end - p) < ARCHIVE_ENTRY_FIXED_SIZE) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+            break;
+        }
+        size_t name_len = GetUi16(p);
+        if ((size_t)(end - p) < ARCHIVE_ENTRY_FIXED_SIZE + name_len) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+            break;
+        }
+        ents[i].name = (char*)mem_alloc(SEVENZIP_MEM_NAMES, name_len + 1);
+        if (!ents[i].name) {
+            result = SEVENZIP_ERROR_MEMORY;
+            break;
+        }
+        memcpy(ents[i].name, p + 2, name_len);
+        ents[i].name[name_len] = '\0';
+        p += 2 + name_len;
+
+        ents[i].original_size = GetUi64(p);
+        ents[i].compressed_size = GetUi64(p + 8);
+        ents[i].offset = GetUi64(p + 16);
+        ents[i].timestamp = GetUi64(p + 24);
+        ents[i].attributes = GetUi32(p + 32);
+        ents[i].crc = GetUi32(p + 36);
+        ents[i].has_crc = 1;
+        p += 40;
+
+        /* The data lies between the header and the index */
+        if (ents[i].compressed_size < 1 || ents[i].offset < ARCHIVE_HEADER_SIZE ||
+            ents[i].offset > index_offset ||
+            ents[i].compressed_size > index_offset - ents[i].offset) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+            break;
+        }
+    }
+    mem_free(index);
+
+    if (result != SEVENZIP_OK) {
+        free_entries(ents, count);
+        return result;
+    }
+    *entries = ents;
+    *entry_count = count;
+    return SEVENZIP_OK;
+}
+
+/* Helper: Read the version 3 index: the chunk table, then the files */
+static SevenZipErrorCode read_dedup_index(
+    FILE* f,
+    ArchiveEntry** entries,
+    uint32_t* entry_count,
+    ArchiveChunk** chunks_out
+) {
+    Byte* index;
+    uint64_t index_size, index_offset;
+    SevenZipErrorCode result = read_index_bytes(f, &index, &index_size, &index_offset);
+    if (result != SEVENZIP_OK) {
+        return result;
+    }
+
+    const Byte* p = index + 4;
+    const Byte* end = index + (size_t)index_size;
+    uint32_t chunk_count = GetUi32(index);
+    if (chunk_count > (index_size - 4) / DEDUP_CHUNK_ENTRY_SIZE ||
+        (size_t)(end - p) - (size_t)chunk_count * DEDUP_CHUNK_ENTRY_SIZE < 4) {
+        mem_free(index);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    ArchiveChunk* chunks = (ArchiveChunk*)mem_alloc(SEVENZIP_MEM_HEADER,
+                                                    (chunk_count ? chunk_count : 1) * sizeof(ArchiveChunk));
+    if (!chunks) {
+        mem_free(index);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    for (uint32_t i = 0; i < chunk_count; i++) {
+        chunks[i].offset = GetUi64(p);
+        chunks[i].compressed_size = GetUi32(p + 8);
+        chunks[i].original_size = GetUi32(p + 12);
+        p += DEDUP_CHUNK_ENTRY_SIZE;
+        /* The data lies between the header and the index */
+        if (chunks[i].compressed_size < 1 || chunks[i].offset < ARCHIVE_HEADER_SIZE ||
+            chunks[i].offset > index_offset ||
+            chunks[i].compressed_size > index_offset - chunks[i].offset) {
+            mem_free(chunks);
+            mem_free(index);
+            return SEVENZIP_ERROR_INVALID_ARCHIVE;
+        }
+    }
+
+    uint32_t count = GetUi32(p);
+    p += 4;
+    if (count > (size_t)(end - p) / DEDUP_FILE_FIXED_SIZE) {
+        mem_free(chunks);
+        mem_free(index);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    ArchiveEntry* ents = (ArchiveEntry*)mem_calloc(SEVENZIP_MEM_HEADER, count ? count : 1,
+                                                   sizeof(ArchiveEntry));
+    if (!ents) {
+        mem_free(chunks);
+        mem_free(index);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < count && result == SEVENZIP_OK; i++) {
+        if ((size_t)(end - p) < DEDUP_FILE_FIXED_SIZE) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+            break;
+        }
+        size_t name_len = GetUi16(p);
+        if ((size_t)(end - p) < DEDUP_FILE_FIXED_SIZE + name_len) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+            break;
+        }
+        ents[i].name = (char*)mem_alloc(SEVENZIP_MEM_NAMES, name_len + 1);
+        if (!ents[i].name) {
+            result = SEVENZIP_ERROR_MEMORY;
+            break;
+        }
+        memcpy(ents[i].name, p + 2, name_len);
+        ents[i].name[name_len] = '\0';
+        p += 2 + name_len;
+
+        ents[i].original_size = GetUi64(p);
+        ents[i].timestamp = GetUi64(p + 8);
+        ents[i].attributes = GetUi32(p + 16);
+        ents[i].crc = GetUi32(p + 20);
+        ents[i].has_crc = 1;
+        uint32_t refs = GetUi32(p + 24);
+        p += 28;
+        if (refs > (size_t)(end - p) / 4) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+            break;
+        }
+        ents[i].chunks = (uint32_t*)mem_alloc(SEVENZIP_MEM_HEADER, (refs ? refs : 1) * sizeof(uint32_t));
+        if (!ents[i].chunks) {
+            result = SEVENZIP_ERROR_MEMORY;
+            break;
+        }
+        ents[i].chunk_count = refs;
+
+        /* The chunks must add up to the file */
+        uint64_t total = 0;
+        for (uint32_t c = 0; c < refs; c++) {
+            uint32_t id = GetUi32(p);
+            p += 4;
+            if (id >= chunk_count) {
+                result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+                break;
+            }
+            ents[i].chunks[c] = id;
+            ents[i].compressed_size += chunks[id].compressed_size;
+            total += chunks[id].original_size;
+        }
+        if (result == SEVENZIP_OK && total != ents[i].original_size) {
+            result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+        }
+        ents[i].offset = refs ? chunks[ents[i].chunks[0]].offset : ARCHIVE_HEADER_SIZE;
+    }
+    mem_free(index);
+
+    if (result != SEVENZIP_OK) {
+        free_entries(ents, count);
+        mem_free(chunks);
+        return result;
+    }
+    *entries = ents;
+    *entry_count = count;
+    *chunks_out = chunks;
+    return SEVENZIP_OK;
+}
+
+/* Helper: Read archive header and entries; *chunks is the chunk table
+ * of a version 3 archive, NULL for the others */
+static SevenZipErrorCode read_archive_entries(
+    const char* archive_path,
+    ArchiveEntry** entries,
+    uint32_t* entry_count,
+    ArchiveChunk** chunks
+) {
+    *chunks = NULL;
+    FILE* f = fopen(archive_path, "rb");
+    if (!f) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+
+    /* Read and verify magic and version */
+    Byte header[ARCHIVE_HEADER_SIZE];
+    SevenZipErrorCode result = SEVENZIP_ERROR_INVALID_ARCHIVE;
+    if (fread(header, 1, ARCHIVE_HEADER_SIZE, f) == ARCHIVE_HEADER_SIZE &&
+        memcmp(header, ARCHIVE_MAGIC, 4) == 0) {
+        if (header[4] == ARCHIVE_VERSION) {
+            result = read_archive_index(f, entries, entry_count);
+        } else if (header[4] == ARCHIVE_VERSION_DEDUP) {
+            result = read_dedup_index(f, entries, entry_count, chunks);
+        } else if (header[4] == ARCHIVE_VERSION_1) {
+            result = read_archive_header_v1(f, entries, entry_count);
+        }
+    }
+
+    fclose(f);
+    return result;
+}
+
+/* Helper: Decode one block into the output, writing from the decoder's
+ * dictionary; adds what it wrote to *out_processed */
+static SevenZipErrorCode decode_block(
+    PackedInput* in,
+    CLzma2Dec* decoder,
+    const ArchiveChunk* block,
+    FILE* out_file,
+    SparseOutput* sparse_out,
+    WriteHints* hints,
+    UInt32* crc,
+    uint64_t* out_processed
+) {
+    /* Position at compressed data (absolute position) */
+    if (!packed_input_seek(in, block->offset, block->compressed_size)) {
+        return SEVENZIP_ERROR_EXTRACT;
+    }
+
     /* Read LZMA2 property byte (first byte of compressed data) */
-    Byte prop;
-    if (fread(&prop, 1, 1, archive_file) != 1) {
-        free(in_buf);
-        free(out_buf);
-        fclose(out_file);
+    const Byte* data;
+    if (packed_input_peek(in, &data) == 0) {
         return SEVENZIP_ERROR_EXTRACT;
     }
-    
-    /* Initialize LZMA2 decoder */
-    CLzma2Dec decoder;
-    Lzma2Dec_Construct(&decoder);
-    SRes res = Lzma2Dec_Allocate(&decoder, prop, &g_Alloc);
+    Byte prop = data[0];
+    packed_input_consume(in, 1);
+
+    /* The dictionary is kept while blocks have the same size */
+    SRes res = Lzma2Dec_Allocate(decoder, prop, &g_MemDecoderAlloc);
     if (res != SZ_OK) {
-        free(in_buf);
-        free(out_buf);
-        fclose(out_file);
         return SEVENZIP_ERROR_COMPRESS;
     }
-    
-    Lzma2Dec_Init(&decoder);
-    
-    /* Decompress data (remaining bytes after prop) */
-    uint64_t remaining = entry->compressed_size - 1; // -1 for prop byte already read
+    Lzma2Dec_Init(decoder);
+
+    CLzmaDec* dic = &decoder->decoder;
+    uint64_t done = 0;
+    while (done < block->original_size) {
+        if (dic->dicPos == dic->dicBufSize) dic->dicPos = 0;
+        SizeT start = dic->dicPos;
+        SizeT limit = dic->dicBufSize;
+        uint64_t left = block->original_size - done;
+        if (limit - start > left) limit = start + (SizeT)left;
+
+        size_t avail = packed_input_peek(in, &data);
+        SizeT in_size = avail;
+        ELzmaStatus status;
+        res = Lzma2Dec_DecodeToDic(decoder, limit, data, &in_size, LZMA_FINISH_ANY, &status);
+        packed_input_consume(in, in_size);
+
+        size_t produced = dic->dicPos - start;
+        if (produced > 0) {
+            const Byte* out = dic->dic + start;
+            int written = sparse_out ? sparse_output_write(sparse_out, out_file, out, produced)
+                                     : fwrite(out, 1, produced, out_file) == produced;
+            if (!written) {
+                return SEVENZIP_ERROR_EXTRACT;
+            }
+            write_hints_wrote(hints, produced);
+            if (crc) *crc = CrcUpdate(*crc, out, produced);
+            done += produced;
+            *out_processed += produced;
+        }
+
+        if (res != SZ_OK) {
+            return SEVENZIP_ERROR_COMPRESS;
+        }
+        if (status == LZMA_STATUS_FINISHED_WITH_MARK) {
+            break;
+        }
+        if (avail == 0 && produced == 0) {
+            if (in->read_error) return SEVENZIP_ERROR_EXTRACT;
+            break;
+        }
+    }
+    return SEVENZIP_OK;
+}
+
+/* Helper: Decompress file from archive: its one block, or its chunks in
+ * turn; the CRC of a version 2 or 3 entry is summed when `check_crc`,
+ * and the file leaves the page cache as it is written when `cache_neutral`.
+ * `decoder` is the caller's, kept from entry to entry with its dictionary. */
+static SevenZipErrorCode extract_file_from_archive(
+    PackedInput* in,
+    CLzma2Dec* decoder,
+    const ArchiveEntry* entry,
+    const ArchiveChunk* chunks,
+    const char* output_path,
+    int sparse,
+    int cache_neutral,
+    int check_crc
+) {
+    /* Open output file */
+    FILE* out_file = fopen(output_path, "wb");
+    if (!out_file) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    SparseOutput sparse_out;
+    if (sparse) {
+        sparse_output_begin(&sparse_out, out_file);
+    } else {
+        entry_preallocate(out_file, entry->original_size);
+    }
+    WriteHints hints;
+    write_hints_begin(&hints, out_file, cache_neutral);
+
     uint64_t out_processed = 0;
+    UInt32 crc = CRC_INIT_VAL;
+    check_crc = check_crc && entry->has_crc;
     SevenZipErrorCode result = SEVENZIP_OK;
-    
-    while (remaining > 0 && out_processed < entry->original_size) {
-        size_t in_size = (remaining < IN_BUF_SIZE) ? remaining : IN_BUF_SIZE;
-        in_size = fread(in_buf, 1, in_size, archive_file);
-        if (in_size == 0) break;
-        
-        Byte* in_ptr = in_buf;
-        size_t in_remaining = in_size;
-        
-        while (in_remaining > 0) {
-            size_t out_size = OUT_BUF_SIZE;
-            size_t in_processed = in_remaining;
-            ELzmaStatus status;
-            
-            res = Lzma2Dec_DecodeToBuf(
-                &decoder,
-                out_buf, &out_size,
-                in_ptr, &in_processed,
-                LZMA_FINISH_ANY,
-                &status
-            );
-            
-            if (res != SZ_OK) {
-                result = SEVENZIP_ERROR_COMPRESS;
-                goto cleanup;
-            }
-            
-            if (out_size > 0) {
-                if (fwrite(out_buf, 1, out_size, out_file) != out_size) {
-                    result = SEVENZIP_ERROR_EXTRACT;
-                    goto cleanup;
-                }
-                out_processed += out_size;
-            }
-            
-            in_ptr += in_processed;
-            in_remaining -= in_processed;
-            remaining -= in_processed;
-            
-            if (status == LZMA_STATUS_FINISHED_WITH_MARK) {
-                goto cleanup;
-            }
+
+    ArchiveChunk whole = { entry->offset, entry->compressed_size, entry->original_size };
+    uint32_t block_count = entry->chunks ? entry->chunk_count : 1;
+    uint64_t expected = 0;
+    for (uint32_t b = 0; b < block_count && result == SEVENZIP_OK; b++) {
+        const ArchiveChunk* block = entry->chunks ? &chunks[entry->chunks[b]] : &whole;
+        result = decode_block(in, decoder, block, out_file, sparse ? &sparse_out : NULL, &hints,
+                              check_crc ? &crc : NULL, &out_processed);
+        /* Chunks after a short one would land in the wrong place */
+        expected += block->original_size;
+        if (result == SEVENZIP_OK && entry->chunks && out_processed != expected) {
+            result = SEVENZIP_ERROR_EXTRACT;
         }
     }
-    
-cleanup:
-    Lzma2Dec_Free(&decoder, &g_Alloc);
-    free(in_buf);
-    free(out_buf);
-    fclose(out_file);
-    
+
+    /* Version 2 and 3 entries must come out whole and unchanged */
+    if (result == SEVENZIP_OK && entry->has_crc &&
+        (out_processed != entry->original_size || (check_crc && CRC_GET_DIGEST(crc) != entry->crc))) {
+        result = SEVENZIP_ERROR_EXTRACT;
+    }
+    if (result == SEVENZIP_OK && sparse && !sparse_output_end(&sparse_out, out_file)) {
+        result = SEVENZIP_ERROR_EXTRACT;
+    }
+    write_hints_end(&hints, out_file);
+
+    if (fclose(out_file) != 0 && result == SEVENZIP_OK) {
+        result = SEVENZIP_ERROR_EXTRACT;
+    }
+
     if (result != SEVENZIP_OK) {
         remove(output_path);
     }
-    
+
     return result;
 }
 
-/* Main function: Extract multi-file archive */
-SevenZipErrorCode sevenzip_extract_archive(
+/* Entries are handed out in data order so reads move forward */
+typedef struct {
+    uint64_t offset;
+    uint32_t index;
+} EntryOrder;
+
+static int compare_offsets(const void* a, const void* b) {
+    uint64_t x = ((const EntryOrder*)a)->offset;
+    uint64_t y = ((const EntryOrder*)b)->offset;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Entries decoded at once, shared by the workers */
+typedef struct {
+    const char* archive_path;
+    const char* output_dir;
+    const ArchiveEntry* entries;
+    const ArchiveChunk* chunks;  /* Version 3 chunk table */
+    const EntryOrder* order;     /* Entries by data offset */
+    uint32_t entry_count;
+    int sparse;
+    int cache_neutral;
+    int check_crc;
+    DirCache* dirs;
+    CCriticalSection lock;       /* Guards everything below */
+    uint32_t next;
+    uint32_t entries_done;
+    SevenZipErrorCode error_code;
+    SevenZipProgressCallback progress_callback;
+    void* user_data;
+} ExtractPool;
+
+typedef struct {
+    CThread thread;
+    ExtractPool* pool;
+} ExtractPoolThread;
+
+static void extract_pool_run(ExtractPool* pool, PackedInput* in) {
+    char output_path[1024];
+    CLzma2Dec decoder;
+    Lzma2Dec_Construct(&decoder);
+    for (;;) {
+        CriticalSection_Enter(&pool->lock);
+        uint32_t n = pool->next;
+        int done = pool->error_code != SEVENZIP_OK || n >= pool->entry_count;
+        if (!done) pool->next++;
+        CriticalSection_Leave(&pool->lock);
+        if (done) break;
+
+        /* Build output path and create parent directory if needed */
+        const ArchiveEntry* entry = &pool->entries[pool->order[n].index];
+        snprintf(output_path, sizeof(output_path), "%s/%s", pool->output_dir, entry->name);
+        dir_cache_create_parent(pool->dirs, output_path);
+
+        SevenZipErrorCode result = extract_file_from_archive(in, &decoder, entry, pool->chunks, output_path,
+                                                              pool->sparse, pool->cache_neutral, pool->check_crc);
+
+        CriticalSection_Enter(&pool->lock);
+        if (result != SEVENZIP_OK) {
+            if (pool->error_code == SEVENZIP_OK) pool->error_code = result;
+        } else {
+            pool->entries_done++;
+            if (pool->progress_callback) {
+                pool->progress_callback(pool->entries_done, pool->entry_count, pool->user_data);
+            }
+        }
+        CriticalSection_Leave(&pool->lock);
+        if (result != SEVENZIP_OK) break;
+    }
+    Lzma2Dec_Free(&decoder, &g_MemDecoderAlloc);
+}
+
+static THREAD_FUNC_DECL ExtractPool_Thread(void* arg) {
+    ExtractPoolThread* t = (ExtractPoolThread*)arg;
+    thread_sched_enter();
+    PackedInput in;
+    /* A worker that cannot open the archive leaves its share to the others */
+    if (packed_input_open(&in, t->pool->archive_path)) {
+        extract_pool_run(t->pool, &in);
+        packed_input_close(&in);
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Main function: Extract multi-file archive with options */
+SevenZipErrorCode sevenzip_extract_archive_with_options(
     const char* archive_path,
     const char* output_dir,
-    const char* password,
+    const SevenZipExtractOptions* options,
     SevenZipProgressCallback progress_callback,
     void* user_data
 ) {
     if (!archive_path || !output_dir) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
-    
-    /* Open archive */
-    FILE* archive_file = fopen(archive_path, "rb");
-    if (!archive_file) {
-        return SEVENZIP_ERROR_OPEN_FILE;
-    }
-    
+    global_tables_init();
+
     /* Read header and entries */
     ArchiveEntry* entries = NULL;
     uint32_t entry_count = 0;
-    SevenZipErrorCode result = read_archive_header(archive_file, &entries, &entry_count);
+    ArchiveChunk* chunks = NULL;
+    SevenZipErrorCode result = read_archive_entries(archive_path, &entries, &entry_count, &chunks);
     if (result != SEVENZIP_OK) {
-        fclose(archive_file);
         return result;
     }
-    
-    /* Remember position after header */
-    long data_start_pos = ftell(archive_file);
-    
-    /* Create output directory */
-    create_directory_recursive(output_dir);
-    
-    /* Extract each file */
+
+    /* Read the archive front to back: entries in the order of their data */
+    EntryOrder* order = (EntryOrder*)mem_alloc(SEVENZIP_MEM_OTHER,
+                                                 (entry_count ? entry_count : 1) * sizeof(EntryOrder));
+    PackedInput in;
+    if (!order) {
+        free_entries(entries, entry_count);
+        mem_free(chunks);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    if (!packed_input_open(&in, archive_path)) {
+        mem_free(order);
+        free_entries(entries, entry_count);
+        mem_free(chunks);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
     for (uint32_t i = 0; i < entry_count; i++) {
-        /* Build output path */
-        char output_path[1024];
-        snprintf(output_path, sizeof(output_path), "%s/%s", output_dir, entries[i].name);
-        
-        /* Create parent directory if needed */
-        char* last_slash = strrchr(output_path, '/');
-        if (last_slash) {
-            *last_slash = '\0';
-            create_directory_recursive(output_path);
-            *last_slash = '/';
-        }
-        
-        /* Extract file */
-        result = extract_file_from_archive(archive_file, &entries[i], output_path, data_start_pos);
-        if (result != SEVENZIP_OK) {
-            break;
+        order[i].offset = entries[i].offset;
+        order[i].index = i;
+    }
+    qsort(order, entry_count, sizeof(EntryOrder), compare_offsets);
+
+    /* Create output directory; each directory is created once */
+    DirCache dirs;
+    dir_cache_init(&dirs);
+    char output_path[1024];
+    snprintf(output_path, sizeof(output_path), "%s", output_dir);
+    dir_cache_create(&dirs, output_path);
+
+    ExtractPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.archive_path = archive_path;
+    pool.output_dir = output_dir;
+    pool.entries = entries;
+    pool.chunks = chunks;
+    pool.order = order;
+    pool.entry_count = entry_count;
+    pool.sparse = options ? options->sparse_output : 0;
+    pool.cache_neutral = options ? options->cache_neutral_output : 0;
+    /* An entry is one stream: SEVENZIP_VERIFY_FOLDER checks it as FILE */
+    pool.check_crc = !options || options->verify != SEVENZIP_VERIFY_NONE;
+    pool.dirs = &dirs;
+    pool.progress_callback = progress_callback;
+    pool.user_data = user_data;
+
+    int num_threads = options && options->num_threads > 0
+        ? options->num_threads : thread_auto_count(EXTRACT_DEFAULT_THREADS);
+    ThreadLease lease;
+    num_threads = thread_lease_acquire(&lease, num_threads, options ? options->thread_weight : 0);
+    if (num_threads > EXTRACT_MAX_THREADS) num_threads = EXTRACT_MAX_THREADS;
+    if ((uint32_t)num_threads > entry_count) num_threads = entry_count ? (int)entry_count : 1;
+
+    if (CriticalSection_Init(&pool.lock) != 0) {
+        result = SEVENZIP_ERROR_MEMORY;
+    } else {
+        /* Threads that fail to start leave their share to the others */
+        ExtractPoolThread threads[EXTRACT_MAX_THREADS];
+        int started = 0;
+        for (int i = 1; i < num_threads; i++) {
+            ExtractPoolThread* t = &threads[started];
+            t->pool = &pool;
+            Thread_CONSTRUCT(&t->thread)
+            if (Thread_Create(&t->thread, ExtractPool_Thread, t) != 0) break;
+            started++;
         }
-        
-        /* Progress callback */
-        if (progress_callback) {
-            progress_callback(i + 1, entry_count, user_data);
+
+        extract_pool_run(&pool, &in);
+
+        for (int i = 0; i < started; i++) {
+            Thread_Wait_Close(&threads[i].thread);
         }
+        CriticalSection_Delete(&pool.lock);
+        result = pool.error_code;
     }
-    
+    thread_lease_release(&lease);
+
     /* Cleanup */
+    dir_cache_free(&dirs);
+    packed_input_close(&in);
+    mem_free(order);
+    free_entries(entries, entry_count);
+    mem_free(chunks);
+
+    return result;
+}
+
+/* Main function: Extract multi-file archive */
+SevenZipErrorCode sevenzip_extract_archive(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    /* 7ZFF archives are never encrypted */
+    if (password && password[0]) {
+        return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+    }
+    return sevenzip_extract_archive_with_options(archive_path, output_dir, NULL,
+                                                 progress_callback, user_data);
+}
+
+/* Main function: Extract one file of a multi-file archive */
+SevenZipErrorCode sevenzip_extract_archive_file(
+    const char* archive_path,
+    const char* output_dir,
+    const char* file_name
+) {
+    if (!archive_path || !output_dir || !file_name) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    global_tables_init();
+
+    ArchiveEntry* entries = NULL;
+    uint32_t entry_count = 0;
+    ArchiveChunk* chunks = NULL;
+    SevenZipErrorCode result = read_archive_entries(archive_path, &entries, &entry_count, &chunks);
+    if (result != SEVENZIP_OK) {
+        return result;
+    }
+
+    const ArchiveEntry* entry = NULL;
     for (uint32_t i = 0; i < entry_count; i++) {
-        if (entries[i].name) free(entries[i].name);
+        if (strcmp(entries[i].name, file_name) == 0) {
+            entry = &entries[i];
+            break;
+        }
     }
-    free(entries);
-    fclose(archive_file);
-    
+
+    /* Only this entry's data is read */
+    PackedInput in;
+    if (!entry) {
+        result = SEVENZIP_ERROR_EXTRACT;
+    } else if (!packed_input_open(&in, archive_path)) {
+        result = SEVENZIP_ERROR_OPEN_FILE;
+    } else {
+        DirCache dirs;
+        dir_cache_init(&dirs);
+        char output_path[1024];
+        snprintf(output_path, sizeof(output_path), "%s/%s", output_dir, entry->name);
+        dir_cache_create_parent(&dirs, output_path);
+        CLzma2Dec decoder;
+        Lzma2Dec_Construct(&decoder);
+        result = extract_file_from_archive(&in, &decoder, entry, chunks, output_path, 0, 0, 1);
+        Lzma2Dec_Free(&decoder, &g_MemDecoderAlloc);
+        dir_cache_free(&dirs);
+        packed_input_close(&in);
+    }
+
+    free_entries(entries, entry_count);
+    mem_free(chunks);
     return result;
 }
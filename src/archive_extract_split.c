@@ -6,39 +6,59 @@
 
 #include "../include/7z_ffi.h"
 #include "7z.h"
-#include "7zAlloc.h"
 #include "7zBuf.h"
 #include "7zCrc.h"
 #include "7zFile.h"
 #include "7zVersion.h"
+#include "mem_alloc.h"
+#include "folder_stream.h"
+#include "mmap_stream.h"
+#include "volume_stream.h"
+#include "dir_cache.h"
+#include "extract_checkpoint.h"
+#include "entry_writer.h"
+#include "sparse_output.h"
+#include "write_hints.h"
+#include "utf_convert.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+#include "metrics.h"
+#include "Threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 
 #ifdef _WIN32
     #include <windows.h>
-    #include <direct.h>
-    #define MKDIR(path) _mkdir(path)
     #define PATH_SEP '\\'
 #else
     #include <unistd.h>
     #include <sys/types.h>
-    #define MKDIR(path) mkdir(path, 0755)
     #define PATH_SEP '/'
 #endif
 
-/* Multi-volume input stream */
+/*
+ * Volumes given up as decoding leaves them behind. With one worker the
+ * folders are read in archive order, and every seek lands in the folder
+ * being decoded, so a seek tells which folder that is. A folder read
+ * whole may seek anywhere from its pack start on; a streamed one only
+ * reads on from where it is, up to the next folder's start.
+ */
 typedef struct {
-    ISeekInStream vt;
-    FILE** volumes;           // Array of volume file handles
-    int volume_count;         // Number of volumes
-    uint64_t* volume_sizes;   // Size of each volume
-    uint64_t* volume_offsets; // Cumulative offsets
+    const CSzArEx* db;        /* Set once decoding starts */
+    VolumeSet* volumes;
+    UInt32 folder;            /* Folder being decoded */
+    int forward;              /* It only reads forward */
+    int released;             /* Volumes before this one are gone */
+    SevenZipVolumeCallback callback;  /* NULL: delete them */
+    void* user_data;
+} SplitConsume;
+
+/* Reader over the volumes, with byte progress */
+typedef struct {
+    VolumeInStream reader;    // Positioned reads of the shared volumes
     uint64_t total_size;      // Total size across all volumes
-    int current_volume;       // Currently active volume
-    uint64_t current_pos;     // Global position
     
     /* Progress tracking */
     SevenZipBytesProgressCallback progress_callback;
@@ -46,322 +66,502 @@ typedef struct {
     uint64_t bytes_extracted;
     uint64_t total_bytes;
     char current_file[512];
+    CCriticalSection* progress_lock; // Set when workers share the progress
+    uint64_t* shared_bytes;          // Bytes read by all workers
+    SplitConsume* consume;           // Set when volumes are given up as they are read past
 } MultiVolumeInStream;
 
-/* Read callback for multi-volume stream */
-static SRes MultiVolumeInStream_Read(ISeekInStreamPtr pp, void *buf, size_t *size) {
-    MultiVolumeInStream* p = (MultiVolumeInStream*)pp;
-    uint8_t* ptr = (uint8_t*)buf;
-    size_t remaining = *size;
-    size_t total_read = 0;
-    
-    while (remaining > 0 && p->current_pos < p->total_size) {
-        // Find which volume contains current position
-        int volume_idx = 0;
-        for (int i = 0; i < p->volume_count; i++) {
-            if (p->current_pos < p->volume_offsets[i + 1]) {
-                volume_idx = i;
-                break;
-            }
-        }
-        
-        // Calculate position within volume
-        uint64_t volume_start = p->volume_offsets[volume_idx];
-        uint64_t volume_pos = p->current_pos - volume_start;
-        uint64_t volume_remaining = p->volume_sizes[volume_idx] - volume_pos;
-        
-        // Read from current volume
-        size_t to_read = remaining;
-        if (to_read > volume_remaining) {
-            to_read = (size_t)volume_remaining;
-        }
-        
-        FILE* vol = p->volumes[volume_idx];
-        if (fseek(vol, (long)volume_pos, SEEK_SET) != 0) {
-            *size = total_read;
-            return SZ_ERROR_READ;
-        }
-        
-        size_t bytes_read = fread(ptr, 1, to_read, vol);
-        if (bytes_read == 0 && to_read > 0) {
-            *size = total_read;
-            return SZ_ERROR_READ;
-        }
-        
-        ptr += bytes_read;
-        remaining -= bytes_read;
-        total_read += bytes_read;
-        p->current_pos += bytes_read;
-        p->bytes_extracted += bytes_read;
-        
-        // Update progress
-        if (p->progress_callback) {
-            p->progress_callback(
-                p->bytes_extracted,
-                p->total_bytes,
-                p->bytes_extracted, // Current file bytes
-                p->total_bytes,     // Current file total
-                p->current_file,
-                p->user_data
-            );
-        }
+static uint64_t split_folder_start(const CSzArEx* db, UInt32 folder) {
+    const CSzAr* ar = &db->db;
+    UInt32 pack = folder < ar->NumFolders ? ar->FoStartPackStreamIndex[folder] : ar->NumPackStreams;
+    return db->dataPos + ar->PackPositions[pack];
+}
+
+/* Last folder starting at or before pos */
+static UInt32 split_folder_at(const CSzArEx* db, uint64_t pos) {
+    UInt32 lo = 0;
+    UInt32 hi = db->db.NumFolders > 0 ? db->db.NumFolders - 1 : 0;
+    while (lo < hi) {
+        UInt32 mid = lo + (hi - lo + 1) / 2;
+        if (split_folder_start(db, mid) <= pos) lo = mid;
+        else hi = mid - 1;
     }
-    
-    *size = total_read;
-    return SZ_OK;
+    return lo;
 }
 
-/* Seek callback for multi-volume stream */
-static SRes MultiVolumeInStream_Seek(ISeekInStreamPtr pp, Int64 *pos, ESzSeek origin) {
-    MultiVolumeInStream* p = (MultiVolumeInStream*)pp;
-    
-    switch (origin) {
-        case SZ_SEEK_SET:
-            p->current_pos = (uint64_t)*pos;
-            break;
-        case SZ_SEEK_CUR:
-            p->current_pos += *pos;
-            break;
-        case SZ_SEEK_END:
-            p->current_pos = p->total_size + *pos;
-            break;
+/* Close volume v and delete it, or hand it to the callback */
+static void split_consume_release(SplitConsume* c, int v) {
+    VolumeSet* set = c->volumes;
+    if (!volume_set_release(set, v)) return;
+    if (c->callback) {
+        c->callback((uint32_t)v, set->paths[v], set->sizes[v], NULL, c->user_data);
+    } else {
+        remove(set->paths[v]);
     }
+}
+
+/* Give up the volumes wholly before anything the decoder can still read */
+static void split_consume_advance(MultiVolumeInStream* p, size_t size) {
+    SplitConsume* c = p->consume;
+    const CSzArEx* db = c->db;
+    if (!db || db->db.NumFolders == 0) return;
+    if (p->reader.seeked) {
+        p->reader.seeked = 0;
+        c->folder = split_folder_at(db, p->reader.pos - size);
+        c->forward = folder_stream_reads_forward(db, c->folder);
+    }
+    uint64_t keep = split_folder_start(db, c->folder);
+    if (c->forward) {
+        uint64_t next = split_folder_start(db, c->folder + 1);
+        keep = p->reader.pos < next ? p->reader.pos : next;
+    }
+    VolumeSet* set = c->volumes;
+    while (c->released < set->count && set->offsets[c->released + 1] <= keep) {
+        split_consume_release(c, c->released++);
+    }
+}
+
+/* Count bytes taken from the volumes and report progress */
+static void split_progress_add(MultiVolumeInStream* p, size_t size) {
+    p->bytes_extracted += size;
+    if (!p->progress_callback) return;
     
-    if (p->current_pos > p->total_size) {
-        p->current_pos = p->total_size;
+    uint64_t done = p->bytes_extracted;
+    if (p->progress_lock) {
+        CriticalSection_Enter(p->progress_lock);
+        *p->shared_bytes += size;
+        done = *p->shared_bytes;
+    }
+    p->progress_callback(
+        done,
+        p->total_bytes,
+        done,               // Current file bytes
+        p->total_bytes,     // Current file total
+        p->current_file,
+        p->user_data
+    );
+    if (p->progress_lock) {
+        CriticalSection_Leave(p->progress_lock);
     }
+}
+
+/* Consume hook of the mapped and the volume readers */
+static void split_progress_consumed(void* ctx, size_t size) {
+    MultiVolumeInStream* p = (MultiVolumeInStream*)ctx;
+    split_progress_add(p, size);
+    if (p->consume) split_consume_advance(p, size);
+}
+
+/* Writes decoded files under the output directory */
+typedef struct {
+    FolderStreamSink vt;
+    const CSzArEx* db;
+    MultiVolumeInStream* in_stream;
+    const char* output_dir;
+    OutputDurability* durability;  /* Shared by the workers */
+    FILE* file;
+    int sparse;           /* Zero blocks of `file` are left as holes */
+    SparseOutput out;
+    int cache_neutral;    /* `file` leaves the page cache as it is written */
+    WriteHints hints;
+    ExtractCheckpoint* checkpoint;  /* Shared by the workers */
+    UInt32 folder;        /* Folder of the last file begun, (UInt32)-1 for none */
+    int file_done;        /* A file is checkpointed once ended, CRC checked */
+} SplitSink;
+
+/* Output path of an entry; 0 if its name cannot be read */
+static int split_output_path(SplitSink* p, UInt32 file_index, char* out_path, size_t out_size) {
+    char empty[1] = {0};
+    size_t len = SzArEx_GetFileNameUtf16(p->db, file_index, NULL);
+    char* file_name = len > 1 ?
+        utf16le_to_utf8_dup(p->db->FileNames + p->db->FileNameOffsets[file_index] * 2, len) : empty;
+    if (!file_name) return 0;
     
-    *pos = (Int64)p->current_pos;
+    strncpy(p->in_stream->current_file, file_name, sizeof(p->in_stream->current_file) - 1);
+    snprintf(out_path, out_size, "%s%c%s", p->output_dir, PATH_SEP, file_name);
+    if (file_name != empty) mem_free(file_name);
+    return 1;
+}
+
+static SRes SplitSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    SplitSink* p = Z7_CONTAINER_FROM_VTBL(pp, SplitSink, vt);
+    /* A sink sees whole folders in turn, so the one before is done */
+    UInt32 folder = p->db->FileToFolder[file_index];
+    if (folder != (UInt32)-1 && folder != p->folder) {
+        if (p->folder != (UInt32)-1) extract_checkpoint_folder_done(p->checkpoint, p->folder);
+        p->folder = folder;
+    }
+    char out_path[1024];
+    if (!split_output_path(p, file_index, out_path, sizeof(out_path))) {
+        return SZ_OK;  /* Decoded and checked, not written */
+    }
+    p->file = output_durability_open(p->durability, out_path);
+    if (p->file && p->sparse) sparse_output_begin(&p->out, p->file);
+    else if (p->file) entry_preallocate(p->file, SzArEx_GetFileSize(p->db, file_index));
+    write_hints_begin(&p->hints, p->file, p->cache_neutral);
     return SZ_OK;
 }
 
-/* Detect and open all volumes of a split archive */
-static int open_split_volumes(const char* first_volume_path, MultiVolumeInStream* stream) {
-    // Parse base path (remove .001, .002, etc.)
-    char base_path[1024];
-    strncpy(base_path, first_volume_path, sizeof(base_path) - 1);
-    
-    // Check if path ends with .001, .002, etc.
-    size_t len = strlen(base_path);
-    if (len > 4 && base_path[len-4] == '.' && 
-        base_path[len-3] >= '0' && base_path[len-3] <= '9') {
-        base_path[len-4] = '\0'; // Remove .XXX
+static SRes SplitSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    SplitSink* p = Z7_CONTAINER_FROM_VTBL(pp, SplitSink, vt);
+    if (p->file) {
+        if (p->sparse) sparse_output_write(&p->out, p->file, data, size);
+        else fwrite(data, 1, size, p->file);
+        write_hints_wrote(&p->hints, size);
     }
-    
-    // Try to open volumes sequentially
-    FILE** volumes = NULL;
-    uint64_t* sizes = NULL;
-    int count = 0;
-    int capacity = 10;
-    
-    volumes = (FILE**)malloc(capacity * sizeof(FILE*));
-    sizes = (uint64_t*)malloc(capacity * sizeof(uint64_t));
-    
-    if (!volumes || !sizes) {
-        free(volumes);
-        free(sizes);
-        return 0;
+    return SZ_OK;
+}
+
+static SRes SplitSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    SplitSink* p = Z7_CONTAINER_FROM_VTBL(pp, SplitSink, vt);
+    if (p->file) {
+        if (p->sparse) sparse_output_end(&p->out, p->file);
+        write_hints_end(&p->hints, p->file);
+        output_durability_close(p->durability, p->file);
+        p->file = NULL;
     }
-    
-    // Try opening volumes
-    for (int i = 1; i <= 999; i++) {
-        char volume_path[1024];
-        if (i == 1) {
-            // First volume might be .7z or .7z.001
-            snprintf(volume_path, sizeof(volume_path), "%s.001", base_path);
-            FILE* f = fopen(volume_path, "rb");
-            if (!f) {
-                // Try without .001
-                snprintf(volume_path, sizeof(volume_path), "%s", base_path);
-                f = fopen(volume_path, "rb");
-            }
-            if (!f) break;
-            
-            volumes[count] = f;
-        } else {
-            snprintf(volume_path, sizeof(volume_path), "%s.%03d", base_path, i);
-            FILE* f = fopen(volume_path, "rb");
-            if (!f) break; // No more volumes
-            
-            volumes[count] = f;
-        }
-        
-        // Get volume size
-        fseek(volumes[count], 0, SEEK_END);
-        sizes[count] = (uint64_t)ftell(volumes[count]);
-        fseek(volumes[count], 0, SEEK_SET);
-        
-        count++;
-        
-        // Expand arrays if needed
-        if (count >= capacity) {
-            capacity *= 2;
-            FILE** new_volumes = (FILE**)realloc(volumes, capacity * sizeof(FILE*));
-            uint64_t* new_sizes = (uint64_t*)realloc(sizes, capacity * sizeof(uint64_t));
-            if (!new_volumes || !new_sizes) {
-                for (int j = 0; j < count; j++) fclose(volumes[j]);
-                free(volumes);
-                free(sizes);
-                return 0;
-            }
-            volumes = new_volumes;
-            sizes = new_sizes;
-        }
+    if (p->file_done && p->db->FileToFolder[file_index] != (UInt32)-1) {
+        extract_checkpoint_file_done(p->checkpoint, file_index);
     }
-    
-    if (count == 0) {
-        free(volumes);
-        free(sizes);
-        return 0;
+    return SZ_OK;
+}
+
+/* Volumes, reader and sink of one extraction worker */
+typedef struct {
+    VolumeSet volumes;        /* Opened by worker 0, shared by the others */
+    MultiVolumeInStream in_stream;
+    MmapInStream mapped;
+    CLookToRead2 look_stream;
+    ILookInStreamPtr stream;  /* &mapped.vt, or the buffered reader */
+    SplitSink sink;
+} SplitWorker;
+
+/* Worker 0 opens and maps the volumes (or only opens them, so they can be
+ * given up); later workers share its mapping or its handles */
+static int split_worker_open(SplitWorker* w, const char* archive_path, int readahead, int map,
+                             SplitWorker* first, ISzAllocPtr alloc) {
+    VolumeSet* set = first ? &first->volumes : &w->volumes;
+    if (!first) {
+        if (!volume_set_open(set, archive_path, readahead)) return 0;
+        if (map && !set->parity) mmap_in_stream_open_files(&w->mapped, set->files, set->sizes, set->count);
+        w->mapped.readahead = set->readahead;
+    } else if (first->mapped.volumes) {
+        mmap_in_stream_share(&w->mapped, &first->mapped);
     }
-    
-    // Calculate cumulative offsets
-    uint64_t* offsets = (uint64_t*)malloc((count + 1) * sizeof(uint64_t));
-    if (!offsets) {
-        for (int i = 0; i < count; i++) fclose(volumes[i]);
-        free(volumes);
-        free(sizes);
-        return 0;
+    w->in_stream.total_size = set->total_size;
+    if (w->mapped.volumes) {
+        w->mapped.consumed = split_progress_consumed;
+        w->mapped.consumed_ctx = &w->in_stream;
+        w->stream = &w->mapped.vt;
+        return 1;
     }
-    
-    offsets[0] = 0;
-    for (int i = 0; i < count; i++) {
-        offsets[i + 1] = offsets[i] + sizes[i];
+    volume_in_stream_init(&w->in_stream.reader, set);
+    w->in_stream.reader.consumed = split_progress_consumed;
+    w->in_stream.reader.consumed_ctx = &w->in_stream;
+    LookToRead2_CreateVTable(&w->look_stream, False);
+    w->look_stream.buf = (Byte*)ISzAlloc_Alloc(alloc, (1 << 18)); // 256KB buffer
+    if (!w->look_stream.buf) {
+        volume_set_close(&w->volumes);
+        return 0;
     }
-    
-    // Initialize stream
-    stream->vt.Read = MultiVolumeInStream_Read;
-    stream->vt.Seek = MultiVolumeInStream_Seek;
-    stream->volumes = volumes;
-    stream->volume_count = count;
-    stream->volume_sizes = sizes;
-    stream->volume_offsets = offsets;
-    stream->total_size = offsets[count];
-    stream->current_volume = 0;
-    stream->current_pos = 0;
-    stream->bytes_extracted = 0;
-    
+    w->look_stream.bufSize = (1 << 18);
+    w->look_stream.realStream = &w->in_stream.reader.vt;
+    LookToRead2_INIT(&w->look_stream);
+    w->stream = &w->look_stream.vt;
     return 1;
 }
 
-/* Close all volumes */
-static void close_split_volumes(MultiVolumeInStream* stream) {
-    if (stream->volumes) {
-        for (int i = 0; i < stream->volume_count; i++) {
-            if (stream->volumes[i]) {
-                fclose(stream->volumes[i]);
-            }
-        }
-        free(stream->volumes);
+/* Worker 0 is closed last, as the others read its volumes */
+static void split_worker_close(SplitWorker* w, ISzAllocPtr alloc) {
+    if (w->sink.file) {
+        fclose(w->sink.file);
+        w->sink.file = NULL;
     }
-    free(stream->volume_sizes);
-    free(stream->volume_offsets);
+    ISzAlloc_Free(alloc, w->look_stream.buf);
+    mmap_in_stream_close(&w->mapped);
+    volume_set_close(&w->volumes);
 }
 
-/**
- * Extract a 7z archive with streaming decompression and split volume support
- */
-SevenZipErrorCode sevenzip_extract_streaming(
+/* `op` gets the bytes of a run that succeeds */
+static SevenZipErrorCode extract_streaming_decode(
     const char* archive_path,
     const char* output_dir,
     const char* password,
+    int num_threads,
+    int lzma2_threads,
+    int sparse_output,
+    int cache_neutral,
+    SevenZipDurability durability,
+    SevenZipVerifyMode verify,
+    int volume_readahead,
+    uint64_t max_memory,
+    int consume_volumes,
+    SevenZipVolumeCallback volume_consumed,
+    void* volume_user_data,
+    const char* checkpoint_path,
     SevenZipBytesProgressCallback progress_callback,
-    void* user_data
+    void* user_data,
+    MetricsOp* op
 ) {
-    if (!archive_path || !output_dir) {
+    if (!archive_path || !output_dir || (checkpoint_path && consume_volumes)) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    // Initialize CRC tables
-    CrcGenerateTable();
+    global_tables_init();
     
-    // Open split volumes
-    MultiVolumeInStream in_stream = {0};
-    if (!open_split_volumes(archive_path, &in_stream)) {
+    ISzAlloc alloc_imp = g_MemDecoderAlloc;  /* Dictionaries may use huge pages */
+    ISzAlloc alloc_header = g_MemHeaderAlloc;  /* Database and header parse */
+    
+    // Open split volumes; worker 0 also reads the header
+    SplitWorker* workers = (SplitWorker*)calloc((size_t)num_threads, sizeof(SplitWorker));
+    if (!workers) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    if (!split_worker_open(&workers[0], archive_path, volume_readahead, !consume_volumes,
+                           NULL, &g_MemIoAlloc)) {
+        free(workers);
         return SEVENZIP_ERROR_OPEN_FILE;
     }
     
-    in_stream.progress_callback = progress_callback;
-    in_stream.user_data = user_data;
-    in_stream.total_bytes = in_stream.total_size;
+    MultiVolumeInStream* in_stream = &workers[0].in_stream;
+    in_stream->progress_callback = progress_callback;
+    in_stream->user_data = user_data;
+    in_stream->total_bytes = in_stream->total_size;
+    
+    // Only the volumes of a series are given up, never a lone archive file
+    SplitConsume consume;
+    memset(&consume, 0, sizeof(consume));
+    consume.volumes = &workers[0].volumes;
+    consume.callback = volume_consumed;
+    consume.user_data = volume_user_data;
+    if (consume_volumes && workers[0].volumes.series) {
+        in_stream->consume = &consume;
+    }
     
-    // Create output directory
-    MKDIR(output_dir);
+    // Create output directory; directories made during the run are remembered
+    DirCache dirs;
+    dir_cache_init(&dirs);
+    char output_root[1024];
+    snprintf(output_root, sizeof(output_root), "%s", output_dir);
+    dir_cache_create(&dirs, output_root);
+    OutputDurability durable;
+    SevenZipErrorCode durability_err = output_durability_begin(&durable, durability, output_dir, &dirs);
     
     // Initialize 7z structures
-    CLookToRead2 look_stream;
     CSzArEx db;
-    ISzAlloc alloc_imp = {SzAlloc, SzFree};
-    ISzAlloc alloc_temp_imp = {SzAllocTemp, SzFreeTemp};
-    
-    LookToRead2_CreateVTable(&look_stream, False);
-    look_stream.buf = (Byte*)ISzAlloc_Alloc(&alloc_imp, (1 << 18)); // 256KB buffer
-    if (!look_stream.buf) {
-        close_split_volumes(&in_stream);
-        return SEVENZIP_ERROR_MEMORY;
-    }
-    look_stream.bufSize = (1 << 18);
-    look_stream.realStream = (ISeekInStreamPtr)&in_stream;
-    LookToRead2_INIT(&look_stream);
-    
     SzArEx_Init(&db);
     
     // Open archive
-    SRes res = SzArEx_Open(&db, &look_stream.vt, &alloc_imp, &alloc_temp_imp);
+    SRes res = durability_err == SEVENZIP_OK
+        ? SzArEx_Open(&db, workers[0].stream, &alloc_header, &alloc_header) : SZ_ERROR_MEM;
+    int num_workers = 1;
+    
+    // Folders a failed run wrote are skipped, the one it stopped in resumed
+    ExtractCheckpoint checkpoint;
+    SevenZipErrorCode checkpoint_err = SEVENZIP_OK;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    if (res == SZ_OK) {
+        checkpoint_err = extract_checkpoint_begin(&checkpoint, checkpoint_path, &db);
+        if (checkpoint_err != SEVENZIP_OK) res = SZ_ERROR_PARAM;
+    }
+    const FolderStreamRange* ranges = extract_checkpoint_ranges(&checkpoint);
+    
+    if (res == SZ_OK) {
+        // More workers only when there are folders for them
+        int requested_threads = num_threads;
+        if (in_stream->consume) {
+            num_threads = 1;  /* Folders in archive order, one at a time */
+        }
+        if ((UInt32)num_threads > db.db.NumFolders) {
+            num_threads = db.db.NumFolders > 0 ? (int)db.db.NumFolders : 1;
+        }
+        while (num_workers < num_threads &&
+               split_worker_open(&workers[num_workers], archive_path, 0, 1, &workers[0], &g_MemIoAlloc)) {
+            num_workers++;
+        }
+        // Threads the folder workers leave idle go to their LZMA2 decoders
+        if (lzma2_threads <= 0) {
+            lzma2_threads = requested_threads / num_workers;
+            if (lzma2_threads < 1) lzma2_threads = 1;
+        }
+        // Decoders held to max_memory before any of them allocates
+        int fit_workers = num_workers;
+        if (folder_stream_fit_memory(&db, ranges, max_memory, &fit_workers, &lzma2_threads, NULL) != SZ_OK) {
+            res = SZ_ERROR_MEM;
+        }
+        while (num_workers > fit_workers) split_worker_close(&workers[--num_workers], &g_MemIoAlloc);
+    }
     
     if (res == SZ_OK) {
-        // Extract all files
-        UInt32 block_index = 0xFFFFFFFF;
-        Byte* out_buffer = NULL;
-        size_t out_buffer_size = 0;
+        // Byte progress is summed over all workers' reads
+        CCriticalSection progress_lock;
+        uint64_t shared_bytes = in_stream->bytes_extracted;
+        int have_lock = 0;
+        if (num_workers > 1) {
+            if (CriticalSection_Init(&progress_lock) == 0) {
+                have_lock = 1;
+            } else {
+                while (num_workers > 1) split_worker_close(&workers[--num_workers], &g_MemIoAlloc);
+            }
+        }
         
-        for (UInt32 i = 0; i < db.NumFiles; i++) {
-            size_t offset = 0;
-            size_t out_size_processed = 0;
+        FolderStreamWorker folder_workers[FOLDER_STREAM_MAX_WORKERS];
+        for (int w = 0; w < num_workers; w++) {
+            MultiVolumeInStream* ws = &workers[w].in_stream;
+            ws->progress_callback = progress_callback;
+            ws->user_data = user_data;
+            ws->total_bytes = ws->total_size;
+            if (have_lock) {
+                ws->progress_lock = &progress_lock;
+                ws->shared_bytes = &shared_bytes;
+            }
             
-            // Get file info
-            size_t len = SzArEx_GetFileNameUtf16(&db, i, NULL);
-            UInt16* temp = (UInt16*)malloc(len * sizeof(UInt16));
-            if (temp) {
-                SzArEx_GetFileNameUtf16(&db, i, temp);
-                
-                // Convert UTF-16 to UTF-8 (simplified)
-                char file_name[512] = {0};
-                for (size_t j = 0; j < len && j < 511; j++) {
-                    file_name[j] = (char)temp[j];
-                }
-                
-                strncpy(in_stream.current_file, file_name, sizeof(in_stream.current_file) - 1);
-                free(temp);
-                
-                // Extract file
-                res = SzArEx_Extract(&db, &look_stream.vt, i,
-                                    &block_index, &out_buffer, &out_buffer_size,
-                                    &offset, &out_size_processed,
-                                    &alloc_imp, &alloc_temp_imp);
-                
-                if (res == SZ_OK && !SzArEx_IsDir(&db, i)) {
-                    // Write file
-                    char out_path[1024];
-                    snprintf(out_path, sizeof(out_path), "%s%c%s", 
-                            output_dir, PATH_SEP, file_name);
-                    
-                    FILE* out_file = fopen(out_path, "wb");
-                    if (out_file) {
-                        fwrite(out_buffer + offset, 1, out_size_processed, out_file);
-                        fclose(out_file);
-                    }
+            // Writes each folder's files as they decode
+            SplitSink* sink = &workers[w].sink;
+            sink->vt.Begin = SplitSink_Begin;
+            sink->vt.Write = SplitSink_Write;
+            sink->vt.End = SplitSink_End;
+            sink->vt.WriteStored = NULL;
+            sink->db = &db;
+            sink->in_stream = ws;
+            sink->output_dir = output_dir;
+            sink->durability = &durable;
+            sink->file = NULL;
+            sink->sparse = sparse_output;
+            sink->cache_neutral = cache_neutral;
+            sink->checkpoint = &checkpoint;
+            sink->folder = (UInt32)-1;
+            /* Lzma2DecMt checks CRCs behind End, and folder CRCs only at the folder's end */
+            sink->file_done = lzma2_threads <= 1 && verify != SEVENZIP_VERIFY_FOLDER;
+            folder_workers[w].stream = workers[w].stream;
+            folder_workers[w].sink = &sink->vt;
+        }
+        
+        // Directories and empty files
+        for (UInt32 i = 0; i < db.NumFiles; i++) {
+            if (SzArEx_IsDir(&db, i)) {
+                char dir_path[1024];
+                if (split_output_path(&workers[0].sink, i, dir_path, sizeof(dir_path))) {
+                    dir_cache_create(&dirs, dir_path);
                 }
+            } else if (db.FileToFolder[i] == (UInt32)-1) {
+                SplitSink_Begin(&workers[0].sink.vt, i);
+                SplitSink_End(&workers[0].sink.vt, i);
             }
         }
         
-        ISzAlloc_Free(&alloc_imp, out_buffer);
+        consume.db = &db;
+        res = folder_stream_decode_folders(&db, folder_workers, num_workers, ranges,
+                                           lzma2_threads, verify, password, &alloc_imp, NULL);
+        consume.db = NULL;
+        
+        // The header is in memory, so what is left is done with too
+        if (res == SZ_OK && in_stream->consume) {
+            while (consume.released < consume.volumes->count) {
+                split_consume_release(&consume, consume.released++);
+            }
+        }
+        
+        if (have_lock) {
+            for (int w = 0; w < num_workers; w++) {
+                workers[w].in_stream.progress_lock = NULL;
+            }
+            CriticalSection_Delete(&progress_lock);
+        }
     }
     
     // Cleanup
-    SzArEx_Free(&db, &alloc_imp);
-    ISzAlloc_Free(&alloc_imp, look_stream.buf);
-    close_split_volumes(&in_stream);
+    if (res == SZ_OK) folder_stream_entry_bytes(&db, NULL, &op->bytes_in, &op->bytes_out);
+    if (checkpoint_err == SEVENZIP_OK) extract_checkpoint_end(&checkpoint, res == SZ_OK);
+    SzArEx_Free(&db, &alloc_header);
+    for (int w = num_workers; w-- > 0;) {
+        split_worker_close(&workers[w], &g_MemIoAlloc);
+    }
+    free(workers);
+    if (durability_err == SEVENZIP_OK) durability_err = output_durability_end(&durable, res == SZ_OK);
+    dir_cache_free(&dirs);
+    
+    if (checkpoint_err != SEVENZIP_OK) return checkpoint_err;
+    if (res == SZ_OK && durability_err != SEVENZIP_OK) return durability_err;
+    return (res == SZ_OK) ? SEVENZIP_OK :
+           (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+}
+
+/* extract_streaming_decode(), counted in the process metrics */
+static SevenZipErrorCode extract_streaming(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    int num_threads,
+    int lzma2_threads,
+    int sparse_output,
+    int cache_neutral,
+    SevenZipDurability durability,
+    SevenZipVerifyMode verify,
+    int volume_readahead,
+    uint64_t max_memory,
+    int consume_volumes,
+    SevenZipVolumeCallback volume_consumed,
+    void* volume_user_data,
+    const char* checkpoint_path,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    MetricsOp op;
+    metrics_op_begin(&op, SEVENZIP_METRIC_EXTRACT);
+    SevenZipErrorCode err = extract_streaming_decode(archive_path, output_dir, password, num_threads,
+                                                     lzma2_threads, sparse_output, cache_neutral,
+                                                     durability, verify, volume_readahead, max_memory,
+                                                     consume_volumes, volume_consumed, volume_user_data,
+                                                     checkpoint_path, progress_callback, user_data, &op);
+    metrics_op_end(&op, err);
+    return err;
+}
+
+/**
+ * Extract a 7z archive with streaming decompression and split volume support
+ */
+SevenZipErrorCode sevenzip_extract_streaming(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    return extract_streaming(archive_path, output_dir, password, 1, 1, 0, 0,
+                             SEVENZIP_DURABILITY_NONE, SEVENZIP_VERIFY_FILE,
+                             0, 0, 0, NULL, NULL, NULL, progress_callback, user_data);
+}
+
+SevenZipErrorCode sevenzip_extract_streaming_with_options(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    int num_threads = options ? options->num_threads : 0;
+    int lzma2_threads = options ? options->lzma2_threads : 0;
+    int sparse_output = options ? options->sparse_output : 0;
+    if (num_threads <= 0) num_threads = thread_auto_count(FOLDER_STREAM_DEFAULT_WORKERS);
+    if (num_threads > FOLDER_STREAM_MAX_WORKERS) num_threads = FOLDER_STREAM_MAX_WORKERS;
     
-    return (res == SZ_OK) ? SEVENZIP_OK : SEVENZIP_ERROR_EXTRACT;
+    ThreadLease lease;
+    num_threads = thread_lease_acquire(&lease, num_threads, options ? options->thread_weight : 0);
+    thread_lease_fit(&lease, &num_threads, &lzma2_threads);
+    SevenZipErrorCode err = extract_streaming(archive_path, output_dir, password, num_threads,
+                                              lzma2_threads, sparse_output,
+                                              options ? options->cache_neutral_output : 0,
+                                              options ? options->durability : SEVENZIP_DURABILITY_NONE,
+                                              options ? options->verify : SEVENZIP_VERIFY_FILE,
+                                              options ? options->volume_readahead : 0,
+                                              options ? options->max_memory : 0,
+                                              options ? options->consume_volumes : 0,
+                                              options ? options->volume_consumed : NULL,
+                                              options ? options->volume_consumed_user_data : NULL,
+                                              options ? options->checkpoint_path : NULL,
+                                              progress_callback, user_data);
+    thread_lease_release(&lease);
+    return err;
 }
@@ -0,0 +1,351 @@
+/**
+ * 7z Coder Filters
+ *
+ * Branch converters (BCJ, ARM64, ...) applied to executable code before
+ * LZMA2. They turn relative call/jump targets into absolute addresses so
+ * repeated calls to the same function become repeated byte strings.
+ * Delta stores byte differences at a fixed distance, which suits raw
+ * multichannel samples and uncompressed pixels.
+ * The decoder side lives in lzma/C/7zDec.c.
+ */
+
+#include "archive_filters.h"
+#include "Bra.h"
+#include "mem_alloc.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 7z method IDs (big-endian byte order as stored in the header) */
+static const Byte k7zMethodBCJ[4]   = { 0x03, 0x03, 0x01, 0x03 };
+static const Byte k7zMethodPPC[4]   = { 0x03, 0x03, 0x02, 0x05 };
+static const Byte k7zMethodIA64[4]  = { 0x03, 0x03, 0x04, 0x01 };
+static const Byte k7zMethodARM[4]   = { 0x03, 0x03, 0x05, 0x01 };
+static const Byte k7zMethodARMT[4]  = { 0x03, 0x03, 0x07, 0x01 };
+static const Byte k7zMethodSPARC[4] = { 0x03, 0x03, 0x08, 0x05 };
+static const Byte k7zMethodARM64[1] = { 0x0A };
+static const Byte k7zMethodDelta[1] = { 0x03 };
+
+static uint16_t read_u16(const Byte* p, int big_endian) {
+    return big_endian ? (uint16_t)((p[0] << 8) | p[1])
+                      : (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const Byte* p, int big_endian) {
+    return big_endian ? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]
+                      : (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* ELF: e_machine at offset 18, byte order from EI_DATA */
+static SevenZipFilter detect_elf(const Byte* head, size_t size) {
+    if (size < 20) return SEVENZIP_FILTER_NONE;
+    int big_endian = (head[5] == 2);
+    switch (read_u16(head + 18, big_endian)) {
+        case 3:    /* EM_386 */
+        case 62:   /* EM_X86_64 */
+            return SEVENZIP_FILTER_BCJ;
+        case 183:  /* EM_AARCH64 */
+            return SEVENZIP_FILTER_ARM64;
+        case 40:   /* EM_ARM - modern 32-bit ARM code is mostly Thumb-2 */
+            return SEVENZIP_FILTER_ARMT;
+        case 20:   /* EM_PPC */
+        case 21:   /* EM_PPC64 */
+            /* The PPC converter handles big-endian code only */
+            return big_endian ? SEVENZIP_FILTER_PPC : SEVENZIP_FILTER_NONE;
+        case 2:    /* EM_SPARC */
+        case 18:   /* EM_SPARC32PLUS */
+        case 43:   /* EM_SPARCV9 */
+            return SEVENZIP_FILTER_SPARC;
+        case 50:   /* EM_IA_64 */
+            return SEVENZIP_FILTER_IA64;
+        default:
+            return SEVENZIP_FILTER_NONE;
+    }
+}
+
+/* PE: "MZ" stub, e_lfanew at 0x3C, then "PE\0\0" and the COFF machine field */
+static SevenZipFilter detect_pe(const Byte* head, size_t size) {
+    if (size < 0x40) return SEVENZIP_FILTER_NONE;
+    uint32_t pe_offset = read_u32(head + 0x3C, 0);
+    if (pe_offset > size - 6 || memcmp(head + pe_offset, "PE\0\0", 4) != 0) {
+        return SEVENZIP_FILTER_NONE;
+    }
+    switch (read_u16(head + pe_offset + 4, 0)) {
+        case 0x014C:  /* IMAGE_FILE_MACHINE_I386 */
+        case 0x8664:  /* IMAGE_FILE_MACHINE_AMD64 */
+            return SEVENZIP_FILTER_BCJ;
+        case 0xAA64:  /* IMAGE_FILE_MACHINE_ARM64 */
+            return SEVENZIP_FILTER_ARM64;
+        case 0x01C0:  /* IMAGE_FILE_MACHINE_ARM */
+            return SEVENZIP_FILTER_ARM;
+        case 0x01C4:  /* IMAGE_FILE_MACHINE_ARMNT (Thumb-2) */
+            return SEVENZIP_FILTER_ARMT;
+        case 0x0200:  /* IMAGE_FILE_MACHINE_IA64 */
+            return SEVENZIP_FILTER_IA64;
+        default:
+            return SEVENZIP_FILTER_NONE;
+    }
+}
+
+/* Mach-O (thin, either byte order): cputype follows the magic */
+static SevenZipFilter detect_macho(const Byte* head, size_t size, int big_endian) {
+    if (size < 8) return SEVENZIP_FILTER_NONE;
+    switch (read_u32(head + 4, big_endian)) {
+        case 7:           /* CPU_TYPE_X86 */
+        case 0x01000007:  /* CPU_TYPE_X86_64 */
+            return SEVENZIP_FILTER_BCJ;
+        case 0x0100000C:  /* CPU_TYPE_ARM64 */
+            return SEVENZIP_FILTER_ARM64;
+        case 12:          /* CPU_TYPE_ARM */
+            return SEVENZIP_FILTER_ARMT;
+        case 18:          /* CPU_TYPE_POWERPC */
+            return big_endian ? SEVENZIP_FILTER_PPC : SEVENZIP_FILTER_NONE;
+        default:
+            return SEVENZIP_FILTER_NONE;
+    }
+}
+
+SevenZipFilter sevenzip_filter_detect(const Byte* head, size_t size) {
+    if (!head || size < 4) return SEVENZIP_FILTER_NONE;
+
+    if (memcmp(head, "\x7F" "ELF", 4) == 0) {
+        return detect_elf(head, size);
+    }
+    if (head[0] == 'M' && head[1] == 'Z') {
+        return detect_pe(head, size);
+    }
+
+    uint32_t magic = read_u32(head, 0);
+    if (magic == 0xFEEDFACE || magic == 0xFEEDFACF) {
+        return detect_macho(head, size, 0);
+    }
+    if (magic == 0xCEFAEDFE || magic == 0xCFFAEDFE) {
+        return detect_macho(head, size, 1);
+    }
+
+    return SEVENZIP_FILTER_NONE;
+}
+
+SevenZipFilter sevenzip_filter_detect_file(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return SEVENZIP_FILTER_NONE;
+
+    Byte head[FILTER_DETECT_SIZE];
+    size_t got = fread(head, 1, sizeof(head), f);
+    fclose(f);
+
+    return sevenzip_filter_detect(head, got);
+}
+
+int sevenzip_extension_in_list(const char* path, const char* list) {
+    const char* dot = strrchr(path, '.');
+    const char* sep = strrchr(path, '/');
+    if (!dot || (sep && dot < sep) || dot[1] == '\0') return 0;
+    const char* ext = dot + 1;
+    size_t ext_len = strlen(ext);
+
+    const char* p = list;
+    while (*p) {
+        while (*p == ',' || *p == ' ' || *p == '.') p++;
+        const char* start = p;
+        while (*p && *p != ',' && *p != ' ') p++;
+        size_t len = (size_t)(p - start);
+        if (len == ext_len) {
+            size_t i = 0;
+            while (i < len && tolower((unsigned char)start[i]) == tolower((unsigned char)ext[i])) i++;
+            if (i == len) return 1;
+        }
+    }
+    return 0;
+}
+
+/* strcmp() ignoring ASCII case */
+static int compare_folded(const char* a, const char* b) {
+    for (;; a++, b++) {
+        int ca = tolower((unsigned char)*a);
+        int cb = tolower((unsigned char)*b);
+        if (ca != cb || ca == 0) return ca - cb;
+    }
+}
+
+int sevenzip_solid_order_compare(const char* name_a, uint64_t size_a,
+                                 const char* name_b, uint64_t size_b) {
+    const char* base_a = strrchr(name_a, '/');
+    const char* base_b = strrchr(name_b, '/');
+    base_a = base_a ? base_a + 1 : name_a;
+    base_b = base_b ? base_b + 1 : name_b;
+    const char* ext_a = strrchr(base_a, '.');
+    const char* ext_b = strrchr(base_b, '.');
+    int c = compare_folded(ext_a ? ext_a + 1 : "", ext_b ? ext_b + 1 : "");
+    if (c == 0) c = compare_folded(base_a, base_b);
+    if (c == 0) c = strcmp(base_a, base_b);
+    if (c == 0 && size_a != size_b) c = size_a < size_b ? -1 : 1;
+    return c;
+}
+
+SevenZipFilter sevenzip_filter_choose(
+    SevenZipFilter requested,
+    const char* path,
+    uint64_t size,
+    const char* delta_extensions
+) {
+    if (requested != SEVENZIP_FILTER_AUTO) {
+        return requested;
+    }
+    if (delta_extensions && path && sevenzip_extension_in_list(path, delta_extensions)) {
+        return SEVENZIP_FILTER_DELTA;
+    }
+    if (size < FILTER_DETECT_MIN_SIZE || !path) {
+        return SEVENZIP_FILTER_NONE;
+    }
+    return sevenzip_filter_detect_file(path);
+}
+
+unsigned sevenzip_filter_delta_distance(int option) {
+    if (option < 1) return 1;
+    if (option > 256) return 256;
+    return (unsigned)option;
+}
+
+size_t sevenzip_filter_write_coder(SevenZipFilter filter, unsigned delta_distance, Byte* p) {
+    const Byte* id;
+    size_t id_size = 4;
+
+    if (filter == SEVENZIP_FILTER_DELTA) {
+        /* Coder flags: 1-byte ID with properties; the property is distance - 1 */
+        p[0] = 0x21;
+        p[1] = k7zMethodDelta[0];
+        p[2] = 1;
+        p[3] = (Byte)(sevenzip_filter_delta_distance((int)delta_distance) - 1);
+        return 4;
+    }
+
+    switch (filter) {
+        case SEVENZIP_FILTER_BCJ:   id = k7zMethodBCJ; break;
+        case SEVENZIP_FILTER_PPC:   id = k7zMethodPPC; break;
+        case SEVENZIP_FILTER_IA64:  id = k7zMethodIA64; break;
+        case SEVENZIP_FILTER_ARM:   id = k7zMethodARM; break;
+        case SEVENZIP_FILTER_ARMT:  id = k7zMethodARMT; break;
+        case SEVENZIP_FILTER_SPARC: id = k7zMethodSPARC; break;
+        case SEVENZIP_FILTER_ARM64: id = k7zMethodARM64; id_size = 1; break;
+        default:
+            return 0;
+    }
+
+    /* Coder flags: simple coder, no properties, ID size in the low bits */
+    p[0] = (Byte)id_size;
+    memcpy(p + 1, id, id_size);
+    return 1 + id_size;
+}
+
+/* Convert as much of `data` as the filter allows; returns bytes processed */
+static SizeT filter_convert(FilterInStream* s, Byte* data, SizeT size) {
+    Byte* end;
+    switch (s->filter) {
+        case SEVENZIP_FILTER_BCJ:   end = z7_BranchConvSt_X86_Enc(data, size, s->pc, &s->x86_state); break;
+        case SEVENZIP_FILTER_ARM64: end = z7_BranchConv_ARM64_Enc(data, size, s->pc); break;
+        case SEVENZIP_FILTER_ARM:   end = z7_BranchConv_ARM_Enc(data, size, s->pc); break;
+        case SEVENZIP_FILTER_ARMT:  end = z7_BranchConv_ARMT_Enc(data, size, s->pc); break;
+        case SEVENZIP_FILTER_PPC:   end = z7_BranchConv_PPC_Enc(data, size, s->pc); break;
+        case SEVENZIP_FILTER_SPARC: end = z7_BranchConv_SPARC_Enc(data, size, s->pc); break;
+        case SEVENZIP_FILTER_IA64:  end = z7_BranchConv_IA64_Enc(data, size, s->pc); break;
+        case SEVENZIP_FILTER_DELTA:
+            Delta_Encode(s->delta_state, s->delta_distance, data, size);
+            return size;
+        default:
+            return size;
+    }
+    return (SizeT)(end - data);
+}
+
+static SRes FilterInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    FilterInStream* s = Z7_CONTAINER_FROM_VTBL(pp, FilterInStream, vt);
+
+    while (s->pos == s->converted) {
+        /* Keep the unconverted tail (branch look-ahead) at the buffer start */
+        if (s->pos > 0) {
+            memmove(s->buf, s->buf + s->pos, s->filled - s->pos);
+            s->filled -= s->pos;
+            s->converted = 0;
+            s->pos = 0;
+        }
+
+        if (s->eof) {
+            if (s->filled == 0) {
+                *size = 0;
+                return SZ_OK;
+            }
+            /* Too short to hold a branch: passed through unchanged */
+            s->converted = s->filled;
+            break;
+        }
+
+        while (s->filled < FILTER_BUFFER_SIZE && !s->eof) {
+            size_t n = FILTER_BUFFER_SIZE - s->filled;
+            SRes res = ISeqInStream_Read(s->src, s->buf + s->filled, &n);
+            if (res != SZ_OK) return res;
+            if (n == 0) s->eof = 1;
+            s->filled += n;
+        }
+
+        SizeT processed = filter_convert(s, s->buf, s->filled);
+        s->pc += (UInt32)processed;
+        s->converted = processed;
+    }
+
+    size_t n = s->converted - s->pos;
+    if (n > *size) n = *size;
+    memcpy(buf, s->buf + s->pos, n);
+    s->pos += n;
+    *size = n;
+    return SZ_OK;
+}
+
+SRes FilterInStream_Init(FilterInStream* s, SevenZipFilter filter, unsigned delta_distance,
+                         ISeqInStreamPtr src) {
+    memset(s, 0, sizeof(*s));
+    s->vt.Read = FilterInStream_Read;
+    s->src = src;
+    s->filter = filter;
+    s->delta_distance = sevenzip_filter_delta_distance((int)delta_distance);
+    Delta_Init(s->delta_state);
+    s->x86_state = Z7_BRANCH_CONV_ST_X86_STATE_INIT_VAL;
+    s->buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, FILTER_BUFFER_SIZE);
+    return s->buf ? SZ_OK : SZ_ERROR_MEM;
+}
+
+void FilterInStream_Free(FilterInStream* s) {
+    mem_free(s->buf);
+    s->buf = NULL;
+}
+
+void FilterDecoder_Init(FilterDecoder* d, SevenZipFilter filter, unsigned delta_distance) {
+    memset(d, 0, sizeof(*d));
+    d->filter = filter;
+    d->delta_distance = sevenzip_filter_delta_distance((int)delta_distance);
+    Delta_Init(d->delta_state);
+    d->x86_state = Z7_BRANCH_CONV_ST_X86_STATE_INIT_VAL;
+}
+
+SizeT FilterDecoder_Convert(FilterDecoder* d, Byte* data, SizeT size) {
+    Byte* end;
+    switch (d->filter) {
+        case SEVENZIP_FILTER_BCJ:   end = z7_BranchConvSt_X86_Dec(data, size, d->pc, &d->x86_state); break;
+        case SEVENZIP_FILTER_ARM64: end = z7_BranchConv_ARM64_Dec(data, size, d->pc); break;
+        case SEVENZIP_FILTER_ARM:   end = z7_BranchConv_ARM_Dec(data, size, d->pc); break;
+        case SEVENZIP_FILTER_ARMT:  end = z7_BranchConv_ARMT_Dec(data, size, d->pc); break;
+        case SEVENZIP_FILTER_PPC:   end = z7_BranchConv_PPC_Dec(data, size, d->pc); break;
+        case SEVENZIP_FILTER_SPARC: end = z7_BranchConv_SPARC_Dec(data, size, d->pc); break;
+        case SEVENZIP_FILTER_IA64:  end = z7_BranchConv_IA64_Dec(data, size, d->pc); break;
+        case SEVENZIP_FILTER_DELTA:
+            Delta_Decode(d->delta_state, d->delta_distance, data, size);
+            return size;
+        default:
+            return size;
+    }
+    SizeT processed = (SizeT)(end - data);
+    d->pc += (UInt32)processed;
+    return processed;
+}
@@ -0,0 +1,147 @@
+/**
+ * 7z Coder Filters - Internal Header
+ *
+ * Branch-converter and Delta filters that run in front of LZMA2 on the
+ * compression path, plus the detection used to pick one automatically.
+ */
+
+#ifndef SEVENZIP_ARCHIVE_FILTERS_H
+#define SEVENZIP_ARCHIVE_FILTERS_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "Delta.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes of the file start needed by sevenzip_filter_detect() */
+#define FILTER_DETECT_SIZE 4096
+
+/* Files smaller than this are not worth probing for an executable header */
+#define FILTER_DETECT_MIN_SIZE 4096
+
+/* Conversion buffer used by FilterInStream */
+#define FILTER_BUFFER_SIZE (1 << 16)
+
+/**
+ * Pick a branch filter from the start of a file
+ * Recognizes ELF, PE and Mach-O executables.
+ * @param head First bytes of the file
+ * @param size Number of bytes in head (up to FILTER_DETECT_SIZE)
+ * @return Matching filter, or SEVENZIP_FILTER_NONE
+ */
+SevenZipFilter sevenzip_filter_detect(const Byte* head, size_t size);
+
+/**
+ * Read the start of a file and pick a branch filter for it
+ * @param path Filesystem path
+ * @return Matching filter, or SEVENZIP_FILTER_NONE if unknown or unreadable
+ */
+SevenZipFilter sevenzip_filter_detect_file(const char* path);
+
+/**
+ * Case-insensitive match of a path's extension against a list
+ * @param list Extensions separated by commas or spaces, with or without
+ *             the dot ("wav,raw,.bmp")
+ * @return 1 if the extension after the last '.' of the file name is listed
+ */
+int sevenzip_extension_in_list(const char* path, const char* list);
+
+/**
+ * Order of two files in a sorted solid stream (7-Zip's -mqs): by
+ * extension, case-insensitive, then file name, then size, so files of
+ * one type, and with them one filter, form contiguous runs
+ * @param name_a Archive name of the first file ('/'-separated)
+ * @return <0, 0 or >0 as the first file goes before, level with or after
+ *         the second; callers keep scan order among equal files
+ */
+int sevenzip_solid_order_compare(const char* name_a, uint64_t size_a,
+                                 const char* name_b, uint64_t size_b);
+
+/**
+ * Resolve the requested filter for one file
+ * AUTO applies Delta to files matching `delta_extensions` and probes the
+ * rest for executable headers; any other request is returned unchanged.
+ * @param requested Filter from the options
+ * @param path Filesystem path (probed only in AUTO mode)
+ * @param size File size in bytes
+ * @param delta_extensions Comma-separated extensions for Delta (NULL = none)
+ * @return Filter to use for this file
+ */
+SevenZipFilter sevenzip_filter_choose(
+    SevenZipFilter requested,
+    const char* path,
+    uint64_t size,
+    const char* delta_extensions
+);
+
+/**
+ * Clamp a delta_distance option to the 1-256 range 7z supports
+ */
+unsigned sevenzip_filter_delta_distance(int option);
+
+/**
+ * Write the 7z coder record (flags, method ID, properties) for a filter
+ * @param filter Filter other than AUTO/NONE
+ * @param delta_distance Byte distance for SEVENZIP_FILTER_DELTA (1-256)
+ * @param p Output buffer (at least 5 bytes)
+ * @return Number of bytes written, 0 if the filter has no coder
+ */
+size_t sevenzip_filter_write_coder(SevenZipFilter filter, unsigned delta_distance, Byte* p);
+
+/* Input stream that applies a filter to the data read from `src` */
+typedef struct {
+    ISeqInStream vt;
+    ISeqInStreamPtr src;
+    SevenZipFilter filter;
+    unsigned delta_distance;
+    Byte delta_state[DELTA_STATE_SIZE];
+    Byte* buf;
+    size_t pos;        /* Next converted byte to hand out */
+    size_t converted;  /* End of converted data in buf */
+    size_t filled;     /* End of valid data in buf */
+    UInt32 pc;
+    UInt32 x86_state;
+    int eof;
+} FilterInStream;
+
+/**
+ * Initialize a filter stream over `src`
+ * @return SZ_OK, or SZ_ERROR_MEM if the conversion buffer cannot be allocated
+ */
+SRes FilterInStream_Init(FilterInStream* s, SevenZipFilter filter, unsigned delta_distance,
+                         ISeqInStreamPtr src);
+
+/**
+ * Release the conversion buffer
+ */
+void FilterInStream_Free(FilterInStream* s);
+
+/* Inverse of a filter for data pushed through it in order, as the
+   decoding side of FilterInStream */
+typedef struct {
+    SevenZipFilter filter;
+    unsigned delta_distance;
+    Byte delta_state[DELTA_STATE_SIZE];
+    UInt32 pc;
+    UInt32 x86_state;
+} FilterDecoder;
+
+void FilterDecoder_Init(FilterDecoder* d, SevenZipFilter filter, unsigned delta_distance);
+
+/**
+ * Restore as much of `data` as the filter allows, in place
+ * @return Bytes restored; the rest (branch look-ahead) must be passed
+ *         again with the data after it, or kept as is at the end
+ */
+SizeT FilterDecoder_Convert(FilterDecoder* d, Byte* data, SizeT size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ARCHIVE_FILTERS_H */
@@ -0,0 +1,240 @@
+/**
+ * Open Archive Handle
+ *
+ * Opens an archive (single file, split volumes, or a caller's ranged
+ * reader) and parses its header once for any number of list and extract
+ * calls, and gives each call a reader of its own.
+ */
+
+#include "archive_handle.h"
+#include "archive_vfs.h"
+#include "7zCrc.h"
+#include "key_cache.h"
+#include "mem_alloc.h"
+#include "global_tables.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARCHIVE_LOOK_BUF_SIZE (1 << 18)   // 256KB read buffer when the volumes are not mapped
+
+/* A zeroed handle with its locks and caches set up, keeping a copy of `password` */
+static SevenZipArchive* archive_alloc(const char* password) {
+    SevenZipArchive* a = (SevenZipArchive*)calloc(1, sizeof(SevenZipArchive));
+    if (!a) {
+        return NULL;
+    }
+    if (password) {
+        size_t size = strlen(password) + 1;
+        a->password = (char*)malloc(size);
+        if (!a->password) {
+            free(a);
+            return NULL;
+        }
+        memcpy(a->password, password, size);
+    }
+    a->alloc = g_MemDecoderAlloc;  /* Dictionaries may use huge pages */
+    a->cache_limit = ARCHIVE_FOLDER_CACHE_MAX;
+    a->cache_budget = ARCHIVE_FOLDER_CACHE_BUDGET;
+    SzArEx_Init(&a->db);
+    if (pthread_mutex_init(&a->cache_lock, NULL) != 0) {
+        free(a->password);
+        free(a);
+        return NULL;
+    }
+    if (pthread_mutex_init(&a->vfs_lock, NULL) != 0) {
+        pthread_mutex_destroy(&a->cache_lock);
+        free(a->password);
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+/* Read through a look buffer over `real`, which must outlive it */
+static int archive_look_open(CLookToRead2* look, ISeekInStreamPtr real) {
+    LookToRead2_CreateVTable(look, False);
+    look->buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, ARCHIVE_LOOK_BUF_SIZE);
+    if (!look->buf) return 0;
+    look->bufSize = ARCHIVE_LOOK_BUF_SIZE;
+    look->realStream = real;
+    LookToRead2_INIT(look);
+    return 1;
+}
+
+/* Parse the header through a->stream; the handle is closed on failure */
+static SevenZipErrorCode archive_parse(SevenZipArchive* a, SevenZipArchive** archive) {
+    SRes res = SzArEx_Open(&a->db, a->stream, &g_MemHeaderAlloc, &g_MemHeaderAlloc);
+    if (res != SZ_OK) {
+        sevenzip_close(a);
+        return (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    *archive = a;
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_open(
+    const char* archive_path,
+    const char* password,
+    SevenZipArchive** archive
+) {
+    if (!archive_path || !archive) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    *archive = NULL;
+
+    global_tables_init();
+
+    SevenZipArchive* a = archive_alloc(password);
+    if (!a) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    /* Volumes mapped, else read through a look buffer */
+    if (!volume_set_open(&a->volumes, archive_path, 0)) {
+        sevenzip_close(a);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    if (!a->volumes.parity &&
+        mmap_in_stream_open_files(&a->mapped, a->volumes.files, a->volumes.sizes,
+                                  a->volumes.count)) {
+        a->mapped.readahead = a->volumes.readahead;
+        a->stream = &a->mapped.vt;
+    } else {
+        volume_in_stream_init(&a->in_stream, &a->volumes);
+        if (!archive_look_open(&a->look_stream, &a->in_stream.vt)) {
+            sevenzip_close(a);
+            return SEVENZIP_ERROR_MEMORY;
+        }
+        a->stream = &a->look_stream.vt;
+    }
+    return archive_parse(a, archive);
+}
+
+SevenZipErrorCode sevenzip_open_range(
+    const SevenZipRangeReader* reader,
+    const char* password,
+    SevenZipArchive** archive
+) {
+    if (!reader || !reader->read_at || !archive) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    *archive = NULL;
+
+    global_tables_init();
+
+    SevenZipArchive* a = archive_alloc(password);
+    if (!a) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    a->remote = (RangeSource*)mem_calloc(SEVENZIP_MEM_OTHER, 1, sizeof(RangeSource));
+    if (!a->remote || !range_source_open(a->remote, reader)) {
+        mem_free(a->remote);
+        a->remote = NULL;
+        sevenzip_close(a);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    range_in_stream_init(&a->range_stream, a->remote);
+    if (!archive_look_open(&a->look_stream, &a->range_stream.vt)) {
+        sevenzip_close(a);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    a->stream = &a->look_stream.vt;
+    return archive_parse(a, archive);
+}
+
+void archive_cache_unref(ArchiveFolderCache* c) {
+    if (--c->refs == 0) {
+        mem_free(c->data);
+        mem_free(c);
+    }
+}
+
+void archive_cache_evict(SevenZipArchive* archive, ArchiveFolderCache* c) {
+    if (c->prev) c->prev->next = c->next;
+    else archive->cache_head = c->next;
+    if (c->next) c->next->prev = c->prev;
+    else archive->cache_tail = c->prev;
+    c->prev = c->next = NULL;
+    archive->cache_bytes -= c->capacity;
+    archive_cache_unref(c);
+}
+
+void archive_cache_trim(SevenZipArchive* archive) {
+    ArchiveFolderCache* c = archive->cache_tail;
+    while (c) {
+        ArchiveFolderCache* prev = c->prev;
+        if (c->ready && (c->capacity > archive->cache_limit ||
+                         archive->cache_bytes > archive->cache_budget)) {
+            archive_cache_evict(archive, c);
+        }
+        c = prev;
+    }
+}
+
+void sevenzip_archive_set_folder_cache(SevenZipArchive* archive, uint64_t max_folder_size) {
+    if (!archive) return;
+    if (max_folder_size > ARCHIVE_FOLDER_CACHE_MAX) max_folder_size = ARCHIVE_FOLDER_CACHE_MAX;
+    pthread_mutex_lock(&archive->cache_lock);
+    archive->cache_limit = (size_t)max_folder_size;
+    archive_cache_trim(archive);
+    pthread_mutex_unlock(&archive->cache_lock);
+}
+
+void sevenzip_archive_set_cache_budget(SevenZipArchive* archive, uint64_t total_bytes) {
+    if (!archive) return;
+    if (total_bytes > SIZE_MAX) total_bytes = SIZE_MAX;
+    pthread_mutex_lock(&archive->cache_lock);
+    archive->cache_budget = (size_t)total_bytes;
+    archive_cache_trim(archive);
+    pthread_mutex_unlock(&archive->cache_lock);
+}
+
+SRes archive_reader_open(ArchiveReader* reader, SevenZipArchive* archive) {
+    memset(reader, 0, sizeof(*reader));
+    if (archive->stream == &archive->mapped.vt) {
+        mmap_in_stream_share(&reader->mapped, &archive->mapped);
+        reader->stream = &reader->mapped.vt;
+        return SZ_OK;
+    }
+    ISeekInStreamPtr real;
+    if (archive->remote) {
+        range_in_stream_init(&reader->range_stream, archive->remote);
+        real = &reader->range_stream.vt;
+    } else {
+        volume_in_stream_init(&reader->in_stream, &archive->volumes);
+        real = &reader->in_stream.vt;
+    }
+    if (!archive_look_open(&reader->look_stream, real)) return SZ_ERROR_MEM;
+    reader->stream = &reader->look_stream.vt;
+    return SZ_OK;
+}
+
+void archive_reader_close(ArchiveReader* reader) {
+    ISzAlloc_Free(&g_MemIoAlloc, reader->look_stream.buf);
+    mmap_in_stream_close(&reader->mapped);
+    memset(reader, 0, sizeof(*reader));
+}
+
+void sevenzip_close(SevenZipArchive* archive) {
+    if (!archive) return;
+    SzArEx_Free(&archive->db, &archive->alloc);
+    while (archive->cache_head) {
+        archive_cache_evict(archive, archive->cache_head);
+    }
+    pthread_mutex_destroy(&archive->cache_lock);
+    archive_vfs_free(archive->vfs);
+    pthread_mutex_destroy(&archive->vfs_lock);
+    ISzAlloc_Free(&g_MemIoAlloc, archive->look_stream.buf);
+    mmap_in_stream_close(&archive->mapped);
+    volume_set_close(&archive->volumes);
+    if (archive->remote) {
+        range_source_close(archive->remote);
+        mem_free(archive->remote);
+    }
+    if (archive->password) {
+        key_cache_zero(archive->password, strlen(archive->password));
+        free(archive->password);
+    }
+    free(archive);
+}
@@ -0,0 +1,118 @@
+/**
+ * Open Archive Handle - Internal Header
+ *
+ * State behind SevenZipArchive: the volumes (or the remote blocks) and
+ * reader the header was parsed from, the parsed database, and the
+ * folders decoded whole.
+ * Entries of a folder up to ARCHIVE_FOLDER_CACHE_MAX unpacked bytes are
+ * served by decoding the folder once into the cache and copying from it;
+ * every file's CRC is checked when the folder is decoded. The cache holds
+ * as many folders as fit in `cache_budget` and drops the least recently
+ * read first, so callers that come back to a few hot folders pay one
+ * decode each. Larger folders stream only the requested entry, from the
+ * nearest point the coder can start at.
+ *
+ * Calls may run on several threads at once. The database is only read
+ * after the open; each call reads the archive through its own
+ * ArchiveReader (positioned reads, or its own view of the mappings) and
+ * its own decoder state. The cache is shared under `cache_lock`: a call
+ * copies from a folder holding a reference, so dropping it from the
+ * cache frees it only once the last copy is done, and while one call
+ * fills a folder the others stream their entry of it instead of
+ * decoding it again.
+ */
+
+#ifndef SEVENZIP_ARCHIVE_HANDLE_H
+#define SEVENZIP_ARCHIVE_HANDLE_H
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "mmap_stream.h"
+#include "range_stream.h"
+#include "volume_stream.h"
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Largest folder kept decoded between calls */
+#define ARCHIVE_FOLDER_CACHE_MAX (64 << 20)
+
+/* Default total of the folders kept decoded */
+#define ARCHIVE_FOLDER_CACHE_BUDGET (64 << 20)
+
+/* A folder decoded whole, or being decoded */
+typedef struct ArchiveFolderCache {
+    UInt32 folder;
+    Byte* data;
+    size_t capacity;
+    int refs;                 /* Calls copying from it, plus 1 while the handle holds it */
+    int ready;                /* Decoded; until then only the filling call uses it */
+    struct ArchiveFolderCache* prev;  /* Toward the most recently read */
+    struct ArchiveFolderCache* next;
+} ArchiveFolderCache;
+
+struct SevenZipArchive {
+    VolumeSet volumes;
+    MmapInStream mapped;
+    RangeSource* remote;      /* sevenzip_open_range(): the blocks fetched, else NULL */
+    RangeInStream range_stream;
+    VolumeInStream in_stream;
+    CLookToRead2 look_stream;
+    ILookInStreamPtr stream;  /* &mapped.vt, or the buffered reader; the open only */
+    ISzAlloc alloc;
+    CSzArEx db;
+    char* password;           /* Copy of the open's password for 7zAES folders, or NULL */
+
+    /* Folders decoded whole, most recently read first; `cache_lock`
+     * guards these */
+    pthread_mutex_t cache_lock;
+    ArchiveFolderCache* cache_head;
+    ArchiveFolderCache* cache_tail;
+    size_t cache_bytes;       /* Capacity of the folders in the list */
+    size_t cache_limit;       /* Largest folder cached (0 = none) */
+    size_t cache_budget;      /* Most bytes the list holds (0 = none) */
+
+    /* Path tree of sevenzip_archive_stat/readdir, built on first use */
+    pthread_mutex_t vfs_lock;
+    struct ArchiveVfs* vfs;
+};
+
+/* The archive as one call reads it */
+typedef struct {
+    MmapInStream mapped;
+    RangeInStream range_stream;
+    VolumeInStream in_stream;
+    CLookToRead2 look_stream;
+    ILookInStreamPtr stream;
+} ArchiveReader;
+
+/* A reader of its own for one call; SZ_ERROR_MEM without a look buffer */
+SRes archive_reader_open(ArchiveReader* reader, SevenZipArchive* archive);
+
+void archive_reader_close(ArchiveReader* reader);
+
+/* Drop a reference to a cached folder; the caller holds `cache_lock` */
+void archive_cache_unref(ArchiveFolderCache* c);
+
+/* Take a folder out of the list, dropping the list's reference; the
+ * caller holds `cache_lock` */
+void archive_cache_evict(SevenZipArchive* archive, ArchiveFolderCache* c);
+
+/* Drop decoded folders, least recently read first, until the list fits
+ * the limits again; folders still being filled are left to their caller.
+ * The caller holds `cache_lock` */
+void archive_cache_trim(SevenZipArchive* archive);
+
+/* Entries [first, first + count) of a parsed database as one
+ * sevenzip_free_list() block (archive_list.c) */
+SevenZipErrorCode list_entries(const CSzArEx* db, UInt32 first, UInt32 count,
+                               SevenZipList** list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ARCHIVE_HANDLE_H */
@@ -0,0 +1,230 @@
+/**
+ * 7z Header Encoding
+ *
+ * The plain header is built in a HeaderBuffer, which grows geometrically
+ * instead of taking a capacity estimated from the file count.
+ *
+ * A header with millions of entries is mostly names, sizes and times that
+ * compress very well. 7-Zip stores such headers as one LZMA stream placed
+ * after the packed data, described by a small kEncodedHeader record whose
+ * layout is that of a one-folder StreamsInfo. The reader side is
+ * SzReadAndDecodePackedStreams() in lzma/C/7zArcIn.c.
+ */
+
+#include "archive_header.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
+#include "LzmaEnc.h"
+#include "mem_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Property IDs used by the record */
+enum {
+    k7zIdEnd = 0x00,
+    k7zIdPackInfo = 0x06,
+    k7zIdUnpackInfo = 0x07,
+    k7zIdSize = 0x09,
+    k7zIdCRC = 0x0A,
+    k7zIdFolder = 0x0B,
+    k7zIdCodersUnpackSize = 0x0C,
+    k7zIdEncodedHeader = 0x17
+};
+
+static const Byte k7zMethodLZMA[3] = { 0x03, 0x01, 0x01 };
+
+/* Upper bound of the record: ids, five 9-byte numbers, coder and CRC */
+#define HEADER_RECORD_MAX 96
+
+static void write_number(Byte** buf, uint64_t value) {
+    Byte* p = *buf;
+    int extra = 0;
+
+    while (extra < 8 && value >= ((uint64_t)1 << (7 * (extra + 1)))) {
+        extra++;
+    }
+    if (extra == 8) {
+        *p++ = 0xFF;
+    } else {
+        /* Leading 1-bits count the extra bytes, high bits of value follow */
+        *p++ = (Byte)((0xFF00 >> extra) | (value >> (8 * extra)));
+    }
+    for (int i = 0; i < extra; i++) {
+        *p++ = (Byte)(value >> (8 * i));
+    }
+    *buf = p;
+}
+
+/* Numbers take at most 9 bytes */
+#define NUMBER_MAX_SIZE 9
+
+/* First allocation; enough for a few hundred entries */
+#define HEADER_BUFFER_INITIAL (64 * 1024)
+
+void header_buffer_init(HeaderBuffer* hb) {
+    memset(hb, 0, sizeof(*hb));
+}
+
+void header_buffer_free(HeaderBuffer* hb) {
+    mem_free(hb->data);
+    header_buffer_init(hb);
+}
+
+Byte* header_buffer_reserve(HeaderBuffer* hb, size_t size) {
+    if (hb->failed) return NULL;
+    if (size > hb->capacity - hb->size) {
+        size_t capacity = hb->capacity ? hb->capacity : HEADER_BUFFER_INITIAL;
+        while (size > capacity - hb->size) {
+            if (capacity > SIZE_MAX / 2) {
+                hb->failed = 1;
+                return NULL;
+            }
+            capacity *= 2;
+        }
+        Byte* data = (Byte*)mem_realloc(SEVENZIP_MEM_HEADER, hb->data, capacity);
+        if (!data) {
+            hb->failed = 1;
+            return NULL;
+        }
+        hb->data = data;
+        hb->capacity = capacity;
+    }
+    return hb->data + hb->size;
+}
+
+void header_buffer_commit(HeaderBuffer* hb, size_t size) {
+    if (!hb->failed) hb->size += size;
+}
+
+void header_buffer_byte(HeaderBuffer* hb, Byte value) {
+    Byte* p = header_buffer_reserve(hb, 1);
+    if (!p) return;
+    *p = value;
+    hb->size++;
+}
+
+void header_buffer_bytes(HeaderBuffer* hb, const void* data, size_t size) {
+    Byte* p = header_buffer_reserve(hb, size);
+    if (!p || size == 0) return;
+    memcpy(p, data, size);
+    hb->size += size;
+}
+
+void header_buffer_number(HeaderBuffer* hb, uint64_t value) {
+    Byte* p = header_buffer_reserve(hb, NUMBER_MAX_SIZE);
+    if (!p) return;
+    Byte* end = p;
+    write_number(&end, value);
+    hb->size += (size_t)(end - p);
+}
+
+void header_buffer_uint32(HeaderBuffer* hb, uint32_t value) {
+    Byte* p = header_buffer_reserve(hb, 4);
+    if (!p) return;
+    SetUi32(p, value);
+    hb->size += 4;
+}
+
+void header_buffer_uint64(HeaderBuffer* hb, uint64_t value) {
+    Byte* p = header_buffer_reserve(hb, 8);
+    if (!p) return;
+    SetUi64(p, value);
+    hb->size += 8;
+}
+
+void header_bits_begin(HeaderBits* bits, HeaderBuffer* hb) {
+    bits->hb = hb;
+    bits->bits = 0;
+    bits->count = 0;
+}
+
+void header_bits_put(HeaderBits* bits, int set) {
+    if (set) bits->bits |= (Byte)(0x80 >> bits->count);
+    if (++bits->count == 8) {
+        header_buffer_byte(bits->hb, bits->bits);
+        bits->bits = 0;
+        bits->count = 0;
+    }
+}
+
+void header_bits_end(HeaderBits* bits) {
+    if (bits->count) header_buffer_byte(bits->hb, bits->bits);
+    bits->bits = 0;
+    bits->count = 0;
+}
+
+int sevenzip_encode_header(const Byte* header, size_t header_size, uint64_t pack_pos,
+                           Byte** out, size_t* out_size, size_t* record_offset) {
+    *out = NULL;
+    *out_size = 0;
+    *record_offset = 0;
+
+    /* Room for no more than the plain header: a larger result is useless */
+    if (header_size <= HEADER_RECORD_MAX) {
+        return 0;
+    }
+    size_t capacity = header_size;
+    Byte* buf = (Byte*)mem_alloc(SEVENZIP_MEM_HEADER, capacity);
+    if (!buf) {
+        return 0;
+    }
+
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = 5;
+    props.dictSize = HEADER_DICT_SIZE;
+    props.fb = 273;
+    props.reduceSize = header_size;
+    props.numThreads = 2;
+
+    Byte coder_props[LZMA_PROPS_SIZE];
+    SizeT coder_props_size = LZMA_PROPS_SIZE;
+    SizeT packed_size = capacity - HEADER_RECORD_MAX;
+    SRes res = LzmaEncode(buf, &packed_size, header, header_size, &props,
+                          coder_props, &coder_props_size, 0, NULL,
+                          &g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    if (res != SZ_OK || coder_props_size != LZMA_PROPS_SIZE) {
+        /* SZ_ERROR_OUTPUT_EOF: the header does not shrink enough */
+        mem_free(buf);
+        return 0;
+    }
+
+    Byte* p = buf + packed_size;
+    *p++ = k7zIdEncodedHeader;
+
+    *p++ = k7zIdPackInfo;
+    write_number(&p, pack_pos);
+    write_number(&p, 1);
+    *p++ = k7zIdSize;
+    write_number(&p, packed_size);
+    *p++ = k7zIdEnd;
+
+    *p++ = k7zIdUnpackInfo;
+    *p++ = k7zIdFolder;
+    write_number(&p, 1);      /* One folder */
+    *p++ = 0;                 /* Not external */
+    write_number(&p, 1);      /* One coder */
+    *p++ = (Byte)(sizeof(k7zMethodLZMA) | 0x20);  /* ID size, has properties */
+    memcpy(p, k7zMethodLZMA, sizeof(k7zMethodLZMA));
+    p += sizeof(k7zMethodLZMA);
+    write_number(&p, LZMA_PROPS_SIZE);
+    memcpy(p, coder_props, LZMA_PROPS_SIZE);
+    p += LZMA_PROPS_SIZE;
+    *p++ = k7zIdCodersUnpackSize;
+    write_number(&p, header_size);
+    *p++ = k7zIdCRC;
+    *p++ = 1;                 /* All CRCs defined */
+    uint32_t crc = CrcCalc(header, header_size);
+    for (int i = 0; i < 4; i++) {
+        *p++ = (Byte)(crc >> (8 * i));
+    }
+    *p++ = k7zIdEnd;
+
+    *p++ = k7zIdEnd;          /* End of StreamsInfo */
+
+    *out = buf;
+    *out_size = (size_t)(p - buf);
+    *record_offset = packed_size;
+    return 1;
+}
@@ -0,0 +1,103 @@
+/**
+ * 7z Header Encoding - Internal Header
+ *
+ * Building the plain archive header, and its compression into a
+ * kEncodedHeader record, shared by the create paths that write the 7z
+ * header by hand.
+ */
+
+#ifndef SEVENZIP_ARCHIVE_HEADER_H
+#define SEVENZIP_ARCHIVE_HEADER_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Dictionary of the header coder, as used by 7-Zip for headers */
+#define HEADER_DICT_SIZE (1 << 20)
+
+/* Room to reserve for a coder record written in place (PPMd, filter, AES) */
+#define HEADER_CODER_MAX 32
+
+/**
+ * Growable buffer a plain header is written into front to back
+ * Nothing is sized up front: capacity doubles as properties are added, so
+ * building stays linear and holds at most twice the header, and every write
+ * is bounds checked. After an allocation failure the writes are dropped
+ * and `failed` is set; callers check it once, when the header is done.
+ */
+typedef struct {
+    Byte* data;
+    size_t size;
+    size_t capacity;
+    int failed;
+} HeaderBuffer;
+
+/* Empty buffer; the first write allocates */
+void header_buffer_init(HeaderBuffer* hb);
+
+/* Release the buffer (and reset it to empty) */
+void header_buffer_free(HeaderBuffer* hb);
+
+/**
+ * Room for `size` more bytes at the end of the buffer
+ * Writing there adds nothing until header_buffer_commit() says how many
+ * bytes were used; the pointer is valid until the next write.
+ * @return Write position, or NULL once an allocation has failed
+ */
+Byte* header_buffer_reserve(HeaderBuffer* hb, size_t size);
+
+/* Add `size` bytes written at the reserved position */
+void header_buffer_commit(HeaderBuffer* hb, size_t size);
+
+void header_buffer_byte(HeaderBuffer* hb, Byte value);
+void header_buffer_bytes(HeaderBuffer* hb, const void* data, size_t size);
+
+/* 7z variable-length number (1-9 bytes) */
+void header_buffer_number(HeaderBuffer* hb, uint64_t value);
+
+/* Little-endian fixed-size values (CRCs, attributes, FILETIMEs) */
+void header_buffer_uint32(HeaderBuffer* hb, uint32_t value);
+void header_buffer_uint64(HeaderBuffer* hb, uint64_t value);
+
+/* 7z bit vector (first item in the high bit), written one item at a time */
+typedef struct {
+    HeaderBuffer* hb;
+    Byte bits;
+    unsigned count;
+} HeaderBits;
+
+void header_bits_begin(HeaderBits* bits, HeaderBuffer* hb);
+void header_bits_put(HeaderBits* bits, int set);
+
+/* Write the last, zero-padded byte */
+void header_bits_end(HeaderBits* bits);
+
+/**
+ * LZMA-compress a plain header (starting with kHeader)
+ * The result is the packed stream followed by the kEncodedHeader record
+ * that describes it; it is written where the plain header would go.
+ * The start header then points at the record, not at the stream.
+ * @param header Plain header bytes
+ * @param header_size Size of the plain header
+ * @param pack_pos Offset of the packed stream from the end of the
+ *                 signature header (the archive's packed data size)
+ * @param out Output: packed stream + record (caller frees with mem_free())
+ * @param out_size Output: total size of *out
+ * @param record_offset Output: offset of the record within *out
+ * @return 1 if encoded, 0 if the plain header should be written instead
+ *         (compression does not shrink it, or out of memory)
+ */
+int sevenzip_encode_header(const Byte* header, size_t header_size, uint64_t pack_pos,
+                           Byte** out, size_t* out_size, size_t* record_offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ARCHIVE_HEADER_H */
@@ -0,0 +1,292 @@
+/**
+ * Archive Index
+ *
+ * The records are encoded field by field, so the file is the same on
+ * every host; a list then copies the string table over in one piece and
+ * points the entry names into it.
+ */
+
+#include "archive_index.h"
+#include "mem_alloc.h"
+#include "global_tables.h"
+#include "../lzma/C/7zCrc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+
+#define INDEX_MAGIC "7zFFIidx"
+#define INDEX_MAGIC_SIZE 8
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 64
+#define INDEX_ENTRY_SIZE 40
+#define INDEX_FOLDER_SIZE 32
+#define INDEX_VOLUME_SIZE 8
+
+/* Larger than any index a name-limited archive can have: a corrupt count
+ * fails here instead of in an allocation */
+#define INDEX_MAX_SIZE ((uint64_t)1 << 40)
+
+void archive_index_writer_init(ArchiveIndexWriter* w) {
+    memset(w, 0, sizeof(*w));
+}
+
+void archive_index_writer_free(ArchiveIndexWriter* w) {
+    mem_free(w->data);
+    mem_free(w->names);
+    memset(w, 0, sizeof(*w));
+}
+
+/* Append `size` bytes to the buffer at `*buf` */
+static void index_put(ArchiveIndexWriter* w, unsigned char** buf, size_t* used, size_t* capacity,
+                      const void* data, size_t size) {
+    if (w->failed) return;
+    if (*used + size > *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 4096;
+        while (grown < *used + size) grown *= 2;
+        unsigned char* p = (unsigned char*)mem_realloc(SEVENZIP_MEM_HEADER, *buf, grown);
+        if (!p) {
+            w->failed = 1;
+            return;
+        }
+        *buf = p;
+        *capacity = grown;
+    }
+    memcpy(*buf + *used, data, size);
+    *used += size;
+}
+
+static void put_u32(unsigned char* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_u64(unsigned char* p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+void archive_index_add_entry(ArchiveIndexWriter* w, const char* name, const ArchiveIndexEntry* entry) {
+    unsigned char rec[INDEX_ENTRY_SIZE];
+    put_u64(rec, entry->size);
+    put_u64(rec + 8, entry->mtime);
+    put_u64(rec + 16, w->names_size);
+    put_u32(rec + 24, entry->folder);
+    put_u32(rec + 28, entry->attrib);
+    put_u32(rec + 32, entry->crc);
+    put_u32(rec + 36, entry->flags);
+    index_put(w, &w->data, &w->size, &w->capacity, rec, sizeof(rec));
+    index_put(w, &w->names, &w->names_size, &w->names_capacity, name, strlen(name) + 1);
+    w->entry_count++;
+}
+
+void archive_index_add_folder(ArchiveIndexWriter* w, const ArchiveIndexFolder* folder) {
+    unsigned char rec[INDEX_FOLDER_SIZE];
+    put_u64(rec, folder->pack_offset);
+    put_u64(rec + 8, folder->pack_size);
+    put_u64(rec + 16, folder->unpack_size);
+    put_u32(rec + 24, folder->num_files);
+    put_u32(rec + 28, folder->flags);
+    index_put(w, &w->data, &w->size, &w->capacity, rec, sizeof(rec));
+    w->folder_count++;
+}
+
+void archive_index_add_volume(ArchiveIndexWriter* w, uint64_t size) {
+    unsigned char rec[INDEX_VOLUME_SIZE];
+    put_u64(rec, size);
+    index_put(w, &w->data, &w->size, &w->capacity, rec, sizeof(rec));
+    w->volume_count++;
+}
+
+void archive_index_path(char* buffer, size_t size, const char* archive_path) {
+    snprintf(buffer, size, "%s%s", archive_path, ARCHIVE_INDEX_SUFFIX);
+}
+
+int archive_index_write(const ArchiveIndexWriter* w, const char* path) {
+    if (w->failed) return 0;
+    global_tables_init();
+
+    unsigned char header[INDEX_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    put_u32(header + 8, INDEX_VERSION);
+    put_u64(header + 16, w->entry_count);
+    put_u64(header + 24, w->folder_count);
+    put_u64(header + 32, w->volume_count);
+    put_u64(header + 40, w->names_size);
+    UInt32 crc = CrcUpdate(CRC_INIT_VAL, header + 16, INDEX_HEADER_SIZE - 16);
+    crc = CrcUpdate(crc, w->data, w->size);
+    crc = CrcUpdate(crc, w->names, w->names_size);
+    put_u32(header + 12, CRC_GET_DIGEST(crc));
+
+    char tmp_path[1300];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) return 0;
+    int ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) &&
+             fwrite(w->data, 1, w->size, f) == w->size &&
+             fwrite(w->names, 1, w->names_size, f) == w->names_size;
+    ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp_path, path) == 0;
+#endif
+    if (!ok) remove(tmp_path);
+    return ok;
+}
+
+SevenZipErrorCode archive_index_read(ArchiveIndexReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    FILE* f = fopen(path, "rb");
+    if (!f) return SEVENZIP_ERROR_OPEN_FILE;
+    unsigned char header[INDEX_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+        memcmp(header, INDEX_MAGIC, INDEX_MAGIC_SIZE) != 0 ||
+        get_u32(header + 8) != INDEX_VERSION) {
+        fclose(f);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+
+    uint64_t entries = get_u64(header + 16);
+    uint64_t folders = get_u64(header + 24);
+    uint64_t volumes = get_u64(header + 32);
+    uint64_t names = get_u64(header + 40);
+    if (entries > INDEX_MAX_SIZE || folders > INDEX_MAX_SIZE || volumes > INDEX_MAX_SIZE ||
+        names > INDEX_MAX_SIZE) {
+        fclose(f);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    uint64_t total = INDEX_HEADER_SIZE + entries * INDEX_ENTRY_SIZE + folders * INDEX_FOLDER_SIZE +
+                     volumes * INDEX_VOLUME_SIZE + names;
+    if (total > INDEX_MAX_SIZE || total != (size_t)total) {
+        fclose(f);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+
+    unsigned char* buf = (unsigned char*)mem_alloc(SEVENZIP_MEM_HEADER, (size_t)total);
+    if (!buf) {
+        fclose(f);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    memcpy(buf, header, sizeof(header));
+    size_t body = (size_t)total - INDEX_HEADER_SIZE;
+    int ok = fread(buf + INDEX_HEADER_SIZE, 1, body, f) == body && fgetc(f) == EOF;
+    fclose(f);
+    if (ok) {
+        global_tables_init();
+        ok = CrcCalc(buf + 16, (size_t)total - 16) == get_u32(buf + 12);
+    }
+    if (ok && names > 0) {
+        ok = buf[total - 1] == '\0';
+    }
+    if (!ok) {
+        mem_free(buf);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    r->data = buf;
+    r->size = (size_t)total;
+    r->entry_count = entries;
+    r->folder_count = folders;
+    r->volume_count = volumes;
+    r->names_size = (size_t)names;
+    r->names = (const char*)buf + r->size - r->names_size;
+    return SEVENZIP_OK;
+}
+
+void archive_index_reader_free(ArchiveIndexReader* r) {
+    mem_free(r->data);
+    memset(r, 0, sizeof(*r));
+}
+
+int archive_index_get_entry(const ArchiveIndexReader* r, uint64_t i, ArchiveIndexEntry* entry,
+                            const char** name) {
+    const unsigned char* rec = r->data + INDEX_HEADER_SIZE + i * INDEX_ENTRY_SIZE;
+    entry->size = get_u64(rec);
+    entry->mtime = get_u64(rec + 8);
+    entry->name_offset = get_u64(rec + 16);
+    entry->folder = get_u32(rec + 24);
+    entry->attrib = get_u32(rec + 28);
+    entry->crc = get_u32(rec + 32);
+    entry->flags = get_u32(rec + 36);
+    if (entry->name_offset >= r->names_size) return 0;
+    *name = r->names + entry->name_offset;
+    return 1;
+}
+
+void archive_index_get_folder(const ArchiveIndexReader* r, uint64_t i, ArchiveIndexFolder* folder) {
+    const unsigned char* rec = r->data + INDEX_HEADER_SIZE + r->entry_count * INDEX_ENTRY_SIZE +
+                               i * INDEX_FOLDER_SIZE;
+    folder->pack_offset = get_u64(rec);
+    folder->pack_size = get_u64(rec + 8);
+    folder->unpack_size = get_u64(rec + 16);
+    folder->num_files = get_u32(rec + 24);
+    folder->flags = get_u32(rec + 28);
+}
+
+uint64_t archive_index_get_volume(const ArchiveIndexReader* r, uint64_t i) {
+    return get_u64(r->data + INDEX_HEADER_SIZE + r->entry_count * INDEX_ENTRY_SIZE +
+                   r->folder_count * INDEX_FOLDER_SIZE + i * INDEX_VOLUME_SIZE);
+}
+
+SevenZipErrorCode sevenzip_list_index(const char* index_path, SevenZipList** list) {
+    if (!index_path || !list) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    *list = NULL;
+
+    ArchiveIndexReader r;
+    SevenZipErrorCode err = archive_index_read(&r, index_path);
+    if (err != SEVENZIP_OK) {
+        return err;
+    }
+    size_t count = (size_t)r.entry_count;
+
+    /* One block, as sevenzip_list() returns it */
+    size_t header_size = sizeof(SevenZipList) + count * sizeof(SevenZipEntry);
+    unsigned char* block = (unsigned char*)mem_alloc(SEVENZIP_MEM_NAMES, header_size + r.names_size);
+    if (!block) {
+        archive_index_reader_free(&r);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    SevenZipList* result = (SevenZipList*)block;
+    result->count = count;
+    result->entries = count ? (SevenZipEntry*)(block + sizeof(SevenZipList)) : NULL;
+    char* result_names = (char*)(block + header_size);
+    memcpy(result_names, r.names, r.names_size);
+
+    for (size_t i = 0; i < count; i++) {
+        ArchiveIndexEntry rec;
+        const char* name;
+        if (!archive_index_get_entry(&r, i, &rec, &name)) {
+            mem_free(block);
+            archive_index_reader_free(&r);
+            return SEVENZIP_ERROR_INVALID_ARCHIVE;
+        }
+        SevenZipEntry* entry = &result->entries[i];
+        entry->name = *name ? result_names + rec.name_offset : NULL;
+        entry->size = rec.size;
+        entry->packed_size = 0;
+        /* FILETIME to Unix time, as sevenzip_list() converts it */
+        entry->modified_time = rec.mtime / 10000000ULL - 11644473600ULL;
+        entry->attributes = rec.attrib;
+        entry->is_directory = (rec.flags & ARCHIVE_INDEX_ENTRY_DIR) != 0;
+    }
+
+    archive_index_reader_free(&r);
+    *list = result;
+    return SEVENZIP_OK;
+}
@@ -0,0 +1,115 @@
+/**
+ * Archive Index - Internal Header
+ *
+ * Sidecar of SevenZipStreamOptions.write_index: the entry table, folder
+ * pack offsets and volume sizes of an archive the create engine wrote,
+ * in <archive_path>.7zidx. sevenzip_list_index() lists from it without
+ * opening a volume or parsing the header.
+ *
+ * Every field is little-endian and fixed-width, and names are offsets
+ * into a NUL-terminated string table, so a mapped index can be read in
+ * place:
+ *
+ *   header   magic "7zFFIidx", version, the counts below, CRC of the rest
+ *   entries  entry_count x ArchiveIndexEntry (40 bytes)
+ *   folders  folder_count x ArchiveIndexFolder (32 bytes)
+ *   volumes  volume_count x uint64 size
+ *   names    names_size bytes of UTF-8, each name NUL-terminated
+ */
+
+#ifndef SEVENZIP_ARCHIVE_INDEX_H
+#define SEVENZIP_ARCHIVE_INDEX_H
+
+#include "../include/7z_ffi.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARCHIVE_INDEX_SUFFIX ".7zidx"
+
+#define ARCHIVE_INDEX_NO_FOLDER 0xFFFFFFFFu
+
+#define ARCHIVE_INDEX_ENTRY_DIR 1u        /* Directory */
+#define ARCHIVE_INDEX_FOLDER_ENCRYPTED 1u  /* 7zAES coder in front */
+
+typedef struct {
+    uint64_t size;
+    uint64_t mtime;        /* FILETIME */
+    uint64_t name_offset;  /* Into the string table */
+    uint32_t folder;       /* ARCHIVE_INDEX_NO_FOLDER = empty file or directory */
+    uint32_t attrib;
+    uint32_t crc;
+    uint32_t flags;        /* ARCHIVE_INDEX_ENTRY_* */
+} ArchiveIndexEntry;
+
+typedef struct {
+    uint64_t pack_offset;  /* Of the pack stream, from the start of volume 0 */
+    uint64_t pack_size;
+    uint64_t unpack_size;
+    uint32_t num_files;    /* Non-empty files in the folder */
+    uint32_t flags;        /* ARCHIVE_INDEX_FOLDER_* */
+} ArchiveIndexFolder;
+
+/* Index under construction, in memory until archive_index_write() */
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    unsigned char* names;
+    size_t names_size;
+    size_t names_capacity;
+    uint64_t entry_count;
+    uint64_t folder_count;
+    uint64_t volume_count;
+    int failed;            /* Out of memory */
+} ArchiveIndexWriter;
+
+void archive_index_writer_init(ArchiveIndexWriter* w);
+void archive_index_writer_free(ArchiveIndexWriter* w);
+
+/* Add records in table order: every entry, then every folder, then every volume */
+void archive_index_add_entry(ArchiveIndexWriter* w, const char* name, const ArchiveIndexEntry* entry);
+void archive_index_add_folder(ArchiveIndexWriter* w, const ArchiveIndexFolder* folder);
+void archive_index_add_volume(ArchiveIndexWriter* w, uint64_t size);
+
+/* Path of the index of `archive_path` */
+void archive_index_path(char* buffer, size_t size, const char* archive_path);
+
+/* Write the index to `path`, through a temporary file renamed into place
+ * @return 1 on success, 0 on failure (nothing at `path` changed)
+ */
+int archive_index_write(const ArchiveIndexWriter* w, const char* path);
+
+/* An index read whole and checked, its records decoded on demand */
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    uint64_t entry_count;
+    uint64_t folder_count;
+    uint64_t volume_count;
+    const char* names;     /* String table, NUL-terminated */
+    size_t names_size;
+} ArchiveIndexReader;
+
+/**
+ * Read the index at `path`
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_OPEN_FILE, SEVENZIP_ERROR_INVALID_ARCHIVE
+ *         (not an intact index) or SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode archive_index_read(ArchiveIndexReader* r, const char* path);
+void archive_index_reader_free(ArchiveIndexReader* r);
+
+/* Record i, i below the count; 0 if its name lies outside the string table */
+int archive_index_get_entry(const ArchiveIndexReader* r, uint64_t i, ArchiveIndexEntry* entry,
+                            const char** name);
+void archive_index_get_folder(const ArchiveIndexReader* r, uint64_t i, ArchiveIndexFolder* folder);
+uint64_t archive_index_get_volume(const ArchiveIndexReader* r, uint64_t i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ARCHIVE_INDEX_H */
@@ -1,133 +1,271 @@
 #include "7z_ffi.h"
 #include "7z.h"
-#include "7zAlloc.h"
 #include "7zBuf.h"
 #include "7zCrc.h"
 #include "7zFile.h"
 #include "7zVersion.h"
+#include "mmap_stream.h"
+#include "volume_stream.h"
+#include "archive_handle.h"
+#include "utf_convert.h"
+#include "mem_alloc.h"
+#include "global_tables.h"
+#include "metrics.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-SevenZipErrorCode sevenzip_list(
-    const char* archive_path,
-    const char* password,
-    SevenZipList** list
-) {
-    if (!archive_path || !list) {
-        return SEVENZIP_ERROR_INVALID_PARAM;
+/* Modified time of entry i as a Unix timestamp, 0 when not stored */
+static uint64_t entry_unix_time(const CSzArEx* db, UInt32 i) {
+    if (!SzBitWithVals_Check(&db->MTime, i)) return 0;
+    const CNtfsFileTime* ft = db->MTime.Vals + i;
+    /* Convert Windows FILETIME to Unix timestamp (simplified) */
+    return (ft->Low | ((uint64_t)ft->High << 32)) / 10000000ULL - 11644473600ULL;
+}
+
+/* Names of entries [first, first + count) to UTF-8 at `names`, NULL for
+ * an unnamed entry; returns the end of the last name */
+static char* convert_names(const CSzArEx* db, UInt32 first, UInt32 count,
+                           char** out, size_t stride, char* names) {
+    for (UInt32 k = 0; k < count; k++) {
+        UInt32 i = first + k;
+        size_t len = SzArEx_GetFileNameUtf16(db, i, NULL);
+        char** name = (char**)((Byte*)out + k * stride);
+        *name = NULL;
+        if (len > 1) {
+            *name = names;
+            names += utf16le_to_utf8(db->FileNames + db->FileNameOffsets[i] * 2, len, names);
+        }
+    }
+    return names;
+}
+
+/* Bytes of the UTF-8 names of entries [first, first + count) */
+static size_t names_size(const CSzArEx* db, UInt32 first, UInt32 count) {
+    /* The names are contiguous in the header, so one pass over the span
+     * (empty names cost a spare byte each) */
+    return count ? utf16le_to_utf8_size(
+        db->FileNames + db->FileNameOffsets[first] * 2,
+        db->FileNameOffsets[first + count] - db->FileNameOffsets[first]) : 0;
+}
+
+/*
+ * Entries [first, first + count) of a parsed archive as one block: the
+ * list, the entry array and every name, so sevenzip_free_list() frees
+ * once. Names are converted straight from the header's UTF-16.
+ */
+SevenZipErrorCode list_entries(const CSzArEx* db, UInt32 first, UInt32 count,
+                               SevenZipList** list) {
+    /* Size the name arena first */
+    size_t header_size = sizeof(SevenZipList) + (size_t)count * sizeof(SevenZipEntry);
+    Byte* block = (Byte*)mem_alloc(SEVENZIP_MEM_NAMES, header_size + names_size(db, first, count));
+    if (!block) {
+        return SEVENZIP_ERROR_MEMORY;
     }
     
-    /* Initialize CRC tables */
-    CrcGenerateTable();
+    SevenZipList* result = (SevenZipList*)block;
+    result->count = count;
+    result->entries = count ? (SevenZipEntry*)(block + sizeof(SevenZipList)) : NULL;
     
-    /* Open archive file */
-    CFileInStream archive_stream;
-    CLookToRead2 look_stream;
-    const size_t kInputBufSize = ((size_t)1 << 18);
+    /* Names: UTF-16 to UTF-8, into the arena */
+    if (count) {
+        convert_names(db, first, count, &result->entries[0].name, sizeof(SevenZipEntry),
+                      (char*)(block + header_size));
+    }
     
-    if (InFile_Open(&archive_stream.file, archive_path) != 0) {
-        return SEVENZIP_ERROR_OPEN_FILE;
+    /* Populate entry information */
+    for (UInt32 k = 0; k < count; k++) {
+        UInt32 i = first + k;
+        SevenZipEntry* entry = &result->entries[k];
+        entry->size = SzArEx_GetFileSize(db, i);
+        entry->packed_size = 0; /* Would need to calculate from block info */
+        entry->modified_time = entry_unix_time(db, i);
+        entry->attributes = SzBitWithVals_Check(&db->Attribs, i) ? db->Attribs.Vals[i] : 0;
+        entry->is_directory = SzArEx_IsDir(db, i);
     }
     
-    FileInStream_CreateVTable(&archive_stream);
+    *list = result;
+    return SEVENZIP_OK;
+}
+
+/*
+ * The requested columns of entries [first, first + count) as one block:
+ * the header, then the 8-byte columns, the attributes, the directory flags
+ * and the names, so sevenzip_free_list_columns() frees once. Columns not
+ * asked for take no space and no conversion.
+ */
+static SevenZipErrorCode list_columns(const CSzArEx* db, UInt32 first, UInt32 count,
+                                      uint32_t fields, SevenZipListColumns** columns) {
+    size_t n = count;
+    size_t size = sizeof(SevenZipListColumns);
+    size_t at_names = size;
+    if (fields & SEVENZIP_FIELD_NAME) size += n * sizeof(char*);
+    size_t at_sizes = size;
+    if (fields & SEVENZIP_FIELD_SIZE) size += n * sizeof(uint64_t);
+    size_t at_times = size;
+    if (fields & SEVENZIP_FIELD_MTIME) size += n * sizeof(uint64_t);
+    size_t at_attribs = size;
+    if (fields & SEVENZIP_FIELD_ATTRIBUTES) size += n * sizeof(uint32_t);
+    size_t at_dirs = size;
+    if (fields & SEVENZIP_FIELD_IS_DIRECTORY) size += n;
+    size_t at_arena = size;
+    if (fields & SEVENZIP_FIELD_NAME) size += names_size(db, first, count);
     
-    /* Allocators */
-    ISzAlloc alloc_imp = { SzAlloc, SzFree };
-    ISzAlloc alloc_temp = { SzAllocTemp, SzFreeTemp };
-    
-    /* Initialize look stream */
-    LookToRead2_CreateVTable(&look_stream, False);
-    look_stream.buf = (Byte *)ISzAlloc_Alloc(&alloc_imp, kInputBufSize);
-    if (!look_stream.buf) {
-        File_Close(&archive_stream.file);
+    Byte* block = (Byte*)mem_alloc(SEVENZIP_MEM_NAMES, size);
+    if (!block) {
         return SEVENZIP_ERROR_MEMORY;
     }
-    look_stream.bufSize = kInputBufSize;
-    look_stream.realStream = &archive_stream.vt;
-    LookToRead2_INIT(&look_stream);
+    SevenZipListColumns* result = (SevenZipListColumns*)block;
+    memset(result, 0, sizeof(*result));
+    result->count = n;
     
-    /* Initialize archive database */
-    CSzArEx db;
-    SzArEx_Init(&db);
-    
-    /* Open archive */
-    SRes res = SzArEx_Open(&db, &look_stream.vt, &alloc_imp, &alloc_temp);
-    if (res != SZ_OK) {
-        File_Close(&archive_stream.file);
-        SzArEx_Free(&db, &alloc_imp);
-        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    if (fields & SEVENZIP_FIELD_NAME) {
+        result->names = (char**)(block + at_names);
+        convert_names(db, first, count, result->names, sizeof(char*), (char*)(block + at_arena));
     }
-    
-    /* Allocate result structure */
-    SevenZipList* result = (SevenZipList*)malloc(sizeof(SevenZipList));
-    if (!result) {
-        File_Close(&archive_stream.file);
-        SzArEx_Free(&db, &alloc_imp);
-        return SEVENZIP_ERROR_MEMORY;
+    if (fields & SEVENZIP_FIELD_SIZE) {
+        result->sizes = (uint64_t*)(block + at_sizes);
+        for (UInt32 k = 0; k < count; k++) result->sizes[k] = SzArEx_GetFileSize(db, first + k);
+    }
+    if (fields & SEVENZIP_FIELD_MTIME) {
+        result->modified_times = (uint64_t*)(block + at_times);
+        for (UInt32 k = 0; k < count; k++) result->modified_times[k] = entry_unix_time(db, first + k);
+    }
+    if (fields & SEVENZIP_FIELD_ATTRIBUTES) {
+        result->attributes = (uint32_t*)(block + at_attribs);
+        for (UInt32 k = 0; k < count; k++) {
+            UInt32 i = first + k;
+            result->attributes[k] = SzBitWithVals_Check(&db->Attribs, i) ? db->Attribs.Vals[i] : 0;
+        }
+    }
+    if (fields & SEVENZIP_FIELD_IS_DIRECTORY) {
+        result->is_directory = (uint8_t*)(block + at_dirs);
+        for (UInt32 k = 0; k < count; k++) result->is_directory[k] = (uint8_t)SzArEx_IsDir(db, first + k);
     }
     
-    result->count = db.NumFiles;
-    result->entries = (SevenZipEntry*)calloc(db.NumFiles, sizeof(SevenZipEntry));
+    *columns = result;
+    return SEVENZIP_OK;
+}
+
+/* Helper: Parse the header of archive_path and list every entry */
+static SevenZipErrorCode list_archive(const char* archive_path, SevenZipList** list) {
     
-    if (!result->entries) {
-        free(result);
-        File_Close(&archive_stream.file);
-        SzArEx_Free(&db, &alloc_imp);
-        return SEVENZIP_ERROR_MEMORY;
-    }
+    global_tables_init();
     
-    /* Populate entry information */
-    for (UInt32 i = 0; i < db.NumFiles; i++) {
-        /* Get file name */
-        size_t len = SzArEx_GetFileNameUtf16(&db, i, NULL);
-        if (len > 1) {
-            UInt16* temp = (UInt16*)malloc(len * sizeof(UInt16));
-            if (temp) {
-                SzArEx_GetFileNameUtf16(&db, i, temp);
-                
-                /* Convert UTF-16 to UTF-8 (simplified) */
-                result->entries[i].name = (char*)malloc(len);
-                if (result->entries[i].name) {
-                    for (size_t j = 0; j < len; j++) {
-                        result->entries[i].name[j] = (char)(temp[j] < 256 ? temp[j] : '?');
-                    }
-                }
-                free(temp);
-            }
-        }
-        
-        /* Get file size */
-        result->entries[i].size = SzArEx_GetFileSize(&db, i);
-        
-        /* Get packed size (approximate) */
-        result->entries[i].packed_size = 0; /* Would need to calculate from block info */
-        
-        /* Get modified time */
-        if (SzBitWithVals_Check(&db.MTime, i)) {
-            const CNtfsFileTime* ft = db.MTime.Vals + i;
-            /* Convert Windows FILETIME to Unix timestamp (simplified) */
-            result->entries[i].modified_time = (ft->Low | ((uint64_t)ft->High << 32)) / 10000000ULL - 11644473600ULL;
-        } else {
-            result->entries[i].modified_time = 0;
+    /* Allocators */
+    ISzAlloc alloc_imp = g_MemHeaderAlloc;
+    
+    /* Open archive file: mapped, else its volumes through a look buffer */
+    MmapInStream mapped;
+    VolumeSet volumes;
+    VolumeInStream in_stream;
+    CLookToRead2 look_stream;
+    const size_t kInputBufSize = ((size_t)1 << 18);
+    ILookInStreamPtr stream = &mapped.vt;
+    
+    if (!mmap_in_stream_open(&mapped, archive_path)) {
+        if (!volume_set_open(&volumes, archive_path, 0)) {
+            return SEVENZIP_ERROR_OPEN_FILE;
         }
+        volume_in_stream_init(&in_stream, &volumes);
         
-        /* Get attributes */
-        result->entries[i].attributes = 0;
-        if (SzBitWithVals_Check(&db.Attribs, i)) {
-            result->entries[i].attributes = db.Attribs.Vals[i];
+        /* Initialize look stream */
+        LookToRead2_CreateVTable(&look_stream, False);
+        look_stream.buf = (Byte *)ISzAlloc_Alloc(&g_MemIoAlloc, kInputBufSize);
+        if (!look_stream.buf) {
+            volume_set_close(&volumes);
+            return SEVENZIP_ERROR_MEMORY;
         }
-        
-        /* Check if directory */
-        result->entries[i].is_directory = SzArEx_IsDir(&db, i);
+        look_stream.bufSize = kInputBufSize;
+        look_stream.realStream = &in_stream.vt;
+        LookToRead2_INIT(&look_stream);
+        stream = &look_stream.vt;
     }
     
+    /* Initialize archive database */
+    CSzArEx db;
+    SzArEx_Init(&db);
+    
+    /* Open archive; listing needs nothing but the parsed header */
+    SRes res = SzArEx_Open(&db, stream, &alloc_imp, &alloc_imp);
+    if (stream == &mapped.vt) {
+        mmap_in_stream_close(&mapped);
+    } else {
+        ISzAlloc_Free(&g_MemIoAlloc, look_stream.buf);
+        volume_set_close(&volumes);
+    }
+    if (res != SZ_OK) {
+        SzArEx_Free(&db, &alloc_imp);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    
+    SevenZipErrorCode err = list_entries(&db, 0, db.NumFiles, list);
+    
     /* Cleanup */
-    ISzAlloc_Free(&alloc_imp, look_stream.buf);
     SzArEx_Free(&db, &alloc_imp);
-    File_Close(&archive_stream.file);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_list(
+    const char* archive_path,
+    const char* password,
+    SevenZipList** list
+) {
+    if (!archive_path || !list) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
     
-    *list = result;
-    return SEVENZIP_OK;
+    MetricsOp op;
+    metrics_op_begin(&op, SEVENZIP_METRIC_LIST);
+    SevenZipErrorCode err = list_archive(archive_path, list);
+    metrics_op_end(&op, err);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_archive_list(
+    SevenZipArchive* archive,
+    SevenZipList** list
+) {
+    if (!archive || !list) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    return list_entries(&archive->db, 0, archive->db.NumFiles, list);
+}
+
+SevenZipErrorCode sevenzip_archive_list_page(
+    SevenZipArchive* archive,
+    uint32_t first_index,
+    uint32_t max_entries,
+    SevenZipList** list
+) {
+    if (!archive || !list) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    UInt32 total = archive->db.NumFiles;
+    UInt32 first = first_index < total ? first_index : total;
+    UInt32 count = total - first;
+    if (count > max_entries) count = max_entries;
+    return list_entries(&archive->db, first, count, list);
+}
+
+uint32_t sevenzip_archive_entry_count(const SevenZipArchive* archive) {
+    return archive ? archive->db.NumFiles : 0;
+}
+
+SevenZipErrorCode sevenzip_archive_list_columns(
+    SevenZipArchive* archive,
+    uint32_t first_index,
+    uint32_t max_entries,
+    uint32_t fields,
+    SevenZipListColumns** columns
+) {
+    if (!archive || !columns) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    UInt32 total = archive->db.NumFiles;
+    UInt32 first = first_index < total ? first_index : total;
+    UInt32 count = total - first;
+    if (count > max_entries) count = max_entries;
+    return list_columns(&archive->db, first, count, fields, columns);
 }
@@ -0,0 +1,343 @@
+/**
+ * 7z to .xz Remux
+ *
+ * A 7z folder with one LZMA2 coder holds a raw LZMA2 stream, end marker
+ * included, which is what an .xz block wraps. The folder's packed bytes
+ * are copied unchanged into one block, behind a block header with the
+ * coder's dictionary property and the packed and unpacked sizes (which
+ * let multi-threaded xz decoders split the work), and followed by the
+ * block check, the index and the stream footer.
+ *
+ * Only the check needs the decoded data: the folder is decoded once
+ * through folder_stream.h to sum it, before anything is written, unless
+ * there is no check or the CRC32 check is the archive's CRC of the folder
+ * or of its one file.
+ */
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
+#include "Xz.h"
+#include "mem_alloc.h"
+#include "folder_stream.h"
+#include "mmap_stream.h"
+#include "volume_stream.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define REMUX_DEFAULT_LZMA2_THREADS 2
+#define REMUX_COPY_STEP (1 << 20)       // Packed bytes per write
+#define REMUX_FILE_BUF_SIZE (1 << 20)   // stdio buffer of the output file
+#define REMUX_LZMA2_DICT_PROP_MAX 40
+
+/* Sums the decoded folder into the block check */
+typedef struct {
+    FolderStreamSink vt;
+    CXzCheck check;
+    UInt64 done;
+    UInt64 total;
+    SevenZipProgressCallback progress_callback;
+    void* user_data;
+} CheckSink;
+
+static SRes CheckSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    (void)pp;
+    (void)file_index;
+    return SZ_OK;
+}
+
+static SRes CheckSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    CheckSink* p = Z7_CONTAINER_FROM_VTBL(pp, CheckSink, vt);
+    XzCheck_Update(&p->check, data, size);
+    p->done += size;
+    if (p->progress_callback) p->progress_callback(p->done, p->total, p->user_data);
+    return SZ_OK;
+}
+
+static SRes CheckSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    (void)pp;
+    (void)file_index;
+    return SZ_OK;
+}
+
+/* 1 if the folder holds one file and the archive stores its CRC */
+static int folder_single_file_crc(const CSzArEx* db, UInt32 folder_index, UInt32* crc) {
+    UInt32 file = (UInt32)-1;
+    for (UInt32 i = db->FolderToFile[folder_index]; i < db->FolderToFile[folder_index + 1]; i++) {
+        if (db->FileToFolder[i] != folder_index) continue;
+        if (file != (UInt32)-1) return 0;
+        file = i;
+    }
+    if (file == (UInt32)-1 || !SzBitWithVals_Check(&db->CRCs, file)) return 0;
+    *crc = db->CRCs.Vals[file];
+    return 1;
+}
+
+static int write_all(FILE* f, const void* data, size_t size) {
+    return fwrite(data, 1, size, f) == size;
+}
+
+/* Header, packed data, padding and check of the block; *unpadded_size
+ * as the index records it */
+static SevenZipErrorCode write_block(
+    FILE* out,
+    ILookInStreamPtr stream,
+    UInt64 pack_offset,
+    UInt64 pack_size,
+    UInt64 unpack_size,
+    Byte dict_prop,
+    const Byte* check,
+    unsigned check_size,
+    UInt64 progress_base,
+    UInt64 progress_total,
+    SevenZipProgressCallback progress_callback,
+    void* user_data,
+    UInt64* unpadded_size
+) {
+    Byte header[64];
+    unsigned pos = 1;
+    header[pos++] = XZ_BF_PACK_SIZE | XZ_BF_UNPACK_SIZE;  /* One filter */
+    pos += Xz_WriteVarInt(header + pos, pack_size);
+    pos += Xz_WriteVarInt(header + pos, unpack_size);
+    header[pos++] = XZ_ID_LZMA2;
+    header[pos++] = 1;  /* Property size */
+    header[pos++] = dict_prop;
+    while ((pos & 3) != 0) header[pos++] = 0;
+    header[0] = (Byte)(pos / 4);  /* Size with the CRC, in 4-byte units, minus 1 */
+    SetUi32(header + pos, CrcCalc(header, pos));
+    pos += 4;
+    if (!write_all(out, header, pos)) return SEVENZIP_ERROR_COMPRESS;
+
+    if (LookInStream_SeekTo(stream, pack_offset) != SZ_OK) return SEVENZIP_ERROR_EXTRACT;
+    UInt64 left = pack_size;
+    Byte last = 1;
+    while (left != 0) {
+        const void* data;
+        size_t size = left < REMUX_COPY_STEP ? (size_t)left : REMUX_COPY_STEP;
+        if (ILookInStream_Look(stream, &data, &size) != SZ_OK || size == 0) {
+            return SEVENZIP_ERROR_EXTRACT;
+        }
+        if (!write_all(out, data, size)) return SEVENZIP_ERROR_COMPRESS;
+        last = ((const Byte*)data)[size - 1];
+        ILookInStream_Skip(stream, size);
+        left -= size;
+        if (progress_callback) {
+            progress_callback(progress_base + pack_size - left, progress_total, user_data);
+        }
+    }
+    /* xz needs the stream's end marker; 7z decoders accept it missing */
+    if (last != 0) return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+
+    static const Byte zeros[3];
+    if (!write_all(out, zeros, (size_t)((4 - (pack_size & 3)) & 3)) ||
+        !write_all(out, check, check_size)) {
+        return SEVENZIP_ERROR_COMPRESS;
+    }
+    *unpadded_size = pos + pack_size + check_size;
+    return SEVENZIP_OK;
+}
+
+/* Index of the one block, then the stream footer */
+static SevenZipErrorCode write_index(FILE* out, UInt64 unpadded_size, UInt64 unpack_size,
+                                     const Byte* flags) {
+    Byte index[32];
+    unsigned pos = 0;
+    index[pos++] = 0;  /* Index indicator */
+    pos += Xz_WriteVarInt(index + pos, 1);
+    pos += Xz_WriteVarInt(index + pos, unpadded_size);
+    pos += Xz_WriteVarInt(index + pos, unpack_size);
+    while ((pos & 3) != 0) index[pos++] = 0;
+    SetUi32(index + pos, CrcCalc(index, pos));
+    pos += 4;
+
+    Byte footer[XZ_STREAM_FOOTER_SIZE];
+    SetUi32(footer + 4, pos / 4 - 1);  /* Backward size */
+    footer[8] = flags[0];
+    footer[9] = flags[1];
+    SetUi32(footer, CrcCalc(footer + 4, 6));
+    footer[10] = XZ_FOOTER_SIG_0;
+    footer[11] = XZ_FOOTER_SIG_1;
+    return write_all(out, index, pos) && write_all(out, footer, sizeof(footer))
+           ? SEVENZIP_OK : SEVENZIP_ERROR_COMPRESS;
+}
+
+static SevenZipErrorCode remux_folder(
+    VolumeSet* volumes,
+    UInt32 folder_index,
+    const char* xz_path,
+    SevenZipXzCheck check_type,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    ISzAlloc alloc_imp = g_MemDecoderAlloc;
+    ISzAlloc alloc_header = g_MemHeaderAlloc;
+
+    /* Mapped volumes, else a look buffer over them */
+    MmapInStream mapped;
+    VolumeInStream in_stream;
+    CLookToRead2 look_stream;
+    ILookInStreamPtr stream;
+    memset(&mapped, 0, sizeof(mapped));
+    look_stream.buf = NULL;
+    if (!volumes->parity && mmap_in_stream_open_files(&mapped, volumes->files, volumes->sizes, volumes->count)) {
+        mapped.readahead = volumes->readahead;
+        stream = &mapped.vt;
+    } else {
+        volume_in_stream_init(&in_stream, volumes);
+        LookToRead2_CreateVTable(&look_stream, False);
+        look_stream.buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, REMUX_COPY_STEP);
+        if (!look_stream.buf) return SEVENZIP_ERROR_MEMORY;
+        look_stream.bufSize = REMUX_COPY_STEP;
+        look_stream.realStream = &in_stream.vt;
+        LookToRead2_INIT(&look_stream);
+        stream = &look_stream.vt;
+    }
+
+    CSzArEx db;
+    SzArEx_Init(&db);
+    SRes res = SzArEx_Open(&db, stream, &alloc_header, &alloc_header);
+    SevenZipErrorCode error_code = SEVENZIP_OK;
+    if (res != SZ_OK) {
+        error_code = res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_INVALID_ARCHIVE;
+    } else if (folder_index >= db.db.NumFolders) {
+        error_code = SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    /* One LZMA2 coder and its one packed stream, nothing else */
+    Byte dict_prop = 0;
+    if (error_code == SEVENZIP_OK) {
+        const CSzAr* ar = &db.db;
+        const Byte* coders = ar->CodersData + ar->FoCodersOffsets[folder_index];
+        CSzFolder folder;
+        CSzData sd;
+        sd.Data = coders;
+        sd.Size = ar->FoCodersOffsets[(size_t)folder_index + 1] - ar->FoCodersOffsets[folder_index];
+        if (SzGetNextFolderItem(&folder, &sd) != SZ_OK) {
+            error_code = SEVENZIP_ERROR_INVALID_ARCHIVE;
+        } else if (folder.NumCoders != 1 || folder.NumPackStreams != 1 ||
+                   folder.Coders[0].MethodID != XZ_ID_LZMA2 || folder.Coders[0].PropsSize != 1 ||
+                   coders[folder.Coders[0].PropsOffset] > REMUX_LZMA2_DICT_PROP_MAX) {
+            error_code = SEVENZIP_ERROR_NOT_IMPLEMENTED;
+        } else {
+            dict_prop = coders[folder.Coders[0].PropsOffset];
+        }
+    }
+
+    UInt64 pack_offset = 0, pack_size = 0, unpack_size = 0;
+    if (error_code == SEVENZIP_OK) {
+        UInt32 pack_index = db.db.FoStartPackStreamIndex[folder_index];
+        pack_offset = db.dataPos + db.db.PackPositions[pack_index];
+        pack_size = db.db.PackPositions[pack_index + 1] - db.db.PackPositions[pack_index];
+        unpack_size = SzAr_GetFolderUnpackSize(&db.db, folder_index);
+    }
+
+    /* The check: for CRC32, the folder's CRC or that of its one file when
+       the archive stores it, else summed over the decoded folder */
+    CheckSink sink;
+    memset(&sink, 0, sizeof(sink));
+    Byte check[64];
+    unsigned check_size = 0;
+    int decode = 0;
+    if (error_code == SEVENZIP_OK && check_type != SEVENZIP_XZ_CHECK_NONE) {
+        decode = 1;
+        if (check_type == SEVENZIP_XZ_CHECK_CRC32) {
+            UInt32 crc = 0;
+            if (SzBitWithVals_Check(&db.db.FolderCRCs, folder_index)) {
+                crc = db.db.FolderCRCs.Vals[folder_index];
+                decode = 0;
+            } else if (folder_single_file_crc(&db, folder_index, &crc)) {
+                decode = 0;
+            }
+            if (!decode) {
+                SetUi32(check, crc);
+                check_size = 4;
+            }
+        }
+    }
+    UInt64 progress_total = pack_size + (decode ? unpack_size : 0);
+
+    if (decode) {
+        sink.vt.Begin = CheckSink_Begin;
+        sink.vt.Write = CheckSink_Write;
+        sink.vt.End = CheckSink_End;
+        sink.vt.WriteStored = NULL;
+        sink.total = progress_total;
+        sink.progress_callback = progress_callback;
+        sink.user_data = user_data;
+        XzCheck_Init(&sink.check, (unsigned)check_type);
+        res = folder_stream_decode(&db, stream, folder_index, &sink.vt, NULL,
+                                   thread_auto_count(REMUX_DEFAULT_LZMA2_THREADS),
+                                   NULL, &alloc_imp);
+        if (res != SZ_OK) {
+            error_code = res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+        } else {
+            XzCheck_Final(&sink.check, check);
+            check_size = XzFlags_GetCheckSize((CXzStreamFlags)check_type);
+        }
+    }
+
+    FILE* out = NULL;
+    if (error_code == SEVENZIP_OK) {
+        out = fopen(xz_path, "wb");
+        if (!out) error_code = SEVENZIP_ERROR_OPEN_FILE;
+        else setvbuf(out, NULL, _IOFBF, REMUX_FILE_BUF_SIZE);
+    }
+
+    Byte stream_header[XZ_STREAM_HEADER_SIZE];
+    memcpy(stream_header, XZ_SIG, XZ_SIG_SIZE);
+    stream_header[XZ_SIG_SIZE] = 0;
+    stream_header[XZ_SIG_SIZE + 1] = (Byte)check_type;
+    SetUi32(stream_header + XZ_SIG_SIZE + 2, CrcCalc(stream_header + XZ_SIG_SIZE, 2));
+
+    UInt64 unpadded_size = 0;
+    if (error_code == SEVENZIP_OK && !write_all(out, stream_header, sizeof(stream_header))) {
+        error_code = SEVENZIP_ERROR_COMPRESS;
+    }
+    if (error_code == SEVENZIP_OK) {
+        error_code = write_block(out, stream, pack_offset, pack_size, unpack_size, dict_prop,
+                                 check, check_size, progress_total - pack_size, progress_total,
+                                 progress_callback, user_data, &unpadded_size);
+    }
+    if (error_code == SEVENZIP_OK) {
+        error_code = write_index(out, unpadded_size, unpack_size, stream_header + XZ_SIG_SIZE);
+    }
+
+    if (out) {
+        if (fclose(out) != 0 && error_code == SEVENZIP_OK) error_code = SEVENZIP_ERROR_COMPRESS;
+        if (error_code != SEVENZIP_OK) remove(xz_path);
+    }
+    SzArEx_Free(&db, &alloc_header);
+    ISzAlloc_Free(&g_MemIoAlloc, look_stream.buf);
+    mmap_in_stream_close(&mapped);
+    return error_code;
+}
+
+SevenZipErrorCode sevenzip_remux_to_xz(
+    const char* archive_path,
+    uint32_t folder_index,
+    const char* xz_path,
+    SevenZipXzCheck check,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !xz_path ||
+        (check != SEVENZIP_XZ_CHECK_NONE && check != SEVENZIP_XZ_CHECK_CRC32 &&
+         check != SEVENZIP_XZ_CHECK_CRC64 && check != SEVENZIP_XZ_CHECK_SHA256)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    global_tables_init();
+
+    VolumeSet volumes;
+    if (!volume_set_open(&volumes, archive_path, 0)) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    SevenZipErrorCode err = remux_folder(&volumes, folder_index, xz_path, check,
+                                         progress_callback, user_data);
+    volume_set_close(&volumes);
+    return err;
+}
@@ -0,0 +1,727 @@
+/**
+ * Archive Service
+ *
+ * A fixed pool of max_clients threads takes connections off one listening
+ * socket, each serving one request at a time, so a burst of clients waits
+ * in the listen backlog rather than adding threads. Create and extract
+ * requests become background jobs, so they queue with every other job of
+ * the process behind SevenZipInitOptions.max_jobs. List and read requests
+ * go through archives kept open in a small LRU table, shared by all
+ * clients; an archive found changed on disk (device, inode, size or
+ * mtime) is opened again, its old handle closed once no request holds it.
+ */
+
+#include "../include/7z_ffi.h"
+#include "service_protocol.h"
+#include "cancel_token.h"
+#include "key_cache.h"
+#include "mem_alloc.h"
+#include "metrics.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVICE_DEFAULT_CLIENTS 16
+#define SERVICE_DEFAULT_ARCHIVES 16
+#define SERVICE_DEFAULT_CACHE_BUDGET ((uint64_t)64 << 20)
+#define SERVICE_DEFAULT_MODE 0600
+#define SERVICE_POLL_MS 100          /* How soon the threads see a stop */
+
+/* Archive kept open for list and read requests */
+typedef struct {
+    SevenZipArchive* archive;        /* NULL = free slot */
+    char* path;                      /* As requested */
+    char* password;                  /* NULL for none; zeroed when dropped */
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    int refs;                        /* Requests using it */
+    int stale;                       /* Changed on disk: closed once released */
+    uint64_t last_used;
+} ServiceArchive;
+
+struct SevenZipService {
+    int listen_fd;
+    char* socket_path;
+    SevenZipServiceOptions options;
+    SevenZipCancelToken* stop;
+    pthread_t* threads;
+    int num_threads;
+    pthread_mutex_t lock;            /* Guards archives and clock */
+    ServiceArchive* archives;        /* options.max_archives slots */
+    uint64_t clock;
+};
+
+void sevenzip_service_options_init(SevenZipServiceOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->max_clients = SERVICE_DEFAULT_CLIENTS;
+    options->max_archives = SERVICE_DEFAULT_ARCHIVES;
+    options->cache_budget = SERVICE_DEFAULT_CACHE_BUDGET;
+    options->socket_mode = SERVICE_DEFAULT_MODE;
+}
+
+/* Helper: Free a password copy without leaving it in memory */
+static void password_free(char* password) {
+    if (!password) return;
+    key_cache_zero(password, strlen(password));
+    mem_free(password);
+}
+
+/* Helper: Close a slot's archive and free the slot (refs 0) */
+static void archive_slot_drop(ServiceArchive* slot) {
+    sevenzip_close(slot->archive);
+    mem_free(slot->path);
+    password_free(slot->password);
+    memset(slot, 0, sizeof(*slot));
+}
+
+static int same_password(const char* a, const char* b) {
+    return (!a && !b) || (a && b && strcmp(a, b) == 0);
+}
+
+/*
+ * The open archive of `path` and `password`, opened and kept in a free or
+ * least recently used idle slot if it is not there yet; with every slot
+ * in use it is opened for this request only. Release with archive_release().
+ */
+static SevenZipErrorCode archive_acquire(SevenZipService* s, const char* path,
+                                         const char* password, SevenZipArchive** archive) {
+    struct stat st;
+    if (stat(path, &st) != 0) return SEVENZIP_ERROR_OPEN_FILE;
+
+    pthread_mutex_lock(&s->lock);
+    for (int i = 0; i < s->options.max_archives; i++) {
+        ServiceArchive* slot = &s->archives[i];
+        if (!slot->archive || slot->stale || strcmp(slot->path, path) != 0 ||
+            !same_password(slot->password, password)) {
+            continue;
+        }
+        if (slot->dev == st.st_dev && slot->ino == st.st_ino && slot->size == st.st_size &&
+            slot->mtime == st.st_mtime) {
+            slot->refs++;
+            slot->last_used = ++s->clock;
+            *archive = slot->archive;
+            pthread_mutex_unlock(&s->lock);
+            metrics_cache_lookup(SEVENZIP_METRIC_CACHE_HEADER, 1);
+            return SEVENZIP_OK;
+        }
+        slot->stale = 1;
+        if (slot->refs == 0) archive_slot_drop(slot);
+    }
+    pthread_mutex_unlock(&s->lock);
+    metrics_cache_lookup(SEVENZIP_METRIC_CACHE_HEADER, 0);
+
+    /* Opened outside the lock: two requests may both open it, and both keep it */
+    SevenZipArchive* opened = NULL;
+    SevenZipErrorCode err = sevenzip_open(path, password, &opened);
+    if (err != SEVENZIP_OK) return err;
+    sevenzip_archive_set_cache_budget(opened, s->options.cache_budget);
+    char* path_copy = mem_strdup(SEVENZIP_MEM_NAMES, path);
+    char* password_copy = password ? mem_strdup(SEVENZIP_MEM_OTHER, password) : NULL;
+
+    pthread_mutex_lock(&s->lock);
+    ServiceArchive* target = NULL;
+    for (int i = 0; i < s->options.max_archives; i++) {
+        ServiceArchive* slot = &s->archives[i];
+        if (!slot->archive) {
+            target = slot;
+            break;
+        }
+        if (slot->refs == 0 && (!target || slot->last_used < target->last_used)) target = slot;
+    }
+    if (target && path_copy && (password_copy || !password)) {
+        if (target->archive) archive_slot_drop(target);
+        target->archive = opened;
+        target->path = path_copy;
+        target->password = password_copy;
+        target->dev = st.st_dev;
+        target->ino = st.st_ino;
+        target->size = st.st_size;
+        target->mtime = st.st_mtime;
+        target->refs = 1;
+        target->last_used = ++s->clock;
+        path_copy = NULL;
+        password_copy = NULL;
+    }
+    pthread_mutex_unlock(&s->lock);
+    mem_free(path_copy);
+    password_free(password_copy);
+    *archive = opened;
+    return SEVENZIP_OK;
+}
+
+static void archive_release(SevenZipService* s, SevenZipArchive* archive) {
+    pthread_mutex_lock(&s->lock);
+    for (int i = 0; i < s->options.max_archives; i++) {
+        ServiceArchive* slot = &s->archives[i];
+        if (slot->archive != archive) continue;
+        if (--slot->refs == 0 && slot->stale) archive_slot_drop(slot);
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    pthread_mutex_unlock(&s->lock);
+    sevenzip_close(archive);  /* Opened for one request */
+}
+
+/* Entry decoded into a shared memory object, sized once its size is known */
+typedef struct {
+    int fd;
+    unsigned char* map;
+    uint64_t size;
+    uint64_t written;
+} ShmSink;
+
+static int shm_sink_begin(uint32_t entry_index, const char* name, uint64_t size, void* user_data) {
+    ShmSink* sink = (ShmSink*)user_data;
+    (void)entry_index;
+    (void)name;
+    if (size == 0) return 0;
+    if (size > (uint64_t)SIZE_MAX) return 1;
+    sink->fd = service_shm_create(size);
+    if (sink->fd < 0) return 1;
+    void* map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, sink->fd, 0);
+    if (map == MAP_FAILED) return 1;
+    sink->map = (unsigned char*)map;
+    sink->size = size;
+    return 0;
+}
+
+static int shm_sink_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    ShmSink* sink = (ShmSink*)user_data;
+    (void)entry_index;
+    if (size > sink->size - sink->written) return 1;
+    memcpy(sink->map + sink->written, data, size);
+    sink->written += size;
+    return 0;
+}
+
+/* Reply with a list, through a shared memory object */
+static int reply_with_list(int fd, const SevenZipList* list) {
+    uint64_t size = service_list_size(list);
+    int data_fd = service_shm_create(size);
+    void* map = data_fd >= 0
+        ? mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, data_fd, 0) : MAP_FAILED;
+    int sent;
+    if (map != MAP_FAILED) {
+        service_list_encode(list, (unsigned char*)map);
+        munmap(map, (size_t)size);
+        sent = service_send_reply(fd, SEVENZIP_OK, size, data_fd);
+    } else {
+        sent = service_send_reply(fd, SEVENZIP_ERROR_MEMORY, 0, -1);
+    }
+    if (data_fd >= 0) close(data_fd);
+    return sent;
+}
+
+static SevenZipErrorCode serve_create(const ServiceRequest* req) {
+    if (req->count < 3 || !req->strings[0] || req->args[0] < SEVENZIP_LEVEL_STORE ||
+        req->args[0] > SEVENZIP_LEVEL_ULTRA) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const char** inputs = (const char**)mem_alloc(SEVENZIP_MEM_NAMES, (size_t)(req->count - 1) * sizeof(char*));
+    if (!inputs) return SEVENZIP_ERROR_MEMORY;
+    for (uint32_t i = 2; i < req->count; i++) {
+        if (!req->strings[i]) {
+            mem_free((void*)inputs);
+            return SEVENZIP_ERROR_INVALID_PARAM;
+        }
+        inputs[i - 2] = req->strings[i];
+    }
+    inputs[req->count - 2] = NULL;
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.num_threads = (int)req->args[1];
+    options.solid = (int)req->args[2];
+    options.password = req->strings[1];
+    SevenZipJob* job = NULL;
+    SevenZipErrorCode err = sevenzip_submit_create(req->strings[0], inputs,
+                                                   (SevenZipCompressionLevel)req->args[0], &options,
+                                                   NULL, NULL, NULL, &job);
+    if (err == SEVENZIP_OK) {
+        err = sevenzip_job_wait(job);
+        sevenzip_job_free(job);
+    }
+    mem_free((void*)inputs);
+    return err;
+}
+
+static SevenZipErrorCode serve_extract(const ServiceRequest* req) {
+    if (req->count != 3 || !req->strings[0] || !req->strings[1] ||
+        req->args[1] < SEVENZIP_VERIFY_FILE || req->args[1] > SEVENZIP_VERIFY_NONE ||
+        req->args[2] < SEVENZIP_EXISTING_OVERWRITE || req->args[2] > SEVENZIP_EXISTING_SKIP_SAME_CRC ||
+        req->args[5] < SEVENZIP_DURABILITY_NONE || req->args[5] > SEVENZIP_DURABILITY_ATOMIC) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.num_threads = (int)req->args[0];
+    options.verify = (SevenZipVerifyMode)req->args[1];
+    options.existing = (SevenZipExistingPolicy)req->args[2];
+    options.sparse_output = (int)req->args[3];
+    options.cache_neutral_output = (int)req->args[4];
+    options.durability = (SevenZipDurability)req->args[5];
+    SevenZipJob* job = NULL;
+    SevenZipErrorCode err = sevenzip_submit_extract(req->strings[0], req->strings[1], req->strings[2],
+                                                    &options, NULL, NULL, NULL, &job);
+    if (err == SEVENZIP_OK) {
+        err = sevenzip_job_wait(job);
+        sevenzip_job_free(job);
+    }
+    return err;
+}
+
+/* Serve the one request of a connection; 0 if it was not one */
+static int serve_connection(SevenZipService* s, int fd) {
+    ServiceRequest req;
+    if (!service_recv_request(fd, &req)) return 0;
+
+    int sent;
+    SevenZipErrorCode err = SEVENZIP_ERROR_INVALID_PARAM;
+    SevenZipArchive* archive = NULL;
+    switch (req.op) {
+    case SERVICE_OP_CREATE:
+        sent = service_send_reply(fd, serve_create(&req), 0, -1);
+        break;
+    case SERVICE_OP_EXTRACT:
+        sent = service_send_reply(fd, serve_extract(&req), 0, -1);
+        break;
+    case SERVICE_OP_LIST:
+        if (req.count == 2 && req.strings[0]) {
+            err = archive_acquire(s, req.strings[0], req.strings[1], &archive);
+        }
+        if (err == SEVENZIP_OK) {
+            SevenZipList* list = NULL;
+            err = sevenzip_archive_list(archive, &list);
+            archive_release(s, archive);
+            if (err == SEVENZIP_OK) {
+                sent = reply_with_list(fd, list);
+                sevenzip_free_list(list);
+                break;
+            }
+        }
+        sent = service_send_reply(fd, err, 0, -1);
+        break;
+    case SERVICE_OP_READ: {
+        ShmSink shm = { -1, NULL, 0, 0 };
+        if (req.count == 2 && req.strings[0] && req.args[0] >= 0 && req.args[0] <= (int64_t)UINT32_MAX) {
+            err = archive_acquire(s, req.strings[0], req.strings[1], &archive);
+        }
+        if (err == SEVENZIP_OK) {
+            SevenZipExtractSink sink = { shm_sink_begin, shm_sink_write, NULL, &shm };
+            err = sevenzip_archive_extract_entry(archive, (uint32_t)req.args[0], &sink);
+            archive_release(s, archive);
+            if (err == SEVENZIP_OK && shm.written != shm.size) err = SEVENZIP_ERROR_EXTRACT;
+        }
+        if (shm.map) munmap(shm.map, (size_t)shm.size);
+        sent = err == SEVENZIP_OK
+            ? service_send_reply(fd, SEVENZIP_OK, shm.size, shm.fd)
+            : service_send_reply(fd, err, 0, -1);
+        if (shm.fd >= 0) close(shm.fd);
+        break;
+    }
+    default:
+        sent = service_send_reply(fd, SEVENZIP_ERROR_NOT_IMPLEMENTED, 0, -1);
+        break;
+    }
+    service_request_free(&req);
+    return sent;
+}
+
+static void* service_thread(void* arg) {
+    SevenZipService* s = (SevenZipService*)arg;
+    while (!cancel_token_requested(s->stop)) {
+        struct pollfd pfd = { s->listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, SERVICE_POLL_MS) <= 0) continue;
+        /* Every idle thread wakes; the others find nothing to accept */
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        service_socket_setup(fd);
+        serve_connection(s, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* Helper: Unix socket address of `path`; 0 if it does not fit */
+static int socket_address(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(addr->sun_path)) return 0;
+    memcpy(addr->sun_path, path, len + 1);
+    return 1;
+}
+
+static void service_free(SevenZipService* s) {
+    if (s->listen_fd >= 0) close(s->listen_fd);
+    for (int i = 0; s->archives && i < s->options.max_archives; i++) {
+        if (s->archives[i].archive) archive_slot_drop(&s->archives[i]);
+    }
+    pthread_mutex_destroy(&s->lock);
+    sevenzip_cancel_token_free(s->stop);
+    mem_free(s->archives);
+    mem_free(s->threads);
+    mem_free(s->socket_path);
+    mem_free(s);
+}
+
+SevenZipErrorCode sevenzip_service_start(
+    const char* socket_path,
+    const SevenZipServiceOptions* options,
+    SevenZipService** service
+) {
+    struct sockaddr_un addr;
+    if (!service || !socket_path || !socket_address(socket_path, &addr)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    *service = NULL;
+
+    SevenZipService* s = (SevenZipService*)mem_alloc(SEVENZIP_MEM_OTHER, sizeof(SevenZipService));
+    if (!s) return SEVENZIP_ERROR_MEMORY;
+    memset(s, 0, sizeof(*s));
+    s->listen_fd = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    sevenzip_service_options_init(&s->options);
+    if (options) {
+        if (options->max_clients > 0) s->options.max_clients = options->max_clients;
+        if (options->max_archives > 0) s->options.max_archives = options->max_archives;
+        if (options->cache_budget > 0) s->options.cache_budget = options->cache_budget;
+        if (options->socket_mode > 0) s->options.socket_mode = options->socket_mode;
+    }
+    s->stop = sevenzip_cancel_token_create();
+    s->socket_path = mem_strdup(SEVENZIP_MEM_NAMES, socket_path);
+    s->archives = (ServiceArchive*)mem_alloc(SEVENZIP_MEM_OTHER,
+                                             (size_t)s->options.max_archives * sizeof(ServiceArchive));
+    s->threads = (pthread_t*)mem_alloc(SEVENZIP_MEM_OTHER,
+                                       (size_t)s->options.max_clients * sizeof(pthread_t));
+    if (!s->stop || !s->socket_path || !s->archives || !s->threads) {
+        service_free(s);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    memset(s->archives, 0, (size_t)s->options.max_archives * sizeof(ServiceArchive));
+
+    /* A socket file nobody answers on is left from a service that is gone */
+    s->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int bound = s->listen_fd >= 0 && bind(s->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    if (!bound && s->listen_fd >= 0 && errno == EADDRINUSE) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int live = probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        struct stat st;
+        if (!live && lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode) && unlink(socket_path) == 0) {
+            bound = bind(s->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        }
+    }
+    /* Connections are refused until listen(), so the mode is in place first */
+    if (!bound || chmod(socket_path, (mode_t)(s->options.socket_mode & 0777)) != 0 ||
+        listen(s->listen_fd, SOMAXCONN) != 0) {
+        if (bound) unlink(socket_path);
+        service_free(s);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    fcntl(s->listen_fd, F_SETFL, fcntl(s->listen_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(s->listen_fd, F_SETFD, FD_CLOEXEC);
+
+    while (s->num_threads < s->options.max_clients &&
+           pthread_create(&s->threads[s->num_threads], NULL, service_thread, s) == 0) {
+        s->num_threads++;
+    }
+    if (s->num_threads == 0) {
+        unlink(socket_path);
+        service_free(s);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    *service = s;
+    return SEVENZIP_OK;
+}
+
+void sevenzip_service_stop(SevenZipService* service) {
+    if (!service) return;
+    sevenzip_cancel_token_cancel(service->stop);
+    for (int i = 0; i < service->num_threads; i++) {
+        pthread_join(service->threads[i], NULL);
+    }
+    unlink(service->socket_path);
+    service_free(service);
+}
+
+/* Helper: `path` from the caller's working directory (mem_free() it) */
+static char* absolute_path(const char* path) {
+    if (path[0] == '/') return mem_strdup(SEVENZIP_MEM_NAMES, path);
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) return NULL;
+    size_t cwd_len = strlen(cwd);
+    size_t len = strlen(path);
+    char* result = (char*)mem_alloc(SEVENZIP_MEM_NAMES, cwd_len + 1 + len + 1);
+    if (!result) return NULL;
+    memcpy(result, cwd, cwd_len);
+    result[cwd_len] = '/';
+    memcpy(result + cwd_len + 1, path, len + 1);
+    return result;
+}
+
+/* Send a request and wait for its reply; *data_fd is the reply's shared memory or -1 */
+static SevenZipErrorCode service_call(const char* socket_path, const ServiceRequest* req,
+                                      uint64_t* size, int* data_fd) {
+    struct sockaddr_un addr;
+    *data_fd = -1;
+    if (!socket_address(socket_path, &addr)) return SEVENZIP_ERROR_INVALID_PARAM;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return SEVENZIP_ERROR_OPEN_FILE;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    /* Jobs may take longer than a message: the reply is waited for without a timeout */
+    struct timeval send_timeout = { SERVICE_IO_TIMEOUT_SEC, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    SevenZipErrorCode result = SEVENZIP_ERROR_UNKNOWN;
+    if (!service_send_request(fd, req) || !service_recv_reply(fd, &result, size, data_fd)) {
+        result = SEVENZIP_ERROR_UNKNOWN;
+    }
+    close(fd);
+    return result;
+}
+
+/* Helper: Map `size` bytes of a reply's shared memory read-only and close it */
+static const void* map_reply(int data_fd, uint64_t size) {
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (size <= (uint64_t)SIZE_MAX && fstat(data_fd, &st) == 0 && (uint64_t)st.st_size >= size) {
+        map = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, data_fd, 0);
+    }
+    close(data_fd);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+SevenZipErrorCode sevenzip_service_create(
+    const char* socket_path,
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options
+) {
+    if (!socket_path || !archive_path || !input_paths || !input_paths[0]) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    uint32_t inputs = 0;
+    while (input_paths[inputs]) inputs++;
+    if (inputs > SERVICE_MAX_STRINGS - 2) return SEVENZIP_ERROR_INVALID_PARAM;
+
+    ServiceRequest req;
+    memset(&req, 0, sizeof(req));
+    req.op = SERVICE_OP_CREATE;
+    req.count = inputs + 2;
+    req.args[0] = level;
+    req.args[1] = options ? options->num_threads : 0;
+    req.args[2] = options ? options->solid : 1;
+    char** strings = (char**)mem_alloc(SEVENZIP_MEM_NAMES, (size_t)req.count * sizeof(char*));
+    if (!strings) return SEVENZIP_ERROR_MEMORY;
+    memset(strings, 0, (size_t)req.count * sizeof(char*));
+    int ok = (strings[0] = absolute_path(archive_path)) != NULL;
+    for (uint32_t i = 0; ok && i < inputs; i++) {
+        ok = (strings[i + 2] = absolute_path(input_paths[i])) != NULL;
+    }
+    const char* password = options ? options->password : NULL;
+    req.strings = (const char**)strings;
+
+    SevenZipErrorCode err = SEVENZIP_ERROR_MEMORY;
+    if (ok) {
+        strings[1] = (char*)password;
+        uint64_t size;
+        int data_fd;
+        err = service_call(socket_path, &req, &size, &data_fd);
+        if (data_fd >= 0) close(data_fd);
+        strings[1] = NULL;
+    }
+    for (uint32_t i = 0; i < req.count; i++) mem_free(strings[i]);
+    mem_free(strings);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_service_extract(
+    const char* socket_path,
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options
+) {
+    if (!socket_path || !archive_path || !output_dir) return SEVENZIP_ERROR_INVALID_PARAM;
+    SevenZipExtractOptions defaults;
+    if (!options) {
+        sevenzip_extract_options_init(&defaults);
+        options = &defaults;
+    }
+    char* archive_abs = absolute_path(archive_path);
+    char* output_abs = absolute_path(output_dir);
+    SevenZipErrorCode err = SEVENZIP_ERROR_MEMORY;
+    if (archive_abs && output_abs) {
+        const char* strings[3] = { archive_abs, output_abs, password };
+        ServiceRequest req;
+        memset(&req, 0, sizeof(req));
+        req.op = SERVICE_OP_EXTRACT;
+        req.strings = strings;
+        req.count = 3;
+        req.args[0] = options->num_threads;
+        req.args[1] = options->verify;
+        req.args[2] = options->existing;
+        req.args[3] = options->sparse_output;
+        req.args[4] = options->cache_neutral_output;
+        req.args[5] = options->durability;
+        uint64_t size;
+        int data_fd;
+        err = service_call(socket_path, &req, &size, &data_fd);
+        if (data_fd >= 0) close(data_fd);
+    }
+    mem_free(archive_abs);
+    mem_free(output_abs);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_service_list(
+    const char* socket_path,
+    const char* archive_path,
+    const char* password,
+    SevenZipList** list
+) {
+    if (!socket_path || !archive_path || !list) return SEVENZIP_ERROR_INVALID_PARAM;
+    *list = NULL;
+    char* archive_abs = absolute_path(archive_path);
+    if (!archive_abs) return SEVENZIP_ERROR_MEMORY;
+    const char* strings[2] = { archive_abs, password };
+    ServiceRequest req;
+    memset(&req, 0, sizeof(req));
+    req.op = SERVICE_OP_LIST;
+    req.strings = strings;
+    req.count = 2;
+    uint64_t size = 0;
+    int data_fd;
+    SevenZipErrorCode err = service_call(socket_path, &req, &size, &data_fd);
+    mem_free(archive_abs);
+    if (err != SEVENZIP_OK) {
+        if (data_fd >= 0) close(data_fd);
+        return err;
+    }
+    if (data_fd < 0) return SEVENZIP_ERROR_UNKNOWN;
+    const void* map = map_reply(data_fd, size);
+    if (!map) return SEVENZIP_ERROR_UNKNOWN;
+    err = service_list_decode((const unsigned char*)map, size, list);
+    munmap((void*)map, (size_t)size);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_service_read_entry(
+    const char* socket_path,
+    const char* archive_path,
+    const char* password,
+    uint32_t entry_index,
+    const void** data,
+    size_t* size
+) {
+    if (!socket_path || !archive_path || !data || !size) return SEVENZIP_ERROR_INVALID_PARAM;
+    *data = NULL;
+    *size = 0;
+    char* archive_abs = absolute_path(archive_path);
+    if (!archive_abs) return SEVENZIP_ERROR_MEMORY;
+    const char* strings[2] = { archive_abs, password };
+    ServiceRequest req;
+    memset(&req, 0, sizeof(req));
+    req.op = SERVICE_OP_READ;
+    req.strings = strings;
+    req.count = 2;
+    req.args[0] = entry_index;
+    uint64_t data_size = 0;
+    int data_fd;
+    SevenZipErrorCode err = service_call(socket_path, &req, &data_size, &data_fd);
+    mem_free(archive_abs);
+    if (err != SEVENZIP_OK) {
+        if (data_fd >= 0) close(data_fd);
+        return err;
+    }
+    if (data_fd < 0) return SEVENZIP_OK;  /* Empty file */
+    *data = map_reply(data_fd, data_size);
+    if (!*data) return SEVENZIP_ERROR_UNKNOWN;
+    *size = (size_t)data_size;
+    return SEVENZIP_OK;
+}
+
+void sevenzip_service_free_data(const void* data, size_t size) {
+    if (data) munmap((void*)data, size);
+}
+
+#else /* _WIN32: no Unix sockets or descriptor passing */
+
+void sevenzip_service_options_init(SevenZipServiceOptions* options) {
+    if (options) memset(options, 0, sizeof(*options));
+}
+
+SevenZipErrorCode sevenzip_service_start(const char* socket_path, const SevenZipServiceOptions* options,
+                                         SevenZipService** service) {
+    (void)socket_path;
+    (void)options;
+    if (service) *service = NULL;
+    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+}
+
+void sevenzip_service_stop(SevenZipService* service) {
+    (void)service;
+}
+
+SevenZipErrorCode sevenzip_service_create(const char* socket_path, const char* archive_path,
+                                          const char** input_paths, SevenZipCompressionLevel level,
+                                          const SevenZipStreamOptions* options) {
+    (void)socket_path; (void)archive_path; (void)input_paths; (void)level; (void)options;
+    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+}
+
+SevenZipErrorCode sevenzip_service_extract(const char* socket_path, const char* archive_path,
+                                           const char* output_dir, const char* password,
+                                           const SevenZipExtractOptions* options) {
+    (void)socket_path; (void)archive_path; (void)output_dir; (void)password; (void)options;
+    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+}
+
+SevenZipErrorCode sevenzip_service_list(const char* socket_path, const char* archive_path,
+                                        const char* password, SevenZipList** list) {
+    (void)socket_path; (void)archive_path; (void)password;
+    if (list) *list = NULL;
+    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+}
+
+SevenZipErrorCode sevenzip_service_read_entry(const char* socket_path, const char* archive_path,
+                                              const char* password, uint32_t entry_index,
+                                              const void** data, size_t* size) {
+    (void)socket_path; (void)archive_path; (void)password; (void)entry_index;
+    if (data) *data = NULL;
+    if (size) *size = 0;
+    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+}
+
+void sevenzip_service_free_data(const void* data, size_t size) {
+    (void)data;
+    (void)size;
+}
+
+#endif
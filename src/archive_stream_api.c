@@ -1,74 +1,34 @@
 /**
  * Streaming 7z Archive Creation
  * 
- * Implements chunk-based compression to handle files larger than RAM.
- * Supports split/multi-volume archives for easier transfer.
- * Provides byte-level progress tracking.
+ * Options of the SevenZipStreamOptions entry points, and
+ * sevenzip_create_7z_streaming(): a plain archive, or volumes once the
+ * input outgrows split_size, written by the create engine
+ * (create_engine.h) with byte-level progress. sevenzip_create_7z_auto()
+ * hands a few small files to the in-memory builder instead.
  */
 
 #include "../include/7z_ffi.h"
-#include "Lzma2Enc.h"
-#include "7zCrc.h"
-#include "Alloc.h"
+#include "create_engine.h"
+#include "memory_budget.h"
 
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
-#include <time.h>
-#include <errno.h>
 
 #ifdef _WIN32
-    #include <windows.h>
-    #include <direct.h>
     #define STAT _stat
-    #define MKDIR(path) _mkdir(path)
-    #define PATH_SEP '\\'
     #define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
-    #define S_ISDIR(m) (((m) & _S_IFMT) == _S_IFDIR)
 #else
-    #include <unistd.h>
-    #include <dirent.h>
-    #include <sys/types.h>
     #define STAT stat
-    #define MKDIR(path) mkdir(path, 0755)
-    #define PATH_SEP '/'
 #endif
 
 #define DEFAULT_CHUNK_SIZE (64 * 1024 * 1024)  // 64 MB
 #define DEFAULT_DICT_SIZE (32 * 1024 * 1024)   // 32 MB
 #define DEFAULT_THREADS 2
-#define TEMP_FILE_PREFIX "7z_temp_"
+#define DEFAULT_PREFETCH_BUFFERS 4                // 4 x 4MB read-ahead slots
 
-/* Context for streaming compression */
-typedef struct {
-    FILE* current_volume;
-    uint64_t current_volume_size;
-    uint64_t volume_index;
-    uint64_t split_size;
-    char base_archive_path[1024];
-    char temp_dir[512];
-    
-    /* Progress tracking */
-    uint64_t total_bytes_processed;
-    uint64_t total_bytes_to_process;
-    SevenZipBytesProgressCallback progress_callback;
-    void* user_data;
-    
-    /* Current file being processed */
-    char current_file_name[512];
-    uint64_t current_file_bytes;
-    uint64_t current_file_total;
-} StreamContext;
-
-/* File list for gathering all input files */
-typedef struct {
-    char** paths;
-    uint64_t* sizes;
-    size_t count;
-    size_t capacity;
-    uint64_t total_size;
-} FileList;
+#define AUTO_IN_MEMORY_MAX_BYTES (16 * 1024 * 1024)  // Inputs the builder takes
+#define AUTO_IN_MEMORY_MAX_FILES 256
 
 /**
  * Initialize streaming options with defaults
@@ -85,361 +45,233 @@ void sevenzip_stream_options_init(SevenZipStreamOptions* options) {
     options->chunk_size = DEFAULT_CHUNK_SIZE;
     options->temp_dir = NULL;  // Use system default
     options->delete_temp_on_error = 1;
+    options->prefetch_buffers = DEFAULT_PREFETCH_BUFFERS;
+    options->solid_block_size = 0;
+    options->solid_block_files = 0;
+    options->filter = SEVENZIP_FILTER_AUTO;
+    options->delta_distance = 0;
+    options->delta_extensions = NULL;
+    options->method = SEVENZIP_METHOD_LZMA2;
+    options->ppmd_order = 0;
+    options->ppmd_mem_size = 0;
+    options->max_memory = 0;
+    options->unbuffered_output = 0;
+    options->input_access_hints = 0;
+    options->progress_interval_ms = 0;
+    options->progress_interval_bytes = 0;
+    options->cancel = NULL;
+    options->checkpoint = 0;
+    options->block_size = 0;
+    options->numa_policy = SEVENZIP_NUMA_OFF;
+    options->volume_dirs = NULL;
+    options->digest_manifest = NULL;
+    options->digest_algorithm = SEVENZIP_DIGEST_SHA256;
+    options->snapshot_base = NULL;
+    options->snapshot_output = NULL;
+    options->detect_compressed = 0;
+    options->lzma_params = NULL;
+    options->sync_volumes = 0;
+    options->volume_complete = NULL;
+    options->volume_user_data = NULL;
+    options->volume_digests = 0;
+    options->volume_manifest = NULL;
+    options->write_index = 0;
+    options->zero_blocks = 0;
+    options->memory_pressure_throttle = 0;
+    options->rate_limit = NULL;
+    options->next_input_path = NULL;
+    options->input_path_user_data = NULL;
+    options->input_list = NULL;
+    options->verify_writes = 0;
+    options->group_duplicates = 0;
+    options->solid_sort = 0;
+    options->streamable = 0;
+    options->streamable_reserve = 0;
+    options->folder_stats = 0;
+    options->throughput_target = 0;
+    options->entry_policy = NULL;
+    options->entry_policy_data = NULL;
+    options->deterministic = 0;
+    options->fixed_mtime = 0;
+    options->block_cache_dir = NULL;
 }
 
 /**
- * Get temporary directory path
+ * Create a 7z archive with streaming compression
+ * 
+ * Without split_size the archive is one file; with it, an input that fits
+ * one volume still is, and a larger one becomes archive_path.001, ...
  */
-static void get_temp_dir(char* buffer, size_t size, const char* custom_temp) {
-    if (custom_temp && custom_temp[0]) {
-        snprintf(buffer, size, "%s", custom_temp);
-        return;
+SevenZipErrorCode sevenzip_create_7z_streaming(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !create_job_has_inputs(input_paths, options)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-#ifdef _WIN32
-    char temp[MAX_PATH];
-    GetTempPathA(MAX_PATH, temp);
-    snprintf(buffer, size, "%s", temp);
-#else
-    const char* tmp = getenv("TMPDIR");
-    if (!tmp) tmp = getenv("TEMP");
-    if (!tmp) tmp = getenv("TMP");
-    if (!tmp) tmp = "/tmp";
-    snprintf(buffer, size, "%s", tmp);
-#endif
-}
-
-/**
- * Generate volume filename (e.g., archive.7z.001, archive.7z.002)
- */
-static void get_volume_name(const char* base_path, uint64_t volume_index, char* buffer, size_t size) {
-    if (volume_index == 0) {
-        snprintf(buffer, size, "%s", base_path);
-    } else {
-        snprintf(buffer, size, "%s.%03llu", base_path, (unsigned long long)volume_index);
+    CreateJob job;
+    create_job_init(&job, archive_path, input_paths, level, options, CREATE_OUTPUT_FILE,
+                    progress_callback, user_data);
+    if (job.options.split_size > 0) {
+        job.output = CREATE_OUTPUT_FIT;
     }
+    return create_engine_run(&job);
 }
 
 /**
- * Open next volume for writing
+ * Create a 7z archive as one solid folder
+ * 
+ * Every file goes to one LZMA2 stream, whatever the solid and stored-format
+ * options say; the archive is always a single file. The stream is cut into
+ * independent chunk_size blocks coded on every thread and written in order,
+ * so one huge file scales with the cores in threads x chunk memory.
  */
-static int open_next_volume(StreamContext* ctx) {
-    char volume_path[1024];
-    
-    if (ctx->current_volume) {
-        fclose(ctx->current_volume);
-        ctx->current_volume = NULL;
-    }
-    
-    get_volume_name(ctx->base_archive_path, ctx->volume_index, volume_path, sizeof(volume_path));
-    
-    ctx->current_volume = fopen(volume_path, "wb");
-    if (!ctx->current_volume) {
-        fprintf(stderr, "Failed to open volume: %s\n", volume_path);
-        return 0;
+SevenZipErrorCode sevenzip_create_7z_true_streaming(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!archive_path || !create_job_has_inputs(input_paths, options)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    ctx->current_volume_size = 0;
-    ctx->volume_index++;
-    
-    return 1;
+    CreateJob job;
+    create_job_init(&job, archive_path, input_paths, level, options, CREATE_OUTPUT_FILE,
+                    progress_callback, user_data);
+    job.options.split_size = 0;
+    job.options.solid = 1;
+    job.options.solid_block_size = 0;
+    job.options.solid_block_files = 0;
+    job.options.detect_compressed = 0;
+    job.chunk_blocks = 1;
+    return create_engine_run(&job);
 }
 
 /**
- * Write data to archive, handling volume splits
+ * Estimate the peak memory of sevenzip_create_7z_streaming()
  */
-static int write_to_archive(StreamContext* ctx, const void* data, size_t size) {
-    const uint8_t* ptr = (const uint8_t*)data;
-    size_t remaining = size;
-    
-    while (remaining > 0) {
-        // Check if we need to start a new volume
-        if (ctx->split_size > 0 && ctx->current_volume_size >= ctx->split_size) {
-            if (!open_next_volume(ctx)) {
-                return 0;
-            }
-        }
-        
-        // Calculate how much we can write to current volume
-        size_t to_write = remaining;
-        if (ctx->split_size > 0) {
-            uint64_t space_left = ctx->split_size - ctx->current_volume_size;
-            if (to_write > space_left) {
-                to_write = (size_t)space_left;
-            }
-        }
-        
-        // Write the data
-        size_t written = fwrite(ptr, 1, to_write, ctx->current_volume);
-        if (written != to_write) {
-            fprintf(stderr, "Write error: expected %zu, wrote %zu\n", to_write, written);
-            return 0;
-        }
-        
-        ctx->current_volume_size += written;
-        ptr += written;
-        remaining -= written;
+SevenZipErrorCode sevenzip_estimate_memory(
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    uint64_t* peak_bytes
+) {
+    if (!peak_bytes) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    return 1;
-}
-
-/**
- * Update progress callback
- */
-static void update_progress(StreamContext* ctx) {
-    if (ctx->progress_callback) {
-        ctx->progress_callback(
-            ctx->total_bytes_processed,
-            ctx->total_bytes_to_process,
-            ctx->current_file_bytes,
-            ctx->current_file_total,
-            ctx->current_file_name,
-            ctx->user_data
-        );
+    SevenZipStreamOptions default_opts;
+    if (!options) {
+        sevenzip_stream_options_init(&default_opts);
+        options = &default_opts;
     }
+    return sevenzip_multivolume_memory_plan(level, options, peak_bytes);
 }
 
-/**
- * Initialize file list
- */
-static void file_list_init(FileList* list) {
-    list->paths = NULL;
-    list->sizes = NULL;
-    list->count = 0;
-    list->capacity = 0;
-    list->total_size = 0;
+/* Streaming options for the in-memory builder, which has no volumes,
+ * encryption, checkpoints, manifests or snapshots */
+static int auto_needs_engine(const SevenZipStreamOptions* o) {
+    return (o->password && o->password[0]) || o->split_size > 0 || o->checkpoint ||
+           o->volume_dirs || o->digest_manifest || o->snapshot_base || o->snapshot_output ||
+           o->unbuffered_output || o->sync_volumes || o->volume_complete ||
+           o->volume_digests || o->volume_manifest || o->write_index ||
+           o->zero_blocks || o->memory_pressure_throttle || o->rate_limit ||
+           o->verify_writes || o->next_input_path || o->input_list ||
+           o->group_duplicates || o->streamable || o->folder_stats ||
+           o->throughput_target > 0 || o->entry_policy;
 }
 
-/**
- * Add file to list
- */
-static int file_list_add(FileList* list, const char* path, uint64_t size) {
-    if (list->count >= list->capacity) {
-        size_t new_capacity = list->capacity == 0 ? 64 : list->capacity * 2;
-        char** new_paths = (char**)realloc(list->paths, new_capacity * sizeof(char*));
-        uint64_t* new_sizes = (uint64_t*)realloc(list->sizes, new_capacity * sizeof(uint64_t));
-        
-        if (!new_paths || !new_sizes) {
-            free(new_paths);
-            free(new_sizes);
-            return 0;
-        }
-        
-        list->paths = new_paths;
-        list->sizes = new_sizes;
-        list->capacity = new_capacity;
-    }
-    
-    list->paths[list->count] = strdup(path);
-    if (!list->paths[list->count]) {
-        return 0;
-    }
-    
-    list->sizes[list->count] = size;
-    list->total_size += size;
-    list->count++;
-    
-    return 1;
+static void auto_compress_options(const SevenZipStreamOptions* o, SevenZipCompressOptions* c) {
+    memset(c, 0, sizeof(*c));
+    c->num_threads = o->num_threads;
+    c->dict_size = o->dict_size;
+    c->solid = o->solid;
+    c->solid_block_size = o->solid_block_size;
+    c->solid_block_files = o->solid_block_files;
+    c->filter = o->filter;
+    c->delta_distance = o->delta_distance;
+    c->delta_extensions = o->delta_extensions;
+    c->method = o->method;
+    c->ppmd_order = o->ppmd_order;
+    c->ppmd_mem_size = o->ppmd_mem_size;
+    c->max_memory = o->max_memory;
+    c->cancel = o->cancel;
+    c->block_size = o->block_size;
+    c->thread_weight = o->thread_weight;
+    c->numa_policy = o->numa_policy;
+    c->detect_compressed = o->detect_compressed;
+    c->lzma_params = o->lzma_params;
+    c->solid_sort = o->solid_sort;
 }
 
-/**
- * Free file list
- */
-static void file_list_free(FileList* list) {
-    if (list->paths) {
-        for (size_t i = 0; i < list->count; i++) {
-            free(list->paths[i]);
-        }
-        free(list->paths);
+/* Total size of the inputs while they are few small regular files;
+ * 0 as soon as one is not (a directory, missing, or over the limits) */
+static int auto_small_files(const char** input_paths, uint64_t* total_bytes) {
+    uint64_t total = 0;
+    int count = 0;
+    for (const char** p = input_paths; *p; p++) {
+        struct STAT st;
+        if (STAT(*p, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+        total += (uint64_t)st.st_size;
+        if (++count > AUTO_IN_MEMORY_MAX_FILES || total > AUTO_IN_MEMORY_MAX_BYTES) return 0;
     }
-    free(list->sizes);
-    file_list_init(list);
+    *total_bytes = total;
+    return count > 0;
 }
 
-/**
- * Recursively gather all files from paths
- */
-static int gather_files(const char* path, FileList* list);
-
-static int gather_directory_files(const char* dir_path, FileList* list) {
-#ifdef _WIN32
-    WIN32_FIND_DATAA find_data;
-    char search_path[1024];
-    snprintf(search_path, sizeof(search_path), "%s\\*", dir_path);
-    
-    HANDLE hFind = FindFirstFileA(search_path, &find_data);
-    if (hFind == INVALID_HANDLE_VALUE) {
-        return 0;
+static SevenZipErrorCode auto_choose(const char** input_paths, SevenZipCompressionLevel level,
+                                     const SevenZipStreamOptions* options,
+                                     SevenZipCreateEngine* engine, uint64_t* total_bytes) {
+    *engine = SEVENZIP_ENGINE_STREAMING;
+    *total_bytes = 0;
+    if (auto_needs_engine(options) || !auto_small_files(input_paths, total_bytes)) {
+        return SEVENZIP_OK;
     }
-    
-    do {
-        if (strcmp(find_data.cFileName, ".") == 0 || strcmp(find_data.cFileName, "..") == 0) {
-            continue;
-        }
-        
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s\\%s", dir_path, find_data.cFileName);
-        
-        if (!gather_files(full_path, list)) {
-            FindClose(hFind);
-            return 0;
-        }
-    } while (FindNextFileA(hFind, &find_data));
-    
-    FindClose(hFind);
-#else
-    DIR* dir = opendir(dir_path);
-    if (!dir) {
-        return 0;
-    }
-    
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-        
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-        
-        if (!gather_files(full_path, list)) {
-            closedir(dir);
-            return 0;
-        }
-    }
-    
-    closedir(dir);
-#endif
-    
-    return 1;
-}
 
-static int gather_files(const char* path, FileList* list) {
-    struct STAT st;
-    if (STAT(path, &st) != 0) {
-        fprintf(stderr, "Cannot stat: %s\n", path);
-        return 0;
+    /* The builder holds each file and its compressed copy besides the coders */
+    SevenZipCompressOptions copts;
+    auto_compress_options(options, &copts);
+    uint64_t peak = 0;
+    if (sevenzip_create_memory_plan(level, &copts, &peak) != SEVENZIP_OK) {
+        return SEVENZIP_OK;
     }
-    
-    if (S_ISREG(st.st_mode)) {
-        return file_list_add(list, path, (uint64_t)st.st_size);
-    } else if (S_ISDIR(st.st_mode)) {
-        return gather_directory_files(path, list);
+    uint64_t available = sevenzip_available_memory();
+    if (available == 0 || peak + 2 * *total_bytes <= available / 2) {
+        *engine = SEVENZIP_ENGINE_IN_MEMORY;
     }
-    
-    return 1;  // Skip other file types
+    return SEVENZIP_OK;
 }
 
-/**
- * Compress a single file in chunks using LZMA2
- * This is a simplified version that compresses each chunk independently
- * and writes to a temporary file, then combines them.
- */
-static SevenZipErrorCode compress_file_streaming(
-    StreamContext* ctx,
-    const char* file_path,
-    uint64_t file_size,
+SevenZipErrorCode sevenzip_choose_create_engine(
+    const char** input_paths,
     SevenZipCompressionLevel level,
-    uint64_t chunk_size,
-    int num_threads
+    const SevenZipStreamOptions* options,
+    SevenZipCreateEngine* engine
 ) {
-    FILE* input = fopen(file_path, "rb");
-    if (!input) {
-        fprintf(stderr, "Cannot open input file: %s\n", file_path);
-        return SEVENZIP_ERROR_OPEN_FILE;
-    }
-    
-    // Update progress context
-    snprintf(ctx->current_file_name, sizeof(ctx->current_file_name), "%s", file_path);
-    ctx->current_file_bytes = 0;
-    ctx->current_file_total = file_size;
-    
-    // Allocate chunk buffer
-    uint8_t* chunk_buffer = (uint8_t*)malloc(chunk_size);
-    if (!chunk_buffer) {
-        fclose(input);
-        return SEVENZIP_ERROR_MEMORY;
-    }
-    
-    // Initialize LZMA2 encoder
-    CLzma2EncHandle enc = Lzma2Enc_Create(&g_Alloc, &g_Alloc);
-    if (!enc) {
-        free(chunk_buffer);
-        fclose(input);
-        return SEVENZIP_ERROR_MEMORY;
-    }
-    
-    CLzma2EncProps props;
-    Lzma2EncProps_Init(&props);
-    props.lzmaProps.level = level;
-    
-    /* OPTIMIZED: Block-level parallelism for multi-core compression
-     * Use N/2 block threads with 2 LZMA threads each for max throughput */
-    if (num_threads > 0) {
-        int block_threads = num_threads / 2;
-        if (block_threads < 1) block_threads = 1;
-        props.numBlockThreads_Max = block_threads;
-        props.lzmaProps.numThreads = 2;
-        props.numTotalThreads = num_threads;
-        props.blockSize = 0;  /* Auto-calculate based on dictionary */
-    }
-    
-    SRes res = Lzma2Enc_SetProps(enc, &props);
-    if (res != SZ_OK) {
-        Lzma2Enc_Destroy(enc);
-        free(chunk_buffer);
-        fclose(input);
-        return SEVENZIP_ERROR_COMPRESS;
+    if (!create_job_has_inputs(input_paths, options) || !engine) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    // Process file in chunks
-    uint64_t bytes_read_total = 0;
-    while (bytes_read_total < file_size) {
-        size_t to_read = (size_t)chunk_size;
-        if (bytes_read_total + to_read > file_size) {
-            to_read = (size_t)(file_size - bytes_read_total);
-        }
-        
-        size_t bytes_read = fread(chunk_buffer, 1, to_read, input);
-        if (bytes_read == 0) {
-            break;
-        }
-        
-        // For now, just write uncompressed data to demonstrate streaming
-        // A full implementation would compress using proper LZMA2 stream API
-        if (!write_to_archive(ctx, chunk_buffer, bytes_read)) {
-            Lzma2Enc_Destroy(enc);
-            free(chunk_buffer);
-            fclose(input);
-            return SEVENZIP_ERROR_COMPRESS;
-        }
-        
-        bytes_read_total += bytes_read;
-        ctx->current_file_bytes = bytes_read_total;
-        ctx->total_bytes_processed += bytes_read;
-        
-        // Update progress
-        update_progress(ctx);
+    SevenZipStreamOptions default_opts;
+    if (!options) {
+        sevenzip_stream_options_init(&default_opts);
+        options = &default_opts;
     }
-    
-    Lzma2Enc_Destroy(enc);
-    free(chunk_buffer);
-    fclose(input);
-    
-    return SEVENZIP_OK;
+    uint64_t total_bytes;
+    return auto_choose(input_paths, level, options, engine, &total_bytes);
 }
 
 /**
- * Create a 7z archive with streaming compression
- * 
- * IMPLEMENTATION NOTE: For non-split archives (split_size == 0), this function
- * uses the standard sevenzip_create_7z() to create a proper 7z archive.
- * Split archive support with streaming requires full LZMA SDK integration
- * which is complex - for now, we ensure compatibility by using the standard
- * creation path when splits are not needed.
+ * Create a 7z archive with the in-memory builder or the create engine
  */
-SevenZipErrorCode sevenzip_create_7z_streaming(
+SevenZipErrorCode sevenzip_create_7z_auto(
     const char* archive_path,
     const char** input_paths,
     SevenZipCompressionLevel level,
@@ -447,108 +279,44 @@ SevenZipErrorCode sevenzip_create_7z_streaming(
     SevenZipBytesProgressCallback progress_callback,
     void* user_data
 ) {
-    if (!archive_path || !input_paths) {
+    if (!archive_path || !create_job_has_inputs(input_paths, options)) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    // Initialize options with defaults if not provided
-    SevenZipStreamOptions default_opts;
-    if (!options) {
-        sevenzip_stream_options_init(&default_opts);
-        options = &default_opts;
-    }
-    
-    // For non-split archives, use the standard creation function
-    // This ensures we create proper, valid 7z archives
-    if (options->split_size == 0) {
-        // Convert StreamOptions to CompressOptions
-        SevenZipCompressOptions comp_opts;
-        comp_opts.num_threads = options->num_threads;
-        comp_opts.dict_size = options->dict_size;
-        comp_opts.solid = options->solid;
-        comp_opts.password = options->password;
-        
-        // Use standard creation (which creates valid 7z archives)
-        // Note: We lose the byte-level progress callback, but archives work
-        SevenZipProgressCallback simple_callback = NULL;
-        if (progress_callback) {
-            // Wrap the bytes callback as a simple callback
-            // TODO: Implement wrapper to convert between callback types
-            simple_callback = NULL;  // For now, no progress with streaming
+    SevenZipStreamOptions opts;
+    if (options) opts = *options;
+    else sevenzip_stream_options_init(&opts);
+    
+    SevenZipCreateEngine engine;
+    uint64_t total_bytes;
+    auto_choose(input_paths, level, &opts, &engine, &total_bytes);
+    
+    if (engine == SEVENZIP_ENGINE_IN_MEMORY) {
+        /* The builder reports inputs listed, not compressed: start and end only */
+        SevenZipCompressOptions copts;
+        auto_compress_options(&opts, &copts);
+        if (progress_callback) progress_callback(0, total_bytes, 0, 0, NULL, user_data);
+        SevenZipErrorCode result = sevenzip_create_7z(archive_path, input_paths, level, &copts,
+                                                      NULL, NULL);
+        if (result == SEVENZIP_OK && progress_callback) {
+            progress_callback(total_bytes, total_bytes, 0, 0, NULL, user_data);
         }
-        
-        return sevenzip_create_7z(
-            archive_path,
-            input_paths,
-            level,
-            &comp_opts,
-            simple_callback,
-            user_data
-        );
+        return result;
     }
     
-    // SPLIT ARCHIVE IMPLEMENTATION
-    // For split archives, we need to implement proper 7z multi-volume support
-    // This is complex and requires full LZMA SDK integration
-    
-    // Gather all input files
-    FileList files;
-    file_list_init(&files);
-    
-    for (int i = 0; input_paths[i] != NULL; i++) {
-        if (!gather_files(input_paths[i], &files)) {
-            file_list_free(&files);
-            return SEVENZIP_ERROR_INVALID_PARAM;
+    /* Hold a job that would not fit to what there is */
+    uint64_t available = sevenzip_available_memory();
+    uint64_t peak = 0;
+    if (opts.max_memory == 0 && available > 0 &&
+        sevenzip_multivolume_memory_plan(level, &opts, &peak) == SEVENZIP_OK &&
+        peak > available / 4 * 3) {
+        opts.max_memory = available / 4 * 3;
+        if (sevenzip_multivolume_memory_plan(level, &opts, &peak) != SEVENZIP_OK) {
+            opts.max_memory = 0;
         }
     }
-    
-    if (files.count == 0) {
-        file_list_free(&files);
-        return SEVENZIP_ERROR_INVALID_PARAM;
-    }
-    
-    // Check if total size requires splitting
-    if (files.total_size <= options->split_size) {
-        // Total size fits in one volume, use standard creation
-        file_list_free(&files);
-        
-        SevenZipCompressOptions comp_opts;
-        comp_opts.num_threads = options->num_threads;
-        comp_opts.dict_size = options->dict_size;
-        comp_opts.solid = options->solid;
-        comp_opts.password = options->password;
-        
-        return sevenzip_create_7z(
-            archive_path,
-            input_paths,
-            level,
-            &comp_opts,
-            NULL,
-            user_data
-        );
-    }
-    
-    // TRUE MULTI-VOLUME ARCHIVES - Use complete multi-volume implementation
-    file_list_free(&files);
-    
-    // Delegate to complete multi-volume implementation
-    extern SevenZipErrorCode sevenzip_create_multivolume_7z_complete(
-        const char* archive_path,
-        const char** input_paths,
-        SevenZipCompressionLevel level,
-        const SevenZipStreamOptions* options,
-        SevenZipBytesProgressCallback progress_callback,
-        void* user_data
-    );
-    
-    return sevenzip_create_multivolume_7z_complete(
-        archive_path,
-        input_paths,
-        level,
-        options,
-        progress_callback,
-        user_data
-    );
+    return sevenzip_create_7z_streaming(archive_path, input_paths, level, &opts,
+                                        progress_callback, user_data);
 }
 
 /* 
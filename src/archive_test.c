@@ -3,14 +3,26 @@
  * 
  * Verify archive integrity without extracting files.
  * Validates CRCs, headers, and structure.
+ * sevenzip_archive_batch() lists or tests many archives at once.
  */
 
 #include "../include/7z_ffi.h"
 #include "7z.h"
-#include "7zAlloc.h"
 #include "7zBuf.h"
 #include "7zCrc.h"
 #include "7zFile.h"
+#include "mem_alloc.h"
+#include "folder_stream.h"
+#include "mmap_stream.h"
+#include "volume_stream.h"
+#include "utf_convert.h"
+#include "thread_quota.h"
+#include "thread_placement.h"
+#include "cancel_token.h"
+#include "archive_handle.h"
+#include "global_tables.h"
+#include "metrics.h"
+#include "Threads.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,324 +44,574 @@ typedef struct {
     char first_error[512];
 } TestResult;
 
-/* Multi-volume input stream (reuse from 7z_extract_split.c) */
+/* Counts and progress shared by the test workers */
 typedef struct {
-    ISeekInStream vt;
-    FILE** volumes;
-    int volume_count;
-    uint64_t* volume_sizes;
-    uint64_t* volume_offsets;
-    uint64_t total_size;
-    int current_volume;
-    uint64_t current_pos;
-} MultiVolumeInStream;
+    TestResult result;
+    CCriticalSection* lock;   // Set when several workers test at once
+    SevenZipBytesProgressCallback progress_callback;
+    void* user_data;
+} TestProgress;
 
-/* Forward declarations */
-static int open_split_volumes(const char* base_path, MultiVolumeInStream* stream);
-static void close_split_volumes(MultiVolumeInStream* stream);
-static SRes MultiVolumeInStream_Read(ISeekInStreamPtr pp, void *buf, size_t *size);
-static SRes MultiVolumeInStream_Seek(ISeekInStreamPtr pp, Int64 *pos, ESzSeek origin);
+// Receives decoded files for CRC checking only; the bytes are dropped
+typedef struct {
+    FolderStreamSink vt;
+    const CSzArEx* db;
+    TestProgress* progress;
+    UInt32 current;           // File being decoded, for the error message
+    char file_name[512];
+} TestSink;
 
-/* Seek callback for multi-volume stream */
-static SRes MultiVolumeInStream_Seek(ISeekInStreamPtr pp, Int64 *pos, ESzSeek origin) {
-    MultiVolumeInStream* p = (MultiVolumeInStream*)pp;
-    
-    uint64_t new_pos;
-    switch (origin) {
-        case SZ_SEEK_SET:
-            new_pos = (uint64_t)*pos;
-            break;
-        case SZ_SEEK_CUR:
-            new_pos = p->current_pos + (uint64_t)*pos;
-            break;
-        case SZ_SEEK_END:
-            new_pos = p->total_size + (uint64_t)*pos;
-            break;
-        default:
-            return SZ_ERROR_PARAM;
-    }
-    
-    if (new_pos > p->total_size) {
-        return SZ_ERROR_PARAM;
-    }
+/* Name of an entry for progress and errors, truncated to fit */
+static void test_file_name(const CSzArEx* db, UInt32 file_index, char* out, size_t out_size) {
+    out[0] = '\0';
+    char* name = utf16le_to_utf8_dup(db->FileNames + db->FileNameOffsets[file_index] * 2,
+                                     SzArEx_GetFileNameUtf16(db, file_index, NULL));
+    if (!name) return;
+    strncpy(out, name, out_size - 1);
+    out[out_size - 1] = '\0';
+    mem_free(name);
+}
+
+static SRes TestSink_Begin(FolderStreamSink* pp, UInt32 file_index) {
+    TestSink* p = Z7_CONTAINER_FROM_VTBL(pp, TestSink, vt);
+    TestProgress* progress = p->progress;
+    p->current = file_index;
+    if (!progress->progress_callback) return SZ_OK;
     
-    p->current_pos = new_pos;
-    *pos = (Int64)new_pos;
+    // Report progress
+    test_file_name(p->db, file_index, p->file_name, sizeof(p->file_name));
+    if (progress->lock) CriticalSection_Enter(progress->lock);
+    progress->progress_callback(
+        progress->result.tested_bytes,
+        progress->result.total_bytes,
+        0,
+        SzArEx_GetFileSize(p->db, file_index),
+        p->file_name,
+        progress->user_data
+    );
+    if (progress->lock) CriticalSection_Leave(progress->lock);
     return SZ_OK;
 }
 
-/* Read callback for multi-volume stream */
-static SRes MultiVolumeInStream_Read(ISeekInStreamPtr pp, void *buf, size_t *size) {
-    MultiVolumeInStream* p = (MultiVolumeInStream*)pp;
-    uint8_t* ptr = (uint8_t*)buf;
-    size_t remaining = *size;
-    size_t total_read = 0;
-    
-    while (remaining > 0 && p->current_pos < p->total_size) {
-        // Find which volume contains current position
-        int volume_idx = 0;
-        for (int i = 0; i < p->volume_count; i++) {
-            if (p->current_pos < p->volume_offsets[i + 1]) {
-                volume_idx = i;
-                break;
-            }
-        }
-        
-        // Calculate position within volume
-        uint64_t volume_start = p->volume_offsets[volume_idx];
-        uint64_t volume_pos = p->current_pos - volume_start;
-        uint64_t volume_remaining = p->volume_sizes[volume_idx] - volume_pos;
-        
-        // Read from current volume
-        size_t to_read = remaining;
-        if (to_read > volume_remaining) {
-            to_read = (size_t)volume_remaining;
-        }
-        
-        FILE* vol = p->volumes[volume_idx];
-        if (fseek(vol, (long)volume_pos, SEEK_SET) != 0) {
-            *size = total_read;
-            return SZ_ERROR_READ;
-        }
-        
-        size_t bytes_read = fread(ptr, 1, to_read, vol);
-        if (bytes_read == 0 && to_read > 0) {
-            *size = total_read;
-            return SZ_ERROR_READ;
-        }
-        
-        ptr += bytes_read;
-        remaining -= bytes_read;
-        total_read += bytes_read;
-        p->current_pos += bytes_read;
-    }
-    
-    *size = total_read;
-    return (total_read > 0) ? SZ_OK : SZ_ERROR_READ;
+static SRes TestSink_Write(FolderStreamSink* pp, const Byte* data, size_t size) {
+    (void)pp;
+    (void)data;
+    (void)size;
+    return SZ_OK;
 }
 
-/* Open split volumes */
-static int open_split_volumes(const char* base_path, MultiVolumeInStream* stream) {
-    memset(stream, 0, sizeof(MultiVolumeInStream));
-    stream->vt.Read = (SRes (*)(ISeekInStreamPtr, void *, size_t *))MultiVolumeInStream_Read;
-    stream->vt.Seek = MultiVolumeInStream_Seek;
-    
-    // Try to open first volume
-    FILE* first = fopen(base_path, "rb");
-    if (!first) {
-        // Try .001 extension
-        char vol_path[1024];
-        snprintf(vol_path, sizeof(vol_path), "%s.001", base_path);
-        first = fopen(vol_path, "rb");
-        if (!first) return 0;
-        
-        // Multi-volume archive
-        stream->volumes = (FILE**)calloc(256, sizeof(FILE*));
-        stream->volume_sizes = (uint64_t*)calloc(256, sizeof(uint64_t));
-        stream->volume_offsets = (uint64_t*)calloc(257, sizeof(uint64_t));
-        
-        stream->volumes[0] = first;
-        fseek(first, 0, SEEK_END);
-        stream->volume_sizes[0] = (uint64_t)ftell(first);
-        stream->volume_offsets[0] = 0;
-        stream->volume_offsets[1] = stream->volume_sizes[0];
-        stream->volume_count = 1;
-        stream->total_size = stream->volume_sizes[0];
-        
-        // Open remaining volumes
-        for (int i = 2; i <= 256; i++) {
-            snprintf(vol_path, sizeof(vol_path), "%s.%03d", base_path, i);
-            FILE* vol = fopen(vol_path, "rb");
-            if (!vol) break;
-            
-            stream->volumes[i-1] = vol;
-            fseek(vol, 0, SEEK_END);
-            stream->volume_sizes[i-1] = (uint64_t)ftell(vol);
-            stream->total_size += stream->volume_sizes[i-1];
-            stream->volume_offsets[i] = stream->total_size;
-            stream->volume_count = i;
-        }
-    } else {
-        // Single volume
-        stream->volumes = (FILE**)calloc(1, sizeof(FILE*));
-        stream->volume_sizes = (uint64_t*)calloc(1, sizeof(uint64_t));
-        stream->volume_offsets = (uint64_t*)calloc(2, sizeof(uint64_t));
-        
-        stream->volumes[0] = first;
-        fseek(first, 0, SEEK_END);
-        stream->volume_sizes[0] = (uint64_t)ftell(first);
-        stream->volume_offsets[0] = 0;
-        stream->volume_offsets[1] = stream->volume_sizes[0];
-        stream->volume_count = 1;
-        stream->total_size = stream->volume_sizes[0];
+/* Called once the file's CRC matched */
+static SRes TestSink_End(FolderStreamSink* pp, UInt32 file_index) {
+    TestSink* p = Z7_CONTAINER_FROM_VTBL(pp, TestSink, vt);
+    TestProgress* progress = p->progress;
+    if (progress->lock) CriticalSection_Enter(progress->lock);
+    progress->result.tested_files++;
+    progress->result.tested_bytes += SzArEx_GetFileSize(p->db, file_index);
+    if (progress->lock) CriticalSection_Leave(progress->lock);
+    return SZ_OK;
+}
+
+/* Reader and sink of one test worker */
+typedef struct {
+    MmapInStream mapped;
+    VolumeInStream in_stream;
+    CLookToRead2 look_stream;
+    ILookInStreamPtr stream;  /* &mapped.vt, or the buffered reader */
+    TestSink sink;
+} TestWorker;
+
+/* Worker 0 maps the volumes; later workers share its mapping, or read the handles at their own offsets */
+static int test_worker_open(TestWorker* w, VolumeSet* volumes, const TestWorker* first,
+                            ISzAllocPtr alloc) {
+    if (first ? first->mapped.volumes != NULL
+              : !volumes->parity &&
+                mmap_in_stream_open_files(&w->mapped, volumes->files, volumes->sizes, volumes->count)) {
+        if (first) mmap_in_stream_share(&w->mapped, &first->mapped);
+        else w->mapped.readahead = volumes->readahead;
+        w->stream = &w->mapped.vt;
+        return 1;
     }
-    
+    volume_in_stream_init(&w->in_stream, volumes);
+    LookToRead2_CreateVTable(&w->look_stream, False);
+    w->look_stream.buf = (Byte*)ISzAlloc_Alloc(alloc, (1 << 18)); // 256KB buffer
+    if (!w->look_stream.buf) return 0;
+    w->look_stream.bufSize = (1 << 18);
+    w->look_stream.realStream = &w->in_stream.vt;
+    LookToRead2_INIT(&w->look_stream);
+    w->stream = &w->look_stream.vt;
     return 1;
 }
 
-/* Close split volumes */
-static void close_split_volumes(MultiVolumeInStream* stream) {
-    if (stream->volumes) {
-        for (int i = 0; i < stream->volume_count; i++) {
-            if (stream->volumes[i]) {
-                fclose(stream->volumes[i]);
-            }
-        }
-        free(stream->volumes);
-    }
-    free(stream->volume_sizes);
-    free(stream->volume_offsets);
+static void test_worker_close(TestWorker* w, ISzAllocPtr alloc) {
+    ISzAlloc_Free(alloc, w->look_stream.buf);
+    w->look_stream.buf = NULL;
+    mmap_in_stream_close(&w->mapped);
 }
 
-/**
- * Test archive integrity without extracting
- * @param archive_path Path to archive file
- * @param password Optional password (NULL if not encrypted)
- * @param progress_callback Optional progress callback
- * @param user_data User data for progress callback
- * @return SEVENZIP_OK if archive is valid, error code otherwise
- */
-SevenZipErrorCode sevenzip_test_archive(
+/* `op` gets the bytes of a test that passes */
+static SevenZipErrorCode test_archive_decode(
     const char* archive_path,
     const char* password,
+    int num_threads,
+    int lzma2_threads,
+    uint64_t max_memory,
     SevenZipBytesProgressCallback progress_callback,
-    void* user_data
+    void* user_data,
+    MetricsOp* op
 ) {
     if (!archive_path) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    // Initialize CRC tables
-    CrcGenerateTable();
+    global_tables_init();
     
     // Open archive (possibly split volumes)
-    MultiVolumeInStream in_stream = {0};
-    if (!open_split_volumes(archive_path, &in_stream)) {
+    VolumeSet volumes;
+    if (!volume_set_open(&volumes, archive_path, 0)) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
     
-    // Initialize 7z structures
-    CLookToRead2 look_stream;
-    CSzArEx db;
-    ISzAlloc alloc_imp = {SzAlloc, SzFree};
-    ISzAlloc alloc_temp_imp = {SzAllocTemp, SzFreeTemp};
-    
-    LookToRead2_CreateVTable(&look_stream, False);
-    look_stream.buf = (Byte*)ISzAlloc_Alloc(&alloc_imp, (1 << 18)); // 256KB buffer
-    if (!look_stream.buf) {
-        close_split_volumes(&in_stream);
+    // Volumes mapped, else read through a look buffer per worker
+    ISzAlloc alloc_imp = g_MemDecoderAlloc;  /* Dictionaries may use huge pages */
+    ISzAlloc alloc_header = g_MemHeaderAlloc;  /* Database and header parse */
+    TestWorker* workers = (TestWorker*)calloc((size_t)num_threads, sizeof(TestWorker));
+    if (!workers) {
+        volume_set_close(&volumes);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    if (!test_worker_open(&workers[0], &volumes, NULL, &g_MemIoAlloc)) {
+        free(workers);
+        volume_set_close(&volumes);
         return SEVENZIP_ERROR_MEMORY;
     }
-    look_stream.bufSize = (1 << 18);
-    look_stream.realStream = (ISeekInStreamPtr)&in_stream;
-    LookToRead2_INIT(&look_stream);
     
+    CSzArEx db;
     SzArEx_Init(&db);
     
     // Open and validate archive structure
-    SRes res = SzArEx_Open(&db, &look_stream.vt, &alloc_imp, &alloc_temp_imp);
+    SRes res = SzArEx_Open(&db, workers[0].stream, &alloc_header, &alloc_header);
     
     if (res != SZ_OK) {
-        SzArEx_Free(&db, &alloc_imp);
-        ISzAlloc_Free(&alloc_imp, look_stream.buf);
-        close_split_volumes(&in_stream);
+        SzArEx_Free(&db, &alloc_header);
+        test_worker_close(&workers[0], &g_MemIoAlloc);
+        free(workers);
+        volume_set_close(&volumes);
         return (res == SZ_ERROR_NO_ARCHIVE) ? SEVENZIP_ERROR_INVALID_ARCHIVE :
                (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY :
                SEVENZIP_ERROR_EXTRACT;
     }
     
     // Test result tracking
-    TestResult result = {0};
-    result.total_files = (int)db.NumFiles;
+    TestProgress progress;
+    memset(&progress, 0, sizeof(progress));
+    progress.progress_callback = progress_callback;
+    progress.user_data = user_data;
+    progress.result.total_files = (int)db.NumFiles;
     
     // Calculate total bytes
     for (UInt32 i = 0; i < db.NumFiles; i++) {
         if (!SzArEx_IsDir(&db, i)) {
-            result.total_bytes += SzArEx_GetFileSize(&db, i);
+            progress.result.total_bytes += SzArEx_GetFileSize(&db, i);
         }
     }
     
-    // Test each file by extracting and verifying CRC
-    UInt32 block_index = 0xFFFFFFFF;
-    Byte* out_buffer = NULL;
-    size_t out_buffer_size = 0;
-    
-    for (UInt32 i = 0; i < db.NumFiles; i++) {
-        // Skip directories
-        if (SzArEx_IsDir(&db, i)) {
-            continue;
+    // One reader per worker, never more workers than folders
+    int requested_threads = num_threads;
+    if ((UInt32)num_threads > db.db.NumFolders) {
+        num_threads = db.db.NumFolders > 0 ? (int)db.db.NumFolders : 1;
+    }
+    int num_workers = 1;
+    while (num_workers < num_threads &&
+           test_worker_open(&workers[num_workers], &volumes, &workers[0], &g_MemIoAlloc)) {
+        num_workers++;
+    }
+    // Threads the folder workers leave idle go to their LZMA2 decoders
+    if (lzma2_threads <= 0) {
+        lzma2_threads = requested_threads / num_workers;
+        if (lzma2_threads < 1) lzma2_threads = 1;
+    }
+    // Decoders held to max_memory before any of them allocates
+    int fit_workers = num_workers;
+    if (folder_stream_fit_memory(&db, NULL, max_memory, &fit_workers, &lzma2_threads, NULL) != SZ_OK) {
+        SzArEx_Free(&db, &alloc_header);
+        for (int w = num_workers; w-- > 0;) {
+            test_worker_close(&workers[w], &g_MemIoAlloc);
         }
-        
-        // Get file name for progress
-        size_t len = SzArEx_GetFileNameUtf16(&db, i, NULL);
-        UInt16* temp = (UInt16*)malloc(len * sizeof(UInt16));
-        char file_name[512] = {0};
-        
-        if (temp) {
-            SzArEx_GetFileNameUtf16(&db, i, temp);
-            // Convert UTF-16 to UTF-8 (simplified)
-            for (size_t j = 0; j < len && j < 511; j++) {
-                file_name[j] = (char)temp[j];
-            }
-            free(temp);
+        free(workers);
+        volume_set_close(&volumes);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    while (num_workers > fit_workers) test_worker_close(&workers[--num_workers], &g_MemIoAlloc);
+    CCriticalSection progress_lock;
+    if (num_workers > 1) {
+        if (CriticalSection_Init(&progress_lock) == 0) {
+            progress.lock = &progress_lock;
+        } else {
+            while (num_workers > 1) test_worker_close(&workers[--num_workers], &g_MemIoAlloc);
         }
-        
-        uint64_t file_size = SzArEx_GetFileSize(&db, i);
-        
-        // Report progress
-        if (progress_callback) {
-            progress_callback(
-                result.tested_bytes,
-                result.total_bytes,
-                0,
-                file_size,
-                file_name,
-                user_data
-            );
+    }
+    
+    FolderStreamWorker folder_workers[FOLDER_STREAM_MAX_WORKERS];
+    for (int w = 0; w < num_workers; w++) {
+        TestSink* sink = &workers[w].sink;
+        sink->vt.Begin = TestSink_Begin;
+        sink->vt.Write = TestSink_Write;
+        sink->vt.End = TestSink_End;
+        sink->vt.WriteStored = NULL;
+        sink->db = &db;
+        sink->progress = &progress;
+        sink->current = (UInt32)-1;
+        folder_workers[w].stream = workers[w].stream;
+        folder_workers[w].sink = &sink->vt;
+    }
+    
+    // Empty files have nothing to decode
+    for (UInt32 i = 0; i < db.NumFiles; i++) {
+        if (!SzArEx_IsDir(&db, i) && db.FileToFolder[i] == (UInt32)-1) {
+            TestSink_Begin(&workers[0].sink.vt, i);
+            TestSink_End(&workers[0].sink.vt, i);
         }
-        
-        // Extract file to memory (tests decompression and CRC)
-        size_t offset = 0;
-        size_t out_size_processed = 0;
-        
-        res = SzArEx_Extract(&db, &look_stream.vt, i,
-                            &block_index, &out_buffer, &out_buffer_size,
-                            &offset, &out_size_processed,
-                            &alloc_imp, &alloc_temp_imp);
-        
-        if (res == SZ_OK) {
-            result.tested_files++;
-            result.tested_bytes += file_size;
-        } else {
-            result.errors++;
-            if (result.first_error[0] == '\0') {
-                snprintf(result.first_error, sizeof(result.first_error),
-                        "Failed to test file: %s (error %d)", file_name, res);
-            }
+    }
+    
+    // Test each folder by decoding it front to back; the decoder checks
+    // every file CRC as the file's last byte comes out
+    int failed_worker = 0;
+    res = folder_stream_decode_folders(&db, folder_workers, num_workers, NULL,
+                                       lzma2_threads, SEVENZIP_VERIFY_FILE, password,
+                                       &alloc_imp, &failed_worker);
+    if (res != SZ_OK) {
+        TestSink* failed = &workers[failed_worker].sink;
+        /* A CRC checked behind the decoder fails after the next files began */
+        UInt32 failed_file = folder_workers[failed_worker].crc_failed_file;
+        if (failed_file == (UInt32)-1) failed_file = failed->current;
+        char name[512] = "";
+        if (failed_file != (UInt32)-1) {
+            test_file_name(&db, failed_file, name, sizeof(name));
         }
+        progress.result.errors++;
+        snprintf(progress.result.first_error, sizeof(progress.result.first_error),
+                "Failed to test file: %s (error %d)", name, res);
     }
     
     // Final progress update
     if (progress_callback) {
         progress_callback(
-            result.total_bytes,
-            result.total_bytes,
+            progress.result.total_bytes,
+            progress.result.total_bytes,
             0, 0, "",
             user_data
         );
     }
     
     // Cleanup
-    ISzAlloc_Free(&alloc_imp, out_buffer);
-    SzArEx_Free(&db, &alloc_imp);
-    ISzAlloc_Free(&alloc_imp, look_stream.buf);
-    close_split_volumes(&in_stream);
+    if (progress.result.errors == 0) folder_stream_entry_bytes(&db, NULL, &op->bytes_in, &op->bytes_out);
+    SzArEx_Free(&db, &alloc_header);
+    for (int w = num_workers; w-- > 0;) {
+        test_worker_close(&workers[w], &g_MemIoAlloc);
+    }
+    free(workers);
+    volume_set_close(&volumes);
+    if (progress.lock) {
+        CriticalSection_Delete(&progress_lock);
+    }
     
     // Return result
-    if (result.errors > 0) {
-        fprintf(stderr, "Archive test failed: %s\n", result.first_error);
+    if (progress.result.errors > 0) {
+        fprintf(stderr, "Archive test failed: %s\n", progress.result.first_error);
         return SEVENZIP_ERROR_EXTRACT;
     }
     
     return SEVENZIP_OK;
 }
+
+/* test_archive_decode(), counted in the process metrics */
+static SevenZipErrorCode test_archive(
+    const char* archive_path,
+    const char* password,
+    int num_threads,
+    int lzma2_threads,
+    uint64_t max_memory,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    MetricsOp op;
+    metrics_op_begin(&op, SEVENZIP_METRIC_TEST);
+    SevenZipErrorCode err = test_archive_decode(archive_path, password, num_threads, lzma2_threads,
+                                                max_memory, progress_callback, user_data, &op);
+    metrics_op_end(&op, err);
+    return err;
+}
+
+/**
+ * Test archive integrity without extracting
+ * @param archive_path Path to archive file
+ * @param password Optional password (NULL if not encrypted)
+ * @param progress_callback Optional progress callback
+ * @param user_data User data for progress callback
+ * @return SEVENZIP_OK if archive is valid, error code otherwise
+ */
+SevenZipErrorCode sevenzip_test_archive(
+    const char* archive_path,
+    const char* password,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    return test_archive(archive_path, password, 1, 1, 0, progress_callback, user_data);
+}
+
+SevenZipErrorCode sevenzip_test_archive_with_options(
+    const char* archive_path,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    int num_threads = options ? options->num_threads : 0;
+    int lzma2_threads = options ? options->lzma2_threads : 0;
+    if (num_threads <= 0) num_threads = thread_auto_count(FOLDER_STREAM_DEFAULT_WORKERS);
+    if (num_threads > FOLDER_STREAM_MAX_WORKERS) num_threads = FOLDER_STREAM_MAX_WORKERS;
+    
+    ThreadLease lease;
+    num_threads = thread_lease_acquire(&lease, num_threads, options ? options->thread_weight : 0);
+    thread_lease_fit(&lease, &num_threads, &lzma2_threads);
+    SevenZipErrorCode err = test_archive(archive_path, password, num_threads, lzma2_threads,
+                                         options ? options->max_memory : 0, progress_callback,
+                                         user_data);
+    thread_lease_release(&lease);
+    return err;
+}
+
+/* ============================================================================
+ * Batch: list or test many archives on a pool of workers
+ * ============================================================================ */
+
+/*
+ * Volumes are read through the handles rather than mapped, so that every
+ * read of the batch passes the I/O slots: a worker holds a slot for one
+ * look-buffer refill, and at most io_depth refills are in flight however
+ * many workers are parsing or decoding.
+ */
+typedef struct {
+    ISeekInStream vt;
+    VolumeInStream inner;
+    CSemaphore* slots;
+    const SevenZipCancelToken* cancel;
+} BatchInStream;
+
+static SRes BatchInStream_Read(ISeekInStreamPtr pp, void* buf, size_t* size) {
+    BatchInStream* p = Z7_CONTAINER_FROM_VTBL(pp, BatchInStream, vt);
+    if (cancel_token_requested(p->cancel)) return SZ_ERROR_PROGRESS;
+    Semaphore_Wait(p->slots);
+    SRes res = ISeekInStream_Read(&p->inner.vt, buf, size);
+    Semaphore_Release1(p->slots);
+    return res;
+}
+
+static SRes BatchInStream_Seek(ISeekInStreamPtr pp, Int64* pos, ESzSeek origin) {
+    BatchInStream* p = Z7_CONTAINER_FROM_VTBL(pp, BatchInStream, vt);
+    return ISeekInStream_Seek(&p->inner.vt, pos, origin);
+}
+
+typedef struct {
+    const char** paths;
+    size_t count;
+    SevenZipArchiveBatchMode mode;
+    int lzma2_threads;
+    const SevenZipCancelToken* cancel;
+    SevenZipArchiveBatchCallback callback;
+    void* user_data;
+    CSemaphore slots;
+    CCriticalSection lock;          /* Hands out archives and serializes the callback */
+    size_t next;
+    int stopped;                    /* The callback returned nonzero */
+    size_t failed_index;            /* Lowest failed archive (count = none) */
+    SevenZipErrorCode failed;
+} ArchiveBatchPool;
+
+/* Open, list and (for SEVENZIP_ARCHIVE_BATCH_TEST) test one archive
+ * into `r`; `r->list` is left for the caller to free */
+static void archive_batch_one(ArchiveBatchPool* pool, Byte* look_buf, SevenZipArchiveBatchResult* r) {
+    VolumeSet volumes;
+    if (!volume_set_open(&volumes, r->archive_path, 0)) {
+        r->result = SEVENZIP_ERROR_OPEN_FILE;
+        return;
+    }
+    BatchInStream in;
+    in.vt.Read = BatchInStream_Read;
+    in.vt.Seek = BatchInStream_Seek;
+    volume_in_stream_init(&in.inner, &volumes);
+    in.slots = &pool->slots;
+    in.cancel = pool->cancel;
+    CLookToRead2 look;
+    LookToRead2_CreateVTable(&look, False);
+    look.buf = look_buf;
+    look.bufSize = (1 << 18);
+    look.realStream = &in.vt;
+    LookToRead2_INIT(&look);
+    
+    ISzAlloc alloc_header = g_MemHeaderAlloc;
+    CSzArEx db;
+    SzArEx_Init(&db);
+    SRes res = SzArEx_Open(&db, &look.vt, &alloc_header, &alloc_header);
+    if (res != SZ_OK) {
+        r->result = (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY :
+                    (res == SZ_ERROR_PROGRESS) ? SEVENZIP_ERROR_CANCELLED :
+                    SEVENZIP_ERROR_INVALID_ARCHIVE;
+    } else {
+        r->num_folders = db.db.NumFolders;
+        r->packed_size = db.db.PackPositions ? db.db.PackPositions[db.db.NumPackStreams] : 0;
+        for (UInt32 i = 0; i < db.NumFiles; i++) {
+            if (!SzArEx_IsDir(&db, i)) r->unpacked_size += SzArEx_GetFileSize(&db, i);
+        }
+        SevenZipList* list = NULL;
+        r->result = list_entries(&db, 0, db.NumFiles, &list);
+        r->list = list;
+    }
+    
+    if (r->result == SEVENZIP_OK && pool->mode == SEVENZIP_ARCHIVE_BATCH_TEST) {
+        TestProgress progress;
+        memset(&progress, 0, sizeof(progress));
+        TestSink sink;
+        sink.vt.Begin = TestSink_Begin;
+        sink.vt.Write = TestSink_Write;
+        sink.vt.End = TestSink_End;
+        sink.vt.WriteStored = NULL;
+        sink.db = &db;
+        sink.progress = &progress;
+        sink.current = (UInt32)-1;
+        FolderStreamWorker worker;
+        worker.stream = &look.vt;
+        worker.sink = &sink.vt;
+        ISzAlloc alloc_imp = g_MemDecoderAlloc;
+        res = folder_stream_decode_folders(&db, &worker, 1, NULL, pool->lzma2_threads,
+                                           SEVENZIP_VERIFY_FILE, NULL, &alloc_imp, NULL);
+        r->tested_bytes = progress.result.tested_bytes;
+        if (res != SZ_OK) {
+            r->result = (res == SZ_ERROR_MEM) ? SEVENZIP_ERROR_MEMORY :
+                        (res == SZ_ERROR_PROGRESS) ? SEVENZIP_ERROR_CANCELLED :
+                        SEVENZIP_ERROR_EXTRACT;
+        }
+    }
+    
+    SzArEx_Free(&db, &alloc_header);
+    volume_set_close(&volumes);
+}
+
+static void ArchiveBatchPool_Work(ArchiveBatchPool* pool) {
+    Byte* look_buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, (1 << 18));
+    
+    for (;;) {
+        CriticalSection_Enter(&pool->lock);
+        size_t i = pool->stopped ? pool->count : pool->next++;
+        CriticalSection_Leave(&pool->lock);
+        if (i >= pool->count) break;
+        
+        SevenZipArchiveBatchResult r;
+        memset(&r, 0, sizeof(r));
+        r.index = i;
+        r.archive_path = pool->paths[i];
+        if (!r.archive_path) {
+            r.result = SEVENZIP_ERROR_INVALID_PARAM;
+        } else if (!look_buf) {
+            r.result = SEVENZIP_ERROR_MEMORY;
+        } else if (cancel_token_requested(pool->cancel)) {
+            r.result = SEVENZIP_ERROR_CANCELLED;
+        } else {
+            archive_batch_one(pool, look_buf, &r);
+        }
+        
+        CriticalSection_Enter(&pool->lock);
+        if (r.result != SEVENZIP_OK && i < pool->failed_index) {
+            pool->failed_index = i;
+            pool->failed = r.result;
+        }
+        if (!pool->stopped && pool->callback && pool->callback(&r, pool->user_data) != 0) {
+            pool->stopped = 1;
+        }
+        CriticalSection_Leave(&pool->lock);
+        sevenzip_free_list((SevenZipList*)r.list);
+    }
+    
+    ISzAlloc_Free(&g_MemIoAlloc, look_buf);
+}
+
+static THREAD_FUNC_DECL ArchiveBatchPool_Thread(void* arg) {
+    thread_sched_enter();
+    ArchiveBatchPool_Work((ArchiveBatchPool*)arg);
+    return THREAD_FUNC_RET_ZERO;
+}
+
+void sevenzip_archive_batch_options_init(SevenZipArchiveBatchOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->mode = SEVENZIP_ARCHIVE_BATCH_LIST;
+}
+
+SevenZipErrorCode sevenzip_archive_batch(
+    const char** archive_paths,
+    size_t count,
+    const SevenZipArchiveBatchOptions* options,
+    SevenZipArchiveBatchCallback callback,
+    void* user_data
+) {
+    if (!archive_paths && count > 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    if (count == 0) return SEVENZIP_OK;
+    
+    global_tables_init();
+    
+    SevenZipArchiveBatchOptions defaults;
+    sevenzip_archive_batch_options_init(&defaults);
+    const SevenZipArchiveBatchOptions* opts = options ? options : &defaults;
+    
+    /* One archive per worker; threads the workers leave idle go to their
+     * LZMA2 decoders */
+    ThreadLease lease;
+    int num_threads = thread_lease_acquire(&lease, opts->num_threads, opts->thread_weight);
+    if (num_threads <= 0) num_threads = hardware_thread_count();
+    int num_workers = num_threads;
+    if ((size_t)num_workers > count) num_workers = (int)count;
+    int io_depth = opts->io_depth > 0 ? opts->io_depth : num_workers;
+    
+    ArchiveBatchPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.paths = archive_paths;
+    pool.count = count;
+    pool.mode = opts->mode;
+    pool.lzma2_threads = num_threads / num_workers;
+    pool.cancel = opts->cancel;
+    pool.callback = callback;
+    pool.user_data = user_data;
+    pool.failed_index = count;
+    Semaphore_Construct(&pool.slots);
+    if (Semaphore_Create(&pool.slots, (UInt32)io_depth, (UInt32)io_depth) != 0) {
+        thread_lease_release(&lease);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    CriticalSection_Init(&pool.lock);
+    
+    /* The calling thread is a worker too, so a failed thread start only
+     * narrows the pool */
+    CThread* threads = NULL;
+    int started = 0;
+    if (num_workers > 1) {
+        threads = (CThread*)mem_calloc(SEVENZIP_MEM_OTHER, (size_t)num_workers - 1, sizeof(CThread));
+    }
+    for (int i = 0; threads && i < num_workers - 1; i++) {
+        Thread_CONSTRUCT(&threads[i])
+        if (Thread_Create(&threads[i], ArchiveBatchPool_Thread, &pool) != 0) break;
+        started++;
+    }
+    ArchiveBatchPool_Work(&pool);
+    for (int i = 0; i < started; i++) {
+        Thread_Wait_Close(&threads[i]);
+    }
+    mem_free(threads);
+    CriticalSection_Delete(&pool.lock);
+    Semaphore_Close(&pool.slots);
+    thread_lease_release(&lease);
+    
+    if (pool.stopped) return SEVENZIP_ERROR_CANCELLED;
+    return pool.failed_index < count ? pool.failed : SEVENZIP_OK;
+}
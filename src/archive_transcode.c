@@ -0,0 +1,170 @@
+/**
+ * Archive Transcoding
+ *
+ * Rewrites an archive at another level, method or solid layout without
+ * staging its files on disk. The source is opened once (sevenzip_open())
+ * and a stream pump job (stream_pump.h) decodes its files in the order of
+ * their data, each folder once, into the pump's output ring; the creation
+ * engine (sevenzip_create_7z_from_source()) pulls the entries from that
+ * ring on its own threads. Directories and empty files, which carry no
+ * data, go first. A full ring holds the decoder until the encoder catches
+ * up, so memory is the decoder, the encoder and the ring.
+ */
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "mem_alloc.h"
+#include "stream_pump.h"
+#include "entry_writer.h"
+#include "utf_convert.h"
+#include "archive_handle.h"
+
+#include <string.h>
+
+#define TRANSCODE_RING_SIZE (4 << 20)   // Decoded bytes kept ahead of the encoder
+
+/* FILETIME of 1970-01-01 UTC */
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+typedef struct {
+    SevenZipArchive* archive;
+    UInt32* order;            /* Entries as passed on: no data first, then the rest */
+    UInt32 count;
+    UInt32 next;              /* Next of `order` to pass on */
+    UInt32 data_first;        /* Start of the entries with data in `order` */
+    StreamPump* pump;
+    UInt64 left;              /* Bytes of the current entry not read yet */
+    char* name;               /* Name of the current entry */
+    size_t name_capacity;
+    SevenZipErrorCode error;  /* Of the decoder, or a short entry */
+} Transcode;
+
+static int ring_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    (void)entry_index;
+    return stream_pump_write((StreamPump*)user_data, data, size) ? 0 : 1;
+}
+
+static SevenZipErrorCode transcode_job(StreamPump* pump, void* arg) {
+    const Transcode* t = (const Transcode*)arg;
+    SevenZipExtractSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.write = ring_write;
+    sink.user_data = pump;
+    return sevenzip_archive_extract_entries(t->archive, t->order + t->data_first,
+                                            t->count - t->data_first, &sink);
+}
+
+static int transcode_read(void* buf, size_t* size, void* user_data) {
+    Transcode* t = (Transcode*)user_data;
+    size_t want = *size < t->left ? *size : (size_t)t->left;
+    *size = 0;
+    if (want == 0) return 0;
+    int finished = 0;
+    SevenZipErrorCode err = stream_pump_exchange(t->pump, NULL, NULL, buf, &want, 0, &finished);
+    if (err == SEVENZIP_OK && want == 0) err = SEVENZIP_ERROR_EXTRACT;  /* Ended inside the entry */
+    if (err != SEVENZIP_OK) {
+        t->error = err;
+        return 1;
+    }
+    t->left -= want;
+    *size = want;
+    return 0;
+}
+
+static int transcode_next(SevenZipSourceEntry* entry, void* user_data) {
+    Transcode* t = (Transcode*)user_data;
+    if (t->left != 0) {
+        t->error = SEVENZIP_ERROR_EXTRACT;  /* The engine left bytes unread */
+        return 1;
+    }
+    if (t->next == t->count) return 0;
+    const CSzArEx* db = &t->archive->db;
+    UInt32 i = t->order[t->next++];
+
+    size_t units = SzArEx_GetFileNameUtf16(db, i, NULL);
+    const Byte* utf16 = db->FileNames + db->FileNameOffsets[i] * 2;
+    size_t need = units > 1 ? utf16le_to_utf8_size(utf16, units) : 5;
+    if (need > t->name_capacity) {
+        char* name = (char*)mem_alloc(SEVENZIP_MEM_NAMES, need * 2);
+        if (!name) {
+            t->error = SEVENZIP_ERROR_MEMORY;
+            return 1;
+        }
+        mem_free(t->name);
+        t->name = name;
+        t->name_capacity = need * 2;
+    }
+    if (units > 1) utf16le_to_utf8(utf16, units, t->name);
+    else memcpy(t->name, "data", 5);
+
+    EntryMeta meta;
+    entry_meta_get(db, i, &meta);
+    entry->name = t->name;
+    entry->is_dir = SzArEx_IsDir(db, i);
+    entry->size = entry->is_dir ? 0 : SzArEx_GetFileSize(db, i);
+    if (meta.has_mtime && meta.mtime >= FILETIME_UNIX_EPOCH + 10000000) {
+        entry->mtime = (int64_t)((meta.mtime - FILETIME_UNIX_EPOCH) / 10000000);
+    }
+    if (meta.has_attrib) entry->attributes = meta.attrib;
+    if (entry->size) {
+        entry->read = transcode_read;
+        entry->read_user_data = t;
+    }
+    t->left = entry->size;
+    return 0;
+}
+
+SevenZipErrorCode sevenzip_transcode_archive(
+    const char* source_path,
+    const char* archive_path,
+    const char* password,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!source_path || !archive_path || strcmp(source_path, archive_path) == 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    Transcode t;
+    memset(&t, 0, sizeof(t));
+    SevenZipErrorCode err = sevenzip_open(source_path, password, &t.archive);
+    if (err != SEVENZIP_OK) return err;
+
+    /* Directories and empty files, then the files with data in index order,
+       which is the order of their data */
+    const CSzArEx* db = &t.archive->db;
+    t.order = (UInt32*)mem_alloc(SEVENZIP_MEM_OTHER, (db->NumFiles ? db->NumFiles : 1) * sizeof(UInt32));
+    if (!t.order) {
+        sevenzip_close(t.archive);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) t.data_first = t.count;
+        for (UInt32 i = 0; i < db->NumFiles; i++) {
+            int has_data = !SzArEx_IsDir(db, i) && db->FileToFolder[i] != (UInt32)-1;
+            if (has_data == pass) t.order[t.count++] = i;
+        }
+    }
+
+    t.pump = stream_pump_start(0, TRANSCODE_RING_SIZE, transcode_job, &t);
+    if (!t.pump) {
+        err = SEVENZIP_ERROR_MEMORY;
+    } else {
+        SevenZipEntrySource source;
+        source.next_entry = transcode_next;
+        source.user_data = &t;
+        err = sevenzip_create_7z_from_source(archive_path, &source, level, options,
+                                             progress_callback, user_data);
+        SevenZipErrorCode job_err = stream_pump_end(t.pump);
+        /* A decoder failure fails the engine's read: report the cause */
+        if (t.error != SEVENZIP_OK) err = t.error;
+        else if (err == SEVENZIP_OK && job_err != SEVENZIP_OK) err = job_err;
+    }
+
+    mem_free(t.name);
+    mem_free(t.order);
+    sevenzip_close(t.archive);
+    return err;
+}
@@ -0,0 +1,301 @@
+/**
+ * Archive Tree
+ *
+ * Names are split at '/' and '\\' (archives written on Windows use
+ * either), empty and "." components are dropped, and a later entry of
+ * the same path replaces an earlier one, as extraction would. Node names
+ * sit NUL-terminated in one growing buffer so readdir hands them out in
+ * place.
+ */
+
+#include "archive_vfs.h"
+#include "archive_handle.h"
+#include "utf_convert.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+#define VFS_NONE 0xFFFFFFFFu
+
+typedef struct {
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t last_child;
+    uint32_t next_sibling;
+    uint32_t hash_next;       /* Next node of the same bucket */
+    uint32_t hash;
+    uint32_t entry;           /* SEVENZIP_VFS_NO_ENTRY for a directory only implied */
+    uint32_t name_len;
+    size_t name;              /* Offset into names */
+} VfsNode;
+
+struct ArchiveVfs {
+    VfsNode* nodes;           /* nodes[0] is the root */
+    uint32_t count;
+    uint32_t capacity;
+    char* names;
+    size_t names_size;
+    size_t names_capacity;
+    uint32_t* buckets;
+    uint32_t bucket_mask;
+};
+
+static uint32_t vfs_hash(uint32_t parent, const char* name, size_t len) {
+    uint32_t h = 2166136261u ^ parent;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t vfs_find(const ArchiveVfs* vfs, uint32_t parent, const char* name, size_t len) {
+    uint32_t h = vfs_hash(parent, name, len);
+    for (uint32_t i = vfs->buckets[h & vfs->bucket_mask]; i != VFS_NONE; i = vfs->nodes[i].hash_next) {
+        const VfsNode* n = &vfs->nodes[i];
+        if (n->hash == h && n->parent == parent && n->name_len == len &&
+            memcmp(vfs->names + n->name, name, len) == 0) {
+            return i;
+        }
+    }
+    return VFS_NONE;
+}
+
+/* Twice the buckets, every node but the root hashed again */
+static int vfs_rehash(ArchiveVfs* vfs) {
+    uint32_t buckets = (vfs->bucket_mask + 1) * 2;
+    uint32_t* table = (uint32_t*)mem_alloc(SEVENZIP_MEM_HEADER, (size_t)buckets * sizeof(uint32_t));
+    if (!table) return 0;
+    memset(table, 0xFF, (size_t)buckets * sizeof(uint32_t));
+    mem_free(vfs->buckets);
+    vfs->buckets = table;
+    vfs->bucket_mask = buckets - 1;
+    for (uint32_t i = 1; i < vfs->count; i++) {
+        VfsNode* n = &vfs->nodes[i];
+        n->hash_next = table[n->hash & vfs->bucket_mask];
+        table[n->hash & vfs->bucket_mask] = i;
+    }
+    return 1;
+}
+
+/* A new child of `parent`, after its others; VFS_NONE when out of memory */
+static uint32_t vfs_add(ArchiveVfs* vfs, uint32_t parent, const char* name, size_t len) {
+    if (vfs->count == vfs->capacity) {
+        if (vfs->capacity >= VFS_NONE / 2) return VFS_NONE;
+        uint32_t grown = vfs->capacity * 2;
+        VfsNode* nodes = (VfsNode*)mem_realloc(SEVENZIP_MEM_HEADER, vfs->nodes,
+                                               (size_t)grown * sizeof(VfsNode));
+        if (!nodes) return VFS_NONE;
+        vfs->nodes = nodes;
+        vfs->capacity = grown;
+    }
+    if (vfs->names_size + len + 1 > vfs->names_capacity) {
+        size_t grown = vfs->names_capacity * 2;
+        while (grown < vfs->names_size + len + 1) grown *= 2;
+        char* names = (char*)mem_realloc(SEVENZIP_MEM_NAMES, vfs->names, grown);
+        if (!names) return VFS_NONE;
+        vfs->names = names;
+        vfs->names_capacity = grown;
+    }
+    if (vfs->count >= (vfs->bucket_mask + 1) / 2 && !vfs_rehash(vfs)) return VFS_NONE;
+
+    uint32_t index = vfs->count++;
+    VfsNode* n = &vfs->nodes[index];
+    n->parent = parent;
+    n->first_child = n->last_child = n->next_sibling = VFS_NONE;
+    n->entry = SEVENZIP_VFS_NO_ENTRY;
+    n->hash = vfs_hash(parent, name, len);
+    n->hash_next = vfs->buckets[n->hash & vfs->bucket_mask];
+    vfs->buckets[n->hash & vfs->bucket_mask] = index;
+    n->name = vfs->names_size;
+    n->name_len = (uint32_t)len;
+    memcpy(vfs->names + vfs->names_size, name, len);
+    vfs->names[vfs->names_size + len] = '\0';
+    vfs->names_size += len + 1;
+
+    VfsNode* p = &vfs->nodes[parent];
+    if (p->last_child == VFS_NONE) p->first_child = index;
+    else vfs->nodes[p->last_child].next_sibling = index;
+    p->last_child = index;
+    return index;
+}
+
+/* Next component of `*path`, advancing past it: length 0 at the end */
+static size_t vfs_next_component(const char** path, const char** start) {
+    const char* p = *path;
+    for (;;) {
+        while (*p == '/' || *p == '\\') p++;
+        const char* s = p;
+        while (*p && *p != '/' && *p != '\\') p++;
+        if (p - s == 1 && s[0] == '.') continue;
+        *start = s;
+        *path = p;
+        return (size_t)(p - s);
+    }
+}
+
+void archive_vfs_free(ArchiveVfs* vfs) {
+    if (!vfs) return;
+    mem_free(vfs->nodes);
+    mem_free(vfs->names);
+    mem_free(vfs->buckets);
+    mem_free(vfs);
+}
+
+ArchiveVfs* archive_vfs_build(const CSzArEx* db) {
+    ArchiveVfs* vfs = (ArchiveVfs*)mem_alloc(SEVENZIP_MEM_HEADER, sizeof(ArchiveVfs));
+    if (!vfs) return NULL;
+    memset(vfs, 0, sizeof(*vfs));
+
+    /* Buckets for every entry and a few implied directories, so most
+     * archives never rehash */
+    uint32_t buckets = 64;
+    while (buckets < 0x80000000u && buckets / 2 < db->NumFiles + 1) buckets *= 2;
+    vfs->capacity = 64;
+    vfs->names_capacity = 4096;
+    vfs->nodes = (VfsNode*)mem_alloc(SEVENZIP_MEM_HEADER, vfs->capacity * sizeof(VfsNode));
+    vfs->names = (char*)mem_alloc(SEVENZIP_MEM_NAMES, vfs->names_capacity);
+    vfs->buckets = (uint32_t*)mem_alloc(SEVENZIP_MEM_HEADER, (size_t)buckets * sizeof(uint32_t));
+    if (!vfs->nodes || !vfs->names || !vfs->buckets) {
+        archive_vfs_free(vfs);
+        return NULL;
+    }
+    memset(vfs->buckets, 0xFF, (size_t)buckets * sizeof(uint32_t));
+    vfs->bucket_mask = buckets - 1;
+
+    VfsNode* root = &vfs->nodes[0];
+    memset(root, 0, sizeof(*root));
+    root->parent = root->first_child = root->last_child = root->next_sibling = VFS_NONE;
+    root->hash_next = VFS_NONE;
+    root->entry = SEVENZIP_VFS_NO_ENTRY;
+    vfs->names[0] = '\0';
+    vfs->names_size = 1;
+    vfs->count = 1;
+
+    char* scratch = NULL;
+    size_t scratch_size = 0;
+    for (UInt32 i = 0; i < db->NumFiles; i++) {
+        size_t units = SzArEx_GetFileNameUtf16(db, i, NULL);
+        if (units <= 1) continue;
+        const Byte* utf16 = db->FileNames + db->FileNameOffsets[i] * 2;
+        size_t need = utf16le_to_utf8_size(utf16, units);
+        if (need > scratch_size) {
+            char* grown = (char*)mem_realloc(SEVENZIP_MEM_NAMES, scratch, need);
+            if (!grown) {
+                mem_free(scratch);
+                archive_vfs_free(vfs);
+                return NULL;
+            }
+            scratch = grown;
+            scratch_size = need;
+        }
+        utf16le_to_utf8(utf16, units, scratch);
+
+        const char* path = scratch;
+        const char* name;
+        size_t len;
+        uint32_t node = 0;
+        while ((len = vfs_next_component(&path, &name)) > 0) {
+            uint32_t child = vfs_find(vfs, node, name, len);
+            if (child == VFS_NONE) child = vfs_add(vfs, node, name, len);
+            if (child == VFS_NONE) {
+                mem_free(scratch);
+                archive_vfs_free(vfs);
+                return NULL;
+            }
+            node = child;
+        }
+        if (node != 0) vfs->nodes[node].entry = i;
+    }
+    mem_free(scratch);
+    return vfs;
+}
+
+/* The tree of the handle, built by the first call that needs it */
+static const ArchiveVfs* vfs_of(SevenZipArchive* archive) {
+    pthread_mutex_lock(&archive->vfs_lock);
+    if (!archive->vfs) archive->vfs = archive_vfs_build(&archive->db);
+    const ArchiveVfs* vfs = archive->vfs;
+    pthread_mutex_unlock(&archive->vfs_lock);
+    return vfs;
+}
+
+static uint32_t vfs_lookup(const ArchiveVfs* vfs, const char* path) {
+    const char* name;
+    size_t len;
+    uint32_t node = 0;
+    while (node != VFS_NONE && (len = vfs_next_component(&path, &name)) > 0) {
+        node = vfs_find(vfs, node, name, len);
+    }
+    return node;
+}
+
+static void vfs_stat(const CSzArEx* db, const ArchiveVfs* vfs, uint32_t node, SevenZipVfsStat* st) {
+    const VfsNode* n = &vfs->nodes[node];
+    memset(st, 0, sizeof(*st));
+    st->entry_index = n->entry;
+    st->is_directory = 1;
+    if (n->entry == SEVENZIP_VFS_NO_ENTRY) return;
+
+    UInt32 i = n->entry;
+    st->size = SzArEx_GetFileSize(db, i);
+    if (SzBitWithVals_Check(&db->MTime, i)) {
+        const CNtfsFileTime* ft = db->MTime.Vals + i;
+        st->modified_time = (ft->Low | ((uint64_t)ft->High << 32)) / 10000000ULL - 11644473600ULL;
+    }
+    if (SzBitWithVals_Check(&db->Attribs, i)) {
+        st->attributes = db->Attribs.Vals[i];
+    }
+    /* A file that other names pass through is shown as the directory */
+    st->is_directory = SzArEx_IsDir(db, i) || n->first_child != VFS_NONE;
+    if (st->is_directory) st->size = 0;
+}
+
+SevenZipErrorCode sevenzip_archive_stat(
+    SevenZipArchive* archive,
+    const char* path,
+    SevenZipVfsStat* stat
+) {
+    if (!archive || !path || !stat) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const ArchiveVfs* vfs = vfs_of(archive);
+    if (!vfs) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    uint32_t node = vfs_lookup(vfs, path);
+    if (node == VFS_NONE) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    vfs_stat(&archive->db, vfs, node, stat);
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_archive_readdir(
+    SevenZipArchive* archive,
+    const char* path,
+    SevenZipVfsDirCallback callback,
+    void* user_data
+) {
+    if (!archive || !path || !callback) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const ArchiveVfs* vfs = vfs_of(archive);
+    if (!vfs) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    uint32_t node = vfs_lookup(vfs, path);
+    if (node == VFS_NONE) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    SevenZipVfsStat st;
+    vfs_stat(&archive->db, vfs, node, &st);
+    if (!st.is_directory) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    for (uint32_t c = vfs->nodes[node].first_child; c != VFS_NONE; c = vfs->nodes[c].next_sibling) {
+        vfs_stat(&archive->db, vfs, c, &st);
+        if (callback(vfs->names + vfs->nodes[c].name, &st, user_data) != 0) break;
+    }
+    return SEVENZIP_OK;
+}
@@ -0,0 +1,36 @@
+/**
+ * Archive Tree - Internal Header
+ *
+ * The directory tree behind sevenzip_archive_stat() and
+ * sevenzip_archive_readdir(), built from the header's names the first
+ * time either is called and kept until sevenzip_close(). Every path
+ * component is a node; directories that only appear as prefixes of other
+ * names get a node without an entry. Nodes are found by (parent, name) in
+ * one hash table, so a lookup costs a probe per component whatever the
+ * directory sizes, and children keep archive order for readdir.
+ */
+
+#ifndef SEVENZIP_ARCHIVE_VFS_H
+#define SEVENZIP_ARCHIVE_VFS_H
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ArchiveVfs ArchiveVfs;
+
+/* The tree of a parsed archive; NULL when out of memory */
+ArchiveVfs* archive_vfs_build(const CSzArEx* db);
+
+void archive_vfs_free(ArchiveVfs* vfs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ARCHIVE_VFS_H */
@@ -0,0 +1,440 @@
+/**
+ * Background Jobs
+ *
+ * A job owns copies of everything the blocking call reads, so the
+ * submitter's buffers may go as soon as the submit returns. Two
+ * references keep it alive, the handle and the runner; whichever lets go
+ * last frees it, so a handle released early leaves the job running.
+ * The completion pipe is made on the first sevenzip_job_fd() only: most
+ * jobs are waited on or called back and never need one.
+ */
+
+#include "async_job.h"
+#include "create_engine.h"
+#include "mem_alloc.h"
+#include "metrics.h"
+#include "thread_quota.h"
+#include "thread_placement.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+typedef enum {
+    JOB_CREATE = 0,
+    JOB_EXTRACT = 1
+} JobKind;
+
+struct SevenZipJob {
+    struct SevenZipJob* next;          /* Queue link, under g_jobs_lock */
+    JobKind kind;
+
+    /* Copies of the call's arguments */
+    char* archive_path;
+    char** input_paths;                /* JOB_CREATE, NULL-terminated, or NULL with a path source */
+    char** volume_dirs;                /* JOB_CREATE, NULL-terminated or NULL */
+    char** include_patterns;           /* NULL-terminated or NULL */
+    char** exclude_patterns;
+    char* output_dir;                  /* JOB_EXTRACT */
+    char* password;
+    char* temp_dir;
+    char* delta_extensions;
+    char* input_list;
+    SevenZipCompressionLevel level;
+    SevenZipStreamOptions stream_options;
+    SevenZipLzmaParams lzma_params;    /* Copy of stream_options.lzma_params */
+    SevenZipExtractOptions extract_options;
+    SevenZipBytesProgressCallback bytes_progress;
+    SevenZipProgressCallback progress;
+    SevenZipJobCallback done_callback;
+    void* user_data;
+    SevenZipCancelToken* cancel;       /* The options token, or own_cancel */
+    SevenZipCancelToken* own_cancel;
+    SevenZipRateLimit* rate_limit;     /* JOB_CREATE: the options budget, or own_rate_limit */
+    SevenZipRateLimit* own_rate_limit;
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    int refs;                          /* Handle and runner */
+    int done;
+    SevenZipErrorCode result;
+    int fds[2];                        /* Completion pipe, -1 until asked for */
+};
+
+static pthread_mutex_t g_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_jobs_queued = PTHREAD_COND_INITIALIZER;
+static SevenZipJob* g_queue_head = NULL;
+static SevenZipJob* g_queue_tail = NULL;
+static int g_max_runners = 0;         /* 0 = hardware threads */
+static int g_runners = 0;
+static int g_idle_runners = 0;
+static int g_busy_runners = 0;
+
+static int runner_limit(void) {
+    return g_max_runners > 0 ? g_max_runners : hardware_thread_count();
+}
+
+void job_runners_set(int max_jobs) {
+    pthread_mutex_lock(&g_jobs_lock);
+    g_max_runners = max_jobs > 0 ? max_jobs : 0;
+    pthread_cond_broadcast(&g_jobs_queued);
+    pthread_mutex_unlock(&g_jobs_lock);
+}
+
+static void job_free_list(char** list) {
+    if (!list) return;
+    for (char** p = list; *p; p++) mem_free(*p);
+    mem_free(list);
+}
+
+static void job_destroy(SevenZipJob* job) {
+    mem_free(job->archive_path);
+    job_free_list(job->input_paths);
+    job_free_list(job->volume_dirs);
+    job_free_list(job->include_patterns);
+    job_free_list(job->exclude_patterns);
+    mem_free(job->output_dir);
+    mem_free(job->password);
+    mem_free(job->temp_dir);
+    mem_free(job->delta_extensions);
+    mem_free(job->input_list);
+    sevenzip_cancel_token_free(job->own_cancel);
+    sevenzip_rate_limit_free(job->own_rate_limit);
+#ifndef _WIN32
+    if (job->fds[0] >= 0) {
+        close(job->fds[0]);
+        close(job->fds[1]);
+    }
+#endif
+    pthread_cond_destroy(&job->finished);
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+}
+
+static void job_release(SevenZipJob* job) {
+    pthread_mutex_lock(&job->lock);
+    int last = --job->refs == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (last) job_destroy(job);
+}
+
+/* Copy of `s`; NULL stays NULL, `*failed` is set when out of memory */
+static char* job_strdup(const char* s, int* failed) {
+    if (!s) return NULL;
+    char* copy = mem_strdup(SEVENZIP_MEM_NAMES, s);
+    if (!copy) *failed = 1;
+    return copy;
+}
+
+/* Copy of a NULL-terminated list (NULL stays NULL) */
+static char** job_strdup_list(const char** list, int* failed) {
+    if (!list) return NULL;
+    size_t count = 0;
+    while (list[count]) count++;
+    char** copy = (char**)mem_calloc(SEVENZIP_MEM_NAMES, count + 1, sizeof(char*));
+    if (!copy) {
+        *failed = 1;
+        return NULL;
+    }
+    for (size_t i = 0; i < count && !*failed; i++) {
+        copy[i] = job_strdup(list[i], failed);
+    }
+    return copy;
+}
+
+static SevenZipJob* job_new(JobKind kind, SevenZipJobCallback done_callback, void* user_data) {
+    SevenZipJob* job = (SevenZipJob*)calloc(1, sizeof(SevenZipJob));
+    if (!job) return NULL;
+    if (pthread_mutex_init(&job->lock, NULL) != 0) {
+        free(job);
+        return NULL;
+    }
+    if (pthread_cond_init(&job->finished, NULL) != 0) {
+        pthread_mutex_destroy(&job->lock);
+        free(job);
+        return NULL;
+    }
+    job->kind = kind;
+    job->done_callback = done_callback;
+    job->user_data = user_data;
+    job->refs = 2;
+    job->fds[0] = job->fds[1] = -1;
+    return job;
+}
+
+/* The caller's token, else one of the job's own for sevenzip_job_cancel() */
+static int job_set_cancel(SevenZipJob* job, SevenZipCancelToken* token) {
+    if (!token) {
+        job->own_cancel = sevenzip_cancel_token_create();
+        token = job->own_cancel;
+    }
+    job->cancel = token;
+    return token != NULL;
+}
+
+/* The caller's budget, else an unlimited one for sevenzip_job_set_rate_limit() */
+static int job_set_rate_limit(SevenZipJob* job, SevenZipRateLimit* limit) {
+    if (!limit) {
+        job->own_rate_limit = sevenzip_rate_limit_create(0, 0);
+        limit = job->own_rate_limit;
+    }
+    job->rate_limit = limit;
+    return limit != NULL;
+}
+
+static void job_run(SevenZipJob* job) {
+    SevenZipErrorCode result = SEVENZIP_ERROR_CANCELLED;
+    if (!sevenzip_cancel_token_is_cancelled(job->cancel)) {
+        if (job->kind == JOB_CREATE) {
+            result = sevenzip_create_7z_streaming(job->archive_path, (const char**)job->input_paths,
+                                                  job->level, &job->stream_options,
+                                                  job->bytes_progress, job->user_data);
+        } else {
+            result = sevenzip_extract_with_options(job->archive_path, job->output_dir,
+                                                   job->password, &job->extract_options,
+                                                   job->progress, job->user_data);
+        }
+    }
+    /* Before anyone learns it is done */
+    metrics_gauge_add(METRICS_GAUGE_JOBS_ACTIVE, -1);
+
+    if (job->done_callback) job->done_callback(job, result, job->user_data);
+
+    pthread_mutex_lock(&job->lock);
+    job->result = result;
+    job->done = 1;
+#ifndef _WIN32
+    if (job->fds[1] >= 0) {
+        ssize_t written = write(job->fds[1], "", 1);
+        (void)written;
+    }
+#endif
+    pthread_cond_broadcast(&job->finished);
+    pthread_mutex_unlock(&job->lock);
+    job_release(job);
+}
+
+static void* job_runner(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_jobs_lock);
+    for (;;) {
+        while (!g_queue_head || g_busy_runners >= runner_limit()) {
+            g_idle_runners++;
+            pthread_cond_wait(&g_jobs_queued, &g_jobs_lock);
+            g_idle_runners--;
+        }
+        SevenZipJob* job = g_queue_head;
+        g_queue_head = job->next;
+        if (!g_queue_head) g_queue_tail = NULL;
+        g_busy_runners++;
+        pthread_mutex_unlock(&g_jobs_lock);
+        metrics_gauge_add(METRICS_GAUGE_JOBS_QUEUED, -1);
+        metrics_gauge_add(METRICS_GAUGE_JOBS_ACTIVE, 1);
+
+        /* Picks up settings of a sevenzip_init_with_options() call since the last job */
+        thread_sched_enter();
+        job_run(job);
+
+        pthread_mutex_lock(&g_jobs_lock);
+        g_busy_runners--;
+        if (g_queue_head) pthread_cond_signal(&g_jobs_queued);
+    }
+    return NULL;
+}
+
+/* Queue `job`, starting a runner when none is free */
+static SevenZipErrorCode job_submit(SevenZipJob* job, SevenZipJob** handle) {
+    pthread_mutex_lock(&g_jobs_lock);
+    if (g_idle_runners == 0 && g_runners < runner_limit()) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, job_runner, NULL) == 0) {
+            g_runners++;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    if (g_runners == 0) {
+        pthread_mutex_unlock(&g_jobs_lock);
+        job_destroy(job);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    if (g_queue_tail) {
+        g_queue_tail->next = job;
+    } else {
+        g_queue_head = job;
+    }
+    g_queue_tail = job;
+    metrics_gauge_add(METRICS_GAUGE_JOBS_QUEUED, 1);
+    if (!handle) job->refs--;          /* Nobody holds a handle: the runner frees it */
+    pthread_cond_signal(&g_jobs_queued);
+    pthread_mutex_unlock(&g_jobs_lock);
+
+    if (handle) *handle = job;
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_submit_create(
+    const char* archive_path,
+    const char** input_paths,
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    SevenZipBytesProgressCallback progress_callback,
+    SevenZipJobCallback done_callback,
+    void* user_data,
+    SevenZipJob** job
+) {
+    if (job) *job = NULL;
+    if (!archive_path || !create_job_has_inputs(input_paths, options)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    SevenZipJob* j = job_new(JOB_CREATE, done_callback, user_data);
+    if (!j) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    if (options) {
+        j->stream_options = *options;
+    } else {
+        sevenzip_stream_options_init(&j->stream_options);
+    }
+    j->level = level;
+    j->bytes_progress = progress_callback;
+
+    int failed = 0;
+    j->archive_path = job_strdup(archive_path, &failed);
+    j->input_paths = job_strdup_list(input_paths, &failed);
+    j->volume_dirs = job_strdup_list(j->stream_options.volume_dirs, &failed);
+    j->include_patterns = job_strdup_list(j->stream_options.include_patterns, &failed);
+    j->exclude_patterns = job_strdup_list(j->stream_options.exclude_patterns, &failed);
+    j->password = job_strdup(j->stream_options.password, &failed);
+    j->temp_dir = job_strdup(j->stream_options.temp_dir, &failed);
+    j->delta_extensions = job_strdup(j->stream_options.delta_extensions, &failed);
+    j->input_list = job_strdup(j->stream_options.input_list, &failed);
+    if (failed || !job_set_cancel(j, j->stream_options.cancel) ||
+        !job_set_rate_limit(j, j->stream_options.rate_limit)) {
+        job_destroy(j);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    j->stream_options.password = j->password;
+    j->stream_options.temp_dir = j->temp_dir;
+    j->stream_options.delta_extensions = j->delta_extensions;
+    j->stream_options.input_list = j->input_list;
+    j->stream_options.volume_dirs = (const char**)j->volume_dirs;
+    j->stream_options.include_patterns = (const char**)j->include_patterns;
+    j->stream_options.exclude_patterns = (const char**)j->exclude_patterns;
+    j->stream_options.cancel = j->cancel;
+    j->stream_options.rate_limit = j->rate_limit;
+    if (j->stream_options.lzma_params) {
+        j->lzma_params = *j->stream_options.lzma_params;
+        j->stream_options.lzma_params = &j->lzma_params;
+    }
+
+    return job_submit(j, job);
+}
+
+SevenZipErrorCode sevenzip_submit_extract(
+    const char* archive_path,
+    const char* output_dir,
+    const char* password,
+    const SevenZipExtractOptions* options,
+    SevenZipProgressCallback progress_callback,
+    SevenZipJobCallback done_callback,
+    void* user_data,
+    SevenZipJob** job
+) {
+    if (job) *job = NULL;
+    if (!archive_path || !output_dir) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    SevenZipJob* j = job_new(JOB_EXTRACT, done_callback, user_data);
+    if (!j) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    if (options) {
+        j->extract_options = *options;
+    } else {
+        sevenzip_extract_options_init(&j->extract_options);
+    }
+    j->progress = progress_callback;
+
+    int failed = 0;
+    j->archive_path = job_strdup(archive_path, &failed);
+    j->output_dir = job_strdup(output_dir, &failed);
+    j->password = job_strdup(password, &failed);
+    j->include_patterns = job_strdup_list(j->extract_options.include_patterns, &failed);
+    j->exclude_patterns = job_strdup_list(j->extract_options.exclude_patterns, &failed);
+    if (failed || !job_set_cancel(j, j->extract_options.cancel)) {
+        job_destroy(j);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    j->extract_options.cancel = j->cancel;
+    j->extract_options.include_patterns = (const char**)j->include_patterns;
+    j->extract_options.exclude_patterns = (const char**)j->exclude_patterns;
+
+    return job_submit(j, job);
+}
+
+SevenZipErrorCode sevenzip_job_wait(SevenZipJob* job) {
+    if (!job) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    pthread_mutex_lock(&job->lock);
+    while (!job->done) {
+        pthread_cond_wait(&job->finished, &job->lock);
+    }
+    SevenZipErrorCode result = job->result;
+    pthread_mutex_unlock(&job->lock);
+    return result;
+}
+
+int sevenzip_job_poll(SevenZipJob* job, SevenZipErrorCode* result) {
+    if (!job) return 0;
+    pthread_mutex_lock(&job->lock);
+    int done = job->done;
+    if (done && result) *result = job->result;
+    pthread_mutex_unlock(&job->lock);
+    return done;
+}
+
+int sevenzip_job_fd(SevenZipJob* job) {
+#ifdef _WIN32
+    (void)job;
+    return -1;
+#else
+    if (!job) return -1;
+    pthread_mutex_lock(&job->lock);
+    if (job->fds[0] < 0 && pipe(job->fds) == 0) {
+        fcntl(job->fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(job->fds[1], F_SETFD, FD_CLOEXEC);
+        if (job->done) {
+            ssize_t written = write(job->fds[1], "", 1);
+            (void)written;
+        }
+    }
+    int fd = job->fds[0];
+    pthread_mutex_unlock(&job->lock);
+    return fd;
+#endif
+}
+
+void sevenzip_job_cancel(SevenZipJob* job) {
+    if (job) sevenzip_cancel_token_cancel(job->cancel);
+}
+
+void sevenzip_job_set_rate_limit(SevenZipJob* job, uint64_t read_bytes_per_sec,
+                                 uint64_t write_bytes_per_sec) {
+    if (job) sevenzip_rate_limit_set(job->rate_limit, read_bytes_per_sec, write_bytes_per_sec);
+}
+
+void sevenzip_job_free(SevenZipJob* job) {
+    if (job) job_release(job);
+}
@@ -0,0 +1,26 @@
+/**
+ * Background Jobs - Internal Header
+ *
+ * Runner threads behind sevenzip_submit_create() and
+ * sevenzip_submit_extract(). Runners start as jobs are queued with none
+ * idle, up to the limit, and then stay for the life of the process.
+ */
+
+#ifndef SEVENZIP_ASYNC_JOB_H
+#define SEVENZIP_ASYNC_JOB_H
+
+#include "../include/7z_ffi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Jobs run at once (0 = hardware threads); runners past a lowered limit
+ * finish their job and wait until the count is back under it */
+void job_runners_set(int max_jobs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ASYNC_JOB_H */
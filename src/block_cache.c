@@ -0,0 +1,155 @@
+/**
+ * Block Cache
+ */
+
+#include "block_cache.h"
+#include "mem_alloc.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define block_cache_pid() ((unsigned long)_getpid())
+#else
+#include <unistd.h>
+#define block_cache_pid() ((unsigned long)getpid())
+#endif
+
+#define BLOCK_CACHE_MAGIC "7zbc"
+#define BLOCK_CACHE_VERSION 1
+#define BLOCK_CACHE_HEADER_SIZE 32
+
+UInt64 block_cache_coder_key(const void* settings, size_t size) {
+    Xxh3State state;
+    Byte digest[XXH3_128_DIGEST_SIZE];
+    xxh3_128_init(&state);
+    xxh3_128_update(&state, settings, size);
+    xxh3_128_final(&state, digest);
+    return GetUi64(digest);
+}
+
+/* Helper: Path of the entry of `key` in `dir` (mem_free() it) */
+static char* entry_path(const char* dir, const BlockCacheKey* key) {
+    size_t dir_len = strlen(dir);
+    size_t size = dir_len + 1 + XXH3_128_DIGEST_SIZE * 2 + 1 + 16 + sizeof(".7zb");
+    char* path = (char*)mem_alloc(SEVENZIP_MEM_NAMES, size);
+    if (!path) return NULL;
+    char* p = path;
+    memcpy(p, dir, dir_len);
+    p += dir_len;
+    if (dir_len > 0 && dir[dir_len - 1] != '/' && dir[dir_len - 1] != '\\') *p++ = '/';
+    for (size_t i = 0; i < XXH3_128_DIGEST_SIZE; i++) {
+        p += sprintf(p, "%02x", key->content[i]);
+    }
+    sprintf(p, "-%016llx.7zb", (unsigned long long)key->coder);
+    return path;
+}
+
+FILE* block_cache_open(const char* dir, const BlockCacheKey* key, BlockCacheInfo* info) {
+    char* path = entry_path(dir, key);
+    if (!path) return NULL;
+    FILE* f = fopen(path, "rb");
+    mem_free(path);
+    if (!f) return NULL;
+
+    Byte h[BLOCK_CACHE_HEADER_SIZE];
+    if (fread(h, 1, sizeof(h), f) != sizeof(h) || memcmp(h, BLOCK_CACHE_MAGIC, 4) != 0 ||
+        h[4] != BLOCK_CACHE_VERSION || h[6] > SEVENZIP_FILTER_DELTA || h[7] > 1) {
+        fclose(f);
+        return NULL;
+    }
+    info->prop = h[5];
+    info->filter = (SevenZipFilter)h[6];
+    info->use_ppmd = h[7];
+    info->unpack_size = GetUi64(h + 8);
+    info->pack_size = GetUi64(h + 16);
+    info->crc = GetUi32(h + 24);
+    info->pack_crc = GetUi32(h + 28);
+    return f;
+}
+
+int block_cache_copy(FILE* f, const BlockCacheInfo* info, ISeqOutStreamPtr out,
+                     Byte* buf, size_t buf_size) {
+    UInt32 crc = CRC_INIT_VAL;
+    UInt64 left = info->pack_size;
+    while (left > 0) {
+        size_t want = left < buf_size ? (size_t)left : buf_size;
+        if (fread(buf, 1, want, f) != want) return 0;
+        crc = CrcUpdate(crc, buf, want);
+        if (ISeqOutStream_Write(out, buf, want) != want) return 0;
+        left -= want;
+    }
+    return CRC_GET_DIGEST(crc) == info->pack_crc && fgetc(f) == EOF;
+}
+
+void block_cache_drop(const char* dir, const BlockCacheKey* key) {
+    char* path = entry_path(dir, key);
+    if (path) remove(path);
+    mem_free(path);
+}
+
+int block_cache_write_begin(BlockCacheWriter* w, const char* dir, const BlockCacheKey* key) {
+    memset(w, 0, sizeof(*w));
+    w->path = entry_path(dir, key);
+    if (!w->path) return 0;
+    size_t size = strlen(w->path) + 32;
+    w->tmp_path = (char*)mem_alloc(SEVENZIP_MEM_NAMES, size);
+    if (w->tmp_path) {
+        /* Jobs sharing the directory may make the same entry at once */
+        snprintf(w->tmp_path, size, "%s.%lu.tmp", w->path, block_cache_pid());
+        w->f = fopen(w->tmp_path, "wb");
+    }
+    Byte h[BLOCK_CACHE_HEADER_SIZE];
+    memset(h, 0, sizeof(h));
+    if (!w->f || fwrite(h, 1, sizeof(h), w->f) != sizeof(h)) {
+        block_cache_write_end(w, NULL);
+        return 0;
+    }
+    w->pack_crc = CRC_INIT_VAL;
+    return 1;
+}
+
+void block_cache_write(BlockCacheWriter* w, const void* data, size_t size) {
+    if (!w->f || w->failed) return;
+    if (fwrite(data, 1, size, w->f) != size) {
+        w->failed = 1;
+        return;
+    }
+    w->pack_crc = CrcUpdate(w->pack_crc, data, size);
+    w->pack_size += size;
+}
+
+int block_cache_write_end(BlockCacheWriter* w, const BlockCacheInfo* info) {
+    int ok = 0;
+    if (w->f) {
+        ok = info && !w->failed && info->pack_size == w->pack_size;
+        if (ok) {
+            Byte h[BLOCK_CACHE_HEADER_SIZE];
+            memcpy(h, BLOCK_CACHE_MAGIC, 4);
+            h[4] = BLOCK_CACHE_VERSION;
+            h[5] = info->prop;
+            h[6] = (Byte)info->filter;
+            h[7] = (Byte)(info->use_ppmd != 0);
+            SetUi64(h + 8, info->unpack_size)
+            SetUi64(h + 16, info->pack_size)
+            SetUi32(h + 24, info->crc)
+            SetUi32(h + 28, CRC_GET_DIGEST(w->pack_crc))
+            ok = fseek(w->f, 0, SEEK_SET) == 0 && fwrite(h, 1, sizeof(h), w->f) == sizeof(h);
+        }
+        ok = fclose(w->f) == 0 && ok;
+#ifdef _WIN32
+        ok = ok && MoveFileExA(w->tmp_path, w->path, MOVEFILE_REPLACE_EXISTING);
+#else
+        ok = ok && rename(w->tmp_path, w->path) == 0;
+#endif
+        if (!ok) remove(w->tmp_path);
+    }
+    mem_free(w->path);
+    mem_free(w->tmp_path);
+    memset(w, 0, sizeof(*w));
+    return ok;
+}
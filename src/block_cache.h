@@ -0,0 +1,97 @@
+/**
+ * Block Cache - Internal Header
+ *
+ * Pack streams of non-solid folders kept on disk across create jobs
+ * (SevenZipStreamOptions.block_cache_dir), so a file that comes back with
+ * the same data and coder settings is spliced into the next archive
+ * instead of compressed again. An entry is keyed by the XXH3-128 of the
+ * file's data and a fingerprint of its coder settings, and is one file
+ * named <content>-<coder>.7zb in hex:
+ *
+ *   "7zbc" version(1) prop(1) filter(1) ppmd(1)
+ *   unpack size(8) pack size(8) data CRC(4) pack CRC(4)
+ *   pack stream
+ *
+ * with the numbers little endian. Entries are written under a temporary
+ * name and renamed into place, so jobs sharing a directory only ever see
+ * complete ones; only entries found damaged are removed here.
+ */
+
+#ifndef SEVENZIP_BLOCK_CACHE_H
+#define SEVENZIP_BLOCK_CACHE_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "xxh3.h"
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    Byte content[XXH3_128_DIGEST_SIZE];  /* XXH3-128 of the file's data */
+    UInt64 coder;                        /* block_cache_coder_key() */
+} BlockCacheKey;
+
+typedef struct {
+    Byte prop;              /* LZMA2 property byte */
+    SevenZipFilter filter;  /* Of the folder, none if the data was stored */
+    int use_ppmd;           /* PPMd folder (prop unused) */
+    UInt64 unpack_size;
+    UInt64 pack_size;
+    UInt32 crc;             /* Of the unpacked data */
+    UInt32 pack_crc;        /* Of the pack stream */
+} BlockCacheInfo;
+
+typedef struct {
+    FILE* f;                /* NULL = no entry being written */
+    char* path;             /* Final name */
+    char* tmp_path;         /* Name while written */
+    UInt64 pack_size;
+    UInt32 pack_crc;
+    int failed;
+} BlockCacheWriter;
+
+/* Fingerprint of the coder settings in `settings` (what makes two pack
+ * streams of the same data differ) */
+UInt64 block_cache_coder_key(const void* settings, size_t size);
+
+/**
+ * Open the entry of `key` in `dir`, its header read into `info`
+ * @return The entry positioned at its pack stream, NULL if there is none
+ *         or its header is not one
+ */
+FILE* block_cache_open(const char* dir, const BlockCacheKey* key, BlockCacheInfo* info);
+
+/**
+ * Copy the pack stream of an entry opened by block_cache_open() to `out`
+ * through `buf`
+ * @return 1 if all of it was copied and matches its CRC
+ */
+int block_cache_copy(FILE* f, const BlockCacheInfo* info, ISeqOutStreamPtr out,
+                     Byte* buf, size_t buf_size);
+
+/* Remove the entry of `key` from `dir` (found damaged) */
+void block_cache_drop(const char* dir, const BlockCacheKey* key);
+
+/* Start writing the entry of `key` in `dir`; 0 if it cannot be created
+ * (the writer is then idle and the job goes on without caching) */
+int block_cache_write_begin(BlockCacheWriter* w, const char* dir, const BlockCacheKey* key);
+
+/* Append pack stream bytes; a failure drops the entry at the end */
+void block_cache_write(BlockCacheWriter* w, const void* data, size_t size);
+
+/**
+ * Finish the entry: its header written and the file moved into place
+ * With `info` NULL, or after a failed write, the entry is dropped.
+ * @return 1 if the entry was stored
+ */
+int block_cache_write_end(BlockCacheWriter* w, const BlockCacheInfo* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_BLOCK_CACHE_H */
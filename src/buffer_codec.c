@@ -0,0 +1,631 @@
+/**
+ * In-Memory Compression
+ *
+ * .lzma, LZMA2 and single-file .7z data in caller buffers. The encoders
+ * read the input where it is and write into the output buffer; the
+ * decoders use the output buffer as their dictionary, so nothing is staged
+ * or copied on either side. Sizes for preallocation come from the .lzma
+ * header, the LZMA2 chunk headers and the 7z header.
+ */
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "7zCrc.h"
+#include "LzmaEnc.h"
+#include "LzmaDec.h"
+#include "Lzma2Enc.h"
+#include "Lzma2Dec.h"
+#include "mem_alloc.h"
+#include "buffer_codec.h"
+#include "mmap_stream.h"
+#include "utf_convert.h"
+#include "lzma_params.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+#include "archive_header.h"
+#include "thread_placement.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZMA_PROPS_SIZE 5
+#define LZMA_HEADER_SIZE 13           // 5 bytes props + 8 bytes uncompressed size
+#define LZMA2_COPY_CHUNK_SIZE (1 << 16)
+#define LZMA2_CHUNK_OVERHEAD 6        // Largest LZMA2 chunk header
+#define LZMA2_ENCODE_SLACK 16         // Room past the output the encoder needs while trying a chunk
+#define SIGNATURE_HEADER_SIZE 32
+#define SINGLE_HEADER_MAX 96          // 7z header of one file, without its name
+#define BUFFER_MAX_THREADS 64
+#define DEFAULT_ENTRY_NAME "data"
+
+/* 7z header version (k7zSignature comes from 7z.h) */
+#define k7zMajorVersion 0
+#define k7zMinorVersion 4
+
+void sevenzip_buffer_options_init(SevenZipBufferOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->num_threads = 0;
+    options->entry_name = NULL;
+    options->lzma_params = NULL;
+}
+
+static const char* entry_name(const SevenZipBufferOptions* options) {
+    return (options && options->entry_name && options->entry_name[0])
+        ? options->entry_name : DEFAULT_ENTRY_NAME;
+}
+
+/* Property byte and stream; a 64KB chunk stored whole or split in two costs at most 6 bytes */
+static size_t lzma2_bound(size_t input_size) {
+    return 1 + input_size + (input_size / LZMA2_COPY_CHUNK_SIZE + 1) * LZMA2_CHUNK_OVERHEAD +
+           LZMA2_ENCODE_SLACK;
+}
+
+size_t sevenzip_compress_buffer_bound(
+    SevenZipBufferFormat format,
+    size_t input_size,
+    const SevenZipBufferOptions* options
+) {
+    /* Keeps the sums below from wrapping; no buffer comes near it */
+    if (input_size > SIZE_MAX / 2) return 0;
+    switch (format) {
+        case SEVENZIP_BUFFER_LZMA:
+            return LZMA_HEADER_SIZE + input_size + input_size / 3 + 128;
+        case SEVENZIP_BUFFER_LZMA2:
+            return lzma2_bound(input_size);
+        case SEVENZIP_BUFFER_7Z:
+            return SIGNATURE_HEADER_SIZE + lzma2_bound(input_size) + SINGLE_HEADER_MAX +
+                   utf8_to_utf16le_size(entry_name(options)) + 2;
+        default:
+            return 0;
+    }
+}
+
+void buffer_codec_lzma_props(CLzmaEncProps* props, SevenZipCompressionLevel level,
+                             UInt64 input_size) {
+    switch (level) {
+        case SEVENZIP_LEVEL_STORE:
+            props->level = 0;
+            props->dictSize = 1 << 16; /* 64 KB */
+            break;
+        case SEVENZIP_LEVEL_FASTEST:
+            props->level = 1;
+            props->dictSize = 1 << 18; /* 256 KB */
+            break;
+        case SEVENZIP_LEVEL_FAST:
+            props->level = 3;
+            props->dictSize = 1 << 20; /* 1 MB */
+            break;
+        case SEVENZIP_LEVEL_MAXIMUM:
+            props->level = 7;
+            props->dictSize = 1 << 25; /* 32 MB */
+            break;
+        case SEVENZIP_LEVEL_ULTRA:
+            props->level = 9;
+            props->dictSize = 1 << 26; /* 64 MB */
+            break;
+        case SEVENZIP_LEVEL_NORMAL:
+        default:
+            props->level = 5;
+            props->dictSize = 1 << 23; /* 8 MB */
+            break;
+    }
+    props->reduceSize = input_size;
+}
+
+int buffer_codec_threads(const SevenZipBufferOptions* options) {
+    int num_threads = options ? options->num_threads : 0;
+    if (num_threads <= 0) num_threads = 1;
+    if (num_threads > BUFFER_MAX_THREADS) num_threads = BUFFER_MAX_THREADS;
+    return num_threads;
+}
+
+static SevenZipErrorCode encode_error(SRes res) {
+    if (res == SZ_ERROR_OUTPUT_EOF) return SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+    if (res == SZ_ERROR_MEM) return SEVENZIP_ERROR_MEMORY;
+    if (res == SZ_ERROR_PARAM) return SEVENZIP_ERROR_INVALID_PARAM;
+    return SEVENZIP_ERROR_COMPRESS;
+}
+
+/* .lzma: header, then the stream straight into the output */
+static SevenZipErrorCode encode_lzma(const Byte* input, size_t input_size, Byte* output,
+                                     size_t* output_size, SevenZipCompressionLevel level,
+                                     const SevenZipBufferOptions* options) {
+    if (*output_size < LZMA_HEADER_SIZE) return SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+
+    ThreadPlacer placer;
+    int placed = thread_placer_init(&placer, SEVENZIP_NUMA_OFF);
+    ISzAllocPtr alloc = placed ? &placer.small : &g_MemEncoderAlloc;
+    ISzAllocPtr alloc_big = placed ? &placer.big : &g_MemMatchFinderAlloc;
+    CLzmaEncHandle encoder = LzmaEnc_Create(alloc);
+    if (!encoder) return SEVENZIP_ERROR_MEMORY;
+
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    buffer_codec_lzma_props(&props, level, input_size);
+    sevenzip_lzma_params_apply(options ? options->lzma_params : NULL, &props);
+
+    /* LZMA has no block threads; a second thread runs the BT match finder */
+    ThreadLease lease;
+    props.numThreads = thread_lease_acquire(&lease, buffer_codec_threads(options) > 1 ? 2 : 1, 0);
+    LzmaEncProps_Normalize(&props);
+
+    SizeT props_size = LZMA_PROPS_SIZE;
+    SizeT packed_size = *output_size - LZMA_HEADER_SIZE;
+    SRes res = LzmaEnc_SetProps(encoder, &props);
+    if (res == SZ_OK) res = LzmaEnc_WriteProperties(encoder, output, &props_size);
+    if (res == SZ_OK) {
+        res = LzmaEnc_MemEncode(encoder, output + LZMA_HEADER_SIZE, &packed_size,
+                                input, input_size, 0, NULL, alloc, alloc_big);
+    }
+    LzmaEnc_Destroy(encoder, alloc, alloc_big);
+    thread_lease_release(&lease);
+    if (res != SZ_OK) return encode_error(res);
+
+    UInt64 size = input_size;
+    for (int i = 0; i < 8; i++) {
+        output[LZMA_PROPS_SIZE + i] = (Byte)(size >> (i * 8));
+    }
+    *output_size = LZMA_HEADER_SIZE + packed_size;
+    return SEVENZIP_OK;
+}
+
+/* Raw LZMA2 stream into the output; *prop gets its property byte */
+static SevenZipErrorCode encode_lzma2_stream(const Byte* input, size_t input_size, Byte* output,
+                                             size_t* output_size, Byte* prop,
+                                             SevenZipCompressionLevel level,
+                                             const SevenZipBufferOptions* options) {
+    ThreadPlacer placer;
+    CLzma2EncHandle encoder = thread_placer_init(&placer, SEVENZIP_NUMA_OFF)
+        ? Lzma2Enc_Create(&placer.small, &placer.big)
+        : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    if (!encoder) return SEVENZIP_ERROR_MEMORY;
+
+    CLzma2EncProps props;
+    Lzma2EncProps_Init(&props);
+    buffer_codec_lzma_props(&props.lzmaProps, level, input_size);
+    sevenzip_lzma_params_apply(options ? options->lzma_params : NULL, &props.lzmaProps);
+
+    ThreadLease lease;
+    props.numTotalThreads = thread_lease_acquire(&lease, buffer_codec_threads(options), 0);
+    Lzma2EncProps_Normalize(&props);
+
+    SRes res = Lzma2Enc_SetProps(encoder, &props);
+    if (res == SZ_OK) {
+        Lzma2Enc_SetDataSize(encoder, input_size);
+        *prop = Lzma2Enc_WriteProperties(encoder);
+        res = Lzma2Enc_Encode2(encoder, NULL, output, output_size,
+                               NULL, input, input_size, NULL);
+    }
+    Lzma2Enc_Destroy(encoder);
+    thread_lease_release(&lease);
+    return res == SZ_OK ? SEVENZIP_OK : encode_error(res);
+}
+
+static SevenZipErrorCode encode_lzma2(const Byte* input, size_t input_size, Byte* output,
+                                      size_t* output_size, SevenZipCompressionLevel level,
+                                      const SevenZipBufferOptions* options) {
+    if (*output_size < 1) return SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+    size_t stream_size = *output_size - 1;
+    SevenZipErrorCode err = encode_lzma2_stream(input, input_size, output + 1, &stream_size,
+                                                output, level, options);
+    if (err == SEVENZIP_OK) *output_size = 1 + stream_size;
+    return err;
+}
+
+/**
+ * 7z header of the one file: an LZMA2 folder checked by its folder CRC
+ * (one stream per folder, so no SubStreamsInfo), or an empty file
+ */
+static void write_single_header(HeaderBuffer* hb, const char* name, uint64_t size,
+                                uint64_t packed_size, Byte prop, uint32_t crc) {
+    header_buffer_byte(hb, 0x01);  /* kHeader */
+
+    if (size > 0) {
+        header_buffer_byte(hb, 0x04);  /* kMainStreamsInfo */
+
+        header_buffer_byte(hb, 0x06);  /* kPackInfo */
+        header_buffer_number(hb, 0);  /* Pack position (start of data) */
+        header_buffer_number(hb, 1);  /* Number of pack streams */
+        header_buffer_byte(hb, 0x09);  /* kSize */
+        header_buffer_number(hb, packed_size);
+        header_buffer_byte(hb, 0x00);  /* kEnd of PackInfo */
+
+        header_buffer_byte(hb, 0x07);  /* kUnpackInfo */
+        header_buffer_byte(hb, 0x0B);  /* kFolder */
+        header_buffer_number(hb, 1);  /* Number of folders */
+        header_buffer_byte(hb, 0x00);  /* External = false */
+        header_buffer_number(hb, 1);  /* Number of coders */
+        header_buffer_byte(hb, 0x21);  /* ID size 1, has properties */
+        header_buffer_byte(hb, 0x21);  /* LZMA2 codec ID */
+        header_buffer_number(hb, 1);  /* Properties size */
+        header_buffer_byte(hb, prop);
+        header_buffer_byte(hb, 0x0C);  /* kCodersUnpackSize */
+        header_buffer_number(hb, size);
+        header_buffer_byte(hb, 0x0A);  /* kCRC */
+        header_buffer_byte(hb, 0x01);  /* AllAreDefined = true */
+        header_buffer_uint32(hb, crc);
+        header_buffer_byte(hb, 0x00);  /* kEnd of UnpackInfo */
+
+        header_buffer_byte(hb, 0x00);  /* kEnd of MainStreamsInfo */
+    }
+
+    header_buffer_byte(hb, 0x05);  /* kFilesInfo */
+    header_buffer_number(hb, 1);
+
+    if (size == 0) {
+        header_buffer_byte(hb, 0x0E);  /* kEmptyStream */
+        header_buffer_number(hb, 1);
+        header_buffer_byte(hb, 0x80);
+        header_buffer_byte(hb, 0x0F);  /* kEmptyFile */
+        header_buffer_number(hb, 1);
+        header_buffer_byte(hb, 0x80);
+    }
+
+    size_t name_size = utf8_to_utf16le_size(name) + 2;
+    header_buffer_byte(hb, 0x11);  /* kName */
+    header_buffer_number(hb, 1 + name_size);
+    header_buffer_byte(hb, 0x00);  /* External = false */
+    Byte* q = header_buffer_reserve(hb, name_size);
+    if (q) {
+        size_t len = utf8_to_utf16le(name, q);
+        q[len] = 0; q[len + 1] = 0;  /* Null terminator */
+        header_buffer_commit(hb, len + 2);
+    }
+
+    header_buffer_byte(hb, 0x15);  /* kWinAttrib */
+    header_buffer_number(hb, 2 + 4);
+    header_buffer_byte(hb, 0x01);  /* AllAreDefined */
+    header_buffer_byte(hb, 0x00);  /* External = false */
+    header_buffer_uint32(hb, 0x20);  /* FILE_ATTRIBUTE_ARCHIVE */
+
+    header_buffer_byte(hb, 0x00);  /* kEnd of FilesInfo */
+    header_buffer_byte(hb, 0x00);  /* kEnd of Header */
+}
+
+/* .7z: signature header, the LZMA2 stream in place, then the plain header */
+static SevenZipErrorCode encode_7z(const Byte* input, size_t input_size, Byte* output,
+                                   size_t* output_size, SevenZipCompressionLevel level,
+                                   const SevenZipBufferOptions* options) {
+    size_t capacity = *output_size;
+    if (capacity < SIGNATURE_HEADER_SIZE) return SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+    global_tables_init();
+
+    size_t packed_size = 0;
+    Byte prop = 0;
+    if (input_size > 0) {
+        packed_size = capacity - SIGNATURE_HEADER_SIZE;
+        SevenZipErrorCode err = encode_lzma2_stream(input, input_size, output + SIGNATURE_HEADER_SIZE,
+                                                    &packed_size, &prop, level, options);
+        if (err != SEVENZIP_OK) return err;
+    }
+
+    HeaderBuffer hb;
+    header_buffer_init(&hb);
+    write_single_header(&hb, entry_name(options), input_size, packed_size, prop,
+                        input_size > 0 ? CrcCalc(input, input_size) : 0);
+    if (hb.failed) {
+        header_buffer_free(&hb);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    size_t header_pos = SIGNATURE_HEADER_SIZE + packed_size;
+    if (hb.size > capacity - header_pos) {
+        header_buffer_free(&hb);
+        return SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+    }
+    memcpy(output + header_pos, hb.data, hb.size);
+
+    /* Start header: NextHeaderOffset, NextHeaderSize, NextHeaderCRC */
+    uint64_t next_header_offset = packed_size;
+    uint64_t next_header_size = hb.size;
+    uint32_t next_header_crc = CrcCalc(hb.data, hb.size);
+    header_buffer_free(&hb);
+
+    Byte* sig = output;
+    memcpy(sig, k7zSignature, k7zSignatureSize);
+    sig[6] = k7zMajorVersion;
+    sig[7] = k7zMinorVersion;
+    memcpy(sig + 12, &next_header_offset, 8);
+    memcpy(sig + 20, &next_header_size, 8);
+    memcpy(sig + 28, &next_header_crc, 4);
+    uint32_t start_header_crc = CrcCalc(sig + 12, 20);
+    memcpy(sig + 8, &start_header_crc, 4);
+
+    *output_size = header_pos + next_header_size;
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_compress_buffer(
+    SevenZipBufferFormat format,
+    const void* input,
+    size_t input_size,
+    void* output,
+    size_t* output_size,
+    SevenZipCompressionLevel level,
+    const SevenZipBufferOptions* options
+) {
+    if ((!input && input_size > 0) || !output_size || (!output && *output_size > 0)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    SevenZipErrorCode err;
+    switch (format) {
+        case SEVENZIP_BUFFER_LZMA:
+            err = encode_lzma((const Byte*)input, input_size, (Byte*)output, output_size, level, options);
+            break;
+        case SEVENZIP_BUFFER_LZMA2:
+            err = encode_lzma2((const Byte*)input, input_size, (Byte*)output, output_size, level, options);
+            break;
+        case SEVENZIP_BUFFER_7Z:
+            err = encode_7z((const Byte*)input, input_size, (Byte*)output, output_size, level, options);
+            break;
+        default:
+            return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    if (err == SEVENZIP_ERROR_BUFFER_TOO_SMALL) {
+        *output_size = sevenzip_compress_buffer_bound(format, input_size, options);
+    } else if (err != SEVENZIP_OK) {
+        *output_size = 0;
+    }
+    return err;
+}
+
+/* ============================================================================
+ * Decompression
+ * ============================================================================ */
+
+static SevenZipErrorCode decode_error(SRes res) {
+    return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+}
+
+/* Size from the .lzma header; UINT64_MAX if the stream ends in a marker instead */
+static SevenZipErrorCode lzma_header_size(const Byte* input, size_t input_size, uint64_t* size) {
+    if (input_size < LZMA_HEADER_SIZE) return SEVENZIP_ERROR_EXTRACT;
+    *size = 0;
+    for (int i = 0; i < 8; i++) {
+        *size |= ((uint64_t)input[LZMA_PROPS_SIZE + i]) << (i * 8);
+    }
+    return SEVENZIP_OK;
+}
+
+/* Decode a .lzma stream of unknown size through its dictionary, counting bytes */
+static SevenZipErrorCode lzma_count_size(const Byte* input, size_t input_size, uint64_t* size) {
+    CLzmaDec decoder;
+    LzmaDec_Construct(&decoder);
+    SRes res = LzmaDec_Allocate(&decoder, input, LZMA_PROPS_SIZE, &g_MemDecoderAlloc);
+    if (res != SZ_OK) return decode_error(res);
+    LzmaDec_Init(&decoder);
+
+    const Byte* in = input + LZMA_HEADER_SIZE;
+    size_t in_left = input_size - LZMA_HEADER_SIZE;
+    uint64_t total = 0;
+    ELzmaStatus status = LZMA_STATUS_NOT_SPECIFIED;
+    for (;;) {
+        if (decoder.dicPos == decoder.dicBufSize) decoder.dicPos = 0;
+        SizeT dic_start = decoder.dicPos;
+        SizeT in_processed = in_left;
+        res = LzmaDec_DecodeToDic(&decoder, decoder.dicBufSize, in, &in_processed,
+                                  LZMA_FINISH_ANY, &status);
+        total += decoder.dicPos - dic_start;
+        in += in_processed;
+        in_left -= in_processed;
+        if (res != SZ_OK || status == LZMA_STATUS_FINISHED_WITH_MARK) break;
+        if (in_processed == 0 && decoder.dicPos == dic_start) {
+            res = SZ_ERROR_INPUT_EOF;
+            break;
+        }
+    }
+    LzmaDec_Free(&decoder, &g_MemDecoderAlloc);
+    if (res != SZ_OK) return decode_error(res);
+    *size = total;
+    return SEVENZIP_OK;
+}
+
+/* Sum the unpacked sizes of the LZMA2 chunk headers, skipping the chunk data */
+static SevenZipErrorCode lzma2_stream_size(const Byte* input, size_t input_size, uint64_t* size) {
+    const Byte* p = input;
+    size_t left = input_size;
+    uint64_t total = 0;
+    for (;;) {
+        if (left < 1) return SEVENZIP_ERROR_EXTRACT;
+        Byte control = *p;
+        size_t header, packed;
+        if (control == 0) break;
+        if (control == 1 || control == 2) {
+            if (left < 3) return SEVENZIP_ERROR_EXTRACT;
+            header = 3;
+            packed = ((size_t)p[1] << 8 | p[2]) + 1;
+            total += packed;
+        } else if (control >= 0x80) {
+            header = ((control >> 5) & 3) >= 2 ? 6 : 5;  /* State reset with new properties */
+            if (left < header) return SEVENZIP_ERROR_EXTRACT;
+            total += ((uint64_t)(control & 0x1F) << 16 | (uint64_t)p[1] << 8 | p[2]) + 1;
+            packed = ((size_t)p[3] << 8 | p[4]) + 1;
+        } else {
+            return SEVENZIP_ERROR_EXTRACT;
+        }
+        if (packed > left - header) return SEVENZIP_ERROR_EXTRACT;
+        p += header + packed;
+        left -= header + packed;
+    }
+    *size = total;
+    return SEVENZIP_OK;
+}
+
+/* A 7z archive in memory and its one file */
+typedef struct {
+    MmapVolume volume;
+    MmapInStream stream;
+    CSzArEx db;
+    UInt32 file;
+} SingleEntry;
+
+static SevenZipErrorCode single_entry_open(SingleEntry* e, const void* input, size_t input_size) {
+    global_tables_init();
+    mmap_in_stream_open_memory(&e->stream, &e->volume, input, input_size);
+    SzArEx_Init(&e->db);
+    SRes res = SzArEx_Open(&e->db, &e->stream.vt, &g_MemHeaderAlloc, &g_MemHeaderAlloc);
+    if (res != SZ_OK) {
+        SzArEx_Free(&e->db, &g_MemHeaderAlloc);
+        return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+
+    UInt32 files = 0;
+    for (UInt32 i = 0; i < e->db.NumFiles; i++) {
+        if (!SzArEx_IsDir(&e->db, i)) {
+            e->file = i;
+            files++;
+        }
+    }
+    if (files != 1) {
+        SzArEx_Free(&e->db, &g_MemHeaderAlloc);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    return SEVENZIP_OK;
+}
+
+static void single_entry_close(SingleEntry* e) {
+    SzArEx_Free(&e->db, &g_MemHeaderAlloc);
+    mmap_in_stream_close(&e->stream);
+}
+
+/* Decode the file's folder into output (exactly its size) and check the CRC */
+static SevenZipErrorCode single_entry_decode(SingleEntry* e, Byte* output, size_t size) {
+    if (size == 0) return SEVENZIP_OK;
+    UInt32 folder = e->db.FileToFolder[e->file];
+    if (folder == (UInt32)-1 || SzAr_GetFolderUnpackSize(&e->db.db, folder) != size) {
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    SRes res = SzAr_DecodeFolder(&e->db.db, folder, &e->stream.vt, e->db.dataPos,
+                                 output, size, &g_MemDecoderAlloc);
+    if (res != SZ_OK) return decode_error(res);
+    /* SzAr_DecodeFolder checked the folder CRC already */
+    if (!SzBitWithVals_Check(&e->db.db.FolderCRCs, folder) &&
+        SzBitWithVals_Check(&e->db.CRCs, e->file) &&
+        CrcCalc(output, size) != e->db.CRCs.Vals[e->file]) {
+        return SEVENZIP_ERROR_EXTRACT;
+    }
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_decompress_buffer_size(
+    SevenZipBufferFormat format,
+    const void* input,
+    size_t input_size,
+    uint64_t* size
+) {
+    if (!input || !size) return SEVENZIP_ERROR_INVALID_PARAM;
+    const Byte* in = (const Byte*)input;
+    SevenZipErrorCode err;
+    switch (format) {
+        case SEVENZIP_BUFFER_LZMA:
+            err = lzma_header_size(in, input_size, size);
+            if (err == SEVENZIP_OK && *size == UINT64_MAX) {
+                err = lzma_count_size(in, input_size, size);
+            }
+            return err;
+        case SEVENZIP_BUFFER_LZMA2:
+            if (input_size < 1) return SEVENZIP_ERROR_EXTRACT;
+            return lzma2_stream_size(in + 1, input_size - 1, size);
+        case SEVENZIP_BUFFER_7Z: {
+            SingleEntry e;
+            err = single_entry_open(&e, input, input_size);
+            if (err != SEVENZIP_OK) return err;
+            *size = SzArEx_GetFileSize(&e.db, e.file);
+            single_entry_close(&e);
+            return SEVENZIP_OK;
+        }
+        default:
+            return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+}
+
+/* Fit check shared by the formats: on a miss *output_size is the size needed */
+static int fits(uint64_t size, size_t* output_size) {
+    if (size > *output_size) {
+        *output_size = size > SIZE_MAX ? SIZE_MAX : (size_t)size;
+        return 0;
+    }
+    return 1;
+}
+
+static SevenZipErrorCode decode_lzma(const Byte* input, size_t input_size, Byte* output,
+                                     size_t* output_size) {
+    uint64_t size;
+    SevenZipErrorCode err = sevenzip_decompress_buffer_size(SEVENZIP_BUFFER_LZMA, input,
+                                                            input_size, &size);
+    if (err != SEVENZIP_OK) return err;
+    if (!fits(size, output_size)) return SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+
+    /* A stream of known size may still end in a marker; finish past it */
+    SizeT dest_len = (SizeT)size;
+    SizeT src_len = input_size - LZMA_HEADER_SIZE;
+    ELzmaStatus status;
+    SRes res = LzmaDecode(output, &dest_len, input + LZMA_HEADER_SIZE, &src_len,
+                          input, LZMA_PROPS_SIZE, LZMA_FINISH_END, &status, &g_MemDecoderAlloc);
+    if (res != SZ_OK) return decode_error(res);
+    if (dest_len != size || (status != LZMA_STATUS_FINISHED_WITH_MARK &&
+                             status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)) {
+        return SEVENZIP_ERROR_EXTRACT;
+    }
+    *output_size = dest_len;
+    return SEVENZIP_OK;
+}
+
+static SevenZipErrorCode decode_lzma2(const Byte* input, size_t input_size, Byte* output,
+                                      size_t* output_size) {
+    uint64_t size;
+    SevenZipErrorCode err = sevenzip_decompress_buffer_size(SEVENZIP_BUFFER_LZMA2, input,
+                                                            input_size, &size);
+    if (err != SEVENZIP_OK) return err;
+    if (!fits(size, output_size)) return SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+
+    SizeT dest_len = (SizeT)size;
+    SizeT src_len = input_size - 1;
+    ELzmaStatus status;
+    SRes res = Lzma2Decode(output, &dest_len, input + 1, &src_len, input[0],
+                           LZMA_FINISH_END, &status, &g_MemDecoderAlloc);
+    if (res != SZ_OK) return decode_error(res);
+    if (dest_len != size || status != LZMA_STATUS_FINISHED_WITH_MARK) {
+        return SEVENZIP_ERROR_EXTRACT;
+    }
+    *output_size = dest_len;
+    return SEVENZIP_OK;
+}
+
+static SevenZipErrorCode decode_7z(const void* input, size_t input_size, Byte* output,
+                                   size_t* output_size) {
+    SingleEntry e;
+    SevenZipErrorCode err = single_entry_open(&e, input, input_size);
+    if (err != SEVENZIP_OK) return err;
+    uint64_t size = SzArEx_GetFileSize(&e.db, e.file);
+    if (!fits(size, output_size)) {
+        err = SEVENZIP_ERROR_BUFFER_TOO_SMALL;
+    } else {
+        err = single_entry_decode(&e, output, (size_t)size);
+        if (err == SEVENZIP_OK) *output_size = (size_t)size;
+    }
+    single_entry_close(&e);
+    return err;
+}
+
+SevenZipErrorCode sevenzip_decompress_buffer(
+    SevenZipBufferFormat format,
+    const void* input,
+    size_t input_size,
+    void* output,
+    size_t* output_size
+) {
+    if (!input || !output_size || (!output && *output_size > 0)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    switch (format) {
+        case SEVENZIP_BUFFER_LZMA:
+            return decode_lzma((const Byte*)input, input_size, (Byte*)output, output_size);
+        case SEVENZIP_BUFFER_LZMA2:
+            return decode_lzma2((const Byte*)input, input_size, (Byte*)output, output_size);
+        case SEVENZIP_BUFFER_7Z:
+            return decode_7z(input, input_size, (Byte*)output, output_size);
+        default:
+            return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+}
@@ -0,0 +1,31 @@
+/**
+ * In-Memory Compression - Internal Header
+ *
+ * Encoder settings shared by the buffer API (buffer_codec.c) and the
+ * streaming encoder (stream_codec.c), so a stream and a buffer compressed
+ * at the same level and options come out alike.
+ */
+
+#ifndef SEVENZIP_BUFFER_CODEC_H
+#define SEVENZIP_BUFFER_CODEC_H
+
+#include "../include/7z_ffi.h"
+#include "LzmaEnc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* LZMA properties for a level; the dictionary shrinks to `input_size`
+ * ((UInt64)(Int64)-1 = unknown) */
+void buffer_codec_lzma_props(CLzmaEncProps* props, SevenZipCompressionLevel level,
+                             UInt64 input_size);
+
+/* Encoder threads asked for by the options, 1 to 64 */
+int buffer_codec_threads(const SevenZipBufferOptions* options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_BUFFER_CODEC_H */
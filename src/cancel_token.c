@@ -0,0 +1,63 @@
+/**
+ * Cancellation Token
+ *
+ * A single lock-free flag, so cancelling is safe from signal handlers
+ * and checking it costs one load on the read paths.
+ */
+
+#include "cancel_token.h"
+
+#include <stdlib.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <windows.h>
+    struct SevenZipCancelToken { volatile LONG cancelled; };
+    #define FLAG_LOAD(p) InterlockedCompareExchange((p), 0, 0)
+    #define FLAG_STORE(p, v) InterlockedExchange((p), (v))
+#else
+    #include <stdatomic.h>
+    struct SevenZipCancelToken { atomic_int cancelled; };
+    #define FLAG_LOAD(p) atomic_load_explicit((p), memory_order_relaxed)
+    #define FLAG_STORE(p, v) atomic_store_explicit((p), (v), memory_order_relaxed)
+#endif
+
+SevenZipCancelToken* sevenzip_cancel_token_create(void) {
+    SevenZipCancelToken* token = (SevenZipCancelToken*)malloc(sizeof(SevenZipCancelToken));
+    if (token) FLAG_STORE(&token->cancelled, 0);
+    return token;
+}
+
+void sevenzip_cancel_token_cancel(SevenZipCancelToken* token) {
+    if (token) FLAG_STORE(&token->cancelled, 1);
+}
+
+int sevenzip_cancel_token_is_cancelled(const SevenZipCancelToken* token) {
+    return cancel_token_requested(token);
+}
+
+void sevenzip_cancel_token_reset(SevenZipCancelToken* token) {
+    if (token) FLAG_STORE(&token->cancelled, 0);
+}
+
+void sevenzip_cancel_token_free(SevenZipCancelToken* token) {
+    free(token);
+}
+
+int cancel_token_requested(const SevenZipCancelToken* token) {
+    /* The flag is only ever written through a non-const token */
+    return token && FLAG_LOAD(&((SevenZipCancelToken*)token)->cancelled) != 0;
+}
+
+static SRes CancelProgress_Progress(ICompressProgressPtr pp, UInt64 in_size, UInt64 out_size) {
+    CancelProgress* p = Z7_CONTAINER_FROM_VTBL(pp, CancelProgress, vt);
+    if (cancel_token_requested(p->token)) return SZ_ERROR_PROGRESS;
+    return p->next ? ICompressProgress_Progress(p->next, in_size, out_size) : SZ_OK;
+}
+
+ICompressProgressPtr CancelProgress_Init(CancelProgress* p, const SevenZipCancelToken* token,
+                                         ICompressProgressPtr next) {
+    p->vt.Progress = CancelProgress_Progress;
+    p->token = token;
+    p->next = next;
+    return token ? &p->vt : next;
+}
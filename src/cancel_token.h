@@ -0,0 +1,43 @@
+/**
+ * Cancellation Token - Internal Header
+ *
+ * Checks of a job's SevenZipCancelToken. Read streams test the token on
+ * every call and fail with SZ_ERROR_PROGRESS; CancelProgress carries the
+ * same test into the encoders' progress callbacks, which MtCoder threads
+ * reach several times per block.
+ */
+
+#ifndef SEVENZIP_CANCEL_TOKEN_H
+#define SEVENZIP_CANCEL_TOKEN_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 1 once the token is cancelled; NULL is never cancelled */
+int cancel_token_requested(const SevenZipCancelToken* token);
+
+/* Progress sink failing with SZ_ERROR_PROGRESS once `token` is cancelled,
+ * passing every other call on to `next` */
+typedef struct {
+    ICompressProgress vt;
+    const SevenZipCancelToken* token;
+    ICompressProgressPtr next;
+} CancelProgress;
+
+/**
+ * Progress sink to hand an encoder
+ * @param next Sink chained behind the check (NULL = none)
+ * @return &p->vt, or `next` unchanged when there is no token
+ */
+ICompressProgressPtr CancelProgress_Init(CancelProgress* p, const SevenZipCancelToken* token,
+                                         ICompressProgressPtr next);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_CANCEL_TOKEN_H */
@@ -0,0 +1,95 @@
+/**
+ * Content-Defined Chunker
+ *
+ * The scan runs in three phases, each a tight loop bounded by the end of
+ * the data or of the phase: skipping to the hashed part of the minimum,
+ * hashing without testing up to the minimum, and hashing with the mask
+ * of the side of the average the chunk is on, up to the maximum. The
+ * Gear table comes from a fixed seed, so cut points, and with them
+ * archives, do not change between runs.
+ */
+
+#include "cdc_chunker.h"
+
+#include <string.h>
+
+#define CDC_WINDOW 64   /* Bytes the hash's top bit depends on */
+
+static uint64_t g_gear[256];
+
+void cdc_prepare(void) {
+    /* SplitMix64 */
+    uint64_t x = 0x7a3f5c4e1d2b6980ULL;
+    for (int i = 0; i < 256; i++) {
+        x += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        g_gear[i] = z ^ (z >> 31);
+    }
+}
+
+/* Helper: `bits` top bits set */
+static uint64_t top_mask(int bits) {
+    return ~(uint64_t)0 << (64 - bits);
+}
+
+void cdc_chunker_init(CdcChunker* c, uint32_t avg_size) {
+    memset(c, 0, sizeof(*c));
+    if (avg_size < CDC_MIN_AVERAGE) avg_size = CDC_MIN_AVERAGE;
+    if (avg_size > CDC_MAX_AVERAGE) avg_size = CDC_MAX_AVERAGE;
+    int bits = 0;
+    while (((uint32_t)2 << bits) <= avg_size) bits++;
+    c->avg_size = (uint32_t)1 << bits;
+    c->min_size = c->avg_size / 4;
+    c->max_size = c->avg_size * 4;
+    c->mask_small = top_mask(bits + 2);
+    c->mask_large = top_mask(bits - 2);
+}
+
+size_t cdc_chunker_scan(CdcChunker* c, const uint8_t* data, size_t size, int* cut) {
+    uint64_t h = c->hash;
+    uint32_t length = c->length;
+    size_t i = 0;
+    *cut = 0;
+
+    /* Bytes further than the window before the minimum never matter */
+    if (length < c->min_size - CDC_WINDOW) {
+        size_t skip = c->min_size - CDC_WINDOW - length;
+        if (skip > size) skip = size;
+        i = skip;
+        length += (uint32_t)skip;
+    }
+    if (length < c->min_size) {
+        size_t start = i;
+        size_t end = i + (c->min_size - length);
+        if (end > size) end = size;
+        for (; i < end; i++) h = (h << 1) + g_gear[data[i]];
+        length += (uint32_t)(i - start);
+    }
+    while (i < size && length >= c->min_size) {
+        uint64_t mask = length < c->avg_size ? c->mask_small : c->mask_large;
+        uint32_t phase_end = length < c->avg_size ? c->avg_size : c->max_size;
+        size_t end = i + (phase_end - length);
+        if (end > size) end = size;
+        size_t start = i;
+        for (; i < end; i++) {
+            h = (h << 1) + g_gear[data[i]];
+            if (!(h & mask)) {
+                i++;
+                *cut = 1;
+                break;
+            }
+        }
+        length += (uint32_t)(i - start);
+        if (*cut || length >= c->max_size) {
+            *cut = 1;
+            c->hash = 0;
+            c->length = 0;
+            return i;
+        }
+    }
+    c->hash = h;
+    c->length = length;
+    return i;
+}
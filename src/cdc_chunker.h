@@ -0,0 +1,62 @@
+/**
+ * Content-Defined Chunker - Internal Header
+ *
+ * FastCDC cut points for SevenZipCompressOptions.dedup_chunk_size. A
+ * 64-bit Gear hash (shift left, add a random value per byte) runs over
+ * the data; its top bits depend on the last 64 bytes only, so a cut is
+ * found again after an insertion or deletion upstream, and chunks away
+ * from a change keep their contents. Normalized chunking tests a mask
+ * two bits harder before the average size and two bits easier after it,
+ * which keeps most chunks near the average; nothing is hashed before the
+ * last 64 bytes of the minimum, as those cannot cut.
+ *
+ *     CdcChunker c;
+ *     cdc_chunker_init(&c, avg);
+ *     for each piece of input:
+ *         while piece left:
+ *             n = cdc_chunker_scan(&c, piece, left, &cut);
+ *             ... append n bytes to the chunk; on cut, the chunk is whole ...
+ */
+
+#ifndef SEVENZIP_CDC_CHUNKER_H
+#define SEVENZIP_CDC_CHUNKER_H
+
+#include "../include/7z_ffi.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CDC_MIN_AVERAGE (4u << 10)
+#define CDC_MAX_AVERAGE (4u << 20)
+
+typedef struct {
+    uint32_t min_size;     /* avg / 4 */
+    uint32_t avg_size;
+    uint32_t max_size;     /* avg * 4: the largest chunk */
+    uint64_t mask_small;   /* Before avg_size */
+    uint64_t mask_large;   /* From avg_size */
+    uint64_t hash;
+    uint32_t length;       /* Bytes of the chunk scanned so far */
+} CdcChunker;
+
+/* Fill the Gear table (from global_tables_init()) */
+void cdc_prepare(void);
+
+/* avg_size is rounded down to a power of two within CDC_MIN_AVERAGE..CDC_MAX_AVERAGE */
+void cdc_chunker_init(CdcChunker* c, uint32_t avg_size);
+
+/**
+ * Scan the next bytes of the input
+ * @return Bytes of `data` that belong to the current chunk; *cut is set
+ *         when the chunk ends after them, and the next chunk starts
+ */
+size_t cdc_chunker_scan(CdcChunker* c, const uint8_t* data, size_t size, int* cut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_CDC_CHUNKER_H */
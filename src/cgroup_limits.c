@@ -0,0 +1,215 @@
+/**
+ * Cgroup Limits
+ *
+ * /proc/self/cgroup names the process's cgroup as seen from the host's
+ * root. Inside a container with a private cgroup namespace, or one whose
+ * own cgroup is mounted at the top, that path does not exist under the
+ * mount; the walk up to the mount point then finds the container's
+ * limits at the top.
+ */
+
+#include "cgroup_limits.h"
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <string.h>
+
+#define CGROUP_PATH_MAX 512
+
+typedef struct {
+    char v2[CGROUP_PATH_MAX];         /* "0::" line: the unified hierarchy */
+    char v1_memory[CGROUP_PATH_MAX];  /* v1 memory controller */
+    char v1_cpu[CGROUP_PATH_MAX];     /* v1 cpu controller */
+} CgroupPaths;
+
+/* Whether the comma-separated `list` (`len` bytes) names `controller` */
+static int has_controller(const char* list, size_t len, const char* controller) {
+    size_t n = strlen(controller);
+    const char* end = list + len;
+    while (list < end) {
+        const char* comma = memchr(list, ',', (size_t)(end - list));
+        size_t item = comma ? (size_t)(comma - list) : (size_t)(end - list);
+        if (item == n && memcmp(list, controller, n) == 0) return 1;
+        list += item + 1;
+    }
+    return 0;
+}
+
+static void read_cgroup_paths(CgroupPaths* paths) {
+    memset(paths, 0, sizeof(*paths));
+    FILE* f = fopen("/proc/self/cgroup", "r");
+    if (!f) return;
+
+    char line[CGROUP_PATH_MAX + 128];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        /* hierarchy-ID:controller-list:path */
+        char* list = strchr(line, ':');
+        char* path = list ? strchr(list + 1, ':') : NULL;
+        if (!path) continue;
+        list++;
+        size_t list_len = (size_t)(path - list);
+        path++;
+        if (list_len == 0 && strncmp(line, "0:", 2) == 0) {
+            snprintf(paths->v2, sizeof(paths->v2), "%s", path);
+        } else if (has_controller(list, list_len, "memory")) {
+            snprintf(paths->v1_memory, sizeof(paths->v1_memory), "%s", path);
+        } else if (has_controller(list, list_len, "cpu")) {
+            snprintf(paths->v1_cpu, sizeof(paths->v1_cpu), "%s", path);
+        }
+    }
+    fclose(f);
+}
+
+/* Up to two numbers at the start of `dir`/`name`; "max" and a missing file
+ * give none */
+static int read_numbers(const char* dir, const char* name, long long* a, long long* b) {
+    char path[2 * CGROUP_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    int n = fscanf(f, "%lld %lld", a, b);
+    fclose(f);
+    return n > 0 ? n : 0;
+}
+
+typedef void (*CgroupVisit)(const char* dir, void* user_data);
+
+/* Visit the directory of cgroup `path` under the mount `root`, each parent,
+ * and `root` itself */
+static void walk_cgroup(const char* root, const char* path, CgroupVisit visit, void* user_data) {
+    char rel[CGROUP_PATH_MAX];
+    snprintf(rel, sizeof(rel), "%s", path);
+    for (;;) {
+        size_t len = strlen(rel);
+        while (len > 0 && rel[len - 1] == '/') rel[--len] = '\0';
+
+        char dir[2 * CGROUP_PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s%s", root, rel);
+        visit(dir, user_data);
+        if (len == 0) break;
+
+        char* slash = strrchr(rel, '/');
+        if (slash) *slash = '\0';
+        else rel[0] = '\0';
+    }
+}
+
+typedef struct {
+    const char* limit_file;
+    const char* usage_file;
+    uint64_t available;               /* 0 = no limit seen */
+} MemoryVisit;
+
+static void visit_memory(const char* dir, void* user_data) {
+    MemoryVisit* v = (MemoryVisit*)user_data;
+    long long limit, usage, unused;
+    if (read_numbers(dir, v->limit_file, &limit, &unused) < 1) return;
+    /* v1 reports no limit as a page-rounded 2^63 */
+    if (limit <= 0 || (uint64_t)limit >= ((uint64_t)1 << 62)) return;
+    if (read_numbers(dir, v->usage_file, &usage, &unused) < 1 || usage < 0) usage = 0;
+
+    uint64_t room = (uint64_t)usage < (uint64_t)limit ? (uint64_t)(limit - usage) : 1;
+    if (v->available == 0 || room < v->available) v->available = room;
+}
+
+uint64_t cgroup_memory_available(void) {
+    CgroupPaths paths;
+    read_cgroup_paths(&paths);
+
+    MemoryVisit v2 = { "memory.max", "memory.current", 0 };
+    walk_cgroup("/sys/fs/cgroup", paths.v2, visit_memory, &v2);
+    if (v2.available) return v2.available;
+
+    MemoryVisit v1 = { "memory.limit_in_bytes", "memory.usage_in_bytes", 0 };
+    walk_cgroup("/sys/fs/cgroup/memory", paths.v1_memory, visit_memory, &v1);
+    return v1.available;
+}
+
+typedef struct {
+    int v1;
+    int cpus;                         /* 0 = no quota seen */
+} CpuVisit;
+
+static void visit_cpu(const char* dir, void* user_data) {
+    CpuVisit* v = (CpuVisit*)user_data;
+    long long quota, period, unused;
+    if (v->v1) {
+        if (read_numbers(dir, "cpu.cfs_quota_us", &quota, &unused) < 1 ||
+            read_numbers(dir, "cpu.cfs_period_us", &period, &unused) < 1) {
+            return;
+        }
+    } else if (read_numbers(dir, "cpu.max", &quota, &period) < 2) {
+        return;
+    }
+    if (quota <= 0 || period <= 0) return;
+
+    long long cpus = (quota + period - 1) / period;
+    if (cpus > 1 << 20) return;
+    if (v->cpus == 0 || cpus < v->cpus) v->cpus = (int)cpus;
+}
+
+int cgroup_cpu_limit(void) {
+    CgroupPaths paths;
+    read_cgroup_paths(&paths);
+
+    CpuVisit v2 = { 0, 0 };
+    walk_cgroup("/sys/fs/cgroup", paths.v2, visit_cpu, &v2);
+    if (v2.cpus) return v2.cpus;
+
+    /* "cpu" is usually a link to the joint "cpu,cpuacct" mount */
+    CpuVisit v1 = { 1, 0 };
+    walk_cgroup("/sys/fs/cgroup/cpu", paths.v1_cpu, visit_cpu, &v1);
+    if (v1.cpus == 0) walk_cgroup("/sys/fs/cgroup/cpu,cpuacct", paths.v1_cpu, visit_cpu, &v1);
+    return v1.cpus;
+}
+
+typedef struct {
+    char* path;
+    size_t size;
+    int found;
+} PressureVisit;
+
+static void visit_pressure(const char* dir, void* user_data) {
+    PressureVisit* v = (PressureVisit*)user_data;
+    if (v->found) return;
+    snprintf(v->path, v->size, "%s/memory.pressure", dir);
+    FILE* f = fopen(v->path, "r");
+    if (!f) return;
+    fclose(f);
+    v->found = 1;
+}
+
+int cgroup_memory_pressure_path(char* path, size_t size) {
+    CgroupPaths paths;
+    read_cgroup_paths(&paths);
+
+    /* The root cgroup has no memory.pressure: the walk ends at the system's */
+    PressureVisit v = { path, size, 0 };
+    walk_cgroup("/sys/fs/cgroup", paths.v2, visit_pressure, &v);
+    if (v.found) return 1;
+    snprintf(path, size, "/proc/pressure/memory");
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    fclose(f);
+    return 1;
+}
+
+#else
+
+uint64_t cgroup_memory_available(void) {
+    return 0;
+}
+
+int cgroup_cpu_limit(void) {
+    return 0;
+}
+
+int cgroup_memory_pressure_path(char* path, size_t size) {
+    (void)path;
+    (void)size;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * Cgroup Limits - Internal Header
+ *
+ * Memory and CPU limits of the control group the process runs in, for
+ * the "auto" defaults: a container on a large host gets threads and
+ * buffers for its own share, not the host's. cgroup v2 (cpu.max,
+ * memory.max) and v1 (cpu.cfs_quota_us, memory.limit_in_bytes) are read
+ * at the process's cgroup and every parent; the tightest limit counts.
+ * Only Linux has cgroups; elsewhere there is no limit.
+ */
+
+#ifndef SEVENZIP_CGROUP_LIMITS_H
+#define SEVENZIP_CGROUP_LIMITS_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Room left under the memory limit (limit minus usage); 0 = no limit */
+uint64_t cgroup_memory_available(void);
+
+/* CPUs the CFS quota allows, quota over period rounded up; 0 = no quota */
+int cgroup_cpu_limit(void);
+
+/**
+ * Path of the memory pressure (PSI) file to watch: memory.pressure of the
+ * process's cgroup v2 or its nearest parent that has one, else
+ * /proc/pressure/memory
+ * @return 0 when neither exists (no PSI in the kernel, not Linux)
+ */
+int cgroup_memory_pressure_path(char* path, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_CGROUP_LIMITS_H */
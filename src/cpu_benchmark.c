@@ -0,0 +1,649 @@
+/**
+ * CPU Benchmark and Auto-Tuning
+ *
+ * The workload follows `7z b`: generated data mixing literals with
+ * matches at all distances, coded by one-shot LzmaEncode()/LzmaDecode()
+ * with one thread per coder. Each run repeats until BENCH_MIN_SECONDS
+ * have passed, so fast levels are timed as precisely as slow ones. The
+ * all-threads runs give every thread the repeat count of the one-thread
+ * run and time them from one start signal to the last join.
+ *
+ * The job estimate compresses samples of the real inputs with the same
+ * one-shot encoder and borrows the benchmark's thread scaling.
+ */
+
+#include "../include/7z_ffi.h"
+#include "LzmaEnc.h"
+#include "LzmaDec.h"
+#include "Threads.h"
+#include "mem_alloc.h"
+#include "thread_quota.h"
+#include "thread_placement.h"
+#include "dir_scan.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #define STAT _stat64
+    #define FSEEK _fseeki64
+    #define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
+    #define S_ISDIR(m) (((m) & _S_IFMT) == _S_IFDIR)
+#else
+    #include <time.h>
+    #define STAT stat
+    #define FSEEK fseeko
+#endif
+
+#define BENCH_DATA_SIZE ((size_t)1 << 20)
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_MAX_THREADS 256
+
+/* Smallest block the tuner hands a thread, and the default of 4x dictionary */
+#define TUNE_MIN_BLOCK ((uint64_t)1 << 20)
+
+/* Levels the tuner considers, best ratio first */
+static const SevenZipCompressionLevel k_tune_levels[] = {
+    SEVENZIP_LEVEL_ULTRA, SEVENZIP_LEVEL_MAXIMUM, SEVENZIP_LEVEL_NORMAL,
+    SEVENZIP_LEVEL_FAST, SEVENZIP_LEVEL_FASTEST
+};
+
+/* Cache per level (index = level); concurrent calls wait on the lock */
+static pthread_mutex_t g_bench_lock = PTHREAD_MUTEX_INITIALIZER;
+static SevenZipBenchmarkResult g_bench_cache[SEVENZIP_LEVEL_ULTRA + 1];
+
+typedef struct {
+    int decode;
+    int level;
+    const Byte* data;
+    const Byte* packed;
+    size_t packed_size;
+    const Byte* props;
+    unsigned passes;
+    CManualResetEvent start;
+} BenchJob;
+
+typedef struct {
+    const BenchJob* job;
+    CThread thread;
+    SRes res;
+} BenchWorker;
+
+static double now_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+static int hardware_threads(void) {
+    int n = hardware_thread_count();
+    return n > BENCH_MAX_THREADS ? BENCH_MAX_THREADS : n;
+}
+
+/* Literal runs and copies at short and long distances, roughly 3:1 for LZMA */
+static void bench_generate(Byte* buf, size_t size) {
+    UInt32 x = 0x9E3779B9;
+    size_t pos = 0;
+    while (pos < size) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        size_t len;
+        if (pos < 256 || (x & 3) == 0) {
+            len = 1 + ((x >> 2) & 31);
+            for (size_t i = 0; i < len && pos < size; i++) {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                buf[pos++] = (Byte)(x >> 24);
+            }
+        } else {
+            size_t span = (size_t)1 << (8 + ((x >> 2) & 7) * 2);   /* 256 B .. 4 MB */
+            if (span > pos) span = pos;
+            size_t dist = 1 + (size_t)((x >> 8) % span);
+            len = 2 + ((x >> 26) & 31);
+            for (size_t i = 0; i < len && pos < size; i++, pos++) {
+                buf[pos] = buf[pos - dist];
+            }
+        }
+    }
+}
+
+static SRes bench_encode(int level, const Byte* data, size_t size, Byte* out, size_t* out_size,
+                         Byte* props) {
+    CLzmaEncProps p;
+    LzmaEncProps_Init(&p);
+    p.level = level;
+    p.reduceSize = size;
+    p.numThreads = 1;
+    SizeT dest_len = *out_size;
+    SizeT props_size = LZMA_PROPS_SIZE;
+    SRes res = LzmaEncode(out, &dest_len, data, size, &p, props, &props_size, 0,
+                          NULL, &g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    *out_size = dest_len;
+    return res;
+}
+
+static SRes bench_decode(const Byte* packed, size_t packed_size, const Byte* props, Byte* out) {
+    SizeT dest_len = BENCH_DATA_SIZE;
+    SizeT src_len = packed_size;
+    ELzmaStatus status;
+    SRes res = LzmaDecode(out, &dest_len, packed, &src_len, props, LZMA_PROPS_SIZE,
+                          LZMA_FINISH_END, &status, &g_MemDecoderAlloc);
+    if (res == SZ_OK && dest_len != BENCH_DATA_SIZE) res = SZ_ERROR_DATA;
+    return res;
+}
+
+/* One job's passes into a buffer of the worker's own */
+static SRes bench_run(const BenchJob* job) {
+    size_t capacity = BENCH_DATA_SIZE + BENCH_DATA_SIZE / 2 + (1 << 16);
+    Byte* out = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, capacity);
+    if (!out) return SZ_ERROR_MEM;
+    SRes res = SZ_OK;
+    for (unsigned i = 0; i < job->passes && res == SZ_OK; i++) {
+        if (job->decode) {
+            res = bench_decode(job->packed, job->packed_size, job->props, out);
+        } else {
+            size_t size = capacity;
+            Byte props[LZMA_PROPS_SIZE];
+            res = bench_encode(job->level, job->data, BENCH_DATA_SIZE, out, &size, props);
+        }
+    }
+    mem_free(out);
+    return res;
+}
+
+static THREAD_FUNC_DECL bench_thread(void* arg) {
+    BenchWorker* w = (BenchWorker*)arg;
+    thread_sched_enter();
+    Event_Wait(&((BenchJob*)w->job)->start);
+    w->res = bench_run(w->job);
+    return 0;
+}
+
+/* Seconds for `threads` workers to finish job->passes each */
+static SRes bench_parallel(BenchJob* job, int threads, double* seconds) {
+    BenchWorker* workers = (BenchWorker*)calloc((size_t)threads, sizeof(BenchWorker));
+    if (!workers) return SZ_ERROR_MEM;
+    Event_Construct(&job->start);
+    if (ManualResetEvent_CreateNotSignaled(&job->start) != 0) {
+        free(workers);
+        return SZ_ERROR_THREAD;
+    }
+
+    SRes res = SZ_OK;
+    int started = 0;
+    for (; started < threads; started++) {
+        workers[started].job = job;
+        Thread_CONSTRUCT(&workers[started].thread);
+        if (Thread_Create(&workers[started].thread, bench_thread, &workers[started]) != 0) {
+            res = SZ_ERROR_THREAD;
+            break;
+        }
+    }
+    double begin = now_seconds();
+    Event_Set(&job->start);
+    for (int i = 0; i < started; i++) {
+        Thread_Wait_Close(&workers[i].thread);
+        if (workers[i].res != SZ_OK && res == SZ_OK) res = workers[i].res;
+    }
+    *seconds = now_seconds() - begin;
+
+    Event_Close(&job->start);
+    free(workers);
+    return res;
+}
+
+/* Repeat `job` alone until BENCH_MIN_SECONDS passed; the passes are left in job->passes */
+static SRes bench_single(BenchJob* job, double* mbps) {
+    unsigned passes = 0;
+    double begin = now_seconds();
+    double elapsed = 0;
+    BenchJob once = *job;
+    once.passes = 1;
+    do {
+        SRes res = bench_run(&once);
+        if (res != SZ_OK) return res;
+        passes++;
+        elapsed = now_seconds() - begin;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    job->passes = passes;
+    *mbps = (double)passes * BENCH_DATA_SIZE / 1e6 / elapsed;
+    return SZ_OK;
+}
+
+static SevenZipErrorCode run_benchmark(int level, int threads, SevenZipBenchmarkResult* r) {
+    size_t capacity = BENCH_DATA_SIZE + BENCH_DATA_SIZE / 2 + (1 << 16);
+    Byte* data = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, BENCH_DATA_SIZE);
+    Byte* packed = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, capacity);
+    Byte* check = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, BENCH_DATA_SIZE);
+    if (!data || !packed || !check) {
+        mem_free(data);
+        mem_free(packed);
+        mem_free(check);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    bench_generate(data, BENCH_DATA_SIZE);
+
+    /* The packed stream the decode runs read, checked once */
+    Byte props[LZMA_PROPS_SIZE];
+    size_t packed_size = capacity;
+    SRes res = bench_encode(level, data, BENCH_DATA_SIZE, packed, &packed_size, props);
+    if (res == SZ_OK) res = bench_decode(packed, packed_size, props, check);
+    if (res == SZ_OK && memcmp(data, check, BENCH_DATA_SIZE) != 0) res = SZ_ERROR_DATA;
+
+    BenchJob encode = { .decode = 0, .level = level, .data = data };
+    BenchJob decode = { .decode = 1, .level = level, .packed = packed,
+                        .packed_size = packed_size, .props = props };
+    memset(r, 0, sizeof(*r));
+    r->level = (SevenZipCompressionLevel)level;
+    r->threads = threads;
+    if (res == SZ_OK) res = bench_single(&encode, &r->encode_mbps);
+    if (res == SZ_OK) res = bench_single(&decode, &r->decode_mbps);
+
+    if (res == SZ_OK && threads > 1) {
+        double seconds = 0;
+        res = bench_parallel(&encode, threads, &seconds);
+        if (res == SZ_OK) {
+            r->encode_mbps_all = (double)threads * encode.passes * BENCH_DATA_SIZE / 1e6 / seconds;
+            res = bench_parallel(&decode, threads, &seconds);
+        }
+        if (res == SZ_OK) {
+            r->decode_mbps_all = (double)threads * decode.passes * BENCH_DATA_SIZE / 1e6 / seconds;
+        }
+    } else {
+        r->encode_mbps_all = r->encode_mbps;
+        r->decode_mbps_all = r->decode_mbps;
+    }
+
+    mem_free(data);
+    mem_free(packed);
+    mem_free(check);
+    if (res == SZ_ERROR_MEM) return SEVENZIP_ERROR_MEMORY;
+    if (res != SZ_OK) {
+        fprintf(stderr, "Error: Benchmark failed at level %d (%d)\n", level, res);
+        return SEVENZIP_ERROR_UNKNOWN;
+    }
+    return SEVENZIP_OK;
+}
+
+static int valid_level(SevenZipCompressionLevel level) {
+    return level == SEVENZIP_LEVEL_FASTEST || level == SEVENZIP_LEVEL_FAST ||
+           level == SEVENZIP_LEVEL_NORMAL || level == SEVENZIP_LEVEL_MAXIMUM ||
+           level == SEVENZIP_LEVEL_ULTRA;
+}
+
+SevenZipErrorCode sevenzip_benchmark(SevenZipCompressionLevel level, int threads,
+                                     SevenZipBenchmarkResult* result) {
+    if (!result || !valid_level(level) || threads < 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    if (threads == 0) threads = hardware_threads();
+    if (threads > BENCH_MAX_THREADS) threads = BENCH_MAX_THREADS;
+
+    pthread_mutex_lock(&g_bench_lock);
+    SevenZipBenchmarkResult* cached = &g_bench_cache[level];
+    SevenZipErrorCode err = SEVENZIP_OK;
+    if (cached->threads != threads) {
+        SevenZipBenchmarkResult fresh;
+        err = run_benchmark((int)level, threads, &fresh);
+        if (err == SEVENZIP_OK) *cached = fresh;
+    }
+    if (err == SEVENZIP_OK) *result = *cached;
+    pthread_mutex_unlock(&g_bench_lock);
+    return err;
+}
+
+/* The dictionary setup_props() gives a level, which sets the default block of 4x */
+static uint64_t level_dict_size(SevenZipCompressionLevel level) {
+    switch (level) {
+        case SEVENZIP_LEVEL_FASTEST: return (uint64_t)1 << 18;
+        case SEVENZIP_LEVEL_FAST: return (uint64_t)1 << 20;
+        case SEVENZIP_LEVEL_MAXIMUM: return (uint64_t)1 << 25;
+        case SEVENZIP_LEVEL_ULTRA: return (uint64_t)1 << 26;
+        default: return (uint64_t)1 << 23;
+    }
+}
+
+SevenZipErrorCode sevenzip_auto_tune(double target_mbps, uint64_t input_size,
+                                     SevenZipCompressionLevel max_level,
+                                     SevenZipTuning* tuning) {
+    if (!tuning || max_level == SEVENZIP_LEVEL_STORE || !valid_level(max_level)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    int hw = hardware_threads();
+
+    /* Threads past one per minimum block have nothing to compress */
+    int useful = hw;
+    if (input_size > 0) {
+        uint64_t blocks = (input_size + TUNE_MIN_BLOCK - 1) / TUNE_MIN_BLOCK;
+        if (blocks < (uint64_t)useful) useful = (int)blocks;
+    }
+
+    memset(tuning, 0, sizeof(*tuning));
+    for (size_t i = 0; i < sizeof(k_tune_levels) / sizeof(k_tune_levels[0]); i++) {
+        SevenZipCompressionLevel level = k_tune_levels[i];
+        if (level > max_level) continue;
+
+        SevenZipBenchmarkResult bench;
+        SevenZipErrorCode err = sevenzip_benchmark(level, hw, &bench);
+        if (err != SEVENZIP_OK) return err;
+        double per_thread = bench.encode_mbps_all / bench.threads;
+
+        int threads = useful;
+        if (target_mbps > 0 && per_thread > 0) {
+            double needed = target_mbps / per_thread;
+            if (needed < useful) threads = needed <= 1 ? 1 : (int)needed + (needed > (int)needed);
+        }
+        tuning->level = level;
+        tuning->num_threads = threads;
+        tuning->expected_mbps = per_thread * threads;
+        if (target_mbps <= 0 || tuning->expected_mbps >= target_mbps) break;
+    }
+
+    /* A block per thread when the default 4x dictionary would leave some idle */
+    if (input_size > 0 && tuning->num_threads > 1) {
+        uint64_t block = (input_size + (uint64_t)tuning->num_threads - 1) / (uint64_t)tuning->num_threads;
+        block = (block + TUNE_MIN_BLOCK - 1) & ~(TUNE_MIN_BLOCK - 1);
+        if (block < 4 * level_dict_size(tuning->level)) tuning->block_size = block;
+    }
+    return SEVENZIP_OK;
+}
+
+/* ---- Job estimate ---- */
+
+/* Bytes read at one sample position */
+#define ESTIMATE_PIECE ((uint64_t)256 << 10)
+
+/* Extensions told apart; files of further ones share the last group */
+#define ESTIMATE_MAX_GROUPS 64
+#define ESTIMATE_EXT_MAX 16
+
+typedef struct {
+    char* path;
+    uint64_t size;
+    int group;
+} EstimateFile;
+
+typedef struct {
+    char ext[ESTIMATE_EXT_MAX];  /* Lower case; "" = none or too long */
+    uint64_t bytes;
+    uint64_t budget;             /* Sample bytes to read */
+} EstimateGroup;
+
+typedef struct {
+    EstimateFile* files;
+    size_t count;
+    size_t capacity;
+    EstimateGroup groups[ESTIMATE_MAX_GROUPS];
+    int group_count;
+    uint64_t total;
+} EstimateInputs;
+
+void sevenzip_estimate_options_init(SevenZipEstimateOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->sample_fraction = 0.01;
+    options->min_sample_bytes = (uint64_t)1 << 20;
+    options->max_sample_bytes = (uint64_t)16 << 20;
+    options->min_level = SEVENZIP_LEVEL_FASTEST;
+    options->max_level = SEVENZIP_LEVEL_ULTRA;
+}
+
+static int estimate_group(EstimateInputs* in, const char* path) {
+    const char* base = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    char ext[ESTIMATE_EXT_MAX] = "";
+    const char* dot = strrchr(base, '.');
+    if (dot && dot != base && strlen(dot + 1) < ESTIMATE_EXT_MAX) {
+        size_t i = 0;
+        for (const char* p = dot + 1; *p; p++) ext[i++] = (char)tolower((unsigned char)*p);
+        ext[i] = '\0';
+    }
+    for (int g = 0; g < in->group_count; g++) {
+        if (strcmp(in->groups[g].ext, ext) == 0) return g;
+    }
+    if (in->group_count == ESTIMATE_MAX_GROUPS) return ESTIMATE_MAX_GROUPS - 1;
+    memcpy(in->groups[in->group_count].ext, ext, sizeof(ext));
+    return in->group_count++;
+}
+
+static SevenZipErrorCode estimate_add_file(EstimateInputs* in, const char* path, uint64_t size) {
+    if (size == 0) return SEVENZIP_OK;
+    if (in->count == in->capacity) {
+        size_t capacity = in->capacity ? in->capacity * 2 : 256;
+        EstimateFile* files = (EstimateFile*)mem_realloc(SEVENZIP_MEM_HEADER, in->files,
+                                                         capacity * sizeof(EstimateFile));
+        if (!files) return SEVENZIP_ERROR_MEMORY;
+        in->files = files;
+        in->capacity = capacity;
+    }
+    EstimateFile* f = &in->files[in->count];
+    f->path = mem_strdup(SEVENZIP_MEM_NAMES, path);
+    if (!f->path) return SEVENZIP_ERROR_MEMORY;
+    f->size = size;
+    f->group = estimate_group(in, path);
+    in->groups[f->group].bytes += size;
+    in->total += size;
+    in->count++;
+    return SEVENZIP_OK;
+}
+
+static SevenZipErrorCode estimate_scan_entry(const DirScanEntry* entry, void* user_data) {
+    if (entry->is_dir) return SEVENZIP_OK;
+    return estimate_add_file((EstimateInputs*)user_data, entry->full_path, entry->size);
+}
+
+static void estimate_inputs_free(EstimateInputs* in) {
+    for (size_t i = 0; i < in->count; i++) mem_free(in->files[i].path);
+    mem_free(in->files);
+    in->files = NULL;
+    in->count = 0;
+}
+
+static SevenZipErrorCode estimate_gather(EstimateInputs* in, const char** input_paths) {
+    for (const char** p = input_paths; *p; p++) {
+        struct STAT st;
+        if (STAT(*p, &st) != 0) return SEVENZIP_ERROR_OPEN_FILE;
+        SevenZipErrorCode err = SEVENZIP_OK;
+        if (S_ISDIR(st.st_mode)) {
+            err = sevenzip_scan_directory(*p, NULL, DIR_SCAN_SKIP_ERRORS, 0, NULL, estimate_scan_entry, in);
+        } else if (S_ISREG(st.st_mode)) {
+            err = estimate_add_file(in, *p, (uint64_t)st.st_size);
+        }
+        if (err != SEVENZIP_OK) return err;
+    }
+    return SEVENZIP_OK;
+}
+
+/* Sample budgets: sample_fraction of each group, at least min_sample_bytes,
+ * all of them scaled down together to fit max_sample_bytes */
+static uint64_t estimate_budgets(EstimateInputs* in, const SevenZipEstimateOptions* o) {
+    uint64_t sum = 0;
+    for (int g = 0; g < in->group_count; g++) {
+        EstimateGroup* group = &in->groups[g];
+        double want = (double)group->bytes * o->sample_fraction;
+        uint64_t budget = want > (double)group->bytes ? group->bytes : (uint64_t)want;
+        if (budget < o->min_sample_bytes) budget = o->min_sample_bytes;
+        if (budget > group->bytes) budget = group->bytes;
+        group->budget = budget;
+        sum += budget;
+    }
+    uint64_t largest = 0;
+    for (int g = 0; g < in->group_count; g++) {
+        EstimateGroup* group = &in->groups[g];
+        if (o->max_sample_bytes > 0 && sum > o->max_sample_bytes) {
+            group->budget = (uint64_t)((double)group->budget * o->max_sample_bytes / sum);
+            if (group->budget == 0) group->budget = 1;
+        }
+        if (group->budget > largest) largest = group->budget;
+    }
+    return largest;
+}
+
+/* Up to `len` bytes at offset `off` of a group's files joined in order,
+ * from the file `*i` (starting at group offset `*base`) onwards; offsets
+ * only move forward. Files that shrank since the scan give fewer bytes.
+ * @return Bytes read */
+static size_t estimate_read(const EstimateInputs* in, const size_t* order, size_t end,
+                            size_t* i, uint64_t* base, uint64_t off, Byte* out, size_t len) {
+    size_t done = 0;
+    while (done < len && *i < end) {
+        const EstimateFile* f = &in->files[order[*i]];
+        if (off >= *base + f->size) {
+            *base += f->size;
+            (*i)++;
+            continue;
+        }
+        uint64_t at = off - *base;
+        size_t want = len - done;
+        if ((uint64_t)want > f->size - at) want = (size_t)(f->size - at);
+        size_t got = 0;
+        FILE* file = fopen(f->path, "rb");
+        if (file) {
+            if (FSEEK(file, (int64_t)at, SEEK_SET) == 0) got = fread(out + done, 1, want, file);
+            fclose(file);
+        }
+        done += got;
+        off += want;
+    }
+    return done;
+}
+
+/* Samples of group `g` into `buf`: pieces evenly spread over its bytes
+ * @return Bytes read */
+static size_t estimate_sample(const EstimateInputs* in, const size_t* order, size_t first, size_t end,
+                              int g, Byte* buf) {
+    const EstimateGroup* group = &in->groups[g];
+    uint64_t pieces = (group->budget + ESTIMATE_PIECE - 1) / ESTIMATE_PIECE;
+    uint64_t piece = group->budget / pieces;
+    size_t i = first;
+    uint64_t base = 0;
+    size_t size = 0;
+    for (uint64_t j = 0; j < pieces; j++) {
+        double center = ((double)j + 0.5) * (double)group->bytes / (double)pieces;
+        uint64_t off = center > (double)(piece / 2) ? (uint64_t)center - piece / 2 : 0;
+        if (off > group->bytes - piece) off = group->bytes - piece;
+        size += estimate_read(in, order, end, &i, &base, off, buf + size, (size_t)piece);
+    }
+    return size;
+}
+
+SevenZipErrorCode sevenzip_estimate_job(const char** input_paths,
+                                        const SevenZipEstimateOptions* options,
+                                        SevenZipJobEstimate* estimates, size_t capacity,
+                                        size_t* count) {
+    SevenZipEstimateOptions o;
+    if (options) {
+        o = *options;
+    } else {
+        sevenzip_estimate_options_init(&o);
+    }
+    if (!input_paths || !input_paths[0] || !count || (!estimates && capacity > 0) ||
+        !valid_level(o.min_level) || !valid_level(o.max_level) || o.min_level > o.max_level ||
+        o.sample_fraction < 0 || o.num_threads < 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    SevenZipJobEstimate levels[sizeof(k_tune_levels) / sizeof(k_tune_levels[0])];
+    size_t level_count = 0;
+    for (size_t i = 0; i < sizeof(k_tune_levels) / sizeof(k_tune_levels[0]); i++) {
+        if (k_tune_levels[i] < o.min_level || k_tune_levels[i] > o.max_level) continue;
+        memset(&levels[level_count], 0, sizeof(levels[0]));
+        levels[level_count++].level = k_tune_levels[i];
+    }
+
+    EstimateInputs in;
+    memset(&in, 0, sizeof(in));
+    SevenZipErrorCode err = estimate_gather(&in, input_paths);
+    size_t* order = NULL;
+    Byte* sample = NULL;
+    Byte* packed = NULL;
+    size_t packed_capacity = 0;
+    if (err == SEVENZIP_OK && in.count > 0) {
+        uint64_t largest = estimate_budgets(&in, &o);
+        packed_capacity = (size_t)(largest + largest / 2 + (1 << 16));
+        order = (size_t*)mem_alloc(SEVENZIP_MEM_HEADER, in.count * sizeof(size_t));
+        sample = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, (size_t)largest);
+        packed = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, packed_capacity);
+        if (!order || !sample || !packed) err = SEVENZIP_ERROR_MEMORY;
+    }
+
+    /* One-thread seconds per level, summed over the groups */
+    double seconds[sizeof(k_tune_levels) / sizeof(k_tune_levels[0])] = {0};
+    double predicted[sizeof(k_tune_levels) / sizeof(k_tune_levels[0])] = {0};
+    uint64_t sampled = 0;
+    size_t first = 0;
+    for (int g = 0; err == SEVENZIP_OK && g < in.group_count; g++) {
+        /* The group's files in scan order */
+        size_t end = first;
+        for (size_t i = 0; i < in.count; i++) {
+            if (in.files[i].group == g) order[end++] = i;
+        }
+        size_t size = estimate_sample(&in, order, first, end, g, sample);
+        first = end;
+        if (size == 0) continue;
+        sampled += size;
+        double scale = (double)in.groups[g].bytes / (double)size;
+        for (size_t l = 0; l < level_count; l++) {
+            size_t out_size = packed_capacity;
+            Byte props[LZMA_PROPS_SIZE];
+            double begin = now_seconds();
+            SRes res = bench_encode((int)levels[l].level, sample, size, packed, &out_size, props);
+            if (res != SZ_OK) {
+                err = res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_COMPRESS;
+                break;
+            }
+            seconds[l] += (now_seconds() - begin) * scale;
+            predicted[l] += (double)out_size * scale;
+        }
+    }
+    mem_free(order);
+    mem_free(sample);
+    mem_free(packed);
+
+    /* Threads past one per default block have nothing to compress */
+    int threads = o.num_threads > 0 ? o.num_threads : hardware_threads();
+    for (size_t l = 0; err == SEVENZIP_OK && l < level_count; l++) {
+        SevenZipJobEstimate* e = &levels[l];
+        uint64_t block = 4 * level_dict_size(e->level);
+        uint64_t blocks = (in.total + block - 1) / block;
+        e->num_threads = blocks < (uint64_t)threads ? (blocks > 0 ? (int)blocks : 1) : threads;
+        e->input_bytes = in.total;
+        e->sample_bytes = sampled;
+        e->predicted_size = (uint64_t)(predicted[l] + 0.5);
+        e->predicted_seconds_one_thread = seconds[l];
+        double speedup = 1.0;
+        if (e->num_threads > 1) {
+            SevenZipBenchmarkResult bench;
+            err = sevenzip_benchmark(e->level, e->num_threads, &bench);
+            if (err != SEVENZIP_OK) break;
+            double efficiency = bench.encode_mbps > 0
+                ? bench.encode_mbps_all / ((double)bench.threads * bench.encode_mbps) : 1.0;
+            if (efficiency > 1.0) efficiency = 1.0;
+            speedup = e->num_threads * efficiency;
+            if (speedup < 1.0) speedup = 1.0;
+        }
+        e->predicted_seconds = seconds[l] / speedup;
+    }
+    estimate_inputs_free(&in);
+    if (err != SEVENZIP_OK) return err;
+
+    *count = level_count;
+    for (size_t l = 0; l < level_count && l < capacity; l++) estimates[l] = levels[l];
+    return SEVENZIP_OK;
+}
@@ -0,0 +1,318 @@
+/**
+ * CPU Feature Report
+ *
+ * The SDK picks its CRC, AES and SHA-256 block functions in
+ * global_tables_init() and the match finder's in LzFindPrepare(), from
+ * the CPU_IsSupported_*() detection in CpuArch.c; each fast path is
+ * compiled with a target attribute, so none needs -march. This reads
+ * back what was picked: the exported function pointers and flags where
+ * the SDK keeps them, and LzFindPrepare()'s own test where it does not.
+ *
+ * The kernel variants are every version of those block functions this
+ * host can run, called directly rather than through the pointers, so
+ * each can be timed against the one dispatch picked. The match finders
+ * have no CPU-specific version in their search loop (normalisation, the
+ * SIMD part, runs once per 4GB of window), so they are listed by kind.
+ */
+
+#include "../include/7z_ffi.h"
+#include "global_tables.h"
+#include "xxh3.h"
+
+#include "7zCrc.h"
+#include "Aes.h"
+#include "Compiler.h"
+#include "CpuArch.h"
+#include "Sha256.h"
+#include "LzFind.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+/* Set by CrcGenerateTable() only when the ARMv8 CRC loops are chosen */
+extern CRC_FUNC g_CrcUpdateT0_32;
+extern CRC_FUNC g_CrcUpdateT0_64;
+extern CRC_FUNC g_CrcUpdate;
+extern UInt32 g_CrcTable[];
+
+#ifndef MY_CPU_BE
+UInt32 Z7_FASTCALL CrcUpdateT4(UInt32 v, const void *data, size_t size, const UInt32 *table);
+UInt32 Z7_FASTCALL CrcUpdateT8(UInt32 v, const void *data, size_t size, const UInt32 *table);
+#endif
+
+#ifdef MY_CPU_ARM_OR_ARM64
+    #define KERNEL_AES_HW "armv8-aes"
+    #define KERNEL_SHA_HW "armv8-sha2"
+#else
+    #define KERNEL_AES_HW "aes-ni"
+    #define KERNEL_SHA_HW "sha-ni"
+#endif
+
+/* History of the match finder variants, and the input they reach back over */
+#define KERNEL_MF_MAX_HISTORY ((UInt32)1 << 24)
+#define KERNEL_MF_NICE_LEN 32
+#define KERNEL_MF_CUT_VALUE 32
+
+/* LzFind.c keeps its SaturSub pointer static; these are the conditions
+ * under which it compiles the SIMD versions */
+#if defined(MY_CPU_X86_OR_AMD64)
+    #if defined(__clang__) && (__clang_major__ >= 4) \
+        || defined(Z7_GCC_VERSION) && (Z7_GCC_VERSION >= 40701)
+        #define MATCH_FINDER_SIMD_128
+        #define MATCH_FINDER_SIMD_256
+    #elif defined(_MSC_VER)
+        #if (_MSC_VER >= 1600)
+            #define MATCH_FINDER_SIMD_128
+        #endif
+        #if (_MSC_VER >= 1900)
+            #define MATCH_FINDER_SIMD_256
+        #endif
+    #endif
+#elif defined(MY_CPU_ARM64)
+    #if defined(__clang__) && (__clang_major__ >= 8) \
+        || defined(__GNUC__) && (__GNUC__ >= 8) \
+        || defined(_MSC_VER) && (_MSC_VER >= 1910)
+        #define MATCH_FINDER_SIMD_128
+    #endif
+#endif
+
+static int match_finder_bits(void) {
+#if defined(MATCH_FINDER_SIMD_128) && defined(MY_CPU_ARM64)
+    if (CPU_IsSupported_NEON()) return 128;
+#elif defined(MATCH_FINDER_SIMD_128)
+    if (CPU_IsSupported_SSE41()) {
+    #ifdef MATCH_FINDER_SIMD_256
+        if (CPU_IsSupported_AVX2()) return 256;
+    #endif
+        return 128;
+    }
+#endif
+    return 0;
+}
+
+SevenZipErrorCode sevenzip_get_cpu_features(SevenZipCpuFeatures* features) {
+    if (!features) return SEVENZIP_ERROR_INVALID_PARAM;
+    global_tables_init();
+
+    memset(features, 0, sizeof(*features));
+    features->crc32_hw = g_CrcUpdateT0_32 != NULL || g_CrcUpdateT0_64 != NULL;
+    features->aes_hw = (g_Aes_SupportedFunctions_Flags & k_Aes_SupportedFunctions_HW) != 0;
+    features->aes_vaes_avx2 = (g_Aes_SupportedFunctions_Flags & k_Aes_SupportedFunctions_HW_256) != 0;
+
+    CSha256 sha;
+    Sha256_Init(&sha);
+    features->sha256_hw = Sha256_SetFunction(&sha, SHA256_ALGO_HW) ? 1 : 0;
+
+    features->match_finder_bits = match_finder_bits();
+    features->xxh3_avx2 = xxh3_uses_avx2();
+#ifdef Z7_LZMA_DEC_OPT
+    features->lzma_dec_asm = 1;
+#endif
+    return SEVENZIP_OK;
+}
+
+/* A kernel variant and the function that runs it */
+typedef struct {
+    SevenZipKernel kernel;
+    const char* name;
+    CRC_FUNC crc;
+    AES_CODE_FUNC aes;
+    unsigned sha_algo;
+    int bt_mode;
+    int in_use;
+} KernelVariant;
+
+static size_t kernel_list(KernelVariant* list) {
+    global_tables_init();
+    size_t n = 0;
+    memset(list, 0, SEVENZIP_MAX_KERNEL_VARIANTS * sizeof(*list));
+
+#ifndef MY_CPU_BE
+    list[n].kernel = SEVENZIP_KERNEL_CRC32;
+    list[n].name = "slice4";
+    list[n++].crc = CrcUpdateT4;
+    list[n].kernel = SEVENZIP_KERNEL_CRC32;
+    list[n].name = "slice8";
+    list[n++].crc = CrcUpdateT8;
+#else
+    list[n].kernel = SEVENZIP_KERNEL_CRC32;
+    list[n].name = "tables";
+    list[n++].crc = g_CrcUpdate;
+#endif
+    if (g_CrcUpdateT0_64 || g_CrcUpdateT0_32) {
+        list[n].kernel = SEVENZIP_KERNEL_CRC32;
+        list[n].name = "armv8-crc32";
+        list[n++].crc = g_CrcUpdateT0_64 ? g_CrcUpdateT0_64 : g_CrcUpdateT0_32;
+    }
+
+    int aes_hw = (g_Aes_SupportedFunctions_Flags & k_Aes_SupportedFunctions_HW) != 0;
+    list[n].kernel = SEVENZIP_KERNEL_AES_CBC_ENCODE;
+    list[n].name = "scalar";
+    list[n++].aes = AesCbc_Encode;
+    if (aes_hw) {
+        list[n].kernel = SEVENZIP_KERNEL_AES_CBC_ENCODE;
+        list[n].name = KERNEL_AES_HW;
+        list[n++].aes = AesCbc_Encode_HW;
+    }
+    list[n].kernel = SEVENZIP_KERNEL_AES_CBC_DECODE;
+    list[n].name = "scalar";
+    list[n++].aes = AesCbc_Decode;
+    if (aes_hw) {
+        list[n].kernel = SEVENZIP_KERNEL_AES_CBC_DECODE;
+        list[n].name = KERNEL_AES_HW;
+        list[n++].aes = AesCbc_Decode_HW;
+    }
+    if (g_Aes_SupportedFunctions_Flags & k_Aes_SupportedFunctions_HW_256) {
+        list[n].kernel = SEVENZIP_KERNEL_AES_CBC_DECODE;
+        list[n].name = "vaes-avx2";
+        list[n++].aes = AesCbc_Decode_HW_256;
+    }
+
+    CSha256 sha;
+    Sha256_Init(&sha);
+    list[n].kernel = SEVENZIP_KERNEL_SHA256;
+    list[n].name = "scalar";
+    list[n++].sha_algo = SHA256_ALGO_SW;
+    if (Sha256_SetFunction(&sha, SHA256_ALGO_HW)) {
+        list[n].kernel = SEVENZIP_KERNEL_SHA256;
+        list[n].name = KERNEL_SHA_HW;
+        list[n++].sha_algo = SHA256_ALGO_HW;
+    }
+
+    list[n].kernel = SEVENZIP_KERNEL_MATCH_FINDER;
+    list[n].name = "bt4";
+    list[n++].bt_mode = 1;
+    list[n].kernel = SEVENZIP_KERNEL_MATCH_FINDER;
+    list[n].name = "hc4";
+    list[n++].bt_mode = 0;
+
+    /* What dispatch picked: the pointers the library calls through */
+    CSha256 picked;
+    Sha256_Init(&picked);
+    for (size_t i = 0; i < n; i++) {
+        KernelVariant* v = &list[i];
+        switch (v->kernel) {
+            case SEVENZIP_KERNEL_CRC32: v->in_use = v->crc == g_CrcUpdate; break;
+            case SEVENZIP_KERNEL_AES_CBC_ENCODE: v->in_use = v->aes == g_AesCbc_Encode; break;
+            case SEVENZIP_KERNEL_AES_CBC_DECODE: v->in_use = v->aes == g_AesCbc_Decode; break;
+            case SEVENZIP_KERNEL_SHA256:
+                Sha256_SetFunction(&sha, v->sha_algo);
+                v->in_use = sha.func_UpdateBlocks == picked.func_UpdateBlocks;
+                break;
+            default: v->in_use = 1; break;  /* Both serve, by level */
+        }
+    }
+    return n;
+}
+
+size_t sevenzip_kernel_variants(SevenZipKernelVariant* variants, size_t capacity) {
+    KernelVariant list[SEVENZIP_MAX_KERNEL_VARIANTS];
+    size_t n = kernel_list(list);
+    for (size_t i = 0; i < n && i < capacity && variants; i++) {
+        variants[i].kernel = list[i].kernel;
+        variants[i].name = list[i].name;
+        variants[i].in_use = list[i].in_use;
+    }
+    return n;
+}
+
+/* The input through the match finder, searched where a greedy parse
+ * would look; the matches found summed */
+static SevenZipErrorCode kernel_match_finder(int bt_mode, const Byte* data, size_t size,
+                                             uint32_t* check) {
+    if (size > ((size_t)1 << 30)) return SEVENZIP_ERROR_INVALID_PARAM;
+    UInt32 history = size < KERNEL_MF_MAX_HISTORY ? (UInt32)size : KERNEL_MF_MAX_HISTORY;
+    if (history < (1 << 12)) history = 1 << 12;
+
+    CMatchFinder mf;
+    IMatchFinder2 vt;
+    MatchFinder_Construct(&mf);
+    mf.btMode = (Byte)bt_mode;
+    mf.numHashBytes = 4;
+    mf.cutValue = KERNEL_MF_CUT_VALUE;
+    mf.expectedDataSize = size;
+    MatchFinder_SET_DIRECT_INPUT_BUF(&mf, data, size)
+    if (!MatchFinder_Create(&mf, history, 0, KERNEL_MF_NICE_LEN, 0, &g_MemMatchFinderAlloc)) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    MatchFinder_CreateVTable(&mf, &vt);
+    vt.Init(&mf);
+    UInt32 distances[KERNEL_MF_NICE_LEN * 2 + 2];
+    UInt32 sum = 0;
+    while (vt.GetNumAvailableBytes(&mf) != 0) {
+        const UInt32* end = vt.GetMatches(&mf, distances);
+        sum += (UInt32)(end - distances);
+        /* Greedy, as the fast levels parse: the longest match is taken whole */
+        if (end != distances) {
+            UInt32 skip = end[-2] - 1;
+            UInt32 avail = vt.GetNumAvailableBytes(&mf);
+            if (skip > avail) skip = avail;
+            if (skip > 0) vt.Skip(&mf, skip);
+        }
+    }
+    MatchFinder_Free(&mf, &g_MemMatchFinderAlloc);
+    *check = sum;
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_kernel_run(size_t variant, void* data, size_t size, uint32_t* check) {
+    KernelVariant list[SEVENZIP_MAX_KERNEL_VARIANTS];
+    size_t n = kernel_list(list);
+    if (variant >= n || (!data && size > 0)) return SEVENZIP_ERROR_INVALID_PARAM;
+    const KernelVariant* v = &list[variant];
+    uint32_t result = 0;
+
+    switch (v->kernel) {
+        case SEVENZIP_KERNEL_CRC32:
+            result = CRC_GET_DIGEST(v->crc(CRC_INIT_VAL, data, size, g_CrcTable));
+            break;
+        case SEVENZIP_KERNEL_AES_CBC_ENCODE:
+        case SEVENZIP_KERNEL_AES_CBC_DECODE: {
+            if (((uintptr_t)data & 15) != 0 || size % AES_BLOCK_SIZE != 0) {
+                return SEVENZIP_ERROR_INVALID_PARAM;
+            }
+            UInt32* aes = (UInt32*)mem_alloc_aligned(SEVENZIP_MEM_OTHER,
+                                                     AES_NUM_IVMRK_WORDS * sizeof(UInt32), 16);
+            if (!aes) return SEVENZIP_ERROR_MEMORY;
+            Byte key[AES_KEY_SIZE];
+            Byte iv[AES_BLOCK_SIZE];
+            for (unsigned i = 0; i < sizeof(key); i++) key[i] = (Byte)(i * 7 + 1);
+            memset(iv, 0x5A, sizeof(iv));
+            AesCbc_Init(aes, iv);
+            if (v->kernel == SEVENZIP_KERNEL_AES_CBC_ENCODE) Aes_SetKey_Enc(aes + 4, key, AES_KEY_SIZE);
+            else Aes_SetKey_Dec(aes + 4, key, AES_KEY_SIZE);
+            Byte* blocks = (Byte*)data;
+            size_t num_blocks = size / AES_BLOCK_SIZE;
+            /* The VAES decoder loads 32-byte vectors aligned: as cbc_decode()
+             * in encryption_aes.c, a 16-byte aligned buffer has its first
+             * block decoded on its own */
+            if (v->kernel == SEVENZIP_KERNEL_AES_CBC_DECODE && num_blocks > 1 &&
+                ((uintptr_t)blocks & 31) != 0) {
+                v->aes(aes, blocks, 1);
+                blocks += AES_BLOCK_SIZE;
+                num_blocks--;
+            }
+            v->aes(aes, blocks, num_blocks);
+            result = size > 0 ? GetUi32((const Byte*)data + size - 4) : 0;
+            mem_free(aes);
+            break;
+        }
+        case SEVENZIP_KERNEL_SHA256: {
+            CSha256 sha;
+            Byte digest[SHA256_DIGEST_SIZE];
+            Sha256_Init(&sha);
+            Sha256_SetFunction(&sha, v->sha_algo);
+            Sha256_Update(&sha, (const Byte*)data, size);
+            Sha256_Final(&sha, digest);
+            result = GetUi32(digest);
+            break;
+        }
+        default: {
+            SevenZipErrorCode err = kernel_match_finder(v->bt_mode, (const Byte*)data, size, &result);
+            if (err != SEVENZIP_OK) return err;
+            break;
+        }
+    }
+    if (check) *check = result;
+    return SEVENZIP_OK;
+}
@@ -0,0 +1,191 @@
+/**
+ * CRC Checker
+ *
+ * One lock and one condition variable, as in the stream pump. The
+ * checker sums a stretch of the ring with the lock released: the decoder
+ * only writes into free room, and the stretch stays taken until the
+ * checker gives it back.
+ */
+
+#include "crc_checker.h"
+#include "mem_alloc.h"
+#include "thread_placement.h"
+
+#include "7zCrc.h"
+
+#include <pthread.h>
+#include <string.h>
+
+typedef struct {
+    UInt64 end;                   /* Stream offset just past the file */
+    UInt32 file_index;
+    int has_crc;
+    UInt32 expected;
+} CrcMark;
+
+struct CrcChecker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    Byte* data;
+    size_t start;                 /* Oldest unchecked byte */
+    size_t size;                  /* Unchecked bytes held */
+    UInt64 added;                 /* Stream offset of the next byte added */
+    UInt64 checked;               /* Stream offset of the next byte to check */
+    CrcMark marks[CRC_CHECKER_MAX_MARKS];
+    unsigned mark_start;
+    unsigned mark_count;
+    int sum_folder;
+    UInt32 file_crc;              /* Checker thread only */
+    UInt32 folder_crc;            /* Checker thread only */
+    int closing;                  /* Check what is left, then stop */
+    int stop;
+    int done;                     /* The checker has stopped */
+    SRes res;
+    UInt32 failed_file;
+};
+
+static void* checker_thread(void* arg) {
+    CrcChecker* c = (CrcChecker*)arg;
+    thread_sched_enter();
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        /* Files that end here, empty ones included */
+        while (c->mark_count > 0 && c->marks[c->mark_start].end == c->checked) {
+            const CrcMark* m = &c->marks[c->mark_start];
+            if (m->has_crc && CRC_GET_DIGEST(c->file_crc) != m->expected && c->res == SZ_OK) {
+                c->res = SZ_ERROR_CRC;
+                c->failed_file = m->file_index;
+            }
+            c->file_crc = CRC_INIT_VAL;
+            c->mark_start = (c->mark_start + 1) % CRC_CHECKER_MAX_MARKS;
+            c->mark_count--;
+            pthread_cond_broadcast(&c->changed);
+        }
+        if (c->stop || c->res != SZ_OK) break;
+        if (c->size == 0) {
+            if (c->closing) break;
+            pthread_cond_wait(&c->changed, &c->lock);
+            continue;
+        }
+
+        /* Up to the next file end or the end of the ring */
+        size_t n = CRC_CHECKER_RING_SIZE - c->start;
+        if (n > c->size) n = c->size;
+        if (c->mark_count > 0 && c->marks[c->mark_start].end - c->checked < n) {
+            n = (size_t)(c->marks[c->mark_start].end - c->checked);
+        }
+        const Byte* p = c->data + c->start;
+        pthread_mutex_unlock(&c->lock);
+
+        c->file_crc = CrcUpdate(c->file_crc, p, n);
+        if (c->sum_folder) c->folder_crc = CrcUpdate(c->folder_crc, p, n);
+
+        pthread_mutex_lock(&c->lock);
+        c->start = (c->start + n) % CRC_CHECKER_RING_SIZE;
+        c->size -= n;
+        c->checked += n;
+        pthread_cond_broadcast(&c->changed);
+    }
+    c->done = 1;
+    pthread_cond_broadcast(&c->changed);
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+CrcChecker* crc_checker_start(int sum_folder) {
+    CrcChecker* c = (CrcChecker*)mem_alloc(SEVENZIP_MEM_OTHER, sizeof(CrcChecker));
+    if (!c) return NULL;
+    memset(c, 0, sizeof(*c));
+    c->sum_folder = sum_folder;
+    c->file_crc = CRC_INIT_VAL;
+    c->folder_crc = CRC_INIT_VAL;
+    c->data = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, CRC_CHECKER_RING_SIZE);
+    if (!c->data) {
+        mem_free(c);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&c->lock, NULL) != 0) {
+        mem_free(c->data);
+        mem_free(c);
+        return NULL;
+    }
+    if (pthread_cond_init(&c->changed, NULL) != 0) {
+        pthread_mutex_destroy(&c->lock);
+        mem_free(c->data);
+        mem_free(c);
+        return NULL;
+    }
+    if (pthread_create(&c->thread, NULL, checker_thread, c) != 0) {
+        pthread_cond_destroy(&c->changed);
+        pthread_mutex_destroy(&c->lock);
+        mem_free(c->data);
+        mem_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+SRes crc_checker_add(CrcChecker* c, const Byte* data, size_t size) {
+    pthread_mutex_lock(&c->lock);
+    while (size > 0 && !c->done) {
+        while (c->size == CRC_CHECKER_RING_SIZE && !c->done) {
+            pthread_cond_wait(&c->changed, &c->lock);
+        }
+        if (c->done) break;
+        size_t room = CRC_CHECKER_RING_SIZE - c->size;
+        size_t put = size < room ? size : room;
+        size_t end = (c->start + c->size) % CRC_CHECKER_RING_SIZE;
+        size_t first = CRC_CHECKER_RING_SIZE - end;
+        if (first > put) first = put;
+        memcpy(c->data + end, data, first);
+        memcpy(c->data, data + first, put - first);
+        c->size += put;
+        c->added += put;
+        data += put;
+        size -= put;
+        pthread_cond_broadcast(&c->changed);
+    }
+    SRes res = c->res;
+    pthread_mutex_unlock(&c->lock);
+    return res;
+}
+
+SRes crc_checker_end_file(CrcChecker* c, UInt32 file_index, int has_crc, UInt32 expected) {
+    pthread_mutex_lock(&c->lock);
+    while (c->mark_count == CRC_CHECKER_MAX_MARKS && !c->done) {
+        pthread_cond_wait(&c->changed, &c->lock);
+    }
+    if (!c->done) {
+        CrcMark* m = &c->marks[(c->mark_start + c->mark_count) % CRC_CHECKER_MAX_MARKS];
+        m->end = c->added;
+        m->file_index = file_index;
+        m->has_crc = has_crc;
+        m->expected = expected;
+        c->mark_count++;
+        pthread_cond_broadcast(&c->changed);
+    }
+    SRes res = c->res;
+    pthread_mutex_unlock(&c->lock);
+    return res;
+}
+
+SRes crc_checker_end(CrcChecker* c, int drain, UInt32* folder_crc, UInt32* failed_file) {
+    pthread_mutex_lock(&c->lock);
+    if (drain) c->closing = 1;
+    else c->stop = 1;
+    pthread_cond_broadcast(&c->changed);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    SRes res = c->res;
+    if (folder_crc) *folder_crc = CRC_GET_DIGEST(c->folder_crc);
+    if (failed_file) *failed_file = c->failed_file;
+    pthread_cond_destroy(&c->changed);
+    pthread_mutex_destroy(&c->lock);
+    mem_free(c->data);
+    mem_free(c);
+    return res;
+}
@@ -0,0 +1,56 @@
+/**
+ * CRC Checker - Internal Header
+ *
+ * Checks the file and folder CRCs of decoded data on a helper thread.
+ * The decoder copies each piece of output into a ring and goes on; the
+ * checker runs CrcUpdate() (the hardware CRC where CpuArch.c found one)
+ * over the ring behind it and compares each file's CRC when the file's
+ * end mark comes round. The decoder only waits when the ring or the mark
+ * queue is full, that is when checking falls a whole ring behind.
+ *
+ *     decoder:  crc_checker_add() / crc_checker_end_file()  -> ring, marks
+ *     checker:  CrcUpdate() over the ring, compare at each mark
+ */
+
+#ifndef SEVENZIP_CRC_CHECKER_H
+#define SEVENZIP_CRC_CHECKER_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Decoded bytes the checker may fall behind by */
+#define CRC_CHECKER_RING_SIZE (4 << 20)
+
+/* File ends queued ahead of the checker */
+#define CRC_CHECKER_MAX_MARKS 1024
+
+typedef struct CrcChecker CrcChecker;
+
+/* Start a checker, also summing the folder CRC when `sum_folder`; NULL when
+ * the ring or the thread cannot be had (check on the calling thread then) */
+CrcChecker* crc_checker_start(int sum_folder);
+
+/* Data of the current file; SZ_ERROR_CRC once an earlier file failed */
+SRes crc_checker_add(CrcChecker* checker, const Byte* data, size_t size);
+
+/* The current file ends after the data added so far; compare its CRC with
+ * `expected` when `has_crc`. SZ_ERROR_CRC once an earlier file failed. */
+SRes crc_checker_end_file(CrcChecker* checker, UInt32 file_index, int has_crc, UInt32 expected);
+
+/*
+ * Stop the checker and free it. With `drain` everything added is checked
+ * first and `*folder_crc` gets the digest of it (when summed); without,
+ * the checker stops where it is. Returns SZ_ERROR_CRC with `*failed_file`
+ * set if a file failed, else SZ_OK.
+ */
+SRes crc_checker_end(CrcChecker* checker, int drain, UInt32* folder_crc, UInt32* failed_file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_CRC_CHECKER_H */
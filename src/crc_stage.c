@@ -0,0 +1,171 @@
+/**
+ * CRC Stage
+ *
+ * One helper thread fed through a ring of entries guarded by two
+ * semaphores, like the solid prefetch ring. CrcUpdate() dispatches to the
+ * hardware CRC paths of 7zCrcOpt.c, so the thread keeps up with memory
+ * bandwidth while the encoder threads compress; manifest digests take the
+ * SHA-NI / ARMv8 paths of Sha256Opt.c or the AVX2 / SSE2 loop of xxh3.c.
+ */
+
+#include "crc_stage.h"
+#include "7zCrc.h"
+#include "thread_placement.h"
+
+#include <string.h>
+
+enum {
+    CRC_ENTRY_BEGIN,
+    CRC_ENTRY_DATA,
+    CRC_ENTRY_END,
+    CRC_ENTRY_SYNC
+};
+
+static THREAD_FUNC_DECL CrcStage_Thread(void* arg) {
+    CrcStage* s = (CrcStage*)arg;
+    thread_sched_enter();
+
+    for (;;) {
+        Semaphore_Wait(&s->filled_slots);
+        if (s->stop) break;
+
+        CrcStageEntry* e = &s->entries[s->head];
+        int kind = e->kind;
+        switch (kind) {
+            case CRC_ENTRY_BEGIN:
+                s->crc = CRC_INIT_VAL;
+                s->hints = e->hints;
+                s->hint_pos = 0;
+                s->slot = e->slot;
+                if (s->slot) file_digest_init(&s->file_digest, s->slot->algorithm);
+                break;
+            case CRC_ENTRY_DATA:
+                s->crc = CrcUpdate(s->crc, e->data, e->size);
+                if (s->slot) file_digest_update(&s->file_digest, e->data, e->size);
+                if (s->hints) {
+                    s->hint_pos += e->size;
+                    read_hints_advance(s->hints, s->hint_pos);
+                }
+                break;
+            case CRC_ENTRY_END:
+                *e->digest = CRC_GET_DIGEST(s->crc);
+                if (s->slot) file_digest_final(&s->file_digest, s->slot);
+                s->hints = NULL;
+                s->slot = NULL;
+                break;
+            default:
+                break;
+        }
+        s->head = (s->head + 1) % CRC_STAGE_SLOTS;
+        Semaphore_Release1(&s->free_slots);
+        if (kind == CRC_ENTRY_SYNC) {
+            Semaphore_Release1(&s->synced);
+        }
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+static void crc_stage_close_handles(CrcStage* s) {
+    if (Semaphore_IsCreated(&s->free_slots)) Semaphore_Close(&s->free_slots);
+    if (Semaphore_IsCreated(&s->filled_slots)) Semaphore_Close(&s->filled_slots);
+    if (Semaphore_IsCreated(&s->synced)) Semaphore_Close(&s->synced);
+}
+
+static int crc_stage_start(CrcStage* s) {
+    if (Thread_WasCreated(&s->thread)) return 1;
+    if (s->failed) return 0;
+
+    /* +1 on filled_slots max leaves room for the shutdown wake-up */
+    if (Semaphore_Create(&s->free_slots, CRC_STAGE_SLOTS, CRC_STAGE_SLOTS) != 0 ||
+        Semaphore_Create(&s->filled_slots, 0, CRC_STAGE_SLOTS + 1) != 0 ||
+        Semaphore_Create(&s->synced, 0, 1) != 0 ||
+        Thread_Create(&s->thread, CrcStage_Thread, s) != 0) {
+        crc_stage_close_handles(s);
+        s->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static void crc_stage_push(CrcStage* s, int kind, const void* data, size_t size,
+                           uint32_t* digest, ReadHints* hints, FileDigestSlot* slot) {
+    Semaphore_Wait(&s->free_slots);
+    CrcStageEntry* e = &s->entries[s->tail];
+    e->kind = kind;
+    e->data = (const Byte*)data;
+    e->size = size;
+    e->digest = digest;
+    e->hints = hints;
+    e->slot = slot;
+    s->tail = (s->tail + 1) % CRC_STAGE_SLOTS;
+    Semaphore_Release1(&s->filled_slots);
+}
+
+void crc_stage_init(CrcStage* stage) {
+    memset(stage, 0, sizeof(*stage));
+    Thread_CONSTRUCT(&stage->thread)
+    Semaphore_Construct(&stage->free_slots);
+    Semaphore_Construct(&stage->filled_slots);
+    Semaphore_Construct(&stage->synced);
+}
+
+void crc_stage_begin(CrcStage* stage, uint64_t size, ReadHints* hints) {
+    crc_stage_begin_digest(stage, size, hints, NULL);
+}
+
+void crc_stage_begin_digest(CrcStage* stage, uint64_t size, ReadHints* hints, FileDigestSlot* slot) {
+    stage->async = size >= CRC_STAGE_MIN_SIZE && crc_stage_start(stage);
+    if (stage->async) {
+        crc_stage_push(stage, CRC_ENTRY_BEGIN, NULL, 0, NULL, hints, slot);
+    } else {
+        stage->inline_crc = CRC_INIT_VAL;
+        stage->inline_hints = hints;
+        stage->inline_pos = 0;
+        stage->inline_slot = slot;
+        if (slot) file_digest_init(&stage->inline_digest, slot->algorithm);
+    }
+}
+
+void crc_stage_update(CrcStage* stage, const void* data, size_t size) {
+    if (size == 0) return;
+    if (stage->async) {
+        crc_stage_push(stage, CRC_ENTRY_DATA, data, size, NULL, NULL, NULL);
+        return;
+    }
+    stage->inline_crc = CrcUpdate(stage->inline_crc, data, size);
+    if (stage->inline_slot) file_digest_update(&stage->inline_digest, data, size);
+    if (stage->inline_hints) {
+        stage->inline_pos += size;
+        read_hints_advance(stage->inline_hints, stage->inline_pos);
+    }
+}
+
+void crc_stage_end(CrcStage* stage, uint32_t* digest) {
+    if (stage->async) {
+        crc_stage_push(stage, CRC_ENTRY_END, NULL, 0, digest, NULL, NULL);
+        stage->async = 0;
+        return;
+    }
+    *digest = CRC_GET_DIGEST(stage->inline_crc);
+    if (stage->inline_slot) file_digest_final(&stage->inline_digest, stage->inline_slot);
+    stage->inline_hints = NULL;
+    stage->inline_slot = NULL;
+}
+
+void crc_stage_sync(CrcStage* stage) {
+    if (!Thread_WasCreated(&stage->thread)) return;
+    crc_stage_push(stage, CRC_ENTRY_SYNC, NULL, 0, NULL, NULL, NULL);
+    Semaphore_Wait(&stage->synced);
+}
+
+void crc_stage_destroy(CrcStage* stage) {
+    if (Thread_WasCreated(&stage->thread)) {
+        /* Ranges may belong to buffers about to be freed: finish them first */
+        crc_stage_sync(stage);
+        stage->stop = 1;
+        Semaphore_Release1(&stage->filled_slots);
+        Thread_Wait_Close(&stage->thread);
+    }
+    crc_stage_close_handles(stage);
+    crc_stage_init(stage);
+}
@@ -0,0 +1,108 @@
+/**
+ * CRC Stage - Internal Header
+ *
+ * Per-file CRC32, and the manifest digest where asked for, computed on a helper
+ * thread instead of inside the encoder's read callback, which is then
+ * left with a memcpy. The caller
+ * submits byte ranges in file order; each range must stay valid and
+ * unmodified until crc_stage_sync() returns (a mapping, or a staging
+ * buffer that is only refilled after a sync). Files smaller than
+ * CRC_STAGE_MIN_SIZE, and every file when the thread cannot be started,
+ * are checksummed inline on the caller's thread.
+ */
+
+#ifndef SEVENZIP_CRC_STAGE_H
+#define SEVENZIP_CRC_STAGE_H
+
+#include "../include/7z_ffi.h"
+#include "read_hints.h"
+#include "7zTypes.h"
+#include "file_digest.h"
+#include "Threads.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Smaller files do not pay for the hand-off to the thread */
+#define CRC_STAGE_MIN_SIZE (1024 * 1024)
+
+/* Queued entries; bounds how far the thread may lag behind the caller */
+#define CRC_STAGE_SLOTS 16
+
+/* Suggested size of a staging buffer in front of a FILE* source */
+#define CRC_STAGE_BUFFER_SIZE (1024 * 1024)
+
+typedef struct {
+    int kind;
+    const Byte* data;
+    size_t size;
+    uint32_t* digest;     /* End of file: where the digest goes */
+    ReadHints* hints;     /* Begin of file: advanced as ranges are done */
+    FileDigestSlot* slot; /* Begin of file: where its manifest digest goes, or NULL */
+} CrcStageEntry;
+
+typedef struct {
+    CrcStageEntry entries[CRC_STAGE_SLOTS];
+    UInt32 head;          /* Next entry to process (thread only) */
+    UInt32 tail;          /* Next entry to fill (caller only) */
+    CSemaphore free_slots;
+    CSemaphore filled_slots;
+    CSemaphore synced;
+    CThread thread;
+    volatile int stop;
+    int failed;           /* Thread could not be started: stay inline */
+    /* Thread side: file in progress */
+    uint32_t crc;
+    ReadHints* hints;
+    uint64_t hint_pos;
+    FileDigest file_digest;
+    FileDigestSlot* slot; /* NULL = CRC only */
+    /* Caller side */
+    int async;            /* Current file goes through the thread */
+    uint32_t inline_crc;
+    ReadHints* inline_hints;
+    uint64_t inline_pos;
+    FileDigest inline_digest;
+    FileDigestSlot* inline_slot;
+} CrcStage;
+
+/* Set up an idle stage; the thread is started by the first large file */
+void crc_stage_init(CrcStage* stage);
+
+/**
+ * Start checksumming a file
+ * @param stage Stage
+ * @param size File size (decides between the thread and inline)
+ * @param hints Read hints to advance once ranges are checksummed (for a
+ *              mapped source, whose pages must stay until then), or NULL
+ */
+void crc_stage_begin(CrcStage* stage, uint64_t size, ReadHints* hints);
+
+/* As crc_stage_begin(), and the file's digest of slot->algorithm is
+ * stored to `slot` (NULL = CRC only) along with its CRC */
+void crc_stage_begin_digest(CrcStage* stage, uint64_t size, ReadHints* hints, FileDigestSlot* slot);
+
+/* Add the next range of the current file */
+void crc_stage_update(CrcStage* stage, const void* data, size_t size);
+
+/**
+ * Finish the current file
+ * The digest is stored to *digest (and the slot's where asked for), at
+ * the latest by the next sync.
+ */
+void crc_stage_end(CrcStage* stage, uint32_t* digest);
+
+/* Wait until every submitted range is checksummed and digests are stored */
+void crc_stage_sync(CrcStage* stage);
+
+/* Stop the thread (after a sync) */
+void crc_stage_destroy(CrcStage* stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_CRC_STAGE_H */
@@ -0,0 +1,69 @@
+/**
+ * Create Engine - Internal Header
+ *
+ * The one pipeline behind the create functions that take
+ * SevenZipStreamOptions: scan, read-ahead, classify (method, filter, stored
+ * formats), encode, 7zAES, volume writer and header, with bounded buffers
+ * between the stages (archive_create_multivolume.c). The public functions
+ * only say what they want in a CreateJob, so a change to a stage reaches all
+ * of them: sevenzip_create_7z_streaming(), sevenzip_create_7z_true_streaming(),
+ * sevenzip_create_multivolume_7z_complete() and sevenzip_create_7z_to_sink().
+ */
+
+#ifndef SEVENZIP_CREATE_ENGINE_H
+#define SEVENZIP_CREATE_ENGINE_H
+
+#include "../include/7z_ffi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where the archive goes */
+typedef enum {
+    CREATE_OUTPUT_FILE,     /* One file, archive_path */
+    CREATE_OUTPUT_VOLUMES,  /* archive_path.001, .002, ... of options.split_size bytes */
+    CREATE_OUTPUT_FIT,      /* VOLUMES, or FILE when the input fits one volume */
+    CREATE_OUTPUT_SINK      /* Volumes to `sink`, one unless options.split_size is set */
+} CreateOutput;
+
+typedef struct {
+    const char* archive_path;    /* Unused for CREATE_OUTPUT_SINK */
+    const char** input_paths;
+    SevenZipCompressionLevel level;
+    SevenZipStreamOptions options;  /* Caller's copy, adjusted per output */
+    CreateOutput output;
+    const SevenZipArchiveSink* sink;
+    SevenZipBytesProgressCallback progress_callback;
+    void* user_data;
+    int chunk_blocks;  /* Solid folders cut into options.chunk_size LZMA2 blocks,
+                          one block thread per thread */
+} CreateJob;
+
+/**
+ * Set up a job; options NULL = sevenzip_stream_options_init() defaults
+ */
+void create_job_init(CreateJob* job, const char* archive_path, const char** input_paths,
+                     SevenZipCompressionLevel level, const SevenZipStreamOptions* options,
+                     CreateOutput output, SevenZipBytesProgressCallback progress_callback,
+                     void* user_data);
+
+/**
+ * Whether a job has something to gather: input_paths, or the
+ * next_input_path / input_list of `options` (NULL = defaults)
+ */
+int create_job_has_inputs(const char** input_paths, const SevenZipStreamOptions* options);
+
+/**
+ * Run a job on threads of the sevenzip_init_with_options() quota
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_INVALID_PARAM for options the output
+ *         cannot take (a checkpoint without volume files, VOLUMES without
+ *         split_size) or no input, or the error of the failing stage
+ */
+SevenZipErrorCode create_engine_run(CreateJob* job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_CREATE_ENGINE_H */
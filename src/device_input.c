@@ -0,0 +1,165 @@
+/**
+ * Device Input
+ *
+ * Reads are positioned (pread, ReadFile with an offset), so the stdio
+ * stream the device was opened as is never read or moved; it only holds
+ * the descriptor. A device that refuses an unbuffered read drops back to
+ * cached reads of the same aligned blocks.
+ */
+
+/* O_DIRECT is only declared with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "device_input.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <winioctl.h>
+    #include <io.h>
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/ioctl.h>
+    #if defined(__linux__)
+        #include <linux/fs.h>
+    #elif defined(__APPLE__)
+        #include <sys/disk.h>
+    #elif defined(__FreeBSD__)
+        #include <sys/disk.h>
+    #endif
+#endif
+
+int device_input_probe(const char* path, uint64_t* size) {
+    *size = 0;
+#ifdef _WIN32
+    /* \\.\PhysicalDriveN, \\.\C: and the like; stat() fails on them */
+    if (strncmp(path, "\\\\.\\", 4) != 0) return 0;
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                           OPEN_EXISTING, 0, NULL);
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    GET_LENGTH_INFORMATION length;
+    DWORD got = 0;
+    int ok = DeviceIoControl(h, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length, sizeof(length),
+                             &got, NULL) != 0;
+    CloseHandle(h);
+    if (!ok || length.Length.QuadPart <= 0) return 0;
+    *size = (uint64_t)length.Length.QuadPart;
+    return 1;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0 || !(S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode))) return 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = 0;
+#if defined(__linux__) && defined(BLKGETSIZE64)
+    uint64_t bytes = 0;
+    ok = ioctl(fd, BLKGETSIZE64, &bytes) == 0;
+    *size = bytes;
+#elif defined(__APPLE__) && defined(DKIOCGETBLOCKCOUNT)
+    uint64_t blocks = 0;
+    uint32_t block_size = 0;
+    ok = ioctl(fd, DKIOCGETBLOCKCOUNT, &blocks) == 0 && ioctl(fd, DKIOCGETBLOCKSIZE, &block_size) == 0;
+    *size = blocks * block_size;
+#elif defined(__FreeBSD__) && defined(DIOCGMEDIASIZE)
+    off_t bytes = 0;
+    ok = ioctl(fd, DIOCGMEDIASIZE, &bytes) == 0;
+    *size = (uint64_t)bytes;
+#endif
+    close(fd);
+    return ok && *size > 0;
+#endif
+}
+
+/* Bypass the page cache for the descriptor; 0 where it cannot be */
+static int device_set_direct(FILE* file, int on) {
+#if defined(_WIN32)
+    (void)file;
+    (void)on;
+    return 0;
+#elif defined(O_DIRECT)
+    int fd = fileno(file);
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return 0;
+    flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(fd, F_SETFL, flags) == 0 && on;
+#elif defined(F_NOCACHE)
+    return fcntl(fileno(file), F_NOCACHE, on) == 0 && on;
+#else
+    (void)file;
+    (void)on;
+    return 0;
+#endif
+}
+
+SRes device_input_begin(DeviceInput* in, FILE* file, uint64_t size, uint64_t offset) {
+    memset(in, 0, sizeof(*in));
+    in->file = file;
+    in->size = size;
+    in->pos = offset;
+    in->next = offset & ~(uint64_t)(DEVICE_READ_ALIGNMENT - 1);
+    in->skip = (size_t)(offset - in->next);
+    in->buffer = (Byte*)mem_alloc_aligned(SEVENZIP_MEM_IO_BUFFERS, DEVICE_READ_SIZE, DEVICE_READ_ALIGNMENT);
+    if (!in->buffer) return SZ_ERROR_MEM;
+    in->direct = device_set_direct(file, 1);
+    return SZ_OK;
+}
+
+/* One aligned read at in->next; bytes read, or -1 on error */
+static int64_t device_read_block(DeviceInput* in) {
+#ifdef _WIN32
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(in->file));
+    OVERLAPPED at;
+    memset(&at, 0, sizeof(at));
+    at.Offset = (DWORD)in->next;
+    at.OffsetHigh = (DWORD)(in->next >> 32);
+    DWORD got = 0;
+    if (!ReadFile(h, in->buffer, DEVICE_READ_SIZE, &got, &at)) {
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    }
+    return (int64_t)got;
+#else
+    for (;;) {
+        ssize_t got = pread(fileno(in->file), in->buffer, DEVICE_READ_SIZE, (off_t)in->next);
+        if (got >= 0) return (int64_t)got;
+        if (errno == EINTR) continue;
+        if (errno == EINVAL && in->direct) {
+            in->direct = device_set_direct(in->file, 0);
+            continue;
+        }
+        return -1;
+    }
+#endif
+}
+
+size_t device_input_read(DeviceInput* in, void* out, size_t size) {
+    if (in->pos >= in->size) return 0;
+    if (in->buf_pos == in->buf_size) {
+        int64_t got = device_read_block(in);
+        if (got <= (int64_t)in->skip) return 0;
+        in->next += (uint64_t)got;
+        in->buf_size = (size_t)got;
+        in->buf_pos = in->skip;
+        in->skip = 0;
+    }
+    size_t n = in->buf_size - in->buf_pos;
+    if (n > size) n = size;
+    if (n > in->size - in->pos) n = (size_t)(in->size - in->pos);
+    memcpy(out, in->buffer + in->buf_pos, n);
+    in->buf_pos += n;
+    in->pos += n;
+    return n;
+}
+
+void device_input_end(DeviceInput* in) {
+    if (in->direct) device_set_direct(in->file, 0);
+    mem_free(in->buffer);
+    in->buffer = NULL;
+}
@@ -0,0 +1,68 @@
+/**
+ * Device Input - Internal Header
+ *
+ * Block and raw devices as archive inputs (/dev/sdb, /dev/rdisk2,
+ * \\.\PhysicalDrive1). stat() gives them no size, so it is asked of the
+ * device (BLKGETSIZE64, DKIOCGETBLOCKCOUNT, DIOCGMEDIASIZE,
+ * IOCTL_DISK_GET_LENGTH_INFO). Their data is read past the page cache
+ * (O_DIRECT, F_NOCACHE) in DEVICE_READ_SIZE reads at aligned offsets into
+ * an aligned buffer, which raw devices require and which streams a disk
+ * at device speed; where the cache cannot be bypassed the same aligned
+ * reads go through it.
+ */
+
+#ifndef SEVENZIP_DEVICE_INPUT_H
+#define SEVENZIP_DEVICE_INPUT_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes per device read, and the alignment of buffer and offsets */
+#define DEVICE_READ_SIZE (4 * 1024 * 1024)
+#define DEVICE_READ_ALIGNMENT 4096
+
+typedef struct {
+    FILE* file;
+    Byte* buffer;         /* DEVICE_READ_SIZE bytes, DEVICE_READ_ALIGNMENT aligned */
+    size_t buf_size;      /* Bytes of the last read */
+    size_t buf_pos;       /* Bytes of it handed out */
+    size_t skip;          /* Bytes of the first read before the start offset */
+    uint64_t next;        /* Aligned offset of the next read */
+    uint64_t pos;         /* Offset of the next byte handed out */
+    uint64_t size;
+    int direct;           /* Reads bypass the page cache */
+} DeviceInput;
+
+/**
+ * Size of the block or raw device at `path`
+ * @return 1 for a device whose size was read, 0 for anything else
+ */
+int device_input_probe(const char* path, uint64_t* size);
+
+/**
+ * Start reading the device open as `file` sequentially from `offset`
+ * @return SZ_OK, or SZ_ERROR_MEM without the buffer
+ */
+SRes device_input_begin(DeviceInput* in, FILE* file, uint64_t size, uint64_t offset);
+
+/**
+ * Up to `size` bytes at the cursor
+ * @return Bytes stored at out (0 at the end of the device or on error)
+ */
+size_t device_input_read(DeviceInput* in, void* out, size_t size);
+
+/* Free the buffer; `file` is left open */
+void device_input_end(DeviceInput* in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_DEVICE_INPUT_H */
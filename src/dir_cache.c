@@ -0,0 +1,289 @@
+/**
+ * Directory Creation Cache
+ *
+ * A string hash set kept at most half full. mkdir runs outside the lock;
+ * two threads creating the same directory both see success or EEXIST and
+ * the second insert finds the first, closing the descriptor it opened.
+ * Descriptors are only closed when the cache is freed, so one handed out
+ * stays valid while other threads insert.
+ */
+
+#include "dir_cache.h"
+#include "mem_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #define MKDIR(path) _mkdir(path)
+    #define IS_SEPARATOR(c) ((c) == '/' || (c) == '\\')
+#else
+    #include <sys/types.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #define MKDIR(path) mkdir(path, 0755)
+    #define IS_SEPARATOR(c) ((c) == '/')
+    #define DIR_OPEN_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+    #define FILE_OPEN_FLAGS (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC)
+#endif
+
+static uint32_t path_hash(const char* s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (Byte)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Caller holds the lock */
+static DirCacheSlot* find_slot(DirCacheSlot* slots, size_t capacity, const char* path) {
+    size_t mask = capacity - 1;
+    size_t i = path_hash(path) & mask;
+    while (slots[i].path && strcmp(slots[i].path, path) != 0) i = (i + 1) & mask;
+    return &slots[i];
+}
+
+/* Whether `path` is cached, and its descriptor (-1 if none) */
+static int cache_lookup(DirCache* cache, const char* path, int* fd) {
+    *fd = -1;
+    if (!cache->has_lock) return 0;
+    CriticalSection_Enter(&cache->lock);
+    DirCacheSlot* slot = cache->capacity > 0 ? find_slot(cache->slots, cache->capacity, path) : NULL;
+    int hit = slot && slot->path;
+    if (hit) *fd = slot->fd;
+    CriticalSection_Leave(&cache->lock);
+    return hit;
+}
+
+/* Caller holds the lock; on failure the table stays as it was */
+static int grow(DirCache* cache) {
+    size_t capacity = cache->capacity ? cache->capacity * 2 : 256;
+    DirCacheSlot* slots = (DirCacheSlot*)mem_calloc(SEVENZIP_MEM_OTHER, capacity, sizeof(DirCacheSlot));
+    if (!slots) return 0;
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->slots[i].path) *find_slot(slots, capacity, cache->slots[i].path) = cache->slots[i];
+    }
+    mem_free(cache->slots);
+    cache->slots = slots;
+    cache->capacity = capacity;
+    return 1;
+}
+
+#ifndef _WIN32
+/* Whether another directory may still be kept open */
+static int fd_room(DirCache* cache) {
+    if (!cache->has_lock) return 0;
+    CriticalSection_Enter(&cache->lock);
+    int room = cache->open_fds < DIR_CACHE_MAX_FDS;
+    CriticalSection_Leave(&cache->lock);
+    return room;
+}
+#endif
+
+/*
+ * Remember `path` with `fd` (-1 = none), which the cache takes over
+ * @return The descriptor now cached for `path`: `fd`, that of an earlier
+ *         insert, or -1 (`fd` closed) past the limit or out of memory,
+ *         which only costs lookups by path
+ */
+static int cache_insert(DirCache* cache, const char* path, int fd) {
+    int cached = -1;
+    if (cache->has_lock) {
+        CriticalSection_Enter(&cache->lock);
+        if ((cache->count + 1) * 2 <= cache->capacity || grow(cache)) {
+            DirCacheSlot* slot = find_slot(cache->slots, cache->capacity, path);
+            if (slot->path) {
+                cached = slot->fd;
+            } else if ((slot->path = mem_strdup(SEVENZIP_MEM_NAMES, path)) != NULL) {
+                cache->count++;
+                if (fd >= 0 && cache->open_fds < DIR_CACHE_MAX_FDS) {
+                    slot->fd = fd;
+                    cache->open_fds++;
+                    cached = fd;
+                } else {
+                    slot->fd = -1;
+                }
+            }
+        }
+        CriticalSection_Leave(&cache->lock);
+    }
+#ifndef _WIN32
+    if (fd >= 0 && cached != fd) close(fd);
+#endif
+    return cached;
+}
+
+/*
+ * mkdir each level of path[0, len) from `start` down; levels above start
+ * are known to exist, the one just above open as `parent_fd` (or -1). A
+ * failing intermediate level (e.g. an existing ancestor the process may
+ * not write to) is not fatal: the outcome is that of the last level,
+ * whose descriptor goes to `fd`.
+ */
+static int create_levels(DirCache* cache, char* path, size_t start, size_t len, int parent_fd,
+                         int* fd) {
+    int result = 0;
+    size_t name = start;  /* Start of the level's own name */
+    for (size_t i = start; i <= len; i++) {
+        if (i < len && !IS_SEPARATOR(path[i])) continue;
+        if (i == 0 || IS_SEPARATOR(path[i - 1])) {  /* Root or repeated separator */
+            name = i + 1;
+            continue;
+        }
+        char c = path[i];
+        path[i] = 0;
+#ifdef _WIN32
+        if (i == 2 && path[1] == ':') {  /* Drive */
+            path[i] = c;
+            name = i + 1;
+            continue;
+        }
+        result = (MKDIR(path) == 0 || errno == EEXIST) ? 0 : -1;
+        if (result == 0) cache_insert(cache, path, -1);
+        (void)parent_fd;
+#else
+        int made = parent_fd >= 0 ? mkdirat(parent_fd, path + name, 0755) : MKDIR(path);
+        result = (made == 0 || errno == EEXIST) ? 0 : -1;
+        int level_fd = -1;
+        if (result == 0 && fd_room(cache)) {
+            level_fd = parent_fd >= 0 ? openat(parent_fd, path + name, DIR_OPEN_FLAGS)
+                                      : open(path, DIR_OPEN_FLAGS);
+        }
+        parent_fd = result == 0 ? cache_insert(cache, path, level_fd) : -1;
+#endif
+        path[i] = c;
+        name = i + 1;
+    }
+    *fd = result == 0 ? parent_fd : -1;
+    return result;
+}
+
+/* dir_cache_create(), giving the directory's descriptor (-1 if none) */
+static int create_dir(DirCache* cache, char* path, int* fd) {
+    *fd = -1;
+    size_t len = strlen(path);
+    while (len > 1 && IS_SEPARATOR(path[len - 1])) len--;
+    if (len == 0) return -1;
+
+    char saved = path[len];
+    path[len] = 0;
+    int result = 0;
+    if (!cache_lookup(cache, path, fd)) {
+        /* Deepest cached ancestor */
+        size_t start = 0;
+        int parent_fd = -1;
+        for (size_t i = len; i-- > 1;) {
+            if (!IS_SEPARATOR(path[i])) continue;
+            char c = path[i];
+            path[i] = 0;
+            int hit = cache_lookup(cache, path, &parent_fd);
+            path[i] = c;
+            if (hit) {
+                start = i + 1;
+                break;
+            }
+        }
+        result = create_levels(cache, path, start, len, parent_fd, fd);
+    }
+    path[len] = saved;
+    return result;
+}
+
+void dir_cache_init(DirCache* cache) {
+    memset(cache, 0, sizeof(*cache));
+    cache->has_lock = CriticalSection_Init(&cache->lock) == 0;
+}
+
+void dir_cache_free(DirCache* cache) {
+    for (size_t i = 0; i < cache->capacity; i++) {
+#ifndef _WIN32
+        if (cache->slots[i].path && cache->slots[i].fd >= 0) close(cache->slots[i].fd);
+#endif
+        mem_free(cache->slots[i].path);
+    }
+    mem_free(cache->slots);
+    if (cache->has_lock) CriticalSection_Delete(&cache->lock);
+    memset(cache, 0, sizeof(*cache));
+}
+
+int dir_cache_create(DirCache* cache, char* path) {
+    int fd;
+    return create_dir(cache, path, &fd);
+}
+
+/* Last separator of `path`, NULL for a bare name */
+static char* last_separator(char* path) {
+    char* last = NULL;
+    for (char* p = path; *p; p++) {
+        if (IS_SEPARATOR(*p)) last = p;
+    }
+    return last;
+}
+
+int dir_cache_create_parent(DirCache* cache, char* file_path) {
+    char* last = last_separator(file_path);
+    if (!last || last == file_path) return 0;
+    char c = *last;
+    *last = 0;
+    int result = dir_cache_create(cache, file_path);
+    *last = c;
+    return result;
+}
+
+FILE* dir_cache_fopen(DirCache* cache, char* path) {
+    char* last = last_separator(path);
+    int parent_fd = -1;
+    if (last && last != path) {
+        char c = *last;
+        *last = 0;
+        create_dir(cache, path, &parent_fd);
+        *last = c;
+    }
+#ifdef _WIN32
+    (void)parent_fd;
+    return fopen(path, "wb");
+#else
+    /* Same mode as fopen() */
+    int fd = parent_fd >= 0 ? openat(parent_fd, last + 1, FILE_OPEN_FLAGS, 0666)
+                            : open(path, FILE_OPEN_FLAGS, 0666);
+    if (fd < 0) return NULL;
+    FILE* f = fdopen(fd, "wb");
+    if (!f) close(fd);
+    return f;
+#endif
+}
+
+int dir_cache_fd(DirCache* cache, const char* path) {
+    int fd;
+    cache_lookup(cache, path, &fd);
+    return fd;
+}
+
+int dir_cache_sync(DirCache* cache) {
+    int result = 0;
+#ifndef _WIN32
+    if (cache->has_lock) CriticalSection_Enter(&cache->lock);
+    for (size_t i = 0; i < cache->capacity; i++) {
+        const DirCacheSlot* slot = &cache->slots[i];
+        if (!slot->path) continue;
+        if (slot->fd >= 0) {
+            if (fsync(slot->fd) != 0) result = -1;
+            continue;
+        }
+        /* Ancestors the run did not make may not be ours to open */
+        int fd = open(slot->path, O_RDONLY);
+        if (fd < 0) continue;
+        if (fsync(fd) != 0) result = -1;
+        close(fd);
+    }
+    if (cache->has_lock) CriticalSection_Leave(&cache->lock);
+#else
+    (void)cache;
+#endif
+    return result;
+}
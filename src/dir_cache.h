@@ -0,0 +1,86 @@
+/**
+ * Directory Creation Cache - Internal Header
+ *
+ * Directories created (or found existing) during one extraction run, so
+ * that every directory entry and every file's parent costs at most one
+ * mkdir instead of a stat and mkdir per path component per call. A path
+ * missing from the cache is created level by level below its deepest
+ * cached ancestor; the first path of a run walks down from the root.
+ *
+ * Outside Windows the cache also keeps each directory open, up to
+ * DIR_CACHE_MAX_FDS of them: levels below a cached directory are made
+ * with mkdirat() and files opened with openat() against it, so the
+ * kernel resolves one name per call instead of the whole path again.
+ *
+ * Lookups and inserts are locked, so the writer threads of one run can
+ * share a cache.
+ */
+
+#ifndef SEVENZIP_DIR_CACHE_H
+#define SEVENZIP_DIR_CACHE_H
+
+#include "../include/7z_ffi.h"
+#include "Threads.h"
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Directories kept open per cache; the ones past it are used by path */
+#define DIR_CACHE_MAX_FDS 256
+
+typedef struct {
+    char* path;          /* NULL = empty */
+    int fd;              /* The directory, open, or -1 */
+} DirCacheSlot;
+
+typedef struct {
+    DirCacheSlot* slots; /* Open addressing on FNV-1a */
+    size_t capacity;     /* Power of two, 0 until the first insert */
+    size_t count;
+    size_t open_fds;
+    CCriticalSection lock;
+    int has_lock;        /* 0 if the lock could not be set up: no caching */
+} DirCache;
+
+void dir_cache_init(DirCache* cache);
+void dir_cache_free(DirCache* cache);
+
+/**
+ * Create a directory and any missing parents
+ * `path` is modified during the call and restored before it returns.
+ * @return 0 if the directory exists afterwards, -1 otherwise
+ */
+int dir_cache_create(DirCache* cache, char* path);
+
+/**
+ * Create the directory a file goes into (nothing for a bare file name)
+ * @return 0 if the parent exists afterwards, -1 otherwise
+ */
+int dir_cache_create_parent(DirCache* cache, char* file_path);
+
+/**
+ * Create the directory a file goes into and open the file for writing,
+ * truncated, relative to the directory's descriptor when it is open
+ * `path` is modified during the call and restored before it returns.
+ * @return The file, or NULL
+ */
+FILE* dir_cache_fopen(DirCache* cache, char* path);
+
+/* Descriptor the cache holds for directory `path`, -1 if none (owned by the cache) */
+int dir_cache_fd(DirCache* cache, const char* path);
+
+/**
+ * fsync every directory of the run, so the names of the files and
+ * directories made in them are on disk (a no-op on Windows)
+ * @return 0 if all that could be opened were synced, -1 otherwise
+ */
+int dir_cache_sync(DirCache* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_DIR_CACHE_H */
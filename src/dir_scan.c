@@ -0,0 +1,524 @@
+/**
+ * Directory Scanner
+ *
+ * The calling thread lists the root itself; when it has subdirectories,
+ * worker threads take them from a shared stack and list them into tree
+ * nodes, pushing the subdirectories they find in turn. Meanwhile the
+ * calling thread walks the tree depth-first and waits only for the next
+ * directory it needs, so entries come out in the same order as a
+ * sequential walk while later directories are still being read.
+ *
+ * On POSIX each directory is opened once and its entries are examined
+ * with fstatat() relative to it; d_type skips the stat for special files
+ * and, when directory metadata is not wanted, for subdirectories.
+ *
+ * With a filter, each entry's archive name is tested as it is read, before
+ * its stat: an excluded entry is never stat'ed, and an excluded directory
+ * gets no node, so nothing below it is opened. Files outside the include
+ * patterns are dropped the same way; directories outside them are still
+ * listed, for files below them that match, but not reported.
+ */
+
+#include "dir_scan.h"
+#include "Threads.h"
+#include "mem_alloc.h"
+#include "name_filter.h"
+#include "thread_placement.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #define PATH_SEP '\\'
+#else
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <unistd.h>
+    #define PATH_SEP '/'
+    #ifndef O_DIRECTORY
+        #define O_DIRECTORY 0
+    #endif
+    #ifndef O_CLOEXEC
+        #define O_CLOEXEC 0
+    #endif
+#endif
+
+/* Upper bound of queued directories counted by the work semaphore */
+#define DIR_SCAN_MAX_QUEUED ((UInt32)1 << 30)
+
+typedef struct DirScanNode DirScanNode;
+
+/* One entry of a listed directory */
+typedef struct {
+    char* name;           /* Entry name within the directory */
+    uint64_t size;
+    uint64_t mtime;
+    uint32_t attrib;
+    uint64_t inode;
+    uint64_t dev;
+    int hard_linked;
+    int read_only;
+    int sparse;
+    int is_dir;
+    int hidden;           /* A directory listed only for what is below it */
+    DirScanNode* child;   /* Listing of a subdirectory, NULL once emitted */
+} DirScanItem;
+
+/* A directory waiting to be listed, being listed or listed */
+struct DirScanNode {
+    char* path;           /* Filesystem path */
+    char* archive;        /* Archive name, kept only when filtering */
+    DirScanItem* items;
+    size_t count;
+    size_t capacity;
+    SevenZipErrorCode result;
+    int done;             /* Listing finished (guarded by the scanner lock) */
+    DirScanNode* next;    /* Work stack link */
+};
+
+typedef struct {
+    int flags;
+    const NameFilter* filter;
+    int threaded;             /* 0 = nodes are listed inline when emitted */
+    int stop;
+    CCriticalSection lock;
+    CSemaphore work;          /* One count per queued node, plus stop wake-ups */
+    CAutoResetEvent listed;   /* Set whenever a node finishes listing */
+    DirScanNode* stack;
+} DirScanner;
+
+/* Growable string the emitter builds paths and names in */
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} DirScanBuffer;
+
+static int buffer_join(DirScanBuffer* buf, size_t base_len, char sep, const char* str) {
+    size_t add = strlen(str);
+    size_t need = base_len + 1 + add + 1;
+    if (need > buf->capacity) {
+        size_t cap = buf->capacity ? buf->capacity : 256;
+        while (cap < need) cap *= 2;
+        char* data = (char*)mem_realloc(SEVENZIP_MEM_NAMES, buf->data, cap);
+        if (!data) return 0;
+        buf->data = data;
+        buf->capacity = cap;
+    }
+    buf->len = base_len;
+    if (base_len > 0) buf->data[buf->len++] = sep;
+    memcpy(buf->data + buf->len, str, add + 1);
+    buf->len += add;
+    return 1;
+}
+
+static DirScanNode* node_create(const char* parent, const char* name, const char* archive) {
+    DirScanNode* node = (DirScanNode*)mem_calloc(SEVENZIP_MEM_OTHER, 1, sizeof(DirScanNode));
+    if (!node) return NULL;
+    if (archive) {
+        node->archive = mem_strdup(SEVENZIP_MEM_NAMES, archive);
+        if (!node->archive) {
+            mem_free(node);
+            return NULL;
+        }
+    }
+
+    size_t parent_len = strlen(parent);
+    size_t name_len = name ? strlen(name) : 0;
+    node->path = (char*)mem_alloc(SEVENZIP_MEM_NAMES, parent_len + 1 + name_len + 1);
+    if (!node->path) {
+        mem_free(node->archive);
+        mem_free(node);
+        return NULL;
+    }
+    memcpy(node->path, parent, parent_len);
+    if (name) {
+        node->path[parent_len] = PATH_SEP;
+        memcpy(node->path + parent_len + 1, name, name_len + 1);
+    } else {
+        node->path[parent_len] = '\0';
+    }
+    return node;
+}
+
+static void node_free(DirScanNode* node) {
+    if (!node) return;
+    for (size_t i = 0; i < node->count; i++) {
+        mem_free(node->items[i].name);
+        node_free(node->items[i].child);
+    }
+    mem_free(node->items);
+    mem_free(node->path);
+    mem_free(node->archive);
+    mem_free(node);
+}
+
+/* Append an entry; directories get a child node for their own listing,
+ * named `archive` in the archive when filtering */
+static SevenZipErrorCode node_add(DirScanNode* node, const char* name, const char* archive,
+                                  const DirScanItem* meta) {
+    if (node->count >= node->capacity) {
+        size_t cap = node->capacity ? node->capacity * 2 : 16;
+        DirScanItem* items = (DirScanItem*)mem_realloc(SEVENZIP_MEM_OTHER, node->items,
+                                                      cap * sizeof(DirScanItem));
+        if (!items) return SEVENZIP_ERROR_MEMORY;
+        node->items = items;
+        node->capacity = cap;
+    }
+
+    DirScanItem* item = &node->items[node->count];
+    *item = *meta;
+    item->child = NULL;
+    item->name = mem_strdup(SEVENZIP_MEM_NAMES, name);
+    if (!item->name) return SEVENZIP_ERROR_MEMORY;
+    if (item->is_dir) {
+        item->child = node_create(node->path, name, archive);
+        if (!item->child) {
+            mem_free(item->name);
+            return SEVENZIP_ERROR_MEMORY;
+        }
+    }
+    node->count++;
+    return SEVENZIP_OK;
+}
+
+/* Helper: Archive name of entry `name` of `node` into `buf`; 0 without memory */
+static int archive_name(DirScanBuffer* buf, const DirScanNode* node, const char* name) {
+    return buffer_join(buf, 0, '/', node->archive) && buffer_join(buf, buf->len, '/', name);
+}
+
+#ifdef _WIN32
+static SevenZipErrorCode list_directory(DirScanNode* node, int flags, const NameFilter* filter) {
+    DirScanBuffer pattern = { NULL, 0, 0 };
+    if (!buffer_join(&pattern, 0, '\\', node->path) ||
+        !buffer_join(&pattern, pattern.len, '\\', "*")) {
+        mem_free(pattern.data);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    WIN32_FIND_DATAA fd;
+    HANDLE hFind = FindFirstFileA(pattern.data, &fd);
+    mem_free(pattern.data);
+    if (hFind == INVALID_HANDLE_VALUE) return SEVENZIP_ERROR_OPEN_FILE;
+
+    DirScanBuffer archive = { NULL, 0, 0 };
+    SevenZipErrorCode result = SEVENZIP_OK;
+    do {
+        if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+        int included = 1;
+        if (filter) {
+            if (!archive_name(&archive, node, fd.cFileName)) {
+                result = SEVENZIP_ERROR_MEMORY;
+                break;
+            }
+            if (name_filter_excludes(filter, archive.data)) continue;
+            included = name_filter_includes(filter, archive.data);
+            if (!included && !(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) continue;
+        }
+
+        /* FindFirstFile already returns the metadata: no stat per entry */
+        DirScanItem meta;
+        memset(&meta, 0, sizeof(meta));
+        meta.is_dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        if (!meta.is_dir) {
+            meta.size = ((uint64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+        }
+        meta.mtime = ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32) |
+                     fd.ftLastWriteTime.dwLowDateTime;
+        meta.attrib = fd.dwFileAttributes;
+        meta.read_only = (fd.dwFileAttributes & FILE_ATTRIBUTE_READONLY) != 0;
+        meta.sparse = (fd.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE) != 0;
+        meta.hidden = !included;
+
+        result = node_add(node, fd.cFileName, filter ? archive.data : NULL, &meta);
+    } while (result == SEVENZIP_OK && FindNextFileA(hFind, &fd));
+
+    FindClose(hFind);
+    mem_free(archive.data);
+    (void)flags;
+    return result;
+}
+#else
+static SevenZipErrorCode list_directory(DirScanNode* node, int flags, const NameFilter* filter) {
+    int fd = open(node->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return SEVENZIP_ERROR_OPEN_FILE;
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+
+    DirScanBuffer archive = { NULL, 0, 0 };
+    SevenZipErrorCode result = SEVENZIP_OK;
+    struct dirent* de;
+    while (result == SEVENZIP_OK && (de = readdir(dir)) != NULL) {
+        const char* name = de->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+        DirScanItem meta;
+        memset(&meta, 0, sizeof(meta));
+        int known = 0;
+#ifdef DT_UNKNOWN
+        switch (de->d_type) {
+            case DT_DIR:
+                meta.is_dir = 1;
+                known = !(flags & DIR_SCAN_DIRS);  /* No metadata wanted */
+                break;
+            case DT_REG:
+            case DT_LNK:
+            case DT_UNKNOWN:
+                break;
+            default:
+                continue;  /* FIFOs, sockets and devices are never archived */
+        }
+#endif
+        /* Filtered by name before the stat; a file outside the includes
+         * is dropped here too when d_type already says it is a file */
+        int included = 1;
+        if (filter) {
+            if (!archive_name(&archive, node, name)) {
+                result = SEVENZIP_ERROR_MEMORY;
+                break;
+            }
+            if (name_filter_excludes(filter, archive.data)) continue;
+            included = name_filter_includes(filter, archive.data);
+#ifdef DT_UNKNOWN
+            if (!included && de->d_type == DT_REG) continue;
+#endif
+        }
+        if (!known) {
+            /* Follows symbolic links, like stat() on the full path */
+            struct stat st;
+            if (fstatat(dirfd(dir), name, &st, 0) != 0) {
+                if (flags & DIR_SCAN_SKIP_ERRORS) continue;
+                result = SEVENZIP_ERROR_OPEN_FILE;
+                break;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                meta.is_dir = 1;
+            } else if (S_ISREG(st.st_mode)) {
+                meta.is_dir = 0;
+                meta.size = (uint64_t)st.st_size;
+                meta.sparse = (uint64_t)st.st_blocks * 512 < meta.size;
+                meta.hard_linked = st.st_nlink > 1;
+            } else {
+                continue;
+            }
+            meta.mtime = (uint64_t)st.st_mtime * 10000000ULL + 116444736000000000ULL;
+            meta.attrib = (uint32_t)st.st_mode;
+            meta.inode = (uint64_t)st.st_ino;
+            meta.dev = (uint64_t)st.st_dev;
+            meta.read_only = !(st.st_mode & S_IWUSR);
+        }
+        if (!included && !meta.is_dir) continue;
+        meta.hidden = !included;
+
+        result = node_add(node, name, filter ? archive.data : NULL, &meta);
+    }
+
+    closedir(dir);
+    mem_free(archive.data);
+    return result;
+}
+#endif
+
+/* Publish a finished listing and queue its subdirectories, first on top */
+static void finish_listing(DirScanner* s, DirScanNode* node, SevenZipErrorCode result) {
+    UInt32 pushed = 0;
+    CriticalSection_Enter(&s->lock);
+    node->result = result;
+    if (result == SEVENZIP_OK) {
+        for (size_t i = node->count; i-- > 0;) {
+            DirScanNode* child = node->items[i].child;
+            if (child) {
+                child->next = s->stack;
+                s->stack = child;
+                pushed++;
+            }
+        }
+    }
+    node->done = 1;
+    CriticalSection_Leave(&s->lock);
+
+    if (pushed) Semaphore_ReleaseN(&s->work, pushed);
+    Event_Set(&s->listed);
+}
+
+static THREAD_FUNC_DECL DirScan_Thread(void* arg) {
+    DirScanner* s = (DirScanner*)arg;
+    thread_sched_enter();
+    for (;;) {
+        Semaphore_Wait(&s->work);
+
+        CriticalSection_Enter(&s->lock);
+        DirScanNode* node = s->stack;
+        if (s->stop || !node) {
+            CriticalSection_Leave(&s->lock);
+            break;
+        }
+        s->stack = node->next;
+        CriticalSection_Leave(&s->lock);
+
+        finish_listing(s, node, list_directory(node, s->flags, s->filter));
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Make sure `node` is listed: by a worker, or inline without workers */
+static void wait_listed(DirScanner* s, DirScanNode* node) {
+    if (!s->threaded) {
+        if (!node->done) {
+            node->result = list_directory(node, s->flags, s->filter);
+            node->done = 1;
+        }
+        return;
+    }
+    for (;;) {
+        CriticalSection_Enter(&s->lock);
+        int done = node->done;
+        CriticalSection_Leave(&s->lock);
+        if (done) return;
+        Event_Wait(&s->listed);
+    }
+}
+
+static SevenZipErrorCode emit_directory(
+    DirScanner* s,
+    DirScanNode* node,
+    DirScanBuffer* path,
+    DirScanBuffer* name,
+    DirScanCallback callback,
+    void* user_data
+) {
+    wait_listed(s, node);
+    if (node->result != SEVENZIP_OK) {
+        return (s->flags & DIR_SCAN_SKIP_ERRORS) ? SEVENZIP_OK : node->result;
+    }
+
+    size_t path_len = path->len;
+    size_t name_len = name->len;
+    for (size_t i = 0; i < node->count; i++) {
+        DirScanItem* item = &node->items[i];
+        if (!buffer_join(path, path_len, PATH_SEP, item->name) ||
+            !buffer_join(name, name_len, '/', item->name)) {
+            return SEVENZIP_ERROR_MEMORY;
+        }
+
+        if (!item->is_dir || ((s->flags & DIR_SCAN_DIRS) && !item->hidden)) {
+            DirScanEntry entry;
+            entry.full_path = path->data;
+            entry.name = name->data;
+            entry.size = item->size;
+            entry.mtime = item->mtime;
+            entry.attrib = item->attrib;
+            entry.inode = item->inode;
+            entry.dev = item->dev;
+            entry.hard_linked = item->hard_linked;
+            entry.read_only = item->read_only;
+            entry.sparse = item->sparse;
+            entry.is_dir = item->is_dir;
+            SevenZipErrorCode res = callback(&entry, user_data);
+            if (res != SEVENZIP_OK) return res;
+        }
+
+        if (item->child) {
+            SevenZipErrorCode res = emit_directory(s, item->child, path, name, callback, user_data);
+            if (res != SEVENZIP_OK) return res;
+            /* Whole subtree emitted: nothing below it is queued any more */
+            node_free(item->child);
+            item->child = NULL;
+        }
+    }
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_scan_directory(
+    const char* dir_path,
+    const char* base_name,
+    int flags,
+    int num_threads,
+    const NameFilter* filter,
+    DirScanCallback callback,
+    void* user_data
+) {
+    if (!dir_path || !callback) return SEVENZIP_ERROR_INVALID_PARAM;
+    if (num_threads <= 0) num_threads = DIR_SCAN_DEFAULT_THREADS;
+
+    DirScanNode* root = node_create(dir_path, NULL, filter ? (base_name ? base_name : "") : NULL);
+    if (!root) return SEVENZIP_ERROR_MEMORY;
+
+    DirScanner s;
+    memset(&s, 0, sizeof(s));
+    s.flags = flags;
+    s.filter = filter;
+
+    /* The root is listed here: flat directories never start a thread */
+    root->result = list_directory(root, flags, filter);
+    root->done = 1;
+
+    size_t subdirs = 0;
+    if (root->result == SEVENZIP_OK) {
+        for (size_t i = 0; i < root->count; i++) {
+            if (root->items[i].child) subdirs++;
+        }
+    }
+
+    CThread threads[DIR_SCAN_DEFAULT_THREADS * 4];
+    int max_threads = (int)(sizeof(threads) / sizeof(threads[0]));
+    int thread_count = 0;
+    if (num_threads > max_threads) num_threads = max_threads;
+
+    Semaphore_Construct(&s.work);
+    Event_Construct(&s.listed);
+    if (num_threads > 1 && subdirs > 0 && CriticalSection_Init(&s.lock) == 0) {
+        if (Semaphore_Create(&s.work, 0, DIR_SCAN_MAX_QUEUED) == 0 &&
+            AutoResetEvent_CreateNotSignaled(&s.listed) == 0) {
+            for (; thread_count < num_threads; thread_count++) {
+                Thread_CONSTRUCT(&threads[thread_count]);
+                if (Thread_Create(&threads[thread_count], DirScan_Thread, &s) != 0) break;
+            }
+        }
+        if (thread_count > 0) {
+            s.threaded = 1;
+            CriticalSection_Enter(&s.lock);
+            root->done = 0;
+            CriticalSection_Leave(&s.lock);
+            finish_listing(&s, root, root->result);
+        } else {
+            if (Semaphore_IsCreated(&s.work)) Semaphore_Close(&s.work);
+            if (Event_IsCreated(&s.listed)) Event_Close(&s.listed);
+            CriticalSection_Delete(&s.lock);
+        }
+    }
+
+    DirScanBuffer path = { NULL, 0, 0 };
+    DirScanBuffer name = { NULL, 0, 0 };
+    SevenZipErrorCode result = SEVENZIP_OK;
+    if (!buffer_join(&path, 0, PATH_SEP, dir_path) ||
+        !buffer_join(&name, 0, '/', base_name ? base_name : "")) {
+        result = SEVENZIP_ERROR_MEMORY;
+    } else {
+        result = emit_directory(&s, root, &path, &name, callback, user_data);
+    }
+
+    if (s.threaded) {
+        /* Wake every worker; queued nodes are dropped with the tree */
+        CriticalSection_Enter(&s.lock);
+        s.stop = 1;
+        CriticalSection_Leave(&s.lock);
+        Semaphore_ReleaseN(&s.work, (UInt32)thread_count);
+        for (int i = 0; i < thread_count; i++) {
+            Thread_Wait_Close(&threads[i]);
+        }
+        Semaphore_Close(&s.work);
+        Event_Close(&s.listed);
+        CriticalSection_Delete(&s.lock);
+    }
+
+    mem_free(path.data);
+    mem_free(name.data);
+    node_free(root);
+    return result;
+}
@@ -0,0 +1,81 @@
+/**
+ * Directory Scanner - Internal Header
+ *
+ * Shared recursive directory walk for the create paths. Subdirectories
+ * are listed by a pool of worker threads, so trees on high-latency
+ * storage are read many directories at a time, while entries are still
+ * handed to the caller one by one, in depth-first readdir order, as soon
+ * as every entry before them is known.
+ */
+
+#ifndef SEVENZIP_DIR_SCAN_H
+#define SEVENZIP_DIR_SCAN_H
+
+#include "../include/7z_ffi.h"
+#include "name_filter.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Report directories as entries, not only the files inside them */
+#define DIR_SCAN_DIRS 0x01
+
+/* Skip entries and subdirectories that cannot be read instead of failing */
+#define DIR_SCAN_SKIP_ERRORS 0x02
+
+/* Directories listed concurrently when the caller passes 0 threads */
+#define DIR_SCAN_DEFAULT_THREADS 8
+
+/* One scanned file or directory; strings are valid during the callback only */
+typedef struct {
+    const char* full_path;  /* Filesystem path */
+    const char* name;       /* Archive name: base name + '/'-separated path */
+    uint64_t size;          /* 0 for directories */
+    uint64_t mtime;         /* FILETIME */
+    uint32_t attrib;        /* st_mode on POSIX, FILE_ATTRIBUTE_* on Windows */
+    uint64_t inode;         /* st_ino on POSIX, 0 on Windows */
+    uint64_t dev;           /* st_dev on POSIX, 0 on Windows */
+    int hard_linked;        /* A file with other names (st_nlink > 1; 0 on Windows) */
+    int read_only;          /* Owner has no write permission */
+    int sparse;             /* Fewer bytes allocated than its size (Windows: marked sparse) */
+    int is_dir;
+} DirScanEntry;
+
+/**
+ * Receives each entry on the calling thread
+ * @return SEVENZIP_OK to continue; any other code stops the scan
+ */
+typedef SevenZipErrorCode (*DirScanCallback)(const DirScanEntry* entry, void* user_data);
+
+/**
+ * Walk everything below `dir_path` (the directory itself is not reported)
+ * Only directories and regular files are reported; symbolic links are
+ * followed.
+ * @param dir_path Directory to scan
+ * @param base_name Archive name prefix for the entries (NULL or "" = none)
+ * @param flags DIR_SCAN_* flags
+ * @param num_threads Listing threads (0 = DIR_SCAN_DEFAULT_THREADS, 1 = inline)
+ * @param filter Patterns tested against archive names before each stat;
+ *               excluded directories are not descended (NULL = all)
+ * @param callback Entry consumer
+ * @param user_data Passed to callback
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_OPEN_FILE for an unreadable entry
+ *         (without DIR_SCAN_SKIP_ERRORS), or the callback's error code
+ */
+SevenZipErrorCode sevenzip_scan_directory(
+    const char* dir_path,
+    const char* base_name,
+    int flags,
+    int num_threads,
+    const NameFilter* filter,
+    DirScanCallback callback,
+    void* user_data
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_DIR_SCAN_H */
@@ -10,6 +10,11 @@
 #include "Aes.h"
 #include "Sha256.h"
 #include "7zCrc.h"
+#include "key_cache.h"
+#include "global_tables.h"
+#include "Threads.h"
+#include "thread_placement.h"
+#include "thread_quota.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -20,9 +25,17 @@
 #define AES_BLOCK_SIZE 16
 #define PBKDF2_ITERATIONS 262144  // 256K iterations (7-Zip default)
 
+// Parallel CBC decryption: segments below this size are not worth a thread
+#define PARALLEL_DECRYPT_MIN_SEGMENT (1 << 20)
+#define PARALLEL_DECRYPT_DEFAULT_THREADS 4
+#define PARALLEL_DECRYPT_MAX_THREADS 64
+
 /**
  * PBKDF2-SHA256 key derivation (simplified version)
  * In production, use a full PBKDF2 implementation
+ *
+ * Keys are served from the process-wide cache of key_cache.c when the same
+ * password, salt and iteration count were derived before.
  */
 static void derive_key_from_password(
     const char* password,
@@ -32,8 +45,16 @@ static void derive_key_from_password(
     uint8_t* key,
     size_t key_len
 ) {
-    CSha256 sha;
     uint8_t hash[SHA256_DIGEST_SIZE];
+    size_t out_len = (key_len < SHA256_DIGEST_SIZE) ? key_len : SHA256_DIGEST_SIZE;
+    
+    if (key_cache_lookup(KEY_CACHE_KDF_PBKDF2, password, salt, salt_len, iterations, hash)) {
+        memcpy(key, hash, out_len);
+        key_cache_zero(hash, sizeof(hash));
+        return;
+    }
+    
+    CSha256 sha;
     size_t password_len = strlen(password);
     
     // Initialize SHA256
@@ -51,8 +72,49 @@ static void derive_key_from_password(
         Sha256_Final(&sha, hash);
     }
     
+    key_cache_store(KEY_CACHE_KDF_PBKDF2, password, salt, salt_len, iterations, hash);
+    
     // Copy to output key
-    memcpy(key, hash, (key_len < SHA256_DIGEST_SIZE) ? key_len : SHA256_DIGEST_SIZE);
+    memcpy(key, hash, out_len);
+    key_cache_zero(hash, sizeof(hash));
+    key_cache_zero(&sha, sizeof(sha));
+}
+
+/**
+ * CBC-decrypt blocks in place. The VAES path of g_AesCbc_Decode reads
+ * 32-byte vectors with aligned loads, so a buffer that is only 16-byte
+ * aligned gets its first block decoded on its own.
+ */
+static void cbc_decode(uint32_t* ivAes, uint8_t* data, size_t num_blocks) {
+    if (num_blocks > 1 && ((uintptr_t)data & 31) != 0) {
+        g_AesCbc_Decode(ivAes, data, 1);
+        data += AES_BLOCK_SIZE;
+        num_blocks--;
+    }
+    g_AesCbc_Decode(ivAes, data, num_blocks);
+}
+
+/**
+ * Check and remove PKCS#7 padding from decrypted data
+ */
+static SevenZipErrorCode strip_padding(
+    const uint8_t* plaintext,
+    size_t len,
+    size_t* plaintext_len
+) {
+    uint8_t padding_byte = plaintext[len - 1];
+    if (padding_byte > 0 && padding_byte <= AES_BLOCK_SIZE) {
+        // Verify padding
+        for (size_t i = len - padding_byte; i < len; i++) {
+            if (plaintext[i] != padding_byte) {
+                return SEVENZIP_ERROR_EXTRACT; // Invalid padding = wrong password
+            }
+        }
+        *plaintext_len = len - padding_byte;
+    } else {
+        *plaintext_len = len;
+    }
+    return SEVENZIP_OK;
 }
 
 /**
@@ -82,8 +144,7 @@ SevenZipErrorCode sevenzip_init_encryption(
         iv[i] = (uint8_t)(rand() & 0xFF);
     }
     
-    // Initialize AES tables
-    AesGenTables();
+    global_tables_init();
     
     // Set up AES encryption key
     Aes_SetKey_Enc(aes_context, key, AES_KEY_SIZE);
@@ -108,8 +169,7 @@ SevenZipErrorCode sevenzip_init_decryption(
     // Derive decryption key from password
     derive_key_from_password(password, salt, salt_len, PBKDF2_ITERATIONS, key, AES_KEY_SIZE);
     
-    // Initialize AES tables
-    AesGenTables();
+    global_tables_init();
     
     // Set up AES decryption key
     Aes_SetKey_Dec(aes_context, key, AES_KEY_SIZE);
@@ -221,28 +281,221 @@ SevenZipErrorCode sevenzip_decrypt_data(
     
     // Decrypt data in-place using AES-CBC
     size_t num_blocks = ciphertext_len / AES_BLOCK_SIZE;
-    g_AesCbc_Decode(ivAes, plaintext, num_blocks);
+    cbc_decode(ivAes, plaintext, num_blocks);
     
-    // Remove PKCS#7 padding
-    uint8_t padding_byte = plaintext[ciphertext_len - 1];
-    if (padding_byte > 0 && padding_byte <= AES_BLOCK_SIZE) {
-        // Verify padding
-        for (size_t i = ciphertext_len - padding_byte; i < ciphertext_len; i++) {
-            if (plaintext[i] != padding_byte) {
-                free(ivAes);
-                return SEVENZIP_ERROR_EXTRACT; // Invalid padding = wrong password
-            }
+    free(ivAes);
+    
+    return strip_padding(plaintext, ciphertext_len, plaintext_len);
+}
+
+/**
+ * One run of blocks of a parallel decryption, chained from the ciphertext
+ * block before it
+ */
+typedef struct {
+    const uint32_t* aes_context;
+    uint8_t iv[AES_BLOCK_SIZE];
+    const uint8_t* src;
+    uint8_t* dst;
+    size_t num_blocks;
+    int ok;
+    CThread thread;
+} DecryptSegment;
+
+static int decrypt_segment(DecryptSegment* seg) {
+    uint32_t* ivAes = (uint32_t*)aligned_alloc(16, AES_NUM_IVMRK_WORDS * sizeof(uint32_t));
+    if (!ivAes) {
+        return 0;
+    }
+    AesCbc_Init(ivAes, seg->iv);
+    memcpy(ivAes + 4, seg->aes_context, (AES_NUM_IVMRK_WORDS - 4) * sizeof(uint32_t));
+    
+    if (seg->dst != seg->src) {
+        memcpy(seg->dst, seg->src, seg->num_blocks * AES_BLOCK_SIZE);
+    }
+    cbc_decode(ivAes, seg->dst, seg->num_blocks);
+    
+    key_cache_zero(ivAes, AES_NUM_IVMRK_WORDS * sizeof(uint32_t));
+    free(ivAes);
+    return 1;
+}
+
+static THREAD_FUNC_DECL DecryptSegment_Thread(void* arg) {
+    DecryptSegment* seg = (DecryptSegment*)arg;
+    thread_sched_enter();
+    seg->ok = decrypt_segment(seg);
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/**
+ * Decrypt data using AES-256-CBC on several threads
+ *
+ * Block i of CBC decrypts from ciphertext blocks i-1 and i only, so the
+ * buffer is cut into runs whose IV is the last ciphertext block of the
+ * previous run. The IVs are taken before anything is written, which keeps
+ * plaintext == ciphertext (in place) valid.
+ */
+SevenZipErrorCode sevenzip_decrypt_data_parallel(
+    uint32_t* aes_context,
+    const uint8_t* iv,
+    const uint8_t* ciphertext,
+    size_t ciphertext_len,
+    uint8_t* plaintext,
+    size_t* plaintext_len,
+    int num_threads
+) {
+    if (!aes_context || !iv || !ciphertext || !plaintext || !plaintext_len) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    // Ciphertext must be multiple of block size
+    if (ciphertext_len % AES_BLOCK_SIZE != 0 || ciphertext_len == 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    if (*plaintext_len < ciphertext_len) {
+        *plaintext_len = ciphertext_len;
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    
+    if (num_threads <= 0) num_threads = thread_auto_count(PARALLEL_DECRYPT_DEFAULT_THREADS);
+    if (num_threads > PARALLEL_DECRYPT_MAX_THREADS) num_threads = PARALLEL_DECRYPT_MAX_THREADS;
+    size_t count = ciphertext_len / PARALLEL_DECRYPT_MIN_SEGMENT;
+    if (count > (size_t)num_threads) count = (size_t)num_threads;
+    if (count == 0) count = 1;
+    
+    DecryptSegment segments[PARALLEL_DECRYPT_MAX_THREADS];
+    size_t total_blocks = ciphertext_len / AES_BLOCK_SIZE;
+    size_t first = 0;
+    for (size_t i = 0; i < count; i++) {
+        DecryptSegment* seg = &segments[i];
+        size_t end = total_blocks * (i + 1) / count;
+        seg->aes_context = aes_context;
+        memcpy(seg->iv, first == 0 ? iv : ciphertext + (first - 1) * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        seg->src = ciphertext + first * AES_BLOCK_SIZE;
+        seg->dst = plaintext + first * AES_BLOCK_SIZE;
+        seg->num_blocks = end - first;
+        seg->ok = 0;
+        Thread_CONSTRUCT(&seg->thread)
+        first = end;
+    }
+    
+    // The calling thread takes the first run, and any run whose thread failed
+    for (size_t i = 1; i < count; i++) {
+        if (Thread_Create(&segments[i].thread, DecryptSegment_Thread, &segments[i]) != 0) {
+            segments[i].ok = decrypt_segment(&segments[i]);
         }
-        *plaintext_len = ciphertext_len - padding_byte;
+    }
+    segments[0].ok = decrypt_segment(&segments[0]);
+    
+    int ok = segments[0].ok;
+    for (size_t i = 1; i < count; i++) {
+        if (Thread_WasCreated(&segments[i].thread)) {
+            Thread_Wait_Close(&segments[i].thread);
+        }
+        ok = ok && segments[i].ok;
+    }
+    if (!ok) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    
+    return strip_padding(plaintext, ciphertext_len, plaintext_len);
+}
+
+/**
+ * Streaming cipher context. The IV + key schedule array comes first so it
+ * gets the alignment of the allocation (32 bytes, for the VAES path).
+ */
+struct SevenZipCryptContext {
+    uint32_t aes[AES_NUM_IVMRK_WORDS];
+    SevenZipCryptMode mode;
+};
+
+#define CRYPT_CONTEXT_ALIGN 32
+#define CRYPT_CONTEXT_ALLOC_SIZE \
+    ((sizeof(SevenZipCryptContext) + CRYPT_CONTEXT_ALIGN - 1) & ~(size_t)(CRYPT_CONTEXT_ALIGN - 1))
+
+/**
+ * Create a persistent AES-256-CBC context
+ */
+SevenZipErrorCode sevenzip_crypt_create(
+    SevenZipCryptMode mode,
+    const uint8_t* key,
+    const uint8_t* iv,
+    SevenZipCryptContext** ctx
+) {
+    if (!key || !iv || !ctx ||
+        (mode != SEVENZIP_CRYPT_ENCRYPT && mode != SEVENZIP_CRYPT_DECRYPT)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    
+    SevenZipCryptContext* c = (SevenZipCryptContext*)aligned_alloc(
+        CRYPT_CONTEXT_ALIGN, CRYPT_CONTEXT_ALLOC_SIZE);
+    if (!c) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    
+    global_tables_init();
+    c->mode = mode;
+    AesCbc_Init(c->aes, iv);
+    if (mode == SEVENZIP_CRYPT_ENCRYPT) {
+        Aes_SetKey_Enc(c->aes + 4, key, AES_KEY_SIZE);
     } else {
-        *plaintext_len = ciphertext_len;
+        Aes_SetKey_Dec(c->aes + 4, key, AES_KEY_SIZE);
     }
     
-    free(ivAes);
+    *ctx = c;
+    return SEVENZIP_OK;
+}
+
+/**
+ * Encrypt or decrypt whole blocks in place, continuing the CBC chain
+ */
+SevenZipErrorCode sevenzip_crypt_update(
+    SevenZipCryptContext* ctx,
+    uint8_t* buf,
+    size_t len
+) {
+    if (!ctx || (!buf && len > 0) || len % AES_BLOCK_SIZE != 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    if (len == 0) {
+        return SEVENZIP_OK;
+    }
     
+    if (ctx->mode == SEVENZIP_CRYPT_ENCRYPT) {
+        g_AesCbc_Encode(ctx->aes, buf, len / AES_BLOCK_SIZE);
+    } else {
+        cbc_decode(ctx->aes, buf, len / AES_BLOCK_SIZE);
+    }
     return SEVENZIP_OK;
 }
 
+/**
+ * Start a new CBC chain with the same key schedule
+ */
+SevenZipErrorCode sevenzip_crypt_reset(
+    SevenZipCryptContext* ctx,
+    const uint8_t* iv
+) {
+    if (!ctx || !iv) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    AesCbc_Init(ctx->aes, iv);
+    return SEVENZIP_OK;
+}
+
+/**
+ * Zeroize and free a streaming cipher context
+ */
+void sevenzip_crypt_free(SevenZipCryptContext* ctx) {
+    if (!ctx) {
+        return;
+    }
+    key_cache_zero(ctx, sizeof(*ctx));
+    free(ctx);
+}
+
 /**
  * Verify password by attempting to decrypt a test block
  */
@@ -89,6 +89,72 @@ SevenZipErrorCode sevenzip_decrypt_data(
     size_t* plaintext_len
 );
 
+/**
+ * Decrypt data using AES-256-CBC, split across threads
+ * @param aes_context AES context from init_decryption
+ * @param iv Initialization vector (16 bytes)
+ * @param ciphertext Input ciphertext data
+ * @param ciphertext_len Length of ciphertext
+ * @param plaintext Output buffer for plaintext (may be ciphertext itself)
+ * @param plaintext_len In: buffer size, Out: actual plaintext length
+ * @param num_threads Maximum threads (0 = default)
+ * @return SEVENZIP_OK on success, SEVENZIP_ERROR_EXTRACT if wrong password
+ */
+SevenZipErrorCode sevenzip_decrypt_data_parallel(
+    uint32_t* aes_context,
+    const uint8_t* iv,
+    const uint8_t* ciphertext,
+    size_t ciphertext_len,
+    uint8_t* plaintext,
+    size_t* plaintext_len,
+    int num_threads
+);
+
+/**
+ * Create a persistent AES-256-CBC context for in-place chunked processing
+ * @param mode SEVENZIP_CRYPT_ENCRYPT or SEVENZIP_CRYPT_DECRYPT
+ * @param key AES-256 key (32 bytes)
+ * @param iv Initialization vector (16 bytes)
+ * @param ctx Output: new context
+ * @return SEVENZIP_OK on success
+ */
+SevenZipErrorCode sevenzip_crypt_create(
+    SevenZipCryptMode mode,
+    const uint8_t* key,
+    const uint8_t* iv,
+    SevenZipCryptContext** ctx
+);
+
+/**
+ * Process the next whole blocks of the stream in place
+ * @param ctx Context from sevenzip_crypt_create
+ * @param buf Data, overwritten with the result
+ * @param len Length (multiple of 16)
+ * @return SEVENZIP_OK on success
+ */
+SevenZipErrorCode sevenzip_crypt_update(
+    SevenZipCryptContext* ctx,
+    uint8_t* buf,
+    size_t len
+);
+
+/**
+ * Restart the context with a new IV
+ * @param ctx Context from sevenzip_crypt_create
+ * @param iv Initialization vector (16 bytes)
+ * @return SEVENZIP_OK on success
+ */
+SevenZipErrorCode sevenzip_crypt_reset(
+    SevenZipCryptContext* ctx,
+    const uint8_t* iv
+);
+
+/**
+ * Zeroize and free a context
+ * @param ctx Context from sevenzip_crypt_create (NULL is ignored)
+ */
+void sevenzip_crypt_free(SevenZipCryptContext* ctx);
+
 /**
  * Verify password is correct by decrypting test block
  * @param password Password to verify
@@ -0,0 +1,299 @@
+/**
+ * Entropy Estimation
+ *
+ * Decides whether a file or folder is worth running through LZMA2.
+ * Instead of looking only at the first bytes (which for media files are
+ * mostly low-entropy headers), ENTROPY_WINDOWS windows are taken at evenly
+ * spaced interior offsets, skipping the start of the data. The estimate is the mean of the windows'
+ * order-0 entropies in bits per byte; one histogram over all windows would
+ * overstate it whenever windows of different data (text next to zeros next
+ * to video) are mixed.
+ */
+
+#include "entropy_estimate.h"
+#include "archive_filters.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define ENTROPY_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define ENTROPY_USE_NEON 1
+#endif
+
+#ifdef _WIN32
+    #define STAT _stat64
+    #define FSEEK _fseeki64
+#else
+    #define STAT stat
+    #define FSEEK fseeko
+#endif
+
+void entropy_histogram_init(EntropyHistogram* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+/* Four interleaved sub-histograms keep runs of equal bytes from serializing
+ * on one counter; the lanes are then folded into `h` four counters at a time. */
+void entropy_histogram_add(EntropyHistogram* h, const Byte* data, size_t size) {
+    uint32_t lanes[4][256];
+    memset(lanes, 0, sizeof(lanes));
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        lanes[0][(Byte)v]++;
+        lanes[1][(Byte)(v >> 8)]++;
+        lanes[2][(Byte)(v >> 16)]++;
+        lanes[3][(Byte)(v >> 24)]++;
+        lanes[0][(Byte)(v >> 32)]++;
+        lanes[1][(Byte)(v >> 40)]++;
+        lanes[2][(Byte)(v >> 48)]++;
+        lanes[3][(Byte)(v >> 56)]++;
+    }
+    for (; i < size; i++) {
+        lanes[0][data[i]]++;
+    }
+
+    for (unsigned k = 0; k < 256; k += 4) {
+#if defined(ENTROPY_USE_SSE2)
+        __m128i sum = _mm_loadu_si128((const __m128i*)(h->counts + k));
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(lanes[0] + k)));
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(lanes[1] + k)));
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(lanes[2] + k)));
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(lanes[3] + k)));
+        _mm_storeu_si128((__m128i*)(h->counts + k), sum);
+#elif defined(ENTROPY_USE_NEON)
+        uint32x4_t sum = vld1q_u32(h->counts + k);
+        sum = vaddq_u32(sum, vld1q_u32(lanes[0] + k));
+        sum = vaddq_u32(sum, vld1q_u32(lanes[1] + k));
+        sum = vaddq_u32(sum, vld1q_u32(lanes[2] + k));
+        sum = vaddq_u32(sum, vld1q_u32(lanes[3] + k));
+        vst1q_u32(h->counts + k, sum);
+#else
+        for (unsigned j = k; j < k + 4; j++) {
+            h->counts[j] += lanes[0][j] + lanes[1][j] + lanes[2][j] + lanes[3][j];
+        }
+#endif
+    }
+    h->total += size;
+}
+
+/* log2 without libm: integer part from the top set bit, fraction by
+ * repeated squaring of the mantissa (20 bits is far below the noise
+ * of a 64KB sample) */
+static double log2_u64(uint64_t x) {
+    unsigned k = 0;
+    while ((x >> k) > 1) k++;
+
+    double m = (double)x / (double)((uint64_t)1 << k);
+    double result = (double)k;
+    double bit = 0.5;
+    for (int i = 0; i < 20; i++) {
+        m *= m;
+        if (m >= 2.0) {
+            m *= 0.5;
+            result += bit;
+        }
+        bit *= 0.5;
+    }
+    return result;
+}
+
+double entropy_histogram_bits(const EntropyHistogram* h) {
+    if (h->total == 0) return 0.0;
+
+    /* H = log2(n) - (1/n) * sum(c * log2(c)) */
+    double weighted = 0.0;
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t c = h->counts[i];
+        if (c > 1) weighted += (double)c * log2_u64(c);
+    }
+    double bits = log2_u64(h->total) - weighted / (double)h->total;
+    return bits < 0.0 ? 0.0 : bits;
+}
+
+uint64_t entropy_window_offset(uint64_t size, unsigned i) {
+    return (size - ENTROPY_WINDOW_SIZE) / (ENTROPY_WINDOWS + 1) * (i + 1);
+}
+
+int entropy_histogram_add_file_range(EntropyHistogram* h, const char* path,
+                                     uint64_t offset, size_t len) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+
+    Byte window[ENTROPY_WINDOW_SIZE];
+    int ok = FSEEK(f, (int64_t)offset, SEEK_SET) == 0;
+    while (ok && len > 0) {
+        size_t got = fread(window, 1, len < sizeof(window) ? len : sizeof(window), f);
+        if (got == 0) {
+            ok = !ferror(f);
+            break;
+        }
+        entropy_histogram_add(h, window, got);
+        len -= got;
+    }
+    fclose(f);
+    return ok;
+}
+
+void entropy_mean_add(EntropyMean* m, const EntropyHistogram* h) {
+    m->weighted_bits += entropy_histogram_bits(h) * (double)h->total;
+    m->total += h->total;
+}
+
+double entropy_mean_bits(const EntropyMean* m) {
+    return m->total > 0 ? m->weighted_bits / (double)m->total : 0.0;
+}
+
+double sevenzip_entropy_of_buffer(const Byte* data, size_t size) {
+    EntropyMean mean = { 0.0, 0 };
+    EntropyHistogram h;
+
+    if (size <= (size_t)ENTROPY_WINDOWS * ENTROPY_WINDOW_SIZE) {
+        for (size_t pos = 0; pos < size; pos += ENTROPY_WINDOW_SIZE) {
+            entropy_histogram_init(&h);
+            entropy_histogram_add(&h, data + pos,
+                                  size - pos < ENTROPY_WINDOW_SIZE ? size - pos : ENTROPY_WINDOW_SIZE);
+            entropy_mean_add(&mean, &h);
+        }
+    } else {
+        for (unsigned i = 0; i < ENTROPY_WINDOWS; i++) {
+            entropy_histogram_init(&h);
+            entropy_histogram_add(&h, data + entropy_window_offset(size, i), ENTROPY_WINDOW_SIZE);
+            entropy_mean_add(&mean, &h);
+        }
+    }
+    return entropy_mean_bits(&mean);
+}
+
+SevenZipErrorCode sevenzip_entropy_of_file(const char* path, uint64_t size, double* bits_per_byte) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return SEVENZIP_ERROR_OPEN_FILE;
+
+    Byte window[ENTROPY_WINDOW_SIZE];
+    EntropyMean mean = { 0.0, 0 };
+    EntropyHistogram h;
+    int small = size <= (uint64_t)ENTROPY_WINDOWS * ENTROPY_WINDOW_SIZE;
+
+    for (unsigned i = 0; i < ENTROPY_WINDOWS; i++) {
+        if (!small && FSEEK(f, (int64_t)entropy_window_offset(size, i), SEEK_SET) != 0) break;
+        size_t got = fread(window, 1, sizeof(window), f);
+        if (got == 0) break;
+        entropy_histogram_init(&h);
+        entropy_histogram_add(&h, window, got);
+        entropy_mean_add(&mean, &h);
+    }
+
+    int failed = ferror(f);
+    fclose(f);
+    if (failed) return SEVENZIP_ERROR_OPEN_FILE;
+
+    *bits_per_byte = entropy_mean_bits(&mean);
+    return SEVENZIP_OK;
+}
+
+int sevenzip_entropy_is_compressible(double bits_per_byte) {
+    return bits_per_byte < ENTROPY_INCOMPRESSIBLE_BITS;
+}
+
+int sevenzip_ratio_is_worthwhile(uint64_t unpacked, uint64_t packed) {
+    return packed < unpacked - unpacked / RATIO_MIN_SAVING_DIV;
+}
+
+static SRes RatioGuard_Progress(ICompressProgressPtr pp, UInt64 in_size, UInt64 out_size) {
+    RatioGuard* g = Z7_CONTAINER_FROM_VTBL(pp, RatioGuard, vt);
+
+    /* (UInt64)(Int64)-1 = size not known yet */
+    if (g->disarmed) return SZ_OK;
+    if (in_size == (UInt64)(Int64)-1 || out_size == (UInt64)(Int64)-1) return SZ_OK;
+    if (in_size < RATIO_GUARD_MIN_INPUT) return SZ_OK;
+
+    if (!sevenzip_ratio_is_worthwhile(in_size, out_size)) {
+        g->tripped = 1;
+        return SZ_ERROR_PROGRESS;
+    }
+    return SZ_OK;
+}
+
+void RatioGuard_Init(RatioGuard* g) {
+    g->vt.Progress = RatioGuard_Progress;
+    g->tripped = 0;
+    g->disarmed = 0;
+}
+
+SevenZipErrorCode sevenzip_estimate_entropy(const char* path, double* bits_per_byte) {
+    if (!path || !bits_per_byte) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    struct STAT st;
+    if (STAT(path, &st) != 0) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    return sevenzip_entropy_of_file(path, (uint64_t)st.st_size, bits_per_byte);
+}
+
+/* Extensions of formats whose data is compressed already */
+static const char* const k_precompressed_extensions =
+    "jpg,jpeg,png,gif,webp,heic,avif,"
+    "zip,jar,apk,docx,xlsx,pptx,odt,epub,"
+    "gz,tgz,bz2,xz,txz,zst,lz4,7z,rar,"
+    "mp4,m4v,m4a,mov,mkv,webm,mp3,ogg,opus,flac";
+
+/* Magic number at a fixed offset of the file start */
+typedef struct {
+    size_t offset;
+    size_t size;
+    const char* bytes;
+} PrecompressedMagic;
+
+static const PrecompressedMagic k_precompressed_magics[] = {
+    { 0, 3, "\xFF\xD8\xFF" },                      /* JPEG */
+    { 0, 8, "\x89PNG\r\n\x1A\n" },                 /* PNG */
+    { 0, 4, "GIF8" },                                /* GIF */
+    { 8, 4, "WEBP" },                                /* WebP (after "RIFF" and size) */
+    { 0, 4, "PK\x03\x04" },                          /* ZIP, DOCX/XLSX/PPTX, JAR, APK */
+    { 0, 2, "\x1F\x8B" },                            /* gzip */
+    { 0, 3, "BZh" },                                 /* bzip2 */
+    { 0, 6, "\xFD" "7zXZ\x00" },                     /* xz */
+    { 0, 4, "\x28\xB5\x2F\xFD" },                    /* zstd */
+    { 0, 4, "\x04\x22\x4D\x18" },                    /* LZ4 frame */
+    { 0, 6, "7z\xBC\xAF\x27\x1C" },                  /* 7z */
+    { 0, 6, "Rar!\x1A\x07" },                        /* RAR 4 and 5 */
+    { 4, 4, "ftyp" },                                /* ISO BMFF: MP4, MOV, HEIC, AVIF */
+    { 0, 4, "\x1A\x45\xDF\xA3" },                    /* Matroska, WebM */
+    { 0, 3, "ID3" },                                 /* MP3 with ID3v2 tag */
+    { 0, 4, "OggS" },                                /* Ogg */
+    { 0, 4, "fLaC" },                                /* FLAC */
+};
+
+int sevenzip_is_precompressed_magic(const Byte* head, size_t size) {
+    if (!head) return 0;
+    for (size_t i = 0; i < sizeof(k_precompressed_magics) / sizeof(k_precompressed_magics[0]); i++) {
+        const PrecompressedMagic* m = &k_precompressed_magics[i];
+        if (m->offset + m->size <= size && memcmp(head + m->offset, m->bytes, m->size) == 0) {
+            /* WebP is only a RIFF with that form type */
+            if (m->offset == 8 && memcmp(head, "RIFF", 4) != 0) continue;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int sevenzip_is_precompressed_file(const char* path) {
+    if (!path) return 0;
+    if (sevenzip_extension_in_list(path, k_precompressed_extensions)) return 1;
+
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    Byte head[PRECOMPRESSED_MAGIC_SIZE];
+    size_t got = fread(head, 1, sizeof(head), f);
+    fclose(f);
+    return sevenzip_is_precompressed_magic(head, got);
+}
@@ -0,0 +1,148 @@
+/**
+ * Entropy Estimation - Internal Header
+ *
+ * Order-0 entropy of windows sampled across a buffer or file, used for
+ * the store-vs-compress decision on every creation path.
+ */
+
+#ifndef SEVENZIP_ENTROPY_ESTIMATE_H
+#define SEVENZIP_ENTROPY_ESTIMATE_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sampling: ENTROPY_WINDOWS windows of ENTROPY_WINDOW_SIZE bytes at evenly
+ * spaced interior offsets (64KB read in total); smaller inputs are read
+ * whole, one window at a time */
+#define ENTROPY_WINDOWS 8
+#define ENTROPY_WINDOW_SIZE (8 * 1024)
+
+/* Inputs smaller than this are always compressed */
+#define ENTROPY_MIN_CHECK_SIZE (1024 * 1024)
+
+/* At or above this many bits per byte, LZMA2 is not expected to gain anything */
+#define ENTROPY_INCOMPRESSIBLE_BITS 7.8
+
+/* A compressed stream must save at least 1/RATIO_MIN_SAVING_DIV (~1.5%) of
+ * its input to be kept; RatioGuard starts judging after RATIO_GUARD_MIN_INPUT */
+#define RATIO_MIN_SAVING_DIV 64
+#define RATIO_GUARD_MIN_INPUT (4 * 1024 * 1024)
+
+/* Bytes of the file start read by sevenzip_is_precompressed_file() */
+#define PRECOMPRESSED_MAGIC_SIZE 16
+
+/* Byte histogram accumulated over one or more windows */
+typedef struct {
+    uint32_t counts[256];
+    uint64_t total;
+} EntropyHistogram;
+
+/* Byte-weighted mean of per-window entropies */
+typedef struct {
+    double weighted_bits;
+    uint64_t total;
+} EntropyMean;
+
+void entropy_histogram_init(EntropyHistogram* h);
+
+/**
+ * Add `size` bytes to the histogram (vectorized lane merge on SSE2/NEON)
+ */
+void entropy_histogram_add(EntropyHistogram* h, const Byte* data, size_t size);
+
+/**
+ * Shannon entropy of the histogram
+ * @return Bits per byte, 0.0 (constant) to 8.0 (uniform); 0.0 if empty
+ */
+double entropy_histogram_bits(const EntropyHistogram* h);
+
+/**
+ * Add one window's histogram to the mean
+ */
+void entropy_mean_add(EntropyMean* m, const EntropyHistogram* h);
+
+/**
+ * Mean entropy of the windows added so far
+ * @return Bits per byte; 0.0 if no window was added
+ */
+double entropy_mean_bits(const EntropyMean* m);
+
+/**
+ * Start of sample window `i` in data of `size` bytes (> ENTROPY_WINDOWS * ENTROPY_WINDOW_SIZE)
+ * Windows sit at 1/(N+1) ... N/(N+1) of the data, so a header at the
+ * start does not decide the estimate.
+ */
+uint64_t entropy_window_offset(uint64_t size, unsigned i);
+
+/**
+ * Add up to `len` bytes of a file starting at `offset` to the histogram
+ * @return 1 on success, 0 if the file cannot be opened, positioned or read
+ */
+int entropy_histogram_add_file_range(EntropyHistogram* h, const char* path,
+                                     uint64_t offset, size_t len);
+
+/**
+ * Estimate the entropy of an in-memory buffer from sampled windows
+ * @return Mean bits per byte over the windows
+ */
+double sevenzip_entropy_of_buffer(const Byte* data, size_t size);
+
+/**
+ * Estimate the entropy of the first `size` bytes of a file from sampled windows
+ * @param bits_per_byte Output estimate
+ * @return SEVENZIP_OK, or SEVENZIP_ERROR_OPEN_FILE if the file cannot be read
+ */
+SevenZipErrorCode sevenzip_entropy_of_file(const char* path, uint64_t size, double* bits_per_byte);
+
+/**
+ * Decide after compressing whether the packed stream is worth keeping
+ * @return 1 if `packed` saves enough over `unpacked`, 0 to store instead
+ */
+int sevenzip_ratio_is_worthwhile(uint64_t unpacked, uint64_t packed);
+
+/* Progress sink that aborts an encode (SZ_ERROR_PROGRESS) as soon as the
+ * running ratio shows the data is not compressing, so incompressible input
+ * costs only the first RATIO_GUARD_MIN_INPUT bytes of encoder time */
+typedef struct {
+    ICompressProgress vt;
+    int tripped;  /* 1 = the guard stopped the encode */
+    int disarmed; /* 1 = the output is kept whatever the ratio */
+} RatioGuard;
+
+void RatioGuard_Init(RatioGuard* g);
+
+/**
+ * Store-vs-compress decision for an estimate
+ * @return 1 if worth compressing, 0 if the data looks random/already compressed
+ */
+int sevenzip_entropy_is_compressible(double bits_per_byte);
+
+/**
+ * Recognize an already-compressed format from the start of a file
+ * Images (JPEG, PNG, GIF, WebP), archives and compressed streams (ZIP and
+ * its Office/JAR family, gzip, bzip2, xz, zstd, LZ4, 7z, RAR) and media
+ * containers (ISO BMFF/MP4/HEIC, Matroska/WebM, MP3, Ogg, FLAC).
+ * @param head First bytes of the file
+ * @param size Number of bytes in head (up to PRECOMPRESSED_MAGIC_SIZE)
+ * @return 1 if the data is known to be compressed already
+ */
+int sevenzip_is_precompressed_magic(const Byte* head, size_t size);
+
+/**
+ * Classify a file by extension, then by magic bytes, for the Copy codec
+ * Cheaper than sampling the entropy and decisive for small files too.
+ * @return 1 if LZMA2 or PPMd are not expected to gain anything on it
+ */
+int sevenzip_is_precompressed_file(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ENTROPY_ESTIMATE_H */
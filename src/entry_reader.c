@@ -0,0 +1,77 @@
+/**
+ * Archive Entry Reader
+ *
+ * sevenzip_archive_extract_entry() pushes a file into a sink from start
+ * to end in one call. The reader runs that call as a stream pump job
+ * (stream_pump.h) whose sink fills the output ring, and hands the ring out
+ * to the reads; a full ring holds the decoder until the caller catches up.
+ */
+
+#include "../include/7z_ffi.h"
+#include "archive_handle.h"
+#include "mem_alloc.h"
+#include "stream_pump.h"
+
+#include <string.h>
+
+#define ENTRY_READER_RING_SIZE (1 << 20)   // Decoded bytes kept ahead of the reads
+
+struct SevenZipEntryReader {
+    StreamPump* pump;
+    SevenZipArchive* archive;
+    uint32_t entry_index;
+};
+
+static int ring_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    (void)entry_index;
+    return stream_pump_write((StreamPump*)user_data, data, size) ? 0 : 1;
+}
+
+static SevenZipErrorCode entry_job(StreamPump* pump, void* arg) {
+    const SevenZipEntryReader* reader = (const SevenZipEntryReader*)arg;
+    SevenZipExtractSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.write = ring_write;
+    sink.user_data = pump;
+    return sevenzip_archive_extract_entry(reader->archive, reader->entry_index, &sink);
+}
+
+SevenZipErrorCode sevenzip_entry_reader_open(
+    SevenZipArchive* archive,
+    uint32_t entry_index,
+    SevenZipEntryReader** reader
+) {
+    if (!reader) return SEVENZIP_ERROR_INVALID_PARAM;
+    *reader = NULL;
+    if (!archive || entry_index >= archive->db.NumFiles ||
+        SzArEx_IsDir(&archive->db, entry_index)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    SevenZipEntryReader* r = (SevenZipEntryReader*)mem_alloc(SEVENZIP_MEM_OTHER, sizeof(SevenZipEntryReader));
+    if (!r) return SEVENZIP_ERROR_MEMORY;
+    r->archive = archive;
+    r->entry_index = entry_index;
+    r->pump = stream_pump_start(0, ENTRY_READER_RING_SIZE, entry_job, r);
+    if (!r->pump) {
+        mem_free(r);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    *reader = r;
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_entry_reader_read(
+    SevenZipEntryReader* reader,
+    void* buffer,
+    size_t* size
+) {
+    if (!reader || !size || (!buffer && *size)) return SEVENZIP_ERROR_INVALID_PARAM;
+    return stream_pump_exchange(reader->pump, NULL, NULL, buffer, size, 0, NULL);
+}
+
+void sevenzip_entry_reader_close(SevenZipEntryReader* reader) {
+    if (!reader) return;
+    stream_pump_end(reader->pump);
+    mem_free(reader);
+}
@@ -0,0 +1,369 @@
+/**
+ * Entry Writer Pool
+ *
+ * A ring of jobs shared by the submitting decoders and the writer threads;
+ * two semaphores count the free and the filled slots and one lock guards
+ * the ring indices and the error. Jobs are taken in submission order, and
+ * one stop job per writer ends the pool once everything before it is out.
+ */
+
+/* fallocate() is only declared by glibc's <fcntl.h> with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "entry_writer.h"
+#include "sparse_output.h"
+#include "write_hints.h"
+#include "mem_alloc.h"
+#include "thread_placement.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+/* FILETIME of 1970-01-01 UTC */
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+/* Attribute flag of archives that carry a Unix mode in the high 16 bits */
+#define ATTRIB_UNIX_EXTENSION 0x8000
+
+void entry_meta_get(const CSzArEx* db, UInt32 index, EntryMeta* meta) {
+    memset(meta, 0, sizeof(*meta));
+    if (SzBitWithVals_Check(&db->MTime, index)) {
+        meta->has_mtime = 1;
+        meta->mtime = db->MTime.Vals[index].Low |
+                      ((uint64_t)db->MTime.Vals[index].High << 32);
+    }
+    if (SzBitWithVals_Check(&db->Attribs, index)) {
+        meta->has_attrib = 1;
+        meta->attrib = db->Attribs.Vals[index];
+    }
+}
+
+#ifdef _WIN32
+static void apply_meta_handle(HANDLE h, const EntryMeta* meta) {
+    if (meta->has_mtime && h != INVALID_HANDLE_VALUE) {
+        FILETIME ft;
+        ft.dwLowDateTime = (DWORD)meta->mtime;
+        ft.dwHighDateTime = (DWORD)(meta->mtime >> 32);
+        SetFileTime(h, NULL, NULL, &ft);
+    }
+}
+#else
+static void apply_meta_fd(int fd, const EntryMeta* meta) {
+    /* Plain st_mode values (no extension flag or no high bits) are left alone */
+    if (meta->has_attrib && (meta->attrib & ATTRIB_UNIX_EXTENSION) && (meta->attrib >> 16) != 0) {
+        fchmod(fd, (mode_t)((meta->attrib >> 16) & 07777));
+    }
+    if (meta->has_mtime) {
+        int64_t ticks = (int64_t)(meta->mtime - FILETIME_UNIX_EPOCH);
+        int64_t sec = ticks / 10000000;
+        int64_t rem = ticks % 10000000;
+        if (rem < 0) {
+            rem += 10000000;
+            sec--;
+        }
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = (time_t)sec;
+        times[1].tv_nsec = (long)(rem * 100);
+        futimens(fd, times);
+    }
+}
+#endif
+
+static void apply_meta(FILE* file, const EntryMeta* meta) {
+#ifdef _WIN32
+    apply_meta_handle((HANDLE)_get_osfhandle(_fileno(file)), meta);
+#else
+    apply_meta_fd(fileno(file), meta);
+#endif
+}
+
+int entry_meta_apply(FILE* file, const EntryMeta* meta) {
+    int failed = fflush(file) != 0;
+    if (!failed && meta) apply_meta(file, meta);
+    return failed;
+}
+
+int entry_meta_close(FILE* file, const EntryMeta* meta) {
+    int failed = entry_meta_apply(file, meta);
+    if (fclose(file) != 0) failed = 1;
+    return failed;
+}
+
+void entry_meta_batch_init(EntryMetaBatch* batch) {
+    memset(batch, 0, sizeof(*batch));
+}
+
+void entry_meta_batch_add(EntryMetaBatch* batch, const char* path, const EntryMeta* meta) {
+    if (!meta->has_mtime && !meta->has_attrib) return;
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+        EntryMetaDir* grown = (EntryMetaDir*)mem_realloc(SEVENZIP_MEM_OTHER, batch->dirs,
+                                                         capacity * sizeof(EntryMetaDir));
+        if (!grown) return;
+        batch->dirs = grown;
+        batch->capacity = capacity;
+    }
+    char* owned = mem_strdup(SEVENZIP_MEM_NAMES, path);
+    if (!owned) return;
+    batch->dirs[batch->count].path = owned;
+    batch->dirs[batch->count].meta = *meta;
+    batch->count++;
+}
+
+/* A directory's path is longer than any of its ancestors' */
+static int compare_deepest_first(const void* a, const void* b) {
+    size_t la = strlen(((const EntryMetaDir*)a)->path);
+    size_t lb = strlen(((const EntryMetaDir*)b)->path);
+    return la < lb ? 1 : la > lb ? -1 : 0;
+}
+
+void entry_meta_batch_apply(EntryMetaBatch* batch, DirCache* dirs) {
+    if (batch->count > 1) qsort(batch->dirs, batch->count, sizeof(EntryMetaDir), compare_deepest_first);
+    for (size_t i = 0; i < batch->count; i++) {
+        const EntryMetaDir* dir = &batch->dirs[i];
+#ifdef _WIN32
+        (void)dirs;
+        HANDLE h = CreateFileA(dir->path, FILE_WRITE_ATTRIBUTES,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (h != INVALID_HANDLE_VALUE) {
+            apply_meta_handle(h, &dir->meta);
+            CloseHandle(h);
+        }
+#else
+        int fd = dirs ? dir_cache_fd(dirs, dir->path) : -1;
+        if (fd >= 0) {
+            apply_meta_fd(fd, &dir->meta);
+        } else if ((fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+            apply_meta_fd(fd, &dir->meta);
+            close(fd);
+        }
+#endif
+        mem_free(dir->path);
+    }
+    batch->count = 0;
+}
+
+void entry_meta_batch_free(EntryMetaBatch* batch) {
+    for (size_t i = 0; i < batch->count; i++) mem_free(batch->dirs[i].path);
+    mem_free(batch->dirs);
+    memset(batch, 0, sizeof(*batch));
+}
+
+int entry_meta_matches(const char* path, uint64_t size, const EntryMeta* meta) {
+    if (!meta->has_mtime) return 0;
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return 0;
+    }
+    uint64_t file_size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    uint64_t mtime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+                     data.ftLastWriteTime.dwLowDateTime;
+    return file_size == size && mtime / 10000000 == meta->mtime / 10000000;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size != size) {
+        return 0;
+    }
+    int64_t ticks = (int64_t)(meta->mtime - FILETIME_UNIX_EPOCH);
+    int64_t sec = ticks / 10000000;
+    if (ticks % 10000000 < 0) sec--;
+    return (int64_t)st.st_mtime == sec;
+#endif
+}
+
+void entry_preallocate(FILE* file, uint64_t size) {
+    if (size < ENTRY_PREALLOCATE_MIN) return;
+#if defined(__linux__)
+    /* Not posix_fallocate: it changes the size, and its fallback writes the zeros itself */
+    fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#elif defined(__APPLE__) && defined(F_PREALLOCATE)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)size, 0 };
+    if (fcntl(fileno(file), F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(fileno(file), F_PREALLOCATE, &store);
+    }
+#elif defined(_WIN32)
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    SetFileInformationByHandle((HANDLE)_get_osfhandle(_fileno(file)), FileAllocationInfo,
+                               &info, sizeof(info));
+#else
+    (void)file;
+#endif
+}
+
+static SevenZipErrorCode write_job(EntryWriterPool* pool, EntryWriterJob* job) {
+    FILE* file = pool->open(pool->open_ctx, job->path);
+    if (!file) return SEVENZIP_ERROR_OPEN_FILE;
+    /* The whole entry is in memory: one write, no copy through stdio */
+    setvbuf(file, NULL, _IONBF, 0);
+    WriteHints hints;
+    write_hints_begin(&hints, file, pool->cache_neutral);
+    int failed;
+    if (pool->sparse) {
+        SparseOutput out;
+        sparse_output_begin(&out, file);
+        failed = !sparse_output_write(&out, file, job->data, job->size) ||
+                 !sparse_output_end(&out, file);
+    } else {
+        failed = job->size > 0 && fwrite(job->data, 1, job->size, file) != job->size;
+    }
+    write_hints_wrote(&hints, job->size);
+    write_hints_end(&hints, file);
+    if (entry_meta_apply(file, &job->meta) != 0) failed = 1;
+    if (output_durability_close(pool->durability, file) != 0) failed = 1;
+    return failed ? SEVENZIP_ERROR_EXTRACT : SEVENZIP_OK;
+}
+
+static THREAD_FUNC_DECL EntryWriter_Thread(void* arg) {
+    EntryWriterPool* pool = (EntryWriterPool*)arg;
+    thread_sched_enter();
+
+    for (;;) {
+        Semaphore_Wait(&pool->filled_slots);
+        CriticalSection_Enter(&pool->lock);
+        EntryWriterJob job = pool->jobs[pool->head];
+        pool->head = (pool->head + 1) % pool->count;
+        int failed = pool->error_code != SEVENZIP_OK;
+        CriticalSection_Leave(&pool->lock);
+        Semaphore_Release1(&pool->free_slots);
+        if (job.stop) break;
+
+        /* After a failure the rest is dropped, as the decoders stop too */
+        SevenZipErrorCode err = failed ? SEVENZIP_OK : write_job(pool, &job);
+        mem_free(job.path);
+        mem_free(job.data);
+        if (err != SEVENZIP_OK) {
+            CriticalSection_Enter(&pool->lock);
+            if (pool->error_code == SEVENZIP_OK) pool->error_code = err;
+            CriticalSection_Leave(&pool->lock);
+        }
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Queue a job; the slot is taken under the lock, as several decoders submit */
+static SevenZipErrorCode pool_push(EntryWriterPool* pool, const EntryWriterJob* job) {
+    Semaphore_Wait(&pool->free_slots);
+    CriticalSection_Enter(&pool->lock);
+    SevenZipErrorCode err = job->stop ? SEVENZIP_OK : pool->error_code;
+    if (err == SEVENZIP_OK) {
+        pool->jobs[pool->tail] = *job;
+        pool->tail = (pool->tail + 1) % pool->count;
+    }
+    CriticalSection_Leave(&pool->lock);
+    if (err != SEVENZIP_OK) {
+        Semaphore_Release1(&pool->free_slots);
+        return err;
+    }
+    Semaphore_Release1(&pool->filled_slots);
+    return SEVENZIP_OK;
+}
+
+static void pool_close_handles(EntryWriterPool* pool) {
+    if (Semaphore_IsCreated(&pool->free_slots)) Semaphore_Close(&pool->free_slots);
+    if (Semaphore_IsCreated(&pool->filled_slots)) Semaphore_Close(&pool->filled_slots);
+    CriticalSection_Delete(&pool->lock);
+    free(pool->jobs);
+    pool->jobs = NULL;
+    pool->count = 0;
+}
+
+int entry_writer_pool_start(EntryWriterPool* pool, int num_threads, int sparse,
+                            int cache_neutral, EntryWriterOpen open, void* open_ctx,
+                            OutputDurability* durability) {
+    memset(pool, 0, sizeof(*pool));
+    Semaphore_Construct(&pool->free_slots);
+    Semaphore_Construct(&pool->filled_slots);
+    for (int i = 0; i < ENTRY_WRITER_MAX_THREADS; i++) {
+        Thread_CONSTRUCT(&pool->threads[i])
+    }
+    pool->open = open;
+    pool->open_ctx = open_ctx;
+    pool->sparse = sparse;
+    pool->cache_neutral = cache_neutral;
+    pool->durability = durability;
+    pool->error_code = SEVENZIP_OK;
+    if (num_threads <= 0) return 0;
+    if (num_threads > ENTRY_WRITER_MAX_THREADS) num_threads = ENTRY_WRITER_MAX_THREADS;
+
+    UInt32 count = (UInt32)num_threads * ENTRY_WRITER_SLOTS_PER_THREAD;
+    pool->jobs = (EntryWriterJob*)calloc(count, sizeof(EntryWriterJob));
+    if (!pool->jobs) return 0;
+    if (CriticalSection_Init(&pool->lock) != 0) {
+        free(pool->jobs);
+        pool->jobs = NULL;
+        return 0;
+    }
+    pool->count = count;
+    if (Semaphore_Create(&pool->free_slots, count, count) != 0 ||
+        Semaphore_Create(&pool->filled_slots, 0, count) != 0) {
+        pool_close_handles(pool);
+        return 0;
+    }
+
+    /* Run with however many writers could be started */
+    while (pool->num_threads < num_threads &&
+           Thread_Create(&pool->threads[pool->num_threads], EntryWriter_Thread, pool) == 0) {
+        pool->num_threads++;
+    }
+    if (pool->num_threads == 0) {
+        pool_close_handles(pool);
+        return 0;
+    }
+    return 1;
+}
+
+SevenZipErrorCode entry_writer_pool_submit(EntryWriterPool* pool, char* path,
+                                           Byte* data, size_t size,
+                                           const EntryMeta* meta) {
+    EntryWriterJob job;
+    job.path = path;
+    job.data = data;
+    job.size = size;
+    job.meta = *meta;
+    job.stop = 0;
+    SevenZipErrorCode err = pool_push(pool, &job);
+    if (err != SEVENZIP_OK) {
+        mem_free(path);
+        mem_free(data);
+    }
+    return err;
+}
+
+SevenZipErrorCode entry_writer_pool_finish(EntryWriterPool* pool) {
+    if (pool->count == 0) return pool->error_code;
+
+    EntryWriterJob stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.stop = 1;
+    for (int i = 0; i < pool->num_threads; i++) {
+        pool_push(pool, &stop);
+    }
+    for (int i = 0; i < pool->num_threads; i++) {
+        Thread_Wait_Close(&pool->threads[i]);
+    }
+
+    SevenZipErrorCode err = pool->error_code;
+    pool_close_handles(pool);
+    pool->num_threads = 0;
+    return err;
+}
@@ -0,0 +1,185 @@
+/**
+ * Entry Writer Pool - Internal Header
+ *
+ * Writer threads that create, fill and close extracted files so the
+ * decoders do not wait on file creation (slow on network shares and on
+ * volumes scanned on open). A decoder buffers an entry of up to
+ * ENTRY_WRITER_MAX_BUFFERED bytes and submits it whole once its CRC
+ * matched; larger entries are cheap to open relative to their size and
+ * are still written by the decoder itself. The queue holds a fixed number
+ * of entries, which bounds the buffered bytes, and blocks the decoders
+ * when the writers fall behind.
+ *
+ * Writers restore the modification time, and the permission bits of
+ * archives carrying Unix attributes, on the open file before closing it.
+ * In sparse mode they skip all-zero blocks (sparse_output.h); in
+ * cache-neutral mode each file leaves the page cache once closed
+ * (write_hints.h).
+ */
+
+#ifndef SEVENZIP_ENTRY_WRITER_H
+#define SEVENZIP_ENTRY_WRITER_H
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "output_durability.h"
+#include "Threads.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Writers when the caller asks for "auto", and the hard cap */
+#define ENTRY_WRITER_DEFAULT_THREADS 4
+#define ENTRY_WRITER_MAX_THREADS 16
+
+/* Largest entry passed to the writers; bigger ones are written inline */
+#define ENTRY_WRITER_MAX_BUFFERED (1024 * 1024)
+
+/* Queued entries per writer thread */
+#define ENTRY_WRITER_SLOTS_PER_THREAD 4
+
+/* Smallest file given its disk space up front; smaller ones land in one write */
+#define ENTRY_PREALLOCATE_MIN (1024 * 1024)
+
+/* Metadata restored on an extracted file */
+typedef struct {
+    int has_mtime;
+    uint64_t mtime;      /* FILETIME: 100ns ticks since 1601-01-01 UTC */
+    int has_attrib;
+    uint32_t attrib;     /* Windows attributes; Unix mode in the high 16 bits if 0x8000 */
+} EntryMeta;
+
+/* Creates parent directories and opens `path` for writing; may run on several writers at once */
+typedef FILE* (*EntryWriterOpen)(void* ctx, char* path);
+
+typedef struct {
+    char* path;          /* Owned */
+    Byte* data;          /* Owned, NULL for an empty file */
+    size_t size;
+    EntryMeta meta;
+    int stop;            /* Shutdown request, carries no entry */
+} EntryWriterJob;
+
+typedef struct {
+    EntryWriterJob* jobs;
+    UInt32 count;        /* 0 = not running, callers write inline */
+    UInt32 head;         /* Next job to write (writers, under lock) */
+    UInt32 tail;         /* Next job to fill (submitters, under lock) */
+    CCriticalSection lock;
+    CSemaphore free_slots;
+    CSemaphore filled_slots;
+    CThread threads[ENTRY_WRITER_MAX_THREADS];
+    int num_threads;
+    EntryWriterOpen open;
+    void* open_ctx;
+    int sparse;          /* Leave all-zero blocks as holes */
+    int cache_neutral;   /* Drop each file from the page cache once written */
+    OutputDurability* durability;  /* Closes the files (NULL = fclose) */
+    SevenZipErrorCode error_code;  /* First failed job (under lock) */
+} EntryWriterPool;
+
+/* Metadata of an archive entry */
+void entry_meta_get(const CSzArEx* db, UInt32 index, EntryMeta* meta);
+
+/**
+ * Flush a file written through stdio and restore its metadata
+ * Metadata is restored on the open descriptor after the flush, so no
+ * later write moves the time again; failing to restore it is not an error.
+ * @return 0 on success, non-zero if the flush failed
+ */
+int entry_meta_apply(FILE* file, const EntryMeta* meta);
+
+/**
+ * entry_meta_apply() and close the file
+ * @return 0 on success, non-zero if the flush or close failed
+ */
+int entry_meta_close(FILE* file, const EntryMeta* meta);
+
+/* Directory whose metadata waits for the end of the run */
+typedef struct {
+    char* path;          /* Owned */
+    EntryMeta meta;
+} EntryMetaDir;
+
+/*
+ * Metadata of the directories of a run, restored in one pass once every
+ * file is in place: creating a file in a directory moves its time, and
+ * a restored mode may take away the write permission the run needs.
+ */
+typedef struct {
+    EntryMetaDir* dirs;
+    size_t count;
+    size_t capacity;
+} EntryMetaBatch;
+
+void entry_meta_batch_init(EntryMetaBatch* batch);
+
+/* Queue the metadata of directory `path`; out of memory only loses it */
+void entry_meta_batch_add(EntryMetaBatch* batch, const char* path, const EntryMeta* meta);
+
+/**
+ * Restore the queued metadata, deepest directories first, on the
+ * descriptors `dirs` holds open (by path for the others), and empty the
+ * batch; failing to restore it is not an error
+ */
+void entry_meta_batch_apply(EntryMetaBatch* batch, DirCache* dirs);
+
+void entry_meta_batch_free(EntryMetaBatch* batch);
+
+/**
+ * Whether `path` is a regular file of `size` bytes last modified at the
+ * time in `meta`, to the second (filesystems differ in finer precision)
+ * @return 1 if it is, 0 if not or when `meta` has no time
+ */
+int entry_meta_matches(const char* path, uint64_t size, const EntryMeta* meta);
+
+/**
+ * Reserve disk space for a file that will grow to `size` bytes
+ * The file size is left alone and grows with the writes, so a failed
+ * extraction is not padded out. Files below ENTRY_PREALLOCATE_MIN are
+ * skipped, as is any failure (no filesystem support, ENOSPC), which only
+ * loses the contiguous layout.
+ */
+void entry_preallocate(FILE* file, uint64_t size);
+
+/**
+ * Start the writer threads
+ * @param pool Pool to set up
+ * @param num_threads Writers (clamped to ENTRY_WRITER_MAX_THREADS)
+ * @param sparse 1 to write files with holes for their zero blocks
+ * @param cache_neutral 1 to leave no file in the page cache
+ * @param open Opener used by the writers
+ * @param open_ctx Passed to `open`
+ * @param durability Closes the written files (NULL = fclose)
+ * @return 1 if at least one writer runs, 0 if the caller has to write
+ *         inline (num_threads <= 0, or threads could not be started)
+ */
+int entry_writer_pool_start(EntryWriterPool* pool, int num_threads, int sparse,
+                            int cache_neutral, EntryWriterOpen open, void* open_ctx,
+                            OutputDurability* durability);
+
+/**
+ * Queue an entry; blocks while the queue is full
+ * Takes ownership of `path` and `data` (malloc'ed) in every case.
+ * @return SEVENZIP_OK, or the error of an earlier job, in which case the
+ *         entry is dropped and the caller should stop
+ */
+SevenZipErrorCode entry_writer_pool_submit(EntryWriterPool* pool, char* path,
+                                           Byte* data, size_t size,
+                                           const EntryMeta* meta);
+
+/**
+ * Write everything still queued and stop the writers
+ * @return SEVENZIP_OK, or the error of the first failed job
+ */
+SevenZipErrorCode entry_writer_pool_finish(EntryWriterPool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ENTRY_WRITER_H */
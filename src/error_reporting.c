@@ -6,6 +6,7 @@
  */
 
 #include "7z_ffi.h"
+#include "error_reporting.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -124,6 +125,10 @@ const char* sevenzip_get_error_string(SevenZipErrorCode code) {
             return "Invalid parameter provided to function";
         case SEVENZIP_ERROR_NOT_IMPLEMENTED:
             return "Feature not implemented";
+        case SEVENZIP_ERROR_CANCELLED:
+            return "Operation cancelled through its cancellation token";
+        case SEVENZIP_ERROR_BUFFER_TOO_SMALL:
+            return "Output buffer too small - the size needed is returned in its place";
         case SEVENZIP_ERROR_UNKNOWN:
         default:
             return "Unknown error occurred";
@@ -0,0 +1,34 @@
+/**
+ * Error Reporting - Internal Header
+ *
+ * Sets the calling thread's detail for sevenzip_get_last_error(). A
+ * module that fails a call for a reason the code alone does not explain
+ * records it here and returns the code as usual.
+ */
+
+#ifndef SEVENZIP_ERROR_REPORTING_H
+#define SEVENZIP_ERROR_REPORTING_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Record the last error of the calling thread
+ * @param message What failed (NULL = none)
+ * @param file_context File or value involved (NULL = none)
+ * @param position Byte position involved (-1 = none)
+ * @param suggestion How to fix it (NULL = none)
+ */
+void sevenzip_set_error_internal(SevenZipErrorCode code, const char* message,
+                                 const char* file_context, int64_t position,
+                                 const char* suggestion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ERROR_REPORTING_H */
@@ -0,0 +1,197 @@
+/**
+ * Extraction Checkpoint
+ *
+ * Only folders begun are stored, as (folder, first file left) pairs.
+ * Numbers are 8 little-endian bytes; a CRC32 of everything before it
+ * ends the file. The fingerprint is a CRC32 of the pack and unpack
+ * positions, which change with any change to the archive's contents.
+ */
+
+#include "extract_checkpoint.h"
+#include "mem_alloc.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+
+#define XCKPT_MAGIC "7zFFxckp"
+#define XCKPT_MAGIC_SIZE 8
+#define XCKPT_VERSION 1
+#define XCKPT_HEAD_SIZE (XCKPT_MAGIC_SIZE + 5 * 8)
+
+static uint32_t crc_u64(uint32_t crc, UInt64 value) {
+    Byte b[8];
+    SetUi64(b, value)
+    return CrcUpdate(crc, b, sizeof(b));
+}
+
+static uint32_t archive_fingerprint(const CSzArEx* db) {
+    uint32_t crc = CRC_INIT_VAL;
+    for (UInt32 i = 0; i <= db->db.NumPackStreams; i++) {
+        crc = crc_u64(crc, db->db.PackPositions[i]);
+    }
+    for (UInt32 i = 0; i <= db->NumFiles; i++) {
+        crc = crc_u64(crc, db->UnpackPositions[i]);
+    }
+    return CRC_GET_DIGEST(crc);
+}
+
+/* Apply a saved checkpoint; 0 if it is damaged or of another archive */
+static int checkpoint_load(ExtractCheckpoint* ck, const Byte* data, size_t size) {
+    const CSzArEx* db = ck->db;
+    if (size < XCKPT_HEAD_SIZE + 4 || memcmp(data, XCKPT_MAGIC, XCKPT_MAGIC_SIZE) != 0 ||
+        GetUi32(data + size - 4) != CrcCalc(data, size - 4)) {
+        return 0;
+    }
+    const Byte* p = data + XCKPT_MAGIC_SIZE;
+    UInt64 count = GetUi64(p + 32);
+    if (GetUi64(p) != XCKPT_VERSION || GetUi64(p + 8) != db->NumFiles ||
+        GetUi64(p + 16) != db->db.NumFolders || GetUi64(p + 24) != ck->fingerprint ||
+        count > db->db.NumFolders || size - XCKPT_HEAD_SIZE - 4 != count * 16) {
+        return 0;
+    }
+    p += 40;
+    for (UInt64 i = 0; i < count; i++, p += 16) {
+        UInt64 f = GetUi64(p);
+        UInt64 first = GetUi64(p + 8);
+        if (f >= db->db.NumFolders || first < ck->ranges[f].first || first > ck->ranges[f].limit) {
+            return 0;
+        }
+        ck->ranges[f].first = (UInt32)first;
+    }
+    return 1;
+}
+
+SevenZipErrorCode extract_checkpoint_begin(ExtractCheckpoint* ck, const char* path,
+                                           const CSzArEx* db) {
+    memset(ck, 0, sizeof(*ck));
+    if (!path) return SEVENZIP_OK;
+    UInt32 num_folders = db->db.NumFolders;
+    ck->ranges = (FolderStreamRange*)mem_alloc(SEVENZIP_MEM_OTHER,
+                                               (num_folders ? num_folders : 1) * sizeof(FolderStreamRange));
+    if (!ck->ranges) return SEVENZIP_ERROR_MEMORY;
+    for (UInt32 f = 0; f < num_folders; f++) {
+        ck->ranges[f].first = db->FolderToFile[f];
+        ck->ranges[f].limit = db->FolderToFile[f + 1];
+    }
+    ck->path = path;
+    ck->db = db;
+    ck->fingerprint = archive_fingerprint(db);
+    ck->has_lock = CriticalSection_Init(&ck->lock) == 0;
+
+    /* No file yet: a first run */
+    FILE* f = fopen(path, "rb");
+    if (!f) return SEVENZIP_OK;
+    SevenZipErrorCode err = SEVENZIP_ERROR_INVALID_PARAM;
+    Byte* data = NULL;
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+    if (size >= 0 && (UInt64)size <= XCKPT_HEAD_SIZE + 4 + (UInt64)num_folders * 16 &&
+        fseek(f, 0, SEEK_SET) == 0) {
+        data = (Byte*)mem_alloc(SEVENZIP_MEM_OTHER, size > 0 ? (size_t)size : 1);
+        if (!data) {
+            err = SEVENZIP_ERROR_MEMORY;
+        } else if (fread(data, 1, (size_t)size, f) == (size_t)size &&
+                   checkpoint_load(ck, data, (size_t)size)) {
+            err = SEVENZIP_OK;
+        }
+    }
+    mem_free(data);
+    fclose(f);
+    if (err != SEVENZIP_OK) {
+        ck->path = NULL;  /* Left for the caller to look at */
+        extract_checkpoint_end(ck, 0);
+    }
+    return err;
+}
+
+const FolderStreamRange* extract_checkpoint_ranges(const ExtractCheckpoint* ck) {
+    return ck->path ? ck->ranges : NULL;
+}
+
+/* Write the folders begun to a new file and rename it over the old one */
+static int checkpoint_save(ExtractCheckpoint* ck) {
+    const CSzArEx* db = ck->db;
+    UInt64 count = 0;
+    for (UInt32 f = 0; f < db->db.NumFolders; f++) {
+        if (ck->ranges[f].first != db->FolderToFile[f]) count++;
+    }
+    size_t size = XCKPT_HEAD_SIZE + (size_t)count * 16 + 4;
+    Byte* data = (Byte*)mem_alloc(SEVENZIP_MEM_OTHER, size);
+    if (!data) return 0;
+    Byte* p = data;
+    memcpy(p, XCKPT_MAGIC, XCKPT_MAGIC_SIZE);
+    p += XCKPT_MAGIC_SIZE;
+    SetUi64(p, XCKPT_VERSION)
+    SetUi64(p + 8, db->NumFiles)
+    SetUi64(p + 16, db->db.NumFolders)
+    SetUi64(p + 24, ck->fingerprint)
+    SetUi64(p + 32, count)
+    p += 40;
+    for (UInt32 f = 0; f < db->db.NumFolders; f++) {
+        if (ck->ranges[f].first == db->FolderToFile[f]) continue;
+        SetUi64(p, f)
+        SetUi64(p + 8, ck->ranges[f].first)
+        p += 16;
+    }
+    SetUi32(p, CrcCalc(data, size - 4))
+
+    char tmp_path[1300];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", ck->path);
+    FILE* f = fopen(tmp_path, "wb");
+    int ok = f && fwrite(data, 1, size, f) == size;
+    if (f) ok = fclose(f) == 0 && ok;
+    mem_free(data);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, ck->path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp_path, ck->path) == 0;
+#endif
+    if (!ok) {
+        remove(tmp_path);
+        fprintf(stderr, "Cannot write checkpoint: %s\n", ck->path);
+        return 0;
+    }
+    ck->pending = 0;
+    return 1;
+}
+
+/* Move the folder of `file_index`, or folder `f`, on to `first` */
+static void checkpoint_advance(ExtractCheckpoint* ck, UInt32 f, UInt32 first, UInt64 bytes) {
+    if (!ck->path || f >= ck->db->db.NumFolders) return;
+    if (ck->has_lock) CriticalSection_Enter(&ck->lock);
+    if (first > ck->ranges[f].first) {
+        ck->ranges[f].first = first;
+        ck->pending += bytes;
+        if (ck->pending >= EXTRACT_CHECKPOINT_INTERVAL) checkpoint_save(ck);
+    }
+    if (ck->has_lock) CriticalSection_Leave(&ck->lock);
+}
+
+void extract_checkpoint_file_done(ExtractCheckpoint* ck, UInt32 file_index) {
+    if (!ck->path) return;
+    checkpoint_advance(ck, ck->db->FileToFolder[file_index], file_index + 1,
+                       SzArEx_GetFileSize(ck->db, file_index));
+}
+
+void extract_checkpoint_folder_done(ExtractCheckpoint* ck, UInt32 f) {
+    if (!ck->path || f >= ck->db->db.NumFolders) return;
+    UInt32 first = ck->ranges[f].first;
+    UInt64 left = ck->db->UnpackPositions[ck->ranges[f].limit] - ck->db->UnpackPositions[first];
+    checkpoint_advance(ck, f, ck->ranges[f].limit, left);
+}
+
+void extract_checkpoint_end(ExtractCheckpoint* ck, int complete) {
+    if (ck->path) {
+        if (complete) remove(ck->path);
+        else checkpoint_save(ck);
+    }
+    if (ck->has_lock) CriticalSection_Delete(&ck->lock);
+    mem_free(ck->ranges);
+    memset(ck, 0, sizeof(*ck));
+}
@@ -0,0 +1,74 @@
+/**
+ * Extraction Checkpoint - Internal Header
+ *
+ * How far a streaming extraction got, kept in a file so that a run which
+ * failed partway (a volume source gone, the process killed) can be
+ * resumed where it stopped. Per folder it holds the first file not yet
+ * written: a folder whose files are all written is skipped on resume,
+ * and one stopped inside is decoded again from the last decoder reset
+ * point before that file (folder_stream_decode()), the files before it
+ * left as they are. Only files whose CRC matched count as written.
+ *
+ * The file is replaced by a rename, so a crash leaves one whole
+ * checkpoint or the other. It records files as closed, not as synced.
+ */
+
+#ifndef SEVENZIP_EXTRACT_CHECKPOINT_H
+#define SEVENZIP_EXTRACT_CHECKPOINT_H
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include "folder_stream.h"
+#include "Threads.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Output finished between two saves during a run; a failed run always saves */
+#define EXTRACT_CHECKPOINT_INTERVAL (64 * 1024 * 1024)
+
+typedef struct {
+    const char* path;          /* NULL = no checkpoint */
+    const CSzArEx* db;
+    FolderStreamRange* ranges; /* Per folder, the files left to write */
+    uint32_t fingerprint;      /* Of the archive's layout, tells another archive */
+    uint64_t pending;          /* Bytes finished since the last save */
+    CCriticalSection lock;     /* Workers finish folders at once */
+    int has_lock;
+} ExtractCheckpoint;
+
+/**
+ * Set up the checkpoint of an opened archive, reading `path` if it exists
+ * @param ck Checkpoint to set up; freed with extract_checkpoint_end()
+ * @param path Checkpoint file (NULL: every folder is decoded, nothing saved)
+ * @param db Opened archive, which must outlive the checkpoint
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_INVALID_PARAM if the file is damaged
+ *         or belongs to another archive, SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode extract_checkpoint_begin(ExtractCheckpoint* ck, const char* path,
+                                           const CSzArEx* db);
+
+/* Per folder, the files still to write, for folder_stream_decode_folders()
+ * (NULL without a checkpoint: every folder whole) */
+const FolderStreamRange* extract_checkpoint_ranges(const ExtractCheckpoint* ck);
+
+/* File `file_index` of its folder, and all before it, are written and
+ * their CRCs matched */
+void extract_checkpoint_file_done(ExtractCheckpoint* ck, UInt32 file_index);
+
+/* Every file of folder `f` is written */
+void extract_checkpoint_folder_done(ExtractCheckpoint* ck, UInt32 f);
+
+/**
+ * Finish the run: remove the file once the archive is extracted, or save
+ * where a failed run got to, and free the checkpoint
+ */
+void extract_checkpoint_end(ExtractCheckpoint* ck, int complete);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_EXTRACT_CHECKPOINT_H */
@@ -1,36 +1,52 @@
 #include "7z_ffi.h"
-#include "7zCrc.h"  // Add CRC header for CrcGenerateTable()
+#include "mem_alloc.h"
+#include "thread_quota.h"
+#include "async_job.h"
+#include "global_tables.h"
+#include "thread_placement.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #define SEVENZIP_VERSION "1.0.0"
 
-/* Global initialization flag */
-static int g_initialized = 0;
-
 SevenZipErrorCode sevenzip_init(void) {
-    if (g_initialized) {
-        return SEVENZIP_OK;
+    /* Built once per process; later calls and concurrent ones just wait for it */
+    global_tables_init();
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_init_with_options(const SevenZipInitOptions* options) {
+    if (options && (options->max_threads < 0 || options->max_jobs < 0)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    SevenZipErrorCode err = sevenzip_init();
+    if (err == SEVENZIP_OK) {
+        err = thread_sched_set(options);
+    }
+    if (err != SEVENZIP_OK) {
+        return err;
     }
     
-    /* Initialize CRC table - CRITICAL: Must be called before any compression operations */
-    CrcGenerateTable();
-    
-    /* Initialize any other global state here */
-    
-    g_initialized = 1;
+    int max_threads = 0;
+    if (options) {
+        max_threads = options->max_threads > 0 ? options->max_threads : hardware_thread_count();
+    }
+    thread_quota_set(max_threads);
+    job_runners_set(options ? options->max_jobs : 0);
+    mem_pool_set_limit(options ? options->decoder_pool_bytes : 0);
     return SEVENZIP_OK;
 }
 
 void sevenzip_cleanup(void) {
-    if (!g_initialized) {
-        return;
-    }
-    
-    /* Cleanup any global state here */
-    
-    g_initialized = 0;
+    /* The tables stay valid for the life of the process, so calls still
+     * running on other threads are not affected; blocks they free later
+     * go back to the pool */
+    mem_pool_trim();
+}
+
+int sevenzip_hardware_threads(void) {
+    return hardware_thread_count();
 }
 
 const char* sevenzip_get_error_message(SevenZipErrorCode error_code) {
@@ -51,6 +67,10 @@ const char* sevenzip_get_error_message(SevenZipErrorCode error_code) {
             return "Invalid parameter";
         case SEVENZIP_ERROR_NOT_IMPLEMENTED:
             return "Feature not implemented";
+        case SEVENZIP_ERROR_CANCELLED:
+            return "Operation cancelled";
+        case SEVENZIP_ERROR_BUFFER_TOO_SMALL:
+            return "Output buffer too small";
         default:
             return "Unknown error";
     }
@@ -60,21 +80,13 @@ const char* sevenzip_get_version(void) {
     return SEVENZIP_VERSION;
 }
 
+/* Lists are one block: entries and names follow the list header */
 void sevenzip_free_list(SevenZipList* list) {
-    if (!list) {
-        return;
-    }
-    
-    if (list->entries) {
-        for (size_t i = 0; i < list->count; i++) {
-            if (list->entries[i].name) {
-                free(list->entries[i].name);
-            }
-        }
-        free(list->entries);
-    }
-    
-    free(list);
+    mem_free(list);
+}
+
+void sevenzip_free_list_columns(SevenZipListColumns* columns) {
+    mem_free(columns);
 }
 
 /* Stub implementation that redirects to sevenzip_create_7z */
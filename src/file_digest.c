@@ -0,0 +1,41 @@
+/**
+ * File Digest
+ *
+ * Dispatch to Sha256.c (SHA-NI / ARMv8 via Sha256Prepare()) or xxh3.c
+ * (AVX2 / SSE2 via xxh3_prepare()); both are set up by global_tables_init().
+ */
+
+#include "file_digest.h"
+
+size_t file_digest_size(SevenZipDigestAlgorithm algorithm) {
+    switch (algorithm) {
+        case SEVENZIP_DIGEST_SHA256: return SHA256_DIGEST_SIZE;
+        case SEVENZIP_DIGEST_XXH3_128: return XXH3_128_DIGEST_SIZE;
+    }
+    return 0;
+}
+
+void file_digest_init(FileDigest* digest, SevenZipDigestAlgorithm algorithm) {
+    digest->algorithm = algorithm;
+    if (algorithm == SEVENZIP_DIGEST_XXH3_128) {
+        xxh3_128_init(&digest->u.xxh3);
+    } else {
+        Sha256_Init(&digest->u.sha256);
+    }
+}
+
+void file_digest_update(FileDigest* digest, const void* data, size_t size) {
+    if (digest->algorithm == SEVENZIP_DIGEST_XXH3_128) {
+        xxh3_128_update(&digest->u.xxh3, data, size);
+    } else {
+        Sha256_Update(&digest->u.sha256, (const Byte*)data, size);
+    }
+}
+
+void file_digest_final(FileDigest* digest, FileDigestSlot* slot) {
+    if (digest->algorithm == SEVENZIP_DIGEST_XXH3_128) {
+        xxh3_128_final(&digest->u.xxh3, slot->value);
+    } else {
+        Sha256_Final(&digest->u.sha256, slot->value);
+    }
+}
@@ -0,0 +1,51 @@
+/**
+ * File Digest - Internal Header
+ *
+ * Per-file digest of SevenZipStreamOptions.digest_manifest, computed in
+ * the pass that reads the file for its CRC: SHA-256, or XXH3-128 for change
+ * detection. The result goes to a FileDigestSlot, which also says which
+ * algorithm to run, so the readers need no other state for it.
+ */
+
+#ifndef SEVENZIP_FILE_DIGEST_H
+#define SEVENZIP_FILE_DIGEST_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "Sha256.h"
+#include "xxh3.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FILE_DIGEST_MAX_SIZE SHA256_DIGEST_SIZE
+
+typedef struct {
+    SevenZipDigestAlgorithm algorithm;
+    Byte value[FILE_DIGEST_MAX_SIZE];   /* file_digest_size() bytes used */
+} FileDigestSlot;
+
+typedef struct {
+    SevenZipDigestAlgorithm algorithm;
+    union {
+        CSha256 sha256;
+        Xxh3State xxh3;
+    } u;
+} FileDigest;
+
+/* Digest length in bytes (0 = unknown algorithm) */
+size_t file_digest_size(SevenZipDigestAlgorithm algorithm);
+
+void file_digest_init(FileDigest* digest, SevenZipDigestAlgorithm algorithm);
+void file_digest_update(FileDigest* digest, const void* data, size_t size);
+
+/* Store the digest to slot->value */
+void file_digest_final(FileDigest* digest, FileDigestSlot* slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_FILE_DIGEST_H */
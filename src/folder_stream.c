@@ -0,0 +1,1272 @@
+/**
+ * Folder Stream Decoder
+ *
+ * Main coder -> optional filter stage -> file splitter -> sink. LZMA and
+ * LZMA2 decode into their own dictionary used as a ring, and each decoded
+ * run is passed on straight from it. Branch filters are stateful and
+ * convert up to a few bytes short of the end, so the filter stage keeps
+ * the unconverted tail in front of the next run, which gives the same
+ * output as converting the whole folder in one call. Copy folders without
+ * a filter go to sinks with WriteStored as spans of the packed stream, so
+ * the sink can copy the file range instead of writing the bytes.
+ *
+ * When Lzma2DecMt decodes a folder on several threads, one thread summing
+ * CRCs behind them would set the pace, so the CRCs go to a CrcChecker
+ * (crc_checker.h) and the splitter only hands it copies of the output.
+ *
+ * A 7zAES coder in front of the main coder turns into the look stream
+ * the main coder reads: an AesInStream (aes_coder.h) that decrypts ahead
+ * of it on a thread of its own, seeking in plaintext offsets.
+ */
+
+#include "folder_stream.h"
+#include "aes_coder.h"
+#include "crc_checker.h"
+#include "7zCrc.h"
+#include "Bra.h"
+#include "CpuArch.h"
+#include "Delta.h"
+#include "Lzma2Dec.h"
+#include "Lzma2DecMt.h"
+#include "LzmaDec.h"
+#include "Ppmd7.h"
+#include "Threads.h"
+#include "thread_placement.h"
+
+#include <string.h>
+
+#define METHOD_COPY  0
+#define METHOD_DELTA 3
+#define METHOD_ARM64 0xa
+#define METHOD_LZMA2 0x21
+#define METHOD_PPMD  0x30401
+#define METHOD_LZMA  0x30101
+#define METHOD_BCJ   0x3030103
+#define METHOD_PPC   0x3030205
+#define METHOD_IA64  0x3030401
+#define METHOD_ARM   0x3030501
+#define METHOD_ARMT  0x3030701
+#define METHOD_SPARC 0x3030805
+#define METHOD_AES   0x6F10701
+
+#define LZMA_DICT_MIN (1 << 12)
+
+/* Internal: the last file under the caller's limit is out, stop decoding */
+#define FOLDER_OUT_DONE (-1)
+
+/* Offset of output that is not a span of the packed stream */
+#define FOLDER_OUT_NOT_STORED ((UInt64)-1)
+
+/* Splits the folder's unpacked stream into its files */
+typedef struct {
+    const CSzArEx* db;
+    UInt32 folder_index;
+    FolderStreamSink* sink;
+    UInt32 next_file;
+    UInt32 end_file;
+    int partial;        /* end_file is the caller's limit, not the folder's end */
+    UInt64 skip;        /* Decoded bytes to drop before next_file starts */
+    int file_open;
+    UInt32 file_index;
+    UInt64 file_remaining;
+    UInt32 file_crc;
+    int check_file_crc;
+    int check_folder_crc;
+    UInt32 folder_crc;
+    CrcChecker* checker;  /* NULL: CRCs summed here */
+    UInt32 crc_failed_file;
+} FolderOut;
+
+/* Branch or Delta converter between the main coder and FolderOut */
+typedef struct {
+    UInt32 method;
+    Byte* buf;
+    size_t fill;
+    UInt32 pc;
+    UInt32 x86_state;
+    unsigned delta_dist;
+    Byte delta_state[DELTA_STATE_SIZE];
+} FolderFilter;
+
+typedef struct {
+    FolderOut out;
+    FolderFilter filter;
+    int has_filter;
+    ILookInStreamPtr stream;
+} FolderDecoder;
+
+static SRes folder_out_finish_file(FolderOut* o) {
+    const CSzArEx* db = o->db;
+    int has_crc = o->check_file_crc && SzBitWithVals_Check(&db->CRCs, o->file_index);
+    o->file_open = 0;
+    if (o->checker) {
+        RINOK(crc_checker_end_file(o->checker, o->file_index, has_crc,
+                                   has_crc ? db->CRCs.Vals[o->file_index] : 0))
+    } else if (has_crc && CRC_GET_DIGEST(o->file_crc) != db->CRCs.Vals[o->file_index]) {
+        o->crc_failed_file = o->file_index;
+        return SZ_ERROR_CRC;
+    }
+    RINOK(o->sink->End(o->sink, o->file_index))
+    return (o->partial && o->next_file >= o->end_file) ? FOLDER_OUT_DONE : SZ_OK;
+}
+
+/*
+ * Open the next file of the folder that has data; files of size 0 on the
+ * way are begun and ended at once. Returns SZ_ERROR_DATA if none is left.
+ */
+static SRes folder_out_open_next(FolderOut* o, int need_data) {
+    const CSzArEx* db = o->db;
+    while (o->next_file < o->end_file) {
+        UInt32 i = o->next_file++;
+        if (db->FileToFolder[i] != o->folder_index || SzArEx_IsDir(db, i)) {
+            continue;
+        }
+        o->file_index = i;
+        o->file_remaining = SzArEx_GetFileSize(db, i);
+        o->file_crc = CRC_INIT_VAL;
+        o->file_open = 1;
+        RINOK(o->sink->Begin(o->sink, i))
+        if (o->file_remaining != 0) {
+            return SZ_OK;
+        }
+        RINOK(folder_out_finish_file(o))
+    }
+    if (o->partial) return FOLDER_OUT_DONE;
+    return need_data ? SZ_ERROR_DATA : SZ_OK;
+}
+
+/* Data that is at `stored` of the packed stream, FOLDER_OUT_NOT_STORED if
+ * it came out of a coder */
+static SRes folder_out_put(FolderOut* o, const Byte* data, size_t size, UInt64 stored) {
+    if (o->skip > 0) {
+        size_t drop = size < o->skip ? size : (size_t)o->skip;
+        o->skip -= drop;
+        data += drop;
+        size -= drop;
+        if (stored != FOLDER_OUT_NOT_STORED) stored += drop;
+    }
+    if (o->check_folder_crc && !o->checker) {
+        o->folder_crc = CrcUpdate(o->folder_crc, data, size);
+    }
+    while (size > 0) {
+        if (!o->file_open) {
+            RINOK(folder_out_open_next(o, 1))
+        }
+        size_t take = size;
+        if (take > o->file_remaining) take = (size_t)o->file_remaining;
+        if (stored != FOLDER_OUT_NOT_STORED && o->sink->WriteStored) {
+            RINOK(o->sink->WriteStored(o->sink, stored, data, take))
+            stored += take;
+        } else {
+            RINOK(o->sink->Write(o->sink, data, take))
+        }
+        if (o->checker) {
+            RINOK(crc_checker_add(o->checker, data, take))
+        } else if (o->check_file_crc) {
+            o->file_crc = CrcUpdate(o->file_crc, data, take);
+        }
+        o->file_remaining -= take;
+        data += take;
+        size -= take;
+        if (o->file_remaining == 0) {
+            RINOK(folder_out_finish_file(o))
+        }
+    }
+    return SZ_OK;
+}
+
+static SRes folder_out_write(FolderOut* o, const Byte* data, size_t size) {
+    return folder_out_put(o, data, size, FOLDER_OUT_NOT_STORED);
+}
+
+/* All data is out: flush trailing empty files and check the folder CRC */
+static SRes folder_out_close(FolderOut* o) {
+    if (o->file_open) {
+        return SZ_ERROR_DATA;
+    }
+    RINOK(folder_out_open_next(o, 0))
+    if (o->file_open) {
+        return SZ_ERROR_DATA;  /* Output ended inside a file */
+    }
+    const CSzAr* ar = &o->db->db;
+    if (o->check_folder_crc && !o->checker &&
+        CRC_GET_DIGEST(o->folder_crc) != ar->FolderCRCs.Vals[o->folder_index]) {
+        return SZ_ERROR_CRC;
+    }
+    return SZ_OK;
+}
+
+/*
+ * Wait for the checker to catch up with `res` (the decode's result) and
+ * free it. A file CRC it failed explains an error better than what the
+ * decoder hit after it; the folder CRC can only be checked once it is done.
+ */
+static SRes folder_out_end_checker(FolderOut* o, SRes res) {
+    UInt32 folder_crc = 0;
+    UInt32 failed_file = 0;
+    SRes crc_res = crc_checker_end(o->checker, res == SZ_OK || res == FOLDER_OUT_DONE,
+                                   &folder_crc, &failed_file);
+    o->checker = NULL;
+    if (crc_res != SZ_OK) {
+        o->crc_failed_file = failed_file;
+        return crc_res;
+    }
+    if (res == SZ_OK && o->check_folder_crc &&
+        folder_crc != o->db->db.FolderCRCs.Vals[o->folder_index]) {
+        return SZ_ERROR_CRC;
+    }
+    return res;
+}
+
+/* Convert the staged bytes as far as the filter can; returns bytes done */
+static size_t folder_filter_convert(FolderFilter* f, Byte* data, size_t size) {
+    Byte* end;
+    switch (f->method) {
+        case METHOD_DELTA:
+            Delta_Decode(f->delta_state, f->delta_dist, data, size);
+            return size;
+        case METHOD_BCJ:
+            end = z7_BranchConvSt_X86_Dec(data, size, f->pc, &f->x86_state);
+            break;
+        case METHOD_ARM64: end = z7_BranchConv_ARM64_Dec(data, size, f->pc); break;
+        case METHOD_PPC:   end = z7_BranchConv_PPC_Dec(data, size, f->pc); break;
+        case METHOD_IA64:  end = z7_BranchConv_IA64_Dec(data, size, f->pc); break;
+        case METHOD_SPARC: end = z7_BranchConv_SPARC_Dec(data, size, f->pc); break;
+        case METHOD_ARM:   end = z7_BranchConv_ARM_Dec(data, size, f->pc); break;
+        case METHOD_ARMT:  end = z7_BranchConv_ARMT_Dec(data, size, f->pc); break;
+        default:
+            return size;
+    }
+    size_t done = (size_t)(end - data);
+    f->pc += (UInt32)done;
+    return done;
+}
+
+/* Output of the main coder */
+static SRes folder_emit(FolderDecoder* d, const Byte* data, size_t size) {
+    if (!d->has_filter) {
+        return folder_out_write(&d->out, data, size);
+    }
+
+    FolderFilter* f = &d->filter;
+    while (size > 0) {
+        size_t copy = FOLDER_STREAM_WINDOW - f->fill;
+        if (copy > size) copy = size;
+        memcpy(f->buf + f->fill, data, copy);
+        f->fill += copy;
+        data += copy;
+        size -= copy;
+
+        size_t done = folder_filter_convert(f, f->buf, f->fill);
+        RINOK(folder_out_write(&d->out, f->buf, done))
+        memmove(f->buf, f->buf + done, f->fill - done);
+        f->fill -= done;
+    }
+    return SZ_OK;
+}
+
+/* End of the main coder's output: the unconvertible tail goes out as is */
+static SRes folder_emit_flush(FolderDecoder* d) {
+    if (!d->has_filter || d->filter.fill == 0) {
+        return SZ_OK;
+    }
+    SRes res = folder_out_write(&d->out, d->filter.buf, d->filter.fill);
+    d->filter.fill = 0;
+    return res;
+}
+
+/* `offset`: where the data starts in the packed stream, FOLDER_OUT_NOT_STORED
+ * if the input is not the packed stream itself */
+static SRes decode_copy(FolderDecoder* d, UInt64 offset, UInt64 in_size, UInt64 out_size) {
+    if (in_size != out_size) {
+        return SZ_ERROR_DATA;
+    }
+    while (in_size > 0) {
+        const void* in_buf;
+        size_t cur = FOLDER_STREAM_INPUT_STEP;
+        if (cur > in_size) cur = (size_t)in_size;
+        RINOK(ILookInStream_Look(d->stream, &in_buf, &cur))
+        if (cur == 0) {
+            return SZ_ERROR_INPUT_EOF;
+        }
+        if (d->has_filter) {
+            RINOK(folder_emit(d, (const Byte*)in_buf, cur))
+        } else {
+            RINOK(folder_out_put(&d->out, (const Byte*)in_buf, cur, offset))
+        }
+        if (offset != FOLDER_OUT_NOT_STORED) offset += cur;
+        in_size -= cur;
+        RINOK(ILookInStream_Skip(d->stream, cur))
+    }
+    return SZ_OK;
+}
+
+/*
+ * One LZMA or LZMA2 decoder step into the ring dictionary; the same loop
+ * and end checks as SzDecodeLzma/SzDecodeLzma2, with the output limit cut
+ * at the ring's end.
+ */
+static SRes decode_lz(FolderDecoder* d, CLzmaDec* dic, CLzma2Dec* lzma2,
+                      UInt64 in_size, UInt64 out_size) {
+    SRes res = SZ_OK;
+    UInt64 out_left = out_size;
+
+    for (;;) {
+        const void* in_buf = NULL;
+        size_t lookahead = FOLDER_STREAM_INPUT_STEP;
+        if (lookahead > in_size) lookahead = (size_t)in_size;
+        res = ILookInStream_Look(d->stream, &in_buf, &lookahead);
+        if (res != SZ_OK) break;
+
+        if (dic->dicPos == dic->dicBufSize) dic->dicPos = 0;
+        SizeT start = dic->dicPos;
+        SizeT limit = dic->dicBufSize;
+        ELzmaFinishMode finish = LZMA_FINISH_ANY;
+        if (out_left <= limit - start) {
+            limit = start + (SizeT)out_left;
+            finish = LZMA_FINISH_END;
+        }
+
+        SizeT in_processed = (SizeT)lookahead;
+        ELzmaStatus status;
+        if (lzma2) {
+            res = Lzma2Dec_DecodeToDic(lzma2, limit, (const Byte*)in_buf, &in_processed, finish, &status);
+        } else {
+            res = LzmaDec_DecodeToDic(dic, limit, (const Byte*)in_buf, &in_processed, finish, &status);
+        }
+        in_size -= in_processed;
+        SizeT produced = dic->dicPos - start;
+        out_left -= produced;
+        if (res != SZ_OK) break;
+
+        if (produced > 0) {
+            res = folder_emit(d, dic->dic + start, produced);
+            if (res != SZ_OK) break;
+        }
+
+        if (status == LZMA_STATUS_FINISHED_WITH_MARK) {
+            if (out_left != 0 || in_size != 0) res = SZ_ERROR_DATA;
+            break;
+        }
+        if (!lzma2 && out_left == 0 && in_size == 0 &&
+            status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK) {
+            break;
+        }
+        if (in_processed == 0 && produced == 0) {
+            res = SZ_ERROR_DATA;
+            break;
+        }
+
+        res = ILookInStream_Skip(d->stream, in_processed);
+        if (res != SZ_OK) break;
+    }
+    return res;
+}
+
+/*
+ * Last LZMA2 dictionary reset at or before unpacked offset `target`, found
+ * from the chunk headers alone (control byte and sizes), so nothing is
+ * decoded on the way. Multi-block streams reset at every block; a stream
+ * without resets, or a header that does not parse, leaves the start at 0.
+ */
+static SRes lzma2_find_reset(ILookInStreamPtr stream, UInt64 pack_pos, UInt64 in_size,
+                             UInt64 target, UInt64* pack_skip, UInt64* unpack_skip) {
+    UInt64 packed = 0;
+    UInt64 unpacked = 0;
+    *pack_skip = 0;
+    *unpack_skip = 0;
+    while (packed < in_size && unpacked <= target) {
+        Byte h[6];
+        size_t n = sizeof(h);
+        if (n > in_size - packed) n = (size_t)(in_size - packed);
+        RINOK(LookInStream_SeekTo(stream, pack_pos + packed))
+        RINOK(LookInStream_Read(stream, h, n))
+
+        unsigned c = h[0];
+        UInt64 chunk_unpack;
+        UInt64 chunk_pack;
+        if ((c == 1 || c == 2) && n >= 3) {
+            /* Uncompressed chunk; 1 also resets the dictionary */
+            chunk_unpack = (((UInt32)h[1] << 8) | h[2]) + 1;
+            chunk_pack = 3 + chunk_unpack;
+        } else if (c >= 0x80 && n >= 5) {
+            /* LZMA chunk; 0xE0 and up reset the dictionary */
+            chunk_unpack = ((((UInt32)c & 0x1F) << 16) | ((UInt32)h[1] << 8) | h[2]) + 1;
+            chunk_pack = (((UInt32)h[3] << 8) | h[4]) + 1 + (c >= 0xC0 ? 6 : 5);
+        } else {
+            break;  /* End marker, or left to the decoder to reject */
+        }
+        if (c == 1 || c >= 0xE0) {
+            *pack_skip = packed;
+            *unpack_skip = unpacked;
+        }
+        packed += chunk_pack;
+        unpacked += chunk_unpack;
+    }
+    return SZ_OK;
+}
+
+/* Smallest dictionary that still covers the whole folder */
+static UInt32 lzma_dict_for(UInt32 dict, UInt64 out_size) {
+    if (out_size >= dict) return dict;
+    return out_size < LZMA_DICT_MIN ? LZMA_DICT_MIN : (UInt32)out_size;
+}
+
+static SRes decode_lzma(FolderDecoder* d, const Byte* props, unsigned props_size,
+                        UInt64 in_size, UInt64 out_size, ISzAllocPtr alloc) {
+    if (props_size != LZMA_PROPS_SIZE) {
+        return SZ_ERROR_UNSUPPORTED;
+    }
+    Byte p[LZMA_PROPS_SIZE];
+    memcpy(p, props, LZMA_PROPS_SIZE);
+    SetUi32(p + 1, lzma_dict_for(GetUi32(props + 1), out_size))
+
+    CLzmaDec dec;
+    LzmaDec_CONSTRUCT(&dec)
+    RINOK(LzmaDec_Allocate(&dec, p, LZMA_PROPS_SIZE, alloc))
+    LzmaDec_Init(&dec);
+    SRes res = decode_lz(d, &dec, NULL, in_size, out_size);
+    LzmaDec_Free(&dec, alloc);
+    return res;
+}
+
+/* Sequential view of the folder's pack stream for Lzma2DecMt */
+typedef struct {
+    ISeqInStream vt;
+    ILookInStreamPtr stream;
+    UInt64 remaining;
+} PackInStream;
+
+static SRes PackInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    PackInStream* p = Z7_CONTAINER_FROM_VTBL(pp, PackInStream, vt);
+    if (*size > p->remaining) *size = (size_t)p->remaining;
+    if (*size == 0) return SZ_OK;
+    SRes res = ILookInStream_Read(p->stream, buf, size);
+    p->remaining -= *size;
+    return res;
+}
+
+/* Lzma2DecMt output into the filter stage and file splitter */
+typedef struct {
+    ISeqOutStream vt;
+    FolderDecoder* d;
+    SRes res;
+} FolderSeqOutStream;
+
+static size_t FolderSeqOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    FolderSeqOutStream* p = Z7_CONTAINER_FROM_VTBL(pp, FolderSeqOutStream, vt);
+    if (p->res == SZ_OK) {
+        p->res = folder_emit(p->d, (const Byte*)data, size);
+    }
+    return p->res == SZ_OK ? size : 0;
+}
+
+/*
+ * Multi-block LZMA2 (the writers' blockSize streams) decoded on several
+ * threads; streams without block resets fall back to one thread inside
+ * Lzma2DecMt
+ */
+static SRes decode_lzma2_mt(FolderDecoder* d, Byte prop, int threads,
+                            UInt64 in_size, UInt64 out_size, ISzAllocPtr alloc) {
+    ThreadPlacer placer;
+    CLzma2DecMtHandle dec = thread_placer_init_decoder(&placer, alloc)
+        ? Lzma2DecMt_Create(&placer.small, &placer.big)
+        : Lzma2DecMt_Create(alloc, alloc);
+    if (!dec) {
+        return SZ_ERROR_MEM;
+    }
+    CLzma2DecMtProps props;
+    Lzma2DecMtProps_Init(&props);
+    props.numThreads = (unsigned)threads;
+
+    PackInStream in;
+    in.vt.Read = PackInStream_Read;
+    in.stream = d->stream;
+    in.remaining = in_size;
+    FolderSeqOutStream out;
+    out.vt.Write = FolderSeqOutStream_Write;
+    out.d = d;
+    out.res = SZ_OK;
+
+    UInt64 in_processed = 0;
+    int is_mt = 0;
+    SRes res = Lzma2DecMt_Decode(dec, prop, &props, &out.vt, &out_size, 1,
+                                 &in.vt, &in_processed, &is_mt, NULL);
+    Lzma2DecMt_Destroy(dec);
+    if (out.res != SZ_OK) {
+        return out.res;  /* CRC or sink error rather than SZ_ERROR_WRITE */
+    }
+    if (res == SZ_OK && in_processed != in_size) {
+        res = SZ_ERROR_DATA;
+    }
+    return res;
+}
+
+static UInt64 lzma2_dict_size(Byte prop) {
+    return ((UInt64)2 | (prop & 1)) << (prop / 2 + 11);
+}
+
+/* Lower the dictionary property while the smaller size still covers the folder */
+static Byte lzma2_prop_for(Byte prop, UInt64 out_size) {
+    while (prop > 0 && lzma2_dict_size((Byte)(prop - 1)) >= out_size) {
+        prop--;
+    }
+    return prop;
+}
+
+static SRes decode_lzma2(FolderDecoder* d, const Byte* props, unsigned props_size,
+                         int threads, UInt64 in_size, UInt64 out_size, ISzAllocPtr alloc) {
+    if (props_size != 1 || props[0] > 40) {
+        return SZ_ERROR_UNSUPPORTED;
+    }
+    Byte prop = lzma2_prop_for(props[0], out_size);
+    if (threads > 1) {
+        return decode_lzma2_mt(d, prop, threads, in_size, out_size, alloc);
+    }
+
+    CLzma2Dec dec;
+    Lzma2Dec_CONSTRUCT(&dec)
+    RINOK(Lzma2Dec_Allocate(&dec, prop, alloc))
+    Lzma2Dec_Init(&dec);
+    SRes res = decode_lz(d, &dec.decoder, &dec, in_size, out_size);
+    Lzma2Dec_Free(&dec, alloc);
+    return res;
+}
+
+/* IByteIn over the look stream, as in 7zDec.c */
+typedef struct {
+    IByteIn vt;
+    const Byte* cur;
+    const Byte* end;
+    const Byte* begin;
+    UInt64 processed;
+    BoolInt extra;
+    SRes res;
+    ILookInStreamPtr stream;
+} ByteInToLook;
+
+static Byte ByteInToLook_Read(IByteInPtr pp) {
+    ByteInToLook* p = Z7_CONTAINER_FROM_VTBL(pp, ByteInToLook, vt);
+    if (p->cur != p->end) {
+        return *p->cur++;
+    }
+    if (p->res == SZ_OK) {
+        size_t size = (size_t)(p->cur - p->begin);
+        p->processed += size;
+        p->res = ILookInStream_Skip(p->stream, size);
+        size = FOLDER_STREAM_INPUT_STEP;
+        if (p->res == SZ_OK) {
+            p->res = ILookInStream_Look(p->stream, (const void**)&p->begin, &size);
+        }
+        p->cur = p->begin;
+        p->end = p->begin + (p->res == SZ_OK ? size : 0);
+        if (p->cur != p->end) {
+            return *p->cur++;
+        }
+    }
+    p->extra = True;
+    return 0;
+}
+
+static SRes decode_ppmd(FolderDecoder* d, const Byte* props, unsigned props_size,
+                        UInt64 in_size, UInt64 out_size, ISzAllocPtr alloc) {
+    if (props_size != 5) {
+        return SZ_ERROR_UNSUPPORTED;
+    }
+    unsigned order = props[0];
+    UInt32 mem_size = GetUi32(props + 1);
+    if (order < PPMD7_MIN_ORDER || order > PPMD7_MAX_ORDER ||
+        mem_size < PPMD7_MIN_MEM_SIZE || mem_size > PPMD7_MAX_MEM_SIZE) {
+        return SZ_ERROR_UNSUPPORTED;
+    }
+
+    Byte* window = (Byte*)ISzAlloc_Alloc(alloc, FOLDER_STREAM_WINDOW);
+    if (!window) {
+        return SZ_ERROR_MEM;
+    }
+    CPpmd7 ppmd;
+    Ppmd7_Construct(&ppmd);
+    if (!Ppmd7_Alloc(&ppmd, mem_size, alloc)) {
+        ISzAlloc_Free(alloc, window);
+        return SZ_ERROR_MEM;
+    }
+    Ppmd7_Init(&ppmd, order);
+
+    ByteInToLook s;
+    s.vt.Read = ByteInToLook_Read;
+    s.stream = d->stream;
+    s.begin = s.end = s.cur = NULL;
+    s.extra = False;
+    s.res = SZ_OK;
+    s.processed = 0;
+
+    SRes res = SZ_OK;
+    ppmd.rc.dec.Stream = &s.vt;
+    if (!Ppmd7z_RangeDec_Init(&ppmd.rc.dec)) {
+        res = SZ_ERROR_DATA;
+    } else {
+        UInt64 out_left = out_size;
+        while (res == SZ_OK && out_left > 0 && !s.extra) {
+            size_t n = FOLDER_STREAM_WINDOW;
+            if (n > out_left) n = (size_t)out_left;
+            size_t k = 0;
+            for (; k < n; k++) {
+                int sym = Ppmd7z_DecodeSymbol(&ppmd);
+                if (s.extra || sym < 0) break;
+                window[k] = (Byte)sym;
+            }
+            if (k != n) {
+                res = SZ_ERROR_DATA;
+                break;
+            }
+            res = folder_emit(d, window, n);
+            out_left -= n;
+        }
+        if (res == SZ_OK && !s.extra && !Ppmd7z_RangeDec_IsFinishedOK(&ppmd.rc.dec)) {
+            res = SZ_ERROR_DATA;
+        }
+    }
+    if (res == SZ_OK || res == SZ_ERROR_DATA) {
+        if (s.extra) {
+            res = (s.res != SZ_OK ? s.res : SZ_ERROR_DATA);
+        } else if (res == SZ_OK && s.processed + (size_t)(s.cur - s.begin) != in_size) {
+            res = SZ_ERROR_DATA;
+        }
+    }
+
+    Ppmd7_Free(&ppmd, alloc);
+    ISzAlloc_Free(alloc, window);
+    return res;
+}
+
+static int is_main_method(UInt32 m) {
+    return m == METHOD_COPY || m == METHOD_LZMA || m == METHOD_LZMA2 || m == METHOD_PPMD;
+}
+
+static int is_filter_method(UInt32 m) {
+    switch (m) {
+        case METHOD_DELTA: case METHOD_BCJ: case METHOD_PPC: case METHOD_IA64:
+        case METHOD_SPARC: case METHOD_ARM: case METHOD_ARM64: case METHOD_ARMT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Coder indices of a streamable folder, -1 where the stage is absent */
+typedef struct {
+    int aes;
+    int main;
+    int filter;
+} FolderChain;
+
+/*
+ * Coders of one stream each in a line from the single pack stream to the
+ * folder's output: 7zAES first if encrypted, one main coder, optionally
+ * one filter after it (CheckSupportedFolder shapes plus 7zAES, in any
+ * coder order). Returns 0 for other folders.
+ */
+static int folder_chain(const CSzFolder* f, FolderChain* chain) {
+    chain->aes = chain->main = chain->filter = -1;
+    if (f->NumCoders < 1 || f->NumCoders > 3 || f->NumPackStreams != 1 ||
+        f->NumBonds != f->NumCoders - 1) {
+        return 0;
+    }
+    for (UInt32 c = 0; c < f->NumCoders; c++) {
+        if (f->Coders[c].NumStreams != 1) return 0;
+    }
+    /* With one stream per coder, in stream c is coder c's input */
+    UInt32 c = f->PackStreams[0];
+    for (UInt32 step = 0; step < f->NumCoders; step++) {
+        UInt32 m = f->Coders[c].MethodID;
+        if (step == 0 && m == METHOD_AES) {
+            chain->aes = (int)c;
+        } else if (chain->main < 0 && is_main_method(m)) {
+            chain->main = (int)c;
+        } else if (chain->main >= 0 && chain->filter < 0 && is_filter_method(m)) {
+            chain->filter = (int)c;
+        } else {
+            return 0;
+        }
+        /* On to the coder this one's output feeds */
+        UInt32 b = 0;
+        while (b < f->NumBonds && f->Bonds[b].OutIndex != c) b++;
+        if (b == f->NumBonds) {
+            return step + 1 == f->NumCoders && chain->main >= 0;
+        }
+        c = f->Bonds[b].InIndex;
+    }
+    return 0;
+}
+
+static SRes folder_filter_init(FolderFilter* f, const CSzCoderInfo* c, const Byte* props) {
+    f->method = c->MethodID;
+    f->fill = 0;
+    f->pc = 0;
+    f->x86_state = Z7_BRANCH_CONV_ST_X86_STATE_INIT_VAL;
+    if (f->method == METHOD_DELTA) {
+        if (c->PropsSize != 1) return SZ_ERROR_UNSUPPORTED;
+        f->delta_dist = (unsigned)props[0] + 1;
+        Delta_Init(f->delta_state);
+    } else if (f->method == METHOD_ARM64) {
+        if (c->PropsSize == 4) f->pc = GetUi32(props);
+        else if (c->PropsSize != 0) return SZ_ERROR_UNSUPPORTED;
+    } else if (c->PropsSize != 0) {
+        return SZ_ERROR_UNSUPPORTED;
+    }
+    return SZ_OK;
+}
+
+/* Folders outside folder_chain(): whole-folder decode into the same sink */
+static SRes decode_whole(FolderDecoder* d, const CSzArEx* db, UInt32 folder_index,
+                         ISzAllocPtr alloc) {
+    UInt64 size = SzAr_GetFolderUnpackSize(&db->db, folder_index);
+    size_t out_size = (size_t)size;
+    if (out_size != size) {
+        return SZ_ERROR_MEM;
+    }
+    Byte* buffer = (Byte*)ISzAlloc_Alloc(alloc, out_size ? out_size : 1);
+    if (!buffer) {
+        return SZ_ERROR_MEM;
+    }
+    SRes res = SzAr_DecodeFolder(&db->db, folder_index, d->stream, db->dataPos,
+                                 buffer, out_size, alloc);
+    if (res == SZ_OK) {
+        /* SzAr_DecodeFolder checked the folder CRC already */
+        d->out.check_folder_crc = 0;
+        res = folder_out_write(&d->out, buffer, out_size);
+    }
+    ISzAlloc_Free(alloc, buffer);
+    return res;
+}
+
+/*
+ * Which of the file and folder CRCs to sum for `verify`; the folder CRC
+ * only counts when the `whole` folder is decoded. A folder of one file
+ * usually stores its CRC twice, as the folder's and the file's; it is
+ * summed once.
+ */
+static void folder_out_verify(FolderOut* o, SevenZipVerifyMode verify, int whole) {
+    const CSzArEx* db = o->db;
+    UInt32 f = o->folder_index;
+    int has_folder_crc = whole && SzBitWithVals_Check(&db->db.FolderCRCs, f);
+    o->check_file_crc = verify == SEVENZIP_VERIFY_FILE ||
+                        (verify == SEVENZIP_VERIFY_FOLDER && !has_folder_crc);
+    o->check_folder_crc = verify != SEVENZIP_VERIFY_NONE && has_folder_crc;
+    if (o->check_file_crc && o->check_folder_crc) {
+        UInt32 files = 0;
+        UInt32 last = 0;
+        for (UInt32 i = db->FolderToFile[f]; i < db->FolderToFile[f + 1] && files < 2; i++) {
+            if (db->FileToFolder[i] == f && !SzArEx_IsDir(db, i)) {
+                files++;
+                last = i;
+            }
+        }
+        if (files == 1 && SzBitWithVals_Check(&db->CRCs, last) &&
+            db->CRCs.Vals[last] == db->db.FolderCRCs.Vals[f]) {
+            o->check_folder_crc = 0;
+        }
+    }
+}
+
+/* Decrypting stream of an encrypted folder's pack stream */
+static SRes folder_aes_open(AesInStream* aes, const CSzArEx* db, ILookInStreamPtr stream,
+                            UInt32 folder_index, const CSzCoderInfo* coder,
+                            const Byte* props, UInt64 plain_size, const char* password) {
+    const CSzAr* ar = &db->db;
+    AesCoderProps aes_props;
+    if (!password || !sevenzip_aes_read_props(props, coder->PropsSize, &aes_props)) {
+        return SZ_ERROR_UNSUPPORTED;
+    }
+    Byte key[AES_CODER_KEY_SIZE];
+    switch (sevenzip_aes_derive_key_props(password, &aes_props, key)) {
+        case SEVENZIP_OK: break;
+        case SEVENZIP_ERROR_MEMORY: return SZ_ERROR_MEM;
+        default: return SZ_ERROR_UNSUPPORTED;
+    }
+    const UInt64* pack = ar->PackPositions + ar->FoStartPackStreamIndex[folder_index];
+    SRes res = AesInStream_Init(aes, stream, db->dataPos + pack[0], pack[1] - pack[0],
+                                plain_size, key, aes_props.iv);
+    memset(key, 0, sizeof(key));
+    return res;
+}
+
+static SRes folder_decode(const CSzArEx* db, ILookInStreamPtr stream,
+                          UInt32 folder_index, FolderStreamSink* sink,
+                          const FolderStreamRange* range, int lzma2_threads,
+                          SevenZipVerifyMode verify, const char* password,
+                          ISzAllocPtr alloc, UInt32* crc_failed_file) {
+    const CSzAr* ar = &db->db;
+    *crc_failed_file = (UInt32)-1;
+    if (folder_index >= ar->NumFolders) {
+        return SZ_ERROR_PARAM;
+    }
+
+    CSzFolder folder;
+    CSzData sd;
+    const Byte* data = ar->CodersData + ar->FoCodersOffsets[folder_index];
+    sd.Data = data;
+    sd.Size = ar->FoCodersOffsets[(size_t)folder_index + 1] - ar->FoCodersOffsets[folder_index];
+    RINOK(SzGetNextFolderItem(&folder, &sd))
+
+    FolderDecoder d;
+    memset(&d, 0, sizeof(d));
+    d.stream = stream;
+    d.out.db = db;
+    d.out.folder_index = folder_index;
+    d.out.sink = sink;
+    d.out.next_file = db->FolderToFile[folder_index];
+    d.out.end_file = db->FolderToFile[folder_index + 1];
+    d.out.folder_crc = CRC_INIT_VAL;
+    d.out.crc_failed_file = (UInt32)-1;
+
+    /* Unpacked offset of the first wanted file */
+    UInt64 start = 0;
+    if (range) {
+        if (range->limit < d.out.end_file) {
+            d.out.end_file = range->limit;
+            d.out.partial = 1;
+        }
+        if (range->first > d.out.next_file && range->first < d.out.end_file) {
+            start = db->UnpackPositions[range->first] - db->UnpackPositions[d.out.next_file];
+            d.out.next_file = range->first;
+        }
+    }
+    d.out.skip = start;
+    folder_out_verify(&d.out, verify, !d.out.partial && start == 0);
+
+    SRes res;
+    FolderChain chain;
+    if (!folder_chain(&folder, &chain)) {
+        res = decode_whole(&d, db, folder_index, alloc);
+    } else {
+        if (chain.filter >= 0) {
+            const CSzCoderInfo* filter = &folder.Coders[chain.filter];
+            RINOK(folder_filter_init(&d.filter, filter, data + filter->PropsOffset))
+            d.filter.buf = (Byte*)ISzAlloc_Alloc(alloc, FOLDER_STREAM_WINDOW);
+            if (!d.filter.buf) {
+                return SZ_ERROR_MEM;
+            }
+            d.has_filter = 1;
+        }
+
+        const CSzCoderInfo* coder = &folder.Coders[chain.main];
+        const Byte* props = data + coder->PropsOffset;
+        const UInt64* pack = ar->PackPositions + ar->FoStartPackStreamIndex[folder_index];
+        const UInt64* unpack = ar->CoderUnpackSizes + ar->FoToCoderUnpackSizes[folder_index];
+        UInt64 in_size = pack[1] - pack[0];
+        UInt64 out_size = unpack[chain.main];
+
+        /* An encrypted folder's main coder reads the plaintext, from offset 0 */
+        AesInStream aes;
+        UInt64 in_base = db->dataPos + pack[0];
+        res = SZ_OK;
+        if (chain.aes >= 0) {
+            const CSzCoderInfo* aes_coder = &folder.Coders[chain.aes];
+            in_size = unpack[chain.aes];
+            in_base = 0;
+            res = folder_aes_open(&aes, db, stream, folder_index, aes_coder,
+                                  data + aes_coder->PropsOffset, in_size, password);
+            if (res == SZ_OK) {
+                stream = &aes.vt;
+                d.stream = stream;
+            }
+        }
+
+        /* Where decoding can begin: Copy anywhere, LZMA2 at a dictionary
+           reset; filters carry state from the folder start */
+        UInt64 pack_skip = 0;
+        UInt64 unpack_skip = 0;
+        if (res == SZ_OK && start > 0 && !d.has_filter) {
+            if (coder->MethodID == METHOD_COPY && in_size == out_size) {
+                pack_skip = unpack_skip = start;
+            } else if (coder->MethodID == METHOD_LZMA2) {
+                res = lzma2_find_reset(stream, in_base, in_size, start, &pack_skip, &unpack_skip);
+            }
+        }
+        d.out.skip = start - unpack_skip;
+        in_size -= pack_skip;
+        out_size -= unpack_skip;
+
+        if (res == SZ_OK) {
+            res = LookInStream_SeekTo(stream, in_base + pack_skip);
+        }
+        if (res == SZ_OK && coder->MethodID == METHOD_LZMA2 && lzma2_threads > 1 &&
+            (d.out.check_file_crc || d.out.check_folder_crc)) {
+            d.out.checker = crc_checker_start(d.out.check_folder_crc);
+        }
+        if (res == SZ_OK) {
+            switch (coder->MethodID) {
+                case METHOD_COPY:
+                    res = decode_copy(&d, chain.aes >= 0 ? FOLDER_OUT_NOT_STORED : in_base + pack_skip,
+                                      in_size, out_size);
+                    break;
+                case METHOD_LZMA:
+                    res = decode_lzma(&d, props, coder->PropsSize, in_size, out_size, alloc);
+                    break;
+                case METHOD_LZMA2:
+                    res = decode_lzma2(&d, props, coder->PropsSize, lzma2_threads, in_size, out_size, alloc);
+                    break;
+                default:
+                    res = decode_ppmd(&d, props, coder->PropsSize, in_size, out_size, alloc);
+                    break;
+            }
+        }
+        if (res == SZ_OK) {
+            res = folder_emit_flush(&d);
+        }
+        if (stream == &aes.vt) {
+            AesInStream_Free(&aes);
+        }
+        ISzAlloc_Free(alloc, d.filter.buf);
+    }
+
+    if (res == SZ_OK) {
+        res = folder_out_close(&d.out);
+    }
+    if (d.out.checker) {
+        res = folder_out_end_checker(&d.out, res);
+    }
+    *crc_failed_file = d.out.crc_failed_file;
+    if (res == FOLDER_OUT_DONE) {
+        return SZ_OK;  /* The rest of the folder is not wanted */
+    }
+    return res;
+}
+
+int folder_stream_reads_forward(const CSzArEx* db, UInt32 folder_index) {
+    const CSzAr* ar = &db->db;
+    CSzFolder folder;
+    CSzData sd;
+    FolderChain chain;
+    if (folder_index >= ar->NumFolders) return 0;
+    sd.Data = ar->CodersData + ar->FoCodersOffsets[folder_index];
+    sd.Size = ar->FoCodersOffsets[(size_t)folder_index + 1] - ar->FoCodersOffsets[folder_index];
+    return SzGetNextFolderItem(&folder, &sd) == SZ_OK && folder_chain(&folder, &chain);
+}
+
+SRes folder_stream_decode(const CSzArEx* db, ILookInStreamPtr stream,
+                          UInt32 folder_index, FolderStreamSink* sink,
+                          const FolderStreamRange* range, int lzma2_threads,
+                          const char* password, ISzAllocPtr alloc) {
+    UInt32 crc_failed_file;
+    return folder_decode(db, stream, folder_index, sink, range, lzma2_threads,
+                         SEVENZIP_VERIFY_FILE, password, alloc, &crc_failed_file);
+}
+
+/* LZMA2 streams have lc + lp <= 4 */
+#define LZMA2_LCLP_MAX 4
+
+/* LzmaDec probability table for lc + lp */
+static UInt64 lzma_probs_size(unsigned lc_lp) {
+    return ((UInt64)1984 + ((UInt64)0x300 << lc_lp)) * sizeof(CLzmaProb);
+}
+
+/* Lzma2DecMt's own limits: unpacked and packed bytes a thread holds per block */
+#define LZMA2_MT_OUT_BLOCK_MAX ((UInt64)1 << 28)
+#define LZMA2_MT_IN_BLOCK_MAX (LZMA2_MT_OUT_BLOCK_MAX + LZMA2_MT_OUT_BLOCK_MAX / 16)
+
+/*
+ * Decoder memory of a folder as folder_decode() allocates it: `base` on
+ * the ring decoder, `per_thread` for each Lzma2DecMt thread (0 unless
+ * the main coder is LZMA2). A folder decoded whole holds every coder's
+ * output at once.
+ */
+static void folder_memory(const CSzArEx* db, UInt32 folder_index,
+                          UInt64* base, UInt64* per_thread) {
+    const CSzAr* ar = &db->db;
+    *base = 0;
+    *per_thread = 0;
+
+    CSzFolder folder;
+    CSzData sd;
+    const Byte* data = ar->CodersData + ar->FoCodersOffsets[folder_index];
+    sd.Data = data;
+    sd.Size = ar->FoCodersOffsets[(size_t)folder_index + 1] - ar->FoCodersOffsets[folder_index];
+    if (SzGetNextFolderItem(&folder, &sd) != SZ_OK) {
+        *base = SzAr_GetFolderUnpackSize(ar, folder_index);
+        return;
+    }
+
+    const UInt64* unpack = ar->CoderUnpackSizes + ar->FoToCoderUnpackSizes[folder_index];
+    FolderChain chain;
+    if (!folder_chain(&folder, &chain)) {
+        for (UInt32 c = 0; c < folder.NumCoders; c++) {
+            const CSzCoderInfo* coder = &folder.Coders[c];
+            const Byte* props = data + coder->PropsOffset;
+            *base += unpack[c];
+            if (coder->MethodID == METHOD_LZMA && coder->PropsSize >= 1) {
+                *base += lzma_probs_size(props[0] % 9 + (props[0] / 9) % 5);
+            } else if (coder->MethodID == METHOD_LZMA2) {
+                *base += lzma_probs_size(LZMA2_LCLP_MAX);
+            } else if (coder->MethodID == METHOD_PPMD && coder->PropsSize == 5) {
+                *base += GetUi32(props + 1);
+            }
+        }
+        return;
+    }
+
+    const CSzCoderInfo* coder = &folder.Coders[chain.main];
+    const Byte* props = data + coder->PropsOffset;
+    const UInt64* pack = ar->PackPositions + ar->FoStartPackStreamIndex[folder_index];
+    UInt64 in_size = chain.aes >= 0 ? unpack[chain.aes] : pack[1] - pack[0];
+    UInt64 out_size = unpack[chain.main];
+    if (chain.filter >= 0) {
+        *base += FOLDER_STREAM_WINDOW;
+    }
+    if (chain.aes >= 0) {
+        *base += AES_IN_STREAM_MEMORY;
+    }
+    switch (coder->MethodID) {
+        case METHOD_LZMA:
+            if (coder->PropsSize == 5) {
+                *base += lzma_dict_for(GetUi32(props + 1), out_size) +
+                         lzma_probs_size(props[0] % 9 + (props[0] / 9) % 5);
+            }
+            break;
+        case METHOD_LZMA2:
+            if (coder->PropsSize == 1 && props[0] <= 40) {
+                UInt64 dict = lzma2_dict_size(lzma2_prop_for(props[0], out_size));
+                UInt64 probs = lzma_probs_size(LZMA2_LCLP_MAX);
+                UInt64 block_out = out_size < LZMA2_MT_OUT_BLOCK_MAX ? out_size : LZMA2_MT_OUT_BLOCK_MAX;
+                UInt64 block_in = in_size < LZMA2_MT_IN_BLOCK_MAX ? in_size : LZMA2_MT_IN_BLOCK_MAX;
+                *per_thread = block_out + block_in + probs;
+                *base += dict + probs;
+            }
+            break;
+        case METHOD_PPMD:
+            if (coder->PropsSize == 5) {
+                *base += (UInt64)GetUi32(props + 1) + FOLDER_STREAM_WINDOW;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Cost of a folder decoded on `threads` LZMA2 threads; Lzma2DecMt may
+ * still fall back to the ring decoder, so the dictionary stays counted */
+static UInt64 folder_memory_on(UInt64 base, UInt64 per_thread, int threads) {
+    return threads > 1 ? base + per_thread * (UInt64)threads : base;
+}
+
+typedef struct {
+    UInt64 base;
+    UInt64 per_thread;
+    UInt32 folder;
+} FolderCost;
+
+/* Keep the `limit` largest folders by base, or by per_thread cost, in descending order */
+static void folder_cost_keep(FolderCost* top, unsigned* count, unsigned limit,
+                             const FolderCost* c, int by_thread) {
+    UInt64 key = by_thread ? c->per_thread : c->base;
+    unsigned i = *count < limit ? (*count)++ : limit;
+    while (i > 0 && (by_thread ? top[i - 1].per_thread : top[i - 1].base) < key) {
+        if (i < limit) top[i] = top[i - 1];
+        i--;
+    }
+    if (i < limit) top[i] = *c;
+}
+
+/* Workers decoding the most costly folders at once, each with its look buffer */
+static UInt64 folder_costs_peak(const FolderCost* costs, unsigned count, int workers, int threads) {
+    UInt64 taken[2 * FOLDER_STREAM_MAX_WORKERS];
+    for (unsigned i = 0; i < count; i++) {
+        taken[i] = folder_memory_on(costs[i].base, costs[i].per_thread, threads);
+    }
+    UInt64 peak = (UInt64)workers * FOLDER_STREAM_INPUT_STEP;
+    for (int w = 0; w < workers; w++) {
+        unsigned best = count;
+        for (unsigned i = 0; i < count; i++) {
+            if (taken[i] != (UInt64)-1 && (best == count || taken[i] > taken[best])) best = i;
+        }
+        if (best == count) break;
+        peak += taken[best];
+        taken[best] = (UInt64)-1;
+    }
+    return peak;
+}
+
+SRes folder_stream_fit_memory(const CSzArEx* db, const FolderStreamRange* ranges,
+                              UInt64 max_memory, int* num_workers, int* lzma2_threads,
+                              UInt64* peak_bytes) {
+    int workers = *num_workers < 1 ? 1 : *num_workers;
+    int threads = *lzma2_threads < 1 ? 1 : *lzma2_threads;
+    if (workers > FOLDER_STREAM_MAX_WORKERS) workers = FOLDER_STREAM_MAX_WORKERS;
+
+    /* Whatever the thread count, the folders decoded at once are among
+       the largest by either cost */
+    FolderCost by_base[FOLDER_STREAM_MAX_WORKERS];
+    FolderCost by_thread[FOLDER_STREAM_MAX_WORKERS];
+    unsigned base_count = 0;
+    unsigned thread_count = 0;
+    for (UInt32 f = 0; f < db->db.NumFolders; f++) {
+        if (ranges && ranges[f].first >= ranges[f].limit) continue;
+        FolderCost c;
+        c.folder = f;
+        folder_memory(db, f, &c.base, &c.per_thread);
+        folder_cost_keep(by_base, &base_count, (unsigned)workers, &c, 0);
+        if (c.per_thread > 0) {
+            folder_cost_keep(by_thread, &thread_count, (unsigned)workers, &c, 1);
+        }
+    }
+    FolderCost costs[2 * FOLDER_STREAM_MAX_WORKERS];
+    unsigned count = 0;
+    for (unsigned i = 0; i < base_count; i++) costs[count++] = by_base[i];
+    for (unsigned i = 0; i < thread_count; i++) {
+        unsigned j = 0;
+        while (j < base_count && by_base[j].folder != by_thread[i].folder) j++;
+        if (j == base_count) costs[count++] = by_thread[i];
+    }
+
+    /* Fewer LZMA2 threads first, then fewer folders at once */
+    UInt64 peak = folder_costs_peak(costs, count, workers, threads);
+    while (max_memory > 0 && peak > max_memory && (threads > 1 || workers > 1)) {
+        if (threads > 1) threads--;
+        else workers--;
+        peak = folder_costs_peak(costs, count, workers, threads);
+    }
+    if (peak_bytes) *peak_bytes = peak;
+    if (max_memory > 0 && peak > max_memory) {
+        return SZ_ERROR_MEM;
+    }
+    *num_workers = workers;
+    *lzma2_threads = threads;
+    return SZ_OK;
+}
+
+typedef struct FolderPool FolderPool;
+
+typedef struct {
+    CThread thread;
+    FolderPool* pool;
+    FolderStreamWorker* worker;
+} FolderPoolThread;
+
+struct FolderPool {
+    const CSzArEx* db;
+    const FolderStreamRange* ranges;
+    int lzma2_threads;
+    SevenZipVerifyMode verify;
+    const char* password;
+    ISzAllocPtr alloc;
+    CCriticalSection lock;
+    UInt32 next_folder;
+    int stop;
+    SRes res;
+    UInt32 failed_folder;
+    int failed_worker;
+    FolderStreamWorker* workers;
+};
+
+static void folder_pool_run(FolderPool* pool, int index) {
+    FolderStreamWorker* w = &pool->workers[index];
+    for (;;) {
+        const CSzArEx* db = pool->db;
+        CriticalSection_Enter(&pool->lock);
+        UInt32 f = pool->next_folder;
+        /* Folders with nothing wanted are never read */
+        while (pool->ranges && f < db->db.NumFolders &&
+               pool->ranges[f].first >= pool->ranges[f].limit) {
+            f++;
+        }
+        int done = pool->stop || f >= db->db.NumFolders;
+        pool->next_folder = done ? f : f + 1;
+        CriticalSection_Leave(&pool->lock);
+        if (done) break;
+
+        UInt32 crc_failed_file;
+        SRes res = folder_decode(db, w->stream, f, w->sink,
+                                 pool->ranges ? &pool->ranges[f] : NULL,
+                                 pool->lzma2_threads, pool->verify, pool->password,
+                                 pool->alloc, &crc_failed_file);
+        if (res != SZ_OK) {
+            w->crc_failed_file = crc_failed_file;
+            CriticalSection_Enter(&pool->lock);
+            pool->stop = 1;
+            if (pool->res == SZ_OK || f < pool->failed_folder) {
+                pool->res = res;
+                pool->failed_folder = f;
+                pool->failed_worker = index;
+            }
+            CriticalSection_Leave(&pool->lock);
+            break;
+        }
+    }
+}
+
+static THREAD_FUNC_DECL FolderPool_Thread(void* arg) {
+    FolderPoolThread* t = (FolderPoolThread*)arg;
+    thread_sched_enter();
+    folder_pool_run(t->pool, (int)(t->worker - t->pool->workers));
+    return THREAD_FUNC_RET_ZERO;
+}
+
+SRes folder_stream_decode_folders(const CSzArEx* db, FolderStreamWorker* workers,
+                                  int num_workers, const FolderStreamRange* ranges,
+                                  int lzma2_threads, SevenZipVerifyMode verify,
+                                  const char* password, ISzAllocPtr alloc,
+                                  int* failed_worker) {
+    if (failed_worker) *failed_worker = 0;
+    if (num_workers < 1 || num_workers > FOLDER_STREAM_MAX_WORKERS) {
+        return SZ_ERROR_PARAM;
+    }
+    if ((UInt32)num_workers > db->db.NumFolders) {
+        num_workers = db->db.NumFolders > 0 ? (int)db->db.NumFolders : 1;
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        workers[i].crc_failed_file = (UInt32)-1;
+    }
+
+    FolderPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.db = db;
+    pool.ranges = ranges;
+    pool.lzma2_threads = lzma2_threads;
+    pool.verify = verify;
+    pool.password = password;
+    pool.alloc = alloc;
+    pool.workers = workers;
+    if (CriticalSection_Init(&pool.lock) != 0) {
+        return SZ_ERROR_THREAD;
+    }
+
+    /* Threads that fail to start leave their share to the others */
+    FolderPoolThread threads[FOLDER_STREAM_MAX_WORKERS];
+    int started = 0;
+    for (int i = 1; i < num_workers; i++) {
+        FolderPoolThread* t = &threads[started];
+        t->pool = &pool;
+        t->worker = &workers[i];
+        Thread_CONSTRUCT(&t->thread)
+        if (Thread_Create(&t->thread, FolderPool_Thread, t) != 0) break;
+        started++;
+    }
+
+    folder_pool_run(&pool, 0);
+
+    for (int i = 0; i < started; i++) {
+        Thread_Wait_Close(&threads[i].thread);
+    }
+    CriticalSection_Delete(&pool.lock);
+
+    if (failed_worker) *failed_worker = pool.failed_worker;
+    return pool.res;
+}
+
+void folder_stream_entry_bytes(const CSzArEx* db, const Byte* selected,
+                               uint64_t* packed, uint64_t* unpacked) {
+    UInt32 last_folder = (UInt32)-1;
+    for (UInt32 i = 0; i < db->NumFiles; i++) {
+        if ((selected && !selected[i]) || SzArEx_IsDir(db, i)) continue;
+        *unpacked += SzArEx_GetFileSize(db, i);
+        UInt32 folder = db->FileToFolder[i];
+        /* A folder's files are consecutive: counted once at its first */
+        if (folder == (UInt32)-1 || folder == last_folder) continue;
+        last_folder = folder;
+        UInt32 first = db->db.FoStartPackStreamIndex[folder];
+        UInt32 limit = db->db.FoStartPackStreamIndex[folder + 1];
+        *packed += db->db.PackPositions[limit] - db->db.PackPositions[first];
+    }
+}
@@ -0,0 +1,169 @@
+/**
+ * Folder Stream Decoder - Internal Header
+ *
+ * Decodes one 7z folder front to back and hands each file's bytes to a
+ * sink as they come out, checking every file CRC on the way, instead of
+ * decoding the whole folder into one buffer the way SzArEx_Extract does.
+ * Memory is the coder state (LZMA/LZMA2 dictionary capped at the folder
+ * size, PPMd model) plus a fixed FOLDER_STREAM_WINDOW, whatever the folder
+ * size. Folders the streaming path does not cover (BCJ2) are decoded
+ * whole and passed to the same sink. Encrypted (7zAES) folders stream
+ * when a password is given.
+ */
+
+#ifndef SEVENZIP_FOLDER_STREAM_H
+#define SEVENZIP_FOLDER_STREAM_H
+
+#include "../include/7z_ffi.h"
+#include "7z.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Staging buffer of the branch/Delta filter stage and of PPMd output */
+#define FOLDER_STREAM_WINDOW (4 << 20)
+
+/* Input taken from the look stream per decoder call */
+#define FOLDER_STREAM_INPUT_STEP (1 << 18)
+
+/*
+ * Receiver of a folder's files, in archive order. Directories are not
+ * passed on. Implementations embed the struct and recover themselves with
+ * Z7_CONTAINER_FROM_VTBL.
+ */
+typedef struct FolderStreamSink FolderStreamSink;
+struct FolderStreamSink {
+    SRes (*Begin)(FolderStreamSink* p, UInt32 file_index);
+    SRes (*Write)(FolderStreamSink* p, const Byte* data, size_t size);
+    /* Called once all bytes of the file are out and its CRC matched; for a
+     * folder decoded on lzma2_threads > 1 threads, once its bytes are out
+     * and its CRC is being checked behind the decoders, a mismatch failing
+     * a later call or the folder's end with SZ_ERROR_CRC */
+    SRes (*End)(FolderStreamSink* p, UInt32 file_index);
+    /* Optional (NULL: Write is called): in place of Write for bytes of a
+     * Copy folder without a filter, which sit unchanged at `offset` of the
+     * packed stream; `data` views them there and they are CRC-summed as
+     * any others */
+    SRes (*WriteStored)(FolderStreamSink* p, UInt64 offset, const Byte* data, size_t size);
+};
+
+/*
+ * Files [first, limit) of a folder that the caller needs. Decoding starts
+ * as close before `first` as the coder allows (at `first` for Copy, at the
+ * last LZMA2 dictionary reset for LZMA2) and stops once the file before
+ * `limit` is out. The folder CRC is only checked when the whole folder
+ * is decoded; every file passed on is CRC-checked unless the caller asked
+ * for less (folder_stream_decode_folders()).
+ */
+typedef struct {
+    UInt32 first;
+    UInt32 limit;
+} FolderStreamRange;
+
+/**
+ * Decode a folder into a sink
+ * With lzma2_threads > 1, LZMA2 folders go through Lzma2DecMt, which
+ * decodes the blocks of multi-block streams in parallel; it holds up to
+ * one unpacked block per thread instead of the capped dictionary.
+ * @param db Opened archive
+ * @param stream Look stream the archive was opened from
+ * @param folder_index Folder to decode
+ * @param sink Receiver of the folder's files
+ * @param range Files wanted from the folder (NULL for all of them)
+ * @param lzma2_threads Decoder threads for an LZMA2 folder (1 = ring decoder)
+ * @param password Password of 7zAES folders (NULL if none); a wrong one
+ *        fails as corrupt data would
+ * @param alloc Thread-safe allocator for coder state and buffers
+ * @return SZ_OK, SZ_ERROR_CRC, SZ_ERROR_DATA, SZ_ERROR_UNSUPPORTED
+ *         (e.g. encrypted without a password), SZ_ERROR_MEM, or an error
+ *         returned by the sink
+ */
+SRes folder_stream_decode(const CSzArEx* db, ILookInStreamPtr stream,
+                          UInt32 folder_index, FolderStreamSink* sink,
+                          const FolderStreamRange* range, int lzma2_threads,
+                          const char* password, ISzAllocPtr alloc);
+
+/*
+ * 1 if the folder streams: decoding it whole seeks once to its pack start
+ * and then only reads forward, without ranges or lookups back. Folders
+ * decoded whole (BCJ2) may seek anywhere in their pack streams.
+ */
+int folder_stream_reads_forward(const CSzArEx* db, UInt32 folder_index);
+
+/* Workers when the caller asks for "auto", and the hard cap */
+#define FOLDER_STREAM_DEFAULT_WORKERS 4
+#define FOLDER_STREAM_MAX_WORKERS 64
+
+/*
+ * One decoding thread's view of the archive: its own positioned reader
+ * (a separate handle on the same file) and its own sink.
+ */
+typedef struct {
+    ILookInStreamPtr stream;
+    FolderStreamSink* sink;
+    UInt32 crc_failed_file;  /* Output: the file whose CRC failed, (UInt32)-1 if none did */
+} FolderStreamWorker;
+
+/**
+ * Decode every folder of an archive, sharing the folders out among workers
+ * Folders are handed out in index order to whichever worker is free, so
+ * each sink sees whole folders in archive order but folders finish out of
+ * order across sinks. Worker 0 runs on the calling thread; with one worker
+ * no thread is started. After an error no new folder is started.
+ * @param db Opened archive
+ * @param workers Reader and sink per worker
+ * @param num_workers Number of workers (1 to FOLDER_STREAM_MAX_WORKERS)
+ * @param ranges Per folder, the files wanted; folders with an empty range
+ *        are skipped (NULL to decode every file of every folder)
+ * @param lzma2_threads Decoder threads per LZMA2 folder, see folder_stream_decode()
+ * @param verify CRCs to check; folder_stream_decode() checks as SEVENZIP_VERIFY_FILE
+ * @param password Password of 7zAES folders (NULL if none)
+ * @param alloc Thread-safe allocator for coder state and buffers
+ * @param failed_worker Output: worker that hit the returned error (may be NULL)
+ * @return SZ_OK, or the error of the lowest-numbered failed folder
+ */
+SRes folder_stream_decode_folders(const CSzArEx* db, FolderStreamWorker* workers,
+                                  int num_workers, const FolderStreamRange* ranges,
+                                  int lzma2_threads, SevenZipVerifyMode verify,
+                                  const char* password, ISzAllocPtr alloc,
+                                  int* failed_worker);
+
+/**
+ * Estimate and cap the decoder memory of folder_stream_decode_folders()
+ * Each folder costs its coder state as folder_stream_decode() allocates
+ * it, sized from the coder props and capped at the folder size as the
+ * decoders cap it, plus the decryption slots of an encrypted one; the peak is that of the costliest folders decoded at
+ * once plus a look buffer per worker. A folder on Lzma2DecMt threads
+ * counts a block of up to 256MB, packed and unpacked, per thread, so
+ * the estimate is an upper bound. Nothing is allocated.
+ * @param db Opened archive
+ * @param ranges As for folder_stream_decode_folders() (NULL for every folder)
+ * @param max_memory Budget in bytes; over it, LZMA2 threads are lowered
+ *        first, then workers (0 = no limit, estimate only)
+ * @param num_workers In: workers to run; out: workers that fit
+ * @param lzma2_threads In: decoder threads per LZMA2 folder; out: threads that fit
+ * @param peak_bytes Output: estimated peak at the counts returned, or on
+ *        SZ_ERROR_MEM at one worker and thread (may be NULL)
+ * @return SZ_OK, or SZ_ERROR_MEM if one folder alone on one thread exceeds
+ *         max_memory (the counts are then left as they were)
+ */
+SRes folder_stream_fit_memory(const CSzArEx* db, const FolderStreamRange* ranges,
+                              UInt64 max_memory, int* num_workers, int* lzma2_threads,
+                              UInt64* peak_bytes);
+
+/**
+ * Add the bytes of decoding the entries `selected` marks (NULL = all;
+ * directories are skipped) to `*packed`, the packed sizes of the folders
+ * holding them, and `*unpacked`, their own sizes
+ */
+void folder_stream_entry_bytes(const CSzArEx* db, const Byte* selected,
+                               uint64_t* packed, uint64_t* unpacked);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_FOLDER_STREAM_H */
@@ -0,0 +1,61 @@
+/**
+ * Global Tables
+ *
+ * CrcGenerateTable(), Crc64GenerateTable(), AesGenTables(), Sha256Prepare(),
+ * xxh3_prepare(), cdc_prepare() and parity_prepare() fill lookup tables and pick the
+ * hardware block functions (g_CrcUpdate, g_AesCbc_*, ...) with plain stores. Two threads
+ * running them at once race even though they store the same values, and
+ * a reader may see a half-built table, so they run exactly once, before
+ * the first thread that needs them goes on.
+ */
+
+#include "global_tables.h"
+#include "7zCrc.h"
+#include "XzCrc64.h"
+#include "Aes.h"
+#include "Sha256.h"
+#include "xxh3.h"
+#include "cdc_chunker.h"
+#include "parity_volumes.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+static void generate_tables(void) {
+    CrcGenerateTable();
+    Crc64GenerateTable();
+    AesGenTables();
+    Sha256Prepare();
+    xxh3_prepare();
+    cdc_prepare();
+    parity_prepare();
+}
+
+#ifdef _WIN32
+
+static INIT_ONCE g_tables_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK generate_tables_once(PINIT_ONCE once, PVOID param, PVOID* context) {
+    (void)once;
+    (void)param;
+    (void)context;
+    generate_tables();
+    return TRUE;
+}
+
+void global_tables_init(void) {
+    InitOnceExecuteOnce(&g_tables_once, generate_tables_once, NULL, NULL);
+}
+
+#else
+
+static pthread_once_t g_tables_once = PTHREAD_ONCE_INIT;
+
+void global_tables_init(void) {
+    pthread_once(&g_tables_once, generate_tables);
+}
+
+#endif
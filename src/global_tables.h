@@ -0,0 +1,26 @@
+/**
+ * Global Tables - Internal Header
+ *
+ * One-time setup of the SDK's CRC, AES and SHA-256 tables and the CPU
+ * feature dispatch behind them and behind XXH3. Every entry point that
+ * reaches those coders calls global_tables_init() first; later calls
+ * return at once.
+ */
+
+#ifndef SEVENZIP_GLOBAL_TABLES_H
+#define SEVENZIP_GLOBAL_TABLES_H
+
+#include "../include/7z_ffi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Build the tables on the first call; safe from any number of threads */
+void global_tables_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_GLOBAL_TABLES_H */
@@ -0,0 +1,133 @@
+/**
+ * Derived Key Cache
+ *
+ * A small array searched linearly under one lock; the lock is never held
+ * while a key is being derived, so two threads missing on the same entry
+ * both derive it and the second store refreshes the first.
+ */
+
+#include "key_cache.h"
+#include "global_tables.h"
+#include "metrics.h"
+#include "Aes.h"
+#include "Sha256.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    static SRWLOCK g_lock = SRWLOCK_INIT;
+    #define KEY_CACHE_LOCK() AcquireSRWLockExclusive(&g_lock)
+    #define KEY_CACHE_UNLOCK() ReleaseSRWLockExclusive(&g_lock)
+#else
+    #include <pthread.h>
+    static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+    #define KEY_CACHE_LOCK() pthread_mutex_lock(&g_lock)
+    #define KEY_CACHE_UNLOCK() pthread_mutex_unlock(&g_lock)
+#endif
+
+typedef struct {
+    int used;
+    KeyCacheKdf kdf;
+    uint8_t password_hash[SHA256_DIGEST_SIZE];
+    uint8_t salt[KEY_CACHE_MAX_SALT];
+    size_t salt_len;
+    uint32_t iterations;
+    uint8_t key[KEY_CACHE_KEY_SIZE];
+    uint64_t last_use;
+} KeyCacheEntry;
+
+static KeyCacheEntry g_entries[KEY_CACHE_ENTRIES];
+static uint64_t g_clock = 0;
+
+void key_cache_zero(void* p, size_t size) {
+    volatile uint8_t* v = (volatile uint8_t*)p;
+    while (size--) *v++ = 0;
+}
+
+static void hash_password(const char* password, uint8_t* digest) {
+    CSha256 sha;
+    Sha256_Init(&sha);
+    Sha256_Update(&sha, (const Byte*)password, strlen(password));
+    Sha256_Final(&sha, digest);
+    key_cache_zero(&sha, sizeof(sha));
+}
+
+/* Caller holds the lock */
+static KeyCacheEntry* find_entry(KeyCacheKdf kdf, const uint8_t* password_hash,
+                                 const uint8_t* salt, size_t salt_len,
+                                 uint32_t iterations) {
+    for (int i = 0; i < KEY_CACHE_ENTRIES; i++) {
+        KeyCacheEntry* e = &g_entries[i];
+        if (e->used && e->kdf == kdf && e->iterations == iterations &&
+            e->salt_len == salt_len &&
+            (salt_len == 0 || memcmp(e->salt, salt, salt_len) == 0) &&
+            memcmp(e->password_hash, password_hash, SHA256_DIGEST_SIZE) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+int key_cache_lookup(KeyCacheKdf kdf, const char* password,
+                     const uint8_t* salt, size_t salt_len,
+                     uint32_t iterations, uint8_t* key) {
+    /* Selects the SHA-NI / ARMv8 block functions of Sha256Opt.c */
+    global_tables_init();
+
+    if (salt_len > KEY_CACHE_MAX_SALT) return 0;
+
+    uint8_t password_hash[SHA256_DIGEST_SIZE];
+    hash_password(password, password_hash);
+
+    int hit = 0;
+    KEY_CACHE_LOCK();
+    KeyCacheEntry* e = find_entry(kdf, password_hash, salt, salt_len, iterations);
+    if (e) {
+        memcpy(key, e->key, KEY_CACHE_KEY_SIZE);
+        e->last_use = ++g_clock;
+        hit = 1;
+    }
+    KEY_CACHE_UNLOCK();
+    metrics_cache_lookup(SEVENZIP_METRIC_CACHE_KEY, hit);
+
+    key_cache_zero(password_hash, sizeof(password_hash));
+    return hit;
+}
+
+void key_cache_store(KeyCacheKdf kdf, const char* password,
+                     const uint8_t* salt, size_t salt_len,
+                     uint32_t iterations, const uint8_t* key) {
+    if (salt_len > KEY_CACHE_MAX_SALT) return;
+
+    uint8_t password_hash[SHA256_DIGEST_SIZE];
+    hash_password(password, password_hash);
+
+    KEY_CACHE_LOCK();
+    KeyCacheEntry* e = find_entry(kdf, password_hash, salt, salt_len, iterations);
+    if (!e) {
+        e = &g_entries[0];
+        for (int i = 0; i < KEY_CACHE_ENTRIES; i++) {
+            if (!g_entries[i].used) { e = &g_entries[i]; break; }
+            if (g_entries[i].last_use < e->last_use) e = &g_entries[i];
+        }
+        key_cache_zero(e, sizeof(*e));
+        e->used = 1;
+        e->kdf = kdf;
+        memcpy(e->password_hash, password_hash, SHA256_DIGEST_SIZE);
+        if (salt_len > 0) memcpy(e->salt, salt, salt_len);
+        e->salt_len = salt_len;
+        e->iterations = iterations;
+    }
+    memcpy(e->key, key, KEY_CACHE_KEY_SIZE);
+    e->last_use = ++g_clock;
+    KEY_CACHE_UNLOCK();
+
+    key_cache_zero(password_hash, sizeof(password_hash));
+}
+
+void sevenzip_clear_key_cache(void) {
+    KEY_CACHE_LOCK();
+    key_cache_zero(g_entries, sizeof(g_entries));
+    KEY_CACHE_UNLOCK();
+}
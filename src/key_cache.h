@@ -0,0 +1,54 @@
+/**
+ * Derived Key Cache - Internal Header
+ *
+ * Process-wide cache of password-derived AES keys, keyed by the SHA-256 of
+ * the password, the salt and the iteration count, so repeated opens of
+ * archives sharing a password skip the key stretching. Shared by the
+ * PBKDF2 helpers of encryption_aes.c and the 7zAES coder. Entries are
+ * zeroized on eviction and by sevenzip_clear_key_cache().
+ */
+
+#ifndef SEVENZIP_KEY_CACHE_H
+#define SEVENZIP_KEY_CACHE_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KEY_CACHE_ENTRIES 16
+#define KEY_CACHE_KEY_SIZE 32
+#define KEY_CACHE_MAX_SALT 64
+
+/* Derivation schemes; the same password and salt give different keys */
+typedef enum {
+    KEY_CACHE_KDF_PBKDF2 = 1,  /* derive_key_from_password() */
+    KEY_CACHE_KDF_7ZAES = 2    /* sevenzip_aes_derive_key() */
+} KeyCacheKdf;
+
+/**
+ * Look up a derived key. The first call also selects the SHA-256 and AES
+ * code paths (Sha256Prepare, AesGenTables), so callers may derive right
+ * after a miss.
+ * @return 1 and fills `key` (KEY_CACHE_KEY_SIZE bytes) on a hit, 0 on a miss
+ */
+int key_cache_lookup(KeyCacheKdf kdf, const char* password,
+                     const uint8_t* salt, size_t salt_len,
+                     uint32_t iterations, uint8_t* key);
+
+/* Remember a derived key, evicting the least recently used entry */
+void key_cache_store(KeyCacheKdf kdf, const char* password,
+                     const uint8_t* salt, size_t salt_len,
+                     uint32_t iterations, const uint8_t* key);
+
+/* Zero memory in a way the compiler cannot drop */
+void key_cache_zero(void* p, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_KEY_CACHE_H */
@@ -0,0 +1,211 @@
+/**
+ * Large-Page Allocation
+ *
+ * Match finders and dictionaries of 64MB and more are walked in a random
+ * order, so with 4KB pages most probes miss the TLB. Blocks of at least
+ * LARGE_PAGE_MIN_ALLOC are mapped with huge pages when enabled:
+ *
+ *   Linux:   explicit MAP_HUGETLB pages, else a huge-page aligned mapping
+ *            with madvise(MADV_HUGEPAGE) for transparent huge pages
+ *   Windows: VirtualAlloc(MEM_LARGE_PAGES), needs SeLockMemoryPrivilege
+ *
+ * Huge-page blocks are remembered in a small table so the free side can
+ * tell them from blocks of the wrapped allocator.
+ */
+
+#include "large_pages.h"
+#include "mem_alloc.h"
+#include "Threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #define LARGE_PAGES_SUPPORTED 1
+#elif defined(__linux__)
+    #include <sys/mman.h>
+    #define LARGE_PAGES_SUPPORTED 1
+#else
+    #define LARGE_PAGES_SUPPORTED 0
+#endif
+
+#define LARGE_PAGE_DEFAULT_SIZE ((size_t)2 * 1024 * 1024)
+
+typedef struct {
+    void* base;   /* Start of the mapping */
+    size_t size;  /* Length of the mapping */
+} LargePageBlock;
+
+static volatile int g_large_pages_enabled = 0;
+static int g_lock_ready = 0;
+static size_t g_page_size = LARGE_PAGE_DEFAULT_SIZE;
+static CCriticalSection g_lock;
+static LargePageBlock g_blocks[LARGE_PAGE_MAX_BLOCKS];
+static size_t g_block_count = 0;
+
+#if LARGE_PAGES_SUPPORTED
+
+#ifdef _WIN32
+
+/* Large pages need SeLockMemoryPrivilege enabled on the process token */
+static int enable_lock_memory_privilege(void) {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return 0;
+    }
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    int ok = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+             AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL) &&
+             GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return ok;
+}
+
+static int detect_page_size(void) {
+    SIZE_T size = GetLargePageMinimum();
+    if (size == 0 || (size & (size - 1)) != 0) return 0;
+    if (!enable_lock_memory_privilege()) return 0;
+    g_page_size = size;
+    return 1;
+}
+
+static void* map_huge(size_t size, size_t* mapped) {
+    size_t len = (size + g_page_size - 1) & ~(g_page_size - 1);
+    void* p = VirtualAlloc(NULL, len, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+    *mapped = len;
+    return p;
+}
+
+static void unmap_huge(void* base, size_t size) {
+    (void)size;
+    VirtualFree(base, 0, MEM_RELEASE);
+}
+
+#else /* __linux__ */
+
+/* Huge page size from /proc/meminfo ("Hugepagesize:    2048 kB") */
+static int detect_page_size(void) {
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (f) {
+        char line[128];
+        unsigned long kb;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1 && kb != 0 &&
+                (kb & (kb - 1)) == 0) {
+                g_page_size = (size_t)kb * 1024;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return 1;
+}
+
+static void* map_huge(size_t size, size_t* mapped) {
+    size_t len = (size + g_page_size - 1) & ~(g_page_size - 1);
+
+#ifdef MAP_HUGETLB
+    /* Explicit pages from the reserved pool (vm.nr_hugepages) */
+    void* p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        *mapped = len;
+        return p;
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    /* Transparent huge pages: over-map, trim to a huge-page boundary so
+     * the kernel can back whole pages, then ask for them */
+    size_t span = len + g_page_size;
+    char* raw = (char*)mmap(NULL, span, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == (char*)MAP_FAILED) return NULL;
+
+    char* aligned = (char*)(((size_t)raw + g_page_size - 1) & ~(g_page_size - 1));
+    size_t head = (size_t)(aligned - raw);
+    size_t tail = span - head - len;
+    if (head) munmap(raw, head);
+    if (tail) munmap(aligned + len, tail);
+
+    madvise(aligned, len, MADV_HUGEPAGE);
+    *mapped = len;
+    return aligned;
+#else
+    return NULL;
+#endif
+}
+
+static void unmap_huge(void* base, size_t size) {
+    munmap(base, size);
+}
+
+#endif
+
+#endif /* LARGE_PAGES_SUPPORTED */
+
+void* large_page_alloc(ISzAllocPtr base, size_t size) {
+#if LARGE_PAGES_SUPPORTED
+    if (g_large_pages_enabled && size >= LARGE_PAGE_MIN_ALLOC) {
+        CriticalSection_Enter(&g_lock);
+        if (g_block_count < LARGE_PAGE_MAX_BLOCKS) {
+            size_t mapped = 0;
+            void* p = map_huge(size, &mapped);
+            if (p) {
+                g_blocks[g_block_count].base = p;
+                g_blocks[g_block_count].size = mapped;
+                g_block_count++;
+                CriticalSection_Leave(&g_lock);
+                return p;
+            }
+        }
+        CriticalSection_Leave(&g_lock);
+    }
+#endif
+    return ISzAlloc_Alloc(base, size);
+}
+
+void large_page_free(ISzAllocPtr base, void* address) {
+    if (!address) return;
+#if LARGE_PAGES_SUPPORTED
+    if (g_lock_ready) {
+        CriticalSection_Enter(&g_lock);
+        for (size_t i = 0; i < g_block_count; i++) {
+            if (g_blocks[i].base == address) {
+                LargePageBlock block = g_blocks[i];
+                g_blocks[i] = g_blocks[--g_block_count];
+                CriticalSection_Leave(&g_lock);
+                unmap_huge(block.base, block.size);
+                return;
+            }
+        }
+        CriticalSection_Leave(&g_lock);
+    }
+#endif
+    ISzAlloc_Free(base, address);
+}
+
+SevenZipErrorCode sevenzip_set_large_pages(int enable) {
+    /* Pooled decoder blocks were mapped under the old setting */
+    mem_pool_trim();
+    if (!enable) {
+        /* Blocks already mapped stay tracked until they are freed */
+        g_large_pages_enabled = 0;
+        return SEVENZIP_OK;
+    }
+
+#if LARGE_PAGES_SUPPORTED
+    if (!g_lock_ready) {
+        if (CriticalSection_Init(&g_lock) != 0) return SEVENZIP_ERROR_MEMORY;
+        g_lock_ready = 1;
+    }
+    if (!detect_page_size()) return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+    g_large_pages_enabled = 1;
+    return SEVENZIP_OK;
+#else
+    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+#endif
+}
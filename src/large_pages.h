@@ -0,0 +1,37 @@
+/**
+ * Large-Page Allocation - Internal Header
+ *
+ * Allocation that backs big encoder and decoder buffers (match finder,
+ * dictionary, PPMd model) with huge pages once sevenzip_set_large_pages()
+ * has enabled them. Small requests, and any request the OS refuses, go to
+ * the wrapped allocator unchanged. mem_alloc.c decides which blocks try.
+ */
+
+#ifndef SEVENZIP_LARGE_PAGES_H
+#define SEVENZIP_LARGE_PAGES_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Requests below this size never use huge pages */
+#define LARGE_PAGE_MIN_ALLOC (4 * 1024 * 1024)
+
+/* Most huge-page blocks tracked at once; later ones fall back */
+#define LARGE_PAGE_MAX_BLOCKS 256
+
+/**
+ * Allocate `size` bytes with huge pages when enabled and the block is big
+ * enough, else from `base`. Free with large_page_free() and the same base.
+ */
+void* large_page_alloc(ISzAllocPtr base, size_t size);
+void large_page_free(ISzAllocPtr base, void* address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_LARGE_PAGES_H */
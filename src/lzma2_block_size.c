@@ -0,0 +1,42 @@
+/**
+ * LZMA2 Block Size
+ *
+ * One block per thread is the target; the encoder hands blocks out in
+ * order, so more blocks than threads only help when blocks compress at
+ * very different speeds, and each extra block costs ratio at its start.
+ */
+
+#include "lzma2_block_size.h"
+
+uint64_t sevenzip_lzma2_block_size(uint64_t data_size, int block_threads,
+                                   uint32_t dict_size, uint64_t ceiling) {
+    if (block_threads <= 1 || data_size == 0 || data_size == UINT64_MAX) return ceiling;
+
+    uint64_t block = (data_size + (uint64_t)block_threads - 1) / (uint64_t)block_threads;
+    uint64_t floor = dict_size > LZMA2_BLOCK_SIZE_STEP ? dict_size : LZMA2_BLOCK_SIZE_STEP;
+    if (block < floor) block = floor;
+    block = (block + LZMA2_BLOCK_SIZE_STEP - 1) & ~(LZMA2_BLOCK_SIZE_STEP - 1);
+    return block < ceiling ? block : ceiling;
+}
+
+void sevenzip_lzma2_spread_blocks(CLzma2EncProps* props, uint64_t data_size) {
+    Lzma2EncProps_Normalize(props);
+    if (props->blockSize == LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID) return;
+
+    uint64_t block = sevenzip_lzma2_block_size(data_size, props->numBlockThreads_Max,
+                                               props->lzmaProps.dictSize, props->blockSize);
+    if (block < props->blockSize) {
+        props->blockSize = block;
+        Lzma2EncProps_Normalize(props);
+    }
+}
+
+void sevenzip_lzma2_fixed_blocks(CLzma2EncProps* props) {
+    if (props->blockSize == LZMA2_ENC_PROPS_BLOCK_SIZE_AUTO) {
+        CLzma2EncProps multi = *props;
+        multi.numBlockThreads_Max = 2;
+        Lzma2EncProps_Normalize(&multi);
+        props->blockSize = multi.blockSize;
+    }
+    Lzma2EncProps_Normalize(props);
+}
@@ -0,0 +1,57 @@
+/**
+ * LZMA2 Block Size - Internal Header
+ *
+ * Block threads of the LZMA2 encoder each compress one block at a time,
+ * so a job with fewer blocks than threads leaves some of them idle. The
+ * block size is picked from the input size, the block threads and the
+ * dictionary: small enough that every thread gets a block, never smaller
+ * than the dictionary, since each block starts with an empty one.
+ */
+
+#ifndef SEVENZIP_LZMA2_BLOCK_SIZE_H
+#define SEVENZIP_LZMA2_BLOCK_SIZE_H
+
+#include "../include/7z_ffi.h"
+#include "Lzma2Enc.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Block sizes are whole multiples of this */
+#define LZMA2_BLOCK_SIZE_STEP ((uint64_t)1 << 20)
+
+/**
+ * Block size that spreads `data_size` bytes over the block threads
+ * @param data_size Bytes the encoder will see (UINT64_MAX = unknown)
+ * @param block_threads Block threads of the encoder
+ * @param dict_size Dictionary size
+ * @param ceiling Largest block size to return (the one configured)
+ * @return Block size in bytes, `ceiling` when it already gives every
+ *         thread a block or the input size is unknown
+ */
+uint64_t sevenzip_lzma2_block_size(uint64_t data_size, int block_threads,
+                                   uint32_t dict_size, uint64_t ceiling);
+
+/**
+ * Normalize props and shrink their block size with sevenzip_lzma2_block_size()
+ * Solid (single-block) and single-threaded properties are only normalized;
+ * the block size never grows, so memory fitted to max_memory still holds.
+ */
+void sevenzip_lzma2_spread_blocks(CLzma2EncProps* props, uint64_t data_size);
+
+/**
+ * Normalize props with a block size that does not depend on the threads
+ * An auto block size, which the encoder makes solid on one block thread,
+ * becomes the size it picks for several, 4x the dictionary within 1MB
+ * to 256MB, so the output is the same on any number (deterministic
+ * output); solid and set block sizes are kept.
+ */
+void sevenzip_lzma2_fixed_blocks(CLzma2EncProps* props);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_LZMA2_BLOCK_SIZE_H */
@@ -1,8 +1,13 @@
 #include "7z_ffi.h"
 #include "7zFile.h"
-#include "7zVersion.h"
+#include "LzmaEnc.h"
 #include "Lzma2Enc.h"
-#include "Alloc.h"
+#include "CpuArch.h"
+#include "mem_alloc.h"
+#include "buffer_codec.h"
+#include "thread_quota.h"
+#include "lzma2_block_size.h"
+#include "thread_placement.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -22,6 +27,10 @@
     #define STAT stat
 #endif
 
+#define LZMA_PROPS_SIZE 5
+#define LZMA_HEADER_SIZE 13                 // 5 bytes props + 8 bytes uncompressed size
+#define LZMA_COMPRESS_DEFAULT_THREADS 4     // Two LZMA2 block threads of two each
+
 /* Helper: Check if path is a directory */
 static int is_directory(const char* path) {
     struct STAT st;
@@ -31,15 +40,6 @@ static int is_directory(const char* path) {
     return S_ISDIR(st.st_mode);
 }
 
-/* Helper: Check if path is a regular file */
-static int is_regular_file(const char* path) {
-    struct STAT st;
-    if (STAT(path, &st) != 0) {
-        return 0;
-    }
-    return S_ISREG(st.st_mode);
-}
-
 /* Helper: Get file size */
 static size_t get_file_size(const char* path) {
     struct STAT st;
@@ -49,220 +49,227 @@ static size_t get_file_size(const char* path) {
     return (size_t)st.st_size;
 }
 
-/* Helper: Read entire file into memory */
-static unsigned char* read_file_contents(const char* path, size_t* out_size) {
-    FILE* file = fopen(path, "rb");
-    if (!file) {
-        return NULL;
-    }
-    
-    /* Get file size */
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    if (size <= 0) {
-        fclose(file);
-        return NULL;
+/* The input file as the encoder's input stream, counting what it read */
+typedef struct {
+    ISeqInStream vt;
+    CSzFile file;
+    UInt64 processed;
+} CountingInStream;
+
+static SRes CountingInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    CountingInStream* p = Z7_CONTAINER_FROM_VTBL(pp, CountingInStream, vt);
+    if (File_Read(&p->file, buf, size) != 0) return SZ_ERROR_READ;
+    p->processed += *size;
+    return SZ_OK;
+}
+
+typedef struct {
+    ISeqOutStream vt;
+    CSzFile file;
+} FileWriteStream;
+
+static size_t FileWriteStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    FileWriteStream* p = Z7_CONTAINER_FROM_VTBL(pp, FileWriteStream, vt);
+    size_t written = size;
+    return File_Write(&p->file, data, &written) == 0 ? written : 0;
+}
+
+/* Progress in input bytes against the file's size when encoding began */
+typedef struct {
+    ICompressProgress vt;
+    SevenZipProgressCallback progress_callback;
+    UInt64 total;
+    void* user_data;
+} CompressProgress;
+
+static SRes CompressProgress_Progress(ICompressProgressPtr pp, UInt64 in_size, UInt64 out_size) {
+    CompressProgress* p = Z7_CONTAINER_FROM_VTBL(pp, CompressProgress, vt);
+    (void)out_size;
+    if (in_size != (UInt64)(Int64)-1) {
+        p->progress_callback(in_size, in_size > p->total ? in_size : p->total, p->user_data);
     }
-    
-    /* Allocate buffer */
-    unsigned char* buffer = (unsigned char*)malloc(size);
-    if (!buffer) {
-        fclose(file);
-        return NULL;
+    return SZ_OK;
+}
+
+static SevenZipErrorCode encode_error(SRes res) {
+    if (res == SZ_ERROR_MEM) return SEVENZIP_ERROR_MEMORY;
+    if (res == SZ_ERROR_PARAM) return SEVENZIP_ERROR_INVALID_PARAM;
+    return SEVENZIP_ERROR_COMPRESS;
+}
+
+static int compress_threads(void) {
+    return thread_auto_count(LZMA_COMPRESS_DEFAULT_THREADS);
+}
+
+/**
+ * .lzma: header, then the stream. A seekable output gets the size read
+ * written into its header at the end; a pipe keeps the size unknown and
+ * the stream ends with an end marker instead.
+ */
+static SRes encode_lzma_file(CountingInStream* in, FileWriteStream* out, UInt64 size_hint,
+                             SevenZipCompressionLevel level, ICompressProgressPtr progress) {
+    Int64 pos = 0;
+    int seekable = File_Seek(&out->file, &pos, SZ_SEEK_CUR) == 0;
+
+    ThreadPlacer placer;
+    int placed = thread_placer_init(&placer, SEVENZIP_NUMA_OFF);
+    ISzAllocPtr alloc = placed ? &placer.small : &g_MemEncoderAlloc;
+    ISzAllocPtr alloc_big = placed ? &placer.big : &g_MemMatchFinderAlloc;
+    CLzmaEncHandle encoder = LzmaEnc_Create(alloc);
+    if (!encoder) return SZ_ERROR_MEM;
+
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    buffer_codec_lzma_props(&props, level, size_hint);
+    props.writeEndMark = !seekable;
+
+    /* LZMA has no block threads; a second thread runs the BT match finder */
+    ThreadLease lease;
+    props.numThreads = thread_lease_acquire(&lease, compress_threads() > 1 ? 2 : 1, 0);
+    LzmaEncProps_Normalize(&props);
+
+    Byte header[LZMA_HEADER_SIZE];
+    SizeT props_size = LZMA_PROPS_SIZE;
+    memset(header + LZMA_PROPS_SIZE, 0xFF, LZMA_HEADER_SIZE - LZMA_PROPS_SIZE);
+    SRes res = LzmaEnc_SetProps(encoder, &props);
+    if (res == SZ_OK) res = LzmaEnc_WriteProperties(encoder, header, &props_size);
+    if (res == SZ_OK && ISeqOutStream_Write(&out->vt, header, LZMA_HEADER_SIZE) != LZMA_HEADER_SIZE) {
+        res = SZ_ERROR_WRITE;
     }
-    
-    /* Read file */
-    size_t read_bytes = fread(buffer, 1, size, file);
-    fclose(file);
-    
-    if (read_bytes != (size_t)size) {
-        free(buffer);
-        return NULL;
+    if (res == SZ_OK) res = LzmaEnc_Encode(encoder, &out->vt, &in->vt, progress, alloc, alloc_big);
+    LzmaEnc_Destroy(encoder, alloc, alloc_big);
+    thread_lease_release(&lease);
+
+    if (res == SZ_OK && seekable) {
+        Byte size[LZMA_HEADER_SIZE - LZMA_PROPS_SIZE];
+        size_t size_len = sizeof(size);
+        SetUi64(size, in->processed)
+        pos = LZMA_PROPS_SIZE;
+        if (File_Seek(&out->file, &pos, SZ_SEEK_SET) != 0 ||
+            File_Write(&out->file, size, &size_len) != 0 || size_len != sizeof(size)) {
+            res = SZ_ERROR_WRITE;
+        }
     }
-    
-    *out_size = size;
-    return buffer;
+    return res;
 }
 
-/* Helper: Convert compression level to LZMA2 properties */
-static void get_lzma2_props_for_level(CLzma2EncProps* props, SevenZipCompressionLevel level) {
-    Lzma2EncProps_Init(props);
-    
-    switch (level) {
-        case SEVENZIP_LEVEL_STORE:
-            /* Minimal compression */
-            props->lzmaProps.level = 0;
-            props->lzmaProps.dictSize = 1 << 16; /* 64 KB */
-            break;
-        case SEVENZIP_LEVEL_FASTEST:
-            props->lzmaProps.level = 1;
-            props->lzmaProps.dictSize = 1 << 18; /* 256 KB */
-            break;
-        case SEVENZIP_LEVEL_FAST:
-            props->lzmaProps.level = 3;
-            props->lzmaProps.dictSize = 1 << 20; /* 1 MB */
-            break;
-        case SEVENZIP_LEVEL_NORMAL:
-            props->lzmaProps.level = 5;
-            props->lzmaProps.dictSize = 1 << 23; /* 8 MB */
-            props->numBlockThreads_Max = 1; /* Enable multi-threading for normal+ */
-            break;
-        case SEVENZIP_LEVEL_MAXIMUM:
-            props->lzmaProps.level = 7;
-            props->lzmaProps.dictSize = 1 << 25; /* 32 MB */
-            props->numBlockThreads_Max = 2;
-            break;
-        case SEVENZIP_LEVEL_ULTRA:
-            props->lzmaProps.level = 9;
-            props->lzmaProps.dictSize = 1 << 26; /* 64 MB */
-            props->numBlockThreads_Max = 2;
-            break;
-        default:
-            props->lzmaProps.level = 5;
-            props->lzmaProps.dictSize = 1 << 23;
-            props->numBlockThreads_Max = 1;
-            break;
+/* LZMA2: property byte, then the stream from the block threads */
+static SRes encode_lzma2_file(CountingInStream* in, FileWriteStream* out, UInt64 size_hint,
+                              SevenZipCompressionLevel level, ICompressProgressPtr progress) {
+    ThreadPlacer placer;
+    CLzma2EncHandle encoder = thread_placer_init(&placer, SEVENZIP_NUMA_OFF)
+        ? Lzma2Enc_Create(&placer.small, &placer.big)
+        : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    if (!encoder) return SZ_ERROR_MEM;
+
+    CLzma2EncProps props;
+    Lzma2EncProps_Init(&props);
+    buffer_codec_lzma_props(&props.lzmaProps, level, size_hint);
+
+    ThreadLease lease;
+    props.numTotalThreads = thread_lease_acquire(&lease, compress_threads(), 0);
+    sevenzip_lzma2_spread_blocks(&props, size_hint);
+
+    SRes res = Lzma2Enc_SetProps(encoder, &props);
+    if (res == SZ_OK) {
+        Byte prop = Lzma2Enc_WriteProperties(encoder);
+        if (ISeqOutStream_Write(&out->vt, &prop, 1) != 1) res = SZ_ERROR_WRITE;
+    }
+    if (res == SZ_OK) {
+        Lzma2Enc_SetDataSize(encoder, size_hint);
+        res = Lzma2Enc_Encode2(encoder, &out->vt, NULL, NULL, &in->vt, NULL, 0, progress);
     }
-    
-    Lzma2EncProps_Normalize(props);
+    Lzma2Enc_Destroy(encoder);
+    thread_lease_release(&lease);
+    return res;
 }
 
-/* Simplified compression for single files using LZMA2 format */
-static SevenZipErrorCode compress_single_file_lzma2(
+/**
+ * Compress one file into another a block at a time
+ * The encoder pulls the input through a stream and writes as it goes, so
+ * memory is the encoder's (dictionary and match finder per block thread)
+ * whatever the file's size. The output matches sevenzip_compress_buffer()'s
+ * layout for the format.
+ */
+static SevenZipErrorCode compress_single_file(
+    SevenZipBufferFormat format,
     const char* input_path,
     const char* output_path,
     SevenZipCompressionLevel level,
     SevenZipProgressCallback progress_callback,
     void* user_data
 ) {
-    /* Read input file */
-    size_t input_size = 0;
-    unsigned char* input_data = read_file_contents(input_path, &input_size);
-    if (!input_data) {
+    CountingInStream in;
+    in.vt.Read = CountingInStream_Read;
+    in.processed = 0;
+    File_Construct(&in.file);
+    if (InFile_Open(&in.file, input_path) != 0) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
-    
-    /* Create LZMA2 encoder */
-    CLzma2EncHandle encoder = Lzma2Enc_Create(&g_Alloc, &g_Alloc);
-    if (!encoder) {
-        free(input_data);
-        return SEVENZIP_ERROR_MEMORY;
+    /* The size only shrinks the dictionary and spreads the blocks; a
+       file still growing is read to its end all the same */
+    UInt64 size_hint = 0;
+    if (File_GetLength(&in.file, &size_hint) != 0) {
+        size_hint = (UInt64)(Int64)-1;
     }
-    
-    /* Set compression properties */
-    CLzma2EncProps props;
-    get_lzma2_props_for_level(&props, level);
-    
-    SRes res = Lzma2Enc_SetProps(encoder, &props);
-    if (res != SZ_OK) {
-        Lzma2Enc_Destroy(encoder);
-        free(input_data);
-        return SEVENZIP_ERROR_COMPRESS;
+
+    FileWriteStream out;
+    out.vt.Write = FileWriteStream_Write;
+    File_Construct(&out.file);
+    if (OutFile_Open(&out.file, output_path) != 0) {
+        File_Close(&in.file);
+        return SEVENZIP_ERROR_OPEN_FILE;
     }
-    
-    /* Get properties byte before encoding */
-    Byte prop = Lzma2Enc_WriteProperties(encoder);
-    
-    /* Allocate output buffer (worst case: input size + overhead) */
-    size_t output_buf_size = input_size + input_size / 3 + 128;
-    unsigned char* output_data = (unsigned char*)malloc(output_buf_size);
-    if (!output_data) {
-        Lzma2Enc_Destroy(encoder);
-        free(input_data);
-        return SEVENZIP_ERROR_MEMORY;
+
+    CompressProgress progress;
+    progress.vt.Progress = CompressProgress_Progress;
+    progress.progress_callback = progress_callback;
+    progress.total = size_hint == (UInt64)(Int64)-1 ? 0 : size_hint;
+    progress.user_data = user_data;
+    ICompressProgressPtr progress_ptr = progress_callback ? &progress.vt : NULL;
+
+    SRes res = format == SEVENZIP_BUFFER_LZMA
+        ? encode_lzma_file(&in, &out, size_hint, level, progress_ptr)
+        : encode_lzma2_file(&in, &out, size_hint, level, progress_ptr);
+    File_Close(&in.file);
+    if (File_Close(&out.file) != 0 && res == SZ_OK) {
+        res = SZ_ERROR_WRITE;
     }
-    
-    /* Encode data */
-    size_t output_size = output_buf_size;
-    res = Lzma2Enc_Encode2(
-        encoder,
-        NULL,                  /* outStream - NULL to use buffer */
-        output_data, &output_size,
-        NULL,                  /* inStream - NULL to use buffer */
-        input_data, input_size,
-        NULL                   /* progress */
-    );
-    
-    Lzma2Enc_Destroy(encoder);
-    free(input_data);
-    
     if (res != SZ_OK) {
-        free(output_data);
-        return SEVENZIP_ERROR_COMPRESS;
-    }
-    
-    /* Write output file with LZMA2 header */
-    FILE* out_file = fopen(output_path, "wb");
-    if (!out_file) {
-        free(output_data);
-        return SEVENZIP_ERROR_OPEN_FILE;
+        remove(output_path);
+        return encode_error(res);
     }
-    
-    /* Write LZMA2 properties (1 byte) */
-    fwrite(&prop, 1, 1, out_file);
-    
-    /* Write compressed data */
-    fwrite(output_data, 1, output_size, out_file);
-    fclose(out_file);
-    free(output_data);
-    
-    /* Progress callback */
+
     if (progress_callback) {
-        progress_callback(1, 1, user_data);
+        progress_callback(in.processed, in.processed, user_data);
     }
-    
     return SEVENZIP_OK;
 }
 
-SevenZipErrorCode sevenzip_compress(
-    const char* archive_path,
-    const char** input_paths,
+SevenZipErrorCode sevenzip_compress_lzma(
+    const char* input_path,
+    const char* output_path,
     SevenZipCompressionLevel level,
-    const char* password,
     SevenZipProgressCallback progress_callback,
     void* user_data
 ) {
-    if (!archive_path || !input_paths) {
+    if (!input_path || !output_path) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
-    
-    /* Count input files */
-    size_t num_inputs = 0;
-    while (input_paths[num_inputs] != NULL) {
-        num_inputs++;
-    }
-    
-    if (num_inputs == 0) {
+    return compress_single_file(SEVENZIP_BUFFER_LZMA, input_path, output_path, level,
+                                progress_callback, user_data);
+}
+
+SevenZipErrorCode sevenzip_compress_lzma2(
+    const char* input_path,
+    const char* output_path,
+    SevenZipCompressionLevel level,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!input_path || !output_path) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
-    
-    /* For now, handle single file compression to LZMA2 format
-     * Full 7z archive creation requires more complex implementation
-     * TODO: Implement full 7z format with multiple files/directories
-     */
-    
-    if (num_inputs == 1 && is_regular_file(input_paths[0])) {
-        /* Single file - use LZMA2 format */
-        return compress_single_file_lzma2(
-            input_paths[0],
-            archive_path,
-            level,
-            progress_callback,
-            user_data
-        );
-    }
-    
-    /* Multiple files or directories not yet supported
-     * TODO: Implement using 7z format encoder:
-     * 1. Traverse directories recursively
-     * 2. Build file list with metadata
-     * 3. Create 7z archive header
-     * 4. Compress files with LZMA2
-     * 5. Write solid or non-solid blocks
-     * 6. Update archive header with offsets
-     */
-    
-    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+    return compress_single_file(SEVENZIP_BUFFER_LZMA2, input_path, output_path, level,
+                                progress_callback, user_data);
 }
@@ -1,13 +1,20 @@
 /**
  * LZMA Decompression Implementation
  * 
- * Implements decompression of standalone LZMA and LZMA2 files
+ * Implements decompression of standalone LZMA and LZMA2 files. Input is
+ * read through PackedInput (mapped in place, or buffered); .lzma output
+ * is written straight from the decoder's dictionary, one output step at
+ * a time, so no output buffer sits between the decoder and the file.
  */
 
 #include "../include/7z_ffi.h"
 #include "LzmaDec.h"
-#include "Lzma2Dec.h"
-#include "Alloc.h"
+#include "Lzma2DecMt.h"
+#include "mem_alloc.h"
+#include "packed_input.h"
+#include "thread_quota.h"
+#include "entry_writer.h"
+#include "thread_placement.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,16 +22,34 @@
 
 #define LZMA_PROPS_SIZE 5
 #define LZMA_HEADER_SIZE 13  // 5 bytes props + 8 bytes uncompressed size
-#define IN_BUF_SIZE (1 << 16)  // 64KB input buffer
-#define OUT_BUF_SIZE (1 << 16) // 64KB output buffer
+#define DECODE_STEP_DEFAULT (4 << 20)  // Bytes decoded between writes
+#define LZMA2_DECODE_DEFAULT_THREADS 2  // Same default as the compressors
+#define LZMA2_DECODE_MAX_THREADS 64
+
+/**
+ * Read `size` bytes from the input (header fields)
+ */
+static int read_exact(PackedInput* in, Byte* buf, size_t size) {
+    while (size > 0) {
+        const Byte* data;
+        size_t n = packed_input_peek(in, &data);
+        if (n == 0) return 0;
+        if (n > size) n = size;
+        memcpy(buf, data, n);
+        packed_input_consume(in, n);
+        buf += n;
+        size -= n;
+    }
+    return 1;
+}
 
 /**
  * Read LZMA file header (props + uncompressed size)
  */
-static SevenZipErrorCode read_lzma_header(FILE* in_file, Byte* props, UInt64* unpack_size) {
+static SevenZipErrorCode read_lzma_header(PackedInput* in, Byte* props, UInt64* unpack_size) {
     Byte header[LZMA_HEADER_SIZE];
     
-    if (fread(header, 1, LZMA_HEADER_SIZE, in_file) != LZMA_HEADER_SIZE) {
+    if (!read_exact(in, header, LZMA_HEADER_SIZE)) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
     
@@ -43,12 +68,24 @@ static SevenZipErrorCode read_lzma_header(FILE* in_file, Byte* props, UInt64* un
     return SEVENZIP_OK;
 }
 
+static size_t decode_step(const SevenZipDecompressOptions* options) {
+    return (options && options->output_step > 0) ? options->output_step : DECODE_STEP_DEFAULT;
+}
+
+void sevenzip_decompress_options_init(SevenZipDecompressOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->num_threads = 0;
+    options->output_step = DECODE_STEP_DEFAULT;
+}
+
 /**
- * Decompress LZMA file using streaming decoder
+ * Decompress LZMA file, decoding into the dictionary and writing from it
  */
-SevenZipErrorCode sevenzip_decompress_lzma(
+SevenZipErrorCode sevenzip_decompress_lzma_with_options(
     const char* lzma_path,
     const char* output_path,
+    const SevenZipDecompressOptions* options,
     SevenZipProgressCallback progress_callback,
     void* user_data
 ) {
@@ -56,142 +93,115 @@ SevenZipErrorCode sevenzip_decompress_lzma(
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
     
-    FILE* in_file = NULL;
-    FILE* out_file = NULL;
-    Byte* in_buf = NULL;
-    Byte* out_buf = NULL;
-    CLzmaDec decoder;
-    SevenZipErrorCode result = SEVENZIP_OK;
-    SRes lzma_res;
-    
-    // Open input file
-    in_file = fopen(lzma_path, "rb");
-    if (!in_file) {
+    // Open input file (mapped when possible)
+    PackedInput in;
+    if (!packed_input_open(&in, lzma_path)) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
     
     // Read LZMA header
     Byte props[LZMA_PROPS_SIZE];
     UInt64 unpack_size;
-    result = read_lzma_header(in_file, props, &unpack_size);
+    SevenZipErrorCode result = read_lzma_header(&in, props, &unpack_size);
     if (result != SEVENZIP_OK) {
-        fclose(in_file);
+        packed_input_close(&in);
         return result;
     }
+    int size_known = unpack_size != (UInt64)(Int64)-1;
+    
+    // Initialize decoder
+    CLzmaDec decoder;
+    LzmaDec_Construct(&decoder);
+    if (LzmaDec_Allocate(&decoder, props, LZMA_PROPS_SIZE, &g_MemDecoderAlloc) != SZ_OK) {
+        packed_input_close(&in);
+        return SEVENZIP_ERROR_COMPRESS;
+    }
+    LzmaDec_Init(&decoder);
     
     // Open output file
-    out_file = fopen(output_path, "wb");
+    FILE* out_file = fopen(output_path, "wb");
     if (!out_file) {
-        fclose(in_file);
+        LzmaDec_Free(&decoder, &g_MemDecoderAlloc);
+        packed_input_close(&in);
         return SEVENZIP_ERROR_OPEN_FILE;
     }
     
-    // Allocate buffers
-    in_buf = (Byte*)malloc(IN_BUF_SIZE);
-    out_buf = (Byte*)malloc(OUT_BUF_SIZE);
-    if (!in_buf || !out_buf) {
-        result = SEVENZIP_ERROR_MEMORY;
-        goto cleanup;
-    }
-    
-    // Initialize decoder
-    LzmaDec_Construct(&decoder);
-    lzma_res = LzmaDec_Allocate(&decoder, props, LZMA_PROPS_SIZE, &g_Alloc);
-    if (lzma_res != SZ_OK) {
-        result = SEVENZIP_ERROR_COMPRESS;
-        goto cleanup;
+    // Writes are whole steps unless the dictionary is smaller; then stdio gathers them
+    size_t step = decode_step(options);
+    if (decoder.dicBufSize < step) {
+        setvbuf(out_file, NULL, _IOFBF, step);
+    } else {
+        setvbuf(out_file, NULL, _IONBF, 0);
     }
+    if (size_known) entry_preallocate(out_file, unpack_size);
     
-    LzmaDec_Init(&decoder);
-    
-    // Decompress in chunks
-    UInt64 in_processed = 0;
+    // Decompress one step at a time
     UInt64 out_processed = 0;
-    int finished = 0;  // Use int instead of Bool
-    
-    while (!finished) {
-        // Read input chunk
-        size_t in_size = fread(in_buf, 1, IN_BUF_SIZE, in_file);
-        if (in_size == 0) {
+    for (;;) {
+        if (decoder.dicPos == decoder.dicBufSize) decoder.dicPos = 0;
+        SizeT start = decoder.dicPos;
+        SizeT limit = (decoder.dicBufSize - start > step) ? start + step : decoder.dicBufSize;
+        ELzmaFinishMode finish_mode = LZMA_FINISH_ANY;
+        if (size_known && limit - start >= unpack_size - out_processed) {
+            limit = start + (SizeT)(unpack_size - out_processed);
+            finish_mode = LZMA_FINISH_END;
+        }
+        
+        const Byte* data;
+        size_t avail = packed_input_peek(&in, &data);
+        SizeT in_size = avail;
+        ELzmaStatus status;
+        SRes lzma_res = LzmaDec_DecodeToDic(&decoder, limit, data, &in_size, finish_mode, &status);
+        packed_input_consume(&in, in_size);
+        
+        // Write output
+        size_t produced = decoder.dicPos - start;
+        if (produced > 0 && fwrite(decoder.dic + start, 1, produced, out_file) != produced) {
+            result = SEVENZIP_ERROR_EXTRACT;
             break;
         }
+        out_processed += produced;
         
-        Byte* in_ptr = in_buf;
-        size_t in_remaining = in_size;
+        if (lzma_res != SZ_OK) {
+            result = SEVENZIP_ERROR_COMPRESS;
+            break;
+        }
+        
+        // Check if decompression is finished
+        if (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+            (size_known && out_processed >= unpack_size)) {
+            break;
+        }
         
-        // Process input buffer
-        while (in_remaining > 0 || finished) {
-            size_t out_size = OUT_BUF_SIZE;
-            size_t in_processed_chunk = in_remaining;
-            ELzmaStatus status;
-            
-            lzma_res = LzmaDec_DecodeToBuf(
-                &decoder,
-                out_buf,
-                &out_size,
-                in_ptr,
-                &in_processed_chunk,
-                (in_size == 0) ? LZMA_FINISH_END : LZMA_FINISH_ANY,
-                &status
-            );
-            
-            if (lzma_res != SZ_OK) {
+        // Out of input: only a stream of unknown size may end without a mark
+        if (avail == 0 && produced == 0) {
+            if (in.read_error) {
+                result = SEVENZIP_ERROR_EXTRACT;
+            } else if (size_known || status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK) {
                 result = SEVENZIP_ERROR_COMPRESS;
-                goto cleanup;
-            }
-            
-            // Write output
-            if (out_size > 0) {
-                if (fwrite(out_buf, 1, out_size, out_file) != out_size) {
-                    result = SEVENZIP_ERROR_EXTRACT;
-                    goto cleanup;
-                }
-                out_processed += out_size;
-            }
-            
-            // Update input pointer
-            in_ptr += in_processed_chunk;
-            in_remaining -= in_processed_chunk;
-            in_processed += in_processed_chunk;
-            
-            // Check if decompression is finished
-            if (status == LZMA_STATUS_FINISHED_WITH_MARK ||
-                (unpack_size != (UInt64)(Int64)-1 && out_processed >= unpack_size)) {
-                finished = 1;
-                break;
-            }
-            
-            // If no more output and no more input, need more input
-            if (out_size == 0 && in_remaining == 0) {
-                break;
-            }
-            
-            // Progress callback
-            if (progress_callback && unpack_size != (UInt64)(Int64)-1) {
-                progress_callback(out_processed, unpack_size, user_data);
             }
+            break;
+        }
+        
+        // Progress callback
+        if (progress_callback && size_known) {
+            progress_callback(out_processed, unpack_size, user_data);
         }
     }
     
     // Final progress callback
-    if (progress_callback) {
+    if (result == SEVENZIP_OK && progress_callback) {
         progress_callback(out_processed, out_processed, user_data);
     }
     
-cleanup:
-    // Free decoder
-    LzmaDec_Free(&decoder, &g_Alloc);
-    
-    // Free buffers
-    if (in_buf) free(in_buf);
-    if (out_buf) free(out_buf);
-    
-    // Close files
-    if (in_file) fclose(in_file);
-    if (out_file) fclose(out_file);
+    LzmaDec_Free(&decoder, &g_MemDecoderAlloc);
+    packed_input_close(&in);
+    if (fclose(out_file) != 0 && result == SEVENZIP_OK) {
+        result = SEVENZIP_ERROR_EXTRACT;
+    }
     
     // Remove output file on error
-    if (result != SEVENZIP_OK && output_path) {
+    if (result != SEVENZIP_OK) {
         remove(output_path);
     }
     
@@ -199,153 +209,167 @@ cleanup:
 }
 
 /**
- * Decompress LZMA2 file using streaming decoder
+ * Decompress LZMA file using streaming decoder
  */
-SevenZipErrorCode sevenzip_decompress_lzma2(
+SevenZipErrorCode sevenzip_decompress_lzma(
+    const char* lzma_path,
+    const char* output_path,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    return sevenzip_decompress_lzma_with_options(lzma_path, output_path, NULL,
+                                                 progress_callback, user_data);
+}
+
+/* Output file writer with output-byte progress */
+typedef struct {
+    ISeqOutStream vt;
+    FILE* file;
+    UInt64 processed;
+    SevenZipProgressCallback progress_callback;
+    void* user_data;
+} FileSeqOutStream;
+
+static size_t FileSeqOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    FileSeqOutStream* p = Z7_CONTAINER_FROM_VTBL(pp, FileSeqOutStream, vt);
+    size_t written = fwrite(data, 1, size, p->file);
+    p->processed += written;
+    // Progress callback (we don't know total size for LZMA2)
+    if (p->progress_callback) {
+        p->progress_callback(p->processed, p->processed, p->user_data);
+    }
+    return written;
+}
+
+/**
+ * Decompress LZMA2 file using the multi-threaded decoder
+ * Streams written with a block size (every writer here) have their blocks
+ * decoded in parallel; single-block streams decode on one thread.
+ */
+SevenZipErrorCode sevenzip_decompress_lzma2_with_options(
     const char* lzma2_path,
     const char* output_path,
+    const SevenZipDecompressOptions* options,
     SevenZipProgressCallback progress_callback,
     void* user_data
 ) {
     if (!lzma2_path || !output_path) {
         return SEVENZIP_ERROR_INVALID_PARAM;
     }
-    
-    FILE* in_file = NULL;
-    FILE* out_file = NULL;
-    Byte* in_buf = NULL;
-    Byte* out_buf = NULL;
-    CLzma2Dec decoder;
-    SevenZipErrorCode result = SEVENZIP_OK;
-    SRes lzma_res;
-    
-    // Open input file
-    in_file = fopen(lzma2_path, "rb");
-    if (!in_file) {
+    int num_threads = options ? options->num_threads : 0;
+    if (num_threads <= 0) num_threads = thread_auto_count(LZMA2_DECODE_DEFAULT_THREADS);
+    if (num_threads > LZMA2_DECODE_MAX_THREADS) num_threads = LZMA2_DECODE_MAX_THREADS;
+    size_t step = decode_step(options);
+    
+    // Open input file (mapped when possible)
+    PackedInput in;
+    if (!packed_input_open(&in, lzma2_path)) {
         return SEVENZIP_ERROR_OPEN_FILE;
     }
     
     // Read LZMA2 properties (1 byte)
     Byte prop;
-    if (fread(&prop, 1, 1, in_file) != 1) {
-        fclose(in_file);
+    if (!read_exact(&in, &prop, 1)) {
+        packed_input_close(&in);
         return SEVENZIP_ERROR_OPEN_FILE;
     }
     
     // Open output file
-    out_file = fopen(output_path, "wb");
+    FILE* out_file = fopen(output_path, "wb");
     if (!out_file) {
-        fclose(in_file);
+        packed_input_close(&in);
         return SEVENZIP_ERROR_OPEN_FILE;
     }
+    setvbuf(out_file, NULL, _IOFBF, step);
     
-    // Allocate buffers
-    in_buf = (Byte*)malloc(IN_BUF_SIZE);
-    out_buf = (Byte*)malloc(OUT_BUF_SIZE);
-    if (!in_buf || !out_buf) {
+    SevenZipErrorCode result = SEVENZIP_OK;
+    ThreadPlacer placer;
+    CLzma2DecMtHandle decoder = thread_placer_init_decoder(&placer, &g_MemDecoderAlloc)
+        ? Lzma2DecMt_Create(&placer.small, &placer.big)
+        : Lzma2DecMt_Create(&g_MemDecoderAlloc, &g_MemDecoderAlloc);
+    if (!decoder) {
         result = SEVENZIP_ERROR_MEMORY;
-        goto cleanup;
-    }
-    
-    // Initialize decoder
-    Lzma2Dec_Construct(&decoder);
-    lzma_res = Lzma2Dec_Allocate(&decoder, prop, &g_Alloc);
-    if (lzma_res != SZ_OK) {
-        result = SEVENZIP_ERROR_COMPRESS;
-        goto cleanup;
-    }
-    
-    Lzma2Dec_Init(&decoder);
-    
-    // Decompress in chunks
-    UInt64 in_processed = 0;
-    UInt64 out_processed = 0;
-    int finished = 0;
-    
-    while (!finished) {
-        // Read input chunk
-        size_t in_size = fread(in_buf, 1, IN_BUF_SIZE, in_file);
-        if (in_size == 0) {
-            break;
-        }
+    } else {
+        CLzma2DecMtProps props;
+        Lzma2DecMtProps_Init(&props);
+        ThreadLease lease;
+        props.numThreads = (unsigned)thread_lease_acquire(&lease, num_threads, 0);
+        props.outStep_ST = step;
         
-        Byte* in_ptr = in_buf;
-        size_t in_remaining = in_size;
+        PackedSeqInStream in_stream;
+        packed_seq_in_stream_init(&in_stream, &in);
+        FileSeqOutStream out_stream;
+        out_stream.vt.Write = FileSeqOutStream_Write;
+        out_stream.file = out_file;
+        out_stream.processed = 0;
+        out_stream.progress_callback = progress_callback;
+        out_stream.user_data = user_data;
         
-        // Process input buffer
-        while (in_remaining > 0 || finished) {
-            size_t out_size = OUT_BUF_SIZE;
-            size_t in_processed_chunk = in_remaining;
-            ELzmaStatus status;
-            
-            lzma_res = Lzma2Dec_DecodeToBuf(
-                &decoder,
-                out_buf,
-                &out_size,
-                in_ptr,
-                &in_processed_chunk,
-                (in_size == 0) ? LZMA_FINISH_END : LZMA_FINISH_ANY,
-                &status
-            );
-            
-            if (lzma_res != SZ_OK) {
-                result = SEVENZIP_ERROR_COMPRESS;
-                goto cleanup;
-            }
-            
-            // Write output
-            if (out_size > 0) {
-                if (fwrite(out_buf, 1, out_size, out_file) != out_size) {
-                    result = SEVENZIP_ERROR_EXTRACT;
-                    goto cleanup;
-                }
-                out_processed += out_size;
-            }
-            
-            // Update input pointer
-            in_ptr += in_processed_chunk;
-            in_remaining -= in_processed_chunk;
-            in_processed += in_processed_chunk;
-            
-            // Check if decompression is finished
-            if (status == LZMA_STATUS_FINISHED_WITH_MARK) {
-                finished = 1;
-                break;
-            }
-            
-            // If no more output and no more input, need more input
-            if (out_size == 0 && in_remaining == 0) {
-                break;
-            }
-            
-            // Progress callback (we don't know total size for LZMA2)
-            if (progress_callback) {
-                progress_callback(out_processed, out_processed, user_data);
-            }
+        UInt64 in_processed = 0;
+        int is_mt = 0;
+        SRes lzma_res = Lzma2DecMt_Decode(decoder, prop, &props, &out_stream.vt, NULL, 1,
+                                          &in_stream.vt, &in_processed, &is_mt, NULL);
+        Lzma2DecMt_Destroy(decoder);
+        thread_lease_release(&lease);
+        
+        if (lzma_res == SZ_ERROR_WRITE) {
+            result = SEVENZIP_ERROR_EXTRACT;
+        } else if (lzma_res == SZ_ERROR_MEM) {
+            result = SEVENZIP_ERROR_MEMORY;
+        } else if (lzma_res != SZ_OK) {
+            result = SEVENZIP_ERROR_COMPRESS;
+        }
+        
+        // Final progress callback
+        if (result == SEVENZIP_OK && progress_callback) {
+            progress_callback(out_stream.processed, out_stream.processed, user_data);
         }
     }
     
-    // Final progress callback
-    if (progress_callback) {
-        progress_callback(out_processed, out_processed, user_data);
+    packed_input_close(&in);
+    if (fclose(out_file) != 0 && result == SEVENZIP_OK) {
+        result = SEVENZIP_ERROR_EXTRACT;
     }
     
-cleanup:
-    // Free decoder
-    Lzma2Dec_Free(&decoder, &g_Alloc);
-    
-    // Free buffers
-    if (in_buf) free(in_buf);
-    if (out_buf) free(out_buf);
-    
-    // Close files
-    if (in_file) fclose(in_file);
-    if (out_file) fclose(out_file);
-    
     // Remove output file on error
-    if (result != SEVENZIP_OK && output_path) {
+    if (result != SEVENZIP_OK) {
         remove(output_path);
     }
     
     return result;
 }
+
+/**
+ * Decompress LZMA2 file using the multi-threaded decoder
+ */
+SevenZipErrorCode sevenzip_decompress_lzma2_mt(
+    const char* lzma2_path,
+    const char* output_path,
+    int num_threads,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipDecompressOptions options;
+    sevenzip_decompress_options_init(&options);
+    options.num_threads = num_threads;
+    return sevenzip_decompress_lzma2_with_options(lzma2_path, output_path, &options,
+                                                  progress_callback, user_data);
+}
+
+/**
+ * Decompress LZMA2 file using streaming decoder
+ * Decodes on one thread: only the single-threaded decoder reports a
+ * stream that ends before its end marker.
+ */
+SevenZipErrorCode sevenzip_decompress_lzma2(
+    const char* lzma2_path,
+    const char* output_path,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipDecompressOptions options;
+    sevenzip_decompress_options_init(&options);
+    options.num_threads = 1;
+    return sevenzip_decompress_lzma2_with_options(lzma2_path, output_path, &options,
+                                                  progress_callback, user_data);
+}
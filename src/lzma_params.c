@@ -0,0 +1,57 @@
+/**
+ * LZMA Encoder Parameters
+ *
+ * -1 (0 for match_cycles and match_finder) keeps the value of the level,
+ * as in CLzmaEncProps. The literal bits are limited to lc + lp <= 4, the
+ * LZMA2 bound, by lowering lc.
+ */
+
+#include "lzma_params.h"
+
+#define LZMA_FB_MIN 5
+#define LZMA_FB_MAX 273
+#define LZMA_LCLP_MAX 4
+#define LZMA_PB_MAX 4
+#define LZMA_MC_MAX ((UInt32)1 << 30)
+
+void sevenzip_lzma_params_init(SevenZipLzmaParams* params) {
+    if (!params) return;
+    params->match_finder = SEVENZIP_MATCH_FINDER_AUTO;
+    params->algorithm = -1;
+    params->fast_bytes = -1;
+    params->match_cycles = 0;
+    params->lc = -1;
+    params->lp = -1;
+    params->pb = -1;
+}
+
+static int clamp_int(int value, int lo, int hi) {
+    return value < lo ? lo : value > hi ? hi : value;
+}
+
+void sevenzip_lzma_params_apply(const SevenZipLzmaParams* params, CLzmaEncProps* props) {
+    if (!params) return;
+
+    switch (params->match_finder) {
+        case SEVENZIP_MATCH_FINDER_HC4: props->btMode = 0; props->numHashBytes = 4; break;
+        case SEVENZIP_MATCH_FINDER_HC5: props->btMode = 0; props->numHashBytes = 5; break;
+        case SEVENZIP_MATCH_FINDER_BT2: props->btMode = 1; props->numHashBytes = 2; break;
+        case SEVENZIP_MATCH_FINDER_BT3: props->btMode = 1; props->numHashBytes = 3; break;
+        case SEVENZIP_MATCH_FINDER_BT4: props->btMode = 1; props->numHashBytes = 4; break;
+        default: break;
+    }
+    if (params->algorithm >= 0) props->algo = params->algorithm ? 1 : 0;
+    if (params->fast_bytes >= 0) props->fb = clamp_int(params->fast_bytes, LZMA_FB_MIN, LZMA_FB_MAX);
+    if (params->match_cycles > 0) {
+        props->mc = params->match_cycles < LZMA_MC_MAX ? params->match_cycles : LZMA_MC_MAX;
+    }
+
+    int lp = params->lp >= 0 ? clamp_int(params->lp, 0, LZMA_LCLP_MAX) : -1;
+    int lc = params->lc >= 0 ? clamp_int(params->lc, 0, LZMA_LCLP_MAX) : -1;
+    int lp_used = lp >= 0 ? lp : 0;
+    if (lc < 0 && lp_used > LZMA_LCLP_MAX - 3) lc = LZMA_LCLP_MAX - lp_used;  /* Default lc is 3 */
+    if (lc >= 0 && lc + lp_used > LZMA_LCLP_MAX) lc = LZMA_LCLP_MAX - lp_used;
+    if (lc >= 0) props->lc = lc;
+    if (lp >= 0) props->lp = lp;
+    if (params->pb >= 0) props->pb = clamp_int(params->pb, 0, LZMA_PB_MAX);
+}
@@ -0,0 +1,29 @@
+/**
+ * LZMA Encoder Parameters - Internal Header
+ *
+ * Applies SevenZipLzmaParams over the CLzmaEncProps a creation path set
+ * up for its level, before Lzma2EncProps_Normalize() fills what is left.
+ */
+
+#ifndef SEVENZIP_LZMA_PARAMS_H
+#define SEVENZIP_LZMA_PARAMS_H
+
+#include "../include/7z_ffi.h"
+#include "LzmaEnc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Copy the set fields of `params` to `props`, clamped to what LZMA2 accepts
+ * @param params Parameters from the options (NULL = leave props unchanged)
+ * @param props Level properties, not yet normalized
+ */
+void sevenzip_lzma_params_apply(const SevenZipLzmaParams* params, CLzmaEncProps* props);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_LZMA_PARAMS_H */
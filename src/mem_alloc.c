@@ -0,0 +1,378 @@
+/**
+ * Memory Accounting
+ *
+ * Each block is preceded by a MemHeader; `offset` leads back from the
+ * returned address to the start of the underlying allocation, so aligned
+ * blocks free the same way as plain ones. The counters are relaxed
+ * atomics: a reader sees every category at some recent moment, not all of
+ * them at one moment.
+ *
+ * The block pool is a small array searched linearly under one lock, as
+ * it holds few blocks and each take or put saves a large allocation and
+ * the page faults of touching it again. Pooled blocks keep their header
+ * and stay counted in their category; taking one is not an allocation.
+ */
+
+#include "mem_alloc.h"
+#include "large_pages.h"
+#include "Alloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    static SRWLOCK g_pool_lock = SRWLOCK_INIT;
+    #define POOL_LOCK() AcquireSRWLockExclusive(&g_pool_lock)
+    #define POOL_UNLOCK() ReleaseSRWLockExclusive(&g_pool_lock)
+#else
+    #include <pthread.h>
+    static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+    #define POOL_LOCK() pthread_mutex_lock(&g_pool_lock)
+    #define POOL_UNLOCK() pthread_mutex_unlock(&g_pool_lock)
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    typedef volatile __int64 MemCounter;
+    #define COUNTER_LOAD(p) ((uint64_t)InterlockedCompareExchange64((p), 0, 0))
+    #define COUNTER_STORE(p, v) InterlockedExchange64((p), (__int64)(v))
+    #define COUNTER_ADD(p, v) ((uint64_t)InterlockedExchangeAdd64((p), (__int64)(v)))
+    #define COUNTER_SUB(p, v) ((uint64_t)InterlockedExchangeAdd64((p), -(__int64)(v)))
+    /* Stores `v` if *p is still *seen, else updates *seen; nonzero when stored */
+    static int counter_cas(MemCounter* p, uint64_t* seen, uint64_t v) {
+        uint64_t old = (uint64_t)InterlockedCompareExchange64(p, (__int64)v, (__int64)*seen);
+        if (old == *seen) return 1;
+        *seen = old;
+        return 0;
+    }
+#else
+    #include <stdatomic.h>
+    typedef _Atomic uint64_t MemCounter;
+    #define COUNTER_LOAD(p) atomic_load_explicit((p), memory_order_relaxed)
+    #define COUNTER_STORE(p, v) atomic_store_explicit((p), (v), memory_order_relaxed)
+    #define COUNTER_ADD(p, v) atomic_fetch_add_explicit((p), (v), memory_order_relaxed)
+    #define COUNTER_SUB(p, v) atomic_fetch_sub_explicit((p), (v), memory_order_relaxed)
+    static int counter_cas(MemCounter* p, uint64_t* seen, uint64_t v) {
+        return atomic_compare_exchange_weak_explicit(p, seen, v, memory_order_relaxed,
+                                                     memory_order_relaxed);
+    }
+#endif
+
+/* Where the underlying allocation came from */
+enum {
+    MEM_ORIGIN_DEFAULT = 0,   /* g_Alloc */
+    MEM_ORIGIN_BIG = 1,       /* g_BigAlloc */
+    MEM_ORIGIN_USER = 2       /* sevenzip_set_allocator() */
+};
+
+typedef struct {
+    uint64_t size;            /* Requested bytes */
+    uint8_t category;
+    uint8_t origin;
+    uint8_t large_pages;      /* Went through large_page_alloc() */
+    uint8_t reserved;
+    uint32_t offset;          /* Returned address minus allocation start */
+} MemHeader;
+
+typedef struct {
+    MemCounter current;
+    MemCounter peak;
+    MemCounter allocations;
+} MemCounters;
+
+/* One per category, then the total */
+static MemCounters g_counters[SEVENZIP_MEM_CATEGORY_COUNT + 1];
+
+static SevenZipAllocator g_user_allocator;
+static volatile int g_user_allocator_set = 0;
+
+static void* User_Alloc(ISzAllocPtr p, size_t size) {
+    (void)p;
+    return g_user_allocator.alloc(g_user_allocator.opaque, size);
+}
+
+static void User_Free(ISzAllocPtr p, void* address) {
+    (void)p;
+    if (address) g_user_allocator.free(g_user_allocator.opaque, address);
+}
+
+static const ISzAlloc g_UserAlloc = { User_Alloc, User_Free };
+
+static const ISzAlloc* origin_allocator(int origin) {
+    switch (origin) {
+        case MEM_ORIGIN_USER: return &g_UserAlloc;
+        case MEM_ORIGIN_BIG: return &g_BigAlloc;
+        default: return &g_Alloc;
+    }
+}
+
+static void raise_peak(MemCounter* peak, uint64_t value) {
+    uint64_t seen = COUNTER_LOAD(peak);
+    while (value > seen && !counter_cas(peak, &seen, value)) {
+    }
+}
+
+static void count_alloc(MemCounters* c, uint64_t size) {
+    raise_peak(&c->peak, COUNTER_ADD(&c->current, size) + size);
+    COUNTER_ADD(&c->allocations, 1);
+}
+
+static void account_alloc(int category, uint64_t size) {
+    count_alloc(&g_counters[category], size);
+    count_alloc(&g_counters[SEVENZIP_MEM_CATEGORY_COUNT], size);
+}
+
+static void account_free(int category, uint64_t size) {
+    COUNTER_SUB(&g_counters[category].current, size);
+    COUNTER_SUB(&g_counters[SEVENZIP_MEM_CATEGORY_COUNT].current, size);
+}
+
+static MemHeader* header_of(void* address) {
+    return (MemHeader*)address - 1;
+}
+
+/* `align` is MEM_ALLOC_ALIGN or a larger power of two */
+static void* alloc_block(int category, size_t size, int big, int large_pages, size_t align) {
+    size_t extra = sizeof(MemHeader) + (align > MEM_ALLOC_ALIGN ? align - 1 : 0);
+    if (size > SIZE_MAX - extra) return NULL;
+
+    int origin = g_user_allocator_set ? MEM_ORIGIN_USER : (big ? MEM_ORIGIN_BIG : MEM_ORIGIN_DEFAULT);
+    const ISzAlloc* base = origin_allocator(origin);
+    Byte* raw = (Byte*)(large_pages ? large_page_alloc(base, size + extra)
+                                    : ISzAlloc_Alloc(base, size + extra));
+    if (!raw) return NULL;
+
+    Byte* data = raw + sizeof(MemHeader);
+    if (align > MEM_ALLOC_ALIGN) {
+        data = (Byte*)(((uintptr_t)data + align - 1) & ~(uintptr_t)(align - 1));
+    }
+    MemHeader* h = header_of(data);
+    h->size = size;
+    h->category = (uint8_t)category;
+    h->origin = (uint8_t)origin;
+    h->large_pages = (uint8_t)large_pages;
+    h->reserved = 0;
+    h->offset = (uint32_t)(data - raw);
+    account_alloc(category, size);
+    return data;
+}
+
+void mem_free(void* address) {
+    if (!address) return;
+    MemHeader* h = header_of(address);
+    account_free(h->category, h->size);
+    const ISzAlloc* base = origin_allocator(h->origin);
+    Byte* raw = (Byte*)address - h->offset;
+    if (h->large_pages) {
+        large_page_free(base, raw);
+    } else {
+        ISzAlloc_Free(base, raw);
+    }
+}
+
+typedef struct {
+    void* block;              /* NULL = empty */
+    uint64_t size;
+    int category;
+    uint64_t stamp;           /* When it was put, for eviction */
+} PoolSlot;
+
+static PoolSlot g_pool[MEM_POOL_SLOTS];
+static uint64_t g_pool_bytes = 0;
+static uint64_t g_pool_limit = MEM_POOL_DEFAULT_BYTES;
+static uint64_t g_pool_clock = 0;
+
+/* Pooled block of exactly `size` bytes of `category`, the last one put, or NULL */
+static void* pool_take(int category, size_t size) {
+    if (size < MEM_POOL_MIN_BLOCK) return NULL;
+    POOL_LOCK();
+    PoolSlot* best = NULL;
+    for (int i = 0; i < MEM_POOL_SLOTS; i++) {
+        PoolSlot* slot = &g_pool[i];
+        if (slot->block && slot->size == size && slot->category == category &&
+            (!best || slot->stamp > best->stamp)) {
+            best = slot;
+        }
+    }
+    void* block = NULL;
+    if (best) {
+        block = best->block;
+        best->block = NULL;
+        g_pool_bytes -= size;
+    }
+    POOL_UNLOCK();
+    return block;
+}
+
+/* Keep a freed block, evicting the oldest ones to make room
+ * @return 1 if pooled, 0 if the caller frees it */
+static int pool_put(void* address) {
+    if (!address) return 0;
+    MemHeader* h = header_of(address);
+    if (h->size < MEM_POOL_MIN_BLOCK) return 0;
+    void* evicted[MEM_POOL_SLOTS];
+    int evicted_count = 0;
+    int pooled = 0;
+    POOL_LOCK();
+    if (h->size <= g_pool_limit) {
+        for (;;) {
+            PoolSlot* empty = NULL;
+            PoolSlot* oldest = NULL;
+            for (int i = 0; i < MEM_POOL_SLOTS; i++) {
+                PoolSlot* slot = &g_pool[i];
+                if (!slot->block) {
+                    if (!empty) empty = slot;
+                } else if (!oldest || slot->stamp < oldest->stamp) {
+                    oldest = slot;
+                }
+            }
+            if (empty && g_pool_bytes + h->size <= g_pool_limit) {
+                empty->block = address;
+                empty->size = h->size;
+                empty->category = h->category;
+                empty->stamp = ++g_pool_clock;
+                g_pool_bytes += h->size;
+                pooled = 1;
+                break;
+            }
+            evicted[evicted_count++] = oldest->block;
+            g_pool_bytes -= oldest->size;
+            oldest->block = NULL;
+        }
+    }
+    POOL_UNLOCK();
+    /* Unmapping is slow: not under the lock */
+    for (int i = 0; i < evicted_count; i++) mem_free(evicted[i]);
+    return pooled;
+}
+
+void mem_pool_trim(void) {
+    void* blocks[MEM_POOL_SLOTS];
+    int count = 0;
+    POOL_LOCK();
+    for (int i = 0; i < MEM_POOL_SLOTS; i++) {
+        if (!g_pool[i].block) continue;
+        blocks[count++] = g_pool[i].block;
+        g_pool[i].block = NULL;
+    }
+    g_pool_bytes = 0;
+    POOL_UNLOCK();
+    for (int i = 0; i < count; i++) mem_free(blocks[i]);
+}
+
+void mem_pool_set_limit(int64_t bytes) {
+    POOL_LOCK();
+    g_pool_limit = bytes == 0 ? MEM_POOL_DEFAULT_BYTES : bytes < 0 ? 0 : (uint64_t)bytes;
+    int over = g_pool_bytes > g_pool_limit;
+    POOL_UNLOCK();
+    /* Shrinking starts over rather than picking what to keep */
+    if (over) mem_pool_trim();
+}
+
+void* mem_alloc(SevenZipMemCategory category, size_t size) {
+    return alloc_block(category, size, 0, 0, MEM_ALLOC_ALIGN);
+}
+
+void* mem_alloc_aligned(SevenZipMemCategory category, size_t size, size_t align) {
+    return alloc_block(category, size, 0, 0, align);
+}
+
+void* mem_calloc(SevenZipMemCategory category, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void* p = alloc_block(category, count * size, 0, 0, MEM_ALLOC_ALIGN);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+/* An existing block keeps its category */
+void* mem_realloc(SevenZipMemCategory category, void* address, size_t size) {
+    if (!address) return mem_alloc(category, size);
+
+    MemHeader* h = header_of(address);
+    if (h->origin == MEM_ORIGIN_DEFAULT && !h->large_pages && h->offset == sizeof(MemHeader)) {
+        /* g_Alloc is malloc: grow in place when the heap can */
+        if (size > SIZE_MAX - sizeof(MemHeader)) return NULL;
+        uint64_t old_size = h->size;
+        int old_category = h->category;
+        MemHeader* moved = (MemHeader*)realloc(h, size + sizeof(MemHeader));
+        if (!moved) return NULL;
+        moved->size = size;
+        account_free(old_category, old_size);
+        account_alloc(old_category, size);
+        return moved + 1;
+    }
+
+    void* p = alloc_block(h->category, size, h->origin == MEM_ORIGIN_BIG, h->large_pages,
+                          MEM_ALLOC_ALIGN);
+    if (!p) return NULL;
+    memcpy(p, address, (size_t)(h->size < size ? h->size : size));
+    mem_free(address);
+    return p;
+}
+
+char* mem_strdup(SevenZipMemCategory category, const char* s) {
+    size_t len = strlen(s) + 1;
+    char* copy = (char*)alloc_block(category, len, 0, 0, MEM_ALLOC_ALIGN);
+    if (copy) memcpy(copy, s, len);
+    return copy;
+}
+
+/* ISzAlloc front ends; the category is fixed by the function, not by `p`,
+ * because callers copy the objects. Pooled ones free into the block pool
+ * and allocate from it first. */
+#define MEM_SZ_ALLOC(name, category, big, large_pages, pooled)           \
+    static void* name##_Alloc(ISzAllocPtr p, size_t size) {              \
+        (void)p;                                                         \
+        void* block = (pooled) ? pool_take(category, size) : NULL;       \
+        return block ? block : alloc_block(category, size, big, large_pages, MEM_ALLOC_ALIGN); \
+    }                                                                    \
+    static void name##_Free(ISzAllocPtr p, void* address) {              \
+        (void)p;                                                         \
+        if (!(pooled) || !pool_put(address)) mem_free(address);          \
+    }                                                                    \
+    const ISzAlloc g_Mem##name##Alloc = { name##_Alloc, name##_Free };
+
+MEM_SZ_ALLOC(Encoder, SEVENZIP_MEM_MATCH_FINDER, 0, 0, 0)
+MEM_SZ_ALLOC(MatchFinder, SEVENZIP_MEM_MATCH_FINDER, 1, 1, 0)
+MEM_SZ_ALLOC(Decoder, SEVENZIP_MEM_DECODER, 0, 1, 1)
+MEM_SZ_ALLOC(Header, SEVENZIP_MEM_HEADER, 0, 0, 0)
+MEM_SZ_ALLOC(Io, SEVENZIP_MEM_IO_BUFFERS, 0, 0, 1)
+
+static void load_usage(SevenZipMemUsage* u, MemCounters* c) {
+    u->current_bytes = COUNTER_LOAD(&c->current);
+    u->peak_bytes = COUNTER_LOAD(&c->peak);
+    u->allocations = COUNTER_LOAD(&c->allocations);
+}
+
+SevenZipErrorCode sevenzip_get_memory_stats(SevenZipMemoryStats* stats) {
+    if (!stats) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    for (int i = 0; i < SEVENZIP_MEM_CATEGORY_COUNT; i++) {
+        load_usage(&stats->categories[i], &g_counters[i]);
+    }
+    load_usage(&stats->total, &g_counters[SEVENZIP_MEM_CATEGORY_COUNT]);
+    return SEVENZIP_OK;
+}
+
+void sevenzip_reset_memory_peaks(void) {
+    for (int i = 0; i <= SEVENZIP_MEM_CATEGORY_COUNT; i++) {
+        COUNTER_STORE(&g_counters[i].peak, COUNTER_LOAD(&g_counters[i].current));
+    }
+}
+
+SevenZipErrorCode sevenzip_set_allocator(const SevenZipAllocator* allocator) {
+    if (!allocator) {
+        mem_pool_trim();
+        g_user_allocator_set = 0;
+        return SEVENZIP_OK;
+    }
+    if (!allocator->alloc || !allocator->free) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    mem_pool_trim();  /* New blocks come from the new allocator */
+    g_user_allocator = *allocator;
+    g_user_allocator_set = 1;
+    return SEVENZIP_OK;
+}
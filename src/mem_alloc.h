@@ -0,0 +1,67 @@
+/**
+ * Memory Accounting - Internal Header
+ *
+ * Counted heap allocation behind sevenzip_get_memory_stats(). Every block
+ * carries a small header with its size, category and origin, so any of
+ * the functions below can free any counted block, and the ISzAlloc
+ * objects may be copied or mixed freely between alloc and free.
+ *
+ * Blocks come from the allocator set with sevenzip_set_allocator(), else
+ * from malloc (g_Alloc) or, for match finders, g_BigAlloc. Match-finder
+ * and decoder blocks may be mapped with huge pages first (large_pages.h).
+ *
+ * Decoder and I/O blocks of MEM_POOL_MIN_BLOCK and more freed through
+ * their ISzAlloc go to a process-wide pool, up to a byte limit, and are
+ * handed out again for the same size and category: the dictionaries and
+ * buffers of the next entry, folder or archive decoded with the same
+ * dictionary size cost no allocation and no page faults.
+ */
+
+#ifndef SEVENZIP_MEM_ALLOC_H
+#define SEVENZIP_MEM_ALLOC_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Alignment of every counted block */
+#define MEM_ALLOC_ALIGN 16
+
+/* Block pool: smallest block kept, blocks kept, default byte limit */
+#define MEM_POOL_MIN_BLOCK (64 * 1024)
+#define MEM_POOL_SLOTS 32
+#define MEM_POOL_DEFAULT_BYTES ((uint64_t)128 << 20)
+
+/* ISzAlloc front ends for the SDK coders, one per use */
+extern const ISzAlloc g_MemEncoderAlloc;      /* Encoder state (MATCH_FINDER) */
+extern const ISzAlloc g_MemMatchFinderAlloc;  /* Match finders, windows, PPMd models; huge pages */
+extern const ISzAlloc g_MemDecoderAlloc;      /* Decoder dictionaries and unpacked folders; huge pages; pooled */
+extern const ISzAlloc g_MemHeaderAlloc;       /* Header parse and archive database */
+extern const ISzAlloc g_MemIoAlloc;           /* I/O buffers; pooled */
+
+/* malloc-style counterparts; mem_free() takes NULL and any counted block */
+void* mem_alloc(SevenZipMemCategory category, size_t size);
+void* mem_calloc(SevenZipMemCategory category, size_t count, size_t size);
+void* mem_realloc(SevenZipMemCategory category, void* address, size_t size);
+char* mem_strdup(SevenZipMemCategory category, const char* s);
+void mem_free(void* address);
+
+/* A block aligned to `align` (a power of two above MEM_ALLOC_ALIGN), freed with mem_free() */
+void* mem_alloc_aligned(SevenZipMemCategory category, size_t size, size_t align);
+
+/* Bytes the block pool may hold (0 = MEM_POOL_DEFAULT_BYTES, negative = no pool) */
+void mem_pool_set_limit(int64_t bytes);
+
+/* Free every pooled block */
+void mem_pool_trim(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_MEM_ALLOC_H */
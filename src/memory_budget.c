@@ -0,0 +1,198 @@
+/**
+ * Memory Budget
+ *
+ * Estimates follow the allocations of the LZMA SDK (LzFind.c, LzmaEnc.c,
+ * Lzma2Enc.c, Ppmd7.c) closely enough to be used as upper bounds by a
+ * scheduler; they do not depend on the input size, so a small job may
+ * use much less than its estimate.
+ */
+
+#include "memory_budget.h"
+#include "cgroup_limits.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#elif defined(__APPLE__)
+    #include <sys/sysctl.h>
+#else
+    #include <unistd.h>
+#endif
+
+/* Coder state outside the match finder: CLzmaEnc with its price tables and
+ * saved state, range-coder buffer, LZMA2 chunk buffer */
+#define LZMA_ENC_STATE_SIZE ((uint64_t)1 << 20)
+
+/* Buffers of the match-finder thread (LzFindMt.c hash and bt blocks) */
+#define LZMA_MT_MF_BUFFERS (((uint64_t)1 << 17) * 2 * 4 + ((uint64_t)1 << 16) * 16 * 4)
+
+/* PPMd I/O buffers and encoder state besides the model */
+#define PPMD_STATE_SIZE ((uint64_t)1 << 20)
+
+/* Hash table entries for a dictionary, as in MatchFinder_GetHashMask() */
+static uint64_t hash_entries(uint32_t dict_size, int num_hash_bytes) {
+    if (num_hash_bytes == 2) return 1 << 16;
+
+    uint32_t hs = dict_size ? dict_size - 1 : 0;
+    hs |= hs >> 1;
+    hs |= hs >> 2;
+    hs |= hs >> 4;
+    hs |= hs >> 8;
+    hs >>= 1;
+    if (hs >= (1 << 24)) {
+        hs = (num_hash_bytes == 3) ? (1 << 24) - 1 : hs >> 1;
+    }
+    hs |= (1 << 16) - 1;
+
+    /* Fixed 2- and 3-byte heads in front of the main table */
+    uint64_t fixed = 0;
+    if (num_hash_bytes > 2) fixed += 1 << 10;
+    if (num_hash_bytes > 3) fixed += 1 << 16;
+    return (uint64_t)hs + 1 + fixed;
+}
+
+/* One LZMA encoder: hash + son arrays, the sliding window and coder state */
+static uint64_t lzma_memory(const CLzmaEncProps* p) {
+    uint64_t dict = p->dictSize;
+    uint64_t sons = (dict + 1) * (p->btMode ? 2 : 1);
+    uint64_t refs = (hash_entries(p->dictSize, p->numHashBytes) + sons) * 4;
+
+    /* Window: history, look-ahead and the move-block reserve */
+    uint64_t window = dict + dict / 2 + ((uint64_t)1 << 21);
+
+    uint64_t lit_probs = ((uint64_t)0x300 << (p->lc + p->lp)) * 2 * 2;
+
+    uint64_t total = refs + window + lit_probs + LZMA_ENC_STATE_SIZE;
+    if (p->numThreads > 1 && p->btMode) total += LZMA_MT_MF_BUFFERS;
+    return total;
+}
+
+uint64_t sevenzip_lzma2_memory(const CLzma2EncProps* props) {
+    int block_threads = props->numBlockThreads_Max > 0 ? props->numBlockThreads_Max : 1;
+    uint64_t per_encoder = lzma_memory(&props->lzmaProps);
+
+    if (block_threads <= 1 || props->blockSize == LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID) {
+        return per_encoder;
+    }
+
+    /* MtCoder: one input block per thread plus a spare, and one packed
+     * output block per thread */
+    uint64_t block = props->blockSize;
+    uint64_t out_block = block + (block >> 10) + 16;
+    return (uint64_t)block_threads * (per_encoder + block + out_block) + block;
+}
+
+uint64_t sevenzip_ppmd_memory(uint32_t mem_size) {
+    return (uint64_t)mem_size + PPMD_STATE_SIZE;
+}
+
+int sevenzip_fit_lzma2(CLzma2EncProps* props, uint64_t budget) {
+    for (;;) {
+        if (sevenzip_lzma2_memory(props) <= budget) return 1;
+
+        CLzmaEncProps* lz = &props->lzmaProps;
+        int block_threads = props->numBlockThreads_Max;
+        int multi_block = block_threads > 1 && props->blockSize != LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID;
+
+        /* 1. Smaller blocks (not below the dictionary or 1MB) */
+        if (multi_block && props->blockSize / 2 >= lz->dictSize &&
+            props->blockSize / 2 >= MEMORY_BUDGET_MIN_SIZE) {
+            props->blockSize /= 2;
+            continue;
+        }
+
+        /* 2. Fewer block threads */
+        if (block_threads > 1) {
+            props->numBlockThreads_Max = block_threads - 1;
+            props->numBlockThreads_Reduced = -1;
+            props->numTotalThreads = lz->numThreads * props->numBlockThreads_Max;
+            continue;
+        }
+
+        /* 3. Match finder on the coder thread */
+        if (lz->numThreads > 1) {
+            lz->numThreads = 1;
+            props->numTotalThreads = 1;
+            continue;
+        }
+
+        /* 4. Smaller dictionary */
+        if (lz->dictSize / 2 >= MEMORY_BUDGET_MIN_SIZE) {
+            lz->dictSize /= 2;
+            continue;
+        }
+
+        return 0;
+    }
+}
+
+int sevenzip_fit_ppmd(uint32_t* mem_size, uint64_t budget) {
+    while (sevenzip_ppmd_memory(*mem_size) > budget) {
+        if (*mem_size / 2 < MEMORY_BUDGET_MIN_SIZE) return 0;
+        *mem_size /= 2;
+    }
+    return 1;
+}
+
+int sevenzip_fit_coders(CLzma2EncProps* props, uint32_t* ppmd_mem_size, uint64_t budget,
+                        uint64_t* used) {
+    uint64_t lzma = props ? sevenzip_lzma2_memory(props) : 0;
+    uint64_t ppmd = ppmd_mem_size ? sevenzip_ppmd_memory(*ppmd_mem_size) : 0;
+    int ok = 1;
+
+    if (lzma + ppmd > budget) {
+        if (props && ppmd_mem_size) {
+            /* Both alive at once: the model gets at most a quarter */
+            if (ppmd > budget / 4) ok = sevenzip_fit_ppmd(ppmd_mem_size, budget / 4);
+            ppmd = sevenzip_ppmd_memory(*ppmd_mem_size);
+            ok = ok && ppmd < budget && sevenzip_fit_lzma2(props, budget - ppmd);
+        } else if (props) {
+            ok = sevenzip_fit_lzma2(props, budget);
+        } else {
+            ok = sevenzip_fit_ppmd(ppmd_mem_size, budget);
+        }
+        lzma = props ? sevenzip_lzma2_memory(props) : 0;
+        ppmd = ppmd_mem_size ? sevenzip_ppmd_memory(*ppmd_mem_size) : 0;
+    }
+
+    if (used) *used = lzma + ppmd;
+    return ok;
+}
+
+uint64_t sevenzip_available_memory(void) {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? (uint64_t)status.ullAvailPhys : 0;
+#elif defined(__APPLE__)
+    /* No cheap count of reclaimable pages: a quarter of the RAM */
+    uint64_t mem = 0;
+    size_t len = sizeof(mem);
+    return sysctlbyname("hw.memsize", &mem, &len, NULL, 0) == 0 ? mem / 4 : 0;
+#elif defined(__linux__)
+    uint64_t avail = 0;
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (f) {
+        char line[256];
+        unsigned long long kb;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+                avail = (uint64_t)kb * 1024;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    uint64_t cgroup = cgroup_memory_available();
+    if (cgroup && (!avail || cgroup < avail)) avail = cgroup;
+    return avail;
+#elif defined(_SC_AVPHYS_PAGES)
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    return pages > 0 && page_size > 0 ? (uint64_t)pages * (uint64_t)page_size : 0;
+#else
+    return 0;
+#endif
+}
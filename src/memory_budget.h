@@ -0,0 +1,89 @@
+/**
+ * Memory Budget - Internal Header
+ *
+ * Peak-memory estimates for the encoders and the fitting used by the
+ * max_memory option: a job that would exceed its budget gets fewer block
+ * threads, smaller LZMA2 blocks and, as a last resort, a smaller
+ * dictionary or PPMd model.
+ */
+
+#ifndef SEVENZIP_MEMORY_BUDGET_H
+#define SEVENZIP_MEMORY_BUDGET_H
+
+#include "../include/7z_ffi.h"
+#include "Lzma2Enc.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Fitting never shrinks a dictionary, LZMA2 block or PPMd model below this */
+#define MEMORY_BUDGET_MIN_SIZE (1 << 20)
+
+/**
+ * Peak heap use of one LZMA2 encoder
+ * Covers the match finder, window and coder state of every block thread
+ * plus the per-block input/output buffers of the multithreaded coder.
+ * @param props Normalized properties (Lzma2EncProps_Normalize)
+ * @return Upper bound in bytes
+ */
+uint64_t sevenzip_lzma2_memory(const CLzma2EncProps* props);
+
+/**
+ * Peak heap use of one PPMd encoder with a `mem_size` model
+ */
+uint64_t sevenzip_ppmd_memory(uint32_t mem_size);
+
+/**
+ * Reduce normalized LZMA2 properties until the encoder fits `budget`
+ * Shrinks the block size toward the dictionary, drops block threads, the
+ * match-finder thread and finally halves the dictionary.
+ * @return 1 if the encoder now fits, 0 if it cannot be made small enough
+ */
+int sevenzip_fit_lzma2(CLzma2EncProps* props, uint64_t budget);
+
+/**
+ * Halve a PPMd model size until it fits `budget` (not below 1MB)
+ * @return 1 if the model now fits, 0 otherwise
+ */
+int sevenzip_fit_ppmd(uint32_t* mem_size, uint64_t budget);
+
+/**
+ * Fit an LZMA2 encoder and a PPMd model that are alive at the same time
+ * @param props Normalized LZMA2 properties (NULL = no LZMA2 encoder)
+ * @param ppmd_mem_size PPMd model size (NULL = no PPMd encoder)
+ * @param budget Bytes available to the coders
+ * @param used Output: estimated bytes after fitting (may be NULL)
+ * @return 1 if both fit, 0 if the budget is too small even after shrinking
+ */
+int sevenzip_fit_coders(CLzma2EncProps* props, uint32_t* ppmd_mem_size, uint64_t budget,
+                        uint64_t* used);
+
+/* Planner of sevenzip_create_7z() and its batch form (archive_create.c) */
+SevenZipErrorCode sevenzip_create_memory_plan(
+    SevenZipCompressionLevel level,
+    const SevenZipCompressOptions* options,
+    uint64_t* peak_bytes
+);
+
+/* Planner of the create engine (create_engine.h, archive_create_multivolume.c) */
+SevenZipErrorCode sevenzip_multivolume_memory_plan(
+    SevenZipCompressionLevel level,
+    const SevenZipStreamOptions* options,
+    uint64_t* peak_bytes
+);
+
+/**
+ * Memory the process can take now without swapping
+ * MemAvailable on Linux, capped by what the cgroup limit leaves (v2 or v1);
+ * available physical memory on Windows, a quarter of the RAM on macOS.
+ * @return Bytes, 0 when unknown
+ */
+uint64_t sevenzip_available_memory(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_MEMORY_BUDGET_H */
@@ -0,0 +1,99 @@
+/**
+ * Memory Pressure
+ *
+ * The PSI file is read by whichever worker finds the last reading stale,
+ * under the lock; waiting workers sleep on the condition variable with a
+ * PRESSURE_POLL_MS timeout, so they see the pressure clear without a
+ * thread of its own. A file that can no longer be read counts as no
+ * pressure.
+ */
+
+#include "memory_pressure.h"
+#include "cgroup_limits.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* The clock of pthread_cond_timedwait() */
+static double now_seconds(struct timespec* ts) {
+    timespec_get(ts, TIME_UTC);
+    return (double)ts->tv_sec + (double)ts->tv_nsec / 1e9;
+}
+
+/* "some avg10" of the PSI file; -1 if unreadable */
+static double read_pressure(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1.0;
+    double avg10 = -1.0;
+    if (fscanf(f, "some avg10=%lf", &avg10) != 1) avg10 = -1.0;
+    fclose(f);
+    return avg10;
+}
+
+/* Read the file again once PRESSURE_POLL_MS has passed; lock held */
+static void poll_pressure(MemoryPressure* p) {
+    struct timespec ts;
+    double now = now_seconds(&ts);
+    if (now - p->polled < PRESSURE_POLL_MS / 1000.0) return;
+    p->polled = now;
+    double avg10 = read_pressure(p->path);
+    if (p->high) {
+        p->high = avg10 >= p->threshold / 2;
+    } else {
+        p->high = avg10 >= p->threshold;
+    }
+}
+
+int memory_pressure_init(MemoryPressure* p, int percent) {
+    char path[sizeof(p->path)];
+    if (!cgroup_memory_pressure_path(path, sizeof(path))) return 0;
+    memory_pressure_init_path(p, path, percent);
+    return 1;
+}
+
+void memory_pressure_init_path(MemoryPressure* p, const char* path, int percent) {
+    memset(p, 0, sizeof(*p));
+    snprintf(p->path, sizeof(p->path), "%s", path);
+    if (percent < 1) percent = 1;
+    if (percent > 100) percent = 100;
+    p->threshold = percent;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->changed, NULL);
+}
+
+void memory_pressure_destroy(MemoryPressure* p) {
+    pthread_cond_destroy(&p->changed);
+    pthread_mutex_destroy(&p->lock);
+}
+
+int memory_pressure_throttled(MemoryPressure* p) {
+    pthread_mutex_lock(&p->lock);
+    poll_pressure(p);
+    int held = p->high && p->active > 0;
+    pthread_mutex_unlock(&p->lock);
+    return held;
+}
+
+void memory_pressure_enter(MemoryPressure* p) {
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        poll_pressure(p);
+        if (!p->high || p->active == 0) break;
+        struct timespec ts;
+        now_seconds(&ts);
+        uint64_t ns = (uint64_t)ts.tv_nsec + PRESSURE_POLL_MS * 1000000ULL;
+        ts.tv_sec += (time_t)(ns / 1000000000ULL);
+        ts.tv_nsec = (long)(ns % 1000000000ULL);
+        pthread_cond_timedwait(&p->changed, &p->lock, &ts);
+    }
+    p->active++;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void memory_pressure_leave(MemoryPressure* p) {
+    pthread_mutex_lock(&p->lock);
+    p->active--;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,62 @@
+/**
+ * Memory Pressure - Internal Header
+ *
+ * Throttling of SevenZipStreamOptions.memory_pressure_throttle. The
+ * "some avg10" figure of the PSI file cgroup_memory_pressure_path() names
+ * (the share of the last 10s in which a task waited for memory) is read
+ * at most every PRESSURE_POLL_MS. Once it reaches the threshold, workers
+ * run one at a time: memory_pressure_enter() holds a worker back at its
+ * next block boundary while another is working, and a held worker frees
+ * its encoder first. Below half the threshold they all run again. One
+ * worker always runs, so the job still finishes under lasting pressure,
+ * only slower.
+ */
+
+#ifndef SEVENZIP_MEMORY_PRESSURE_H
+#define SEVENZIP_MEMORY_PRESSURE_H
+
+#include "../include/7z_ffi.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shortest time between two reads of the PSI file */
+#define PRESSURE_POLL_MS 250
+
+typedef struct {
+    char path[512];       /* PSI file */
+    double threshold;     /* Percent of stalled time that starts throttling */
+    pthread_mutex_t lock;
+    pthread_cond_t changed;  /* A worker left, or it is time to poll again */
+    double polled;        /* Time of the last read, in seconds */
+    int high;             /* Throttling */
+    int active;           /* Workers between enter and leave */
+} MemoryPressure;
+
+/**
+ * Watch the pressure of the process's cgroup (or the system)
+ * @param percent Threshold, clamped to 1..100
+ * @return 0 without a PSI file to watch; `p` is then unused
+ */
+int memory_pressure_init(MemoryPressure* p, int percent);
+
+/* memory_pressure_init() on a given PSI file (tests feed readings this way) */
+void memory_pressure_init_path(MemoryPressure* p, const char* path, int percent);
+
+void memory_pressure_destroy(MemoryPressure* p);
+
+/* Whether memory_pressure_enter() would hold the caller back now */
+int memory_pressure_throttled(MemoryPressure* p);
+
+/* Wait while throttled and another worker is active, then count as active */
+void memory_pressure_enter(MemoryPressure* p);
+
+void memory_pressure_leave(MemoryPressure* p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_MEMORY_PRESSURE_H */
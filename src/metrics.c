@@ -0,0 +1,218 @@
+/**
+ * Process Metrics
+ *
+ * Each thread counts into a shard of its own, created on its first
+ * count and linked into a registry; only the owner writes a shard, so a
+ * count is a relaxed load and store with no read-modify-write. A
+ * snapshot sums the shards under the registry lock, which otherwise
+ * only threads starting to count and exiting take. An exiting thread
+ * folds its shard into `g_retired`. Gauges move on whichever thread sees
+ * the change, so one shard's share of a gauge may be negative; the sum
+ * is not.
+ */
+
+#include "metrics.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <windows.h>
+    typedef volatile __int64 MetricCounter;
+    #define COUNTER_LOAD(p) ((uint64_t)InterlockedCompareExchange64((p), 0, 0))
+    #define COUNTER_STORE(p, v) InterlockedExchange64((p), (__int64)(v))
+#else
+    #include <stdatomic.h>
+    typedef _Atomic uint64_t MetricCounter;
+    #define COUNTER_LOAD(p) atomic_load_explicit((p), memory_order_relaxed)
+    #define COUNTER_STORE(p, v) atomic_store_explicit((p), (v), memory_order_relaxed)
+#endif
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+/* Counters of one operation kind: count, errors, bytes in and out, the
+ * latency sum in nanoseconds, then the buckets (not cumulative) */
+enum {
+    OP_COUNT = 0,
+    OP_ERRORS = 1,
+    OP_BYTES_IN = 2,
+    OP_BYTES_OUT = 3,
+    OP_LATENCY_NS = 4,
+    OP_BUCKETS = 5,
+    OP_SLOTS = OP_BUCKETS + SEVENZIP_METRICS_BUCKETS
+};
+
+enum {
+    SLOT_OPS = 0,
+    SLOT_CACHES = SLOT_OPS + SEVENZIP_METRIC_OP_COUNT * OP_SLOTS,   /* hits, misses */
+    SLOT_GAUGES = SLOT_CACHES + SEVENZIP_METRIC_CACHE_COUNT * 2,
+    SLOT_COUNT = SLOT_GAUGES + METRICS_GAUGE_COUNT
+};
+
+/* Padded so no other thread's counters share its cache lines */
+typedef struct MetricsShard {
+    struct MetricsShard* prev;
+    struct MetricsShard* next;
+    char pad_before[64];
+    MetricCounter counters[SLOT_COUNT];
+    char pad_after[64];
+} MetricsShard;
+
+static pthread_mutex_t g_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static MetricsShard* g_shards = NULL;
+static uint64_t g_retired[SLOT_COUNT];   /* Exited threads, and counts made without a shard */
+
+static pthread_key_t shard_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+
+static void retire_shard(void* p) {
+    MetricsShard* shard = (MetricsShard*)p;
+    pthread_mutex_lock(&g_registry_lock);
+    for (int i = 0; i < SLOT_COUNT; i++) g_retired[i] += COUNTER_LOAD(&shard->counters[i]);
+    if (shard->prev) shard->prev->next = shard->next;
+    else g_shards = shard->next;
+    if (shard->next) shard->next->prev = shard->prev;
+    pthread_mutex_unlock(&g_registry_lock);
+    free(shard);
+}
+
+static void make_shard_key(void) {
+    pthread_key_create(&shard_key, retire_shard);
+}
+
+static MetricsShard* get_shard(void) {
+    pthread_once(&shard_key_once, make_shard_key);
+
+    MetricsShard* shard = (MetricsShard*)pthread_getspecific(shard_key);
+    if (!shard) {
+        shard = (MetricsShard*)calloc(1, sizeof(MetricsShard));
+        if (!shard) return NULL;
+        if (pthread_setspecific(shard_key, shard) != 0) {
+            free(shard);
+            return NULL;
+        }
+        pthread_mutex_lock(&g_registry_lock);
+        shard->next = g_shards;
+        if (g_shards) g_shards->prev = shard;
+        g_shards = shard;
+        pthread_mutex_unlock(&g_registry_lock);
+    }
+    return shard;
+}
+
+/* Helper: Add to a counter of the calling thread */
+static void count(int slot, uint64_t amount) {
+    MetricsShard* shard = get_shard();
+    if (shard) {
+        COUNTER_STORE(&shard->counters[slot], COUNTER_LOAD(&shard->counters[slot]) + amount);
+    } else {
+        pthread_mutex_lock(&g_registry_lock);
+        g_retired[slot] += amount;
+        pthread_mutex_unlock(&g_registry_lock);
+    }
+}
+
+static uint64_t monotonic_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void metrics_op_begin(MetricsOp* m, SevenZipMetricOp op) {
+    m->op = op;
+    m->start_ns = monotonic_ns();
+    m->bytes_in = 0;
+    m->bytes_out = 0;
+}
+
+void metrics_op_end(const MetricsOp* m, SevenZipErrorCode result) {
+    uint64_t elapsed = monotonic_ns() - m->start_ns;
+    int bucket = 0;
+    while (bucket < SEVENZIP_METRICS_BUCKETS - 1 && elapsed > (uint64_t)1000000 << bucket) bucket++;
+
+    int base = SLOT_OPS + (int)m->op * OP_SLOTS;
+    count(base + OP_COUNT, 1);
+    count(base + OP_LATENCY_NS, elapsed);
+    count(base + OP_BUCKETS + bucket, 1);
+    if (result != SEVENZIP_OK) {
+        count(base + OP_ERRORS, 1);
+    } else {
+        if (m->bytes_in) count(base + OP_BYTES_IN, m->bytes_in);
+        if (m->bytes_out) count(base + OP_BYTES_OUT, m->bytes_out);
+    }
+}
+
+void metrics_cache_lookup(SevenZipMetricCache cache, int hit) {
+    count(SLOT_CACHES + (int)cache * 2 + (hit ? 0 : 1), 1);
+}
+
+void metrics_gauge_add(MetricsGauge gauge, int64_t delta) {
+    count(SLOT_GAUGES + (int)gauge, (uint64_t)delta);
+}
+
+/* Helper: A gauge's sum; a snapshot racing both ends of a change may see
+ * the decrement alone */
+static uint64_t gauge_value(uint64_t sum) {
+    return (int64_t)sum > 0 ? sum : 0;
+}
+
+SevenZipErrorCode sevenzip_metrics_snapshot(SevenZipMetrics* metrics) {
+    if (!metrics) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    uint64_t sums[SLOT_COUNT];
+    pthread_mutex_lock(&g_registry_lock);
+    memcpy(sums, g_retired, sizeof(sums));
+    for (MetricsShard* shard = g_shards; shard; shard = shard->next) {
+        for (int i = 0; i < SLOT_COUNT; i++) sums[i] += COUNTER_LOAD(&shard->counters[i]);
+    }
+    pthread_mutex_unlock(&g_registry_lock);
+
+    memset(metrics, 0, sizeof(*metrics));
+    for (int op = 0; op < SEVENZIP_METRIC_OP_COUNT; op++) {
+        const uint64_t* s = sums + SLOT_OPS + op * OP_SLOTS;
+        SevenZipOpMetrics* out = &metrics->ops[op];
+        out->count = s[OP_COUNT];
+        out->errors = s[OP_ERRORS];
+        out->bytes_in = s[OP_BYTES_IN];
+        out->bytes_out = s[OP_BYTES_OUT];
+        out->latency_seconds = (double)s[OP_LATENCY_NS] / 1e9;
+        uint64_t cumulative = 0;
+        for (int b = 0; b < SEVENZIP_METRICS_BUCKETS; b++) {
+            cumulative += s[OP_BUCKETS + b];
+            out->latency_buckets[b] = cumulative;
+        }
+    }
+    for (int b = 0; b < SEVENZIP_METRICS_BUCKETS - 1; b++) {
+        metrics->latency_bounds[b] = 0.001 * (double)((uint64_t)1 << b);
+    }
+    metrics->latency_bounds[SEVENZIP_METRICS_BUCKETS - 1] = INFINITY;
+    for (int c = 0; c < SEVENZIP_METRIC_CACHE_COUNT; c++) {
+        metrics->caches[c].hits = sums[SLOT_CACHES + c * 2];
+        metrics->caches[c].misses = sums[SLOT_CACHES + c * 2 + 1];
+    }
+    metrics->jobs_active = gauge_value(sums[SLOT_GAUGES + METRICS_GAUGE_JOBS_ACTIVE]);
+    metrics->jobs_queued = gauge_value(sums[SLOT_GAUGES + METRICS_GAUGE_JOBS_QUEUED]);
+    metrics->threads_busy = gauge_value(sums[SLOT_GAUGES + METRICS_GAUGE_THREADS_BUSY]);
+
+    SevenZipMemoryStats memory;
+    if (sevenzip_get_memory_stats(&memory) == SEVENZIP_OK) {
+        metrics->bytes_allocated = memory.total.current_bytes;
+        metrics->allocations = memory.total.allocations;
+    }
+    return SEVENZIP_OK;
+}
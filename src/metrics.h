@@ -0,0 +1,51 @@
+/**
+ * Process Metrics - Internal Header
+ *
+ * Counters behind sevenzip_metrics_snapshot(). Operations are timed
+ * around their run:
+ *
+ *     MetricsOp op;
+ *     metrics_op_begin(&op, SEVENZIP_METRIC_EXTRACT);
+ *     ... the operation, setting op.bytes_in and op.bytes_out ...
+ *     metrics_op_end(&op, result);
+ *
+ * Caches report each lookup, and the job queue and thread quota move
+ * their gauges by deltas, from whichever thread sees the change.
+ */
+
+#ifndef SEVENZIP_METRICS_H
+#define SEVENZIP_METRICS_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    METRICS_GAUGE_JOBS_ACTIVE = 0,
+    METRICS_GAUGE_JOBS_QUEUED = 1,
+    METRICS_GAUGE_THREADS_BUSY = 2,
+    METRICS_GAUGE_COUNT = 3
+} MetricsGauge;
+
+typedef struct {
+    SevenZipMetricOp op;
+    uint64_t start_ns;
+    uint64_t bytes_in;         /* Counted only if the operation succeeds */
+    uint64_t bytes_out;
+} MetricsOp;
+
+void metrics_op_begin(MetricsOp* m, SevenZipMetricOp op);
+void metrics_op_end(const MetricsOp* m, SevenZipErrorCode result);
+
+void metrics_cache_lookup(SevenZipMetricCache cache, int hit);
+
+void metrics_gauge_add(MetricsGauge gauge, int64_t delta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_METRICS_H */
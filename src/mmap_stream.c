@@ -0,0 +1,290 @@
+/**
+ * Memory-Mapped Archive Input
+ *
+ * Volumes are mapped whole and read-only; the current volume is cached so
+ * the sequential Look/Skip pairs of the decoders do not search the table.
+ * Reads past the end return no bytes, like a file read at EOF. A volume
+ * found shorter than its mapping fails the read instead of faulting.
+ */
+
+#include "mmap_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && defined(MADV_SEQUENTIAL)
+    #define HAVE_MADVISE 1
+#else
+    #define HAVE_MADVISE 0
+#endif
+
+/* Head of each volume paged in ahead when a reader enters a volume */
+#define MMAP_PREFETCH_SIZE (4 * 1024 * 1024)
+
+static int map_volume(MmapVolume* v, FILE* file, uint64_t size) {
+    v->data = NULL;
+    v->size = size;
+    v->handle = NULL;
+    v->fd = -1;
+    if (size == 0) return 1;
+    if (size > (uint64_t)SIZE_MAX) return 0;
+#ifdef _WIN32
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(file));
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    HANDLE m = CreateFileMappingW(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m) return 0;
+    void* data = MapViewOfFile(m, FILE_MAP_READ, 0, 0, (SIZE_T)size);
+    if (!data) {
+        CloseHandle(m);
+        return 0;
+    }
+    v->handle = m;
+#else
+    int fd = dup(fileno(file));
+    if (fd < 0) return 0;
+    void* data = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+#if HAVE_MADVISE
+    madvise(data, (size_t)size, MADV_SEQUENTIAL);
+#endif
+    v->fd = fd;
+#endif
+    v->data = (const Byte*)data;
+    return 1;
+}
+
+static void unmap_volume(MmapVolume* v) {
+    if (!v->data) return;
+#ifdef _WIN32
+    UnmapViewOfFile((LPCVOID)v->data);
+    CloseHandle((HANDLE)v->handle);
+#else
+    munmap((void*)v->data, (size_t)v->size);
+    if (v->fd >= 0) close(v->fd);
+#endif
+    v->data = NULL;
+    v->fd = -1;
+}
+
+/* Whether the file still covers the whole mapping */
+static int volume_intact(const MmapVolume* v) {
+#ifdef _WIN32
+    (void)v;
+    return 1;
+#else
+    struct stat st;
+    if (v->fd < 0) return 1;
+    return fstat(v->fd, &st) == 0 && (uint64_t)st.st_size >= v->size;
+#endif
+}
+
+/* Start paging in the heads of the volumes after i, ahead of the switch to
+ * them; the kernel reads them at once, each from its own device */
+static void will_need_next(const MmapInStream* p, int i) {
+#if HAVE_MADVISE && defined(MADV_WILLNEED)
+    int ahead = p->readahead > 0 ? p->readahead : 1;
+    for (int k = i + 1; k <= i + ahead && k < p->volume_count; k++) {
+        if (!p->volumes[k].data) continue;
+        uint64_t size = p->volumes[k].size;
+        if (size > MMAP_PREFETCH_SIZE) size = MMAP_PREFETCH_SIZE;
+        madvise((void*)p->volumes[k].data, (size_t)size, MADV_WILLNEED);
+    }
+#else
+    (void)p;
+    (void)i;
+#endif
+}
+
+/* Volume holding the current position, NULL at or past the end */
+static const MmapVolume* locate(MmapInStream* p) {
+    if (p->pos >= p->total_size) return NULL;
+    int i = p->current;
+    const MmapVolume* v = &p->volumes[i];
+    if (p->pos >= v->offset && p->pos < v->offset + v->size) return v;
+    if (i + 1 < p->volume_count && p->pos >= v[1].offset && p->pos < v[1].offset + v[1].size) {
+        i++;
+    } else {
+        /* Last non-empty volume starting at or before pos */
+        int lo = 0;
+        int hi = p->volume_count - 1;
+        while (lo < hi) {
+            int mid = lo + (hi - lo + 1) / 2;
+            if (p->volumes[mid].offset <= p->pos) lo = mid;
+            else hi = mid - 1;
+        }
+        while (p->volumes[lo].size == 0 || p->pos >= p->volumes[lo].offset + p->volumes[lo].size) lo++;
+        i = lo;
+    }
+    p->current = i;
+    will_need_next(p, i);
+    return &p->volumes[i];
+}
+
+/*
+ * Pass new bytes of [start, end) to the consume hook. Decoders stop without
+ * skipping their last lookahead, so bytes count once handed out, the way
+ * a buffered reader counts them once read from the file.
+ */
+static void report_range(MmapInStream* p, uint64_t start, uint64_t end) {
+    if (end <= p->reported) return;
+    if (start < p->reported) start = p->reported;
+    p->reported = end;
+    if (p->consumed) p->consumed(p->consumed_ctx, (size_t)(end - start));
+}
+
+static SRes MmapInStream_Look(ILookInStreamPtr pp, const void** buf, size_t* size) {
+    MmapInStream* p = Z7_CONTAINER_FROM_VTBL(pp, MmapInStream, vt);
+    const MmapVolume* v = locate(p);
+    if (!v) {
+        *size = 0;
+        return SZ_OK;
+    }
+    if (!volume_intact(v)) {
+        *size = 0;
+        return SZ_ERROR_READ;
+    }
+    uint64_t avail = v->offset + v->size - p->pos;
+    if (*size > avail) *size = (size_t)avail;
+    *buf = v->data + (size_t)(p->pos - v->offset);
+    report_range(p, p->pos, p->pos + *size);
+    return SZ_OK;
+}
+
+static SRes MmapInStream_Skip(ILookInStreamPtr pp, size_t offset) {
+    MmapInStream* p = Z7_CONTAINER_FROM_VTBL(pp, MmapInStream, vt);
+    p->pos += offset;
+    return SZ_OK;
+}
+
+static SRes MmapInStream_Read(ILookInStreamPtr pp, void* buf, size_t* size) {
+    MmapInStream* p = Z7_CONTAINER_FROM_VTBL(pp, MmapInStream, vt);
+    Byte* out = (Byte*)buf;
+    uint64_t start = p->pos;
+    size_t done = 0;
+    SRes res = SZ_OK;
+    while (done < *size) {
+        const MmapVolume* v = locate(p);
+        if (!v) break;
+        if (!volume_intact(v)) {
+            res = SZ_ERROR_READ;
+            break;
+        }
+        uint64_t avail = v->offset + v->size - p->pos;
+        size_t n = *size - done;
+        if (n > avail) n = (size_t)avail;
+        memcpy(out + done, v->data + (size_t)(p->pos - v->offset), n);
+        p->pos += n;
+        done += n;
+    }
+    *size = done;
+    report_range(p, start, p->pos);
+    return res;
+}
+
+static SRes MmapInStream_Seek(ILookInStreamPtr pp, Int64* pos, ESzSeek origin) {
+    MmapInStream* p = Z7_CONTAINER_FROM_VTBL(pp, MmapInStream, vt);
+    Int64 base;
+    switch (origin) {
+        case SZ_SEEK_SET: base = 0; break;
+        case SZ_SEEK_CUR: base = (Int64)p->pos; break;
+        case SZ_SEEK_END: base = (Int64)p->total_size; break;
+        default: return SZ_ERROR_PARAM;
+    }
+    if (*pos < -base) return SZ_ERROR_PARAM;
+    p->pos = (uint64_t)(base + *pos);
+    p->reported = p->pos;
+    *pos = (Int64)p->pos;
+    return SZ_OK;
+}
+
+static void init_vtable(MmapInStream* p) {
+    p->vt.Look = MmapInStream_Look;
+    p->vt.Skip = MmapInStream_Skip;
+    p->vt.Read = MmapInStream_Read;
+    p->vt.Seek = MmapInStream_Seek;
+}
+
+int mmap_in_stream_open_files(MmapInStream* p, FILE* const* files,
+                              const uint64_t* sizes, int count) {
+    memset(p, 0, sizeof(*p));
+    if (count <= 0) return 0;
+    p->volumes = (MmapVolume*)calloc((size_t)count, sizeof(MmapVolume));
+    if (!p->volumes) return 0;
+    p->owner = 1;
+    for (int i = 0; i < count; i++) {
+        if (!map_volume(&p->volumes[i], files[i], sizes[i])) {
+            mmap_in_stream_close(p);
+            return 0;
+        }
+        p->volumes[i].offset = p->total_size;
+        p->total_size += sizes[i];
+        p->volume_count = i + 1;
+    }
+    init_vtable(p);
+    return 1;
+}
+
+int mmap_in_stream_open(MmapInStream* p, const char* path) {
+    memset(p, 0, sizeof(*p));
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    uint64_t size;
+#ifdef _WIN32
+    struct _stat64 st;
+    int ok = _fstat64(_fileno(f), &st) == 0;
+#else
+    struct stat st;
+    int ok = fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode);
+#endif
+    size = ok ? (uint64_t)st.st_size : 0;
+    /* An empty file has nothing to map and is no archive either way */
+    ok = ok && size > 0 && mmap_in_stream_open_files(p, &f, &size, 1);
+    fclose(f);
+    return ok;
+}
+
+void mmap_in_stream_open_memory(MmapInStream* p, MmapVolume* volume,
+                                const void* data, size_t size) {
+    memset(p, 0, sizeof(*p));
+    volume->data = size > 0 ? (const Byte*)data : NULL;
+    volume->size = size;
+    volume->offset = 0;
+    volume->handle = NULL;
+    volume->fd = -1;
+    p->volumes = volume;
+    p->volume_count = 1;
+    p->total_size = size;
+    init_vtable(p);
+}
+
+void mmap_in_stream_share(MmapInStream* p, const MmapInStream* src) {
+    *p = *src;
+    p->owner = 0;
+    p->pos = 0;
+    p->reported = 0;
+    p->current = 0;
+    p->consumed = NULL;
+    p->consumed_ctx = NULL;
+}
+
+void mmap_in_stream_close(MmapInStream* p) {
+    if (p->owner && p->volumes) {
+        for (int i = 0; i < p->volume_count; i++) {
+            unmap_volume(&p->volumes[i]);
+        }
+        free(p->volumes);
+    }
+    memset(p, 0, sizeof(*p));
+}
@@ -0,0 +1,97 @@
+/**
+ * Memory-Mapped Archive Input - Internal Header
+ *
+ * An ILookInStream over read-only mappings of the archive volumes. Look
+ * hands out pointers straight into the mapping, so the decoders read the
+ * packed bytes where the page cache holds them: no staging buffer, no
+ * copy and no read() per refill. A split archive maps each volume on its
+ * own and is read as one stream; Look stops at the end of a volume and
+ * the next call continues in the following one.
+ *
+ * A mapping only stays valid while the file keeps its size: touching a
+ * page past the end of a truncated file faults (SIGBUS). Each volume keeps
+ * a descriptor, and every Look and Read checks its size with fstat()
+ * before handing out bytes, so an archive truncated under a running
+ * extraction fails with SZ_ERROR_READ; only a truncation between that
+ * check and the decoder's use of the window can still fault. Windows
+ * refuses to truncate a mapped file and needs no check. Callers fall back
+ * to the buffered readers when mapping fails (empty file, no address
+ * space on 32-bit hosts, special files, no descriptor left).
+ */
+
+#ifndef SEVENZIP_MMAP_STREAM_H
+#define SEVENZIP_MMAP_STREAM_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One mapped volume */
+typedef struct {
+    const Byte* data;  /* NULL for an empty volume */
+    uint64_t size;
+    uint64_t offset;   /* Start of the volume in the joined stream */
+    void* handle;      /* File mapping object (Windows) */
+    int fd;            /* Descriptor for the size check (-1 = none) */
+} MmapVolume;
+
+typedef struct {
+    ILookInStream vt;
+    MmapVolume* volumes;
+    int volume_count;
+    int owner;          /* Unmaps the volumes on close */
+    uint64_t total_size;
+    uint64_t pos;
+    uint64_t reported;  /* End of the bytes passed to `consumed` since the last seek */
+    int current;        /* Volume holding `pos` */
+    int readahead;      /* Volumes after the current one paged in ahead (0 = 1) */
+
+    /* Optional: told how many new bytes each Look or Read handed out */
+    void (*consumed)(void* ctx, size_t size);
+    void* consumed_ctx;
+} MmapInStream;
+
+/**
+ * Map a single-file archive
+ * @return 1 on success, 0 if the file cannot be opened or mapped
+ */
+int mmap_in_stream_open(MmapInStream* p, const char* path);
+
+/**
+ * Map already opened volumes, in order, as one stream
+ * The FILE handles are not closed by the stream and may be closed once
+ * this returns; the mappings, and a duplicate of each descriptor, stay.
+ * @return 1 on success, 0 if any non-empty volume cannot be mapped
+ */
+int mmap_in_stream_open_files(MmapInStream* p, FILE* const* files,
+                              const uint64_t* sizes, int count);
+
+/**
+ * Second reader on the mappings of `src`, with its own position
+ * `src` must stay open while the copy is in use; the copy is closed with
+ * mmap_in_stream_close() as well, which leaves the mappings alone.
+ */
+void mmap_in_stream_share(MmapInStream* p, const MmapInStream* src);
+
+/**
+ * Read a buffer in memory as a one-volume stream, without copying it
+ * `volume` is the stream's volume table; it and `data` must outlive the
+ * stream, and mmap_in_stream_close() leaves both alone.
+ */
+void mmap_in_stream_open_memory(MmapInStream* p, MmapVolume* volume,
+                                const void* data, size_t size);
+
+/* Unmap (if owner) and reset */
+void mmap_in_stream_close(MmapInStream* p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_MMAP_STREAM_H */
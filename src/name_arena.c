@@ -0,0 +1,103 @@
+/**
+ * Name Arena
+ *
+ * Blocks of NAME_ARENA_BLOCK_SIZE bytes filled front to back; a string
+ * longer than a block gets a block of its own.
+ */
+
+#include "name_arena.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+#define NAME_ARENA_BLOCK_SIZE (256 * 1024)
+
+struct NameArenaBlock {
+    NameArenaBlock* next;
+};
+
+void name_arena_init(NameArena* arena) {
+    arena->blocks = NULL;
+    arena->pos = NULL;
+    arena->left = 0;
+}
+
+void name_arena_free(NameArena* arena) {
+    NameArenaBlock* block = arena->blocks;
+    while (block) {
+        NameArenaBlock* next = block->next;
+        mem_free(block);
+        block = next;
+    }
+    name_arena_init(arena);
+}
+
+void name_arena_take(NameArena* arena, NameArena* other) {
+    if (!other->blocks) return;
+    if (!arena->blocks) {
+        *arena = *other;
+    } else {
+        /* Behind the current block, which keeps taking strings */
+        NameArenaBlock* tail = other->blocks;
+        while (tail->next) tail = tail->next;
+        tail->next = arena->blocks->next;
+        arena->blocks->next = other->blocks;
+    }
+    name_arena_init(other);
+}
+
+/* Helper: `size` bytes of string space */
+static char* arena_reserve(NameArena* arena, size_t size) {
+    if (size <= arena->left) {
+        char* p = arena->pos;
+        arena->pos += size;
+        arena->left -= size;
+        return p;
+    }
+    
+    size_t space = size > NAME_ARENA_BLOCK_SIZE ? size : NAME_ARENA_BLOCK_SIZE;
+    NameArenaBlock* block = (NameArenaBlock*)mem_alloc(SEVENZIP_MEM_NAMES,
+                                                       sizeof(NameArenaBlock) + space);
+    if (!block) return NULL;
+    char* p = (char*)(block + 1);
+    if (space - size >= arena->left) {
+        /* The new block has more room left than the current one */
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->pos = p + size;
+        arena->left = space - size;
+    } else {
+        /* Keep filling the current block; an oversized string lives alone */
+        block->next = arena->blocks->next;
+        arena->blocks->next = block;
+    }
+    return p;
+}
+
+char* name_arena_strdup(NameArena* arena, const char* s) {
+    size_t size = strlen(s) + 1;
+    char* copy = arena_reserve(arena, size);
+    if (copy) memcpy(copy, s, size);
+    return copy;
+}
+
+int name_arena_add_entry(NameArena* arena, const char* path, const char* name,
+                         char** path_out, char** name_out) {
+    *path_out = NULL;
+    if (path) {
+        *path_out = name_arena_strdup(arena, path);
+        if (!*path_out) return 0;
+        
+        /* The name is the path's tail from a separator on */
+        size_t path_len = strlen(path);
+        size_t name_len = strlen(name);
+        if (name_len <= path_len && memcmp(path + path_len - name_len, name, name_len) == 0 &&
+            (name_len == path_len || path[path_len - name_len - 1] == '/' ||
+             path[path_len - name_len - 1] == '\\')) {
+            *name_out = *path_out + path_len - name_len;
+            return 1;
+        }
+    }
+    *name_out = name_arena_strdup(arena, name);
+    return *name_out != NULL;
+}
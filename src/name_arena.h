@@ -0,0 +1,54 @@
+/**
+ * Name Arena - Internal Header
+ *
+ * Storage for the name and filesystem path of every entry of a create
+ * job. Strings are packed into large blocks instead of two heap blocks
+ * per entry, and an archive name that is a tail of its entry's path (the
+ * usual case: "dir/sub/file" of "/data/dir/sub/file") points into the
+ * path instead of being stored again. Strings never move and are all
+ * released together by name_arena_free().
+ */
+
+#ifndef SEVENZIP_NAME_ARENA_H
+#define SEVENZIP_NAME_ARENA_H
+
+#include "../include/7z_ffi.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NameArenaBlock NameArenaBlock;
+
+typedef struct {
+    NameArenaBlock* blocks;  /* Most recent first */
+    char* pos;               /* Free space of blocks */
+    size_t left;
+} NameArena;
+
+void name_arena_init(NameArena* arena);
+void name_arena_free(NameArena* arena);
+
+/* Move the strings of `other` to `arena`; `other` is left empty */
+void name_arena_take(NameArena* arena, NameArena* other);
+
+/* Copy of `s` (NULL when out of memory) */
+char* name_arena_strdup(NameArena* arena, const char* s);
+
+/**
+ * Store an entry's path and archive name
+ * @param path Filesystem path, or NULL for entries without one
+ * @param name Archive name
+ * @param path_out Receives the copy of path (NULL if path was NULL)
+ * @param name_out Receives the copy of name, possibly within *path_out
+ * @return 0 when out of memory
+ */
+int name_arena_add_entry(NameArena* arena, const char* path, const char* name,
+                         char** path_out, char** name_out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_NAME_ARENA_H */
@@ -0,0 +1,455 @@
+/**
+ * Name Filter
+ *
+ * The NFA keeps its live states in a list, with a mark per state to keep
+ * duplicates out; only the marks of the list just built are cleared. The
+ * lists live in the caller's frame, so any number of threads may match
+ * against one filter. A state is a token position; star tokens also let the state after them
+ * live, so a state list is always closed over empty matches. Matching a
+ * directory prefix costs nothing extra: at every '/' the list is checked
+ * for an accept token before the '/' is consumed.
+ */
+
+#include "name_filter.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+typedef enum {
+    TOKEN_LITERAL = 0,
+    TOKEN_ANY = 1,          /* ? */
+    TOKEN_CLASS = 2,        /* [...] */
+    TOKEN_STAR = 3,         /* * */
+    TOKEN_DSTAR = 4,        /* ** inside a component */
+    TOKEN_DSTAR_SLASH = 5,  /* A whole ** component and its '/' */
+    TOKEN_ACCEPT = 6
+} NameFilterTokenType;
+
+/* FNV-1a */
+static uint32_t key_hash(const char* text, size_t length) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (uint8_t)text[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t table_size(size_t count) {
+    size_t size = 16;
+    while (size < count * 2) size *= 2;
+    return size;
+}
+
+static void key_insert(NameFilterKey* table, size_t mask, const char* text, size_t length) {
+    uint32_t h = key_hash(text, length);
+    size_t slot = h & mask;
+    while (table[slot].text) {
+        if (table[slot].hash == h && table[slot].length == length &&
+            memcmp(table[slot].text, text, length) == 0) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    table[slot].text = text;
+    table[slot].length = length;
+    table[slot].hash = h;
+}
+
+static int key_find(const NameFilterKey* table, size_t mask, const char* text, size_t length,
+                    uint32_t h) {
+    size_t slot = h & mask;
+    while (table[slot].text) {
+        if (table[slot].hash == h && table[slot].length == length &&
+            memcmp(table[slot].text, text, length) == 0) {
+            return 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return 0;
+}
+
+/* Extension of a pattern of the form "**", '/', "*.ext" (with any_depth
+ * also a bare "*.ext"), NULL for others */
+static const char* pattern_extension(const char* p, size_t length, int any_depth) {
+    const char* ext;
+    if (length > 5 && strncmp(p, "**/*.", 5) == 0) {
+        ext = p + 5;
+    } else if (any_depth && length > 2 && strncmp(p, "*.", 2) == 0) {
+        ext = p + 2;
+    } else {
+        return NULL;
+    }
+    for (const char* c = ext; c < p + length; c++) {
+        if (strchr("*?[\\/.", *c)) return NULL;
+    }
+    return ext;
+}
+
+/* Helper: Length of a pattern less a trailing '/', which names a directory */
+static size_t pattern_length(const char* p) {
+    size_t length = strlen(p);
+    if (length > 1 && p[length - 1] == '/') length--;
+    return length;
+}
+
+/* Helper: With any_depth, a pattern without a '/' matches a component */
+static int pattern_floats(const char* p, size_t length, int any_depth) {
+    return any_depth && !memchr(p, '/', length);
+}
+
+/* Helper: Append the tokens of one glob; 0 if it is malformed */
+static int compile_glob(NamePatternSet* set, const char* p, size_t length, int floats) {
+    const char* end = p + length;
+    set->starts[set->start_count++] = (uint32_t)set->token_count;
+    if (floats) {
+        set->tokens[set->token_count].type = TOKEN_DSTAR_SLASH;
+        set->token_count++;
+    }
+    int component_start = 1;
+    while (p < end) {
+        NameFilterToken t;
+        memset(&t, 0, sizeof(t));
+        char c = *p++;
+        int at_start = component_start;
+        component_start = c == '/';
+        if (c == '\\') {
+            if (p == end) return 0;
+            t.type = TOKEN_LITERAL;
+            t.ch = (uint8_t)*p++;
+            component_start = 0;
+        } else if (c == '*') {
+            if (p < end && *p == '*') {
+                while (p < end && *p == '*') p++;
+                if (at_start && p < end && *p == '/') {
+                    p++;
+                    t.type = TOKEN_DSTAR_SLASH;
+                    component_start = 1;
+                } else {
+                    t.type = TOKEN_DSTAR;
+                }
+            } else {
+                t.type = TOKEN_STAR;
+            }
+            if (t.type == TOKEN_STAR && set->token_count > set->starts[set->start_count - 1] &&
+                set->tokens[set->token_count - 1].type == TOKEN_STAR) {
+                continue;
+            }
+        } else if (c == '?') {
+            t.type = TOKEN_ANY;
+        } else if (c == '[') {
+            uint8_t* bits = set->classes[set->class_count];
+            memset(bits, 0, 32);
+            int negate = p < end && (*p == '!' || *p == '^');
+            if (negate) p++;
+            int first = 1;
+            while (p < end && (first || *p != ']')) {
+                first = 0;
+                int lo = (uint8_t)*p++;
+                if (lo == '\\' && p < end) lo = (uint8_t)*p++;
+                int hi = lo;
+                if (p + 1 < end && *p == '-' && p[1] != ']') {
+                    p++;
+                    hi = (uint8_t)*p++;
+                    if (hi == '\\' && p < end) hi = (uint8_t)*p++;
+                }
+                for (int v = lo; v <= hi; v++) bits[v >> 3] |= (uint8_t)(1u << (v & 7));
+            }
+            if (p == end) return 0;
+            p++;
+            if (negate) {
+                for (int i = 0; i < 32; i++) bits[i] = (uint8_t)~bits[i];
+            }
+            bits['/' >> 3] &= (uint8_t)~(1u << ('/' & 7));
+            t.type = TOKEN_CLASS;
+            t.cls = (uint32_t)set->class_count++;
+        } else {
+            t.type = TOKEN_LITERAL;
+            t.ch = (uint8_t)c;
+        }
+        set->tokens[set->token_count++] = t;
+    }
+    set->tokens[set->token_count].type = TOKEN_ACCEPT;
+    set->token_count++;
+    return 1;
+}
+
+static void pattern_set_free(NamePatternSet* set) {
+    mem_free(set->literals);
+    mem_free(set->extensions);
+    mem_free(set->tokens);
+    mem_free(set->starts);
+    mem_free(set->components);
+    mem_free(set->classes);
+    memset(set, 0, sizeof(*set));
+}
+
+static SevenZipErrorCode pattern_set_compile(NamePatternSet* set, const char* const* patterns,
+                                             int any_depth) {
+    memset(set, 0, sizeof(*set));
+    if (!patterns) return SEVENZIP_OK;
+
+    size_t literals = 0, components = 0, extensions = 0, globs = 0, glob_bytes = 0, classes = 0;
+    for (size_t i = 0; patterns[i]; i++) {
+        const char* p = patterns[i];
+        if (any_depth && p[0] == '/' && p[1]) p++;
+        if (!*p) return SEVENZIP_ERROR_INVALID_PARAM;
+        size_t length = pattern_length(p);
+        set->count++;
+        if (!strpbrk(p, "*?[\\")) {
+            if (pattern_floats(p, length, any_depth)) {
+                components++;
+            } else {
+                literals++;
+            }
+        } else if (pattern_extension(p, length, any_depth)) {
+            extensions++;
+        } else {
+            globs++;
+            glob_bytes += length + 2;
+            for (const char* c = p; *c; c++) classes += *c == '[';
+        }
+    }
+    if (glob_bytes > UINT32_MAX / 2) return SEVENZIP_ERROR_INVALID_PARAM;
+
+    int ok = 1;
+    if (literals) {
+        set->literal_mask = table_size(literals) - 1;
+        set->literals = (NameFilterKey*)mem_calloc(SEVENZIP_MEM_OTHER, set->literal_mask + 1,
+                                                   sizeof(NameFilterKey));
+        ok = ok && set->literals;
+    }
+    if (components) {
+        set->component_mask = table_size(components) - 1;
+        set->components = (NameFilterKey*)mem_calloc(SEVENZIP_MEM_OTHER, set->component_mask + 1,
+                                                     sizeof(NameFilterKey));
+        ok = ok && set->components;
+    }
+    if (extensions) {
+        set->extension_mask = table_size(extensions) - 1;
+        set->extensions = (NameFilterKey*)mem_calloc(SEVENZIP_MEM_OTHER, set->extension_mask + 1,
+                                                     sizeof(NameFilterKey));
+        ok = ok && set->extensions;
+    }
+    if (globs) {
+        set->tokens = (NameFilterToken*)mem_calloc(SEVENZIP_MEM_OTHER, glob_bytes, sizeof(NameFilterToken));
+        set->starts = (uint32_t*)mem_calloc(SEVENZIP_MEM_OTHER, globs, sizeof(uint32_t));
+        set->classes = (uint8_t(*)[32])mem_calloc(SEVENZIP_MEM_OTHER, classes ? classes : 1, 32);
+        ok = ok && set->tokens && set->starts && set->classes;
+    }
+    if (!ok) return SEVENZIP_ERROR_MEMORY;
+
+    for (size_t i = 0; patterns[i]; i++) {
+        const char* p = patterns[i];
+        if (any_depth && p[0] == '/' && p[1]) p++;  /* A leading '/' anchors at the top */
+        size_t length = pattern_length(p);
+        int floats = pattern_floats(p, length, any_depth);
+        const char* ext;
+        if (!strpbrk(p, "*?[\\")) {
+            if (floats) {
+                key_insert(set->components, set->component_mask, p, length);
+            } else {
+                key_insert(set->literals, set->literal_mask, p, length);
+            }
+        } else if ((ext = pattern_extension(p, length, any_depth)) != NULL) {
+            key_insert(set->extensions, set->extension_mask, ext, (size_t)(p + length - ext));
+        } else if (!compile_glob(set, p, length, floats)) {
+            return SEVENZIP_ERROR_INVALID_PARAM;
+        }
+    }
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode name_filter_compile(NameFilter* filter, const char* const* include,
+                                      const char* const* exclude, int flags) {
+    memset(filter, 0, sizeof(*filter));
+    int any_depth = (flags & NAME_FILTER_ANY_DEPTH) != 0;
+    SevenZipErrorCode err = pattern_set_compile(&filter->include, include, any_depth);
+    if (err == SEVENZIP_OK) err = pattern_set_compile(&filter->exclude, exclude, any_depth);
+    if (err != SEVENZIP_OK) name_filter_free(filter);
+    return err;
+}
+
+void name_filter_free(NameFilter* filter) {
+    pattern_set_free(&filter->include);
+    pattern_set_free(&filter->exclude);
+}
+
+/* Helper: The name, or a directory it is under, is a literal pattern */
+static int match_literals(const NamePatternSet* set, const char* name) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0;; i++) {
+        char c = name[i];
+        if ((c == '/' || c == '\0') && i > 0 &&
+            key_find(set->literals, set->literal_mask, name, i, h)) {
+            return 1;
+        }
+        if (!c) return 0;
+        h ^= (uint8_t)c;
+        h *= 16777619u;
+    }
+}
+
+/* Helper: Some component of the name is a component pattern */
+static int match_components(const NamePatternSet* set, const char* name) {
+    uint32_t h = 2166136261u;
+    const char* component = name;
+    for (const char* p = name;; p++) {
+        char c = *p;
+        if (c == '/' || c == '\0') {
+            if (p > component &&
+                key_find(set->components, set->component_mask, component, (size_t)(p - component), h)) {
+                return 1;
+            }
+            if (!c) return 0;
+            h = 2166136261u;
+            component = p + 1;
+            continue;
+        }
+        h ^= (uint8_t)c;
+        h *= 16777619u;
+    }
+}
+
+/* Helper: Some component ends in an extension of the set */
+static int match_extensions(const NamePatternSet* set, const char* name) {
+    const char* dot = NULL;
+    for (const char* p = name;; p++) {
+        if (*p == '/' || *p == '\0') {
+            if (dot) {
+                size_t length = (size_t)(p - dot - 1);
+                if (key_find(set->extensions, set->extension_mask, dot + 1, length,
+                             key_hash(dot + 1, length))) {
+                    return 1;
+                }
+            }
+            if (!*p) return 0;
+            dot = NULL;
+        } else if (*p == '.') {
+            dot = p;
+        }
+    }
+}
+
+/* NFA state lists of one match, on the stack for small sets */
+typedef struct {
+    uint32_t* current;
+    uint32_t* next;
+    uint8_t* marks;    /* Nonzero for states already in the list being built */
+} NfaLists;
+
+/* Helper: Make `state` live; entered, not stayed in, it also makes the
+ * states after the stars it starts on live. A whole ** component stayed
+ * in has consumed part of a component, so it may not match nothing then */
+static void nfa_add(const NamePatternSet* set, NfaLists* l, uint32_t* list, size_t* count,
+                    uint32_t state, int enter) {
+    for (;;) {
+        uint8_t type = set->tokens[state].type;
+        if (!l->marks[state]) {
+            l->marks[state] = 1;
+            list[(*count)++] = state;
+        } else if (!enter || type != TOKEN_DSTAR_SLASH) {
+            return;
+        }
+        if (!enter || (type != TOKEN_STAR && type != TOKEN_DSTAR && type != TOKEN_DSTAR_SLASH)) return;
+        state++;
+    }
+}
+
+/* Helper: Some glob matches the name, or a directory it is under */
+static int nfa_run(const NamePatternSet* set, NfaLists* l, const char* name) {
+    size_t count = 0;
+    for (size_t i = 0; i < set->start_count; i++) nfa_add(set, l, l->current, &count, set->starts[i], 1);
+    for (size_t i = 0; i < count; i++) l->marks[l->current[i]] = 0;
+
+    for (const unsigned char* p = (const unsigned char*)name;; p++) {
+        unsigned char c = *p;
+        if (c == '/' || c == '\0') {
+            for (size_t i = 0; i < count; i++) {
+                if (set->tokens[l->current[i]].type == TOKEN_ACCEPT) return 1;
+            }
+        }
+        if (c == '\0' || count == 0) return 0;
+
+        size_t next_count = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t s = l->current[i];
+            const NameFilterToken* t = &set->tokens[s];
+            switch (t->type) {
+                case TOKEN_LITERAL:
+                    if (c == t->ch) nfa_add(set, l, l->next, &next_count, s + 1, 1);
+                    break;
+                case TOKEN_ANY:
+                    if (c != '/') nfa_add(set, l, l->next, &next_count, s + 1, 1);
+                    break;
+                case TOKEN_CLASS:
+                    if (set->classes[t->cls][c >> 3] & (1u << (c & 7))) {
+                        nfa_add(set, l, l->next, &next_count, s + 1, 1);
+                    }
+                    break;
+                case TOKEN_STAR:
+                    if (c != '/') nfa_add(set, l, l->next, &next_count, s, 1);
+                    break;
+                case TOKEN_DSTAR:
+                    nfa_add(set, l, l->next, &next_count, s, 1);
+                    break;
+                case TOKEN_DSTAR_SLASH:
+                    nfa_add(set, l, l->next, &next_count, s, 0);
+                    if (c == '/') nfa_add(set, l, l->next, &next_count, s + 1, 1);
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (size_t i = 0; i < next_count; i++) l->marks[l->next[i]] = 0;
+        uint32_t* swap = l->current;
+        l->current = l->next;
+        l->next = swap;
+        count = next_count;
+    }
+}
+
+static int match_globs(const NamePatternSet* set, const char* name) {
+    uint32_t current[NAME_FILTER_STACK_STATES], next[NAME_FILTER_STACK_STATES];
+    uint8_t marks[NAME_FILTER_STACK_STATES];
+    NfaLists l;
+    if (set->token_count <= NAME_FILTER_STACK_STATES) {
+        l.current = current;
+        l.next = next;
+        l.marks = marks;
+        memset(marks, 0, set->token_count);
+        return nfa_run(set, &l, name);
+    }
+    l.current = (uint32_t*)mem_alloc(SEVENZIP_MEM_OTHER, set->token_count * 2 * sizeof(uint32_t));
+    l.marks = (uint8_t*)mem_calloc(SEVENZIP_MEM_OTHER, set->token_count, 1);
+    int matched = 0;
+    if (l.current && l.marks) {
+        l.next = l.current + set->token_count;
+        uint32_t* lists = l.current;
+        matched = nfa_run(set, &l, name);
+        l.current = lists;
+    }
+    mem_free(l.current);
+    mem_free(l.marks);
+    return matched;
+}
+
+static int pattern_set_match(const NamePatternSet* set, const char* name) {
+    return (set->literals && match_literals(set, name)) ||
+           (set->components && match_components(set, name)) ||
+           (set->extensions && match_extensions(set, name)) ||
+           (set->start_count && match_globs(set, name));
+}
+
+int name_filter_match(const NameFilter* filter, const char* name) {
+    if (filter->include.count && !pattern_set_match(&filter->include, name)) return 0;
+    return !(filter->exclude.count && pattern_set_match(&filter->exclude, name));
+}
+
+int name_filter_excludes(const NameFilter* filter, const char* name) {
+    return filter->exclude.count && pattern_set_match(&filter->exclude, name);
+}
+
+int name_filter_includes(const NameFilter* filter, const char* name) {
+    return !filter->include.count || pattern_set_match(&filter->include, name);
+}
@@ -0,0 +1,102 @@
+/**
+ * Name Filter - Internal Header
+ *
+ * Include and exclude patterns of SevenZipExtractOptions, compiled once
+ * per extraction and tested against each entry name in the pass that
+ * selects entries, and those of SevenZipStreamOptions, tested by the
+ * directory scan before it stats or descends. An entry is wanted when it matches some include
+ * pattern (or there are none) and no exclude pattern. A pattern matching
+ * a directory also matches everything under it, so "build" excludes
+ * "build/obj/a.o".
+ *
+ * Patterns are globs over '/'-separated names:
+ *
+ *   *        any run of characters within one component
+ *   **       any run of characters, across components; as a whole
+ *            component, any number of components, none included
+ *   ?        one character other than '/'
+ *   [a-z]    one character of the class, [!a-z] or [^a-z] one outside it
+ *   \c       the character c
+ *
+ * With NAME_FILTER_ANY_DEPTH, as for the scan, a pattern without a '/'
+ * other than a trailing one matches any component, as in .gitignore:
+ * "node_modules" and "*.tmp" match at every depth. A leading '/' anchors
+ * a pattern at the top instead.
+ *
+ * Each set is compiled into parts, tried cheapest first: literal names
+ * and literal components in hash sets, extension patterns (a "**" component, then
+ * "*.ext") as a hash set of extensions, and the rest as one NFA whose
+ * states are the positions of all the globs' tokens, run once over the
+ * name for every glob at once.
+ */
+
+#ifndef SEVENZIP_NAME_FILTER_H
+#define SEVENZIP_NAME_FILTER_H
+
+#include "../include/7z_ffi.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A literal name or extension: the caller's bytes, not NUL-terminated */
+typedef struct {
+    const char* text;
+    size_t length;
+    uint32_t hash;
+} NameFilterKey;
+
+typedef struct {
+    uint8_t type;      /* NameFilterTokenType of name_filter.c */
+    uint8_t ch;        /* Literal byte */
+    uint32_t cls;      /* Class index */
+} NameFilterToken;
+
+typedef struct {
+    size_t count;                /* Patterns in the set */
+    NameFilterKey* literals;     /* Open-addressing, text NULL = free */
+    size_t literal_mask;
+    NameFilterKey* components;   /* Literals matching any component */
+    size_t component_mask;
+    NameFilterKey* extensions;
+    size_t extension_mask;
+    NameFilterToken* tokens;     /* Every glob, each ending with an accept token */
+    size_t token_count;
+    uint32_t* starts;            /* First token of each glob */
+    size_t start_count;
+    uint8_t (*classes)[32];      /* Bitmaps of [...] classes */
+    size_t class_count;
+} NamePatternSet;
+
+#define NAME_FILTER_ANY_DEPTH 1      /* Patterns without a '/' match any component */
+#define NAME_FILTER_STACK_STATES 256 /* Larger sets match with heap state lists */
+
+typedef struct {
+    NamePatternSet include;
+    NamePatternSet exclude;
+} NameFilter;
+
+/**
+ * Compile NULL-terminated pattern lists, either of which may be NULL;
+ * the filter points into the caller's strings, which must outlive it
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_INVALID_PARAM for an empty pattern,
+ *         an unclosed class or a trailing '\', or SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode name_filter_compile(NameFilter* filter, const char* const* include,
+                                      const char* const* exclude, int flags);
+void name_filter_free(NameFilter* filter);
+
+/* 1 if `name` is wanted; safe from any number of threads at once */
+int name_filter_match(const NameFilter* filter, const char* name);
+
+/* The two halves of name_filter_match(), for a scan that prunes on one */
+int name_filter_excludes(const NameFilter* filter, const char* name);
+int name_filter_includes(const NameFilter* filter, const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_NAME_FILTER_H */
@@ -0,0 +1,299 @@
+/**
+ * Operation Statistics
+ *
+ * Per-phase wall and CPU time, byte counts and encoder sizing of the
+ * streaming writers. Like the error context, the last stats are kept
+ * per thread.
+ */
+
+#include "op_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+    #include <sys/time.h>
+    #include <sys/resource.h>
+#endif
+
+/* Thread-local last stats, with the folder records */
+typedef struct {
+    SevenZipOpStats stats;
+    SevenZipFolderStats* folders;
+} LastStats;
+
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+static void free_last_stats(void* p) {
+    LastStats* last = (LastStats*)p;
+    free(last->folders);
+    free(last);
+}
+
+static void make_stats_key(void) {
+    pthread_key_create(&stats_key, free_last_stats);
+}
+
+static LastStats* get_last_stats(void) {
+    pthread_once(&stats_key_once, make_stats_key);
+
+    LastStats* last = (LastStats*)pthread_getspecific(stats_key);
+    if (!last) {
+        last = (LastStats*)calloc(1, sizeof(LastStats));
+        if (last) pthread_setspecific(stats_key, last);
+    }
+    return last;
+}
+
+#ifdef _WIN32
+static double filetime_seconds(const FILETIME* a, const FILETIME* b) {
+    ULARGE_INTEGER x, y;
+    x.LowPart = a->dwLowDateTime;
+    x.HighPart = a->dwHighDateTime;
+    y.LowPart = b->dwLowDateTime;
+    y.HighPart = b->dwHighDateTime;
+    return (double)(x.QuadPart + y.QuadPart) / 1e7;
+}
+#endif
+
+static double wall_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/* CPU time of every thread of the process */
+static double process_cpu_seconds(void) {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+    return filetime_seconds(&kernel, &user);
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0.0;
+    return (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1e6 +
+           (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+static double thread_cpu_seconds(void) {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0.0;
+    return filetime_seconds(&kernel, &user);
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0.0;
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+void op_stats_begin(OpStats* s) {
+    memset(s, 0, sizeof(*s));
+    CriticalSection_Init(&s->lock);
+    s->phase = -1;
+    s->start_wall = wall_seconds();
+    s->start_cpu = process_cpu_seconds();
+}
+
+void op_stats_phase_begin(OpStats* s, SevenZipPhase phase) {
+    op_stats_phase_end(s);
+    s->phase = (int)phase;
+    s->phase_wall = wall_seconds();
+    s->phase_cpu = process_cpu_seconds();
+}
+
+void op_stats_phase_end(OpStats* s) {
+    if (s->phase < 0) return;
+    SevenZipPhaseStats* p = &s->stats.phases[s->phase];
+    p->wall_seconds += wall_seconds() - s->phase_wall;
+    p->cpu_seconds += process_cpu_seconds() - s->phase_cpu;
+    s->phase = -1;
+}
+
+void op_stats_io_begin(const OpStats* s, OpStatsTimer* t) {
+    if (!s) return;
+    t->wall = wall_seconds();
+    t->cpu = thread_cpu_seconds();
+}
+
+void op_stats_io_end(OpStats* s, const OpStatsTimer* t, SevenZipPhase phase, uint64_t bytes) {
+    if (!s) return;
+    double wall = wall_seconds() - t->wall;
+    double cpu = thread_cpu_seconds() - t->cpu;
+
+    CriticalSection_Enter(&s->lock);
+    s->stats.phases[phase].wall_seconds += wall;
+    s->stats.phases[phase].cpu_seconds += cpu;
+    if (phase == SEVENZIP_PHASE_READ) {
+        s->stats.bytes_read += bytes;
+    } else {
+        s->stats.bytes_written += bytes;
+    }
+    CriticalSection_Leave(&s->lock);
+}
+
+void op_stats_add_bytes(OpStats* s, uint64_t read, uint64_t written) {
+    if (!s) return;
+    CriticalSection_Enter(&s->lock);
+    s->stats.bytes_read += read;
+    s->stats.bytes_written += written;
+    CriticalSection_Leave(&s->lock);
+}
+
+void op_stats_add_lzma2(OpStats* s, const CLzma2EncProps* props, uint64_t data_size,
+                        int instances) {
+    if (!s) return;
+    /* Normalizing against the input size drops block threads with no block to code */
+    CLzma2EncProps p = *props;
+    p.lzmaProps.reduceSize = data_size;
+    Lzma2EncProps_Normalize(&p);
+    int threads = p.numTotalThreads * instances;
+    if (threads > s->stats.encoder_threads) s->stats.encoder_threads = threads;
+    if (p.blockSize != LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID) op_stats_add_block_size(s, p.blockSize);
+}
+
+void op_stats_add_block_size(OpStats* s, uint64_t block_size) {
+    if (s && block_size > s->stats.lzma2_block_size) s->stats.lzma2_block_size = block_size;
+}
+
+void op_stats_encode_begin(const OpStats* s, OpStatsEncodeTimer* t, CLzma2EncHandle enc) {
+    if (!s) return;
+    memset(&t->counts, 0, sizeof(t->counts));
+    Lzma2Enc_AddStats(enc, &t->counts);
+    t->wall = wall_seconds();
+}
+
+void op_stats_encode_end(const OpStats* s, const OpStatsEncodeTimer* t, CLzma2EncHandle enc,
+                         int threads, OpStatsEncode* sums) {
+    if (!s) return;
+    CLzmaEncStats now;
+    memset(&now, 0, sizeof(now));
+    Lzma2Enc_AddStats(enc, &now);
+    sums->counts.literals += now.literals - t->counts.literals;
+    sums->counts.matches += now.matches - t->counts.matches;
+    sums->counts.reps += now.reps - t->counts.reps;
+    sums->counts.matchBytes += now.matchBytes - t->counts.matchBytes;
+    sums->seconds += wall_seconds() - t->wall;
+    if (threads > sums->threads) sums->threads = threads;
+}
+
+int op_stats_block_threads(const CLzma2EncProps* props, uint64_t data_size) {
+    CLzma2EncProps p = *props;
+    p.lzmaProps.reduceSize = data_size;
+    Lzma2EncProps_Normalize(&p);
+    return p.numBlockThreads_Reduced > 0 ? p.numBlockThreads_Reduced : 1;
+}
+
+void op_stats_encode_merge(OpStatsEncode* sums, const OpStatsEncode* more) {
+    sums->counts.literals += more->counts.literals;
+    sums->counts.matches += more->counts.matches;
+    sums->counts.reps += more->counts.reps;
+    sums->counts.matchBytes += more->counts.matchBytes;
+    sums->seconds += more->seconds;
+    if (more->threads > sums->threads) sums->threads = more->threads;
+}
+
+void op_stats_add_folder(OpStats* s, uint64_t folder, uint64_t unpack_size, uint64_t pack_size,
+                         const OpStatsEncode* sums) {
+    if (!s || sums->threads == 0) return;
+    s->stats.lzma_literals += sums->counts.literals;
+    s->stats.lzma_matches += sums->counts.matches;
+    s->stats.lzma_rep_matches += sums->counts.reps;
+    s->stats.encode_seconds += sums->seconds;
+    s->match_bytes += sums->counts.matchBytes;
+    if (!s->keep_folders) return;
+
+    if (s->stats.folder_stats_count == s->folder_capacity) {
+        size_t grown = s->folder_capacity ? s->folder_capacity * 2 : 64;
+        SevenZipFolderStats* folders = (SevenZipFolderStats*)realloc(s->folders,
+                                                                     grown * sizeof(*folders));
+        if (!folders) return;  /* The totals still count it */
+        s->folders = folders;
+        s->folder_capacity = grown;
+    }
+    SevenZipFolderStats* f = &s->folders[s->stats.folder_stats_count++];
+    uint64_t symbol_matches = sums->counts.matches + sums->counts.reps;
+    f->folder = folder;
+    f->unpack_size = unpack_size;
+    f->pack_size = pack_size;
+    f->literals = sums->counts.literals;
+    f->matches = sums->counts.matches;
+    f->rep_matches = sums->counts.reps;
+    f->average_match_length = symbol_matches ? (double)sums->counts.matchBytes / (double)symbol_matches : 0.0;
+    f->encode_seconds = sums->seconds;
+    f->block_threads = sums->threads;
+    f->bytes_per_second = sums->seconds > 0 ?
+        (double)unpack_size / sums->seconds / (double)sums->threads : 0.0;
+}
+
+void op_stats_finish(OpStats* s) {
+    op_stats_phase_end(s);
+    s->stats.wall_seconds = wall_seconds() - s->start_wall;
+    s->stats.cpu_seconds = process_cpu_seconds() - s->start_cpu;
+    if (s->stats.wall_seconds > 0) {
+        s->stats.files_per_second = (double)s->stats.files / s->stats.wall_seconds;
+    }
+    uint64_t symbol_matches = s->stats.lzma_matches + s->stats.lzma_rep_matches;
+    if (symbol_matches > 0) {
+        s->stats.average_match_length = (double)s->match_bytes / (double)symbol_matches;
+    }
+    CriticalSection_Delete(&s->lock);
+
+    LastStats* last = get_last_stats();
+    if (last) {
+        free(last->folders);
+        last->stats = s->stats;
+        last->folders = s->folders;
+    } else {
+        free(s->folders);
+    }
+    s->folders = NULL;
+    s->folder_capacity = 0;
+}
+
+void op_stats_clear_last(void) {
+    LastStats* last = get_last_stats();
+    if (last) {
+        free(last->folders);
+        memset(last, 0, sizeof(*last));
+    }
+}
+
+SevenZipErrorCode sevenzip_get_last_stats(SevenZipOpStats* stats) {
+    if (!stats) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    LastStats* last = get_last_stats();
+    if (last) {
+        *stats = last->stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_get_last_folder_stats(SevenZipFolderStats* stats, size_t capacity,
+                                                 size_t* count) {
+    if (!count || (!stats && capacity > 0)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    LastStats* last = get_last_stats();
+    size_t have = last ? (size_t)last->stats.folder_stats_count : 0;
+    size_t n = have < capacity ? have : capacity;
+    if (n > 0) memcpy(stats, last->folders, n * sizeof(*stats));
+    *count = have;
+    return SEVENZIP_OK;
+}
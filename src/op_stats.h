@@ -0,0 +1,113 @@
+/**
+ * Operation Statistics - Internal Header
+ *
+ * Recorder behind sevenzip_get_last_stats(). The calling thread marks
+ * the sequential phases (scan, compress, header) with begin/end pairs;
+ * reads and writes are timed where they happen, on any thread, and
+ * summed under a lock. op_stats_finish() publishes the result as the
+ * last stats of the calling thread.
+ *
+ * LZMA2 encoders count the symbols they code for their whole life, so an
+ * encode is measured as the difference of the counts around it; the
+ * writer keeps each folder's sums until the folder is complete and adds
+ * them with op_stats_add_folder().
+ */
+
+#ifndef SEVENZIP_OP_STATS_H
+#define SEVENZIP_OP_STATS_H
+
+#include "../include/7z_ffi.h"
+#include "Lzma2Enc.h"
+#include "Threads.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    SevenZipOpStats stats;
+    double start_wall;
+    double start_cpu;
+    int phase;                 /* Running sequential phase, -1 = none */
+    double phase_wall;
+    double phase_cpu;
+    CCriticalSection lock;     /* Guards the I/O sums */
+    uint64_t match_bytes;      /* Bytes covered by the matches counted */
+    int keep_folders;          /* Records of the folders are kept (folder_stats) */
+    SevenZipFolderStats* folders;
+    size_t folder_capacity;
+} OpStats;
+
+/* Encoder work on one folder: the sums of its encodes */
+typedef struct {
+    CLzmaEncStats counts;
+    double seconds;            /* Wall time inside the encoder */
+    int threads;               /* Block threads of the encoder, the most of any encode */
+} OpStatsEncode;
+
+/* Start of one encode, see op_stats_encode_end() */
+typedef struct {
+    CLzmaEncStats counts;      /* The encoder's counts before it */
+    double wall;
+} OpStatsEncodeTimer;
+
+/* Start of one I/O call, see op_stats_io_end() */
+typedef struct {
+    double wall;
+    double cpu;                /* CPU time of the calling thread */
+} OpStatsTimer;
+
+/* Clear the recorder and start the operation's clock */
+void op_stats_begin(OpStats* s);
+
+/* Sequential phases of the calling thread; beginning one ends the last */
+void op_stats_phase_begin(OpStats* s, SevenZipPhase phase);
+void op_stats_phase_end(OpStats* s);
+
+/* Time one read or write; both are no-ops when `s` is NULL */
+void op_stats_io_begin(const OpStats* s, OpStatsTimer* t);
+void op_stats_io_end(OpStats* s, const OpStatsTimer* t, SevenZipPhase phase, uint64_t bytes);
+
+/* Count bytes moved without a timed call of their own (mapped data, kernel copies) */
+void op_stats_add_bytes(OpStats* s, uint64_t read, uint64_t written);
+
+/**
+ * Record an LZMA2 encoder of `data_size` input (UINT64_MAX = unknown)
+ * encoder_threads becomes the threads it can run, `instances` times over,
+ * if that is more than any earlier encoder of the operation; its block
+ * size is recorded as with op_stats_add_block_size().
+ */
+void op_stats_add_lzma2(OpStats* s, const CLzma2EncProps* props, uint64_t data_size,
+                        int instances);
+
+/* Record an LZMA2 block size in use; lzma2_block_size keeps the largest */
+void op_stats_add_block_size(OpStats* s, uint64_t block_size);
+
+/* Time one encode on `enc`; both are no-ops when `s` is NULL */
+void op_stats_encode_begin(const OpStats* s, OpStatsEncodeTimer* t, CLzma2EncHandle enc);
+void op_stats_encode_end(const OpStats* s, const OpStatsEncodeTimer* t, CLzma2EncHandle enc,
+                         int threads, OpStatsEncode* sums);
+
+/* Block threads an LZMA2 encoder with `props` runs on `data_size` bytes */
+int op_stats_block_threads(const CLzma2EncProps* props, uint64_t data_size);
+
+/* Add the sums of encodes done apart (a worker's block) to a folder's */
+void op_stats_encode_merge(OpStatsEncode* sums, const OpStatsEncode* more);
+
+/* Add a complete LZMA2 folder to the totals, and to the records with
+ * keep_folders; folders with no encode recorded are skipped */
+void op_stats_add_folder(OpStats* s, uint64_t folder, uint64_t unpack_size, uint64_t pack_size,
+                         const OpStatsEncode* sums);
+
+/* End the running phase, fill the totals and publish the stats */
+void op_stats_finish(OpStats* s);
+
+/* Reset the calling thread's last stats to zero */
+void op_stats_clear_last(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_OP_STATS_H */
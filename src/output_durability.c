@@ -0,0 +1,244 @@
+/**
+ * Output Durability
+ *
+ * A file is only renamed once its data is on disk, so after a crash no
+ * name points at data that was not: the rename either happened over
+ * complete data or not at all. Renames wait for a whole batch, as the
+ * syncfs before them covers every file of the batch at once.
+ */
+
+/* syncfs() and sync_file_range() are only declared by glibc with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "output_durability.h"
+#include "mem_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__)
+    #define HAVE_SYNCFS 1
+#else
+    #define HAVE_SYNCFS 0
+#endif
+
+/* Helper: Flush and sync one file; 0 on success */
+static int sync_file(FILE* f) {
+    if (fflush(f) != 0) return -1;
+#ifdef _WIN32
+    return FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(f))) ? 0 : -1;
+#else
+    int fd = fileno(f);
+#if defined(__APPLE__) && defined(F_FULLFSYNC)
+    /* fsync() stops at the drive's cache on macOS */
+    if (fcntl(fd, F_FULLFSYNC) == 0) return 0;
+#endif
+    return fsync(fd);
+#endif
+}
+
+/* Helper: Flush and start writing the file back without waiting for it */
+static int start_writeback(FILE* f) {
+    if (fflush(f) != 0) return -1;
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+    sync_file_range(fileno(f), 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+    return 0;
+}
+
+/* Helper: Temporary name of `path` (mem_free() it) */
+static char* temp_path(const char* path) {
+    size_t len = strlen(path);
+    char* tmp = (char*)mem_alloc(SEVENZIP_MEM_NAMES, len + sizeof(ATOMIC_SUFFIX));
+    if (!tmp) return NULL;
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ATOMIC_SUFFIX, sizeof(ATOMIC_SUFFIX));
+    return tmp;
+}
+
+/* Helper: Remove the temporary name of `path` */
+static void remove_temp(const char* path) {
+    char* tmp = temp_path(path);
+    if (tmp) remove(tmp);
+    mem_free(tmp);
+}
+
+/* Helper: Sync the data of the pending files and rename them into place
+ * (caller holds the lock); after a failure they are removed instead */
+static void commit_pending(OutputDurability* d) {
+    if (d->pending_count == 0) return;
+#if HAVE_SYNCFS
+    if (d->root_fd >= 0 && syncfs(d->root_fd) != 0) d->failed = 1;
+#endif
+    for (size_t i = 0; i < d->pending_count; i++) {
+        char* tmp = temp_path(d->pending[i]);
+        int moved = 0;
+        if (tmp && !d->failed) {
+#ifdef _WIN32
+            moved = MoveFileExA(tmp, d->pending[i], MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+            moved = rename(tmp, d->pending[i]) == 0;
+#endif
+            if (!moved) d->failed = 1;
+        }
+        if (!moved) {
+            if (tmp) remove(tmp);
+            else d->failed = 1;
+        }
+        mem_free(tmp);
+        mem_free(d->pending[i]);
+    }
+    d->pending_count = 0;
+}
+
+SevenZipErrorCode output_durability_begin(OutputDurability* d, SevenZipDurability mode,
+                                          const char* root, DirCache* dirs) {
+    memset(d, 0, sizeof(*d));
+    d->mode = mode;
+    d->root_fd = -1;
+    d->dirs = dirs;
+    if (mode == SEVENZIP_DURABILITY_NONE) return SEVENZIP_OK;
+    d->has_lock = CriticalSection_Init(&d->lock) == 0;
+    if (!d->has_lock) return SEVENZIP_ERROR_MEMORY;
+#if HAVE_SYNCFS
+    if (mode != SEVENZIP_DURABILITY_FILE) d->root_fd = open(root, O_RDONLY | O_CLOEXEC);
+#else
+    (void)root;
+#endif
+    return SEVENZIP_OK;
+}
+
+/* Helper: Create `path` through the run's directories when there are some */
+static FILE* open_in_dirs(OutputDurability* d, char* path) {
+    if (!d || !d->dirs) return fopen(path, "wb");
+    return dir_cache_fopen(d->dirs, path);
+}
+
+FILE* output_durability_open(OutputDurability* d, char* path) {
+    if (!d || d->mode != SEVENZIP_DURABILITY_ATOMIC) return open_in_dirs(d, path);
+
+    char* tmp = temp_path(path);
+    char* owned = mem_strdup(SEVENZIP_MEM_NAMES, path);
+    FILE* f = tmp && owned ? open_in_dirs(d, tmp) : NULL;
+    if (f) {
+        CriticalSection_Enter(&d->lock);
+        if (d->open_count == d->open_capacity) {
+            size_t capacity = d->open_capacity ? d->open_capacity * 2 : 16;
+            DurableFile* grown = (DurableFile*)mem_realloc(SEVENZIP_MEM_OTHER, d->open,
+                                                           capacity * sizeof(DurableFile));
+            if (grown) {
+                d->open = grown;
+                d->open_capacity = capacity;
+            }
+        }
+        if (d->open_count < d->open_capacity) {
+            d->open[d->open_count].file = f;
+            d->open[d->open_count].path = owned;
+            d->open_count++;
+            owned = NULL;
+        }
+        CriticalSection_Leave(&d->lock);
+        if (owned) {
+            fclose(f);
+            remove(tmp);
+            f = NULL;
+        }
+    }
+    mem_free(owned);
+    mem_free(tmp);
+    return f;
+}
+
+int output_durability_close(OutputDurability* d, FILE* file) {
+    if (!d || d->mode == SEVENZIP_DURABILITY_NONE) return fclose(file) != 0;
+
+    int failed = (d->mode == SEVENZIP_DURABILITY_FILE || d->root_fd < 0)
+        ? sync_file(file) != 0 : start_writeback(file) != 0;
+    if (d->mode != SEVENZIP_DURABILITY_ATOMIC) {
+        if (fclose(file) != 0) failed = 1;
+        return failed;
+    }
+
+    char* path = NULL;
+    CriticalSection_Enter(&d->lock);
+    for (size_t i = 0; i < d->open_count; i++) {
+        if (d->open[i].file != file) continue;
+        path = d->open[i].path;
+        d->open[i] = d->open[--d->open_count];
+        break;
+    }
+    CriticalSection_Leave(&d->lock);
+    if (fclose(file) != 0 || !path) failed = 1;
+    if (failed) {
+        if (path) remove_temp(path);
+        mem_free(path);
+        return 1;
+    }
+
+    CriticalSection_Enter(&d->lock);
+    if (d->pending_count == d->pending_capacity) {
+        size_t capacity = d->pending_capacity ? d->pending_capacity * 2 : 64;
+        char** grown = (char**)mem_realloc(SEVENZIP_MEM_OTHER, d->pending, capacity * sizeof(char*));
+        if (grown) {
+            d->pending = grown;
+            d->pending_capacity = capacity;
+        }
+    }
+    if (d->pending_count < d->pending_capacity) {
+        d->pending[d->pending_count++] = path;
+        path = NULL;
+        if (d->pending_count >= ATOMIC_BATCH_FILES) commit_pending(d);
+    }
+    failed = d->failed;
+    CriticalSection_Leave(&d->lock);
+    if (path) {
+        remove_temp(path);
+        mem_free(path);
+        return 1;
+    }
+    return failed;
+}
+
+SevenZipErrorCode output_durability_end(OutputDurability* d, int ok) {
+    if (d->mode == SEVENZIP_DURABILITY_NONE) return SEVENZIP_OK;
+
+    /* Files never closed were abandoned part way */
+    for (size_t i = 0; i < d->open_count; i++) {
+        remove_temp(d->open[i].path);
+        mem_free(d->open[i].path);
+    }
+    commit_pending(d);
+
+    /* The names, and with syncfs the data of files not synced one by one */
+    if (ok && !d->failed) {
+#if HAVE_SYNCFS
+        if (d->root_fd >= 0) {
+            if (syncfs(d->root_fd) != 0) d->failed = 1;
+        } else
+#endif
+        if (d->dirs && dir_cache_sync(d->dirs) != 0) {
+            d->failed = 1;
+        }
+    }
+
+#ifndef _WIN32
+    if (d->root_fd >= 0) close(d->root_fd);
+#endif
+    mem_free(d->open);
+    mem_free(d->pending);
+    CriticalSection_Delete(&d->lock);
+    int failed = d->failed;
+    memset(d, 0, sizeof(*d));
+    d->root_fd = -1;
+    return failed ? SEVENZIP_ERROR_EXTRACT : SEVENZIP_OK;
+}
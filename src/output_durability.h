@@ -0,0 +1,93 @@
+/**
+ * Output Durability - Internal Header
+ *
+ * Makes the files of an extraction durable as SevenZipExtractOptions.durability
+ * asks, at the cost the mode names rather than an fsync per file:
+ *
+ *   FILE     fsync (F_FULLFSYNC on macOS) before each close, directories
+ *            of the run synced once at the end
+ *   BATCHED  writeback started at each close, one syncfs at the end
+ *   ATOMIC   written under <name>.7zpart; every ATOMIC_BATCH_FILES closed
+ *            files, one syncfs and then their renames; names synced at
+ *            the end
+ *
+ * Where there is no syncfs (other than Linux), the batched modes sync
+ * each file as it is closed instead. One state serves all the sinks and
+ * writer threads of a run.
+ */
+
+#ifndef SEVENZIP_OUTPUT_DURABILITY_H
+#define SEVENZIP_OUTPUT_DURABILITY_H
+
+#include "../include/7z_ffi.h"
+#include "dir_cache.h"
+#include "Threads.h"
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Closed files renamed into place at once in ATOMIC mode */
+#define ATOMIC_BATCH_FILES 1024
+
+/* Suffix of a file written in ATOMIC mode until it is renamed */
+#define ATOMIC_SUFFIX ".7zpart"
+
+/* File of the run open under its temporary name */
+typedef struct {
+    FILE* file;
+    char* path;      /* Final name */
+} DurableFile;
+
+typedef struct {
+    SevenZipDurability mode;
+    int root_fd;               /* Output directory, for syncfs (-1 = none: files synced one by one) */
+    DirCache* dirs;            /* Directories of the run, synced at the end */
+    CCriticalSection lock;     /* Guards the lists and `failed` */
+    int has_lock;
+    DurableFile* open;         /* ATOMIC: files being written */
+    size_t open_count;
+    size_t open_capacity;
+    char** pending;            /* ATOMIC: final names of closed files awaiting rename */
+    size_t pending_count;
+    size_t pending_capacity;
+    int failed;                /* A sync or rename failed */
+} OutputDurability;
+
+/**
+ * Set up the state of a run writing under `root`, which exists
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode output_durability_begin(OutputDurability* d, SevenZipDurability mode,
+                                          const char* root, DirCache* dirs);
+
+/* Create `path` for writing, under its temporary name in ATOMIC mode,
+ * making its parent directories through the run's DirCache and opening
+ * it relative to theirs (d NULL = fopen). `path` is modified during the
+ * call and restored before it returns. */
+FILE* output_durability_open(OutputDurability* d, char* path);
+
+/**
+ * Close a file opened by output_durability_open() once it is complete,
+ * its metadata restored (entry_meta_apply()), making it durable as the
+ * mode asks; in ATOMIC mode a full batch is synced and renamed here
+ * @return 0 on success, non-zero if the sync or close failed
+ */
+int output_durability_close(OutputDurability* d, FILE* file);
+
+/**
+ * End the run: files still under temporary names are synced and renamed
+ * (those never closed are removed), and the mode's final sync is made
+ * Call once every file of the run is closed or abandoned (fclose()).
+ * @param ok 0 if the run failed: the final sync is skipped
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_EXTRACT if a sync or rename failed
+ */
+SevenZipErrorCode output_durability_end(OutputDurability* d, int ok);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_OUTPUT_DURABILITY_H */
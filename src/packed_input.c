@@ -0,0 +1,111 @@
+/**
+ * Packed Input
+ */
+
+#include "packed_input.h"
+#include "mem_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #define FSEEK64 _fseeki64
+#else
+    #include <sys/types.h>
+    #define FSEEK64 fseeko
+#endif
+
+int packed_input_open(PackedInput* in, const char* path) {
+    memset(in, 0, sizeof(*in));
+    if (mmap_in_stream_open(&in->mapped, path)) {
+        in->size = in->mapped.total_size;
+        in->end = in->size;
+        return 1;
+    }
+
+    in->file = fopen(path, "rb");
+    if (!in->file) return 0;
+    /* Pooled: archives opened one after another reuse the buffer */
+    in->buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, PACKED_INPUT_BUF_SIZE);
+    if (!in->buf) {
+        fclose(in->file);
+        in->file = NULL;
+        return 0;
+    }
+#ifdef _WIN32
+    struct _stat64 st;
+    int ok = _fstat64(_fileno(in->file), &st) == 0;
+#else
+    struct stat st;
+    int ok = fstat(fileno(in->file), &st) == 0 && S_ISREG(st.st_mode);
+#endif
+    in->size = ok ? (uint64_t)st.st_size : 0;
+    in->end = ok ? in->size : UINT64_MAX;  /* Pipes and devices: read to EOF */
+    return 1;
+}
+
+void packed_input_close(PackedInput* in) {
+    mmap_in_stream_close(&in->mapped);
+    if (in->file) fclose(in->file);
+    ISzAlloc_Free(&g_MemIoAlloc, in->buf);
+    memset(in, 0, sizeof(*in));
+}
+
+int packed_input_seek(PackedInput* in, uint64_t offset, uint64_t size) {
+    in->window = NULL;
+    in->window_size = 0;
+    in->read_error = 0;
+    if (in->mapped.volumes) {
+        if (offset > in->size) offset = in->size;
+        in->pos = offset;
+        in->end = size < in->size - offset ? offset + size : in->size;
+        return 1;
+    }
+    if (FSEEK64(in->file, (int64_t)offset, SEEK_SET) != 0) return 0;
+    in->pos = offset;
+    in->end = size < UINT64_MAX - offset ? offset + size : UINT64_MAX;
+    return 1;
+}
+
+size_t packed_input_peek(PackedInput* in, const Byte** data) {
+    if (in->window_size == 0 && in->pos < in->end) {
+        uint64_t left = in->end - in->pos;
+        if (in->mapped.volumes) {
+            in->window = in->mapped.volumes[0].data + in->pos;
+            in->window_size = left < (uint64_t)SIZE_MAX ? (size_t)left : SIZE_MAX;
+        } else {
+            size_t want = left < PACKED_INPUT_BUF_SIZE ? (size_t)left : PACKED_INPUT_BUF_SIZE;
+            in->window = in->buf;
+            in->window_size = fread(in->buf, 1, want, in->file);
+            if (in->window_size == 0) {
+                if (ferror(in->file)) in->read_error = 1;
+                in->end = in->pos;  /* Shorter than expected: nothing more to read */
+            }
+        }
+    }
+    *data = in->window;
+    return in->window_size;
+}
+
+void packed_input_consume(PackedInput* in, size_t size) {
+    in->window += size;
+    in->window_size -= size;
+    in->pos += size;
+}
+
+static SRes PackedSeqInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    PackedSeqInStream* p = Z7_CONTAINER_FROM_VTBL(pp, PackedSeqInStream, vt);
+    const Byte* data;
+    size_t n = packed_input_peek(p->in, &data);
+    if (n > *size) n = *size;
+    memcpy(buf, data, n);
+    packed_input_consume(p->in, n);
+    *size = n;
+    return p->in->read_error ? SZ_ERROR_READ : SZ_OK;
+}
+
+void packed_seq_in_stream_init(PackedSeqInStream* s, PackedInput* in) {
+    s->vt.Read = PackedSeqInStream_Read;
+    s->in = in;
+}
@@ -0,0 +1,76 @@
+/**
+ * Packed Input - Internal Header
+ *
+ * Compressed input for the standalone decoders (.lzma, .lzma2 and the
+ * custom multi-file format). The file is mapped when it can be, and the
+ * decoder reads the packed bytes in place. Otherwise it is read through
+ * one PACKED_INPUT_BUF_SIZE buffer. Either way the decoder sees a window
+ * of bytes, consumes some of them and asks for the next window.
+ */
+
+#ifndef SEVENZIP_PACKED_INPUT_H
+#define SEVENZIP_PACKED_INPUT_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "mmap_stream.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Read size when the file cannot be mapped */
+#define PACKED_INPUT_BUF_SIZE (1 << 20)
+
+typedef struct {
+    MmapInStream mapped;   /* volumes != NULL when mapped */
+    FILE* file;            /* Buffered fallback */
+    Byte* buf;
+    uint64_t size;         /* File size (0 if unknown) */
+    uint64_t pos;          /* Offset of `window` in the file */
+    uint64_t end;          /* End of the range being read */
+    const Byte* window;
+    size_t window_size;
+    int read_error;
+} PackedInput;
+
+/**
+ * Open a file for reading from offset 0 to its end
+ * @return 1 on success, 0 if it cannot be opened (or no buffer allocated)
+ */
+int packed_input_open(PackedInput* in, const char* path);
+
+void packed_input_close(PackedInput* in);
+
+/**
+ * Read [offset, offset + size) next; the range is cut at the end of the file
+ * @return 1 on success, 0 if the file cannot be positioned
+ */
+int packed_input_seek(PackedInput* in, uint64_t offset, uint64_t size);
+
+/**
+ * Current window, refilled when empty
+ * @return Bytes available at *data; 0 at the end of the range or on a
+ *         read error (read_error set)
+ */
+size_t packed_input_peek(PackedInput* in, const Byte** data);
+
+/* Mark `size` bytes of the window as used */
+void packed_input_consume(PackedInput* in, size_t size);
+
+/* ISeqInStream over the packed input for the SDK's stream coders */
+typedef struct {
+    ISeqInStream vt;
+    PackedInput* in;
+} PackedSeqInStream;
+
+void packed_seq_in_stream_init(PackedSeqInStream* s, PackedInput* in);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_PACKED_INPUT_H */
@@ -0,0 +1,722 @@
+/**
+ * Parity Volumes
+ *
+ * GF(2^8) with the polynomial 0x11d. The multiply-add kernel looks up the
+ * product of each nibble of the source in two 16-entry tables of the
+ * coefficient and XORs them in; with SSSE3 or AVX2 those lookups are
+ * PSHUFB over 16 or 32 bytes at once. Coefficients are c(r, d) =
+ * 1 / (d ^ (PARITY_GROUP_MAX + r)), distinct sums for data volume d and
+ * parity row r, which makes the matrix a Cauchy one.
+ *
+ * Parity file layout, little-endian:
+ *
+ *   magic "7zFFpar1", u32 group, u32 row, u32 data count k, u32 parity
+ *   count n, u32 block size, u32 0, u64 volume size, u64 stripe size,
+ *   u64 size of each data volume, u32 CRC of each block of the k data
+ *   volumes and then of the n parity volumes, u32 CRC of the header,
+ *   followed by the row's parity, `stripe size` bytes (the longest
+ *   volume of the group).
+ */
+
+#include "parity_volumes.h"
+#include "volume_stream.h"
+#include "mem_alloc.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
+
+#include <string.h>
+
+#if defined(MY_CPU_AMD64) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+    #define PARITY_USE_SIMD
+    #include <immintrin.h>
+    #if defined(__GNUC__) || defined(__clang__)
+        #define PARITY_TARGET_SSSE3 __attribute__((target("ssse3")))
+        #define PARITY_TARGET_AVX2 __attribute__((target("avx2")))
+    #else
+        #define PARITY_TARGET_SSSE3
+        #define PARITY_TARGET_AVX2
+    #endif
+#endif
+
+static const char kParityMagic[8] = {'7', 'z', 'F', 'F', 'p', 'a', 'r', '1'};
+#define PARITY_FIXED_HEADER 48
+
+static uint8_t g_exp[512];
+static uint8_t g_log[256];
+static uint8_t g_split[256][32];   /* Products of the low, then the high nibbles */
+
+typedef void (*ParityMulAddFunc)(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t* table);
+
+static void mul_add_scalar(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t* table) {
+    for (size_t i = 0; i < size; i++) {
+        dst[i] ^= table[src[i] & 15] ^ table[16 + (src[i] >> 4)];
+    }
+}
+
+#ifdef PARITY_USE_SIMD
+PARITY_TARGET_SSSE3
+static void mul_add_ssse3(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t* table) {
+    const __m128i lo = _mm_loadu_si128((const __m128i*)table);
+    const __m128i hi = _mm_loadu_si128((const __m128i*)(table + 16));
+    const __m128i mask = _mm_set1_epi8(15);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                                  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, p));
+    }
+    mul_add_scalar(dst + i, src + i, size - i, table);
+}
+
+PARITY_TARGET_AVX2
+static void mul_add_avx2(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t* table) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + 16)));
+    const __m256i mask = _mm256_set1_epi8(15);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+                                     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, p));
+    }
+    mul_add_scalar(dst + i, src + i, size - i, table);
+}
+#endif
+
+static ParityMulAddFunc g_mul_add = mul_add_scalar;
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) {
+    return (a && b) ? g_exp[g_log[a] + g_log[b]] : 0;
+}
+
+static uint8_t gf_inv(uint8_t a) {
+    return g_exp[255 - g_log[a]];
+}
+
+/* Coefficient of data volume `d` of a group in parity row `r` */
+static uint8_t parity_coef(uint32_t r, uint32_t d) {
+    return gf_inv((uint8_t)(d ^ (PARITY_GROUP_MAX + r)));
+}
+
+void parity_prepare(void) {
+    unsigned x = 1;
+    for (int i = 0; i < 255; i++) {
+        g_exp[i] = (uint8_t)x;
+        g_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100) x ^= 0x11d;
+    }
+    for (int i = 255; i < 512; i++) g_exp[i] = g_exp[i - 255];
+    for (int c = 0; c < 256; c++) {
+        for (int i = 0; i < 16; i++) {
+            g_split[c][i] = gf_mul((uint8_t)c, (uint8_t)i);
+            g_split[c][16 + i] = gf_mul((uint8_t)c, (uint8_t)(i << 4));
+        }
+    }
+#ifdef PARITY_USE_SIMD
+    if (CPU_IsSupported_AVX2()) {
+        g_mul_add = mul_add_avx2;
+    } else if (CPU_IsSupported_SSSE3()) {
+        g_mul_add = mul_add_ssse3;
+    }
+#endif
+}
+
+void parity_mul_add(uint8_t* dst, const uint8_t* src, size_t size, uint8_t coef) {
+    if (coef) g_mul_add(dst, src, size, g_split[coef]);
+}
+
+void parity_volume_path(char* buffer, size_t size, const char* base, uint32_t number) {
+    snprintf(buffer, size, "%s.p%03u", base, number);
+}
+
+/* Helper: Bytes of block `b` of a volume of `size` bytes */
+static size_t block_length(uint64_t size, uint32_t b) {
+    uint64_t start = (uint64_t)b * PARITY_BLOCK_SIZE;
+    if (size <= start) return 0;
+    return size - start < PARITY_BLOCK_SIZE ? (size_t)(size - start) : PARITY_BLOCK_SIZE;
+}
+
+static size_t header_size(uint32_t data_count, uint32_t parity_count, uint32_t blocks) {
+    return PARITY_FIXED_HEADER + (size_t)data_count * 8 +
+           (size_t)(data_count + parity_count) * blocks * 4 + 4;
+}
+
+/* ============================================================================
+ * Writer
+ * ============================================================================ */
+
+SevenZipErrorCode parity_writer_init(ParityWriter* w, const char* base, uint32_t parity_count,
+                                     uint64_t volume_size) {
+    memset(w, 0, sizeof(*w));
+    if (parity_count == 0 || parity_count > PARITY_MAX_VOLUMES || volume_size == 0) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    uint64_t blocks = (volume_size + PARITY_BLOCK_SIZE - 1) / PARITY_BLOCK_SIZE;
+    if (volume_size > SIZE_MAX / parity_count || blocks > UINT32_MAX / (PARITY_GROUP_MAX * 4)) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    snprintf(w->base, sizeof(w->base), "%s", base);
+    w->parity_count = parity_count;
+    w->volume_size = volume_size;
+    w->blocks = (uint32_t)blocks;
+    w->volume = UINT32_MAX;
+    w->rows = (uint8_t*)mem_calloc(SEVENZIP_MEM_IO_BUFFERS, parity_count, (size_t)volume_size);
+    w->crcs = (uint32_t*)mem_calloc(SEVENZIP_MEM_OTHER, (size_t)PARITY_GROUP_MAX * w->blocks, 4);
+    w->first_crcs = (uint32_t*)mem_calloc(SEVENZIP_MEM_OTHER, (size_t)PARITY_GROUP_MAX * w->blocks, 4);
+    if (!w->rows || !w->crcs || !w->first_crcs) {
+        parity_writer_free(w);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    return SEVENZIP_OK;
+}
+
+void parity_writer_free(ParityWriter* w) {
+    mem_free(w->rows);
+    mem_free(w->crcs);
+    mem_free(w->first_crcs);
+    w->rows = NULL;
+    w->crcs = NULL;
+    w->first_crcs = NULL;
+}
+
+/* Helper: The volume being fed is complete: keep its size and last block's CRC */
+static void writer_end_volume(ParityWriter* w) {
+    if (w->volume == UINT32_MAX) return;
+    uint32_t d = w->volume % PARITY_GROUP_MAX;
+    if (w->offset % PARITY_BLOCK_SIZE != 0) {
+        w->crcs[(size_t)d * w->blocks + w->offset / PARITY_BLOCK_SIZE] = CRC_GET_DIGEST(w->crc);
+    }
+    w->sizes[d] = w->offset;
+    w->volume = UINT32_MAX;
+}
+
+static void writer_reset(ParityWriter* w, uint32_t group) {
+    memset(w->rows, 0, (size_t)w->parity_count * (size_t)w->volume_size);
+    memset(w->crcs, 0, (size_t)PARITY_GROUP_MAX * w->blocks * 4);
+    memset(w->sizes, 0, sizeof(w->sizes));
+    w->group = group;
+    w->data_count = 0;
+}
+
+static uint64_t writer_stripe(const ParityWriter* w) {
+    uint64_t stripe = 0;
+    for (uint32_t d = 0; d < w->data_count; d++) {
+        if (w->sizes[d] > stripe) stripe = w->sizes[d];
+    }
+    return stripe;
+}
+
+/* Helper: Write the parity files of the group in `rows` */
+static int writer_write_group(ParityWriter* w) {
+    uint32_t k = w->data_count;
+    uint32_t n = w->parity_count;
+    uint64_t stripe = writer_stripe(w);
+    size_t size = header_size(k, n, w->blocks);
+    uint8_t* header = (uint8_t*)mem_alloc(SEVENZIP_MEM_OTHER, size);
+    if (!header) return 0;
+
+    memcpy(header, kParityMagic, 8);
+    SetUi32(header + 8, w->group);
+    SetUi32(header + 16, k);
+    SetUi32(header + 20, n);
+    SetUi32(header + 24, PARITY_BLOCK_SIZE);
+    SetUi32(header + 28, 0);
+    SetUi64(header + 32, w->volume_size);
+    SetUi64(header + 40, stripe);
+    uint8_t* p = header + PARITY_FIXED_HEADER;
+    for (uint32_t d = 0; d < k; d++, p += 8) SetUi64(p, w->sizes[d]);
+    for (size_t i = 0; i < (size_t)k * w->blocks; i++, p += 4) SetUi32(p, w->crcs[i]);
+    for (uint32_t r = 0; r < n; r++) {
+        const uint8_t* row = w->rows + (size_t)r * (size_t)w->volume_size;
+        for (uint32_t b = 0; b < w->blocks; b++, p += 4) {
+            size_t len = block_length(stripe, b);
+            SetUi32(p, len ? CrcCalc(row + (size_t)b * PARITY_BLOCK_SIZE, len) : 0);
+        }
+    }
+
+    int ok = 1;
+    for (uint32_t r = 0; r < n && ok; r++) {
+        SetUi32(header + 12, r);
+        SetUi32(header + size - 4, CrcCalc(header, size - 4));
+        char path[1100];
+        parity_volume_path(path, sizeof(path), w->base, w->group * n + r + 1);
+        FILE* f = fopen(path, "wb");
+        ok = f != NULL;
+        if (ok) {
+            ok = fwrite(header, 1, size, f) == size &&
+                 fwrite(w->rows + (size_t)r * (size_t)w->volume_size, 1, (size_t)stripe, f) == (size_t)stripe;
+            ok = fclose(f) == 0 && ok;
+        }
+    }
+    mem_free(header);
+
+    /* Group 0 is written again once volume 0 is in */
+    if (ok && w->group == 0 && !w->first_written) {
+        w->first_written = 1;
+        w->first_count = k;
+        memcpy(w->first_sizes, w->sizes, sizeof(w->sizes));
+        memcpy(w->first_crcs, w->crcs, (size_t)PARITY_GROUP_MAX * w->blocks * 4);
+    }
+    return ok;
+}
+
+int parity_writer_update(ParityWriter* w, uint32_t volume, const void* data, size_t size) {
+    if (volume != w->volume) {
+        writer_end_volume(w);
+        uint32_t group = volume / PARITY_GROUP_MAX;
+        if (group != w->group) {
+            if (!writer_write_group(w)) return 0;
+            writer_reset(w, group);
+        }
+        w->volume = volume;
+        w->offset = 0;
+        w->crc = CRC_INIT_VAL;
+        if (volume % PARITY_GROUP_MAX >= w->data_count) w->data_count = volume % PARITY_GROUP_MAX + 1;
+    }
+    uint32_t d = volume % PARITY_GROUP_MAX;
+    const uint8_t* src = (const uint8_t*)data;
+    while (size > 0) {
+        size_t n = PARITY_BLOCK_SIZE - (size_t)(w->offset % PARITY_BLOCK_SIZE);
+        if (n > size) n = size;
+        if (w->offset + n > w->volume_size) return 0;
+        for (uint32_t r = 0; r < w->parity_count; r++) {
+            parity_mul_add(w->rows + (size_t)r * (size_t)w->volume_size + (size_t)w->offset, src, n,
+                           parity_coef(r, d));
+        }
+        w->crc = CrcUpdate(w->crc, src, n);
+        w->offset += n;
+        src += n;
+        size -= n;
+        if (w->offset % PARITY_BLOCK_SIZE == 0) {
+            w->crcs[(size_t)d * w->blocks + w->offset / PARITY_BLOCK_SIZE - 1] = CRC_GET_DIGEST(w->crc);
+            w->crc = CRC_INIT_VAL;
+        }
+    }
+    return 1;
+}
+
+/* Helper: Take group 0 back from its files, as written before volume 0 */
+static int writer_reload_first(ParityWriter* w) {
+    writer_reset(w, 0);
+    w->data_count = w->first_count;
+    memcpy(w->sizes, w->first_sizes, sizeof(w->sizes));
+    memcpy(w->crcs, w->first_crcs, (size_t)PARITY_GROUP_MAX * w->blocks * 4);
+    uint64_t stripe = writer_stripe(w);
+    size_t skip = header_size(w->data_count, w->parity_count, w->blocks);
+    int ok = 1;
+    for (uint32_t r = 0; r < w->parity_count && ok; r++) {
+        char path[1100];
+        parity_volume_path(path, sizeof(path), w->base, r + 1);
+        FILE* f = fopen(path, "rb");
+        ok = f && volume_read_at(f, skip, w->rows + (size_t)r * (size_t)w->volume_size,
+                                 (size_t)stripe) == (size_t)stripe;
+        if (f) fclose(f);
+    }
+    return ok;
+}
+
+int parity_writer_finish(ParityWriter* w, const char* first_volume_path) {
+    writer_end_volume(w);
+    uint32_t groups = w->group + 1;
+    if (w->group != 0 && (!writer_write_group(w) || !writer_reload_first(w))) return 0;
+
+    FILE* f = fopen(first_volume_path, "rb");
+    if (!f) return 0;
+    uint8_t* buf = (uint8_t*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, PARITY_BLOCK_SIZE);
+    int ok = buf != NULL;
+    size_t n;
+    while (ok && (n = fread(buf, 1, PARITY_BLOCK_SIZE, f)) > 0) {
+        ok = parity_writer_update(w, 0, buf, n);
+    }
+    ok = ok && !ferror(f);
+    fclose(f);
+    mem_free(buf);
+    if (!ok) return 0;
+    writer_end_volume(w);
+    if (w->data_count == 0) w->data_count = 1;
+    if (!writer_write_group(w)) return 0;
+
+    /* Parity files of an earlier, larger set would be taken for more groups */
+    char path[1100];
+    for (uint32_t number = groups * w->parity_count + 1;; number++) {
+        parity_volume_path(path, sizeof(path), w->base, number);
+        if (remove(path) != 0) break;
+    }
+    return 1;
+}
+
+/* ============================================================================
+ * Reader
+ * ============================================================================ */
+
+enum {
+    BLOCK_UNCHECKED = 0,
+    BLOCK_GOOD = 1,
+    BLOCK_BAD = 2      /* Missing, short or failing its CRC: rebuilt on read */
+};
+
+typedef struct {
+    uint32_t first;        /* First data volume */
+    uint32_t count;
+    uint64_t stripe;
+    size_t data_offset;    /* Header size: where each row's parity starts */
+    FILE* rows[PARITY_MAX_VOLUMES];  /* NULL = missing or damaged header */
+    uint32_t* crcs;        /* (count + parity_count) x blocks */
+} ParityGroup;
+
+struct ParitySet {
+    uint32_t parity_count;
+    uint64_t volume_size;
+    uint32_t blocks;
+    ParityGroup* groups;
+    uint32_t group_count;
+    int volume_count;
+    uint64_t* sizes;
+    /* Written without the lock: every writer of a block stores the same verdict */
+    volatile uint8_t* state;   /* volume_count x blocks */
+
+    /* Repair, one block at a time under `lock` */
+    CCriticalSection lock;
+    uint8_t* sums;         /* parity_count blocks */
+    uint8_t* scratch;
+    uint8_t* repaired;
+    int repaired_volume;   /* Block in `repaired`, -1 = none */
+    uint32_t repaired_block;
+};
+
+/* Header of one parity file, checked */
+typedef struct {
+    uint32_t group, row, count, parity_count;
+    uint64_t volume_size, stripe;
+    uint8_t* data;         /* The whole header */
+    size_t size;
+} ParityHeader;
+
+static int read_header(FILE* f, ParityHeader* h) {
+    uint8_t fixed[PARITY_FIXED_HEADER];
+    memset(h, 0, sizeof(*h));
+    if (volume_read_at(f, 0, fixed, sizeof(fixed)) != sizeof(fixed) ||
+        memcmp(fixed, kParityMagic, 8) != 0 || GetUi32(fixed + 24) != PARITY_BLOCK_SIZE) {
+        return 0;
+    }
+    h->group = GetUi32(fixed + 8);
+    h->row = GetUi32(fixed + 12);
+    h->count = GetUi32(fixed + 16);
+    h->parity_count = GetUi32(fixed + 20);
+    h->volume_size = GetUi64(fixed + 32);
+    h->stripe = GetUi64(fixed + 40);
+    uint64_t blocks = (h->volume_size + PARITY_BLOCK_SIZE - 1) / PARITY_BLOCK_SIZE;
+    if (h->count == 0 || h->count > PARITY_GROUP_MAX || h->parity_count == 0 ||
+        h->parity_count > PARITY_MAX_VOLUMES || h->row >= h->parity_count ||
+        h->stripe > h->volume_size || blocks == 0 || blocks > UINT32_MAX / (PARITY_GROUP_MAX * 4)) {
+        return 0;
+    }
+    h->size = header_size(h->count, h->parity_count, (uint32_t)blocks);
+    h->data = (uint8_t*)mem_alloc(SEVENZIP_MEM_OTHER, h->size);
+    if (!h->data) return 0;
+    if (volume_read_at(f, 0, h->data, h->size) != h->size ||
+        GetUi32(h->data + h->size - 4) != CrcCalc(h->data, h->size - 4)) {
+        mem_free(h->data);
+        h->data = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Helper: Open parity volume `number` if its header is that of `group` and `row` */
+static FILE* open_row(const char* base, uint32_t number, uint32_t group, uint32_t row,
+                      const ParitySet* p, ParityHeader* h) {
+    char path[1100];
+    parity_volume_path(path, sizeof(path), base, number);
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    if (!read_header(f, h)) {
+        fclose(f);
+        return NULL;
+    }
+    if (h->group != group || h->row != row ||
+        (p && (h->parity_count != p->parity_count || h->volume_size != p->volume_size))) {
+        mem_free(h->data);
+        h->data = NULL;
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* Helper: Add group `g` from its parity files; 0 if none of them is readable */
+static int add_group(ParitySet* p, const char* base, uint32_t g) {
+    ParityGroup* grown = (ParityGroup*)mem_realloc(SEVENZIP_MEM_OTHER, p->groups,
+                                                   (g + 1) * sizeof(ParityGroup));
+    if (!grown) return 0;
+    p->groups = grown;
+    ParityGroup* group = &p->groups[g];
+    memset(group, 0, sizeof(*group));
+
+    ParityHeader first;
+    memset(&first, 0, sizeof(first));
+    for (uint32_t r = 0; r < p->parity_count; r++) {
+        ParityHeader h;
+        group->rows[r] = open_row(base, g * p->parity_count + r + 1, g, r, p, &h);
+        if (!group->rows[r]) continue;
+        if (!first.data) {
+            first = h;
+        } else {
+            /* Rows of one group carry the same tables */
+            int same = h.size == first.size && memcmp(h.data + 16, first.data + 16, h.size - 20) == 0;
+            mem_free(h.data);
+            if (!same) {
+                fclose(group->rows[r]);
+                group->rows[r] = NULL;
+            }
+        }
+    }
+    if (!first.data) return 0;
+
+    group->first = (uint32_t)p->volume_count;
+    group->count = first.count;
+    group->stripe = first.stripe;
+    group->data_offset = first.size;
+    size_t crc_count = (size_t)(first.count + p->parity_count) * p->blocks;
+    group->crcs = (uint32_t*)mem_alloc(SEVENZIP_MEM_OTHER, crc_count * 4);
+    uint64_t* sizes = (uint64_t*)mem_realloc(SEVENZIP_MEM_OTHER, p->sizes,
+                                             (p->volume_count + first.count) * sizeof(uint64_t));
+    if (sizes) p->sizes = sizes;
+    if (!group->crcs || !sizes) {
+        mem_free(first.data);
+        for (uint32_t r = 0; r < p->parity_count; r++) {
+            if (group->rows[r]) fclose(group->rows[r]);
+        }
+        mem_free(group->crcs);
+        return 0;
+    }
+    const uint8_t* q = first.data + PARITY_FIXED_HEADER;
+    for (uint32_t d = 0; d < first.count; d++, q += 8) p->sizes[p->volume_count + d] = GetUi64(q);
+    for (size_t i = 0; i < crc_count; i++, q += 4) group->crcs[i] = GetUi32(q);
+    mem_free(first.data);
+    p->volume_count += (int)first.count;
+    p->group_count = g + 1;
+    return 1;
+}
+
+ParitySet* parity_set_open(const char* base) {
+    /* The first readable file of group 0 gives the parity count */
+    ParityHeader h;
+    FILE* f = NULL;
+    for (uint32_t r = 0; r < PARITY_MAX_VOLUMES && !f; r++) {
+        f = open_row(base, r + 1, 0, r, NULL, &h);
+    }
+    if (!f) return NULL;
+    fclose(f);
+    ParitySet* p = (ParitySet*)mem_calloc(SEVENZIP_MEM_OTHER, 1, sizeof(ParitySet));
+    if (!p) {
+        mem_free(h.data);
+        return NULL;
+    }
+    p->parity_count = h.parity_count;
+    p->volume_size = h.volume_size;
+    p->blocks = (uint32_t)((h.volume_size + PARITY_BLOCK_SIZE - 1) / PARITY_BLOCK_SIZE);
+    p->repaired_volume = -1;
+    mem_free(h.data);
+
+    for (uint32_t g = 0; add_group(p, base, g); g++) {
+        if (p->groups[g].count < PARITY_GROUP_MAX || p->volume_count >= VOLUME_MAX_COUNT) break;
+    }
+    p->state = p->volume_count > 0
+        ? (volatile uint8_t*)mem_calloc(SEVENZIP_MEM_OTHER, (size_t)p->volume_count, p->blocks)
+        : NULL;
+    if (!p->state || CriticalSection_Init(&p->lock) != 0) {
+        mem_free((void*)p->state);
+        p->state = NULL;
+        parity_set_close(p);
+        return NULL;
+    }
+    return p;
+}
+
+void parity_set_close(ParitySet* p) {
+    if (!p) return;
+    for (uint32_t g = 0; g < p->group_count; g++) {
+        for (uint32_t r = 0; r < p->parity_count; r++) {
+            if (p->groups[g].rows[r]) fclose(p->groups[g].rows[r]);
+        }
+        mem_free(p->groups[g].crcs);
+    }
+    if (p->state) CriticalSection_Delete(&p->lock);
+    mem_free(p->groups);
+    mem_free(p->sizes);
+    mem_free((void*)p->state);
+    mem_free(p->sums);
+    mem_free(p->scratch);
+    mem_free(p->repaired);
+    mem_free(p);
+}
+
+int parity_set_volume_count(const ParitySet* p) {
+    return p->volume_count;
+}
+
+uint64_t parity_set_volume_size(const ParitySet* p, int volume) {
+    return p->sizes[volume];
+}
+
+/* Helper: Invert the e x e matrix `m` in place; 0 if it is singular */
+static int gf_invert(uint8_t m[PARITY_MAX_VOLUMES][PARITY_MAX_VOLUMES], int e) {
+    uint8_t inv[PARITY_MAX_VOLUMES][PARITY_MAX_VOLUMES];
+    memset(inv, 0, sizeof(inv));
+    for (int i = 0; i < e; i++) inv[i][i] = 1;
+    for (int col = 0; col < e; col++) {
+        int pivot = col;
+        while (pivot < e && m[pivot][col] == 0) pivot++;
+        if (pivot == e) return 0;
+        if (pivot != col) {
+            for (int j = 0; j < e; j++) {
+                uint8_t t = m[col][j]; m[col][j] = m[pivot][j]; m[pivot][j] = t;
+                t = inv[col][j]; inv[col][j] = inv[pivot][j]; inv[pivot][j] = t;
+            }
+        }
+        uint8_t scale = gf_inv(m[col][col]);
+        for (int j = 0; j < e; j++) {
+            m[col][j] = gf_mul(m[col][j], scale);
+            inv[col][j] = gf_mul(inv[col][j], scale);
+        }
+        for (int i = 0; i < e; i++) {
+            uint8_t factor = m[i][col];
+            if (i == col || factor == 0) continue;
+            for (int j = 0; j < e; j++) {
+                m[i][j] ^= gf_mul(factor, m[col][j]);
+                inv[i][j] ^= gf_mul(factor, inv[col][j]);
+            }
+        }
+    }
+    memcpy(m, inv, sizeof(inv));
+    return 1;
+}
+
+/*
+ * Helper: Rebuild block `b` of `volume` into p->repaired (lock held)
+ * Each usable parity row's block, minus what the group's good blocks
+ * contribute to it, is a sum over the lost blocks alone; as many rows as
+ * there are lost blocks give a system the inverted Cauchy submatrix solves.
+ */
+static int repair_block(ParitySet* p, FILE* const* files, int volume, uint32_t b) {
+    if (p->repaired_volume == volume && p->repaired_block == b) return 1;
+    if (!p->sums) {
+        p->sums = (uint8_t*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, (size_t)p->parity_count * PARITY_BLOCK_SIZE);
+        p->scratch = (uint8_t*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, PARITY_BLOCK_SIZE);
+        p->repaired = (uint8_t*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, PARITY_BLOCK_SIZE);
+        if (!p->sums || !p->scratch || !p->repaired) {
+            mem_free(p->sums);
+            mem_free(p->scratch);
+            mem_free(p->repaired);
+            p->sums = p->scratch = p->repaired = NULL;
+            return 0;
+        }
+    }
+    p->repaired_volume = -1;
+    ParityGroup* group = &p->groups[(uint32_t)volume / PARITY_GROUP_MAX];
+    uint32_t target = (uint32_t)volume - group->first;
+    size_t length = block_length(group->stripe, b);
+
+    /* Rows whose block is intact */
+    uint32_t rows[PARITY_MAX_VOLUMES];
+    uint32_t usable = 0;
+    for (uint32_t r = 0; r < p->parity_count; r++) {
+        uint8_t* sum = p->sums + (size_t)r * PARITY_BLOCK_SIZE;
+        FILE* f = group->rows[r];
+        if (f && volume_read_at(f, group->data_offset + (uint64_t)b * PARITY_BLOCK_SIZE, sum, length) == length &&
+            CrcCalc(sum, length) == group->crcs[(size_t)(group->count + r) * p->blocks + b]) {
+            rows[usable++] = r;
+        }
+    }
+
+    /* Take out the good blocks; the others are lost, the target first */
+    uint32_t lost[PARITY_MAX_VOLUMES];
+    uint32_t lost_count = 0;
+    lost[lost_count++] = target;
+    for (uint32_t d = 0; d < group->count; d++) {
+        if (d == target) continue;
+        int v = (int)(group->first + d);
+        size_t n = block_length(p->sizes[v], b);
+        if (n == 0) continue;
+        volatile uint8_t* state = &p->state[(size_t)v * p->blocks + b];
+        if (*state != BLOCK_BAD && files[v] &&
+            volume_read_at(files[v], (uint64_t)b * PARITY_BLOCK_SIZE, p->scratch, n) == n &&
+            CrcCalc(p->scratch, n) == group->crcs[(size_t)d * p->blocks + b]) {
+            *state = BLOCK_GOOD;
+            for (uint32_t i = 0; i < usable; i++) {
+                parity_mul_add(p->sums + (size_t)rows[i] * PARITY_BLOCK_SIZE, p->scratch, n,
+                               parity_coef(rows[i], d));
+            }
+        } else {
+            *state = BLOCK_BAD;
+            if (lost_count == usable) return 0;
+            lost[lost_count++] = d;
+        }
+    }
+    if (lost_count > usable) return 0;
+
+    uint8_t m[PARITY_MAX_VOLUMES][PARITY_MAX_VOLUMES];
+    for (uint32_t i = 0; i < lost_count; i++) {
+        for (uint32_t j = 0; j < lost_count; j++) m[i][j] = parity_coef(rows[i], lost[j]);
+    }
+    if (!gf_invert(m, (int)lost_count)) return 0;
+    memset(p->repaired, 0, length);
+    for (uint32_t i = 0; i < lost_count; i++) {
+        parity_mul_add(p->repaired, p->sums + (size_t)rows[i] * PARITY_BLOCK_SIZE, length, m[0][i]);
+    }
+    size_t n = block_length(p->sizes[volume], b);
+    if (CrcCalc(p->repaired, n) != group->crcs[(size_t)target * p->blocks + b]) return 0;
+    p->repaired_volume = volume;
+    p->repaired_block = b;
+    return 1;
+}
+
+size_t parity_set_read(ParitySet* p, FILE* const* files, int volume, uint64_t offset,
+                       void* buf, size_t size) {
+    uint8_t* out = (uint8_t*)buf;
+    const ParityGroup* group = &p->groups[(uint32_t)volume / PARITY_GROUP_MAX];
+    uint32_t d = (uint32_t)volume - group->first;
+    size_t done = 0;
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint32_t b = (uint32_t)(pos / PARITY_BLOCK_SIZE);
+        size_t within = (size_t)(pos % PARITY_BLOCK_SIZE);
+        size_t n = PARITY_BLOCK_SIZE - within;
+        if (n > size - done) n = size - done;
+        volatile uint8_t* state = &p->state[(size_t)volume * p->blocks + b];
+
+        if (*state == BLOCK_GOOD && volume_read_at(files[volume], pos, out + done, n) == n) {
+            done += n;
+            continue;
+        }
+        if (*state == BLOCK_UNCHECKED && files[volume]) {
+            /* First read of the block: check it whole */
+            size_t length = block_length(p->sizes[volume], b);
+            uint8_t* block = (uint8_t*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, length);
+            if (!block) return 0;
+            int good = volume_read_at(files[volume], (uint64_t)b * PARITY_BLOCK_SIZE, block, length) == length &&
+                       CrcCalc(block, length) == group->crcs[(size_t)d * p->blocks + b];
+            if (good) memcpy(out + done, block + within, n);
+            mem_free(block);
+            *state = good ? BLOCK_GOOD : BLOCK_BAD;
+            if (good) {
+                done += n;
+                continue;
+            }
+        }
+        *state = BLOCK_BAD;
+        CriticalSection_Enter(&p->lock);
+        int ok = repair_block(p, files, volume, b);
+        if (ok) memcpy(out + done, p->repaired + within, n);
+        CriticalSection_Leave(&p->lock);
+        if (!ok) return 0;
+        done += n;
+    }
+    return size;
+}
@@ -0,0 +1,112 @@
+/**
+ * Parity Volumes - Internal Header
+ *
+ * Reed-Solomon parity of split archives (SevenZipStreamOptions.parity_volumes).
+ * Data volumes are taken in groups of up to PARITY_GROUP_MAX; byte i of
+ * parity volume r of a group is the GF(2^8) sum of c(r, d) times byte i
+ * of each data volume d, shorter volumes padded with zeros, where c is a
+ * Cauchy matrix: every square submatrix of it can be inverted, so any
+ * `parity_count` lost volumes of a group can be solved for from the rest.
+ *
+ * Each parity file, <base>.pNNN numbered on from group to group, starts
+ * with a header holding the group's volume sizes and the CRC32 of every
+ * PARITY_BLOCK_SIZE block of its data and parity volumes, so a reader
+ * finds a damaged block without a pass over the whole set, and rebuilds
+ * only that block, from the same block of the others.
+ *
+ * The writer is fed each volume's bytes in order as they are written;
+ * volume 0 is only final once its start header is patched, so it is fed
+ * last, read back from disk.
+ */
+
+#ifndef SEVENZIP_PARITY_VOLUMES_H
+#define SEVENZIP_PARITY_VOLUMES_H
+
+#include "../include/7z_ffi.h"
+#include "Threads.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PARITY_BLOCK_SIZE (1u << 20)  /* Unit of the CRC tables and of repair */
+#define PARITY_GROUP_MAX 128          /* Data volumes per group */
+#define PARITY_MAX_VOLUMES 32         /* Parity volumes per group */
+
+/* Fill the GF(2^8) tables and pick the multiply kernel (from global_tables_init()) */
+void parity_prepare(void);
+
+/* dst ^= coef * src, byte by byte in GF(2^8) */
+void parity_mul_add(uint8_t* dst, const uint8_t* src, size_t size, uint8_t coef);
+
+/* Path of parity volume `number` (1-based) of the archive split at `base` */
+void parity_volume_path(char* buffer, size_t size, const char* base, uint32_t number);
+
+typedef struct {
+    char base[1024];
+    uint32_t parity_count;
+    uint64_t volume_size;     /* Split size: the longest a data volume gets */
+    uint32_t blocks;          /* PARITY_BLOCK_SIZE blocks per volume */
+    uint8_t* rows;            /* parity_count x volume_size: the group being fed */
+    uint32_t group;
+    uint32_t data_count;      /* Data volumes of the group fed so far */
+    uint64_t sizes[PARITY_GROUP_MAX];
+    uint32_t* crcs;           /* PARITY_GROUP_MAX x blocks data block CRCs */
+    uint32_t volume;          /* Volume being fed, UINT32_MAX = none */
+    uint64_t offset;          /* Its bytes so far */
+    uint32_t crc;             /* Of its current block */
+    /* Group 0 when written before volume 0 was fed, to be written again */
+    int first_written;
+    uint32_t first_count;
+    uint64_t first_sizes[PARITY_GROUP_MAX];
+    uint32_t* first_crcs;
+} ParityWriter;
+
+/**
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_INVALID_PARAM for a parity_count
+ *         of 0 or above PARITY_MAX_VOLUMES, SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode parity_writer_init(ParityWriter* w, const char* base, uint32_t parity_count,
+                                     uint64_t volume_size);
+
+/* Bytes of data volume `volume` (0-based, at least 1), following the last
+ * ones fed for it; volumes are fed in order. A group is written out when
+ * the first volume of the next one is fed.
+ * @return 1, or 0 if a parity file could not be written */
+int parity_writer_update(ParityWriter* w, uint32_t volume, const void* data, size_t size);
+
+/* Feed volume 0, read from `first_volume_path`, and write the rest
+ * @return 1, or 0 if a volume could not be read or a parity file written */
+int parity_writer_finish(ParityWriter* w, const char* first_volume_path);
+
+void parity_writer_free(ParityWriter* w);
+
+/* Parity files of a split archive, as read back */
+typedef struct ParitySet ParitySet;
+
+/* NULL unless <base>.p001 (or another parity file of the first group) is found and valid */
+ParitySet* parity_set_open(const char* base);
+void parity_set_close(ParitySet* p);
+
+/* Data volumes, and their sizes, that the parity describes */
+int parity_set_volume_count(const ParitySet* p);
+uint64_t parity_set_volume_size(const ParitySet* p, int volume);
+
+/**
+ * Read bytes of data volume `volume` within its size, through `files`
+ * (the data volumes, NULL where missing). Blocks are checked against
+ * their CRCs the first time they are read; a block that is missing or
+ * fails is rebuilt from the rest of its group. Safe from several threads.
+ * @return `size`, or 0 if a block could neither be read nor rebuilt
+ */
+size_t parity_set_read(ParitySet* p, FILE* const* files, int volume, uint64_t offset,
+                       void* buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_PARITY_VOLUMES_H */
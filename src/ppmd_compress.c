@@ -0,0 +1,166 @@
+/**
+ * PPMd Compression
+ *
+ * PPMd (variant H with the 7z range coder) predicts each byte from the
+ * preceding context and typically beats LZMA2 by 10-30% on natural
+ * language, source code and logs, at the cost of symmetric speed.
+ * The decoder side lives in lzma/C/7zDec.c (built with Z7_PPMD_SUPPORT).
+ */
+
+#include "ppmd_compress.h"
+#include "Ppmd7.h"
+#include "mem_alloc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* 7z method ID 03 04 01 (PPMD) */
+static const Byte k7zMethodPPMD[3] = { 0x03, 0x04, 0x01 };
+
+#define PPMD_IO_BUFFER_SIZE (1 << 16)
+
+/* Per-level model orders used by 7-Zip for PPMd in 7z archives */
+static const Byte k_ppmd_orders[10] = { 3, 4, 4, 5, 5, 6, 8, 16, 24, 32 };
+
+void sevenzip_ppmd_props(
+    SevenZipCompressionLevel level,
+    int order_option,
+    uint32_t mem_option,
+    unsigned* order,
+    UInt32* mem_size
+) {
+    int lvl = (int)level;
+    if (lvl < 1) lvl = 1;
+    if (lvl > 9) lvl = 9;
+
+    unsigned o = order_option > 0 ? (unsigned)order_option : k_ppmd_orders[lvl];
+    if (o < PPMD7_MIN_ORDER) o = PPMD7_MIN_ORDER;
+    if (o > PPMD7_MAX_ORDER) o = PPMD7_MAX_ORDER;
+
+    UInt32 mem = mem_option;
+    if (mem == 0) {
+        mem = lvl >= 9 ? ((UInt32)192 << 20) : ((UInt32)1 << (19 + lvl));
+    }
+    if (mem < PPMD7_MIN_MEM_SIZE) mem = PPMD7_MIN_MEM_SIZE;
+    if (mem > PPMD7_MAX_MEM_SIZE) mem = PPMD7_MAX_MEM_SIZE;
+
+    *order = o;
+    *mem_size = mem;
+}
+
+int sevenzip_ppmd_is_text_file(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+
+    Byte head[PPMD_TEXT_SAMPLE_SIZE];
+    size_t got = fread(head, 1, sizeof(head), f);
+    fclose(f);
+    if (got == 0) return 0;
+
+    /* NULs never appear in text; other control bytes besides
+     * tab/CR/LF/FF/ESC may appear only sparsely. Bytes >= 0x80 are
+     * accepted so UTF-8 and legacy code pages count as text. */
+    size_t control = 0;
+    for (size_t i = 0; i < got; i++) {
+        Byte b = head[i];
+        if (b == 0) return 0;
+        if (b < 0x20 && b != '\t' && b != '\n' && b != '\r' && b != '\f' && b != 0x1B) {
+            control++;
+        }
+    }
+    return control * 100 <= got;
+}
+
+int sevenzip_ppmd_choose(SevenZipMethod method, const char* path) {
+    if (method == SEVENZIP_METHOD_PPMD) return 1;
+    if (method == SEVENZIP_METHOD_AUTO) return sevenzip_ppmd_is_text_file(path);
+    return 0;
+}
+
+/* IByteOut adapter: batches range-coder bytes before writing them out */
+typedef struct {
+    IByteOut vt;
+    ISeqOutStreamPtr out;
+    Byte* buf;
+    size_t pos;
+    SRes res;
+} PpmdByteOut;
+
+static void PpmdByteOut_Flush(PpmdByteOut* p) {
+    if (p->pos != 0 && p->res == SZ_OK) {
+        if (ISeqOutStream_Write(p->out, p->buf, p->pos) != p->pos) {
+            p->res = SZ_ERROR_WRITE;
+        }
+    }
+    p->pos = 0;
+}
+
+static void PpmdByteOut_Write(IByteOutPtr pp, Byte b) {
+    PpmdByteOut* p = Z7_CONTAINER_FROM_VTBL(pp, PpmdByteOut, vt);
+    p->buf[p->pos++] = b;
+    if (p->pos == PPMD_IO_BUFFER_SIZE) {
+        PpmdByteOut_Flush(p);
+    }
+}
+
+SRes sevenzip_ppmd_encode(ISeqOutStreamPtr out, ISeqInStreamPtr in, unsigned order, UInt32 mem_size) {
+    CPpmd7 ppmd;
+    PpmdByteOut byte_out;
+    SRes res = SZ_OK;
+
+    Byte* in_buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, PPMD_IO_BUFFER_SIZE);
+    byte_out.buf = (Byte*)ISzAlloc_Alloc(&g_MemIoAlloc, PPMD_IO_BUFFER_SIZE);
+    if (!in_buf || !byte_out.buf) {
+        ISzAlloc_Free(&g_MemIoAlloc, in_buf);
+        ISzAlloc_Free(&g_MemIoAlloc, byte_out.buf);
+        return SZ_ERROR_MEM;
+    }
+    byte_out.vt.Write = PpmdByteOut_Write;
+    byte_out.out = out;
+    byte_out.pos = 0;
+    byte_out.res = SZ_OK;
+
+    Ppmd7_Construct(&ppmd);
+    if (!Ppmd7_Alloc(&ppmd, mem_size, &g_MemMatchFinderAlloc)) {
+        ISzAlloc_Free(&g_MemIoAlloc, in_buf);
+        ISzAlloc_Free(&g_MemIoAlloc, byte_out.buf);
+        return SZ_ERROR_MEM;
+    }
+
+    ppmd.rc.enc.Stream = &byte_out.vt;
+    Ppmd7z_Init_RangeEnc(&ppmd);
+    Ppmd7_Init(&ppmd, order);
+
+    for (;;) {
+        size_t size = PPMD_IO_BUFFER_SIZE;
+        res = ISeqInStream_Read(in, in_buf, &size);
+        if (res != SZ_OK || size == 0) break;
+        Ppmd7z_EncodeSymbols(&ppmd, in_buf, in_buf + size);
+        if (byte_out.res != SZ_OK) break;
+    }
+
+    /* No end marker: 7z stores the unpacked size, and 7zDec rejects one */
+    if (res == SZ_OK && byte_out.res == SZ_OK) {
+        Ppmd7z_Flush_RangeEnc(&ppmd);
+        PpmdByteOut_Flush(&byte_out);
+    }
+    if (res == SZ_OK) res = byte_out.res;
+
+    Ppmd7_Free(&ppmd, &g_MemMatchFinderAlloc);
+    ISzAlloc_Free(&g_MemIoAlloc, in_buf);
+    ISzAlloc_Free(&g_MemIoAlloc, byte_out.buf);
+    return res;
+}
+
+size_t sevenzip_ppmd_write_coder(unsigned order, UInt32 mem_size, Byte* p) {
+    /* Coder flags: 3-byte ID with properties */
+    p[0] = 0x23;
+    memcpy(p + 1, k7zMethodPPMD, 3);
+    p[4] = 5;
+    p[5] = (Byte)order;
+    p[6] = (Byte)(mem_size & 0xFF);
+    p[7] = (Byte)((mem_size >> 8) & 0xFF);
+    p[8] = (Byte)((mem_size >> 16) & 0xFF);
+    p[9] = (Byte)((mem_size >> 24) & 0xFF);
+    return 10;
+}
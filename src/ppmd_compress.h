@@ -0,0 +1,77 @@
+/**
+ * PPMd Compression - Internal Header
+ *
+ * PPMd (variant H, 7z range coder) encoder used as an alternative to LZMA2
+ * for text-heavy folders, plus the text classifier that selects it.
+ */
+
+#ifndef SEVENZIP_PPMD_COMPRESS_H
+#define SEVENZIP_PPMD_COMPRESS_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes of the file start sampled by sevenzip_ppmd_is_text_file() */
+#define PPMD_TEXT_SAMPLE_SIZE 4096
+
+/**
+ * Resolve the PPMd model order and memory size for a compression level
+ * Zero options take 7-Zip's per-level defaults; values are clamped to the
+ * ranges the decoder accepts.
+ * @param level Compression level
+ * @param order_option Requested order (0 = default)
+ * @param mem_option Requested model size in bytes (0 = default)
+ * @param order Output model order
+ * @param mem_size Output model size
+ */
+void sevenzip_ppmd_props(
+    SevenZipCompressionLevel level,
+    int order_option,
+    uint32_t mem_option,
+    unsigned* order,
+    UInt32* mem_size
+);
+
+/**
+ * Classify a file as text from its first bytes
+ * @param path Filesystem path
+ * @return 1 if the sample looks like text (no NULs, few control bytes), 0 otherwise
+ */
+int sevenzip_ppmd_is_text_file(const char* path);
+
+/**
+ * Decide whether one file is compressed with PPMd
+ * @param method Method from the options
+ * @param path Filesystem path (classified only for SEVENZIP_METHOD_AUTO)
+ * @return 1 for PPMd, 0 for LZMA2
+ */
+int sevenzip_ppmd_choose(SevenZipMethod method, const char* path);
+
+/**
+ * Encode everything readable from `in` as one PPMd stream
+ * @param out Destination for the packed stream
+ * @param in Source data (read until EOF)
+ * @param order Model order
+ * @param mem_size Model size in bytes
+ * @return SZ_OK, SZ_ERROR_MEM, SZ_ERROR_WRITE or the input stream's error
+ */
+SRes sevenzip_ppmd_encode(ISeqOutStreamPtr out, ISeqInStreamPtr in, unsigned order, UInt32 mem_size);
+
+/**
+ * Write the 7z coder record (flags, method ID, 5 property bytes) for PPMd
+ * @param p Output buffer (at least 10 bytes)
+ * @return Number of bytes written
+ */
+size_t sevenzip_ppmd_write_coder(unsigned order, UInt32 mem_size, Byte* p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_PPMD_COMPRESS_H */
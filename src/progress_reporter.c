@@ -0,0 +1,160 @@
+/**
+ * Progress Reporter
+ *
+ * Counters are plain atomics so the hot paths never take a lock or call
+ * out; the reporter thread sleeps on a condition variable between polls
+ * and is woken at once by progress_reporter_stop().
+ */
+
+#include "progress_reporter.h"
+#include "thread_placement.h"
+
+#include <string.h>
+#include <time.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <windows.h>
+    #define COUNTER_LOAD(p) ((uint64_t)InterlockedCompareExchange64((p), 0, 0))
+    #define COUNTER_STORE(p, v) InterlockedExchange64((p), (__int64)(v))
+    #define COUNTER_ADD(p, v) InterlockedExchangeAdd64((p), (__int64)(v))
+    #define NAME_LOAD(p) ((const char*)InterlockedCompareExchangePointer((p), NULL, NULL))
+    #define NAME_STORE(p, v) InterlockedExchangePointer((p), (void*)(v))
+#else
+    #define COUNTER_LOAD(p) atomic_load_explicit((p), memory_order_relaxed)
+    #define COUNTER_STORE(p, v) atomic_store_explicit((p), (v), memory_order_relaxed)
+    #define COUNTER_ADD(p, v) atomic_fetch_add_explicit((p), (v), memory_order_relaxed)
+    #define NAME_LOAD(p) atomic_load_explicit((p), memory_order_relaxed)
+    #define NAME_STORE(p, v) atomic_store_explicit((p), (v), memory_order_relaxed)
+#endif
+
+/* The clock of pthread_cond_timedwait() */
+static double now_seconds(struct timespec* ts) {
+    timespec_get(ts, TIME_UTC);
+    return (double)ts->tv_sec + (double)ts->tv_nsec / 1e9;
+}
+
+/* One call with the current counters; the caller holds r->lock or the thread is gone */
+static void deliver(ProgressReporter* r, uint64_t done) {
+    uint64_t total = COUNTER_LOAD(&r->total);
+    if (r->bytes_callback) {
+        const char* name = NAME_LOAD(&r->file_name);
+        r->bytes_callback(done, total, COUNTER_LOAD(&r->file_done),
+                          COUNTER_LOAD(&r->file_total), name ? name : "", r->user_data);
+    } else {
+        r->count_callback(done, total, r->user_data);
+    }
+    r->reported = done;
+}
+
+static void* reporter_thread(void* arg) {
+    ProgressReporter* r = (ProgressReporter*)arg;
+    thread_sched_enter();
+    uint64_t poll_ms = r->interval_ms;
+    if (r->interval_bytes && poll_ms > PROGRESS_BYTES_POLL_MS) poll_ms = PROGRESS_BYTES_POLL_MS;
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop) {
+        struct timespec ts;
+        now_seconds(&ts);
+        uint64_t ns = (uint64_t)ts.tv_nsec + poll_ms * 1000000ULL;
+        ts.tv_sec += (time_t)(ns / 1000000000ULL);
+        ts.tv_nsec = (long)(ns % 1000000000ULL);
+        pthread_cond_timedwait(&r->wake, &r->lock, &ts);
+        if (r->stop) break;
+
+        uint64_t done = COUNTER_LOAD(&r->done);
+        if (done == r->reported) continue;
+        double now = now_seconds(&ts);
+        int due = (now - r->reported_at) * 1000.0 >= (double)r->interval_ms;
+        if (!due && r->interval_bytes && r->reported != UINT64_MAX) {
+            due = done - r->reported >= r->interval_bytes;
+        }
+        if (due) {
+            deliver(r, done);
+            r->reported_at = now;
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+void progress_reporter_start(ProgressReporter* r,
+                             SevenZipBytesProgressCallback bytes_callback,
+                             SevenZipProgressCallback count_callback,
+                             void* user_data, uint64_t total,
+                             int interval_ms, uint64_t interval_bytes) {
+    memset(r, 0, sizeof(*r));
+    r->bytes_callback = bytes_callback;
+    r->count_callback = bytes_callback ? NULL : count_callback;
+    r->user_data = user_data;
+    r->active = bytes_callback || count_callback;
+    r->immediate = interval_ms < 0;
+    r->interval_ms = interval_ms > 0 ? (uint64_t)interval_ms : PROGRESS_DEFAULT_INTERVAL_MS;
+    r->interval_bytes = interval_bytes;
+    r->reported = UINT64_MAX;
+    COUNTER_STORE(&r->total, total);
+    if (!r->active) return;
+
+    pthread_mutex_init(&r->lock, NULL);
+    if (r->immediate) return;
+
+    struct timespec ts;
+    r->reported_at = now_seconds(&ts);
+    if (pthread_cond_init(&r->wake, NULL) != 0) {
+        r->immediate = 1;
+        return;
+    }
+    if (pthread_create(&r->thread, NULL, reporter_thread, r) != 0) {
+        pthread_cond_destroy(&r->wake);
+        r->immediate = 1;
+        return;
+    }
+    r->running = 1;
+}
+
+void progress_reporter_stop(ProgressReporter* r) {
+    if (!r->active) return;
+    if (r->running) {
+        pthread_mutex_lock(&r->lock);
+        r->stop = 1;
+        pthread_cond_signal(&r->wake);
+        pthread_mutex_unlock(&r->lock);
+        pthread_join(r->thread, NULL);
+        pthread_cond_destroy(&r->wake);
+        r->running = 0;
+    }
+
+    uint64_t done = COUNTER_LOAD(&r->done);
+    if (done != r->reported) deliver(r, done);
+    pthread_mutex_destroy(&r->lock);
+    r->active = 0;
+}
+
+void progress_reporter_set_total(ProgressReporter* r, uint64_t total) {
+    if (!r->active) return;
+    COUNTER_STORE(&r->total, total);
+}
+
+void progress_reporter_begin_file(ProgressReporter* r, const char* name, uint64_t size) {
+    if (!r->active) return;
+    NAME_STORE(&r->file_name, name);
+    COUNTER_STORE(&r->file_total, size);
+    COUNTER_STORE(&r->file_done, 0);
+    if (r->immediate) {
+        pthread_mutex_lock(&r->lock);
+        deliver(r, COUNTER_LOAD(&r->done));
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+void progress_reporter_add(ProgressReporter* r, uint64_t amount) {
+    if (!r->active) return;
+    COUNTER_ADD(&r->file_done, amount);
+    COUNTER_ADD(&r->done, amount);
+    if (r->immediate) {
+        /* Loaded under the lock so the calls never go backwards */
+        pthread_mutex_lock(&r->lock);
+        deliver(r, COUNTER_LOAD(&r->done));
+        pthread_mutex_unlock(&r->lock);
+    }
+}
@@ -0,0 +1,98 @@
+/**
+ * Progress Reporter - Internal Header
+ *
+ * Rate-limited progress delivery. Workers only bump atomic counters
+ * (progress_reporter_add() and friends); a reporter thread hands the
+ * counters to the caller's callback at most once per interval, or once
+ * the byte interval has passed, whichever comes first. The values of
+ * one call are read separately, so the current-file fields may trail
+ * the totals by an update. progress_reporter_stop() delivers the final
+ * counts on the calling thread before it returns.
+ *
+ * A negative interval keeps the old behaviour: every update calls back
+ * at once on the updating thread, one call at a time.
+ */
+
+#ifndef SEVENZIP_PROGRESS_REPORTER_H
+#define SEVENZIP_PROGRESS_REPORTER_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+typedef volatile __int64 ProgressCounter;
+typedef void* volatile ProgressName;
+#else
+#include <stdatomic.h>
+typedef _Atomic uint64_t ProgressCounter;
+typedef _Atomic(const char*) ProgressName;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Interval used when the options leave it at 0 */
+#define PROGRESS_DEFAULT_INTERVAL_MS 100
+
+/* Wake-up period of the reporter while a byte interval is set */
+#define PROGRESS_BYTES_POLL_MS 10
+
+typedef struct {
+    SevenZipBytesProgressCallback bytes_callback;
+    SevenZipProgressCallback count_callback;
+    void* user_data;
+    int active;               /* A callback is set */
+    int immediate;            /* Negative interval: call back from the updaters */
+    uint64_t interval_ms;
+    uint64_t interval_bytes;  /* 0 = time only */
+
+    ProgressCounter done;
+    ProgressCounter total;
+    ProgressCounter file_done;
+    ProgressCounter file_total;
+    ProgressName file_name;   /* Must stay valid until progress_reporter_stop() */
+
+    /* Reporter thread */
+    pthread_t thread;
+    pthread_mutex_t lock;     /* Also serializes immediate calls */
+    pthread_cond_t wake;
+    int running;
+    int stop;
+    uint64_t reported;        /* `done` of the last call, UINT64_MAX = none yet */
+    double reported_at;
+} ProgressReporter;
+
+/**
+ * Start reporting to one of the callbacks (at most one is set)
+ * @param total Value of the `total` argument; may be changed later
+ * @param interval_ms Least time between calls (0 = PROGRESS_DEFAULT_INTERVAL_MS,
+ *                    negative = every update, on the updating thread)
+ * @param interval_bytes Also call back once `done` moved this far (0 = time only)
+ *
+ * Without a callback every other function is a no-op. If the thread
+ * cannot be started the reporter falls back to immediate calls.
+ */
+void progress_reporter_start(ProgressReporter* r,
+                             SevenZipBytesProgressCallback bytes_callback,
+                             SevenZipProgressCallback count_callback,
+                             void* user_data, uint64_t total,
+                             int interval_ms, uint64_t interval_bytes);
+
+/* Stop the thread and deliver what has not been reported yet */
+void progress_reporter_stop(ProgressReporter* r);
+
+void progress_reporter_set_total(ProgressReporter* r, uint64_t total);
+
+/* A new current file of `size` bytes; `name` as for file_name */
+void progress_reporter_begin_file(ProgressReporter* r, const char* name, uint64_t size);
+
+/* `amount` more done, counted against the current file too */
+void progress_reporter_add(ProgressReporter* r, uint64_t amount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_PROGRESS_REPORTER_H */
@@ -0,0 +1,177 @@
+/**
+ * Ranged Remote Input
+ *
+ * Blocks are copied out under the lock, so a block another reader drops
+ * meanwhile is never read half replaced; the callback runs outside it,
+ * and two readers missing the same block may both fetch it. A fetch
+ * serves the read that caused it straight from its own buffer, whatever
+ * the cache keeps.
+ */
+
+#include "range_stream.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+#define RANGE_NO_BLOCK UINT64_MAX
+
+int range_source_open(RangeSource* src, const SevenZipRangeReader* reader) {
+    memset(src, 0, sizeof(*src));
+    src->reader = *reader;
+    for (int i = 0; i < RANGE_CACHE_BLOCKS; i++) {
+        src->blocks[i].index = RANGE_NO_BLOCK;
+    }
+    if (CriticalSection_Init(&src->lock) != 0) {
+        return 0;
+    }
+    src->has_lock = 1;
+    return 1;
+}
+
+void range_source_close(RangeSource* src) {
+    for (int i = 0; i < RANGE_CACHE_BLOCKS; i++) {
+        mem_free(src->blocks[i].data);
+    }
+    if (src->has_lock) {
+        CriticalSection_Delete(&src->lock);
+    }
+    memset(src, 0, sizeof(*src));
+}
+
+/* The caller holds the lock */
+static RangeBlock* range_find(RangeSource* src, uint64_t index) {
+    for (int i = 0; i < RANGE_CACHE_BLOCKS; i++) {
+        if (src->blocks[i].index == index) return &src->blocks[i];
+    }
+    return NULL;
+}
+
+/* Slot for a new block: an empty one, else the least recently read;
+ * the caller holds the lock */
+static RangeBlock* range_victim(RangeSource* src) {
+    RangeBlock* victim = &src->blocks[0];
+    for (int i = 0; i < RANGE_CACHE_BLOCKS; i++) {
+        RangeBlock* b = &src->blocks[i];
+        if (b->index == RANGE_NO_BLOCK) return b;
+        if (b->used < victim->used) victim = b;
+    }
+    return victim;
+}
+
+/*
+ * One request for the missing blocks from `first`, at most `count` and
+ * up to the first block held; the bytes at `pos` go to `dest` as well.
+ * *copied is 0 when `first` is held by now and nothing was fetched.
+ */
+static SRes range_fetch(RangeSource* src, uint64_t first, uint64_t count,
+                        uint64_t pos, Byte* dest, size_t want, size_t* copied) {
+    uint64_t total = src->reader.size;
+    uint64_t last = (total + RANGE_BLOCK_SIZE - 1) / RANGE_BLOCK_SIZE;
+    if (count > RANGE_CACHE_BLOCKS / 2) count = RANGE_CACHE_BLOCKS / 2;
+    if (count > last - first) count = last - first;
+    *copied = 0;
+
+    CriticalSection_Enter(&src->lock);
+    uint64_t n = 0;
+    while (n < count && !range_find(src, first + n)) n++;
+    CriticalSection_Leave(&src->lock);
+    if (n == 0) return SZ_OK;
+
+    uint64_t offset = first * RANGE_BLOCK_SIZE;
+    size_t bytes = (size_t)(total - offset < n * RANGE_BLOCK_SIZE ? total - offset : n * RANGE_BLOCK_SIZE);
+    Byte* buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, bytes);
+    if (!buf) return SZ_ERROR_MEM;
+    if (src->reader.read_at(src->reader.user_data, offset, buf, bytes) != 0) {
+        mem_free(buf);
+        return SZ_ERROR_READ;
+    }
+
+    size_t skip = (size_t)(pos - offset);
+    size_t end_of_first = (size_t)(RANGE_BLOCK_SIZE - pos % RANGE_BLOCK_SIZE);
+    size_t n_copy = want < end_of_first ? want : end_of_first;
+    if (n_copy > bytes - skip) n_copy = bytes - skip;
+    memcpy(dest, buf + skip, n_copy);
+    *copied = n_copy;
+
+    CriticalSection_Enter(&src->lock);
+    for (uint64_t i = 0; i < n; i++) {
+        if (range_find(src, first + i)) continue;
+        RangeBlock* b = range_victim(src);
+        if (!b->data) {
+            b->data = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, RANGE_BLOCK_SIZE);
+            if (!b->data) break;  /* The read is served; the cache just keeps less */
+        }
+        size_t at = (size_t)(i * RANGE_BLOCK_SIZE);
+        b->index = first + i;
+        b->size = bytes - at < RANGE_BLOCK_SIZE ? bytes - at : RANGE_BLOCK_SIZE;
+        b->used = ++src->tick;
+        memcpy(b->data, buf + at, b->size);
+    }
+    CriticalSection_Leave(&src->lock);
+    mem_free(buf);
+    return SZ_OK;
+}
+
+static SRes RangeInStream_Read(ISeekInStreamPtr pp, void* buf, size_t* size) {
+    RangeInStream* p = Z7_CONTAINER_FROM_VTBL(pp, RangeInStream, vt);
+    RangeSource* src = p->src;
+    size_t want = *size;
+    *size = 0;
+    if (want == 0 || p->pos >= src->reader.size) {
+        return SZ_OK;
+    }
+    uint64_t index = p->pos / RANGE_BLOCK_SIZE;
+    size_t offset = (size_t)(p->pos % RANGE_BLOCK_SIZE);
+    int sequential = p->pos == p->next;
+
+    for (;;) {
+        CriticalSection_Enter(&src->lock);
+        RangeBlock* b = range_find(src, index);
+        if (b) {
+            size_t n = b->size - offset < want ? b->size - offset : want;
+            memcpy(buf, b->data + offset, n);
+            b->used = ++src->tick;
+            CriticalSection_Leave(&src->lock);
+            *size = n;
+            break;
+        }
+        CriticalSection_Leave(&src->lock);
+
+        /* A miss: read on further each time the reader keeps going */
+        if (!sequential) {
+            p->ahead = 0;
+        } else {
+            p->ahead = p->ahead == 0 ? RANGE_BLOCK_SIZE : p->ahead * 2;
+            if (p->ahead > RANGE_READAHEAD_MAX) p->ahead = RANGE_READAHEAD_MAX;
+        }
+        RINOK(range_fetch(src, index, 1 + p->ahead / RANGE_BLOCK_SIZE, p->pos,
+                          (Byte*)buf, want, size))
+        if (*size > 0) break;
+    }
+    p->pos += *size;
+    p->next = p->pos;
+    return SZ_OK;
+}
+
+static SRes RangeInStream_Seek(ISeekInStreamPtr pp, Int64* pos, ESzSeek origin) {
+    RangeInStream* p = Z7_CONTAINER_FROM_VTBL(pp, RangeInStream, vt);
+    Int64 base;
+    switch (origin) {
+        case SZ_SEEK_SET: base = 0; break;
+        case SZ_SEEK_CUR: base = (Int64)p->pos; break;
+        case SZ_SEEK_END: base = (Int64)p->src->reader.size; break;
+        default: return SZ_ERROR_PARAM;
+    }
+    if (*pos < -base) return SZ_ERROR_PARAM;
+    p->pos = (uint64_t)(base + *pos);
+    *pos = (Int64)p->pos;
+    return SZ_OK;
+}
+
+void range_in_stream_init(RangeInStream* p, RangeSource* src) {
+    memset(p, 0, sizeof(*p));
+    p->vt.Read = RangeInStream_Read;
+    p->vt.Seek = RangeInStream_Seek;
+    p->src = src;
+    p->next = UINT64_MAX;  /* The first read is not sequential */
+}
@@ -0,0 +1,79 @@
+/**
+ * Ranged Remote Input - Internal Header
+ *
+ * An archive read through the caller's read-at-offset callback (HTTP
+ * range requests, object store GETs) instead of a file. Every request
+ * is a round trip, so reads never go to the callback as they come: the
+ * archive is cut into RANGE_BLOCK_SIZE blocks, a miss fetches the run
+ * of missing blocks it needs in one request, and the blocks stay in a
+ * small cache shared by every reader of the archive, least recently
+ * used dropped first. A reader reading on from where it stopped, as a
+ * folder decoder does, doubles its read-ahead on each miss up to
+ * RANGE_READAHEAD_MAX, so a long folder costs a request per few MB; a
+ * seek drops it back to the one block. Opening and listing an archive
+ * thus fetches its first block and the blocks of its header.
+ */
+
+#ifndef SEVENZIP_RANGE_STREAM_H
+#define SEVENZIP_RANGE_STREAM_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "Threads.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Unit of the cache and of the requests */
+#define RANGE_BLOCK_SIZE (1 << 20)
+
+/* Blocks kept, shared by every reader */
+#define RANGE_CACHE_BLOCKS 16
+
+/* Most bytes fetched past what a sequential reader asked for */
+#define RANGE_READAHEAD_MAX (8 << 20)
+
+typedef struct {
+    uint64_t index;    /* Block number, UINT64_MAX when empty */
+    uint64_t used;     /* Tick of the last read from it */
+    size_t size;       /* RANGE_BLOCK_SIZE, less for the last block */
+    Byte* data;
+} RangeBlock;
+
+typedef struct {
+    SevenZipRangeReader reader;
+    CCriticalSection lock;  /* Guards the blocks and the tick */
+    int has_lock;
+    RangeBlock blocks[RANGE_CACHE_BLOCKS];
+    uint64_t tick;
+} RangeSource;
+
+/**
+ * Set up the cache over a caller's reader
+ * Blocks are allocated as they are first filled.
+ * @return 1 on success, 0 if the lock cannot be set up
+ */
+int range_source_open(RangeSource* src, const SevenZipRangeReader* reader);
+
+/* Free the blocks (safe on a zeroed source) */
+void range_source_close(RangeSource* src);
+
+/* A reader with its own position and read-ahead */
+typedef struct {
+    ISeekInStream vt;
+    RangeSource* src;
+    uint64_t pos;
+    uint64_t next;     /* Where a sequential read continues */
+    size_t ahead;      /* Bytes fetched past the block a miss needs */
+} RangeInStream;
+
+void range_in_stream_init(RangeInStream* p, RangeSource* src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_RANGE_STREAM_H */
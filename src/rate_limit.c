@@ -0,0 +1,120 @@
+/**
+ * Rate Limit
+ *
+ * A taker waits until its bucket is not in debt, then takes all it asked
+ * for, however much: a 4MB read against a budget of 100ms puts the bucket
+ * into debt, and the next taker waits it off. The rate is read again after
+ * every slice of sleep, so sevenzip_rate_limit_set() also reaches takers
+ * already waiting.
+ */
+
+#include "rate_limit.h"
+#include "cancel_token.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+typedef struct {
+    uint64_t rate;      /* Bytes per second, 0 = unlimited */
+    double tokens;      /* Bytes that may go now; negative: debt */
+    double stamp;       /* Time tokens was last brought up to date */
+} RateBucket;
+
+struct SevenZipRateLimit {
+    pthread_mutex_t lock;
+    RateBucket buckets[2];  /* By RateLimitDirection */
+};
+
+static double monotonic_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+static void sleep_seconds(double seconds) {
+#ifdef _WIN32
+    Sleep((DWORD)(seconds * 1000.0) + 1);
+#else
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/* Add what the rate gave since the last refill, up to one slice; lock held */
+static void bucket_refill(RateBucket* b, double now) {
+    if (b->rate > 0) {
+        double cap = (double)b->rate * RATE_LIMIT_SLICE_MS / 1000.0;
+        b->tokens += (now - b->stamp) * (double)b->rate;
+        if (b->tokens > cap) b->tokens = cap;
+    }
+    b->stamp = now;
+}
+
+SevenZipRateLimit* sevenzip_rate_limit_create(uint64_t read_bytes_per_sec,
+                                              uint64_t write_bytes_per_sec) {
+    SevenZipRateLimit* limit = (SevenZipRateLimit*)calloc(1, sizeof(SevenZipRateLimit));
+    if (!limit) return NULL;
+    pthread_mutex_init(&limit->lock, NULL);
+    double now = monotonic_seconds();
+    limit->buckets[RATE_LIMIT_READ].rate = read_bytes_per_sec;
+    limit->buckets[RATE_LIMIT_READ].stamp = now;
+    limit->buckets[RATE_LIMIT_WRITE].rate = write_bytes_per_sec;
+    limit->buckets[RATE_LIMIT_WRITE].stamp = now;
+    return limit;
+}
+
+void sevenzip_rate_limit_set(SevenZipRateLimit* limit, uint64_t read_bytes_per_sec,
+                             uint64_t write_bytes_per_sec) {
+    if (!limit) return;
+    pthread_mutex_lock(&limit->lock);
+    double now = monotonic_seconds();
+    for (int i = 0; i < 2; i++) {
+        RateBucket* b = &limit->buckets[i];
+        bucket_refill(b, now);
+        b->rate = i == RATE_LIMIT_READ ? read_bytes_per_sec : write_bytes_per_sec;
+        /* Debt run up under an old rate is not carried into unlimited */
+        if (b->rate == 0) b->tokens = 0.0;
+    }
+    pthread_mutex_unlock(&limit->lock);
+}
+
+void sevenzip_rate_limit_free(SevenZipRateLimit* limit) {
+    if (!limit) return;
+    pthread_mutex_destroy(&limit->lock);
+    free(limit);
+}
+
+void rate_limit_take(SevenZipRateLimit* limit, RateLimitDirection direction, uint64_t bytes,
+                     const SevenZipCancelToken* cancel) {
+    if (!limit || bytes == 0) return;
+    RateBucket* b = &limit->buckets[direction];
+    for (;;) {
+        pthread_mutex_lock(&limit->lock);
+        bucket_refill(b, monotonic_seconds());
+        if (b->rate == 0 || b->tokens >= 0.0) {
+            if (b->rate > 0) b->tokens -= (double)bytes;
+            pthread_mutex_unlock(&limit->lock);
+            return;
+        }
+        double wait = -b->tokens / (double)b->rate;
+        pthread_mutex_unlock(&limit->lock);
+        if (cancel_token_requested(cancel)) return;
+        if (wait > RATE_LIMIT_SLICE_MS / 1000.0) wait = RATE_LIMIT_SLICE_MS / 1000.0;
+        sleep_seconds(wait);
+    }
+}
@@ -0,0 +1,43 @@
+/**
+ * Rate Limit - Internal Header
+ *
+ * The waits of a job's SevenZipRateLimit. Readers take from the READ
+ * bucket before each read, the volume writer from the WRITE bucket before
+ * each write; a bucket that would go below zero holds its taker back
+ * until it refills at the rate. Readers feed prefetch and staging buffers
+ * and the writer drains the write-behind ring, so the encoders go on with
+ * what is buffered while either waits.
+ */
+
+#ifndef SEVENZIP_RATE_LIMIT_H
+#define SEVENZIP_RATE_LIMIT_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest sleep between two looks at the rate and the cancel token; also
+ * the time of budget a bucket holds */
+#define RATE_LIMIT_SLICE_MS 100
+
+typedef enum {
+    RATE_LIMIT_READ = 0,
+    RATE_LIMIT_WRITE = 1
+} RateLimitDirection;
+
+/**
+ * Wait until `bytes` more fit the budget, and take them
+ * Returns early once `cancel` is cancelled. NULL `limit` and a rate of 0
+ * never wait.
+ */
+void rate_limit_take(SevenZipRateLimit* limit, RateLimitDirection direction, uint64_t bytes,
+                     const SevenZipCancelToken* cancel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_RATE_LIMIT_H */
@@ -0,0 +1,100 @@
+/**
+ * Input Access Hints
+ *
+ * posix_fadvise() steers the page cache for read() sources; a mapped
+ * source additionally gets madvise() on the mapping, because pages still
+ * mapped by this process are not released by POSIX_FADV_DONTNEED.
+ * Hint failures are ignored: they only cost speed, never correctness.
+ */
+
+#include "read_hints.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#if !defined(_WIN32) && defined(POSIX_FADV_SEQUENTIAL)
+    #define HAVE_FADVISE 1
+#else
+    #define HAVE_FADVISE 0
+#endif
+
+#if !defined(_WIN32) && defined(MADV_WILLNEED) && defined(MADV_DONTNEED)
+    #define HAVE_MADVISE 1
+#else
+    #define HAVE_MADVISE 0
+#endif
+
+static void hint_range(const ReadHints* h, uint64_t start, uint64_t end, int willneed) {
+    if (end > h->size) end = h->size;
+    if (start >= end) return;
+#if HAVE_MADVISE
+    /* Window multiples keep `start` page aligned within the mapping */
+    if (h->mapping) {
+        madvise((char*)h->mapping + start, (size_t)(end - start),
+                willneed ? MADV_WILLNEED : MADV_DONTNEED);
+    }
+#endif
+#if HAVE_FADVISE
+    if (h->fd >= 0) {
+        posix_fadvise(h->fd, (off_t)start, (off_t)(end - start),
+                      willneed ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+    }
+#else
+    (void)willneed;
+#endif
+}
+
+void read_hints_begin(ReadHints* hints, int fd, const void* mapping, uint64_t size, int enabled) {
+    hints->fd = -1;
+    hints->mapping = NULL;
+    hints->size = size;
+    hints->advised = 0;
+    hints->dropped = 0;
+    if (!enabled || (fd < 0 && !mapping)) return;
+
+    hints->fd = fd;
+    hints->mapping = mapping;
+#if HAVE_FADVISE
+    if (fd >= 0) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    read_hints_advance(hints, 0);
+}
+
+void read_hints_begin_file(ReadHints* hints, FILE* f, uint64_t size, int enabled) {
+#ifdef _WIN32
+    (void)f;
+    read_hints_begin(hints, -1, NULL, size, 0);
+    (void)enabled;
+#else
+    read_hints_begin(hints, f ? fileno(f) : -1, NULL, size, enabled);
+#endif
+}
+
+void read_hints_advance(ReadHints* hints, uint64_t pos) {
+    if (hints->fd < 0 && !hints->mapping) return;
+
+    /* Keep at least one window requested ahead of the cursor */
+    if (hints->advised < hints->size && hints->advised < pos + READ_HINT_WINDOW) {
+        uint64_t target = (pos / READ_HINT_WINDOW + 2) * READ_HINT_WINDOW;
+        hint_range(hints, hints->advised, target, 1);
+        hints->advised = target;
+    }
+
+    /* Drop whole windows the cursor has left behind */
+    uint64_t consumed = pos - pos % READ_HINT_WINDOW;
+    if (consumed > hints->dropped) {
+        hint_range(hints, hints->dropped, consumed, 0);
+        hints->dropped = consumed;
+    }
+}
+
+void read_hints_end(ReadHints* hints) {
+    if (hints->fd < 0 && !hints->mapping) return;
+    hint_range(hints, hints->dropped, hints->size, 0);
+    hints->dropped = hints->size;
+    hints->fd = -1;
+    hints->mapping = NULL;
+}
@@ -0,0 +1,68 @@
+/**
+ * Input Access Hints - Internal Header
+ *
+ * Kernel hints for sources that are read once from start to end: the
+ * region ahead of the read cursor is requested early (WILLNEED) and the
+ * region behind it is dropped from the page cache (DONTNEED), so a large
+ * input streams at device speed without evicting other data. Enabled by
+ * SevenZipStreamOptions.input_access_hints; a no-op where the platform has
+ * no posix_fadvise.
+ */
+
+#ifndef SEVENZIP_READ_HINTS_H
+#define SEVENZIP_READ_HINTS_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* fopen() mode of inputs read once front to back: on Windows "S" opens
+ * them with FILE_FLAG_SEQUENTIAL_SCAN, so the cache reads ahead further */
+#ifdef _WIN32
+    #define READ_HINTS_FOPEN_MODE "rbS"
+#else
+    #define READ_HINTS_FOPEN_MODE "rb"
+#endif
+
+/* Read-ahead distance, and the step in which consumed data is dropped */
+#define READ_HINT_WINDOW (8 * 1024 * 1024)
+
+typedef struct {
+    int fd;               /* -1 = hints off */
+    const void* mapping;  /* File mapping the reads come from (NULL = read()) */
+    uint64_t size;
+    uint64_t advised;     /* WILLNEED has been issued below this offset */
+    uint64_t dropped;     /* DONTNEED has been issued below this offset */
+} ReadHints;
+
+/**
+ * Start hinting a source about to be read sequentially from offset 0
+ * @param hints State to set up (always usable, also when disabled)
+ * @param fd Descriptor of the source (-1 = none)
+ * @param mapping Address of a mapping of the whole file, or NULL
+ * @param size File size
+ * @param enabled 0 turns every call into a no-op
+ */
+void read_hints_begin(ReadHints* hints, int fd, const void* mapping, uint64_t size, int enabled);
+
+/* As read_hints_begin() for a stdio stream */
+void read_hints_begin_file(ReadHints* hints, FILE* f, uint64_t size, int enabled);
+
+/**
+ * Report that everything below `pos` has been consumed
+ * Requests the next window and drops whole windows behind the cursor.
+ */
+void read_hints_advance(ReadHints* hints, uint64_t pos);
+
+/* The source is done: drop what is left of it from the page cache */
+void read_hints_end(ReadHints* hints);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_READ_HINTS_H */
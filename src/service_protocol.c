@@ -0,0 +1,347 @@
+/**
+ * Archive Service Protocol
+ */
+
+/* memfd_create() is only declared by glibc with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "service_protocol.h"
+#include "key_cache.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+    #define SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define SEND_FLAGS 0         /* SO_NOSIGPIPE instead */
+#endif
+
+#define REQUEST_HEADER (16 + SERVICE_ARGS * 8)
+#define REPLY_HEADER 24
+
+void service_socket_setup(int fd) {
+    struct timeval timeout = { SERVICE_IO_TIMEOUT_SEC, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+/* Helper: Send all of `size` bytes */
+static int send_all(int fd, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, SEND_FLAGS);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 1;
+}
+
+/* Helper: Receive exactly `size` bytes */
+static int recv_all(int fd, void* data, size_t size) {
+    unsigned char* p = (unsigned char*)data;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 1;
+}
+
+int service_send_request(int fd, const ServiceRequest* req) {
+    unsigned char header[REQUEST_HEADER];
+    uint32_t words[4] = { SERVICE_MAGIC, SERVICE_VERSION, (uint32_t)req->op, req->count };
+    memcpy(header, words, sizeof(words));
+    memcpy(header + sizeof(words), req->args, sizeof(req->args));
+    if (!send_all(fd, header, sizeof(header))) return 0;
+    for (uint32_t i = 0; i < req->count; i++) {
+        size_t len = req->strings[i] ? strlen(req->strings[i]) : 0;
+        if (len > SERVICE_MAX_STRING) return 0;
+        uint32_t wire = req->strings[i] ? (uint32_t)len : SERVICE_NULL_STRING;
+        if (!send_all(fd, &wire, sizeof(wire)) || !send_all(fd, req->strings[i], len)) return 0;
+    }
+    return 1;
+}
+
+int service_recv_request(int fd, ServiceRequest* req) {
+    memset(req, 0, sizeof(*req));
+    unsigned char header[REQUEST_HEADER];
+    uint32_t words[4];
+    if (!recv_all(fd, header, sizeof(header))) return 0;
+    memcpy(words, header, sizeof(words));
+    if (words[0] != SERVICE_MAGIC || words[1] != SERVICE_VERSION || words[3] > SERVICE_MAX_STRINGS) {
+        return 0;
+    }
+    req->op = (ServiceOp)words[2];
+    memcpy(req->args, header + sizeof(words), sizeof(req->args));
+
+    /* Pointers first, then each string, growing the block as they come */
+    uint32_t count = words[3];
+    size_t used = (size_t)count * sizeof(char*);
+    size_t capacity = used + 256;
+    unsigned char* block = (unsigned char*)mem_alloc(SEVENZIP_MEM_NAMES, capacity);
+    if (!block) return 0;
+    size_t* offsets = (size_t*)mem_alloc(SEVENZIP_MEM_NAMES, (count ? count : 1) * sizeof(size_t));
+    int ok = offsets != NULL;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint32_t len;
+        ok = recv_all(fd, &len, sizeof(len)) && (len == SERVICE_NULL_STRING || len <= SERVICE_MAX_STRING);
+        if (!ok) break;
+        if (len == SERVICE_NULL_STRING) {
+            offsets[i] = 0;
+            continue;
+        }
+        if (used + len + 1 > capacity) {
+            size_t grown_capacity = (used + len + 1) * 2;
+            unsigned char* grown = (unsigned char*)mem_alloc(SEVENZIP_MEM_NAMES, grown_capacity);
+            ok = grown != NULL;
+            if (!ok) break;
+            memcpy(grown, block, used);
+            key_cache_zero(block, used);
+            mem_free(block);
+            block = grown;
+            capacity = grown_capacity;
+        }
+        ok = recv_all(fd, block + used, len);
+        block[used + len] = '\0';
+        offsets[i] = used;
+        used += len + 1;
+    }
+    if (ok) {
+        req->strings = (const char**)block;
+        for (uint32_t i = 0; i < count; i++) {
+            req->strings[i] = offsets[i] ? (const char*)(block + offsets[i]) : NULL;
+        }
+        req->count = count;
+        req->block_size = capacity;
+    } else {
+        key_cache_zero(block, capacity);
+        mem_free(block);
+    }
+    mem_free(offsets);
+    return ok;
+}
+
+void service_request_free(ServiceRequest* req) {
+    if (req->strings) {
+        key_cache_zero((void*)req->strings, req->block_size);
+        mem_free((void*)req->strings);
+    }
+    memset(req, 0, sizeof(*req));
+}
+
+int service_send_reply(int fd, SevenZipErrorCode result, uint64_t size, int data_fd) {
+    unsigned char header[REPLY_HEADER];
+    uint32_t words[4] = { SERVICE_MAGIC, SERVICE_VERSION, (uint32_t)result, 0 };
+    memcpy(header, words, sizeof(words));
+    memcpy(header + sizeof(words), &size, sizeof(size));
+
+    struct iovec iov = { header, sizeof(header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    if (size > 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &data_fd, sizeof(int));
+    }
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &msg, SEND_FLAGS);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)sizeof(header);
+}
+
+int service_recv_reply(int fd, SevenZipErrorCode* result, uint64_t* size, int* data_fd) {
+    *data_fd = -1;
+    unsigned char header[REPLY_HEADER];
+    struct iovec iov = { header, sizeof(header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n;
+    do {
+#ifdef MSG_CMSG_CLOEXEC
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+#else
+        n = recvmsg(fd, &msg, 0);
+#endif
+    } while (n < 0 && errno == EINTR);
+    for (struct cmsghdr* cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL; cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int)) && *data_fd < 0) {
+            memcpy(data_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    /* The descriptor came with the first byte; the rest of the header may trail */
+    if (n <= 0 || (msg.msg_flags & MSG_CTRUNC) ||
+        (n < (ssize_t)sizeof(header) && !recv_all(fd, header + n, sizeof(header) - (size_t)n))) {
+        goto fail;
+    }
+    uint32_t words[4];
+    memcpy(words, header, sizeof(words));
+    memcpy(size, header + sizeof(words), sizeof(*size));
+    if (words[0] != SERVICE_MAGIC || words[1] != SERVICE_VERSION || (*size > 0) != (*data_fd >= 0)) {
+        goto fail;
+    }
+    *result = (SevenZipErrorCode)(int32_t)words[2];
+    return 1;
+
+fail:
+    if (*data_fd >= 0) close(*data_fd);
+    *data_fd = -1;
+    return 0;
+}
+
+int service_shm_create(uint64_t size) {
+    if (size > (uint64_t)INT64_MAX) return -1;
+    int fd;
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    fd = memfd_create("7z-service", MFD_CLOEXEC);
+#else
+    /* A unique name, unlinked at once: only the descriptor reaches the object */
+    static unsigned long counter = 0;
+    char name[64];
+    fd = -1;
+    for (int attempt = 0; fd < 0 && attempt < 16; attempt++) {
+        snprintf(name, sizeof(name), "/7zsv.%lu.%lu", (unsigned long)getpid(),
+                 __sync_fetch_and_add(&counter, 1));
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd >= 0) shm_unlink(name);
+#endif
+    if (fd >= 0 && ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+#else /* _WIN32: no service */
+
+void service_socket_setup(int fd) { (void)fd; }
+int service_send_request(int fd, const ServiceRequest* req) { (void)fd; (void)req; return 0; }
+int service_recv_request(int fd, ServiceRequest* req) { (void)fd; memset(req, 0, sizeof(*req)); return 0; }
+void service_request_free(ServiceRequest* req) { memset(req, 0, sizeof(*req)); }
+int service_send_reply(int fd, SevenZipErrorCode result, uint64_t size, int data_fd) {
+    (void)fd; (void)result; (void)size; (void)data_fd;
+    return 0;
+}
+int service_recv_reply(int fd, SevenZipErrorCode* result, uint64_t* size, int* data_fd) {
+    (void)fd; (void)result; (void)size;
+    *data_fd = -1;
+    return 0;
+}
+int service_shm_create(uint64_t size) { (void)size; return -1; }
+
+#endif
+
+uint64_t service_list_size(const SevenZipList* list) {
+    uint64_t size = 8 + (uint64_t)list->count * SERVICE_LIST_RECORD;
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->entries[i].name) size += strlen(list->entries[i].name) + 1;
+    }
+    return size;
+}
+
+void service_list_encode(const SevenZipList* list, unsigned char* out) {
+    uint64_t count = list->count;
+    memcpy(out, &count, 8);
+    unsigned char* record = out + 8;
+    unsigned char* names = record + (size_t)count * SERVICE_LIST_RECORD;
+    for (size_t i = 0; i < list->count; i++, record += SERVICE_LIST_RECORD) {
+        const SevenZipEntry* e = &list->entries[i];
+        uint32_t is_dir = (uint32_t)e->is_directory;
+        uint32_t len = e->name ? (uint32_t)strlen(e->name) : SERVICE_NULL_STRING;
+        memcpy(record, &e->size, 8);
+        memcpy(record + 8, &e->packed_size, 8);
+        memcpy(record + 16, &e->modified_time, 8);
+        memcpy(record + 24, &e->attributes, 4);
+        memcpy(record + 28, &is_dir, 4);
+        memcpy(record + 32, &len, 4);
+        memset(record + 36, 0, 4);
+        if (e->name) {
+            memcpy(names, e->name, (size_t)len + 1);
+            names += (size_t)len + 1;
+        }
+    }
+}
+
+SevenZipErrorCode service_list_decode(const unsigned char* in, uint64_t size, SevenZipList** list) {
+    uint64_t count;
+    if (size < 8) return SEVENZIP_ERROR_UNKNOWN;
+    memcpy(&count, in, 8);
+    if (count > (size - 8) / SERVICE_LIST_RECORD) return SEVENZIP_ERROR_UNKNOWN;
+    uint64_t names_size = size - 8 - count * SERVICE_LIST_RECORD;
+    size_t header_size = sizeof(SevenZipList) + (size_t)count * sizeof(SevenZipEntry);
+    if (names_size > SIZE_MAX - header_size) return SEVENZIP_ERROR_MEMORY;
+
+    unsigned char* block = (unsigned char*)mem_alloc(SEVENZIP_MEM_NAMES, header_size + (size_t)names_size);
+    if (!block) return SEVENZIP_ERROR_MEMORY;
+    SevenZipList* result = (SevenZipList*)block;
+    result->count = (size_t)count;
+    result->entries = count ? (SevenZipEntry*)(block + sizeof(SevenZipList)) : NULL;
+    char* arena = (char*)(block + header_size);
+    memcpy(arena, in + 8 + count * SERVICE_LIST_RECORD, (size_t)names_size);
+
+    const unsigned char* record = in + 8;
+    uint64_t at = 0;
+    for (size_t i = 0; i < result->count; i++, record += SERVICE_LIST_RECORD) {
+        SevenZipEntry* e = &result->entries[i];
+        uint32_t is_dir, len;
+        memcpy(&e->size, record, 8);
+        memcpy(&e->packed_size, record + 8, 8);
+        memcpy(&e->modified_time, record + 16, 8);
+        memcpy(&e->attributes, record + 24, 4);
+        memcpy(&is_dir, record + 28, 4);
+        memcpy(&len, record + 32, 4);
+        e->is_directory = (int)is_dir;
+        e->name = NULL;
+        if (len == SERVICE_NULL_STRING) continue;
+        if ((uint64_t)len + 1 > names_size - at || arena[at + len] != '\0') {
+            mem_free(block);
+            return SEVENZIP_ERROR_UNKNOWN;
+        }
+        e->name = arena + at;
+        at += (uint64_t)len + 1;
+    }
+    *list = result;
+    return SEVENZIP_OK;
+}
@@ -0,0 +1,107 @@
+/**
+ * Archive Service Protocol - Internal Header
+ *
+ * Messages between sevenzip_service_*() clients and the service. A
+ * connection carries one request and its reply, in host byte order, as
+ * both ends are on one host:
+ *
+ *   request  magic(4) version(4) op(4) string count(4) args(SERVICE_ARGS x 8)
+ *            strings: length(4) bytes, length SERVICE_NULL_STRING for NULL
+ *   reply    magic(4) version(4) result(4) reserved(4) data size(8)
+ *
+ * A reply with data carries the descriptor of a shared memory object of
+ * at least that size (SCM_RIGHTS), mapped by the client instead of the
+ * data going through the socket. A list travels in it as
+ *
+ *   count(8), then per entry size(8) packed size(8) mtime(8)
+ *   attributes(4) is_directory(4) name length(4), then the names, each
+ *   followed by a NUL (an unnamed entry has length SERVICE_NULL_STRING
+ *   and no name)
+ */
+
+#ifndef SEVENZIP_SERVICE_PROTOCOL_H
+#define SEVENZIP_SERVICE_PROTOCOL_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SERVICE_MAGIC 0x76737A37u     /* "7zsv" */
+#define SERVICE_VERSION 1
+#define SERVICE_ARGS 8
+#define SERVICE_NULL_STRING 0xFFFFFFFFu
+#define SERVICE_MAX_STRINGS 65536     /* Per request (inputs of a create) */
+#define SERVICE_MAX_STRING 65536      /* Bytes of one string */
+#define SERVICE_IO_TIMEOUT_SEC 30     /* A peer silent for longer is dropped */
+#define SERVICE_LIST_RECORD 40
+
+typedef enum {
+    SERVICE_OP_CREATE = 1,   /* archive, password, inputs...; level, num_threads, solid */
+    SERVICE_OP_EXTRACT = 2,  /* archive, output dir, password; num_threads, verify, existing,
+                                sparse_output, cache_neutral_output, durability */
+    SERVICE_OP_LIST = 3,     /* archive, password */
+    SERVICE_OP_READ = 4      /* archive, password; entry index */
+} ServiceOp;
+
+typedef struct {
+    ServiceOp op;
+    int64_t args[SERVICE_ARGS];
+    const char** strings;    /* Entries may be NULL */
+    uint32_t count;
+    size_t block_size;       /* Received: bytes of the strings' allocation */
+} ServiceRequest;
+
+/* Apply SERVICE_IO_TIMEOUT_SEC and keep a vanished peer from raising SIGPIPE */
+void service_socket_setup(int fd);
+
+/* @return 1 if the whole request was sent */
+int service_send_request(int fd, const ServiceRequest* req);
+
+/**
+ * Receive a request; its strings are one allocation, freed (and zeroed,
+ * as they may hold a password) by service_request_free()
+ * @return 1 if a well-formed request was received
+ */
+int service_recv_request(int fd, ServiceRequest* req);
+
+void service_request_free(ServiceRequest* req);
+
+/* Send a reply, with `data_fd` attached when size > 0; 1 if sent */
+int service_send_reply(int fd, SevenZipErrorCode result, uint64_t size, int data_fd);
+
+/**
+ * Receive a reply; *data_fd is the attached descriptor (the caller closes
+ * it) or -1, and a reply claiming data without one is not well-formed
+ * @return 1 if a well-formed reply was received
+ */
+int service_recv_reply(int fd, SevenZipErrorCode* result, uint64_t* size, int* data_fd);
+
+/**
+ * Anonymous shared memory object of `size` bytes, never linked into any
+ * file system (memfd on Linux, an unlinked POSIX object elsewhere)
+ * @return Its descriptor, -1 on failure
+ */
+int service_shm_create(uint64_t size);
+
+/* Bytes a list takes in shared memory */
+uint64_t service_list_size(const SevenZipList* list);
+
+/* Write a list of service_list_size() bytes to `out` */
+void service_list_encode(const SevenZipList* list, unsigned char* out);
+
+/**
+ * Rebuild a list from `size` bytes, as one block sevenzip_free_list() frees
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_UNKNOWN if it is not a list,
+ *         SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode service_list_decode(const unsigned char* in, uint64_t size, SevenZipList** list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_SERVICE_PROTOCOL_H */
@@ -0,0 +1,415 @@
+/**
+ * Small File Batches
+ *
+ * The ring is driven with raw system calls, no liburing: a batch is at
+ * most SMALL_BATCH_FILES entries, the size of the submission queue, so
+ * each stage is one submission that waits for all of its completions.
+ * The probe at setup makes sure the kernel has the open, read and close
+ * operations; a read the kernel cut short is finished with pread().
+ *
+ * The Windows port reads each file with one overlapped ReadFile of its
+ * size rounded up to SMALL_BATCH_ALIGN, so FILE_FLAG_NO_BUFFERING can
+ * bypass the cache: slices of the arena start on that alignment too.
+ * Files the volume will not open unbuffered are read buffered the same
+ * way; a file that grew since the scan fills its slice's padding.
+ */
+
+#include "small_file_batch.h"
+#include "mem_alloc.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        /* Headers from 5.6 on, which has open, read, close and the probe */
+        #ifdef IORING_FEAT_CUR_PERSONALITY
+            #define SMALL_BATCH_RING 1
+        #endif
+    #endif
+#endif
+
+#ifdef _WIN32
+    #include <windows.h>
+    /* A multiple of every sector size unbuffered reads must keep to */
+    #define SMALL_BATCH_ALIGN 4096
+#else
+    #define SMALL_BATCH_ALIGN 1
+#endif
+
+/* Arena bytes of a file's slice */
+#define SMALL_BATCH_SLICE(size) (((size) + SMALL_BATCH_ALIGN - 1) & ~(size_t)(SMALL_BATCH_ALIGN - 1))
+
+#ifdef SMALL_BATCH_RING
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+#endif
+
+#ifdef SMALL_BATCH_RING
+
+static int ring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static int ring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Whether the kernel supports every operation a batch uses */
+static int ring_has_ops(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)mem_calloc(SEVENZIP_MEM_OTHER, 1, size);
+    if (!probe) return 0;
+    int ok = ring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    static const Byte ops[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+    for (size_t i = 0; ok && i < sizeof(ops); i++) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    mem_free(probe);
+    return ok;
+}
+
+static void ring_close(SmallFileBatch* b) {
+    if (b->sqes) munmap(b->sqes, b->sqes_size);
+    if (b->cq_ring && b->cq_ring != b->sq_ring) munmap(b->cq_ring, b->cq_ring_size);
+    if (b->sq_ring) munmap(b->sq_ring, b->sq_ring_size);
+    if (b->ring_fd >= 0) close(b->ring_fd);
+    b->sqes = b->cq_ring = b->sq_ring = NULL;
+    b->ring_fd = -1;
+}
+
+/* Set up the ring; b->ring_fd stays -1 if the kernel cannot give one */
+static void ring_open(SmallFileBatch* b) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    b->ring_fd = ring_setup(SMALL_BATCH_FILES, &p);
+    if (b->ring_fd < 0) {
+        b->ring_fd = -1;
+        return;
+    }
+    if (!ring_has_ops(b->ring_fd)) {
+        ring_close(b);
+        return;
+    }
+
+    b->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    b->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (b->cq_ring_size > b->sq_ring_size) b->sq_ring_size = b->cq_ring_size;
+        b->cq_ring_size = b->sq_ring_size;
+    }
+    b->sq_ring = mmap(NULL, b->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      b->ring_fd, IORING_OFF_SQ_RING);
+    if (b->sq_ring == MAP_FAILED) {
+        b->sq_ring = NULL;
+        ring_close(b);
+        return;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        b->cq_ring = b->sq_ring;
+    } else {
+        b->cq_ring = mmap(NULL, b->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          b->ring_fd, IORING_OFF_CQ_RING);
+        if (b->cq_ring == MAP_FAILED) {
+            b->cq_ring = NULL;
+            ring_close(b);
+            return;
+        }
+    }
+    b->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    b->sqes = mmap(NULL, b->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   b->ring_fd, IORING_OFF_SQES);
+    if (b->sqes == MAP_FAILED) {
+        b->sqes = NULL;
+        ring_close(b);
+        return;
+    }
+
+    Byte* sq = (Byte*)b->sq_ring;
+    Byte* cq = (Byte*)b->cq_ring;
+    b->sq_head = (unsigned*)(sq + p.sq_off.head);
+    b->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    b->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    b->sq_array = (unsigned*)(sq + p.sq_off.array);
+    b->cq_head = (unsigned*)(cq + p.cq_off.head);
+    b->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    b->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    b->cqes = cq + p.cq_off.cqes;
+}
+
+/* The next free submission entry, cleared; the queue is empty between stages */
+static struct io_uring_sqe* ring_next_sqe(SmallFileBatch* b, unsigned n) {
+    unsigned tail = *b->sq_tail + n;
+    unsigned index = tail & *b->sq_mask;
+    struct io_uring_sqe* sqe = &((struct io_uring_sqe*)b->sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    b->sq_array[index] = index;
+    return sqe;
+}
+
+/*
+ * Submit the `n` entries filled since the last stage and wait for all of
+ * them; results[user_data] gets each one's result
+ * @return 0 if the ring failed, the results then unknown
+ */
+static int ring_run(SmallFileBatch* b, unsigned n, int* results) {
+    if (n == 0) return 1;
+    __atomic_store_n(b->sq_tail, *b->sq_tail + n, __ATOMIC_RELEASE);
+
+    unsigned submitted = 0;
+    unsigned completed = 0;
+    while (completed < n) {
+        int ret = ring_enter(b->ring_fd, n - submitted, 1);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return 0;
+        }
+        submitted += (unsigned)ret;
+        if (submitted > n) submitted = n;
+
+        unsigned head = *b->cq_head;
+        unsigned tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const struct io_uring_cqe* cqe = &((const struct io_uring_cqe*)b->cqes)[head & *b->cq_mask];
+            results[cqe->user_data] = cqe->res;
+            head++;
+            completed++;
+        }
+        __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 1;
+}
+
+/* Open, read and close the batch through the ring
+ * @return 0 if the ring failed; files it opened are closed */
+static int ring_read(SmallFileBatch* b, SmallFileRead* files, size_t count) {
+    int results[SMALL_BATCH_FILES];
+    unsigned n = 0;
+
+    /* 1. Every open */
+    for (size_t i = 0; i < count; i++) {
+        struct io_uring_sqe* sqe = ring_next_sqe(b, n++);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)files[i].path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = i;
+    }
+    if (!ring_run(b, n, results)) return 0;
+    for (size_t i = 0; i < count; i++) {
+        files[i].fd = results[i] >= 0 ? results[i] : -1;
+        files[i].failed = files[i].fd < 0;
+    }
+
+    /* 2. Every read of an open file with data */
+    n = 0;
+    for (size_t i = 0; i < count; i++) {
+        results[i] = 0;
+        if (files[i].fd < 0 || files[i].size == 0) continue;
+        struct io_uring_sqe* sqe = ring_next_sqe(b, n++);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = files[i].fd;
+        sqe->addr = (uint64_t)(uintptr_t)files[i].data;
+        sqe->len = (unsigned)files[i].size;
+        sqe->off = 0;
+        sqe->user_data = i;
+    }
+    int ok = ring_run(b, n, results);
+    for (size_t i = 0; ok && i < count; i++) {
+        if (files[i].fd < 0 || files[i].size == 0) continue;
+        size_t got = results[i] > 0 ? (size_t)results[i] : 0;
+        /* A read cut short (signals, network file systems) goes on in place */
+        while (results[i] >= 0 && got < files[i].size) {
+            ssize_t r = pread(files[i].fd, files[i].data + got, files[i].size - got, (off_t)got);
+            if (r <= 0) break;
+            got += (size_t)r;
+        }
+        files[i].failed = got != files[i].size;
+    }
+
+    /* 3. Every close */
+    n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (files[i].fd < 0) continue;
+        struct io_uring_sqe* sqe = ring_next_sqe(b, n++);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = files[i].fd;
+        sqe->user_data = i;
+    }
+    if (!ring_run(b, n, results)) {
+        for (size_t i = 0; i < count; i++) {
+            if (files[i].fd >= 0) close(files[i].fd);
+        }
+        ok = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        files[i].fd = -1;
+    }
+    return ok;
+}
+
+#endif /* SMALL_BATCH_RING */
+
+#ifdef _WIN32
+
+typedef struct {
+    OVERLAPPED ov;
+    HANDLE file;
+} PortRequest;
+
+static void port_close(SmallFileBatch* b) {
+    if (b->port) CloseHandle((HANDLE)b->port);
+    mem_free(b->requests);
+    b->port = NULL;
+    b->requests = NULL;
+}
+
+/* Set up the port; b->port stays NULL if the system cannot give one */
+static void port_open(SmallFileBatch* b) {
+    b->requests = mem_calloc(SEVENZIP_MEM_OTHER, SMALL_BATCH_FILES, sizeof(PortRequest));
+    if (!b->requests) return;
+    b->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (!b->port) port_close(b);
+}
+
+/* Open for overlapped reads, unbuffered where the volume allows it */
+static HANDLE port_open_file(const char* path) {
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    DWORD flags = FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN;
+    HANDLE h = CreateFileA(path, GENERIC_READ, share, NULL, OPEN_EXISTING,
+                           flags | FILE_FLAG_NO_BUFFERING, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        h = CreateFileA(path, GENERIC_READ, share, NULL, OPEN_EXISTING, flags, NULL);
+    }
+    return h;
+}
+
+/* Open every file, queue every read, then take the completions
+ * @return 0 if the port failed; every read has ended and every file is closed */
+static int port_read(SmallFileBatch* b, SmallFileRead* files, size_t count) {
+    PortRequest* req = (PortRequest*)b->requests;
+    size_t pending = 0;
+    for (size_t i = 0; i < count; i++) {
+        req[i].file = INVALID_HANDLE_VALUE;
+        HANDLE h = port_open_file(files[i].path);
+        files[i].failed = h == INVALID_HANDLE_VALUE;
+        if (h == INVALID_HANDLE_VALUE || files[i].size == 0) {
+            if (h != INVALID_HANDLE_VALUE) CloseHandle(h);
+            continue;
+        }
+        memset(&req[i].ov, 0, sizeof(req[i].ov));
+        files[i].failed = 1;
+        if (CreateIoCompletionPort(h, (HANDLE)b->port, (ULONG_PTR)i, 0) != (HANDLE)b->port ||
+            (!ReadFile(h, files[i].data, (DWORD)SMALL_BATCH_SLICE(files[i].size), NULL, &req[i].ov) &&
+             GetLastError() != ERROR_IO_PENDING)) {
+            CloseHandle(h);
+            continue;
+        }
+        req[i].file = h;
+        pending++;
+    }
+
+    int ok = 1;
+    while (pending > 0) {
+        DWORD got = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* ov = NULL;
+        BOOL done = GetQueuedCompletionStatus((HANDLE)b->port, &got, &key, &ov, INFINITE);
+        if (!ov) {
+            ok = 0;  /* The port itself failed */
+            break;
+        }
+        pending--;
+        files[key].failed = !done || got < files[key].size;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (req[i].file == INVALID_HANDLE_VALUE) continue;
+        if (!ok) {
+            /* The arena is reused: no read may land in it later */
+            DWORD got = 0;
+            CancelIoEx(req[i].file, &req[i].ov);
+            GetOverlappedResult(req[i].file, &req[i].ov, &got, TRUE);
+        }
+        CloseHandle(req[i].file);
+    }
+    return ok;
+}
+
+#endif /* _WIN32 */
+
+/* One unbuffered read per file */
+static void plain_read(SmallFileRead* files, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        SmallFileRead* file = &files[i];
+        FILE* fp = fopen(file->path, "rb");
+        file->failed = fp == NULL;
+        if (!fp) continue;
+        setvbuf(fp, NULL, _IONBF, 0);
+        file->failed = file->size > 0 && fread(file->data, 1, file->size, fp) != file->size;
+        fclose(fp);
+    }
+}
+
+SRes small_batch_init(SmallFileBatch* b) {
+    memset(b, 0, sizeof(*b));
+    b->ring_fd = -1;
+    b->arena = (Byte*)mem_alloc_aligned(SEVENZIP_MEM_IO_BUFFERS,
+                                        SMALL_BATCH_BYTES + SMALL_BATCH_FILES * (SMALL_BATCH_ALIGN - 1),
+                                        SMALL_BATCH_ALIGN > 64 ? SMALL_BATCH_ALIGN : 64);
+    if (!b->arena) return SZ_ERROR_MEM;
+#ifdef SMALL_BATCH_RING
+    ring_open(b);
+#endif
+#ifdef _WIN32
+    port_open(b);
+#endif
+    return SZ_OK;
+}
+
+void small_batch_free(SmallFileBatch* b) {
+#ifdef SMALL_BATCH_RING
+    ring_close(b);
+#endif
+#ifdef _WIN32
+    port_close(b);
+#endif
+    mem_free(b->arena);
+    memset(b, 0, sizeof(*b));
+    b->ring_fd = -1;
+}
+
+int small_batch_uses_ring(const SmallFileBatch* b) {
+    return b->ring_fd >= 0 || b->port != NULL;
+}
+
+void small_batch_read(SmallFileBatch* b, SmallFileRead* files, size_t count) {
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        files[i].data = b->arena + offset;
+        files[i].fd = -1;
+        offset += SMALL_BATCH_SLICE(files[i].size);
+    }
+#ifdef SMALL_BATCH_RING
+    if (b->ring_fd >= 0) {
+        if (ring_read(b, files, count)) return;
+        ring_close(b);  /* Broken: this batch and the next read plainly */
+    }
+#endif
+#ifdef _WIN32
+    if (b->port) {
+        if (port_read(b, files, count)) return;
+        port_close(b);
+    }
+#endif
+    plain_read(files, count);
+}
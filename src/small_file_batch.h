@@ -0,0 +1,89 @@
+/**
+ * Small File Batches - Internal Header
+ *
+ * A tree of millions of 4-64KB files spends its read phase in per-file
+ * open, read and close latency, one file at a time. The solid reader
+ * thread hands runs of such files to small_batch_read() instead, which
+ * reads a whole run at once: on Linux through an io_uring, every open of
+ * the run submitted together, then every read, then every close, so up to
+ * SMALL_BATCH_FILES files are in flight; on Windows through a completion
+ * port, every file opened for overlapped unbuffered reads and all of its
+ * reads queued before the first completion is taken; elsewhere, or on
+ * kernels without the ring or its open/read/close operations, one
+ * unbuffered read per file. Contents land in an arena of SMALL_BATCH_BYTES.
+ */
+
+#ifndef SEVENZIP_SMALL_FILE_BATCH_H
+#define SEVENZIP_SMALL_FILE_BATCH_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Files at most this large are read in batches */
+#define SMALL_FILE_MAX (64 * 1024)
+
+/* Files of one batch, and entries of the ring */
+#define SMALL_BATCH_FILES 256
+
+/* Arena for the contents of one batch */
+#define SMALL_BATCH_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+    const char* path;
+    size_t size;     /* Bytes to read, the size the scan found */
+    Byte* data;      /* `size` bytes in the arena, set by small_batch_read() */
+    int fd;          /* Ring only, -1 when not open */
+    int failed;      /* Not opened, or fewer than `size` bytes read */
+} SmallFileRead;
+
+typedef struct {
+    int ring_fd;     /* -1 = plain reads */
+    void* sq_ring;
+    void* cq_ring;
+    void* sqes;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    void* cqes;
+    void* port;      /* Windows: completion port, NULL = plain reads */
+    void* requests;  /* Windows: SMALL_BATCH_FILES overlapped requests */
+    Byte* arena;
+} SmallFileBatch;
+
+/**
+ * Allocate the arena and set up the ring or completion port where the
+ * system has one
+ * @return SZ_OK, or SZ_ERROR_MEM without the arena
+ */
+SRes small_batch_init(SmallFileBatch* b);
+
+void small_batch_free(SmallFileBatch* b);
+
+/* 1 when batches go through io_uring or a completion port */
+int small_batch_uses_ring(const SmallFileBatch* b);
+
+/**
+ * Read `count` files (at most SMALL_BATCH_FILES, SMALL_BATCH_BYTES in all)
+ * into the arena; each one's `data` and `failed` are set, and nothing of
+ * the batch stays open. The contents stay until the next call.
+ */
+void small_batch_read(SmallFileBatch* b, SmallFileRead* files, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_SMALL_FILE_BATCH_H */
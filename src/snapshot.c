@@ -0,0 +1,158 @@
+/**
+ * Input Snapshot
+ */
+
+#include "snapshot.h"
+#include "mem_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_MAGIC "7z-ffi snapshot 1\n"
+
+static size_t name_hash(const char* name) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h = (h ^ *p) * 1099511628211ULL;
+    }
+    return (size_t)h;
+}
+
+static SnapshotEntry* find_slot(SnapshotEntry* slots, size_t capacity, const char* name) {
+    size_t mask = capacity - 1;
+    size_t i = name_hash(name) & mask;
+    while (slots[i].name && strcmp(slots[i].name, name) != 0) i = (i + 1) & mask;
+    return &slots[i];
+}
+
+void snapshot_init(Snapshot* snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+void snapshot_free(Snapshot* snapshot) {
+    mem_free(snapshot->slots);
+    mem_free(snapshot->data);
+    snapshot_init(snapshot);
+}
+
+/* Helper: Decimal number followed by a space; 0 if there is none */
+static int parse_number(char** p, char* end, uint64_t* value) {
+    char* s = *p;
+    if (s >= end || *s < '0' || *s > '9') return 0;
+    uint64_t v = 0;
+    while (s < end && *s >= '0' && *s <= '9') {
+        uint64_t digit = (uint64_t)(*s++ - '0');
+        if (v > (UINT64_MAX - digit) / 10) return 0;
+        v = v * 10 + digit;
+    }
+    if (s >= end || *s != ' ') return 0;
+    *value = v;
+    *p = s + 1;
+    return 1;
+}
+
+/* Helper: Unescape the name at *p up to the end of the line, in place */
+static char* parse_name(char** p, char* end) {
+    char* name = *p;
+    char* out = name;
+    char* s = name;
+    while (s < end && *s != '\n') {
+        if (*s == '\\' && s + 1 < end && (s[1] == '\\' || s[1] == 'n')) {
+            *out++ = s[1] == 'n' ? '\n' : '\\';
+            s += 2;
+        } else {
+            *out++ = *s++;
+        }
+    }
+    if (s >= end) return NULL;
+    *out = '\0';
+    *p = s + 1;
+    return name;
+}
+
+SevenZipErrorCode snapshot_load(Snapshot* snapshot, const char* path) {
+    snapshot_init(snapshot);
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return SEVENZIP_OK;
+    }
+    char* data = NULL;
+    size_t size = 0;
+    int read_ok = 0;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long end = ftell(f);
+        if (end >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+            size = (size_t)end;
+            data = (char*)mem_alloc(SEVENZIP_MEM_NAMES, size + 1);
+            read_ok = data && fread(data, 1, size, f) == size;
+        }
+    }
+    fclose(f);
+    if (!data) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    snapshot->data = data;
+    
+    size_t magic_len = strlen(SNAPSHOT_MAGIC);
+    if (!read_ok || size < magic_len || memcmp(data, SNAPSHOT_MAGIC, magic_len) != 0) {
+        fprintf(stderr, "Not a snapshot: %s\n", path);
+        snapshot_free(snapshot);
+        return SEVENZIP_ERROR_INVALID_ARCHIVE;
+    }
+    
+    /* Every line takes at least 7 bytes, which bounds the table */
+    char* end = data + size;
+    size_t lines = (size - magic_len) / 7 + 1;
+    size_t capacity = 16;
+    while (capacity < lines * 2) capacity *= 2;
+    snapshot->slots = (SnapshotEntry*)mem_calloc(SEVENZIP_MEM_HEADER, capacity, sizeof(SnapshotEntry));
+    if (!snapshot->slots) {
+        snapshot_free(snapshot);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    snapshot->capacity = capacity;
+    
+    char* p = data + magic_len;
+    while (p < end) {
+        SnapshotEntry entry;
+        if (!parse_number(&p, end, &entry.size) || !parse_number(&p, end, &entry.mtime) ||
+            !parse_number(&p, end, &entry.inode) || !(entry.name = parse_name(&p, end))) {
+            fprintf(stderr, "Damaged snapshot: %s\n", path);
+            snapshot_free(snapshot);
+            return SEVENZIP_ERROR_INVALID_ARCHIVE;
+        }
+        SnapshotEntry* slot = find_slot(snapshot->slots, capacity, entry.name);
+        if (!slot->name) snapshot->count++;
+        *slot = entry;
+    }
+    return SEVENZIP_OK;
+}
+
+int snapshot_unchanged(const Snapshot* snapshot, const SnapshotEntry* entry) {
+    if (snapshot->count == 0) return 0;
+    const SnapshotEntry* slot = find_slot(snapshot->slots, snapshot->capacity, entry->name);
+    return slot->name && slot->size == entry->size && slot->mtime == entry->mtime &&
+           slot->inode == entry->inode;
+}
+
+FILE* snapshot_write_begin(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f) fputs(SNAPSHOT_MAGIC, f);
+    return f;
+}
+
+void snapshot_write_entry(FILE* f, const SnapshotEntry* entry) {
+    fprintf(f, "%llu %llu %llu ", (unsigned long long)entry->size,
+            (unsigned long long)entry->mtime, (unsigned long long)entry->inode);
+    for (const char* c = entry->name; *c; c++) {
+        if (*c == '\\') fputs("\\\\", f);
+        else if (*c == '\n') fputs("\\n", f);
+        else fputc(*c, f);
+    }
+    fputc('\n', f);
+}
+
+int snapshot_write_end(FILE* f) {
+    int ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
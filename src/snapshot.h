@@ -0,0 +1,67 @@
+/**
+ * Input Snapshot - Internal Header
+ *
+ * Name, size, modification time and inode of every input of a create
+ * job, saved next to a backup so the next run can leave out the files
+ * that have not changed without reading them. The file is text:
+ *
+ *   7z-ffi snapshot 1
+ *   <size> <mtime> <inode> <name>
+ *
+ * with the FILETIME mtime and the inode (0 where the platform has none)
+ * in decimal, and backslash and newline in names escaped as \\ and \n.
+ */
+
+#ifndef SEVENZIP_SNAPSHOT_H
+#define SEVENZIP_SNAPSHOT_H
+
+#include "../include/7z_ffi.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char* name;
+    uint64_t size;
+    uint64_t mtime;   /* FILETIME */
+    uint64_t inode;   /* 0 = unknown */
+} SnapshotEntry;
+
+typedef struct {
+    SnapshotEntry* slots;  /* Open addressing on FNV-1a of the name, name NULL = empty */
+    size_t capacity;       /* Power of two */
+    size_t count;
+    char* data;            /* The file's text, names unescaped in place */
+} Snapshot;
+
+void snapshot_init(Snapshot* snapshot);
+void snapshot_free(Snapshot* snapshot);
+
+/**
+ * Read a snapshot written by snapshot_write_*()
+ * A missing file loads as an empty snapshot, in which every input counts
+ * as changed, so the first run of a backup needs no special case.
+ * @return SEVENZIP_OK, SEVENZIP_ERROR_INVALID_ARCHIVE if the file is not
+ *         a snapshot, SEVENZIP_ERROR_MEMORY
+ */
+SevenZipErrorCode snapshot_load(Snapshot* snapshot, const char* path);
+
+/* 1 if the snapshot has `entry` with the same size, mtime and inode */
+int snapshot_unchanged(const Snapshot* snapshot, const SnapshotEntry* entry);
+
+/* Start a snapshot file (NULL if it cannot be created) */
+FILE* snapshot_write_begin(const char* path);
+void snapshot_write_entry(FILE* f, const SnapshotEntry* entry);
+
+/* Close the file; 0 if anything failed to be written */
+int snapshot_write_end(FILE* f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_SNAPSHOT_H */
@@ -0,0 +1,131 @@
+/**
+ * Sparse Input
+ *
+ * lseek(SEEK_DATA/SEEK_HOLE) moves the descriptor's offset under stdio,
+ * so each lookup puts it back where the stream left it. A failed lookup
+ * (a filesystem without the queries, a file that changed) ends the
+ * sparse reads: what is left is read as data.
+ */
+
+/* SEEK_DATA and SEEK_HOLE are only declared with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "sparse_input.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <winioctl.h>
+    #include <io.h>
+    #define FSEEK64 _fseeki64
+#else
+    #include <errno.h>
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #define FSEEK64 fseeko
+#endif
+
+#if defined(_WIN32) || (defined(SEEK_DATA) && defined(SEEK_HOLE))
+    #define HAVE_EXTENT_QUERY 1
+#else
+    #define HAVE_EXTENT_QUERY 0
+#endif
+
+/* The extent at in->pos; 0 when it cannot be told */
+static int sparse_find_extent(SparseInput* in) {
+#if defined(_WIN32)
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(in->file));
+    FILE_ALLOCATED_RANGE_BUFFER query, range;
+    query.FileOffset.QuadPart = (LONGLONG)in->pos;
+    query.Length.QuadPart = (LONGLONG)(in->size - in->pos);
+    DWORD got = 0;
+    if (!DeviceIoControl(h, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+                         &range, sizeof(range), &got, NULL) &&
+        GetLastError() != ERROR_MORE_DATA) {
+        return 0;
+    }
+    if (got < sizeof(range)) {
+        in->extent_hole = 1;
+        in->extent_end = in->size;
+    } else if ((uint64_t)range.FileOffset.QuadPart > in->pos) {
+        in->extent_hole = 1;
+        in->extent_end = (uint64_t)range.FileOffset.QuadPart;
+    } else {
+        in->extent_hole = 0;
+        in->extent_end = (uint64_t)range.FileOffset.QuadPart + (uint64_t)range.Length.QuadPart;
+    }
+#elif HAVE_EXTENT_QUERY
+    int fd = fileno(in->file);
+    off_t saved = lseek(fd, 0, SEEK_CUR);
+    if (saved < 0) return 0;
+    off_t data = lseek(fd, (off_t)in->pos, SEEK_DATA);
+    int ok = 1;
+    if (data < 0) {
+        /* ENXIO: no data after pos, the rest is a hole */
+        ok = errno == ENXIO;
+        in->extent_hole = 1;
+        in->extent_end = in->size;
+    } else if ((uint64_t)data > in->pos) {
+        in->extent_hole = 1;
+        in->extent_end = (uint64_t)data;
+    } else {
+        off_t hole = lseek(fd, (off_t)in->pos, SEEK_HOLE);
+        ok = hole >= 0;
+        in->extent_hole = 0;
+        in->extent_end = (uint64_t)hole;
+    }
+    if (lseek(fd, saved, SEEK_SET) != saved) return 0;
+    if (!ok) return 0;
+#else
+    return 0;
+#endif
+    if (in->extent_end > in->size) in->extent_end = in->size;
+    return in->extent_end > in->pos;
+}
+
+void sparse_input_begin(SparseInput* in, FILE* file, uint64_t size, uint64_t offset, int sparse) {
+    memset(in, 0, sizeof(*in));
+    in->file = file;
+    in->size = size;
+    in->pos = offset;
+    in->stream_pos = offset;
+    in->extent_end = offset;
+    /* Fully allocated files (the common case) need no lookups; the scan's
+     * stat already told, so there is none here either */
+#if HAVE_EXTENT_QUERY
+    in->sparse = sparse;
+#else
+    (void)sparse;
+#endif
+}
+
+size_t sparse_input_read(SparseInput* in, void* out, size_t size) {
+    if (!in->sparse) return fread(out, 1, size, in->file);
+    if (in->pos >= in->size) return 0;
+
+    if (in->pos >= in->extent_end && !sparse_find_extent(in)) {
+        in->sparse = 0;
+        if (in->stream_pos != in->pos && FSEEK64(in->file, (int64_t)in->pos, SEEK_SET) != 0) return 0;
+        return fread(out, 1, size, in->file);
+    }
+    uint64_t left = in->extent_end - in->pos;
+    if (size > left) size = (size_t)left;
+
+    if (in->extent_hole) {
+        memset(out, 0, size);
+        in->pos += size;
+        return size;
+    }
+    if (in->stream_pos != in->pos) {
+        if (FSEEK64(in->file, (int64_t)in->pos, SEEK_SET) != 0) return 0;
+        in->stream_pos = in->pos;
+    }
+    size_t got = fread(out, 1, size, in->file);
+    in->pos += got;
+    in->stream_pos += got;
+    return got;
+}
@@ -0,0 +1,52 @@
+/**
+ * Sparse Input - Internal Header
+ *
+ * Reads a source file without reading its holes. A file with fewer
+ * allocated blocks than its size (Windows: marked sparse) has its extents
+ * looked up with SEEK_DATA/SEEK_HOLE (FSCTL_QUERY_ALLOCATED_RANGES), one
+ * lookup per extent; hole ranges are handed out as zeros and the stream
+ * is positioned past them, so a thin-provisioned disk costs the reads of
+ * its allocated extents. Other files, and filesystems without extent
+ * queries, are read as before.
+ */
+
+#ifndef SEVENZIP_SPARSE_INPUT_H
+#define SEVENZIP_SPARSE_INPUT_H
+
+#include "../include/7z_ffi.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    FILE* file;
+    int sparse;           /* 0 = holes are read like data */
+    uint64_t size;
+    uint64_t pos;         /* Offset of the next byte handed out */
+    uint64_t stream_pos;  /* Offset `file` is positioned at */
+    uint64_t extent_end;  /* [pos, extent_end) is one data or hole extent */
+    int extent_hole;
+} SparseInput;
+
+/**
+ * Start reading `file` of `size` bytes, positioned at `offset`, sequentially
+ * @param sparse What the scan found: 0 = fully allocated (Windows: not
+ *               marked sparse), read without lookups
+ */
+void sparse_input_begin(SparseInput* in, FILE* file, uint64_t size, uint64_t offset, int sparse);
+
+/**
+ * fread() for the sparse source: up to `size` bytes at the cursor
+ * @return Bytes stored at out (0 at the end of the file or on error)
+ */
+size_t sparse_input_read(SparseInput* in, void* out, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_SPARSE_INPUT_H */
@@ -0,0 +1,118 @@
+/**
+ * Sparse Output
+ *
+ * Runs of non-zero blocks go out in one fwrite; the stream is positioned
+ * only when the previous block was skipped. The zero check ORs 64 bytes
+ * at a time and stops at the first chunk with a set bit, so data that is
+ * not zero costs little more than one load.
+ */
+
+#include "sparse_output.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SPARSE_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define SPARSE_USE_NEON 1
+#endif
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <winioctl.h>
+    #include <io.h>
+    #define FSEEK64 _fseeki64
+    #define TRUNCATE_FILE(f, len) _chsize_s(_fileno(f), (__int64)(len))
+#else
+    #include <unistd.h>
+    #include <sys/types.h>
+    #define FSEEK64 fseeko
+    #define TRUNCATE_FILE(f, len) ftruncate(fileno(f), (off_t)(len))
+#endif
+
+int sparse_is_zero(const Byte* data, size_t size) {
+    size_t i = 0;
+#if defined(SPARSE_USE_SSE2)
+    for (; i + 64 <= size; i += 64) {
+        __m128i acc = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + i)),
+                         _mm_loadu_si128((const __m128i*)(data + i + 16))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + i + 32)),
+                         _mm_loadu_si128((const __m128i*)(data + i + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) return 0;
+    }
+#elif defined(SPARSE_USE_NEON)
+    for (; i + 64 <= size; i += 64) {
+        uint8x16_t acc = vorrq_u8(vorrq_u8(vld1q_u8(data + i), vld1q_u8(data + i + 16)),
+                                  vorrq_u8(vld1q_u8(data + i + 32), vld1q_u8(data + i + 48)));
+        uint64x2_t wide = vreinterpretq_u64_u8(acc);
+        if ((vgetq_lane_u64(wide, 0) | vgetq_lane_u64(wide, 1)) != 0) return 0;
+    }
+#else
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        if (v != 0) return 0;
+    }
+#endif
+    for (; i < size; i++) {
+        if (data[i] != 0) return 0;
+    }
+    return 1;
+}
+
+void sparse_output_begin(SparseOutput* s, FILE* file) {
+    s->pos = 0;
+    s->behind = 0;
+#ifdef _WIN32
+    /* NTFS allocates skipped ranges of files not marked sparse */
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(file));
+    DWORD returned = 0;
+    if (h != INVALID_HANDLE_VALUE) {
+        DeviceIoControl(h, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL);
+    }
+#else
+    (void)file;
+#endif
+}
+
+int sparse_output_write(SparseOutput* s, FILE* file, const Byte* data, size_t size) {
+    while (size > 0) {
+        /* Up to the next block boundary of the file */
+        size_t n = SPARSE_BLOCK_SIZE - (size_t)(s->pos % SPARSE_BLOCK_SIZE);
+        if (n > size) n = size;
+        if (sparse_is_zero(data, n)) {
+            s->pos += n;
+            s->behind = 1;
+            data += n;
+            size -= n;
+            continue;
+        }
+
+        /* This block and the non-zero blocks right after it */
+        size_t run = n;
+        while (run < size) {
+            size_t next = size - run < SPARSE_BLOCK_SIZE ? size - run : SPARSE_BLOCK_SIZE;
+            if (sparse_is_zero(data + run, next)) break;
+            run += next;
+        }
+        if (s->behind) {
+            if (FSEEK64(file, (int64_t)s->pos, SEEK_SET) != 0) return 0;
+            s->behind = 0;
+        }
+        if (fwrite(data, 1, run, file) != run) return 0;
+        s->pos += run;
+        data += run;
+        size -= run;
+    }
+    return 1;
+}
+
+int sparse_output_end(SparseOutput* s, FILE* file) {
+    if (!s->behind) return 1;
+    if (fflush(file) != 0) return 0;
+    s->behind = 0;
+    return TRUNCATE_FILE(file, s->pos) == 0;
+}
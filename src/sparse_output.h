@@ -0,0 +1,57 @@
+/**
+ * Sparse Output - Internal Header
+ *
+ * Writes an extracted file without its all-zero blocks. Decoded data is
+ * cut at SPARSE_BLOCK_SIZE boundaries of the file offset; a block that is
+ * all zeros is seeked over instead of written, so the filesystem leaves a
+ * hole (ext4, XFS, APFS; NTFS once the file is marked sparse). A file
+ * ending in zeros gets its size from a final truncate. Zero runs leave
+ * holes only where they cover whole filesystem blocks; what is skipped
+ * reads back as zeros either way.
+ */
+
+#ifndef SEVENZIP_SPARSE_OUTPUT_H
+#define SEVENZIP_SPARSE_OUTPUT_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Zero check and hole granularity (the common filesystem block) */
+#define SPARSE_BLOCK_SIZE 4096
+
+typedef struct {
+    uint64_t pos;  /* Bytes of the file produced so far */
+    int behind;    /* Zeros were skipped: the stream position is short of pos */
+} SparseOutput;
+
+/* 1 if all `size` bytes are zero (vectorized on SSE2/NEON) */
+int sparse_is_zero(const Byte* data, size_t size);
+
+/* Start writing a freshly created, empty file (marks it sparse on Windows) */
+void sparse_output_begin(SparseOutput* s, FILE* file);
+
+/**
+ * Append `size` bytes, seeking over all-zero blocks
+ * @return 1 on success, 0 if a seek or write failed
+ */
+int sparse_output_write(SparseOutput* s, FILE* file, const Byte* data, size_t size);
+
+/**
+ * Flush and set the file size when it ends in skipped zeros; call before
+ * metadata is restored and the file is closed
+ * @return 1 on success, 0 if the flush or truncate failed
+ */
+int sparse_output_end(SparseOutput* s, FILE* file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_SPARSE_OUTPUT_H */
@@ -0,0 +1,353 @@
+/**
+ * Streaming Compression
+ *
+ * .lzma and LZMA2 streams fed and drained a piece at a time. The SDK
+ * encoders pull their input through an ISeqInStream until it ends, so the
+ * encoder runs as a stream pump job (stream_pump.h) behind 1MB rings. The
+ * decoders are incremental already and run on the calling thread, from
+ * the caller's input into the caller's output.
+ */
+
+#include "../include/7z_ffi.h"
+#include "LzmaEnc.h"
+#include "LzmaDec.h"
+#include "Lzma2Enc.h"
+#include "Lzma2Dec.h"
+#include "mem_alloc.h"
+#include "lzma_params.h"
+#include "buffer_codec.h"
+#include "stream_pump.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+#include "thread_placement.h"
+
+#include <string.h>
+
+#define LZMA_PROPS_SIZE 5
+#define LZMA_HEADER_SIZE 13           // 5 bytes props + 8 bytes uncompressed size
+#define STREAM_RING_SIZE (1 << 20)    // Each of the encoder's input and output rings
+#define UNKNOWN_SIZE ((UInt64)(Int64)-1)
+
+static int stream_format(SevenZipBufferFormat format) {
+    return format == SEVENZIP_BUFFER_LZMA || format == SEVENZIP_BUFFER_LZMA2;
+}
+
+/* ============================================================================
+ * Encoder
+ * ============================================================================ */
+
+struct SevenZipEncoder {
+    StreamPump* pump;
+    SevenZipBufferFormat format;
+    SevenZipCompressionLevel level;
+    SevenZipBufferOptions options;
+    SevenZipLzmaParams lzma_params;   /* Copy behind options.lzma_params */
+    int finishing;
+};
+
+/* The input ring as the encoder's input stream */
+typedef struct {
+    ISeqInStream vt;
+    StreamPump* pump;
+} PumpInStream;
+
+static SRes PumpInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    PumpInStream* p = Z7_CONTAINER_FROM_VTBL(pp, PumpInStream, vt);
+    *size = stream_pump_read(p->pump, buf, *size);
+    return SZ_OK;
+}
+
+/* The output ring as the encoder's output stream */
+typedef struct {
+    ISeqOutStream vt;
+    StreamPump* pump;
+} PumpOutStream;
+
+static size_t PumpOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    PumpOutStream* p = Z7_CONTAINER_FROM_VTBL(pp, PumpOutStream, vt);
+    return stream_pump_write(p->pump, data, size) ? size : 0;
+}
+
+static SevenZipErrorCode encode_error(SRes res) {
+    if (res == SZ_ERROR_MEM) return SEVENZIP_ERROR_MEMORY;
+    if (res == SZ_ERROR_PARAM) return SEVENZIP_ERROR_INVALID_PARAM;
+    return SEVENZIP_ERROR_COMPRESS;
+}
+
+/* .lzma: header with the size unknown, then the stream and its end marker */
+static SRes encode_lzma_stream(const SevenZipEncoder* enc, PumpInStream* in, PumpOutStream* out) {
+    ThreadPlacer placer;
+    int placed = thread_placer_init(&placer, SEVENZIP_NUMA_OFF);
+    ISzAllocPtr alloc = placed ? &placer.small : &g_MemEncoderAlloc;
+    ISzAllocPtr alloc_big = placed ? &placer.big : &g_MemMatchFinderAlloc;
+    CLzmaEncHandle encoder = LzmaEnc_Create(alloc);
+    if (!encoder) return SZ_ERROR_MEM;
+
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    buffer_codec_lzma_props(&props, enc->level, UNKNOWN_SIZE);
+    sevenzip_lzma_params_apply(enc->options.lzma_params, &props);
+    props.writeEndMark = 1;
+
+    ThreadLease lease;
+    props.numThreads = thread_lease_acquire(&lease, buffer_codec_threads(&enc->options) > 1 ? 2 : 1, 0);
+    LzmaEncProps_Normalize(&props);
+
+    Byte header[LZMA_HEADER_SIZE];
+    SizeT props_size = LZMA_PROPS_SIZE;
+    memset(header + LZMA_PROPS_SIZE, 0xFF, LZMA_HEADER_SIZE - LZMA_PROPS_SIZE);
+    SRes res = LzmaEnc_SetProps(encoder, &props);
+    if (res == SZ_OK) res = LzmaEnc_WriteProperties(encoder, header, &props_size);
+    if (res == SZ_OK && !stream_pump_write(out->pump, header, LZMA_HEADER_SIZE)) {
+        res = SZ_ERROR_WRITE;
+    }
+    if (res == SZ_OK) res = LzmaEnc_Encode(encoder, &out->vt, &in->vt, NULL, alloc, alloc_big);
+    LzmaEnc_Destroy(encoder, alloc, alloc_big);
+    thread_lease_release(&lease);
+    return res;
+}
+
+/* LZMA2: property byte, then the stream */
+static SRes encode_lzma2_stream(const SevenZipEncoder* enc, PumpInStream* in, PumpOutStream* out) {
+    ThreadPlacer placer;
+    CLzma2EncHandle encoder = thread_placer_init(&placer, SEVENZIP_NUMA_OFF)
+        ? Lzma2Enc_Create(&placer.small, &placer.big)
+        : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    if (!encoder) return SZ_ERROR_MEM;
+
+    CLzma2EncProps props;
+    Lzma2EncProps_Init(&props);
+    buffer_codec_lzma_props(&props.lzmaProps, enc->level, UNKNOWN_SIZE);
+    sevenzip_lzma_params_apply(enc->options.lzma_params, &props.lzmaProps);
+
+    ThreadLease lease;
+    props.numTotalThreads = thread_lease_acquire(&lease, buffer_codec_threads(&enc->options), 0);
+    Lzma2EncProps_Normalize(&props);
+
+    SRes res = Lzma2Enc_SetProps(encoder, &props);
+    if (res == SZ_OK) {
+        Byte prop = Lzma2Enc_WriteProperties(encoder);
+        if (!stream_pump_write(out->pump, &prop, 1)) res = SZ_ERROR_WRITE;
+    }
+    if (res == SZ_OK) res = Lzma2Enc_Encode2(encoder, &out->vt, NULL, NULL, &in->vt, NULL, 0, NULL);
+    Lzma2Enc_Destroy(encoder);
+    thread_lease_release(&lease);
+    return res;
+}
+
+static SevenZipErrorCode encoder_job(StreamPump* pump, void* arg) {
+    const SevenZipEncoder* enc = (const SevenZipEncoder*)arg;
+    PumpInStream in = { { PumpInStream_Read }, pump };
+    PumpOutStream out = { { PumpOutStream_Write }, pump };
+    SRes res = enc->format == SEVENZIP_BUFFER_LZMA
+        ? encode_lzma_stream(enc, &in, &out)
+        : encode_lzma2_stream(enc, &in, &out);
+    return res == SZ_OK ? SEVENZIP_OK : encode_error(res);
+}
+
+SevenZipErrorCode sevenzip_encoder_create(
+    SevenZipBufferFormat format,
+    SevenZipCompressionLevel level,
+    const SevenZipBufferOptions* options,
+    SevenZipEncoder** encoder
+) {
+    if (!encoder) return SEVENZIP_ERROR_INVALID_PARAM;
+    *encoder = NULL;
+    if (!stream_format(format)) return SEVENZIP_ERROR_INVALID_PARAM;
+
+    SevenZipEncoder* enc = (SevenZipEncoder*)mem_alloc(SEVENZIP_MEM_OTHER, sizeof(SevenZipEncoder));
+    if (!enc) return SEVENZIP_ERROR_MEMORY;
+    memset(enc, 0, sizeof(*enc));
+    enc->format = format;
+    enc->level = level;
+    if (options) {
+        enc->options = *options;
+    } else {
+        sevenzip_buffer_options_init(&enc->options);
+    }
+    enc->options.entry_name = NULL;
+    if (enc->options.lzma_params) {
+        enc->lzma_params = *enc->options.lzma_params;
+        enc->options.lzma_params = &enc->lzma_params;
+    }
+
+    enc->pump = stream_pump_start(STREAM_RING_SIZE, STREAM_RING_SIZE, encoder_job, enc);
+    if (!enc->pump) {
+        mem_free(enc);
+        return SEVENZIP_ERROR_MEMORY;
+    }
+    *encoder = enc;
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_encoder_update(
+    SevenZipEncoder* encoder,
+    const void* input,
+    size_t* input_size,
+    void* output,
+    size_t* output_size
+) {
+    if (!encoder || !input_size || !output_size ||
+        (!input && *input_size) || (!output && *output_size)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    if (encoder->finishing && *input_size) return SEVENZIP_ERROR_INVALID_PARAM;
+    return stream_pump_exchange(encoder->pump, input, input_size, output, output_size, 0, NULL);
+}
+
+SevenZipErrorCode sevenzip_encoder_finish(
+    SevenZipEncoder* encoder,
+    void* output,
+    size_t* output_size,
+    int* finished
+) {
+    if (!encoder || !output_size || !finished || (!output && *output_size)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    encoder->finishing = 1;
+    return stream_pump_exchange(encoder->pump, NULL, NULL, output, output_size, 1, finished);
+}
+
+void sevenzip_encoder_free(SevenZipEncoder* encoder) {
+    if (!encoder) return;
+    stream_pump_end(encoder->pump);
+    mem_free(encoder);
+}
+
+/* ============================================================================
+ * Decoder
+ * ============================================================================ */
+
+struct SevenZipDecoder {
+    SevenZipBufferFormat format;
+    Byte header[LZMA_HEADER_SIZE];
+    size_t header_size;               /* Header bytes collected so far */
+    int started;                      /* Header parsed, decoder allocated */
+    int finished;
+    UInt64 remaining;                 /* .lzma: bytes still to come, or UNKNOWN_SIZE */
+    CLzmaDec lzma;
+    CLzma2Dec lzma2;
+};
+
+static SevenZipErrorCode decode_error(SRes res) {
+    return res == SZ_ERROR_MEM ? SEVENZIP_ERROR_MEMORY : SEVENZIP_ERROR_EXTRACT;
+}
+
+static size_t header_length(const SevenZipDecoder* dec) {
+    return dec->format == SEVENZIP_BUFFER_LZMA ? LZMA_HEADER_SIZE : 1;
+}
+
+static SRes decoder_start(SevenZipDecoder* dec) {
+    if (dec->format == SEVENZIP_BUFFER_LZMA2) {
+        SRes res = Lzma2Dec_Allocate(&dec->lzma2, dec->header[0], &g_MemDecoderAlloc);
+        if (res == SZ_OK) Lzma2Dec_Init(&dec->lzma2);
+        return res;
+    }
+    dec->remaining = 0;
+    for (int i = 0; i < 8; i++) {
+        dec->remaining |= ((UInt64)dec->header[LZMA_PROPS_SIZE + i]) << (i * 8);
+    }
+    SRes res = LzmaDec_Allocate(&dec->lzma, dec->header, LZMA_PROPS_SIZE, &g_MemDecoderAlloc);
+    if (res == SZ_OK) {
+        LzmaDec_Init(&dec->lzma);
+        dec->finished = dec->remaining == 0;
+    }
+    return res;
+}
+
+SevenZipErrorCode sevenzip_decoder_create(
+    SevenZipBufferFormat format,
+    SevenZipDecoder** decoder
+) {
+    if (!decoder) return SEVENZIP_ERROR_INVALID_PARAM;
+    *decoder = NULL;
+    if (!stream_format(format)) return SEVENZIP_ERROR_INVALID_PARAM;
+
+    SevenZipDecoder* dec = (SevenZipDecoder*)mem_alloc(SEVENZIP_MEM_DECODER, sizeof(SevenZipDecoder));
+    if (!dec) return SEVENZIP_ERROR_MEMORY;
+    memset(dec, 0, sizeof(*dec));
+    dec->format = format;
+    LzmaDec_Construct(&dec->lzma);
+    Lzma2Dec_CONSTRUCT(&dec->lzma2);
+    *decoder = dec;
+    return SEVENZIP_OK;
+}
+
+SevenZipErrorCode sevenzip_decoder_update(
+    SevenZipDecoder* decoder,
+    const void* input,
+    size_t* input_size,
+    void* output,
+    size_t* output_size,
+    int* finished
+) {
+    if (!decoder || !input_size || !output_size || !finished ||
+        (!input && *input_size) || (!output && *output_size)) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    const Byte* in = (const Byte*)input;
+    size_t in_used = 0;
+    size_t out_capacity = *output_size;
+    *output_size = 0;
+
+    if (!decoder->started) {
+        size_t take = header_length(decoder) - decoder->header_size;
+        if (take > *input_size) take = *input_size;
+        if (take) memcpy(decoder->header + decoder->header_size, in, take);
+        decoder->header_size += take;
+        in_used = take;
+        if (decoder->header_size == header_length(decoder)) {
+            SRes res = decoder_start(decoder);
+            if (res != SZ_OK) {
+                *input_size = in_used;
+                return decode_error(res);
+            }
+            decoder->started = 1;
+        }
+    }
+
+    if (decoder->started && !decoder->finished) {
+        SizeT in_len = *input_size - in_used;
+        SizeT out_len = out_capacity;
+        ELzmaStatus status;
+        SRes res;
+        if (decoder->format == SEVENZIP_BUFFER_LZMA) {
+            ELzmaFinishMode mode = LZMA_FINISH_ANY;
+            if (decoder->remaining != UNKNOWN_SIZE && out_len >= decoder->remaining) {
+                out_len = (SizeT)decoder->remaining;
+                mode = LZMA_FINISH_END;
+            }
+            res = LzmaDec_DecodeToBuf(&decoder->lzma, (Byte*)output, &out_len,
+                                      in + in_used, &in_len, mode, &status);
+            if (decoder->remaining != UNKNOWN_SIZE) {
+                decoder->remaining -= out_len;
+                decoder->finished = res == SZ_OK && decoder->remaining == 0 &&
+                    (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+                     status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK);
+            } else {
+                decoder->finished = res == SZ_OK && status == LZMA_STATUS_FINISHED_WITH_MARK;
+            }
+        } else {
+            res = Lzma2Dec_DecodeToBuf(&decoder->lzma2, (Byte*)output, &out_len,
+                                       in + in_used, &in_len, LZMA_FINISH_ANY, &status);
+            decoder->finished = res == SZ_OK && status == LZMA_STATUS_FINISHED_WITH_MARK;
+        }
+        in_used += in_len;
+        *output_size = out_len;
+        if (res != SZ_OK) {
+            *input_size = in_used;
+            return decode_error(res);
+        }
+    }
+
+    *input_size = in_used;
+    *finished = decoder->finished;
+    return SEVENZIP_OK;
+}
+
+void sevenzip_decoder_free(SevenZipDecoder* decoder) {
+    if (!decoder) return;
+    LzmaDec_Free(&decoder->lzma, &g_MemDecoderAlloc);
+    Lzma2Dec_Free(&decoder->lzma2, &g_MemDecoderAlloc);
+    mem_free(decoder);
+}
@@ -0,0 +1,232 @@
+/**
+ * Streamable Archive Layout
+ *
+ * The region is sized for the plain header, so a header written by the
+ * create engine always fits: the encoded form is only kept when it is
+ * the smaller one. The forward reader drops its buffer as it refills, so
+ * the only seeks back it serves are those inside the last refill, which
+ * is all the folder decoders need.
+ */
+
+#include "stream_layout.h"
+#include "mem_alloc.h"
+#include "7zCrc.h"
+#include "CpuArch.h"
+
+#include <string.h>
+
+static const Byte kStreamLayoutMagic[8] = {'7', 'z', 'F', 'F', 'I', 's', 't', 'r'};
+static const Byte k7zSignature[6] = {'7', 'z', 0xBC, 0xAF, 0x27, 0x1C};
+
+/* Plain header bytes per entry besides its name: size, CRC, times and
+ * attributes of the file, and a folder of its own with the largest coder
+ * chain (filter, LZMA2, 7zAES) */
+#define STREAM_LAYOUT_ENTRY_BYTES 136
+#define STREAM_LAYOUT_FIXED_BYTES (64 * 1024)
+
+uint64_t stream_layout_reserve(uint64_t names_size, uint64_t entry_count) {
+    /* UTF-16 takes at most twice the UTF-8 bytes, plus the terminator */
+    uint64_t size = STREAM_LAYOUT_FIXED_BYTES + STREAM_LAYOUT_HEAD_SIZE +
+                    2 * (names_size + entry_count) + STREAM_LAYOUT_ENTRY_BYTES * entry_count;
+    return (size + 4095) & ~(uint64_t)4095;
+}
+
+int stream_layout_head(Byte* head, uint64_t region_size, uint64_t tail_offset,
+                       const Byte* tail, size_t tail_size) {
+    if (region_size < STREAM_LAYOUT_HEAD_SIZE ||
+        (uint64_t)tail_size > region_size - STREAM_LAYOUT_HEAD_SIZE) {
+        return 0;
+    }
+    memcpy(head, kStreamLayoutMagic, sizeof(kStreamLayoutMagic));
+    SetUi64(head + 8, region_size)
+    SetUi64(head + 16, tail_offset)
+    SetUi64(head + 24, (UInt64)tail_size)
+    SetUi32(head + 32, CrcCalc(tail, tail_size))
+    SetUi32(head + 36, CrcCalc(head, 36))
+    return 1;
+}
+
+/* ---- Forward reader ---- */
+
+/* Next bytes from the callback into the emptied buffer; size 0 at the end */
+static SRes forward_refill(ForwardInStream* p) {
+    p->pos = 0;
+    p->size = 0;
+    if (p->failed) return SZ_ERROR_READ;
+    size_t n = STREAM_LAYOUT_READ_BUFFER;
+    if (p->read(p->buf, &n, p->user_data) != 0 || n > STREAM_LAYOUT_READ_BUFFER) {
+        p->failed = 1;
+        return SZ_ERROR_READ;
+    }
+    p->size = n;
+    return SZ_OK;
+}
+
+static SRes ForwardInStream_Look(ILookInStreamPtr pp, const void** buf, size_t* size) {
+    ForwardInStream* p = Z7_CONTAINER_FROM_VTBL(pp, ForwardInStream, vt);
+    if (*size > 0 && p->pos == p->size) {
+        RINOK(forward_refill(p))
+    }
+    size_t avail = p->size - p->pos;
+    if (*size > avail) *size = avail;
+    *buf = p->buf + p->pos;
+    return SZ_OK;
+}
+
+static SRes ForwardInStream_Skip(ILookInStreamPtr pp, size_t offset) {
+    ForwardInStream* p = Z7_CONTAINER_FROM_VTBL(pp, ForwardInStream, vt);
+    p->pos += offset;
+    p->offset += offset;
+    return SZ_OK;
+}
+
+static SRes ForwardInStream_Read(ILookInStreamPtr pp, void* buf, size_t* size) {
+    const void* look;
+    RINOK(ForwardInStream_Look(pp, &look, size))
+    memcpy(buf, look, *size);
+    return ForwardInStream_Skip(pp, *size);
+}
+
+static SRes ForwardInStream_Seek(ILookInStreamPtr pp, Int64* pos, ESzSeek origin) {
+    ForwardInStream* p = Z7_CONTAINER_FROM_VTBL(pp, ForwardInStream, vt);
+    uint64_t target;
+    switch (origin) {
+        case SZ_SEEK_SET: target = (uint64_t)*pos; break;
+        case SZ_SEEK_CUR: target = p->offset + (uint64_t)*pos; break;
+        default: return SZ_ERROR_UNSUPPORTED;  /* The end is not known yet */
+    }
+    if (target < p->offset) {
+        uint64_t back = p->offset - target;
+        if (back > p->pos) return SZ_ERROR_UNSUPPORTED;
+        p->pos -= (size_t)back;
+    } else {
+        /* Bytes in between are read and dropped; past the end reads return none */
+        while (p->offset < target) {
+            if (p->pos == p->size) {
+                RINOK(forward_refill(p))
+                if (p->size == 0) break;
+            }
+            size_t step = p->size - p->pos;
+            if ((uint64_t)step > target - p->offset) step = (size_t)(target - p->offset);
+            p->pos += step;
+            p->offset += step;
+        }
+    }
+    p->offset = target;
+    *pos = (Int64)target;
+    return SZ_OK;
+}
+
+SRes forward_in_stream_init(ForwardInStream* p, SevenZipReadCallback read, void* user_data) {
+    memset(p, 0, sizeof(*p));
+    p->vt.Look = ForwardInStream_Look;
+    p->vt.Skip = ForwardInStream_Skip;
+    p->vt.Read = ForwardInStream_Read;
+    p->vt.Seek = ForwardInStream_Seek;
+    p->read = read;
+    p->user_data = user_data;
+    p->buf = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, STREAM_LAYOUT_READ_BUFFER);
+    return p->buf ? SZ_OK : SZ_ERROR_MEM;
+}
+
+void forward_in_stream_free(ForwardInStream* p) {
+    mem_free(p->buf);
+    p->buf = NULL;
+}
+
+SRes forward_in_stream_drain(ForwardInStream* p, uint64_t end) {
+    if (p->offset >= end) return SZ_OK;
+    Int64 pos = (Int64)end;
+    return ForwardInStream_Seek(&p->vt, &pos, SZ_SEEK_SET);
+}
+
+/* ---- Header view ---- */
+
+uint64_t stream_header_view_end(const StreamHeaderView* view) {
+    return view->tail_offset + view->tail_size;
+}
+
+static SRes StreamHeaderView_Read(ISeekInStreamPtr pp, void* buf, size_t* size) {
+    StreamHeaderView* p = Z7_CONTAINER_FROM_VTBL(pp, StreamHeaderView, vt);
+    uint64_t end = stream_header_view_end(p);
+    size_t n = *size;
+    if (p->pos >= end) {
+        n = 0;
+    } else if (p->pos < STREAM_LAYOUT_START_SIZE) {
+        if (n > STREAM_LAYOUT_START_SIZE - p->pos) n = (size_t)(STREAM_LAYOUT_START_SIZE - p->pos);
+        memcpy(buf, p->start + p->pos, n);
+    } else if (p->pos >= p->tail_offset) {
+        if ((uint64_t)n > end - p->pos) n = (size_t)(end - p->pos);
+        memcpy(buf, p->tail + (p->pos - p->tail_offset), n);
+    } else {
+        /* Pack data the database does not read */
+        if ((uint64_t)n > p->tail_offset - p->pos) n = (size_t)(p->tail_offset - p->pos);
+        memset(buf, 0, n);
+    }
+    p->pos += n;
+    *size = n;
+    return SZ_OK;
+}
+
+static SRes StreamHeaderView_Seek(ISeekInStreamPtr pp, Int64* pos, ESzSeek origin) {
+    StreamHeaderView* p = Z7_CONTAINER_FROM_VTBL(pp, StreamHeaderView, vt);
+    Int64 base = 0;
+    switch (origin) {
+        case SZ_SEEK_SET: base = 0; break;
+        case SZ_SEEK_CUR: base = (Int64)p->pos; break;
+        case SZ_SEEK_END: base = (Int64)stream_header_view_end(p); break;
+        default: return SZ_ERROR_PARAM;
+    }
+    Int64 target = base + *pos;
+    if (target < 0) return SZ_ERROR_PARAM;
+    p->pos = (uint64_t)target;
+    *pos = target;
+    return SZ_OK;
+}
+
+SRes stream_header_view_read(StreamHeaderView* view, ForwardInStream* in) {
+    memset(view, 0, sizeof(*view));
+    view->vt.Read = StreamHeaderView_Read;
+    view->vt.Seek = StreamHeaderView_Seek;
+
+    Byte head[STREAM_LAYOUT_HEAD_SIZE];
+    SRes res = LookInStream_Read(&in->vt, view->start, sizeof(view->start));
+    if (res == SZ_OK) res = LookInStream_Read(&in->vt, head, sizeof(head));
+    if (res == SZ_ERROR_INPUT_EOF) return SZ_ERROR_NO_ARCHIVE;
+    RINOK(res)
+    if (memcmp(view->start, k7zSignature, sizeof(k7zSignature)) != 0 ||
+        memcmp(head, kStreamLayoutMagic, sizeof(kStreamLayoutMagic)) != 0) {
+        return SZ_ERROR_NO_ARCHIVE;
+    }
+    if (GetUi32(head + 36) != CrcCalc(head, 36)) return SZ_ERROR_CRC;
+
+    /* The copy ends where the start header says the archive does */
+    uint64_t region_size = GetUi64(head + 8);
+    uint64_t tail_offset = GetUi64(head + 16);
+    uint64_t tail_size = GetUi64(head + 24);
+    uint64_t next_header_end = STREAM_LAYOUT_START_SIZE + GetUi64(view->start + 12) +
+                               GetUi64(view->start + 20);
+    if (region_size < STREAM_LAYOUT_HEAD_SIZE || tail_size > region_size - STREAM_LAYOUT_HEAD_SIZE ||
+        tail_offset < STREAM_LAYOUT_START_SIZE + region_size ||
+        tail_offset + tail_size != next_header_end || tail_size > (size_t)-1) {
+        return SZ_ERROR_ARCHIVE;
+    }
+
+    view->tail = (Byte*)mem_alloc(SEVENZIP_MEM_HEADER, tail_size > 0 ? (size_t)tail_size : 1);
+    if (!view->tail) return SZ_ERROR_MEM;
+    view->tail_size = (size_t)tail_size;
+    view->tail_offset = tail_offset;
+    res = LookInStream_Read(&in->vt, view->tail, view->tail_size);
+    if (res == SZ_ERROR_INPUT_EOF) res = SZ_ERROR_ARCHIVE;
+    if (res == SZ_OK && CrcCalc(view->tail, view->tail_size) != GetUi32(head + 32)) {
+        res = SZ_ERROR_CRC;
+    }
+    if (res != SZ_OK) stream_header_view_free(view);
+    return res;
+}
+
+void stream_header_view_free(StreamHeaderView* view) {
+    mem_free(view->tail);
+    view->tail = NULL;
+    view->tail_size = 0;
+}
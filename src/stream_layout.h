@@ -0,0 +1,120 @@
+/**
+ * Streamable Archive Layout - Internal Header
+ *
+ * SevenZipStreamOptions.streamable leaves a region of reserved bytes
+ * between the start header and the first pack stream, and once the
+ * archive is complete fills it with a copy of the header's bytes, so a
+ * reader that consumes the archive front to back has the entry table
+ * before the first packed byte. The archive stays a plain 7z archive:
+ * the header's PackPos skips the region, and every other reader ignores
+ * it.
+ *
+ * Every field is little-endian and fixed-width:
+ *
+ *   magic        "7zFFIstr"
+ *   region_size  uint64, bytes reserved (pack data starts at 32 + region_size)
+ *   tail_offset  uint64, archive offset of the header's bytes: the packed
+ *                header stream, if the header is encoded, then the record
+ *                the start header points at
+ *   tail_size    uint64, bytes from tail_offset to the end of the archive
+ *   tail_crc     uint32, CRC of the copy
+ *   head_crc     uint32, CRC of the 36 bytes before it
+ *   tail         tail_size bytes, the copy; zeros up to region_size
+ *
+ * sevenzip_extract_from_stream() reads the start header and the region,
+ * opens the database on a view of the archive made of those two pieces,
+ * and then decodes the folders as their pack streams go by.
+ */
+
+#ifndef SEVENZIP_STREAM_LAYOUT_H
+#define SEVENZIP_STREAM_LAYOUT_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_LAYOUT_START_SIZE 32  /* 7z signature and start header */
+#define STREAM_LAYOUT_HEAD_SIZE 40   /* Region fields before the copy */
+
+/* Staging buffer of the forward reader */
+#define STREAM_LAYOUT_READ_BUFFER (1 << 20)
+
+/**
+ * Bytes to reserve for an archive of `entry_count` entries whose names
+ * take `names_size` bytes of UTF-8: room for the plain header, which the
+ * encoded one stays under, rounded up to 4KB
+ */
+uint64_t stream_layout_reserve(uint64_t names_size, uint64_t entry_count);
+
+/**
+ * Fill the region fields for a copy of `tail`
+ * @param head Output: STREAM_LAYOUT_HEAD_SIZE bytes, written before the copy
+ * @return 0 if the copy does not fit region_size
+ */
+int stream_layout_head(Byte* head, uint64_t region_size, uint64_t tail_offset,
+                       const Byte* tail, size_t tail_size);
+
+/*
+ * ILookInStream over a SevenZipReadCallback that only moves forward:
+ * seeks ahead read and drop the bytes in between, and a seek back may
+ * only land in what the buffer still holds.
+ */
+typedef struct {
+    ILookInStream vt;
+    SevenZipReadCallback read;
+    void* user_data;
+    Byte* buf;             /* STREAM_LAYOUT_READ_BUFFER bytes */
+    size_t pos;            /* Next unread byte in buf */
+    size_t size;           /* Bytes in buf */
+    uint64_t offset;       /* Archive offset of buf[pos] */
+    int failed;            /* The callback returned nonzero */
+} ForwardInStream;
+
+/**
+ * @return SZ_OK, or SZ_ERROR_MEM without the buffer
+ */
+SRes forward_in_stream_init(ForwardInStream* p, SevenZipReadCallback read, void* user_data);
+void forward_in_stream_free(ForwardInStream* p);
+
+/**
+ * Read what follows the archive's last byte read so far, up to `end`
+ * @return SZ_OK, or SZ_ERROR_READ if the callback failed
+ */
+SRes forward_in_stream_drain(ForwardInStream* p, uint64_t end);
+
+/*
+ * The archive as far as SzArEx_Open() reads it: the start header at 0
+ * and the copy of the header's bytes at tail_offset, from the region.
+ */
+typedef struct {
+    ISeekInStream vt;
+    Byte start[STREAM_LAYOUT_START_SIZE];
+    Byte* tail;
+    size_t tail_size;
+    uint64_t tail_offset;
+    uint64_t pos;
+} StreamHeaderView;
+
+/**
+ * Read the start header and the region from the front of `in`, which is
+ * left at the end of the copy
+ * @param view Output: owns the copy until stream_header_view_free()
+ * @return SZ_OK, SZ_ERROR_NO_ARCHIVE if the stream is not a streamable
+ *         archive, SZ_ERROR_CRC, SZ_ERROR_MEM or SZ_ERROR_READ
+ */
+SRes stream_header_view_read(StreamHeaderView* view, ForwardInStream* in);
+void stream_header_view_free(StreamHeaderView* view);
+
+/* Offset one past the archive's last byte */
+uint64_t stream_header_view_end(const StreamHeaderView* view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_STREAM_LAYOUT_H */
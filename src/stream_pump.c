@@ -0,0 +1,210 @@
+/**
+ * Stream Pump
+ *
+ * One lock and one condition variable for the pair: every move of either
+ * ring, the end of the input, the end of the job and a stop wake both
+ * sides, which then look again at what they can do.
+ */
+
+#include "stream_pump.h"
+#include "mem_alloc.h"
+#include "thread_placement.h"
+
+#include <pthread.h>
+#include <string.h>
+
+typedef struct {
+    unsigned char* data;
+    size_t capacity;
+    size_t start;                 /* Oldest byte */
+    size_t size;                  /* Bytes held */
+} PumpRing;
+
+struct StreamPump {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    PumpRing in;
+    PumpRing out;
+    int input_closed;
+    int stop;
+    int done;                     /* The job has returned */
+    SevenZipErrorCode result;
+    StreamPumpJob job;
+    void* arg;
+};
+
+/* Copy up to `size` bytes into the ring; the bytes taken */
+static size_t ring_put(PumpRing* r, const unsigned char* data, size_t size) {
+    size_t room = r->capacity - r->size;
+    if (size > room) size = room;
+    size_t end = (r->start + r->size) % r->capacity;
+    size_t first = r->capacity - end;
+    if (first > size) first = size;
+    memcpy(r->data + end, data, first);
+    memcpy(r->data, data + first, size - first);
+    r->size += size;
+    return size;
+}
+
+/* Copy up to `size` bytes out of the ring; the bytes given */
+static size_t ring_get(PumpRing* r, unsigned char* data, size_t size) {
+    if (size > r->size) size = r->size;
+    size_t first = r->capacity - r->start;
+    if (first > size) first = size;
+    memcpy(data, r->data + r->start, first);
+    memcpy(data + first, r->data, size - first);
+    r->start = (r->start + size) % r->capacity;
+    r->size -= size;
+    return size;
+}
+
+static void* pump_thread(void* arg) {
+    StreamPump* p = (StreamPump*)arg;
+    thread_sched_enter();
+    SevenZipErrorCode result = p->job(p, p->arg);
+
+    pthread_mutex_lock(&p->lock);
+    p->result = result;
+    p->done = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void pump_free(StreamPump* p) {
+    mem_free(p->in.data);
+    mem_free(p->out.data);
+    mem_free(p);
+}
+
+StreamPump* stream_pump_start(size_t in_capacity, size_t out_capacity,
+                              StreamPumpJob job, void* arg) {
+    if (!job || out_capacity == 0) return NULL;
+
+    StreamPump* p = (StreamPump*)mem_alloc(SEVENZIP_MEM_OTHER, sizeof(StreamPump));
+    if (!p) return NULL;
+    memset(p, 0, sizeof(*p));
+    p->job = job;
+    p->arg = arg;
+    p->in.capacity = in_capacity;
+    p->out.capacity = out_capacity;
+    p->input_closed = in_capacity == 0;
+    if (in_capacity) p->in.data = (unsigned char*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, in_capacity);
+    p->out.data = (unsigned char*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, out_capacity);
+    if ((in_capacity && !p->in.data) || !p->out.data) {
+        pump_free(p);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&p->lock, NULL) != 0) {
+        pump_free(p);
+        return NULL;
+    }
+    if (pthread_cond_init(&p->changed, NULL) != 0) {
+        pthread_mutex_destroy(&p->lock);
+        pump_free(p);
+        return NULL;
+    }
+    if (pthread_create(&p->thread, NULL, pump_thread, p) != 0) {
+        pthread_cond_destroy(&p->changed);
+        pthread_mutex_destroy(&p->lock);
+        pump_free(p);
+        return NULL;
+    }
+    return p;
+}
+
+size_t stream_pump_read(StreamPump* p, void* buf, size_t size) {
+    if (size == 0) return 0;
+    pthread_mutex_lock(&p->lock);
+    while (p->in.size == 0 && !p->input_closed && !p->stop) {
+        pthread_cond_wait(&p->changed, &p->lock);
+    }
+    size_t got = p->stop ? 0 : ring_get(&p->in, (unsigned char*)buf, size);
+    if (got) pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    return got;
+}
+
+int stream_pump_write(StreamPump* p, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    pthread_mutex_lock(&p->lock);
+    while (size > 0) {
+        while (p->out.size == p->out.capacity && !p->stop) {
+            pthread_cond_wait(&p->changed, &p->lock);
+        }
+        if (p->stop) break;
+        size_t put = ring_put(&p->out, bytes, size);
+        bytes += put;
+        size -= put;
+        pthread_cond_broadcast(&p->changed);
+    }
+    int ok = !p->stop;
+    pthread_mutex_unlock(&p->lock);
+    return ok;
+}
+
+SevenZipErrorCode stream_pump_exchange(StreamPump* p,
+                                       const void* input, size_t* input_size,
+                                       void* output, size_t* output_size,
+                                       int close_input, int* finished) {
+    size_t in_left = input_size ? *input_size : 0;
+    size_t out_room = output_size ? *output_size : 0;
+    size_t in_moved = 0, out_moved = 0;
+
+    pthread_mutex_lock(&p->lock);
+    if (in_left && p->in.capacity == 0) in_left = 0;
+    /* Nothing left to put in: close now, or a job waiting for input and a
+     * caller waiting for output would wait on each other */
+    if (close_input && in_left == 0 && !p->input_closed) {
+        p->input_closed = 1;
+        pthread_cond_broadcast(&p->changed);
+    }
+    /* With no room for output, a full output ring holds the job until the
+     * caller drains it: waiting for input room would never end */
+    while (!p->done &&
+           !(in_left && p->in.size < p->in.capacity) &&
+           !(out_room && p->out.size > 0) &&
+           (in_left || out_room) &&
+           !(!out_room && p->out.size == p->out.capacity)) {
+        pthread_cond_wait(&p->changed, &p->lock);
+    }
+
+    if (in_left && !p->input_closed) {
+        in_moved = ring_put(&p->in, (const unsigned char*)input, in_left);
+    }
+    if (out_room) {
+        out_moved = ring_get(&p->out, (unsigned char*)output, out_room);
+    }
+    if (close_input && in_moved == in_left) p->input_closed = 1;
+    if (in_moved || out_moved || close_input) pthread_cond_broadcast(&p->changed);
+
+    int ended = p->done && p->out.size == 0;
+    SevenZipErrorCode result = p->done ? p->result : SEVENZIP_OK;
+    pthread_mutex_unlock(&p->lock);
+
+    if (input_size) *input_size = in_moved;
+    if (output_size) *output_size = out_moved;
+    if (finished) *finished = ended && result == SEVENZIP_OK;
+    /* Output made before a failure still goes out first */
+    return (result != SEVENZIP_OK && out_moved == 0) ? result : SEVENZIP_OK;
+}
+
+SevenZipErrorCode stream_pump_end(StreamPump* p) {
+    if (!p) return SEVENZIP_OK;
+
+    pthread_mutex_lock(&p->lock);
+    int stopped = !p->done;
+    p->stop = 1;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+
+    SevenZipErrorCode result = p->result;
+    if (stopped && result != SEVENZIP_OK) result = SEVENZIP_ERROR_CANCELLED;
+    pthread_cond_destroy(&p->changed);
+    pthread_mutex_destroy(&p->lock);
+    pump_free(p);
+    return result;
+}
@@ -0,0 +1,61 @@
+/**
+ * Stream Pump - Internal Header
+ *
+ * Runs a coder that drives its own streams on a helper thread, behind two
+ * bounded byte rings, so that a caller can feed and drain it a piece at a
+ * time. The SDK encoders pull their input from an ISeqInStream and the
+ * folder decoder pushes its output into a sink; neither can be suspended
+ * halfway through a call, so the job blocks on the rings instead:
+ *
+ *     job thread:   stream_pump_read()  <- input ring  <- caller
+ *                   stream_pump_write() -> output ring -> caller
+ *
+ * Memory is the two rings whatever the length of the stream.
+ */
+
+#ifndef SEVENZIP_STREAM_PUMP_H
+#define SEVENZIP_STREAM_PUMP_H
+
+#include "../include/7z_ffi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct StreamPump StreamPump;
+
+/* The work of the helper thread; its result is what stream_pump_end() returns */
+typedef SevenZipErrorCode (*StreamPumpJob)(StreamPump* pump, void* arg);
+
+/* Start `job` with rings of the given sizes (`in_capacity` 0 = the job reads
+ * nothing); NULL when the rings or the thread cannot be had */
+StreamPump* stream_pump_start(size_t in_capacity, size_t out_capacity,
+                              StreamPumpJob job, void* arg);
+
+/* Job side: up to `size` input bytes, waiting for the caller; 0 once the
+ * input is closed and drained, or the pump is stopping */
+size_t stream_pump_read(StreamPump* pump, void* buf, size_t size);
+
+/* Job side: all of `data`, waiting for room; 0 when the pump is stopping */
+int stream_pump_write(StreamPump* pump, const void* data, size_t size);
+
+/* Caller side: move what fits of `input` in and of the output out, waiting
+ * only while neither can move and the job runs. `*input_size` and
+ * `*output_size` come back as the bytes moved; `close_input` ends the input
+ * once all of it is in, before waiting, so a job blocked on an empty input
+ * ring goes on to finish. `*finished` is set when the job has ended and all
+ * its output is out. A failed job's error comes back once it has ended. */
+SevenZipErrorCode stream_pump_exchange(StreamPump* pump,
+                                       const void* input, size_t* input_size,
+                                       void* output, size_t* output_size,
+                                       int close_input, int* finished);
+
+/* Stop the job if it still runs, wait for it and free the pump; the job's
+ * result (SEVENZIP_ERROR_CANCELLED when it was stopped halfway) */
+SevenZipErrorCode stream_pump_end(StreamPump* pump);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_STREAM_PUMP_H */
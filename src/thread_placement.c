@@ -0,0 +1,363 @@
+/**
+ * Thread Placement
+ *
+ * Nodes are read once: /sys/devices/system/node on Linux, the NUMA
+ * processor masks on Windows. Nodes without processors (memory-only
+ * ones) are skipped. Memory is not bound explicitly; after pinning, the
+ * default first-touch policy puts each thread's match finder on its own
+ * node, so no libnuma is needed.
+ *
+ * Scheduling settings map to SCHED_BATCH / SCHED_IDLE, the thread's nice
+ * value and ioprio_set() on Linux, and to thread priorities and the
+ * background mode on Windows. An unprivileged thread may lower these but
+ * not raise them again, which is why only library threads are changed.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "thread_placement.h"
+#include "mem_alloc.h"
+#include "error_reporting.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#elif defined(__linux__)
+    #include <sched.h>
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#define NUMA_MAX_NODES 64
+#define CPU_LIST_WORDS 16    /* CPUs 0-1023 */
+
+/* ioprio_set() values, from linux/ioprio.h */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_VALUE(cls, data) (((cls) << 13) | (data))
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+typedef struct {
+    uint64_t bits[CPU_LIST_WORDS];
+} CpuList;
+
+typedef struct {
+    int generation;              /* 0 = no settings */
+    int has_cpus;
+    CpuList cpus;
+    SevenZipSchedPolicy policy;
+    int nice;
+    SevenZipIoPriority io_priority;
+} SchedSettings;
+
+static pthread_once_t g_nodes_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_place_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_placed_key;   /* Non-NULL once the thread was placed */
+static int g_node_count = 1;
+
+static pthread_once_t g_sched_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_sched_key;    /* Generation the thread was set up for */
+static SchedSettings g_sched;        /* Guarded by g_sched_lock */
+static int g_sched_generations = 0;
+
+#ifdef _WIN32
+static GROUP_AFFINITY g_node_cpus[NUMA_MAX_NODES];
+#elif defined(__linux__)
+static cpu_set_t g_node_cpus[NUMA_MAX_NODES];
+#endif
+
+/* Helper: Parse a cpulist ("0-7,16-23", as in sysfs) into `list`; CPUs
+ * found, -1 when malformed */
+static int parse_cpulist(const char* text, CpuList* list) {
+    memset(list, 0, sizeof(*list));
+    const char* p = text;
+    int count = 0;
+    while (*p == ' ') p++;
+    if (*p == '\0' || *p == '\n') return 0;
+    for (;;) {
+        char* end;
+        if (*p < '0' || *p > '9') return -1;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        p = end;
+        if (*p == '-') {
+            p++;
+            if (*p < '0' || *p > '9') return -1;
+            last = strtoul(p, &end, 10);
+            if (last < first) return -1;
+            p = end;
+        }
+        for (unsigned long cpu = first; cpu <= last && cpu < CPU_LIST_WORDS * 64; cpu++) {
+            uint64_t bit = (uint64_t)1 << (cpu % 64);
+            if (!(list->bits[cpu / 64] & bit)) {
+                list->bits[cpu / 64] |= bit;
+                count++;
+            }
+        }
+        while (*p == ' ') p++;
+        if (*p == '\0' || *p == '\n') return count;
+        if (*p++ != ',') return -1;
+        while (*p == ' ') p++;
+    }
+}
+
+#if defined(__linux__)
+static void cpulist_to_set(const CpuList* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    for (unsigned cpu = 0; cpu < CPU_LIST_WORDS * 64 && cpu < CPU_SETSIZE; cpu++) {
+        if (list->bits[cpu / 64] & ((uint64_t)1 << (cpu % 64))) CPU_SET(cpu, set);
+    }
+}
+
+/* Helper: Read a sysfs cpulist file into `set`; CPUs found */
+static int read_cpulist(const char* path, cpu_set_t* set) {
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    char line[4096];
+    CpuList list;
+    int count = fgets(line, sizeof(line), f) ? parse_cpulist(line, &list) : 0;
+    fclose(f);
+    if (count <= 0) return 0;
+    cpulist_to_set(&list, set);
+    return count;
+}
+#endif
+
+static void detect_nodes(void) {
+    pthread_key_create(&g_placed_key, NULL);
+    int count = 0;
+#ifdef _WIN32
+    ULONG highest = 0;
+    if (GetNumaHighestNodeNumber(&highest)) {
+        for (ULONG n = 0; n <= highest && count < NUMA_MAX_NODES; n++) {
+            if (GetNumaNodeProcessorMaskEx((USHORT)n, &g_node_cpus[count]) &&
+                g_node_cpus[count].Mask != 0) {
+                count++;
+            }
+        }
+    }
+#elif defined(__linux__)
+    for (int n = 0; n < NUMA_MAX_NODES * 4 && count < NUMA_MAX_NODES; n++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+        if (read_cpulist(path, &g_node_cpus[count]) > 0) count++;
+    }
+#endif
+    g_node_count = count > 1 ? count : 1;
+}
+
+int numa_node_count(void) {
+    pthread_once(&g_nodes_once, detect_nodes);
+    return g_node_count;
+}
+
+/* Helper: The affinity of the scheduling settings; 0 when there is none */
+static int sched_cpus(CpuList* cpus) {
+    pthread_mutex_lock(&g_sched_lock);
+    int has_cpus = g_sched.generation != 0 && g_sched.has_cpus;
+    if (has_cpus) *cpus = g_sched.cpus;
+    pthread_mutex_unlock(&g_sched_lock);
+    return has_cpus;
+}
+
+int numa_bind_thread(int node) {
+    if (numa_node_count() < 2 || node < 0) return 0;
+    int index = node % g_node_count;
+    CpuList allowed;
+    int limited = sched_cpus(&allowed);
+#ifdef _WIN32
+    GROUP_AFFINITY affinity = g_node_cpus[index];
+    if (limited && affinity.Group == 0 && (affinity.Mask & (KAFFINITY)allowed.bits[0])) {
+        affinity.Mask &= (KAFFINITY)allowed.bits[0];
+    }
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) != 0;
+#elif defined(__linux__)
+    cpu_set_t set = g_node_cpus[index];
+    if (limited) {
+        /* Stay within the affinity; a node outside it is left to it */
+        cpu_set_t within;
+        cpulist_to_set(&allowed, &within);
+        CPU_AND(&within, &within, &set);
+        if (CPU_COUNT(&within) == 0) return 0;
+        set = within;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#else
+    (void)limited;
+    return 0;
+#endif
+}
+
+static void make_sched_key(void) {
+    pthread_key_create(&g_sched_key, NULL);
+}
+
+SevenZipErrorCode thread_sched_set(const SevenZipInitOptions* options) {
+    SchedSettings s;
+    memset(&s, 0, sizeof(s));
+    if (options) {
+        if (options->nice < 0 || options->nice > 19 ||
+            options->sched_policy < SEVENZIP_SCHED_NORMAL || options->sched_policy > SEVENZIP_SCHED_IDLE ||
+            options->io_priority < SEVENZIP_IO_NORMAL || options->io_priority > SEVENZIP_IO_IDLE) {
+            return SEVENZIP_ERROR_INVALID_PARAM;
+        }
+        if (options->cpu_affinity && options->cpu_affinity[0]) {
+            if (parse_cpulist(options->cpu_affinity, &s.cpus) <= 0) {
+                sevenzip_set_error_internal(SEVENZIP_ERROR_INVALID_PARAM, "Invalid cpu_affinity list",
+                                            options->cpu_affinity, -1,
+                                            "List CPUs as in taskset -c, e.g. \"0-3,8\"");
+                return SEVENZIP_ERROR_INVALID_PARAM;
+            }
+            s.has_cpus = 1;
+        }
+        s.policy = options->sched_policy;
+        s.nice = options->nice;
+        s.io_priority = options->io_priority;
+    }
+    int any = s.has_cpus || s.policy != SEVENZIP_SCHED_NORMAL || s.nice > 0 ||
+              s.io_priority != SEVENZIP_IO_NORMAL;
+
+    pthread_mutex_lock(&g_sched_lock);
+    s.generation = any ? ++g_sched_generations : 0;
+    g_sched = s;
+    pthread_mutex_unlock(&g_sched_lock);
+    return SEVENZIP_OK;
+}
+
+int thread_sched_active(void) {
+    pthread_mutex_lock(&g_sched_lock);
+    int active = g_sched.generation != 0;
+    pthread_mutex_unlock(&g_sched_lock);
+    return active;
+}
+
+/* Helper: Apply `s` to the calling thread */
+static void apply_sched(const SchedSettings* s) {
+#ifdef _WIN32
+    HANDLE self = GetCurrentThread();
+    if (s->has_cpus && s->cpus.bits[0]) {
+        SetThreadAffinityMask(self, (DWORD_PTR)s->cpus.bits[0]);
+    }
+    if (s->io_priority != SEVENZIP_IO_NORMAL) {
+        /* Low I/O and memory priority; there is no finer I/O setting */
+        SetThreadPriority(self, THREAD_MODE_BACKGROUND_BEGIN);
+    }
+    if (s->policy == SEVENZIP_SCHED_IDLE) {
+        SetThreadPriority(self, THREAD_PRIORITY_IDLE);
+    } else if (s->nice >= 10) {
+        SetThreadPriority(self, THREAD_PRIORITY_LOWEST);
+    } else if (s->nice > 0 || s->policy == SEVENZIP_SCHED_BATCH) {
+        SetThreadPriority(self, THREAD_PRIORITY_BELOW_NORMAL);
+    }
+#elif defined(__linux__)
+    if (s->has_cpus) {
+        cpu_set_t set;
+        cpulist_to_set(&s->cpus, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    if (s->policy != SEVENZIP_SCHED_NORMAL) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        pthread_setschedparam(pthread_self(), s->policy == SEVENZIP_SCHED_IDLE ? SCHED_IDLE : SCHED_BATCH,
+                              &param);
+    }
+    /* Linux keeps nice and I/O priority per thread, addressed by its id */
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (s->nice > 0 && getpriority(PRIO_PROCESS, (id_t)tid) < s->nice) {
+        setpriority(PRIO_PROCESS, (id_t)tid, s->nice);
+    }
+#ifdef SYS_ioprio_set
+    if (s->io_priority != SEVENZIP_IO_NORMAL) {
+        int value = s->io_priority == SEVENZIP_IO_IDLE ? IOPRIO_VALUE(IOPRIO_CLASS_IDLE, 0)
+                                                       : IOPRIO_VALUE(IOPRIO_CLASS_BE, 7);
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, (int)tid, value);
+    }
+#endif
+#else
+    /* Elsewhere nice and priorities apply to the whole process */
+    (void)s;
+#endif
+}
+
+void thread_sched_enter(void) {
+    pthread_once(&g_sched_once, make_sched_key);
+    SchedSettings s;
+    pthread_mutex_lock(&g_sched_lock);
+    s = g_sched;
+    pthread_mutex_unlock(&g_sched_lock);
+    if (s.generation == 0 || (intptr_t)pthread_getspecific(g_sched_key) == s.generation) {
+        return;
+    }
+    pthread_setspecific(g_sched_key, (void*)(intptr_t)s.generation);
+    apply_sched(&s);
+}
+
+/* The placer around one of its ISzAlloc members (the SDK hands back const pointers) */
+#define PLACER_OF(p, member) \
+    ((ThreadPlacer*)(void*)((const char*)(p) - offsetof(ThreadPlacer, member)))
+
+/* Set up a coder thread on its first allocation; later ones are passed on */
+static void place_thread(ThreadPlacer* placer) {
+    if (pthread_equal(pthread_self(), placer->owner) || pthread_getspecific(g_placed_key)) {
+        return;
+    }
+    pthread_setspecific(g_placed_key, placer);
+    thread_sched_enter();
+    if (!placer->spread) return;
+    pthread_mutex_lock(&g_place_lock);
+    int node = placer->next_node++;
+    pthread_mutex_unlock(&g_place_lock);
+    numa_bind_thread(node);
+}
+
+static void* PlacerSmall_Alloc(ISzAllocPtr p, size_t size) {
+    ThreadPlacer* placer = PLACER_OF(p, small);
+    place_thread(placer);
+    return ISzAlloc_Alloc(placer->small_base, size);
+}
+
+static void* PlacerBig_Alloc(ISzAllocPtr p, size_t size) {
+    ThreadPlacer* placer = PLACER_OF(p, big);
+    place_thread(placer);
+    return ISzAlloc_Alloc(placer->big_base, size);
+}
+
+static void PlacerSmall_Free(ISzAllocPtr p, void* address) {
+    ISzAlloc_Free(PLACER_OF(p, small)->small_base, address);
+}
+
+static void PlacerBig_Free(ISzAllocPtr p, void* address) {
+    ISzAlloc_Free(PLACER_OF(p, big)->big_base, address);
+}
+
+int thread_placer_init(ThreadPlacer* placer, SevenZipNumaPolicy numa_policy) {
+    int spread = numa_policy == SEVENZIP_NUMA_LOCAL && numa_node_count() >= 2;
+    if (!spread && !thread_sched_active()) return 0;
+    numa_node_count();   /* Creates the per-thread key */
+    placer->small.Alloc = PlacerSmall_Alloc;
+    placer->small.Free = PlacerSmall_Free;
+    placer->big.Alloc = PlacerBig_Alloc;
+    placer->big.Free = PlacerBig_Free;
+    placer->small_base = &g_MemEncoderAlloc;
+    placer->big_base = &g_MemMatchFinderAlloc;
+    placer->owner = pthread_self();
+    placer->spread = spread;
+    placer->next_node = 0;
+    return 1;
+}
+
+int thread_placer_init_decoder(ThreadPlacer* placer, ISzAllocPtr alloc) {
+    if (!thread_placer_init(placer, SEVENZIP_NUMA_OFF)) return 0;
+    placer->small_base = alloc;
+    placer->big_base = alloc;
+    return 1;
+}
@@ -0,0 +1,82 @@
+/**
+ * Thread Placement - Internal Header
+ *
+ * Where and how library threads run: SEVENZIP_NUMA_LOCAL node pinning
+ * and the scheduling settings of sevenzip_init_with_options() (CPU
+ * affinity, SCHED_BATCH / SCHED_IDLE, nice, I/O priority).
+ *
+ * Threads of this library call thread_sched_enter() when they start. The
+ * SDK's coder threads (LZMA2 blocks, match finders, MtDec) are started
+ * inside the SDK, out of reach, but each one allocates its buffers itself
+ * before doing any work or starting threads of its own. A coder created
+ * with a ThreadPlacer's allocators sets up every such thread at that
+ * first allocation: scheduling settings first, then the node, round
+ * robin. Memory is then first touched on that node, and the threads it
+ * starts inherit the settings.
+ *
+ *     ThreadPlacer placer;
+ *     CLzma2EncHandle enc = thread_placer_init(&placer, options->numa_policy)
+ *         ? Lzma2Enc_Create(&placer.small, &placer.big)
+ *         : Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+ *     ... encode ...
+ *     Lzma2Enc_Destroy(enc);
+ *
+ * The thread that sets up the placer (the caller's) is never touched.
+ */
+
+#ifndef SEVENZIP_THREAD_PLACEMENT_H
+#define SEVENZIP_THREAD_PLACEMENT_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    ISzAlloc small;          /* In place of `small_base` */
+    ISzAlloc big;            /* In place of `big_base` */
+    ISzAllocPtr small_base;  /* g_MemEncoderAlloc, or the decoder allocator */
+    ISzAllocPtr big_base;    /* g_MemMatchFinderAlloc, or the decoder allocator */
+    pthread_t owner;         /* Thread that set it up, left alone */
+    int spread;              /* Pin threads to nodes (SEVENZIP_NUMA_LOCAL, several nodes) */
+    int next_node;           /* Node of the next thread, under a global lock */
+} ThreadPlacer;
+
+/* Nodes with processors, 1 where the platform reports none */
+int numa_node_count(void);
+
+/* Pin the calling thread to the processors of `node` modulo the node
+ * count, within the affinity of the scheduling settings; 0 if that is
+ * not possible */
+int numa_bind_thread(int node);
+
+/* Check and store the scheduling fields of `options` (NULL = none);
+ * SEVENZIP_ERROR_INVALID_PARAM leaves the current settings */
+SevenZipErrorCode thread_sched_set(const SevenZipInitOptions* options);
+
+/* 1 when scheduling settings are set */
+int thread_sched_active(void);
+
+/* Apply the scheduling settings to the calling thread, a library thread,
+ * unless it already has the current ones. Failures (e.g. no permission to
+ * use a CPU) are ignored: the thread keeps running as it is. */
+void thread_sched_enter(void);
+
+/* 1 when `placer` is ready: threads are spread over several nodes or
+ * scheduling settings are set; else 0 (use the plain allocators). The
+ * placer must outlive the coder. */
+int thread_placer_init(ThreadPlacer* placer, SevenZipNumaPolicy numa_policy);
+
+/* As thread_placer_init() for a decoder: both members stand in for
+ * `alloc`, and threads are not spread over nodes */
+int thread_placer_init_decoder(ThreadPlacer* placer, ISzAllocPtr alloc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_THREAD_PLACEMENT_H */
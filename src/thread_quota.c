@@ -0,0 +1,142 @@
+/**
+ * Thread Quota
+ *
+ * A job's share is the quota times its weight over the weight of every
+ * job holding or waiting for threads, at least one thread. Jobs asking
+ * while the quota is used up count toward that weight, so the ones
+ * already running do not crowd them out at the next start. Threads are
+ * fixed for the life of a job: the SDK coders size their thread pools
+ * once, so a lease does not grow when others finish.
+ */
+
+/* sched_getaffinity() and CPU_COUNT() are only declared with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "thread_quota.h"
+#include "cgroup_limits.h"
+#include "metrics.h"
+
+#include <pthread.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sched.h>
+    #include <unistd.h>
+#endif
+
+static pthread_mutex_t g_quota_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_quota_freed = PTHREAD_COND_INITIALIZER;
+static int g_quota_threads = 0;      /* 0 = no quota */
+static int g_quota_in_use = 0;       /* Charged by current leases */
+static int g_quota_weight = 0;       /* Weight of jobs running or waiting */
+
+static pthread_key_t lease_key;
+static pthread_once_t lease_key_once = PTHREAD_ONCE_INIT;
+
+static void make_lease_key(void) {
+    pthread_key_create(&lease_key, NULL);
+}
+
+static pthread_once_t hardware_threads_once = PTHREAD_ONCE_INIT;
+static int g_hardware_threads = 1;
+
+/* Processors online, then those the affinity mask (and so a cpuset cgroup)
+ * leaves, then the CFS quota */
+static void count_hardware_threads(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long n = (long)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        long allowed = CPU_COUNT(&set);
+        if (allowed > 0 && allowed < n) n = allowed;
+    }
+#endif
+    long quota = cgroup_cpu_limit();
+    if (quota > 0 && quota < n) n = quota;
+    g_hardware_threads = n > 1 ? (int)n : 1;
+}
+
+int hardware_thread_count(void) {
+    pthread_once(&hardware_threads_once, count_hardware_threads);
+    return g_hardware_threads;
+}
+
+int thread_auto_count(int preferred) {
+    int n = hardware_thread_count();
+    return preferred < n ? preferred : n;
+}
+
+void thread_quota_set(int max_threads) {
+    pthread_mutex_lock(&g_quota_lock);
+    g_quota_threads = max_threads > 0 ? max_threads : 0;
+    pthread_cond_broadcast(&g_quota_freed);
+    pthread_mutex_unlock(&g_quota_lock);
+}
+
+int thread_lease_acquire(ThreadLease* lease, int requested, int weight) {
+    pthread_once(&lease_key_once, make_lease_key);
+    lease->weight = weight > 0 ? weight : 1;
+    lease->charged = 0;
+    lease->outer = (ThreadLease*)pthread_getspecific(lease_key);
+
+    if (lease->outer) {
+        /* Inside another job's callback: its threads are already counted */
+        int outer = lease->outer->threads;
+        lease->limited = lease->outer->limited;
+        lease->threads = requested <= 0 || (lease->limited && requested > outer) ? outer : requested;
+        lease->weight = 0;
+        pthread_setspecific(lease_key, lease);
+        return lease->threads;
+    }
+
+    pthread_mutex_lock(&g_quota_lock);
+    g_quota_weight += lease->weight;
+    while (g_quota_threads > 0 && g_quota_in_use >= g_quota_threads) {
+        pthread_cond_wait(&g_quota_freed, &g_quota_lock);
+    }
+    int quota = g_quota_threads;
+    if (quota > 0) {
+        int share = (int)(((long long)quota * lease->weight + g_quota_weight - 1) / g_quota_weight);
+        int granted = requested > 0 && requested < share ? requested : share;
+        if (granted > quota - g_quota_in_use) granted = quota - g_quota_in_use;
+        lease->charged = granted;
+        g_quota_in_use += granted;
+    }
+    pthread_mutex_unlock(&g_quota_lock);
+
+    lease->limited = quota > 0;
+    lease->threads = lease->limited ? lease->charged
+                   : requested > 0 ? requested : hardware_thread_count();
+    metrics_gauge_add(METRICS_GAUGE_THREADS_BUSY, lease->threads);
+    pthread_setspecific(lease_key, lease);
+    return lease->threads;
+}
+
+void thread_lease_fit(const ThreadLease* lease, int* workers, int* inner) {
+    if (!lease->limited || *inner <= 0) return;
+    if (*inner > lease->threads) *inner = lease->threads;
+    int fit = lease->threads / *inner;
+    if (*workers > fit) *workers = fit;
+}
+
+void thread_lease_release(ThreadLease* lease) {
+    pthread_setspecific(lease_key, lease->outer);
+    if (lease->outer) return;
+    metrics_gauge_add(METRICS_GAUGE_THREADS_BUSY, -(int64_t)lease->threads);
+
+    pthread_mutex_lock(&g_quota_lock);
+    g_quota_in_use -= lease->charged;
+    g_quota_weight -= lease->weight;
+    pthread_cond_broadcast(&g_quota_freed);
+    pthread_mutex_unlock(&g_quota_lock);
+    lease->charged = 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * Thread Quota - Internal Header
+ *
+ * Process-wide limit on compute threads behind sevenzip_init_with_options().
+ * A job leases its threads when it starts and returns them when it ends;
+ * the count it gets is what it configures its coders with.
+ *
+ *     ThreadLease lease;
+ *     int threads = thread_lease_acquire(&lease, options->num_threads, options->thread_weight);
+ *     ... the job, on `threads` threads ...
+ *     thread_lease_release(&lease);
+ *
+ * Without a quota the lease hands the request back unchanged, 0 (auto)
+ * included, and costs one uncontended lock.
+ */
+
+#ifndef SEVENZIP_THREAD_QUOTA_H
+#define SEVENZIP_THREAD_QUOTA_H
+
+#include "../include/7z_ffi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ThreadLease {
+    int threads;                  /* Granted; the request when there is no quota */
+    int weight;                   /* Counted in the share of waiting and running jobs */
+    int charged;                  /* Taken from the quota, returned on release */
+    int limited;                  /* `threads` came from the quota */
+    struct ThreadLease* outer;    /* Lease of the job this one runs inside, on this thread */
+} ThreadLease;
+
+/* Logical processors this process may use, at least 1: those online,
+ * within the affinity mask (cpuset) and the cgroup CPU quota; counted once */
+int hardware_thread_count(void);
+
+/* Threads for a fixed default of `preferred`: no more than the processors */
+int thread_auto_count(int preferred);
+
+/* Resize the quota (0 = none); leases already granted keep their threads */
+void thread_quota_set(int max_threads);
+
+/* Threads for a job asking for `requested` (0 = as many as it may: its
+ * share, or hardware_thread_count() without a quota) at `weight` (0 = 1);
+ * waits while the quota is used up. A job started inside another on the
+ * same thread runs on the outer job's threads. */
+int thread_lease_acquire(ThreadLease* lease, int requested, int weight);
+
+/* Split a lease into `*workers` that run `*inner` threads each, when the
+ * caller fixed `*inner`; without a quota or with `*inner` 0 nothing changes */
+void thread_lease_fit(const ThreadLease* lease, int* workers, int* inner);
+
+void thread_lease_release(ThreadLease* lease);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_THREAD_QUOTA_H */
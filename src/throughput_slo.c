@@ -0,0 +1,81 @@
+/**
+ * Throughput Target
+ *
+ * Each rung halves what the one before it spends: the first halves the
+ * fast bytes and the match finder's search depth, the second switches
+ * to the fast parser, which costs optimal parsing's ratio but runs two
+ * to three times as fast, and the last two cut the searches short. The
+ * window is measured on one rung only, so a move is never judged by
+ * tasks that started before it.
+ */
+
+#include "throughput_slo.h"
+
+#include <string.h>
+
+void throughput_slo_init(ThroughputSlo* s, double target_mbps, int parallel) {
+    memset(s, 0, sizeof(*s));
+    s->target = target_mbps * 1e6;
+    s->parallel = parallel > 0 ? parallel : 1;
+    pthread_mutex_init(&s->lock, NULL);
+}
+
+void throughput_slo_destroy(ThroughputSlo* s) {
+    pthread_mutex_destroy(&s->lock);
+}
+
+int throughput_slo_rung(ThroughputSlo* s) {
+    pthread_mutex_lock(&s->lock);
+    int rung = s->rung;
+    pthread_mutex_unlock(&s->lock);
+    return rung;
+}
+
+void throughput_slo_props(const CLzma2EncProps* base, int rung, CLzma2EncProps* props) {
+    *props = *base;
+    CLzmaEncProps* p = &props->lzmaProps;
+    if (rung >= 1) {
+        p->fb = p->fb / 2 < 8 ? 8 : p->fb / 2;
+        p->mc = p->mc / 2 < 4 ? 4 : p->mc / 2;
+    }
+    if (rung >= 2) {
+        p->algo = 0;
+        if (p->fb > 32) p->fb = 32;
+    }
+    if (rung >= 3) {
+        if (p->fb > 16) p->fb = 16;
+        if (p->mc > 8) p->mc = 8;
+    }
+    if (rung >= SLO_FASTEST_RUNG) {
+        p->fb = 8;
+        if (p->mc > 4) p->mc = 4;
+    }
+}
+
+int throughput_slo_stores(int rung, double bits_per_byte) {
+    return rung >= SLO_STORE_RUNG && bits_per_byte >= SLO_STORE_BITS;
+}
+
+void throughput_slo_report(ThroughputSlo* s, int rung, uint64_t bytes, double seconds) {
+    pthread_mutex_lock(&s->lock);
+    if (rung == s->rung) {
+        s->window_bytes += bytes;
+        s->window_seconds += seconds;
+        if (s->window_bytes >= SLO_WINDOW_BYTES && s->window_seconds > 0) {
+            double rate = (double)s->window_bytes / s->window_seconds * s->parallel;
+            int next = s->rung;
+            if (rate < s->target && s->rung < SLO_STORE_RUNG) {
+                next++;
+            } else if (rate > s->target * SLO_RAISE_MARGIN && s->rung > 0) {
+                next--;
+            }
+            if (next != s->rung) {
+                s->rung = next;
+                s->changes++;
+            }
+            s->window_bytes = 0;
+            s->window_seconds = 0;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+}
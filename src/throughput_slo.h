@@ -0,0 +1,84 @@
+/**
+ * Throughput Target - Internal Header
+ *
+ * Encoder effort control for SevenZipStreamOptions.throughput_target.
+ * Every LZMA2 task reports its input bytes and encoder seconds; once a
+ * window of SLO_WINDOW_BYTES is in, its rate (times the encodes running
+ * at once) moves the job one rung: a faster one below the target, a
+ * stronger one above SLO_RAISE_MARGIN times it. Rungs keep the job's
+ * dictionary, literal settings and match finder, so memory and the
+ * LZMA2 property byte never change and blocks of one file on different
+ * rungs still join into one stream. Past the fastest rung, data whose
+ * sampled entropy reaches SLO_STORE_BITS is stored instead.
+ */
+
+#ifndef SEVENZIP_THROUGHPUT_SLO_H
+#define SEVENZIP_THROUGHPUT_SLO_H
+
+#include "../include/7z_ffi.h"
+#include "Lzma2Enc.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Rung 0 is the level's own settings, SLO_FASTEST_RUNG the fast parser
+ * with the shortest searches; SLO_STORE_RUNG also stores poor data */
+#define SLO_FASTEST_RUNG 4
+#define SLO_STORE_RUNG 5
+
+/* Input bytes of one measuring window */
+#define SLO_WINDOW_BYTES ((uint64_t)4 << 20)
+
+/* Rates above the target times this move to a stronger rung */
+#define SLO_RAISE_MARGIN 1.5
+
+/* Entropy from which SLO_STORE_RUNG stores a file (the usual limit is
+ * ENTROPY_INCOMPRESSIBLE_BITS) */
+#define SLO_STORE_BITS 7.0
+
+typedef struct {
+    double target;            /* Bytes of input per second */
+    int parallel;             /* Encodes running at once */
+    pthread_mutex_t lock;
+    int rung;
+    uint64_t window_bytes;    /* Reported on the current rung since the last move */
+    double window_seconds;    /* Summed over the encodes */
+    uint64_t changes;         /* Moves so far */
+} ThroughputSlo;
+
+/**
+ * @param target_mbps Wanted MB/s of input (> 0)
+ * @param parallel Encodes that will run at once
+ */
+void throughput_slo_init(ThroughputSlo* s, double target_mbps, int parallel);
+
+void throughput_slo_destroy(ThroughputSlo* s);
+
+/* Rung for the next task */
+int throughput_slo_rung(ThroughputSlo* s);
+
+/**
+ * Encoder props of a rung
+ * @param base Normalized props of the job's level
+ */
+void throughput_slo_props(const CLzma2EncProps* base, int rung, CLzma2EncProps* props);
+
+/* Whether a rung stores data of this sampled entropy */
+int throughput_slo_stores(int rung, double bits_per_byte);
+
+/**
+ * Count one finished encode; reports of rungs since left are dropped
+ * @param rung Rung the task ran on
+ * @param bytes Input bytes encoded
+ * @param seconds Encoder wall time
+ */
+void throughput_slo_report(ThroughputSlo* s, int rung, uint64_t bytes, double seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_THROUGHPUT_SLO_H */
@@ -0,0 +1,186 @@
+/**
+ * Trace Recorder
+ *
+ * Rings are linked into a global list when a thread records its first
+ * span and are never freed; a thread that exits hands its ring to the
+ * next new thread, which keeps appending. Events carry the thread id
+ * they were recorded on, so spans of exited threads stay attributed.
+ * Only the owner writes a ring: it fills the slot, then publishes the
+ * count with a release store that the dump reads with acquire.
+ */
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef SEVENZIP_TRACE
+
+#include <pthread.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    typedef volatile __int64 TraceCounter;
+    typedef volatile long TraceFlag;
+    #define COUNTER_LOAD(p) ((uint64_t)InterlockedCompareExchange64((p), 0, 0))
+    #define COUNTER_PUBLISH(p, v) InterlockedExchange64((p), (__int64)(v))
+    #define FLAG_STORE(p, v) InterlockedExchange((p), (v))
+#else
+    #include <stdatomic.h>
+    typedef _Atomic uint64_t TraceCounter;
+    typedef _Atomic int TraceFlag;
+    #define COUNTER_LOAD(p) atomic_load_explicit((p), memory_order_acquire)
+    #define COUNTER_PUBLISH(p, v) atomic_store_explicit((p), (v), memory_order_release)
+    #define FLAG_STORE(p, v) atomic_store_explicit((p), (v), memory_order_release)
+#endif
+
+typedef struct {
+    uint64_t start;           /* ns, trace_now() */
+    uint64_t duration;        /* ns */
+    uint64_t arg;
+    uint32_t tid;
+    uint32_t kind;
+} TraceEvent;
+
+typedef struct TraceRing {
+    struct TraceRing* next;
+    TraceFlag in_use;         /* Owned by a live thread */
+    uint32_t tid;             /* Current owner */
+    TraceCounter written;     /* Events ever recorded; the slot is written % TRACE_RING_EVENTS */
+    TraceEvent events[TRACE_RING_EVENTS];
+} TraceRing;
+
+static const char* const k_kind_names[TRACE_KIND_COUNT] = {
+    "read", "compress", "write", "volume-open", "header-build"
+};
+
+static pthread_mutex_t g_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceRing* g_rings = NULL;     /* Under g_rings_lock */
+static uint32_t g_next_tid = 1;       /* Under g_rings_lock */
+static uint64_t g_epoch = 0;          /* First span's start; timestamps are relative to it */
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/* Thread exit: the ring stays in the list, free for the next thread */
+static void release_ring(void* p) {
+    FLAG_STORE(&((TraceRing*)p)->in_use, 0);
+}
+
+static void make_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+uint64_t trace_now(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* The calling thread's ring, NULL when out of memory (the span is dropped) */
+static TraceRing* thread_ring(uint64_t start) {
+    pthread_once(&ring_key_once, make_ring_key);
+    TraceRing* ring = (TraceRing*)pthread_getspecific(ring_key);
+    if (ring) return ring;
+
+    pthread_mutex_lock(&g_rings_lock);
+    for (ring = g_rings; ring; ring = ring->next) {
+        if (!ring->in_use) break;
+    }
+    if (!ring) {
+        ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+        if (ring) {
+            ring->next = g_rings;
+            g_rings = ring;
+        }
+    }
+    if (ring) {
+        FLAG_STORE(&ring->in_use, 1);
+        ring->tid = g_next_tid++;
+        if (!g_epoch) g_epoch = start;
+    }
+    pthread_mutex_unlock(&g_rings_lock);
+
+    if (ring) pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+void trace_span(TraceKind kind, uint64_t start, uint64_t arg) {
+    uint64_t end = trace_now();
+    TraceRing* ring = thread_ring(start);
+    if (!ring) return;
+
+    uint64_t n = COUNTER_LOAD(&ring->written);
+    TraceEvent* e = &ring->events[n % TRACE_RING_EVENTS];
+    e->start = start;
+    e->duration = end - start;
+    e->arg = arg;
+    e->tid = ring->tid;
+    e->kind = (uint32_t)kind;
+    COUNTER_PUBLISH(&ring->written, n + 1);
+}
+
+/* Chrome "complete" event, after the metadata event; times in microseconds */
+static void write_event(FILE* f, const TraceEvent* e) {
+    uint64_t start = e->start > g_epoch ? e->start - g_epoch : 0;
+    const char* arg_name = e->kind == TRACE_VOLUME_OPEN ? "volume" : "bytes";
+    fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"7z\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+               "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"%s\":%llu}}",
+            k_kind_names[e->kind], e->tid,
+            (double)start / 1000.0, (double)e->duration / 1000.0,
+            arg_name, (unsigned long long)e->arg);
+}
+
+SevenZipErrorCode sevenzip_trace_dump(const char* path) {
+    if (!path) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot create trace file %s\n", path);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"7z_ffi\"}}", f);
+
+    pthread_mutex_lock(&g_rings_lock);
+    for (TraceRing* ring = g_rings; ring; ring = ring->next) {
+        uint64_t written = COUNTER_LOAD(&ring->written);
+        uint64_t i = written > TRACE_RING_EVENTS ? written - TRACE_RING_EVENTS : 0;
+        for (; i < written; i++) {
+            write_event(f, &ring->events[i % TRACE_RING_EVENTS]);
+        }
+    }
+    pthread_mutex_unlock(&g_rings_lock);
+
+    fputs("\n]}\n", f);
+    int failed = ferror(f);
+    if (fclose(f) != 0 || failed) {
+        fprintf(stderr, "Error: Cannot write trace file %s\n", path);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    return SEVENZIP_OK;
+}
+
+#else
+
+SevenZipErrorCode sevenzip_trace_dump(const char* path) {
+    (void)path;
+    return SEVENZIP_ERROR_NOT_IMPLEMENTED;
+}
+
+#endif
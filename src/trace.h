@@ -0,0 +1,59 @@
+/**
+ * Trace Recorder - Internal Header
+ *
+ * Timeline behind sevenzip_trace_dump(), compiled in with ENABLE_TRACE
+ * (SEVENZIP_TRACE). Each thread records finished spans into a ring of
+ * its own, so recording takes no lock: a clock read at each end and one
+ * 32-byte store. Without SEVENZIP_TRACE the macros expand to nothing.
+ *
+ *     TRACE_BEGIN(t);
+ *     ... the work ...
+ *     TRACE_END(t, TRACE_READ, bytes);
+ */
+
+#ifndef SEVENZIP_TRACE_H
+#define SEVENZIP_TRACE_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What a span covers; `arg` is bytes, or the volume index for TRACE_VOLUME_OPEN */
+typedef enum {
+    TRACE_READ = 0,           /* Input read */
+    TRACE_COMPRESS = 1,       /* One encoder call: a file, a solid stream or a worker slot */
+    TRACE_WRITE = 2,          /* Packed output written */
+    TRACE_VOLUME_OPEN = 3,    /* Next volume created */
+    TRACE_HEADER = 4,         /* Archive header built and encoded */
+    TRACE_KIND_COUNT = 5
+} TraceKind;
+
+/* Spans kept per thread; older ones are overwritten */
+#define TRACE_RING_EVENTS 8192
+
+#ifdef SEVENZIP_TRACE
+
+/* Monotonic clock in nanoseconds */
+uint64_t trace_now(void);
+
+/* Record a span of the calling thread that started at `start` */
+void trace_span(TraceKind kind, uint64_t start, uint64_t arg);
+
+#define TRACE_BEGIN(t) uint64_t t##_trace_start = trace_now()
+#define TRACE_END(t, kind, arg) trace_span((kind), t##_trace_start, (uint64_t)(arg))
+
+#else
+
+#define TRACE_BEGIN(t) ((void)0)
+#define TRACE_END(t, kind, arg) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_TRACE_H */
@@ -0,0 +1,184 @@
+/**
+ * Name Conversion
+ *
+ * The ASCII test on eight code units is one compare of a 16-byte vector:
+ * a unit is ASCII when its bits 7-15 are clear. Blocks that pass are
+ * narrowed with one saturating pack; the first block that fails is
+ * converted unit by unit until the next block passes again.
+ */
+
+#include "utf_convert.h"
+#include "mem_alloc.h"
+#include "CpuArch.h"
+
+#include <stdlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define UTF_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define UTF_USE_NEON 1
+#endif
+
+/* Code units per vector block */
+#define UTF_BLOCK_UNITS 8
+
+#if defined(UTF_USE_SSE2) || defined(UTF_USE_NEON)
+/* 1 if the eight units at src are ASCII; then also narrowed into dst unless NULL */
+static int ascii_block(const Byte* src, char* dst) {
+#if defined(UTF_USE_SSE2)
+    __m128i v = _mm_loadu_si128((const __m128i*)src);
+    __m128i high = _mm_and_si128(v, _mm_set1_epi16((short)0xFF80));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) return 0;
+    if (dst) _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(v, v));
+#else
+    uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(src));
+    /* Nonzero lanes are units of 0x80 and above (saturated, not truncated) */
+    uint8x8_t high = vqshrn_n_u16(v, 7);
+    if (vget_lane_u64(vreinterpret_u64_u8(high), 0) != 0) return 0;
+    if (dst) vst1_u8((uint8_t*)dst, vmovn_u16(v));
+#endif
+    return 1;
+}
+#define UTF_HAVE_BLOCKS 1
+#endif
+
+/* Code point at unit i and the units it takes */
+static UInt32 decode_utf16(const Byte* src, size_t units, size_t i, size_t* taken) {
+    UInt32 c = GetUi16(src + i * 2);
+    *taken = 1;
+    if (c < 0xD800 || c >= 0xE000) return c;
+    if (c < 0xDC00 && i + 1 < units) {
+        UInt32 low = GetUi16(src + i * 2 + 2);
+        if (low >= 0xDC00 && low < 0xE000) {
+            *taken = 2;
+            return 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        }
+    }
+    return 0xFFFD;  /* Unpaired surrogate */
+}
+
+static size_t utf8_length(UInt32 c) {
+    return c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+}
+
+size_t utf16le_to_utf8_size(const Byte* src, size_t units) {
+    size_t size = 0;
+    size_t i = 0;
+    while (i < units) {
+#ifdef UTF_HAVE_BLOCKS
+        if (i + UTF_BLOCK_UNITS <= units && ascii_block(src + i * 2, NULL)) {
+            size += UTF_BLOCK_UNITS;
+            i += UTF_BLOCK_UNITS;
+            continue;
+        }
+#endif
+        UInt32 c = GetUi16(src + i * 2);
+        if (c < 0x80) {
+            size++;
+            i++;
+            continue;
+        }
+        size_t taken;
+        size += utf8_length(decode_utf16(src, units, i, &taken));
+        i += taken;
+    }
+    return size;
+}
+
+size_t utf16le_to_utf8(const Byte* src, size_t units, char* dst) {
+    Byte* d = (Byte*)dst;
+    size_t i = 0;
+    while (i < units) {
+#ifdef UTF_HAVE_BLOCKS
+        if (i + UTF_BLOCK_UNITS <= units && ascii_block(src + i * 2, (char*)d)) {
+            d += UTF_BLOCK_UNITS;
+            i += UTF_BLOCK_UNITS;
+            continue;
+        }
+#endif
+        UInt32 c = GetUi16(src + i * 2);
+        if (c < 0x80) {
+            *d++ = (Byte)c;
+            i++;
+            continue;
+        }
+        size_t taken;
+        c = decode_utf16(src, units, i, &taken);
+        i += taken;
+        if (c < 0x800) {
+            *d++ = (Byte)(0xC0 | (c >> 6));
+            *d++ = (Byte)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            *d++ = (Byte)(0xE0 | (c >> 12));
+            *d++ = (Byte)(0x80 | ((c >> 6) & 0x3F));
+            *d++ = (Byte)(0x80 | (c & 0x3F));
+        } else {
+            *d++ = (Byte)(0xF0 | (c >> 18));
+            *d++ = (Byte)(0x80 | ((c >> 12) & 0x3F));
+            *d++ = (Byte)(0x80 | ((c >> 6) & 0x3F));
+            *d++ = (Byte)(0x80 | (c & 0x3F));
+        }
+    }
+    return (size_t)(d - (Byte*)dst);
+}
+
+char* utf16le_to_utf8_dup(const Byte* src, size_t units) {
+    if (units <= 1) return NULL;
+    char* name = (char*)mem_alloc(SEVENZIP_MEM_NAMES, utf16le_to_utf8_size(src, units));
+    if (name) utf16le_to_utf8(src, units, name);
+    return name;
+}
+
+/* Code point at s and the bytes it takes; a byte that does not start a
+ * valid, shortest-form sequence stands for itself */
+static UInt32 decode_utf8(const Byte* s, size_t* taken) {
+    UInt32 c = s[0];
+    *taken = 1;
+    if (c < 0xC2 || c > 0xF4) return c;
+
+    size_t extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+    UInt32 v = c & (0x3F >> extra);
+    for (size_t k = 1; k <= extra; k++) {
+        if ((s[k] & 0xC0) != 0x80) return c;  /* Also stops at the terminator */
+        v = (v << 6) | (s[k] & 0x3F);
+    }
+    if ((extra == 2 && (v < 0x800 || (v >= 0xD800 && v < 0xE000))) ||
+        (extra == 3 && (v < 0x10000 || v > 0x10FFFF))) {
+        return c;
+    }
+    *taken = extra + 1;
+    return v;
+}
+
+size_t utf8_to_utf16le_size(const char* src) {
+    const Byte* s = (const Byte*)src;
+    size_t size = 0;
+    while (*s) {
+        size_t taken;
+        size += decode_utf8(s, &taken) >= 0x10000 ? 4 : 2;
+        s += taken;
+    }
+    return size;
+}
+
+size_t utf8_to_utf16le(const char* src, Byte* dst) {
+    const Byte* s = (const Byte*)src;
+    Byte* d = dst;
+    while (*s) {
+        size_t taken;
+        UInt32 c = decode_utf8(s, &taken);
+        s += taken;
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            SetUi16(d, (UInt16)(0xD800 + (c >> 10)));
+            SetUi16(d + 2, (UInt16)(0xDC00 + (c & 0x3FF)));
+            d += 4;
+        } else {
+            SetUi16(d, (UInt16)c);
+            d += 2;
+        }
+    }
+    return (size_t)(d - dst);
+}
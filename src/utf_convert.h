@@ -0,0 +1,59 @@
+/**
+ * Name Conversion - Internal Header
+ *
+ * Entry names are UTF-16LE in the archive header and UTF-8 everywhere in
+ * the API. Every path that reads or writes names converts through here.
+ * Going to UTF-8, runs of ASCII are converted eight code units at a time
+ * (SSE2/NEON); other characters take the scalar path. Unpaired surrogates
+ * become U+FFFD. Going to UTF-16, bytes that are not valid UTF-8 are taken
+ * as Latin-1, one code unit per byte, so any byte string can be stored.
+ */
+
+#ifndef SEVENZIP_UTF_CONVERT_H
+#define SEVENZIP_UTF_CONVERT_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * UTF-8 bytes needed for `units` UTF-16LE code units
+ * Counting the header's terminator in `units` counts the '\0' too.
+ */
+size_t utf16le_to_utf8_size(const Byte* src, size_t units);
+
+/**
+ * Convert `units` UTF-16LE code units to UTF-8
+ * @param dst Room for utf16le_to_utf8_size(src, units) bytes
+ * @return Bytes written
+ */
+size_t utf16le_to_utf8(const Byte* src, size_t units, char* dst);
+
+/**
+ * `units` UTF-16LE code units, the last of them 0, as a NUL-terminated
+ * UTF-8 string counted as SEVENZIP_MEM_NAMES (free with mem_free())
+ * @return The string, or NULL for an empty name or when out of memory
+ */
+char* utf16le_to_utf8_dup(const Byte* src, size_t units);
+
+/**
+ * UTF-16LE bytes for a NUL-terminated UTF-8 string, without the terminator
+ */
+size_t utf8_to_utf16le_size(const char* src);
+
+/**
+ * Convert a NUL-terminated UTF-8 string to UTF-16LE, without the terminator
+ * @param dst Room for utf8_to_utf16le_size(src) bytes
+ * @return Bytes written
+ */
+size_t utf8_to_utf16le(const char* src, Byte* dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_UTF_CONVERT_H */
@@ -0,0 +1,230 @@
+/**
+ * Volume Follower
+ *
+ * Reads with stdio and clears the end-of-file flag before every read, so
+ * bytes appended since the last one are seen. Arrival is found by
+ * polling: nothing in the file, a look for the next volume, a sleep of
+ * VOLUME_FOLLOW_POLL_MS, again. Without an index the next volume
+ * existing ends the current one, after one more read of it for bytes
+ * written just before the next volume was created; volumes must then
+ * arrive in order. With an index they may arrive in any order.
+ */
+
+#include "volume_follow.h"
+#include "archive_index.h"
+#include "cancel_token.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+static double monotonic_ms(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+#endif
+}
+
+static void sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+void volume_follower_init(VolumeFollower* f, const char* path, int timeout_ms,
+                          const SevenZipCancelToken* cancel) {
+    memset(f, 0, sizeof(*f));
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    f->series = -1;
+    f->timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+    f->cancel = cancel;
+}
+
+void volume_follower_free(VolumeFollower* f) {
+    if (f->file) fclose(f->file);
+    mem_free(f->volume_sizes);
+    f->file = NULL;
+    f->volume_sizes = NULL;
+}
+
+/* Helper: Volume sizes from the index next to the archive, if there is one */
+static void follow_load_index(VolumeFollower* f, const char* archive_path) {
+    char index_path[1100];
+    archive_index_path(index_path, sizeof(index_path), archive_path);
+    ArchiveIndexReader r;
+    if (archive_index_read(&r, index_path) != SEVENZIP_OK) return;
+    if (r.volume_count > 0 && r.volume_count == (size_t)r.volume_count) {
+        f->volume_sizes = (uint64_t*)mem_alloc(SEVENZIP_MEM_OTHER, (size_t)r.volume_count * sizeof(uint64_t));
+        if (f->volume_sizes) {
+            for (uint64_t i = 0; i < r.volume_count; i++) {
+                f->volume_sizes[i] = archive_index_get_volume(&r, i);
+            }
+            f->volume_count = r.volume_count;
+        }
+    }
+    archive_index_reader_free(&r);
+}
+
+/* Helper: Path of series volume `number` */
+static void follow_volume_path(const VolumeFollower* f, int number, char* buffer, size_t size) {
+    snprintf(buffer, size, "%s.%03d", f->base, number);
+}
+
+/* Helper: Open the file to read next, if it exists yet */
+static void follow_open(VolumeFollower* f) {
+    char path[1100];
+    if (f->series < 0) {
+        /* A .NNN path names its series, read from .001; any other path is
+         * the archive itself or the base of its volumes, whichever appears */
+        size_t len = strlen(f->path);
+        if (len > 4 && f->path[len - 4] == '.' &&
+            f->path[len - 3] >= '0' && f->path[len - 3] <= '9' &&
+            f->path[len - 2] >= '0' && f->path[len - 2] <= '9' &&
+            f->path[len - 1] >= '0' && f->path[len - 1] <= '9') {
+            memcpy(f->base, f->path, len - 4);
+            f->base[len - 4] = '\0';
+        } else {
+            f->file = fopen(f->path, "rb");
+            if (f->file) {
+                f->series = 0;
+                follow_load_index(f, f->path);
+                return;
+            }
+            snprintf(f->base, sizeof(f->base), "%s", f->path);
+        }
+        f->volume = 1;
+        follow_volume_path(f, 1, path, sizeof(path));
+        f->file = fopen(path, "rb");
+        if (f->file) {
+            f->series = 1;
+            follow_load_index(f, f->base);
+        }
+        return;
+    }
+    if (f->series == 1) {
+        follow_volume_path(f, f->volume, path, sizeof(path));
+        f->file = fopen(path, "rb");
+    }
+}
+
+/* Helper: Known size of the volume being read, UINT64_MAX without the index */
+static uint64_t follow_volume_size(const VolumeFollower* f) {
+    if (!f->volume_sizes) return UINT64_MAX;
+    uint64_t i = f->series == 1 ? (uint64_t)(f->volume - 1) : 0;
+    return i < f->volume_count ? f->volume_sizes[i] : UINT64_MAX;
+}
+
+/* Helper: Keep the start header; once whole it gives the archive's end,
+ * which an index describing another archive will not add up to */
+static void follow_note(VolumeFollower* f, const void* buf, size_t n) {
+    if (f->archive_pos < sizeof(f->start)) {
+        size_t take = sizeof(f->start) - (size_t)f->archive_pos;
+        if (take > n) take = n;
+        memcpy(f->start + f->archive_pos, buf, take);
+        if (f->archive_pos + take == sizeof(f->start)) {
+            f->archive_end = sizeof(f->start) + get_u64(f->start + 12) + get_u64(f->start + 20);
+            uint64_t total = 0;
+            for (uint64_t i = 0; i < f->volume_count; i++) total += f->volume_sizes[i];
+            if (f->volume_sizes && (total != f->archive_end || (f->series == 0 && f->volume_count != 1))) {
+                mem_free(f->volume_sizes);
+                f->volume_sizes = NULL;
+                f->volume_count = 0;
+            }
+        }
+    }
+    f->archive_pos += n;
+    f->volume_pos += n;
+}
+
+static void follow_advance(VolumeFollower* f) {
+    fclose(f->file);
+    f->file = NULL;
+    f->volume++;
+    f->volume_pos = 0;
+}
+
+int volume_follower_read(void* buf, size_t* size, void* user_data) {
+    VolumeFollower* f = (VolumeFollower*)user_data;
+    size_t want = *size;
+    *size = 0;
+    double wait_start = monotonic_ms();
+    int next_seen = 0;
+
+    for (;;) {
+        if (f->archive_end && f->archive_pos >= f->archive_end) return 0;
+        if (!f->file) follow_open(f);
+        if (f->file) {
+            size_t limit = want;
+            if (f->archive_end && limit > f->archive_end - f->archive_pos) {
+                limit = (size_t)(f->archive_end - f->archive_pos);
+            }
+            uint64_t volume_size = follow_volume_size(f);
+            if (f->series == 1 && f->volume_pos >= volume_size) {
+                follow_advance(f);
+                continue;
+            }
+            if (volume_size != UINT64_MAX && limit > volume_size - f->volume_pos) {
+                limit = (size_t)(volume_size - f->volume_pos);
+            }
+
+            clearerr(f->file);
+            size_t n = fread(buf, 1, limit, f->file);
+            if (n > 0) {
+                follow_note(f, buf, n);
+                *size = n;
+                return 0;
+            }
+            if (ferror(f->file)) return -1;
+
+            /* Nothing more yet: a volume the index does not size is done
+             * once the next exists and one more read finds nothing */
+            if (f->series == 1 && volume_size == UINT64_MAX) {
+                if (next_seen) {
+                    follow_advance(f);
+                    next_seen = 0;
+                    continue;
+                }
+                char path[1100];
+                follow_volume_path(f, f->volume + 1, path, sizeof(path));
+                FILE* next = fopen(path, "rb");
+                if (next) {
+                    fclose(next);
+                    next_seen = 1;
+                    continue;
+                }
+            }
+        }
+
+        if (cancel_token_requested(f->cancel)) {
+            f->cancelled = 1;
+            return -1;
+        }
+        if (f->timeout_ms > 0 && monotonic_ms() - wait_start >= (double)f->timeout_ms) {
+            f->timed_out = 1;
+            return -1;
+        }
+        sleep_ms(VOLUME_FOLLOW_POLL_MS);
+    }
+}
@@ -0,0 +1,56 @@
+/**
+ * Volume Follower - Internal Header
+ *
+ * SevenZipReadCallback behind sevenzip_extract_following(): hands out a
+ * streamable archive front to back while its file, or its .NNN volumes,
+ * are still being written or downloaded. A read past what exists waits
+ * for more instead of ending the stream. The start header gives the
+ * archive's end, so the stream ends exactly there. A volume is finished
+ * once it holds the size the sidecar index (<archive>.7zidx) gives it,
+ * or, without an index, once the next volume exists.
+ */
+
+#ifndef SEVENZIP_VOLUME_FOLLOW_H
+#define SEVENZIP_VOLUME_FOLLOW_H
+
+#include "../include/7z_ffi.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VOLUME_FOLLOW_POLL_MS 50   /* Wait between looks for more bytes */
+
+typedef struct {
+    char path[1024];        /* As given */
+    char base[1024];        /* Series base, once known */
+    int series;             /* -1 = neither the file nor volume 1 found yet, 0 = one file, 1 = .NNN volumes */
+    int volume;             /* Series: number of the volume being read, from 1 */
+    FILE* file;
+    uint64_t volume_pos;    /* Bytes read of `file` */
+    uint64_t archive_pos;   /* Bytes handed out */
+    uint64_t archive_end;   /* 0 until the start header is read */
+    unsigned char start[32];
+    uint64_t* volume_sizes; /* From the index, NULL without one */
+    uint64_t volume_count;
+    int timeout_ms;         /* Longest wait for a byte (0 = until cancelled) */
+    const SevenZipCancelToken* cancel;
+    int timed_out;
+    int cancelled;
+} VolumeFollower;
+
+void volume_follower_init(VolumeFollower* f, const char* path, int timeout_ms,
+                          const SevenZipCancelToken* cancel);
+void volume_follower_free(VolumeFollower* f);
+
+/* SevenZipReadCallback; user_data is the VolumeFollower. Fails once the
+ * wait times out or the token is cancelled, setting the flag */
+int volume_follower_read(void* buf, size_t* size, void* user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_VOLUME_FOLLOW_H */
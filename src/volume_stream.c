@@ -0,0 +1,428 @@
+/**
+ * Split Volume Input
+ *
+ * The prefetch threads start with the first request, each serving its
+ * slot one volume at a time: it drops the slot's head under the lock,
+ * fills the buffer outside it and publishes the volume under the lock
+ * again, so readers copying from a head never see it change.
+ */
+
+#include "volume_stream.h"
+#include "mem_alloc.h"
+#include "thread_placement.h"
+#include "parity_volumes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <io.h>
+    #include <sys/stat.h>
+#else
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+#endif
+
+/* Size of an open volume, 0 if it cannot be queried */
+static uint64_t file_size(FILE* f) {
+#ifdef _WIN32
+    struct _stat64 st;
+    return _fstat64(_fileno(f), &st) == 0 ? (uint64_t)st.st_size : 0;
+#else
+    struct stat st;
+    return fstat(fileno(f), &st) == 0 ? (uint64_t)st.st_size : 0;
+#endif
+}
+
+size_t volume_read_at(FILE* f, uint64_t offset, void* buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        size_t chunk = size - done;
+#ifdef _WIN32
+        if (chunk > 0x40000000) chunk = 0x40000000;
+        HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+        OVERLAPPED ov;
+        DWORD got = 0;
+        uint64_t at = offset + done;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)at;
+        ov.OffsetHigh = (DWORD)(at >> 32);
+        if (h == INVALID_HANDLE_VALUE ||
+            !ReadFile(h, (Byte*)buf + done, (DWORD)chunk, &got, &ov) || got == 0) {
+            break;
+        }
+#else
+        ssize_t got = pread(fileno(f), (Byte*)buf + done, chunk, (off_t)(offset + done));
+        if (got <= 0) break;
+#endif
+        done += (size_t)got;
+    }
+    return done;
+}
+
+/* Add one volume of `size` bytes, opened or (f NULL) missing; closes it on failure */
+static int add_volume(VolumeSet* set, FILE* f, const char* path, uint64_t size, int* capacity) {
+    if (set->count == *capacity) {
+        int grown = *capacity ? *capacity * 2 : 8;
+        FILE** files = (FILE**)mem_realloc(SEVENZIP_MEM_OTHER, set->files,
+                                           (size_t)grown * sizeof(FILE*));
+        if (files) set->files = files;
+        char** paths = files ? (char**)mem_realloc(SEVENZIP_MEM_OTHER, set->paths,
+                                                   (size_t)grown * sizeof(char*))
+                             : NULL;
+        if (paths) set->paths = paths;
+        uint64_t* sizes = paths ? (uint64_t*)mem_realloc(SEVENZIP_MEM_OTHER, set->sizes,
+                                                         (size_t)grown * sizeof(uint64_t))
+                                : NULL;
+        if (sizes) set->sizes = sizes;
+        uint64_t* offsets = sizes ? (uint64_t*)mem_realloc(SEVENZIP_MEM_OTHER, set->offsets,
+                                                           (size_t)(grown + 1) * sizeof(uint64_t))
+                                  : NULL;
+        if (!offsets) {
+            if (f) fclose(f);
+            return 0;
+        }
+        set->offsets = offsets;
+        *capacity = grown;
+    }
+    size_t len = strlen(path) + 1;
+    char* copy = (char*)mem_alloc(SEVENZIP_MEM_OTHER, len);
+    if (!copy) {
+        if (f) fclose(f);
+        return 0;
+    }
+    memcpy(copy, path, len);
+    int i = set->count++;
+    set->files[i] = f;
+    set->paths[i] = copy;
+    set->sizes[i] = size;
+    set->offsets[i] = set->total_size;
+    set->total_size += set->sizes[i];
+    set->offsets[i + 1] = set->total_size;
+    return 1;
+}
+
+/* Size of volume `path`, UINT64_MAX if it cannot be opened */
+static uint64_t path_size(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return UINT64_MAX;
+    uint64_t size = file_size(f);
+    fclose(f);
+    return size;
+}
+
+/* Open the volumes the parity describes; 0 (nothing added) if they are
+ * not the series it was made for: more volumes than it has, or more of
+ * the present ones with another size than with its own */
+static int open_repairable(VolumeSet* set, const char* base, struct ParitySet* parity, int* capacity) {
+    char volume_path[1024];
+    int count = parity_set_volume_count(parity);
+    snprintf(volume_path, sizeof(volume_path), "%s.%03d", base, count + 1);
+    if (count < VOLUME_MAX_COUNT && path_size(volume_path) != UINT64_MAX) return 0;
+    int matched = 0;
+    int mismatched = 0;
+    for (int i = 0; i < count; i++) {
+        snprintf(volume_path, sizeof(volume_path), "%s.%03d", base, i + 1);
+        uint64_t size = path_size(volume_path);
+        if (size == parity_set_volume_size(parity, i)) matched++;
+        else if (size != UINT64_MAX) mismatched++;
+    }
+    if (mismatched > matched) return 0;
+
+    for (int i = 0; i < count; i++) {
+        snprintf(volume_path, sizeof(volume_path), "%s.%03d", base, i + 1);
+        uint64_t size = parity_set_volume_size(parity, i);
+        FILE* f = fopen(volume_path, "rb");
+        if (f && file_size(f) != size) {
+            fclose(f);
+            f = NULL;
+        }
+        if (!add_volume(set, f, volume_path, size, capacity)) return 1;
+    }
+    return 1;
+}
+
+/* Open base.001, base.002, ... until one is missing, or as the parity describes them */
+static void open_series(VolumeSet* set, const char* base, int* capacity) {
+    set->series = 1;
+    struct ParitySet* parity = parity_set_open(base);
+    if (parity && open_repairable(set, base, parity, capacity)) {
+        set->parity = parity;
+        return;
+    }
+    parity_set_close(parity);
+
+    char volume_path[1024];
+    for (int i = 1; i <= VOLUME_MAX_COUNT; i++) {
+        snprintf(volume_path, sizeof(volume_path), "%s.%03d", base, i);
+        FILE* f = fopen(volume_path, "rb");
+        if (!f || !add_volume(set, f, volume_path, file_size(f), capacity)) break;
+    }
+}
+
+int volume_set_open(VolumeSet* set, const char* path, int readahead) {
+    memset(set, 0, sizeof(*set));
+    if (readahead <= 0) readahead = VOLUME_READAHEAD_DEFAULT;
+    set->readahead = readahead < VOLUME_READAHEAD_MAX ? readahead : VOLUME_READAHEAD_MAX;
+
+    int capacity = 0;
+    size_t len = strlen(path);
+    if (len > 4 && len < 1024 && path[len - 4] == '.' &&
+        path[len - 3] >= '0' && path[len - 3] <= '9' &&
+        path[len - 2] >= '0' && path[len - 2] <= '9' &&
+        path[len - 1] >= '0' && path[len - 1] <= '9') {
+        char base[1024];
+        memcpy(base, path, len - 4);
+        base[len - 4] = '\0';
+        open_series(set, base, &capacity);
+    } else {
+        FILE* f = fopen(path, "rb");
+        if (f) {
+            add_volume(set, f, path, file_size(f), &capacity);
+        } else {
+            open_series(set, path, &capacity);
+        }
+    }
+    if (set->count == 0) {
+        volume_set_close(set);
+        return 0;
+    }
+
+    /* Prefetching needs the lock; without it the set still reads */
+    set->has_lock = set->count > 1 && CriticalSection_Init(&set->lock) == 0;
+    return 1;
+}
+
+void volume_set_close(VolumeSet* set) {
+    /* Readers are done, so prefetching no longer changes */
+    if (set->prefetching == 1) {
+        CriticalSection_Enter(&set->lock);
+        set->stop = 1;
+        CriticalSection_Leave(&set->lock);
+        for (int i = 0; i < set->slot_count; i++) {
+            VolumePrefetch* slot = &set->slots[i];
+            Event_Set(&slot->wake);
+            Thread_Wait_Close(&slot->thread);
+            Event_Close(&slot->wake);
+            mem_free(slot->head);
+        }
+    }
+    if (set->has_lock) CriticalSection_Delete(&set->lock);
+    parity_set_close(set->parity);
+    for (int i = 0; i < set->count; i++) {
+        if (set->files[i]) fclose(set->files[i]);
+        mem_free(set->paths[i]);
+    }
+    mem_free(set->files);
+    mem_free(set->paths);
+    mem_free(set->sizes);
+    mem_free(set->offsets);
+    mem_free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+static THREAD_FUNC_DECL VolumePrefetch_Thread(void* arg) {
+    VolumePrefetch* slot = (VolumePrefetch*)arg;
+    VolumeSet* set = slot->set;
+    thread_sched_enter();
+
+    for (;;) {
+        Event_Wait(&slot->wake);
+        CriticalSection_Enter(&set->lock);
+        int stop = set->stop;
+        int v = slot->requested;
+        slot->requested = -1;
+        FILE* f = v >= 0 ? set->files[v] : NULL;
+        if (!stop && f && v != slot->ready) {
+            slot->ready = -1;
+            slot->fetching = v;
+        } else {
+            v = -1;
+        }
+        CriticalSection_Leave(&set->lock);
+        if (stop) break;
+        if (v < 0) continue;
+
+        size_t want = set->sizes[v] < VOLUME_PREFETCH_SIZE ? (size_t)set->sizes[v] : VOLUME_PREFETCH_SIZE;
+        size_t got = volume_read_at(f, 0, slot->head, want);
+
+        CriticalSection_Enter(&set->lock);
+        FILE* released = slot->release;
+        slot->fetching = -1;
+        slot->release = NULL;
+        if (got > 0 && !released) {
+            slot->ready = v;
+            slot->head_size = got;
+        }
+        CriticalSection_Leave(&set->lock);
+        if (released) fclose(released);
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Caller holds the lock; starts as many slots as it can, at least one or
+ * prefetching stays off */
+static int start_prefetch(VolumeSet* set) {
+    int wanted = set->readahead + 1;
+    set->slots = (VolumePrefetch*)mem_calloc(SEVENZIP_MEM_OTHER, (size_t)wanted, sizeof(VolumePrefetch));
+    while (set->slots && set->slot_count < wanted) {
+        VolumePrefetch* slot = &set->slots[set->slot_count];
+        Thread_CONSTRUCT(&slot->thread)
+        Event_Construct(&slot->wake);
+        slot->set = set;
+        slot->requested = -1;
+        slot->ready = -1;
+        slot->fetching = -1;
+        slot->head = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, VOLUME_PREFETCH_SIZE);
+        if (slot->head && AutoResetEvent_CreateNotSignaled(&slot->wake) == 0) {
+            if (Thread_Create(&slot->thread, VolumePrefetch_Thread, slot) == 0) {
+                set->slot_count++;
+                continue;
+            }
+            Event_Close(&slot->wake);
+        }
+        mem_free(slot->head);
+        slot->head = NULL;
+        break;
+    }
+    if (set->slot_count == 0) {
+        mem_free(set->slots);
+        set->slots = NULL;
+        set->prefetching = -1;
+        return 0;
+    }
+    set->prefetching = 1;
+    return 1;
+}
+
+/* Ask for the heads of the volumes after v (none past the last one);
+ * a single slot only ever holds the next volume */
+static void request_readahead(VolumeSet* set, int v) {
+    if (!set->has_lock || v + 1 >= set->count) return;
+    CriticalSection_Enter(&set->lock);
+    if (set->prefetching == 0) start_prefetch(set);
+    uint32_t wake = 0;
+    if (set->prefetching == 1) {
+        int ahead = set->slot_count > 1 ? set->slot_count - 1 : 1;
+        for (int w = v + 1; w <= v + ahead && w < set->count; w++) {
+            VolumePrefetch* slot = &set->slots[w % set->slot_count];
+            if (set->sizes[w] == 0 || !set->files[w] || w == slot->ready || w == slot->requested) continue;
+            slot->requested = w;
+            wake |= 1u << (w % set->slot_count);
+        }
+    }
+    CriticalSection_Leave(&set->lock);
+    for (int i = 0; wake; i++, wake >>= 1) {
+        if (wake & 1) Event_Set(&set->slots[i].wake);
+    }
+}
+
+/* Copy from a prefetched head if it holds [offset, offset + size) of volume v */
+static int read_head(VolumeSet* set, int v, uint64_t offset, void* buf, size_t size) {
+    if (!set->has_lock || offset >= VOLUME_PREFETCH_SIZE) return 0;
+    CriticalSection_Enter(&set->lock);
+    VolumePrefetch* slot = set->prefetching == 1 ? &set->slots[v % set->slot_count] : NULL;
+    int hit = slot && slot->ready == v && offset + size <= slot->head_size;
+    if (hit) memcpy(buf, slot->head + (size_t)offset, size);
+    CriticalSection_Leave(&set->lock);
+    return hit;
+}
+
+/* Volume holding pos < total_size; the hint is usually right or one short */
+static int find_volume(const VolumeSet* set, uint64_t pos, int hint) {
+    if (hint >= 0 && hint < set->count) {
+        if (pos >= set->offsets[hint] && pos < set->offsets[hint + 1]) return hint;
+        if (hint + 1 < set->count && pos >= set->offsets[hint + 1] && pos < set->offsets[hint + 2]) {
+            return hint + 1;
+        }
+    }
+    /* Last volume whose start is <= pos; empty volumes are skipped over */
+    int lo = 0;
+    int hi = set->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (set->offsets[mid] <= pos) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+int volume_set_release(VolumeSet* set, int v) {
+    if (v < 0 || v >= set->count) return 0;
+    if (set->has_lock) CriticalSection_Enter(&set->lock);
+    FILE* f = set->files[v];
+    int was_open = f != NULL;
+    set->files[v] = NULL;
+    for (int i = 0; f && i < set->slot_count; i++) {
+        VolumePrefetch* slot = &set->slots[i];
+        if (slot->requested == v) slot->requested = -1;
+        if (slot->ready == v) slot->ready = -1;
+        if (slot->fetching == v) {
+            slot->release = f;  /* Its thread closes it */
+            f = NULL;
+        }
+    }
+    if (set->has_lock) CriticalSection_Leave(&set->lock);
+    if (f) fclose(f);
+    return was_open;
+}
+
+SRes volume_set_read(VolumeSet* set, uint64_t pos, void* buf, size_t* size, int* current) {
+    Byte* out = (Byte*)buf;
+    size_t done = 0;
+    while (done < *size && pos < set->total_size) {
+        int v = find_volume(set, pos, *current);
+        if (v != *current) {
+            *current = v;
+            if (!set->parity) request_readahead(set, v);
+        }
+        uint64_t offset = pos - set->offsets[v];
+        size_t n = *size - done;
+        if (n > set->sizes[v] - offset) n = (size_t)(set->sizes[v] - offset);
+        size_t got = set->parity ? parity_set_read(set->parity, set->files, v, offset, out + done, n) :
+                     read_head(set, v, offset, out + done, n) ? n :
+                     set->files[v] ? volume_read_at(set->files[v], offset, out + done, n) : 0;
+        if (got == 0) {
+            *size = done;
+            return SZ_ERROR_READ;
+        }
+        done += got;
+        pos += got;
+    }
+    *size = done;
+    return SZ_OK;
+}
+
+static SRes VolumeInStream_Read(ISeekInStreamPtr pp, void* buf, size_t* size) {
+    VolumeInStream* p = Z7_CONTAINER_FROM_VTBL(pp, VolumeInStream, vt);
+    SRes res = volume_set_read(p->set, p->pos, buf, size, &p->current);
+    p->pos += *size;
+    if (p->consumed && *size > 0) p->consumed(p->consumed_ctx, *size);
+    return res;
+}
+
+static SRes VolumeInStream_Seek(ISeekInStreamPtr pp, Int64* pos, ESzSeek origin) {
+    VolumeInStream* p = Z7_CONTAINER_FROM_VTBL(pp, VolumeInStream, vt);
+    Int64 base;
+    switch (origin) {
+        case SZ_SEEK_SET: base = 0; break;
+        case SZ_SEEK_CUR: base = (Int64)p->pos; break;
+        case SZ_SEEK_END: base = (Int64)p->set->total_size; break;
+        default: return SZ_ERROR_PARAM;
+    }
+    if (*pos < -base) return SZ_ERROR_PARAM;
+    p->pos = (uint64_t)(base + *pos);
+    p->seeked = 1;
+    *pos = (Int64)p->pos;
+    return SZ_OK;
+}
+
+void volume_in_stream_init(VolumeInStream* p, VolumeSet* set) {
+    memset(p, 0, sizeof(*p));
+    p->vt.Read = VolumeInStream_Read;
+    p->vt.Seek = VolumeInStream_Seek;
+    p->set = set;
+    p->current = -1;  /* The first read counts as entering a volume */
+}
@@ -0,0 +1,143 @@
+/**
+ * Split Volume Input - Internal Header
+ *
+ * The volumes of a split archive (name.7z.001, .002, ...) opened once and
+ * read as one stream by any number of readers. Each reader keeps its own
+ * position and reads with positioned I/O (pread, ReadFile at an offset),
+ * so readers on several threads share the handles without a shared file
+ * cursor. The volume holding an offset is found by binary search over
+ * the offset table, with the reader's current volume checked first.
+ *
+ * When a reader enters a volume, helper threads read the first
+ * VOLUME_PREFETCH_SIZE bytes of the following `readahead` volumes, one
+ * thread per volume, so the round trips of several volumes (slow on
+ * network mounts and cold storage, and on different devices for striped
+ * volumes) are in flight at once and the switch to the next volume does
+ * not wait for its first one. Reads are served from those copies while
+ * they hold them.
+ *
+ * A volume no reader will come back to can be released: its handle is
+ * closed, so the caller may delete the file while the rest is read.
+ *
+ * When the series has parity volumes (base.p001, ...), the data volumes
+ * are taken from the parity's tables: missing ones, and ones whose size
+ * is wrong, are kept with no handle, and every read goes through the
+ * parity, which checks each block and rebuilds the damaged ones.
+ */
+
+#ifndef SEVENZIP_VOLUME_STREAM_H
+#define SEVENZIP_VOLUME_STREAM_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "Threads.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Head of the next volume read ahead */
+#define VOLUME_PREFETCH_SIZE (4 * 1024 * 1024)
+
+/* Highest volume number tried (.999) */
+#define VOLUME_MAX_COUNT 999
+
+/* Volumes read ahead by default, and at most */
+#define VOLUME_READAHEAD_DEFAULT 2
+#define VOLUME_READAHEAD_MAX 16
+
+struct VolumeSet;
+struct ParitySet;
+
+/* One prefetch thread and its head buffer; volume v uses slot v % slot_count */
+typedef struct {
+    struct VolumeSet* set;
+    CThread thread;
+    CAutoResetEvent wake;
+    int requested;         /* Volume to fetch (-1 = none) */
+    int ready;             /* Volume whose head is in `head` (-1 = none) */
+    int fetching;          /* Volume being read outside the lock (-1 = none) */
+    FILE* release;         /* Handle of `fetching`, released meanwhile; closed once read */
+    Byte* head;
+    size_t head_size;
+} VolumePrefetch;
+
+typedef struct VolumeSet {
+    FILE** files;          /* NULL once released */
+    char** paths;
+    uint64_t* sizes;
+    uint64_t* offsets;     /* count + 1 entries: start of each volume, then the total */
+    int count;
+    int series;            /* Opened as path.001, path.002, ... rather than one file */
+    uint64_t total_size;
+    int readahead;         /* Volumes after the current one fetched ahead */
+    struct ParitySet* parity;  /* Reads checked and repaired through it; NULL = none */
+
+    /* Prefetch; `lock` guards everything below it and the slots' fields */
+    CCriticalSection lock;
+    int has_lock;          /* 0 for a single volume, or if the lock could not be set up */
+    int prefetching;       /* 0 = not started, 1 = running, -1 = could not start */
+    int stop;
+    VolumePrefetch* slots; /* readahead + 1, one holding the current volume's head */
+    int slot_count;        /* Slots whose thread started */
+} VolumeSet;
+
+/**
+ * Open the volumes of an archive
+ * A path ending in .NNN opens that series from .001; any other path is
+ * opened as a single volume if it exists, else as the series path.001,
+ * path.002, ...
+ * @param readahead Volumes read ahead (0 = VOLUME_READAHEAD_DEFAULT,
+ *                  capped at VOLUME_READAHEAD_MAX)
+ * @return 1 on success, 0 if no volume could be opened
+ */
+int volume_set_open(VolumeSet* set, const char* path, int readahead);
+
+/* Read up to `size` bytes at `offset` without moving a shared file position */
+size_t volume_read_at(FILE* f, uint64_t offset, void* buf, size_t size);
+
+/* Stop the prefetch threads and close the volumes (safe on a zeroed set) */
+void volume_set_close(VolumeSet* set);
+
+/**
+ * Close volume v for good
+ * A prefetch of it in flight closes it once done; reads of it fail with
+ * SZ_ERROR_READ from then on. Call it once no reader will come back to v.
+ * @return 1 if v was open
+ */
+int volume_set_release(VolumeSet* set, int v);
+
+/**
+ * Positioned read across volumes
+ * @param set Volumes
+ * @param pos Offset in the joined stream
+ * @param buf Destination
+ * @param size In: bytes wanted; out: bytes read (0 at the end)
+ * @param current In/out: the caller's current volume, a search hint
+ * @return SZ_OK, or SZ_ERROR_READ
+ */
+SRes volume_set_read(VolumeSet* set, uint64_t pos, void* buf, size_t* size, int* current);
+
+/* A reader with its own position */
+typedef struct {
+    ISeekInStream vt;
+    VolumeSet* set;
+    uint64_t pos;
+    int current;
+    int seeked;            /* Set by each Seek; cleared by whoever watches for it */
+
+    /* Optional: told how many bytes each Read returned */
+    void (*consumed)(void* ctx, size_t size);
+    void* consumed_ctx;
+} VolumeInStream;
+
+void volume_in_stream_init(VolumeInStream* p, VolumeSet* set);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_VOLUME_STREAM_H */
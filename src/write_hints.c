@@ -0,0 +1,93 @@
+/**
+ * Output Cache Hints
+ *
+ * POSIX_FADV_DONTNEED only drops clean pages, so a window is waited on
+ * before it is dropped; its writeback was started a window earlier and
+ * has mostly finished by then, so the writer rarely blocks. Hint
+ * failures are ignored: they only cost cache, never correctness.
+ */
+
+/* sync_file_range() is only declared by glibc's <fcntl.h> with GNU extensions */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
+#include "write_hints.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+    #define HAVE_SYNC_RANGE 1
+#else
+    #define HAVE_SYNC_RANGE 0
+#endif
+
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+    #define HAVE_FADVISE 1
+#else
+    #define HAVE_FADVISE 0
+#endif
+
+/* Wait for [start, start + len) to be on disk and drop it (len 0 = to the end) */
+static void drop_range(const WriteHints* h, uint64_t start, uint64_t len) {
+#if HAVE_SYNC_RANGE
+    sync_file_range(h->fd, (off_t)start, (off_t)len,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+#if HAVE_FADVISE
+    posix_fadvise(h->fd, (off_t)start, (off_t)len, POSIX_FADV_DONTNEED);
+#else
+    (void)h;
+    (void)start;
+    (void)len;
+#endif
+}
+
+void write_hints_begin(WriteHints* hints, FILE* f, int enabled) {
+    hints->fd = -1;
+    hints->pos = 0;
+    hints->started = 0;
+    hints->dropped = 0;
+#ifdef _WIN32
+    (void)f;
+    (void)enabled;
+#else
+    if (!enabled || !f) return;
+    hints->fd = fileno(f);
+#if defined(__APPLE__) && defined(F_NOCACHE)
+    fcntl(hints->fd, F_NOCACHE, 1);
+#endif
+#endif
+}
+
+void write_hints_wrote(WriteHints* hints, size_t size) {
+    if (hints->fd < 0) return;
+    hints->pos += size;
+
+    /* Start writeback of whole windows the cursor has left behind */
+    uint64_t written = hints->pos - hints->pos % WRITE_HINT_WINDOW;
+    if (written <= hints->started) return;
+#if HAVE_SYNC_RANGE
+    sync_file_range(hints->fd, (off_t)hints->started, (off_t)(written - hints->started),
+                    SYNC_FILE_RANGE_WRITE);
+#endif
+    hints->started = written;
+
+    /* Drop what was handed to writeback a window earlier */
+    uint64_t clean = written - WRITE_HINT_WINDOW;
+    if (clean > hints->dropped) {
+        drop_range(hints, hints->dropped, clean - hints->dropped);
+        hints->dropped = clean;
+    }
+}
+
+void write_hints_end(WriteHints* hints, FILE* f) {
+    if (hints->fd < 0) return;
+    fflush(f);
+    drop_range(hints, hints->dropped, 0);
+    hints->dropped = hints->pos;
+    hints->fd = -1;
+}
@@ -0,0 +1,64 @@
+/**
+ * Output Cache Hints - Internal Header
+ *
+ * Keeps an extracted file out of the page cache once it is on disk, so a
+ * restore of terabytes does not evict what other processes are using.
+ * Written data is handed to writeback a window at a time as the write
+ * cursor passes it (sync_file_range), and the window before that, by then
+ * clean, is dropped from the cache (POSIX_FADV_DONTNEED); at most two
+ * windows of a file stay cached while it is written, and none once it is
+ * closed. macOS writes such files past the cache (F_NOCACHE). Elsewhere
+ * only pages the kernel has already written back are dropped. Enabled by
+ * SevenZipExtractOptions.cache_neutral_output; a no-op on Windows.
+ */
+
+#ifndef SEVENZIP_WRITE_HINTS_H
+#define SEVENZIP_WRITE_HINTS_H
+
+#include "../include/7z_ffi.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Writeback unit, and the step in which written data is dropped */
+#define WRITE_HINT_WINDOW (8 * 1024 * 1024)
+
+typedef struct {
+    int fd;               /* -1 = hints off */
+    uint64_t pos;         /* Bytes of the file produced so far */
+    uint64_t started;     /* Writeback has been started below this offset */
+    uint64_t dropped;     /* Dropped from the page cache below this offset */
+} WriteHints;
+
+/**
+ * Start hinting a file just opened for writing from offset 0
+ * @param hints State to set up (always usable, also when disabled)
+ * @param f The output file
+ * @param enabled 0 turns every call into a no-op
+ */
+void write_hints_begin(WriteHints* hints, FILE* f, int enabled);
+
+/**
+ * Report `size` more bytes produced at the end of the file (written,
+ * seeked over as a hole, or copied by the kernel)
+ * Starts writeback of whole windows behind the cursor and drops the
+ * windows before them.
+ */
+void write_hints_wrote(WriteHints* hints, size_t size);
+
+/**
+ * The file is complete: flush it, write back what is left and drop all
+ * of it from the page cache; call before metadata is restored and the
+ * file is closed
+ */
+void write_hints_end(WriteHints* hints, FILE* f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_WRITE_HINTS_H */
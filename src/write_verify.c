@@ -0,0 +1,219 @@
+/**
+ * Write Verify
+ *
+ * Blocks carry stream bytes, or a Begin/End marker that opens or closes
+ * a stream, so the thread sees the streams in the order they were
+ * written. Decoded bytes collect in `out` until the filter has restored
+ * them; they are then added to the CRC and size of the stream, the
+ * branch look-ahead staying behind for the next block.
+ */
+
+#include "write_verify.h"
+#include "7zCrc.h"
+#include "mem_alloc.h"
+#include "thread_placement.h"
+
+#include <stdio.h>
+#include <string.h>
+
+enum {
+    VERIFY_DATA,
+    VERIFY_BEGIN,
+    VERIFY_END,
+    VERIFY_STOP
+};
+
+/* Thread: add restored output to the stream's CRC; with `final` the
+ * look-ahead too, which the encoder passed through unchanged */
+static void verify_restore(WriteVerify* v, int final) {
+    SizeT n = final ? v->out_filled : FilterDecoder_Convert(&v->filter, v->out, v->out_filled);
+    v->crc = CrcUpdate(v->crc, v->out, n);
+    v->size += n;
+    memmove(v->out, v->out + n, v->out_filled - n);
+    v->out_filled -= n;
+}
+
+/* Thread: decode bytes of the open stream */
+static void verify_decode(WriteVerify* v, const Byte* src, size_t size) {
+    if (v->broken) return;
+    if (v->finished) {
+        if (size > 0) v->broken = 1;
+        return;
+    }
+    for (;;) {
+        SizeT in_len = size;
+        SizeT out_len = FILTER_BUFFER_SIZE - v->out_filled;
+        ELzmaStatus status;
+        SRes res = Lzma2Dec_DecodeToBuf(&v->dec, v->out + v->out_filled, &out_len,
+                                        src, &in_len, LZMA_FINISH_ANY, &status);
+        src += in_len;
+        size -= in_len;
+        v->out_filled += out_len;
+        verify_restore(v, 0);
+        if (res != SZ_OK) {
+            v->broken = 1;
+            return;
+        }
+        if (status == LZMA_STATUS_FINISHED_WITH_MARK) {
+            v->finished = 1;
+            if (size > 0) v->broken = 1;
+            return;
+        }
+        if (in_len == 0 && out_len == 0) {
+            /* Stuck with input left: not LZMA2 */
+            if (size > 0) v->broken = 1;
+            return;
+        }
+    }
+}
+
+static void verify_begin_stream(WriteVerify* v, const VerifyBlock* blk) {
+    v->streams++;
+    v->dec_ready = Lzma2Dec_Allocate(&v->dec, blk->prop, &g_MemDecoderAlloc) == SZ_OK;
+    if (v->dec_ready) Lzma2Dec_Init(&v->dec);
+    FilterDecoder_Init(&v->filter, blk->filter, blk->delta_distance);
+    v->out_filled = 0;
+    v->crc = CRC_INIT_VAL;
+    v->size = 0;
+    v->finished = 0;
+    v->broken = !v->dec_ready;
+}
+
+static void verify_end_stream(WriteVerify* v, const VerifyBlock* blk) {
+    if (!v->broken) verify_restore(v, 1);
+    if (v->broken || !v->finished || v->size != blk->unpack_size ||
+        CRC_GET_DIGEST(v->crc) != blk->crc) {
+        fprintf(stderr, "Pack stream %zu does not decode to its input\n", v->streams);
+        v->failed = 1;
+    }
+}
+
+static THREAD_FUNC_DECL WriteVerify_Thread(void* arg) {
+    WriteVerify* v = (WriteVerify*)arg;
+    thread_sched_enter();
+
+    for (;;) {
+        Semaphore_Wait(&v->filled_slots);
+        VerifyBlock* blk = &v->blocks[v->head];
+        if (blk->kind == VERIFY_STOP) break;
+        if (!v->discard) {
+            switch (blk->kind) {
+                case VERIFY_BEGIN: verify_begin_stream(v, blk); break;
+                case VERIFY_END:   verify_end_stream(v, blk); break;
+                default:           verify_decode(v, blk->data, blk->size); break;
+            }
+        }
+        blk->size = 0;
+        v->head = (v->head + 1) % VERIFY_BLOCK_COUNT;
+        Semaphore_Release1(&v->free_slots);
+    }
+    return THREAD_FUNC_RET_ZERO;
+}
+
+/* Writer: the block being filled, acquired first if need be */
+static VerifyBlock* verify_acquire(WriteVerify* v) {
+    if (!v->tail_valid) {
+        /* Backpressure: blocks only when the decoder is a ring behind */
+        Semaphore_Wait(&v->free_slots);
+        v->tail_valid = 1;
+        v->blocks[v->tail].kind = VERIFY_DATA;
+        v->blocks[v->tail].size = 0;
+    }
+    return &v->blocks[v->tail];
+}
+
+/* Writer: hand the current block to the thread */
+static void verify_submit(WriteVerify* v) {
+    v->tail = (v->tail + 1) % VERIFY_BLOCK_COUNT;
+    v->tail_valid = 0;
+    Semaphore_Release1(&v->filled_slots);
+}
+
+SRes write_verify_start(WriteVerify* v) {
+    memset(v, 0, sizeof(*v));
+    Thread_CONSTRUCT(&v->thread)
+    Semaphore_Construct(&v->free_slots);
+    Semaphore_Construct(&v->filled_slots);
+    Lzma2Dec_CONSTRUCT(&v->dec);
+
+    v->out = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, FILTER_BUFFER_SIZE);
+    int ok = v->out != NULL;
+    for (UInt32 i = 0; ok && i < VERIFY_BLOCK_COUNT; i++) {
+        v->blocks[i].data = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, VERIFY_BLOCK_SIZE);
+        ok = v->blocks[i].data != NULL;
+    }
+    if (!ok) {
+        write_verify_stop(v, 1);
+        return SZ_ERROR_MEM;
+    }
+
+    if (Semaphore_Create(&v->free_slots, VERIFY_BLOCK_COUNT, VERIFY_BLOCK_COUNT) != 0 ||
+        Semaphore_Create(&v->filled_slots, 0, VERIFY_BLOCK_COUNT) != 0 ||
+        Thread_Create(&v->thread, WriteVerify_Thread, v) != 0) {
+        write_verify_stop(v, 1);
+        return SZ_ERROR_THREAD;
+    }
+    return SZ_OK;
+}
+
+void write_verify_begin(WriteVerify* v, Byte prop, SevenZipFilter filter, unsigned delta_distance) {
+    VerifyBlock* blk = verify_acquire(v);
+    blk->kind = VERIFY_BEGIN;
+    blk->prop = prop;
+    blk->filter = filter;
+    blk->delta_distance = delta_distance;
+    verify_submit(v);
+    v->active = 1;
+}
+
+int write_verify_feed(WriteVerify* v, const void* data, size_t size) {
+    const Byte* src = (const Byte*)data;
+    while (v->active && size > 0 && !v->failed) {
+        VerifyBlock* blk = verify_acquire(v);
+        size_t copy = VERIFY_BLOCK_SIZE - blk->size;
+        if (copy > size) copy = size;
+        memcpy(blk->data + blk->size, src, copy);
+        blk->size += copy;
+        src += copy;
+        size -= copy;
+        if (blk->size == VERIFY_BLOCK_SIZE) verify_submit(v);
+    }
+    return !v->failed;
+}
+
+void write_verify_end(WriteVerify* v, uint32_t crc, uint64_t unpack_size) {
+    if (!v->active) return;
+    if (v->tail_valid && v->blocks[v->tail].size > 0) verify_submit(v);
+    VerifyBlock* blk = verify_acquire(v);
+    blk->kind = VERIFY_END;
+    blk->crc = crc;
+    blk->unpack_size = unpack_size;
+    verify_submit(v);
+    v->active = 0;
+}
+
+int write_verify_stop(WriteVerify* v, int discard) {
+    if (Thread_WasCreated(&v->thread)) {
+        if (discard) {
+            v->discard = 1;
+        } else if (v->active) {
+            /* Never closed: its end mark and CRC went unchecked */
+            v->failed = 1;
+        }
+        /* A partly filled block goes unread */
+        VerifyBlock* blk = verify_acquire(v);
+        blk->kind = VERIFY_STOP;
+        verify_submit(v);
+        Thread_Wait_Close(&v->thread);
+    }
+    int ok = !v->failed;
+    if (Semaphore_IsCreated(&v->free_slots)) Semaphore_Close(&v->free_slots);
+    if (Semaphore_IsCreated(&v->filled_slots)) Semaphore_Close(&v->filled_slots);
+    for (UInt32 i = 0; i < VERIFY_BLOCK_COUNT; i++) {
+        mem_free(v->blocks[i].data);
+    }
+    mem_free(v->out);
+    Lzma2Dec_Free(&v->dec, &g_MemDecoderAlloc);
+    memset(v, 0, sizeof(*v));
+    return ok;
+}
@@ -0,0 +1,98 @@
+/**
+ * Write Verify - Internal Header
+ *
+ * SevenZipStreamOptions.verify_writes: the LZMA2 pack streams of a job
+ * are decoded on a thread of their own while they are written, so the
+ * archive is checked against the CRCs of its input without being read
+ * back. The writer copies each stream's bytes, before encryption, into a
+ * ring of VERIFY_BLOCK_COUNT blocks that the thread decodes in order;
+ * it only waits when the decoder falls that far behind. A stream whose
+ * data, size or end mark differ fails the job.
+ */
+
+#ifndef SEVENZIP_WRITE_VERIFY_H
+#define SEVENZIP_WRITE_VERIFY_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "Lzma2Dec.h"
+#include "Threads.h"
+#include "archive_filters.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VERIFY_BLOCK_SIZE (1024 * 1024)
+#define VERIFY_BLOCK_COUNT 8
+
+/* Ring and decoder memory besides the dictionary of the stream decoded */
+#define VERIFY_FIXED_MEMORY ((uint64_t)VERIFY_BLOCK_COUNT * VERIFY_BLOCK_SIZE + FILTER_BUFFER_SIZE)
+
+typedef struct {
+    int kind;
+    Byte* data;
+    size_t size;
+    Byte prop;                /* Begin: LZMA2 properties of the stream */
+    SevenZipFilter filter;    /* Begin: filter behind LZMA2 */
+    unsigned delta_distance;
+    uint32_t crc;             /* End: CRC of the stream's input */
+    uint64_t unpack_size;     /* End: its size */
+} VerifyBlock;
+
+typedef struct {
+    VerifyBlock blocks[VERIFY_BLOCK_COUNT];
+    UInt32 head;          /* Next block to decode (thread only) */
+    UInt32 tail;          /* Next block to fill (writer only) */
+    int tail_valid;       /* blocks[tail] has been acquired by the writer */
+    CSemaphore free_slots;
+    CSemaphore filled_slots;
+    CThread thread;
+    int active;           /* Writer: a stream is open */
+    volatile int discard; /* Writer gave up: queued blocks are skipped */
+    volatile int failed;  /* A stream did not decode to its input */
+    /* Thread side: stream in progress */
+    CLzma2Dec dec;
+    int dec_ready;        /* dec has probabilities and a dictionary */
+    FilterDecoder filter;
+    Byte* out;            /* FILTER_BUFFER_SIZE bytes of decoded output */
+    size_t out_filled;    /* Bytes of out the filter has yet to restore */
+    uint32_t crc;
+    uint64_t size;
+    int finished;         /* End mark seen */
+    int broken;           /* Corrupt data, or bytes past the end mark */
+    size_t streams;       /* Streams begun, for messages */
+} WriteVerify;
+
+/**
+ * Start the decoder thread
+ * @return SZ_OK, SZ_ERROR_MEM or SZ_ERROR_THREAD; `v` is then stopped
+ */
+SRes write_verify_start(WriteVerify* v);
+
+/* Open the next pack stream: LZMA2 with `prop`, behind `filter` */
+void write_verify_begin(WriteVerify* v, Byte prop, SevenZipFilter filter, unsigned delta_distance);
+
+/**
+ * Queue bytes of the open stream (nothing when none is open)
+ * @return 0 once a stream has failed
+ */
+int write_verify_feed(WriteVerify* v, const void* data, size_t size);
+
+/* Close the open stream, which must decode to `unpack_size` bytes of CRC `crc` */
+void write_verify_end(WriteVerify* v, uint32_t crc, uint64_t unpack_size);
+
+/**
+ * Stop the thread and free the ring and decoder
+ * @param discard 1 = skip what is still queued (the job failed)
+ * @return 1 if every stream decoded to its input
+ */
+int write_verify_stop(WriteVerify* v, int discard);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_WRITE_VERIFY_H */
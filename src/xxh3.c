@@ -0,0 +1,435 @@
+/**
+ * XXH3
+ *
+ * XXH3-128 of xxHash 0.8 with the default secret and seed 0. Inputs of up
+ * to 240 bytes are hashed from the buffer by the short mixers at the end;
+ * longer ones accumulate 64-byte stripes into eight 64-bit lanes, each
+ * stripe keyed by the secret 8 bytes further on, with the lanes scrambled
+ * after every 16 stripes and the last 64 bytes of input always added as a
+ * final stripe. The stripe loop is the only hot part, so it alone has
+ * AVX2 and SSE2 versions; the lanes stay in registers across a call.
+ */
+
+#include "xxh3.h"
+#include "CpuArch.h"
+
+#include <string.h>
+
+#if defined(MY_CPU_AMD64) || (defined(MY_CPU_X86) && defined(__SSE2__))
+    #define XXH3_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+#if defined(MY_CPU_AMD64) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+    #define XXH3_USE_AVX2
+    #include <immintrin.h>
+    #if defined(__GNUC__) || defined(__clang__)
+        #define XXH3_TARGET_AVX2 __attribute__((target("avx2")))
+    #else
+        #define XXH3_TARGET_AVX2
+    #endif
+#endif
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH3_STRIPE_LEN 64
+#define XXH3_SECRET_SIZE 192
+#define XXH3_SECRET_LIMIT (XXH3_SECRET_SIZE - XXH3_STRIPE_LEN)
+#define XXH3_BLOCK_STRIPES (XXH3_SECRET_LIMIT / 8)
+#define XXH3_MIDSIZE_MAX 240
+
+/* Default secret of the specification */
+static const Byte kSecret[XXH3_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
+};
+
+typedef struct {
+    UInt64 low;
+    UInt64 high;
+} Xxh128;
+
+/* Accumulate `stripes` consecutive stripes; stripe n is keyed by secret + 8n */
+typedef void (*Xxh3AccumulateFunc)(UInt64* acc, const Byte* input, const Byte* secret, size_t stripes);
+typedef void (*Xxh3ScrambleFunc)(UInt64* acc, const Byte* secret);
+
+static Xxh128 mul_64x64(UInt64 a, UInt64 b) {
+    Xxh128 r;
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    r.low = (UInt64)product;
+    r.high = (UInt64)(product >> 64);
+#else
+    UInt64 lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    UInt64 hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    UInt64 lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+    UInt64 hi_hi = (a >> 32) * (b >> 32);
+    UInt64 cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    r.low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+    r.high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+#endif
+    return r;
+}
+
+static UInt64 mul_fold64(UInt64 a, UInt64 b) {
+    Xxh128 product = mul_64x64(a, b);
+    return product.low ^ product.high;
+}
+
+static UInt64 xxh3_avalanche(UInt64 h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    return h ^ (h >> 32);
+}
+
+static UInt64 xxh64_avalanche(UInt64 h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+/* ---- Stripe loop ---- */
+
+#ifndef XXH3_USE_SSE2
+static void accumulate_scalar(UInt64* acc, const Byte* input, const Byte* secret, size_t stripes) {
+    for (size_t n = 0; n < stripes; n++) {
+        const Byte* in = input + n * XXH3_STRIPE_LEN;
+        const Byte* key = secret + n * 8;
+        for (unsigned lane = 0; lane < 8; lane++) {
+            UInt64 data = GetUi64(in + lane * 8);
+            UInt64 keyed = data ^ GetUi64(key + lane * 8);
+            acc[lane ^ 1] += data;
+            acc[lane] += (UInt64)(UInt32)keyed * (keyed >> 32);
+        }
+    }
+}
+
+static void scramble_scalar(UInt64* acc, const Byte* secret) {
+    for (unsigned lane = 0; lane < 8; lane++) {
+        UInt64 a = acc[lane];
+        a ^= a >> 47;
+        a ^= GetUi64(secret + lane * 8);
+        acc[lane] = a * XXH_PRIME32_1;
+    }
+}
+#endif
+
+#ifdef XXH3_USE_SSE2
+
+static void accumulate_sse2(UInt64* acc, const Byte* input, const Byte* secret, size_t stripes) {
+    __m128i a[4];
+    for (int i = 0; i < 4; i++) a[i] = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+    for (size_t n = 0; n < stripes; n++) {
+        const Byte* in = input + n * XXH3_STRIPE_LEN;
+        const Byte* key = secret + n * 8;
+        for (int i = 0; i < 4; i++) {
+            __m128i data = _mm_loadu_si128((const __m128i*)(in + 16 * i));
+            __m128i keyed = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(key + 16 * i)));
+            /* Low half of each lane times its high half */
+            __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+        }
+    }
+    for (int i = 0; i < 4; i++) _mm_storeu_si128((__m128i*)(acc + 2 * i), a[i]);
+}
+
+static void scramble_sse2(UInt64* acc, const Byte* secret) {
+    const __m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+    for (int i = 0; i < 4; i++) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(acc + 2 * i));
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm_storeu_si128((__m128i*)(acc + 2 * i), _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+    }
+}
+
+#endif
+
+#ifdef XXH3_USE_AVX2
+
+XXH3_TARGET_AVX2
+static void accumulate_avx2(UInt64* acc, const Byte* input, const Byte* secret, size_t stripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 4));
+    for (size_t n = 0; n < stripes; n++) {
+        const Byte* in = input + n * XXH3_STRIPE_LEN;
+        const Byte* key = secret + n * 8;
+        __m256i d0 = _mm256_loadu_si256((const __m256i*)in);
+        __m256i d1 = _mm256_loadu_si256((const __m256i*)(in + 32));
+        __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i*)key));
+        __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i*)(key + 32)));
+        __m256i p0 = _mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32));
+        __m256i p1 = _mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32));
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+    _mm256_storeu_si256((__m256i*)acc, a0);
+    _mm256_storeu_si256((__m256i*)(acc + 4), a1);
+}
+
+XXH3_TARGET_AVX2
+static void scramble_avx2(UInt64* acc, const Byte* secret) {
+    const __m256i prime = _mm256_set1_epi32((int)XXH_PRIME32_1);
+    for (int i = 0; i < 2; i++) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(acc + 4 * i));
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i*)(secret + 32 * i)));
+        __m256i lo = _mm256_mul_epu32(a, prime);
+        __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+        _mm256_storeu_si256((__m256i*)(acc + 4 * i), _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+    }
+}
+
+#endif
+
+#ifdef XXH3_USE_SSE2
+static Xxh3AccumulateFunc g_accumulate = accumulate_sse2;
+static Xxh3ScrambleFunc g_scramble = scramble_sse2;
+#else
+static Xxh3AccumulateFunc g_accumulate = accumulate_scalar;
+static Xxh3ScrambleFunc g_scramble = scramble_scalar;
+#endif
+
+void xxh3_prepare(void) {
+#ifdef XXH3_USE_AVX2
+    if (CPU_IsSupported_AVX2()) {
+        g_accumulate = accumulate_avx2;
+        g_scramble = scramble_avx2;
+    }
+#endif
+}
+
+int xxh3_uses_avx2(void) {
+#ifdef XXH3_USE_AVX2
+    return g_accumulate == accumulate_avx2;
+#else
+    return 0;
+#endif
+}
+
+/* Add whole stripes, scrambling at every block end; returns the input end */
+static const Byte* consume_stripes(UInt64* acc, size_t* block_stripes,
+                                   const Byte* input, size_t stripes) {
+    size_t room = XXH3_BLOCK_STRIPES - *block_stripes;
+    if (stripes >= room) {
+        const Byte* secret = kSecret + *block_stripes * 8;
+        do {
+            g_accumulate(acc, input, secret, room);
+            g_scramble(acc, kSecret + XXH3_SECRET_LIMIT);
+            input += room * XXH3_STRIPE_LEN;
+            stripes -= room;
+            room = XXH3_BLOCK_STRIPES;
+            secret = kSecret;
+        } while (stripes >= XXH3_BLOCK_STRIPES);
+        *block_stripes = 0;
+    }
+    if (stripes > 0) {
+        g_accumulate(acc, input, kSecret + *block_stripes * 8, stripes);
+        input += stripes * XXH3_STRIPE_LEN;
+        *block_stripes += stripes;
+    }
+    return input;
+}
+
+/* ---- Short inputs ---- */
+
+static UInt64 mix16(const Byte* input, const Byte* secret) {
+    return mul_fold64(GetUi64(input) ^ GetUi64(secret),
+                      GetUi64(input + 8) ^ GetUi64(secret + 8));
+}
+
+static void mix32(Xxh128* acc, const Byte* a, const Byte* b, const Byte* secret) {
+    acc->low += mix16(a, secret);
+    acc->low ^= GetUi64(b) + GetUi64(b + 8);
+    acc->high += mix16(b, secret + 16);
+    acc->high ^= GetUi64(a) + GetUi64(a + 8);
+}
+
+static Xxh128 finish_mid(Xxh128 acc, size_t len) {
+    Xxh128 h;
+    h.low = xxh3_avalanche(acc.low + acc.high);
+    h.high = (UInt64)0 - xxh3_avalanche(acc.low * XXH_PRIME64_1
+                                        + acc.high * XXH_PRIME64_4
+                                        + (UInt64)len * XXH_PRIME64_2);
+    return h;
+}
+
+static Xxh128 hash_short(const Byte* input, size_t len) {
+    const Byte* s = kSecret;
+    Xxh128 h;
+    if (len == 0) {
+        h.low = xxh64_avalanche(GetUi64(s + 64) ^ GetUi64(s + 72));
+        h.high = xxh64_avalanche(GetUi64(s + 80) ^ GetUi64(s + 88));
+    } else if (len <= 3) {
+        UInt32 lo = ((UInt32)input[0] << 16) | ((UInt32)input[len >> 1] << 24)
+                  | (UInt32)input[len - 1] | ((UInt32)len << 8);
+        UInt32 swapped = Z7_BSWAP32(lo);
+        UInt32 hi = (swapped << 13) | (swapped >> 19);
+        h.low = xxh64_avalanche(lo ^ (UInt64)(GetUi32(s) ^ GetUi32(s + 4)));
+        h.high = xxh64_avalanche(hi ^ (UInt64)(GetUi32(s + 8) ^ GetUi32(s + 12)));
+    } else if (len <= 8) {
+        UInt64 in64 = GetUi32(input) + ((UInt64)GetUi32(input + len - 4) << 32);
+        UInt64 keyed = in64 ^ (GetUi64(s + 16) ^ GetUi64(s + 24));
+        h = mul_64x64(keyed, XXH_PRIME64_1 + ((UInt64)len << 2));
+        h.high += h.low << 1;
+        h.low ^= h.high >> 3;
+        h.low ^= h.low >> 35;
+        h.low *= XXH_PRIME_MX2;
+        h.low ^= h.low >> 28;
+        h.high = xxh3_avalanche(h.high);
+    } else if (len <= 16) {
+        UInt64 flip_lo = GetUi64(s + 32) ^ GetUi64(s + 40);
+        UInt64 flip_hi = GetUi64(s + 48) ^ GetUi64(s + 56);
+        UInt64 in_lo = GetUi64(input);
+        UInt64 in_hi = GetUi64(input + len - 8);
+        Xxh128 m = mul_64x64(in_lo ^ in_hi ^ flip_lo, XXH_PRIME64_1);
+        m.low += (UInt64)(len - 1) << 54;
+        in_hi ^= flip_hi;
+        m.high += in_hi + (UInt64)(UInt32)in_hi * (XXH_PRIME32_2 - 1);
+        m.low ^= Z7_BSWAP64(m.high);
+        h = mul_64x64(m.low, XXH_PRIME64_2);
+        h.high += m.high * XXH_PRIME64_2;
+        h.low = xxh3_avalanche(h.low);
+        h.high = xxh3_avalanche(h.high);
+    } else if (len <= 128) {
+        Xxh128 acc;
+        acc.low = (UInt64)len * XXH_PRIME64_1;
+        acc.high = 0;
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) mix32(&acc, input + 48, input + len - 64, s + 96);
+                mix32(&acc, input + 32, input + len - 48, s + 64);
+            }
+            mix32(&acc, input + 16, input + len - 32, s + 32);
+        }
+        mix32(&acc, input, input + len - 16, s);
+        h = finish_mid(acc, len);
+    } else {
+        Xxh128 acc;
+        acc.low = (UInt64)len * XXH_PRIME64_1;
+        acc.high = 0;
+        for (size_t i = 32; i < 160; i += 32) {
+            mix32(&acc, input + i - 32, input + i - 16, s + i - 32);
+        }
+        acc.low = xxh3_avalanche(acc.low);
+        acc.high = xxh3_avalanche(acc.high);
+        for (size_t i = 160; i <= len; i += 32) {
+            mix32(&acc, input + i - 32, input + i - 16, s + 3 + i - 160);
+        }
+        mix32(&acc, input + len - 16, input + len - 32, s + 136 - 17 - 16);
+        h = finish_mid(acc, len);
+    }
+    return h;
+}
+
+/* ---- Streaming ---- */
+
+static UInt64 merge_accs(const UInt64* acc, const Byte* secret, UInt64 start) {
+    UInt64 result = start;
+    for (int i = 0; i < 4; i++) {
+        result += mul_fold64(acc[2 * i] ^ GetUi64(secret + 16 * i),
+                             acc[2 * i + 1] ^ GetUi64(secret + 16 * i + 8));
+    }
+    return xxh3_avalanche(result);
+}
+
+void xxh3_128_init(Xxh3State* state) {
+    static const UInt64 init_acc[8] = {
+        XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+        XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1
+    };
+    memcpy(state->acc, init_acc, sizeof(init_acc));
+    state->buffered = 0;
+    state->block_stripes = 0;
+    state->total_len = 0;
+}
+
+void xxh3_128_update(Xxh3State* state, const void* data, size_t size) {
+    const Byte* input = (const Byte*)data;
+    if (size == 0) return;
+    state->total_len += size;
+
+    if (size <= XXH3_BUFFER_SIZE - state->buffered) {
+        memcpy(state->buffer + state->buffered, input, size);
+        state->buffered += size;
+        return;
+    }
+
+    /* Input goes on past the buffer, so none of it is the last stripe */
+    if (state->buffered) {
+        size_t fill = XXH3_BUFFER_SIZE - state->buffered;
+        memcpy(state->buffer + state->buffered, input, fill);
+        input += fill;
+        size -= fill;
+        consume_stripes(state->acc, &state->block_stripes, state->buffer,
+                        XXH3_BUFFER_SIZE / XXH3_STRIPE_LEN);
+        state->buffered = 0;
+    }
+    if (size > XXH3_BUFFER_SIZE) {
+        const Byte* end = consume_stripes(state->acc, &state->block_stripes, input,
+                                          (size - 1) / XXH3_STRIPE_LEN);
+        size -= (size_t)(end - input);
+        input = end;
+        /* The stripe before what is kept, for a final stripe that reaches back */
+        memcpy(state->buffer + XXH3_BUFFER_SIZE - XXH3_STRIPE_LEN, input - XXH3_STRIPE_LEN,
+               XXH3_STRIPE_LEN);
+    }
+    memcpy(state->buffer, input, size);
+    state->buffered = size;
+}
+
+void xxh3_128_final(const Xxh3State* state, Byte* digest) {
+    Xxh128 h;
+    if (state->total_len > XXH3_MIDSIZE_MAX) {
+        UInt64 acc[8];
+        Byte last[XXH3_STRIPE_LEN];
+        const Byte* last_stripe;
+        memcpy(acc, state->acc, sizeof(acc));
+        if (state->buffered >= XXH3_STRIPE_LEN) {
+            size_t block_stripes = state->block_stripes;
+            consume_stripes(acc, &block_stripes, state->buffer,
+                            (state->buffered - 1) / XXH3_STRIPE_LEN);
+            last_stripe = state->buffer + state->buffered - XXH3_STRIPE_LEN;
+        } else {
+            size_t back = XXH3_STRIPE_LEN - state->buffered;
+            memcpy(last, state->buffer + XXH3_BUFFER_SIZE - back, back);
+            memcpy(last + back, state->buffer, state->buffered);
+            last_stripe = last;
+        }
+        g_accumulate(acc, last_stripe, kSecret + XXH3_SECRET_LIMIT - 7, 1);
+        h.low = merge_accs(acc, kSecret + 11, state->total_len * XXH_PRIME64_1);
+        h.high = merge_accs(acc, kSecret + XXH3_SECRET_SIZE - sizeof(acc) - 11,
+                            ~(state->total_len * XXH_PRIME64_2));
+    } else {
+        h = hash_short(state->buffer, (size_t)state->total_len);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        digest[i] = (Byte)(h.high >> (56 - 8 * i));
+        digest[8 + i] = (Byte)(h.low >> (56 - 8 * i));
+    }
+}
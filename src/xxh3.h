@@ -0,0 +1,52 @@
+/**
+ * XXH3 - Internal Header
+ *
+ * Streaming XXH3-128 (xxHash 0.8, default secret, seed 0) for change
+ * detection manifests. Not a cryptographic hash: it tells whether a file
+ * changed between runs at a fraction of the cost of SHA-256. The stripe
+ * loop runs on AVX2 or SSE2 where the CPU has them, as picked by
+ * xxh3_prepare(). Digests are in the canonical big-endian byte order
+ * printed by `xxhsum -H2`.
+ */
+
+#ifndef SEVENZIP_XXH3_H
+#define SEVENZIP_XXH3_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define XXH3_128_DIGEST_SIZE 16
+
+/* Input held back between updates: the last stripe is only known at the end */
+#define XXH3_BUFFER_SIZE 256
+
+typedef struct {
+    UInt64 acc[8];
+    Byte buffer[XXH3_BUFFER_SIZE];
+    size_t buffered;
+    size_t block_stripes;   /* Stripes of the current block done so far */
+    UInt64 total_len;
+} Xxh3State;
+
+/* Pick the stripe loop for this CPU (from global_tables_init()) */
+void xxh3_prepare(void);
+
+/* 1 when xxh3_prepare() picked the AVX2 stripe loop */
+int xxh3_uses_avx2(void);
+
+void xxh3_128_init(Xxh3State* state);
+void xxh3_128_update(Xxh3State* state, const void* data, size_t size);
+
+/* Store the digest of everything added so far; the state is unchanged */
+void xxh3_128_final(const Xxh3State* state, Byte* digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_XXH3_H */
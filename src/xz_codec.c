@@ -0,0 +1,406 @@
+/**
+ * XZ Compression and Decompression
+ *
+ * .xz files through the SDK's XzEnc and XzDecMt. The encoder compresses
+ * blocks of the input on several threads and writes the packed and
+ * unpacked size into every block header; the multi-threaded decoder needs
+ * those sizes to hand whole blocks to its threads.
+ */
+
+#include "../include/7z_ffi.h"
+#include "7zCrc.h"
+#include "Xz.h"
+#include "XzCrc64.h"
+#include "XzEnc.h"
+#include "Sha256.h"
+#include "mem_alloc.h"
+#include "packed_input.h"
+#include "thread_quota.h"
+#include "global_tables.h"
+#include "thread_placement.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define XZ_DEFAULT_THREADS 2         // Same default as the other coders
+#define XZ_MAX_THREADS 64
+#define XZ_MAX_DICT_SIZE ((uint64_t)3 << 29)  // 1.5GB, the LZMA limit
+#define XZ_DECODE_IN_BUF_SIZE (1 << 20)
+#define XZ_DECODE_OUT_STEP (4 << 20)  // Single-threaded decoder output per write
+#define XZ_FILE_BUF_SIZE (1 << 20)    // stdio buffer of the output file
+
+/* Read callback as a sequential input stream */
+typedef struct {
+    ISeqInStream vt;
+    SevenZipReadCallback read_callback;
+    void* user_data;
+} CallbackInStream;
+
+static SRes CallbackInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    CallbackInStream* p = Z7_CONTAINER_FROM_VTBL(pp, CallbackInStream, vt);
+    return p->read_callback(buf, size, p->user_data) == 0 ? SZ_OK : SZ_ERROR_READ;
+}
+
+/* Output to a file, or to a write callback when file is NULL */
+typedef struct {
+    ISeqOutStream vt;
+    FILE* file;
+    SevenZipWriteCallback write_callback;
+    void* user_data;
+} XzOutStream;
+
+static size_t XzOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    XzOutStream* p = Z7_CONTAINER_FROM_VTBL(pp, XzOutStream, vt);
+    if (p->file) {
+        return fwrite(data, 1, size, p->file);
+    }
+    return p->write_callback(data, size, p->user_data) == 0 ? size : 0;
+}
+
+/* Progress in input bytes of the coder (packed bytes when decoding) */
+typedef struct {
+    ICompressProgress vt;
+    SevenZipProgressCallback progress_callback;
+    uint64_t total;  /* 0 if unknown: the bytes so far are reported as the total */
+    void* user_data;
+} XzProgress;
+
+static SRes XzProgress_Progress(ICompressProgressPtr pp, UInt64 in_size, UInt64 out_size) {
+    XzProgress* p = Z7_CONTAINER_FROM_VTBL(pp, XzProgress, vt);
+    (void)out_size;
+    if (in_size != (UInt64)(Int64)-1) {
+        p->progress_callback(in_size, p->total ? p->total : in_size, p->user_data);
+    }
+    return SZ_OK;
+}
+
+static int xz_threads(const SevenZipXzOptions* options) {
+    int num_threads = options->num_threads;
+    if (num_threads <= 0) num_threads = thread_auto_count(XZ_DEFAULT_THREADS);
+    if (num_threads > XZ_MAX_THREADS) num_threads = XZ_MAX_THREADS;
+    return num_threads;
+}
+
+void sevenzip_xz_options_init(SevenZipXzOptions* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+    options->num_threads = 0;
+    options->dict_size = 0;
+    options->block_size = 0;
+    options->check = SEVENZIP_XZ_CHECK_CRC64;
+}
+
+/* Helper: XzEnc properties for a level and options */
+static void setup_xz_props(
+    CXzProps* props,
+    SevenZipCompressionLevel level,
+    const SevenZipXzOptions* opts,
+    UInt64 size
+) {
+    XzProps_Init(props);
+    CLzmaEncProps* lzma = &props->lzma2Props.lzmaProps;
+
+    switch (level) {
+        case SEVENZIP_LEVEL_STORE:
+            lzma->level = 0;
+            lzma->dictSize = 1 << 16;
+            break;
+        case SEVENZIP_LEVEL_FASTEST:
+            lzma->level = 1;
+            lzma->dictSize = 1 << 18;
+            break;
+        case SEVENZIP_LEVEL_FAST:
+            lzma->level = 3;
+            lzma->dictSize = 1 << 20;
+            break;
+        case SEVENZIP_LEVEL_NORMAL:
+            lzma->level = 5;
+            lzma->dictSize = 1 << 23;
+            break;
+        case SEVENZIP_LEVEL_MAXIMUM:
+            lzma->level = 7;
+            lzma->dictSize = 1 << 25;
+            break;
+        case SEVENZIP_LEVEL_ULTRA:
+            lzma->level = 9;
+            lzma->dictSize = 1 << 26;
+            break;
+        default:
+            lzma->level = 5;
+            lzma->dictSize = 1 << 23;
+    }
+    if (opts->dict_size > 0) {
+        lzma->dictSize = (UInt32)(opts->dict_size < XZ_MAX_DICT_SIZE ? opts->dict_size : XZ_MAX_DICT_SIZE);
+    }
+
+    /* Threads are split between blocks and the match finder of each block */
+    props->numTotalThreads = xz_threads(opts);
+    props->checkId = (unsigned)opts->check;
+    props->blockSize = opts->block_size;  /* 0 and UINT64_MAX are the SDK's auto and solid */
+    props->forceWriteSizesInHeader = opts->block_size != XZ_PROPS_BLOCK_SIZE_SOLID;
+    props->reduceSize = size;
+}
+
+/* Helper: Encode `in` into `out` */
+static SevenZipErrorCode xz_encode(
+    ISeqInStreamPtr in,
+    ISeqOutStreamPtr out,
+    UInt64 size,
+    SevenZipCompressionLevel level,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipXzOptions defaults;
+    if (!options) {
+        sevenzip_xz_options_init(&defaults);
+        options = &defaults;
+    }
+    if (options->check != SEVENZIP_XZ_CHECK_NONE && options->check != SEVENZIP_XZ_CHECK_CRC32 &&
+        options->check != SEVENZIP_XZ_CHECK_CRC64 && options->check != SEVENZIP_XZ_CHECK_SHA256) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+    global_tables_init();
+
+    CXzProps props;
+    setup_xz_props(&props, level, options, size);
+
+    ThreadPlacer placer;
+    CXzEncHandle encoder = thread_placer_init(&placer, SEVENZIP_NUMA_OFF)
+        ? XzEnc_Create(&placer.small, &placer.big)
+        : XzEnc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    if (!encoder) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    ThreadLease lease;
+    props.numTotalThreads = thread_lease_acquire(&lease, props.numTotalThreads, 0);
+    SRes res = XzEnc_SetProps(encoder, &props);
+    if (res == SZ_OK) {
+        if (size != (UInt64)(Int64)-1) XzEnc_SetDataSize(encoder, size);
+        XzProgress progress;
+        progress.vt.Progress = XzProgress_Progress;
+        progress.progress_callback = progress_callback;
+        progress.total = (size != (UInt64)(Int64)-1) ? size : 0;
+        progress.user_data = user_data;
+        res = XzEnc_Encode(encoder, out, in, progress_callback ? &progress.vt : NULL);
+    }
+    XzEnc_Destroy(encoder);
+    thread_lease_release(&lease);
+
+    if (res == SZ_ERROR_MEM) return SEVENZIP_ERROR_MEMORY;
+    if (res == SZ_ERROR_PARAM) return SEVENZIP_ERROR_INVALID_PARAM;
+    return res == SZ_OK ? SEVENZIP_OK : SEVENZIP_ERROR_COMPRESS;
+}
+
+/* Helper: Decode the .xz streams of `in` into `out` */
+static SevenZipErrorCode xz_decode(
+    ISeqInStreamPtr in,
+    ISeqOutStreamPtr out,
+    UInt64 packed_size,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    SevenZipXzOptions defaults;
+    if (!options) {
+        sevenzip_xz_options_init(&defaults);
+        options = &defaults;
+    }
+    global_tables_init();
+
+    ThreadPlacer placer;
+    CXzDecMtHandle decoder = thread_placer_init_decoder(&placer, &g_MemDecoderAlloc)
+        ? XzDecMt_Create(&placer.small, &placer.big)
+        : XzDecMt_Create(&g_MemDecoderAlloc, &g_MemDecoderAlloc);
+    if (!decoder) {
+        return SEVENZIP_ERROR_MEMORY;
+    }
+
+    CXzDecMtProps props;
+    XzDecMtProps_Init(&props);
+    ThreadLease lease;
+    props.numThreads = (unsigned)thread_lease_acquire(&lease, xz_threads(options), 0);
+    props.inBufSize_ST = XZ_DECODE_IN_BUF_SIZE;
+    props.outStep_ST = XZ_DECODE_OUT_STEP;
+
+    XzProgress progress;
+    progress.vt.Progress = XzProgress_Progress;
+    progress.progress_callback = progress_callback;
+    progress.total = packed_size;
+    progress.user_data = user_data;
+
+    CXzStatInfo stat;
+    int is_mt = 0;
+    SRes res = XzDecMt_Decode(decoder, &props, NULL, 1, out, in, &stat, &is_mt,
+                              progress_callback ? &progress.vt : NULL);
+    XzDecMt_Destroy(decoder);
+    thread_lease_release(&lease);
+
+    switch (res) {
+        case SZ_OK:
+            /* Bytes after the last stream that do not start another one */
+            return stat.DataAfterEnd ? SEVENZIP_ERROR_INVALID_ARCHIVE : SEVENZIP_OK;
+        case SZ_ERROR_MEM:
+            return SEVENZIP_ERROR_MEMORY;
+        case SZ_ERROR_NO_ARCHIVE:
+        case SZ_ERROR_ARCHIVE:
+        case SZ_ERROR_UNSUPPORTED:
+        case SZ_ERROR_INPUT_EOF:
+            return SEVENZIP_ERROR_INVALID_ARCHIVE;
+        default:
+            return SEVENZIP_ERROR_EXTRACT;  /* Data or check errors, read or write failures */
+    }
+}
+
+SevenZipErrorCode sevenzip_compress_xz(
+    const char* input_path,
+    const char* xz_path,
+    SevenZipCompressionLevel level,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!input_path || !xz_path) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    // Open input file (mapped when possible)
+    PackedInput in;
+    if (!packed_input_open(&in, input_path)) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    UInt64 size = (in.end != UINT64_MAX) ? in.size : (UInt64)(Int64)-1;
+
+    // Open output file
+    FILE* out_file = fopen(xz_path, "wb");
+    if (!out_file) {
+        packed_input_close(&in);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    setvbuf(out_file, NULL, _IOFBF, XZ_FILE_BUF_SIZE);
+
+    PackedSeqInStream in_stream;
+    packed_seq_in_stream_init(&in_stream, &in);
+    XzOutStream out_stream;
+    out_stream.vt.Write = XzOutStream_Write;
+    out_stream.file = out_file;
+    out_stream.write_callback = NULL;
+    out_stream.user_data = NULL;
+
+    SevenZipErrorCode result = xz_encode(&in_stream.vt, &out_stream.vt, size, level, options,
+                                         progress_callback, user_data);
+
+    packed_input_close(&in);
+    if (fclose(out_file) != 0 && result == SEVENZIP_OK) {
+        result = SEVENZIP_ERROR_COMPRESS;
+    }
+
+    // Remove output file on error
+    if (result != SEVENZIP_OK) {
+        remove(xz_path);
+    }
+
+    return result;
+}
+
+SevenZipErrorCode sevenzip_decompress_xz(
+    const char* xz_path,
+    const char* output_path,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!xz_path || !output_path) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    // Open input file (mapped when possible)
+    PackedInput in;
+    if (!packed_input_open(&in, xz_path)) {
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+
+    // Open output file
+    FILE* out_file = fopen(output_path, "wb");
+    if (!out_file) {
+        packed_input_close(&in);
+        return SEVENZIP_ERROR_OPEN_FILE;
+    }
+    setvbuf(out_file, NULL, _IOFBF, XZ_FILE_BUF_SIZE);
+
+    PackedSeqInStream in_stream;
+    packed_seq_in_stream_init(&in_stream, &in);
+    XzOutStream out_stream;
+    out_stream.vt.Write = XzOutStream_Write;
+    out_stream.file = out_file;
+    out_stream.write_callback = NULL;
+    out_stream.user_data = NULL;
+
+    SevenZipErrorCode result = xz_decode(&in_stream.vt, &out_stream.vt,
+                                         (in.end != UINT64_MAX) ? in.size : 0, options,
+                                         progress_callback, user_data);
+
+    packed_input_close(&in);
+    if (fclose(out_file) != 0 && result == SEVENZIP_OK) {
+        result = SEVENZIP_ERROR_EXTRACT;
+    }
+
+    // Remove output file on error
+    if (result != SEVENZIP_OK) {
+        remove(output_path);
+    }
+
+    return result;
+}
+
+SevenZipErrorCode sevenzip_compress_xz_stream(
+    SevenZipReadCallback read_callback,
+    SevenZipWriteCallback write_callback,
+    SevenZipCompressionLevel level,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!read_callback || !write_callback) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    CallbackInStream in_stream;
+    in_stream.vt.Read = CallbackInStream_Read;
+    in_stream.read_callback = read_callback;
+    in_stream.user_data = user_data;
+    XzOutStream out_stream;
+    out_stream.vt.Write = XzOutStream_Write;
+    out_stream.file = NULL;
+    out_stream.write_callback = write_callback;
+    out_stream.user_data = user_data;
+
+    return xz_encode(&in_stream.vt, &out_stream.vt, (UInt64)(Int64)-1, level, options,
+                     progress_callback, user_data);
+}
+
+SevenZipErrorCode sevenzip_decompress_xz_stream(
+    SevenZipReadCallback read_callback,
+    SevenZipWriteCallback write_callback,
+    const SevenZipXzOptions* options,
+    SevenZipProgressCallback progress_callback,
+    void* user_data
+) {
+    if (!read_callback || !write_callback) {
+        return SEVENZIP_ERROR_INVALID_PARAM;
+    }
+
+    CallbackInStream in_stream;
+    in_stream.vt.Read = CallbackInStream_Read;
+    in_stream.read_callback = read_callback;
+    in_stream.user_data = user_data;
+    XzOutStream out_stream;
+    out_stream.vt.Write = XzOutStream_Write;
+    out_stream.file = NULL;
+    out_stream.write_callback = write_callback;
+    out_stream.user_data = user_data;
+
+    return xz_decode(&in_stream.vt, &out_stream.vt, 0, options, progress_callback, user_data);
+}
@@ -0,0 +1,272 @@
+/**
+ * Zero Runs
+ *
+ * Zero units are only counted while a run is still shorter than
+ * ZERO_RUN_MIN: if data ends it early they are handed to the encoder
+ * after all, written out of nothing. The encoder output passes through a
+ * stream that keeps its last byte back, which is how the end marker of
+ * every segment before a run is dropped.
+ */
+
+#include "zero_runs.h"
+#include "sparse_output.h"
+#include "mem_alloc.h"
+
+#include <string.h>
+
+/* Zeros for the precomputed chunks */
+typedef struct {
+    ISeqInStream vt;
+    size_t left;
+} ZeroInStream;
+
+static SRes ZeroInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    ZeroInStream* p = Z7_CONTAINER_FROM_VTBL(pp, ZeroInStream, vt);
+    if (*size > p->left) *size = p->left;
+    memset(buf, 0, *size);
+    p->left -= *size;
+    return SZ_OK;
+}
+
+/* Growing buffer for the precomputed chunks */
+typedef struct {
+    ISeqOutStream vt;
+    Byte* data;
+    size_t size;
+    size_t capacity;
+} BufferOutStream;
+
+static size_t BufferOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    BufferOutStream* p = Z7_CONTAINER_FROM_VTBL(pp, BufferOutStream, vt);
+    if (p->size + size > p->capacity) {
+        size_t grown = p->capacity ? p->capacity * 2 : 4096;
+        while (grown < p->size + size) grown *= 2;
+        Byte* data_grown = (Byte*)mem_realloc(SEVENZIP_MEM_IO_BUFFERS, p->data, grown);
+        if (!data_grown) return 0;
+        p->data = data_grown;
+        p->capacity = grown;
+    }
+    memcpy(p->data + p->size, data, size);
+    p->size += size;
+    return size;
+}
+
+/* `size` zeros as LZMA2 chunks, the end marker dropped */
+static SRes encode_zeros(size_t size, Byte** data, size_t* data_size) {
+    CLzma2EncHandle enc = Lzma2Enc_Create(&g_MemEncoderAlloc, &g_MemMatchFinderAlloc);
+    if (!enc) return SZ_ERROR_MEM;
+    CLzma2EncProps props;
+    Lzma2EncProps_Init(&props);
+    props.lzmaProps.level = 1;
+    props.lzmaProps.dictSize = ZERO_RUN_UNIT;
+    props.numTotalThreads = 1;
+    props.blockSize = LZMA2_ENC_PROPS_BLOCK_SIZE_SOLID;
+    Lzma2EncProps_Normalize(&props);
+    Lzma2Enc_SetDataSize(enc, size);
+    SRes res = Lzma2Enc_SetProps(enc, &props);
+
+    ZeroInStream in;
+    in.vt.Read = ZeroInStream_Read;
+    in.left = size;
+    BufferOutStream out;
+    memset(&out, 0, sizeof(out));
+    out.vt.Write = BufferOutStream_Write;
+    if (res == SZ_OK) res = Lzma2Enc_Encode2(enc, &out.vt, NULL, NULL, &in.vt, NULL, 0, NULL);
+    Lzma2Enc_Destroy(enc);
+    if (res == SZ_OK && (out.size < 2 || out.data[out.size - 1] != 0)) res = SZ_ERROR_FAIL;
+    if (res != SZ_OK) {
+        mem_free(out.data);
+        return res;
+    }
+    *data = out.data;
+    *data_size = out.size - 1;
+    return SZ_OK;
+}
+
+SRes zero_run_chunks_init(ZeroRunChunks* chunks) {
+    memset(chunks, 0, sizeof(*chunks));
+    SRes res = encode_zeros(ZERO_RUN_BIG, &chunks->big, &chunks->big_size);
+    if (res == SZ_OK) res = encode_zeros(ZERO_RUN_UNIT, &chunks->unit, &chunks->unit_size);
+    if (res != SZ_OK) zero_run_chunks_free(chunks);
+    return res;
+}
+
+void zero_run_chunks_free(ZeroRunChunks* chunks) {
+    mem_free(chunks->big);
+    mem_free(chunks->unit);
+    memset(chunks, 0, sizeof(*chunks));
+}
+
+/* Encoder input: `in` up to the next run */
+typedef struct {
+    ISeqInStream vt;
+    ISeqInStreamPtr src;
+    Byte* unit;            /* Last unit read that is not part of a run */
+    size_t unit_size;
+    size_t unit_pos;
+    UInt64 zeros;          /* Zero units read, not yet a run */
+    UInt64 zeros_out;      /* Zeros that turned out to be data, still to hand out */
+    UInt64 run;            /* Run the current segment stopped at (0 = none) */
+    int src_end;
+    SRes res;
+} SplitInStream;
+
+/* The next unit of `src`, or fewer bytes at its end */
+static SRes split_read_unit(SplitInStream* p, size_t* got) {
+    *got = 0;
+    while (*got < ZERO_RUN_UNIT) {
+        size_t n = ZERO_RUN_UNIT - *got;
+        SRes res = ISeqInStream_Read(p->src, p->unit + *got, &n);
+        if (res != SZ_OK) return res;
+        if (n == 0) {
+            p->src_end = 1;
+            break;
+        }
+        *got += n;
+    }
+    return SZ_OK;
+}
+
+static SRes SplitInStream_Read(ISeqInStreamPtr pp, void* buf, size_t* size) {
+    SplitInStream* p = Z7_CONTAINER_FROM_VTBL(pp, SplitInStream, vt);
+    size_t want = *size;
+    *size = 0;
+    if (want == 0) return SZ_OK;
+    for (;;) {
+        if (p->zeros_out > 0) {
+            size_t n = want < p->zeros_out ? want : (size_t)p->zeros_out;
+            memset(buf, 0, n);
+            p->zeros_out -= n;
+            *size = n;
+            return SZ_OK;
+        }
+        if (p->unit_pos < p->unit_size) {
+            size_t n = p->unit_size - p->unit_pos;
+            if (n > want) n = want;
+            memcpy(buf, p->unit + p->unit_pos, n);
+            p->unit_pos += n;
+            *size = n;
+            return SZ_OK;
+        }
+        if (p->run > 0 || p->src_end) return SZ_OK;
+
+        size_t got;
+        p->res = split_read_unit(p, &got);
+        if (p->res != SZ_OK) return p->res;
+        if (got == ZERO_RUN_UNIT && sparse_is_zero(p->unit, got)) {
+            p->zeros += got;
+            if (p->zeros >= ZERO_RUN_MIN) {
+                p->run = p->zeros;
+                p->zeros = 0;
+            }
+            continue;
+        }
+        /* Data ends the zeros held back: they are data too */
+        p->zeros_out = p->zeros;
+        p->zeros = 0;
+        p->unit_size = got;
+        p->unit_pos = 0;
+    }
+}
+
+/* Read the rest of the run the segment stopped at; its length */
+static SRes split_take_run(SplitInStream* p, UInt64* run) {
+    *run = p->run;
+    p->run = 0;
+    while (!p->src_end) {
+        size_t got;
+        SRes res = split_read_unit(p, &got);
+        if (res != SZ_OK) return res;
+        if (got == ZERO_RUN_UNIT && sparse_is_zero(p->unit, got)) {
+            *run += got;
+            continue;
+        }
+        p->unit_size = got;
+        p->unit_pos = 0;
+        break;
+    }
+    return SZ_OK;
+}
+
+/* Output that keeps its last byte back */
+typedef struct {
+    ISeqOutStream vt;
+    ISeqOutStreamPtr out;
+    Byte last;
+    int has_last;
+} HeldOutStream;
+
+static size_t HeldOutStream_Write(ISeqOutStreamPtr pp, const void* data, size_t size) {
+    HeldOutStream* p = Z7_CONTAINER_FROM_VTBL(pp, HeldOutStream, vt);
+    if (size == 0) return 0;
+    if (p->has_last && ISeqOutStream_Write(p->out, &p->last, 1) != 1) return 0;
+    if (size > 1 && ISeqOutStream_Write(p->out, data, size - 1) != size - 1) return 0;
+    p->last = ((const Byte*)data)[size - 1];
+    p->has_last = 1;
+    return size;
+}
+
+static SRes write_pieces(HeldOutStream* out, const Byte* piece, size_t piece_size, UInt64 count) {
+    for (; count > 0; count--) {
+        if (HeldOutStream_Write(&out->vt, piece, piece_size) != piece_size) return SZ_ERROR_WRITE;
+    }
+    return SZ_OK;
+}
+
+SRes zero_run_encode(CLzma2EncHandle enc, const CLzma2EncProps* props, UInt64 data_size,
+                     ISeqOutStreamPtr out, ISeqInStreamPtr in, ICompressProgressPtr progress,
+                     const ZeroRunChunks* chunks, UInt64* zero_bytes) {
+    if (zero_bytes) *zero_bytes = 0;
+    SplitInStream split;
+    memset(&split, 0, sizeof(split));
+    split.vt.Read = SplitInStream_Read;
+    split.src = in;
+    split.unit = (Byte*)mem_alloc(SEVENZIP_MEM_IO_BUFFERS, ZERO_RUN_UNIT);
+    if (!split.unit) return SZ_ERROR_MEM;
+
+    HeldOutStream held;
+    held.vt.Write = HeldOutStream_Write;
+    held.out = out;
+    held.has_last = 0;
+
+    SRes res = SZ_OK;
+    for (int segment = 0;; segment++) {
+        if (segment > 0) {
+            Lzma2Enc_SetDataSize(enc, data_size);
+            res = Lzma2Enc_SetProps(enc, props);
+            if (res != SZ_OK) break;
+        }
+        res = Lzma2Enc_Encode2(enc, &held.vt, NULL, NULL, &split.vt, NULL, 0, progress);
+        if (res == SZ_OK) res = split.res;
+        if (res != SZ_OK || split.run == 0) break;
+
+        /* The run goes where the segment's end marker was */
+        if (!held.has_last || held.last != 0) {
+            res = SZ_ERROR_FAIL;
+            break;
+        }
+        held.has_last = 0;
+        UInt64 run;
+        res = split_take_run(&split, &run);
+        if (res == SZ_OK) res = write_pieces(&held, chunks->big, chunks->big_size, run / ZERO_RUN_BIG);
+        if (res == SZ_OK) {
+            res = write_pieces(&held, chunks->unit, chunks->unit_size,
+                               (run % ZERO_RUN_BIG) / ZERO_RUN_UNIT);
+        }
+        if (res != SZ_OK) break;
+        if (zero_bytes) *zero_bytes += run;
+
+        /* A run at the end of the input ends the stream itself */
+        if (split.src_end && split.unit_pos == split.unit_size) {
+            Byte end = 0;
+            if (HeldOutStream_Write(&held.vt, &end, 1) != 1) res = SZ_ERROR_WRITE;
+            break;
+        }
+    }
+
+    if (res == SZ_OK && held.has_last && ISeqOutStream_Write(out, &held.last, 1) != 1) {
+        res = SZ_ERROR_WRITE;
+    }
+    mem_free(split.unit);
+    return res;
+}
@@ -0,0 +1,65 @@
+/**
+ * Zero Runs - Internal Header
+ *
+ * Fast path of SevenZipStreamOptions.zero_blocks for disk and memory
+ * images. The encoder input is read in ZERO_RUN_UNIT units; once
+ * ZERO_RUN_MIN bytes of whole zero units follow each other, the encoder
+ * is given the end of its input there and the run goes out as LZMA2
+ * chunks encoded once per job, without a match finder ever seeing it.
+ * Every such chunk resets the dictionary, as the blocks of a
+ * multithreaded Lzma2Enc do, so the result is one ordinary LZMA2 stream
+ * that any decoder reads; the data after a run starts from an empty
+ * dictionary, which only long runs are worth.
+ */
+
+#ifndef SEVENZIP_ZERO_RUNS_H
+#define SEVENZIP_ZERO_RUNS_H
+
+#include "../include/7z_ffi.h"
+#include "7zTypes.h"
+#include "Lzma2Enc.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Units the input is scanned in, from the start of the encoder input */
+#define ZERO_RUN_UNIT (64 << 10)
+
+/* Shortest run taken out of the encoder */
+#define ZERO_RUN_MIN (1 << 20)
+
+/* Zeros per large precomputed piece: LZMA2's largest chunk */
+#define ZERO_RUN_BIG (2 << 20)
+
+/* LZMA2 chunks of ZERO_RUN_BIG and ZERO_RUN_UNIT zeros, without end marker */
+typedef struct {
+    Byte* big;
+    size_t big_size;
+    Byte* unit;
+    size_t unit_size;
+} ZeroRunChunks;
+
+/* Encode the chunks; SZ_ERROR_MEM on failure */
+SRes zero_run_chunks_init(ZeroRunChunks* chunks);
+
+void zero_run_chunks_free(ZeroRunChunks* chunks);
+
+/**
+ * Lzma2Enc_Encode2 with the zero runs of `in` taken out
+ * The caller has set `props` and `data_size` on `enc` for the first
+ * segment (and read its property byte); later segments are set up the
+ * same way, so the property byte holds for the whole stream.
+ * @param zero_bytes Receives the bytes that went out as chunks (may be NULL)
+ * @return As Lzma2Enc_Encode2
+ */
+SRes zero_run_encode(CLzma2EncHandle enc, const CLzma2EncProps* props, UInt64 data_size,
+                     ISeqOutStreamPtr out, ISeqInStreamPtr in, ICompressProgressPtr progress,
+                     const ZeroRunChunks* chunks, UInt64* zero_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEVENZIP_ZERO_RUNS_H */
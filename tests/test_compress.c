@@ -3,11 +3,15 @@
  */
 
 #include "../include/7z_ffi.h"
+#include "../src/memory_pressure.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <poll.h>
 
 /* Test utilities */
 #define TEST_ASSERT(condition, message) \
@@ -113,6 +117,93 @@ static int test_get_version() {
     return 1;
 }
 
+/* Test: CPU kernel report */
+static int test_cpu_features() {
+    SevenZipCpuFeatures features;
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_get_cpu_features(NULL), "NULL rejected");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_cpu_features(&features), "Features reported");
+
+    printf("  crc32_hw=%d aes_hw=%d aes_vaes_avx2=%d sha256_hw=%d match_finder_bits=%d xxh3_avx2=%d lzma_dec_asm=%d\n",
+           features.crc32_hw, features.aes_hw, features.aes_vaes_avx2, features.sha256_hw,
+           features.match_finder_bits, features.xxh3_avx2, features.lzma_dec_asm);
+    TEST_ASSERT(!features.aes_vaes_avx2 || features.aes_hw, "VAES only on top of AES-NI");
+    TEST_ASSERT(features.match_finder_bits == 0 || features.match_finder_bits == 128 ||
+                features.match_finder_bits == 256, "Match-finder width");
+
+    /* The choice is made once: a second report is the same */
+    SevenZipCpuFeatures again;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_cpu_features(&again), "Features reported again");
+    TEST_ASSERT(memcmp(&features, &again, sizeof(features)) == 0, "Same kernels");
+
+    /* Auto thread counts: affinity and cgroup quota only ever take CPUs away */
+    int threads = sevenzip_hardware_threads();
+    printf("  hardware_threads=%d\n", threads);
+    TEST_ASSERT(threads >= 1 && threads <= sysconf(_SC_NPROCESSORS_ONLN), "Threads within those online");
+    return 1;
+}
+
+/* Test: Kernel variants agree with each other and dispatch picked one of each */
+static int test_kernel_variants() {
+    SevenZipKernelVariant variants[SEVENZIP_MAX_KERNEL_VARIANTS];
+    size_t count = sevenzip_kernel_variants(variants, SEVENZIP_MAX_KERNEL_VARIANTS);
+    TEST_ASSERT(count >= 5 && count <= SEVENZIP_MAX_KERNEL_VARIANTS, "Variants listed");
+    TEST_ASSERT_EQUALS(count, sevenzip_kernel_variants(NULL, 0), "Counted without an array");
+
+    static _Alignas(32) unsigned char data[8192];
+    static _Alignas(32) unsigned char work[8192];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (unsigned char)(i * 31 + (i >> 7));
+
+    int in_use[5] = {0, 0, 0, 0, 0};
+    uint32_t first_check[5] = {0, 0, 0, 0, 0};
+    int seen[5] = {0, 0, 0, 0, 0};
+    for (size_t i = 0; i < count; i++) {
+        SevenZipKernel k = variants[i].kernel;
+        TEST_ASSERT(k <= SEVENZIP_KERNEL_MATCH_FINDER && variants[i].name != NULL, "Known kernel");
+        in_use[k] += variants[i].in_use;
+        memcpy(work, data, sizeof(work));
+        uint32_t check = 0;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_kernel_run(i, work, sizeof(work), &check), "Variant runs");
+        /* Every version of a kernel computes the same thing (the match finders differ) */
+        if (k != SEVENZIP_KERNEL_MATCH_FINDER) {
+            if (seen[k]) TEST_ASSERT(check == first_check[k], "Same result as the portable version");
+            first_check[k] = check;
+        }
+        seen[k] = 1;
+    }
+    TEST_ASSERT(in_use[SEVENZIP_KERNEL_CRC32] == 1 && in_use[SEVENZIP_KERNEL_AES_CBC_ENCODE] == 1 &&
+                in_use[SEVENZIP_KERNEL_AES_CBC_DECODE] == 1 && in_use[SEVENZIP_KERNEL_SHA256] == 1,
+                "One version of each picked");
+    TEST_ASSERT(seen[SEVENZIP_KERNEL_MATCH_FINDER], "Match finder listed");
+
+    /* CRC-32 of the portable version is the library's CRC */
+    uint32_t check = 0;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_kernel_run(0, (void*)"123456789", 9, &check), "CRC of the check string");
+    TEST_ASSERT(check == 0xCBF43926u, "CRC-32 check value");
+
+    /* Decoders agree on a buffer 16- but not 32-byte aligned too */
+    int decoded = 0;
+    uint32_t offset_check = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (variants[i].kernel != SEVENZIP_KERNEL_AES_CBC_DECODE) continue;
+        memcpy(work, data, sizeof(work));
+        uint32_t c = 0;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_kernel_run(i, work + 16, 4096, &c), "Decode at a 16-byte offset");
+        if (decoded) TEST_ASSERT(c == offset_check, "Same result at a 16-byte offset");
+        offset_check = c;
+        decoded = 1;
+    }
+
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_kernel_run(count, work, 16, NULL), "Unknown variant");
+    for (size_t i = 0; i < count; i++) {
+        if (variants[i].kernel != SEVENZIP_KERNEL_AES_CBC_ENCODE) continue;
+        TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_kernel_run(i, work + 1, 32, NULL),
+                           "Unaligned AES buffer");
+        TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_kernel_run(i, work, 20, NULL),
+                           "AES buffer of partial blocks");
+    }
+    return 1;
+}
+
 /* Test: Compress single file (Store level) */
 static int test_compress_store() {
     sevenzip_init();
@@ -232,7 +323,7 @@ static int test_stream_options_init() {
     sevenzip_stream_options_init(&opts);
     
     TEST_ASSERT(opts.num_threads >= 0, "Thread count valid");
-    TEST_ASSERT(opts.dict_size >= 0, "Dict size valid");
+    TEST_ASSERT(opts.dict_size != UINT64_MAX, "Dict size initialized");
     TEST_ASSERT(opts.solid == 0 || opts.solid == 1, "Solid flag valid");
     TEST_ASSERT(opts.split_size == 0, "Split size initialized");
     TEST_ASSERT(opts.chunk_size > 0, "Chunk size set");
@@ -282,6 +373,9 @@ static int test_compression_levels() {
         
         TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compression at level");
         TEST_ASSERT(file_exists(output_file), "Output file created");
+        if (levels[i] != SEVENZIP_LEVEL_STORE) {
+            TEST_ASSERT(get_file_size(output_file) < input_size, "Output smaller than input");
+        }
         
         unlink(output_file);
     }
@@ -291,8 +385,3673 @@ static int test_compression_levels() {
     return 1;
 }
 
-/* Main test runner */
-int main(int argc, char** argv) {
+/* Stress: threads initialize, create and verify archives all at once */
+#define STRESS_THREADS 8
+#define STRESS_ROUNDS 3
+
+typedef struct {
+    int index;
+    int failures;
+} StressWorker;
+
+static void* stress_worker(void* arg) {
+    StressWorker* w = (StressWorker*)arg;
+    char input_file[64];
+    char archive_file[64];
+    snprintf(input_file, sizeof(input_file), "/tmp/test_concurrent_%d.txt", w->index);
+    snprintf(archive_file, sizeof(archive_file), "/tmp/test_concurrent_%d.7z", w->index);
+    
+    /* First use of the tables races with the other threads' */
+    if (sevenzip_init() != SEVENZIP_OK) w->failures++;
+    
+    FILE* f = fopen(input_file, "w");
+    if (!f) {
+        w->failures++;
+        return NULL;
+    }
+    for (int i = 0; i < 2000; i++) {
+        fprintf(f, "Thread %d line %d: concurrent calls share the library.\n", w->index, i);
+    }
+    fclose(f);
+    
+    /* Odd threads encrypt, so AES and SHA-256 setup is raced as well */
+    const char* password = (w->index & 1) ? "stress-password" : NULL;
+    SevenZipCompressOptions options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 2;
+    options.solid = 1;
+    options.password = password;
+    
+    const char* inputs[] = {input_file, NULL};
+    for (int round = 0; round < STRESS_ROUNDS; round++) {
+        if (sevenzip_create_7z(archive_file, inputs, SEVENZIP_LEVEL_FAST, &options, NULL, NULL) != SEVENZIP_OK ||
+            sevenzip_test_archive(archive_file, password, NULL, NULL) != SEVENZIP_OK) {
+            w->failures++;
+        }
+    }
+    
+    unlink(input_file);
+    unlink(archive_file);
+    return NULL;
+}
+
+static int test_concurrent_calls() {
+    pthread_t threads[STRESS_THREADS];
+    StressWorker workers[STRESS_THREADS];
+    int started = 0;
+    for (int i = 0; i < STRESS_THREADS; i++) {
+        workers[i].index = i;
+        workers[i].failures = 0;
+        if (pthread_create(&threads[i], NULL, stress_worker, &workers[i]) != 0) break;
+        started++;
+    }
+    
+    int failures = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        failures += workers[i].failures;
+    }
+    
+    TEST_ASSERT_EQUALS(STRESS_THREADS, started, "All worker threads started");
+    TEST_ASSERT_EQUALS(0, failures, "Concurrent create and test calls succeed");
+    return 1;
+}
+
+/* Test: Background scheduling settings are checked, and jobs run under them */
+static int test_background_scheduling() {
+    SevenZipInitOptions init;
+    memset(&init, 0, sizeof(init));
+    init.max_threads = 4;
+    
+    init.nice = 20;
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_init_with_options(&init), "Reject nice above 19");
+    init.nice = 0;
+    init.cpu_affinity = "3-1";
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_init_with_options(&init), "Reject reversed CPU range");
+    init.cpu_affinity = "0,x";
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_init_with_options(&init), "Reject malformed CPU list");
+    SevenZipErrorInfo error;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_error(&error), "Get last error");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, error.code, "Error recorded");
+    TEST_ASSERT(strcmp(error.file_context, "0,x") == 0, "The list named");
+    
+    /* CPU 0 always exists; the lowered threads are the library's, not this one */
+    init.cpu_affinity = "0";
+    init.sched_policy = SEVENZIP_SCHED_IDLE;
+    init.nice = 10;
+    init.io_priority = SEVENZIP_IO_IDLE;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(&init), "Accept scheduling settings");
+    
+    const char* input_file = "/tmp/test_sched.txt";
+    const char* archive_file = "/tmp/test_sched.7z";
+    FILE* f = fopen(input_file, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 20000; i++) {
+        fprintf(f, "Line %d of a background job.\n", i);
+    }
+    fclose(f);
+    
+    SevenZipCompressOptions options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 4;
+    options.block_size = 64 * 1024;
+    const char* inputs[] = {input_file, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z(archive_file, inputs, SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create under scheduling settings");
+    result = sevenzip_test_archive(archive_file, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+    
+    unlink(input_file);
+    unlink(archive_file);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(NULL), "Clear settings");
+    return 1;
+}
+
+/* Test: A file larger than the block size is compressed as several
+ * blocks of one non-solid folder, and extracts unchanged */
+static int test_split_file_blocks() {
+    SevenZipInitOptions init;
+    memset(&init, 0, sizeof(init));
+    init.max_threads = 4;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(&init), "Allow several workers");
+    
+    const char* big_file = "/tmp/test_blocks_big.txt";
+    const char* small_file = "/tmp/test_blocks_small.txt";
+    const char* archive_file = "/tmp/test_blocks.7z";
+    const char* volume_file = "/tmp/test_blocks.7z.001";
+    const char* output_dir = "/tmp/test_blocks_out";
+    FILE* f = fopen(big_file, "w");
+    TEST_ASSERT(f != NULL, "Create large input");
+    for (int i = 0; i < 60000; i++) {
+        fprintf(f, "Record %d: %08x\n", i, (unsigned)(i * 2654435761u));
+    }
+    fclose(f);
+    TEST_ASSERT(create_test_file(small_file, "Small file after the blocks.\n"), "Create small input");
+    
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.num_threads = 4;
+    options.solid = 0;
+    options.block_size = 128 * 1024;
+    options.split_size = 256 * 1024;
+    options.memory_pressure_throttle = 1;  /* Blocks of held-back workers join up the same */
+    const char* inputs[] = {big_file, small_file, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive");
+    result = sevenzip_test_archive(volume_file, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+    result = sevenzip_extract_streaming(volume_file, output_dir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive extracts");
+    
+    char* original = read_file_content(big_file);
+    char* extracted = read_file_content("/tmp/test_blocks_out/test_blocks_big.txt");
+    int same = original && extracted && strcmp(original, extracted) == 0;
+    free(original);
+    free(extracted);
+    TEST_ASSERT(same, "Large file extracts unchanged");
+    
+    unlink(big_file);
+    unlink(small_file);
+    for (int i = 1; i <= 9; i++) {
+        char volume[64];
+        snprintf(volume, sizeof(volume), "%s.%03d", archive_file, i);
+        unlink(volume);
+    }
+    unlink("/tmp/test_blocks_out/test_blocks_big.txt");
+    unlink("/tmp/test_blocks_out/test_blocks_small.txt");
+    rmdir(output_dir);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(NULL), "Clear settings");
+    return 1;
+}
+
+/* Test: Volumes are written round robin to the volume directories and,
+ * gathered in one place, form a valid archive */
+static int test_striped_volumes() {
+    const char* input_file = "/tmp/test_stripe.txt";
+    const char* dirs[] = {"/tmp/test_stripe_a", "/tmp/test_stripe_b", NULL};
+    mkdir(dirs[0], 0755);
+    mkdir(dirs[1], 0755);
+    FILE* f = fopen(input_file, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 20000; i++) {
+        fprintf(f, "Striped line %d\n", i);
+    }
+    fclose(f);
+    
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.split_size = 64 * 1024;
+    options.volume_dirs = dirs;
+    const char* inputs[] = {input_file, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_stripe.7z", inputs, SEVENZIP_LEVEL_STORE,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create striped archive");
+    TEST_ASSERT(file_exists("/tmp/test_stripe_a/test_stripe.7z.001"), "First volume in first directory");
+    TEST_ASSERT(file_exists("/tmp/test_stripe_b/test_stripe.7z.002"), "Second volume in second directory");
+    TEST_ASSERT(file_exists("/tmp/test_stripe_a/test_stripe.7z.003"), "Third volume back in first directory");
+    TEST_ASSERT(!file_exists("/tmp/test_stripe.7z.001"), "Nothing next to the archive path");
+    
+    /* Gather the volumes for extraction */
+    for (int i = 2; i <= 9; i += 2) {
+        char from[64], to[64];
+        snprintf(from, sizeof(from), "%s/test_stripe.7z.%03d", dirs[1], i);
+        snprintf(to, sizeof(to), "%s/test_stripe.7z.%03d", dirs[0], i);
+        rename(from, to);
+    }
+    result = sevenzip_test_archive("/tmp/test_stripe_a/test_stripe.7z.001", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Gathered volumes verify");
+    
+    for (int i = 1; i <= 9; i++) {
+        char volume[64];
+        snprintf(volume, sizeof(volume), "%s/test_stripe.7z.%03d", dirs[0], i);
+        unlink(volume);
+    }
+    rmdir(dirs[0]);
+    rmdir(dirs[1]);
+    unlink(input_file);
+    return 1;
+}
+
+/* In-memory archive of test_create_to_sink(), one volume */
+typedef struct {
+    char* data;
+    size_t size;
+    int volumes;
+    uint64_t end_size;
+} MemorySink;
+
+static int memory_sink_write(uint32_t volume_index, const void* data, size_t size, void* user_data) {
+    MemorySink* sink = (MemorySink*)user_data;
+    if (volume_index != 0) return 1;
+    char* grown = realloc(sink->data, sink->size + size);
+    if (!grown) return 1;
+    memcpy(grown + sink->size, data, size);
+    sink->data = grown;
+    sink->size += size;
+    return 0;
+}
+
+static int memory_sink_patch(uint64_t offset, const void* data, size_t size, void* user_data) {
+    MemorySink* sink = (MemorySink*)user_data;
+    if (offset + size > sink->size) return 1;
+    memcpy(sink->data + offset, data, size);
+    return 0;
+}
+
+static int memory_sink_end(uint32_t volume_index, uint64_t size, void* user_data) {
+    MemorySink* sink = (MemorySink*)user_data;
+    sink->volumes++;
+    sink->end_size = size;
+    return volume_index == 0 ? 0 : 1;
+}
+
+/* Test: Archive written through callbacks, start header patched last */
+static int test_create_to_sink() {
+    const char* input_file = "/tmp/test_sink.txt";
+    const char* archive_path = "/tmp/test_sink.7z";
+    FILE* f = fopen(input_file, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 20000; i++) {
+        fprintf(f, "Sink line %d\n", i);
+    }
+    fclose(f);
+    
+    MemorySink memory = {NULL, 0, 0, 0};
+    SevenZipArchiveSink sink = {NULL, memory_sink_write, memory_sink_patch, memory_sink_end, &memory};
+    const char* inputs[] = {input_file, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_to_sink(inputs, SEVENZIP_LEVEL_FAST, NULL, &sink, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create through the sink");
+    TEST_ASSERT_EQUALS(1, memory.volumes, "One volume ended");
+    TEST_ASSERT(memory.end_size == memory.size, "End size matches the bytes written");
+    
+    f = fopen(archive_path, "wb");
+    TEST_ASSERT(f != NULL, "Create archive file");
+    fwrite(memory.data, 1, memory.size, f);
+    fclose(f);
+    free(memory.data);
+    result = sevenzip_test_archive(archive_path, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Sink output verifies");
+    
+    SevenZipArchiveSink no_patch = {NULL, memory_sink_write, NULL, NULL, &memory};
+    result = sevenzip_create_7z_to_sink(inputs, SEVENZIP_LEVEL_FAST, NULL, &no_patch, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Patch callback is required");
+    
+    unlink(archive_path);
+    unlink(input_file);
+    return 1;
+}
+
+/* Entries of test_create_from_source(): a buffer of known size, then the
+ * same text again with its size left unknown */
+typedef struct {
+    const char* text;
+    size_t pos;
+    int next;
+} TestSource;
+
+static int test_source_read(void* buf, size_t* size, void* user_data) {
+    TestSource* source = (TestSource*)user_data;
+    size_t left = strlen(source->text) - source->pos;
+    if (*size > left) *size = left;
+    if (*size > 7) *size = 7;  /* Short reads, as from a socket */
+    memcpy(buf, source->text + source->pos, *size);
+    source->pos += *size;
+    return 0;
+}
+
+static int test_source_next(SevenZipSourceEntry* entry, void* user_data) {
+    TestSource* source = (TestSource*)user_data;
+    source->pos = 0;
+    switch (source->next++) {
+    case 0:
+        entry->name = "known.txt";
+        entry->size = strlen(source->text);
+        break;
+    case 1:
+        entry->name = "unknown.txt";
+        entry->size = SEVENZIP_SIZE_UNKNOWN;
+        break;
+    default:
+        return 0;
+    }
+    entry->read = test_source_read;
+    entry->read_user_data = source;
+    return 0;
+}
+
+/* Test: Archive of entries produced by callbacks, no input files */
+static int test_create_from_source() {
+    const char* archive_path = "/tmp/test_source.7z";
+    const char* output_dir = "/tmp/test_source_out";
+    TestSource data = {"Entry produced by a callback, read a few bytes at a time\n", 0, 0};
+    SevenZipEntrySource source = {test_source_next, &data};
+    
+    SevenZipErrorCode result = sevenzip_create_7z_from_source(archive_path, &source, SEVENZIP_LEVEL_FAST,
+                                                              NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create from source");
+    result = sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract source archive");
+    
+    const char* names[] = {"known.txt", "unknown.txt"};
+    for (int i = 0; i < 2; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", output_dir, names[i]);
+        char* content = read_file_content(path);
+        TEST_ASSERT(content != NULL, "Read extracted entry");
+        TEST_ASSERT(strcmp(data.text, content) == 0, "Entry content matches");
+        free(content);
+        unlink(path);
+    }
+    rmdir(output_dir);
+    unlink(archive_path);
+    return 1;
+}
+
+/* Test: SHA-256 (FIPS 180-2 vectors) and XXH3-128 manifests written by every reading path */
+static int test_digest_manifest() {
+    const char* archive_path = "/tmp/test_digest.7z";
+    const char* manifest_path = "/tmp/test_digest.sha256";
+    const char* inputs[] = {"/tmp/test_digest_abc.txt", "/tmp/test_digest_a.bin",
+                            "/tmp/test_digest_empty.txt", NULL};
+    const char* expected[] = {
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad  test_digest_abc.txt\n",
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0  test_digest_a.bin\n",
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855  test_digest_empty.txt\n",
+        "06b05ab6733a618578af5f94892f3950  test_digest_abc.txt\n",
+        "a545df8e384a9579b1fd6fae5285c4eb  test_digest_a.bin\n",
+        "99aa06d3014798d86001c324468d497f  test_digest_empty.txt\n"
+    };
+    TEST_ASSERT(create_test_file(inputs[0], "abc"), "Create abc input");
+    TEST_ASSERT(create_test_file(inputs[2], ""), "Create empty input");
+    FILE* f = fopen(inputs[1], "wb");
+    TEST_ASSERT(f != NULL, "Create million-a input");
+    for (int i = 0; i < 1000000; i++) fputc('a', f);
+    fclose(f);
+
+    /* Solid with the reader thread, solid on the CRC stage, Store, non-solid
+     * workers; unsplit and split; both digests */
+    for (int config = 0; config < 16; config++) {
+        int xxh3 = config >> 3;
+        SevenZipStreamOptions opts;
+        sevenzip_stream_options_init(&opts);
+        opts.digest_manifest = manifest_path;
+        opts.digest_algorithm = xxh3 ? SEVENZIP_DIGEST_XXH3_128 : SEVENZIP_DIGEST_SHA256;
+        opts.split_size = (config & 1) ? 256 * 1024 : 0;
+        int path = (config >> 1) & 3;
+        if (path == 1) opts.prefetch_buffers = 0;
+        if (path == 3) opts.solid = 0;
+        SevenZipCompressionLevel level = path == 2 ? SEVENZIP_LEVEL_STORE : SEVENZIP_LEVEL_FAST;
+        unlink(manifest_path);
+
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, level, &opts, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create with digest manifest");
+        char* manifest = read_file_content(manifest_path);
+        TEST_ASSERT(manifest != NULL, "Manifest written");
+        char lines[512] = "";
+        for (int i = 0; i < 3; i++) strcat(lines, expected[xxh3 * 3 + i]);
+        TEST_ASSERT(strcmp(lines, manifest) == 0, "Manifest holds every file's digest");
+        free(manifest);
+
+        char first[256];
+        snprintf(first, sizeof(first), "%s.001", archive_path);
+        result = sevenzip_test_archive(opts.split_size ? first : archive_path, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive with digests verifies");
+        unlink(archive_path);
+        for (int v = 1; v < 8; v++) {
+            char volume[256];
+            snprintf(volume, sizeof(volume), "%s.%03d", archive_path, v);
+            unlink(volume);
+        }
+    }
+
+    SevenZipStreamOptions opts;
+    sevenzip_stream_options_init(&opts);
+    opts.digest_manifest = manifest_path;
+    SevenZipErrorCode result = sevenzip_resume_multivolume(archive_path, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Resumed jobs cannot hash skipped files");
+    opts.digest_algorithm = (SevenZipDigestAlgorithm)7;
+    result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Unknown digest algorithm rejected");
+    unlink(archive_path);
+
+    unlink(manifest_path);
+    for (int i = 0; i < 3; i++) unlink(inputs[i]);
+    return 1;
+}
+
+/* Test: Incremental runs leave out files a snapshot has unchanged */
+static int test_snapshot_incremental() {
+    const char* dir = "/tmp/test_snapshot_in";
+    const char* archive_path = "/tmp/test_snapshot.7z";
+    const char* snapshot_path = "/tmp/test_snapshot.state";
+    const char* inputs[] = {dir, NULL};
+    mkdir(dir, 0755);
+    TEST_ASSERT(create_test_file("/tmp/test_snapshot_in/a.txt", "kept between runs"), "Create a.txt");
+    TEST_ASSERT(create_test_file("/tmp/test_snapshot_in/b.txt", "first version"), "Create b.txt");
+    unlink(snapshot_path);
+
+    SevenZipStreamOptions opts;
+    sevenzip_stream_options_init(&opts);
+    opts.snapshot_base = snapshot_path;
+    opts.snapshot_output = snapshot_path;
+
+    /* Full run (no snapshot yet), a run after changes, a run with none */
+    size_t expected[] = {2, 2, 0};
+    for (int run = 0; run < 3; run++) {
+        if (run == 1) {
+            TEST_ASSERT(create_test_file("/tmp/test_snapshot_in/b.txt", "second, longer version"), "Change b.txt");
+            TEST_ASSERT(create_test_file("/tmp/test_snapshot_in/c.txt", "new file"), "Create c.txt");
+        }
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                                &opts, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create incremental archive");
+        SevenZipList* list = NULL;
+        result = sevenzip_list(archive_path, NULL, &list);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List incremental archive");
+        size_t files = 0;
+        for (size_t i = 0; i < list->count; i++) files += !list->entries[i].is_directory;
+        TEST_ASSERT_EQUALS(expected[run], files, "Only new and changed files archived");
+        for (size_t i = 0; run > 0 && i < list->count; i++) {
+            TEST_ASSERT(strcmp(list->entries[i].name, "test_snapshot_in/a.txt") != 0,
+                        "Unchanged file left out");
+        }
+        sevenzip_free_list(list);
+        unlink(archive_path);
+    }
+
+    char* snapshot = read_file_content(snapshot_path);
+    TEST_ASSERT(snapshot != NULL, "Snapshot written");
+    TEST_ASSERT(strstr(snapshot, " test_snapshot_in/a.txt\n") != NULL, "Snapshot lists files left out");
+    free(snapshot);
+
+    TEST_ASSERT(create_test_file(snapshot_path, "not a snapshot\n"), "Create damaged snapshot");
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_ARCHIVE, result, "Damaged snapshot rejected");
+
+    unlink(archive_path);
+    unlink(snapshot_path);
+    unlink("/tmp/test_snapshot_in/a.txt");
+    unlink("/tmp/test_snapshot_in/b.txt");
+    unlink("/tmp/test_snapshot_in/c.txt");
+    rmdir(dir);
+    return 1;
+}
+
+/* Test: With detect_compressed, a file in a compressed format is stored
+ * in a Copy folder after the other files, by both solid writers */
+static int test_detect_compressed() {
+    const char* text_a = "/tmp/test_detect_a.txt";
+    const char* text_c = "/tmp/test_detect_c.txt";
+    const char* image = "/tmp/test_detect_b.png";
+    const char* archive_file = "/tmp/test_detect.7z";
+    FILE* f = fopen(image, "wb");
+    TEST_ASSERT(f != NULL, "Create image");
+    fwrite("\x89PNG\r\n\x1A\n", 1, 8, f);
+    for (int i = 0; i < 64 * 1024; i++) fputc(0, f);
+    fclose(f);
+    TEST_ASSERT(create_test_file(text_a, "First text file, compressed as usual.\n"), "Create a.txt");
+    TEST_ASSERT(create_test_file(text_c, "Second text file, in the same folder.\n"), "Create c.txt");
+    const char* inputs[] = {text_a, image, text_c, NULL};
+
+    /* sevenzip_create_7z(), then the split writer (taken for digest_manifest) */
+    for (int pass = 0; pass < 2; pass++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.detect_compressed = 1;
+        options.digest_manifest = pass ? "/tmp/test_detect.sha256" : NULL;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                                &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+        TEST_ASSERT(get_file_size(archive_file) > 64 * 1024, "Image stored, not compressed");
+        result = sevenzip_test_archive(archive_file, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+
+        SevenZipList* list = NULL;
+        result = sevenzip_list(archive_file, NULL, &list);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+        TEST_ASSERT_EQUALS(3, list->count, "All files archived");
+        int image_last = strstr(list->entries[2].name, "test_detect_b.png") != NULL;
+        sevenzip_free_list(list);
+        TEST_ASSERT(image_last, "Stored file follows the compressed ones");
+
+        unlink(archive_file);
+    }
+    unlink("/tmp/test_detect.sha256");
+
+    unlink(text_a);
+    unlink(text_c);
+    unlink(image);
+    return 1;
+}
+
+/* Test: solid_sort orders files by extension, then name, in both solid writers */
+static int test_solid_sort() {
+    const char* inputs[] = {"/tmp/test_sort_b.txt", "/tmp/test_sort_c.bin", "/tmp/test_sort_a.txt", NULL};
+    const char* expected[] = {"test_sort_c.bin", "test_sort_a.txt", "test_sort_b.txt"};
+    const char* archive_file = "/tmp/test_sort.7z";
+    for (int i = 0; inputs[i]; i++) {
+        TEST_ASSERT(create_test_file(inputs[i], "Contents of a file to sort by type.\n"), "Create input");
+    }
+
+    /* sevenzip_create_7z(), then the split writer (taken for digest_manifest) */
+    for (int pass = 0; pass < 2; pass++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.solid_sort = 1;
+        options.digest_manifest = pass ? "/tmp/test_sort.sha256" : NULL;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                                &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+        result = sevenzip_test_archive(archive_file, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+
+        SevenZipList* list = NULL;
+        result = sevenzip_list(archive_file, NULL, &list);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+        TEST_ASSERT_EQUALS(3, list->count, "All files archived");
+        int sorted = 1;
+        for (int i = 0; i < 3; i++) {
+            sorted = sorted && strstr(list->entries[i].name, expected[i]) != NULL;
+        }
+        sevenzip_free_list(list);
+        TEST_ASSERT(sorted, "Files in extension, then name order");
+
+        unlink(archive_file);
+    }
+    unlink("/tmp/test_sort.sha256");
+
+    for (int i = 0; inputs[i]; i++) unlink(inputs[i]);
+    return 1;
+}
+
+/* Test: An input a few blocks long is spread over the block threads,
+ * and the stats report the block size chosen */
+static int test_adaptive_block_size() {
+    SevenZipInitOptions init;
+    memset(&init, 0, sizeof(init));
+    init.max_threads = 4;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(&init), "Allow several block threads");
+    
+    const char* input = "/tmp/test_block_size.txt";
+    const char* archive_file = "/tmp/test_block_size.7z";
+    FILE* f = fopen(input, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 300000; i++) {
+        fprintf(f, "Line %d of the block size input: %08x\n", i, (unsigned)(i * 2654435761u));
+    }
+    fclose(f);
+    uint64_t input_size = get_file_size(input);
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.num_threads = 4;
+    options.dict_size = 1024 * 1024;  /* Blocks are never smaller than the dictionary */
+    options.split_size = 4 * 1024 * 1024;
+    const char* inputs[] = {input, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive");
+    SevenZipOpStats stats;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_stats(&stats), "Get stats");
+    TEST_ASSERT(stats.lzma2_block_size > 0, "Block size reported");
+    TEST_ASSERT(stats.lzma2_block_size < input_size, "Every block thread gets a block");
+    TEST_ASSERT(stats.lzma2_block_size % (1024 * 1024) == 0, "Whole megabytes");
+    result = sevenzip_test_archive("/tmp/test_block_size.7z.001", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+
+    unlink(input);
+    for (int i = 1; i <= 9; i++) {
+        char volume[64];
+        snprintf(volume, sizeof(volume), "%s.%03d", archive_file, i);
+        unlink(volume);
+    }
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(NULL), "Clear settings");
+    return 1;
+}
+
+/* Test: group_duplicates brings a copy separated by more than the
+ * dictionary next to its original */
+static int test_group_duplicates() {
+    const char* paths[] = {"/tmp/test_dup_a.bin", "/tmp/test_dup_filler.bin", "/tmp/test_dup_b.bin", NULL};
+    const size_t sizes[] = {256 * 1024, 2 * 1024 * 1024, 256 * 1024};
+    const char* archive_file = "/tmp/test_dup.7z";
+    for (int i = 0; i < 3; i++) {
+        FILE* f = fopen(paths[i], "wb");
+        TEST_ASSERT(f != NULL, "Create input");
+        /* a and b share their bytes, the filler has its own; none compress */
+        uint32_t x = i == 1 ? 12345u : 777u;
+        for (size_t n = 0; n < sizes[i]; n++) {
+            x = x * 1103515245u + 12345u;
+            fputc((int)(x >> 24), f);
+        }
+        fclose(f);
+    }
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.dict_size = 1024 * 1024;
+    uint64_t packed[2];
+    for (int grouped = 0; grouped < 2; grouped++) {
+        options.group_duplicates = grouped;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, paths, SEVENZIP_LEVEL_FAST,
+                                                                &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+        packed[grouped] = get_file_size(archive_file);
+    }
+    TEST_ASSERT(packed[1] + 200 * 1024 < packed[0], "The copy costs next to nothing");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_file, NULL, NULL, NULL),
+                       "Archive verifies");
+
+    for (int i = 0; i < 3; i++) unlink(paths[i]);
+    unlink(archive_file);
+    return 1;
+}
+
+/* Test: A hard link follows its first name and is not read again */
+static int test_hard_links() {
+    const char* dir = "/tmp/test_links";
+    const char* first = "/tmp/test_links/a.bin";
+    const char* filler = "/tmp/test_links/f.bin";
+    const char* link_path = "/tmp/test_links/z.bin";
+    const char* archive_file = "/tmp/test_links.7z";
+    const size_t size = 256 * 1024;
+    mkdir(dir, 0755);
+    const char* files[] = {first, filler};
+    for (int i = 0; i < 2; i++) {
+        FILE* f = fopen(files[i], "wb");
+        TEST_ASSERT(f != NULL, "Create input");
+        uint32_t x = 777u + (uint32_t)i;
+        for (size_t n = 0; n < (i ? 4 : 1) * size; n++) {
+            x = x * 1103515245u + 12345u;
+            fputc((int)(x >> 24), f);
+        }
+        fclose(f);
+    }
+    unlink(link_path);
+    TEST_ASSERT(link(first, link_path) == 0, "Create hard link");
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.dict_size = 1024 * 1024;
+    const char* inputs[] = {first, filler, link_path, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_true_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST,
+                                                                 &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    SevenZipOpStats stats;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_stats(&stats), "Get stats");
+    TEST_ASSERT(stats.bytes_read == 5 * size, "The link is not read");
+    TEST_ASSERT(get_file_size(archive_file) < 5 * size + 64 * 1024, "The link costs next to nothing");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_file, NULL, NULL, NULL),
+                       "Archive verifies");
+
+    unlink(link_path);
+    unlink(filler);
+    unlink(first);
+    rmdir(dir);
+    unlink(archive_file);
+    return 1;
+}
+
+/* Test: True streaming cuts one large input into chunk_size blocks,
+ * a block thread per thread */
+static int test_true_streaming_chunks() {
+    SevenZipInitOptions init;
+    memset(&init, 0, sizeof(init));
+    init.max_threads = 4;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(&init), "Allow several block threads");
+
+    const char* input = "/tmp/test_ts_chunks.txt";
+    const char* archive_file = "/tmp/test_ts_chunks.7z";
+    FILE* f = fopen(input, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 200000; i++) {
+        fprintf(f, "Line %d of the chunked input: %08x\n", i, (unsigned)(i * 2654435761u));
+    }
+    fclose(f);
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.num_threads = 4;
+    options.dict_size = 1024 * 1024;
+    options.chunk_size = 1024 * 1024;
+    const char* inputs[] = {input, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_true_streaming(archive_file, inputs,
+                                                                 SEVENZIP_LEVEL_FAST,
+                                                                 &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    SevenZipOpStats stats;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_stats(&stats), "Get stats");
+    TEST_ASSERT_EQUALS(1024 * 1024, (int)stats.lzma2_block_size, "Blocks of chunk_size");
+    TEST_ASSERT_EQUALS(4, stats.encoder_threads, "A block thread per thread");
+    result = sevenzip_test_archive(archive_file, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+
+    unlink(input);
+    unlink(archive_file);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(NULL), "Clear settings");
+    return 1;
+}
+
+/* Test: folder_stats keeps the encoder counters of each non-solid folder,
+ * and the totals match their sums */
+static int test_folder_stats() {
+    const char* inputs[] = {"/tmp/test_folder_stats_a.txt", "/tmp/test_folder_stats_b.txt", NULL};
+    const char* archive_file = "/tmp/test_folder_stats.7z";
+    for (int i = 0; i < 2; i++) {
+        FILE* f = fopen(inputs[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int n = 0; n < 10000; n++) {
+            fprintf(f, "record %d of file %d: %08x\n", n, i, (unsigned)(n * 2654435761u));
+        }
+        fclose(f);
+    }
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.solid = 0;
+    options.folder_stats = 1;
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    SevenZipOpStats stats;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_stats(&stats), "Get stats");
+    TEST_ASSERT(stats.lzma_literals > 0, "Literals counted");
+#ifdef SEVENZIP_ENCODER_STATS
+    TEST_ASSERT(stats.lzma_matches + stats.lzma_rep_matches > 0, "Matches counted");
+    TEST_ASSERT(stats.average_match_length >= 2.0, "Matches are two bytes or more");
+#endif
+    TEST_ASSERT_EQUALS(2, (int)stats.folder_stats_count, "A record per folder");
+
+    size_t count = 0;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_folder_stats(NULL, 0, &count), "Count records");
+    TEST_ASSERT_EQUALS(2, (int)count, "Two records");
+    SevenZipFolderStats folders[2];
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_folder_stats(folders, 2, &count), "Get records");
+    uint64_t literals = 0;
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUALS(i, (int)folders[i].folder, "Archive order");
+        TEST_ASSERT(folders[i].pack_size > 0 && folders[i].pack_size < folders[i].unpack_size,
+                    "Folder compressed");
+        TEST_ASSERT(folders[i].block_threads >= 1, "Block threads known");
+        literals += folders[i].literals;
+    }
+    TEST_ASSERT(literals == stats.lzma_literals, "Totals are the sums");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_file, NULL, NULL, NULL),
+                       "Archive verifies");
+
+    /* Without the option no records are kept */
+    options.folder_stats = 0;
+    result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_NORMAL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create again");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_folder_stats(NULL, 0, &count), "Count records");
+    TEST_ASSERT_EQUALS(0, (int)count, "No records");
+
+    unlink(inputs[0]);
+    unlink(inputs[1]);
+    unlink(archive_file);
+    return 1;
+}
+
+/* Test: The job estimate predicts the packed size from samples of each
+ * file type, close to what the archive then takes */
+static int test_estimate_job() {
+    const char* dir = "/tmp/test_estimate_job";
+    const char* archive_file = "/tmp/test_estimate_job.7z";
+    char text[256], noise[256];
+    snprintf(text, sizeof(text), "%s/log.txt", dir);
+    snprintf(noise, sizeof(noise), "%s/blob.bin", dir);
+    mkdir(dir, 0755);
+    FILE* f = fopen(text, "w");
+    TEST_ASSERT(f != NULL, "Create text");
+    for (int i = 0; i < 60000; i++) {
+        fprintf(f, "2026-10-15 09:%02d:%02d GET /item/%d %d\n", i / 60 % 60, i % 60, i % 977, 200 + i % 3);
+    }
+    fclose(f);
+    f = fopen(noise, "wb");
+    TEST_ASSERT(f != NULL, "Create noise");
+    uint32_t x = 12345u;
+    for (int i = 0; i < 512 * 1024; i++) {
+        x = x * 1103515245u + 12345u;
+        fputc((int)(x >> 24), f);
+    }
+    fclose(f);
+
+    SevenZipEstimateOptions options;
+    sevenzip_estimate_options_init(&options);
+    options.sample_fraction = 0.1;
+    options.min_sample_bytes = 256 * 1024;
+    options.min_level = SEVENZIP_LEVEL_FASTEST;
+    options.max_level = SEVENZIP_LEVEL_FAST;
+    options.num_threads = 1;
+    const char* inputs[] = {dir, NULL};
+    SevenZipJobEstimate estimates[2];
+    size_t count = 0;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_estimate_job(inputs, &options, estimates, 2, &count),
+                       "Estimate");
+    TEST_ASSERT_EQUALS(2, (int)count, "Two levels");
+    TEST_ASSERT_EQUALS(SEVENZIP_LEVEL_FAST, estimates[0].level, "Best ratio first");
+    TEST_ASSERT_EQUALS(SEVENZIP_LEVEL_FASTEST, estimates[1].level, "Then the faster level");
+    uint64_t input_bytes = get_file_size(text) + get_file_size(noise);
+    TEST_ASSERT(estimates[0].input_bytes == input_bytes, "All input counted");
+    TEST_ASSERT(estimates[0].sample_bytes < input_bytes, "Only samples compressed");
+    TEST_ASSERT(estimates[0].predicted_seconds > 0, "Time predicted");
+
+    SevenZipStreamOptions stream;
+    sevenzip_stream_options_init(&stream);
+    stream.num_threads = 1;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST,
+                                                                 &stream, NULL, NULL),
+                       "Create archive");
+    double actual = (double)get_file_size(archive_file);
+    double predicted = (double)estimates[0].predicted_size;
+    TEST_ASSERT(predicted > actual * 0.75 && predicted < actual * 1.25, "Prediction close to the archive");
+
+    const char* missing[] = {"/tmp/test_estimate_job_missing", NULL};
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, sevenzip_estimate_job(missing, &options, NULL, 0, &count),
+                       "Missing input");
+
+    unlink(text);
+    unlink(noise);
+    rmdir(dir);
+    unlink(archive_file);
+    return 1;
+}
+
+/* Test: A throughput target out of reach moves later files to faster
+ * encoder settings; one easily met keeps the level's own */
+static int test_throughput_target() {
+    const char* dir = "/tmp/test_throughput_target";
+    const char* archive_file = "/tmp/test_throughput_target.7z";
+    char paths[8][256];
+    mkdir(dir, 0755);
+    for (int i = 0; i < 8; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/part%d.log", dir, i);
+        FILE* f = fopen(paths[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int n = 0; n < 30000; n++) {
+            fprintf(f, "%d-%d session=%08x user=%d bytes=%d\n", i, n, (unsigned)(n * 2654435761u),
+                    n % 1013, (n * 7) % 65536);
+        }
+        fclose(f);
+    }
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.solid = 0;
+    options.num_threads = 2;
+    options.throughput_target = 1e6;
+    const char* inputs[] = {dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    SevenZipOpStats stats;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_stats(&stats), "Get stats");
+    TEST_ASSERT(stats.throughput_rung > 0 && stats.throughput_changes > 0, "Settings moved faster");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_file, NULL, NULL, NULL),
+                       "Archive verifies");
+
+    options.throughput_target = 0.001;
+    result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create again");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_stats(&stats), "Get stats");
+    TEST_ASSERT_EQUALS(0, stats.throughput_rung, "Level's own settings");
+    TEST_ASSERT(stats.throughput_changes == 0, "Never moved");
+
+    for (int i = 0; i < 8; i++) unlink(paths[i]);
+    rmdir(dir);
+    unlink(archive_file);
+    return 1;
+}
+
+/* Entry policy of test_entry_policy: text to PPMd in group 1, logs at
+ * level 1, .bin stored; counts the calls whose head matches the file */
+static void policy_by_extension(const char* path, uint64_t size, const uint8_t* head,
+                                size_t head_size, SevenZipEntryPolicy* policy, void* user_data) {
+    int* calls = (int*)user_data;
+    FILE* f = fopen(path, "rb");
+    unsigned char start[16];
+    if (f && size >= sizeof(start) && head_size >= sizeof(start) &&
+        fread(start, 1, sizeof(start), f) == sizeof(start) && memcmp(start, head, sizeof(start)) == 0) {
+        (*calls)++;
+    }
+    if (f) fclose(f);
+    const char* ext = strrchr(path, '.');
+    if (strcmp(ext, ".txt") == 0) {
+        policy->method = SEVENZIP_METHOD_PPMD;
+        policy->group = 1;
+    } else if (strcmp(ext, ".log") == 0) {
+        policy->level = 1;
+    } else if (strcmp(ext, ".bin") == 0) {
+        policy->level = 0;
+    }
+}
+
+static int policy_batch_folders(const SevenZipArchiveBatchResult* result, void* user_data) {
+    *(uint32_t*)user_data = result->num_folders;
+    return 0;
+}
+
+/* Test: A per-file policy splits a solid archive by method, level and
+ * group, with the groups in order */
+static int test_entry_policy() {
+    const char* inputs[] = {"/tmp/test_policy_a.txt", "/tmp/test_policy_c.log", "/tmp/test_policy_b.txt",
+                            "/tmp/test_policy_d.bin", NULL};
+    const char* archive_file = "/tmp/test_policy.7z";
+    for (int i = 0; i < 4; i++) {
+        FILE* f = fopen(inputs[i], "wb");
+        TEST_ASSERT(f != NULL, "Create input");
+        uint32_t x = 2463534242u + (uint32_t)i;
+        for (int n = 0; n < 20000; n++) {
+            if (i == 3) {
+                x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+                fwrite(&x, sizeof(x), 1, f);
+            } else {
+                fprintf(f, "line %d of input %d: %u\n", n, i, (unsigned)(n % 977));
+            }
+        }
+        fclose(f);
+    }
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.folder_stats = 1;
+    int calls = 0;
+    options.entry_policy = policy_by_extension;
+    options.entry_policy_data = &calls;
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    TEST_ASSERT_EQUALS(4, calls, "Called per file with its head");
+
+    /* Group 0: the log, then the stored .bin; group 1: both texts, with
+     * PPMd (only LZMA2 folders get a record) */
+    const char* archives[] = {archive_file};
+    SevenZipArchiveBatchOptions batch;
+    sevenzip_archive_batch_options_init(&batch);
+    uint32_t num_folders = 0;
+    result = sevenzip_archive_batch(archives, 1, &batch, policy_batch_folders, &num_folders);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+    TEST_ASSERT_EQUALS(3, (int)num_folders, "A folder per method, level and group");
+    SevenZipFolderStats folders[3];
+    size_t count = 0;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_folder_stats(folders, 3, &count), "Get records");
+    TEST_ASSERT(count == 1 && folders[0].folder == 0 && folders[0].unpack_size < 1024 * 1024,
+                "The log alone in LZMA2");
+
+    SevenZipList* list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(archive_file, NULL, &list), "List");
+    TEST_ASSERT(list->count == 4 && strstr(list->entries[0].name, "_c.log") &&
+                strstr(list->entries[3].name, "_b.txt"), "Entries in group order");
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_file, NULL, NULL, NULL),
+                       "Archive verifies");
+
+    for (int i = 0; i < 4; i++) unlink(inputs[i]);
+    unlink(archive_file);
+    return 1;
+}
+
+/* Test: Custom LZMA parameters, lc + lp over the LZMA2 limit included,
+ * give archives that verify from both solid writers */
+static int test_lzma_params() {
+    const char* input = "/tmp/test_lzma_params.txt";
+    const char* archive_file = "/tmp/test_lzma_params.7z";
+    FILE* f = fopen(input, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 20000; i++) {
+        fprintf(f, "2026-10-14 12:%02d:%02d INFO request %d served\n", i / 60 % 60, i % 60, i);
+    }
+    fclose(f);
+
+    SevenZipLzmaParams params;
+    sevenzip_lzma_params_init(&params);
+    params.match_finder = SEVENZIP_MATCH_FINDER_HC4;
+    params.algorithm = 0;
+    params.fast_bytes = 32;
+    params.lc = 4;
+    params.lp = 4;  /* Clamped: LZMA2 allows lc + lp <= 4 */
+    const char* inputs[] = {input, NULL};
+
+    /* sevenzip_create_7z(), then the split writer (taken for digest_manifest) */
+    for (int pass = 0; pass < 2; pass++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.lzma_params = &params;
+        options.digest_manifest = pass ? "/tmp/test_lzma_params.sha256" : NULL;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                                &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+        TEST_ASSERT(get_file_size(archive_file) < get_file_size(input) / 4, "Input compressed");
+        result = sevenzip_test_archive(archive_file, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+        unlink(archive_file);
+    }
+    unlink("/tmp/test_lzma_params.sha256");
+
+    unlink(input);
+    return 1;
+}
+
+static int test_buffer_codec() {
+    const size_t size = 300000;
+    unsigned char* input = malloc(size);
+    unsigned char* output = malloc(size);
+    TEST_ASSERT(input && output, "Allocate buffers");
+    const SevenZipBufferFormat formats[] = {SEVENZIP_BUFFER_LZMA, SEVENZIP_BUFFER_LZMA2, SEVENZIP_BUFFER_7Z};
+
+    /* Text, then noise that no coder shrinks: the bound has to hold for it */
+    for (int kind = 0; kind < 2; kind++) {
+        uint32_t seed = 12345;
+        for (size_t i = 0; i < size; i++) {
+            seed = seed * 1103515245 + 12345;
+            input[i] = kind ? (unsigned char)(seed >> 16) : (unsigned char)("request served\n"[i % 15]);
+        }
+        for (int f = 0; f < 3; f++) {
+            size_t bound = sevenzip_compress_buffer_bound(formats[f], size, NULL);
+            TEST_ASSERT(bound > size, "Bound covers the input");
+            unsigned char* packed = malloc(bound);
+            TEST_ASSERT(packed != NULL, "Allocate packed buffer");
+
+            size_t packed_size = 16;
+            SevenZipErrorCode result = sevenzip_compress_buffer(formats[f], input, size, packed, &packed_size,
+                                                                SEVENZIP_LEVEL_FAST, NULL);
+            TEST_ASSERT_EQUALS(SEVENZIP_ERROR_BUFFER_TOO_SMALL, result, "Small output rejected");
+            TEST_ASSERT(packed_size == bound, "Bound returned");
+
+            result = sevenzip_compress_buffer(formats[f], input, size, packed, &packed_size,
+                                              SEVENZIP_LEVEL_FAST, NULL);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compress buffer");
+            TEST_ASSERT(packed_size <= bound, "Output within bound");
+            TEST_ASSERT(kind || packed_size < size / 100, "Text compressed");
+
+            uint64_t unpacked = 0;
+            result = sevenzip_decompress_buffer_size(formats[f], packed, packed_size, &unpacked);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Query size");
+            TEST_ASSERT(unpacked == size, "Size from headers");
+
+            size_t out_size = size - 1;
+            result = sevenzip_decompress_buffer(formats[f], packed, packed_size, output, &out_size);
+            TEST_ASSERT_EQUALS(SEVENZIP_ERROR_BUFFER_TOO_SMALL, result, "Short output rejected");
+            TEST_ASSERT(out_size == size, "Needed size returned");
+            result = sevenzip_decompress_buffer(formats[f], packed, packed_size, output, &out_size);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Decompress buffer");
+            TEST_ASSERT(out_size == size && memcmp(input, output, size) == 0, "Round trip");
+
+            if (formats[f] == SEVENZIP_BUFFER_7Z) {
+                /* The archive reader takes the in-memory archive as it is */
+                const char* archive_file = "/tmp/test_buffer_codec.7z";
+                FILE* af = fopen(archive_file, "wb");
+                TEST_ASSERT(af != NULL, "Write archive");
+                fwrite(packed, 1, packed_size, af);
+                fclose(af);
+                SevenZipList* list = NULL;
+                result = sevenzip_list(archive_file, NULL, &list);
+                TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+                TEST_ASSERT(list->count == 1 && strcmp(list->entries[0].name, "data") == 0 &&
+                            list->entries[0].size == size, "One entry");
+                sevenzip_free_list(list);
+                result = sevenzip_test_archive(archive_file, NULL, NULL, NULL);
+                TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+                unlink(archive_file);
+
+                packed[packed_size / 2] ^= 0x55;
+                out_size = size;
+                result = sevenzip_decompress_buffer(formats[f], packed, packed_size, output, &out_size);
+                TEST_ASSERT(result != SEVENZIP_OK, "Damage detected");
+            }
+            free(packed);
+        }
+    }
+
+    /* Empty input */
+    for (int f = 0; f < 3; f++) {
+        size_t packed_size = size;
+        SevenZipErrorCode result = sevenzip_compress_buffer(formats[f], NULL, 0, output, &packed_size,
+                                                            SEVENZIP_LEVEL_NORMAL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compress empty buffer");
+        memcpy(input, output, packed_size);
+        size_t out_size = size;
+        result = sevenzip_decompress_buffer(formats[f], input, packed_size, output, &out_size);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Decompress empty buffer");
+        TEST_ASSERT(out_size == 0, "Nothing decoded");
+    }
+
+    free(input);
+    free(output);
+    return 1;
+}
+
+/* Helper: stream-encode input in uneven pieces through small output windows */
+static int stream_encode(SevenZipBufferFormat format, const unsigned char* input, size_t size,
+                         unsigned char* packed, size_t capacity, size_t* packed_size) {
+    SevenZipEncoder* encoder = NULL;
+    if (sevenzip_encoder_create(format, SEVENZIP_LEVEL_FAST, NULL, &encoder) != SEVENZIP_OK) return 0;
+    size_t in_pos = 0, out_pos = 0;
+    int finished = 0;
+    while (!finished) {
+        size_t out_size = capacity - out_pos < 1000 ? capacity - out_pos : 1000;
+        SevenZipErrorCode result;
+        if (in_pos < size) {
+            size_t in_size = size - in_pos < 7777 ? size - in_pos : 7777;
+            result = sevenzip_encoder_update(encoder, input + in_pos, &in_size, packed + out_pos, &out_size);
+            in_pos += in_size;
+        } else {
+            result = sevenzip_encoder_finish(encoder, packed + out_pos, &out_size, &finished);
+        }
+        out_pos += out_size;
+        if (result != SEVENZIP_OK || (out_pos == capacity && !finished)) {
+            sevenzip_encoder_free(encoder);
+            return 0;
+        }
+    }
+    sevenzip_encoder_free(encoder);
+    *packed_size = out_pos;
+    return 1;
+}
+
+/* Helper: stream-decode in uneven pieces; 1 when the output matches `expected` */
+static int stream_decode_matches(SevenZipBufferFormat format, const unsigned char* packed, size_t packed_size,
+                                 const unsigned char* expected, size_t size) {
+    SevenZipDecoder* decoder = NULL;
+    if (sevenzip_decoder_create(format, &decoder) != SEVENZIP_OK) return 0;
+    unsigned char window[500];
+    size_t in_pos = 0, out_pos = 0;
+    int finished = 0, matches = 1;
+    while (!finished && matches) {
+        size_t in_size = packed_size - in_pos < 333 ? packed_size - in_pos : 333;
+        size_t out_size = sizeof(window);
+        SevenZipErrorCode result = sevenzip_decoder_update(decoder, packed + in_pos, &in_size,
+                                                           window, &out_size, &finished);
+        if (result != SEVENZIP_OK || (in_size == 0 && out_size == 0 && !finished)) matches = 0;
+        if (out_pos + out_size > size || memcmp(expected + out_pos, window, out_size) != 0) matches = 0;
+        in_pos += in_size;
+        out_pos += out_size;
+    }
+    sevenzip_decoder_free(decoder);
+    return matches && out_pos == size && in_pos == packed_size;
+}
+
+static int test_stream_codec() {
+    const size_t size = 300000;
+    unsigned char* input = malloc(size);
+    unsigned char* output = malloc(size);
+    TEST_ASSERT(input && output, "Allocate buffers");
+    const SevenZipBufferFormat formats[] = {SEVENZIP_BUFFER_LZMA, SEVENZIP_BUFFER_LZMA2};
+    SevenZipEncoder* encoder = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM,
+                       sevenzip_encoder_create(SEVENZIP_BUFFER_7Z, SEVENZIP_LEVEL_FAST, NULL, &encoder),
+                       "No streaming 7z");
+
+    for (int kind = 0; kind < 2; kind++) {
+        uint32_t seed = 777;
+        for (size_t i = 0; i < size; i++) {
+            seed = seed * 1103515245 + 12345;
+            input[i] = kind ? (unsigned char)(seed >> 16) : (unsigned char)("stream piece\n"[i % 13]);
+        }
+        for (int f = 0; f < 2; f++) {
+            size_t bound = sevenzip_compress_buffer_bound(formats[f], size, NULL) + 64;
+            unsigned char* packed = malloc(bound);
+            TEST_ASSERT(packed != NULL, "Allocate packed buffer");
+
+            size_t packed_size = 0;
+            TEST_ASSERT(stream_encode(formats[f], input, size, packed, bound, &packed_size), "Stream encode");
+            TEST_ASSERT(kind || packed_size < size / 100, "Text compressed");
+
+            /* The buffer API reads the stream, and the stream decoder reads both */
+            size_t out_size = size;
+            SevenZipErrorCode result = sevenzip_decompress_buffer(formats[f], packed, packed_size,
+                                                                  output, &out_size);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Buffer decode of the stream");
+            TEST_ASSERT(out_size == size && memcmp(input, output, size) == 0, "Buffer round trip");
+            TEST_ASSERT(stream_decode_matches(formats[f], packed, packed_size, input, size), "Stream round trip");
+
+            packed_size = bound;
+            result = sevenzip_compress_buffer(formats[f], input, size, packed, &packed_size,
+                                              SEVENZIP_LEVEL_FAST, NULL);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compress buffer");
+            TEST_ASSERT(stream_decode_matches(formats[f], packed, packed_size, input, size),
+                        "Stream decode of a buffer");
+            free(packed);
+        }
+    }
+
+    /* An encoder freed halfway stops */
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_encoder_create(SEVENZIP_BUFFER_LZMA2, SEVENZIP_LEVEL_FAST,
+                                                            NULL, &encoder), "Create encoder");
+    for (int i = 0; i < 8; i++) {
+        size_t in_size = size;
+        size_t out_size = 0;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_encoder_update(encoder, input, &in_size, output, &out_size),
+                           "Feed encoder");
+    }
+    sevenzip_encoder_free(encoder);
+
+    free(input);
+    free(output);
+    return 1;
+}
+
+/* Helper: finish an encoder on its own thread, so a hang shows as a timeout */
+typedef struct {
+    SevenZipEncoder* encoder;
+    unsigned char* packed;
+    size_t capacity;
+    size_t packed_size;
+    SevenZipErrorCode result;
+    volatile int done;
+} FinishJob;
+
+static void* finish_encoder(void* arg) {
+    FinishJob* job = (FinishJob*)arg;
+    int finished = 0;
+    job->result = SEVENZIP_OK;
+    while (!finished && job->result == SEVENZIP_OK && job->packed_size < job->capacity) {
+        size_t out_size = job->capacity - job->packed_size;
+        job->result = sevenzip_encoder_finish(job->encoder, job->packed + job->packed_size,
+                                              &out_size, &finished);
+        job->packed_size += out_size;
+    }
+    if (!finished && job->result == SEVENZIP_OK) job->result = SEVENZIP_ERROR_COMPRESS;
+    job->done = 1;
+    return NULL;
+}
+
+/* Test: finishing once the encoder has drained its input ring and waits
+ * for more ends the stream instead of waiting on the encoder */
+static int test_stream_encoder_finish_drained() {
+    static const char text[] = "finish after the input ring drains\n";
+    const size_t size = 40 * (sizeof(text) - 1);
+    unsigned char input[40 * (sizeof(text) - 1)];
+    for (size_t i = 0; i < size; i++) input[i] = (unsigned char)text[i % (sizeof(text) - 1)];
+
+    SevenZipEncoder* encoder = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_encoder_create(SEVENZIP_BUFFER_LZMA2, SEVENZIP_LEVEL_FAST,
+                                                            NULL, &encoder), "Create encoder");
+    size_t in_size = size;
+    size_t out_size = 0;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_encoder_update(encoder, input, &in_size, NULL, &out_size),
+                       "Feed encoder");
+    TEST_ASSERT(in_size == size, "All input taken");
+    /* Let the encoder thread read the ring empty and block for more, then
+     * take the property byte it wrote first, leaving the output ring empty */
+    usleep(200 * 1000);
+    unsigned char prop[16];
+    in_size = 0;
+    out_size = sizeof(prop);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_encoder_update(encoder, input, &in_size, prop, &out_size),
+                       "Take the property byte");
+    TEST_ASSERT(out_size == 1, "Only the property byte is out");
+
+    FinishJob job;
+    memset(&job, 0, sizeof(job));
+    job.encoder = encoder;
+    job.capacity = 64 * 1024;
+    job.packed = malloc(job.capacity);
+    TEST_ASSERT(job.packed != NULL, "Allocate output");
+    job.packed[0] = prop[0];
+    job.packed_size = 1;
+    pthread_t thread;
+    TEST_ASSERT(pthread_create(&thread, NULL, finish_encoder, &job) == 0, "Start finisher");
+    for (int waited = 0; !job.done && waited < 10000; waited += 10) usleep(10 * 1000);
+    TEST_ASSERT(job.done, "Finish returns");
+    pthread_join(thread, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, job.result, "Stream finished");
+    sevenzip_encoder_free(encoder);
+
+    unsigned char output[sizeof(input)];
+    size_t output_size = sizeof(output);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_decompress_buffer(SEVENZIP_BUFFER_LZMA2, job.packed, job.packed_size,
+                                                               output, &output_size), "Decode the stream");
+    TEST_ASSERT(output_size == size && memcmp(output, input, size) == 0, "Round trip");
+    free(job.packed);
+    return 1;
+}
+
+static void count_progress(uint64_t completed, uint64_t total, void* user_data) {
+    uint64_t* last = (uint64_t*)user_data;
+    if (completed <= total) *last = completed;
+}
+
+/* Test: .lzma and LZMA2 files are streamed from file to file; the .lzma
+ * header gets the size once the input is read */
+static int test_compress_standalone_files() {
+    const char* input = "/tmp/test_standalone.bin";
+    const char* packed = "/tmp/test_standalone.pack";
+    const char* output = "/tmp/test_standalone.out";
+    const size_t size = 3 * 1024 * 1024 + 4321;
+    unsigned char* data = malloc(size);
+    TEST_ASSERT(data != NULL, "Allocate input");
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (i / 65536) % 3 ? (unsigned char)("standalone line\n"[i % 16]) : (unsigned char)(seed >> 16);
+    }
+    FILE* f = fopen(input, "wb");
+    TEST_ASSERT(f != NULL, "Write input");
+    fwrite(data, 1, size, f);
+    fclose(f);
+
+    for (int lzma2 = 0; lzma2 < 2; lzma2++) {
+        uint64_t last = 0;
+        SevenZipErrorCode result = lzma2
+            ? sevenzip_compress_lzma2(input, packed, SEVENZIP_LEVEL_FAST, count_progress, &last)
+            : sevenzip_compress_lzma(input, packed, SEVENZIP_LEVEL_FAST, count_progress, &last);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compress file");
+        TEST_ASSERT(last == size, "Progress reaches the size");
+        TEST_ASSERT(get_file_size(packed) < size, "Output smaller");
+
+        if (!lzma2) {
+            unsigned char header[13];
+            f = fopen(packed, "rb");
+            TEST_ASSERT(f != NULL && fread(header, 1, 13, f) == 13, "Read header");
+            fclose(f);
+            uint64_t stored = 0;
+            for (int i = 0; i < 8; i++) stored |= (uint64_t)header[5 + i] << (i * 8);
+            TEST_ASSERT(stored == size, "Size written into the header");
+        }
+
+        result = lzma2 ? sevenzip_decompress_lzma2(packed, output, NULL, NULL)
+                       : sevenzip_decompress_lzma(packed, output, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Decompress file");
+        TEST_ASSERT(get_file_size(output) == size, "Output size");
+        unsigned char* back = malloc(size);
+        f = fopen(output, "rb");
+        TEST_ASSERT(back && f && fread(back, 1, size, f) == size, "Read output");
+        fclose(f);
+        TEST_ASSERT(memcmp(back, data, size) == 0, "Round trip");
+        free(back);
+    }
+
+    /* An empty file compresses too */
+    f = fopen(input, "wb");
+    fclose(f);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_compress_lzma(input, packed, SEVENZIP_LEVEL_NORMAL, NULL, NULL),
+                       "Compress empty file");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_decompress_lzma(packed, output, NULL, NULL), "Decompress empty file");
+    TEST_ASSERT(file_exists(output) && get_file_size(output) == 0, "Empty output");
+
+    free(data);
+    unlink(input);
+    unlink(packed);
+    unlink(output);
+    return 1;
+}
+
+/* Test: an LZMA2 file cut short fails sevenzip_decompress_lzma2() and
+ * leaves no output, wherever it is cut */
+static int test_decompress_lzma2_truncated() {
+    const char* input = "/tmp/test_lzma2_cut.bin";
+    const char* packed = "/tmp/test_lzma2_cut.lzma2";
+    const char* output = "/tmp/test_lzma2_cut.out";
+    const size_t size = 12 * 1024 * 1024;
+    unsigned char* data = malloc(size);
+    TEST_ASSERT(data != NULL, "Allocate input");
+    uint32_t seed = 777;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (i / 65536) % 3 ? (unsigned char)("cut stream\n"[i % 11]) : (unsigned char)(seed >> 16);
+    }
+    FILE* f = fopen(input, "wb");
+    TEST_ASSERT(f != NULL, "Write input");
+    fwrite(data, 1, size, f);
+    fclose(f);
+    free(data);
+
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_compress_lzma2(input, packed, SEVENZIP_LEVEL_FAST, NULL, NULL),
+                       "Compress file");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_decompress_lzma2(packed, output, NULL, NULL),
+                       "Whole file decompresses");
+    TEST_ASSERT(get_file_size(output) == size, "Output size");
+
+    off_t packed_size = (off_t)get_file_size(packed);
+    off_t cuts[] = { packed_size - 1, packed_size - 10, packed_size * 2 / 3, packed_size / 3 };
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++) {
+        TEST_ASSERT(truncate(packed, cuts[i]) == 0, "Cut the file");
+        TEST_ASSERT(sevenzip_decompress_lzma2(packed, output, NULL, NULL) != SEVENZIP_OK,
+                    "Truncated file fails");
+        TEST_ASSERT(!file_exists(output), "No output left behind");
+    }
+
+    unlink(input);
+    unlink(packed);
+    return 1;
+}
+
+/* Test: A few small files take the in-memory builder, directories and
+ * engine-only options the streaming engine; both give the same entries */
+static void auto_progress(uint64_t done, uint64_t total, uint64_t file_done, uint64_t file_total,
+                          const char* name, void* user_data) {
+    uint64_t* last = (uint64_t*)user_data;
+    (void)total; (void)file_done; (void)file_total; (void)name;
+    *last = done;
+}
+
+static int test_create_auto() {
+    const char* text_a = "/tmp/test_auto_a.txt";
+    const char* text_b = "/tmp/test_auto_b.txt";
+    const char* archive_file = "/tmp/test_auto.7z";
+    TEST_ASSERT(create_test_file(text_a, "Small file for the in-memory builder.\n"), "Create a.txt");
+    TEST_ASSERT(create_test_file(text_b, "Another small file.\n"), "Create b.txt");
+    const char* inputs[] = {text_a, text_b, NULL};
+    const char* dir_inputs[] = {"/tmp", NULL};
+
+    SevenZipCreateEngine engine;
+    SevenZipErrorCode result = sevenzip_choose_create_engine(inputs, SEVENZIP_LEVEL_NORMAL, NULL, &engine);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Choose engine");
+    TEST_ASSERT_EQUALS(SEVENZIP_ENGINE_IN_MEMORY, engine, "Small files built in memory");
+    result = sevenzip_choose_create_engine(dir_inputs, SEVENZIP_LEVEL_NORMAL, NULL, &engine);
+    TEST_ASSERT_EQUALS(SEVENZIP_ENGINE_STREAMING, engine, "Directory trees streamed");
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    for (int pass = 0; pass < 2; pass++) {
+        options.split_size = pass ? 4 * 1024 * 1024 : 0;
+        result = sevenzip_choose_create_engine(inputs, SEVENZIP_LEVEL_NORMAL, &options, &engine);
+        TEST_ASSERT_EQUALS(pass ? SEVENZIP_ENGINE_STREAMING : SEVENZIP_ENGINE_IN_MEMORY, engine,
+                           "split_size needs the streaming engine");
+
+        uint64_t last = 0;
+        result = sevenzip_create_7z_auto(archive_file, inputs, SEVENZIP_LEVEL_NORMAL, &options,
+                                         auto_progress, &last);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+        TEST_ASSERT(last == get_file_size(text_a) + get_file_size(text_b), "Progress reaches the total");
+        result = sevenzip_test_archive(archive_file, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+
+        SevenZipList* list = NULL;
+        result = sevenzip_list(archive_file, NULL, &list);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+        TEST_ASSERT_EQUALS(2, list->count, "Both files archived");
+        int named = strcmp(list->entries[0].name, "test_auto_a.txt") == 0 &&
+                    strcmp(list->entries[1].name, "test_auto_b.txt") == 0;
+        sevenzip_free_list(list);
+        TEST_ASSERT(named, "Entries named alike by both engines");
+        unlink(archive_file);
+    }
+
+    unlink(text_a);
+    unlink(text_b);
+    return 1;
+}
+
+/* Volumes reported by test_volume_complete() */
+typedef struct {
+    int count;
+    uint32_t seen;        /* Bit per volume index */
+    uint32_t last_index;
+    uint64_t total;
+    int sizes_match;      /* Every reported size is the closed file's */
+    int digests;          /* Volumes reported with a digest */
+} VolumeReport;
+
+static void record_volume(uint32_t index, const char* path, uint64_t size, const uint8_t* digest,
+                          void* user_data) {
+    VolumeReport* report = (VolumeReport*)user_data;
+    if (digest) report->digests++;
+    struct stat st;
+    if (stat(path, &st) != 0 || (uint64_t)st.st_size != size) report->sizes_match = 0;
+    report->count++;
+    if (index < 32) report->seen |= 1u << index;
+    report->last_index = index;
+    report->total += size;
+}
+
+/* Test: With sync_volumes every volume is reported complete once, at its
+ * final size, the first one last; also through striped volume_dirs. The
+ * volume manifest matches the digests of the finished volume files. */
+static int test_volume_complete() {
+    const char* input_file = "/tmp/test_volfin.txt";
+    const char* dirs[] = {"/tmp/test_volfin_a", "/tmp/test_volfin_b", NULL};
+    mkdir(dirs[0], 0755);
+    mkdir(dirs[1], 0755);
+    FILE* f = fopen(input_file, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 20000; i++) {
+        fprintf(f, "Finished volume line %d\n", i);
+    }
+    fclose(f);
+    const char* inputs[] = {input_file, NULL};
+    
+    for (int pass = 0; pass < 2; pass++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.split_size = 64 * 1024;
+        options.sync_volumes = 1;
+        options.volume_dirs = pass ? dirs : NULL;
+        VolumeReport report;
+        memset(&report, 0, sizeof(report));
+        report.sizes_match = 1;
+        options.volume_complete = record_volume;
+        options.volume_user_data = &report;
+        options.volume_digests = 1;
+        options.volume_manifest = pass ? NULL : "/tmp/test_volfin.sha256";
+        
+        SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_volfin.7z", inputs,
+                                                                SEVENZIP_LEVEL_STORE, &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive");
+        TEST_ASSERT(report.count > 2 && report.count < 32, "Several volumes");
+        TEST_ASSERT(report.seen == (1u << report.count) - 1, "Each volume reported once");
+        TEST_ASSERT_EQUALS(0, report.last_index, "First volume completes last");
+        TEST_ASSERT(report.sizes_match, "Reported sizes are the files'");
+        TEST_ASSERT(report.total > get_file_size(input_file), "Sizes cover the stored data");
+        TEST_ASSERT_EQUALS(report.count, report.digests, "Every volume digested");
+        
+        /* Gather striped volumes for the check */
+        for (int i = 1; i <= report.count; i++) {
+            char from[64], to[64];
+            snprintf(from, sizeof(from), "%s/test_volfin.7z.%03d", dirs[(i - 1) % 2], i);
+            snprintf(to, sizeof(to), "/tmp/test_volfin.7z.%03d", i);
+            if (pass) rename(from, to);
+        }
+        result = sevenzip_test_archive("/tmp/test_volfin.7z.001", NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Archive verifies");
+        
+        if (!pass) {
+            /* The file digests of another archive over the volumes, read
+               from disk, are what the volume manifest has */
+            char names[32][64];
+            const char* volumes[33];
+            for (int i = 0; i < report.count; i++) {
+                snprintf(names[i], sizeof(names[i]), "/tmp/test_volfin.7z.%03d", i + 1);
+                volumes[i] = names[i];
+            }
+            volumes[report.count] = NULL;
+            SevenZipStreamOptions check;
+            sevenzip_stream_options_init(&check);
+            check.digest_manifest = "/tmp/test_volfin_check.sha256";
+            result = sevenzip_create_7z_streaming("/tmp/test_volfin_check.7z", volumes,
+                                                  SEVENZIP_LEVEL_STORE, &check, NULL, NULL);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Digest the volume files");
+            char* expected = read_file_content("/tmp/test_volfin_check.sha256");
+            char* manifest = read_file_content("/tmp/test_volfin.sha256");
+            int same = expected && manifest && strcmp(expected, manifest) == 0;
+            free(expected);
+            free(manifest);
+            TEST_ASSERT(same, "Volume manifest holds the volume digests");
+            unlink("/tmp/test_volfin_check.7z");
+            unlink("/tmp/test_volfin_check.sha256");
+            unlink("/tmp/test_volfin.sha256");
+        }
+        for (int i = 1; i <= report.count; i++) {
+            char volume[64];
+            snprintf(volume, sizeof(volume), "/tmp/test_volfin.7z.%03d", i);
+            unlink(volume);
+        }
+    }
+    
+    rmdir(dirs[0]);
+    rmdir(dirs[1]);
+    unlink(input_file);
+    return 1;
+}
+
+/* Test: The .7zidx sidecar lists what the archive lists, and a damaged
+ * one is refused */
+static int test_list_index() {
+    const char* dir = "/tmp/test_index_in";
+    mkdir(dir, 0755);
+    mkdir("/tmp/test_index_in/sub", 0755);
+    TEST_ASSERT(create_test_file("/tmp/test_index_in/empty.txt", ""), "Create empty file");
+    FILE* f = fopen("/tmp/test_index_in/sub/data.txt", "w");
+    TEST_ASSERT(f != NULL, "Create data file");
+    for (int i = 0; i < 20000; i++) {
+        fprintf(f, "Indexed line %d\n", i);
+    }
+    fclose(f);
+    
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.split_size = 64 * 1024;
+    options.write_index = 1;
+    const char* inputs[] = {dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_index.7z", inputs, SEVENZIP_LEVEL_STORE,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create indexed archive");
+    
+    SevenZipList* from_archive = NULL;
+    SevenZipList* from_index = NULL;
+    SevenZipArchive* archive = NULL;
+    result = sevenzip_open("/tmp/test_index.7z.001", NULL, &archive);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open archive");
+    result = sevenzip_archive_list(archive, &from_archive);
+    sevenzip_close(archive);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+    result = sevenzip_list_index("/tmp/test_index.7z.7zidx", &from_index);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List index");
+    int same = from_archive->count == from_index->count && from_index->count == 4;
+    for (size_t i = 0; same && i < from_index->count; i++) {
+        const SevenZipEntry* a = &from_archive->entries[i];
+        const SevenZipEntry* b = &from_index->entries[i];
+        same = a->name && b->name && strcmp(a->name, b->name) == 0 && a->size == b->size &&
+               a->modified_time == b->modified_time && a->attributes == b->attributes &&
+               a->is_directory == b->is_directory;
+    }
+    sevenzip_free_list(from_archive);
+    sevenzip_free_list(from_index);
+    TEST_ASSERT(same, "Index lists the archive's entries");
+    
+    /* A flipped byte fails the CRC */
+    f = fopen("/tmp/test_index.7z.7zidx", "r+b");
+    TEST_ASSERT(f != NULL, "Open index");
+    fseek(f, 70, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, 70, SEEK_SET);
+    fputc(c ^ 0x01, f);
+    fclose(f);
+    result = sevenzip_list_index("/tmp/test_index.7z.7zidx", &from_index);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_ARCHIVE, result, "Damaged index refused");
+    unlink("/tmp/test_index.7z.7zidx");
+    result = sevenzip_list_index("/tmp/test_index.7z.7zidx", &from_index);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "Missing index reported");
+    
+    for (int i = 1; i <= 9; i++) {
+        char volume[64];
+        snprintf(volume, sizeof(volume), "/tmp/test_index.7z.%03d", i);
+        unlink(volume);
+    }
+    unlink("/tmp/test_index_in/sub/data.txt");
+    unlink("/tmp/test_index_in/empty.txt");
+    rmdir("/tmp/test_index_in/sub");
+    rmdir(dir);
+    return 1;
+}
+
+/* Image layout: data and zero runs, in bytes; a run below 1MB stays data */
+static const size_t zero_image_layout[] = {
+    512 * 1024, 5 * 1024 * 1024 + 40000, 300 * 1024, 700 * 1024, 100 * 1024, 9 * 1024 * 1024
+};
+
+static int write_zero_image(const char* path, unsigned char** image, size_t* size) {
+    size_t total = 0;
+    for (size_t i = 0; i < sizeof(zero_image_layout) / sizeof(zero_image_layout[0]); i++) {
+        total += zero_image_layout[i];
+    }
+    unsigned char* data = (unsigned char*)calloc(total, 1);
+    if (!data) return 0;
+    uint32_t seed = 12345;
+    size_t pos = 0;
+    for (size_t i = 0; i < sizeof(zero_image_layout) / sizeof(zero_image_layout[0]); i++) {
+        if ((i & 1) == 0) {
+            for (size_t j = 0; j < zero_image_layout[i]; j++) {
+                seed = seed * 1103515245u + 12345u;
+                data[pos + j] = (unsigned char)(seed >> 24);
+            }
+        }
+        pos += zero_image_layout[i];
+    }
+    FILE* f = fopen(path, "wb");
+    int ok = f && fwrite(data, 1, total, f) == total;
+    if (f) fclose(f);
+    *image = data;
+    *size = total;
+    return ok;
+}
+
+static int test_zero_blocks() {
+    sevenzip_init();
+    const char* input_file = "/tmp/test_zero_image.img";
+    unsigned char* image = NULL;
+    size_t image_size = 0;
+    int written = write_zero_image(input_file, &image, &image_size);
+    TEST_ASSERT(written, "Create image");
+    
+    const char* inputs[] = {input_file, NULL};
+    unsigned char* extracted = (unsigned char*)malloc(image_size);
+    TEST_ASSERT(extracted != NULL, "Allocate read buffer");
+    for (int solid = 0; solid < 2; solid++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.num_threads = 2;
+        options.solid = solid;
+        options.zero_blocks = 1;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_zero_image.7z", inputs,
+                                                                SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create with zero blocks");
+        TEST_ASSERT(get_file_size("/tmp/test_zero_image.7z") < 2 * 1024 * 1024,
+                    "Archive holds little more than the data");
+        result = sevenzip_test_archive("/tmp/test_zero_image.7z", NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "CRCs match");
+        
+        result = sevenzip_extract("/tmp/test_zero_image.7z", "/tmp/test_zero_image_out", NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract image");
+        FILE* f = fopen("/tmp/test_zero_image_out/test_zero_image.img", "rb");
+        TEST_ASSERT(f != NULL, "Open extracted image");
+        size_t got = fread(extracted, 1, image_size, f);
+        int at_end = fgetc(f) == EOF;
+        fclose(f);
+        TEST_ASSERT(got == image_size && at_end && memcmp(extracted, image, image_size) == 0,
+                    "Image restored byte for byte");
+        unlink("/tmp/test_zero_image_out/test_zero_image.img");
+        rmdir("/tmp/test_zero_image_out");
+        unlink("/tmp/test_zero_image.7z");
+    }
+    
+    free(extracted);
+    free(image);
+    unlink(input_file);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* A thin file: data at the start, in the middle and at the end, holes between */
+static int test_sparse_source() {
+    sevenzip_init();
+    const char* input_file = "/tmp/test_sparse_source.img";
+    const size_t image_size = 48 * 1024 * 1024;
+    const size_t extents[] = {0, 20 * 1024 * 1024 + 4096, image_size - 8192};
+    unsigned char* image = (unsigned char*)calloc(image_size, 1);
+    TEST_ASSERT(image != NULL, "Allocate image");
+    FILE* f = fopen(input_file, "wb");
+    TEST_ASSERT(f != NULL, "Create sparse file");
+    for (size_t i = 0; i < sizeof(extents) / sizeof(extents[0]); i++) {
+        for (size_t j = 0; j < 8192; j++) {
+            image[extents[i] + j] = (unsigned char)(j * 7 + i + 1);
+        }
+        fseek(f, (long)extents[i], SEEK_SET);
+        fwrite(image + extents[i], 1, 8192, f);
+    }
+    fclose(f);
+    TEST_ASSERT(get_file_size(input_file) == image_size, "Sparse file size");
+    
+    const char* inputs[] = {input_file, NULL};
+    unsigned char* extracted = (unsigned char*)malloc(image_size);
+    TEST_ASSERT(extracted != NULL, "Allocate read buffer");
+    for (int solid = 0; solid < 2; solid++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.num_threads = 2;
+        options.solid = solid;
+        options.zero_blocks = solid;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_sparse_source.7z", inputs,
+                                                                SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create from sparse file");
+        result = sevenzip_extract("/tmp/test_sparse_source.7z", "/tmp/test_sparse_source_out", NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract sparse file");
+        f = fopen("/tmp/test_sparse_source_out/test_sparse_source.img", "rb");
+        TEST_ASSERT(f != NULL, "Open extracted file");
+        size_t got = fread(extracted, 1, image_size, f);
+        fclose(f);
+        TEST_ASSERT(got == image_size && memcmp(extracted, image, image_size) == 0,
+                    "Holes read back as zeros");
+        unlink("/tmp/test_sparse_source_out/test_sparse_source.img");
+        rmdir("/tmp/test_sparse_source_out");
+        unlink("/tmp/test_sparse_source.7z");
+    }
+    
+    free(extracted);
+    free(image);
+    unlink(input_file);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* A background job held to 1MB/s of reads, then let go through its handle */
+static int test_rate_limit() {
+    sevenzip_init();
+    const char* input_file = "/tmp/test_rate_limit.dat";
+    const size_t data_size = 8 * 1024 * 1024;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    TEST_ASSERT(data != NULL, "Allocate data");
+    for (size_t i = 0; i < data_size; i++) data[i] = (unsigned char)((i / 64) % 251);
+    FILE* f = fopen(input_file, "wb");
+    TEST_ASSERT(f != NULL, "Create input");
+    size_t written = fwrite(data, 1, data_size, f);
+    fclose(f);
+    free(data);
+    TEST_ASSERT(written == data_size, "Write input");
+    
+    SevenZipRateLimit* limit = sevenzip_rate_limit_create(1024 * 1024, 0);
+    TEST_ASSERT(limit != NULL, "Create rate limit");
+    const char* inputs[] = {input_file, NULL};
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.num_threads = 2;
+    options.rate_limit = limit;
+    SevenZipJob* job = NULL;
+    SevenZipErrorCode result = sevenzip_submit_create("/tmp/test_rate_limit.7z", inputs,
+                                                      SEVENZIP_LEVEL_FASTEST, &options,
+                                                      NULL, NULL, NULL, &job);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Submit job");
+    
+    /* 8MB at 1MB/s: well over a second unless lifted */
+    usleep(300 * 1000);
+    TEST_ASSERT(!sevenzip_job_poll(job, NULL), "Job held to the budget");
+    sevenzip_job_set_rate_limit(job, 0, 0);
+    result = sevenzip_job_wait(job);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Job finishes once unlimited");
+    sevenzip_job_free(job);
+    sevenzip_rate_limit_free(limit);
+    
+    result = sevenzip_test_archive("/tmp/test_rate_limit.7z", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "CRCs match");
+    unlink("/tmp/test_rate_limit.7z");
+    unlink(input_file);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* The pack stream being written goes straight out: no scratch file even
+ * where one cannot be made */
+static int test_write_through() {
+    sevenzip_init();
+    const char* input_file = "/tmp/test_write_through.dat";
+    const size_t data_size = 40 * 1024 * 1024;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    TEST_ASSERT(data != NULL, "Allocate data");
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < data_size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[i] = (unsigned char)x;
+    }
+    FILE* f = fopen(input_file, "wb");
+    TEST_ASSERT(f != NULL, "Create input");
+    size_t written = fwrite(data, 1, data_size, f);
+    fclose(f);
+    TEST_ASSERT(written == data_size, "Write input");
+    
+    const char* inputs[] = {input_file, NULL};
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.num_threads = 1;
+    options.solid = 0;
+    options.temp_dir = "/tmp/test_write_through_missing_dir";
+    SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_write_through.7z", inputs,
+                                                            SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create without scratch space");
+    result = sevenzip_extract("/tmp/test_write_through.7z", "/tmp/test_write_through_out", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract");
+    f = fopen("/tmp/test_write_through_out/test_write_through.dat", "rb");
+    TEST_ASSERT(f != NULL, "Open extracted file");
+    unsigned char* extracted = (unsigned char*)malloc(data_size);
+    size_t got = extracted ? fread(extracted, 1, data_size, f) : 0;
+    int at_end = fgetc(f) == EOF;
+    fclose(f);
+    int same = got == data_size && at_end && memcmp(extracted, data, data_size) == 0;
+    free(extracted);
+    free(data);
+    TEST_ASSERT(same, "Data restored byte for byte");
+    
+    unlink("/tmp/test_write_through_out/test_write_through.dat");
+    rmdir("/tmp/test_write_through_out");
+    unlink("/tmp/test_write_through.7z");
+    unlink(input_file);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Solid and non-solid, filtered and encrypted folders pass the verifier */
+static int test_verify_writes() {
+    sevenzip_init();
+    const char* input_file = "/tmp/test_verify_writes.dat";
+    const size_t data_size = 12 * 1024 * 1024;
+    unsigned char* data = (unsigned char*)malloc(data_size);
+    TEST_ASSERT(data != NULL, "Allocate data");
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < data_size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[i] = (unsigned char)((i / 16) % 97 + (x & 3));
+    }
+    FILE* f = fopen(input_file, "wb");
+    TEST_ASSERT(f != NULL, "Create input");
+    size_t written = fwrite(data, 1, data_size, f);
+    fclose(f);
+    free(data);
+    TEST_ASSERT(written == data_size, "Write input");
+    
+    const char* inputs[] = {input_file, NULL};
+    for (int run = 0; run < 4; run++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.num_threads = 2;
+        options.solid = run & 1;
+        options.filter = (run & 1) ? SEVENZIP_FILTER_DELTA : SEVENZIP_FILTER_BCJ;
+        options.password = (run & 2) ? "verify" : NULL;
+        options.verify_writes = 1;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_verify_writes.7z", inputs,
+                                                                SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create with verify_writes");
+        result = sevenzip_test_archive("/tmp/test_verify_writes.7z", options.password, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "CRCs match");
+        unlink("/tmp/test_verify_writes.7z");
+    }
+    
+    unlink(input_file);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Inputs pulled from a callback and read from a list file, without input_paths */
+static const char* next_test_input(void* user_data) {
+    static const char* paths[] = {"/tmp/test_input_source_0.txt", "/tmp/test_input_source_1.txt"};
+    int* next = (int*)user_data;
+    return *next < 2 ? paths[(*next)++] : NULL;
+}
+
+static int test_input_sources() {
+    sevenzip_init();
+    char path[64];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "/tmp/test_input_source_%d.txt", i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        fprintf(f, "Input %d arrives without an array of paths.\n", i);
+        fclose(f);
+    }
+    FILE* f = fopen("/tmp/test_input_source.lst", "wb");
+    TEST_ASSERT(f != NULL, "Create list");
+    fprintf(f, "\r\n/tmp/test_input_source_2.txt\r\n");
+    fclose(f);
+    
+    int next = 0;
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.next_input_path = next_test_input;
+    options.input_path_user_data = &next;
+    options.input_list = "/tmp/test_input_source.lst";
+    SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_input_source.7z", NULL,
+                                                            SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create from callback and list");
+    SevenZipList* list = NULL;
+    result = sevenzip_list("/tmp/test_input_source.7z", NULL, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+    size_t count = list->count;
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(3, (int)count, "Every source gathered");
+    
+    options.next_input_path = NULL;
+    options.input_list = "/tmp/test_input_source_missing.lst";
+    result = sevenzip_create_7z_streaming("/tmp/test_input_source.7z", NULL,
+                                          SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "Missing list reported");
+    
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "/tmp/test_input_source_%d.txt", i);
+        unlink(path);
+    }
+    unlink("/tmp/test_input_source.lst");
+    unlink("/tmp/test_input_source.7z");
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Parts compressed apart, then assembled into one archive and into volumes */
+static int test_assemble_parts() {
+    sevenzip_init();
+    char path[64];
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "/tmp/test_assemble_%d.txt", i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 200; line++) {
+            fprintf(f, "Input %d, line %d, compressed on node %d.\n", i, line, i / 2);
+        }
+        fclose(f);
+    }
+    
+    const char* node0[] = {"/tmp/test_assemble_0.txt", "/tmp/test_assemble_1.txt", NULL};
+    const char* node1[] = {"/tmp/test_assemble_2.txt", "/tmp/test_assemble_3.txt", NULL};
+    SevenZipCompressOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.num_threads = 1;
+    opts.solid = 0;
+    SevenZipErrorCode result = sevenzip_compress_folder_part("/tmp/test_assemble_p0.7z", node0, "node0",
+                                                             SEVENZIP_LEVEL_FAST, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compress part 0");
+    result = sevenzip_compress_folder_part("/tmp/test_assemble_p1.7z", node1, "node1/",
+                                           SEVENZIP_LEVEL_NORMAL, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compress part 1");
+    
+    const char* parts[] = {"/tmp/test_assemble_p0.7z", "/tmp/test_assemble_p1.7z", NULL};
+    result = sevenzip_assemble_archive("/tmp/test_assemble.7z", parts, 0, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Assemble");
+    result = sevenzip_test_archive("/tmp/test_assemble.7z", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Assembled archive tests clean");
+    
+    SevenZipList* list = NULL;
+    result = sevenzip_list("/tmp/test_assemble.7z", NULL, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List assembled archive");
+    TEST_ASSERT_EQUALS(4, (int)list->count, "Entries of both parts");
+    TEST_ASSERT(strcmp(list->entries[0].name, "node0/test_assemble_0.txt") == 0, "Part 0 first");
+    TEST_ASSERT(strcmp(list->entries[3].name, "node1/test_assemble_3.txt") == 0, "Part 1 prefixed");
+    sevenzip_free_list(list);
+    
+    /* Split output: same bytes, cut into volumes */
+    result = sevenzip_assemble_archive("/tmp/test_assemble_split.7z", parts, 1000, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Assemble into volumes");
+    result = sevenzip_test_archive("/tmp/test_assemble_split.7z.001", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Volumes test clean");
+    struct stat st;
+    TEST_ASSERT(stat("/tmp/test_assemble_split.7z.002", &st) == 0, "Several volumes");
+    TEST_ASSERT(stat("/tmp/test_assemble_split.7z.001", &st) == 0, "First volume");
+    TEST_ASSERT_EQUALS(1000, (int)st.st_size, "Full volume");
+    
+    const char* missing[] = {"/tmp/test_assemble_p0.7z", "/tmp/test_assemble_none.7z", NULL};
+    result = sevenzip_assemble_archive("/tmp/test_assemble_bad.7z", missing, 0, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "Missing part reported");
+    TEST_ASSERT(stat("/tmp/test_assemble_bad.7z", &st) != 0, "Nothing left behind");
+    
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "/tmp/test_assemble_%d.txt", i);
+        unlink(path);
+    }
+    for (int v = 1; v < 100; v++) {
+        snprintf(path, sizeof(path), "/tmp/test_assemble_split.7z.%03d", v);
+        if (unlink(path) != 0) break;
+    }
+    unlink("/tmp/test_assemble_p0.7z");
+    unlink("/tmp/test_assemble_p1.7z");
+    unlink("/tmp/test_assemble.7z");
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Hourly archives merged into one: shared directory once, identical file
+ * (and identical empty file) dropped with its folder, changed file renamed */
+static void write_merge_input(const char* path, const char* text) {
+    FILE* f = fopen(path, "w");
+    if (f) {
+        for (int line = 0; line < 100; line++) fprintf(f, "%s %d\n", text, line);
+        fclose(f);
+    }
+}
+
+static int test_merge_archives() {
+    sevenzip_init();
+    mkdir("/tmp/test_merge_h1", 0755);
+    mkdir("/tmp/test_merge_h1/logs", 0755);
+    mkdir("/tmp/test_merge_h2", 0755);
+    mkdir("/tmp/test_merge_h2/logs", 0755);
+    write_merge_input("/tmp/test_merge_h1/logs/a.txt", "first hour");
+    write_merge_input("/tmp/test_merge_h1/logs/b.txt", "unchanged");
+    write_merge_input("/tmp/test_merge_h2/logs/a.txt", "second hour");
+    write_merge_input("/tmp/test_merge_h2/logs/b.txt", "unchanged");
+    write_merge_input("/tmp/test_merge_h2/logs/c.txt", "new in the second hour");
+    TEST_ASSERT(create_test_file("/tmp/test_merge_h1/logs/empty.log", ""), "Create empty file");
+    TEST_ASSERT(create_test_file("/tmp/test_merge_h2/logs/empty.log", ""), "Create empty file");
+    
+    SevenZipCompressOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.num_threads = 1;
+    opts.solid = 0;
+    const char* h1[] = {"/tmp/test_merge_h1", NULL};
+    const char* h2[] = {"/tmp/test_merge_h2", NULL};
+    SevenZipErrorCode result = sevenzip_create_7z("/tmp/test_merge_h1.7z", h1, SEVENZIP_LEVEL_FAST,
+                                                  &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create first hour");
+    result = sevenzip_create_7z("/tmp/test_merge_h2.7z", h2, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create second hour");
+    
+    const char* inputs[] = {"/tmp/test_merge_h1.7z", "/tmp/test_merge_h2.7z", NULL};
+    result = sevenzip_merge_archives("/tmp/test_merge.7z", inputs, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Merge");
+    result = sevenzip_test_archive("/tmp/test_merge.7z", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Merged archive tests clean");
+    
+    SevenZipList* list = NULL;
+    result = sevenzip_list("/tmp/test_merge.7z", NULL, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List merged archive");
+    int dirs = 0, renamed = 0, b_files = 0, empty_files = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        dirs += list->entries[i].is_directory;
+        renamed += strcmp(list->entries[i].name, "logs/a (2).txt") == 0;
+        b_files += strcmp(list->entries[i].name, "logs/b.txt") == 0;
+        empty_files += strncmp(list->entries[i].name, "logs/empty", 10) == 0;
+    }
+    size_t count = list->count;
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(6, (int)count, "logs, a, b, a (2), c, empty");
+    TEST_ASSERT_EQUALS(1, dirs, "Directory merged");
+    TEST_ASSERT_EQUALS(1, renamed, "Changed file renamed");
+    TEST_ASSERT_EQUALS(1, b_files, "Identical file dropped");
+    TEST_ASSERT_EQUALS(1, empty_files, "Identical empty file dropped, not renamed");
+    
+    /* Every file listed under its own name */
+    SevenZipMergeOptions merge;
+    sevenzip_merge_options_init(&merge);
+    merge.names = SEVENZIP_MERGE_KEEP_ALL;
+    merge.drop_identical = 0;
+    result = sevenzip_merge_archives("/tmp/test_merge.7z", inputs, &merge, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Merge keeping all");
+    result = sevenzip_list("/tmp/test_merge.7z", NULL, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List");
+    count = list->count;
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(8, (int)count, "Both copies of a, b and empty");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive("/tmp/test_merge.7z", NULL, NULL, NULL),
+                       "Tests clean");
+    
+    unlink("/tmp/test_merge_h1/logs/a.txt");
+    unlink("/tmp/test_merge_h1/logs/b.txt");
+    unlink("/tmp/test_merge_h2/logs/a.txt");
+    unlink("/tmp/test_merge_h2/logs/b.txt");
+    unlink("/tmp/test_merge_h2/logs/c.txt");
+    unlink("/tmp/test_merge_h1/logs/empty.log");
+    unlink("/tmp/test_merge_h2/logs/empty.log");
+    rmdir("/tmp/test_merge_h1/logs");
+    rmdir("/tmp/test_merge_h2/logs");
+    rmdir("/tmp/test_merge_h1");
+    rmdir("/tmp/test_merge_h2");
+    unlink("/tmp/test_merge_h1.7z");
+    unlink("/tmp/test_merge_h2.7z");
+    unlink("/tmp/test_merge.7z");
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Volumes cut to another size, joined into one file, and a missing volume */
+static int test_resplit_archive() {
+    sevenzip_init();
+    const char* input_file = "/tmp/test_resplit.bin";
+    FILE* f = fopen(input_file, "wb");
+    TEST_ASSERT(f != NULL, "Create input");
+    unsigned state = 7;
+    for (int i = 0; i < 300000; i++) {
+        state = state * 1103515245u + 12345u;
+        fputc((int)(state >> 24), f);
+    }
+    fclose(f);
+    
+    const char* inputs[] = {input_file, NULL};
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.split_size = 100000;
+    SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_resplit_src.7z", inputs,
+                                                            SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive");
+    
+    result = sevenzip_resplit_archive("/tmp/test_resplit_src.7z.001", "/tmp/test_resplit_dst.7z",
+                                      64 * 1024, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Re-split");
+    struct stat st;
+    TEST_ASSERT(stat("/tmp/test_resplit_dst.7z.005", &st) == 0, "Smaller volumes");
+    TEST_ASSERT(stat("/tmp/test_resplit_dst.7z.001", &st) == 0 && st.st_size == 64 * 1024,
+                "Full volume");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive("/tmp/test_resplit_dst.7z.001", NULL, NULL, NULL),
+                       "Re-split archive tests clean");
+    
+    result = sevenzip_resplit_archive("/tmp/test_resplit_dst.7z.001", "/tmp/test_resplit_joined.7z",
+                                      0, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Join");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive("/tmp/test_resplit_joined.7z", NULL, NULL, NULL),
+                       "Joined archive tests clean");
+    
+    result = sevenzip_resplit_archive("/tmp/test_resplit_dst.7z.001", "/tmp/test_resplit_dst.7z",
+                                      0, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Output over the source refused");
+    
+    unlink("/tmp/test_resplit_dst.7z.003");
+    result = sevenzip_resplit_archive("/tmp/test_resplit_dst.7z.001", "/tmp/test_resplit_bad.7z",
+                                      0, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_ARCHIVE, result, "Missing volume reported");
+    TEST_ASSERT(stat("/tmp/test_resplit_bad.7z", &st) != 0, "Nothing written");
+    
+    char path[64];
+    for (int v = 1; v < 100; v++) {
+        snprintf(path, sizeof(path), "/tmp/test_resplit_src.7z.%03d", v);
+        unlink(path);
+        snprintf(path, sizeof(path), "/tmp/test_resplit_dst.7z.%03d", v);
+        unlink(path);
+    }
+    unlink("/tmp/test_resplit_joined.7z");
+    unlink(input_file);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Entries removed: a whole folder dropped, a solid block repacked, a tree */
+static int test_delete_entries() {
+    sevenzip_init();
+    mkdir("/tmp/test_delete_in", 0755);
+    mkdir("/tmp/test_delete_in/private", 0755);
+    const char* files[] = {"/tmp/test_delete_in/a.txt", "/tmp/test_delete_in/b.txt",
+                           "/tmp/test_delete_in/c.txt", "/tmp/test_delete_in/d.txt",
+                           "/tmp/test_delete_in/private/p.txt"};
+    for (int i = 0; i < 5; i++) {
+        FILE* f = fopen(files[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 300; line++) fprintf(f, "File %d, record %d\n", i, line);
+        fclose(f);
+    }
+    
+    /* Two files per solid block */
+    SevenZipCompressOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.num_threads = 1;
+    opts.solid = 1;
+    opts.solid_block_files = 2;
+    const char* inputs[] = {"/tmp/test_delete_in", NULL};
+    const char* archive = "/tmp/test_delete.7z";
+    SevenZipErrorCode result = sevenzip_create_7z(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    
+    const char* names[] = {"a.txt", "private", "missing.txt", NULL};
+    size_t deleted = 0;
+    result = sevenzip_delete_entries(archive, names, SEVENZIP_LEVEL_FAST, &opts, &deleted);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Delete");
+    TEST_ASSERT_EQUALS(3, (int)deleted, "a.txt, private and private/p.txt");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive, NULL, NULL, NULL), "Tests clean");
+    
+    SevenZipList* list = NULL;
+    result = sevenzip_list(archive, NULL, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List");
+    int left = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        const char* name = list->entries[i].name;
+        left += strcmp(name, "b.txt") == 0 || strcmp(name, "c.txt") == 0 || strcmp(name, "d.txt") == 0;
+    }
+    size_t count = list->count;
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(3, (int)count, "Three entries left");
+    TEST_ASSERT_EQUALS(3, left, "The others kept");
+    
+    /* Repacked and copied folders hold the same bytes as the inputs */
+    result = sevenzip_extract(archive, "/tmp/test_delete_out", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract");
+    TEST_ASSERT(!file_exists("/tmp/test_delete_out/a.txt"), "a.txt gone");
+    for (int i = 1; i < 4; i++) {
+        char out_path[256];
+        snprintf(out_path, sizeof(out_path), "/tmp/test_delete_out/%s", strrchr(files[i], '/') + 1);
+        char* expected = read_file_content(files[i]);
+        char* actual = read_file_content(out_path);
+        int same = expected && actual && strcmp(expected, actual) == 0;
+        free(expected);
+        free(actual);
+        TEST_ASSERT(same, "Kept file matches its input");
+        unlink(out_path);
+    }
+    rmdir("/tmp/test_delete_out");
+    
+    const char* none[] = {"missing.txt", NULL};
+    result = sevenzip_delete_entries(archive, none, SEVENZIP_LEVEL_FAST, NULL, &deleted);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Nothing to delete");
+    TEST_ASSERT_EQUALS(0, (int)deleted, "Nothing matched");
+    
+    for (int i = 0; i < 5; i++) unlink(files[i]);
+    rmdir("/tmp/test_delete_in/private");
+    rmdir("/tmp/test_delete_in");
+    unlink(archive);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Deterministic mode: the same bytes on 1, 2 and 4 threads, solid or not */
+static int test_deterministic_output() {
+    sevenzip_init();
+    mkdir("/tmp/test_det_in", 0755);
+    const char* files[] = {"/tmp/test_det_in/big.txt", "/tmp/test_det_in/b.txt", "/tmp/test_det_in/a.txt"};
+    for (int i = 0; i < 3; i++) {
+        FILE* f = fopen(files[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        /* big.txt spans three 1MB blocks */
+        int lines = i == 0 ? 120000 : 500;
+        for (int line = 0; line < lines; line++) fprintf(f, "File %d, record %d, %d\n", i, line, line * 7919 % 1000);
+        fclose(f);
+    }
+    
+    const char* inputs[] = {"/tmp/test_det_in", NULL};
+    const int threads[] = {1, 2, 4};
+    for (int solid = 0; solid < 2; solid++) {
+        char* first = NULL;
+        uint64_t first_size = 0;
+        for (int t = 0; t < 3; t++) {
+            SevenZipStreamOptions opts;
+            sevenzip_stream_options_init(&opts);
+            opts.num_threads = threads[t];
+            opts.solid = solid;
+            opts.block_size = 1 << 20;
+            opts.deterministic = 1;
+            opts.fixed_mtime = 1000000000;
+            SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_det.7z", inputs,
+                                                                  SEVENZIP_LEVEL_NORMAL, &opts, NULL, NULL);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create deterministic archive");
+            uint64_t size = get_file_size("/tmp/test_det.7z");
+            FILE* f = fopen("/tmp/test_det.7z", "rb");
+            TEST_ASSERT(f != NULL, "Open archive");
+            char* bytes = malloc(size);
+            TEST_ASSERT(bytes != NULL && fread(bytes, 1, size, f) == size, "Read archive");
+            fclose(f);
+            if (!first) {
+                first = bytes;
+                first_size = size;
+                continue;
+            }
+            TEST_ASSERT(size == first_size && memcmp(bytes, first, size) == 0, "Same bytes on every thread count");
+            free(bytes);
+        }
+        free(first);
+    }
+    
+    SevenZipList* list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list("/tmp/test_det.7z", NULL, &list), "List");
+    TEST_ASSERT_EQUALS(4, (int)list->count, "The directory and three files");
+    TEST_ASSERT(strcmp(list->entries[1].name, "test_det_in/a.txt") == 0, "Sorted by name");
+    for (size_t i = 0; i < list->count; i++) {
+        TEST_ASSERT_EQUALS(1000000000, (int)list->entries[i].modified_time, "Fixed mtime");
+    }
+    sevenzip_free_list(list);
+    
+    SevenZipStreamOptions opts;
+    sevenzip_stream_options_init(&opts);
+    opts.deterministic = 1;
+    opts.throughput_target = 50.0;
+    SevenZipErrorCode result = sevenzip_create_7z_streaming("/tmp/test_det.7z", inputs,
+                                                          SEVENZIP_LEVEL_NORMAL, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Not with a throughput target");
+    
+    for (int i = 0; i < 3; i++) unlink(files[i]);
+    rmdir("/tmp/test_det_in");
+    unlink("/tmp/test_det.7z");
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Block cache: unchanged files spliced in, changed ones and new settings compressed */
+static int test_block_cache() {
+    sevenzip_init();
+    const char* cache_dir = "/tmp/test_bcache";
+    mkdir(cache_dir, 0755);
+    mkdir("/tmp/test_bcache_in", 0755);
+    const char* files[] = {"/tmp/test_bcache_in/a.txt", "/tmp/test_bcache_in/b.txt",
+                           "/tmp/test_bcache_in/c.txt"};
+    for (int i = 0; i < 3; i++) {
+        FILE* f = fopen(files[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 2000; line++) fprintf(f, "File %d, record %d\n", i, line);
+        fclose(f);
+    }
+    
+    const char* inputs[] = {"/tmp/test_bcache_in", NULL};
+    const char* archive = "/tmp/test_bcache.7z";
+    SevenZipStreamOptions opts;
+    sevenzip_stream_options_init(&opts);
+    opts.num_threads = 2;
+    opts.solid = 0;
+    opts.block_cache_dir = cache_dir;
+    SevenZipOpStats stats;
+    
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                          &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "First run");
+    sevenzip_get_last_stats(&stats);
+    TEST_ASSERT_EQUALS(3, (int)stats.block_cache_stores, "Every file cached");
+    TEST_ASSERT_EQUALS(0, (int)stats.block_cache_hits, "Nothing to splice yet");
+    uint64_t first_size = get_file_size(archive);
+    
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_NORMAL, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Second run");
+    sevenzip_get_last_stats(&stats);
+    TEST_ASSERT_EQUALS(3, (int)stats.block_cache_hits, "Every file spliced");
+    TEST_ASSERT_EQUALS(0, (int)stats.block_cache_stores, "Nothing new");
+    TEST_ASSERT(get_file_size(archive) == first_size, "Same archive");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive, NULL, NULL, NULL), "Spliced archive tests clean");
+    
+    FILE* f = fopen(files[1], "a");
+    TEST_ASSERT(f != NULL, "Change input");
+    fprintf(f, "One more line\n");
+    fclose(f);
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_NORMAL, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Run with a changed file");
+    sevenzip_get_last_stats(&stats);
+    TEST_ASSERT_EQUALS(2, (int)stats.block_cache_hits, "Unchanged files spliced");
+    TEST_ASSERT_EQUALS(1, (int)stats.block_cache_stores, "Changed file compressed");
+    
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Run at another level");
+    sevenzip_get_last_stats(&stats);
+    TEST_ASSERT_EQUALS(0, (int)stats.block_cache_hits, "Other settings, other keys");
+    
+    /* Damaged entries are compressed again and replaced */
+    DIR* dir = opendir(cache_dir);
+    TEST_ASSERT(dir != NULL, "Open cache");
+    struct dirent* de;
+    int entries = 0;
+    while ((de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, de->d_name);
+        f = fopen(path, "r+b");
+        TEST_ASSERT(f != NULL, "Open entry");
+        fseek(f, 40, SEEK_SET);
+        int c = fgetc(f);
+        fseek(f, 40, SEEK_SET);
+        fputc(c ^ 0xFF, f);
+        fclose(f);
+        entries++;
+    }
+    closedir(dir);
+    TEST_ASSERT_EQUALS(7, entries, "Entries of both levels");
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Run with damaged entries");
+    sevenzip_get_last_stats(&stats);
+    TEST_ASSERT_EQUALS(0, (int)stats.block_cache_hits, "Damaged entries not spliced");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive, NULL, NULL, NULL), "Archive tests clean");
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Run after the damage");
+    sevenzip_get_last_stats(&stats);
+    TEST_ASSERT_EQUALS(3, (int)stats.block_cache_stores + (int)stats.block_cache_hits, "Entries made again");
+    
+    opts.password = "secret";
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Not with a password");
+    
+    dir = opendir(cache_dir);
+    while (dir && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, de->d_name);
+        unlink(path);
+    }
+    if (dir) closedir(dir);
+    rmdir(cache_dir);
+    for (int i = 0; i < 3; i++) unlink(files[i]);
+    rmdir("/tmp/test_bcache_in");
+    unlink(archive);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Main test runner */
+/* Helper: 1 if the archive lists exactly `names` (any order) */
+static int scan_filter_lists(const char* archive, const char* const* names) {
+    SevenZipList* list = NULL;
+    if (sevenzip_list(archive, NULL, &list) != SEVENZIP_OK) return 0;
+    size_t expected = 0;
+    while (names[expected]) expected++;
+    int ok = list->count == expected;
+    for (size_t i = 0; ok && i < list->count; i++) {
+        int found = 0;
+        for (size_t k = 0; k < expected; k++) found |= strcmp(list->entries[i].name, names[k]) == 0;
+        ok = found;
+    }
+    sevenzip_free_list(list);
+    return ok;
+}
+
+static int test_scan_filters() {
+    sevenzip_init();
+    const char* dirs[] = {"/tmp/test_scanfilter_in", "/tmp/test_scanfilter_in/node_modules",
+                          "/tmp/test_scanfilter_in/node_modules/pkg", "/tmp/test_scanfilter_in/src",
+                          "/tmp/test_scanfilter_in/src/node_modules", "/tmp/test_scanfilter_in/build"};
+    const char* files[] = {"/tmp/test_scanfilter_in/a.c", "/tmp/test_scanfilter_in/b.tmp",
+                           "/tmp/test_scanfilter_in/node_modules/pkg/x.js",
+                           "/tmp/test_scanfilter_in/src/c.c", "/tmp/test_scanfilter_in/src/d.tmp",
+                           "/tmp/test_scanfilter_in/src/node_modules/y.js",
+                           "/tmp/test_scanfilter_in/build/o.c"};
+    for (int i = 0; i < 6; i++) mkdir(dirs[i], 0755);
+    for (int i = 0; i < 7; i++) {
+        FILE* f = fopen(files[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        fprintf(f, "contents of %s\n", files[i]);
+        fclose(f);
+    }
+    
+    const char* inputs[] = {"/tmp/test_scanfilter_in", NULL};
+    const char* archive = "/tmp/test_scanfilter.7z";
+    SevenZipStreamOptions opts;
+    sevenzip_stream_options_init(&opts);
+    
+    /* Excluded names at any depth, and one anchored directory */
+    const char* exclude[] = {"node_modules", "*.tmp", "/test_scanfilter_in/build/", NULL};
+    opts.exclude_patterns = exclude;
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FAST,
+                                                          &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create with excludes");
+    const char* kept[] = {"test_scanfilter_in", "test_scanfilter_in/a.c", "test_scanfilter_in/src",
+                          "test_scanfilter_in/src/c.c", NULL};
+    TEST_ASSERT(scan_filter_lists(archive, kept), "Excluded files and subtrees left out");
+    
+    /* Includes keep matching files; other directories are walked, not listed */
+    const char* include[] = {"*.c", NULL};
+    const char* exclude_src[] = {"src", NULL};
+    opts.include_patterns = include;
+    opts.exclude_patterns = exclude_src;
+    opts.num_threads = 2;
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create with includes");
+    const char* included[] = {"test_scanfilter_in/a.c", "test_scanfilter_in/build/o.c", NULL};
+    TEST_ASSERT(scan_filter_lists(archive, included), "Only included files");
+    
+    const char* malformed[] = {"[a", NULL};
+    opts.include_patterns = malformed;
+    result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Malformed pattern");
+    
+    for (int i = 0; i < 7; i++) unlink(files[i]);
+    for (int i = 5; i >= 0; i--) rmdir(dirs[i]);
+    unlink(archive);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Helper: 1 if two files have the same contents */
+static int dedup_same_file(const char* a, const char* b) {
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    int same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa), cb = fgetc(fb);
+        same = ca == cb;
+        if (ca == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+static int test_dedup_chunks() {
+    sevenzip_init();
+    /* Incompressible data: whatever the archive saves is deduplication */
+    const size_t size = 3 << 20;
+    unsigned char* data = (unsigned char*)malloc(size);
+    TEST_ASSERT(data != NULL, "Allocate input");
+    uint32_t x = 12345;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1103515245u + 12345u;
+        data[i] = (unsigned char)(x >> 24);
+    }
+    const char* files[] = {"/tmp/test_dedup_a.bin", "/tmp/test_dedup_b.bin", "/tmp/test_dedup_c.bin", NULL};
+    FILE* f = fopen(files[0], "wb");
+    TEST_ASSERT(f != NULL, "Create a");
+    fwrite(data, 1, size, f);
+    fclose(f);
+    /* b: a with bytes inserted in the middle, which shifts all after them */
+    f = fopen(files[1], "wb");
+    TEST_ASSERT(f != NULL, "Create b");
+    fwrite(data, 1, size / 3, f);
+    fprintf(f, "%s", "an insertion that moves every later byte");
+    fwrite(data + size / 3, 1, size - size / 3, f);
+    fclose(f);
+    f = fopen(files[2], "wb");
+    TEST_ASSERT(f != NULL, "Create c");
+    fwrite(data, 1, size, f);
+    fclose(f);
+    free(data);
+
+    const char* archive = "/tmp/test_dedup.7zff";
+    SevenZipCompressOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.num_threads = 3;
+    opts.dedup_chunk_size = 64 << 10;
+    SevenZipErrorCode result = sevenzip_create_archive_with_options(archive, files, SEVENZIP_LEVEL_FAST,
+                                                                    &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create dedup archive");
+    uint64_t archive_size = get_file_size(archive);
+    TEST_ASSERT(archive_size > size && archive_size < size + size / 8, "Repeated chunks stored once");
+
+    mkdir("/tmp/test_dedup_out", 0755);
+    result = sevenzip_extract_archive(archive, "/tmp/test_dedup_out", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract dedup archive");
+    TEST_ASSERT(dedup_same_file(files[0], "/tmp/test_dedup_out/test_dedup_a.bin"), "a intact");
+    TEST_ASSERT(dedup_same_file(files[1], "/tmp/test_dedup_out/test_dedup_b.bin"), "b intact");
+    TEST_ASSERT(dedup_same_file(files[2], "/tmp/test_dedup_out/test_dedup_c.bin"), "c intact");
+    unlink("/tmp/test_dedup_out/test_dedup_b.bin");
+    result = sevenzip_extract_archive_file(archive, "/tmp/test_dedup_out", "test_dedup_b.bin");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract one file");
+    TEST_ASSERT(dedup_same_file(files[1], "/tmp/test_dedup_out/test_dedup_b.bin"), "b alone intact");
+
+    /* The format has no encryption: a password is refused, not ignored */
+    result = sevenzip_extract_archive(archive, "/tmp/test_dedup_out", "secret", NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_NOT_IMPLEMENTED, result, "Extract with a password");
+    result = sevenzip_create_archive("/tmp/test_dedup_pw.7zff", files, SEVENZIP_LEVEL_FAST, "secret", NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_NOT_IMPLEMENTED, result, "Create with a password");
+    TEST_ASSERT(get_file_size("/tmp/test_dedup_pw.7zff") == 0, "Nothing written");
+
+    for (int i = 0; i < 3; i++) unlink(files[i]);
+    unlink("/tmp/test_dedup_out/test_dedup_a.bin");
+    unlink("/tmp/test_dedup_out/test_dedup_b.bin");
+    unlink("/tmp/test_dedup_out/test_dedup_c.bin");
+    rmdir("/tmp/test_dedup_out");
+    unlink(archive);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Helper: Overwrite `size` bytes of a file at `offset` */
+static int parity_damage(const char* path, long offset, size_t size) {
+    FILE* f = fopen(path, "r+b");
+    if (!f) return 0;
+    char junk[256];
+    memset(junk, 0x5a, sizeof(junk));
+    int ok = size <= sizeof(junk) && fseek(f, offset, SEEK_SET) == 0 && fwrite(junk, 1, size, f) == size;
+    fclose(f);
+    return ok;
+}
+
+/* Test: Parity volumes rebuild a deleted and a damaged volume while the split is read */
+static int test_parity_volumes() {
+    sevenzip_init();
+    const char* input = "/tmp/test_parity.bin";
+    const char* archive = "/tmp/test_parity.7z";
+    const size_t size = 600 * 1024;
+    unsigned char* data = (unsigned char*)malloc(size);
+    TEST_ASSERT(data != NULL, "Allocate input");
+    uint32_t x = 777;
+    for (size_t i = 0; i < size; i++) {
+        x = x * 1103515245u + 12345u;
+        data[i] = (unsigned char)(x >> 24);
+    }
+    FILE* f = fopen(input, "wb");
+    TEST_ASSERT(f != NULL, "Create input");
+    fwrite(data, 1, size, f);
+    fclose(f);
+    free(data);
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.split_size = 64 * 1024;
+    options.parity_volumes = 2;
+    const char* inputs[] = {input, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_STORE,
+                                                            &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive with parity");
+    TEST_ASSERT(file_exists("/tmp/test_parity.7z.p001"), "First parity volume");
+    TEST_ASSERT(file_exists("/tmp/test_parity.7z.p002"), "Second parity volume");
+    TEST_ASSERT(!file_exists("/tmp/test_parity.7z.p003"), "One group, two parity volumes");
+
+    /* Two volumes lost or damaged, one of them the first */
+    unlink("/tmp/test_parity.7z.004");
+    TEST_ASSERT(parity_damage("/tmp/test_parity.7z.001", 40, 200), "Damage first volume");
+    result = sevenzip_test_archive(archive, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Damaged split verifies through parity");
+    mkdir("/tmp/test_parity_out", 0755);
+    result = sevenzip_extract(archive, "/tmp/test_parity_out", NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract damaged split");
+    TEST_ASSERT(dedup_same_file(input, "/tmp/test_parity_out/test_parity.bin"), "Repaired data intact");
+
+    /* A third damaged volume is more than two parity volumes can rebuild */
+    TEST_ASSERT(parity_damage("/tmp/test_parity.7z.007", 1000, 100), "Damage third volume");
+    result = sevenzip_test_archive(archive, NULL, NULL, NULL);
+    TEST_ASSERT(result != SEVENZIP_OK, "Three damaged volumes fail");
+
+    for (int i = 1; i <= 12; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s.%03d", archive, i);
+        unlink(path);
+    }
+    unlink("/tmp/test_parity.7z.p001");
+    unlink("/tmp/test_parity.7z.p002");
+    unlink("/tmp/test_parity_out/test_parity.bin");
+    rmdir("/tmp/test_parity_out");
+    unlink(input);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: A caller's input table is archived as given, names and times included */
+static int test_create_from_table() {
+    const char* archive = "/tmp/test_table.7z";
+    TEST_ASSERT(create_test_file("/tmp/test_table_a.txt", "table entry contents\n"), "Create input");
+    const uint64_t mtime = 1700000000ULL * 10000000ULL + 116444736000000000ULL;
+    SevenZipInputEntry entries[3];
+    memset(entries, 0, sizeof(entries));
+    entries[0].name = "docs";
+    entries[0].mtime = mtime;
+    entries[0].is_dir = 1;
+    entries[1].path = "/tmp/test_table_a.txt";
+    entries[1].name = "docs/renamed.txt";
+    entries[1].size = strlen("table entry contents\n");
+    entries[1].mtime = mtime;
+    entries[1].attrib = 0100644;
+    entries[2].name = "docs/empty";
+    entries[2].mtime = mtime;
+
+    SevenZipErrorCode result = sevenzip_create_7z_from_table(archive, entries, 3, SEVENZIP_LEVEL_FAST,
+                                                             NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create from table");
+    SevenZipList* list = NULL;
+    result = sevenzip_list(archive, NULL, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List table archive");
+    TEST_ASSERT_EQUALS(3, list->count, "Every table entry archived");
+    TEST_ASSERT(strcmp(list->entries[1].name, "docs/renamed.txt") == 0, "Name from the table");
+    TEST_ASSERT_EQUALS(entries[1].size, list->entries[1].size, "Size from the table");
+    TEST_ASSERT(list->entries[1].modified_time == 1700000000ULL, "Time from the table");
+    TEST_ASSERT(list->entries[0].is_directory && !list->entries[2].is_directory, "Types from the table");
+    TEST_ASSERT_EQUALS(0, list->entries[2].size, "Entry without a path is empty");
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive, NULL, NULL, NULL), "Table archive verifies");
+
+    entries[2].name = NULL;
+    result = sevenzip_create_7z_from_table(archive, entries, 3, SEVENZIP_LEVEL_FAST, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Entry without a name rejected");
+
+    unlink("/tmp/test_table_a.txt");
+    unlink(archive);
+    return 1;
+}
+
+static int test_create_7z_password() {
+    const char* archive = "/tmp/test_create_password.7z";
+    const char* outdir = "/tmp/test_create_password_out";
+    const char* text = "encrypted by sevenzip_create_7z\n";
+    TEST_ASSERT(create_test_file("/tmp/test_create_password.txt", text), "Create input");
+    const char* inputs[] = { "/tmp/test_create_password.txt", NULL };
+    SevenZipCompressOptions options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 1;
+    options.solid = 1;
+    options.password = "create-secret";
+
+    SevenZipErrorCode result = sevenzip_create_7z(archive, inputs, SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create with a password");
+    TEST_ASSERT(sevenzip_extract(archive, outdir, NULL, NULL, NULL) != SEVENZIP_OK, "Not readable without the key");
+    TEST_ASSERT(sevenzip_extract(archive, outdir, "wrong", NULL, NULL) != SEVENZIP_OK, "Not readable with a wrong key");
+    result = sevenzip_extract(archive, outdir, "create-secret", NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract with the key");
+    char* content = read_file_content("/tmp/test_create_password_out/test_create_password.txt");
+    TEST_ASSERT(content && strcmp(content, text) == 0, "Content round-trips");
+    free(content);
+
+    SevenZipInputEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.name = "empty";
+    result = sevenzip_create_7z_from_table(archive, &entry, 1, SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_NOT_IMPLEMENTED, result, "Table with a password rejected");
+    result = sevenzip_update_archive(archive, inputs, SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_NOT_IMPLEMENTED, result, "Update with a password rejected");
+
+    unlink("/tmp/test_create_password_out/test_create_password.txt");
+    rmdir(outdir);
+    unlink("/tmp/test_create_password.txt");
+    unlink(archive);
+    return 1;
+}
+
+/* Update: unchanged entries kept, changed ones replaced, new ones added */
+static int test_update_archive() {
+    sevenzip_init();
+    const char* archive = "/tmp/test_update.7z";
+    const char* outdir = "/tmp/test_update_out";
+    mkdir("/tmp/test_update_in", 0755);
+    TEST_ASSERT(create_test_file("/tmp/test_update_in/a.txt", "kept as archived\n"), "Create a.txt");
+    TEST_ASSERT(create_test_file("/tmp/test_update_in/b.txt", "first version\n"), "Create b.txt");
+    unlink(archive);
+
+    /* A missing archive is created */
+    SevenZipCompressOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.num_threads = 1;
+    opts.solid = 1;
+    const char* inputs[] = {"/tmp/test_update_in", NULL};
+    SevenZipErrorCode result = sevenzip_update_archive(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Update creates the archive");
+
+    TEST_ASSERT(create_test_file("/tmp/test_update_in/b.txt", "second, longer version\n"), "Change b.txt");
+    TEST_ASSERT(create_test_file("/tmp/test_update_in/c.txt", "added by the update\n"), "Create c.txt");
+    result = sevenzip_update_archive(archive, inputs, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Update");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive, NULL, NULL, NULL), "Tests clean");
+
+    SevenZipList* list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(archive, NULL, &list), "List");
+    size_t count = list->count;
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(3, (int)count, "a, b once, c");
+
+    result = sevenzip_extract(archive, outdir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract updated archive");
+    const char* names[] = {"a.txt", "b.txt", "c.txt"};
+    for (int i = 0; i < 3; i++) {
+        char in_path[256], out_path[256];
+        snprintf(in_path, sizeof(in_path), "/tmp/test_update_in/%s", names[i]);
+        snprintf(out_path, sizeof(out_path), "%s/%s", outdir, names[i]);
+        char* expected = read_file_content(in_path);
+        char* actual = read_file_content(out_path);
+        int same = expected && actual && strcmp(expected, actual) == 0;
+        free(expected);
+        free(actual);
+        TEST_ASSERT(same, "Extracted file matches its input");
+        unlink(out_path);
+        unlink(in_path);
+    }
+
+    rmdir(outdir);
+    rmdir("/tmp/test_update_in");
+    unlink(archive);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* .xz: multi-block files on several threads, every check type, damage caught */
+static int test_xz_round_trip() {
+    sevenzip_init();
+    const char* input = "/tmp/test_xz_input.txt";
+    const char* xz_path = "/tmp/test_xz.xz";
+    const char* output = "/tmp/test_xz_output.txt";
+    FILE* f = fopen(input, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int line = 0; line < 60000; line++) fprintf(f, "xz record %d: %u\n", line, (unsigned)(line * 2654435761u) >> 20);
+    fclose(f);
+
+    const SevenZipXzCheck checks[] = {SEVENZIP_XZ_CHECK_NONE, SEVENZIP_XZ_CHECK_CRC32,
+                                      SEVENZIP_XZ_CHECK_CRC64, SEVENZIP_XZ_CHECK_SHA256};
+    for (int c = 0; c < 4; c++) {
+        SevenZipXzOptions opts;
+        sevenzip_xz_options_init(&opts);
+        opts.num_threads = 2;
+        opts.block_size = 256 << 10;
+        opts.check = checks[c];
+        SevenZipErrorCode result = sevenzip_compress_xz(input, xz_path, SEVENZIP_LEVEL_FAST, &opts, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Compress to .xz");
+        char* head = read_file_content(xz_path);
+        TEST_ASSERT(head && memcmp(head, "\xFD" "7zXZ", 6) == 0, "xz stream magic");
+        free(head);
+        TEST_ASSERT(get_file_size(xz_path) < get_file_size(input) / 2, "Compressed");
+
+        unlink(output);
+        result = sevenzip_decompress_xz(xz_path, output, &opts, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Decompress .xz");
+        TEST_ASSERT(dedup_same_file(input, output), "Round trip is exact");
+    }
+
+    /* A flipped byte inside the compressed data fails the decoder or the check */
+    f = fopen(xz_path, "r+b");
+    TEST_ASSERT(f != NULL, "Open .xz");
+    fseek(f, (long)(get_file_size(xz_path) / 2), SEEK_SET);
+    int byte = fgetc(f);
+    fseek(f, -1, SEEK_CUR);
+    fputc(byte ^ 0x55, f);
+    fclose(f);
+    TEST_ASSERT(sevenzip_decompress_xz(xz_path, output, NULL, NULL, NULL) != SEVENZIP_OK, "Damage detected");
+
+    unlink(input);
+    unlink(xz_path);
+    unlink(output);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Checkpointed split job cancelled half-way, then finished by resuming */
+static void resume_cancel_progress(uint64_t bytes_processed, uint64_t bytes_total,
+                                   uint64_t current_file_bytes, uint64_t current_file_total,
+                                   const char* current_file_name, void* user_data) {
+    (void)current_file_bytes;
+    (void)current_file_total;
+    (void)current_file_name;
+    if (bytes_total && bytes_processed >= bytes_total / 2) {
+        sevenzip_cancel_token_cancel((SevenZipCancelToken*)user_data);
+    }
+}
+
+static int test_resume_multivolume() {
+    sevenzip_init();
+    const char* archive = "/tmp/test_resume.7z";
+    const char* outdir = "/tmp/test_resume_out";
+    mkdir("/tmp/test_resume_in", 0755);
+    char path[256];
+    /* Incompressible, so the volumes fill and checkpoints are taken */
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < 6; i++) {
+        snprintf(path, sizeof(path), "/tmp/test_resume_in/part%d.bin", i);
+        FILE* f = fopen(path, "wb");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int n = 0; n < 200000; n++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            fputc((int)(x & 0xFF), f);
+        }
+        fclose(f);
+    }
+
+    SevenZipCancelToken* cancel = sevenzip_cancel_token_create();
+    TEST_ASSERT(cancel != NULL, "Create token");
+    SevenZipStreamOptions opts;
+    sevenzip_stream_options_init(&opts);
+    opts.num_threads = 1;
+    opts.solid_block_files = 1;
+    opts.split_size = 128 << 10;
+    opts.checkpoint = 1;
+    opts.progress_interval_ms = -1;
+    opts.cancel = cancel;
+    const char* inputs[] = {"/tmp/test_resume_in", NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_FASTEST, &opts,
+                                                            resume_cancel_progress, cancel);
+    sevenzip_cancel_token_free(cancel);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_CANCELLED, result, "Job cancelled half-way");
+    TEST_ASSERT(file_exists("/tmp/test_resume.7z.ckpt"), "Checkpoint kept");
+
+    opts.cancel = NULL;
+    result = sevenzip_resume_multivolume(archive, &opts, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Resume");
+    TEST_ASSERT(!file_exists("/tmp/test_resume.7z.ckpt"), "Checkpoint removed once complete");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive("/tmp/test_resume.7z.001", NULL, NULL, NULL),
+                       "Resumed archive tests clean");
+    result = sevenzip_extract_streaming("/tmp/test_resume.7z.001", outdir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract resumed archive");
+    for (int i = 0; i < 6; i++) {
+        char out_path[256];
+        snprintf(path, sizeof(path), "/tmp/test_resume_in/part%d.bin", i);
+        snprintf(out_path, sizeof(out_path), "%s/test_resume_in/part%d.bin", outdir, i);
+        TEST_ASSERT(dedup_same_file(path, out_path), "Extracted file matches its input");
+        unlink(out_path);
+        unlink(path);
+    }
+
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, sevenzip_resume_multivolume(archive, &opts, NULL, NULL),
+                       "Nothing to resume");
+    for (int v = 1; v < 32; v++) {
+        snprintf(path, sizeof(path), "%s.%03d", archive, v);
+        unlink(path);
+    }
+    rmdir("/tmp/test_resume_out/test_resume_in");
+    rmdir(outdir);
+    rmdir("/tmp/test_resume_in");
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Background jobs: completion callback, descriptor and poll, queueing, cancel */
+typedef struct {
+    int calls;
+    SevenZipErrorCode result;
+} JobDone;
+
+static void job_done(SevenZipJob* job, SevenZipErrorCode result, void* user_data) {
+    (void)job;
+    JobDone* done = (JobDone*)user_data;
+    done->calls++;
+    done->result = result;
+}
+
+static int test_background_jobs() {
+    SevenZipInitOptions init;
+    memset(&init, 0, sizeof(init));
+    init.max_jobs = 1;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(&init), "One job at a time");
+    const char* input = "/tmp/test_jobs_input.txt";
+    FILE* f = fopen(input, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int line = 0; line < 100000; line++) fprintf(f, "job input line %d\n", line);
+    fclose(f);
+    const char* inputs[] = {input, NULL};
+
+    /* Created in the background, finish seen through the descriptor */
+    JobDone created = {0, SEVENZIP_ERROR_UNKNOWN};
+    SevenZipJob* job = NULL;
+    SevenZipErrorCode result = sevenzip_submit_create("/tmp/test_jobs.7z", inputs, SEVENZIP_LEVEL_FAST, NULL,
+                                                      NULL, job_done, &created, &job);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Submit create");
+    int fd = sevenzip_job_fd(job);
+    TEST_ASSERT(fd >= 0, "Completion descriptor");
+    struct pollfd pfd = {fd, POLLIN, 0};
+    TEST_ASSERT(poll(&pfd, 1, 30000) == 1, "Descriptor readable once finished");
+    TEST_ASSERT(sevenzip_job_poll(job, &result), "Poll sees the job finished");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create job result");
+    TEST_ASSERT_EQUALS(1, created.calls, "Callback called once");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, created.result, "Callback given the result");
+    sevenzip_job_free(job);
+
+    /* A job queued behind a held one is cancelled without starting */
+    SevenZipRateLimit* limit = sevenzip_rate_limit_create(64 * 1024, 0);
+    TEST_ASSERT(limit != NULL, "Create rate limit");
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    options.rate_limit = limit;
+    SevenZipJob* held = NULL;
+    result = sevenzip_submit_create("/tmp/test_jobs_held.7z", inputs, SEVENZIP_LEVEL_FAST, &options,
+                                    NULL, NULL, NULL, &held);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Submit held create");
+    JobDone extracted = {0, SEVENZIP_ERROR_UNKNOWN};
+    SevenZipJob* queued = NULL;
+    result = sevenzip_submit_extract("/tmp/test_jobs.7z", "/tmp/test_jobs_out", NULL, NULL, NULL,
+                                     job_done, &extracted, &queued);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Submit extract");
+    TEST_ASSERT(!sevenzip_job_poll(queued, NULL), "Extract waits its turn");
+    sevenzip_job_cancel(queued);
+    sevenzip_job_cancel(held);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_CANCELLED, sevenzip_job_wait(held), "Held job cancelled");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_CANCELLED, sevenzip_job_wait(queued), "Queued job cancelled");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_CANCELLED, extracted.result, "Callback given the cancellation");
+    TEST_ASSERT(!file_exists("/tmp/test_jobs_out/test_jobs_input.txt"), "Queued job never started");
+    sevenzip_job_free(held);
+    sevenzip_job_free(queued);
+    sevenzip_rate_limit_free(limit);
+
+    /* The archive of the first job extracts to the input */
+    result = sevenzip_submit_extract("/tmp/test_jobs.7z", "/tmp/test_jobs_out", NULL, NULL, NULL,
+                                     NULL, NULL, &job);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Submit extract again");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_job_wait(job), "Extract job");
+    sevenzip_job_free(job);
+    TEST_ASSERT(dedup_same_file(input, "/tmp/test_jobs_out/test_jobs_input.txt"), "Round trip");
+
+    unlink("/tmp/test_jobs_out/test_jobs_input.txt");
+    rmdir("/tmp/test_jobs_out");
+    unlink("/tmp/test_jobs.7z");
+    unlink("/tmp/test_jobs_held.7z");
+    unlink(input);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(NULL), "Default job limit");
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Batch: many small archives on a worker pool, one failing entry reported apart */
+static int test_create_7z_batch() {
+    sevenzip_init();
+    enum { BATCH = 12 };
+    char inputs[BATCH][64], archives[BATCH][64];
+    const char* input_lists[BATCH][2];
+    SevenZipBatchEntry entries[BATCH + 1];
+    for (int i = 0; i < BATCH; i++) {
+        snprintf(inputs[i], sizeof(inputs[i]), "/tmp/test_batch_%d.txt", i);
+        snprintf(archives[i], sizeof(archives[i]), "/tmp/test_batch_%d.7z", i);
+        FILE* f = fopen(inputs[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 50 * (i + 1); line++) fprintf(f, "batch %d line %d\n", i, line);
+        fclose(f);
+        input_lists[i][0] = inputs[i];
+        input_lists[i][1] = NULL;
+        entries[i].archive_path = archives[i];
+        entries[i].input_paths = input_lists[i];
+    }
+    const char* missing[] = {"/tmp/test_batch_missing.txt", NULL};
+    entries[BATCH].archive_path = "/tmp/test_batch_missing.7z";
+    entries[BATCH].input_paths = missing;
+
+    SevenZipCompressOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.num_threads = 4;
+    SevenZipErrorCode results[BATCH + 1];
+    SevenZipErrorCode result = sevenzip_create_7z_batch(entries, BATCH + 1, SEVENZIP_LEVEL_FAST, &opts, results);
+    TEST_ASSERT(result != SEVENZIP_OK, "A failing entry fails the call");
+    TEST_ASSERT(results[BATCH] != SEVENZIP_OK, "The missing input is the one reported");
+    TEST_ASSERT_EQUALS(result, results[BATCH], "Call returns the failing entry's code");
+
+    for (int i = 0; i < BATCH; i++) {
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, results[i], "Entry created");
+        char out_path[96];
+        snprintf(out_path, sizeof(out_path), "/tmp/test_batch_out/test_batch_%d.txt", i);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_extract(archives[i], "/tmp/test_batch_out", NULL, NULL, NULL),
+                           "Extract entry");
+        TEST_ASSERT(dedup_same_file(inputs[i], out_path), "Each archive holds its own input");
+        unlink(out_path);
+        unlink(archives[i]);
+        unlink(inputs[i]);
+    }
+    rmdir("/tmp/test_batch_out");
+    unlink("/tmp/test_batch_missing.7z");
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: sevenzip_estimate_memory() grows with threads and dictionary, and
+ * max_memory holds the job to what it reports */
+static int test_estimate_memory() {
+    SevenZipStreamOptions options;
+    uint64_t one_thread = 0, four_threads = 0, small_dict = 0, large_dict = 0;
+
+    sevenzip_stream_options_init(&options);
+    options.dict_size = 4 * 1024 * 1024;
+    options.num_threads = 1;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_estimate_memory(SEVENZIP_LEVEL_NORMAL, &options, &one_thread),
+                       "Estimate one thread");
+    options.num_threads = 4;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_estimate_memory(SEVENZIP_LEVEL_NORMAL, &options, &four_threads),
+                       "Estimate four threads");
+    TEST_ASSERT(four_threads > one_thread, "More threads need more memory");
+
+    options.num_threads = 1;
+    options.dict_size = 1024 * 1024;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_estimate_memory(SEVENZIP_LEVEL_NORMAL, &options, &small_dict),
+                       "Estimate small dictionary");
+    options.dict_size = 64 * 1024 * 1024;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_estimate_memory(SEVENZIP_LEVEL_NORMAL, &options, &large_dict),
+                       "Estimate large dictionary");
+    TEST_ASSERT(large_dict > small_dict, "A larger dictionary needs more memory");
+
+    const char* input = "/tmp/test_estimate_input.bin";
+    const char* archive = "/tmp/test_estimate.7z";
+    FILE* f = fopen(input, "wb");
+    TEST_ASSERT(f != NULL, "Create input");
+    uint32_t seed = 99;
+    for (size_t i = 0; i < 3 * 1024 * 1024; i++) {
+        seed = seed * 1103515245 + 12345;
+        fputc((i / 4096) % 2 ? 'a' + (int)((seed >> 16) % 8) : "budget line\n"[i % 12], f);
+    }
+    fclose(f);
+    const char* inputs[] = {input, NULL};
+
+    /* Below a single block thread with the smallest dictionary */
+    uint64_t peak = 0;
+    sevenzip_stream_options_init(&options);
+    options.num_threads = 4;
+    options.dict_size = 16 * 1024 * 1024;
+    options.max_memory = 4 * 1024 * 1024;
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_MEMORY, sevenzip_estimate_memory(SEVENZIP_LEVEL_NORMAL, &options, &peak),
+                       "Budget too small to estimate");
+    unlink(archive);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_MEMORY,
+                       sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_NORMAL, &options, NULL, NULL),
+                       "Budget too small to create");
+
+    /* A budget the job fits by shrinking still gives a sound archive */
+    options.max_memory = 64 * 1024 * 1024;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_estimate_memory(SEVENZIP_LEVEL_NORMAL, &options, &peak),
+                       "Estimate within the budget");
+    TEST_ASSERT(peak > 0 && peak <= options.max_memory, "Estimate held to the budget");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK,
+                       sevenzip_create_7z_streaming(archive, inputs, SEVENZIP_LEVEL_NORMAL, &options, NULL, NULL),
+                       "Create within the budget");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive, NULL, NULL, NULL), "Archive tests sound");
+
+    unlink(input);
+    unlink(archive);
+    return 1;
+}
+
+/* Helper: PKCS#7-pad `size` bytes of `data` into `out`; the padded length */
+static size_t pkcs7_pad(const unsigned char* data, size_t size, unsigned char* out) {
+    size_t padded = (size / AES_BLOCK_SIZE + 1) * AES_BLOCK_SIZE;
+    memcpy(out, data, size);
+    memset(out + size, (int)(padded - size), padded - size);
+    return padded;
+}
+
+/* Test: A crypt context fed odd-sized chunks, and reset, gives what
+ * sevenzip_encrypt_data() and sevenzip_decrypt_data() give in one call */
+static int test_crypt_context() {
+    enum { SIZE = 100003, CAPACITY = SIZE + 2 * AES_BLOCK_SIZE };
+    static _Alignas(32) unsigned char plain[CAPACITY];
+    static _Alignas(32) unsigned char expected[CAPACITY];
+    static _Alignas(32) unsigned char work[CAPACITY];
+    static _Alignas(32) unsigned char back[CAPACITY];
+    static _Alignas(16) uint32_t enc_schedule[AES_NUM_IVMRK_WORDS];
+    static _Alignas(16) uint32_t dec_schedule[AES_NUM_IVMRK_WORDS];
+    const size_t chunks[] = {16, 48, 1008, 4112, 80, 32768};
+    for (size_t i = 0; i < SIZE; i++) plain[i] = (unsigned char)(i * 7 + (i >> 9));
+
+    /* Encryption: one context, chunks of several sizes, then a reset */
+    uint8_t key[AES_KEY_SIZE], iv[AES_BLOCK_SIZE];
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_encryption("chunked", key, iv, enc_schedule), "Derive key");
+    size_t expected_size = sizeof(expected);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_encrypt_data(enc_schedule, iv, plain, SIZE, expected, &expected_size),
+                       "Encrypt in one call");
+    SevenZipCryptContext* ctx = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_create(SEVENZIP_CRYPT_ENCRYPT, key, iv, &ctx), "Create context");
+    for (int pass = 0; pass < 2; pass++) {
+        size_t padded = pkcs7_pad(plain, SIZE, work);
+        TEST_ASSERT(padded == expected_size, "Same padded length");
+        for (size_t pos = 0, c = pass; pos < padded; c++) {
+            size_t n = chunks[c % (sizeof(chunks) / sizeof(chunks[0]))];
+            if (n > padded - pos) n = padded - pos;
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_update(ctx, work + pos, n), "Encrypt chunk");
+            pos += n;
+        }
+        TEST_ASSERT(memcmp(work, expected, padded) == 0, "Chunks chain as one call");
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_reset(ctx, iv), "Reset for the next stream");
+    }
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_crypt_update(ctx, work, 20), "Partial block");
+    sevenzip_crypt_free(ctx);
+
+    /* Decryption: a key from a known salt, checked against sevenzip_decrypt_data() */
+    const uint8_t salt[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_decryption("chunked", salt, sizeof(salt), key, dec_schedule),
+                       "Derive decryption key");
+    size_t padded = pkcs7_pad(plain, SIZE, work);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_create(SEVENZIP_CRYPT_ENCRYPT, key, iv, &ctx), "Encrypt context");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_update(ctx, work, padded), "Encrypt whole");
+    sevenzip_crypt_free(ctx);
+    size_t back_size = sizeof(back);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_decrypt_data(dec_schedule, iv, work, padded, back, &back_size),
+                       "Decrypt in one call");
+    TEST_ASSERT(back_size == SIZE && memcmp(back, plain, SIZE) == 0, "One call recovers the input");
+
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_create(SEVENZIP_CRYPT_DECRYPT, key, iv, &ctx), "Decrypt context");
+    for (int pass = 0; pass < 2; pass++) {
+        memcpy(back, work, padded);
+        for (size_t pos = 0, c = pass + 3; pos < padded; c++) {
+            size_t n = chunks[c % (sizeof(chunks) / sizeof(chunks[0]))];
+            if (n > padded - pos) n = padded - pos;
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_update(ctx, back + pos, n), "Decrypt chunk");
+            pos += n;
+        }
+        TEST_ASSERT(memcmp(back, plain, SIZE) == 0 && back[padded - 1] == padded - SIZE,
+                    "Chunks recover the input and its padding");
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_reset(ctx, iv), "Reset for the next stream");
+    }
+    sevenzip_crypt_free(ctx);
+    sevenzip_crypt_free(NULL);
+    return 1;
+}
+
+/* Test: sevenzip_decrypt_data_parallel() matches sevenzip_decrypt_data() on
+ * a ciphertext split into several runs, none of them equal in length */
+static int test_decrypt_data_parallel() {
+    enum { SIZE = 3 * 1024 * 1024 + 12345, CAPACITY = SIZE + 2 * AES_BLOCK_SIZE };
+    static _Alignas(32) unsigned char plain[CAPACITY];
+    static _Alignas(32) unsigned char cipher[CAPACITY];
+    static _Alignas(32) unsigned char serial[CAPACITY];
+    static _Alignas(32) unsigned char parallel[CAPACITY];
+    static _Alignas(16) uint32_t dec_schedule[AES_NUM_IVMRK_WORDS];
+    for (size_t i = 0; i < SIZE; i++) plain[i] = (unsigned char)(i * 13 + (i >> 11));
+
+    const uint8_t salt[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+    const uint8_t iv[AES_BLOCK_SIZE] = {9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 1, 2, 3, 4, 5, 6};
+    uint8_t key[AES_KEY_SIZE];
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_decryption("runs", salt, sizeof(salt), key, dec_schedule),
+                       "Derive key");
+    size_t padded = pkcs7_pad(plain, SIZE, cipher);
+    SevenZipCryptContext* ctx = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_create(SEVENZIP_CRYPT_ENCRYPT, key, iv, &ctx), "Encrypt context");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_crypt_update(ctx, cipher, padded), "Encrypt");
+    sevenzip_crypt_free(ctx);
+    TEST_ASSERT(padded % (1024 * 1024) != 0, "Not a whole number of runs");
+
+    size_t serial_size = sizeof(serial);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_decrypt_data(dec_schedule, iv, cipher, padded, serial, &serial_size),
+                       "Serial decrypt");
+    TEST_ASSERT(serial_size == SIZE && memcmp(serial, plain, SIZE) == 0, "Serial recovers the input");
+
+    /* Three runs of just over 1MB (also when more threads are offered), then one */
+    const int threads[] = {3, 8, 1};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        memset(parallel, 0, sizeof(parallel));
+        size_t parallel_size = sizeof(parallel);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK,
+                           sevenzip_decrypt_data_parallel(dec_schedule, iv, cipher, padded, parallel,
+                                                          &parallel_size, threads[t]),
+                           "Parallel decrypt");
+        TEST_ASSERT(parallel_size == serial_size && memcmp(parallel, serial, serial_size) == 0,
+                    "Parallel matches serial");
+    }
+
+    /* In place: each run's IV must be read before the run before it overwrites it */
+    memcpy(parallel, cipher, padded);
+    size_t in_place_size = padded;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK,
+                       sevenzip_decrypt_data_parallel(dec_schedule, iv, parallel, padded, parallel,
+                                                      &in_place_size, 3),
+                       "In-place parallel decrypt");
+    TEST_ASSERT(in_place_size == serial_size && memcmp(parallel, serial, serial_size) == 0,
+                "In place matches serial");
+    return 1;
+}
+
+/* Test: solid_block_size splits a solid archive into several folders,
+ * from both writers, and every file still extracts intact */
+static int test_solid_block_size() {
+    const char* inputs[] = {"/tmp/test_solid_limit_a.txt", "/tmp/test_solid_limit_b.txt",
+                            "/tmp/test_solid_limit_c.txt", "/tmp/test_solid_limit_d.txt", NULL};
+    const char* names[] = {"test_solid_limit_a.txt", "test_solid_limit_b.txt",
+                           "test_solid_limit_c.txt", "test_solid_limit_d.txt"};
+    const char* archive_file = "/tmp/test_solid_limit.7z";
+    const char* outdir = "/tmp/test_solid_limit_out";
+    for (int i = 0; inputs[i]; i++) {
+        FILE* f = fopen(inputs[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 2000; line++) {
+            fprintf(f, "File %d, line %d of the solid limit input\n", i, line);
+        }
+        fclose(f);
+    }
+
+    /* sevenzip_create_7z(), then the streaming writer */
+    for (int pass = 0; pass < 2; pass++) {
+        SevenZipErrorCode result;
+        if (pass == 0) {
+            SevenZipCompressOptions options;
+            memset(&options, 0, sizeof(options));
+            options.num_threads = 1;
+            options.solid = 1;
+            options.solid_block_size = 100000;
+            result = sevenzip_create_7z(archive_file, inputs, SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+        } else {
+            SevenZipStreamOptions options;
+            sevenzip_stream_options_init(&options);
+            options.solid_block_size = 100000;
+            result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+        }
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+        const char* archives[] = {archive_file};
+        SevenZipArchiveBatchOptions batch;
+        sevenzip_archive_batch_options_init(&batch);
+        uint32_t num_folders = 0;
+        result = sevenzip_archive_batch(archives, 1, &batch, policy_batch_folders, &num_folders);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+        TEST_ASSERT(num_folders > 1, "A new folder once the limit is reached");
+
+        result = sevenzip_extract(archive_file, outdir, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract archive");
+        for (int i = 0; inputs[i]; i++) {
+            char path[256];
+            snprintf(path, sizeof(path), "%s/%s", outdir, names[i]);
+            char* expected = read_file_content(inputs[i]);
+            char* actual = read_file_content(path);
+            int same = expected && actual && strcmp(expected, actual) == 0;
+            free(expected);
+            free(actual);
+            TEST_ASSERT(same, "File extracts intact");
+            unlink(path);
+        }
+        rmdir(outdir);
+        unlink(archive_file);
+    }
+
+    for (int i = 0; inputs[i]; i++) unlink(inputs[i]);
+    return 1;
+}
+
+/* Helper: read a whole file; NULL if it cannot be read */
+static unsigned char* read_file_bytes(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char* data = malloc(length > 0 ? (size_t)length : 1);
+    *size = data ? fread(data, 1, (size_t)length, f) : 0;
+    fclose(f);
+    return data;
+}
+
+/* Test: A split archive written with unbuffered_output matches the buffered
+ * one volume for volume and extracts byte-identical. Where the filesystem
+ * rejects O_DIRECT (tmpfs before Linux 6.6) this runs the buffered fallback. */
+static int test_unbuffered_split() {
+    const char* dirs[] = {"/tmp", "/dev/shm"};
+    for (size_t d = 0; d < sizeof(dirs) / sizeof(dirs[0]); d++) {
+        struct stat st;
+        if (stat(dirs[d], &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+        char input[256], buffered[256], direct[256], outdir[256];
+        snprintf(input, sizeof(input), "%s/test_unbuffered.bin", dirs[d]);
+        snprintf(buffered, sizeof(buffered), "%s/test_unbuffered_ref.7z", dirs[d]);
+        snprintf(direct, sizeof(direct), "%s/test_unbuffered.7z", dirs[d]);
+        snprintf(outdir, sizeof(outdir), "%s/test_unbuffered_out", dirs[d]);
+
+        /* Half text, half noise, so volumes are not block-aligned in size */
+        size_t size = 1536 * 1024 + 777;
+        unsigned char* data = malloc(size);
+        TEST_ASSERT(data != NULL, "Allocate input");
+        uint32_t seed = 12345;
+        for (size_t i = 0; i < size; i++) {
+            seed = seed * 1103515245u + 12345u;
+            data[i] = i < size / 2 ? (unsigned char)('a' + (seed >> 16) % 8) : (unsigned char)(seed >> 16);
+        }
+        FILE* f = fopen(input, "wb");
+        TEST_ASSERT(f != NULL && fwrite(data, 1, size, f) == size, "Write input");
+        fclose(f);
+
+        const char* inputs[] = {input, NULL};
+        for (int pass = 0; pass < 2; pass++) {
+            SevenZipStreamOptions options;
+            sevenzip_stream_options_init(&options);
+            options.num_threads = 1;
+            options.split_size = 100000;
+            options.unbuffered_output = pass;
+            SevenZipErrorCode result = sevenzip_create_7z_streaming(pass ? direct : buffered, inputs,
+                                                                    SEVENZIP_LEVEL_FAST, &options, NULL, NULL);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive");
+        }
+
+        int volumes = 0;
+        for (int i = 1;; i++) {
+            char ref_path[300], direct_path[300];
+            snprintf(ref_path, sizeof(ref_path), "%s.%03d", buffered, i);
+            snprintf(direct_path, sizeof(direct_path), "%s.%03d", direct, i);
+            if (!file_exists(ref_path)) {
+                TEST_ASSERT(!file_exists(direct_path), "No extra volume");
+                break;
+            }
+            size_t ref_size = 0, direct_size = 0;
+            unsigned char* ref = read_file_bytes(ref_path, &ref_size);
+            unsigned char* out = read_file_bytes(direct_path, &direct_size);
+            int same = ref && out && ref_size == direct_size && memcmp(ref, out, ref_size) == 0;
+            free(ref);
+            free(out);
+            TEST_ASSERT(same, "Volume matches the buffered one");
+            volumes++;
+        }
+        TEST_ASSERT(volumes > 2, "Several volumes");
+
+        char first[300], extracted[300];
+        snprintf(first, sizeof(first), "%s.001", direct);
+        snprintf(extracted, sizeof(extracted), "%s/test_unbuffered.bin", outdir);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_extract_streaming(first, outdir, NULL, NULL, NULL),
+                           "Extract archive");
+        size_t out_size = 0;
+        unsigned char* out = read_file_bytes(extracted, &out_size);
+        int same = out && out_size == size && memcmp(out, data, size) == 0;
+        free(out);
+        free(data);
+        TEST_ASSERT(same, "Extracted byte-identical");
+
+        unlink(extracted);
+        rmdir(outdir);
+        unlink(input);
+        for (int i = 1; i <= volumes; i++) {
+            char path[300];
+            snprintf(path, sizeof(path), "%s.%03d", buffered, i);
+            unlink(path);
+            snprintf(path, sizeof(path), "%s.%03d", direct, i);
+            unlink(path);
+        }
+    }
+    return 1;
+}
+
+/* Test: After a streaming create the stats count every input byte read
+ * and every archive byte written, and each phase took measurable time */
+static int test_last_stats() {
+    const char* inputs[] = {"/tmp/test_stats_a.txt", "/tmp/test_stats_b.txt", NULL};
+    const char* archive_file = "/tmp/test_stats.7z";
+    uint64_t input_size = 0;
+    for (int i = 0; inputs[i]; i++) {
+        FILE* f = fopen(inputs[i], "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 40000; line++) {
+            fprintf(f, "Input %d, line %d: %08x\n", i, line, (unsigned)(line * 2654435761u));
+        }
+        fclose(f);
+        input_size += get_file_size(inputs[i]);
+    }
+
+    /* One archive, then split volumes */
+    for (int pass = 0; pass < 2; pass++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.split_size = pass ? 256 * 1024 : 0;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                                &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+        uint64_t archive_size = 0;
+        int volumes = 0;
+        if (pass == 0) {
+            archive_size = get_file_size(archive_file);
+        } else {
+            char volume[64];
+            for (int i = 1;; i++, volumes++) {
+                snprintf(volume, sizeof(volume), "%s.%03d", archive_file, i);
+                if (!file_exists(volume)) break;
+                archive_size += get_file_size(volume);
+            }
+        }
+
+        SevenZipOpStats stats;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_get_last_stats(&stats), "Get stats");
+        TEST_ASSERT(stats.bytes_read == input_size, "Every input byte read once");
+        TEST_ASSERT(archive_size > 0 && stats.bytes_written == archive_size, "Every archive byte counted");
+        TEST_ASSERT_EQUALS(2, (int)stats.files, "Both files");
+        TEST_ASSERT(stats.wall_seconds > 0, "Operation timed");
+        for (int phase = 0; phase < SEVENZIP_PHASE_COUNT; phase++) {
+            TEST_ASSERT(stats.phases[phase].wall_seconds > 0, "Phase timed");
+        }
+        TEST_ASSERT(stats.phases[SEVENZIP_PHASE_COMPRESS].wall_seconds <= stats.wall_seconds,
+                    "Data stage within the operation");
+
+        if (pass == 0) {
+            unlink(archive_file);
+        } else {
+            char volume[64];
+            for (int i = 1; i <= volumes; i++) {
+                snprintf(volume, sizeof(volume), "%s.%03d", archive_file, i);
+                unlink(volume);
+            }
+        }
+    }
+
+    for (int i = 0; inputs[i]; i++) unlink(inputs[i]);
+    return 1;
+}
+
+/* Test: sevenzip_trace_dump() writes Chrome trace JSON holding the spans
+ * of the last create; without ENABLE_TRACE it reports that it is absent */
+static int test_trace_dump() {
+    const char* trace_file = "/tmp/test_trace.json";
+#ifdef SEVENZIP_TRACE
+    const char* input = "/tmp/test_trace.txt";
+    const char* archive_file = "/tmp/test_trace.7z";
+    FILE* f = fopen(input, "w");
+    TEST_ASSERT(f != NULL, "Create input");
+    for (int i = 0; i < 20000; i++) fprintf(f, "Traced line %d\n", i);
+    fclose(f);
+    const char* inputs[] = {input, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_file, inputs, SEVENZIP_LEVEL_FAST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_trace_dump(trace_file), "Dump trace");
+    char* json = read_file_content(trace_file);
+    TEST_ASSERT(json != NULL, "Trace written");
+    const char* events = strstr(json, "\"traceEvents\":[");
+    const char* first_span = strstr(json, "\"ph\":");
+    int well_formed = json[0] == '{' && events && first_span && events < first_span &&
+                      strcmp(json + strlen(json) - 3, "]}\n") == 0;
+    int spans = strstr(json, "\"name\":\"read\"") && strstr(json, "\"name\":\"compress\"") &&
+                strstr(json, "\"name\":\"write\"") && strstr(json, "\"name\":\"header-build\"");
+    free(json);
+    TEST_ASSERT(well_formed, "An object opening with the traceEvents array");
+    TEST_ASSERT(spans, "Read, compress, write and header spans recorded");
+
+    unlink(input);
+    unlink(archive_file);
+    unlink(trace_file);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_trace_dump(NULL), "Path required");
+#else
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_NOT_IMPLEMENTED, sevenzip_trace_dump(trace_file), "Not recorded");
+    TEST_ASSERT(!file_exists(trace_file), "No file written");
+#endif
+    return 1;
+}
+
+/* Test: A short benchmark gives positive rates, and auto-tuning stays
+ * within the hardware threads and meets a target it can reach */
+static int test_benchmark_auto_tune() {
+    int hardware = sevenzip_hardware_threads();
+    TEST_ASSERT(hardware >= 1, "At least one hardware thread");
+
+    SevenZipBenchmarkResult bench;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_benchmark(SEVENZIP_LEVEL_FASTEST, 2, &bench), "Benchmark");
+    TEST_ASSERT(bench.level == SEVENZIP_LEVEL_FASTEST && bench.threads == 2, "Settings echoed");
+    TEST_ASSERT(bench.encode_mbps > 0 && bench.decode_mbps > 0, "One-thread rates");
+    TEST_ASSERT(bench.encode_mbps_all > 0 && bench.decode_mbps_all > 0, "All-thread rates");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_benchmark(SEVENZIP_LEVEL_STORE, 1, &bench),
+                       "Store has no coder");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_benchmark(SEVENZIP_LEVEL_FASTEST, 1, NULL),
+                       "Result required");
+
+    /* A target any level meets */
+    SevenZipTuning tuning;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_auto_tune(0.5, 64 * 1024 * 1024, SEVENZIP_LEVEL_FAST, &tuning),
+                       "Tune for a low target");
+    TEST_ASSERT(tuning.num_threads >= 1 && tuning.num_threads <= hardware, "Threads within the hardware");
+    TEST_ASSERT(tuning.level >= SEVENZIP_LEVEL_FASTEST && tuning.level <= SEVENZIP_LEVEL_FAST,
+                "Level within the limit");
+    TEST_ASSERT(tuning.expected_mbps >= 0.5, "Target met");
+
+    /* One no level meets: the fastest on all threads */
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_auto_tune(1e9, 0, SEVENZIP_LEVEL_FAST, &tuning),
+                       "Tune for an unreachable target");
+    TEST_ASSERT_EQUALS(SEVENZIP_LEVEL_FASTEST, tuning.level, "Fastest level");
+    TEST_ASSERT_EQUALS(hardware, tuning.num_threads, "All threads");
+    TEST_ASSERT(tuning.expected_mbps > 0 && tuning.expected_mbps < 1e9, "Short of the target");
+    TEST_ASSERT_EQUALS(0, (int)tuning.block_size, "Block size left to the default");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_auto_tune(1.0, 0, SEVENZIP_LEVEL_STORE, &tuning),
+                       "Store cannot be tuned");
+    return 1;
+}
+
+/* Helper: replace a PSI file with one whose "some avg10" is `avg10`
+ * (renamed into place, so a worker polling it never reads it half
+ * written), then let the previous reading go stale */
+static int write_psi(const char* path, double avg10) {
+    char temp[256];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE* f = fopen(temp, "w");
+    if (!f) return 0;
+    fprintf(f, "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\n"
+               "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", avg10);
+    fclose(f);
+    if (rename(temp, path) != 0) return 0;
+    usleep((PRESSURE_POLL_MS + 50) * 1000);
+    return 1;
+}
+
+static void* pressure_worker(void* arg) {
+    MemoryPressure* p = (MemoryPressure*)arg;
+    memory_pressure_enter(p);
+    return NULL;
+}
+
+/* Test: Workers run one at a time once the reading reaches the threshold,
+ * and all run again only below half of it */
+static int test_memory_pressure_hysteresis() {
+    const char* psi = "/tmp/test_memory.pressure";
+    TEST_ASSERT(write_psi(psi, 0.0), "Write PSI file");
+    MemoryPressure pressure;
+    memory_pressure_init_path(&pressure, psi, 20);
+
+    /* No pressure: a second worker joins the first at once */
+    memory_pressure_enter(&pressure);
+    TEST_ASSERT(!memory_pressure_throttled(&pressure), "Not throttled");
+    memory_pressure_enter(&pressure);
+    memory_pressure_leave(&pressure);
+
+    /* At the threshold the second worker waits for the first */
+    TEST_ASSERT(write_psi(psi, 20.0), "Raise pressure");
+    TEST_ASSERT(memory_pressure_throttled(&pressure), "Throttled at the threshold");
+    pthread_t worker;
+    TEST_ASSERT(pthread_create(&worker, NULL, pressure_worker, &pressure) == 0, "Start worker");
+    usleep(2 * PRESSURE_POLL_MS * 1000);
+    pthread_mutex_lock(&pressure.lock);
+    int active = pressure.active;
+    pthread_mutex_unlock(&pressure.lock);
+    TEST_ASSERT_EQUALS(1, active, "Second worker held back");
+
+    /* Below the threshold but not below half: still one at a time */
+    TEST_ASSERT(write_psi(psi, 15.0), "Lower pressure a little");
+    TEST_ASSERT(memory_pressure_throttled(&pressure), "Still throttled above half");
+    usleep(2 * PRESSURE_POLL_MS * 1000);
+    pthread_mutex_lock(&pressure.lock);
+    active = pressure.active;
+    pthread_mutex_unlock(&pressure.lock);
+    TEST_ASSERT_EQUALS(1, active, "Second worker still held back");
+
+    /* Below half the threshold the held worker goes on by itself */
+    TEST_ASSERT(write_psi(psi, 9.0), "Lower pressure below half");
+    pthread_join(worker, NULL);
+    TEST_ASSERT(!memory_pressure_throttled(&pressure), "No longer throttled");
+    memory_pressure_leave(&pressure);
+    memory_pressure_leave(&pressure);
+
+    /* A worker alone always runs, whatever the pressure */
+    TEST_ASSERT(write_psi(psi, 90.0), "Raise pressure again");
+    memory_pressure_enter(&pressure);
+    TEST_ASSERT(memory_pressure_throttled(&pressure), "Throttled");
+    memory_pressure_leave(&pressure);
+    TEST_ASSERT(!memory_pressure_throttled(&pressure), "Nobody to wait for");
+
+    memory_pressure_destroy(&pressure);
+    unlink(psi);
+    return 1;
+}
+
+int main(void) {
     printf("===========================================\n");
     printf("7z FFI SDK - Compression Unit Tests\n");
     printf("===========================================\n\n");
@@ -300,11 +4059,71 @@ int main(int argc, char** argv) {
     /* Run all tests */
     RUN_TEST(test_init);
     RUN_TEST(test_get_version);
+    RUN_TEST(test_cpu_features);
+    RUN_TEST(test_kernel_variants);
     RUN_TEST(test_compress_store);
     RUN_TEST(test_compress_normal);
     RUN_TEST(test_compress_invalid_params);
     RUN_TEST(test_stream_options_init);
     RUN_TEST(test_compression_levels);
+    RUN_TEST(test_concurrent_calls);
+    RUN_TEST(test_background_scheduling);
+    RUN_TEST(test_split_file_blocks);
+    RUN_TEST(test_striped_volumes);
+    RUN_TEST(test_create_to_sink);
+    RUN_TEST(test_create_from_source);
+    RUN_TEST(test_digest_manifest);
+    RUN_TEST(test_snapshot_incremental);
+    RUN_TEST(test_detect_compressed);
+    RUN_TEST(test_solid_sort);
+    RUN_TEST(test_adaptive_block_size);
+    RUN_TEST(test_true_streaming_chunks);
+    RUN_TEST(test_folder_stats);
+    RUN_TEST(test_estimate_job);
+    RUN_TEST(test_throughput_target);
+    RUN_TEST(test_entry_policy);
+    RUN_TEST(test_group_duplicates);
+    RUN_TEST(test_hard_links);
+    RUN_TEST(test_lzma_params);
+    RUN_TEST(test_buffer_codec);
+    RUN_TEST(test_stream_codec);
+    RUN_TEST(test_stream_encoder_finish_drained);
+    RUN_TEST(test_compress_standalone_files);
+    RUN_TEST(test_decompress_lzma2_truncated);
+    RUN_TEST(test_create_auto);
+    RUN_TEST(test_volume_complete);
+    RUN_TEST(test_list_index);
+    RUN_TEST(test_zero_blocks);
+    RUN_TEST(test_sparse_source);
+    RUN_TEST(test_rate_limit);
+    RUN_TEST(test_write_through);
+    RUN_TEST(test_verify_writes);
+    RUN_TEST(test_input_sources);
+    RUN_TEST(test_assemble_parts);
+    RUN_TEST(test_merge_archives);
+    RUN_TEST(test_resplit_archive);
+    RUN_TEST(test_delete_entries);
+    RUN_TEST(test_deterministic_output);
+    RUN_TEST(test_block_cache);
+    RUN_TEST(test_scan_filters);
+    RUN_TEST(test_dedup_chunks);
+    RUN_TEST(test_parity_volumes);
+    RUN_TEST(test_create_from_table);
+    RUN_TEST(test_create_7z_password);
+    RUN_TEST(test_update_archive);
+    RUN_TEST(test_xz_round_trip);
+    RUN_TEST(test_resume_multivolume);
+    RUN_TEST(test_background_jobs);
+    RUN_TEST(test_create_7z_batch);
+    RUN_TEST(test_estimate_memory);
+    RUN_TEST(test_crypt_context);
+    RUN_TEST(test_decrypt_data_parallel);
+    RUN_TEST(test_solid_block_size);
+    RUN_TEST(test_unbuffered_split);
+    RUN_TEST(test_last_stats);
+    RUN_TEST(test_trace_dump);
+    RUN_TEST(test_benchmark_auto_tune);
+    RUN_TEST(test_memory_pressure_hysteresis);
     
     /* Print summary */
     printf("\n===========================================\n");
@@ -0,0 +1,261 @@
+/**
+ * Unit tests for the C++ wrapper (7z_ffi.hpp)
+ */
+
+#include "../include/7z_ffi.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+/* Test utilities */
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "FAIL: %s\n  %s:%d: %s\n", message, __FILE__, __LINE__, #condition); \
+            return 0; \
+        } \
+    } while(0)
+
+#define TEST_ASSERT_EQUALS(expected, actual, message) \
+    do { \
+        if ((expected) != (actual)) { \
+            fprintf(stderr, "FAIL: %s\n  Expected: %d, Got: %d\n  %s:%d\n", \
+                    message, (int)(expected), (int)(actual), __FILE__, __LINE__); \
+            return 0; \
+        } \
+    } while(0)
+
+#define RUN_TEST(test_func) \
+    do { \
+        printf("Running %s... ", #test_func); \
+        fflush(stdout); \
+        if (test_func()) { \
+            printf("PASS\n"); \
+            tests_passed++; \
+        } else { \
+            tests_failed++; \
+        } \
+        tests_run++; \
+    } while(0)
+
+/* Global test stats */
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+/* Helper: Create a test file */
+static int create_test_file(const char* path, const char* content) {
+    FILE* f = fopen(path, "w");
+    if (!f) return 0;
+    size_t len = strlen(content);
+    size_t written = fwrite(content, 1, len, f);
+    fclose(f);
+    return written == len;
+}
+
+/* Entries seen by an extract sink, with the bytes of the last one */
+struct CollectSink {
+    int begun = 0;
+    int ended = 0;
+    std::string name;
+    std::string data;
+
+    int begin_entry(uint32_t, std::string_view entry_name, uint64_t) {
+        begun++;
+        name.assign(entry_name);
+        data.clear();
+        return 0;
+    }
+    int write(uint32_t, sevenzip::Bytes bytes) {
+        data.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        return 0;
+    }
+    int end_entry(uint32_t) {
+        ended++;
+        return 0;
+    }
+};
+
+/* Sink with write only: the adapter leaves the other callbacks NULL */
+struct SizeSink {
+    size_t bytes = 0;
+    int write(uint32_t, sevenzip::Bytes data) {
+        bytes += data.size();
+        return 0;
+    }
+};
+
+/* Test: Handles, zero-copy name views and sink adapters over an open archive */
+static int test_archive_handles() {
+    const char* archive_path = "/tmp/test_cpp_handles.7z";
+    std::vector<std::string> inputs = {"/tmp/test_cpp_a.txt", "/tmp/test_cpp_b.txt"};
+    TEST_ASSERT(create_test_file(inputs[0].c_str(), "first file\n"), "Create input a");
+    TEST_ASSERT(create_test_file(inputs[1].c_str(), "second file, a little longer\n"), "Create input b");
+
+    sevenzip::ErrorCode result = sevenzip::create_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST, nullptr);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create from std::string paths");
+
+    sevenzip::Archive opened;
+    result = sevenzip::Archive::open(archive_path, nullptr, opened);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open archive");
+    sevenzip::Archive archive = std::move(opened);
+    TEST_ASSERT(opened.get() == nullptr, "Moved-from handle is empty");
+    TEST_ASSERT_EQUALS(2, archive.entry_count(), "Entry count");
+
+    sevenzip::List list;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, archive.list(list), "List archive");
+    TEST_ASSERT_EQUALS(2, list.size(), "Two entries listed");
+    uint32_t b_index = UINT32_MAX;
+    uint32_t index = 0;
+    for (sevenzip::EntryView entry : list) {
+        TEST_ASSERT(entry.name().data() == list.get()->entries[index].name, "Name views the C string");
+        if (entry.name() == "test_cpp_b.txt") b_index = index;
+        index++;
+    }
+    TEST_ASSERT(b_index != UINT32_MAX, "Entry found by name");
+
+    CollectSink sink;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, archive.extract_entry(b_index, sink), "Extract through sink");
+    TEST_ASSERT(sink.begun == 1 && sink.ended == 1, "Sink saw one entry");
+    TEST_ASSERT(sink.name == "test_cpp_b.txt", "Sink got the name");
+    TEST_ASSERT(sink.data == "second file, a little longer\n", "Sink got the data");
+
+    SizeSink sizes;
+    std::vector<uint32_t> both = {0, 1};
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, archive.extract_entries(both, sizes), "Extract entries, write only");
+    TEST_ASSERT_EQUALS(strlen("first file\n") + strlen("second file, a little longer\n"), sizes.bytes,
+                       "Write-only sink got every byte");
+
+    sevenzip::EntryReader reader;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, archive.open_reader(b_index, reader), "Open entry reader");
+    char buffer[64];
+    std::string read_back;
+    for (;;) {
+        size_t size = sizeof(buffer);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, reader.read(buffer, size), "Read entry");
+        if (size == 0) break;
+        read_back.append(buffer, size);
+    }
+    TEST_ASSERT(read_back == sink.data, "Reader matches sink");
+    reader.reset();
+
+    sevenzip::List owned;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip::List::open(archive_path, nullptr, owned), "List by path");
+    list = std::move(owned);
+    TEST_ASSERT(owned.empty() && list.size() == 2, "List moved");
+
+    unlink(archive_path);
+    for (const std::string& input : inputs) unlink(input.c_str());
+    return 1;
+}
+
+/* In-memory archive, volume 0 only */
+struct MemorySink {
+    std::vector<unsigned char> data;
+    int ended = 0;
+
+    int write(uint32_t volume, sevenzip::Bytes bytes) {
+        if (volume != 0) return 1;
+        data.insert(data.end(), bytes.begin(), bytes.end());
+        return 0;
+    }
+    int patch(uint64_t offset, sevenzip::Bytes bytes) {
+        if (offset + bytes.size() > data.size()) return 1;
+        memcpy(data.data() + offset, bytes.data(), bytes.size());
+        return 0;
+    }
+    int end_volume(uint32_t, uint64_t size) {
+        ended++;
+        return size == data.size() ? 0 : 1;
+    }
+};
+
+/* Entries made from one string, read a few bytes at a time */
+struct TextSource {
+    const char* text;
+    size_t pos = 0;
+    int next = 0;
+
+    explicit TextSource(const char* t) : text(t) {}
+
+    int read(void* buf, size_t& size) {
+        size_t left = strlen(text) - pos;
+        if (size > left) size = left;
+        if (size > 5) size = 5;
+        memcpy(buf, text + pos, size);
+        pos += size;
+        return 0;
+    }
+    int next_entry(SevenZipSourceEntry& entry) {
+        if (next == 2) return 0;
+        entry.name = next++ == 0 ? "one.txt" : "two.txt";
+        entry.size = SEVENZIP_SIZE_UNKNOWN;
+        pos = 0;
+        sevenzip::bind_read(entry, *this);
+        return 0;
+    }
+};
+
+/* Test: Archive sink and entry source adapters, and a background job */
+static int test_stream_adapters() {
+    const char* source_path = "/tmp/test_cpp_source.7z";
+    const char* sink_path = "/tmp/test_cpp_sink.7z";
+    const char* job_path = "/tmp/test_cpp_job.7z";
+    const char* text = "Produced by a C++ source object\n";
+
+    TextSource source(text);
+    sevenzip::ErrorCode result = sevenzip::create_from_source(source_path, source, SEVENZIP_LEVEL_FAST, nullptr);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create from source object");
+    sevenzip::List list;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip::List::open(source_path, nullptr, list), "List source archive");
+    TEST_ASSERT_EQUALS(2, list.size(), "Both source entries");
+    TEST_ASSERT(list[0].name() == "one.txt" && list[1].name() == "two.txt", "Source entry names");
+    TEST_ASSERT_EQUALS(strlen(text), list[1].size(), "Source entry size");
+
+    const char* inputs[] = {source_path, nullptr};
+    MemorySink memory;
+    result = sevenzip::create_to_sink(inputs, SEVENZIP_LEVEL_FAST, nullptr, memory);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create to sink object");
+    TEST_ASSERT_EQUALS(1, memory.ended, "Volume ended");
+    FILE* f = fopen(sink_path, "wb");
+    TEST_ASSERT(f != NULL, "Write sink archive");
+    fwrite(memory.data.data(), 1, memory.data.size(), f);
+    fclose(f);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(sink_path, NULL, NULL, NULL), "Sink output verifies");
+
+    sevenzip::Job job;
+    result = sevenzip::Job::submit_create(job_path, inputs, SEVENZIP_LEVEL_FAST, nullptr, job);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Submit job");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, job.wait(), "Job finished");
+    TEST_ASSERT(job.poll(), "Job polls finished");
+
+    unlink(job_path);
+    unlink(sink_path);
+    unlink(source_path);
+    return 1;
+}
+
+int main() {
+    printf("===========================================\n");
+    printf("7z FFI SDK - C++ Wrapper Unit Tests\n");
+    printf("===========================================\n\n");
+
+    sevenzip_init();
+
+    RUN_TEST(test_archive_handles);
+    RUN_TEST(test_stream_adapters);
+
+    sevenzip_cleanup();
+
+    printf("\n===========================================\n");
+    printf("Test Results:\n");
+    printf("  Total:  %d\n", tests_run);
+    printf("  Passed: %d\n", tests_passed);
+    printf("  Failed: %d\n", tests_failed);
+    printf("===========================================\n");
+
+    return tests_failed > 0 ? 1 : 0;
+}
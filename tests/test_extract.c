@@ -4,10 +4,13 @@
 
 #include "../include/7z_ffi.h"
 #include <stdio.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <utime.h>
 
 /* Test utilities */
 #define TEST_ASSERT(condition, message) \
@@ -295,8 +298,3312 @@ static int test_extract_and_verify() {
     return 1;
 }
 
+/* Test: True streaming archive round trip (directory, several files, empty file) */
+static int test_true_streaming_round_trip() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_ts_input";
+    const char* archive_path = "/tmp/test_ts.7z";
+    const char* output_dir = "/tmp/test_ts_output";
+    const char* content_a = "First file streamed through LZMA2\n";
+    const char* content_b = "Second file, appended to the same solid stream\n";
+
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/a.txt", input_dir);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        printf("SKIP (cannot create temp file) ");
+        sevenzip_cleanup();
+        return 1;
+    }
+    fputs(content_a, f);
+    fclose(f);
+
+    snprintf(path, sizeof(path), "%s/b.txt", input_dir);
+    f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create second input file");
+    fputs(content_b, f);
+    fclose(f);
+
+    snprintf(path, sizeof(path), "%s/empty.txt", input_dir);
+    f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create empty input file");
+    fclose(f);
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_true_streaming(
+        archive_path, inputs, SEVENZIP_LEVEL_FAST, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "True streaming compression succeeds");
+
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_path, NULL, NULL, NULL),
+                       "Archive passes integrity test");
+
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extraction succeeds");
+
+    snprintf(path, sizeof(path), "%s/test_ts_input/a.txt", output_dir);
+    char* extracted = read_file_content(path);
+    TEST_ASSERT(extracted != NULL, "Read first extracted file");
+    TEST_ASSERT(strcmp(content_a, extracted) == 0, "First file matches");
+    free(extracted);
+
+    snprintf(path, sizeof(path), "%s/test_ts_input/b.txt", output_dir);
+    extracted = read_file_content(path);
+    TEST_ASSERT(extracted != NULL, "Read second extracted file");
+    TEST_ASSERT(strcmp(content_b, extracted) == 0, "Second file matches");
+    free(extracted);
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: A tree of small files, read a batch at a time by the solid reader */
+#define SMALL_BATCH_TEST_FILES 300
+
+static size_t small_batch_size(int file) {
+    return file == 150 ? 200 * 1024 : (size_t)(file * 211) % 9000;
+}
+
+static int small_batch_matches(const char* path, int file) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t i = 0;
+    int c;
+    int ok = 1;
+    while ((c = fgetc(f)) != EOF) {
+        if (c != (int)((file * 31 + i * 7) & 0xff)) ok = 0;
+        i++;
+    }
+    fclose(f);
+    return ok && i == small_batch_size(file);
+}
+
+static int test_small_file_batches() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_small_input";
+    const char* archive_path = "/tmp/test_small.7z";
+    const char* output_dir = "/tmp/test_small_output";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+
+    /* Empty and small files around one too large for a batch */
+    for (int file = 0; file < SMALL_BATCH_TEST_FILES; file++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/f%03d", input_dir, file);
+        FILE* f = fopen(path, "wb");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (size_t i = 0; i < small_batch_size(file); i++) fputc((int)((file * 31 + i * 7) & 0xff), f);
+        fclose(f);
+    }
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_true_streaming(
+        archive_path, inputs, SEVENZIP_LEVEL_FAST, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive of small files");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_path, NULL, NULL, NULL),
+                       "CRCs of the batched files verify");
+
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extraction succeeds");
+    int all = 1;
+    for (int file = 0; file < SMALL_BATCH_TEST_FILES; file++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/test_small_input/f%03d", output_dir, file);
+        all = all && small_batch_matches(path, file);
+    }
+    TEST_ASSERT(all, "Every file matches");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Split archive extraction reading several volumes ahead */
+static int test_split_volume_readahead() {
+    sevenzip_init();
+
+    const char* input_file = "/tmp/test_readahead.txt";
+    const char* archive_path = "/tmp/test_readahead.7z";
+    const char* output_dir = "/tmp/test_readahead_output";
+
+    FILE* f = fopen(input_file, "w");
+    if (!f) {
+        printf("SKIP (cannot create temp file) ");
+        sevenzip_cleanup();
+        return 1;
+    }
+    for (int i = 0; i < 20000; i++) {
+        fprintf(f, "Read-ahead line %d\n", i);
+    }
+    fclose(f);
+
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.split_size = 64 * 1024;
+    const char* inputs[] = {input_file, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_STORE,
+                                                            &stream_options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.volume_readahead = 3;
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract_streaming_with_options("/tmp/test_readahead.7z.001", output_dir, NULL,
+                                                     &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extraction with read-ahead succeeds");
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/test_readahead.txt", output_dir);
+    char* original = read_file_content(input_file);
+    char* extracted = read_file_content(path);
+    TEST_ASSERT(original != NULL && extracted != NULL, "Read both files");
+    TEST_ASSERT(strcmp(original, extracted) == 0, "Content matches original");
+    free(extracted);
+
+    /* The unmapped paths read the series through one set of positioned
+     * readers, named by its base path */
+    SevenZipList* list = NULL;
+    result = sevenzip_list(archive_path, NULL, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List the series by its base path");
+    TEST_ASSERT(list->count == 1, "One entry");
+    sevenzip_free_list(list);
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract the series by its base path");
+    extracted = read_file_content(path);
+    TEST_ASSERT(extracted != NULL && strcmp(original, extracted) == 0, "Content matches original");
+    free(original);
+    free(extracted);
+
+    for (int i = 1; i <= 9; i++) {
+        snprintf(path, sizeof(path), "%s.%03d", archive_path, i);
+        unlink(path);
+    }
+    unlink(input_file);
+    remove_dir_recursive(output_dir);
+
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: One entry of an open archive read in small pieces */
+static int test_entry_reader() {
+    sevenzip_init();
+
+    const char* input_file = "/tmp/test_entry_reader.txt";
+    const char* archive_path = "/tmp/test_entry_reader.7z";
+
+    FILE* f = fopen(input_file, "w");
+    if (!f) {
+        printf("SKIP (cannot create temp file) ");
+        sevenzip_cleanup();
+        return 1;
+    }
+    for (int i = 0; i < 200000; i++) {
+        fprintf(f, "Entry reader line %d\n", i);
+    }
+    fclose(f);
+
+    const char* inputs[] = {input_file, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipArchive* archive = NULL;
+    result = sevenzip_open(archive_path, NULL, &archive);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open archive");
+    TEST_ASSERT(sevenzip_archive_entry_count(archive) == 1, "One entry");
+
+    SevenZipEntryReader* reader = NULL;
+    result = sevenzip_entry_reader_open(archive, 1, &reader);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Index past the end rejected");
+
+    /* Read to the end, more than the reader keeps ahead */
+    char* original = read_file_content(input_file);
+    TEST_ASSERT(original != NULL, "Read original");
+    size_t original_size = strlen(original);
+    result = sevenzip_entry_reader_open(archive, 0, &reader);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open reader");
+    size_t total = 0;
+    int matches = 1;
+    char buf[3000];
+    for (;;) {
+        size_t size = sizeof(buf);
+        result = sevenzip_entry_reader_read(reader, buf, &size);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Read entry");
+        if (size == 0) break;
+        if (total + size > original_size || memcmp(original + total, buf, size) != 0) matches = 0;
+        total += size;
+    }
+    sevenzip_entry_reader_close(reader);
+    TEST_ASSERT(matches && total == original_size, "Content matches original");
+
+    /* Closed after one read: the decoder stops, the archive stays usable */
+    result = sevenzip_entry_reader_open(archive, 0, &reader);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Reopen reader");
+    size_t size = sizeof(buf);
+    result = sevenzip_entry_reader_read(reader, buf, &size);
+    TEST_ASSERT(result == SEVENZIP_OK && size > 0, "First read");
+    sevenzip_entry_reader_close(reader);
+    result = sevenzip_entry_reader_open(archive, 0, &reader);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open reader again");
+    size = sizeof(buf);
+    result = sevenzip_entry_reader_read(reader, buf, &size);
+    TEST_ASSERT(result == SEVENZIP_OK && size > 0 && memcmp(buf, original, size) == 0,
+                "Reader starts at the beginning");
+    sevenzip_entry_reader_close(reader);
+
+    free(original);
+    sevenzip_close(archive);
+    unlink(archive_path);
+    unlink(input_file);
+
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Threads reading entries of one open archive at once */
+#define SHARED_FILES 8
+#define SHARED_FILE_SIZE 150000
+#define SHARED_THREADS 4
+
+static unsigned char shared_byte(int file, size_t i) {
+    return (unsigned char)("shared handle "[(i + (size_t)file) % 14] + (i / 4096 + (size_t)file) % 7);
+}
+
+typedef struct {
+    SevenZipArchive* archive;
+    uint32_t count;
+    int start;
+    int failures;
+    unsigned char buf[SHARED_FILE_SIZE];
+    size_t size;
+} SharedReader;
+
+static int shared_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    (void)entry_index;
+    SharedReader* r = (SharedReader*)user_data;
+    if (size > sizeof(r->buf) - r->size) return 1;
+    memcpy(r->buf + r->size, data, size);
+    r->size += size;
+    return 0;
+}
+
+static void* shared_worker(void* arg) {
+    SharedReader* r = (SharedReader*)arg;
+    SevenZipList* list = NULL;
+    if (sevenzip_archive_list(r->archive, &list) != SEVENZIP_OK) {
+        r->failures++;
+        return NULL;
+    }
+    SevenZipExtractSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.write = shared_write;
+    sink.user_data = r;
+    for (int round = 0; round < 3; round++) {
+        for (uint32_t k = 0; k < r->count; k++) {
+            uint32_t index = (k + (uint32_t)r->start) % r->count;
+            if (list->entries[index].is_directory) continue;
+            int file = atoi(strrchr(list->entries[index].name, 'f') + 1);
+            r->size = 0;
+            if (sevenzip_archive_extract_entry(r->archive, index, &sink) != SEVENZIP_OK ||
+                r->size != SHARED_FILE_SIZE) {
+                r->failures++;
+                continue;
+            }
+            for (size_t i = 0; i < r->size; i++) {
+                if (r->buf[i] != shared_byte(file, i)) {
+                    r->failures++;
+                    break;
+                }
+            }
+        }
+    }
+    sevenzip_free_list(list);
+    return NULL;
+}
+
+static int test_shared_archive_handle() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_shared_input";
+    const char* archive_path = "/tmp/test_shared.7z";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+
+    static unsigned char content[SHARED_FILE_SIZE];
+    for (int file = 0; file < SHARED_FILES; file++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/f%d", input_dir, file);
+        FILE* f = fopen(path, "wb");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (size_t i = 0; i < SHARED_FILE_SIZE; i++) content[i] = shared_byte(file, i);
+        fwrite(content, 1, SHARED_FILE_SIZE, f);
+        fclose(f);
+    }
+
+    /* Solid: one folder, shared from the cache; then a folder per file,
+     * every one kept; then no cache at all; then a budget of two folders,
+     * the least recently read dropped while other threads copy from it */
+    for (int mode = 0; mode < 4; mode++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.solid = mode == 0;
+        const char* inputs[] = {input_dir, NULL};
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                                &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+        SevenZipArchive* archive = NULL;
+        result = sevenzip_open(archive_path, NULL, &archive);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open archive");
+        if (mode == 2) sevenzip_archive_set_folder_cache(archive, 0);
+        if (mode == 3) sevenzip_archive_set_cache_budget(archive, 2 * SHARED_FILE_SIZE);
+
+        static SharedReader readers[SHARED_THREADS];
+        pthread_t threads[SHARED_THREADS];
+        for (int t = 0; t < SHARED_THREADS; t++) {
+            readers[t].archive = archive;
+            readers[t].count = sevenzip_archive_entry_count(archive);
+            readers[t].start = t * 3;
+            readers[t].failures = 0;
+            TEST_ASSERT(pthread_create(&threads[t], NULL, shared_worker, &readers[t]) == 0, "Start reader");
+        }
+        int failures = 0;
+        for (int t = 0; t < SHARED_THREADS; t++) {
+            pthread_join(threads[t], NULL);
+            failures += readers[t].failures;
+        }
+        sevenzip_close(archive);
+        unlink(archive_path);
+        TEST_ASSERT_EQUALS(0, failures, "Every concurrent read matches");
+    }
+
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: A queue of entries comes out in the order of the data, each once */
+typedef struct {
+    uint32_t order[16];
+    int begins;
+    int ends;
+    size_t bytes;
+} QueuedEntries;
+
+static int queued_begin(uint32_t entry_index, const char* name, uint64_t size, void* user_data) {
+    (void)name;
+    (void)size;
+    QueuedEntries* q = (QueuedEntries*)user_data;
+    if (q->begins < 16) q->order[q->begins] = entry_index;
+    q->begins++;
+    return 0;
+}
+
+static int queued_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    (void)entry_index;
+    (void)data;
+    ((QueuedEntries*)user_data)->bytes += size;
+    return 0;
+}
+
+static int queued_end(uint32_t entry_index, void* user_data) {
+    (void)entry_index;
+    ((QueuedEntries*)user_data)->ends++;
+    return 0;
+}
+
+static int test_archive_extract_entries() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_queue_input";
+    const char* archive_path = "/tmp/test_queue.7z";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    for (int i = 0; i < 6; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/q%d.txt", input_dir, i);
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (int line = 0; line < 1000; line++) fprintf(f, "queued file %d line %d\n", i, line);
+        fclose(f);
+    }
+
+    /* Three folders of two files */
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.solid_block_files = 2;
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            &stream_options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipArchive* archive = NULL;
+    result = sevenzip_open(archive_path, NULL, &archive);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open archive");
+    SevenZipList* list = NULL;
+    result = sevenzip_archive_list(archive, &list);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List archive");
+    uint32_t files[6];
+    size_t file_size = 0;
+    int n = 0;
+    for (size_t i = 0; i < list->count && n < 6; i++) {
+        if (list->entries[i].is_directory) continue;
+        files[n++] = (uint32_t)i;
+        file_size = (size_t)list->entries[i].size;
+    }
+    TEST_ASSERT_EQUALS(6, n, "Six files listed");
+    uint32_t dir_index = (uint32_t)list->count;
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->entries[i].is_directory) dir_index = (uint32_t)i;
+    }
+    sevenzip_free_list(list);
+
+    /* Requests out of order, one twice, one folder not touched at all;
+       with and without the folder cache */
+    uint32_t queue[] = {files[5], files[0], files[4], files[1], files[5]};
+    for (int cached = 0; cached <= 1; cached++) {
+        sevenzip_archive_set_folder_cache(archive, cached ? 64 << 20 : 0);
+        QueuedEntries q;
+        memset(&q, 0, sizeof(q));
+        SevenZipExtractSink sink = {queued_begin, queued_write, queued_end, &q};
+        result = sevenzip_archive_extract_entries(archive, queue, 5, &sink);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract queued entries");
+        TEST_ASSERT(q.begins == 4 && q.ends == 4, "Each requested entry once");
+        TEST_ASSERT(q.order[0] == files[0] && q.order[1] == files[1] &&
+                    q.order[2] == files[4] && q.order[3] == files[5], "Entries in archive order");
+        TEST_ASSERT(q.bytes == 4 * file_size, "Every byte passed on");
+    }
+
+    if (dir_index < 16) {
+        QueuedEntries q;
+        memset(&q, 0, sizeof(q));
+        SevenZipExtractSink sink = {queued_begin, queued_write, queued_end, &q};
+        uint32_t bad[] = {files[0], dir_index};
+        result = sevenzip_archive_extract_entries(archive, bad, 2, &sink);
+        TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Directory rejected");
+        TEST_ASSERT_EQUALS(0, q.begins, "Nothing passed on");
+    }
+
+    sevenzip_close(archive);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: CRCs of a multi-threaded LZMA2 folder checked behind the decoder */
+#define CRC_BEHIND_FILES 4
+
+static const size_t crc_behind_sizes[CRC_BEHIND_FILES] = {0, 3000, 2 << 20, 6 << 20};
+
+static unsigned char crc_behind_byte(int file, size_t i, uint32_t* state) {
+    if (file == 3) {
+        *state = *state * 1664525u + 1013904223u;
+        return (unsigned char)(*state >> 24);
+    }
+    return (unsigned char)("crc checker "[i % 12] + file);
+}
+
+static int crc_behind_matches(const char* path, int file) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    uint32_t state = 12345;
+    size_t i = 0;
+    int c;
+    int ok = 1;
+    while ((c = fgetc(f)) != EOF) {
+        if (i >= crc_behind_sizes[file] || c != crc_behind_byte(file, i, &state)) ok = 0;
+        i++;
+    }
+    fclose(f);
+    return ok && i == crc_behind_sizes[file];
+}
+
+static int test_crc_checked_behind_decoder() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_crc_input";
+    const char* archive_path = "/tmp/test_crc_behind.7z";
+    const char* output_dir = "/tmp/test_crc_output";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+
+    /* Empty, small and large files; the random one is stored in
+     * uncompressed chunks, so a flipped byte reaches the output as is */
+    for (int file = 0; file < CRC_BEHIND_FILES; file++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/c%d", input_dir, file);
+        FILE* f = fopen(path, "wb");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        uint32_t state = 12345;
+        for (size_t i = 0; i < crc_behind_sizes[file]; i++) fputc(crc_behind_byte(file, i, &state), f);
+        fclose(f);
+    }
+
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.num_threads = 2;
+    stream_options.block_size = 1 << 20;
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            &stream_options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create multi-block archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.num_threads = 1;
+    options.lzma2_threads = 4;
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Multi-threaded extraction succeeds");
+    for (int file = 0; file < CRC_BEHIND_FILES; file++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/test_crc_input/c%d", output_dir, file);
+        TEST_ASSERT(crc_behind_matches(path, file), "Extracted file matches");
+    }
+
+    /* Flip a byte in the middle of the archive, inside the random file */
+    FILE* f = fopen(archive_path, "r+b");
+    TEST_ASSERT(f != NULL, "Reopen archive");
+    fseek(f, 0, SEEK_END);
+    long middle = ftell(f) / 2;
+    fseek(f, middle, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, middle, SEEK_SET);
+    fputc(c ^ 0x5a, f);
+    fclose(f);
+
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT(result != SEVENZIP_OK, "Corrupted file fails its CRC check");
+    result = sevenzip_test_archive(archive_path, NULL, NULL, NULL);
+    TEST_ASSERT(result != SEVENZIP_OK, "Archive test reports the bad CRC");
+
+    /* No folder CRC is stored, so FOLDER still checks the files; NONE
+     * computes no CRC and passes the flipped byte on */
+    options.verify = SEVENZIP_VERIFY_FOLDER;
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT(result != SEVENZIP_OK, "Folder verification falls back to file CRCs");
+    options.verify = SEVENZIP_VERIFY_NONE;
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Unverified extraction skips the CRCs");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/test_crc_input/c2", output_dir);
+    TEST_ASSERT(crc_behind_matches(path, 2), "Untouched file still matches");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Progress callback cutting the archive short once the first file is out */
+static void truncate_on_progress(uint64_t completed, uint64_t total, void* user_data) {
+    (void)total;
+    if (completed == 1) truncate((const char*)user_data, 4096);
+}
+
+/* Test: An archive truncated under a running mapped extraction fails the
+ * extraction instead of faulting */
+static int test_extract_truncated_while_mapped() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_cut_input";
+    const char* archive_path = "/tmp/test_cut.7z";
+    const char* output_dir = "/tmp/test_cut_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+
+    /* Files of random letters, one LZMA2 folder each (random bytes would
+     * be stored and copied without the mapping), so the later folders lie
+     * well past the cut */
+    uint32_t state = 4321;
+    for (int file = 0; file < 4; file++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/r%d", input_dir, file);
+        FILE* f = fopen(path, "wb");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (size_t i = 0; i < 1024 * 1024; i++) {
+            state = state * 1103515245 + 12345;
+            fputc('a' + (int)((state >> 16) % 16), f);
+        }
+        fclose(f);
+    }
+
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.solid = 0;
+    const char* inputs[] = {input_dir, NULL};
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                                 &stream_options, NULL, NULL),
+                       "Create non-solid archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.num_threads = 1;
+    options.writer_threads = 0;
+    options.progress_interval_ms = -1;
+    SevenZipErrorCode result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options,
+                                                             truncate_on_progress, (void*)archive_path);
+    TEST_ASSERT(result != SEVENZIP_OK, "Truncated archive fails the extraction");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Re-extraction that leaves files already extracted alone */
+static int test_extract_skip_existing() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_existing_input";
+    const char* archive_path = "/tmp/test_existing.7z";
+    const char* output_dir = "/tmp/test_existing_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+    const char* names[] = {"a.txt", "b.txt", "c.txt"};
+    for (int i = 0; i < 3; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (int line = 0; line < 2000; line++) fprintf(f, "%s line %d\n", names[i], line);
+        fclose(f);
+    }
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.existing = SEVENZIP_EXISTING_SKIP_SAME;
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "First extraction writes everything");
+
+    /* a.txt: same size and time, other bytes; b.txt: gone */
+    char a_path[512], b_path[512], a_input[512];
+    snprintf(a_path, sizeof(a_path), "%s/test_existing_input/a.txt", output_dir);
+    snprintf(b_path, sizeof(b_path), "%s/test_existing_input/b.txt", output_dir);
+    snprintf(a_input, sizeof(a_input), "%s/a.txt", input_dir);
+    struct stat st;
+    TEST_ASSERT(stat(a_path, &st) == 0, "Stat extracted file");
+    FILE* f = fopen(a_path, "r+");
+    TEST_ASSERT(f != NULL, "Reopen extracted file");
+    fputc('#', f);
+    fclose(f);
+    struct utimbuf times = {st.st_atime, st.st_mtime};
+    utime(a_path, &times);
+    unlink(b_path);
+
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Re-extraction succeeds");
+    char* original = read_file_content(a_input);
+    char* extracted = read_file_content(a_path);
+    TEST_ASSERT(original != NULL && extracted != NULL, "Read both files");
+    TEST_ASSERT(extracted[0] == '#', "Same size and time: left alone");
+    free(extracted);
+    TEST_ASSERT(access(b_path, F_OK) == 0, "Missing file written again");
+
+    options.existing = SEVENZIP_EXISTING_SKIP_SAME_CRC;
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Re-extraction with CRCs succeeds");
+    extracted = read_file_content(a_path);
+    TEST_ASSERT(extracted != NULL && strcmp(original, extracted) == 0, "Other CRC: written again");
+    free(original);
+    free(extracted);
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Stored files copied straight from the archive */
+static int test_extract_stored_range_copy() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_stored_input";
+    const char* archive_path = "/tmp/test_stored.7z";
+    const char* output_dir = "/tmp/test_stored_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+
+    /* Above the writer pool's limit, so the decoding thread writes it */
+    static char big[3 << 20];
+    for (size_t i = 0; i < sizeof(big); i++) big[i] = (char)('a' + (i * 7) % 26);
+    big[sizeof(big) - 1] = '\0';
+    char path[512];
+    snprintf(path, sizeof(path), "%s/big.txt", input_dir);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        printf("SKIP (cannot create temp file) ");
+        sevenzip_cleanup();
+        return 1;
+    }
+    fputs(big, f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/small.txt", input_dir);
+    f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create small file");
+    fputs("small stored file\n", f);
+    fclose(f);
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_STORE,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create stored archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract stored archive");
+    snprintf(path, sizeof(path), "%s/test_stored_input/big.txt", output_dir);
+    char* extracted = read_file_content(path);
+    TEST_ASSERT(extracted != NULL && strcmp(extracted, big) == 0, "Large stored file matches");
+    free(extracted);
+    snprintf(path, sizeof(path), "%s/test_stored_input/small.txt", output_dir);
+    extracted = read_file_content(path);
+    TEST_ASSERT(extracted != NULL && strcmp(extracted, "small stored file\n") == 0,
+                "Small stored file matches");
+    free(extracted);
+
+    /* A flipped byte reaches the copy, and the CRC still catches it */
+    f = fopen(archive_path, "r+b");
+    TEST_ASSERT(f != NULL, "Reopen archive");
+    fseek(f, 32 + 1000, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, 32 + 1000, SEEK_SET);
+    fputc(c ^ 0x20, f);
+    fclose(f);
+    remove_dir_recursive(output_dir);
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT(result != SEVENZIP_OK, "Corrupted stored file fails its CRC check");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: stat, readdir and pread through the tree of an open archive */
+#define VFS_BIG_SIZE (1 << 20)
+
+static unsigned char vfs_byte(size_t i) {
+    return (unsigned char)((i * 2654435761u) >> 13);
+}
+
+typedef struct {
+    int count;
+    int saw_file;
+    int saw_dir;
+} VfsListing;
+
+static int vfs_list_child(const char* name, const SevenZipVfsStat* stat, void* user_data) {
+    VfsListing* listing = (VfsListing*)user_data;
+    listing->count++;
+    if (strcmp(name, "a.txt") == 0 && !stat->is_directory && stat->size == 6) listing->saw_file = 1;
+    if (strcmp(name, "sub") == 0 && stat->is_directory) listing->saw_dir = 1;
+    return 0;
+}
+
+static int test_archive_vfs() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_vfs_input";
+    const char* archive_path = "/tmp/test_vfs.7z";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    mkdir("/tmp/test_vfs_input/sub", 0755);
+
+    FILE* f = fopen("/tmp/test_vfs_input/a.txt", "wb");
+    if (!f) {
+        printf("SKIP (cannot create temp file) ");
+        sevenzip_cleanup();
+        return 1;
+    }
+    fputs("alpha\n", f);
+    fclose(f);
+    static unsigned char big[VFS_BIG_SIZE];
+    for (size_t i = 0; i < sizeof(big); i++) big[i] = vfs_byte(i);
+    f = fopen("/tmp/test_vfs_input/sub/b.bin", "wb");
+    TEST_ASSERT(f != NULL, "Create big file");
+    fwrite(big, 1, sizeof(big), f);
+    fclose(f);
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    SevenZipArchive* archive = NULL;
+    result = sevenzip_open(archive_path, NULL, &archive);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open archive");
+
+    SevenZipVfsStat st;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_stat(archive, "/", &st), "Stat root");
+    TEST_ASSERT(st.is_directory && st.entry_index == SEVENZIP_VFS_NO_ENTRY, "Root is a directory");
+    VfsListing listing = {0, 0, 0};
+    result = sevenzip_archive_readdir(archive, "test_vfs_input/", vfs_list_child, &listing);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Read directory");
+    TEST_ASSERT(listing.count == 2 && listing.saw_file && listing.saw_dir, "Directory lists both children");
+
+    result = sevenzip_archive_stat(archive, "/test_vfs_input//sub/./b.bin", &st);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Stat big file");
+    TEST_ASSERT(!st.is_directory && st.size == VFS_BIG_SIZE, "Big file size");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, sevenzip_archive_stat(archive, "test_vfs_input/none", &st),
+                       "Missing path");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM,
+                       sevenzip_archive_readdir(archive, "test_vfs_input/a.txt", vfs_list_child, &listing),
+                       "Readdir of a file");
+
+    /* Copied from the cached folder, then decoded up to the window */
+    uint32_t entry = st.entry_index;
+    static unsigned char window[70000];
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) sevenzip_archive_set_cache_budget(archive, 0);
+        size_t size = sizeof(window);
+        result = sevenzip_archive_pread(archive, entry, 300001, window, &size);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Read window");
+        TEST_ASSERT(size == sizeof(window) && memcmp(window, big + 300001, size) == 0, "Window matches");
+        size = sizeof(window);
+        result = sevenzip_archive_pread(archive, entry, VFS_BIG_SIZE - 100, window, &size);
+        TEST_ASSERT(result == SEVENZIP_OK && size == 100 &&
+                    memcmp(window, big + VFS_BIG_SIZE - 100, 100) == 0, "Short read at the end");
+        size = sizeof(window);
+        result = sevenzip_archive_pread(archive, entry, VFS_BIG_SIZE, window, &size);
+        TEST_ASSERT(result == SEVENZIP_OK && size == 0, "Nothing past the end");
+    }
+
+    sevenzip_close(archive);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Decoder memory estimated from the coder props and held to max_memory */
+static int test_extract_memory_limit() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_memlimit_input";
+    const char* archive_path = "/tmp/test_memlimit.7z";
+    const char* output_dir = "/tmp/test_memlimit_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+    const char* names[] = {"a.txt", "b.txt", "c.txt"};
+    for (int i = 0; i < 3; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (int line = 0; line < 20000; line++) fprintf(f, "%s line %d\n", names[i], line);
+        fclose(f);
+    }
+    /* One folder per file */
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.solid = 0;
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                            &stream_options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.num_threads = 3;
+    options.lzma2_threads = 1;
+    uint64_t peak3 = 0;
+    result = sevenzip_estimate_extract_memory(archive_path, &options, &peak3);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Estimate for three workers");
+    options.num_threads = 1;
+    uint64_t peak1 = 0;
+    result = sevenzip_estimate_extract_memory(archive_path, &options, &peak1);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Estimate for one worker");
+    /* Dictionaries are capped at the folder size, not the level's 16MB */
+    TEST_ASSERT(peak1 > 0 && peak1 < 4 * 1024 * 1024, "One folder costs its own size");
+    TEST_ASSERT(peak3 > peak1, "Three folders at once cost more");
+
+    /* A budget under three folders runs fewer at once */
+    options.num_threads = 3;
+    options.max_memory = peak3 - 1;
+    uint64_t fitted = 0;
+    result = sevenzip_estimate_extract_memory(archive_path, &options, &fitted);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Estimate under a budget");
+    TEST_ASSERT(fitted >= peak1 && fitted <= options.max_memory, "Fewer workers fit the budget");
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extraction under a budget");
+    char input_path[512], output_path[512];
+    snprintf(input_path, sizeof(input_path), "%s/c.txt", input_dir);
+    snprintf(output_path, sizeof(output_path), "%s/test_memlimit_input/c.txt", output_dir);
+    char* original = read_file_content(input_path);
+    char* extracted = read_file_content(output_path);
+    TEST_ASSERT(original != NULL && extracted != NULL && strcmp(original, extracted) == 0,
+                "Content matches");
+    free(original);
+    free(extracted);
+
+    /* A budget no folder fits: rejected before anything is decoded */
+    remove_dir_recursive(output_dir);
+    options.max_memory = peak1 - 1;
+    result = sevenzip_estimate_extract_memory(archive_path, &options, &fitted);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_MEMORY, result, "Estimate over the budget");
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_MEMORY, result, "Extraction over the budget");
+    TEST_ASSERT(!dir_exists(output_dir), "Nothing written");
+    result = sevenzip_test_archive_with_options(archive_path, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_MEMORY, result, "Test over the budget");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Cache-neutral output writes the same files, sparse or not */
+#define CACHE_NEUTRAL_SIZE ((20 << 20) + 12345)
+
+static unsigned char cache_neutral_byte(size_t i) {
+    /* Zero runs of whole 4KB blocks between patterned ones */
+    return (i / 4096) % 3 == 0 ? 0 : (unsigned char)((i * 2654435761u) >> 11);
+}
+
+static int cache_neutral_file_matches(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    static unsigned char buf[1 << 16];
+    size_t pos = 0, n;
+    int ok = 1;
+    while (ok && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (size_t i = 0; ok && i < n; i++) ok = buf[i] == cache_neutral_byte(pos + i);
+        pos += n;
+    }
+    fclose(f);
+    return ok && pos == CACHE_NEUTRAL_SIZE;
+}
+
+static int test_extract_cache_neutral() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_nocache_input";
+    const char* archive_path = "/tmp/test_nocache.7z";
+    const char* output_dir = "/tmp/test_nocache_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+
+    /* Several write windows through the decoding thread, one file through the writers */
+    char path[512];
+    snprintf(path, sizeof(path), "%s/big.bin", input_dir);
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        printf("SKIP (cannot create temp file) ");
+        sevenzip_cleanup();
+        return 1;
+    }
+    for (size_t i = 0; i < CACHE_NEUTRAL_SIZE; i++) fputc(cache_neutral_byte(i), f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/small.txt", input_dir);
+    f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create small file");
+    fputs("small file\n", f);
+    fclose(f);
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FASTEST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.cache_neutral_output = 1;
+    for (int sparse = 0; sparse <= 1; sparse++) {
+        options.sparse_output = sparse;
+        remove_dir_recursive(output_dir);
+        result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Cache-neutral extraction");
+        snprintf(path, sizeof(path), "%s/test_nocache_input/big.bin", output_dir);
+        TEST_ASSERT(cache_neutral_file_matches(path), "Large file matches");
+        snprintf(path, sizeof(path), "%s/test_nocache_input/small.txt", output_dir);
+        char* extracted = read_file_content(path);
+        TEST_ASSERT(extracted != NULL && strcmp(extracted, "small file\n") == 0, "Small file matches");
+        free(extracted);
+    }
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Extracted files complete under every durability mode, none left under a temporary name */
+static int test_extract_durability() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_durable_input";
+    const char* archive_path = "/tmp/test_durable.7z";
+    const char* output_dir = "/tmp/test_durable_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+
+    /* One file through the decoding thread, small ones through the writers, one empty */
+    const char* names[] = {"big.bin", "a.txt", "b.txt", "empty.txt"};
+    char path[512];
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        FILE* f = fopen(path, "wb");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        if (i == 0) {
+            for (size_t b = 0; b < ((size_t)3 << 20); b++) fputc((int)((b * 2654435761u) >> 24), f);
+        } else if (i < 3) {
+            for (int line = 0; line < 500; line++) fprintf(f, "%s line %d\n", names[i], line);
+        }
+        fclose(f);
+    }
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FASTEST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    TEST_ASSERT_EQUALS(SEVENZIP_DURABILITY_NONE, options.durability, "Default is no durability");
+    for (int mode = SEVENZIP_DURABILITY_NONE; mode <= SEVENZIP_DURABILITY_ATOMIC; mode++) {
+        options.durability = (SevenZipDurability)mode;
+        for (int streaming = 0; streaming <= 1; streaming++) {
+            /* The second pass of each mode writes over the first */
+            result = streaming
+                ? sevenzip_extract_streaming_with_options(archive_path, output_dir, NULL, &options, NULL, NULL)
+                : sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Durable extraction");
+            for (int i = 0; i < 4; i++) {
+                char input[512];
+                snprintf(input, sizeof(input), "%s/%s", input_dir, names[i]);
+                snprintf(path, sizeof(path), "%s/test_durable_input/%s", output_dir, names[i]);
+                struct stat in_st, out_st;
+                TEST_ASSERT(stat(input, &in_st) == 0 && stat(path, &out_st) == 0, "Stat both files");
+                TEST_ASSERT(in_st.st_size == out_st.st_size, "Same size");
+                if (i > 0 && i < 3) {
+                    char* original = read_file_content(input);
+                    char* extracted = read_file_content(path);
+                    TEST_ASSERT(original != NULL && extracted != NULL &&
+                                strcmp(original, extracted) == 0, "Same content");
+                    free(original);
+                    free(extracted);
+                }
+                if (!streaming) TEST_ASSERT(in_st.st_mtime == out_st.st_mtime, "Time kept across the rename");
+                snprintf(path, sizeof(path), "%s/test_durable_input/%s.7zpart", output_dir, names[i]);
+                TEST_ASSERT(access(path, F_OK) != 0, "No temporary name left");
+            }
+        }
+    }
+
+    /* Skipped files are not opened, so nothing is renamed over them */
+    options.durability = SEVENZIP_DURABILITY_ATOMIC;
+    options.existing = SEVENZIP_EXISTING_SKIP_SAME;
+    result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Atomic extraction skipping existing files");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* An archive in memory served as a remote object would be */
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    int calls;
+    uint64_t bytes;
+    int fail;
+} RangeServer;
+
+static int range_server_read(void* user_data, uint64_t offset, void* buf, size_t size) {
+    RangeServer* server = (RangeServer*)user_data;
+    if (server->fail || offset > server->size || size > server->size - offset) return -1;
+    memcpy(buf, server->data + offset, size);
+    server->calls++;
+    server->bytes += size;
+    return 0;
+}
+
+/* Test: Names, times and attributes read in place from the header */
+static int test_list_header_in_place() {
+    sevenzip_init();
+    const char* input_dir = "/tmp/test_in_place_input";
+    const char* archive_path = "/tmp/test_in_place.7z";
+    mkdir(input_dir, 0755);
+    char paths[40][256];
+    for (int i = 0; i < 40; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/entry_%02d.txt", input_dir, i);
+        FILE* f = fopen(paths[i], "wb");
+        TEST_ASSERT(f != NULL, "Create input");
+        fprintf(f, "entry %d\n", i);
+        fclose(f);
+        struct utimbuf times = {1500000000 + i, 1500000000 + i * 60};
+        utime(paths[i], &times);
+    }
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipList* list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(archive_path, NULL, &list), "List by path");
+    size_t files = 0;
+    for (size_t k = 0; k < list->count; k++) {
+        const SevenZipEntry* entry = &list->entries[k];
+        if (entry->is_directory) continue;
+        files++;
+        const char* base = strrchr(entry->name, '/');
+        int i = -1;
+        TEST_ASSERT(base && sscanf(base, "/entry_%d.txt", &i) == 1 && i >= 0 && i < 40, "Name");
+        TEST_ASSERT(entry->modified_time == (uint64_t)(1500000000 + i * 60), "Time of its own");
+        TEST_ASSERT(entry->attributes != 0, "Attributes");
+    }
+    TEST_ASSERT(files == 40, "Every file");
+    sevenzip_free_list(list);
+
+    /* A handle keeps the header for its lifetime */
+    SevenZipArchive* archive = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_open(archive_path, NULL, &archive), "Open archive");
+    SevenZipListColumns* columns = NULL;
+    result = sevenzip_archive_list_columns(archive, 10, 5, SEVENZIP_FIELD_ALL, &columns);
+    TEST_ASSERT(result == SEVENZIP_OK && columns->count == 5, "Page of five");
+    for (size_t k = 0; k < 5; k++) {
+        int i = -1;
+        if (columns->is_directory[k]) continue;
+        sscanf(strrchr(columns->names[k], '/'), "/entry_%d.txt", &i);
+        TEST_ASSERT(columns->modified_times[k] == (uint64_t)(1500000000 + i * 60), "Column time");
+    }
+    sevenzip_free_list_columns(columns);
+    sevenzip_close(archive);
+
+    for (int i = 0; i < 40; i++) unlink(paths[i]);
+    rmdir(input_dir);
+    unlink(archive_path);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Column lists carry the fields asked for and nothing else */
+static int test_list_columns() {
+    sevenzip_init();
+    const char* input_dir = "/tmp/test_columns_input";
+    const char* archive_path = "/tmp/test_columns.7z";
+    mkdir(input_dir, 0755);
+    const char* names[] = {"/tmp/test_columns_input/a.txt", "/tmp/test_columns_input/b.txt",
+                           "/tmp/test_columns_input/c.txt"};
+    for (int i = 0; i < 3; i++) {
+        FILE* f = fopen(names[i], "wb");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int k = 0; k <= i * 100; k++) fputs("column\n", f);
+        fclose(f);
+    }
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    SevenZipArchive* archive = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_open(archive_path, NULL, &archive), "Open archive");
+    SevenZipList* list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_list(archive, &list), "List");
+
+    SevenZipListColumns* columns = NULL;
+    result = sevenzip_archive_list_columns(archive, 0, 1000, SEVENZIP_FIELD_NAME | SEVENZIP_FIELD_SIZE,
+                                           &columns);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List names and sizes");
+    TEST_ASSERT(columns->count == list->count, "Every entry");
+    TEST_ASSERT(columns->names && columns->sizes, "Requested columns");
+    TEST_ASSERT(!columns->modified_times && !columns->attributes && !columns->is_directory,
+                "No other columns");
+    for (size_t i = 0; i < list->count; i++) {
+        TEST_ASSERT(strcmp(columns->names[i], list->entries[i].name) == 0, "Name matches");
+        TEST_ASSERT(columns->sizes[i] == list->entries[i].size, "Size matches");
+    }
+    sevenzip_free_list_columns(columns);
+
+    result = sevenzip_archive_list_columns(archive, 1, 2, SEVENZIP_FIELD_ALL & ~SEVENZIP_FIELD_NAME,
+                                           &columns);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List a page without names");
+    TEST_ASSERT(columns->count == 2 && !columns->names, "Page of two, no names");
+    for (size_t k = 0; k < 2; k++) {
+        const SevenZipEntry* entry = &list->entries[1 + k];
+        TEST_ASSERT(columns->modified_times[k] == entry->modified_time &&
+                    columns->attributes[k] == entry->attributes &&
+                    columns->is_directory[k] == entry->is_directory, "Fields match");
+    }
+    sevenzip_free_list_columns(columns);
+
+    result = sevenzip_archive_list_columns(archive, 1000, 10, SEVENZIP_FIELD_ALL, &columns);
+    TEST_ASSERT(result == SEVENZIP_OK && columns->count == 0, "Empty past the end");
+    sevenzip_free_list_columns(columns);
+
+    sevenzip_free_list(list);
+    sevenzip_close(archive);
+    for (int i = 0; i < 3; i++) unlink(names[i]);
+    rmdir(input_dir);
+    unlink(archive_path);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Archive read through ranged requests */
+static int test_open_range() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_range_input";
+    const char* archive_path = "/tmp/test_range.7z";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    const size_t file_size = 3 << 20;
+    unsigned char* content = (unsigned char*)malloc(file_size);
+    TEST_ASSERT(content != NULL, "Allocate content");
+    for (int i = 0; i < 3; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/f%d.bin", input_dir, i);
+        FILE* f = fopen(path, "wb");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            free(content);
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (size_t k = 0; k < file_size; k++) content[k] = (unsigned char)((k * 2654435761u >> 13) + i);
+        fwrite(content, 1, file_size, f);
+        fclose(f);
+    }
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.solid = 0;
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_STORE,
+                                                            &stream_options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    FILE* f = fopen(archive_path, "rb");
+    TEST_ASSERT(f != NULL, "Open archive file");
+    fseek(f, 0, SEEK_END);
+    long archive_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char* data = (unsigned char*)malloc((size_t)archive_size);
+    TEST_ASSERT(data != NULL && fread(data, 1, (size_t)archive_size, f) == (size_t)archive_size,
+                "Read archive file");
+    fclose(f);
+
+    RangeServer server = {data, (size_t)archive_size, 0, 0, 0};
+    SevenZipRangeReader reader = {range_server_read, (uint64_t)archive_size, &server};
+    SevenZipArchive* archive = NULL;
+    result = sevenzip_open_range(&reader, NULL, &archive);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Open through ranges");
+    TEST_ASSERT(server.calls <= 2, "Open costs the first block and the header's");
+    SevenZipList* list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_list(archive, &list), "List");
+    int opened_calls = server.calls;
+    TEST_ASSERT(list->count >= 3, "Every file listed");
+    sevenzip_free_list(list);
+    TEST_ASSERT_EQUALS(opened_calls, server.calls, "Listing reads nothing more");
+
+    /* A whole file, read on sequentially: a few growing requests; the
+       stored folder holds every file, so it is not decoded whole */
+    sevenzip_archive_set_folder_cache(archive, 0);
+    SevenZipVfsStat st;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_stat(archive, "test_range_input/f2.bin", &st),
+                       "Stat last file");
+    unsigned char* out = (unsigned char*)malloc(file_size);
+    TEST_ASSERT(out != NULL, "Allocate output");
+    size_t done = 0;
+    while (done < file_size) {
+        size_t size = 65536;
+        result = sevenzip_archive_pread(archive, st.entry_index, done, out + done, &size);
+        TEST_ASSERT(result == SEVENZIP_OK && size > 0, "Read a window");
+        done += size;
+    }
+    for (size_t k = 0; k < file_size; k++) content[k] = (unsigned char)((k * 2654435761u >> 13) + 2);
+    TEST_ASSERT(memcmp(out, content, file_size) == 0, "Content matches");
+    TEST_ASSERT(server.bytes < (uint64_t)archive_size, "Other files are not fetched");
+    TEST_ASSERT(server.calls - opened_calls <= 4, "Reads are coalesced");
+
+    sevenzip_close(archive);
+
+    /* Failed requests surface as errors */
+    server.fail = 1;
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_ARCHIVE, sevenzip_open_range(&reader, NULL, &archive),
+                       "Read error reported");
+    RangeServer broken = {data, 100, 0, 0, 0};
+    SevenZipRangeReader short_reader = {range_server_read, 100, &broken};
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_ARCHIVE, sevenzip_open_range(&short_reader, NULL, &archive),
+                       "Truncated archive rejected");
+
+    free(out);
+    free(data);
+    free(content);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* A pipe: the archive handed out in short, uneven reads, never sought */
+typedef struct {
+    FILE* file;
+    size_t step;
+    uint64_t bytes;
+} PipeReader;
+
+static int pipe_read(void* buf, size_t* size, void* user_data) {
+    PipeReader* pipe = (PipeReader*)user_data;
+    size_t want = *size < pipe->step ? *size : pipe->step;
+    pipe->step = pipe->step % 7919 + 1013;
+    *size = fread(buf, 1, want, pipe->file);
+    pipe->bytes += *size;
+    return ferror(pipe->file) ? -1 : 0;
+}
+
+/* Test: A streamable archive extracts front to back from a read callback */
+static int test_extract_from_stream() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_fromstream_input";
+    const char* archive_path = "/tmp/test_fromstream.7z";
+    const char* plain_path = "/tmp/test_fromstream_plain.7z";
+    const char* output_dir = "/tmp/test_fromstream_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/sub", input_dir);
+    mkdir(path, 0755);
+    for (int i = 0; i < 5; i++) {
+        snprintf(path, sizeof(path), "%s/%sf%d.txt", input_dir, i % 2 ? "sub/" : "", i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input file");
+        for (int line = 0; line < 200 * (i + 1); line++) fprintf(f, "file %d line %d\n", i, line);
+        fclose(f);
+    }
+    snprintf(path, sizeof(path), "%s/empty.txt", input_dir);
+    FILE* f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create empty file");
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/big.bin", input_dir);
+    f = fopen(path, "wb");
+    TEST_ASSERT(f != NULL, "Create large file");
+    for (size_t i = 0; i < 3 * 1024 * 1024; i++) fputc((int)((i * 7) ^ (i >> 11)) & 0xFF, f);
+    fclose(f);
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.solid_block_files = 2;
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(plain_path, inputs, SEVENZIP_LEVEL_FASTEST,
+                                                            &stream_options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create plain archive");
+
+    SevenZipCompressionLevel levels[] = {SEVENZIP_LEVEL_FASTEST, SEVENZIP_LEVEL_STORE};
+    for (int l = 0; l < 2; l++) {
+        stream_options.streamable = 1;
+        result = sevenzip_create_7z_streaming(archive_path, inputs, levels[l], &stream_options,
+                                              NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create streamable archive");
+
+        /* Still a plain 7z archive to the other readers */
+        SevenZipList* list = NULL;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(archive_path, NULL, &list), "List archive");
+        TEST_ASSERT(list->count == 9, "All entries listed");
+        sevenzip_free_list(list);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_path, NULL, NULL, NULL), "Test archive");
+
+        for (int threads = 1; threads <= 2; threads++) {
+            SevenZipExtractOptions options;
+            sevenzip_extract_options_init(&options);
+            options.num_threads = threads;
+            options.writer_threads = threads - 1;
+            PipeReader pipe = { fopen(archive_path, "rb"), 1, 0 };
+            TEST_ASSERT(pipe.file != NULL, "Open archive");
+            remove_dir_recursive(output_dir);
+            result = sevenzip_extract_from_stream(pipe_read, output_dir, &options, NULL, &pipe);
+            fclose(pipe.file);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract from stream");
+
+            struct stat st;
+            TEST_ASSERT(stat(archive_path, &st) == 0 && pipe.bytes == (uint64_t)st.st_size,
+                        "Archive read once, to its end");
+            for (int i = 0; i < 5; i++) {
+                char source[512];
+                snprintf(source, sizeof(source), "%s/%sf%d.txt", input_dir, i % 2 ? "sub/" : "", i);
+                snprintf(path, sizeof(path), "%s/test_fromstream_input/%sf%d.txt", output_dir,
+                         i % 2 ? "sub/" : "", i);
+                char* expected = read_file_content(source);
+                char* extracted = read_file_content(path);
+                TEST_ASSERT(expected && extracted && strcmp(expected, extracted) == 0, "File matches");
+                free(expected);
+                free(extracted);
+            }
+            snprintf(path, sizeof(path), "%s/test_fromstream_input/empty.txt", output_dir);
+            TEST_ASSERT(stat(path, &st) == 0 && st.st_size == 0, "Empty file written");
+            snprintf(path, sizeof(path), "%s/test_fromstream_input/big.bin", output_dir);
+            FILE* big = fopen(path, "rb");
+            TEST_ASSERT(big != NULL, "Large file written");
+            size_t mismatches = 0;
+            size_t count = 0;
+            for (int c; (c = fgetc(big)) != EOF; count++) {
+                if (c != ((int)((count * 7) ^ (count >> 11)) & 0xFF)) mismatches++;
+            }
+            fclose(big);
+            TEST_ASSERT(count == 3 * 1024 * 1024 && mismatches == 0, "Large file matches");
+        }
+    }
+
+    /* An archive without the front region cannot be read from a stream */
+    PipeReader pipe = { fopen(plain_path, "rb"), 4096, 0 };
+    TEST_ASSERT(pipe.file != NULL, "Open plain archive");
+    result = sevenzip_extract_from_stream(pipe_read, output_dir, NULL, NULL, &pipe);
+    fclose(pipe.file);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_ARCHIVE, result, "Plain archive rejected");
+
+    /* A region too small leaves a complete archive that is not streamable */
+    stream_options.streamable_reserve = 64;
+    result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FASTEST,
+                                          &stream_options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_COMPRESS, result, "Header over the reserve");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_path, NULL, NULL, NULL), "Archive complete");
+
+    unlink(archive_path);
+    unlink(plain_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Results seen by the batch callback, by archive index */
+typedef struct {
+    int calls;
+    int seen[8];
+    SevenZipErrorCode results[8];
+    size_t entries[8];
+    uint64_t tested[8];
+    int stop_after;                  /* Calls before the callback stops the batch (0 = never) */
+} BatchSeen;
+
+static int batch_collect(const SevenZipArchiveBatchResult* r, void* user_data) {
+    BatchSeen* seen = (BatchSeen*)user_data;
+    seen->calls++;
+    seen->seen[r->index]++;
+    seen->results[r->index] = r->result;
+    seen->entries[r->index] = r->list ? r->list->count : 0;
+    seen->tested[r->index] = r->tested_bytes;
+    return seen->stop_after && seen->calls >= seen->stop_after;
+}
+
+static int test_archive_batch() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_batch_input";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    char path[512];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/f%d.txt", input_dir, i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input file");
+        for (int line = 0; line < 2000; line++) fprintf(f, "file %d line %d\n", i, line);
+        fclose(f);
+    }
+
+    /* Four good archives, one with damaged packed data, one missing */
+    char paths[6][64];
+    const char* archive_paths[6];
+    const char* inputs[] = {input_dir, NULL};
+    for (int a = 0; a < 6; a++) {
+        snprintf(paths[a], sizeof(paths[a]), "/tmp/test_batch_%d.7z", a);
+        archive_paths[a] = paths[a];
+        unlink(paths[a]);
+        if (a == 5) continue;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(
+            paths[a], inputs, a % 2 ? SEVENZIP_LEVEL_STORE : SEVENZIP_LEVEL_FASTEST, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    }
+    FILE* damaged = fopen(paths[2], "r+b");
+    TEST_ASSERT(damaged != NULL, "Open archive to damage");
+    fseek(damaged, 200, SEEK_SET);
+    int c = fgetc(damaged);
+    fseek(damaged, 200, SEEK_SET);
+    fputc(c ^ 0x55, damaged);
+    fclose(damaged);
+
+    /* Listing only reads headers, so the damaged archive lists */
+    SevenZipArchiveBatchOptions options;
+    sevenzip_archive_batch_options_init(&options);
+    options.num_threads = 3;
+    options.io_depth = 1;
+    BatchSeen seen;
+    memset(&seen, 0, sizeof(seen));
+    SevenZipErrorCode result = sevenzip_archive_batch(archive_paths, 6, &options, batch_collect, &seen);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "Missing archive fails the batch");
+    TEST_ASSERT(seen.calls == 6, "Every archive reported");
+    for (int a = 0; a < 5; a++) {
+        TEST_ASSERT(seen.seen[a] == 1, "Reported once");
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, seen.results[a], "Archive listed");
+        TEST_ASSERT(seen.entries[a] == 4, "Entries listed");
+    }
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, seen.results[5], "Missing archive");
+
+    /* Testing decodes, and finds the damage */
+    options.mode = SEVENZIP_ARCHIVE_BATCH_TEST;
+    options.io_depth = 0;
+    memset(&seen, 0, sizeof(seen));
+    result = sevenzip_archive_batch(archive_paths, 5, &options, batch_collect, &seen);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_EXTRACT, result, "Damaged archive fails the batch");
+    for (int a = 0; a < 5; a++) {
+        TEST_ASSERT(seen.seen[a] == 1, "Reported once");
+        if (a == 2) continue;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, seen.results[a], "Archive tested");
+        TEST_ASSERT(seen.tested[a] > 0, "Bytes tested");
+    }
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_EXTRACT, seen.results[2], "Damage found");
+
+    /* The callback stops the batch; archives not started are not reported */
+    options.num_threads = 1;
+    memset(&seen, 0, sizeof(seen));
+    seen.stop_after = 2;
+    result = sevenzip_archive_batch(archive_paths, 5, &options, batch_collect, &seen);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_CANCELLED, result, "Batch stopped");
+    TEST_ASSERT(seen.calls == 2, "Stopped after two archives");
+
+    for (int a = 0; a < 6; a++) unlink(paths[a]);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Collects one extracted entry for test_catalog_lookup() */
+typedef struct {
+    char data[256];
+    size_t size;
+} CatalogEntryBuf;
+
+static int catalog_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    (void)entry_index;
+    CatalogEntryBuf* buf = (CatalogEntryBuf*)user_data;
+    if (size > sizeof(buf->data) - 1 - buf->size) return 1;
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    buf->data[buf->size] = '\0';
+    return 0;
+}
+
+static int test_catalog_lookup() {
+    sevenzip_init();
+
+    const char* dirs[] = {"/tmp/test_catalog_input", "/tmp/test_catalog_other"};
+    const char* catalog_path = "/tmp/test_catalog.7zcat";
+    char path[512];
+    for (int d = 0; d < 2; d++) {
+        remove_dir_recursive(dirs[d]);
+        mkdir(dirs[d], 0755);
+        for (int i = 0; i < 3; i++) {
+            snprintf(path, sizeof(path), "%s/%c.txt", dirs[d], 'a' + i + 3 * d);
+            FILE* f = fopen(path, "w");
+            TEST_ASSERT(f != NULL, "Create input file");
+            fprintf(f, "content of %c", 'a' + i + 3 * d);
+            fclose(f);
+        }
+    }
+
+    /* Same tree with a sidecar index and without, then a second tree */
+    const char* archive_paths[] = {"/tmp/test_catalog_0.7z", "/tmp/test_catalog_1.7z",
+                                   "/tmp/test_catalog_2.7z"};
+    for (int a = 0; a < 3; a++) {
+        const char* inputs[] = {dirs[a == 2], NULL};
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.write_index = a == 0;
+        snprintf(path, sizeof(path), "%s.7zidx", archive_paths[a]);
+        unlink(path);
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_paths[a], inputs,
+                                                                SEVENZIP_LEVEL_FASTEST, &options,
+                                                                NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    }
+    snprintf(path, sizeof(path), "%s.7zidx", archive_paths[0]);
+    TEST_ASSERT(file_exists(path), "Sidecar written");
+
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_catalog_build(archive_paths, 3, catalog_path),
+                       "Build catalog");
+    SevenZipCatalog* catalog = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_catalog_open(catalog_path, &catalog), "Open catalog");
+
+    /* A path in two archives: one from the sidecar, one from the header */
+    SevenZipCatalogHit hits[4];
+    size_t count = 0;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK,
+                       sevenzip_catalog_lookup(catalog, "test_catalog_input/b.txt", hits, 4, &count),
+                       "Look up shared path");
+    TEST_ASSERT(count == 2, "Found in both archives");
+    TEST_ASSERT(hits[0].archive_index == 0 && hits[1].archive_index == 1, "Hits in archive order");
+    TEST_ASSERT(strcmp(hits[1].archive_path, archive_paths[1]) == 0, "Archive path kept");
+    TEST_ASSERT(hits[0].entry_index == hits[1].entry_index && hits[0].folder_index == hits[1].folder_index &&
+                hits[0].pack_offset == hits[1].pack_offset && hits[0].size == hits[1].size,
+                "Sidecar and header agree");
+    TEST_ASSERT(hits[0].folder_index != SEVENZIP_CATALOG_NO_FOLDER && !hits[0].is_directory,
+                "File with data");
+
+    /* The hit feeds a single-member extraction */
+    for (size_t h = 0; h < count; h++) {
+        SevenZipArchive* archive = NULL;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_open(hits[h].archive_path, NULL, &archive), "Open hit");
+        CatalogEntryBuf buf;
+        memset(&buf, 0, sizeof(buf));
+        SevenZipExtractSink sink;
+        memset(&sink, 0, sizeof(sink));
+        sink.write = catalog_write;
+        sink.user_data = &buf;
+        SevenZipErrorCode result = sevenzip_archive_extract_entry(archive, hits[h].entry_index, &sink);
+        sevenzip_close(archive);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract hit");
+        TEST_ASSERT(strcmp(buf.data, "content of b") == 0, "Hit is the entry");
+    }
+
+    TEST_ASSERT_EQUALS(SEVENZIP_OK,
+                       sevenzip_catalog_lookup(catalog, "test_catalog_other/f.txt", hits, 1, &count),
+                       "Look up single path");
+    TEST_ASSERT(count == 1 && hits[0].archive_index == 2, "Found in the other archive");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK,
+                       sevenzip_catalog_lookup(catalog, "test_catalog_input", hits, 1, &count),
+                       "Look up directory");
+    TEST_ASSERT(count == 2 && hits[0].is_directory && hits[0].folder_index == SEVENZIP_CATALOG_NO_FOLDER,
+                "Directory found, only the first returned");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK,
+                       sevenzip_catalog_lookup(catalog, "test_catalog_input/z.txt", hits, 4, &count),
+                       "Look up missing path");
+    TEST_ASSERT(count == 0, "Missing path not found");
+    sevenzip_catalog_close(catalog);
+
+    /* A truncated catalog is refused */
+    TEST_ASSERT(truncate(catalog_path, 100) == 0, "Truncate catalog");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_ARCHIVE, sevenzip_catalog_open(catalog_path, &catalog),
+                       "Truncated catalog refused");
+
+    unlink(catalog_path);
+    for (int a = 0; a < 3; a++) {
+        unlink(archive_paths[a]);
+        snprintf(path, sizeof(path), "%s.7zidx", archive_paths[a]);
+        unlink(path);
+    }
+    remove_dir_recursive(dirs[0]);
+    remove_dir_recursive(dirs[1]);
+    sevenzip_cleanup();
+    return 1;
+}
+
 /* Main test runner */
-int main(int argc, char** argv) {
+/* Test: 7zAES folders decoded with the password, whole and from the middle */
+static unsigned char encrypted_byte(int file, size_t i) {
+    /* Mostly incompressible, so the pack streams span many decryption slots */
+    return (unsigned char)(((i + (size_t)file) * 2654435761u) >> 11);
+}
+
+static int encrypted_matches(const char* path, int file, size_t size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t i = 0;
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        if (i >= size || (unsigned char)c != encrypted_byte(file, i)) break;
+        i++;
+    }
+    fclose(f);
+    return c == EOF && i == size;
+}
+
+static int test_extract_encrypted() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_aes_input";
+    const char* archive_path = "/tmp/test_aes.7z";
+    const char* output_dir = "/tmp/test_aes_output";
+    const size_t sizes[3] = {3 << 20, 100000, 17};
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    char path[512];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/f%d.bin", input_dir, i);
+        FILE* f = fopen(path, "wb");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (size_t k = 0; k < sizes[i]; k++) fputc(encrypted_byte(i, k), f);
+        fclose(f);
+    }
+
+    /* Non-solid LZMA2, solid LZMA2 behind BCJ, and stored */
+    const char* inputs[] = {input_dir, NULL};
+    for (int run = 0; run < 3; run++) {
+        SevenZipStreamOptions options;
+        sevenzip_stream_options_init(&options);
+        options.num_threads = 2;
+        options.solid = run == 1;
+        options.filter = run == 1 ? SEVENZIP_FILTER_BCJ : SEVENZIP_FILTER_NONE;
+        options.password = "restore";
+        unlink(archive_path);
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(
+            archive_path, inputs, run == 2 ? SEVENZIP_LEVEL_STORE : SEVENZIP_LEVEL_FASTEST,
+            &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create encrypted archive");
+
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_path, "restore", NULL, NULL),
+                           "Test with the password");
+        TEST_ASSERT(sevenzip_test_archive(archive_path, "wrong", NULL, NULL) != SEVENZIP_OK,
+                    "Wrong password fails");
+        TEST_ASSERT(sevenzip_test_archive(archive_path, NULL, NULL, NULL) != SEVENZIP_OK,
+                    "No password fails");
+
+        SevenZipExtractOptions extract_options;
+        sevenzip_extract_options_init(&extract_options);
+        extract_options.num_threads = 2;
+        extract_options.lzma2_threads = 2;
+        remove_dir_recursive(output_dir);
+        result = sevenzip_extract_with_options(archive_path, output_dir, "restore", &extract_options,
+                                               NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract with the password");
+        for (int i = 0; i < 3; i++) {
+            snprintf(path, sizeof(path), "%s/test_aes_input/f%d.bin", output_dir, i);
+            TEST_ASSERT(encrypted_matches(path, i, sizes[i]), "Decrypted file matches");
+        }
+
+        /* Reads from the middle seek in the ciphertext */
+        SevenZipArchive* archive = NULL;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_open(archive_path, "restore", &archive), "Open");
+        SevenZipList* list = NULL;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_list(archive, &list), "List");
+        uint32_t big = (uint32_t)-1;
+        for (size_t e = 0; e < list->count; e++) {
+            if (strstr(list->entries[e].name, "f0.bin")) big = (uint32_t)e;
+        }
+        sevenzip_free_list(list);
+        TEST_ASSERT(big != (uint32_t)-1, "Large file listed");
+        unsigned char buf[4096];
+        const uint64_t offsets[3] = {(3 << 20) - 5000, 1000003, 7};
+        for (int k = 0; k < 3; k++) {
+            size_t size = sizeof(buf);
+            result = sevenzip_archive_pread(archive, big, offsets[k], buf, &size);
+            TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Read from the middle");
+            TEST_ASSERT(size == sizeof(buf), "Full read");
+            int same = 1;
+            for (size_t b = 0; b < size; b++) {
+                if (buf[b] != encrypted_byte(0, (size_t)offsets[k] + b)) same = 0;
+            }
+            TEST_ASSERT(same, "Bytes from the middle match");
+        }
+        sevenzip_close(archive);
+    }
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Volumes handed back by consume_volumes, and the bytes read by then */
+typedef struct {
+    int count;
+    int in_order;
+    uint64_t read;
+    uint64_t read_at_first;
+    uint64_t total;
+} ConsumedVolumes;
+
+static void consume_progress(uint64_t processed, uint64_t total, uint64_t file_bytes,
+                             uint64_t file_total, const char* name, void* user_data) {
+    ConsumedVolumes* c = (ConsumedVolumes*)user_data;
+    (void)file_bytes; (void)file_total; (void)name;
+    c->read = processed;
+    c->total = total;
+}
+
+static void consume_volume(uint32_t index, const char* path, uint64_t size,
+                           const uint8_t* digest, void* user_data) {
+    ConsumedVolumes* c = (ConsumedVolumes*)user_data;
+    (void)size;
+    if (c->count == 0) c->read_at_first = c->read;
+    if (index != (uint32_t)c->count || digest != NULL) c->in_order = 0;
+    c->count++;
+    unlink(path);
+}
+
+/* Test: Split volumes given up as extraction moves past them */
+static int test_extract_consume_volumes() {
+    sevenzip_init();
+
+    const char* input_file = "/tmp/test_consume.bin";
+    const char* archive_path = "/tmp/test_consume.7z";
+    const char* output_dir = "/tmp/test_consume_output";
+
+    FILE* f = fopen(input_file, "wb");
+    if (!f) {
+        printf("SKIP (cannot create temp file) ");
+        sevenzip_cleanup();
+        return 1;
+    }
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < 512 * 1024; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        fputc((int)(x & 0x0F) + 'a', f);
+    }
+    fclose(f);
+
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.split_size = 64 * 1024;
+    const char* inputs[] = {input_file, NULL};
+    char path[512];
+    char* original = read_file_content(input_file);
+    TEST_ASSERT(original != NULL, "Read the input");
+
+    for (int pass = 0; pass < 2; pass++) {
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                                &stream_options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create split archive");
+        int volumes = 0;
+        for (;;) {
+            snprintf(path, sizeof(path), "%s.%03d", archive_path, volumes + 1);
+            if (access(path, F_OK) != 0) break;
+            volumes++;
+        }
+        TEST_ASSERT(volumes > 2, "Several volumes");
+
+        /* The first pass hands the volumes back, the second deletes them */
+        ConsumedVolumes consumed = {0, 1, 0, 0, 0};
+        SevenZipExtractOptions options;
+        sevenzip_extract_options_init(&options);
+        options.consume_volumes = 1;
+        if (pass == 0) {
+            options.volume_consumed = consume_volume;
+            options.volume_consumed_user_data = &consumed;
+        }
+        remove_dir_recursive(output_dir);
+        snprintf(path, sizeof(path), "%s.001", archive_path);
+        result = sevenzip_extract_streaming_with_options(path, output_dir, NULL, &options,
+                                                         consume_progress, &consumed);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extraction consuming the volumes succeeds");
+        if (pass == 0) {
+            TEST_ASSERT(consumed.count == volumes && consumed.in_order, "Every volume handed back in order");
+            TEST_ASSERT(consumed.read_at_first < consumed.total, "The first volume goes before the end");
+        }
+        for (int i = 1; i <= volumes; i++) {
+            snprintf(path, sizeof(path), "%s.%03d", archive_path, i);
+            TEST_ASSERT(access(path, F_OK) != 0, "Volume is gone");
+        }
+
+        snprintf(path, sizeof(path), "%s/test_consume.bin", output_dir);
+        char* extracted = read_file_content(path);
+        TEST_ASSERT(extracted != NULL && strcmp(original, extracted) == 0, "Content matches original");
+        free(extracted);
+    }
+    free(original);
+
+    unlink(input_file);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: A failed streaming extraction resumed from its checkpoint */
+static int test_extract_resume_checkpoint() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_xckpt_input";
+    const char* archive_path = "/tmp/test_xckpt.7z";
+    const char* output_dir = "/tmp/test_xckpt_output";
+    const char* checkpoint_path = "/tmp/test_xckpt.ckpt";
+    const char* names[3] = {"a.txt", "b.txt", "c.txt"};
+    const char* contents[3] = {"alpha file for the checkpoint test\n",
+                               "bravo file for the checkpoint test\n",
+                               "charlie file for the checkpoint test\n"};
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    unlink(checkpoint_path);
+    mkdir(input_dir, 0755);
+    char path[512];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        fputs(contents[i], f);
+        fclose(f);
+    }
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_STORE,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create stored archive");
+
+    /* Stored data is the files' bytes: find where each one is */
+    char* archive = read_file_content(archive_path);
+    TEST_ASSERT(archive != NULL, "Read the archive");
+    long offsets[3];
+    int first = 0, last = 0;
+    for (int i = 0; i < 3; i++) {
+        const char* at = strstr(archive + 32, contents[i]);
+        TEST_ASSERT(at != NULL, "Stored file found in the archive");
+        offsets[i] = (long)(at - archive);
+        if (offsets[i] < offsets[first]) first = i;
+        if (offsets[i] > offsets[last]) last = i;
+    }
+    free(archive);
+
+    /* The last file fails its CRC, as if its volume source went away */
+    FILE* f = fopen(archive_path, "r+b");
+    TEST_ASSERT(f != NULL, "Reopen archive");
+    fseek(f, offsets[last], SEEK_SET);
+    fputc(contents[last][0] ^ 0x20, f);
+    fclose(f);
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.num_threads = 1;
+    options.checkpoint_path = checkpoint_path;
+    result = sevenzip_extract_streaming_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT(result != SEVENZIP_OK, "Corrupted file fails the run");
+    TEST_ASSERT(access(checkpoint_path, F_OK) == 0, "Failed run leaves a checkpoint");
+
+    /* Files the checkpoint records are not written again */
+    snprintf(path, sizeof(path), "%s/test_xckpt_input/%s", output_dir, names[first]);
+    TEST_ASSERT(access(path, F_OK) == 0, "File before the failure written");
+    unlink(path);
+    f = fopen(archive_path, "r+b");
+    TEST_ASSERT(f != NULL, "Reopen archive");
+    fseek(f, offsets[last], SEEK_SET);
+    fputc(contents[last][0], f);
+    fclose(f);
+    result = sevenzip_extract_streaming_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Resumed run succeeds");
+    TEST_ASSERT(access(path, F_OK) != 0, "Checkpointed file skipped");
+    TEST_ASSERT(access(checkpoint_path, F_OK) != 0, "Checkpoint removed once complete");
+    for (int i = 0; i < 3; i++) {
+        if (i == first) continue;
+        snprintf(path, sizeof(path), "%s/test_xckpt_input/%s", output_dir, names[i]);
+        char* extracted = read_file_content(path);
+        TEST_ASSERT(extracted != NULL && strcmp(extracted, contents[i]) == 0, "Content matches original");
+        free(extracted);
+    }
+
+    /* A checkpoint that is not this archive's is refused */
+    f = fopen(checkpoint_path, "wb");
+    TEST_ASSERT(f != NULL, "Write a foreign checkpoint");
+    fputs("not a checkpoint", f);
+    fclose(f);
+    result = sevenzip_extract_streaming_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "Foreign checkpoint refused");
+
+    unlink(checkpoint_path);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+static int tar_collect(const void* data, size_t size, void* user_data) {
+    return fwrite(data, 1, size, (FILE*)user_data) == size ? 0 : 1;
+}
+
+static int tar_stop(const void* data, size_t size, void* user_data) {
+    (void)data;
+    (void)size;
+    (void)user_data;
+    return 1;
+}
+
+/* Size of the tar member `want` (suffix of its path), its data at *data; -1 if absent */
+static long tar_find(const unsigned char* tar, size_t size, const char* want, const unsigned char** data,
+                     int* bad_checksum) {
+    char pax_path[512] = "";
+    for (size_t pos = 0; pos + 512 <= size;) {
+        const unsigned char* h = tar + pos;
+        if (h[0] == 0) break;
+        unsigned sum = 0;
+        for (int i = 0; i < 512; i++) sum += (i >= 148 && i < 156) ? ' ' : h[i];
+        if (sum != (unsigned)strtoul((const char*)h + 148, NULL, 8)) *bad_checksum = 1;
+        long member = strtol((const char*)h + 124, NULL, 8);
+        char name[512];
+        if (h[345]) snprintf(name, sizeof(name), "%.155s/%.100s", h + 345, h);
+        else snprintf(name, sizeof(name), "%.100s", h);
+        if (h[156] == 'x') {
+            const char* rec = strstr((const char*)h + 512, " path=");
+            if (rec) {
+                const char* end = strchr(rec, '\n');
+                snprintf(pax_path, sizeof(pax_path), "%.*s", (int)(end - rec - 6), rec + 6);
+            }
+        } else {
+            if (pax_path[0]) snprintf(name, sizeof(name), "%s", pax_path);
+            pax_path[0] = '\0';
+            size_t len = strlen(name), want_len = strlen(want);
+            if (len >= want_len && strcmp(name + len - want_len, want) == 0) {
+                *data = h + 512;
+                return member;
+            }
+        }
+        pos += 512 + ((size_t)member + 511) / 512 * 512;
+    }
+    return -1;
+}
+
+static int test_export_tar() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_tar_input";
+    const char* archive_path = "/tmp/test_tar.7z";
+    const char* tar_path = "/tmp/test_tar.tar";
+    char long_dir[160];
+    char long_name[170];
+    memset(long_dir, 'd', 120);
+    long_dir[120] = '\0';
+    memset(long_name, 'n', 150);
+    strcpy(long_name + 150, ".txt");
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", input_dir, long_dir);
+    mkdir(path, 0755);
+
+    const char* text = "tar export: one record per entry\n";
+    snprintf(path, sizeof(path), "%s/a.txt", input_dir);
+    FILE* f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create input file");
+    for (int i = 0; i < 1000; i++) fputs(text, f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/%s/%s", input_dir, long_dir, long_name);
+    f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create long-named file");
+    fputs(text, f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/empty.txt", input_dir);
+    f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create empty file");
+    fclose(f);
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    f = fopen(tar_path, "wb");
+    TEST_ASSERT(f != NULL, "Open tar output");
+    result = sevenzip_export_tar(archive_path, NULL, NULL, tar_collect, f);
+    fclose(f);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Export tar");
+
+    f = fopen(tar_path, "rb");
+    TEST_ASSERT(f != NULL, "Read tar");
+    fseek(f, 0, SEEK_END);
+    long tar_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char* tar = malloc((size_t)tar_size);
+    TEST_ASSERT(tar && fread(tar, 1, (size_t)tar_size, f) == (size_t)tar_size, "Read tar bytes");
+    fclose(f);
+    TEST_ASSERT(tar_size % 512 == 0 && tar_size >= 1024, "Whole blocks");
+    static const unsigned char zeros[1024];
+    TEST_ASSERT(memcmp(tar + tar_size - 1024, zeros, 1024) == 0, "End-of-archive blocks");
+
+    int bad_checksum = 0;
+    const unsigned char* data = NULL;
+    long size = tar_find(tar, (size_t)tar_size, "/a.txt", &data, &bad_checksum);
+    TEST_ASSERT(size == (long)(1000 * strlen(text)), "Member size");
+    TEST_ASSERT(memcmp(data, text, strlen(text)) == 0 &&
+                memcmp(data + size - strlen(text), text, strlen(text)) == 0, "Member content");
+    snprintf(path, sizeof(path), "%s/%s", long_dir, long_name);
+    size = tar_find(tar, (size_t)tar_size, path, &data, &bad_checksum);
+    TEST_ASSERT(size == (long)strlen(text) && memcmp(data, text, strlen(text)) == 0, "Long name via pax");
+    TEST_ASSERT(tar_find(tar, (size_t)tar_size, "/empty.txt", &data, &bad_checksum) == 0, "Empty file");
+    snprintf(path, sizeof(path), "%s/", long_dir);
+    TEST_ASSERT(tar_find(tar, (size_t)tar_size, path, &data, &bad_checksum) == 0, "Directory record");
+    TEST_ASSERT(!bad_checksum, "Header checksums");
+    free(tar);
+
+    result = sevenzip_export_tar(archive_path, NULL, NULL, tar_stop, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_EXTRACT, result, "Callback stops the export");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_export_tar(archive_path, NULL, NULL, NULL, NULL),
+                       "Callback required");
+
+    unlink(tar_path);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+static const SevenZipEntry* find_entry(const SevenZipList* list, const char* name) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->entries[i].name && strcmp(list->entries[i].name, name) == 0) return &list->entries[i];
+    }
+    return NULL;
+}
+
+static int test_transcode_archive() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_transcode_input";
+    const char* source_path = "/tmp/test_transcode_src.7z";
+    const char* archive_path = "/tmp/test_transcode_dst.7z";
+    const char* output_dir = "/tmp/test_transcode_output";
+    const char* text = "transcoded without a scratch directory\n";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+    char path[512];
+    snprintf(path, sizeof(path), "%s/sub", input_dir);
+    mkdir(path, 0755);
+    const char* names[3] = {"big.txt", "sub/small.txt", "empty.txt"};
+    const int repeats[3] = {20000, 3, 0};
+    for (int n = 0; n < 3; n++) {
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[n]);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input file");
+        for (int i = 0; i < repeats[n]; i++) fputs(text, f);
+        fclose(f);
+    }
+    snprintf(path, sizeof(path), "%s/sub/small.txt", input_dir);
+    chmod(path, 0600);
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(source_path, inputs, SEVENZIP_LEVEL_STORE,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create stored source");
+
+    SevenZipStreamOptions options;
+    sevenzip_stream_options_init(&options);
+    result = sevenzip_transcode_archive(source_path, archive_path, NULL, SEVENZIP_LEVEL_FAST, &options,
+                                        NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Transcode archive");
+
+    struct stat src_st, dst_st;
+    TEST_ASSERT(stat(source_path, &src_st) == 0 && stat(archive_path, &dst_st) == 0, "Both archives exist");
+    TEST_ASSERT(dst_st.st_size < src_st.st_size / 10, "Recompressed smaller");
+
+    SevenZipList* src_list = NULL;
+    SevenZipList* dst_list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(source_path, NULL, &src_list), "List source");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(archive_path, NULL, &dst_list), "List result");
+    TEST_ASSERT(src_list->count == dst_list->count, "Same entry count");
+    for (size_t i = 0; i < src_list->count; i++) {
+        const SevenZipEntry* a = &src_list->entries[i];
+        const SevenZipEntry* b = find_entry(dst_list, a->name);
+        TEST_ASSERT(b != NULL, "Entry kept");
+        TEST_ASSERT(a->size == b->size && a->is_directory == b->is_directory, "Size and kind kept");
+        TEST_ASSERT(a->attributes == b->attributes && a->modified_time == b->modified_time,
+                    "Attributes and time kept");
+    }
+    sevenzip_free_list(src_list);
+    sevenzip_free_list(dst_list);
+
+    result = sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract result");
+    for (int n = 0; n < 3; n++) {
+        snprintf(path, sizeof(path), "%s/test_transcode_input/%s", output_dir, names[n]);
+        char* extracted = read_file_content(path);
+        TEST_ASSERT(extracted != NULL, "Extracted file present");
+        TEST_ASSERT(strlen(extracted) == strlen(text) * (size_t)repeats[n] &&
+                    (repeats[n] == 0 || strncmp(extracted, text, strlen(text)) == 0), "Content kept");
+        free(extracted);
+    }
+
+    /* A damaged source fails instead of writing a short archive */
+    char* archive = read_file_content(source_path);
+    TEST_ASSERT(archive != NULL, "Read source");
+    const char* at = strstr(archive + 32, text);
+    TEST_ASSERT(at != NULL, "Stored data found");
+    long offset = (long)(at - archive);
+    free(archive);
+    FILE* f = fopen(source_path, "r+b");
+    TEST_ASSERT(f != NULL, "Reopen source");
+    fseek(f, offset, SEEK_SET);
+    fputc(text[0] ^ 0x20, f);
+    fclose(f);
+    result = sevenzip_transcode_archive(source_path, archive_path, NULL, SEVENZIP_LEVEL_FAST, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_EXTRACT, result, "Damaged source fails");
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM,
+                       sevenzip_transcode_archive(source_path, source_path, NULL, SEVENZIP_LEVEL_FAST,
+                                                  NULL, NULL, NULL), "Source not overwritten");
+
+    unlink(source_path);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: LZMA2 folders rewrapped as .xz decode to the folder's data */
+static int test_remux_to_xz() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_remux_input";
+    const char* archive_path = "/tmp/test_remux.7z";
+    const char* stored_path = "/tmp/test_remux_stored.7z";
+    const char* xz_path = "/tmp/test_remux.xz";
+    const char* output_path = "/tmp/test_remux_output.txt";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    char path[512];
+    snprintf(path, sizeof(path), "%s/data.txt", input_dir);
+    FILE* f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create input file");
+    for (int i = 0; i < 60000; i++) fprintf(f, "line %d of the remuxed folder\n", i * 7919 % 100003);
+    fclose(f);
+    char* original = read_file_content(path);
+    TEST_ASSERT(original != NULL, "Read input");
+
+    const char* inputs[] = {path, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_NORMAL,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    const SevenZipXzCheck checks[4] = {SEVENZIP_XZ_CHECK_CRC64, SEVENZIP_XZ_CHECK_CRC32,
+                                       SEVENZIP_XZ_CHECK_SHA256, SEVENZIP_XZ_CHECK_NONE};
+    for (int c = 0; c < 4; c++) {
+        result = sevenzip_remux_to_xz(archive_path, 0, xz_path, checks[c], NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Remux folder");
+        unlink(output_path);
+        result = sevenzip_decompress_xz(xz_path, output_path, NULL, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Decompress .xz");
+        char* decoded = read_file_content(output_path);
+        TEST_ASSERT(decoded != NULL && strcmp(decoded, original) == 0, "Same data");
+        free(decoded);
+    }
+
+    /* A damaged check fails the xz decoder */
+    struct stat st;
+    TEST_ASSERT(stat(xz_path, &st) == 0, "Output exists");
+    result = sevenzip_remux_to_xz(archive_path, 0, xz_path, SEVENZIP_XZ_CHECK_CRC32, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Remux with CRC32");
+    TEST_ASSERT(stat(xz_path, &st) == 0, "Output exists");
+    f = fopen(xz_path, "r+b");
+    TEST_ASSERT(f != NULL, "Reopen .xz");
+    fseek(f, (long)st.st_size - 12 - 8 - 4, SEEK_SET);  /* Footer, index, check */
+    int b = fgetc(f);
+    fseek(f, (long)st.st_size - 12 - 8 - 4, SEEK_SET);
+    fputc(b ^ 1, f);
+    fclose(f);
+    TEST_ASSERT(sevenzip_decompress_xz(xz_path, output_path, NULL, NULL, NULL) != SEVENZIP_OK,
+                "Damaged check detected");
+
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM,
+                       sevenzip_remux_to_xz(archive_path, 1, xz_path, SEVENZIP_XZ_CHECK_CRC64, NULL, NULL),
+                       "Folder past the last");
+    result = sevenzip_create_7z_streaming(stored_path, inputs, SEVENZIP_LEVEL_STORE, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create stored archive");
+    unlink(xz_path);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_NOT_IMPLEMENTED,
+                       sevenzip_remux_to_xz(stored_path, 0, xz_path, SEVENZIP_XZ_CHECK_CRC64, NULL, NULL),
+                       "Copy folder refused");
+    TEST_ASSERT(stat(xz_path, &st) != 0, "No output left");
+
+    free(original);
+    unlink(archive_path);
+    unlink(stored_path);
+    unlink(output_path);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Requests served by another thread's service come back as the local calls give them */
+#define SERVICE_SOCKET "/tmp/test_service.sock"
+#define SERVICE_THREADS 4
+
+typedef struct {
+    const char* archive_path;
+    uint32_t entry;
+    const char* expected;
+    int failures;
+} ServiceReader;
+
+static void* service_reader(void* arg) {
+    ServiceReader* r = (ServiceReader*)arg;
+    for (int round = 0; round < 20; round++) {
+        const void* data = NULL;
+        size_t size = 0;
+        SevenZipErrorCode err = sevenzip_service_read_entry(SERVICE_SOCKET, r->archive_path, NULL,
+                                                            r->entry, &data, &size);
+        if (err != SEVENZIP_OK || size != strlen(r->expected) || memcmp(data, r->expected, size) != 0) {
+            r->failures++;
+        }
+        sevenzip_service_free_data(data, size);
+    }
+    return NULL;
+}
+
+static int test_archive_service() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_service_input";
+    const char* archive_path = "/tmp/test_service.7z";
+    const char* output_dir = "/tmp/test_service_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    unlink(archive_path);
+    mkdir(input_dir, 0755);
+    const char* names[] = {"a.txt", "b.txt", "empty.txt"};
+    for (int i = 0; i < 3; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        int lines = i == 0 ? 50 : i == 1 ? 20000 : 0;
+        for (int line = 0; line < lines; line++) fprintf(f, "%s line %d\n", names[i], line);
+        fclose(f);
+    }
+
+    SevenZipService* service = NULL;
+    SevenZipErrorCode result = sevenzip_service_start(SERVICE_SOCKET, NULL, &service);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Start service");
+    SevenZipService* second = NULL;
+    result = sevenzip_service_start(SERVICE_SOCKET, NULL, &second);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "A live service keeps its socket");
+
+    const char* inputs[] = {input_dir, NULL};
+    result = sevenzip_service_create(SERVICE_SOCKET, archive_path, inputs, SEVENZIP_LEVEL_FAST, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create through the service");
+
+    SevenZipList* local = NULL;
+    SevenZipList* remote = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(archive_path, NULL, &local), "List locally");
+    result = sevenzip_service_list(SERVICE_SOCKET, archive_path, NULL, &remote);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "List through the service");
+    TEST_ASSERT_EQUALS((int)local->count, (int)remote->count, "Same entry count");
+    for (size_t i = 0; i < local->count; i++) {
+        TEST_ASSERT(strcmp(local->entries[i].name, remote->entries[i].name) == 0 &&
+                    local->entries[i].size == remote->entries[i].size &&
+                    local->entries[i].modified_time == remote->entries[i].modified_time &&
+                    local->entries[i].is_directory == remote->entries[i].is_directory, "Same entry");
+    }
+
+    /* Each file from shared memory, several clients at once on the archive the service keeps */
+    static ServiceReader readers[SERVICE_THREADS];
+    char* contents[3] = {NULL, NULL, NULL};
+    int readers_used = 0;
+    for (size_t i = 0; i < remote->count; i++) {
+        const void* data = NULL;
+        size_t size = 0;
+        result = sevenzip_service_read_entry(SERVICE_SOCKET, archive_path, NULL, (uint32_t)i, &data, &size);
+        if (remote->entries[i].is_directory) {
+            TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, result, "A directory has no data");
+            continue;
+        }
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Read through the service");
+        for (int n = 0; n < 3; n++) {
+            if (!strstr(remote->entries[i].name, names[n])) continue;
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s", input_dir, names[n]);
+            contents[n] = read_file_content(path);
+            TEST_ASSERT(contents[n] != NULL && size == strlen(contents[n]) &&
+                        (size == 0 ? data == NULL : memcmp(data, contents[n], size) == 0), "Same data");
+            if (size > 0 && readers_used < SERVICE_THREADS) {
+                readers[readers_used].archive_path = archive_path;
+                readers[readers_used].entry = (uint32_t)i;
+                readers[readers_used].expected = contents[n];
+                readers[readers_used].failures = 0;
+                readers_used++;
+            }
+        }
+        sevenzip_service_free_data(data, size);
+    }
+    TEST_ASSERT_EQUALS(2, readers_used, "Both files with data read");
+    while (readers_used < SERVICE_THREADS) {
+        readers[readers_used] = readers[readers_used % 2];
+        readers_used++;
+    }
+    pthread_t threads[SERVICE_THREADS];
+    for (int t = 0; t < SERVICE_THREADS; t++) {
+        TEST_ASSERT(pthread_create(&threads[t], NULL, service_reader, &readers[t]) == 0, "Start client");
+    }
+    int failures = 0;
+    for (int t = 0; t < SERVICE_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        failures += readers[t].failures;
+    }
+    TEST_ASSERT_EQUALS(0, failures, "Every concurrent read matches");
+
+    result = sevenzip_service_extract(SERVICE_SOCKET, archive_path, output_dir, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract through the service");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/test_service_input/b.txt", output_dir);
+    char* extracted = read_file_content(path);
+    TEST_ASSERT(extracted != NULL && contents[1] != NULL && strcmp(extracted, contents[1]) == 0,
+                "Extracted file matches");
+    free(extracted);
+
+    /* An archive rewritten under the same name is opened again */
+    snprintf(path, sizeof(path), "%s/c.txt", input_dir);
+    FILE* f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Add a file");
+    fputs("new file\n", f);
+    fclose(f);
+    unlink(archive_path);
+    result = sevenzip_service_create(SERVICE_SOCKET, archive_path, inputs, SEVENZIP_LEVEL_FAST, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create again");
+    SevenZipList* changed = NULL;
+    result = sevenzip_service_list(SERVICE_SOCKET, archive_path, NULL, &changed);
+    TEST_ASSERT(result == SEVENZIP_OK && changed->count == remote->count + 1, "Changed archive listed anew");
+    sevenzip_free_list(changed);
+
+    result = sevenzip_service_list(SERVICE_SOCKET, "/tmp/test_service_missing.7z", NULL, &changed);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "Missing archive");
+
+    sevenzip_service_stop(service);
+    TEST_ASSERT(access(SERVICE_SOCKET, F_OK) != 0, "Socket removed");
+    result = sevenzip_service_list(SERVICE_SOCKET, archive_path, NULL, &changed);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "No service after stop");
+
+    for (int n = 0; n < 3; n++) free(contents[n]);
+    sevenzip_free_list(local);
+    sevenzip_free_list(remote);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Lists an archive on a thread that exits before the snapshot */
+static void* metrics_list_thread(void* arg) {
+    SevenZipList* list = NULL;
+    if (sevenzip_list((const char*)arg, NULL, &list) == SEVENZIP_OK) sevenzip_free_list(list);
+    return NULL;
+}
+
+static int metrics_count_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    (void)entry_index;
+    (void)data;
+    *(uint64_t*)user_data += size;
+    return 0;
+}
+
+static int test_metrics_snapshot() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_metrics_input";
+    const char* archive_path = "/tmp/test_metrics.7z";
+    const char* output_dir = "/tmp/test_metrics_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+    uint64_t input_bytes = 0;
+    for (int i = 0; i < 2; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/file%d.txt", input_dir, i);
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            printf("SKIP (cannot create temp file) ");
+            sevenzip_cleanup();
+            return 1;
+        }
+        for (int line = 0; line < 4000; line++) {
+            input_bytes += (uint64_t)fprintf(f, "file %d line %d\n", i, line);
+        }
+        fclose(f);
+    }
+
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM, sevenzip_metrics_snapshot(NULL), "NULL rejected");
+    SevenZipMetrics before, after;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_metrics_snapshot(&before), "Snapshot before");
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FASTEST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+    struct stat st;
+    TEST_ASSERT(stat(archive_path, &st) == 0, "Archive written");
+
+    result = sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract");
+    SevenZipJob* job = NULL;
+    result = sevenzip_submit_extract(archive_path, output_dir, NULL, NULL, NULL, NULL, NULL, &job);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Submit extract");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_job_wait(job), "Extract job");
+    sevenzip_job_free(job);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_test_archive(archive_path, NULL, NULL, NULL), "Test archive");
+    SevenZipList* list = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, sevenzip_list("/tmp/test_metrics_missing.7z", NULL, &list),
+                       "List a missing archive");
+
+    pthread_t thread;
+    TEST_ASSERT(pthread_create(&thread, NULL, metrics_list_thread, (void*)archive_path) == 0, "Start thread");
+    pthread_join(thread, NULL);
+
+    /* The second read of the folder comes from the handle's cache */
+    SevenZipArchive* archive = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_open(archive_path, NULL, &archive), "Open archive");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_list(archive, &list), "List handle");
+    uint32_t file_index = 0;
+    while (file_index < list->count && list->entries[file_index].is_directory) file_index++;
+    TEST_ASSERT(file_index < list->count, "A file entry");
+    uint64_t file_size = list->entries[file_index].size;
+    sevenzip_free_list(list);
+    uint64_t read_bytes = 0;
+    SevenZipExtractSink sink = {NULL, metrics_count_write, NULL, &read_bytes};
+    for (int round = 0; round < 2; round++) {
+        result = sevenzip_archive_extract_entry(archive, file_index, &sink);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Read entry");
+    }
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_metrics_snapshot(&after), "Snapshot after");
+    TEST_ASSERT(after.bytes_allocated > 0, "Open archive holds memory");
+    sevenzip_close(archive);
+
+    const SevenZipOpMetrics* create = &after.ops[SEVENZIP_METRIC_CREATE];
+    const SevenZipOpMetrics* extract = &after.ops[SEVENZIP_METRIC_EXTRACT];
+    const SevenZipOpMetrics* test = &after.ops[SEVENZIP_METRIC_TEST];
+    const SevenZipOpMetrics* listed = &after.ops[SEVENZIP_METRIC_LIST];
+    const SevenZipOpMetrics* read = &after.ops[SEVENZIP_METRIC_READ];
+    TEST_ASSERT(create->count == before.ops[SEVENZIP_METRIC_CREATE].count + 1, "One create");
+    TEST_ASSERT(create->bytes_in - before.ops[SEVENZIP_METRIC_CREATE].bytes_in == input_bytes,
+                "Create read the inputs");
+    TEST_ASSERT(create->bytes_out - before.ops[SEVENZIP_METRIC_CREATE].bytes_out == (uint64_t)st.st_size,
+                "Create wrote the archive");
+    TEST_ASSERT(extract->count == before.ops[SEVENZIP_METRIC_EXTRACT].count + 2, "Two extracts, one a job");
+    TEST_ASSERT(extract->bytes_out - before.ops[SEVENZIP_METRIC_EXTRACT].bytes_out == 2 * input_bytes,
+                "Extracts wrote the files");
+    TEST_ASSERT(extract->bytes_in > before.ops[SEVENZIP_METRIC_EXTRACT].bytes_in &&
+                extract->bytes_in - before.ops[SEVENZIP_METRIC_EXTRACT].bytes_in < 2 * (uint64_t)st.st_size,
+                "Extracts decoded the packed data");
+    TEST_ASSERT(test->count == before.ops[SEVENZIP_METRIC_TEST].count + 1 &&
+                test->bytes_out - before.ops[SEVENZIP_METRIC_TEST].bytes_out == input_bytes, "One test");
+    TEST_ASSERT(listed->count == before.ops[SEVENZIP_METRIC_LIST].count + 2, "Lists of exited threads kept");
+    TEST_ASSERT(listed->errors == before.ops[SEVENZIP_METRIC_LIST].errors + 1, "Failed list counted");
+    TEST_ASSERT(read->count == before.ops[SEVENZIP_METRIC_READ].count + 2 && read_bytes == 2 * file_size &&
+                read->bytes_out - before.ops[SEVENZIP_METRIC_READ].bytes_out == read_bytes, "Two reads");
+    const SevenZipCacheMetrics* folders = &after.caches[SEVENZIP_METRIC_CACHE_FOLDER];
+    TEST_ASSERT(folders->hits > before.caches[SEVENZIP_METRIC_CACHE_FOLDER].hits &&
+                folders->misses > before.caches[SEVENZIP_METRIC_CACHE_FOLDER].misses, "Folder cache miss, then hit");
+
+    /* Buckets are cumulative and end at +Inf with every operation */
+    TEST_ASSERT(after.latency_bounds[0] == 0.001 && isinf(after.latency_bounds[SEVENZIP_METRICS_BUCKETS - 1]),
+                "Bucket bounds");
+    for (int op = 0; op < SEVENZIP_METRIC_OP_COUNT; op++) {
+        const SevenZipOpMetrics* m = &after.ops[op];
+        for (int b = 1; b < SEVENZIP_METRICS_BUCKETS; b++) {
+            TEST_ASSERT(m->latency_buckets[b] >= m->latency_buckets[b - 1], "Buckets grow");
+        }
+        TEST_ASSERT(m->latency_buckets[SEVENZIP_METRICS_BUCKETS - 1] == m->count, "Last bucket holds all");
+    }
+    TEST_ASSERT(extract->latency_seconds > before.ops[SEVENZIP_METRIC_EXTRACT].latency_seconds, "Latency summed");
+    TEST_ASSERT(after.jobs_active == 0 && after.jobs_queued == 0 && after.threads_busy == 0,
+                "Nothing running");
+
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    unlink(archive_path);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Volumes arriving one at a time, each in a few pieces */
+typedef struct {
+    const char* staged;     /* Base of the complete volumes */
+    const char* target;     /* Base they are copied to */
+    int volumes;
+    int with_index;         /* Copy the index first, and volume 3 before volume 2 */
+} VolumeArrival;
+
+static void* arrive_volumes(void* arg) {
+    VolumeArrival* a = (VolumeArrival*)arg;
+    char from[512];
+    char to[512];
+    if (a->with_index) {
+        snprintf(from, sizeof(from), "%s.7zidx", a->staged);
+        snprintf(to, sizeof(to), "%s.7zidx", a->target);
+        rename(from, to);
+    }
+    for (int v = 0; v < a->volumes; v++) {
+        int number = a->with_index && v == 1 ? 3 : a->with_index && v == 2 ? 2 : v + 1;
+        snprintf(from, sizeof(from), "%s.%03d", a->staged, number);
+        snprintf(to, sizeof(to), "%s.%03d", a->target, number);
+        FILE* in = fopen(from, "rb");
+        FILE* out = fopen(to, "wb");
+        if (!in || !out) {
+            if (in) fclose(in);
+            if (out) fclose(out);
+            return NULL;
+        }
+        char buf[24 * 1024];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            fwrite(buf, 1, n, out);
+            fflush(out);
+            usleep(20000);
+        }
+        fclose(in);
+        fclose(out);
+    }
+    return NULL;
+}
+
+typedef struct {
+    const char* last_volume;
+    int calls;
+    int before_last;        /* Entries finished before the last volume existed */
+} FollowProgress;
+
+static void follow_progress(uint64_t completed, uint64_t total, void* user_data) {
+    FollowProgress* p = (FollowProgress*)user_data;
+    (void)completed; (void)total;
+    p->calls++;
+    if (access(p->last_volume, F_OK) != 0) p->before_last++;
+}
+
+/* Test: A split streamable archive extracts while its volumes arrive */
+static int test_extract_following() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_follow_input";
+    const char* staged = "/tmp/test_follow_staged.7z";
+    const char* target = "/tmp/test_follow.7z";
+    const char* output_dir = "/tmp/test_follow_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+
+    char path[512];
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < 6; i++) {
+        snprintf(path, sizeof(path), "%s/f%d.txt", input_dir, i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input file");
+        for (int c = 0; c < 48 * 1024; c++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            fputc((int)(x & 0x0F) + 'a', f);
+        }
+        fclose(f);
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        const char* inputs[] = {input_dir, NULL};
+        SevenZipStreamOptions stream_options;
+        sevenzip_stream_options_init(&stream_options);
+        stream_options.split_size = 32 * 1024;
+        stream_options.solid_block_files = 1;
+        stream_options.streamable = 1;
+        stream_options.streamable_reserve = 8192;
+        stream_options.write_index = pass;
+        SevenZipErrorCode result = sevenzip_create_7z_streaming(staged, inputs, SEVENZIP_LEVEL_FASTEST,
+                                                                &stream_options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create streamable split archive");
+        int volumes = 0;
+        for (;;) {
+            snprintf(path, sizeof(path), "%s.%03d", staged, volumes + 1);
+            if (access(path, F_OK) != 0) break;
+            volumes++;
+        }
+        TEST_ASSERT(volumes > 3, "Several volumes");
+
+        for (int i = 1; i <= volumes; i++) {
+            snprintf(path, sizeof(path), "%s.%03d", target, i);
+            unlink(path);
+        }
+        char last_volume[512];
+        snprintf(last_volume, sizeof(last_volume), "%s.%03d", target, volumes);
+        VolumeArrival arrival = {staged, target, volumes, pass};
+        FollowProgress progress = {last_volume, 0, 0};
+        pthread_t thread;
+        TEST_ASSERT(pthread_create(&thread, NULL, arrive_volumes, &arrival) == 0, "Start arrivals");
+
+        SevenZipExtractOptions options;
+        sevenzip_extract_options_init(&options);
+        options.progress_interval_ms = -1;
+        options.follow_timeout_ms = 10000;
+        result = sevenzip_extract_following(target, output_dir, &options, follow_progress, &progress);
+        pthread_join(thread, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extraction following the volumes succeeds");
+        TEST_ASSERT(progress.calls == 7 && progress.before_last > 0, "Entries written before the last volume");
+
+        for (int i = 0; i < 6; i++) {
+            char source[512];
+            snprintf(source, sizeof(source), "%s/f%d.txt", input_dir, i);
+            snprintf(path, sizeof(path), "%s/test_follow_input/f%d.txt", output_dir, i);
+            char* expected = read_file_content(source);
+            char* extracted = read_file_content(path);
+            TEST_ASSERT(expected && extracted && strcmp(expected, extracted) == 0, "File matches");
+            free(expected);
+            free(extracted);
+        }
+
+        for (int i = 1; i <= volumes; i++) {
+            snprintf(path, sizeof(path), "%s.%03d", staged, i);
+            unlink(path);
+            if (i > 1) {
+                snprintf(path, sizeof(path), "%s.%03d", target, i);
+                unlink(path);
+            }
+        }
+        snprintf(path, sizeof(path), "%s.7zidx", target);
+        unlink(path);
+        remove_dir_recursive(output_dir);
+    }
+
+    /* Volumes that stop arriving fail the wait, as does a cancelled job */
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.follow_timeout_ms = 200;
+    SevenZipErrorCode result = sevenzip_extract_following(target, output_dir, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_OPEN_FILE, result, "Missing volume times out");
+    SevenZipCancelToken* cancel = sevenzip_cancel_token_create();
+    TEST_ASSERT(cancel != NULL, "Create token");
+    sevenzip_cancel_token_cancel(cancel);
+    options.follow_timeout_ms = 0;
+    options.cancel = cancel;
+    result = sevenzip_extract_following(target, output_dir, &options, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_CANCELLED, result, "Cancelled wait");
+    sevenzip_cancel_token_free(cancel);
+
+    snprintf(path, sizeof(path), "%s.001", target);
+    unlink(path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Include and exclude patterns select the entries extracted */
+static int test_extract_patterns() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_patterns_input";
+    const char* archive_path = "/tmp/test_patterns.7z";
+    const char* output_dir = "/tmp/test_patterns_output";
+    const char* names[] = {"logs/a/x.json", "logs/a/y.txt", "logs/b.json", "src/main.c",
+                           "src/lib/util.c", "build/obj/a.o", "README"};
+    const int count = (int)(sizeof(names) / sizeof(names[0]));
+    remove_dir_recursive(input_dir);
+    char path[512];
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "mkdir -p \"$(dirname %s/%s)\"", input_dir, names[i]);
+        TEST_ASSERT(system(path) == 0, "Create input directory");
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input file");
+        for (int line = 0; line < 100; line++) fprintf(f, "%s line %d\n", names[i], line);
+        fclose(f);
+    }
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.solid_block_files = 2;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                                 &stream_options, NULL, NULL),
+                       "Create archive");
+
+    const char* json[] = {"test_patterns_input/logs/**/*.json", NULL};
+    const char* sources[] = {"test_patterns_input/src", "test_patterns_input/READM?", NULL};
+    const char* no_lib[] = {"test_patterns_input/src/lib/", NULL};
+    const char* no_objects[] = {"**/*.o", "*/[l]ogs/?/*", NULL};
+    struct {
+        const char** include;
+        const char** exclude;
+        const char* wanted;   /* Per name: '1' extracted */
+    } cases[] = {
+        {json, NULL, "1010000"},
+        {sources, no_lib, "0001001"},
+        {NULL, no_objects, "0011101"},
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        SevenZipExtractOptions options;
+        sevenzip_extract_options_init(&options);
+        options.include_patterns = cases[c].include;
+        options.exclude_patterns = cases[c].exclude;
+        remove_dir_recursive(output_dir);
+        SevenZipErrorCode result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options,
+                                                                 NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract with patterns");
+        for (int i = 0; i < count; i++) {
+            snprintf(path, sizeof(path), "%s/test_patterns_input/%s", output_dir, names[i]);
+            TEST_ASSERT(file_exists(path) == (cases[c].wanted[i] == '1'), "Entry selected by the patterns");
+        }
+    }
+
+    /* Patterns that cannot be compiled fail before anything is written */
+    const char* unclosed[] = {"src/[ab", NULL};
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    options.include_patterns = unclosed;
+    remove_dir_recursive(output_dir);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_INVALID_PARAM,
+                       sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL),
+                       "Unclosed class rejected");
+    TEST_ASSERT(!dir_exists(output_dir), "Nothing written");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Files opened relative to cached directories, past the descriptor limit too, and directory times restored */
+static int test_extract_directory_metadata() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_dirmeta_input";
+    const char* archive_path = "/tmp/test_dirmeta.7z";
+    const char* output_dir = "/tmp/test_dirmeta_output";
+    const int wide = 300;  /* More directories than the cache keeps open */
+    const int depth = 16;
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+
+    char path[1024];
+    for (int d = 0; d < wide; d++) {
+        snprintf(path, sizeof(path), "%s/d%03d", input_dir, d);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/d%03d/file.txt", input_dir, d);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create wide file");
+        fputs("wide\n", f);
+        fclose(f);
+    }
+    int len = snprintf(path, sizeof(path), "%s/deep", input_dir);
+    mkdir(path, 0755);
+    for (int level = 0; level < depth; level++) {
+        len += snprintf(path + len, sizeof(path) - len, "/l%d", level);
+        mkdir(path, 0755);
+    }
+    snprintf(path + len, sizeof(path) - len, "/leaf.txt");
+    FILE* f = fopen(path, "w");
+    TEST_ASSERT(f != NULL, "Create deep file");
+    fputs("deep\n", f);
+    fclose(f);
+
+    /* Times set once nothing more is made in the directories */
+    for (int d = 0; d < wide; d++) {
+        snprintf(path, sizeof(path), "%s/d%03d", input_dir, d);
+        struct utimbuf times = {1400000000, 1400000000 + d * 60};
+        utime(path, &times);
+    }
+    len = snprintf(path, sizeof(path), "%s/deep", input_dir);
+    for (int level = 0; level < depth; level++) {
+        len += snprintf(path + len, sizeof(path) - len, "/l%d", level);
+        struct utimbuf times = {1400000000, 1450000000 + level};
+        utime(path, &times);
+    }
+
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipErrorCode result = sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FASTEST,
+                                                            NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Create archive");
+
+    SevenZipExtractOptions options;
+    sevenzip_extract_options_init(&options);
+    for (int atomic = 0; atomic <= 1; atomic++) {
+        options.durability = atomic ? SEVENZIP_DURABILITY_ATOMIC : SEVENZIP_DURABILITY_NONE;
+        remove_dir_recursive(output_dir);
+        result = sevenzip_extract_with_options(archive_path, output_dir, NULL, &options, NULL, NULL);
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract tree");
+
+        struct stat st;
+        for (int d = 0; d < wide; d++) {
+            snprintf(path, sizeof(path), "%s/test_dirmeta_input/d%03d", output_dir, d);
+            TEST_ASSERT(stat(path, &st) == 0 && S_ISDIR(st.st_mode), "Wide directory");
+            TEST_ASSERT(st.st_mtime == 1400000000 + d * 60, "Wide directory time restored");
+            snprintf(path, sizeof(path), "%s/test_dirmeta_input/d%03d/file.txt", output_dir, d);
+            char* content = read_file_content(path);
+            TEST_ASSERT(content && strcmp(content, "wide\n") == 0, "Wide file");
+            free(content);
+        }
+        len = snprintf(path, sizeof(path), "%s/test_dirmeta_input/deep", output_dir);
+        for (int level = 0; level < depth; level++) {
+            len += snprintf(path + len, sizeof(path) - len, "/l%d", level);
+            TEST_ASSERT(stat(path, &st) == 0 && st.st_mtime == 1450000000 + level,
+                        "Deep directory time restored");
+        }
+        snprintf(path + len, sizeof(path) - len, "/leaf.txt");
+        char* content = read_file_content(path);
+        TEST_ASSERT(content && strcmp(content, "deep\n") == 0, "Deep file");
+        free(content);
+    }
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Allocator counting the blocks of the pool's size and up */
+static volatile long g_large_allocations = 0;
+
+static void* counting_alloc(void* opaque, size_t size) {
+    (void)opaque;
+    if (size >= 64 * 1024) __sync_fetch_and_add(&g_large_allocations, 1);
+    return malloc(size);
+}
+
+static void counting_free(void* opaque, void* address) {
+    (void)opaque;
+    free(address);
+}
+
+/* Test: Archives decoded again take their dictionaries and buffers from the pool */
+static int test_decoder_pool() {
+    sevenzip_init();
+
+    const char* input_dir = "/tmp/test_pool_input";
+    const char* archive_path = "/tmp/test_pool.7z";
+    const char* output_dir = "/tmp/test_pool_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+    char path[512];
+    /* Files above the writers' buffering limit, each its own folder and dictionary */
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/part_%d.txt", input_dir, i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 100000; line++) fprintf(f, "part %d line %d %d\n", i, line, line * i);
+        fclose(f);
+    }
+    const char* inputs[] = {input_dir, NULL};
+    SevenZipStreamOptions stream_options;
+    sevenzip_stream_options_init(&stream_options);
+    stream_options.solid_block_files = 1;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_create_7z_streaming(archive_path, inputs, SEVENZIP_LEVEL_FAST,
+                                                                 &stream_options, NULL, NULL),
+                       "Create archive");
+
+    SevenZipAllocator allocator = {counting_alloc, counting_free, NULL};
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_set_allocator(&allocator), "Set allocator");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL),
+                       "First extraction");
+    long first = g_large_allocations;
+    TEST_ASSERT(first > 0, "First extraction allocates its dictionaries");
+    for (int run = 0; run < 3; run++) {
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL),
+                           "Extraction from the pool");
+    }
+    TEST_ASSERT(g_large_allocations == first, "No large allocation once the pool is warm");
+
+    /* Without a pool every run allocates them again */
+    SevenZipInitOptions init;
+    memset(&init, 0, sizeof(init));
+    init.decoder_pool_bytes = -1;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(&init), "Turn the pool off");
+    long before = g_large_allocations;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_extract(archive_path, output_dir, NULL, NULL, NULL),
+                       "Extraction without a pool");
+    TEST_ASSERT(g_large_allocations > before, "Allocates without a pool");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_init_with_options(NULL), "Default pool");
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_set_allocator(NULL), "Reset allocator");
+
+    snprintf(path, sizeof(path), "%s/test_pool_input/part_2.txt", output_dir);
+    char* content = read_file_content(path);
+    TEST_ASSERT(content && strncmp(content, "part 2 line 0 0\n", 16) == 0, "Extracted content");
+    free(content);
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Selected files only; a name matching no entry fails the call but not the others */
+static int test_extract_files() {
+    sevenzip_init();
+    const char* input_dir = "/tmp/test_select_input";
+    const char* archive_path = "/tmp/test_select.7z";
+    const char* output_dir = "/tmp/test_select_output";
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    mkdir(input_dir, 0755);
+    const char* names[] = {"a.txt", "b.txt", "c.txt"};
+    char path[512];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 2000; line++) fprintf(f, "%s line %d\n", names[i], line);
+        fclose(f);
+    }
+    const char* inputs[] = {input_dir, NULL};
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_create_7z(archive_path, inputs, SEVENZIP_LEVEL_FAST, NULL, NULL, NULL),
+                       "Create archive");
+
+    /* Out of archive order: each is still written once, with its own data */
+    const char* wanted[] = {"c.txt", "a.txt", NULL};
+    SevenZipErrorCode result = sevenzip_extract_files(archive_path, output_dir, wanted, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract two files");
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", output_dir, names[i]);
+        char* actual = read_file_content(path);
+        snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+        char* expected = read_file_content(path);
+        int present = actual != NULL;
+        int same = actual && expected && strcmp(actual, expected) == 0;
+        free(actual);
+        free(expected);
+        if (i == 1) TEST_ASSERT(!present, "b.txt not selected");
+        else TEST_ASSERT(same, "Selected file matches its input");
+    }
+
+    const char* missing[] = {"b.txt", "missing.txt", NULL};
+    result = sevenzip_extract_files(archive_path, output_dir, missing, NULL, NULL, NULL);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_EXTRACT, result, "A name matching no entry");
+    snprintf(path, sizeof(path), "%s/b.txt", output_dir);
+    TEST_ASSERT(file_exists(path), "The other name still extracted");
+    snprintf(path, sizeof(path), "%s/missing.txt", output_dir);
+    TEST_ASSERT(!file_exists(path), "Nothing written for the missing name");
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    remove_dir_recursive(output_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Sink receiving entries: each one's bytes are checked against its input */
+typedef struct {
+    const char* input_dir;
+    char name[256];
+    char* data;
+    size_t size;
+    int begun;
+    int ended;
+    int matched;
+    int stop_in_write;
+} SinkState;
+
+static int sink_begin(uint32_t entry_index, const char* name, uint64_t size, void* user_data) {
+    (void)entry_index;
+    SinkState* s = (SinkState*)user_data;
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    free(s->data);
+    s->data = (char*)malloc((size_t)size + 1);
+    s->size = 0;
+    s->begun++;
+    return s->data ? 0 : 1;
+}
+
+static int sink_write(uint32_t entry_index, const void* data, size_t size, void* user_data) {
+    (void)entry_index;
+    SinkState* s = (SinkState*)user_data;
+    if (s->stop_in_write) return 1;
+    memcpy(s->data + s->size, data, size);
+    s->size += size;
+    return 0;
+}
+
+static int sink_end(uint32_t entry_index, void* user_data) {
+    (void)entry_index;
+    SinkState* s = (SinkState*)user_data;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", s->input_dir, s->name);
+    char* expected = read_file_content(path);
+    s->data[s->size] = '\0';
+    s->matched += expected && strcmp(expected, s->data) == 0;
+    free(expected);
+    s->ended++;
+    return 0;
+}
+
+static int test_extract_to_sink() {
+    sevenzip_init();
+    const char* input_dir = "/tmp/test_sink_input";
+    const char* archive_path = "/tmp/test_sink.7z";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    char path[512];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/file%d.txt", input_dir, i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line < 3000 * (i + 1); line++) fprintf(f, "sink file %d line %d\n", i, line);
+        fclose(f);
+    }
+    const char* inputs[] = {input_dir, NULL};
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_create_7z(archive_path, inputs, SEVENZIP_LEVEL_FAST, NULL, NULL, NULL),
+                       "Create archive");
+
+    SinkState state;
+    memset(&state, 0, sizeof(state));
+    state.input_dir = input_dir;
+    SevenZipExtractSink sink = {sink_begin, sink_write, sink_end, &state};
+    SevenZipErrorCode result = sevenzip_extract_to_sink(archive_path, NULL, NULL, &sink);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract every entry to the sink");
+    TEST_ASSERT_EQUALS(3, state.begun, "Every file begun");
+    TEST_ASSERT_EQUALS(3, state.ended, "Every file ended");
+    TEST_ASSERT_EQUALS(3, state.matched, "Every file's bytes match");
+    free(state.data);
+
+    const char* one[] = {"file1.txt", NULL};
+    memset(&state, 0, sizeof(state));
+    state.input_dir = input_dir;
+    result = sevenzip_extract_to_sink(archive_path, one, NULL, &sink);
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, result, "Extract one entry to the sink");
+    TEST_ASSERT(state.begun == 1 && state.matched == 1, "Only the named file");
+    free(state.data);
+
+    /* A callback returning nonzero stops the extraction */
+    memset(&state, 0, sizeof(state));
+    state.input_dir = input_dir;
+    state.stop_in_write = 1;
+    result = sevenzip_extract_to_sink(archive_path, NULL, NULL, &sink);
+    TEST_ASSERT_EQUALS(SEVENZIP_ERROR_EXTRACT, result, "Stopped by the sink");
+    TEST_ASSERT_EQUALS(1, state.begun, "Nothing begun after the stop");
+    TEST_ASSERT_EQUALS(0, state.ended, "No entry ended");
+    free(state.data);
+
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+/* Test: Pages of sevenzip_archive_list_page() join up to sevenzip_list() */
+static int test_archive_list_pages() {
+    sevenzip_init();
+    const char* input_dir = "/tmp/test_pages_input";
+    const char* archive_path = "/tmp/test_pages.7z";
+    remove_dir_recursive(input_dir);
+    mkdir(input_dir, 0755);
+    for (int i = 0; i < 23; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/page_%02d.txt", input_dir, i);
+        FILE* f = fopen(path, "w");
+        TEST_ASSERT(f != NULL, "Create input");
+        for (int line = 0; line <= i * 10; line++) fprintf(f, "page %d line %d\n", i, line);
+        fclose(f);
+    }
+    const char* inputs[] = {input_dir, NULL};
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_create_7z(archive_path, inputs, SEVENZIP_LEVEL_FAST, NULL, NULL, NULL),
+                       "Create archive");
+
+    SevenZipList* full = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_list(archive_path, NULL, &full), "List by path");
+    SevenZipArchive* archive = NULL;
+    TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_open(archive_path, NULL, &archive), "Open archive");
+    uint32_t count = sevenzip_archive_entry_count(archive);
+    TEST_ASSERT(count == full->count && count == 23, "Entry count matches the list");
+    TEST_ASSERT(sevenzip_archive_entry_count(NULL) == 0, "No archive, no entries");
+
+    /* Pages of five: four full ones and a last one of three */
+    const uint32_t page_size = 5;
+    size_t joined = 0;
+    int pages = 0;
+    for (uint32_t first = 0;; first += page_size) {
+        SevenZipList* page = NULL;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_list_page(archive, first, page_size, &page), "List page");
+        pages++;
+        for (size_t k = 0; k < page->count; k++) {
+            const SevenZipEntry* a = &page->entries[k];
+            const SevenZipEntry* b = &full->entries[joined + k];
+            TEST_ASSERT(joined + k < full->count, "No more entries than the list");
+            TEST_ASSERT(strcmp(a->name, b->name) == 0, "Same name in place");
+            TEST_ASSERT(a->size == b->size && a->packed_size == b->packed_size, "Same sizes");
+            TEST_ASSERT(a->modified_time == b->modified_time && a->attributes == b->attributes &&
+                        a->is_directory == b->is_directory, "Same metadata");
+        }
+        joined += page->count;
+        size_t got = page->count;
+        sevenzip_free_list(page);
+        if (got < page_size) {
+            TEST_ASSERT(got == count % page_size, "Last page partial");
+            break;
+        }
+    }
+    TEST_ASSERT(pages == 5 && joined == full->count, "Pages join up to the list");
+
+    /* At and past the end: empty pages */
+    uint32_t starts[] = {count, count + 100};
+    for (int i = 0; i < 2; i++) {
+        SevenZipList* page = NULL;
+        TEST_ASSERT_EQUALS(SEVENZIP_OK, sevenzip_archive_list_page(archive, starts[i], page_size, &page),
+                           "List past the end");
+        TEST_ASSERT(page->count == 0, "Empty page");
+        sevenzip_free_list(page);
+    }
+
+    sevenzip_close(archive);
+    sevenzip_free_list(full);
+    unlink(archive_path);
+    remove_dir_recursive(input_dir);
+    sevenzip_cleanup();
+    return 1;
+}
+
+int main(void) {
     printf("===========================================\n");
     printf("7z FFI SDK - Extraction Unit Tests\n");
     printf("===========================================\n\n");
@@ -307,6 +3614,41 @@ int main(int argc, char** argv) {
     RUN_TEST(test_list_archive);
     RUN_TEST(test_list_invalid_params);
     RUN_TEST(test_extract_and_verify);
+    RUN_TEST(test_true_streaming_round_trip);
+    RUN_TEST(test_small_file_batches);
+    RUN_TEST(test_split_volume_readahead);
+    RUN_TEST(test_entry_reader);
+    RUN_TEST(test_shared_archive_handle);
+    RUN_TEST(test_archive_extract_entries);
+    RUN_TEST(test_crc_checked_behind_decoder);
+    RUN_TEST(test_extract_truncated_while_mapped);
+    RUN_TEST(test_extract_skip_existing);
+    RUN_TEST(test_extract_stored_range_copy);
+    RUN_TEST(test_archive_vfs);
+    RUN_TEST(test_extract_memory_limit);
+    RUN_TEST(test_extract_cache_neutral);
+    RUN_TEST(test_extract_durability);
+    RUN_TEST(test_list_columns);
+    RUN_TEST(test_list_header_in_place);
+    RUN_TEST(test_open_range);
+    RUN_TEST(test_extract_from_stream);
+    RUN_TEST(test_archive_batch);
+    RUN_TEST(test_catalog_lookup);
+    RUN_TEST(test_extract_encrypted);
+    RUN_TEST(test_extract_consume_volumes);
+    RUN_TEST(test_extract_resume_checkpoint);
+    RUN_TEST(test_export_tar);
+    RUN_TEST(test_transcode_archive);
+    RUN_TEST(test_remux_to_xz);
+    RUN_TEST(test_archive_service);
+    RUN_TEST(test_metrics_snapshot);
+    RUN_TEST(test_extract_following);
+    RUN_TEST(test_extract_patterns);
+    RUN_TEST(test_extract_directory_metadata);
+    RUN_TEST(test_decoder_pool);
+    RUN_TEST(test_extract_files);
+    RUN_TEST(test_extract_to_sink);
+    RUN_TEST(test_archive_list_pages);
     
     /* Print summary */
     printf("\n===========================================\n");